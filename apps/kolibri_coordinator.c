@@ -1,5 +1,10 @@
 /*
  * Kolibri Coordinator: collects best formulas from nodes and rebroadcasts.
+ *
+ * With --upstream the coordinators form a tree: each keeps the top-k formulas
+ * of its subtree and forwards them to its parent, which relays the best it
+ * knows back down. A round then costs a coordinator its own children plus k
+ * upstream sends, however many nodes sit below it.
  */
 
 #include "kolibri/formula.h"
@@ -47,6 +52,77 @@ static void targets_push(TargetList *list, const char *host, uint16_t port) {
   t->port = port;
 }
 
+/* Splits HOST:PORT; a bare port means localhost. */
+static void parse_endpoint(const char *arg, char host[64], uint16_t *port) {
+  const char *colon = strchr(arg, ':');
+  if (colon) {
+    size_t host_len = (size_t)(colon - arg);
+    if (host_len >= 64U) host_len = 63U;
+    memcpy(host, arg, host_len);
+    host[host_len] = '\0';
+    *port = (uint16_t)strtoul(colon + 1, NULL, 10);
+  } else {
+    strcpy(host, "127.0.0.1");
+    *port = (uint16_t)strtoul(arg, NULL, 10);
+  }
+}
+
+#define TOP_K_MAX 32U
+
+typedef struct {
+  KolibriFormula formula;
+  int forwarded;
+} Candidate;
+
+/* Best distinct genes of the subtree, ranked by fitness. */
+typedef struct {
+  Candidate items[TOP_K_MAX];
+  size_t count;
+  size_t limit;
+} TopFormulas;
+
+/*
+ * A gene stays marked as forwarded until its fitness improves, so formulas
+ * the parent relays back down are echoed upstream at most once.
+ */
+static void top_offer(TopFormulas *top, const KolibriFormula *formula) {
+  size_t pos = top->count;
+  for (size_t i = 0; i < top->count; ++i) {
+    const KolibriGene *gene = &top->items[i].formula.gene;
+    if (gene->length == formula->gene.length &&
+        memcmp(gene->digits, formula->gene.digits, gene->length) == 0) {
+      if (formula->fitness <= top->items[i].formula.fitness) {
+        return;
+      }
+      pos = i;
+      break;
+    }
+  }
+  if (pos == top->count) {
+    if (top->count < top->limit) {
+      top->count++;
+    } else if (top->count > 0 && formula->fitness > top->items[top->count - 1U].formula.fitness) {
+      pos = top->count - 1U;
+    } else {
+      return;
+    }
+  }
+  while (pos > 0 && top->items[pos - 1U].formula.fitness < formula->fitness) {
+    top->items[pos] = top->items[pos - 1U];
+    pos--;
+  }
+  top->items[pos].formula = *formula;
+  top->items[pos].forwarded = 0;
+}
+
+static void top_forward(TopFormulas *top, KolibriNetPeers *upstream) {
+  for (size_t i = 0; i < top->count; ++i) {
+    if (!top->items[i].forwarded && kn_peers_send_formula(upstream, 0U, &top->items[i].formula) == 0) {
+      top->items[i].forwarded = 1;
+    }
+  }
+}
+
 static volatile sig_atomic_t running = 1;
 
 static void handle_sig(int sig) {
@@ -54,6 +130,30 @@ static void handle_sig(int sig) {
   running = 0;
 }
 
+/* Writes next to the target and renames, so a scraper never sees half a file. */
+static void write_stats(const KolibriNetPeers *peers, const char *path, int prometheus) {
+  size_t capacity = 1024U + peers->count * 1024U;
+  char *buffer = (char *)malloc(capacity);
+  if (!buffer) {
+    return;
+  }
+  int len = prometheus ? kn_peers_stats_prometheus(peers, buffer, capacity)
+                       : kn_peers_stats_json(peers, buffer, capacity);
+  char tmp_path[4096];
+  if (len >= 0 && snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) < (int)sizeof(tmp_path)) {
+    FILE *out = fopen(tmp_path, "w");
+    if (out) {
+      int ok = fwrite(buffer, 1U, (size_t)len, out) == (size_t)len;
+      ok = fclose(out) == 0 && ok;
+      if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "[coord] failed to write stats to %s: %s\n", path, strerror(errno));
+        remove(tmp_path);
+      }
+    }
+  }
+  free(buffer);
+}
+
 static uint64_t now_ms(void) {
 #if defined(CLOCK_MONOTONIC)
   struct timespec ts;
@@ -74,6 +174,11 @@ int main(int argc, char **argv) {
   /* Defaults: localhost base-port/count via flags */
   uint16_t base_port = 0U;
   int count = 0;
+  const char *stats_path = NULL;
+  int stats_prometheus = 0;
+  char upstream_host[64] = "";
+  uint16_t upstream_port = 0U;
+  size_t top_k = 4U;
 
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
@@ -81,19 +186,19 @@ int main(int argc, char **argv) {
       continue;
     }
     if (strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
-      const char *arg = argv[++i];
-      const char *colon = strchr(arg, ':');
-      if (colon) {
-        char host[64];
-        size_t host_len = (size_t)(colon - arg);
-        if (host_len >= sizeof(host)) host_len = sizeof(host) - 1U;
-        memcpy(host, arg, host_len);
-        host[host_len] = '\0';
-        uint16_t port = (uint16_t)strtoul(colon + 1, NULL, 10);
-        targets_push(&targets, host, port);
-      } else {
-        targets_push(&targets, "127.0.0.1", (uint16_t)strtoul(arg, NULL, 10));
-      }
+      char host[64];
+      uint16_t port;
+      parse_endpoint(argv[++i], host, &port);
+      targets_push(&targets, host, port);
+      continue;
+    }
+    if (strcmp(argv[i], "--upstream") == 0 && i + 1 < argc) {
+      parse_endpoint(argv[++i], upstream_host, &upstream_port);
+      continue;
+    }
+    if (strcmp(argv[i], "--top-k") == 0 && i + 1 < argc) {
+      long k = strtol(argv[++i], NULL, 10);
+      top_k = k < 1 ? 1U : (k > (long)TOP_K_MAX ? TOP_K_MAX : (size_t)k);
       continue;
     }
     if (strcmp(argv[i], "--base-port") == 0 && i + 1 < argc) {
@@ -104,8 +209,26 @@ int main(int argc, char **argv) {
       count = atoi(argv[++i]);
       continue;
     }
+    if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+      stats_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--stats-format") == 0 && i + 1 < argc) {
+      const char *format = argv[++i];
+      if (strcmp(format, "prometheus") == 0) {
+        stats_prometheus = 1;
+      } else if (strcmp(format, "json") == 0) {
+        stats_prometheus = 0;
+      } else {
+        fprintf(stderr, "[coord] unknown stats format %s\n", format);
+        return 1;
+      }
+      continue;
+    }
     if (strcmp(argv[i], "--help") == 0) {
-      printf("Usage: %s [--listen PORT] [--node HOST:PORT]... [--base-port P --count N]\n", argv[0]);
+      printf("Usage: %s [--listen PORT] [--node HOST:PORT]... [--base-port P --count N]\n"
+             "          [--upstream HOST:PORT [--top-k K]]\n"
+             "          [--stats PATH [--stats-format json|prometheus]]\n", argv[0]);
       return 0;
     }
   }
@@ -127,6 +250,22 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  KolibriNetPeers peers;
+  kn_peers_init(&peers, 0U);
+  for (size_t i = 0; i < targets.count; ++i) {
+    kn_peers_add(&peers, targets.items[i].host, targets.items[i].port);
+  }
+
+  KolibriNetPeers upstream;
+  kn_peers_init(&upstream, 0U);
+  if (upstream_host[0] != '\0' && kn_peers_add(&upstream, upstream_host, upstream_port) < 0) {
+    fprintf(stderr, "[coord] bad upstream %s\n", upstream_host);
+    return 1;
+  }
+  TopFormulas top;
+  memset(&top, 0, sizeof(top));
+  top.limit = top_k;
+
   signal(SIGINT, handle_sig);
   signal(SIGTERM, handle_sig);
 
@@ -137,22 +276,29 @@ int main(int argc, char **argv) {
   const uint32_t interval_ms = 2000U;
 
   printf("[coord] listening on %u; targets=%zu\n", listen_port, targets.count);
+  if (upstream.count > 0) {
+    printf("[coord] forwarding top-%zu to %s:%u\n", top.limit, upstream_host, upstream_port);
+  }
 
   while (running) {
-    KolibriNetMessage msg;
-    int rc = kn_listener_poll(&listener, 200U, &msg);
-    if (rc > 0) {
-      if (msg.type == KOLIBRI_MSG_MIGRATE_RULE) {
+    KolibriNetMessage batch[64];
+    size_t received = kn_listener_poll_many(&listener, 200U, batch, sizeof(batch) / sizeof(batch[0]));
+    for (size_t m = 0; m < received; ++m) {
+      const KolibriNetMessage *msg = &batch[m];
+      if (msg->type == KOLIBRI_MSG_MIGRATE_RULE) {
         KolibriFormula incoming;
         memset(&incoming, 0, sizeof(incoming));
-        incoming.gene.length = msg.data.formula.length;
+        incoming.gene.length = msg->data.formula.length;
         if (incoming.gene.length > sizeof(incoming.gene.digits)) {
           incoming.gene.length = sizeof(incoming.gene.digits);
         }
-        memcpy(incoming.gene.digits, msg.data.formula.digits, incoming.gene.length);
-        incoming.fitness = msg.data.formula.fitness;
+        memcpy(incoming.gene.digits, msg->data.formula.digits, incoming.gene.length);
+        incoming.fitness = msg->data.formula.fitness;
         incoming.feedback = 0.0;
 
+        if (upstream.count > 0) {
+          top_offer(&top, &incoming);
+        }
         if (incoming.fitness > best_fitness) {
           best = incoming;
           best_fitness = incoming.fitness;
@@ -163,15 +309,24 @@ int main(int argc, char **argv) {
 
     uint64_t now = now_ms();
     if (best_fitness > -1e8 && (now - last_broadcast) >= interval_ms) {
-      for (size_t i = 0; i < targets.count; ++i) {
-        if (kn_share_formula(targets.items[i].host, targets.items[i].port, 0U, &best) == 0) {
-          /* ok */
-        }
+      size_t delivered = kn_peers_broadcast_formula(&peers, &best);
+      uint64_t round_ms = now_ms() - now;
+      if (delivered < peers.count) {
+        printf("[coord] round: %zu/%zu targets in %llu ms\n", delivered, peers.count,
+               (unsigned long long)round_ms);
+      }
+      if (stats_path) {
+        write_stats(&peers, stats_path, stats_prometheus);
+      }
+      if (upstream.count > 0) {
+        top_forward(&top, &upstream);
       }
-      last_broadcast = now;
+      last_broadcast = now_ms();
     }
   }
 
+  kn_peers_close(&upstream);
+  kn_peers_close(&peers);
   kn_listener_close(&listener);
   printf("[coord] shutdown\n");
   return 0;
@@ -0,0 +1,150 @@
+#include "kolibri/genome.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KOLIBRI_COMPACT_KEEP_DEFAULT 2U
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  kolibri_genome segments --dir DIR (--key FILE | --key-inline KEY)\n"
+            "  kolibri_genome verify --dir DIR (--key FILE | --key-inline KEY) [--threads N]\n"
+            "  kolibri_genome compact --dir DIR (--key FILE | --key-inline KEY) [--keep N]\n");
+}
+
+typedef struct {
+    const char *dir;
+    unsigned char key[KOLIBRI_HMAC_KEY_SIZE];
+    size_t key_len;
+    unsigned long number;
+} GenomeArgs;
+
+static int load_key_from_file(const char *path, unsigned char *out, size_t *out_len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    size_t total = fread(out, 1, KOLIBRI_HMAC_KEY_SIZE, f);
+    fclose(f);
+    if (total == 0) {
+        return -1;
+    }
+    *out_len = total;
+    return 0;
+}
+
+/* number_flag names the optional numeric option of the subcommand. */
+static int parse_args(int argc, char **argv, const char *number_flag, unsigned long number_default,
+                      GenomeArgs *args) {
+    memset(args, 0, sizeof(*args));
+    args->number = number_default;
+    const char *key_path = NULL;
+    const char *key_inline = NULL;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+            args->dir = argv[++i];
+        } else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            key_path = argv[++i];
+        } else if (strcmp(argv[i], "--key-inline") == 0 && i + 1 < argc) {
+            key_inline = argv[++i];
+        } else if (number_flag && strcmp(argv[i], number_flag) == 0 && i + 1 < argc) {
+            char *end = NULL;
+            args->number = strtoul(argv[++i], &end, 10);
+            if (!end || *end != '\0') {
+                fprintf(stderr, "Invalid %s value: %s\n", number_flag, argv[i]);
+                return 1;
+            }
+        }
+    }
+    if (key_inline && key_inline[0] != '\0') {
+        size_t len = strlen(key_inline);
+        if (len > sizeof(args->key)) {
+            len = sizeof(args->key);
+        }
+        memcpy(args->key, key_inline, len);
+        args->key_len = len;
+    } else if (key_path && load_key_from_file(key_path, args->key, &args->key_len) != 0) {
+        fprintf(stderr, "Unable to read key: %s\n", key_path);
+        return 1;
+    }
+    if (!args->dir || args->key_len == 0) {
+        print_usage();
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_segments(int argc, char **argv) {
+    GenomeArgs args;
+    if (parse_args(argc, argv, NULL, 0UL, &args) != 0) {
+        return 1;
+    }
+    KolibriGenomeSegment *segments = NULL;
+    size_t count = 0;
+    if (kg_segments_load(args.dir, args.key, args.key_len, &segments, &count) != 0) {
+        fprintf(stderr, "Invalid manifest in %s\n", args.dir);
+        return 1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        printf("%llu\t%llu\t%s\n", (unsigned long long)segments[i].first_index,
+               (unsigned long long)segments[i].block_count,
+               segments[i].file[0] ? segments[i].file : "(summary)");
+    }
+    free(segments);
+    return 0;
+}
+
+static int cmd_verify(int argc, char **argv) {
+    GenomeArgs args;
+    if (parse_args(argc, argv, "--threads", 0UL, &args) != 0) {
+        return 1;
+    }
+    KolibriGenomeVerifyOptions options = {(size_t)args.number, NULL};
+    int rc = kg_verify_segmented(args.dir, args.key, args.key_len, &options);
+    if (rc != 0) {
+        fprintf(stderr, rc > 0 ? "Genome not found: %s\n" : "Genome verification failed: %s\n", args.dir);
+        return 1;
+    }
+    printf("Геном %s проверен\n", args.dir);
+    return 0;
+}
+
+static int cmd_compact(int argc, char **argv) {
+    GenomeArgs args;
+    if (parse_args(argc, argv, "--keep", KOLIBRI_COMPACT_KEEP_DEFAULT, &args) != 0) {
+        return 1;
+    }
+    /* Compacting a broken chain would sign over the damage. */
+    if (kg_verify_segmented(args.dir, args.key, args.key_len, NULL) != 0) {
+        fprintf(stderr, "Genome verification failed: %s\n", args.dir);
+        return 1;
+    }
+    int folded = kg_compact(args.dir, args.key, args.key_len, (size_t)args.number);
+    if (folded < 0) {
+        fprintf(stderr, "Compaction failed: %s\n", args.dir);
+        return 1;
+    }
+    printf("Свёрнуто сегментов: %d\n", folded);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+    const char *command = argv[1];
+    if (strcmp(command, "segments") == 0) {
+        return cmd_segments(argc - 2, &argv[2]);
+    }
+    if (strcmp(command, "verify") == 0) {
+        return cmd_verify(argc - 2, &argv[2]);
+    }
+    if (strcmp(command, "compact") == 0) {
+        return cmd_compact(argc - 2, &argv[2]);
+    }
+    print_usage();
+    return 1;
+}
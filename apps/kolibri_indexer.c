@@ -1,23 +1,51 @@
 #include "kolibri/knowledge_index.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
 
 static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
-            "  kolibri_indexer build --output DIR ROOT...\n"
-            "  kolibri_indexer search --query TEXT [--limit N] ROOT...\n");
+            "  kolibri_indexer build --output DIR [--threads N] [--stem] [--incremental]\n"
+            "                        [--quantize] [--embeddings FILE] ROOT...\n"
+            "  kolibri_indexer search --query TEXT [--limit N] ROOT...\n"
+            "  kolibri_indexer bench --queries FILE [--iterations N] [--threads T] [--limit K]\n"
+            "                        (--index DIR | ROOT...)\n");
 }
 
 static int handle_build(int argc, char **argv) {
     const char *output_dir = NULL;
-    size_t root_start = 0U;
+    size_t root_start = (size_t)argc;
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.threads = 0U;
+    options.keep_positions = 1;
+    int incremental = 0;
+    const char *embeddings = NULL;
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             output_dir = argv[i + 1];
-            root_start = (size_t)(i + 2);
+            i++;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = (size_t)atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--stem") == 0) {
+            options.stemming = 1;
+        } else if (strcmp(argv[i], "--quantize") == 0) {
+            options.quantize = 1;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            incremental = 1;
+        } else if (strcmp(argv[i], "--embeddings") == 0 && i + 1 < argc) {
+            embeddings = argv[i + 1];
+            i++;
+        } else {
+            root_start = (size_t)i;
             break;
         }
     }
@@ -27,13 +55,43 @@ static int handle_build(int argc, char **argv) {
     }
 
     size_t root_count = (size_t)argc - root_start;
+    const char *const *roots = (const char *const *)&argv[root_start];
     KolibriKnowledgeIndex *index = NULL;
-    int err = kolibri_knowledge_index_create((const char *const *)&argv[root_start], root_count, 1024U, &index);
+    int err = 0;
+    if (incremental) {
+        options.keep_term_counts = 1;
+        if (kolibri_knowledge_index_load_json(output_dir, &index) == 0 && index) {
+            size_t changed = 0U;
+            err = kolibri_knowledge_index_update(index, roots, root_count, &options, &changed);
+            if (err == 0) {
+                fprintf(stdout, "Incremental update: %zu document(s) changed\n", changed);
+            } else {
+                /* No term counts, another --stem setting or a failed update: start over. */
+                fprintf(stderr, "Incremental update unavailable (%d), rebuilding\n", err);
+                kolibri_knowledge_index_destroy(index);
+                index = NULL;
+            }
+        }
+    }
+    if (!index) {
+        err = kolibri_knowledge_index_create_ex(roots, root_count, &options, &index);
+    }
     if (err != 0 || !index) {
         fprintf(stderr, "Failed to build index: %d\n", err);
         return 1;
     }
+    if (embeddings) {
+        err = kolibri_knowledge_index_load_embeddings(index, embeddings, NULL);
+        if (err != 0) {
+            fprintf(stderr, "Failed to load embeddings from %s: %d\n", embeddings, err);
+            kolibri_knowledge_index_destroy(index);
+            return 1;
+        }
+    }
     err = kolibri_knowledge_index_write_json(index, output_dir);
+    if (err == 0) {
+        err = kolibri_knowledge_index_write_binary(index, output_dir);
+    }
     kolibri_knowledge_index_destroy(index);
     if (err != 0) {
         fprintf(stderr, "Failed to write index: %d\n", err);
@@ -102,6 +160,273 @@ static int handle_search(int argc, char **argv) {
     return 0;
 }
 
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t lhs = *(const uint64_t *)a;
+    uint64_t rhs = *(const uint64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_us(const uint64_t *sorted, size_t count, double q) {
+    if (count == 0U) {
+        return 0.0;
+    }
+    size_t at = (size_t)(q * (double)(count - 1U) + 0.5);
+    return (double)sorted[at] / 1000.0;
+}
+
+/* One query per non-empty line, trailing CR/LF stripped. */
+static char **load_queries(const char *path, size_t *out_count) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+    char **queries = NULL;
+    size_t count = 0U;
+    size_t capacity = 0U;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0U) {
+            continue;
+        }
+        if (count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2U : 64U;
+            char **grown = (char **)realloc(queries, new_capacity * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            queries = grown;
+            capacity = new_capacity;
+        }
+        queries[count] = (char *)malloc(len + 1U);
+        if (!queries[count]) {
+            break;
+        }
+        memcpy(queries[count], line, len + 1U);
+        count++;
+    }
+    fclose(file);
+    *out_count = count;
+    return queries;
+}
+
+static void free_queries(char **queries, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(queries[i]);
+    }
+    free(queries);
+}
+
+typedef struct {
+    const KolibriKnowledgeIndex *index;
+    char **queries;
+    size_t query_count;
+    size_t total;
+    size_t limit;
+    uint64_t *latencies;
+    atomic_size_t next;
+    atomic_int failed;
+} BenchShared;
+
+typedef struct {
+    BenchShared *shared;
+    size_t *indices;
+    float *scores;
+} BenchWorker;
+
+static void *bench_main(void *arg) {
+    BenchWorker *worker = (BenchWorker *)arg;
+    BenchShared *shared = worker->shared;
+    size_t i;
+    while ((i = atomic_fetch_add(&shared->next, 1U)) < shared->total) {
+        size_t count = 0U;
+        uint64_t started = monotonic_ns();
+        int err = kolibri_knowledge_index_search(shared->index, shared->queries[i % shared->query_count],
+                                                 shared->limit, worker->indices, worker->scores, &count);
+        shared->latencies[i] = monotonic_ns() - started;
+        if (err != 0) {
+            atomic_store(&shared->failed, err);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * recall@k of the pruned top-k search against the head of an exhaustive
+ * ranking of every document. A hit tied with the k-th exhaustive score
+ * counts, since either document is a correct answer.
+ */
+static double bench_recall(const KolibriKnowledgeIndex *index, char **queries, size_t query_count,
+                           size_t limit) {
+    size_t doc_count = kolibri_knowledge_index_document_count(index);
+    if (doc_count == 0U || limit == 0U) {
+        return 1.0;
+    }
+    size_t *exact = (size_t *)malloc(doc_count * sizeof(size_t));
+    float *exact_scores = (float *)malloc(doc_count * sizeof(float));
+    size_t *pruned = (size_t *)malloc(limit * sizeof(size_t));
+    float *pruned_scores = (float *)malloc(limit * sizeof(float));
+    size_t hits = 0U;
+    size_t expected = 0U;
+    for (size_t q = 0; exact && exact_scores && pruned && pruned_scores && q < query_count; ++q) {
+        size_t exact_count = 0U;
+        size_t pruned_count = 0U;
+        if (kolibri_knowledge_index_search(index, queries[q], doc_count, exact, exact_scores, &exact_count) != 0 ||
+            kolibri_knowledge_index_search(index, queries[q], limit, pruned, pruned_scores, &pruned_count) != 0) {
+            continue;
+        }
+        size_t head = exact_count < limit ? exact_count : limit;
+        expected += head;
+        for (size_t i = 0; i < pruned_count && head > 0U; ++i) {
+            int hit = pruned_scores[i] >= exact_scores[head - 1U];
+            for (size_t j = 0; j < head && !hit; ++j) {
+                hit = exact[j] == pruned[i];
+            }
+            hits += hit ? 1U : 0U;
+        }
+    }
+    free(exact);
+    free(exact_scores);
+    free(pruned);
+    free(pruned_scores);
+    return expected ? (double)(hits < expected ? hits : expected) / (double)expected : 1.0;
+}
+
+static int handle_bench(int argc, char **argv) {
+    const char *queries_path = NULL;
+    const char *index_dir = NULL;
+    size_t iterations = 1U;
+    size_t threads = 1U;
+    size_t limit = 10U;
+    size_t root_start = (size_t)argc;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            queries_path = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            index_dir = argv[++i];
+        } else {
+            root_start = (size_t)i;
+            break;
+        }
+    }
+    if (!queries_path || (!index_dir && root_start >= (size_t)argc)) {
+        print_usage();
+        return 1;
+    }
+    iterations = iterations ? iterations : 1U;
+    threads = threads ? threads : 1U;
+    limit = limit ? limit : 1U;
+
+    size_t query_count = 0U;
+    char **queries = load_queries(queries_path, &query_count);
+    if (!queries || query_count == 0U) {
+        fprintf(stderr, "No queries in %s\n", queries_path);
+        free_queries(queries, query_count);
+        return 1;
+    }
+
+    KolibriKnowledgeIndex *index = NULL;
+    uint64_t load_started = monotonic_ns();
+    int err;
+    if (index_dir) {
+        err = kolibri_knowledge_index_load_binary(index_dir, &index);
+        if (err != 0 || !index) {
+            err = kolibri_knowledge_index_load_json(index_dir, &index);
+        }
+    } else {
+        KolibriKnowledgeIndexOptions options;
+        kolibri_knowledge_index_options_init(&options);
+        options.threads = 0U;
+        options.keep_positions = 1;
+        err = kolibri_knowledge_index_create_ex((const char *const *)&argv[root_start],
+                                                (size_t)argc - root_start, &options, &index);
+    }
+    double load_ms = (double)(monotonic_ns() - load_started) / 1e6;
+    if (err != 0 || !index) {
+        fprintf(stderr, "Failed to load index: %d\n", err);
+        free_queries(queries, query_count);
+        return 1;
+    }
+
+    BenchShared shared;
+    shared.index = index;
+    shared.queries = queries;
+    shared.query_count = query_count;
+    shared.total = query_count * iterations;
+    shared.limit = limit;
+    shared.latencies = (uint64_t *)malloc(shared.total * sizeof(uint64_t));
+    atomic_init(&shared.next, 0U);
+    atomic_init(&shared.failed, 0);
+    BenchWorker *workers = (BenchWorker *)calloc(threads, sizeof(BenchWorker));
+    pthread_t *handles = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    unsigned char *started = (unsigned char *)calloc(threads, 1U);
+    int ok = shared.latencies && workers && handles && started;
+    for (size_t w = 0; ok && w < threads; ++w) {
+        workers[w].shared = &shared;
+        workers[w].indices = (size_t *)malloc(limit * sizeof(size_t));
+        workers[w].scores = (float *)malloc(limit * sizeof(float));
+        ok = workers[w].indices && workers[w].scores;
+    }
+    if (!ok) {
+        fprintf(stderr, "Allocation failure\n");
+    } else {
+        uint64_t bench_started = monotonic_ns();
+        for (size_t w = 1; w < threads; ++w) {
+            started[w] = pthread_create(&handles[w], NULL, bench_main, &workers[w]) == 0;
+        }
+        bench_main(&workers[0]);
+        for (size_t w = 1; w < threads; ++w) {
+            if (started[w]) {
+                pthread_join(handles[w], NULL);
+            }
+        }
+        double elapsed = (double)(monotonic_ns() - bench_started) / 1e9;
+        double recall = bench_recall(index, queries, query_count, limit);
+        qsort(shared.latencies, shared.total, sizeof(uint64_t), compare_u64);
+        struct rusage usage;
+        long max_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? (long)usage.ru_maxrss : 0L;
+#if defined(__APPLE__)
+        max_rss_kb /= 1024L;
+#endif
+        printf("{\"documents\":%zu,\"tokens\":%zu,\"queries\":%zu,\"iterations\":%zu,\"threads\":%zu,"
+               "\"limit\":%zu,\"load_ms\":%.3f,\"elapsed_sec\":%.3f,\"qps\":%.1f,\"latency_p50_us\":%.1f,"
+               "\"latency_p90_us\":%.1f,\"latency_p99_us\":%.1f,\"latency_max_us\":%.1f,"
+               "\"recall_at_k\":%.4f,\"max_rss_kb\":%ld,\"errors\":%d}\n",
+               kolibri_knowledge_index_document_count(index), kolibri_knowledge_index_token_count(index),
+               query_count, iterations, threads, limit, load_ms, elapsed,
+               elapsed > 0.0 ? (double)shared.total / elapsed : 0.0,
+               percentile_us(shared.latencies, shared.total, 0.50),
+               percentile_us(shared.latencies, shared.total, 0.90),
+               percentile_us(shared.latencies, shared.total, 0.99),
+               percentile_us(shared.latencies, shared.total, 1.0), recall, max_rss_kb,
+               atomic_load(&shared.failed));
+    }
+    for (size_t w = 0; workers && w < threads; ++w) {
+        free(workers[w].indices);
+        free(workers[w].scores);
+    }
+    free(started);
+    free(handles);
+    free(workers);
+    free(shared.latencies);
+    kolibri_knowledge_index_destroy(index);
+    free_queries(queries, query_count);
+    return ok && atomic_load(&shared.failed) == 0 ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         print_usage();
@@ -113,6 +438,9 @@ int main(int argc, char **argv) {
     if (strcmp(argv[1], "search") == 0) {
         return handle_search(argc - 2, &argv[2]);
     }
+    if (strcmp(argv[1], "bench") == 0) {
+        return handle_bench(argc - 2, &argv[2]);
+    }
     print_usage();
     return 1;
 }
@@ -1,15 +1,30 @@
 /*
  * Kolibri Knowledge Relay: replicate TEACH/USER_FEEDBACK from knowledge genome
- * to node genomes, re-signing with node HMAC keys.
+ * to node genomes, re-signing with node HMAC keys. The source (a genome file
+ * or a segmented directory) is tailed with kg_follow from the saved offset, so
+ * each run reads only new blocks; --follow keeps relaying as blocks arrive.
+ * Events are gathered into batches, and each batch is committed to all
+ * targets in parallel, one kg_append_batch and one sync per target. Every
+ * target keeps its own high-water mark in the offset file.
  */
 
 #include "kolibri/genome.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RELAY_FOLLOW_WAIT_MS 1000
+/* Relayed events gathered from the source before one group commit. */
+#define RELAY_BATCH_MAX 256
+#define RELAY_MAX_TARGETS 256
+#define RELAY_MAX_THREADS 16
 
 static int ends_with(const char *s, const char *suffix) {
   size_t ls = strlen(s), lsf = strlen(suffix);
@@ -18,18 +33,208 @@ static int ends_with(const char *s, const char *suffix) {
 
 static int is_genome_file(const char *name) { return ends_with(name, ".dat"); }
 
-static void relay_event_to_target(const char *target_path, const unsigned char *key,
-                                  size_t key_len, const char *event_type,
-                                  const char *payload) {
-  KolibriGenome g;
-  if (kg_open(&g, target_path, key, key_len) != 0) {
-    fprintf(stderr, "[relay] open target failed: %s\n", target_path);
+typedef struct {
+  unsigned long long index; /* source block */
+  char event_type[KOLIBRI_EVENT_TYPE_SIZE + 1];
+  char payload[KOLIBRI_PAYLOAD_SIZE + 1];
+} RelayEvent;
+
+/*
+ * next_index is the target's high-water mark: every relayed source block
+ * below it is in the target. A target whose append fails stops at its mark
+ * for the rest of the run, so it never gets a gap; the next run resumes it.
+ */
+typedef struct {
+  char name[256];
+  unsigned long long next_index;
+  int lagging;
+} RelayTarget;
+
+typedef struct {
+  const char *targets_dir;
+  const unsigned char *key;
+  size_t key_len;
+  KolibriGenomeSyncMode sync_mode;
+  RelayTarget targets[RELAY_MAX_TARGETS];
+  size_t target_count;
+  /* The batch being committed; workers only read it. */
+  const RelayEvent *events;
+  size_t event_count;
+  unsigned long long batch_end;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned long long generation;
+  size_t next_target;
+  size_t busy;
+  int stop;
+  pthread_t threads[RELAY_MAX_THREADS];
+  size_t thread_count;
+} RelayCrew;
+
+/*
+ * Appends the batch's events the target does not hold yet with one
+ * kg_append_batch and one sync. The target is opened per batch, as nodes may
+ * append to their genome between batches; the .verified checkpoint the node
+ * keeps next to it limits the open check to blocks added since.
+ */
+static void relay_commit_target(const RelayCrew *crew, RelayTarget *target) {
+  if (target->lagging) {
+    return;
+  }
+  KolibriGenomeEntry entries[RELAY_BATCH_MAX];
+  size_t count = 0U;
+  for (size_t i = 0; i < crew->event_count; ++i) {
+    if (crew->events[i].index >= target->next_index) {
+      entries[count].event_type = crew->events[i].event_type;
+      entries[count].payload = crew->events[i].payload;
+      count++;
+    }
+  }
+  if (count > 0U) {
+    char path[512];
+    char checkpoint[540];
+    snprintf(path, sizeof(path), "%s/%s", crew->targets_dir, target->name);
+    snprintf(checkpoint, sizeof(checkpoint), "%s.verified", path);
+    KolibriGenomeVerifyOptions verify = {1U, checkpoint};
+    KolibriGenomeSyncPolicy policy = {crew->sync_mode, 0U, 0U};
+    KolibriGenome g;
+    if (kg_open_ex(&g, path, crew->key, crew->key_len, &verify) != 0) {
+      fprintf(stderr, "[relay] open target failed: %s\n", path);
+      target->lagging = 1;
+      return;
+    }
+    kg_set_sync_policy(&g, &policy);
+    int ok = kg_append_batch(&g, entries, count, NULL) == 0 && kg_sync(&g) == 0;
+    kg_close(&g);
+    if (!ok) {
+      fprintf(stderr, "[relay] append failed: %s\n", path);
+      target->lagging = 1;
+      return;
+    }
+  }
+  if (crew->batch_end > target->next_index) {
+    target->next_index = crew->batch_end;
+  }
+}
+
+/* Workers take targets of the current generation until none are left. */
+static void *relay_worker_main(void *arg) {
+  RelayCrew *crew = (RelayCrew *)arg;
+  unsigned long long seen = 0ULL;
+  pthread_mutex_lock(&crew->lock);
+  for (;;) {
+    while (!crew->stop && crew->generation == seen) {
+      pthread_cond_wait(&crew->wake, &crew->lock);
+    }
+    if (crew->stop) {
+      break;
+    }
+    seen = crew->generation;
+    while (crew->next_target < crew->target_count) {
+      RelayTarget *target = &crew->targets[crew->next_target++];
+      pthread_mutex_unlock(&crew->lock);
+      relay_commit_target(crew, target);
+      pthread_mutex_lock(&crew->lock);
+    }
+    if (--crew->busy == 0U) {
+      pthread_cond_signal(&crew->done);
+    }
+  }
+  pthread_mutex_unlock(&crew->lock);
+  return NULL;
+}
+
+static void relay_crew_start(RelayCrew *crew, size_t threads) {
+  pthread_mutex_init(&crew->lock, NULL);
+  pthread_cond_init(&crew->wake, NULL);
+  pthread_cond_init(&crew->done, NULL);
+  if (threads > RELAY_MAX_THREADS) threads = RELAY_MAX_THREADS;
+  /* One thread gains nothing over committing on the caller. */
+  for (size_t i = 0; threads > 1U && i < threads; ++i) {
+    if (pthread_create(&crew->threads[crew->thread_count], NULL, relay_worker_main, crew) != 0) {
+      break;
+    }
+    crew->thread_count++;
+  }
+}
+
+static void relay_crew_stop(RelayCrew *crew) {
+  pthread_mutex_lock(&crew->lock);
+  crew->stop = 1;
+  pthread_cond_broadcast(&crew->wake);
+  pthread_mutex_unlock(&crew->lock);
+  for (size_t i = 0; i < crew->thread_count; ++i) {
+    pthread_join(crew->threads[i], NULL);
+  }
+  pthread_cond_destroy(&crew->done);
+  pthread_cond_destroy(&crew->wake);
+  pthread_mutex_destroy(&crew->lock);
+}
+
+/* Commits one batch to every target in parallel and waits for all of them. */
+static void relay_crew_commit(RelayCrew *crew, const RelayEvent *events, size_t count,
+                              unsigned long long batch_end) {
+  crew->events = events;
+  crew->event_count = count;
+  crew->batch_end = batch_end;
+  if (crew->thread_count == 0U) {
+    for (size_t i = 0; i < crew->target_count; ++i) {
+      relay_commit_target(crew, &crew->targets[i]);
+    }
     return;
   }
-  if (kg_append(&g, event_type, payload, NULL) != 0) {
-    fprintf(stderr, "[relay] append failed: %s\n", target_path);
+  pthread_mutex_lock(&crew->lock);
+  crew->next_target = 0U;
+  crew->busy = crew->thread_count;
+  crew->generation++;
+  pthread_cond_broadcast(&crew->wake);
+  while (crew->busy > 0U) {
+    pthread_cond_wait(&crew->done, &crew->lock);
+  }
+  pthread_mutex_unlock(&crew->lock);
+}
+
+static RelayTarget *relay_find_target(RelayCrew *crew, const char *name) {
+  for (size_t i = 0; i < crew->target_count; ++i) {
+    if (strcmp(crew->targets[i].name, name) == 0) {
+      return &crew->targets[i];
+    }
+  }
+  return NULL;
+}
+
+static RelayTarget *relay_add_target(RelayCrew *crew, const char *name,
+                                     unsigned long long next_index) {
+  if (crew->target_count >= RELAY_MAX_TARGETS || strlen(name) >= sizeof(crew->targets[0].name)) {
+    return NULL;
+  }
+  RelayTarget *target = &crew->targets[crew->target_count++];
+  memset(target, 0, sizeof(*target));
+  strcpy(target->name, name);
+  target->next_index = next_index;
+  return target;
+}
+
+/* Picks up genomes created in targets_dir since the last scan; they start
+ * at next_index, like the targets that were there when a run began. */
+static int relay_scan_targets(RelayCrew *crew, unsigned long long next_index) {
+  DIR *dir = opendir(crew->targets_dir);
+  if (!dir) {
+    fprintf(stderr, "[relay] cannot open targets-dir %s\n", crew->targets_dir);
+    return -1;
   }
-  kg_close(&g);
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] == '.') continue;
+    if (!is_genome_file(ent->d_name)) continue;
+    if (!relay_find_target(crew, ent->d_name) &&
+        !relay_add_target(crew, ent->d_name, next_index)) {
+      fprintf(stderr, "[relay] target skipped: %s\n", ent->d_name);
+    }
+  }
+  closedir(dir);
+  return 0;
 }
 
 static int load_key_from_file(const char *path, unsigned char *out, size_t *out_len) {
@@ -42,18 +247,117 @@ static int load_key_from_file(const char *path, unsigned char *out, size_t *out_
   return 0;
 }
 
+static volatile sig_atomic_t relay_running = 1;
+
+static void relay_stop(int signo) {
+  (void)signo;
+  relay_running = 0;
+}
+
+/* Inline key, then key file; like the knowledge server, the source key falls
+ * back to KOLIBRI_HMAC_KEY, KOLIBRI_HMAC_KEY_FILE and root.key. */
+static int resolve_key(const char *inline_key, const char *path, int use_environment,
+                       unsigned char *out, size_t *out_len) {
+  if (!inline_key && use_environment) {
+    const char *env_inline = getenv("KOLIBRI_HMAC_KEY");
+    if (env_inline && *env_inline) {
+      inline_key = env_inline;
+    }
+  }
+  if (inline_key && inline_key[0] != '\0') {
+    size_t len = strlen(inline_key);
+    if (len > KOLIBRI_HMAC_KEY_SIZE) len = KOLIBRI_HMAC_KEY_SIZE;
+    memcpy(out, inline_key, len);
+    *out_len = len;
+    return 0;
+  }
+  if (!path && use_environment) {
+    const char *env_file = getenv("KOLIBRI_HMAC_KEY_FILE");
+    path = (env_file && *env_file) ? env_file : "root.key";
+  }
+  return path ? load_key_from_file(path, out, out_len) : -1;
+}
+
+/*
+ * The offset file holds the next source block to read on its first line,
+ * then one "<high-water mark> <target>" line per target. A file with only
+ * the first line, as older relays wrote it, gives every target that mark.
+ * Marks of targets no longer in targets_dir are dropped.
+ */
+static unsigned long long load_offsets(const char *offset_path, RelayCrew *crew) {
+  unsigned long long start_index = 0ULL;
+  FILE *ofs = fopen(offset_path, "r");
+  if (!ofs) return 0ULL;
+  char line[320];
+  if (fgets(line, sizeof(line), ofs) && sscanf(line, "%llu", &start_index) != 1) {
+    start_index = 0ULL;
+  }
+  while (fgets(line, sizeof(line), ofs)) {
+    unsigned long long mark = 0ULL;
+    int name_at = 0;
+    if (sscanf(line, "%llu %n", &mark, &name_at) != 1 || name_at == 0) continue;
+    char *name = line + name_at;
+    name[strcspn(name, "\r\n")] = '\0';
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", crew->targets_dir, name);
+    if (!is_genome_file(name) || strchr(name, '/') || relay_find_target(crew, name) ||
+        stat(path, &st) != 0) {
+      continue;
+    }
+    relay_add_target(crew, name, mark);
+  }
+  fclose(ofs);
+  return start_index;
+}
+
+/* Replaced through a temporary file, so a crash leaves the previous marks. */
+static void store_offsets(const char *offset_path, unsigned long long next_index,
+                          const RelayCrew *crew) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", offset_path);
+  FILE *ofs = fopen(tmp, "w");
+  if (!ofs) return;
+  int ok = fprintf(ofs, "%llu\n", next_index) > 0;
+  for (size_t i = 0; ok && i < crew->target_count; ++i) {
+    ok = fprintf(ofs, "%llu %s\n", crew->targets[i].next_index, crew->targets[i].name) > 0;
+  }
+  ok = fclose(ofs) == 0 && ok;
+  if (!ok || rename(tmp, offset_path) != 0) {
+    remove(tmp);
+  }
+}
+
+static int is_relayed(const ReasonBlock *block) {
+  return strncmp(block->event_type, "TEACH", 5) == 0 ||
+         strncmp(block->event_type, "USER_FEEDBACK", 13) == 0;
+}
+
 int main(int argc, char **argv) {
   const char *source_path = ".kolibri/knowledge_genome.dat";
+  const char *source_key_path = NULL;
+  const char *source_key_inline = NULL;
   const char *targets_dir = "build/cluster";
   const char *target_key_path = "build/cluster/swarm.key";
   const char *target_key_inline = NULL;
   const char *offset_path = ".kolibri/knowledge_relay.offset";
+  int follow = 0;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  KolibriGenomeSyncMode sync_mode = KG_SYNC_FLUSH;
 
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
       source_path = argv[++i];
       continue;
     }
+    if (strcmp(argv[i], "--source-key") == 0 && i + 1 < argc) {
+      source_key_path = argv[++i];
+      continue;
+    }
+    if (strcmp(argv[i], "--source-key-inline") == 0 && i + 1 < argc) {
+      source_key_inline = argv[++i];
+      continue;
+    }
     if (strcmp(argv[i], "--targets-dir") == 0 && i + 1 < argc) {
       targets_dir = argv[++i];
       continue;
@@ -70,99 +374,140 @@ int main(int argc, char **argv) {
       offset_path = argv[++i];
       continue;
     }
+    if (strcmp(argv[i], "--follow") == 0) {
+      follow = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = strtol(argv[++i], NULL, 10);
+      continue;
+    }
+    if (strcmp(argv[i], "--fsync") == 0) {
+      sync_mode = KG_SYNC_FDATASYNC;
+      continue;
+    }
     if (strcmp(argv[i], "--help") == 0) {
-      printf("Usage: %s [--source PATH] [--targets-dir DIR] [--target-key FILE] [--offset FILE]\n", argv[0]);
+      printf("Usage: %s [--source PATH|DIR] [--source-key FILE] [--targets-dir DIR] [--target-key FILE]\n"
+             "       [--offset FILE] [--follow] [--threads N] [--fsync]\n",
+             argv[0]);
       return 0;
     }
   }
 
   unsigned char target_key[KOLIBRI_HMAC_KEY_SIZE];
   size_t target_key_len = 0U;
-  if (target_key_inline && target_key_inline[0] != '\0') {
-    size_t len = strlen(target_key_inline);
-    if (len > sizeof(target_key)) len = sizeof(target_key);
-    memcpy(target_key, target_key_inline, len);
-    target_key_len = len;
-  } else {
-    if (load_key_from_file(target_key_path, target_key, &target_key_len) != 0) {
-      fprintf(stderr, "[relay] failed to load target key: %s\n", target_key_path);
-      return 1;
-    }
+  if (resolve_key(target_key_inline, target_key_path, 0, target_key, &target_key_len) != 0) {
+    fprintf(stderr, "[relay] failed to load target key: %s\n", target_key_path);
+    return 1;
+  }
+  /* Source blocks are verified, so the source genome key is needed too. */
+  unsigned char source_key[KOLIBRI_HMAC_KEY_SIZE];
+  size_t source_key_len = 0U;
+  if (resolve_key(source_key_inline, source_key_path, 1, source_key, &source_key_len) != 0) {
+    fprintf(stderr, "[relay] failed to load source key for %s\n", source_path);
+    return 1;
   }
 
-  FILE *src = fopen(source_path, "rb");
-  if (!src) {
+  struct stat st;
+  if (!follow && stat(source_path, &st) != 0) {
     fprintf(stderr, "[relay] cannot open source %s: %s\n", source_path, strerror(errno));
     return 1;
   }
 
-  unsigned long long start_index = 0ULL;
-  FILE *ofs = fopen(offset_path, "r");
-  if (ofs) {
-    if (fscanf(ofs, "%llu", &start_index) != 1) {
-      start_index = 0ULL;
+  static RelayCrew crew;
+  crew.targets_dir = targets_dir;
+  crew.key = target_key;
+  crew.key_len = target_key_len;
+  crew.sync_mode = sync_mode;
+  unsigned long long start_index = load_offsets(offset_path, &crew);
+  if (relay_scan_targets(&crew, start_index) != 0) {
+    return 1;
+  }
+  /* A target that lagged behind last time sets where reading resumes. */
+  unsigned long long read_index = start_index;
+  for (size_t i = 0; i < crew.target_count; ++i) {
+    if (crew.targets[i].next_index < read_index) {
+      read_index = crew.targets[i].next_index;
     }
-    fclose(ofs);
   }
 
-  /* Iterate over fixed-size blocks */
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  unsigned long long processed = 0ULL;
+  KolibriGenomeFollower follower;
+  if (kg_follow_open(&follower, source_path, source_key, source_key_len, read_index) != 0) {
+    fprintf(stderr, "[relay] cannot follow source %s\n", source_path);
+    return 1;
+  }
+  if (follower.start_index > read_index) {
+    fprintf(stderr, "[relay] blocks %llu..%llu were compacted, skipping\n", read_index,
+            (unsigned long long)follower.start_index - 1ULL);
+    read_index = follower.start_index;
+  }
 
-  /* Skip blocks below start_index by reading and counting */
-  while (fread(bytes, 1, KOLIBRI_BLOCK_SIZE, src) == KOLIBRI_BLOCK_SIZE) {
-    /* Deserialize minimal fields: index, event_type, payload */
-    unsigned long long idx = 0ULL;
-    for (int i = 0; i < 8; ++i) {
-      idx = (idx << 8) | (unsigned long long)bytes[i];
-    }
-    if (idx < start_index) {
-      continue;
+  if (follow) {
+    signal(SIGINT, relay_stop);
+    signal(SIGTERM, relay_stop);
+  }
+  RelayEvent *events = (RelayEvent *)malloc(RELAY_BATCH_MAX * sizeof(RelayEvent));
+  if (!events) {
+    kg_follow_close(&follower);
+    return 1;
+  }
+  relay_crew_start(&crew, threads > 0 ? (size_t)threads : 1U);
+  unsigned long long processed = 0ULL;
+  int status = 0;
+  while (relay_running) {
+    /* Blocks already in the source are taken without waiting, so a backlog
+     * goes out in full batches and a live tail in small ones. */
+    unsigned long long batch_start = read_index;
+    size_t count = 0U;
+    int rc = 0;
+    while (count < RELAY_BATCH_MAX) {
+      ReasonBlock block;
+      int wait_ms = follow && read_index == batch_start ? RELAY_FOLLOW_WAIT_MS : 0;
+      rc = kg_follow(&follower, &block, wait_ms);
+      if (rc != 0) {
+        break;
+      }
+      read_index = (unsigned long long)block.index + 1ULL;
+      if (!is_relayed(&block)) {
+        continue;
+      }
+      RelayEvent *event = &events[count++];
+      event->index = (unsigned long long)block.index;
+      memcpy(event->event_type, block.event_type, KOLIBRI_EVENT_TYPE_SIZE);
+      memcpy(event->payload, block.payload, KOLIBRI_PAYLOAD_SIZE);
+      event->event_type[KOLIBRI_EVENT_TYPE_SIZE] = '\0';
+      event->payload[KOLIBRI_PAYLOAD_SIZE] = '\0';
     }
-
-    char event_type[KOLIBRI_EVENT_TYPE_SIZE + 1];
-    char payload[KOLIBRI_PAYLOAD_SIZE + 1];
-    memset(event_type, 0, sizeof(event_type));
-    memset(payload, 0, sizeof(payload));
-    memcpy(event_type, bytes + 16 + KOLIBRI_HASH_SIZE * 2, KOLIBRI_EVENT_TYPE_SIZE);
-    memcpy(payload, bytes + 16 + KOLIBRI_HASH_SIZE * 2 + KOLIBRI_EVENT_TYPE_SIZE, KOLIBRI_PAYLOAD_SIZE);
-    event_type[KOLIBRI_EVENT_TYPE_SIZE] = '\0';
-    payload[KOLIBRI_PAYLOAD_SIZE] = '\0';
-
-    /* Filter events */
-    if (strncmp(event_type, "TEACH", 5) != 0 && strncmp(event_type, "USER_FEEDBACK", 13) != 0) {
-      start_index = idx + 1ULL;
-      continue;
+    if (read_index != batch_start) {
+      /* Unstored marks make the next run read these blocks again. */
+      if (relay_scan_targets(&crew, batch_start) != 0) {
+        status = 1;
+        break;
+      }
+      relay_crew_commit(&crew, events, count, read_index);
+      store_offsets(offset_path, read_index, &crew);
+      processed += count;
     }
-
-    /* Broadcast to all genomes in targets_dir */
-    DIR *dir = opendir(targets_dir);
-    if (!dir) {
-      fprintf(stderr, "[relay] cannot open targets-dir %s\n", targets_dir);
+    if (rc < 0) {
+      fprintf(stderr, "[relay] source chain broken at block %llu\n", read_index);
+      status = 1;
       break;
     }
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-      if (ent->d_name[0] == '.') continue;
-      if (!is_genome_file(ent->d_name)) continue;
-      char path[512];
-      snprintf(path, sizeof(path), "%s/%s", targets_dir, ent->d_name);
-      relay_event_to_target(path, target_key, target_key_len, event_type, payload);
+    if (rc > 0 && !follow) {
+      break;
     }
-    closedir(dir);
-
-    start_index = idx + 1ULL;
-    processed += 1ULL;
   }
+  relay_crew_stop(&crew);
+  kg_follow_close(&follower);
+  free(events);
 
-  fclose(src);
-
-  ofs = fopen(offset_path, "w");
-  if (ofs) {
-    fprintf(ofs, "%llu\n", start_index);
-    fclose(ofs);
+  for (size_t i = 0; i < crew.target_count; ++i) {
+    if (crew.targets[i].lagging) {
+      fprintf(stderr, "[relay] %s stopped at block %llu, the next run resumes it\n",
+              crew.targets[i].name, crew.targets[i].next_index);
+      status = 1;
+    }
   }
-
-  printf("[relay] processed %llu events\n", processed);
-  return 0;
+  printf("[relay] processed %llu events into %zu targets\n", processed, crew.target_count);
+  return status;
 }
@@ -0,0 +1,1048 @@
+/*
+ * Kolibri Load Generator: drives kolibri_knowledge_server over keep-alive
+ * connections at a fixed, open-loop request rate.
+ *
+ * Request i is due at start + i / rate whether or not earlier requests have
+ * been answered, and its latency is measured from that due time. A stalled
+ * server therefore shows up as the queueing delay every later request would
+ * have seen, not as a quiet pause in sending (coordinated omission); the
+ * time from the actual send is reported alongside as the service time.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_DEFAULT_PORT 8000U
+#define LOADGEN_REQUEST_MAX 4096U
+#define LOADGEN_QUERY_MAX 512U
+#define LOADGEN_RESPONSE_MAX (16U * 1024U * 1024U)
+#define LOADGEN_POLL_MAX_MS 100
+
+typedef enum {
+    LOAD_SEARCH = 0,
+    LOAD_TEACH = 1,
+    LOAD_FEEDBACK = 2,
+    LOAD_KINDS = 3
+} LoadKind;
+
+static const char *const load_kind_names[LOAD_KINDS] = {"search", "teach", "feedback"};
+
+static const char *const load_default_queries[] = {
+    "kolibri",          "genome",        "formula evolution", "swarm",
+    "knowledge server", "архитектура",   "цифровой геном",    "roadmap",
+    "wasm bridge",      "release plan",  "kolibri os",        "live learning",
+};
+
+typedef struct {
+    struct sockaddr_storage address;
+    socklen_t address_len;
+    char host[256];
+    unsigned port;
+    double rate;
+    double duration_sec;
+    double warmup_sec;
+    size_t connections;
+    size_t threads;
+    unsigned mix[LOAD_KINDS];
+    unsigned mix_total;
+    const char *const *queries;
+    size_t query_count;
+    const char *token;
+    size_t limit;
+    uint64_t timeout_ns;
+    uint64_t start_ns;
+    uint64_t record_from_ns;
+    uint64_t end_ns;
+    uint64_t total;
+} LoadConfig;
+
+typedef struct {
+    uint64_t *values;
+    size_t count;
+    size_t capacity;
+} LoadSamples;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t ok;
+    uint64_t client_errors;
+    uint64_t rate_limited;
+    uint64_t server_errors;
+    uint64_t socket_errors;
+    uint64_t timeouts;
+    LoadSamples latency;
+    LoadSamples service;
+} LoadStats;
+
+typedef struct {
+    int fd;
+    int busy;
+    int retried;
+    LoadKind kind;
+    uint64_t request;
+    uint64_t intended_ns;
+    uint64_t sent_ns;
+    char out[LOADGEN_REQUEST_MAX];
+    size_t out_len;
+    size_t out_sent;
+    char *in;
+    size_t in_len;
+    size_t in_capacity;
+} LoadConnection;
+
+typedef struct {
+    const LoadConfig *config;
+    size_t id;
+    LoadConnection *conns;
+    size_t conn_count;
+    size_t cursor;
+    uint64_t scheduled;
+    uint64_t issued;
+    uint64_t total;
+    uint64_t connects;
+    uint64_t connect_errors;
+    uint64_t backlog_max;
+    uint64_t unsent;
+    LoadStats stats[LOAD_KINDS];
+} LoadWorker;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  kolibri_loadgen [--host HOST] [--port PORT] [--rate RPS] [--duration SEC]\n"
+            "                  [--warmup SEC] [--connections N] [--threads T]\n"
+            "                  [--mix SEARCH,TEACH,FEEDBACK] [--queries FILE] [--limit K]\n"
+            "                  [--token TOKEN] [--timeout-ms MS] [--json PATH]\n"
+            "Defaults: 127.0.0.1:%u, 100 req/s for 10 s after 1 s of warmup, 16 connections,\n"
+            "1 thread, search only (--mix 100,0,0), limit 3, 10000 ms timeout.\n"
+            "Teach and feedback need the admin token (--token or KOLIBRI_KNOWLEDGE_ADMIN_TOKEN);\n"
+            "the server rate-limits them per client address, which shows as rate_limited.\n",
+            LOADGEN_DEFAULT_PORT);
+}
+
+static int samples_push(LoadSamples *samples, uint64_t value) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2U : 1024U;
+        uint64_t *grown = (uint64_t *)realloc(samples->values, capacity * sizeof(uint64_t));
+        if (!grown) {
+            return -1;
+        }
+        samples->values = grown;
+        samples->capacity = capacity;
+    }
+    samples->values[samples->count++] = value;
+    return 0;
+}
+
+static int samples_merge(LoadSamples *dst, const LoadSamples *src) {
+    for (size_t i = 0; i < src->count; ++i) {
+        if (samples_push(dst, src->values[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t lhs = *(const uint64_t *)a;
+    uint64_t rhs = *(const uint64_t *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_ms(const LoadSamples *sorted, double q) {
+    if (sorted->count == 0U) {
+        return 0.0;
+    }
+    size_t at = (size_t)(q * (double)(sorted->count - 1U) + 0.5);
+    return (double)sorted->values[at] / 1e6;
+}
+
+/* One query per non-empty line, trailing CR/LF stripped. */
+static char **load_queries(const char *path, size_t *out_count) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+    char **queries = NULL;
+    size_t count = 0U;
+    size_t capacity = 0U;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0U) {
+            continue;
+        }
+        if (len >= LOADGEN_QUERY_MAX) {
+            len = LOADGEN_QUERY_MAX - 1U;
+            line[len] = '\0';
+        }
+        if (count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2U : 64U;
+            char **grown = (char **)realloc(queries, new_capacity * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            queries = grown;
+            capacity = new_capacity;
+        }
+        queries[count] = (char *)malloc(len + 1U);
+        if (!queries[count]) {
+            break;
+        }
+        memcpy(queries[count], line, len + 1U);
+        count++;
+    }
+    fclose(file);
+    *out_count = count;
+    return queries;
+}
+
+static void free_queries(char **queries, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(queries[i]);
+    }
+    free(queries);
+}
+
+/* application/x-www-form-urlencoded, which the server decodes for q and a. */
+static size_t url_encode(const char *text, char *out, size_t cap) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t len = 0U;
+    for (const unsigned char *p = (const unsigned char *)text; *p && len + 4U <= cap; ++p) {
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') ||
+            *p == '-' || *p == '_' || *p == '.' || *p == '~') {
+            out[len++] = (char)*p;
+        } else if (*p == ' ') {
+            out[len++] = '+';
+        } else {
+            out[len++] = '%';
+            out[len++] = hex[*p >> 4];
+            out[len++] = hex[*p & 15U];
+        }
+    }
+    if (cap > 0U) {
+        out[len] = '\0';
+    }
+    return len;
+}
+
+/* splitmix64 of the request number, so a run's mix does not depend on timing. */
+static uint64_t request_hash(uint64_t request) {
+    uint64_t z = request + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static LoadKind request_kind(const LoadConfig *config, uint64_t request) {
+    unsigned pick = (unsigned)(request_hash(request) % config->mix_total);
+    for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+        if (pick < config->mix[kind]) {
+            return (LoadKind)kind;
+        }
+        pick -= config->mix[kind];
+    }
+    return LOAD_SEARCH;
+}
+
+static uint64_t request_due_ns(const LoadConfig *config, uint64_t request) {
+    return config->start_ns + (uint64_t)((double)request * 1e9 / config->rate);
+}
+
+static void build_request(const LoadConfig *config, LoadConnection *conn) {
+    char query[LOADGEN_QUERY_MAX * 3U];
+    url_encode(config->queries[conn->request % config->query_count], query, sizeof(query));
+    int written;
+    if (conn->kind == LOAD_SEARCH) {
+        written = snprintf(conn->out, sizeof(conn->out),
+                           "GET /api/knowledge/search?q=%s&limit=%zu HTTP/1.1\r\n"
+                           "Host: %s\r\nConnection: keep-alive\r\n\r\n",
+                           query, config->limit, config->host);
+    } else {
+        char body[LOADGEN_QUERY_MAX * 3U + 128U];
+        if (conn->kind == LOAD_TEACH) {
+            snprintf(body, sizeof(body), "q=%s&a=loadgen+answer+%llu", query,
+                     (unsigned long long)conn->request);
+        } else {
+            snprintf(body, sizeof(body), "rating=%s&q=%s&a=loadgen+answer+%llu",
+                     conn->request % 2U ? "good" : "bad", query, (unsigned long long)conn->request);
+        }
+        written = snprintf(conn->out, sizeof(conn->out),
+                           "POST /api/knowledge/%s HTTP/1.1\r\n"
+                           "Host: %s\r\nConnection: keep-alive\r\n"
+                           "Authorization: Bearer %s\r\n"
+                           "Content-Type: application/x-www-form-urlencoded\r\n"
+                           "Content-Length: %zu\r\n\r\n%s",
+                           load_kind_names[conn->kind], config->host, config->token ? config->token : "",
+                           strlen(body), body);
+    }
+    conn->out_len = written < 0 ? 0U : (size_t)written < sizeof(conn->out) ? (size_t)written
+                                                                            : sizeof(conn->out) - 1U;
+    conn->out_sent = 0U;
+}
+
+static int connection_open(const LoadConfig *config, LoadConnection *conn) {
+    int fd = socket(config->address.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const struct sockaddr *)&config->address, config->address_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(fd);
+        return -1;
+    }
+    conn->fd = fd;
+    conn->in_len = 0U;
+    return 0;
+}
+
+static void connection_close(LoadConnection *conn) {
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    conn->in_len = 0U;
+}
+
+static int connection_send(LoadConnection *conn) {
+    while (conn->out_sent < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        conn->out_sent += (size_t)n;
+    }
+    return 0;
+}
+
+/* Case-insensitive header lookup inside [headers, end); the value is trimmed. */
+static int header_value(const char *headers, const char *end, const char *name, char *out, size_t cap) {
+    size_t name_len = strlen(name);
+    const char *line = headers;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', (size_t)(end - line));
+        if (!eol) {
+            eol = end;
+        }
+        if ((size_t)(eol - line) > name_len && strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *value = line + name_len + 1U;
+            while (value < eol && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            const char *value_end = eol;
+            while (value_end > value && (value_end[-1] == '\r' || value_end[-1] == ' ')) {
+                value_end--;
+            }
+            size_t len = (size_t)(value_end - value) < cap - 1U ? (size_t)(value_end - value) : cap - 1U;
+            memcpy(out, value, len);
+            out[len] = '\0';
+            return 0;
+        }
+        line = eol + 1;
+    }
+    return -1;
+}
+
+/* Walks a chunked body: 1 when the terminating chunk has arrived, 0 for more, -1 malformed. */
+static int chunked_complete(const char *body, const char *end, size_t *out_length) {
+    const char *cursor = body;
+    for (;;) {
+        const char *eol = memchr(cursor, '\n', (size_t)(end - cursor));
+        if (!eol) {
+            return 0;
+        }
+        char *size_end = NULL;
+        unsigned long size = strtoul(cursor, &size_end, 16);
+        if (size_end == cursor) {
+            return -1;
+        }
+        cursor = eol + 1;
+        if (size == 0UL) {
+            /* No trailers are sent, so the body ends at the next blank line. */
+            if (end - cursor < 2) {
+                return 0;
+            }
+            *out_length = (size_t)(cursor + 2 - body);
+            return 1;
+        }
+        if ((size_t)(end - cursor) < size + 2U) {
+            return 0;
+        }
+        cursor += size + 2U;
+    }
+}
+
+/*
+ * 1 when conn->in holds a whole response (status, its length and whether the
+ * server closes the connection after it), 0 when more bytes are needed and
+ * -1 when the response cannot be framed.
+ */
+static int response_complete(const LoadConnection *conn, int *out_status, size_t *out_length, int *out_close) {
+    const char *start = conn->in;
+    const char *end = conn->in + conn->in_len;
+    const char *marker = NULL;
+    for (const char *p = start; p + 4 <= end; ++p) {
+        if (p[0] == '\r' && p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+            marker = p;
+            break;
+        }
+    }
+    if (!marker) {
+        return conn->in_len > LOADGEN_RESPONSE_MAX ? -1 : 0;
+    }
+    int status = 0;
+    if (conn->in_len < 12U || strncmp(start, "HTTP/1.", 7) != 0 || sscanf(start + 8, " %d", &status) != 1) {
+        return -1;
+    }
+    const char *headers = memchr(start, '\n', (size_t)(marker - start));
+    headers = headers ? headers + 1 : marker;
+    const char *body = marker + 4;
+    char value[64];
+    *out_close = header_value(headers, marker, "Connection", value, sizeof(value)) == 0 &&
+                 strcasecmp(value, "close") == 0;
+    *out_status = status;
+    if (header_value(headers, marker, "Transfer-Encoding", value, sizeof(value)) == 0 &&
+        strcasecmp(value, "chunked") == 0) {
+        size_t body_length = 0U;
+        int framed = chunked_complete(body, end, &body_length);
+        if (framed > 0) {
+            *out_length = (size_t)(body - start) + body_length;
+        }
+        return framed;
+    }
+    size_t content_length = 0U;
+    if (header_value(headers, marker, "Content-Length", value, sizeof(value)) == 0) {
+        content_length = (size_t)strtoull(value, NULL, 10);
+    }
+    if ((size_t)(end - body) < content_length) {
+        return 0;
+    }
+    *out_length = (size_t)(body - start) + content_length;
+    return 1;
+}
+
+static LoadStats *worker_stats(LoadWorker *worker, const LoadConnection *conn) {
+    return conn->intended_ns >= worker->config->record_from_ns ? &worker->stats[conn->kind] : NULL;
+}
+
+static void finish_request(LoadWorker *worker, LoadConnection *conn, int status) {
+    LoadStats *stats = worker_stats(worker, conn);
+    conn->busy = 0;
+    if (!stats) {
+        return;
+    }
+    uint64_t now = monotonic_ns();
+    stats->requests++;
+    if (status >= 200 && status < 300) {
+        stats->ok++;
+    } else if (status == 429) {
+        stats->rate_limited++;
+    } else if (status >= 500) {
+        stats->server_errors++;
+    } else {
+        stats->client_errors++;
+    }
+    (void)samples_push(&stats->latency, now - conn->intended_ns);
+    (void)samples_push(&stats->service, now - conn->sent_ns);
+}
+
+static void fail_request(LoadWorker *worker, LoadConnection *conn, int timed_out) {
+    LoadStats *stats = worker_stats(worker, conn);
+    conn->busy = 0;
+    connection_close(conn);
+    if (!stats) {
+        return;
+    }
+    stats->requests++;
+    if (timed_out) {
+        stats->timeouts++;
+    } else {
+        stats->socket_errors++;
+    }
+}
+
+static int start_request(LoadWorker *worker, LoadConnection *conn, uint64_t index) {
+    const LoadConfig *config = worker->config;
+    if (conn->fd < 0) {
+        worker->connects++;
+        if (connection_open(config, conn) != 0) {
+            worker->connect_errors++;
+            return -1;
+        }
+    }
+    conn->busy = 1;
+    conn->retried = 0;
+    conn->request = index * config->threads + worker->id;
+    conn->kind = request_kind(config, conn->request);
+    conn->intended_ns = request_due_ns(config, conn->request);
+    conn->sent_ns = monotonic_ns();
+    conn->in_len = 0U;
+    build_request(config, conn);
+    if (connection_send(conn) != 0) {
+        fail_request(worker, conn, 0);
+    }
+    return 0;
+}
+
+/*
+ * A keep-alive connection the server closed while idle reads EOF before any
+ * byte of the answer; the request is sent once more on a fresh connection.
+ */
+static void retry_request(LoadWorker *worker, LoadConnection *conn) {
+    connection_close(conn);
+    worker->connects++;
+    if (connection_open(worker->config, conn) != 0) {
+        worker->connect_errors++;
+        fail_request(worker, conn, 0);
+        return;
+    }
+    conn->retried = 1;
+    conn->out_sent = 0U;
+    if (connection_send(conn) != 0) {
+        fail_request(worker, conn, 0);
+    }
+}
+
+static void connection_read(LoadWorker *worker, LoadConnection *conn) {
+    for (;;) {
+        if (conn->in_capacity - conn->in_len < 4096U) {
+            size_t capacity = conn->in_capacity ? conn->in_capacity * 2U : 16384U;
+            char *grown = (char *)realloc(conn->in, capacity);
+            if (!grown) {
+                fail_request(worker, conn, 0);
+                return;
+            }
+            conn->in = grown;
+            conn->in_capacity = capacity;
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_capacity - conn->in_len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (n <= 0) {
+            if (!conn->busy) {
+                connection_close(conn);
+            } else if (n == 0 && conn->in_len == 0U && !conn->retried) {
+                retry_request(worker, conn);
+            } else {
+                fail_request(worker, conn, 0);
+            }
+            return;
+        }
+        if (!conn->busy) {
+            /* Bytes nobody asked for; the connection is out of step. */
+            connection_close(conn);
+            return;
+        }
+        conn->in_len += (size_t)n;
+        int status = 0;
+        size_t length = 0U;
+        int closing = 0;
+        int framed = response_complete(conn, &status, &length, &closing);
+        if (framed < 0 || (framed > 0 && length != conn->in_len)) {
+            /* Malformed, or bytes beyond the answer of a request never pipelined. */
+            fail_request(worker, conn, 0);
+            return;
+        }
+        if (framed > 0) {
+            finish_request(worker, conn, status);
+            conn->in_len = 0U;
+            if (closing) {
+                connection_close(conn);
+            }
+            return;
+        }
+    }
+}
+
+static LoadConnection *idle_connection(LoadWorker *worker) {
+    for (size_t step = 0; step < worker->conn_count; ++step) {
+        LoadConnection *conn = &worker->conns[(worker->cursor + step) % worker->conn_count];
+        if (!conn->busy) {
+            worker->cursor = (worker->cursor + step + 1U) % worker->conn_count;
+            return conn;
+        }
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg) {
+    LoadWorker *worker = (LoadWorker *)arg;
+    const LoadConfig *config = worker->config;
+    struct pollfd *fds = (struct pollfd *)calloc(worker->conn_count, sizeof(struct pollfd));
+    LoadConnection **polled = (LoadConnection **)calloc(worker->conn_count, sizeof(LoadConnection *));
+    if (!fds || !polled) {
+        free(fds);
+        free(polled);
+        worker->unsent = worker->total;
+        return NULL;
+    }
+    uint64_t drain_deadline = config->end_ns + config->timeout_ns;
+    for (;;) {
+        uint64_t now = monotonic_ns();
+        while (worker->scheduled < worker->total &&
+               request_due_ns(config, worker->scheduled * config->threads + worker->id) <= now) {
+            worker->scheduled++;
+        }
+        while (worker->issued < worker->scheduled) {
+            LoadConnection *conn = idle_connection(worker);
+            if (!conn || start_request(worker, conn, worker->issued) != 0) {
+                break;
+            }
+            worker->issued++;
+        }
+        if (worker->scheduled - worker->issued > worker->backlog_max) {
+            worker->backlog_max = worker->scheduled - worker->issued;
+        }
+
+        size_t busy = 0U;
+        size_t count = 0U;
+        for (size_t i = 0; i < worker->conn_count; ++i) {
+            LoadConnection *conn = &worker->conns[i];
+            if (conn->busy && now > conn->sent_ns + config->timeout_ns) {
+                fail_request(worker, conn, 1);
+            }
+            busy += conn->busy ? 1U : 0U;
+            if (conn->fd >= 0) {
+                fds[count].fd = conn->fd;
+                fds[count].events = POLLIN;
+                if (conn->busy && conn->out_sent < conn->out_len) {
+                    fds[count].events |= POLLOUT;
+                }
+                fds[count].revents = 0;
+                polled[count++] = conn;
+            }
+        }
+        if (worker->issued == worker->total && busy == 0U) {
+            break;
+        }
+        if (now >= drain_deadline) {
+            worker->unsent = worker->total - worker->issued;
+            for (size_t i = 0; i < worker->conn_count; ++i) {
+                if (worker->conns[i].busy) {
+                    fail_request(worker, &worker->conns[i], 1);
+                }
+            }
+            break;
+        }
+
+        /* Sleeps until the next due request; with a backlog only answers matter. */
+        int timeout_ms = LOADGEN_POLL_MAX_MS;
+        if (worker->scheduled < worker->total && worker->issued == worker->scheduled) {
+            uint64_t due = request_due_ns(config, worker->scheduled * config->threads + worker->id);
+            uint64_t wait = due > now ? due - now : 0U;
+            timeout_ms = wait / 1000000U < (uint64_t)timeout_ms ? (int)(wait / 1000000U) : timeout_ms;
+        } else if (worker->issued < worker->scheduled && busy < worker->conn_count) {
+            /* Idle connections exist but could not connect; retry soon. */
+            timeout_ms = 1;
+        }
+        int ready = poll(fds, (nfds_t)count, timeout_ms);
+        if (ready <= 0) {
+            continue;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            LoadConnection *conn = polled[i];
+            if (fds[i].revents == 0 || conn->fd != fds[i].fd) {
+                continue;
+            }
+            if ((fds[i].revents & POLLOUT) && conn->busy && connection_send(conn) != 0) {
+                fail_request(worker, conn, 0);
+                continue;
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                connection_read(worker, conn);
+            }
+        }
+    }
+    free(fds);
+    free(polled);
+    return NULL;
+}
+
+static int parse_double(const char *text, double *out) {
+    char *end = NULL;
+    double value = strtod(text, &end);
+    if (!end || *end != '\0' || !(value >= 0.0)) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+static int parse_size(const char *text, size_t *out) {
+    char *end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (!end || *end != '\0' || text[0] == '-') {
+        return -1;
+    }
+    *out = (size_t)value;
+    return 0;
+}
+
+static int parse_mix(const char *text, LoadConfig *config) {
+    unsigned values[LOAD_KINDS] = {0U, 0U, 0U};
+    if (sscanf(text, "%u,%u,%u", &values[0], &values[1], &values[2]) < 1) {
+        return -1;
+    }
+    config->mix_total = 0U;
+    for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+        config->mix[kind] = values[kind];
+        config->mix_total += values[kind];
+    }
+    return config->mix_total > 0U ? 0 : -1;
+}
+
+static int resolve_target(LoadConfig *config) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char port[16];
+    snprintf(port, sizeof(port), "%u", config->port);
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(config->host, port, &hints, &result) != 0 || !result) {
+        return -1;
+    }
+    memcpy(&config->address, result->ai_addr, result->ai_addrlen);
+    config->address_len = (socklen_t)result->ai_addrlen;
+    freeaddrinfo(result);
+    return 0;
+}
+
+static void stats_sort(LoadStats *stats) {
+    qsort(stats->latency.values, stats->latency.count, sizeof(uint64_t), compare_u64);
+    qsort(stats->service.values, stats->service.count, sizeof(uint64_t), compare_u64);
+}
+
+/* Both printers expect the samples sorted by stats_sort. */
+static void print_stats_json(FILE *out, const char *name, const LoadStats *stats, double elapsed) {
+    uint64_t failed = stats->requests - stats->ok;
+    fprintf(out,
+            "\"%s\":{\"requests\":%llu,\"ok\":%llu,\"client_errors\":%llu,\"rate_limited\":%llu,"
+            "\"server_errors\":%llu,\"socket_errors\":%llu,\"timeouts\":%llu,\"error_rate\":%.6f,"
+            "\"rps\":%.1f,\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,"
+            "\"p9999\":%.3f,\"max\":%.3f},\"service_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}}",
+            name, (unsigned long long)stats->requests, (unsigned long long)stats->ok,
+            (unsigned long long)stats->client_errors, (unsigned long long)stats->rate_limited,
+            (unsigned long long)stats->server_errors, (unsigned long long)stats->socket_errors,
+            (unsigned long long)stats->timeouts,
+            stats->requests ? (double)failed / (double)stats->requests : 0.0,
+            elapsed > 0.0 ? (double)stats->requests / elapsed : 0.0, percentile_ms(&stats->latency, 0.50),
+            percentile_ms(&stats->latency, 0.90), percentile_ms(&stats->latency, 0.99),
+            percentile_ms(&stats->latency, 0.999), percentile_ms(&stats->latency, 0.9999),
+            percentile_ms(&stats->latency, 1.0), percentile_ms(&stats->service, 0.50),
+            percentile_ms(&stats->service, 0.99), percentile_ms(&stats->service, 1.0));
+}
+
+static void print_stats_row(const char *name, const LoadStats *stats) {
+    printf("%-9s %9llu %9llu %7llu %7llu %7llu %7llu %7llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+           (unsigned long long)stats->requests, (unsigned long long)stats->ok,
+           (unsigned long long)stats->client_errors, (unsigned long long)stats->rate_limited,
+           (unsigned long long)stats->server_errors, (unsigned long long)stats->socket_errors,
+           (unsigned long long)stats->timeouts, percentile_ms(&stats->latency, 0.50),
+           percentile_ms(&stats->latency, 0.99), percentile_ms(&stats->latency, 0.999),
+           percentile_ms(&stats->latency, 1.0), percentile_ms(&stats->service, 0.99));
+}
+
+static void stats_add(LoadStats *dst, const LoadStats *src) {
+    dst->requests += src->requests;
+    dst->ok += src->ok;
+    dst->client_errors += src->client_errors;
+    dst->rate_limited += src->rate_limited;
+    dst->server_errors += src->server_errors;
+    dst->socket_errors += src->socket_errors;
+    dst->timeouts += src->timeouts;
+    (void)samples_merge(&dst->latency, &src->latency);
+    (void)samples_merge(&dst->service, &src->service);
+}
+
+static void stats_free(LoadStats *stats) {
+    free(stats->latency.values);
+    free(stats->service.values);
+}
+
+int main(int argc, char **argv) {
+    LoadConfig config;
+    memset(&config, 0, sizeof(config));
+    snprintf(config.host, sizeof(config.host), "127.0.0.1");
+    config.port = LOADGEN_DEFAULT_PORT;
+    config.rate = 100.0;
+    config.duration_sec = 10.0;
+    config.warmup_sec = 1.0;
+    config.connections = 16U;
+    config.threads = 1U;
+    config.mix[LOAD_SEARCH] = 100U;
+    config.mix_total = 100U;
+    config.limit = 3U;
+    config.token = getenv("KOLIBRI_KNOWLEDGE_ADMIN_TOKEN");
+    size_t timeout_ms = 10000U;
+    const char *queries_path = NULL;
+    const char *json_path = NULL;
+    char **loaded = NULL;
+
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        size_t port = 0U;
+        int bad = 0;
+        if (strcmp(arg, "--help") == 0) {
+            print_usage();
+            return 0;
+        }
+        if (!value) {
+            bad = 1;
+        } else if (strcmp(arg, "--host") == 0) {
+            bad = strlen(value) >= sizeof(config.host);
+            snprintf(config.host, sizeof(config.host), "%s", value);
+        } else if (strcmp(arg, "--port") == 0) {
+            bad = parse_size(value, &port) != 0 || port == 0U || port > 65535U;
+            config.port = (unsigned)port;
+        } else if (strcmp(arg, "--rate") == 0) {
+            bad = parse_double(value, &config.rate) != 0 || config.rate <= 0.0;
+        } else if (strcmp(arg, "--duration") == 0) {
+            bad = parse_double(value, &config.duration_sec) != 0 || config.duration_sec <= 0.0;
+        } else if (strcmp(arg, "--warmup") == 0) {
+            bad = parse_double(value, &config.warmup_sec) != 0;
+        } else if (strcmp(arg, "--connections") == 0) {
+            bad = parse_size(value, &config.connections) != 0 || config.connections == 0U;
+        } else if (strcmp(arg, "--threads") == 0) {
+            bad = parse_size(value, &config.threads) != 0 || config.threads == 0U;
+        } else if (strcmp(arg, "--mix") == 0) {
+            bad = parse_mix(value, &config) != 0;
+        } else if (strcmp(arg, "--queries") == 0) {
+            queries_path = value;
+        } else if (strcmp(arg, "--limit") == 0) {
+            bad = parse_size(value, &config.limit) != 0;
+        } else if (strcmp(arg, "--token") == 0) {
+            config.token = value;
+        } else if (strcmp(arg, "--timeout-ms") == 0) {
+            bad = parse_size(value, &timeout_ms) != 0 || timeout_ms == 0U;
+        } else if (strcmp(arg, "--json") == 0) {
+            json_path = value;
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            print_usage();
+            return 1;
+        }
+        ++i;
+    }
+    if ((config.mix[LOAD_TEACH] || config.mix[LOAD_FEEDBACK]) && (!config.token || !config.token[0])) {
+        fprintf(stderr, "[kolibri-loadgen] teach/feedback need --token or KOLIBRI_KNOWLEDGE_ADMIN_TOKEN\n");
+        return 1;
+    }
+    if (config.threads > config.connections) {
+        config.threads = config.connections;
+    }
+    if (queries_path) {
+        loaded = load_queries(queries_path, &config.query_count);
+        if (!loaded || config.query_count == 0U) {
+            fprintf(stderr, "[kolibri-loadgen] no queries in %s\n", queries_path);
+            free_queries(loaded, config.query_count);
+            return 1;
+        }
+        config.queries = (const char *const *)loaded;
+    } else {
+        config.queries = load_default_queries;
+        config.query_count = sizeof(load_default_queries) / sizeof(load_default_queries[0]);
+    }
+    if (resolve_target(&config) != 0) {
+        fprintf(stderr, "[kolibri-loadgen] cannot resolve %s:%u\n", config.host, config.port);
+        free_queries(loaded, loaded ? config.query_count : 0U);
+        return 1;
+    }
+    config.timeout_ns = (uint64_t)timeout_ms * 1000000ULL;
+    config.total = (uint64_t)(config.rate * (config.warmup_sec + config.duration_sec));
+
+    LoadWorker *workers = (LoadWorker *)calloc(config.threads, sizeof(LoadWorker));
+    LoadConnection *conns = (LoadConnection *)calloc(config.connections, sizeof(LoadConnection));
+    pthread_t *handles = (pthread_t *)calloc(config.threads, sizeof(pthread_t));
+    unsigned char *started = (unsigned char *)calloc(config.threads, 1U);
+    int status = 0;
+    if (!workers || !conns || !handles || !started) {
+        fprintf(stderr, "[kolibri-loadgen] allocation failure\n");
+        status = 1;
+    }
+
+    /* Every connection is opened up front and held for the whole run. */
+    size_t opened = 0U;
+    for (size_t i = 0; status == 0 && i < config.connections; ++i) {
+        conns[i].fd = -1;
+        opened += connection_open(&config, &conns[i]) == 0 ? 1U : 0U;
+    }
+    if (status == 0 && opened == 0U) {
+        fprintf(stderr, "[kolibri-loadgen] cannot connect to %s:%u\n", config.host, config.port);
+        status = 1;
+    }
+
+    double elapsed = 0.0;
+    if (status == 0) {
+        size_t offset = 0U;
+        for (size_t t = 0; t < config.threads; ++t) {
+            LoadWorker *worker = &workers[t];
+            worker->config = &config;
+            worker->id = t;
+            worker->conn_count = config.connections / config.threads +
+                                 (t < config.connections % config.threads ? 1U : 0U);
+            worker->conns = &conns[offset];
+            offset += worker->conn_count;
+            worker->total = config.total / config.threads + (t < config.total % config.threads ? 1U : 0U);
+        }
+        config.start_ns = monotonic_ns() + 10000000ULL;
+        config.record_from_ns = config.start_ns + (uint64_t)(config.warmup_sec * 1e9);
+        config.end_ns = request_due_ns(&config, config.total);
+        for (size_t t = 1; t < config.threads; ++t) {
+            started[t] = pthread_create(&handles[t], NULL, worker_main, &workers[t]) == 0;
+            if (!started[t]) {
+                workers[t].unsent = workers[t].total;
+            }
+        }
+        worker_main(&workers[0]);
+        for (size_t t = 1; t < config.threads; ++t) {
+            if (started[t]) {
+                pthread_join(handles[t], NULL);
+            }
+        }
+        uint64_t finished = monotonic_ns();
+        elapsed = (double)(finished - config.record_from_ns) / 1e9;
+    }
+
+    if (status == 0) {
+        LoadStats kinds[LOAD_KINDS];
+        LoadStats total;
+        memset(kinds, 0, sizeof(kinds));
+        memset(&total, 0, sizeof(total));
+        uint64_t connects = 0U;
+        uint64_t connect_errors = 0U;
+        uint64_t backlog_max = 0U;
+        uint64_t unsent = 0U;
+        for (size_t t = 0; t < config.threads; ++t) {
+            for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+                stats_add(&kinds[kind], &workers[t].stats[kind]);
+                stats_add(&total, &workers[t].stats[kind]);
+            }
+            connects += workers[t].connects;
+            connect_errors += workers[t].connect_errors;
+            backlog_max = workers[t].backlog_max > backlog_max ? workers[t].backlog_max : backlog_max;
+            unsent += workers[t].unsent;
+        }
+
+        stats_sort(&total);
+        for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+            stats_sort(&kinds[kind]);
+        }
+        FILE *json = NULL;
+        if (json_path) {
+            json = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+            if (!json) {
+                fprintf(stderr, "[kolibri-loadgen] cannot write %s\n", json_path);
+                status = 1;
+            }
+        }
+        if (json) {
+            FILE *sink = json;
+            fprintf(sink,
+                    "{\"target\":\"%s:%u\",\"rate\":%.1f,\"duration_sec\":%.3f,\"warmup_sec\":%.3f,"
+                    "\"connections\":%zu,\"threads\":%zu,\"mix\":[%u,%u,%u],\"queries\":%zu,"
+                    "\"elapsed_sec\":%.3f,\"opened\":%zu,\"reconnects\":%llu,\"connect_errors\":%llu,"
+                    "\"backlog_max\":%llu,\"unsent\":%llu,",
+                    config.host, config.port, config.rate, config.duration_sec, config.warmup_sec,
+                    config.connections, config.threads, config.mix[0], config.mix[1], config.mix[2],
+                    config.query_count, elapsed, opened, (unsigned long long)connects,
+                    (unsigned long long)connect_errors, (unsigned long long)backlog_max,
+                    (unsigned long long)unsent);
+            print_stats_json(sink, "total", &total, elapsed);
+            fputs(",\"kinds\":{", sink);
+            int first = 1;
+            for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+                if (config.mix[kind] == 0U) {
+                    continue;
+                }
+                fputs(first ? "" : ",", sink);
+                print_stats_json(sink, load_kind_names[kind], &kinds[kind], elapsed);
+                first = 0;
+            }
+            fputs("}}\n", sink);
+            if (sink != stdout && fclose(sink) != 0) {
+                fprintf(stderr, "[kolibri-loadgen] cannot write %s\n", json_path);
+                status = 1;
+            }
+        }
+        if (!json || json != stdout) {
+            printf("%s:%u  %.1f req/s for %.1f s, %zu connections, %zu thread(s), achieved %.1f req/s\n",
+                   config.host, config.port, config.rate, config.duration_sec, config.connections,
+                   config.threads, elapsed > 0.0 ? (double)total.requests / elapsed : 0.0);
+            printf("%-9s %9s %9s %7s %7s %7s %7s %7s %9s %9s %9s %9s %9s\n", "kind", "requests", "ok", "4xx",
+                   "429", "5xx", "socket", "timeout", "p50 ms", "p99 ms", "p99.9 ms", "max ms", "svc p99");
+            for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+                if (config.mix[kind] != 0U) {
+                    print_stats_row(load_kind_names[kind], &kinds[kind]);
+                }
+            }
+            print_stats_row("total", &total);
+            printf("reconnects %llu, connect errors %llu, largest backlog %llu, unsent %llu\n",
+                   (unsigned long long)connects, (unsigned long long)connect_errors,
+                   (unsigned long long)backlog_max, (unsigned long long)unsent);
+        }
+        if (total.requests == 0U || total.ok == 0U) {
+            status = 1;
+        }
+        for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+            stats_free(&kinds[kind]);
+        }
+        stats_free(&total);
+    }
+
+    for (size_t t = 0; workers && t < config.threads; ++t) {
+        for (int kind = 0; kind < LOAD_KINDS; ++kind) {
+            stats_free(&workers[t].stats[kind]);
+        }
+    }
+    for (size_t i = 0; conns && i < config.connections; ++i) {
+        connection_close(&conns[i]);
+        free(conns[i].in);
+    }
+    free(started);
+    free(handles);
+    free(conns);
+    free(workers);
+    free_queries(loaded, loaded ? config.query_count : 0U);
+    return status;
+}
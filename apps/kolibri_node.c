@@ -5,20 +5,43 @@
 #include "kolibri/decimal.h"
 #include "kolibri/formula.h"
 #include "kolibri/genome.h"
+#include "kolibri/island.h"
+#include "kolibri/log.h"
 #include "kolibri/net.h"
 #include "kolibri/script.h"
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 
 #define KOLIBRI_MEMORY_CAPACITY 8192U
+#define KOLIBRI_NODE_TICK_DEADLINE_MS 250U
+/* Scripts yield to the listener this often. */
+#define KOLIBRI_NODE_SCRIPT_SLICE_NS 5000000ULL
+#define KOLIBRI_NODE_EVOLVE_BUDGET_MS 20U
+/* Continuous evolution records an EVOLVE block at most this often. */
+#define KOLIBRI_NODE_EVOLVE_RECORD_MS 1000U
+/* Longest poll wait; listeners without a readiness fd are polled this often. */
+#define KOLIBRI_NODE_IDLE_MS 1000U
+#define KOLIBRI_NODE_LISTENER_POLL_MS 20U
+#define KOLIBRI_NODE_IDLE_RETRY_MS 100U
+#define KOLIBRI_NODE_MAX_TIMERS 4U
+#define KOLIBRI_NODE_MAX_SOURCES 4U
+/* Imported formulas waiting for the worker; later ones are dropped. */
+/* Migrants waiting for the next evolution cycle, and how many of the fittest
+ * enter the pool per cycle. */
+#define KOLIBRI_NODE_INBOX_CAPACITY 64U
+#define KOLIBRI_NODE_MIGRANTS_PER_CYCLE 4U
+#define KOLIBRI_NODE_CHECKPOINT_MS 60000U
 
 typedef enum {
     KOLIBRI_KEY_SOURCE_DEFAULT,
@@ -37,6 +60,10 @@ typedef struct {
     bool verify_genome;
     char genome_path[260];
     char bootstrap_script[260];
+    /* Pool checkpoint restored at startup and saved every checkpoint_ms
+     * (0: only on exit); empty disables checkpoints. */
+    char checkpoint_path[260];
+    uint32_t checkpoint_ms;
     KolibriKeySource hmac_key_source;
     unsigned char hmac_key_inline[KOLIBRI_HMAC_KEY_SIZE];
     size_t hmac_key_inline_len;
@@ -44,20 +71,46 @@ typedef struct {
     bool health_check;
     bool auto_learn;
     uint32_t auto_evolve_ms;
+    bool auto_evolve_set;
     uint32_t auto_sync_ms;
+    uint32_t evolve_budget_ms;
+    bool daemon;
+    uint32_t islands;
+    KolibriMigrationPolicy migration;
+    /* Diagnostics sink: a file (empty: the standard streams), its format, the
+     * lowest level kept and records per second per call site (0: no limit). */
+    char log_path[260];
+    KolibriLogFormat log_format;
+    KolibriLogLevel log_level;
+    uint32_t log_rate;
 } KolibriNodeOptions;
 
+struct KolibriNodeCommand;
+struct KolibriNodeSnapshot;
+
+/*
+ * Once the worker runs, it alone touches the pool, the archipelago and the
+ * script. Other threads send it commands and read the snapshot it publishes.
+ */
 typedef struct {
     KolibriNodeOptions options;
     KolibriGenome genome;
     bool genome_ready;
+    pthread_mutex_t genome_lock;
     KolibriFormulaPool pool;
+    KolibriArchipelago archipelago;
+    bool archipelago_ready;
     KolibriScript script;
     bool script_ready;
+    /* Lines of a :ks block that is still open. */
+    char script_pending[4096];
+    size_t script_pending_len;
     uint8_t memory_buffer[KOLIBRI_MEMORY_CAPACITY];
     k_digit_stream memory;
     bool listener_ready;
     KolibriNetListener listener;
+    /* The --peer connection stays open between syncs. */
+    KolibriNetPeers peers;
     KolibriGene last_gene;
     bool last_gene_valid;
     int last_question;
@@ -65,10 +118,88 @@ typedef struct {
     unsigned char hmac_key[KOLIBRI_HMAC_KEY_SIZE];
     size_t hmac_key_len;
     char hmac_key_origin[320];
-    uint64_t last_evolve_ms;
-    uint64_t last_sync_ms;
+    bool running;
+    /* Bytes read from stdin that do not form a whole line yet. */
+    char input[1024];
+    size_t input_len;
+    uint64_t last_evolve_record_ms;
+    bool checkpoint_restored;
+    uint64_t checkpoint_hash;
+    pthread_t worker;
+    bool worker_running;
+    pthread_mutex_t worker_lock;
+    pthread_cond_t worker_wake;
+    pthread_cond_t worker_done;
+    struct KolibriNodeCommand *queue_head;
+    struct KolibriNodeCommand *queue_tail;
+    /* Distinct migrant genes, guarded by worker_lock. */
+    KolibriFormula inbox[KOLIBRI_NODE_INBOX_CAPACITY];
+    size_t inbox_count;
+    size_t inbox_received;
+    KolibriFormula migrants[KOLIBRI_NODE_INBOX_CAPACITY];
+    bool worker_stop;
+    /* Published by the worker, taken by the main thread, which owns snapshot. */
+    struct KolibriNodeSnapshot *published;
+    struct KolibriNodeSnapshot *snapshot;
+    /* The worker's newest association table, shared by its snapshots. */
+    struct KolibriNodeAssociations *associations;
+    bool associations_dirty;
 } KolibriNode;
 
+/* Associations are immutable once built and freed with their last snapshot. */
+typedef struct KolibriNodeAssociations {
+    unsigned refs;
+    size_t count;
+    KolibriAssociation items[];
+} KolibriNodeAssociations;
+
+/* What commands on other threads may read; best.associations points into associations. */
+typedef struct KolibriNodeSnapshot {
+    bool has_best;
+    KolibriFormula best;
+    KolibriNodeAssociations *associations;
+    KolibriPoolProfile profile;
+    size_t examples;
+} KolibriNodeSnapshot;
+
+/* A call for the worker thread; the caller waits for done. */
+typedef struct KolibriNodeCommand {
+    void (*run)(KolibriNode *node, void *arg);
+    void *arg;
+    bool done;
+    struct KolibriNodeCommand *next;
+} KolibriNodeCommand;
+
+/*
+ * A timer with interval_ms 0 fires on every pass of the loop while it has
+ * work; fire returns false when it had none, and the timer then waits
+ * KOLIBRI_NODE_IDLE_RETRY_MS.
+ */
+typedef struct {
+    uint32_t interval_ms;
+    uint64_t due_ms;
+    bool (*fire)(KolibriNode *node);
+} KolibriNodeTimer;
+
+/* fd -1 marks a source without a readiness fd; it is serviced on every pass. */
+typedef struct {
+    int fd;
+    void (*ready)(KolibriNode *node);
+} KolibriNodeSource;
+
+typedef struct {
+    KolibriNodeTimer timers[KOLIBRI_NODE_MAX_TIMERS];
+    size_t timer_count;
+    KolibriNodeSource sources[KOLIBRI_NODE_MAX_SOURCES];
+    size_t source_count;
+} KolibriNodeLoop;
+
+static volatile sig_atomic_t node_signalled = 0;
+
+static void node_call(KolibriNode *node, void (*run)(KolibriNode *node, void *arg), void *arg);
+static const KolibriNodeSnapshot *node_snapshot(KolibriNode *node);
+static void node_service_listener(KolibriNode *node);
+
 static const unsigned char KOLIBRI_HMAC_KEY[] = "kolibri-secret-key";
 
 static void options_init(KolibriNodeOptions *options) {
@@ -83,6 +214,8 @@ static void options_init(KolibriNodeOptions *options) {
     strncpy(options->genome_path, "genome.dat", sizeof(options->genome_path) - 1);
     options->genome_path[sizeof(options->genome_path) - 1] = '\0';
     options->bootstrap_script[0] = '\0';
+    options->checkpoint_path[0] = '\0';
+    options->checkpoint_ms = KOLIBRI_NODE_CHECKPOINT_MS;
     options->hmac_key_source = KOLIBRI_KEY_SOURCE_DEFAULT;
     memset(options->hmac_key_inline, 0, sizeof(options->hmac_key_inline));
     options->hmac_key_inline_len = 0U;
@@ -90,7 +223,16 @@ static void options_init(KolibriNodeOptions *options) {
     options->health_check = false;
     options->auto_learn = true;
     options->auto_evolve_ms = 500U;
+    options->auto_evolve_set = false;
     options->auto_sync_ms = 2000U;
+    options->evolve_budget_ms = KOLIBRI_NODE_EVOLVE_BUDGET_MS;
+    options->daemon = false;
+    options->islands = 1U;
+    kf_migration_policy_default(&options->migration);
+    options->log_path[0] = '\0';
+    options->log_format = KOLIBRI_LOG_FORMAT_TEXT;
+    options->log_level = KOLIBRI_LOG_LEVEL_INFO;
+    options->log_rate = 100U;
 }
 
 static void parse_options(int argc, char **argv, KolibriNodeOptions *options) {
@@ -142,6 +284,18 @@ static void parse_options(int argc, char **argv, KolibriNodeOptions *options) {
             ++i;
             continue;
         }
+        if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            strncpy(options->checkpoint_path, argv[i + 1],
+                    sizeof(options->checkpoint_path) - 1);
+            options->checkpoint_path[sizeof(options->checkpoint_path) - 1] = '\0';
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--checkpoint-ms") == 0 && i + 1 < argc) {
+            options->checkpoint_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
         if (strcmp(argv[i], "--verify-genome") == 0) {
             options->verify_genome = true;
             continue;
@@ -187,14 +341,81 @@ static void parse_options(int argc, char **argv, KolibriNodeOptions *options) {
         }
         if (strcmp(argv[i], "--auto-evolve-ms") == 0 && i + 1 < argc) {
             options->auto_evolve_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            options->auto_evolve_set = true;
             ++i;
             continue;
         }
+        if (strcmp(argv[i], "--evolve-budget-ms") == 0 && i + 1 < argc) {
+            options->evolve_budget_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--daemon") == 0) {
+            options->daemon = true;
+            continue;
+        }
         if (strcmp(argv[i], "--auto-sync-ms") == 0 && i + 1 < argc) {
             options->auto_sync_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
             ++i;
             continue;
         }
+        if (strcmp(argv[i], "--islands") == 0 && i + 1 < argc) {
+            options->islands = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--migration-topology") == 0 && i + 1 < argc) {
+            if (kf_migration_topology_parse(argv[i + 1], &options->migration.topology) != 0) {
+                fprintf(stderr, "[Острова] неизвестная топология %s, используется ring\n",
+                        argv[i + 1]);
+                options->migration.topology = KOLIBRI_MIGRATION_RING;
+            }
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--migration-interval") == 0 && i + 1 < argc) {
+            options->migration.interval = (size_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--migrants") == 0 && i + 1 < argc) {
+            options->migration.migrants = (size_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+            strncpy(options->log_path, argv[i + 1], sizeof(options->log_path) - 1);
+            options->log_path[sizeof(options->log_path) - 1] = '\0';
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--log-format") == 0 && i + 1 < argc) {
+            if (kolibri_log_parse_format(argv[i + 1], &options->log_format) != 0) {
+                fprintf(stderr, "[Журнал] неизвестный формат %s, используется text\n",
+                        argv[i + 1]);
+                options->log_format = KOLIBRI_LOG_FORMAT_TEXT;
+            }
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (kolibri_log_parse_level(argv[i + 1], &options->log_level) != 0) {
+                fprintf(stderr, "[Журнал] неизвестный уровень %s, используется info\n",
+                        argv[i + 1]);
+                options->log_level = KOLIBRI_LOG_LEVEL_INFO;
+            }
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--log-rate") == 0 && i + 1 < argc) {
+            options->log_rate = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
+    }
+    /* Without a console to wait on, a daemon evolves back to back by default. */
+    if (options->daemon && !options->auto_evolve_set) {
+        options->auto_evolve_ms = 0U;
     }
 }
 
@@ -362,11 +583,15 @@ static int node_record_event(KolibriNode *node, const char *event, const char *p
     }
     char encoded[KOLIBRI_PAYLOAD_SIZE];
     if (kg_encode_payload(payload, encoded, sizeof(encoded)) != 0) {
-        fprintf(stderr, "[Геном] не удалось закодировать событие %s\n", event);
+        KOLIBRI_LOG_ERROR("Геном", "не удалось закодировать событие %s", event);
         return -1;
     }
-    if (kg_append(&node->genome, event, encoded, NULL) != 0) {
-        fprintf(stderr, "[Геном] не удалось записать событие %s\n", event);
+    /* Both the console and the worker record events. */
+    pthread_mutex_lock(&node->genome_lock);
+    int status = kg_append(&node->genome, event, encoded, NULL);
+    pthread_mutex_unlock(&node->genome_lock);
+    if (status != 0) {
+        KOLIBRI_LOG_ERROR("Геном", "не удалось записать событие %s", event);
         return -1;
     }
     return 0;
@@ -386,11 +611,9 @@ static void node_store_text(KolibriNode *node, const char *text) {
     if (k_transduce_utf8(&local, (const unsigned char *)text, len) != 0) {
         return;
     }
-    for (size_t i = 0; i < local.length; ++i) {
-        if (k_digit_stream_push(&node->memory, local.digits[i]) != 0) {
-            break;
-        }
-    }
+    size_t room = node->memory.capacity - node->memory.length;
+    (void)k_digit_stream_push_bulk(&node->memory, local.digits,
+                                   local.length < room ? local.length : room);
 }
 
 static void node_reset_last_answer(KolibriNode *node) {
@@ -403,25 +626,27 @@ static void node_reset_last_answer(KolibriNode *node) {
     memset(&node->last_gene, 0, sizeof(node->last_gene));
 }
 
-static void node_apply_feedback(KolibriNode *node, double delta, const char *rating, const char *message) {
-    if (!node) {
-        return;
-    }
-    if (!node->last_gene_valid) {
-        printf("[Учитель] нет последнего ответа для оценки\n");
-        return;
-    }
-    if (kf_pool_feedback(&node->pool, &node->last_gene, delta) != 0) {
+typedef struct {
+    double delta;
+    const char *rating;
+    const char *message;
+} KolibriNodeFeedback;
+
+/* Worker side of :good/:bad. */
+static void node_feedback_run(KolibriNode *node, void *arg) {
+    const KolibriNodeFeedback *feedback = (const KolibriNodeFeedback *)arg;
+    if (kf_pool_feedback(&node->pool, &node->last_gene, feedback->delta) != 0) {
         printf("[Учитель] текущий ген уже изменился, повторите запрос\n");
         node_reset_last_answer(node);
         return;
     }
-    if (message) {
-        printf("%s\n", message);
+    if (feedback->message) {
+        printf("%s\n", feedback->message);
     }
     char payload[128];
     snprintf(payload, sizeof(payload), "rating=%s input=%d output=%d delta=%.3f",
-             rating ? rating : "unknown", node->last_question, node->last_answer, delta);
+             feedback->rating ? feedback->rating : "unknown", node->last_question,
+             node->last_answer, feedback->delta);
     node_record_event(node, "USER_FEEDBACK", payload);
     const KolibriFormula *best = kf_pool_best(&node->pool);
     if (best) {
@@ -432,6 +657,18 @@ static void node_apply_feedback(KolibriNode *node, double delta, const char *rat
     }
 }
 
+static void node_apply_feedback(KolibriNode *node, double delta, const char *rating, const char *message) {
+    if (!node) {
+        return;
+    }
+    if (!node->last_gene_valid) {
+        printf("[Учитель] нет последнего ответа для оценки\n");
+        return;
+    }
+    KolibriNodeFeedback feedback = {delta, rating, message};
+    node_call(node, node_feedback_run, &feedback);
+}
+
 static void node_handle_good(KolibriNode *node) {
     node_apply_feedback(node, 0.15, "good", "[Учитель] формула поощрена");
 }
@@ -440,15 +677,28 @@ static void node_handle_bad(KolibriNode *node) {
     node_apply_feedback(node, -0.25, "bad", "[Учитель] формула наказана");
 }
 
+/* Restarts and health checks only verify blocks appended since the last
+ * successful check; --verify still checks the whole chain. */
+static void node_verify_options(const KolibriNode *node, char *checkpoint,
+                                size_t checkpoint_size,
+                                KolibriGenomeVerifyOptions *options) {
+    snprintf(checkpoint, checkpoint_size, "%s.verified", node->options.genome_path);
+    options->threads = 0;
+    options->checkpoint_path = checkpoint;
+}
+
 static int node_open_genome(KolibriNode *node) {
     if (!node) {
         return -1;
     }
+    char checkpoint[300];
+    KolibriGenomeVerifyOptions verify;
+    node_verify_options(node, checkpoint, sizeof(checkpoint), &verify);
     if (node->options.verify_genome) {
         printf("[Геном] проверяем %s (ключ: %s)\n", node->options.genome_path,
                node->hmac_key_origin);
-        int status = kg_verify_file(node->options.genome_path, node->hmac_key,
-                                    node->hmac_key_len);
+        int status = kg_verify_file_ex(node->options.genome_path, node->hmac_key,
+                                       node->hmac_key_len, &verify);
         if (status == 1) {
             printf("[Геном] журнал отсутствует, создаём новый (ключ: %s)\n",
                    node->hmac_key_origin);
@@ -462,8 +712,8 @@ static int node_open_genome(KolibriNode *node) {
                    node->hmac_key_origin);
         }
     }
-    if (kg_open(&node->genome, node->options.genome_path, node->hmac_key,
-                node->hmac_key_len) != 0) {
+    if (kg_open_ex(&node->genome, node->options.genome_path, node->hmac_key,
+                   node->hmac_key_len, &verify) != 0) {
         fprintf(stderr,
                 "[Геном] не удалось открыть %s (ключ: %s)\n",
                 node->options.genome_path, node->hmac_key_origin);
@@ -511,8 +761,19 @@ static void node_print_canvas(const KolibriNode *node) {
     }
 }
 
-static void node_report_formula(const KolibriNode *node) {
-    const KolibriFormula *best = kf_pool_best(&node->pool);
+static void node_print_profile(KolibriNode *node) {
+    const KolibriNodeSnapshot *snapshot = node_snapshot(node);
+    char profile[512];
+    if (!snapshot || kf_pool_profile_json(&snapshot->profile, profile, sizeof(profile)) < 0) {
+        printf("[Профиль] не удалось сформировать отчёт\n");
+        return;
+    }
+    printf("%s\n", profile);
+}
+
+static void node_report_formula(KolibriNode *node) {
+    const KolibriNodeSnapshot *snapshot = node_snapshot(node);
+    const KolibriFormula *best = snapshot && snapshot->has_best ? &snapshot->best : NULL;
     if (!best) {
         printf("[Формулы] пока нет подходящих генов\n");
         return;
@@ -537,13 +798,13 @@ static void node_share_formula(KolibriNode *node) {
         printf("[Рой] соседи не заданы\n");
         return;
     }
-    const KolibriFormula *best = kf_pool_best(&node->pool);
+    const KolibriNodeSnapshot *snapshot = node_snapshot(node);
+    const KolibriFormula *best = snapshot && snapshot->has_best ? &snapshot->best : NULL;
     if (!best) {
         printf("[Рой] подходящая формула отсутствует\n");
         return;
     }
-    if (kn_share_formula(node->options.peer_host, node->options.peer_port,
-                         node->options.node_id, best) == 0) {
+    if (kn_peers_send_formula(&node->peers, 0U, best) == 0) {
         printf("[Рой] формула отправлена на %s:%u\n", node->options.peer_host,
                node->options.peer_port);
         node_record_event(node, "SYNC", "передан лучший ген");
@@ -552,28 +813,376 @@ static void node_share_formula(KolibriNode *node) {
     }
 }
 
-static void node_poll_listener(KolibriNode *node) {
-    if (!node->listener_ready) {
+/* Evolves the pool, on all islands when the node runs an archipelago. */
+static void node_evolve(KolibriNode *node, size_t generations) {
+    if (node->archipelago_ready) {
+        kf_archipelago_tick(&node->archipelago, generations);
+    } else {
+        kf_pool_tick(&node->pool, generations);
+    }
+}
+
+/* Pool checkpoints. */
+
+/* Runs on the worker, or on the main thread once the worker has stopped. */
+static void node_checkpoint_save(KolibriNode *node) {
+    uint64_t hash = 0;
+    if (kf_pool_save(&node->pool, node->options.checkpoint_path, &hash) != 0) {
+        KOLIBRI_LOG_ERROR("Чекпоинт", "не удалось записать %s", node->options.checkpoint_path);
+        return;
+    }
+    /* An unchanged pool writes the same bytes, and the genome already names them. */
+    if (hash == node->checkpoint_hash) {
+        return;
+    }
+    node->checkpoint_hash = hash;
+    char payload[32];
+    snprintf(payload, sizeof(payload), "fnv1a64=%016" PRIx64, hash);
+    node_record_event(node, "CHECKPOINT", payload);
+}
+
+static void node_checkpoint_run(KolibriNode *node, void *arg) {
+    (void)arg;
+    node_checkpoint_save(node);
+}
+
+static bool node_checkpoint_timer(KolibriNode *node) {
+    node_call(node, node_checkpoint_run, NULL);
+    return true;
+}
+
+/* A missing checkpoint starts a fresh pool; a damaged one stops the node
+ * rather than being overwritten by the next save. */
+static int node_restore_checkpoint(KolibriNode *node) {
+    const char *path = node->options.checkpoint_path;
+    if (path[0] == '\0' || node->options.health_check) {
+        return 0;
+    }
+    uint64_t hash = 0;
+    int status = kf_pool_load(&node->pool, path, &hash);
+    if (status == 1) {
+        KOLIBRI_LOG_INFO("Чекпоинт", "%s не найден, пул начинается с нуля", path);
+        return 0;
+    }
+    if (status != 0) {
+        KOLIBRI_LOG_ERROR("Чекпоинт", "%s повреждён или не подходит пулу", path);
+        return -1;
+    }
+    node->checkpoint_restored = true;
+    node->checkpoint_hash = hash;
+    KOLIBRI_LOG_INFO("Чекпоинт", "пул восстановлен из %s: примеров %zu, ассоциаций %zu", path,
+                     node->pool.examples, node->pool.association_count);
+    return 0;
+}
+
+/* Evolution worker. */
+
+static void node_deadline(struct timespec *until, uint64_t ms) {
+    clock_gettime(CLOCK_REALTIME, until);
+    until->tv_sec += (time_t)(ms / 1000U);
+    until->tv_nsec += (long)(ms % 1000U) * 1000000L;
+    if (until->tv_nsec >= 1000000000L) {
+        until->tv_sec += 1;
+        until->tv_nsec -= 1000000000L;
+    }
+}
+
+static void node_associations_release(KolibriNodeAssociations *table) {
+    if (table && __atomic_sub_fetch(&table->refs, 1U, __ATOMIC_ACQ_REL) == 0U) {
+        free(table);
+    }
+}
+
+static void node_snapshot_free(KolibriNodeSnapshot *snapshot) {
+    if (snapshot) {
+        node_associations_release(snapshot->associations);
+        free(snapshot);
+    }
+}
+
+/* Copies the pool's best formula and profile into a new snapshot. The
+ * association table is copied only after it may have changed. */
+static void node_publish(KolibriNode *node) {
+    const KolibriFormulaPool *pool = &node->pool;
+    KolibriNodeAssociations *table = node->associations;
+    if (!table || node->associations_dirty || table->count != pool->association_count) {
+        KolibriNodeAssociations *fresh = (KolibriNodeAssociations *)malloc(
+            sizeof(*fresh) + pool->association_count * sizeof(KolibriAssociation));
+        if (!fresh) {
+            return;
+        }
+        fresh->refs = 1U;
+        fresh->count = pool->association_count;
+        memcpy(fresh->items, pool->associations, fresh->count * sizeof(KolibriAssociation));
+        node_associations_release(table);
+        node->associations = table = fresh;
+        node->associations_dirty = false;
+    }
+    KolibriNodeSnapshot *snapshot = (KolibriNodeSnapshot *)calloc(1, sizeof(*snapshot));
+    if (!snapshot) {
+        return;
+    }
+    __atomic_add_fetch(&table->refs, 1U, __ATOMIC_RELAXED);
+    snapshot->associations = table;
+    const KolibriFormula *best = kf_pool_best(pool);
+    if (best) {
+        snapshot->has_best = true;
+        snapshot->best = *best;
+        if (snapshot->best.association_count > table->count) {
+            snapshot->best.association_count = table->count;
+        }
+        snapshot->best.associations = snapshot->best.association_count > 0 ? table->items : NULL;
+    }
+    snapshot->profile = *kf_pool_profile(pool);
+    snapshot->examples = pool->examples;
+    /* A snapshot the main thread never took can go right away. */
+    node_snapshot_free(__atomic_exchange_n(&node->published, snapshot, __ATOMIC_ACQ_REL));
+}
+
+static const KolibriNodeSnapshot *node_snapshot(KolibriNode *node) {
+    KolibriNodeSnapshot *fresh = __atomic_exchange_n(&node->published, NULL, __ATOMIC_ACQ_REL);
+    if (fresh) {
+        node_snapshot_free(node->snapshot);
+        node->snapshot = fresh;
+    }
+    return node->snapshot;
+}
+
+/* One background slice: as many generations as fit in evolve_budget_ms, or a
+ * single one with a zero budget, so a queued command waits at most a slice. */
+static void node_evolve_slice(KolibriNode *node) {
+    uint32_t budget = node->options.evolve_budget_ms;
+    if (node->archipelago_ready) {
+        uint64_t started = now_ms();
+        do {
+            node_evolve(node, 1);
+        } while (budget > 0U && now_ms() - started < budget);
+    } else {
+        KolibriTickBudget slice = {budget > 0U ? SIZE_MAX : 1U, budget, 0.0, 0U};
+        kf_pool_tick_until(&node->pool, &slice);
+    }
+    uint64_t now = now_ms();
+    if (node->options.auto_evolve_ms > 0U ||
+        now - node->last_evolve_record_ms >= KOLIBRI_NODE_EVOLVE_RECORD_MS) {
+        node_record_event(node, "EVOLVE", "автоцикл");
+        node->last_evolve_record_ms = now;
+    }
+}
+
+static bool node_same_gene(const KolibriGene *lhs, const KolibriGene *rhs) {
+    return lhs->length == rhs->length && memcmp(lhs->digits, rhs->digits, lhs->length) == 0;
+}
+
+static int node_compare_migrants(const void *lhs, const void *rhs) {
+    double a = ((const KolibriFormula *)lhs)->fitness;
+    double b = ((const KolibriFormula *)rhs)->fitness;
+    return (a < b) - (a > b);
+}
+
+/* Called with worker_lock held. A repeated gene keeps its best fitness; a
+ * full inbox gives up its weakest migrant for a fitter one. */
+static void node_inbox_add(KolibriNode *node, const KolibriFormula *formula) {
+    node->inbox_received++;
+    size_t weakest = 0;
+    for (size_t i = 0; i < node->inbox_count; ++i) {
+        KolibriFormula *held = &node->inbox[i];
+        if (node_same_gene(&held->gene, &formula->gene)) {
+            if (formula->fitness > held->fitness) {
+                held->fitness = formula->fitness;
+            }
+            return;
+        }
+        if (held->fitness < node->inbox[weakest].fitness) {
+            weakest = i;
+        }
+    }
+    if (node->inbox_count < KOLIBRI_NODE_INBOX_CAPACITY) {
+        node->inbox[node->inbox_count++] = *formula;
+    } else if (formula->fitness > node->inbox[weakest].fitness) {
+        node->inbox[weakest] = *formula;
+    }
+}
+
+/*
+ * Worker side, called with worker_lock held and returns with it held. The
+ * fittest migrants replace the weakest formulas and the rest are dropped, so
+ * a burst costs one admission and one genome block however many genes came.
+ */
+static bool node_admit_migrants(KolibriNode *node) {
+    size_t count = node->inbox_count;
+    size_t received = node->inbox_received;
+    if (count == 0) {
+        return false;
+    }
+    memcpy(node->migrants, node->inbox, count * sizeof(KolibriFormula));
+    node->inbox_count = 0;
+    node->inbox_received = 0;
+    pthread_mutex_unlock(&node->worker_lock);
+    qsort(node->migrants, count, sizeof(KolibriFormula), node_compare_migrants);
+    size_t offered = count < KOLIBRI_NODE_MIGRANTS_PER_CYCLE ? count : KOLIBRI_NODE_MIGRANTS_PER_CYCLE;
+    size_t admitted = kf_pool_immigrate(&node->pool, node->migrants, offered);
+    if (admitted > 0) {
+        /* The text takes 57 bytes and each count up to 20 digits. */
+        char payload[128];
+        snprintf(payload, sizeof(payload), "принято генов: %zu из %zu (уникальных %zu)",
+                 admitted, received, count);
+        node_record_event(node, "IMPORT", payload);
+    }
+    node_publish(node);
+    pthread_mutex_lock(&node->worker_lock);
+    return true;
+}
+
+/* Called with worker_lock held. */
+static void node_queue_push(KolibriNode *node, KolibriNodeCommand *command) {
+    command->next = NULL;
+    if (node->queue_tail) {
+        node->queue_tail->next = command;
+    } else {
+        node->queue_head = command;
+    }
+    node->queue_tail = command;
+    pthread_cond_signal(&node->worker_wake);
+}
+
+/* Commands go first; background evolution runs only while the queue is empty. */
+static void *node_worker_main(void *arg) {
+    KolibriNode *node = (KolibriNode *)arg;
+    uint64_t next_evolve_ms = now_ms() + node->options.auto_evolve_ms;
+    pthread_mutex_lock(&node->worker_lock);
+    while (true) {
+        KolibriNodeCommand *command = node->queue_head;
+        if (command) {
+            node->queue_head = command->next;
+            if (!node->queue_head) {
+                node->queue_tail = NULL;
+            }
+            pthread_mutex_unlock(&node->worker_lock);
+            command->run(node, command->arg);
+            node->associations_dirty = true;
+            node_publish(node);
+            pthread_mutex_lock(&node->worker_lock);
+            command->done = true;
+            pthread_cond_broadcast(&node->worker_done);
+            continue;
+        }
+        bool evolving = node->options.auto_learn && node->pool.examples > 0;
+        bool due = evolving && now_ms() >= next_evolve_ms;
+        /* Migrants enter once per evolution cycle, or at once when nothing evolves. */
+        if ((due || !evolving || node->worker_stop) && node_admit_migrants(node)) {
+            continue;
+        }
+        if (node->worker_stop) {
+            break;
+        }
+        if (due) {
+            pthread_mutex_unlock(&node->worker_lock);
+            node_evolve_slice(node);
+            node_publish(node);
+            next_evolve_ms = now_ms() + node->options.auto_evolve_ms;
+            pthread_mutex_lock(&node->worker_lock);
+            continue;
+        }
+        if (evolving) {
+            struct timespec until;
+            uint64_t now = now_ms();
+            node_deadline(&until, next_evolve_ms > now ? next_evolve_ms - now : 0U);
+            pthread_cond_timedwait(&node->worker_wake, &node->worker_lock, &until);
+        } else {
+            pthread_cond_wait(&node->worker_wake, &node->worker_lock);
+        }
+    }
+    pthread_mutex_unlock(&node->worker_lock);
+    return NULL;
+}
+
+static void node_start_worker(KolibriNode *node) {
+    node_publish(node);
+    node->worker_stop = false;
+    if (pthread_create(&node->worker, NULL, node_worker_main, node) != 0) {
+        KOLIBRI_LOG_WARN("Формулы", "фоновый поток не запущен, эволюция только по командам");
         return;
     }
-    KolibriNetMessage message;
-    int status = kn_listener_poll(&node->listener, 0U, &message);
-    if (status <= 0) {
+    node->worker_running = true;
+}
+
+static void node_stop_worker(KolibriNode *node) {
+    if (node->worker_running) {
+        pthread_mutex_lock(&node->worker_lock);
+        node->worker_stop = true;
+        pthread_cond_signal(&node->worker_wake);
+        pthread_mutex_unlock(&node->worker_lock);
+        pthread_join(node->worker, NULL);
+        node->worker_running = false;
+    }
+    node_snapshot_free(__atomic_exchange_n(&node->published, NULL, __ATOMIC_ACQ_REL));
+    node_snapshot_free(node->snapshot);
+    node->snapshot = NULL;
+    node_associations_release(node->associations);
+    node->associations = NULL;
+}
+
+/*
+ * Runs run(node, arg) on the worker and waits for it; without a worker it runs
+ * here. Swarm messages keep being read and queued while the caller waits.
+ */
+static void node_call(KolibriNode *node, void (*run)(KolibriNode *node, void *arg), void *arg) {
+    if (!node->worker_running) {
+        run(node, arg);
+        node->associations_dirty = true;
+        node_publish(node);
         return;
     }
-    switch (message.type) {
+    KolibriNodeCommand command;
+    memset(&command, 0, sizeof(command));
+    command.run = run;
+    command.arg = arg;
+    pthread_mutex_lock(&node->worker_lock);
+    node_queue_push(node, &command);
+    while (!command.done) {
+        if (!node->listener_ready) {
+            pthread_cond_wait(&node->worker_done, &node->worker_lock);
+            continue;
+        }
+        struct timespec until;
+        node_deadline(&until, KOLIBRI_NODE_LISTENER_POLL_MS);
+        if (pthread_cond_timedwait(&node->worker_done, &node->worker_lock, &until) == ETIMEDOUT &&
+            !command.done) {
+            pthread_mutex_unlock(&node->worker_lock);
+            node_service_listener(node);
+            pthread_mutex_lock(&node->worker_lock);
+        }
+    }
+    pthread_mutex_unlock(&node->worker_lock);
+}
+
+/* Puts an imported formula in the migrant inbox without waiting. */
+static void node_post_import(KolibriNode *node, const KolibriFormula *formula) {
+    pthread_mutex_lock(&node->worker_lock);
+    node_inbox_add(node, formula);
+    if (node->worker_running) {
+        pthread_cond_signal(&node->worker_wake);
+    } else {
+        node_admit_migrants(node);
+    }
+    pthread_mutex_unlock(&node->worker_lock);
+}
+
+static void node_handle_message(KolibriNode *node, const KolibriNetMessage *message) {
+    switch (message->type) {
     case KOLIBRI_MSG_HELLO:
-        printf("[Рой] приветствие от узла %u\n", message.data.hello.node_id);
+        KOLIBRI_LOG_INFO("Рой", "приветствие от узла %u", message->data.hello.node_id);
         break;
     case KOLIBRI_MSG_MIGRATE_RULE: {
         KolibriFormula imported;
-        imported.gene.length = message.data.formula.length;
+        memset(&imported, 0, sizeof(imported));
+        imported.gene.length = message->data.formula.length;
         if (imported.gene.length > sizeof(imported.gene.digits)) {
             imported.gene.length = sizeof(imported.gene.digits);
         }
-        memcpy(imported.gene.digits, message.data.formula.digits,
+        memcpy(imported.gene.digits, message->data.formula.digits,
                imported.gene.length);
-        imported.fitness = message.data.formula.fitness;
+        imported.fitness = message->data.formula.fitness;
         imported.feedback = 0.0;
 
         char digits_text[33];
@@ -593,62 +1202,79 @@ static void node_poll_listener(KolibriNode *node) {
         int preview = 0;
         bool preview_ok = kf_formula_apply(&imported, 4, &preview) == 0;
         if (preview_ok) {
-            printf("[Рой] получен ген от узла %u %s fitness=%.3f f(4)=%d\n",
-                   message.data.formula.node_id, description,
-                   message.data.formula.fitness, preview);
+            KOLIBRI_LOG_INFO("Рой", "получен ген от узла %u %s fitness=%.3f f(4)=%d",
+                             message->data.formula.node_id, description,
+                             message->data.formula.fitness, preview);
         } else {
-            printf("[Рой] получен ген от узла %u %s fitness=%.3f\n",
-                   message.data.formula.node_id, description,
-                   message.data.formula.fitness);
-        }
-        if (node->pool.count > 0) {
-            size_t slot = node->pool.count - 1U;
-            node->pool.formulas[slot] = imported;
-            kf_pool_tick(&node->pool, 4);
-            node_record_event(node, "IMPORT", "ген принят от соседа");
+            KOLIBRI_LOG_INFO("Рой", "получен ген от узла %u %s fitness=%.3f",
+                             message->data.formula.node_id, description,
+                             message->data.formula.fitness);
         }
+        node_post_import(node, &imported);
         break;
     }
     case KOLIBRI_MSG_ACK:
-        printf("[Рой] ACK=%u\n", message.data.ack.status);
+        KOLIBRI_LOG_INFO("Рой", "ACK=%u", message->data.ack.status);
         break;
     }
 }
 
-static void node_handle_tick(KolibriNode *node, size_t generations) {
+/* Interactive ticks stop once the pool has converged or the deadline passes. */
+static void node_tick_run(KolibriNode *node, size_t generations) {
     if (node->pool.examples == 0) {
         printf("[Формулы] нет обучающих примеров\n");
         return;
     }
-    kf_pool_tick(&node->pool, generations);
-    printf("[Формулы] выполнено поколений: %zu\n", generations);
+    size_t completed = generations;
+    if (node->archipelago_ready) {
+        node_evolve(node, generations);
+    } else {
+        KolibriTickBudget budget = {generations, KOLIBRI_NODE_TICK_DEADLINE_MS, 1.0, 0U};
+        completed = kf_pool_tick_until(&node->pool, &budget);
+    }
+    printf("[Формулы] выполнено поколений: %zu\n", completed);
     node_record_event(node, "EVOLVE", "цикл выполнен");
     node_reset_last_answer(node);
 }
 
-static void node_execute_script(KolibriNode *node, const char *path) {
-    if (!node || !path || path[0] == '\0') {
-        printf("[KolibriScript] требуется путь к файлу\n");
-        return;
-    }
+static void node_tick_call(KolibriNode *node, void *arg) {
+    node_tick_run(node, *(const size_t *)arg);
+}
+
+static void node_handle_tick(KolibriNode *node, size_t generations) {
+    node_call(node, node_tick_call, &generations);
+}
 
+static bool node_prepare_script(KolibriNode *node) {
     if (!node->script_ready) {
         if (ks_init(&node->script, &node->pool, node->genome_ready ? &node->genome : NULL) != 0) {
             fprintf(stderr, "[KolibriScript] не удалось инициализировать интерпретатор\n");
-            return;
+            return false;
         }
         node->script_ready = true;
     } else {
         node->script.pool = &node->pool;
         node->script.genome = node->genome_ready ? &node->genome : NULL;
     }
-
     ks_set_output(&node->script, stdout);
+    return true;
+}
+
+static void node_script_run(KolibriNode *node, void *arg) {
+    const char *path = (const char *)arg;
+    if (!node_prepare_script(node)) {
+        return;
+    }
+    node->script_pending_len = 0;
     if (ks_load_file(&node->script, path) != 0) {
         fprintf(stderr, "[KolibriScript] не удалось загрузить сценарий %s\n", path);
         return;
     }
-    if (ks_execute(&node->script) != 0) {
+    /* The console keeps reading the listener while the worker runs this. */
+    KolibriScriptStatus status;
+    while ((status = ks_step(&node->script, KOLIBRI_NODE_SCRIPT_SLICE_NS)) == KOLIBRI_SCRIPT_YIELDED) {
+    }
+    if (status != KOLIBRI_SCRIPT_DONE) {
         fprintf(stderr, "[KolibriScript] выполнение завершилось ошибкой для %s\n", path);
         return;
     }
@@ -658,6 +1284,64 @@ static void node_execute_script(KolibriNode *node, const char *path) {
     node_reset_last_answer(node);
 }
 
+static void node_execute_script(KolibriNode *node, const char *path) {
+    if (!node || !path || path[0] == '\0') {
+        printf("[KolibriScript] требуется путь к файлу\n");
+        return;
+    }
+    node_call(node, node_script_run, (void *)path);
+}
+
+/* Runs one line of KolibriScript on top of the state left by earlier ones. */
+static void node_line_run(KolibriNode *node, void *arg) {
+    const char *text = (const char *)arg;
+    if (!node_prepare_script(node)) {
+        return;
+    }
+    size_t length = strlen(text);
+    if (node->script_pending_len + length + 2U > sizeof(node->script_pending)) {
+        printf("[KolibriScript] блок слишком длинный, он отброшен\n");
+        node->script_pending_len = 0;
+        return;
+    }
+    memcpy(node->script_pending + node->script_pending_len, text, length);
+    node->script_pending_len += length;
+    node->script_pending[node->script_pending_len++] = '\n';
+    node->script_pending[node->script_pending_len] = '\0';
+    int rc = ks_execute_append(&node->script, node->script_pending);
+    if (rc == 1) {
+        printf("[KolibriScript] блок открыт, продолжайте :ks\n");
+        return;
+    }
+    node->script_pending_len = 0;
+    if (rc != 0) {
+        printf("[KolibriScript] строка не выполнена\n");
+        return;
+    }
+    node_reset_last_answer(node);
+}
+
+static void node_execute_line(KolibriNode *node, const char *text) {
+    node_call(node, node_line_run, (void *)text);
+}
+
+typedef struct {
+    int input;
+    int target;
+    bool added;
+} KolibriNodeExample;
+
+static void node_teach_run(KolibriNode *node, void *arg) {
+    KolibriNodeExample *example = (KolibriNodeExample *)arg;
+    if (kf_pool_add_example(&node->pool, example->input, example->target) != 0) {
+        printf("[Учитель] буфер примеров заполнен\n");
+        return;
+    }
+    example->added = true;
+    node_record_event(node, "TEACH", "пример добавлен");
+    node_tick_run(node, 8);
+}
+
 static void node_handle_teach(KolibriNode *node, const char *payload) {
     if (!payload || payload[0] == '\0') {
         printf("[Учитель] требуется пример формата a->b\n");
@@ -679,13 +1363,11 @@ static void node_handle_teach(KolibriNode *node, const char *payload) {
             printf("[Учитель] не удалось разобрать числа\n");
             return;
         }
-        if (kf_pool_add_example(&node->pool, input, target) != 0) {
-            printf("[Учитель] буфер примеров заполнен\n");
-            return;
+        KolibriNodeExample example = {input, target, false};
+        node_call(node, node_teach_run, &example);
+        if (example.added) {
+            node_store_text(node, payload);
         }
-        node_store_text(node, payload);
-        node_record_event(node, "TEACH", "пример добавлен");
-        node_handle_tick(node, 8);
         return;
     }
     node_store_text(node, payload);
@@ -703,7 +1385,8 @@ static void node_handle_ask(KolibriNode *node, const char *payload) {
         printf("[Вопрос] ожидалось целое число\n");
         return;
     }
-    const KolibriFormula *best = kf_pool_best(&node->pool);
+    const KolibriNodeSnapshot *snapshot = node_snapshot(node);
+    const KolibriFormula *best = snapshot && snapshot->has_best ? &snapshot->best : NULL;
     if (!best) {
         printf("[Вопрос] эволюция ещё не дала формулы\n");
         return;
@@ -751,166 +1434,304 @@ static void node_print_help(void) {
     printf(":sync — поделиться формулой с соседом\n");
     printf(":verify — проверить геном\n");
     printf(":script <файл> — выполнить KolibriScript из файла\n");
+    printf(":ks <строка> — выполнить строку KolibriScript, сохраняя состояние\n");
     printf(":fractal — показать фрактальную канву памяти\n");
+    printf(":profile — профиль эволюции пула в JSON\n");
     printf(":quit — завершить работу\n");
 }
 
-static void node_run(KolibriNode *node) {
-    printf("Колибри узел %u готов. :help для списка команд.\n",
-           node->options.node_id);
-    if (node->options.bootstrap_script[0] != '\0') {
-        node_execute_script(node, node->options.bootstrap_script);
-    }
-    node->last_evolve_ms = now_ms();
-    node->last_sync_ms = node->last_evolve_ms;
-    char line[512];
-    bool prompt_printed = false;
-    while (true) {
-        node_poll_listener(node);
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(0, &rfds);
-        struct timeval tv;
-        uint32_t timeout_ms = node->options.auto_learn ? (node->options.auto_evolve_ms > 0 ? node->options.auto_evolve_ms : 500U) : 1000U;
-        tv.tv_sec = timeout_ms / 1000U;
-        tv.tv_usec = (timeout_ms % 1000U) * 1000U;
-        if (!prompt_printed) {
-            printf("колибри-%u> ", node->options.node_id);
-            fflush(stdout);
-            prompt_printed = true;
-        }
-        int ready = select(1, &rfds, NULL, NULL, &tv);
-        if (ready > 0 && FD_ISSET(0, &rfds)) {
-            if (!fgets(line, sizeof(line), stdin)) {
-                printf("\n[Сессия] входной поток закрыт\n");
-                break;
-            }
-            prompt_printed = false;
-            trim_newline(line);
-            trim_spaces(line);
-            if (line[0] == '\0') {
-                continue;
-            }
-            node_poll_listener(node);
-            if (line[0] == ':') {
-            const char *command = line + 1;
-            while (*command && !isspace((unsigned char)*command)) {
-                ++command;
-            }
-            size_t prefix = (size_t)(command - (line + 1));
-            char name[32];
-            strncpy(name, line + 1, prefix);
-            name[prefix] = '\0';
-            while (*command && isspace((unsigned char)*command)) {
-                ++command;
-            }
-            if (strcmp(name, "teach") == 0) {
-                node_handle_teach(node, command);
-                continue;
-            }
-            if (strcmp(name, "ask") == 0) {
-                node_handle_ask(node, command);
-                continue;
-            }
-            if (strcmp(name, "good") == 0) {
-                node_handle_good(node);
-                continue;
-            }
-            if (strcmp(name, "bad") == 0) {
-                node_handle_bad(node);
-                continue;
-            }
-            if (strcmp(name, "tick") == 0) {
-                int gens = 1;
-                if (command[0] != '\0') {
-                    if (!parse_int32(command, &gens) || gens <= 0) {
-                        printf("[Формулы] ожидалось натуральное число\n");
-                        continue;
-                    }
-                }
-                node_handle_tick(node, (size_t)gens);
-                continue;
-            }
-            if (strcmp(name, "evolve") == 0) {
-                int gens = 32;
-                if (command[0] != '\0') {
-                    if (!parse_int32(command, &gens) || gens <= 0) {
-                        printf("[Формулы] ожидалось натуральное число\n");
-                        continue;
-                    }
+/* Runs one console line; false once the session should end. */
+static bool node_handle_line(KolibriNode *node, char *line) {
+    trim_newline(line);
+    trim_spaces(line);
+    if (line[0] == '\0') {
+        return true;
+    }
+    if (line[0] == ':') {
+        const char *command = line + 1;
+        while (*command && !isspace((unsigned char)*command)) {
+            ++command;
+        }
+        size_t prefix = (size_t)(command - (line + 1));
+        char name[32];
+        strncpy(name, line + 1, prefix);
+        name[prefix] = '\0';
+        while (*command && isspace((unsigned char)*command)) {
+            ++command;
+        }
+        if (strcmp(name, "teach") == 0) {
+            node_handle_teach(node, command);
+            return true;
+        }
+        if (strcmp(name, "ask") == 0) {
+            node_handle_ask(node, command);
+            return true;
+        }
+        if (strcmp(name, "good") == 0) {
+            node_handle_good(node);
+            return true;
+        }
+        if (strcmp(name, "bad") == 0) {
+            node_handle_bad(node);
+            return true;
+        }
+        if (strcmp(name, "tick") == 0) {
+            int gens = 1;
+            if (command[0] != '\0') {
+                if (!parse_int32(command, &gens) || gens <= 0) {
+                    printf("[Формулы] ожидалось натуральное число\n");
+                    return true;
                 }
-                node_handle_tick(node, (size_t)gens);
-                continue;
-            }
-            if (strcmp(name, "why") == 0) {
-                node_report_formula(node);
-                continue;
-            }
-            if (strcmp(name, "canvas") == 0) {
-                node_print_canvas(node);
-                continue;
-            }
-            if (strcmp(name, "sync") == 0) {
-                node_share_formula(node);
-                continue;
             }
-            if (strcmp(name, "verify") == 0) {
-                node_handle_verify(node);
-                continue;
-            }
-            if (strcmp(name, "script") == 0) {
-                if (command[0] == '\0') {
-                    printf("[KolibriScript] требуется путь к файлу\n");
-                    continue;
+            node_handle_tick(node, (size_t)gens);
+            return true;
+        }
+        if (strcmp(name, "evolve") == 0) {
+            int gens = 32;
+            if (command[0] != '\0') {
+                if (!parse_int32(command, &gens) || gens <= 0) {
+                    printf("[Формулы] ожидалось натуральное число\n");
+                    return true;
                 }
-                node_execute_script(node, command);
-                continue;
             }
-            if (strcmp(name, "fractal") == 0) {
-                node_print_canvas(node);
-                continue;
+            node_handle_tick(node, (size_t)gens);
+            return true;
+        }
+        if (strcmp(name, "why") == 0) {
+            node_report_formula(node);
+            return true;
+        }
+        if (strcmp(name, "canvas") == 0) {
+            node_print_canvas(node);
+            return true;
+        }
+        if (strcmp(name, "sync") == 0) {
+            node_share_formula(node);
+            return true;
+        }
+        if (strcmp(name, "verify") == 0) {
+            node_handle_verify(node);
+            return true;
+        }
+        if (strcmp(name, "script") == 0) {
+            if (command[0] == '\0') {
+                printf("[KolibriScript] требуется путь к файлу\n");
+                return true;
             }
-            if (strcmp(name, "help") == 0) {
-                node_print_help();
-                continue;
+            node_execute_script(node, command);
+            return true;
+        }
+        if (strcmp(name, "ks") == 0) {
+            node_execute_line(node, command);
+            return true;
+        }
+        if (strcmp(name, "fractal") == 0) {
+            node_print_canvas(node);
+            return true;
+        }
+        if (strcmp(name, "profile") == 0) {
+            node_print_profile(node);
+            return true;
+        }
+        if (strcmp(name, "help") == 0) {
+            node_print_help();
+            return true;
+        }
+        if (strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0) {
+            printf("[Сессия] завершение работы по команде\n");
+            return false;
+        }
+        printf("[Команда] неизвестная директива %s\n", name);
+        return true;
+    }
+    node_store_text(node, line);
+    node_record_event(node, "NOTE", "свободный текст сохранён");
+    return true;
+}
+
+static void node_print_prompt(const KolibriNode *node) {
+    printf("колибри-%u> ", node->options.node_id);
+    fflush(stdout);
+}
+
+/* Reads what stdin has and runs every complete line; a line that fills the
+ * buffer is run as is. */
+static void node_read_input(KolibriNode *node) {
+    ssize_t got = read(STDIN_FILENO, node->input + node->input_len,
+                       sizeof(node->input) - 1U - node->input_len);
+    if (got < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            node->running = false;
+        }
+        return;
+    }
+    bool closed = got == 0;
+    node->input_len += (size_t)got;
+    size_t start = 0;
+    bool ran = false;
+    while (node->running && start < node->input_len) {
+        char *newline = memchr(node->input + start, '\n', node->input_len - start);
+        size_t end = newline ? (size_t)(newline - node->input)
+                             : node->input_len;
+        if (!newline && !closed && node->input_len < sizeof(node->input) - 1U) {
+            break;
+        }
+        node->input[end] = '\0';
+        if (!node_handle_line(node, node->input + start)) {
+            node->running = false;
+        }
+        ran = true;
+        start = newline ? end + 1U : end;
+    }
+    memmove(node->input, node->input + start, node->input_len - start);
+    node->input_len -= start;
+    if (closed && node->running) {
+        printf("\n[Сессия] входной поток закрыт\n");
+        node->running = false;
+    }
+    if (ran && node->running) {
+        node_print_prompt(node);
+    }
+}
+
+/* Listener readiness: drains every decoded message, not just one batch. */
+static void node_service_listener(KolibriNode *node) {
+    KolibriNetMessage messages[16];
+    size_t count;
+    do {
+        count = kn_listener_poll_many(&node->listener, 0U, messages,
+                                      sizeof(messages) / sizeof(messages[0]));
+        for (size_t i = 0; i < count; ++i) {
+            node_handle_message(node, &messages[i]);
+        }
+    } while (count == sizeof(messages) / sizeof(messages[0]));
+}
+
+static bool node_sync_timer(KolibriNode *node) {
+    node_share_formula(node);
+    return true;
+}
+
+static void node_loop_add_timer(KolibriNodeLoop *loop, uint32_t interval_ms,
+                                bool (*fire)(KolibriNode *node)) {
+    if (loop->timer_count < KOLIBRI_NODE_MAX_TIMERS) {
+        KolibriNodeTimer *timer = &loop->timers[loop->timer_count++];
+        timer->interval_ms = interval_ms;
+        timer->due_ms = now_ms() + interval_ms;
+        timer->fire = fire;
+    }
+}
+
+static void node_loop_add_source(KolibriNodeLoop *loop, int fd,
+                                 void (*ready)(KolibriNode *node)) {
+    if (loop->source_count < KOLIBRI_NODE_MAX_SOURCES) {
+        loop->sources[loop->source_count].fd = fd;
+        loop->sources[loop->source_count].ready = ready;
+        loop->source_count++;
+    }
+}
+
+/* Fires due timers, then waits for a source until the next timer is due. */
+static void node_loop_run(KolibriNode *node, KolibriNodeLoop *loop) {
+    while (node->running && !node_signalled) {
+        uint64_t wait_ms = KOLIBRI_NODE_IDLE_MS;
+        for (size_t i = 0; i < loop->timer_count && node->running; ++i) {
+            KolibriNodeTimer *timer = &loop->timers[i];
+            uint64_t now = now_ms();
+            if (now >= timer->due_ms) {
+                bool busy = timer->fire(node);
+                now = now_ms();
+                timer->due_ms = now + (busy || timer->interval_ms > 0U ? timer->interval_ms
+                                                                      : KOLIBRI_NODE_IDLE_RETRY_MS);
             }
-            if (strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0) {
-                printf("[Сессия] завершение работы по команде\n");
-                break;
+            uint64_t left = timer->due_ms > now ? timer->due_ms - now : 0U;
+            if (left < wait_ms) {
+                wait_ms = left;
             }
-            printf("[Команда] неизвестная директива %s\n", name);
-            continue;
+        }
+        struct pollfd fds[KOLIBRI_NODE_MAX_SOURCES];
+        for (size_t i = 0; i < loop->source_count; ++i) {
+            fds[i].fd = loop->sources[i].fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+            if (fds[i].fd < 0 && wait_ms > KOLIBRI_NODE_LISTENER_POLL_MS) {
+                wait_ms = KOLIBRI_NODE_LISTENER_POLL_MS;
             }
-            node_store_text(node, line);
-            node_record_event(node, "NOTE", "свободный текст сохранён");
-        } else {
-            if (node->options.auto_learn) {
-                uint64_t now = now_ms();
-                if (node->pool.examples > 0 && (now - node->last_evolve_ms) >= node->options.auto_evolve_ms) {
-                    kf_pool_tick(&node->pool, 1);
-                    node_record_event(node, "EVOLVE", "автоцикл");
-                    node->last_evolve_ms = now;
-                }
-                if (node->options.peer_enabled && (now - node->last_sync_ms) >= node->options.auto_sync_ms) {
-                    node_share_formula(node);
-                    node->last_sync_ms = now;
-                }
+        }
+        if (!node->running) {
+            break;
+        }
+        int ready = poll(fds, (nfds_t)loop->source_count, (int)wait_ms);
+        if (ready < 0 && errno != EINTR) {
+            KOLIBRI_LOG_ERROR("Сессия", "poll: %s", strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < loop->source_count && node->running; ++i) {
+            if (fds[i].fd < 0 || (ready > 0 && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)))) {
+                loop->sources[i].ready(node);
             }
         }
     }
 }
 
+static void node_stop(int signo) {
+    (void)signo;
+    node_signalled = 1;
+}
+
+static void node_run(KolibriNode *node) {
+    if (node->options.daemon) {
+        printf("Колибри узел %u запущен в режиме демона.\n", node->options.node_id);
+    } else {
+        printf("Колибри узел %u готов. :help для списка команд.\n",
+               node->options.node_id);
+    }
+    signal(SIGINT, node_stop);
+    signal(SIGTERM, node_stop);
+    node->running = true;
+    node_start_worker(node);
+    /* A restored pool already holds what the bootstrap script would teach. */
+    if (node->options.bootstrap_script[0] != '\0' && node->checkpoint_restored) {
+        printf("[Чекпоинт] %s пропущен\n", node->options.bootstrap_script);
+    } else if (node->options.bootstrap_script[0] != '\0') {
+        node_execute_script(node, node->options.bootstrap_script);
+    }
+    KolibriNodeLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    bool checkpoints = node->options.checkpoint_path[0] != '\0';
+    if (checkpoints && node->options.checkpoint_ms > 0U) {
+        node_loop_add_timer(&loop, node->options.checkpoint_ms, node_checkpoint_timer);
+    }
+    if (node->options.auto_learn && node->options.peer_enabled) {
+        node_loop_add_timer(&loop, node->options.auto_sync_ms, node_sync_timer);
+    }
+    if (node->listener_ready) {
+        node_loop_add_source(&loop, kn_listener_fd(&node->listener), node_service_listener);
+    }
+    if (!node->options.daemon) {
+        node_loop_add_source(&loop, STDIN_FILENO, node_read_input);
+        node_print_prompt(node);
+    }
+    node_loop_run(node, &loop);
+    node_stop_worker(node);
+    if (checkpoints) {
+        node_checkpoint_save(node);
+    }
+    if (node_signalled) {
+        printf("\n[Сессия] получен сигнал завершения\n");
+    }
+}
+
 static int node_start_listener(KolibriNode *node) {
     if (!node->options.listen_enabled) {
         return 0;
     }
     if (kn_listener_start(&node->listener, node->options.listen_port) != 0) {
-        fprintf(stderr, "[Рой] не удалось открыть порт %u\n",
-                node->options.listen_port);
+        KOLIBRI_LOG_ERROR("Рой", "не удалось открыть порт %u", node->options.listen_port);
         return -1;
     }
     node->listener_ready = true;
-    printf("[Рой] слушаем порт %u\n", node->options.listen_port);
+    KOLIBRI_LOG_INFO("Рой", "слушаем порт %u", node->options.listen_port);
     return 0;
 }
 
@@ -922,38 +1743,85 @@ static void node_stop_listener(KolibriNode *node) {
     node->listener_ready = false;
 }
 
+static void node_close_archipelago(KolibriNode *node) {
+    if (!node->archipelago_ready) {
+        return;
+    }
+    kf_archipelago_free(&node->archipelago);
+    node->archipelago_ready = false;
+}
+
 static int node_init(KolibriNode *node, const KolibriNodeOptions *options) {
     memset(node, 0, sizeof(*node));
     node->options = *options;
+    pthread_mutex_init(&node->genome_lock, NULL);
+    pthread_mutex_init(&node->worker_lock, NULL);
+    pthread_cond_init(&node->worker_wake, NULL);
+    pthread_cond_init(&node->worker_done, NULL);
     if (node_load_hmac_key(node) != 0) {
         return -1;
     }
     node_reset_last_answer(node);
     k_digit_stream_init(&node->memory, node->memory_buffer, sizeof(node->memory_buffer));
     kf_pool_init(&node->pool, node->options.seed);
+    if (node_restore_checkpoint(node) != 0) {
+        return -1;
+    }
+    if (node->options.islands > 1U) {
+        if (kf_archipelago_init(&node->archipelago, &node->pool, node->options.islands,
+                                &node->options.migration, node->options.seed) != 0) {
+            KOLIBRI_LOG_ERROR("Острова", "не удалось создать %u островов",
+                              (unsigned)node->options.islands);
+            return -1;
+        }
+        node->archipelago_ready = true;
+        KOLIBRI_LOG_INFO("Острова", "островов: %u, миграция каждые %zu поколений",
+                         (unsigned)node->options.islands, node->archipelago.policy.interval);
+    }
     if (node_open_genome(node) != 0) {
+        node_close_archipelago(node);
         return -1;
     }
+    if (node->checkpoint_restored) {
+        char payload[32];
+        snprintf(payload, sizeof(payload), "fnv1a64=%016" PRIx64, node->checkpoint_hash);
+        node_record_event(node, "RESTORE", payload);
+    }
     if (node_start_listener(node) != 0) {
         node_close_genome(node);
+        node_close_archipelago(node);
         return -1;
     }
+    kn_peers_init(&node->peers, node->options.node_id);
+    if (node->options.peer_enabled &&
+        kn_peers_add(&node->peers, node->options.peer_host, node->options.peer_port) < 0) {
+        node->options.peer_enabled = false;
+    }
     return 0;
 }
 
 static void node_shutdown(KolibriNode *node) {
     node_stop_listener(node);
+    kn_peers_close(&node->peers);
     if (node->script_ready) {
         ks_free(&node->script);
         node->script_ready = false;
     }
     node_close_genome(node);
+    node_close_archipelago(node);
+    pthread_cond_destroy(&node->worker_done);
+    pthread_cond_destroy(&node->worker_wake);
+    pthread_mutex_destroy(&node->worker_lock);
+    pthread_mutex_destroy(&node->genome_lock);
 }
 
 static int node_emit_health(KolibriNode *node) {
-    int genome_status = kg_verify_file(node->options.genome_path,
-                                       node->hmac_key,
-                                       node->hmac_key_len);
+    char checkpoint[300];
+    KolibriGenomeVerifyOptions verify;
+    node_verify_options(node, checkpoint, sizeof(checkpoint), &verify);
+    int genome_status = kg_verify_file_ex(node->options.genome_path,
+                                          node->hmac_key,
+                                          node->hmac_key_len, &verify);
     const char *genome_state = "unknown";
     if (genome_status == 0) {
         genome_state = "ok";
@@ -973,23 +1841,54 @@ static int node_emit_health(KolibriNode *node) {
     return (genome_status == 0) ? 0 : 1;
 }
 
+/* Diagnostics go through the log sink so a slow console never holds up the
+ * worker or the listener; REPL replies stay on stdout. */
+static FILE *node_start_log(const KolibriNodeOptions *options) {
+    FILE *out = NULL;
+    if (options->log_path[0] != '\0') {
+        out = fopen(options->log_path,
+                    options->log_format == KOLIBRI_LOG_FORMAT_BINARY ? "ab" : "a");
+        if (!out) {
+            fprintf(stderr, "[Журнал] не удалось открыть %s: %s\n", options->log_path,
+                    strerror(errno));
+        }
+    }
+    KolibriLogConfig config = {options->log_level, options->log_format, out, 0U,
+                               options->log_rate};
+    if (kolibri_log_start(&config) != 0) {
+        fprintf(stderr, "[Журнал] фоновая запись не запущена, журнал синхронный\n");
+    }
+    return out;
+}
+
+static void node_stop_log(FILE *out) {
+    kolibri_log_stop();
+    if (out) {
+        fclose(out);
+    }
+}
+
 int main(int argc, char **argv) {
     KolibriNodeOptions options;
     parse_options(argc, argv, &options);
     if (options.health_check) {
         options.listen_enabled = false;
     }
+    FILE *log_out = node_start_log(&options);
     KolibriNode node;
     if (node_init(&node, &options) != 0) {
+        node_stop_log(log_out);
         return 1;
     }
     if (options.health_check) {
         int status = node_emit_health(&node);
         node_shutdown(&node);
+        node_stop_log(log_out);
         return status;
     }
     node_run(&node);
     node_shutdown(&node);
+    node_stop_log(log_out);
     printf("Колибри узел %u завершил работу\n", options.node_id);
     return 0;
 }
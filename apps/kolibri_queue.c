@@ -5,10 +5,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define KOLIBRI_IMPORT_BATCH_DEFAULT 500U
+
 static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
             "  kolibri_queue enqueue --db PATH --title TITLE --content TEXT [--source S] [--metadata JSON]\n"
+            "  kolibri_queue import --db PATH [--input FILE.jsonl] [--batch N]\n"
             "  kolibri_queue list --db PATH [--status pending|approved|rejected] [--limit N]\n"
             "  kolibri_queue moderate --db PATH --id ID --status approved|rejected --moderator NAME [--note TEXT]\n"
             "  kolibri_queue export --db PATH --status approved|rejected --output DIR\n");
@@ -61,6 +64,271 @@ static int cmd_enqueue(int argc, char **argv) {
     return 0;
 }
 
+/* Minimal JSONL support for import: one object per line with string fields
+ * title, content, source and an arbitrary JSON value under metadata. */
+static void skip_ws(char **cursor) {
+    while (**cursor == ' ' || **cursor == '\t' || **cursor == '\r' || **cursor == '\n') {
+        (*cursor)++;
+    }
+}
+
+static void utf8_append(char *out, size_t *len, unsigned long cp) {
+    if (cp < 0x80UL) {
+        out[(*len)++] = (char)cp;
+    } else if (cp < 0x800UL) {
+        out[(*len)++] = (char)(0xC0UL | (cp >> 6));
+        out[(*len)++] = (char)(0x80UL | (cp & 0x3FUL));
+    } else {
+        out[(*len)++] = (char)(0xE0UL | (cp >> 12));
+        out[(*len)++] = (char)(0x80UL | ((cp >> 6) & 0x3FUL));
+        out[(*len)++] = (char)(0x80UL | (cp & 0x3FUL));
+    }
+}
+
+/* Unescapes in place: the decoded string is never longer than its source. */
+static char *parse_string(char **cursor) {
+    if (**cursor != '"') {
+        return NULL;
+    }
+    char *out = ++(*cursor);
+    size_t len = 0U;
+    while (**cursor && **cursor != '"') {
+        char ch = *(*cursor)++;
+        if (ch != '\\') {
+            out[len++] = ch;
+            continue;
+        }
+        ch = *(*cursor)++;
+        switch (ch) {
+        case 'n': out[len++] = '\n'; break;
+        case 't': out[len++] = '\t'; break;
+        case 'r': out[len++] = '\r'; break;
+        case 'b': out[len++] = '\b'; break;
+        case 'f': out[len++] = '\f'; break;
+        case '"': case '\\': case '/': out[len++] = ch; break;
+        case 'u': {
+            char hex[5] = {0};
+            for (int i = 0; i < 4; ++i) {
+                if (!(*cursor)[i]) {
+                    return NULL;
+                }
+                hex[i] = (*cursor)[i];
+            }
+            char *end = NULL;
+            unsigned long cp = strtoul(hex, &end, 16);
+            if (end != hex + 4) {
+                return NULL;
+            }
+            *cursor += 4;
+            utf8_append(out, &len, cp);
+            break;
+        }
+        default:
+            return NULL;
+        }
+    }
+    if (**cursor != '"') {
+        return NULL;
+    }
+    **cursor = '\0';
+    (*cursor)++;
+    out[len] = '\0';
+    return out;
+}
+
+/* Skips one JSON value without modifying it, so metadata keeps its text. */
+static int skip_value(char **cursor) {
+    int depth = 0;
+    int in_string = 0;
+    if (**cursor != '"' && **cursor != '{' && **cursor != '[') {
+        const char *start = *cursor;
+        *cursor += strcspn(*cursor, ",}] \t\r\n");
+        return *cursor == start ? -1 : 0;
+    }
+    do {
+        char ch = *(*cursor)++;
+        if (!ch) {
+            return -1;
+        }
+        if (in_string) {
+            if (ch == '\\' && **cursor) {
+                (*cursor)++;
+            } else if (ch == '"') {
+                in_string = 0;
+            }
+        } else if (ch == '"') {
+            in_string = 1;
+        } else if (ch == '{' || ch == '[') {
+            depth++;
+        } else if (ch == '}' || ch == ']') {
+            depth--;
+        }
+    } while (depth > 0 || in_string);
+    return 0;
+}
+
+static int parse_submission(char *line, KolibriQueueSubmission *out) {
+    memset(out, 0, sizeof(*out));
+    char *cursor = line;
+    skip_ws(&cursor);
+    if (*cursor != '{') {
+        return -1;
+    }
+    cursor++;
+    while (1) {
+        skip_ws(&cursor);
+        if (*cursor == '}') {
+            break;
+        }
+        char *key = parse_string(&cursor);
+        skip_ws(&cursor);
+        if (!key || *cursor != ':') {
+            return -1;
+        }
+        cursor++;
+        skip_ws(&cursor);
+        const char **field = NULL;
+        if (strcmp(key, "title") == 0) {
+            field = &out->title;
+        } else if (strcmp(key, "content") == 0) {
+            field = &out->content;
+        } else if (strcmp(key, "source") == 0) {
+            field = &out->source;
+        }
+        char *value_end = NULL;
+        if (field && *cursor == '"') {
+            *field = parse_string(&cursor);
+            if (!*field) {
+                return -1;
+            }
+        } else {
+            char *value = cursor;
+            if (skip_value(&cursor) != 0) {
+                return -1;
+            }
+            if (strcmp(key, "metadata") == 0 && strncmp(value, "null", 4U) != 0) {
+                out->metadata_json = value;
+                value_end = cursor;
+            }
+        }
+        skip_ws(&cursor);
+        char next = *cursor;
+        if (value_end) {
+            *value_end = '\0';
+        }
+        if (next == ',') {
+            cursor++;
+            continue;
+        }
+        if (next == '}') {
+            break;
+        }
+        return -1;
+    }
+    return out->title && out->content ? 0 : -1;
+}
+
+static int import_flush(KolibriQueue *queue, KolibriQueueSubmission *batch, char **lines, size_t *count, size_t *imported) {
+    int rc = kolibri_queue_enqueue_batch(queue, batch, *count, NULL);
+    if (rc == SQLITE_OK) {
+        *imported += *count;
+    }
+    for (size_t i = 0; i < *count; ++i) {
+        free(lines[i]);
+    }
+    *count = 0U;
+    return rc;
+}
+
+static int cmd_import(int argc, char **argv) {
+    const char *db_path = NULL;
+    const char *input_path = NULL;
+    size_t batch_size = KOLIBRI_IMPORT_BATCH_DEFAULT;
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
+            db_path = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_size = (size_t)atoi(argv[++i]);
+        }
+    }
+    if (!db_path || batch_size == 0U) {
+        print_usage();
+        return 1;
+    }
+    FILE *input = stdin;
+    if (input_path && strcmp(input_path, "-") != 0) {
+        input = fopen(input_path, "rb");
+        if (!input) {
+            fprintf(stderr, "Unable to open %s\n", input_path);
+            return 1;
+        }
+    }
+    KolibriQueue *queue = NULL;
+    if (kolibri_queue_open(db_path, &queue) != SQLITE_OK) {
+        fprintf(stderr, "Unable to open queue database\n");
+        if (input != stdin) {
+            fclose(input);
+        }
+        return 1;
+    }
+    KolibriQueueSubmission *batch = (KolibriQueueSubmission *)calloc(batch_size, sizeof(KolibriQueueSubmission));
+    char **lines = (char **)calloc(batch_size, sizeof(char *));
+    int status = 0;
+    size_t count = 0U;
+    size_t imported = 0U;
+    size_t line_number = 0U;
+    char *line = NULL;
+    size_t line_capacity = 0U;
+    if (!batch || !lines) {
+        fprintf(stderr, "Out of memory\n");
+        status = 1;
+    }
+    while (status == 0 && getline(&line, &line_capacity, input) >= 0) {
+        line_number++;
+        char *cursor = line;
+        skip_ws(&cursor);
+        if (*cursor == '\0') {
+            continue;
+        }
+        if (parse_submission(line, &batch[count]) != 0) {
+            fprintf(stderr, "Invalid submission on line %zu\n", line_number);
+            status = 1;
+            break;
+        }
+        lines[count++] = line;
+        line = NULL;
+        line_capacity = 0U;
+        if (count == batch_size) {
+            int rc = import_flush(queue, batch, lines, &count, &imported);
+            if (rc != SQLITE_OK) {
+                fprintf(stderr, "Import failed: %d\n", rc);
+                status = 1;
+            }
+        }
+    }
+    if (status == 0 && count > 0U) {
+        int rc = import_flush(queue, batch, lines, &count, &imported);
+        if (rc != SQLITE_OK) {
+            fprintf(stderr, "Import failed: %d\n", rc);
+            status = 1;
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        free(lines[i]);
+    }
+    free(line);
+    free(lines);
+    free(batch);
+    kolibri_queue_close(queue);
+    if (input != stdin) {
+        fclose(input);
+    }
+    printf("Импортировано %zu заявок\n", imported);
+    return status;
+}
+
 static int cmd_list(int argc, char **argv) {
     const char *db_path = NULL;
     KolibriQueueStatus status = KOLIBRI_QUEUE_STATUS_PENDING;
@@ -199,6 +467,9 @@ int main(int argc, char **argv) {
     if (strcmp(command, "enqueue") == 0) {
         return cmd_enqueue(argc - 2, &argv[2]);
     }
+    if (strcmp(command, "import") == 0) {
+        return cmd_import(argc - 2, &argv[2]);
+    }
     if (strcmp(command, "list") == 0) {
         return cmd_list(argc - 2, &argv[2]);
     }
@@ -1,16 +1,34 @@
 #include "kolibri/sim.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <time.h>
 
 static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
-            "  kolibri_sim tick [--seed N] [--steps S]\n"
+            "  kolibri_sim tick [--seed N] [--steps S] [--profile] [OUTPUT]\n"
             "  kolibri_sim reset [--seed N]\n"
-            "  kolibri_sim soak [--seed N] [--minutes M] [--log PATH]\n");
+            "  kolibri_sim soak [--seed N] [--minutes M | --ticks T] [--sims K] [--threads W]\n"
+            "                   [--log PATH] [--profile] [OUTPUT]\n"
+            "OUTPUT: [--trace PATH] [--trace-genome] [--genome PATH]\n");
+}
+
+/* Trace and genome options shared by tick and soak; returns 1 when argv[*i] was one. */
+static int parse_output_option(int argc, char **argv, int *i, KolibriSimConfig *cfg) {
+    if (strcmp(argv[*i], "--trace") == 0 && *i + 1 < argc) {
+        cfg->trace_path = argv[++*i];
+    } else if (strcmp(argv[*i], "--genome") == 0 && *i + 1 < argc) {
+        cfg->genome_path = argv[++*i];
+    } else if (strcmp(argv[*i], "--trace-genome") == 0) {
+        cfg->trace_include_genome = 1;
+    } else {
+        return 0;
+    }
+    return 1;
 }
 
 static void json_escape(FILE *out, const char *text) {
@@ -44,35 +62,23 @@ static void dump_logs(KolibriSim *sim, FILE *out, size_t *last_offset, int as_js
     KolibriSimLog logs[64];
     size_t count = 0U;
     size_t offset = 0U;
-    if (kolibri_sim_get_logs(sim, logs, 64U, &count, &offset) != 0) {
-        return;
-    }
-    if (count == 0U) {
-        return;
-    }
-    size_t start = 0U;
-    if (*last_offset > offset) {
-        start = *last_offset - offset;
-        if (start > count) {
-            start = count;
-        }
-    }
-    for (size_t i = start; i < count; ++i) {
-        const char *tip = logs[i].tip ? logs[i].tip : "";
-        const char *msg = logs[i].soobshenie ? logs[i].soobshenie : "";
-        if (as_json) {
-            fprintf(out, "{");
-            fputs("\"tip\":\"", out);
-            json_escape(out, tip);
-            fputs("\",\"soobshenie\":\"", out);
-            json_escape(out, msg);
-            fprintf(out, "\",\"metka\":%.6f}\n", logs[i].metka);
-        } else {
-            fprintf(out, "[%zu] %s: %s\n", offset + i, tip, msg);
+    while (kolibri_sim_get_logs(sim, *last_offset, logs, 64U, &count, &offset) == 0 &&
+           count > 0U) {
+        for (size_t i = 0; i < count; ++i) {
+            if (as_json) {
+                fprintf(out, "{");
+                fputs("\"tip\":\"", out);
+                json_escape(out, logs[i].tip);
+                fputs("\",\"soobshenie\":\"", out);
+                json_escape(out, logs[i].soobshenie);
+                fprintf(out, "\",\"metka\":%.6f}\n", logs[i].metka);
+            } else {
+                fprintf(out, "[%zu] %s: %s\n", offset + i, logs[i].tip, logs[i].soobshenie);
+            }
         }
+        *last_offset = offset + count;
     }
     fflush(out);
-    *last_offset = offset + count;
 }
 
 static void sim_print_logs(KolibriSim *sim) {
@@ -80,24 +86,36 @@ static void sim_print_logs(KolibriSim *sim) {
     dump_logs(sim, stdout, &last_offset, 0);
 }
 
+static void sim_print_profile(KolibriSim *sim) {
+    char profile[512];
+    if (kolibri_sim_get_profile_json(sim, profile, sizeof(profile)) == 0) {
+        printf("{\"profile\":%s}\n", profile);
+    }
+}
+
 static int cmd_tick(int argc, char **argv) {
     uint32_t seed = 0U;
     size_t steps = 1U;
-    for (int i = 0; i < argc; ++i) {
-        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
-            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
-        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
-            steps = (size_t)strtoul(argv[++i], NULL, 10);
-        }
-    }
-
+    int show_profile = 0;
     KolibriSimConfig cfg = {
-        .seed = seed,
+        .seed = 0U,
         .hmac_key = "kolibri-hmac",
         .trace_path = NULL,
         .trace_include_genome = 0,
         .genome_path = NULL,
     };
+    for (int i = 0; i < argc; ++i) {
+        if (parse_output_option(argc, argv, &i, &cfg)) {
+            continue;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            show_profile = 1;
+        }
+    }
+    cfg.seed = seed;
 
     KolibriSim *sim = kolibri_sim_create(&cfg);
     if (!sim) {
@@ -114,6 +132,9 @@ static int cmd_tick(int argc, char **argv) {
     }
 
     sim_print_logs(sim);
+    if (show_profile) {
+        sim_print_profile(sim);
+    }
     kolibri_sim_destroy(sim);
     return 0;
 }
@@ -148,63 +169,123 @@ static int cmd_reset(int argc, char **argv) {
     return 0;
 }
 
+static int compare_u64(const void *lhs, const void *rhs) {
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/* Nearest-rank percentile of sorted samples, in milliseconds. */
+static double percentile_ms(const uint64_t *sorted, size_t count, double fraction) {
+    if (count == 0U) {
+        return 0.0;
+    }
+    size_t rank = (size_t)(fraction * (double)count + 0.999999);
+    if (rank == 0U) {
+        rank = 1U;
+    }
+    if (rank > count) {
+        rank = count;
+    }
+    return (double)sorted[rank - 1U] / 1e6;
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Steps --sims simulations (seeds N, N+1, ...) for --minutes * 60 rounds,
+ * or --ticks rounds, and reports throughput and per-tick latency as JSON.
+ * Logs and --profile follow the first simulation.
+ */
 static int cmd_soak(int argc, char **argv) {
     uint32_t seed = 0U;
     size_t minutes = 5U;
+    size_t rounds = 0U;
+    size_t sims = 1U;
+    size_t threads = 0U;
     const char *log_path = NULL;
+    int show_profile = 0;
+    KolibriSimConfig cfg = {
+        .seed = 0U,
+        .hmac_key = "kolibri-hmac",
+        .trace_path = NULL,
+        .trace_include_genome = 0,
+        .genome_path = NULL,
+    };
     for (int i = 0; i < argc; ++i) {
-        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+        if (parse_output_option(argc, argv, &i, &cfg)) {
+            continue;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
             seed = (uint32_t)strtoul(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) {
             minutes = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) {
+            rounds = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sims") == 0 && i + 1 < argc) {
+            sims = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (size_t)strtoul(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
             log_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            show_profile = 1;
         }
     }
+    if (rounds == 0U) {
+        const size_t ticks_per_minute = 60U;
+        rounds = minutes * ticks_per_minute;
+    } else {
+        minutes = 0U;
+    }
+    if (sims == 0U) {
+        sims = 1U;
+    }
+    cfg.seed = seed;
 
-    KolibriSimConfig cfg = {
-        .seed = seed,
-        .hmac_key = "kolibri-hmac",
-        .trace_path = NULL,
-        .trace_include_genome = 0,
-        .genome_path = NULL,
-    };
-
-    KolibriSim *sim = kolibri_sim_create(&cfg);
-    if (!sim) {
-        fprintf(stderr, "kolibri_sim_create failed\n");
+    KolibriSimBatch *batch = kolibri_sim_batch_create(&cfg, sims, threads);
+    uint64_t *samples = (uint64_t *)malloc((rounds ? rounds : 1U) * sims * sizeof(uint64_t));
+    if (!batch || !samples) {
+        fprintf(stderr, "kolibri_sim_batch_create failed\n");
+        kolibri_sim_batch_destroy(batch);
+        free(samples);
         return 1;
     }
+    KolibriSim *sim = kolibri_sim_batch_get(batch, 0U);
 
     FILE *log_file = NULL;
     if (log_path) {
         log_file = fopen(log_path, "w");
         if (!log_file) {
             fprintf(stderr, "unable to open log file: %s\n", log_path);
-            kolibri_sim_destroy(sim);
+            kolibri_sim_batch_destroy(batch);
+            free(samples);
             return 1;
         }
     }
 
     size_t last_offset_file = 0U;
     size_t total_ticks = 0U;
-    const size_t ticks_per_minute = 60U;
-    for (size_t minute = 0; minute < minutes; ++minute) {
-        for (size_t step = 0; step < ticks_per_minute; ++step) {
-            if (kolibri_sim_tick(sim) != 0) {
-                fprintf(stderr, "kolibri_sim_tick failed\n");
-                if (log_file) {
-                    fclose(log_file);
-                }
-                kolibri_sim_destroy(sim);
-                return 1;
-            }
-            total_ticks += 1U;
+    double started = monotonic_seconds();
+    for (size_t round = 0; round < rounds; ++round) {
+        if (kolibri_sim_batch_tick(batch, &samples[round * sims]) != 0) {
+            fprintf(stderr, "kolibri_sim_tick failed\n");
             if (log_file) {
-                dump_logs(sim, log_file, &last_offset_file, 1);
+                fclose(log_file);
             }
+            kolibri_sim_batch_destroy(batch);
+            free(samples);
+            return 1;
+        }
+        total_ticks += sims;
+        if (log_file) {
+            dump_logs(sim, log_file, &last_offset_file, 1);
         }
     }
+    double elapsed = monotonic_seconds() - started;
 
     if (log_file) {
         fclose(log_file);
@@ -213,18 +294,44 @@ static int cmd_soak(int argc, char **argv) {
         dump_logs(sim, stdout, &offset_stdout, 0);
     }
 
+    uint64_t evaluations = 0U;
+    for (size_t i = 0; i < sims; ++i) {
+        evaluations += kolibri_sim_evaluations(kolibri_sim_batch_get(batch, i));
+    }
+    qsort(samples, total_ticks, sizeof(uint64_t), compare_u64);
+    struct rusage usage;
+    long max_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? (long)usage.ru_maxrss : 0L;
+#if defined(__APPLE__)
+    max_rss_kb /= 1024L;
+#endif
+    double rate = elapsed > 0.0 ? 1.0 / elapsed : 0.0;
+
     printf("{\"minutes\":%zu,\"ticks\":%zu,\"seed\":%u,\"log_path\":",
            minutes,
            total_ticks,
            seed);
     if (log_path) {
-        printf("\"%s\"}", log_path);
+        printf("\"%s\"", log_path);
     } else {
-        printf("null}");
+        printf("null");
     }
+    printf(",\"sims\":%zu,\"threads\":%zu,\"elapsed_sec\":%.3f,\"ticks_per_sec\":%.1f,"
+           "\"tick_p50_ms\":%.3f,\"tick_p99_ms\":%.3f,\"evaluations_per_sec\":%.0f,\"max_rss_kb\":%ld}",
+           sims,
+           kolibri_sim_batch_threads(batch),
+           elapsed,
+           (double)total_ticks * rate,
+           percentile_ms(samples, total_ticks, 0.50),
+           percentile_ms(samples, total_ticks, 0.99),
+           (double)evaluations * rate,
+           max_rss_kb);
     putchar('\n');
+    if (show_profile) {
+        sim_print_profile(sim);
+    }
 
-    kolibri_sim_destroy(sim);
+    kolibri_sim_batch_destroy(batch);
+    free(samples);
     return 0;
 }
 
@@ -4,6 +4,7 @@
 
 #include "kolibri/decimal.h"
 #include "kolibri/digits.h"
+#include "kolibri/script.h"
 
 #include <errno.h>
 #include <stdbool.h>
@@ -14,8 +15,10 @@
 
 static void vyvesti_spravku(void) {
     fprintf(stderr,
-            "Использование: ks_compiler [--decode] [-o файл] [вход]\n"
+            "Использование: ks_compiler [--decode | --ksc] [-o файл] [вход]\n"
             "  --decode       Преобразовать цифровой поток обратно в текст\n"
+            "  --ksc          Скомпилировать сценарий в байткод .ksc (по умолчанию\n"
+            "                 рядом с входным файлом)\n"
             "  -o файл        Путь для сохранения результата (по умолчанию stdout)\n"
             "  вход           Файл KolibriScript (.ks или .ksd), '-' — stdin\n");
 }
@@ -201,14 +204,55 @@ static int kodirovat(const char *vyhod, const unsigned char *vhod,
     return zapis;
 }
 
+static int kompilirovat(const char *vyhod, const char *vhod,
+                        const unsigned char *dannye, size_t dlina) {
+    char put[4096];
+    if (!vyhod) {
+        if (!vhod || strcmp(vhod, "-") == 0 ||
+            ks_program_cache_path(vhod, put, sizeof(put)) != 0) {
+            fprintf(stderr, "[Ошибка] Для stdin укажите путь артефакта через -o\n");
+            return -1;
+        }
+        vyhod = put;
+    }
+    char *tekst = (char *)malloc(dlina + 1U);
+    if (!tekst) {
+        fprintf(stderr, "[Ошибка] Недостаточно памяти для сценария\n");
+        return -1;
+    }
+    memcpy(tekst, dannye, dlina);
+    tekst[dlina] = '\0';
+
+    KolibriScript skript;
+    KolibriScriptProgram *programma = NULL;
+    int kod = -1;
+    if (ks_init(&skript, NULL, NULL) == 0 && ks_load_text(&skript, tekst) == 0) {
+        programma = ks_compile(&skript);
+    }
+    if (!programma) {
+        fprintf(stderr, "[Ошибка] Сценарий не компилируется\n");
+    } else if (ks_program_save(programma, tekst, vyhod) != 0) {
+        fprintf(stderr, "[Ошибка] Не удалось записать '%s'\n", vyhod);
+    } else {
+        kod = 0;
+    }
+    ks_program_free(programma);
+    ks_free(&skript);
+    free(tekst);
+    return kod;
+}
+
 int main(int argc, char **argv) {
     const char *vyhod = NULL;
     const char *vhod = NULL;
     bool decode = false;
+    bool ksc = false;
 
     for (int indeks = 1; indeks < argc; ++indeks) {
         if (strcmp(argv[indeks], "--decode") == 0) {
             decode = true;
+        } else if (strcmp(argv[indeks], "--ksc") == 0) {
+            ksc = true;
         } else if (strcmp(argv[indeks], "-o") == 0) {
             if (indeks + 1 >= argc) {
                 vyvesti_spravku();
@@ -233,6 +277,11 @@ int main(int argc, char **argv) {
     if (!dannye) {
         return 1;
     }
+    if (ksc) {
+        int kod = kompilirovat(vyhod, vhod, dannye, dlina);
+        free(dannye);
+        return kod == 0 ? 0 : 1;
+    }
     if (decode) {
         int kod = dekodirovat(vyhod, dannye, dlina);
         free(dannye);
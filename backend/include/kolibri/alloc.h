@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#ifndef KOLIBRI_ALLOC_H
+#define KOLIBRI_ALLOC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocator hooks for kolibri_core. The three callbacks follow malloc,
+ * realloc and free (free gets NULL too) and receive user as their first
+ * argument, so a tenant arena, a tracking wrapper or a failure injector can
+ * sit behind them.
+ *
+ * Objects that accept an allocator (knowledge index, sigma state, script,
+ * sim) copy it when they are created and use the copy until they are freed.
+ * Everything else, and every object given NULL, takes the process default,
+ * which is libc until kolibri_allocator_set_default replaces it. Set the
+ * default before creating objects: it is not synchronised with allocations
+ * and memory must go back to the allocator it came from.
+ */
+typedef struct {
+    void *(*alloc)(void *user, size_t size);
+    void *(*realloc)(void *user, void *ptr, size_t size);
+    void (*free)(void *user, void *ptr);
+    void *user;
+} KolibriAllocator;
+
+/* NULL restores libc; -1 when a callback is missing. */
+int kolibri_allocator_set_default(const KolibriAllocator *allocator);
+const KolibriAllocator *kolibri_allocator_default(void);
+/* Copies allocator, or the default when it is NULL, into out. */
+void kolibri_allocator_resolve(KolibriAllocator *out, const KolibriAllocator *allocator);
+
+/* allocator may be NULL for the default. calloc and strdup return NULL on overflow too. */
+void *kolibri_mem_alloc(const KolibriAllocator *allocator, size_t size);
+void *kolibri_mem_calloc(const KolibriAllocator *allocator, size_t count, size_t size);
+void *kolibri_mem_realloc(const KolibriAllocator *allocator, void *ptr, size_t size);
+void kolibri_mem_free(const KolibriAllocator *allocator, void *ptr);
+char *kolibri_mem_strdup(const KolibriAllocator *allocator, const char *text);
+char *kolibri_mem_strndup(const KolibriAllocator *allocator, const char *text, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KOLIBRI_ALLOC_H */
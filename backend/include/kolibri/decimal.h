@@ -14,13 +14,29 @@ typedef struct {
     size_t cursor;
 } k_digit_stream;
 
+/*
+ * The one digit-stream core; kolibri_potok_cifr (digits.h) forwards here.
+ * Neither init nor reset touches the buffer: reset only drops the length,
+ * and digits past it are unspecified.
+ */
 void k_digit_stream_init(k_digit_stream *stream, uint8_t *buffer, size_t capacity);
 void k_digit_stream_reset(k_digit_stream *stream);
 void k_digit_stream_rewind(k_digit_stream *stream);
 int k_digit_stream_push(k_digit_stream *stream, uint8_t digit);
+/* Appends count digits 0..9 or nothing: capacity and digits are checked first. */
+int k_digit_stream_push_bulk(k_digit_stream *stream, const uint8_t *digits, size_t count);
 int k_digit_stream_read(k_digit_stream *stream, uint8_t *digit);
 size_t k_digit_stream_remaining(const k_digit_stream *stream);
 
+/*
+ * Raw transducer kernels without capacity checks: k_utf8_to_digits writes
+ * 3 * len digits, k_digits_to_utf8 reads 3 * triplets and returns -1 for a
+ * digit above 9 or -2 for a triplet above 255.
+ */
+void k_utf8_to_digits(const unsigned char *bytes, size_t len, uint8_t *out);
+int k_digits_to_utf8(const uint8_t *digits, size_t triplets, unsigned char *out);
+
+/* Both fail without writing when the whole input does not fit. */
 int k_transduce_utf8(k_digit_stream *stream, const unsigned char *bytes, size_t len);
 int k_emit_utf8(const k_digit_stream *stream, unsigned char *out, size_t out_len, size_t *written);
 
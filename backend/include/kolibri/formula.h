@@ -31,7 +31,23 @@ typedef struct {
 
 #define KOLIBRI_FORMULA_MAX_ASSOCIATIONS 32
 #define KOLIBRI_POOL_MAX_ASSOCIATIONS 64
+#define KOLIBRI_POOL_MAX_FORMULAS 24
+#define KOLIBRI_POOL_MAX_PARALLELISM 8
+#define KOLIBRI_POOL_MAX_EXAMPLES 64
+#define KOLIBRI_POOL_CACHE_SLOTS 128
+#define KOLIBRI_POOL_ASSOC_KEY_SLOTS (2 * KOLIBRI_POOL_MAX_ASSOCIATIONS)
+#define KOLIBRI_POOL_ASSOC_WORDS ((KOLIBRI_POOL_MAX_ASSOCIATIONS + 63) / 64)
+/* Trigram buckets of the partial-match index. Its rows are bitmaps over
+ * association slots: one key trigram per question, every trigram, and
+ * questions under three bytes. */
+#define KOLIBRI_ASSOC_GRAM_BUCKETS 512
+#define KOLIBRI_ASSOC_GRAM_ROWS (2 * KOLIBRI_ASSOC_GRAM_BUCKETS + 1)
 
+/*
+ * Only the hot evolution state lives in a formula. Associations stay in the
+ * pool's table and a formula refers to a prefix of it, so the pointer is valid
+ * for as long as the pool is neither freed nor moved.
+ */
 typedef struct {
     KolibriGene gene;
     double fitness;
@@ -39,25 +55,86 @@ typedef struct {
     double invariant_drift_b;
     double invariant_drift_d;
     double phase;
-    KolibriAssociation associations[KOLIBRI_FORMULA_MAX_ASSOCIATIONS];
+    const KolibriAssociation *associations;
     size_t association_count;
 } KolibriFormula;
 
+/*
+ * Times are monotonic wall clock. evaluation_ns and coherence_ns are summed
+ * over the worker threads, so with parallelism above 1 they can exceed
+ * total_tick_ns; sort_ns and reproduce_ns run on the calling thread only.
+ */
 typedef struct {
     uint64_t generation_steps;
     uint64_t evaluation_calls;
     double last_generation_ms;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    double cache_hit_rate;
+    uint64_t last_tick_ns;
+    uint64_t total_tick_ns;
+    uint64_t evaluation_ns;
+    uint64_t coherence_ns;
+    uint64_t sort_ns;
+    uint64_t reproduce_ns;
+    double evaluations_per_sec;
 } KolibriPoolProfile;
 
+/*
+ * Stop conditions for kf_pool_tick_until. Zero fields are ignored, except
+ * max_generations, which always caps the run (zero means one generation).
+ */
 typedef struct {
-    KolibriFormula formulas[24];
+    size_t max_generations;
+    uint32_t deadline_ms;
+    double target_fitness;
+    size_t stagnation_generations;
+} KolibriTickBudget;
+
+/*
+ * Dataset-dependent metrics of one gene. An entry is valid only while its
+ * version matches the pool's dataset_version; version 0 marks an empty slot.
+ */
+typedef struct {
+    uint64_t version;
+    KolibriGene gene;
+    double base_score;
+    double drift_b;
+    double drift_d;
+    double phase;
+} KolibriFitnessCacheEntry;
+
+/* Capacities of a heap pool; a zero field takes the fixed pool's limit. */
+typedef struct {
+    size_t formula_capacity;
+    size_t example_capacity;
+    size_t association_capacity;
+    uint64_t seed;
+} KolibriPoolConfig;
+
+/*
+ * The arrays point either at the embedded storage (kf_pool_init, used by the
+ * kernel and wasm builds) or at heap buffers sized by kf_pool_create. count is
+ * the population size and never changes after setup.
+ */
+typedef struct {
+    KolibriFormula *formulas;
     size_t count;
     KolibriRng rng;
-    int inputs[64];
-    int targets[64];
+    int *inputs;
+    int *targets;
     size_t examples;
-    KolibriAssociation associations[KOLIBRI_POOL_MAX_ASSOCIATIONS];
+    size_t example_capacity;
+    uint32_t input_peak; /* largest |input| seen, picks the batch kernel */
+    KolibriAssociation *associations;
     size_t association_count;
+    size_t association_capacity;
+    uint32_t *association_keys; /* open addressing on input_hash, slot + 1 */
+    size_t association_key_slots;
+    uint64_t *association_grams;
+    size_t association_words;
+    uint64_t *association_signatures; /* trigram bits of each question */
+    uint32_t association_gram_load[KOLIBRI_ASSOC_GRAM_BUCKETS];
     double lambda_b;
     double lambda_d;
     double target_b;
@@ -67,10 +144,50 @@ typedef struct {
     double coherence_gain;
     double temperature;
     size_t top_k;
+    size_t parallelism;
     KolibriPoolProfile profile;
+    KolibriFitnessCacheEntry *cache;
+    size_t cache_slots;
+    uint64_t dataset_version;
+    int owns_storage;
+    KolibriFormula formula_storage[KOLIBRI_POOL_MAX_FORMULAS];
+    int input_storage[KOLIBRI_POOL_MAX_EXAMPLES];
+    int target_storage[KOLIBRI_POOL_MAX_EXAMPLES];
+    KolibriAssociation association_storage[KOLIBRI_POOL_MAX_ASSOCIATIONS];
+    uint32_t association_key_storage[KOLIBRI_POOL_ASSOC_KEY_SLOTS];
+    uint64_t association_gram_storage[KOLIBRI_ASSOC_GRAM_ROWS * KOLIBRI_POOL_ASSOC_WORDS];
+    uint64_t association_signature_storage[KOLIBRI_POOL_MAX_ASSOCIATIONS];
+    KolibriFitnessCacheEntry cache_storage[KOLIBRI_POOL_CACHE_SLOTS];
 } KolibriFormulaPool;
 
+/* Sets up a pool on its embedded storage. The pool must not be moved. */
 void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed);
+/* Allocates a pool with caller-chosen capacities; NULL on failure. */
+KolibriFormulaPool *kf_pool_create(const KolibriPoolConfig *config);
+/* Frees a pool from kf_pool_create; pools set up by kf_pool_init are left alone. */
+void kf_pool_destroy(KolibriFormulaPool *pool);
+/*
+ * Makes dst an exact copy of src: formulas, generator, examples, associations
+ * with their index, settings and fitness cache; only the profile starts over.
+ * dst needs the same population size and room for src's data.
+ */
+int kf_pool_copy(KolibriFormulaPool *dst, const KolibriFormulaPool *src);
+/* A heap pool with the capacities of pool and a copy of its state; NULL on failure. */
+KolibriFormulaPool *kf_pool_clone(const KolibriFormulaPool *pool);
+/*
+ * Checkpoints the learned state: formulas with their fitness, generator,
+ * settings, examples and associations. The fitness cache, profile and
+ * parallelism are not kept. The file is replaced atomically and closed by
+ * a 64-bit FNV-1a hash of its contents, which hash receives when not NULL.
+ */
+int kf_pool_save(const KolibriFormulaPool *pool, const char *path, uint64_t *hash);
+/*
+ * Restores a checkpoint into a pool of the same population size with room
+ * for its examples and associations. Returns 0 when loaded, 1 when the file
+ * does not exist and -1 when it is unreadable, damaged or does not fit; the
+ * pool is left untouched unless it returns 0.
+ */
+int kf_pool_load(KolibriFormulaPool *pool, const char *path, uint64_t *hash);
 void kf_pool_clear_examples(KolibriFormulaPool *pool);
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target);
 int kf_pool_add_association(KolibriFormulaPool *pool,
@@ -79,12 +196,55 @@ int kf_pool_add_association(KolibriFormulaPool *pool,
                             const char *answer,
                             const char *source,
                             uint64_t timestamp);
+/* One question/answer pair for kf_pool_add_associations_bulk. */
+typedef struct {
+    const char *question;
+    const char *answer;
+} KolibriAssociationInput;
+
+/*
+ * Same result as kf_pool_add_association over items in order, with one source
+ * and timestamp, but an overflowing table costs one index rebuild per call
+ * instead of one per pair. Pairs with a NULL side are skipped. Returns the
+ * number of pairs stored.
+ */
+size_t kf_pool_add_associations_bulk(KolibriFormulaPool *pool,
+                                     KolibriSymbolTable *symbols,
+                                     const KolibriAssociationInput *items,
+                                     size_t count,
+                                     const char *source,
+                                     uint64_t timestamp);
 void kf_pool_tick(KolibriFormulaPool *pool, size_t generations);
+/*
+ * Evolves until a budget condition holds and returns the generations run.
+ * The stop checks see each generation's scores before it reproduces, so a
+ * pool that already meets target_fitness runs zero generations.
+ */
+size_t kf_pool_tick_until(KolibriFormulaPool *pool, const KolibriTickBudget *budget);
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool);
 int kf_formula_apply(const KolibriFormula *formula, int input, int *output);
 size_t kf_formula_digits(const KolibriFormula *formula, uint8_t *out, size_t out_len);
 int kf_formula_describe(const KolibriFormula *formula, char *buffer, size_t buffer_len);
 int kf_pool_feedback(KolibriFormulaPool *pool, const KolibriGene *gene, double delta);
+/*
+ * Replaces the weakest formulas of a ranked pool with migrants, skipping genes
+ * the pool already holds, and keeps the pool ranked. Returns how many came in.
+ */
+size_t kf_pool_immigrate(KolibriFormulaPool *pool, const KolibriFormula *migrants, size_t count);
+/* First association with this input_hash, found through the pool's index. */
+const KolibriAssociation *kf_pool_find_association(const KolibriFormulaPool *pool, int input_hash);
+/*
+ * kf_formula_lookup_answer for a formula of this pool, answered from the
+ * index when the formula shares the pool's association table.
+ */
+int kf_pool_lookup_answer(const KolibriFormulaPool *pool, const KolibriFormula *formula,
+                          int input, char *buffer, size_t buffer_len);
+/*
+ * Longest association whose question contains, or is contained in, question
+ * (ASCII case-insensitive); NULL if none does.
+ */
+const KolibriAssociation *kf_pool_match_association(const KolibriFormulaPool *pool,
+                                                    const char *question);
 int kf_formula_lookup_answer(const KolibriFormula *formula, int input,
                              char *buffer, size_t buffer_len);
 int kf_hash_from_text(const char *text);
@@ -92,7 +252,21 @@ void kf_pool_set_penalties(KolibriFormulaPool *pool, double lambda_b, double lam
 void kf_pool_set_targets(KolibriFormulaPool *pool, double target_b, double target_d);
 void kf_pool_set_coherence_gain(KolibriFormulaPool *pool, double gain);
 void kf_pool_set_sampling(KolibriFormulaPool *pool, double temperature, size_t top_k);
+/*
+ * Evaluates beam groups on up to threads workers (0 picks the number of online
+ * CPUs). Evaluation draws no random numbers and reproduction stays serial, so
+ * the result does not depend on the thread count. Builds without threads
+ * always evaluate serially.
+ */
+void kf_pool_set_parallelism(KolibriFormulaPool *pool, size_t threads);
+/* Drops cached fitness metrics; needed after editing inputs/targets directly. */
+void kf_pool_invalidate_cache(KolibriFormulaPool *pool);
 const KolibriPoolProfile *kf_pool_profile(const KolibriFormulaPool *pool);
+/*
+ * Writes the profile as one JSON object. Returns the length written, or -1
+ * if the buffer is too small.
+ */
+int kf_pool_profile_json(const KolibriPoolProfile *profile, char *buffer, size_t buffer_len);
 
 
 #endif /* KOLIBRI_FORMULA_H */
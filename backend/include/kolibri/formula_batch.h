@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#ifndef KOLIBRI_FORMULA_BATCH_H
+#define KOLIBRI_FORMULA_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Batch kernel shared by the backend interpreter and the bare-metal kernel:
+ * apply slope * x + bias (or slope * x * x + bias) to every example and sum
+ * |target - prediction|, the predictions and the targets. All sums are exact
+ * integers, so every kernel gives the same totals as the scalar loop.
+ *
+ * Written with GCC vector extensions rather than intrinsics headers, which
+ * pull in the C library and are unavailable to a freestanding build. Four
+ * int32 lanes map to SSE2 on x86 (including the i686 kernel) and to NEON on
+ * ARM.
+ */
+typedef struct {
+    int64_t abs_error;
+    int64_t predictions;
+    int64_t targets;
+} KolibriBatchSums;
+
+/* Largest |input| for which the op stays inside int32 without clamping. */
+#define KOLIBRI_BATCH_LINEAR_PEAK 21691753U
+#define KOLIBRI_BATCH_QUADRATIC_PEAK 4657U
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define KOLIBRI_BATCH_VEC4 1
+
+typedef int32_t KolibriBatchI32x4 __attribute__((vector_size(16)));
+typedef int32_t KolibriBatchI32x4u __attribute__((vector_size(16), aligned(4), may_alias));
+typedef int64_t KolibriBatchI64x2 __attribute__((vector_size(16)));
+
+#if defined(__clang__) || __GNUC__ >= 12
+#define KOLIBRI_BATCH_SHUFFLE(a, b, i0, i1, i2, i3) __builtin_shufflevector((a), (b), i0, i1, i2, i3)
+#else
+#define KOLIBRI_BATCH_SHUFFLE(a, b, i0, i1, i2, i3) \
+    __builtin_shuffle((a), (b), (KolibriBatchI32x4){i0, i1, i2, i3})
+#endif
+
+/* Sign-extends the low or high pair of lanes to int64. */
+#define KOLIBRI_BATCH_WIDEN_LO(v, sign) ((KolibriBatchI64x2)KOLIBRI_BATCH_SHUFFLE((v), (sign), 0, 4, 1, 5))
+#define KOLIBRI_BATCH_WIDEN_HI(v, sign) ((KolibriBatchI64x2)KOLIBRI_BATCH_SHUFFLE((v), (sign), 2, 6, 3, 7))
+
+static inline KolibriBatchI64x2 kolibri_batch_abs64(KolibriBatchI64x2 value) {
+    KolibriBatchI32x4 high = (KolibriBatchI32x4)value >> 31;
+    KolibriBatchI64x2 sign = (KolibriBatchI64x2)KOLIBRI_BATCH_SHUFFLE(high, high, 1, 1, 3, 3);
+    return (value ^ sign) - sign;
+}
+
+/*
+ * Handles whole groups of four examples and returns how many it consumed;
+ * the caller finishes the tail with its scalar loop. Exact only while no
+ * prediction leaves int32, i.e. |input| within the peaks above.
+ */
+static inline size_t kolibri_batch_apply_vec4(int32_t slope, int32_t bias, int quadratic,
+                                              const int *inputs, const int *targets,
+                                              size_t count, KolibriBatchSums *sums) {
+    const KolibriBatchI32x4 slope4 = {slope, slope, slope, slope};
+    const KolibriBatchI32x4 bias4 = {bias, bias, bias, bias};
+    KolibriBatchI64x2 abs_error = {0, 0};
+    KolibriBatchI64x2 predictions = {0, 0};
+    KolibriBatchI64x2 target_sum = {0, 0};
+    size_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        KolibriBatchI32x4 x = *(const KolibriBatchI32x4u *)&inputs[i];
+        KolibriBatchI32x4 t = *(const KolibriBatchI32x4u *)&targets[i];
+        if (quadratic) {
+            x = x * x;
+        }
+        KolibriBatchI32x4 p = x * slope4 + bias4;
+        KolibriBatchI32x4 p_sign = p >> 31;
+        KolibriBatchI32x4 t_sign = t >> 31;
+        KolibriBatchI64x2 p_lo = KOLIBRI_BATCH_WIDEN_LO(p, p_sign);
+        KolibriBatchI64x2 p_hi = KOLIBRI_BATCH_WIDEN_HI(p, p_sign);
+        KolibriBatchI64x2 t_lo = KOLIBRI_BATCH_WIDEN_LO(t, t_sign);
+        KolibriBatchI64x2 t_hi = KOLIBRI_BATCH_WIDEN_HI(t, t_sign);
+        abs_error += kolibri_batch_abs64(t_lo - p_lo) + kolibri_batch_abs64(t_hi - p_hi);
+        predictions += p_lo + p_hi;
+        target_sum += t_lo + t_hi;
+    }
+    sums->abs_error += abs_error[0] + abs_error[1];
+    sums->predictions += predictions[0] + predictions[1];
+    sums->targets += target_sum[0] + target_sum[1];
+    return i;
+}
+#else
+static inline size_t kolibri_batch_apply_vec4(int32_t slope, int32_t bias, int quadratic,
+                                              const int *inputs, const int *targets,
+                                              size_t count, KolibriBatchSums *sums) {
+    (void)slope;
+    (void)bias;
+    (void)quadratic;
+    (void)inputs;
+    (void)targets;
+    (void)count;
+    (void)sums;
+    return 0;
+}
+#endif
+
+#endif /* KOLIBRI_FORMULA_BATCH_H */
@@ -1,6 +1,7 @@
 #ifndef KOLIBRI_GENOME_H
 #define KOLIBRI_GENOME_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -16,6 +17,20 @@ extern "C" {
   (sizeof(uint64_t) + sizeof(uint64_t) + KOLIBRI_HASH_SIZE +                   \
    KOLIBRI_HASH_SIZE + KOLIBRI_EVENT_TYPE_SIZE + KOLIBRI_PAYLOAD_SIZE)
 
+/*
+ * On-disk formats. v1 files are a bare array of fixed KOLIBRI_BLOCK_SIZE
+ * blocks. v2 files start with KOLIBRI_GENOME_V2_MAGIC and hold variable-length
+ * records: a big-endian u16 record length, index, timestamp, prev_hash, hmac,
+ * a u8-prefixed event type, a payload encoding byte and the packed payload
+ * (the bytes behind kg_encode_payload's digit triples, or BCD for any other
+ * digit string). HMACs and prev_hash are always computed over the v1 layout
+ * of a block, so both formats share one chain and convert without re-signing.
+ */
+#define KOLIBRI_GENOME_FORMAT_V1 1
+#define KOLIBRI_GENOME_FORMAT_V2 2
+#define KOLIBRI_GENOME_V2_MAGIC "KOLIBRI2"
+#define KOLIBRI_GENOME_V2_HEADER_SIZE 8
+
 typedef struct {
   uint64_t index;
   uint64_t timestamp;
@@ -25,6 +40,25 @@ typedef struct {
   char payload[KOLIBRI_PAYLOAD_SIZE];
 } ReasonBlock;
 
+typedef enum {
+  KG_SYNC_FLUSH,     /* fflush to the kernel only */
+  KG_SYNC_FDATASYNC, /* fflush + fdatasync */
+  KG_SYNC_FSYNC      /* fflush + fsync */
+} KolibriGenomeSyncMode;
+
+/* When appends are made durable; a sync happens as soon as either bound is
+ * reached (checked on append, so idle writers should call kg_sync). */
+typedef struct {
+  KolibriGenomeSyncMode mode;
+  size_t every_blocks; /* 0 disables the block bound */
+  uint32_t every_ms;   /* 0 disables the time bound */
+} KolibriGenomeSyncPolicy;
+
+typedef struct {
+  const char *event_type;
+  const char *payload; /* digits, see kg_encode_payload; NULL is empty */
+} KolibriGenomeEntry;
+
 typedef struct {
   FILE *file;
   unsigned char last_hash[KOLIBRI_HASH_SIZE];
@@ -34,15 +68,122 @@ typedef struct {
   char path[260];
   uint64_t next_index;
   int has_last_block;
+  KolibriGenomeSyncPolicy sync;
+  size_t unsynced_blocks;
+  uint64_t last_sync_ns;
+  unsigned char chain_hash[KOLIBRI_HASH_SIZE]; /* next block's prev_hash */
+  uint64_t segment_blocks; /* 0 for a single-file genome */
+  uint64_t segment_first;  /* index of the active segment's first block */
+  int format;              /* KOLIBRI_GENOME_FORMAT_* of the active file */
 } KolibriGenome;
 
+/*
+ * Segmented genome: a directory of segment-<first index>.dat files holding
+ * at most segment_blocks blocks each, plus a MANIFEST with one HMAC-signed
+ * line per sealed segment (first index, block count, SHA-256 of its last
+ * block). The chain runs across segments unchanged, so opening verifies only
+ * the active segment against the manifest. Compaction folds old segments
+ * into a signed summary line and deletes their files.
+ */
+#define KOLIBRI_SEGMENT_NAME_SIZE 48
+
+typedef struct {
+  uint64_t first_index;
+  uint64_t block_count;
+  unsigned char last_hash[KOLIBRI_HASH_SIZE];
+  char file[KOLIBRI_SEGMENT_NAME_SIZE]; /* empty for a folded summary */
+} KolibriGenomeSegment;
+
+/* Read-only mmap view of a genome file for O(1) access to any block. */
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  uint64_t block_count; /* whole blocks; a torn tail is not counted */
+  int format;
+  uint64_t *offsets; /* v2: block_count + 1 record offsets, NULL for v1 */
+} KolibriGenomeReader;
+
+/* Tail cursor over a genome file or segmented directory. It yields verified
+ * blocks from start_index on and waits for appends (inotify on Linux, size
+ * polling elsewhere). Blocks before start_index are only hashed, so the first
+ * yielded block is linked to them but not to the genesis block. */
+typedef struct {
+  char path[260];
+  int segmented;
+  unsigned char key[KOLIBRI_HMAC_KEY_SIZE];
+  size_t key_len;
+  FILE *file;            /* active file, NULL until it exists */
+  int format;            /* 0 until the active file's header is readable */
+  uint64_t offset;       /* next unread byte of the active file */
+  uint64_t segment_first;
+  uint64_t start_index;  /* moved past blocks folded by kg_compact */
+  uint64_t next_index;   /* index of the next block read */
+  unsigned char prev_hash[KOLIBRI_HASH_SIZE];
+  int notify_fd;         /* -1 when polling */
+} KolibriGenomeFollower;
+
+typedef struct {
+  size_t threads; /* HMAC/linkage workers, 0 = online CPUs */
+  /* Remembers the verified prefix (HMAC-signed with the genome key), so the
+   * next verification only checks blocks appended since. NULL disables. */
+  const char *checkpoint_path;
+} KolibriGenomeVerifyOptions;
+
 int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
             size_t key_len);
+int kg_open_ex(KolibriGenome *ctx, const char *path, const unsigned char *key,
+               size_t key_len, const KolibriGenomeVerifyOptions *options);
 void kg_close(KolibriGenome *ctx);
 int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload,
               ReasonBlock *out_block);
+/* Appends count blocks with one write; all entries are validated first, so
+ * either every block is appended or none is. */
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEntry *entries,
+                    size_t count, ReasonBlock *out_blocks);
+/* Defaults to flushing after every block, as kg_append always did. */
+void kg_set_sync_policy(KolibriGenome *ctx,
+                        const KolibriGenomeSyncPolicy *policy);
+int kg_sync(KolibriGenome *ctx);
+/* Chooses the format of an empty genome file (new genomes start as v1);
+ * -1 once the active file holds blocks in another format. */
+int kg_set_format(KolibriGenome *ctx, int format);
+/* 0 when the chain is intact, 1 when the file does not exist, -1 otherwise. */
 int kg_verify_file(const char *path, const unsigned char *key,
                    size_t key_len);
+int kg_verify_file_ex(const char *path, const unsigned char *key,
+                      size_t key_len, const KolibriGenomeVerifyOptions *options);
+/* Same codes as kg_verify_file for opening: 1 when missing, -1 on error. */
+int kg_reader_open(KolibriGenomeReader *reader, const char *path);
+void kg_reader_close(KolibriGenomeReader *reader);
+/* Decodes block `index` without verifying it; -1 when out of range or the
+ * record is malformed. */
+int kg_read_block(const KolibriGenomeReader *reader, uint64_t index,
+                  ReasonBlock *out_block);
+int kg_open_segmented(KolibriGenome *ctx, const char *dir,
+                      const unsigned char *key, size_t key_len,
+                      uint64_t segment_blocks);
+/* Sealed segments in order; the active one follows the last entry. */
+int kg_segments_load(const char *dir, const unsigned char *key, size_t key_len,
+                     KolibriGenomeSegment **out_segments, size_t *out_count);
+/* Checks every segment still on disk plus manifest continuity; codes as
+ * kg_verify_file. */
+int kg_verify_segmented(const char *dir, const unsigned char *key,
+                        size_t key_len,
+                        const KolibriGenomeVerifyOptions *options);
+/* Folds all but the newest keep_segments sealed segments; returns how many
+ * segments were folded or -1. Must not run while a writer has it open. */
+int kg_compact(const char *dir, const unsigned char *key, size_t key_len,
+               size_t keep_segments);
+/* A directory path follows a segmented genome; the file does not need to
+ * exist yet. */
+int kg_follow_open(KolibriGenomeFollower *follower, const char *path,
+                   const unsigned char *key, size_t key_len,
+                   uint64_t start_index);
+/* 0 with the next block, 1 when none arrived within timeout_ms (negative
+ * waits forever), -1 on a broken chain or malformed file. */
+int kg_follow(KolibriGenomeFollower *follower, ReasonBlock *out_block,
+              int timeout_ms);
+void kg_follow_close(KolibriGenomeFollower *follower);
 int kg_encode_payload(const char *utf8, char *out, size_t out_len);
 
 #ifdef __cplusplus
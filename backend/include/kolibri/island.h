@@ -0,0 +1,70 @@
+#ifndef KOLIBRI_ISLAND_H
+#define KOLIBRI_ISLAND_H
+
+#include "kolibri/formula.h"
+#include "kolibri/random.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KOLIBRI_ARCHIPELAGO_MAX_ISLANDS 64U
+#define KOLIBRI_MIGRATION_MAX_MIGRANTS 8U
+
+typedef enum {
+    KOLIBRI_MIGRATION_RING = 0,
+    KOLIBRI_MIGRATION_RANDOM = 1,
+    KOLIBRI_MIGRATION_FULL = 2
+} KolibriMigrationTopology;
+
+/*
+ * Every interval generations each member sends its best migrants formulas to
+ * the members the topology picks. The same policy drives the islands of one
+ * process and the swarm peers in roy.c.
+ */
+typedef struct {
+    KolibriMigrationTopology topology;
+    size_t interval;
+    size_t migrants;
+} KolibriMigrationPolicy;
+
+void kf_migration_policy_default(KolibriMigrationPolicy *policy);
+/* Parses "ring", "random" or "full"; returns -1 for anything else. */
+int kf_migration_topology_parse(const char *text, KolibriMigrationTopology *out);
+/*
+ * Writes the members that source sends to (never source itself) into targets
+ * and returns their count. random feeds the RANDOM topology.
+ */
+size_t kf_migration_targets(const KolibriMigrationPolicy *policy, size_t source,
+                            size_t member_count, uint64_t random,
+                            size_t *targets, size_t max_targets);
+
+/*
+ * Island 0 is the caller's pool; the others are heap pools of the same size
+ * that copy its examples and settings before every tick. Islands evolve on
+ * their own threads between migrations, and migration runs serially on
+ * the archipelago's generator, so the outcome does not depend on scheduling.
+ */
+typedef struct {
+    KolibriFormulaPool *islands[KOLIBRI_ARCHIPELAGO_MAX_ISLANDS];
+    size_t count;
+    KolibriMigrationPolicy policy;
+    KolibriRng rng;
+    size_t since_migration;
+    uint64_t migrations;
+} KolibriArchipelago;
+
+int kf_archipelago_init(KolibriArchipelago *archipelago, KolibriFormulaPool *home,
+                        size_t count, const KolibriMigrationPolicy *policy, uint64_t seed);
+void kf_archipelago_free(KolibriArchipelago *archipelago);
+void kf_archipelago_tick(KolibriArchipelago *archipelago, size_t generations);
+const KolibriFormula *kf_archipelago_best(const KolibriArchipelago *archipelago);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KOLIBRI_ISLAND_H */
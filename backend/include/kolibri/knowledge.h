@@ -15,6 +15,8 @@ typedef struct {
     KolibriKnowledgeDocument *documents;
     size_t count;
     size_t capacity;
+    void *grams; /* n-gram postings over content_lower, rebuilt by load_directory */
+    void *strings; /* arena owning every document string */
 } KolibriKnowledgeIndex;
 
 int kolibri_knowledge_index_init(KolibriKnowledgeIndex *index);
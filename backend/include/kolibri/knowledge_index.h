@@ -6,6 +6,9 @@
 #define KOLIBRI_KNOWLEDGE_INDEX_H
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "kolibri/alloc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,7 +17,7 @@ extern "C" {
 typedef struct KolibriKnowledgeIndex KolibriKnowledgeIndex;
 
 typedef struct {
-    size_t token_index;
+    uint32_t token_index;
     float weight;
 } KolibriKnowledgeVectorItem;
 
@@ -26,6 +29,9 @@ typedef struct {
     const KolibriKnowledgeVectorItem *vector;
     size_t vector_size;
     float norm;
+    /* Unit-length dense vector of kolibri_knowledge_index_embedding_dim()
+     * floats, or NULL when the document has none. */
+    const float *embedding;
 } KolibriKnowledgeDoc;
 
 typedef struct {
@@ -33,11 +39,97 @@ typedef struct {
     float idf;
 } KolibriKnowledgeToken;
 
+typedef struct {
+    size_t max_length;    /* content excerpt limit in bytes */
+    size_t threads;       /* build workers; 0 uses every online CPU */
+    int keep_term_counts; /* retain per-document counts so the index can be updated */
+    double idf_staleness; /* share of changed documents before commit recomputes IDF */
+    int stemming;         /* strip Russian/English endings; add_document follows the index */
+    int keep_positions;   /* positional postings for "quoted phrases"; add_document follows the index */
+    /* 8-bit postings and lanes scored in integers, the best candidates rescored
+     * exactly; loaded indexes keep the layout they were written with. */
+    int quantize;
+    /* With shard_count > 1, create_ex and update keep only the crawled files
+     * whose id kolibri_knowledge_index_shard_of assigns to shard_index. */
+    size_t shard_count;
+    size_t shard_index;
+    /* Memory for everything create_ex builds (NULL: the default, as loaded
+     * indexes always use); copied, and must be thread-safe with threads > 1. */
+    const KolibriAllocator *allocator;
+} KolibriKnowledgeIndexOptions;
+
+void kolibri_knowledge_index_options_init(KolibriKnowledgeIndexOptions *options);
+
+/* Shard owning the document id (the file name without .md): a 64-bit FNV-1a
+ * hash modulo shard_count, 0 when shard_count <= 1. */
+size_t kolibri_knowledge_index_shard_of(const char *id, size_t shard_count);
+
+/* HNSW graph over the document embeddings. */
+typedef struct {
+    size_t m;               /* links per node on the upper layers, 2 * m on the bottom one */
+    size_t ef_construction; /* candidates kept while a node is inserted */
+    size_t ef_search;       /* candidates kept by a query that passes ef = 0 */
+    uint64_t seed;          /* layer draws; a build is reproducible for a given seed */
+} KolibriKnowledgeAnnOptions;
+
+void kolibri_knowledge_index_ann_options_init(KolibriKnowledgeAnnOptions *options);
+
+typedef struct {
+    size_t candidates;    /* taken from each list; 0 means 4 * limit */
+    size_t ef;            /* dense candidates, 0 uses the graph's ef_search */
+    float rrf_k;          /* reciprocal rank fusion constant: weight / (rrf_k + rank) */
+    float lexical_weight;
+    float dense_weight;
+} KolibriKnowledgeHybridOptions;
+
+void kolibri_knowledge_index_hybrid_options_init(KolibriKnowledgeHybridOptions *options);
+
 int kolibri_knowledge_index_create(const char *const *roots,
                                    size_t root_count,
                                    size_t max_length,
                                    KolibriKnowledgeIndex **out_index);
 
+/* Parses documents and computes their vectors on options->threads workers;
+ * the result is identical to a single-threaded build. No call aborts when
+ * memory runs out: it returns ENOMEM, and a create or load builds nothing. */
+int kolibri_knowledge_index_create_ex(const char *const *roots,
+                                      size_t root_count,
+                                      const KolibriKnowledgeIndexOptions *options,
+                                      KolibriKnowledgeIndex **out_index);
+
+/*
+ * Incremental maintenance; the index must keep term counts (built with
+ * keep_term_counts or loaded from such a JSON) and not be a mapped snapshot,
+ * otherwise ENOTSUP / EROFS. Adding a source that is already indexed replaces it.
+ * Changes become searchable after commit, which drops removed documents
+ * (renumbering the rest), recomputes IDF and all vectors once the staleness
+ * bound is exceeded and rebuilds the postings.
+ * After ENOMEM the index stays safe to use but may lack the change; a commit
+ * that could not rebuild the postings leaves searches empty until one does.
+ */
+int kolibri_knowledge_index_add_document(KolibriKnowledgeIndex *index,
+                                         const char *path,
+                                         const KolibriKnowledgeIndexOptions *options);
+
+int kolibri_knowledge_index_remove_document(KolibriKnowledgeIndex *index, const char *source);
+
+int kolibri_knowledge_index_commit(KolibriKnowledgeIndex *index,
+                                   const KolibriKnowledgeIndexOptions *options);
+
+/* Syncs the index with the Markdown under roots: unchanged size+mtime (or
+ * content hash) is skipped, changed files are re-parsed, vanished ones removed.
+ * EINVAL when options->stemming differs from the setting the index was built with. */
+int kolibri_knowledge_index_update(KolibriKnowledgeIndex *index,
+                                   const char *const *roots,
+                                   size_t root_count,
+                                   const KolibriKnowledgeIndexOptions *options,
+                                   size_t *out_changed);
+
+/* Cheap change detector over the Markdown files (paths, sizes, mtimes) under roots. */
+int kolibri_knowledge_index_fingerprint(const char *const *roots,
+                                        size_t root_count,
+                                        unsigned long long *out_fingerprint);
+
 void kolibri_knowledge_index_destroy(KolibriKnowledgeIndex *index);
 
 size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index);
@@ -50,6 +142,10 @@ size_t kolibri_knowledge_index_token_count(const KolibriKnowledgeIndex *index);
 const KolibriKnowledgeToken *kolibri_knowledge_index_token(const KolibriKnowledgeIndex *index,
                                                            size_t idx);
 
+/* Query syntax: plain words are scored by TF-IDF cosine; "quoted phrases"
+ * restrict results to documents containing the words in that order (when the
+ * index keeps positions, otherwise they count as plain words); a trailing '*'
+ * matches the most frequent dictionary words with that prefix. */
 int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
                                    const char *query,
                                    size_t limit,
@@ -57,12 +153,89 @@ int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
                                    float *out_scores,
                                    size_t *out_result_count);
 
+/* Completes the last word of prefix with up to limit dictionary tokens, most
+ * frequent first. Tokens point into the index and live as long as it does. */
+int kolibri_knowledge_index_suggest(const KolibriKnowledgeIndex *index,
+                                    const char *prefix,
+                                    size_t limit,
+                                    const char **out_tokens,
+                                    size_t *out_count);
+
+/* Scores query_count queries in one pass over the postings. Results for query
+ * q occupy out_indices/out_scores[q * limit .. q * limit + out_result_counts[q]). */
+int kolibri_knowledge_index_search_batch(const KolibriKnowledgeIndex *index,
+                                         const char *const *queries,
+                                         size_t query_count,
+                                         size_t limit,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_counts);
+
+/*
+ * Dense vectors. set_embeddings takes document_count rows of dim floats in
+ * document order (an all-zero row leaves that document without one) and
+ * rebuilds the graph; the vectors are copied and normalized. load_embeddings
+ * reads a sidecar of text lines "<source or id>\t<dim floats>", blank and
+ * '#' lines skipped; listed documents that are not in the index are
+ * ignored, unlisted ones get no embedding. Either replaces every embedding
+ * the index had, or on error (EINVAL, ENOMEM, EROFS for a mapped snapshot)
+ * keeps them. Documents added later have none until the next call; a commit
+ * that drops documents rebuilds the graph, and on ENOMEM drops it.
+ * Embeddings are kept by the binary snapshot, not by the JSON files.
+ */
+int kolibri_knowledge_index_set_embeddings(KolibriKnowledgeIndex *index,
+                                           const float *vectors,
+                                           size_t dim,
+                                           const KolibriKnowledgeAnnOptions *options);
+
+int kolibri_knowledge_index_load_embeddings(KolibriKnowledgeIndex *index,
+                                            const char *path,
+                                            const KolibriKnowledgeAnnOptions *options);
+
+/* 0 while the index has no embeddings. */
+size_t kolibri_knowledge_index_embedding_dim(const KolibriKnowledgeIndex *index);
+
+/* Approximate nearest documents by cosine similarity, best first; ef = 0
+ * takes the graph's ef_search, and at least limit candidates are kept.
+ * EINVAL when dim differs from the index's; no results without embeddings. */
+int kolibri_knowledge_index_search_dense(const KolibriKnowledgeIndex *index,
+                                         const float *query,
+                                         size_t dim,
+                                         size_t limit,
+                                         size_t ef,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_count);
+
+/* Fuses the lexical and dense rankings by weighted reciprocal rank; either
+ * query may be NULL (embedding with dim 0), leaving the other ranking alone.
+ * Scores are the fused values, not similarities. */
+int kolibri_knowledge_index_search_hybrid(const KolibriKnowledgeIndex *index,
+                                          const char *query,
+                                          const float *embedding,
+                                          size_t dim,
+                                          const KolibriKnowledgeHybridOptions *options,
+                                          size_t limit,
+                                          size_t *out_indices,
+                                          float *out_scores,
+                                          size_t *out_result_count);
+
 int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
                                        const char *output_dir);
 
 int kolibri_knowledge_index_load_json(const char *input_dir,
                                       KolibriKnowledgeIndex **out_index);
 
+/* Writes output_dir/index.kbin: a versioned snapshot of strings, tokens,
+ * vectors, postings and the embedding graph that load_binary maps read-only
+ * without parsing. */
+int kolibri_knowledge_index_write_binary(const KolibriKnowledgeIndex *index,
+                                         const char *output_dir);
+
+/* EINVAL for a foreign, truncated or corrupt snapshot; callers fall back to JSON. */
+int kolibri_knowledge_index_load_binary(const char *input_dir,
+                                        KolibriKnowledgeIndex **out_index);
+
 #ifdef __cplusplus
 }
 #endif
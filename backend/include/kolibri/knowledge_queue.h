@@ -19,6 +19,19 @@ typedef enum {
 
 typedef struct KolibriQueue KolibriQueue;
 
+typedef enum {
+    KOLIBRI_QUEUE_JOURNAL_WAL,    /* readers never block the writer; synchronous=NORMAL */
+    KOLIBRI_QUEUE_JOURNAL_DELETE, /* SQLite default rollback journal; synchronous=FULL */
+} KolibriQueueJournalMode;
+
+typedef struct {
+    KolibriQueueJournalMode journal_mode;
+    int cache_size_kib;         /* page cache per connection, 0 keeps the SQLite default */
+    long long mmap_size;        /* bytes of the file mapped for reads, 0 disables */
+    int busy_timeout_ms;        /* wait on a locked database instead of SQLITE_BUSY */
+    size_t export_threads;      /* writers for export_markdown, 0 = online CPUs (at most 16) */
+} KolibriQueueOptions;
+
 typedef struct {
     long long submission_id;
     char *created_at;
@@ -32,8 +45,39 @@ typedef struct {
     char *moderated_at;
 } KolibriQueueRecord;
 
+/* Borrowed view of a submission, valid until the next iterator step. */
+typedef struct {
+    long long submission_id;
+    const char *created_at;
+    const char *title;
+    const char *content;
+    const char *source;
+    const char *metadata;
+    KolibriQueueStatus status;
+    const char *moderator;
+    const char *moderation_note;
+    const char *moderated_at;
+} KolibriQueueRow;
+
+typedef struct KolibriQueueIter KolibriQueueIter;
+
+/* One entry of a batched enqueue; source and metadata_json may be NULL. */
+typedef struct {
+    const char *title;
+    const char *content;
+    const char *source;
+    const char *metadata_json;
+} KolibriQueueSubmission;
+
+void kolibri_queue_options_init(KolibriQueueOptions *options);
+
+/* Opens with kolibri_queue_options_init() defaults. */
 int kolibri_queue_open(const char *database_path, KolibriQueue **out_queue);
 
+int kolibri_queue_open_ex(const char *database_path,
+                          const KolibriQueueOptions *options,
+                          KolibriQueue **out_queue);
+
 void kolibri_queue_close(KolibriQueue *queue);
 
 int kolibri_queue_enqueue(KolibriQueue *queue,
@@ -43,6 +87,13 @@ int kolibri_queue_enqueue(KolibriQueue *queue,
                           const char *metadata_json,
                           long long *out_submission_id);
 
+/* Inserts all submissions in one transaction: either every row lands or none
+ * does. out_submission_ids, when given, receives count ids. */
+int kolibri_queue_enqueue_batch(KolibriQueue *queue,
+                                const KolibriQueueSubmission *submissions,
+                                size_t count,
+                                long long *out_submission_ids);
+
 int kolibri_queue_fetch(KolibriQueue *queue,
                         KolibriQueueStatus status,
                         size_t limit,
@@ -51,12 +102,33 @@ int kolibri_queue_fetch(KolibriQueue *queue,
 
 void kolibri_queue_free_records(KolibriQueueRecord *records, size_t count);
 
+/*
+ * Walks submissions with the given status in submission_id order, starting
+ * after after_id (0 for the beginning). Rows are read page_size at a time
+ * with keyset pagination, so no read transaction spans pages and memory does
+ * not grow with the backlog. next returns SQLITE_ROW with out_row filled,
+ * SQLITE_DONE at the end, or an SQLite error.
+ */
+int kolibri_queue_iter_open(KolibriQueue *queue,
+                            KolibriQueueStatus status,
+                            long long after_id,
+                            size_t page_size,
+                            KolibriQueueIter **out_iter);
+
+int kolibri_queue_iter_next(KolibriQueueIter *iter, KolibriQueueRow *out_row);
+
+void kolibri_queue_iter_close(KolibriQueueIter *iter);
+
 int kolibri_queue_moderate(KolibriQueue *queue,
                            long long submission_id,
                            KolibriQueueStatus status,
                            const char *moderator,
                            const char *note);
 
+/* Incremental: files are named by submission id and the .kolibri_export
+ * manifest in destination_dir keeps a hash per file, so only new or changed
+ * records are written (temp file + rename) and stale files removed.
+ * out_exported counts every record in the export, written or not. */
 int kolibri_queue_export_markdown(KolibriQueue *queue,
                                   KolibriQueueStatus status,
                                   const char *destination_dir,
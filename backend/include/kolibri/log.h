@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#ifndef KOLIBRI_LOG_H
+#define KOLIBRI_LOG_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Structured logging for hot paths. A record is formatted by the caller
+ * straight into a slot of a bounded lock-free ring and written out by a
+ * drain thread, so a slow terminal or pipe never stalls the producer; a
+ * full ring drops the record and counts it. Before kolibri_log_start and
+ * after kolibri_log_stop records are written synchronously.
+ *
+ * The module name is kept by pointer and must outlive the record (a string
+ * literal). Records under the global level or their module's level are
+ * discarded before formatting. With a rate limit each call site, told apart
+ * by its format string, keeps that many records per second; the rest are
+ * counted and reported by one record when the next second begins.
+ *
+ * Text lines read "[module] message". Without an output file they go to
+ * stdout below KOLIBRI_LOG_LEVEL_WARN and to stderr from it; other formats
+ * use stdout. JSON lines carry ts_ns, level, module and message. A binary
+ * log starts with the magic "KLG1" and holds records of u64 wall-clock ns,
+ * u8 level, u16 module length, u16 message length, then module and message
+ * bytes; integers are little-endian.
+ */
+
+#define KOLIBRI_LOG_DEFAULT_CAPACITY 4096U
+#define KOLIBRI_LOG_MESSAGE_MAX 256U
+#define KOLIBRI_LOG_MODULES_MAX 64U
+
+typedef enum {
+    KOLIBRI_LOG_LEVEL_DEBUG = 0,
+    KOLIBRI_LOG_LEVEL_INFO,
+    KOLIBRI_LOG_LEVEL_WARN,
+    KOLIBRI_LOG_LEVEL_ERROR,
+    KOLIBRI_LOG_LEVEL_OFF
+} KolibriLogLevel;
+
+typedef enum {
+    KOLIBRI_LOG_FORMAT_TEXT = 0,
+    KOLIBRI_LOG_FORMAT_JSONL,
+    KOLIBRI_LOG_FORMAT_BINARY
+} KolibriLogFormat;
+
+/* out NULL picks the standard streams; capacity 0 takes the default; rate_limit 0 is unlimited. */
+typedef struct {
+    KolibriLogLevel level;
+    KolibriLogFormat format;
+    FILE *out;
+    size_t capacity;
+    uint32_t rate_limit;
+} KolibriLogConfig;
+
+typedef struct {
+    uint64_t written;
+    uint64_t dropped;    /* lost to a full ring */
+    uint64_t suppressed; /* held back by the rate limit */
+} KolibriLogStats;
+
+/*
+ * Applies config and starts the drain thread; the ring capacity is rounded
+ * up to a power of two. Restarting drains the previous ring first. -1 on a
+ * bad config or when the thread cannot start, leaving logging synchronous.
+ */
+int kolibri_log_start(const KolibriLogConfig *config);
+/* Writes everything queued and stops the thread; later records are written
+ * synchronously as text to the standard streams. */
+void kolibri_log_stop(void);
+/* Waits until every record queued before the call has been written. */
+void kolibri_log_flush(void);
+
+void kolibri_log_set_level(KolibriLogLevel level);
+/* Overrides the global level for one module. -1 when the module table is full. */
+int kolibri_log_set_module_level(const char *module, KolibriLogLevel level);
+int kolibri_log_enabled(KolibriLogLevel level, const char *module);
+
+void kolibri_log_write(KolibriLogLevel level, const char *module, const char *format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+void kolibri_log_vwrite(KolibriLogLevel level, const char *module, const char *format, va_list args);
+
+/* Counters since the last start. */
+void kolibri_log_stats(KolibriLogStats *stats);
+
+/* "debug", "info", "warn", "error", "off" and "text", "jsonl", "binary"; -1 otherwise. */
+int kolibri_log_parse_level(const char *text, KolibriLogLevel *level);
+int kolibri_log_parse_format(const char *text, KolibriLogFormat *format);
+
+#define KOLIBRI_LOG_DEBUG(module, ...) kolibri_log_write(KOLIBRI_LOG_LEVEL_DEBUG, (module), __VA_ARGS__)
+#define KOLIBRI_LOG_INFO(module, ...) kolibri_log_write(KOLIBRI_LOG_LEVEL_INFO, (module), __VA_ARGS__)
+#define KOLIBRI_LOG_WARN(module, ...) kolibri_log_write(KOLIBRI_LOG_LEVEL_WARN, (module), __VA_ARGS__)
+#define KOLIBRI_LOG_ERROR(module, ...) kolibri_log_write(KOLIBRI_LOG_LEVEL_ERROR, (module), __VA_ARGS__)
+
+#endif /* KOLIBRI_LOG_H */
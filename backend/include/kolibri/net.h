@@ -9,11 +9,15 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Largest frame: a 3-byte header and up to 256 payload bytes. */
+#define KOLIBRI_NET_FRAME_MAX (3U + 256U)
+
 typedef enum {
     KOLIBRI_MSG_HELLO = 1,
     KOLIBRI_MSG_MIGRATE_RULE = 2,
@@ -43,15 +47,111 @@ size_t kn_message_encode_formula(uint8_t *buffer, size_t buffer_len, uint32_t no
 size_t kn_message_encode_ack(uint8_t *buffer, size_t buffer_len, uint8_t status);
 int kn_message_decode(const uint8_t *buffer, size_t buffer_len, KolibriNetMessage *out_message);
 
+/*
+ * A frame encoded once and shared by many sends. The header and the payload
+ * are handed out as two iovecs for writev/sendmsg. A blob starts with one
+ * reference and is freed when the last one is released; references may be
+ * taken and dropped from any thread.
+ */
+typedef struct {
+    uint32_t refs;
+    size_t length;
+    uint8_t frame[KOLIBRI_NET_FRAME_MAX];
+} KolibriNetBlob;
+
+KolibriNetBlob *kn_blob_hello(uint32_t node_id);
+KolibriNetBlob *kn_blob_formula(uint32_t node_id, const KolibriFormula *formula);
+KolibriNetBlob *kn_blob_retain(KolibriNetBlob *blob);
+void kn_blob_release(KolibriNetBlob *blob);
+/* Fills iov[0] with the header and iov[1] with the payload; returns 2. */
+size_t kn_blob_iov(const KolibriNetBlob *blob, struct iovec iov[2]);
+
+/* One-shot share: connects, sends HELLO and the formula, then closes. */
 int kn_share_formula(const char *host, uint16_t port, uint32_t node_id, const KolibriFormula *formula);
 
+/*
+ * Long-lived outgoing connection. A peer connects on first use, sends HELLO
+ * once and then any number of framed messages. After a failure it stays
+ * closed until retry_at_ms; the delay doubles per failure up to 30 s.
+ */
+typedef struct {
+    char host[64];
+    uint16_t port;
+    int socket_fd;
+    uint32_t failures; /* consecutive, reset by a successful send */
+    uint64_t retry_at_ms;
+    uint64_t sent;
+    uint64_t errors;
+    uint32_t connect_us; /* last connect, including the wait for other peers */
+    uint32_t send_us;    /* last successful send */
+} KolibriNetPeer;
+
+typedef struct {
+    KolibriNetPeer *items;
+    size_t count;
+    size_t capacity;
+    uint32_t node_id;
+} KolibriNetPeers;
+
+void kn_peers_init(KolibriNetPeers *peers, uint32_t node_id);
+/* Returns the index of the new peer, or -1. */
+int kn_peers_add(KolibriNetPeers *peers, const char *host, uint16_t port);
+/* -1 while the peer is backing off or when the send fails. */
+int kn_peers_send_formula(KolibriNetPeers *peers, size_t index, const KolibriFormula *formula);
+/* Sends an encoded blob to one peer without copying it. */
+int kn_peers_send_blob(KolibriNetPeers *peers, size_t index, const KolibriNetBlob *blob);
+/* Encodes the formula once, sends it to every peer and returns how many accepted it. */
+size_t kn_peers_broadcast_formula(KolibriNetPeers *peers, const KolibriFormula *formula);
+/*
+ * Closed peers that are due for a retry connect in parallel first, so an
+ * unreachable host costs the round one connect timeout, not one per host.
+ */
+size_t kn_peers_broadcast_blob(KolibriNetPeers *peers, const KolibriNetBlob *blob);
+/*
+ * Per-peer counters and backoff state as one JSON object or as Prometheus
+ * text. Returns the length written, or -1 if the buffer is too small.
+ */
+int kn_peers_stats_json(const KolibriNetPeers *peers, char *buffer, size_t buffer_len);
+int kn_peers_stats_prometheus(const KolibriNetPeers *peers, char *buffer, size_t buffer_len);
+void kn_peers_close(KolibriNetPeers *peers);
+
+/* An accepted connection with its partially received frames. */
+typedef struct {
+    int fd;
+    size_t used;
+    uint8_t buffer[KOLIBRI_NET_FRAME_MAX];
+} KolibriNetConnection;
+
+/*
+ * Accepted connections stay open and non-blocking, so one peer can stream
+ * many messages and an idle one never stalls the others. Linux waits on
+ * epoll, other systems on select.
+ */
 typedef struct {
     int socket_fd;
     uint16_t port;
+    KolibriNetConnection *clients;
+    size_t client_count;
+    size_t client_capacity;
+    size_t next_client;
+    int poller;
 } KolibriNetListener;
 
 int kn_listener_start(KolibriNetListener *listener, uint16_t port);
+/* 1 with a message, 0 on timeout, -1 on error; UINT32_MAX waits forever. */
 int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms, KolibriNetMessage *out_message);
+/*
+ * Waits once and returns up to capacity decoded messages, in arrival order
+ * per connection. Already buffered frames are returned without waiting.
+ */
+size_t kn_listener_poll_many(KolibriNetListener *listener, uint32_t timeout_ms,
+                             KolibriNetMessage *messages, size_t capacity);
+/*
+ * A descriptor that polls readable while kn_listener_poll_many has input to
+ * process, for callers running their own event loop; -1 where the listener
+ * has none (select builds), in which case the caller polls periodically.
+ */
+int kn_listener_fd(const KolibriNetListener *listener);
 void kn_listener_close(KolibriNetListener *listener);
 
 #ifdef __cplusplus
@@ -2,6 +2,7 @@
 #define KOLIBRI_ROY_H
 
 #include "kolibri/formula.h"
+#include "kolibri/island.h"
 
 #include <netinet/in.h>
 #include <pthread.h>
@@ -14,7 +15,14 @@ extern "C" {
 #endif
 
 #define KOLIBRI_ROY_MAGIC "KSP1"
+/* Начальная ёмкость таблицы соседей; таблица удваивается до предела. */
 #define KOLIBRI_ROY_MAX_SOSSEDI 64U
+#define KOLIBRI_ROY_PREDEL_SOSEDEJ 65536U
+/* Наибольший частичный вид; обычно он порядка log2 числа соседей. */
+#define KOLIBRI_ROY_MAX_VID 32U
+/* Генов в одном анонсе и отпечатков, которые узел помнит как уже виденные. */
+#define KOLIBRI_ROY_VITRINA 16U
+#define KOLIBRI_ROY_VIDENNYE 256U
 #define KOLIBRI_ROY_MAX_OCHERED 32U
 #define KOLIBRI_ROY_HMAC_SIZE 32U
 #define KOLIBRI_ROY_PRIVET_INTERVAL 5U
@@ -37,25 +45,69 @@ typedef struct {
     KolibriRoySobytieTip tip;
     uint32_t identifikator;
     struct sockaddr_in adres;
-    KolibriFormula formula;
+    /* Полезная нагрузка FORMULA — ровно то, что несёт пакет. */
+    KolibriGene gene;
+    double fitness;
+    /* Поколение из анонса; 0 у формул, присланных целиком. */
+    uint32_t pokolenie;
 } KolibriRoySobytie;
 
+/* Анонсированный ген, который сосед может запросить по отпечатку. */
+typedef struct {
+    uint64_t hesh;
+    uint32_t pokolenie;
+    KolibriGene gene;
+    double fitness;
+} KolibriRoyVitrina;
+
 typedef struct {
     uint32_t sobstvennyj_id;
     uint16_t port;
     int soket;
+    int opros;    /* epoll приёмного потока, -1 без epoll */
+    int budilnik; /* eventfd, будит поток при остановке */
     unsigned char klyuch[KOLIBRI_ROY_HMAC_SIZE];
     size_t dlina_klyucha;
+    /* Ключевые контексты HMAC: шаблон для копий при отправке и контекст потока приёма. */
+    void *hmac_shablon;
+    void *hmac_priem;
     pthread_t potok;
     int zapushchen;
     pthread_mutex_t zamek;
-    KolibriRoySosed sosedi[KOLIBRI_ROY_MAX_SOSSEDI];
+    /*
+     * Известные соседи. Индексы — открытая адресация по идентификатору и по
+     * адресу, в ячейке номер соседа + 1; ячеек вдвое больше ёмкости.
+     */
+    KolibriRoySosed *sosedi;
     size_t chislo_sosedey;
-    pthread_mutex_t ochered_zamek;
-    KolibriRoySobytie ochered[KOLIBRI_ROY_MAX_OCHERED];
+    size_t emkost_sosedey;
+    uint32_t *indeks_id;
+    uint32_t *indeks_adres;
+    size_t chislo_yacheek;
+    /*
+     * Частичный вид в духе Cyclon: идентификаторы соседей, с которыми узел
+     * общается, и их возраст в раундах обмена. Все поля соседей — под zamek.
+     */
+    uint32_t vid[KOLIBRI_ROY_MAX_VID];
+    uint32_t vid_vozrast[KOLIBRI_ROY_MAX_VID];
+    size_t razmer_vida;
+    uint64_t sluchaj;
+    time_t poslednyaya_chistka;
+    /* Последний анонс узла (под zamek) и отпечатки, уже увиденные потоком приёма. */
+    KolibriRoyVitrina vitrina[KOLIBRI_ROY_VITRINA];
+    size_t vitrina_chislo;
+    uint64_t vidennye[KOLIBRI_ROY_VIDENNYE];
+    size_t vidennye_pozitsiya;
+    /*
+     * Кольцо без блокировок на одного писателя (поток приёма) и одного
+     * читателя (kolibri_roy_poluchit_sobytie). Голова и хвост растут
+     * монотонно, ячейка — младшие биты; глубина — степень двойки.
+     */
+    KolibriRoySobytie *ochered;
+    size_t ochered_glubina;
     size_t ochered_golova;
     size_t ochered_hvost;
-    size_t ochered_schetchik;
+    uint64_t ochered_poteri;
     time_t poslednij_privet;
 } KolibriRoy;
 
@@ -63,16 +115,32 @@ typedef struct {
 int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
         const unsigned char *klyuch, size_t dlina_klyucha);
 
+/*
+ * То же с очередью событий заданной глубины (округляется вверх до степени
+ * двойки, 0 — KOLIBRI_ROY_MAX_OCHERED). Событие, пришедшее в полную
+ * очередь, отбрасывается и учитывается в kolibri_roy_poteri.
+ */
+int kolibri_roy_zapustit_s_glubinoj(KolibriRoy *roy, uint32_t identifikator,
+        uint16_t port, const unsigned char *klyuch, size_t dlina_klyucha,
+        size_t glubina);
+
 /* Останавливает потоки и закрывает сокеты роя. */
 void kolibri_roy_ostanovit(KolibriRoy *roy);
 
 /* Возвращает очередное событие роя, если оно присутствует. */
 int kolibri_roy_poluchit_sobytie(KolibriRoy *roy, KolibriRoySobytie *sobytie);
 
+/* Число событий, отброшенных из-за переполнения очереди. */
+uint64_t kolibri_roy_poteri(const KolibriRoy *roy);
+
 /* Возвращает копию списка соседей в предоставленный буфер. */
 size_t kolibri_roy_spisok_sosedey(KolibriRoy *roy, KolibriRoySosed *naznachenie,
         size_t maksimalno);
 
+/* Возвращает копию частичного вида — соседей, которым уходят формулы. */
+size_t kolibri_roy_vid(KolibriRoy *roy, KolibriRoySosed *naznachenie,
+        size_t maksimalno);
+
 /* Отправляет широковещательное приветствие в сеть. */
 int kolibri_roy_otpravit_privet(KolibriRoy *roy);
 
@@ -80,13 +148,30 @@ int kolibri_roy_otpravit_privet(KolibriRoy *roy);
 int kolibri_roy_dobavit_soseda(KolibriRoy *roy, const struct sockaddr_in *adres,
         uint32_t identifikator);
 
-/* Отправляет формулу случайному соседу, используя внешнее случайное число. */
+/* Отправляет формулу случайному соседу из частичного вида, используя внешнее случайное число. */
 int kolibri_roy_otpravit_sluchajnomu(KolibriRoy *roy, uint64_t sluchajnoe,
         const KolibriFormula *formula);
 
 /* Рассылает формулу всем соседям и широковещательно. */
 int kolibri_roy_otpravit_vsem(KolibriRoy *roy, const KolibriFormula *formula);
 
+/*
+ * Анонсирует до KOLIBRI_ROY_VITRINA формул соседям частичного вида: в
+ * датаграмме только поколение и отпечаток гена. Сосед, не видевший
+ * отпечатка, запрашивает ген, и ответ приходит событием FORMULA с этим
+ * поколением. Уже анонсированные гены не повторяются. Возвращает число
+ * новых генов в анонсе или -1.
+ */
+int kolibri_roy_anonsirovat(KolibriRoy *roy, const KolibriFormula *formuly,
+        size_t chislo, uint32_t pokolenie);
+
+/*
+ * Отправляет формулу соседям по политике миграции: участники роя — сам узел и
+ * его соседи, упорядоченные по идентификатору. Возвращает число отправок.
+ */
+int kolibri_roy_migrirovat(KolibriRoy *roy, const KolibriMigrationPolicy *politika,
+        uint64_t sluchajnoe, const KolibriFormula *formula);
+
 #ifdef __cplusplus
 }
 #endif
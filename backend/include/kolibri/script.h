@@ -5,6 +5,7 @@
 #ifndef KOLIBRI_SCRIPT_H
 #define KOLIBRI_SCRIPT_H
 
+#include "kolibri/alloc.h"
 #include "kolibri/formula.h"
 #include "kolibri/genome.h"
 #include "kolibri/symbol_table.h"
@@ -22,6 +23,27 @@ extern "C" {
 struct KolibriScriptVariable;
 struct KolibriScriptAssociation;
 struct KolibriScriptFormulaBinding;
+struct KolibriScriptFrame;
+struct KolibriTeachBatch;
+struct KolibriScriptProfiler;
+struct KolibriScriptChanges;
+struct KolibriScriptContinuation;
+
+/*
+ * Общий пул для одновременных сценариев: пул и геном владельца, таблица
+ * символов, которой кодируются их связи, и блокировка над всеми тремя.
+ */
+typedef struct KolibriSharedPool KolibriSharedPool;
+
+/* Исход ks_step. */
+typedef enum {
+    KOLIBRI_SCRIPT_ERROR = -1,
+    KOLIBRI_SCRIPT_DONE = 0,
+    KOLIBRI_SCRIPT_YIELDED = 1
+} KolibriScriptStatus;
+
+/* Скомпилированный байткод сценария; неизменяем после ks_compile. */
+typedef struct KolibriScriptProgram KolibriScriptProgram;
 
 typedef struct {
     double lambda_b;
@@ -33,6 +55,39 @@ typedef struct {
     int cf_beam;
 } KolibriScriptControls;
 
+/* Блочная арена: выделенная память возвращается только целиком. */
+typedef struct KolibriScriptArenaChunk KolibriScriptArenaChunk;
+typedef struct {
+    KolibriScriptArenaChunk *head;
+    const KolibriAllocator *allocator; /* NULL — распределитель по умолчанию */
+} KolibriScriptArena;
+
+/*
+ * Статистика оператора, начинающегося в line:column. self_ns не включает
+ * вложенные операторы, evolution_ns — часть self_ns внутри kf_pool_tick.
+ * parent — индекс объемлющего оператора плюс один, 0 на верхнем уровне.
+ */
+typedef struct {
+    size_t line;
+    size_t column;
+    const char *kind;
+    size_t parent;
+    uint64_t count;
+    uint64_t self_ns;
+    uint64_t evolution_ns;
+} KolibriScriptProfileEntry;
+
+/* Вызывается после каждого шага оператора с его собственным временем. */
+typedef void (*KolibriScriptTraceHook)(void *user, const KolibriScriptProfileEntry *entry,
+                                       uint64_t self_ns);
+
+/* Хеш-индекс имён поверх массива переменных или формул. */
+typedef struct {
+    size_t *slots;
+    size_t capacity;
+    const KolibriAllocator *allocator;
+} KolibriScriptNameIndex;
+
 typedef struct {
     KolibriFormulaPool *pool;
     KolibriGenome *genome;
@@ -54,11 +109,42 @@ typedef struct {
     struct KolibriScriptFormulaBinding *formulas;
     size_t formulas_count;
     size_t formulas_capacity;
+
+    struct KolibriScriptFrame *frame;
+    KolibriScriptProgram *program;
+
+    KolibriScriptNameIndex variables_index;
+    KolibriScriptNameIndex formulas_index;
+
+    /* Строки значений, переменных и связей текущего запуска. */
+    KolibriScriptArena arena;
+    /* Связи подряд идущих 'обучить связь', ещё не переданные в пул. */
+    struct KolibriTeachBatch *teach;
+    /* NULL, пока профилировщик выключен. */
+    struct KolibriScriptProfiler *profiler;
+    /* Снимок общего пула и изменения запуска; NULL без ks_attach_shared. */
+    struct KolibriScriptChanges *changes;
+    /* Строк, переданных ks_execute_append после последнего полного запуска. */
+    size_t session_lines;
+    /* Запуск, начатый ks_step и ещё не завершённый. */
+    struct KolibriScriptContinuation *continuation;
+    /*
+     * Копия распределителя из ks_init_ex. Арены и индексы выше ссылаются на
+     * неё, поэтому после ks_init сценарий нельзя перемещать в памяти.
+     */
+    KolibriAllocator allocator;
 } KolibriScript;
 
 /* Инициализирует интерпретатор и выделяет внутренний цифровой буфер. */
 int ks_init(KolibriScript *skript, KolibriFormulaPool *pool,
             KolibriGenome *genome);
+/*
+ * То же, но вся память интерпретатора и программ из ks_compile берётся из
+ * allocator (NULL — распределитель по умолчанию). Таблица символов и пул
+ * формул пользуются распределителем по умолчанию.
+ */
+int ks_init_ex(KolibriScript *skript, KolibriFormulaPool *pool,
+               KolibriGenome *genome, const KolibriAllocator *allocator);
 
 /* Освобождает выделенные ресурсы интерпретатора. */
 void ks_free(KolibriScript *skript);
@@ -69,14 +155,115 @@ void ks_set_output(KolibriScript *skript, FILE *vyvod);
 /* Загружает русскоязычный сценарий из текстовой строки. */
 int ks_load_text(KolibriScript *skript, const char *text);
 
-/* Загружает сценарий из файла на диске. */
+/*
+ * Загружает сценарий из файла на диске. Если рядом лежит артефакт .ksc
+ * (см. ks_program_cache_path) для того же исходного текста, ks_execute
+ * исполняет его байткод без лексера и парсера.
+ */
 int ks_load_file(KolibriScript *skript, const char *path);
 
 /* Выполняет сценарий, возвращает 0 при успехе. */
 int ks_execute(KolibriScript *skript);
 
+/*
+ * Разбирает и исполняет только фрагмент text — операторы без обрамления
+ * 'начало:'/'конец.' — сохраняя переменные, привязки формул и режим
+ * прошлых запусков. Строки фрагментов нумеруются подряд по всей сессии;
+ * ks_execute начинает сессию заново. Загруженный текст не меняется.
+ * Возвращает 0 при успехе, 1, если фрагмент обрывается внутри
+ * незакрытого блока (ничего не исполнено, нужен фрагмент длиннее), и -1
+ * при ошибке.
+ */
+int ks_execute_append(KolibriScript *skript, const char *text);
+
+/*
+ * Компилирует загруженный сценарий в байткод, возвращает NULL при ошибке.
+ * Программу можно исполнять многократно и с разными пулами: она не зависит
+ * от состояния интерпретатора, которым была скомпилирована.
+ */
+KolibriScriptProgram *ks_compile(KolibriScript *skript);
+
+/* Исполняет скомпилированную программу, возвращает 0 при успехе. */
+int ks_execute_compiled(KolibriScript *skript, const KolibriScriptProgram *program);
+
+/*
+ * Исполняет загруженный сценарий порциями: первый вызов начинает запуск,
+ * следующие продолжают его с места остановки. Получив budget_ns, запуск
+ * уступает управление в первой точке уступки после истечения бюджета — на
+ * обратном переходе цикла или после 'вызвать эволюцию' и 'оценить' — и
+ * возвращает KOLIBRI_SCRIPT_YIELDED. Точка продолжения — счётчик команд и
+ * счётчики циклов байткода — хранится в сценарии, так что между порциями
+ * вызывающий свободен. ks_execute и ks_execute_compiled отменяют
+ * незавершённый запуск.
+ */
+KolibriScriptStatus ks_step(KolibriScript *skript, uint64_t budget_ns);
+
+/* Освобождает программу, полученную от ks_compile. */
+void ks_program_free(KolibriScriptProgram *program);
+
+/* Путь артефакта для исходника: "x.ks" -> "x.ksc", иначе добавляется ".ksc". */
+int ks_program_cache_path(const char *source_path, char *out, size_t out_len);
+
+/* Сохраняет программу в версионированный артефакт .ksc с хешем исходного текста. */
+int ks_program_save(const KolibriScriptProgram *program, const char *source_text,
+                    const char *path);
+
+/* Загружает артефакт; NULL, если он повреждён, другой версии или от другого текста. */
+KolibriScriptProgram *ks_program_load(const char *path, const char *source_text);
+
+/*
+ * Обучает пул парам вопрос/ответ вместе с n-граммами вопросов, как
+ * последовательность 'обучить связь', но пакетами через
+ * kf_pool_add_associations_bulk и с одной записью в геноме на весь вызов.
+ * Строки пар нужны только на время вызова.
+ */
+int ks_teach_bulk(KolibriScript *skript, const KolibriAssociationInput *pairs, size_t count);
+
 int ks_set_controls(KolibriScript *skript, const KolibriScriptControls *controls);
 
+/* Создаёт общий пул над пулом и геномом владельца; NULL при ошибке. */
+KolibriSharedPool *ks_shared_create(KolibriFormulaPool *pool, KolibriGenome *genome);
+
+/* Освобождает общий пул; сами пул и геном остаются владельцу. */
+void ks_shared_destroy(KolibriSharedPool *shared);
+
+/* Блокировка, под которой владелец читает или меняет пул и геном, пока идут запуски. */
+void ks_shared_lock(KolibriSharedPool *shared);
+void ks_shared_unlock(KolibriSharedPool *shared);
+
+/*
+ * Переводит сценарий на снимки общего пула (NULL возвращает пул и геном из
+ * ks_init). Каждый запуск ks_execute, ks_execute_compiled и ks_teach_bulk
+ * под блокировкой копирует пул, исполняется над копией без блокировок и
+ * затем под той же блокировкой переносит в общий пул изменения: новые связи,
+ * лучшие выведенные формулы и события генома. Сценарии на разных потоках
+ * исполняются одновременно, если у каждого свой KolibriScript.
+ */
+int ks_attach_shared(KolibriScript *skript, KolibriSharedPool *shared);
+
+/*
+ * Включает или выключает профилирование операторов. Статистика копится по
+ * запускам, пока не загружен другой текст или не вызван ks_profile_reset.
+ * ks_init включает профилировщик, если задана переменная окружения
+ * KOLIBRI_SCRIPT_PROFILE: "1" печатает отчёт в stderr при ks_free, любое
+ * другое значение — путь, куда ks_free допишет свёрнутые стеки.
+ */
+int ks_set_profiler(KolibriScript *skript, int enabled);
+
+/* Устанавливает трассировщик (NULL снимает); при необходимости включает профилировщик. */
+int ks_set_trace_hook(KolibriScript *skript, KolibriScriptTraceHook hook, void *user);
+
+/* Возвращает число записей профиля и указатель на них (действителен до следующего запуска). */
+size_t ks_profile_entries(const KolibriScript *skript, const KolibriScriptProfileEntry **entries);
+
+void ks_profile_reset(KolibriScript *skript);
+
+/* Плоский отчёт: по строке на оператор, по убыванию полного времени. */
+int ks_profile_report(const KolibriScript *skript, FILE *out);
+
+/* Свёрнутые стеки ("кадр;кадр значение") для flamegraph.pl, speedscope и т. п. */
+int ks_profile_write_collapsed(const KolibriScript *skript, FILE *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "kolibri/alloc.h"
+
 /* Публичный API для KOLIBRI-Σ */
 
 #ifdef __cplusplus
@@ -11,6 +13,8 @@ extern "C" {
 #endif
 
 uintptr_t k_state_new(uint32_t cap);
+/* Same, with every buffer of the state from allocator (NULL: the default). */
+uintptr_t k_state_new_ex(uint32_t cap, const KolibriAllocator *allocator);
 void      k_state_free(uintptr_t state);
 
 int k_observe(uintptr_t state, const uint8_t *in, size_t n);
@@ -25,14 +29,46 @@ int k_decode(uintptr_t state,
 
 int k_digit_add_syll(uintptr_t state, uint8_t digit, const uint8_t *u8, uint16_t len);
 
-int k_state_save(uintptr_t state, uint8_t *out, size_t cap);
-int k_state_load(uintptr_t state, const uint8_t *in, size_t n);
+/*
+ * k_state_save writes format v2; k_state_save_size is its exact length.
+ * k_state_load reads v1 and v2 and copies each digit's strings in one block.
+ */
+int    k_state_save(uintptr_t state, uint8_t *out, size_t cap);
+size_t k_state_save_size(uintptr_t state);
+int    k_state_load(uintptr_t state, const uint8_t *in, size_t n);
+
+/*
+ * Read-only states over a v2 snapshot whose strings stay where they are.
+ * k_state_view borrows in, which must outlive the state; k_state_map maps
+ * the file and unmaps it in k_state_free (0 where mmap is unavailable).
+ * Such states decode, save and profile; k_observe, k_digit_add_syll and
+ * k_state_load fail on them.
+ */
+uintptr_t k_state_view(const uint8_t *in, size_t n);
+uintptr_t k_state_map(const char *path);
 
 int k_profile(uintptr_t state, uint32_t what, uint8_t *out, size_t cap);
 
+/* Defaults picked up by k_state_new; states that already exist keep theirs. */
 int k_set_constraints(float breadth, float depth);
 int k_vote_mode(int mode);
 
+/*
+ * Limits and vote mode of one state. k_decode reads nothing else, so separate
+ * states can decode concurrently without locking. k_state_vote_mode returns
+ * the previous mode and ignores unknown ones.
+ */
+int k_state_set_constraints(uintptr_t state, float breadth, float depth);
+int k_state_vote_mode(uintptr_t state, int mode);
+
+/*
+ * Guards every digit with its own reader-writer lock so one state can take
+ * k_observe from several threads while others decode. Each k_observe call
+ * merges its words and locks every touched digit once. Switch the mode only
+ * while no other thread uses the state; -1 where threads are unavailable.
+ */
+int k_state_set_concurrent(uintptr_t state, int enabled);
+
 #ifdef __cplusplus
 }
 #endif
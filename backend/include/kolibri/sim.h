@@ -8,18 +8,29 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "kolibri/alloc.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct KolibriSim KolibriSim;
 
+/*
+ * trace_path appends one JSON object per log entry and tick to the file from a
+ * background thread; trace_include_genome adds the genome blocks. genome_path
+ * opens an HMAC chain (keyed by hmac_key) that gets one block per tick. The
+ * paths are only read by kolibri_sim_create and kolibri_sim_reset. allocator
+ * (NULL: the default) serves the sim and its trace buffers; it is copied at
+ * create and a reset keeps the original one.
+ */
 typedef struct {
     uint32_t seed;
     const char *hmac_key;
     const char *trace_path;
     int trace_include_genome;
     const char *genome_path;
+    const KolibriAllocator *allocator;
 } KolibriSimConfig;
 
 typedef struct {
@@ -48,7 +59,13 @@ void kolibri_sim_destroy(KolibriSim *sim);
 
 int kolibri_sim_tick(KolibriSim *sim);
 
+/*
+ * Fills buffer with views of the retained entries numbered since_offset and
+ * later (0 starts at the oldest one). *out_offset is the number of the first
+ * entry returned. The views stay valid until the next tick or reset.
+ */
 int kolibri_sim_get_logs(KolibriSim *sim,
+                         size_t since_offset,
                          KolibriSimLog *buffer,
                          size_t capacity,
                          size_t *out_count,
@@ -59,6 +76,10 @@ int kolibri_sim_get_formulas(KolibriSim *sim,
                              size_t capacity,
                              size_t *out_count);
 
+/*
+ * The newest blocks appended this run, oldest first, up to 64. The views stay
+ * valid until the next tick or reset.
+ */
 int kolibri_sim_get_genome(KolibriSim *sim,
                            KolibriSimGenomeBlock *buffer,
                            size_t capacity,
@@ -66,6 +87,31 @@ int kolibri_sim_get_genome(KolibriSim *sim,
 
 int kolibri_sim_reset(KolibriSim *sim, const KolibriSimConfig *config);
 
+/* Writes the formula pool profile as a JSON object. */
+int kolibri_sim_get_profile_json(KolibriSim *sim, char *buffer, size_t capacity);
+/* Formula evaluations run by the simulation's pool so far. */
+uint64_t kolibri_sim_evaluations(const KolibriSim *sim);
+
+/*
+ * Independent simulations stepped together on a fixed set of worker threads.
+ * Simulation i is created from config with seed config->seed + i, so a batch
+ * evolves exactly like count separate simulations ticked one by one. With
+ * more than one simulation, trace and genome paths get a ".i" suffix.
+ */
+typedef struct KolibriSimBatch KolibriSimBatch;
+
+/* threads = 0 uses every online CPU; the calling thread is one of them. */
+KolibriSimBatch *kolibri_sim_batch_create(const KolibriSimConfig *config, size_t count, size_t threads);
+void kolibri_sim_batch_destroy(KolibriSimBatch *batch);
+size_t kolibri_sim_batch_size(const KolibriSimBatch *batch);
+size_t kolibri_sim_batch_threads(const KolibriSimBatch *batch);
+KolibriSim *kolibri_sim_batch_get(KolibriSimBatch *batch, size_t index);
+/*
+ * Ticks every simulation once and returns 0, or -1 if any tick failed.
+ * tick_ns, when not NULL, receives the duration of each simulation's tick.
+ */
+int kolibri_sim_batch_tick(KolibriSimBatch *batch, uint64_t *tick_ns);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,8 @@ extern "C" {
 #define KOLIBRI_SWARM_DIGITS 10
 #define KOLIBRI_SWARM_ID_MAX 96
 #define KOLIBRI_SWARM_ENDPOINT_MAX 192
+/* Largest piece an export hands to its writer. */
+#define KOLIBRI_SWARM_EXPORT_CHUNK 4096
 
 typedef struct {
     char id[KOLIBRI_SWARM_ID_MAX];
@@ -22,6 +24,12 @@ typedef struct {
     uint64_t exchange_count;
 } KolibriSwarmNode;
 
+/*
+ * nodes stays the record of every peer. Scoring reads a float copy laid out
+ * by column: KOLIBRI_SWARM_DIGITS signature columns and then the energy
+ * column, each node_capacity long, so a selection is one matrix-vector
+ * product over contiguous memory.
+ */
 typedef struct {
     char self_id[KOLIBRI_SWARM_ID_MAX];
     double self_energy;
@@ -31,6 +39,10 @@ typedef struct {
     KolibriSwarmNode *nodes;
     size_t node_count;
     size_t node_capacity;
+    float *columns;
+    time_t *activity;
+    uint32_t *index; /* open addressing on the id hash, node + 1 */
+    size_t index_slots;
 } KolibriSwarm;
 
 int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_capacity);
@@ -39,8 +51,34 @@ int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char
 void kolibri_swarm_record_local_activity(KolibriSwarm *swarm, const char *stimulus, double impact);
 void kolibri_swarm_record_peer_activity(KolibriSwarm *swarm, const char *node_id, double impact, const char *stimulus);
 const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, double exploration_bias);
+/*
+ * Writes up to k nodes with the best kolibri_swarm_select_peer scores to out,
+ * best first, and returns how many. sample = 0 scores every node; otherwise
+ * only sample consecutive nodes from a seed-dependent offset are scored, an
+ * approximate answer whose cost does not grow with the registry.
+ */
+size_t kolibri_swarm_select_peers(const KolibriSwarm *swarm, double exploration_bias, size_t sample,
+                                  const KolibriSwarmNode **out, size_t k);
 int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size);
 
+/* Receives consecutive pieces of an export; a nonzero return stops it. */
+typedef int (*KolibriSwarmWriter)(void *context, const void *data, size_t length);
+
+/*
+ * Streams the JSON of kolibri_swarm_format_status through writer without
+ * allocating, so the registry size is not bounded by any buffer. Returns 0,
+ * or -1 if the writer stopped the export.
+ */
+int kolibri_swarm_export_json(const KolibriSwarm *swarm, KolibriSwarmWriter writer, void *context);
+/*
+ * The same record in little-endian binary: "KSW1", u32 node count, the self
+ * record (u8 id length, id, f64 energy, f64 x 10 signature, u64 fractal
+ * seed, i64 last local update), then per node u8 id length, id, u8 endpoint
+ * length, endpoint, f64 energy, i64 last activity, u64 exchange count and
+ * f64 x 10 signature.
+ */
+int kolibri_swarm_export_binary(const KolibriSwarm *swarm, KolibriSwarmWriter writer, void *context);
+
 #ifdef __cplusplus
 }
 #endif
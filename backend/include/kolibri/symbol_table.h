@@ -10,28 +10,66 @@
 extern "C" {
 #endif
 
-#define KOLIBRI_SYMBOL_MAX 256
 #define KOLIBRI_SYMBOL_DIGITS 3
+#define KOLIBRI_SYMBOL_DIGITS_MAX 9
+/*
+ * Codes 0-998 take three digits. Code 999 is the escape: it is followed by six
+ * more digits, so a table holds up to KOLIBRI_SYMBOL_LIMIT symbols.
+ */
+#define KOLIBRI_SYMBOL_ESCAPE 999U
+#define KOLIBRI_SYMBOL_LIMIT (KOLIBRI_SYMBOL_ESCAPE + 1000000U)
 
 typedef struct {
     uint32_t codepoint;
-    uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
+    uint32_t code;
 } KolibriSymbolEntry;
 
+/*
+ * The arrays are heap buffers that grow with the table, so a table is copied
+ * with kolibri_symbol_table_copy and released with kolibri_symbol_table_free.
+ * A zeroed table is empty.
+ */
 typedef struct {
-    KolibriSymbolEntry entries[KOLIBRI_SYMBOL_MAX];
+    KolibriSymbolEntry *entries;
     size_t count;
+    size_t capacity;
     uint64_t version;
     KolibriGenome *genome;
+    uint32_t *slots;      /* open addressing on codepoint, entry + 1 */
+    uint32_t *code_slots; /* open addressing on code, entry + 1 */
+    uint32_t next_code;
+    size_t logged; /* entries below this are in the genome */
 } KolibriSymbolTable;
 
 void kolibri_symbol_table_init(KolibriSymbolTable *table, KolibriGenome *genome);
+void kolibri_symbol_table_free(KolibriSymbolTable *table);
+/* dst is a table set up by kolibri_symbol_table_init; 0 or -1 without memory. */
+int kolibri_symbol_table_copy(KolibriSymbolTable *dst, const KolibriSymbolTable *src);
+/*
+ * Starts from the snapshot next to the genome when its checksum holds and it
+ * still matches the genome, replays only the blocks after it and refreshes
+ * the snapshot when they held mappings.
+ */
 void kolibri_symbol_table_load(KolibriSymbolTable *table);
 void kolibri_symbol_table_seed_defaults(KolibriSymbolTable *table);
+/*
+ * New symbols are queued; this logs them to the genome, several mappings per
+ * SYMBOL_BATCH block. Encoding flushes on its own once a block is full.
+ */
+int kolibri_symbol_table_flush(KolibriSymbolTable *table);
+/* Writes <genome path>.symbols with the logged mappings; -1 on failure. */
+int kolibri_symbol_table_save_snapshot(KolibriSymbolTable *table);
+/* Three-digit forms; -1 for a symbol whose code is escaped. */
 int kolibri_symbol_encode(KolibriSymbolTable *table, uint32_t codepoint, uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]);
 int kolibri_symbol_decode(const KolibriSymbolTable *table,
                           const uint8_t digits[KOLIBRI_SYMBOL_DIGITS],
                           uint32_t *out_codepoint);
+/* Returns the digits written (3 or 9), or -1. */
+int kolibri_symbol_encode_var(KolibriSymbolTable *table, uint32_t codepoint,
+                              uint8_t *out_digits, size_t out_len);
+/* Decodes the code at the start of digits; returns the digits consumed or -1. */
+int kolibri_symbol_decode_var(const KolibriSymbolTable *table, const uint8_t *digits,
+                              size_t len, uint32_t *out_codepoint);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#ifndef KOLIBRI_TRACE_H
+#define KOLIBRI_TRACE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Hot-path tracing shared by the backend modules. A span records its name
+ * (a string literal, kept by pointer), start and duration into a ring owned
+ * by the calling thread, so recording never contends with other threads;
+ * a full ring overwrites its oldest spans. While tracing is stopped a span
+ * costs one relaxed load. Building with KOLIBRI_TRACE_DISABLED compiles
+ * the macros out entirely.
+ *
+ * The exporter writes the Chrome trace event format, which chrome://tracing
+ * and Perfetto open directly.
+ */
+
+#define KOLIBRI_TRACE_DEFAULT_CAPACITY 16384U
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+} KolibriTraceSpan;
+
+extern atomic_int kolibri_trace_active;
+
+static inline int kolibri_trace_on(void) {
+    return atomic_load_explicit(&kolibri_trace_active, memory_order_relaxed);
+}
+
+/* Monotonic clock the spans are stamped with. */
+uint64_t kolibri_trace_now_ns(void);
+
+/*
+ * Starts recording with rings of capacity spans per thread (0 takes the
+ * default) and drops whatever was recorded before. -1 on bad capacity.
+ */
+int kolibri_trace_start(size_t capacity);
+void kolibri_trace_stop(void);
+/* Starts tracing when KOLIBRI_TRACE names an output file; returns the path or NULL. */
+const char *kolibri_trace_start_from_env(void);
+
+/* Records a span measured by the caller; a no-op while tracing is stopped. */
+void kolibri_trace_complete(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+/* Spans kept in the rings and spans lost to overwrites since the last start. */
+size_t kolibri_trace_span_count(void);
+uint64_t kolibri_trace_dropped(void);
+
+/* Writes every kept span, oldest first per thread. 0 on success, -1 on write errors. */
+int kolibri_trace_write_json(FILE *out);
+int kolibri_trace_write_file(const char *path);
+
+static inline KolibriTraceSpan kolibri_trace_span_begin(const char *name) {
+    KolibriTraceSpan span = {name, kolibri_trace_on() ? kolibri_trace_now_ns() : 0U};
+    return span;
+}
+
+static inline void kolibri_trace_span_end(KolibriTraceSpan *span) {
+    if (span->start_ns != 0U) {
+        kolibri_trace_complete(span->name, span->start_ns, kolibri_trace_now_ns());
+    }
+}
+
+#define KOLIBRI_TRACE_CONCAT_(a, b) a##b
+#define KOLIBRI_TRACE_CONCAT(a, b) KOLIBRI_TRACE_CONCAT_(a, b)
+
+#if defined(KOLIBRI_TRACE_DISABLED)
+#define KOLIBRI_TRACE_SCOPE(name) ((void)0)
+#define KOLIBRI_TRACE_BEGIN(span, name) ((void)0)
+#define KOLIBRI_TRACE_END(span) ((void)0)
+/* Keeps the arguments referenced, unevaluated, so name tables stay in use. */
+#define KOLIBRI_TRACE_COMPLETE(name, start_ns, end_ns) \
+    ((void)sizeof(name), (void)sizeof(start_ns), (void)sizeof(end_ns))
+#else
+#if defined(__GNUC__) || defined(__clang__)
+/* A span that ends when the enclosing block is left, on any path. */
+#define KOLIBRI_TRACE_SCOPE(name)                                                          \
+    KolibriTraceSpan KOLIBRI_TRACE_CONCAT(kolibri_trace_scope_, __LINE__)                  \
+        __attribute__((cleanup(kolibri_trace_span_end), unused)) = kolibri_trace_span_begin(name)
+#else
+#define KOLIBRI_TRACE_SCOPE(name) ((void)0)
+#endif
+#define KOLIBRI_TRACE_BEGIN(span, name) KolibriTraceSpan span = kolibri_trace_span_begin(name)
+#define KOLIBRI_TRACE_END(span) kolibri_trace_span_end(&(span))
+#define KOLIBRI_TRACE_COMPLETE(name, start_ns, end_ns)            \
+    do {                                                          \
+        if (kolibri_trace_on()) {                                 \
+            kolibri_trace_complete((name), (start_ns), (end_ns)); \
+        }                                                         \
+    } while (0)
+#endif
+
+#endif /* KOLIBRI_TRACE_H */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#ifndef KOLIBRI_WASM_BRIDGE_H
+#define KOLIBRI_WASM_BRIDGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * KolibriScript bridge for wasm hosts. Every context owns a formula pool and
+ * an interpreter and is addressed by handle, so one module instance can keep
+ * many pools warm. A handle is the slot index + 1 in the low 16 bits and the
+ * slot's generation above, so a freed handle stops resolving once its slot is
+ * reused; 0 is never a handle.
+ *
+ * The handle-less functions work on a default context of their own, which
+ * kolibri_bridge_handle exposes to the *_handle functions.
+ */
+
+/* A new context with a seeded pool and default controls; 0 on failure. */
+uint32_t kolibri_bridge_new(void);
+void kolibri_bridge_free(uint32_t handle);
+
+/* Reseeds the pool and restarts the interpreter; the controls are kept. */
+int kolibri_bridge_reset_handle(uint32_t handle);
+/*
+ * Drops the interpreter's variables, formulas and program but keeps the pool
+ * with everything it has learned, so no pool re-init is paid per session.
+ */
+int kolibri_bridge_reset_script_handle(uint32_t handle);
+int kolibri_bridge_configure_handle(uint32_t handle,
+                                    int lambda_b_milli,
+                                    int lambda_d_milli,
+                                    int target_b_milli,
+                                    int target_d_milli,
+                                    int temperature_milli,
+                                    int top_k,
+                                    int enable_cf_beam);
+/* Output length on success; -1 init, -2 sink, -3 parse, -4 run, -5 arguments. */
+int kolibri_bridge_execute_handle(uint32_t handle, const char *program_utf8,
+                                  char *out_buffer, size_t out_capacity);
+
+/* The default context, created on first use; 0 on failure. */
+uint32_t kolibri_bridge_handle(void);
+/* Replaces the default context with a fresh one. */
+int kolibri_bridge_init(void);
+int kolibri_bridge_reset(void);
+int kolibri_bridge_reset_script(void);
+int kolibri_bridge_configure(int lambda_b_milli,
+                             int lambda_d_milli,
+                             int target_b_milli,
+                             int target_d_milli,
+                             int temperature_milli,
+                             int top_k,
+                             int enable_cf_beam);
+int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t out_capacity);
+
+int kolibri_bridge_has_simd(void);
+int kolibri_bridge_lane_width(void);
+
+#endif /* KOLIBRI_WASM_BRIDGE_H */
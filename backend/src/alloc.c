@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *libc_alloc(void *user, size_t size) {
+    (void)user;
+    return malloc(size);
+}
+
+static void *libc_realloc(void *user, void *ptr, size_t size) {
+    (void)user;
+    return realloc(ptr, size);
+}
+
+static void libc_free(void *user, void *ptr) {
+    (void)user;
+    free(ptr);
+}
+
+static const KolibriAllocator kolibri_libc_allocator = {libc_alloc, libc_realloc, libc_free, NULL};
+static KolibriAllocator kolibri_default_allocator = {libc_alloc, libc_realloc, libc_free, NULL};
+
+int kolibri_allocator_set_default(const KolibriAllocator *allocator) {
+    if (!allocator) {
+        kolibri_default_allocator = kolibri_libc_allocator;
+        return 0;
+    }
+    if (!allocator->alloc || !allocator->realloc || !allocator->free) {
+        return -1;
+    }
+    kolibri_default_allocator = *allocator;
+    return 0;
+}
+
+const KolibriAllocator *kolibri_allocator_default(void) {
+    return &kolibri_default_allocator;
+}
+
+void kolibri_allocator_resolve(KolibriAllocator *out, const KolibriAllocator *allocator) {
+    if (!out) {
+        return;
+    }
+    *out = allocator ? *allocator : kolibri_default_allocator;
+}
+
+static const KolibriAllocator *pick(const KolibriAllocator *allocator) {
+    return allocator ? allocator : &kolibri_default_allocator;
+}
+
+void *kolibri_mem_alloc(const KolibriAllocator *allocator, size_t size) {
+    const KolibriAllocator *use = pick(allocator);
+    return use->alloc(use->user, size);
+}
+
+void *kolibri_mem_calloc(const KolibriAllocator *allocator, size_t count, size_t size) {
+    if (size != 0U && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *ptr = kolibri_mem_alloc(allocator, count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *kolibri_mem_realloc(const KolibriAllocator *allocator, void *ptr, size_t size) {
+    const KolibriAllocator *use = pick(allocator);
+    return use->realloc(use->user, ptr, size);
+}
+
+void kolibri_mem_free(const KolibriAllocator *allocator, void *ptr) {
+    const KolibriAllocator *use = pick(allocator);
+    use->free(use->user, ptr);
+}
+
+char *kolibri_mem_strndup(const KolibriAllocator *allocator, const char *text, size_t len) {
+    if (!text || len == SIZE_MAX) {
+        return NULL;
+    }
+    char *copy = (char *)kolibri_mem_alloc(allocator, len + 1U);
+    if (copy) {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+char *kolibri_mem_strdup(const KolibriAllocator *allocator, const char *text) {
+    return text ? kolibri_mem_strndup(allocator, text, strlen(text)) : NULL;
+}
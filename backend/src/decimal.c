@@ -8,6 +8,26 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define KOLIBRI_DIGITS_SSSE3 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KOLIBRI_DIGITS_NEON 1
+#endif
+
+/* Inputs shorter than this stay on the table loop. */
+#define KOLIBRI_DIGITS_VECTOR_MIN 32U
+
+#define K_TRIPLET(b) {(uint8_t)((b) / 100U), (uint8_t)((b) / 10U % 10U), (uint8_t)((b) % 10U)}
+#define K_TRIPLET4(b) K_TRIPLET(b), K_TRIPLET((b) + 1U), K_TRIPLET((b) + 2U), K_TRIPLET((b) + 3U)
+#define K_TRIPLET16(b) K_TRIPLET4(b), K_TRIPLET4((b) + 4U), K_TRIPLET4((b) + 8U), K_TRIPLET4((b) + 12U)
+#define K_TRIPLET64(b) K_TRIPLET16(b), K_TRIPLET16((b) + 16U), K_TRIPLET16((b) + 32U), K_TRIPLET16((b) + 48U)
+
+static const uint8_t k_digit_triplets[256][3] = {
+    K_TRIPLET64(0U), K_TRIPLET64(64U), K_TRIPLET64(128U), K_TRIPLET64(192U)
+};
+
 static int ensure_space(k_digit_stream *stream) {
     if (!stream || !stream->digits) {
         return -1;
@@ -26,16 +46,12 @@ void k_digit_stream_init(k_digit_stream *stream, uint8_t *buffer, size_t capacit
     stream->capacity = capacity;
     stream->length = 0;
     stream->cursor = 0;
-    if (stream->digits && stream->capacity > 0) {
-        memset(stream->digits, 0, stream->capacity);
-    }
 }
 
 void k_digit_stream_reset(k_digit_stream *stream) {
-    if (!stream || !stream->digits) {
+    if (!stream) {
         return;
     }
-    memset(stream->digits, 0, stream->capacity);
     stream->length = 0;
     stream->cursor = 0;
 }
@@ -79,30 +95,159 @@ size_t k_digit_stream_remaining(const k_digit_stream *stream) {
     return stream->length - stream->cursor;
 }
 
-static int encode_byte(k_digit_stream *stream, unsigned char value) {
-    uint8_t hundreds = (uint8_t)(value / 100U);
-    uint8_t tens = (uint8_t)((value / 10U) % 10U);
-    uint8_t ones = (uint8_t)(value % 10U);
-    if (k_digit_stream_push(stream, hundreds) != 0 ||
-        k_digit_stream_push(stream, tens) != 0 ||
-        k_digit_stream_push(stream, ones) != 0) {
+int k_digit_stream_push_bulk(k_digit_stream *stream, const uint8_t *digits, size_t count) {
+    if (!stream || !stream->digits || (!digits && count > 0)) {
         return -1;
     }
+    if (count > stream->capacity - stream->length) {
+        return -1;
+    }
+    uint8_t bad = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bad |= (uint8_t)(digits[i] > 9);
+    }
+    if (bad) {
+        return -1;
+    }
+    if (count > 0) {
+        memcpy(stream->digits + stream->length, digits, count);
+    }
+    stream->length += count;
     return 0;
 }
 
-int k_transduce_utf8(k_digit_stream *stream, const unsigned char *bytes, size_t len) {
-    if (!stream || !bytes) {
-        return -1;
+#if defined(KOLIBRI_DIGITS_SSSE3)
+#define Z 0x80
+/* Byte k of output vector q takes digit k % 3 of input byte k / 3. */
+static const uint8_t k_triplet_shuffle[3][3][16] = {
+    {
+        {0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z, Z, 5},
+        {Z, 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z, Z},
+        {Z, Z, 0, Z, Z, 1, Z, Z, 2, Z, Z, 3, Z, Z, 4, Z}},
+    {
+        {Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z, 10, Z},
+        {5, Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z, 10},
+        {Z, 5, Z, Z, 6, Z, Z, 7, Z, Z, 8, Z, Z, 9, Z, Z}},
+    {
+        {Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15, Z, Z},
+        {Z, Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15, Z},
+        {10, Z, Z, 11, Z, Z, 12, Z, Z, 13, Z, Z, 14, Z, Z, 15}}
+};
+#undef Z
+
+/*
+ * b / 100 == (b * 41) >> 12 for every byte and r / 10 == (r * 205) >> 11 for
+ * r < 100, so the split needs only 16-bit multiplies; pshufb interleaves the
+ * three digit planes.
+ */
+__attribute__((target("ssse3"))) static size_t utf8_to_digits_ssse3(const unsigned char *bytes,
+                                                                    size_t len, uint8_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i div100 = _mm_set1_epi16(41);
+    const __m128i div10 = _mm_set1_epi16(205);
+    const __m128i hundred = _mm_set1_epi16(100);
+    const __m128i ten = _mm_set1_epi16(10);
+    __m128i shuffle[3][3];
+    for (size_t q = 0; q < 3; ++q) {
+        for (size_t c = 0; c < 3; ++c) {
+            shuffle[q][c] = _mm_loadu_si128((const __m128i *)k_triplet_shuffle[q][c]);
+        }
+    }
+    size_t i = 0;
+    for (; i + 16U <= len; i += 16U) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(bytes + i));
+        __m128i planes[3][2];
+        for (size_t half = 0; half < 2; ++half) {
+            __m128i x = half ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero);
+            __m128i h = _mm_srli_epi16(_mm_mullo_epi16(x, div100), 12);
+            __m128i r = _mm_sub_epi16(x, _mm_mullo_epi16(h, hundred));
+            __m128i t = _mm_srli_epi16(_mm_mullo_epi16(r, div10), 11);
+            planes[0][half] = h;
+            planes[1][half] = t;
+            planes[2][half] = _mm_sub_epi16(r, _mm_mullo_epi16(t, ten));
+        }
+        __m128i digit[3];
+        for (size_t c = 0; c < 3; ++c) {
+            digit[c] = _mm_packus_epi16(planes[c][0], planes[c][1]);
+        }
+        for (size_t q = 0; q < 3; ++q) {
+            __m128i block = _mm_or_si128(_mm_shuffle_epi8(digit[0], shuffle[q][0]),
+                                         _mm_or_si128(_mm_shuffle_epi8(digit[1], shuffle[q][1]),
+                                                      _mm_shuffle_epi8(digit[2], shuffle[q][2])));
+            _mm_storeu_si128((__m128i *)(out + 3U * i + 16U * q), block);
+        }
+    }
+    return i;
+}
+#elif defined(KOLIBRI_DIGITS_NEON)
+/* Same split as the SSSE3 kernel; vst3q_u8 does the interleaving. */
+static size_t utf8_to_digits_neon(const unsigned char *bytes, size_t len, uint8_t *out) {
+    size_t i = 0;
+    for (; i + 16U <= len; i += 16U) {
+        uint8x16_t v = vld1q_u8(bytes + i);
+        uint16x8_t x[2] = {vmovl_u8(vget_low_u8(v)), vmovl_u8(vget_high_u8(v))};
+        uint8x8_t plane[3][2];
+        for (size_t half = 0; half < 2; ++half) {
+            uint16x8_t h = vshrq_n_u16(vmulq_n_u16(x[half], 41), 12);
+            uint16x8_t r = vmlsq_n_u16(x[half], h, 100);
+            uint16x8_t t = vshrq_n_u16(vmulq_n_u16(r, 205), 11);
+            plane[0][half] = vmovn_u16(h);
+            plane[1][half] = vmovn_u16(t);
+            plane[2][half] = vmovn_u16(vmlsq_n_u16(r, t, 10));
+        }
+        uint8x16x3_t digits;
+        digits.val[0] = vcombine_u8(plane[0][0], plane[0][1]);
+        digits.val[1] = vcombine_u8(plane[1][0], plane[1][1]);
+        digits.val[2] = vcombine_u8(plane[2][0], plane[2][1]);
+        vst3q_u8(out + 3U * i, digits);
+    }
+    return i;
+}
+#endif
+
+void k_utf8_to_digits(const unsigned char *bytes, size_t len, uint8_t *out) {
+    size_t i = 0;
+#if defined(KOLIBRI_DIGITS_SSSE3)
+    if (len >= KOLIBRI_DIGITS_VECTOR_MIN && __builtin_cpu_supports("ssse3")) {
+        i = utf8_to_digits_ssse3(bytes, len, out);
     }
-    for (size_t i = 0; i < len; ++i) {
-        if (encode_byte(stream, bytes[i]) != 0) {
+#elif defined(KOLIBRI_DIGITS_NEON)
+    if (len >= KOLIBRI_DIGITS_VECTOR_MIN) {
+        i = utf8_to_digits_neon(bytes, len, out);
+    }
+#endif
+    for (; i < len; ++i) {
+        memcpy(out + 3U * i, k_digit_triplets[bytes[i]], 3U);
+    }
+}
+
+int k_digits_to_utf8(const uint8_t *digits, size_t triplets, unsigned char *out) {
+    for (size_t i = 0; i < triplets; ++i) {
+        const uint8_t *d = digits + 3U * i;
+        if (d[0] > 9 || d[1] > 9 || d[2] > 9) {
             return -1;
         }
+        unsigned int value = d[0] * 100U + d[1] * 10U + d[2];
+        if (value > 255U) {
+            return -2;
+        }
+        out[i] = (unsigned char)value;
     }
     return 0;
 }
 
+int k_transduce_utf8(k_digit_stream *stream, const unsigned char *bytes, size_t len) {
+    if (!stream || !stream->digits || !bytes) {
+        return -1;
+    }
+    if (len > (stream->capacity - stream->length) / 3U) {
+        return -1;
+    }
+    k_utf8_to_digits(bytes, len, stream->digits + stream->length);
+    stream->length += len * 3U;
+    return 0;
+}
+
 int k_emit_utf8(const k_digit_stream *stream, unsigned char *out, size_t out_len,
                 size_t *written) {
     if (!stream || !out) {
@@ -115,12 +260,8 @@ int k_emit_utf8(const k_digit_stream *stream, unsigned char *out, size_t out_len
     if (out_len < expected) {
         return -1;
     }
-    for (size_t i = 0; i < expected; ++i) {
-        size_t offset = i * 3U;
-        unsigned int value = (unsigned int)(stream->digits[offset] * 100U +
-                                            stream->digits[offset + 1] * 10U +
-                                            stream->digits[offset + 2]);
-        out[i] = (unsigned char)value;
+    if (k_digits_to_utf8(stream->digits, expected, out) != 0) {
+        return -1;
     }
     if (written) {
         *written = expected;
@@ -144,23 +285,15 @@ int k_encode_text(const char *input, char *out, size_t out_len) {
         return -1;
     }
     size_t len = strlen(input);
-    size_t need = len * 3U + 1U;
-    if (out_len < need) {
+    if (len > (SIZE_MAX - 1U) / 3U || out_len < len * 3U + 1U) {
         return -1;
     }
-    uint8_t buffer[512];
-    if (len * 3U > sizeof(buffer)) {
-        return -1;
+    uint8_t *digits = (uint8_t *)out;
+    k_utf8_to_digits((const unsigned char *)input, len, digits);
+    for (size_t i = 0; i < len * 3U; ++i) {
+        digits[i] = (uint8_t)(digits[i] + '0');
     }
-    k_digit_stream stream;
-    k_digit_stream_init(&stream, buffer, sizeof(buffer));
-    if (k_transduce_utf8(&stream, (const unsigned char *)input, len) != 0) {
-        return -1;
-    }
-    for (size_t i = 0; i < stream.length; ++i) {
-        out[i] = (char)('0' + stream.digits[i]);
-    }
-    out[stream.length] = '\0';
+    out[len * 3U] = '\0';
     return 0;
 }
 
@@ -176,27 +309,19 @@ int k_decode_text(const char *digits, char *out, size_t out_len) {
     if (out_len < expected + 1U) {
         return -1;
     }
-    uint8_t buffer[512];
-    if (len > sizeof(buffer)) {
-        return -1;
-    }
-    k_digit_stream stream;
-    k_digit_stream_init(&stream, buffer, len);
-    for (size_t i = 0; i < len; ++i) {
-        if (digits[i] < '0' || digits[i] > '9') {
+    for (size_t i = 0; i < expected; ++i) {
+        unsigned int d0 = (unsigned char)digits[3U * i] - (unsigned int)'0';
+        unsigned int d1 = (unsigned char)digits[3U * i + 1U] - (unsigned int)'0';
+        unsigned int d2 = (unsigned char)digits[3U * i + 2U] - (unsigned int)'0';
+        if (d0 > 9U || d1 > 9U || d2 > 9U) {
             return -1;
         }
-        stream.digits[i] = (uint8_t)(digits[i] - '0');
-    }
-    stream.length = len;
-    unsigned char decoded[256];
-    size_t produced = 0;
-    if (k_emit_utf8(&stream, decoded, sizeof(decoded), &produced) != 0) {
-        return -1;
-    }
-    for (size_t i = 0; i < produced; ++i) {
-        out[i] = (char)decoded[i];
+        unsigned int value = d0 * 100U + d1 * 10U + d2;
+        if (value > 255U) {
+            return -1;
+        }
+        out[i] = (char)value;
     }
-    out[produced] = '\0';
+    out[expected] = '\0';
     return 0;
 }
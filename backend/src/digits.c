@@ -1,8 +1,24 @@
 #include "kolibri/digits.h"
 
+#include "kolibri/decimal.h"
+
+#include <stdint.h>
+
+/* Поток повторяет поля k_digit_stream; операции идут через ядро decimal.c. */
+static k_digit_stream potok_vid(const kolibri_potok_cifr *p) {
+    k_digit_stream vid;
+    vid.digits = p->danniye;
+    vid.capacity = p->emkost;
+    vid.length = p->dlina;
+    vid.cursor = p->pozitsiya;
+    return vid;
+}
+
 int kolibri_potok_cifr_init(kolibri_potok_cifr *p, uint8_t *buf, size_t cap) {
     if (!p || !buf || cap == 0) return -1;
-    p->danniye = buf; p->emkost = cap; p->dlina = 0; p->pozitsiya = 0;
+    k_digit_stream vid;
+    k_digit_stream_init(&vid, buf, cap);
+    p->danniye = vid.digits; p->emkost = vid.capacity; p->dlina = vid.length; p->pozitsiya = vid.cursor;
     return 0;
 }
 void kolibri_potok_cifr_sbros(kolibri_potok_cifr *p)      { if (p){ p->dlina = 0; p->pozitsiya = 0; } }
@@ -11,28 +27,17 @@ void kolibri_potok_cifr_vernutsya(kolibri_potok_cifr *p)  { if (p){ p->pozitsiya
 int kolibri_potok_cifr_push(kolibri_potok_cifr *p, uint8_t digit) {
     if (!p) return -1;
     if (digit > 9U) return -2;
-    if (p->dlina >= p->emkost) return -3;
-    p->danniye[p->dlina++] = digit;
+    k_digit_stream vid = potok_vid(p);
+    if (k_digit_stream_push(&vid, digit) != 0) return -3;
+    p->dlina = vid.length;
     return 0;
 }
 
-static inline void split3(uint8_t b, uint8_t *s, uint8_t *d, uint8_t *e) {
-    *s = (uint8_t)(b / 100U);
-    b  = (uint8_t)(b % 100U);
-    *d = (uint8_t)(b / 10U);
-    *e = (uint8_t)(b % 10U);
-}
-
 int kolibri_transducirovat_utf8(kolibri_potok_cifr *p, const uint8_t *utf8, size_t n) {
     if (!p || !utf8) return -1;
-    size_t need = kolibri_dlina_kodirovki_teksta(n);
-    if (p->emkost - p->dlina < need) return -2;
-    for (size_t i = 0; i < n; ++i) {
-        uint8_t s,d,e; split3(utf8[i], &s, &d, &e);
-        if (kolibri_potok_cifr_push(p,s)) return -3;
-        if (kolibri_potok_cifr_push(p,d)) return -3;
-        if (kolibri_potok_cifr_push(p,e)) return -3;
-    }
+    k_digit_stream vid = potok_vid(p);
+    if (k_transduce_utf8(&vid, utf8, n) != 0) return -2;
+    p->dlina = vid.length;
     return 0;
 }
 
@@ -42,14 +47,9 @@ int kolibri_izluchit_utf8(const kolibri_potok_cifr *p, uint8_t *out, size_t out_
     if (p->dlina % 3U) return -2;
     size_t need = kolibri_dlina_dekodirovki_teksta(p->dlina);
     if (out_cap < need) return -3;
-    size_t pos = 0, w = 0;
-    while (pos + 2 < p->dlina) {
-        uint8_t s = p->danniye[pos++], d = p->danniye[pos++], e = p->danniye[pos++];
-        if (s>9 || d>9 || e>9) return -4;
-        uint16_t val = (uint16_t)(s*100U + d*10U + e);
-        if (val > 255U) return -5;
-        out[w++] = (uint8_t)val;
-    }
-    if (written) *written = w;
+    int rc = k_digits_to_utf8(p->danniye, need, out);
+    if (rc == -1) return -4;
+    if (rc == -2) return -5;
+    if (written) *written = need;
     return 0;
 }
@@ -5,9 +5,12 @@
 #include "kolibri/formula.h"
 
 #include "kolibri/decimal.h"
+#include "kolibri/formula_batch.h"
 #include "kolibri/symbol_table.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 #include <math.h>
 #include <stddef.h>
@@ -16,6 +19,20 @@
 #include <string.h>
 #include <time.h>
 
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#define KOLIBRI_FORMULA_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define KOLIBRI_BATCH_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KOLIBRI_BATCH_NEON 1
+#endif
+
 #if defined(__GNUC__) || defined(__clang__)
 #define KOLIBRI_FORCE_INLINE static inline __attribute__((always_inline))
 #else
@@ -71,7 +88,7 @@ KOLIBRI_FORCE_INLINE size_t kolibri_popcount16(uint32_t mask) {
 }
 #endif
 
-#define KOLIBRI_FORMULA_CAPACITY (sizeof(((KolibriFormulaPool *)0)->formulas) / sizeof(KolibriFormula))
+#define KOLIBRI_FORMULA_CAPACITY KOLIBRI_POOL_MAX_FORMULAS
 #define KOLIBRI_DIGIT_MAX 9U
 #define KOLIBRI_ASSOC_TEXT_LIMIT (sizeof(((KolibriAssociation *)0)->question))
 
@@ -209,6 +226,28 @@ static void association_reset(KolibriAssociation *assoc) {
     assoc->source[0] = '\0';
 }
 
+static size_t association_encode(KolibriSymbolTable *symbols, const char *text, uint8_t *digits) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    size_t len = strlen(text);
+    size_t pos = 0U;
+    size_t written = 0U;
+    while (pos < len && written + KOLIBRI_SYMBOL_DIGITS <= KOLIBRI_ASSOC_DIGITS_MAX) {
+        uint32_t codepoint = 0U;
+        size_t consumed = kolibri_utf8_decode_next(bytes, len, pos, &codepoint);
+        if (consumed == 0U) {
+            codepoint = (uint32_t)bytes[pos];
+            consumed = 1U;
+        }
+        int width = kolibri_symbol_encode_var(symbols, codepoint, &digits[written],
+                                              KOLIBRI_ASSOC_DIGITS_MAX - written);
+        if (width > 0) {
+            written += (size_t)width;
+        }
+        pos += consumed;
+    }
+    return written;
+}
+
 static void association_set(KolibriAssociation *assoc,
                             KolibriSymbolTable *symbols,
                             const char *question,
@@ -232,40 +271,8 @@ static void association_set(KolibriAssociation *assoc,
     assoc->input_hash = kolibri_hash_to_int(fnv1a32(assoc->question));
     assoc->output_hash = kolibri_hash_to_int(fnv1a32(assoc->answer));
     if (symbols) {
-        const unsigned char *qbytes = (const unsigned char *)assoc->question;
-        size_t qlen = strlen(assoc->question);
-        size_t qpos = 0U;
-        while (qpos < qlen && assoc->question_digits_length + KOLIBRI_SYMBOL_DIGITS <= KOLIBRI_ASSOC_DIGITS_MAX) {
-            uint32_t codepoint = 0U;
-            size_t consumed = kolibri_utf8_decode_next(qbytes, qlen, qpos, &codepoint);
-            if (consumed == 0U) {
-                codepoint = (uint32_t)qbytes[qpos];
-                consumed = 1U;
-            }
-            uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
-            if (kolibri_symbol_encode(symbols, codepoint, digits) == 0) {
-                memcpy(&assoc->question_digits[assoc->question_digits_length], digits, KOLIBRI_SYMBOL_DIGITS);
-                assoc->question_digits_length += KOLIBRI_SYMBOL_DIGITS;
-            }
-            qpos += consumed;
-        }
-        const unsigned char *abytes = (const unsigned char *)assoc->answer;
-        size_t alen = strlen(assoc->answer);
-        size_t apos = 0U;
-        while (apos < alen && assoc->answer_digits_length + KOLIBRI_SYMBOL_DIGITS <= KOLIBRI_ASSOC_DIGITS_MAX) {
-            uint32_t codepoint = 0U;
-            size_t consumed = kolibri_utf8_decode_next(abytes, alen, apos, &codepoint);
-            if (consumed == 0U) {
-                codepoint = (uint32_t)abytes[apos];
-                consumed = 1U;
-            }
-            uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
-            if (kolibri_symbol_encode(symbols, codepoint, digits) == 0) {
-                memcpy(&assoc->answer_digits[assoc->answer_digits_length], digits, KOLIBRI_SYMBOL_DIGITS);
-                assoc->answer_digits_length += KOLIBRI_SYMBOL_DIGITS;
-            }
-            apos += consumed;
-        }
+        assoc->question_digits_length = association_encode(symbols, assoc->question, assoc->question_digits);
+        assoc->answer_digits_length = association_encode(symbols, assoc->answer, assoc->answer_digits);
     }
 }
 
@@ -276,18 +283,121 @@ static int association_equals(const KolibriAssociation *a, const KolibriAssociat
     return a->input_hash == b->input_hash && strcmp(a->question, b->question) == 0;
 }
 
+/*
+ * Association index. Keys map input_hash to the lowest slot holding it;
+ * linear probing keeps equal hashes in slot order. A question inside the
+ * asked text has its key trigram there, one around it has every trigram of
+ * the text, and the 64-bit signatures drop most false candidates before the
+ * substring check.
+ */
+static size_t association_key_home(const KolibriFormulaPool *pool, int input_hash) {
+    uint32_t h = (uint32_t)input_hash * 2654435761U;
+    return (size_t)(h ^ (h >> 16)) & (pool->association_key_slots - 1U);
+}
+
+static size_t association_fold(const char *src, char *dst, size_t dst_len) {
+    size_t i = 0;
+    for (; src[i] && i + 1 < dst_len; ++i) {
+        dst[i] = (char)tolower((unsigned char)src[i]);
+    }
+    dst[i] = '\0';
+    return i;
+}
+
+static size_t association_gram(const char *text) {
+    uint32_t v = ((uint32_t)(unsigned char)text[0] << 16) |
+                 ((uint32_t)(unsigned char)text[1] << 8) | (uint32_t)(unsigned char)text[2];
+    return (size_t)((v * 2654435761U) >> 16) & (KOLIBRI_ASSOC_GRAM_BUCKETS - 1U);
+}
+
+static size_t lowest_bit(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(mask);
+#else
+    size_t bit = 0;
+    while ((mask & 1ULL) == 0ULL) {
+        mask >>= 1U;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+static uint64_t *association_row(const KolibriFormulaPool *pool, size_t row) {
+    return &pool->association_grams[row * pool->association_words];
+}
+
+static void association_key_add(KolibriFormulaPool *pool, size_t slot) {
+    size_t probe = association_key_home(pool, pool->associations[slot].input_hash);
+    while (pool->association_keys[probe] != 0U) {
+        probe = (probe + 1U) & (pool->association_key_slots - 1U);
+    }
+    pool->association_keys[probe] = (uint32_t)slot + 1U;
+}
+
+static void association_index_add(KolibriFormulaPool *pool, size_t slot) {
+    const KolibriAssociation *assoc = &pool->associations[slot];
+    association_key_add(pool, slot);
+
+    char folded[KOLIBRI_ASSOC_QUESTION_MAX];
+    size_t len = association_fold(assoc->question, folded, sizeof(folded));
+    uint64_t bit = 1ULL << (slot % 64U);
+    size_t word = slot / 64U;
+    uint64_t signature = 0ULL;
+    if (len > 0 && len < 3) {
+        association_row(pool, 2 * KOLIBRI_ASSOC_GRAM_BUCKETS)[word] |= bit;
+    }
+    /* Keying on the least loaded trigram keeps shared prefixes such as
+     * "how much is" from landing every question in one row. */
+    size_t key = KOLIBRI_ASSOC_GRAM_BUCKETS;
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        size_t gram = association_gram(&folded[i]);
+        association_row(pool, KOLIBRI_ASSOC_GRAM_BUCKETS + gram)[word] |= bit;
+        signature |= 1ULL << (gram % 64U);
+        if (key == KOLIBRI_ASSOC_GRAM_BUCKETS ||
+            pool->association_gram_load[gram] < pool->association_gram_load[key]) {
+            key = gram;
+        }
+    }
+    if (key < KOLIBRI_ASSOC_GRAM_BUCKETS) {
+        association_row(pool, key)[word] |= bit;
+        pool->association_gram_load[key]++;
+    }
+    pool->association_signatures[slot] = signature;
+}
+
+static void association_index_rebuild(KolibriFormulaPool *pool) {
+    memset(pool->association_keys, 0, pool->association_key_slots * sizeof(uint32_t));
+    memset(pool->association_grams, 0,
+           KOLIBRI_ASSOC_GRAM_ROWS * pool->association_words * sizeof(uint64_t));
+    memset(pool->association_gram_load, 0, sizeof(pool->association_gram_load));
+    for (size_t i = 0; i < pool->association_count; ++i) {
+        association_index_add(pool, i);
+    }
+}
+
+static KolibriAssociation *association_index_find(const KolibriFormulaPool *pool,
+                                                  const KolibriAssociation *key) {
+    size_t probe = association_key_home(pool, key->input_hash);
+    for (uint32_t entry; (entry = pool->association_keys[probe]) != 0U;
+         probe = (probe + 1U) & (pool->association_key_slots - 1U)) {
+        KolibriAssociation *candidate = &pool->associations[entry - 1U];
+        if (association_equals(candidate, key)) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
 static int encode_text_digits(const char *text, uint8_t *out, size_t out_len) {
     if (!text || !out) {
         return 0;
     }
-    size_t required = k_encode_text_length(strlen(text));
-    if (required > out_len) {
-        return 0;
-    }
-    if (k_encode_text(text, (char *)out, out_len) != 0) {
+    size_t len = strlen(text);
+    if (k_encode_text_length(len) > out_len || k_encode_text(text, (char *)out, out_len) != 0) {
         return 0;
     }
-    return (int)strlen((const char *)out);
+    return (int)(len * 3U);
 }
 
 /* -------------------------- Прогноз формулы ------------------------ */
@@ -329,39 +439,55 @@ static int decode_bias(const KolibriGene *gene, size_t offset, int *bias) {
     return 0;
 }
 
-static int formula_predict_numeric(const KolibriFormula *formula, int input, int *output) {
-    if (!formula || !output) {
+/* A gene decoded once; operation 1 is folded into operation 0 by negating bias. */
+typedef struct {
+    int operation;
+    int slope;
+    int bias;
+    int auxiliary;
+} KolibriFormulaOp;
+
+static int formula_decode(const KolibriFormula *formula, KolibriFormulaOp *op) {
+    if (!formula || !op) {
         return -1;
     }
-    int operation = 0;
-    int slope = 0;
-    int bias = 0;
-    int auxiliary = 0;
-    if (decode_operation(&formula->gene, 0, &operation) != 0 ||
-        decode_signed(&formula->gene, 1, &slope) != 0 ||
-        decode_bias(&formula->gene, 4, &bias) != 0 ||
-        decode_signed(&formula->gene, 7, &auxiliary) != 0) {
+    if (decode_operation(&formula->gene, 0, &op->operation) != 0 ||
+        decode_signed(&formula->gene, 1, &op->slope) != 0 ||
+        decode_bias(&formula->gene, 4, &op->bias) != 0 ||
+        decode_signed(&formula->gene, 7, &op->auxiliary) != 0) {
         return -1;
     }
+    if (op->operation == 1) {
+        op->operation = 0;
+        op->bias = -op->bias;
+    }
+    return 0;
+}
+
+KOLIBRI_FORCE_INLINE int formula_op_apply(const KolibriFormulaOp *op, int input) {
     long long result = 0;
-    switch (operation) {
+    switch (op->operation) {
     case 0:
-        result = (long long)slope * (long long)input + bias;
-        break;
-    case 1:
-        result = (long long)slope * (long long)input - bias;
+        result = (long long)op->slope * (long long)input + op->bias;
         break;
     case 2: {
-        long long divisor = auxiliary == 0 ? 1 : auxiliary;
-        result = ((long long)slope * (long long)input) % divisor;
-        result += bias;
+        long long divisor = op->auxiliary == 0 ? 1 : op->auxiliary;
+        result = ((long long)op->slope * (long long)input) % divisor;
+        result += op->bias;
         break;
     }
-    case 3:
-        result = (long long)slope * (long long)input * (long long)input + bias;
+    case 3: {
+        long long square = (long long)input * (long long)input;
+        if (op->slope != 0 && square > LLONG_MAX / 100LL) {
+            /* |slope| <= 99, so the product would overflow; it saturates anyway. */
+            result = op->slope > 0 ? LLONG_MAX : LLONG_MIN;
+        } else {
+            result = (long long)op->slope * square + op->bias;
+        }
         break;
+    }
     default:
-        result = bias;
+        result = op->bias;
         break;
     }
     if (result > 2147483647LL) {
@@ -370,10 +496,151 @@ static int formula_predict_numeric(const KolibriFormula *formula, int input, int
     if (result < -2147483648LL) {
         result = -2147483648LL;
     }
-    *output = (int)result;
+    return (int)result;
+}
+
+static int formula_predict_numeric(const KolibriFormula *formula, int input, int *output) {
+    KolibriFormulaOp op;
+    if (!output || formula_decode(formula, &op) != 0) {
+        return -1;
+    }
+    *output = formula_op_apply(&op, input);
     return 0;
 }
 
+/*
+ * Batch kernels: apply one decoded op to every example and sum |target -
+ * prediction|, the predictions and the targets (KolibriBatchSums, shared
+ * with the kernel in kolibri/formula_batch.h).
+ */
+static void batch_apply_scalar(const KolibriFormulaOp *op, const int *inputs, const int *targets,
+                               size_t count, KolibriBatchSums *sums) {
+    int64_t abs_error = 0;
+    int64_t predictions = 0;
+    int64_t target_sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int64_t prediction = formula_op_apply(op, inputs[i]);
+        int64_t diff = (int64_t)targets[i] - prediction;
+        abs_error += diff < 0 ? -diff : diff;
+        predictions += prediction;
+        target_sum += targets[i];
+    }
+    sums->abs_error += abs_error;
+    sums->predictions += predictions;
+    sums->targets += target_sum;
+}
+
+#if defined(KOLIBRI_BATCH_AVX2)
+__attribute__((target("avx2"))) static void batch_apply_avx2(const KolibriFormulaOp *op,
+                                                             const int *inputs,
+                                                             const int *targets,
+                                                             size_t count,
+                                                             KolibriBatchSums *sums) {
+    const __m256i slope = _mm256_set1_epi32(op->slope);
+    const __m256i bias = _mm256_set1_epi32(op->bias);
+    const int quadratic = op->operation == 3;
+    __m256i abs_error = _mm256_setzero_si256();
+    __m256i predictions = _mm256_setzero_si256();
+    __m256i target_sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8U <= count; i += 8U) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)&inputs[i]);
+        if (quadratic) {
+            x = _mm256_mullo_epi32(x, x);
+        }
+        __m256i p = _mm256_add_epi32(_mm256_mullo_epi32(x, slope), bias);
+        __m256i t = _mm256_loadu_si256((const __m256i *)&targets[i]);
+        __m256i p_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p));
+        __m256i p_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1));
+        __m256i t_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(t));
+        __m256i t_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(t, 1));
+        __m256i d_lo = _mm256_sub_epi64(t_lo, p_lo);
+        __m256i d_hi = _mm256_sub_epi64(t_hi, p_hi);
+        __m256i s_lo = _mm256_cmpgt_epi64(_mm256_setzero_si256(), d_lo);
+        __m256i s_hi = _mm256_cmpgt_epi64(_mm256_setzero_si256(), d_hi);
+        d_lo = _mm256_sub_epi64(_mm256_xor_si256(d_lo, s_lo), s_lo);
+        d_hi = _mm256_sub_epi64(_mm256_xor_si256(d_hi, s_hi), s_hi);
+        abs_error = _mm256_add_epi64(abs_error, _mm256_add_epi64(d_lo, d_hi));
+        predictions = _mm256_add_epi64(predictions, _mm256_add_epi64(p_lo, p_hi));
+        target_sum = _mm256_add_epi64(target_sum, _mm256_add_epi64(t_lo, t_hi));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, abs_error);
+    sums->abs_error += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, predictions);
+    sums->predictions += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i *)lanes, target_sum);
+    sums->targets += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    batch_apply_scalar(op, inputs + i, targets + i, count - i, sums);
+}
+#elif defined(KOLIBRI_BATCH_NEON)
+static void batch_apply_neon(const KolibriFormulaOp *op, const int *inputs, const int *targets,
+                             size_t count, KolibriBatchSums *sums) {
+    const int32x4_t slope = vdupq_n_s32(op->slope);
+    const int32x4_t bias = vdupq_n_s32(op->bias);
+    const int quadratic = op->operation == 3;
+    int64x2_t abs_error = vdupq_n_s64(0);
+    int64x2_t predictions = vdupq_n_s64(0);
+    int64x2_t target_sum = vdupq_n_s64(0);
+    size_t i = 0;
+    for (; i + 4U <= count; i += 4U) {
+        int32x4_t x = vld1q_s32(&inputs[i]);
+        if (quadratic) {
+            x = vmulq_s32(x, x);
+        }
+        int32x4_t p = vmlaq_s32(bias, x, slope);
+        int32x4_t t = vld1q_s32(&targets[i]);
+        int64x2_t p_lo = vmovl_s32(vget_low_s32(p));
+        int64x2_t p_hi = vmovl_s32(vget_high_s32(p));
+        int64x2_t t_lo = vmovl_s32(vget_low_s32(t));
+        int64x2_t t_hi = vmovl_s32(vget_high_s32(t));
+        abs_error = vaddq_s64(abs_error, vabsq_s64(vsubq_s64(t_lo, p_lo)));
+        abs_error = vaddq_s64(abs_error, vabsq_s64(vsubq_s64(t_hi, p_hi)));
+        predictions = vaddq_s64(predictions, vaddq_s64(p_lo, p_hi));
+        target_sum = vaddq_s64(target_sum, vaddq_s64(t_lo, t_hi));
+    }
+    sums->abs_error += vgetq_lane_s64(abs_error, 0) + vgetq_lane_s64(abs_error, 1);
+    sums->predictions += vgetq_lane_s64(predictions, 0) + vgetq_lane_s64(predictions, 1);
+    sums->targets += vgetq_lane_s64(target_sum, 0) + vgetq_lane_s64(target_sum, 1);
+    batch_apply_scalar(op, inputs + i, targets + i, count - i, sums);
+}
+#endif
+
+static void formula_batch_apply(const KolibriFormulaOp *op, const KolibriFormulaPool *pool,
+                                KolibriBatchSums *sums) {
+    sums->abs_error = 0;
+    sums->predictions = 0;
+    sums->targets = 0;
+    /* The vector kernels work in int32 lanes, which is exact only while no
+     * prediction needs clamping; modulo has no vector form. */
+    int fits = (op->operation == 0 && pool->input_peak <= KOLIBRI_BATCH_LINEAR_PEAK) ||
+               (op->operation == 3 && pool->input_peak <= KOLIBRI_BATCH_QUADRATIC_PEAK);
+#if defined(KOLIBRI_BATCH_AVX2)
+    if (fits && __builtin_cpu_supports("avx2")) {
+        batch_apply_avx2(op, pool->inputs, pool->targets, pool->examples, sums);
+        return;
+    }
+#elif defined(KOLIBRI_BATCH_NEON)
+    if (fits) {
+        batch_apply_neon(op, pool->inputs, pool->targets, pool->examples, sums);
+        return;
+    }
+#endif
+#if defined(KOLIBRI_BATCH_VEC4)
+    /* Four-lane kernel: SSE2 is baseline on x86-64, so CPUs without AVX2
+     * still get a vector path. */
+    if (fits) {
+        size_t done = kolibri_batch_apply_vec4(op->slope, op->bias, op->operation == 3,
+                                               pool->inputs, pool->targets, pool->examples, sums);
+        batch_apply_scalar(op, pool->inputs + done, pool->targets + done, pool->examples - done,
+                           sums);
+        return;
+    }
+#endif
+    (void)fits;
+    batch_apply_scalar(op, pool->inputs, pool->targets, pool->examples, sums);
+}
+
 static double complexity_penalty(const KolibriGene *gene) {
     double penalty = 0.0;
     for (size_t i = 0; i < gene->length; ++i) {
@@ -392,6 +659,53 @@ typedef struct {
     double phase;
 } KolibriEvaluation;
 
+/* ---------------------- Кэш оценок ------------------------------- */
+
+static uint64_t gene_hash(const KolibriGene *gene) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < gene->length; ++i) {
+        hash ^= (uint64_t)gene->digits[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ (uint64_t)gene->length;
+}
+
+/* Direct-mapped: a gene has one slot and a newer gene simply evicts it. */
+static KolibriFitnessCacheEntry *cache_slot(const KolibriFormulaPool *pool, const KolibriGene *gene) {
+    if (pool->cache_slots == 0U || gene->length > sizeof(gene->digits)) {
+        return NULL;
+    }
+    return &pool->cache[gene_hash(gene) & (uint64_t)(pool->cache_slots - 1U)];
+}
+
+static int cache_lookup(const KolibriFormulaPool *pool, const KolibriGene *gene,
+                        KolibriEvaluation *out) {
+    const KolibriFitnessCacheEntry *entry = cache_slot(pool, gene);
+    if (!entry || entry->version != pool->dataset_version || entry->gene.length != gene->length ||
+        memcmp(entry->gene.digits, gene->digits, gene->length) != 0) {
+        return 0;
+    }
+    out->base_score = entry->base_score;
+    out->drift_b = entry->drift_b;
+    out->drift_d = entry->drift_d;
+    out->phase = entry->phase;
+    return 1;
+}
+
+static void cache_store(KolibriFormulaPool *pool, const KolibriGene *gene,
+                        const KolibriEvaluation *eval) {
+    KolibriFitnessCacheEntry *entry = cache_slot(pool, gene);
+    if (!entry) {
+        return;
+    }
+    entry->version = pool->dataset_version;
+    entry->gene = *gene;
+    entry->base_score = eval->base_score;
+    entry->drift_b = eval->drift_b;
+    entry->drift_d = eval->drift_d;
+    entry->phase = eval->phase;
+}
+
 static double compute_gene_diversity(const KolibriGene *gene) {
     if (!gene || gene->length == 0) {
         return 0.0;
@@ -475,20 +789,16 @@ static KolibriEvaluation evaluate_formula_metrics(const KolibriFormula *formula,
         return eval;
     }
 
-    double total_error = 0.0;
-    double sum_predictions = 0.0;
-    double sum_targets = 0.0;
-    for (size_t i = 0; i < pool->examples; ++i) {
-        int prediction = 0;
-        if (formula_predict_numeric(formula, pool->inputs[i], &prediction) != 0) {
-            eval.base_score = 0.0;
-            return eval;
-        }
-        int diff = pool->targets[i] - prediction;
-        total_error += fabs((double)diff);
-        sum_predictions += (double)prediction;
-        sum_targets += (double)pool->targets[i];
+    KolibriFormulaOp op;
+    if (formula_decode(formula, &op) != 0) {
+        eval.base_score = 0.0;
+        return eval;
     }
+    KolibriBatchSums sums;
+    formula_batch_apply(&op, pool, &sums);
+    double total_error = (double)sums.abs_error;
+    double sum_predictions = (double)sums.predictions;
+    double sum_targets = (double)sums.targets;
 
     double penalty = complexity_penalty(&formula->gene);
     eval.base_score = 1.0 / (1.0 + total_error + penalty);
@@ -517,6 +827,20 @@ static KolibriEvaluation evaluate_formula_metrics(const KolibriFormula *formula,
     return eval;
 }
 
+static uint64_t monotonic_ns(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+#endif
+    return (uint64_t)((double)clock() * 1e9 / (double)CLOCKS_PER_SEC);
+}
+
+static void profile_reset(KolibriPoolProfile *profile) {
+    memset(profile, 0, sizeof(*profile));
+}
+
 static void apply_feedback_bonus(KolibriFormula *formula, double *fitness) {
     if (!formula || !fitness) {
         return;
@@ -529,15 +853,32 @@ typedef struct {
     KolibriFormula *formula;
     KolibriEvaluation evaluation;
     double score;
+    KolibriEvaluation *metrics;
+    int cached;
 } KolibriBeamLane;
 
-static void evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count) {
+/*
+ * Per-slot metrics of one evaluation pass. Cache lookups and stores happen
+ * serially around the pass, so workers never touch the cache.
+ */
+typedef struct {
+    KolibriEvaluation *metrics;
+    unsigned char *cached;
+} KolibriEvalPass;
+
+/* Returns the nanoseconds spent on the coherence adjustment. */
+static uint64_t evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count) {
     if (!pool || !lanes || lane_count == 0U) {
-        return;
+        return 0ULL;
     }
 
     for (size_t i = 0; i < lane_count; ++i) {
-        lanes[i].evaluation = evaluate_formula_metrics(lanes[i].formula, pool);
+        if (lanes[i].cached) {
+            lanes[i].evaluation = *lanes[i].metrics;
+        } else {
+            lanes[i].evaluation = evaluate_formula_metrics(lanes[i].formula, pool);
+            *lanes[i].metrics = lanes[i].evaluation;
+        }
         double penalty = pool->lambda_b * fmax(0.0, lanes[i].evaluation.drift_b) +
                          pool->lambda_d * fmax(0.0, lanes[i].evaluation.drift_d);
         double score = lanes[i].evaluation.base_score - penalty;
@@ -548,7 +889,9 @@ static void evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes
         lanes[i].score = score;
     }
 
+    uint64_t coherence_ns = 0ULL;
     if (pool->coherence_gain != 0.0) {
+        uint64_t coherence_start = monotonic_ns();
         for (size_t i = 0; i < lane_count; ++i) {
             double adjustment = 0.0;
             for (size_t j = 0; j < lane_count; ++j) {
@@ -561,6 +904,7 @@ static void evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes
             }
             lanes[i].score += adjustment;
         }
+        coherence_ns = monotonic_ns() - coherence_start;
     }
 
     for (size_t i = 0; i < lane_count; ++i) {
@@ -570,8 +914,117 @@ static void evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes
         lanes[i].formula->invariant_drift_d = lanes[i].evaluation.drift_d;
         lanes[i].formula->phase = lanes[i].evaluation.phase;
     }
+    return coherence_ns;
+}
+
+/* Groups are cut by slot index alone, so how they are scheduled cannot change
+ * any score. */
+static void evaluate_group_at(KolibriFormulaPool *pool, const KolibriEvalPass *pass, size_t group) {
+    uint64_t start = monotonic_ns();
+    KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
+    size_t index = group * KOLIBRI_BEAM_MAX_LANES;
+    size_t lane_count = 0U;
+    while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
+        lanes[lane_count].formula = &pool->formulas[index];
+        lanes[lane_count].score = 0.0;
+        lanes[lane_count].evaluation.base_score = 0.0;
+        lanes[lane_count].metrics = &pass->metrics[index];
+        lanes[lane_count].cached = pass->cached[index];
+        ++lane_count;
+        ++index;
+    }
+    uint64_t coherence_ns = evaluate_beam_group(pool, lanes, lane_count);
+    uint64_t elapsed = monotonic_ns() - start;
+    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.evaluation_ns, elapsed - coherence_ns);
+    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.coherence_ns, coherence_ns);
+}
+
+static size_t beam_group_count(const KolibriFormulaPool *pool) {
+    return (pool->count + KOLIBRI_BEAM_MAX_LANES - 1U) / KOLIBRI_BEAM_MAX_LANES;
+}
+
+#if defined(KOLIBRI_FORMULA_THREADS)
+/* Workers live for one kf_pool_tick and take groups one at a time each round. */
+typedef struct {
+    KolibriFormulaPool *pool;
+    const KolibriEvalPass *pass;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t round;
+    size_t next_group;
+    size_t pending;
+    int stop;
+} KolibriEvalCrew;
+
+static void crew_drain(KolibriEvalCrew *crew) {
+    size_t groups = beam_group_count(crew->pool);
+    for (;;) {
+        pthread_mutex_lock(&crew->lock);
+        size_t group = crew->next_group;
+        if (group < groups) {
+            crew->next_group++;
+        }
+        pthread_mutex_unlock(&crew->lock);
+        if (group >= groups) {
+            return;
+        }
+        evaluate_group_at(crew->pool, crew->pass, group);
+        pthread_mutex_lock(&crew->lock);
+        if (--crew->pending == 0U) {
+            pthread_cond_signal(&crew->done);
+        }
+        pthread_mutex_unlock(&crew->lock);
+    }
 }
 
+static void *crew_worker_main(void *arg) {
+    KolibriEvalCrew *crew = (KolibriEvalCrew *)arg;
+    uint64_t seen = 0ULL;
+    for (;;) {
+        pthread_mutex_lock(&crew->lock);
+        while (!crew->stop && crew->round == seen) {
+            pthread_cond_wait(&crew->wake, &crew->lock);
+        }
+        if (crew->stop) {
+            pthread_mutex_unlock(&crew->lock);
+            return NULL;
+        }
+        seen = crew->round;
+        pthread_mutex_unlock(&crew->lock);
+        crew_drain(crew);
+    }
+}
+
+static void crew_evaluate(KolibriEvalCrew *crew) {
+    pthread_mutex_lock(&crew->lock);
+    crew->next_group = 0U;
+    crew->pending = beam_group_count(crew->pool);
+    crew->round++;
+    pthread_cond_broadcast(&crew->wake);
+    pthread_mutex_unlock(&crew->lock);
+    crew_drain(crew);
+    pthread_mutex_lock(&crew->lock);
+    while (crew->pending > 0U) {
+        pthread_cond_wait(&crew->done, &crew->lock);
+    }
+    pthread_mutex_unlock(&crew->lock);
+}
+
+static size_t resolve_parallelism(const KolibriFormulaPool *pool) {
+    size_t threads = pool->parallelism;
+    if (threads == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1U;
+    }
+    if (threads > KOLIBRI_POOL_MAX_PARALLELISM) {
+        threads = KOLIBRI_POOL_MAX_PARALLELISM;
+    }
+    size_t groups = beam_group_count(pool);
+    return threads < groups ? threads : groups;
+}
+#endif
+
 static void mutate_gene(KolibriFormulaPool *pool, KolibriGene *gene) {
     if (!gene) {
         return;
@@ -622,19 +1075,114 @@ static void crossover(KolibriFormulaPool *pool, const KolibriGene *parent_a, con
     }
 }
 
-static int compare_formulas(const void *lhs, const void *rhs) {
-    const KolibriFormula *a = (const KolibriFormula *)lhs;
-    const KolibriFormula *b = (const KolibriFormula *)rhs;
+/* Formulas are ranked through (fitness, slot) pairs instead of being moved;
+ * the slot breaks ties so the order does not depend on qsort. */
+typedef struct {
+    double fitness;
+    size_t slot;
+} KolibriRank;
+
+static int compare_ranks(const void *lhs, const void *rhs) {
+    const KolibriRank *a = (const KolibriRank *)lhs;
+    const KolibriRank *b = (const KolibriRank *)rhs;
     if (a->fitness < b->fitness) {
         return 1;
     }
     if (a->fitness > b->fitness) {
         return -1;
     }
+    return a->slot < b->slot ? -1 : (a->slot > b->slot ? 1 : 0);
+}
+
+/* Ranking buffers for one tick; fixed pools fit in the inline arrays. */
+typedef struct {
+    KolibriRank *ranks;
+    size_t *order;
+    KolibriFormula *ranked;
+    KolibriEvalPass pass;
+    KolibriRank rank_storage[KOLIBRI_FORMULA_CAPACITY];
+    size_t order_storage[KOLIBRI_FORMULA_CAPACITY];
+    KolibriFormula ranked_storage[KOLIBRI_FORMULA_CAPACITY];
+    KolibriEvaluation metrics_storage[KOLIBRI_FORMULA_CAPACITY];
+    unsigned char cached_storage[KOLIBRI_FORMULA_CAPACITY];
+} KolibriTickScratch;
+
+static void tick_scratch_free(KolibriTickScratch *scratch) {
+    free(scratch->ranks);
+    free(scratch->order);
+    free(scratch->ranked);
+    free(scratch->pass.metrics);
+    free(scratch->pass.cached);
+}
+
+static int tick_scratch_init(KolibriTickScratch *scratch, size_t count) {
+    if (count <= KOLIBRI_FORMULA_CAPACITY) {
+        scratch->ranks = scratch->rank_storage;
+        scratch->order = scratch->order_storage;
+        scratch->ranked = scratch->ranked_storage;
+        scratch->pass.metrics = scratch->metrics_storage;
+        scratch->pass.cached = scratch->cached_storage;
+        return 0;
+    }
+    scratch->ranks = malloc(count * sizeof(KolibriRank));
+    scratch->order = malloc(count * sizeof(size_t));
+    scratch->ranked = malloc(count * sizeof(KolibriFormula));
+    scratch->pass.metrics = malloc(count * sizeof(KolibriEvaluation));
+    scratch->pass.cached = malloc(count);
+    if (!scratch->ranks || !scratch->order || !scratch->ranked || !scratch->pass.metrics ||
+        !scratch->pass.cached) {
+        tick_scratch_free(scratch);
+        return -1;
+    }
     return 0;
 }
 
-static void reproduce(KolibriFormulaPool *pool) {
+static void tick_scratch_release(KolibriTickScratch *scratch) {
+    if (scratch->ranks != scratch->rank_storage) {
+        tick_scratch_free(scratch);
+    }
+}
+
+/* Serial halves of an evaluation pass around the (possibly parallel) scoring. */
+static void cache_prefetch(KolibriFormulaPool *pool, KolibriEvalPass *pass) {
+    uint64_t hits = 0ULL;
+    for (size_t i = 0; i < pool->count; ++i) {
+        pass->cached[i] = (unsigned char)cache_lookup(pool, &pool->formulas[i].gene, &pass->metrics[i]);
+        hits += pass->cached[i];
+    }
+    pool->profile.cache_hits += hits;
+    pool->profile.cache_misses += (uint64_t)pool->count - hits;
+}
+
+static void cache_commit(KolibriFormulaPool *pool, const KolibriEvalPass *pass) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        if (!pass->cached[i]) {
+            cache_store(pool, &pool->formulas[i].gene, &pass->metrics[i]);
+        }
+    }
+}
+
+/* Fills scratch->order with formula slots from best to worst. */
+static void rank_formulas(const KolibriFormulaPool *pool, KolibriTickScratch *scratch) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        scratch->ranks[i].fitness = pool->formulas[i].fitness;
+        scratch->ranks[i].slot = i;
+    }
+    qsort(scratch->ranks, pool->count, sizeof(KolibriRank), compare_ranks);
+    for (size_t i = 0; i < pool->count; ++i) {
+        scratch->order[i] = scratch->ranks[i].slot;
+    }
+}
+
+/* Moves the formulas into rank order once, so formulas[0] is the best. */
+static void apply_ranking(KolibriFormulaPool *pool, KolibriTickScratch *scratch) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        scratch->ranked[i] = pool->formulas[scratch->order[i]];
+    }
+    memcpy(pool->formulas, scratch->ranked, pool->count * sizeof(KolibriFormula));
+}
+
+static void reproduce(KolibriFormulaPool *pool, const size_t *order) {
     size_t elite = pool->count / 3U;
     if (elite == 0) {
         elite = 1;
@@ -654,20 +1202,22 @@ static void reproduce(KolibriFormulaPool *pool) {
             parent_b_index = (parent_b_index + 1U) % parent_pool;
         }
         KolibriGene child;
-        crossover(pool, &pool->formulas[parent_a_index].gene,
-                  &pool->formulas[parent_b_index].gene, &child);
+        crossover(pool, &pool->formulas[order[parent_a_index]].gene,
+                  &pool->formulas[order[parent_b_index]].gene, &child);
         mutate_gene(pool, &child);
-        gene_copy(&child, &pool->formulas[i].gene);
-        pool->formulas[i].fitness = 0.0;
-        pool->formulas[i].feedback = 0.0;
-        pool->formulas[i].invariant_drift_b = 0.0;
-        pool->formulas[i].invariant_drift_d = 0.0;
-        pool->formulas[i].phase = 0.0;
-        pool->formulas[i].association_count = 0;
+        KolibriFormula *slot = &pool->formulas[order[i]];
+        gene_copy(&child, &slot->gene);
+        slot->fitness = 0.0;
+        slot->feedback = 0.0;
+        slot->invariant_drift_b = 0.0;
+        slot->invariant_drift_d = 0.0;
+        slot->phase = 0.0;
+        slot->associations = NULL;
+        slot->association_count = 0;
     }
 }
 
-static void copy_dataset_into_formula(const KolibriFormulaPool *pool, KolibriFormula *formula) {
+static void share_dataset_with_formula(const KolibriFormulaPool *pool, KolibriFormula *formula) {
     if (!pool || !formula) {
         return;
     }
@@ -675,14 +1225,17 @@ static void copy_dataset_into_formula(const KolibriFormulaPool *pool, KolibriFor
     if (limit > KOLIBRI_FORMULA_MAX_ASSOCIATIONS) {
         limit = KOLIBRI_FORMULA_MAX_ASSOCIATIONS;
     }
+    formula->associations = pool->associations;
     formula->association_count = limit;
-    for (size_t i = 0; i < limit; ++i) {
-        formula->associations[i] = pool->associations[i];
-    }
     formula->invariant_drift_b = 0.0;
     formula->invariant_drift_d = 0.0;
 }
 
+static void formula_forget_dataset(KolibriFormula *formula) {
+    formula->associations = NULL;
+    formula->association_count = 0;
+}
+
 static double evaluate_association_fitness(const KolibriFormulaPool *pool) {
     if (!pool || pool->association_count == 0) {
         return 0.0;
@@ -692,12 +1245,12 @@ static double evaluate_association_fitness(const KolibriFormulaPool *pool) {
 
 /* ---------------------- Публичные функции ------------------------- */
 
-void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
-    if (!pool) {
-        return;
-    }
-    pool->count = KOLIBRI_FORMULA_CAPACITY;
+/* Resets everything but the storage pointers and capacities. */
+static void pool_reset(KolibriFormulaPool *pool, uint64_t seed) {
+    memset(pool->cache, 0, pool->cache_slots * sizeof(KolibriFitnessCacheEntry));
+    pool->dataset_version = 1U;
     pool->examples = 0;
+    pool->input_peak = 0U;
     pool->association_count = 0;
     pool->lambda_b = 0.0;
     pool->lambda_d = 0.0;
@@ -708,11 +1261,8 @@ void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
     pool->coherence_gain = 0.0;
     pool->temperature = 1.0;
     pool->top_k = pool->count;
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.generation_steps, 0ULL);
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.evaluation_calls, 0ULL);
-    pool->profile.generation_steps = 0ULL;
-    pool->profile.evaluation_calls = 0ULL;
-    pool->profile.last_generation_ms = 0.0;
+    pool->parallelism = 1U;
+    profile_reset(&pool->profile);
     k_rng_seed(&pool->rng, seed);
     for (size_t i = 0; i < pool->count; ++i) {
         gene_randomize(pool, &pool->formulas[i].gene);
@@ -721,11 +1271,553 @@ void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
         pool->formulas[i].invariant_drift_b = 0.0;
         pool->formulas[i].invariant_drift_d = 0.0;
         pool->formulas[i].phase = 0.0;
-        pool->formulas[i].association_count = 0;
+        formula_forget_dataset(&pool->formulas[i]);
+    }
+    for (size_t i = 0; i < pool->association_capacity; ++i) {
+        association_reset(&pool->associations[i]);
+    }
+    association_index_rebuild(pool);
+}
+
+void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
+    if (!pool) {
+        return;
+    }
+    pool->formulas = pool->formula_storage;
+    pool->count = KOLIBRI_FORMULA_CAPACITY;
+    pool->inputs = pool->input_storage;
+    pool->targets = pool->target_storage;
+    pool->example_capacity = KOLIBRI_POOL_MAX_EXAMPLES;
+    pool->associations = pool->association_storage;
+    pool->association_capacity = KOLIBRI_POOL_MAX_ASSOCIATIONS;
+    pool->association_keys = pool->association_key_storage;
+    pool->association_key_slots = KOLIBRI_POOL_ASSOC_KEY_SLOTS;
+    pool->association_grams = pool->association_gram_storage;
+    pool->association_words = KOLIBRI_POOL_ASSOC_WORDS;
+    pool->association_signatures = pool->association_signature_storage;
+    pool->cache = pool->cache_storage;
+    pool->cache_slots = KOLIBRI_POOL_CACHE_SLOTS;
+    pool->owns_storage = 0;
+    pool_reset(pool, seed);
+}
+
+KolibriFormulaPool *kf_pool_create(const KolibriPoolConfig *config) {
+    size_t formulas = config ? config->formula_capacity : 0U;
+    size_t examples = config ? config->example_capacity : 0U;
+    size_t associations = config ? config->association_capacity : 0U;
+    if (formulas == 0U) {
+        formulas = KOLIBRI_FORMULA_CAPACITY;
+    }
+    if (examples == 0U) {
+        examples = KOLIBRI_POOL_MAX_EXAMPLES;
+    }
+    if (associations == 0U) {
+        associations = KOLIBRI_POOL_MAX_ASSOCIATIONS;
+    }
+    KolibriFormulaPool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->formulas = calloc(formulas, sizeof(KolibriFormula));
+    pool->inputs = calloc(examples, sizeof(int));
+    pool->targets = calloc(examples, sizeof(int));
+    pool->associations = calloc(associations, sizeof(KolibriAssociation));
+    size_t key_slots = 2U;
+    while (key_slots < associations * 2U) {
+        key_slots <<= 1U;
+    }
+    pool->association_keys = calloc(key_slots, sizeof(uint32_t));
+    pool->association_key_slots = key_slots;
+    pool->association_words = (associations + 63U) / 64U;
+    pool->association_grams =
+        calloc(KOLIBRI_ASSOC_GRAM_ROWS * pool->association_words, sizeof(uint64_t));
+    pool->association_signatures = calloc(associations, sizeof(uint64_t));
+    /* Room for a few generations of distinct genes, as a power of two. */
+    size_t slots = KOLIBRI_POOL_CACHE_SLOTS;
+    while (slots < formulas * 4U && slots < ((size_t)1 << 20)) {
+        slots <<= 1U;
+    }
+    pool->cache = calloc(slots, sizeof(KolibriFitnessCacheEntry));
+    pool->cache_slots = slots;
+    pool->owns_storage = 1;
+    if (!pool->formulas || !pool->inputs || !pool->targets || !pool->associations ||
+        !pool->association_keys || !pool->association_grams || !pool->association_signatures ||
+        !pool->cache) {
+        kf_pool_destroy(pool);
+        return NULL;
+    }
+    pool->count = formulas;
+    pool->example_capacity = examples;
+    pool->association_capacity = associations;
+    pool_reset(pool, config ? config->seed : 0U);
+    return pool;
+}
+
+void kf_pool_destroy(KolibriFormulaPool *pool) {
+    if (!pool || !pool->owns_storage) {
+        return;
+    }
+    free(pool->formulas);
+    free(pool->inputs);
+    free(pool->targets);
+    free(pool->associations);
+    free(pool->association_keys);
+    free(pool->association_grams);
+    free(pool->association_signatures);
+    free(pool->cache);
+    free(pool);
+}
+
+int kf_pool_copy(KolibriFormulaPool *dst, const KolibriFormulaPool *src) {
+    if (!dst || !src || dst == src || dst->count != src->count ||
+        dst->example_capacity < src->examples ||
+        dst->association_capacity < src->association_count) {
+        return -1;
     }
-    for (size_t i = 0; i < KOLIBRI_POOL_MAX_ASSOCIATIONS; ++i) {
+    for (size_t i = 0; i < src->count; ++i) {
+        dst->formulas[i] = src->formulas[i];
+        /* A formula sharing the source's table shares the copy's instead. */
+        if (src->formulas[i].associations == src->associations) {
+            dst->formulas[i].associations = dst->associations;
+        } else {
+            formula_forget_dataset(&dst->formulas[i]);
+        }
+    }
+    dst->rng = src->rng;
+    memcpy(dst->inputs, src->inputs, src->examples * sizeof(int));
+    memcpy(dst->targets, src->targets, src->examples * sizeof(int));
+    dst->examples = src->examples;
+    dst->input_peak = src->input_peak;
+    for (size_t i = src->association_count; i < dst->association_count; ++i) {
+        association_reset(&dst->associations[i]);
+    }
+    memcpy(dst->associations, src->associations, src->association_count * sizeof(KolibriAssociation));
+    dst->association_count = src->association_count;
+    if (dst->association_key_slots == src->association_key_slots &&
+        dst->association_words == src->association_words) {
+        memcpy(dst->association_keys, src->association_keys,
+               src->association_key_slots * sizeof(uint32_t));
+        memcpy(dst->association_grams, src->association_grams,
+               KOLIBRI_ASSOC_GRAM_ROWS * src->association_words * sizeof(uint64_t));
+        memcpy(dst->association_signatures, src->association_signatures,
+               src->association_count * sizeof(uint64_t));
+        memcpy(dst->association_gram_load, src->association_gram_load,
+               sizeof(dst->association_gram_load));
+    } else {
+        association_index_rebuild(dst);
+    }
+    dst->lambda_b = src->lambda_b;
+    dst->lambda_d = src->lambda_d;
+    dst->target_b = src->target_b;
+    dst->target_d = src->target_d;
+    dst->use_custom_target_b = src->use_custom_target_b;
+    dst->use_custom_target_d = src->use_custom_target_d;
+    dst->coherence_gain = src->coherence_gain;
+    dst->temperature = src->temperature;
+    dst->top_k = src->top_k;
+    dst->parallelism = src->parallelism;
+    profile_reset(&dst->profile);
+    /* Cached scores stay valid as long as the versions agree. */
+    dst->dataset_version = src->dataset_version;
+    if (dst->cache_slots == src->cache_slots) {
+        memcpy(dst->cache, src->cache, src->cache_slots * sizeof(KolibriFitnessCacheEntry));
+    } else {
+        memset(dst->cache, 0, dst->cache_slots * sizeof(KolibriFitnessCacheEntry));
+    }
+    return 0;
+}
+
+KolibriFormulaPool *kf_pool_clone(const KolibriFormulaPool *pool) {
+    if (!pool) {
+        return NULL;
+    }
+    KolibriPoolConfig config = {pool->count, pool->example_capacity, pool->association_capacity, 0U};
+    KolibriFormulaPool *clone = kf_pool_create(&config);
+    if (clone && kf_pool_copy(clone, pool) != 0) {
+        kf_pool_destroy(clone);
+        return NULL;
+    }
+    return clone;
+}
+
+/*
+ * A checkpoint is the little-endian image of a pool's learned state: magic,
+ * format version, population and table sizes, generator and settings, the
+ * formulas, the examples and the association table, closed by the FNV-1a
+ * hash of every byte before it. A formula keeps only the length of the table
+ * prefix it shares, so each association is written once, with its hashes;
+ * the lookup index and the fitness cache are rebuilt on load.
+ */
+#define KOLIBRI_POOL_CHECKPOINT_MAGIC "KFPC"
+#define KOLIBRI_POOL_CHECKPOINT_VERSION 1U
+#define KOLIBRI_POOL_CHECKPOINT_TRAILER 8U
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int ok;
+} KolibriCheckpointWriter;
+
+typedef struct {
+    const unsigned char *data;
+    size_t length;
+    size_t offset;
+    int ok;
+} KolibriCheckpointReader;
+
+static uint64_t fnv1a64(const unsigned char *bytes, size_t len) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint64_t)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void checkpoint_put_bytes(KolibriCheckpointWriter *writer, const void *bytes, size_t len) {
+    if (!writer->ok || len == 0U) {
+        return;
+    }
+    if (len > writer->capacity - writer->length) {
+        size_t capacity = writer->capacity ? writer->capacity : 4096U;
+        while (capacity - writer->length < len) {
+            capacity *= 2U;
+        }
+        unsigned char *grown = realloc(writer->data, capacity);
+        if (!grown) {
+            writer->ok = 0;
+            return;
+        }
+        writer->data = grown;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->data + writer->length, bytes, len);
+    writer->length += len;
+}
+
+static void checkpoint_put(KolibriCheckpointWriter *writer, uint64_t value, size_t bytes) {
+    unsigned char buffer[8];
+    for (size_t i = 0; i < bytes; ++i) {
+        buffer[i] = (unsigned char)(value >> (8U * i));
+    }
+    checkpoint_put_bytes(writer, buffer, bytes);
+}
+
+static void checkpoint_put_double(KolibriCheckpointWriter *writer, double value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    checkpoint_put(writer, bits, 8U);
+}
+
+static void checkpoint_put_span(KolibriCheckpointWriter *writer, const void *bytes, size_t len) {
+    checkpoint_put(writer, len, 2U);
+    checkpoint_put_bytes(writer, bytes, len);
+}
+
+static const unsigned char *checkpoint_take(KolibriCheckpointReader *reader, size_t len) {
+    if (!reader->ok || len > reader->length - reader->offset) {
+        reader->ok = 0;
+        return NULL;
+    }
+    const unsigned char *bytes = reader->data + reader->offset;
+    reader->offset += len;
+    return bytes;
+}
+
+static uint64_t checkpoint_get(KolibriCheckpointReader *reader, size_t bytes) {
+    const unsigned char *buffer = checkpoint_take(reader, bytes);
+    uint64_t value = 0;
+    for (size_t i = 0; buffer && i < bytes; ++i) {
+        value |= (uint64_t)buffer[i] << (8U * i);
+    }
+    return value;
+}
+
+static double checkpoint_get_double(KolibriCheckpointReader *reader) {
+    uint64_t bits = checkpoint_get(reader, 8U);
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/* Reads a span of at most capacity bytes; returns its length. */
+static size_t checkpoint_get_span(KolibriCheckpointReader *reader, void *out, size_t capacity) {
+    size_t len = (size_t)checkpoint_get(reader, 2U);
+    if (len > capacity) {
+        reader->ok = 0;
+        return 0U;
+    }
+    const unsigned char *bytes = checkpoint_take(reader, len);
+    if (bytes && len > 0U) {
+        memcpy(out, bytes, len);
+    }
+    return bytes ? len : 0U;
+}
+
+static void checkpoint_get_text(KolibriCheckpointReader *reader, char *out, size_t out_size) {
+    size_t len = checkpoint_get_span(reader, out, out_size - 1U);
+    out[len] = '\0';
+    if (memchr(out, '\0', len)) {
+        reader->ok = 0;
+    }
+}
+
+static void checkpoint_write_pool(KolibriCheckpointWriter *writer, const KolibriFormulaPool *pool) {
+    checkpoint_put_bytes(writer, KOLIBRI_POOL_CHECKPOINT_MAGIC, 4U);
+    checkpoint_put(writer, KOLIBRI_POOL_CHECKPOINT_VERSION, 4U);
+    checkpoint_put(writer, pool->count, 4U);
+    checkpoint_put(writer, pool->examples, 4U);
+    checkpoint_put(writer, pool->association_count, 4U);
+    checkpoint_put(writer, pool->rng.state, 8U);
+    checkpoint_put_double(writer, pool->lambda_b);
+    checkpoint_put_double(writer, pool->lambda_d);
+    checkpoint_put_double(writer, pool->target_b);
+    checkpoint_put_double(writer, pool->target_d);
+    checkpoint_put(writer, pool->use_custom_target_b ? 1U : 0U, 1U);
+    checkpoint_put(writer, pool->use_custom_target_d ? 1U : 0U, 1U);
+    checkpoint_put_double(writer, pool->coherence_gain);
+    checkpoint_put_double(writer, pool->temperature);
+    checkpoint_put(writer, pool->top_k, 4U);
+    for (size_t i = 0; i < pool->count; ++i) {
+        const KolibriFormula *formula = &pool->formulas[i];
+        checkpoint_put_span(writer, formula->gene.digits, formula->gene.length);
+        checkpoint_put_double(writer, formula->fitness);
+        checkpoint_put_double(writer, formula->feedback);
+        checkpoint_put_double(writer, formula->invariant_drift_b);
+        checkpoint_put_double(writer, formula->invariant_drift_d);
+        checkpoint_put_double(writer, formula->phase);
+        size_t shared = formula->associations == pool->associations ? formula->association_count : 0U;
+        checkpoint_put(writer, shared, 1U);
+    }
+    for (size_t i = 0; i < pool->examples; ++i) {
+        checkpoint_put(writer, (uint32_t)pool->inputs[i], 4U);
+        checkpoint_put(writer, (uint32_t)pool->targets[i], 4U);
+    }
+    for (size_t i = 0; i < pool->association_count; ++i) {
+        const KolibriAssociation *assoc = &pool->associations[i];
+        checkpoint_put(writer, (uint32_t)assoc->input_hash, 4U);
+        checkpoint_put(writer, (uint32_t)assoc->output_hash, 4U);
+        checkpoint_put(writer, assoc->timestamp, 8U);
+        checkpoint_put_span(writer, assoc->question, strlen(assoc->question));
+        checkpoint_put_span(writer, assoc->answer, strlen(assoc->answer));
+        checkpoint_put_span(writer, assoc->source, strlen(assoc->source));
+        checkpoint_put_span(writer, assoc->question_digits, assoc->question_digits_length);
+        checkpoint_put_span(writer, assoc->answer_digits, assoc->answer_digits_length);
+    }
+}
+
+int kf_pool_save(const KolibriFormulaPool *pool, const char *path, uint64_t *hash) {
+    if (!pool || !path) {
+        return -1;
+    }
+    KolibriCheckpointWriter writer = {NULL, 0U, 0U, 1};
+    checkpoint_write_pool(&writer, pool);
+    uint64_t digest = writer.ok ? fnv1a64(writer.data, writer.length) : 0U;
+    checkpoint_put(&writer, digest, KOLIBRI_POOL_CHECKPOINT_TRAILER);
+    if (!writer.ok) {
+        free(writer.data);
+        return -1;
+    }
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    int ok = file != NULL;
+    if (file) {
+        ok = fwrite(writer.data, 1U, writer.length, file) == writer.length;
+        ok = fclose(file) == 0 && ok;
+    }
+    free(writer.data);
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    if (hash) {
+        *hash = digest;
+    }
+    return 0;
+}
+
+/* The parsed state, kept apart until the whole checkpoint has checked out. */
+typedef struct {
+    KolibriRng rng;
+    double lambda_b;
+    double lambda_d;
+    double target_b;
+    double target_d;
+    int use_custom_target_b;
+    int use_custom_target_d;
+    double coherence_gain;
+    double temperature;
+    size_t top_k;
+    size_t examples;
+    size_t association_count;
+    KolibriFormula *formulas;
+    int *inputs;
+    int *targets;
+    KolibriAssociation *associations;
+} KolibriCheckpointState;
+
+static void checkpoint_state_free(KolibriCheckpointState *state) {
+    free(state->formulas);
+    free(state->inputs);
+    free(state->targets);
+    free(state->associations);
+}
+
+static int checkpoint_read_pool(KolibriCheckpointReader *reader, const KolibriFormulaPool *pool,
+                                KolibriCheckpointState *state) {
+    const unsigned char *magic = checkpoint_take(reader, 4U);
+    if (!magic || memcmp(magic, KOLIBRI_POOL_CHECKPOINT_MAGIC, 4U) != 0 ||
+        checkpoint_get(reader, 4U) != KOLIBRI_POOL_CHECKPOINT_VERSION ||
+        checkpoint_get(reader, 4U) != pool->count) {
+        return -1;
+    }
+    state->examples = (size_t)checkpoint_get(reader, 4U);
+    state->association_count = (size_t)checkpoint_get(reader, 4U);
+    if (!reader->ok || state->examples > pool->example_capacity ||
+        state->association_count > pool->association_capacity) {
+        return -1;
+    }
+    state->rng.state = checkpoint_get(reader, 8U);
+    state->lambda_b = checkpoint_get_double(reader);
+    state->lambda_d = checkpoint_get_double(reader);
+    state->target_b = checkpoint_get_double(reader);
+    state->target_d = checkpoint_get_double(reader);
+    state->use_custom_target_b = checkpoint_get(reader, 1U) != 0U;
+    state->use_custom_target_d = checkpoint_get(reader, 1U) != 0U;
+    state->coherence_gain = checkpoint_get_double(reader);
+    state->temperature = checkpoint_get_double(reader);
+    state->top_k = (size_t)checkpoint_get(reader, 4U);
+    state->formulas = calloc(pool->count, sizeof(KolibriFormula));
+    state->inputs = malloc((state->examples ? state->examples : 1U) * sizeof(int));
+    state->targets = malloc((state->examples ? state->examples : 1U) * sizeof(int));
+    state->associations = calloc(state->association_count ? state->association_count : 1U,
+                                 sizeof(KolibriAssociation));
+    if (!state->formulas || !state->inputs || !state->targets || !state->associations) {
+        return -1;
+    }
+    size_t shared_limit = state->association_count < KOLIBRI_FORMULA_MAX_ASSOCIATIONS
+                              ? state->association_count
+                              : KOLIBRI_FORMULA_MAX_ASSOCIATIONS;
+    for (size_t i = 0; i < pool->count && reader->ok; ++i) {
+        KolibriFormula *formula = &state->formulas[i];
+        formula->gene.length =
+            checkpoint_get_span(reader, formula->gene.digits, sizeof(formula->gene.digits));
+        for (size_t d = 0; d < formula->gene.length; ++d) {
+            if (formula->gene.digits[d] > KOLIBRI_DIGIT_MAX) {
+                return -1;
+            }
+        }
+        formula->fitness = checkpoint_get_double(reader);
+        formula->feedback = checkpoint_get_double(reader);
+        formula->invariant_drift_b = checkpoint_get_double(reader);
+        formula->invariant_drift_d = checkpoint_get_double(reader);
+        formula->phase = checkpoint_get_double(reader);
+        formula->association_count = (size_t)checkpoint_get(reader, 1U);
+        if (formula->association_count > shared_limit) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < state->examples; ++i) {
+        state->inputs[i] = (int)(int32_t)(uint32_t)checkpoint_get(reader, 4U);
+        state->targets[i] = (int)(int32_t)(uint32_t)checkpoint_get(reader, 4U);
+    }
+    for (size_t i = 0; i < state->association_count && reader->ok; ++i) {
+        KolibriAssociation *assoc = &state->associations[i];
+        assoc->input_hash = (int)(int32_t)(uint32_t)checkpoint_get(reader, 4U);
+        assoc->output_hash = (int)(int32_t)(uint32_t)checkpoint_get(reader, 4U);
+        assoc->timestamp = checkpoint_get(reader, 8U);
+        checkpoint_get_text(reader, assoc->question, sizeof(assoc->question));
+        checkpoint_get_text(reader, assoc->answer, sizeof(assoc->answer));
+        checkpoint_get_text(reader, assoc->source, sizeof(assoc->source));
+        assoc->question_digits_length =
+            checkpoint_get_span(reader, assoc->question_digits, sizeof(assoc->question_digits));
+        assoc->answer_digits_length =
+            checkpoint_get_span(reader, assoc->answer_digits, sizeof(assoc->answer_digits));
+    }
+    return reader->ok && reader->offset == reader->length ? 0 : -1;
+}
+
+static void checkpoint_apply(KolibriFormulaPool *pool, const KolibriCheckpointState *state) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        pool->formulas[i] = state->formulas[i];
+        pool->formulas[i].associations =
+            state->formulas[i].association_count > 0U ? pool->associations : NULL;
+    }
+    pool->rng = state->rng;
+    pool->lambda_b = state->lambda_b;
+    pool->lambda_d = state->lambda_d;
+    pool->target_b = state->target_b;
+    pool->target_d = state->target_d;
+    pool->use_custom_target_b = state->use_custom_target_b;
+    pool->use_custom_target_d = state->use_custom_target_d;
+    pool->coherence_gain = state->coherence_gain;
+    pool->temperature = state->temperature;
+    pool->top_k = state->top_k;
+    pool->examples = state->examples;
+    pool->input_peak = 0U;
+    for (size_t i = 0; i < state->examples; ++i) {
+        pool->inputs[i] = state->inputs[i];
+        pool->targets[i] = state->targets[i];
+        int input = state->inputs[i];
+        uint32_t magnitude = input < 0 ? 0U - (uint32_t)input : (uint32_t)input;
+        if (magnitude > pool->input_peak) {
+            pool->input_peak = magnitude;
+        }
+    }
+    for (size_t i = state->association_count; i < pool->association_count; ++i) {
         association_reset(&pool->associations[i]);
     }
+    if (state->association_count > 0U) {
+        memcpy(pool->associations, state->associations,
+               state->association_count * sizeof(KolibriAssociation));
+    }
+    pool->association_count = state->association_count;
+    association_index_rebuild(pool);
+    kf_pool_invalidate_cache(pool);
+    profile_reset(&pool->profile);
+}
+
+int kf_pool_load(KolibriFormulaPool *pool, const char *path, uint64_t *hash) {
+    if (!pool || !path) {
+        return -1;
+    }
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return errno == ENOENT ? 1 : -1;
+    }
+    unsigned char *data = NULL;
+    long size = -1;
+    if (fseek(file, 0L, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size > (long)KOLIBRI_POOL_CHECKPOINT_TRAILER && fseek(file, 0L, SEEK_SET) == 0) {
+        data = malloc((size_t)size);
+    }
+    int ok = data && fread(data, 1U, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    if (!ok) {
+        free(data);
+        return -1;
+    }
+    size_t body = (size_t)size - KOLIBRI_POOL_CHECKPOINT_TRAILER;
+    KolibriCheckpointReader trailer = {data + body, KOLIBRI_POOL_CHECKPOINT_TRAILER, 0U, 1};
+    uint64_t digest = checkpoint_get(&trailer, KOLIBRI_POOL_CHECKPOINT_TRAILER);
+    KolibriCheckpointReader reader = {data, body, 0U, 1};
+    KolibriCheckpointState state;
+    memset(&state, 0, sizeof(state));
+    int status = -1;
+    if (fnv1a64(data, body) == digest && checkpoint_read_pool(&reader, pool, &state) == 0) {
+        checkpoint_apply(pool, &state);
+        if (hash) {
+            *hash = digest;
+        }
+        status = 0;
+    }
+    checkpoint_state_free(&state);
+    free(data);
+    return status;
 }
 
 void kf_pool_clear_examples(KolibriFormulaPool *pool) {
@@ -733,27 +1825,35 @@ void kf_pool_clear_examples(KolibriFormulaPool *pool) {
         return;
     }
     pool->examples = 0;
+    pool->input_peak = 0U;
     pool->association_count = 0;
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.generation_steps, 0ULL);
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.evaluation_calls, 0ULL);
-    pool->profile.generation_steps = 0ULL;
-    pool->profile.evaluation_calls = 0ULL;
-    pool->profile.last_generation_ms = 0.0;
-    for (size_t i = 0; i < KOLIBRI_POOL_MAX_ASSOCIATIONS; ++i) {
+    kf_pool_invalidate_cache(pool);
+    profile_reset(&pool->profile);
+    for (size_t i = 0; i < pool->association_capacity; ++i) {
         association_reset(&pool->associations[i]);
     }
+    association_index_rebuild(pool);
+    /* The shared table is empty now. */
+    for (size_t i = 0; i < pool->count; ++i) {
+        formula_forget_dataset(&pool->formulas[i]);
+    }
 }
 
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target) {
     if (!pool) {
         return -1;
     }
-    if (pool->examples >= sizeof(pool->inputs) / sizeof(pool->inputs[0])) {
+    if (pool->examples >= pool->example_capacity) {
         return -1;
     }
     pool->inputs[pool->examples] = input;
     pool->targets[pool->examples] = target;
     pool->examples++;
+    kf_pool_invalidate_cache(pool);
+    uint32_t magnitude = input < 0 ? 0U - (uint32_t)input : (uint32_t)input;
+    if (magnitude > pool->input_peak) {
+        pool->input_peak = magnitude;
+    }
     return 0;
 }
 
@@ -768,97 +1868,273 @@ int kf_pool_add_association(KolibriFormulaPool *pool,
     }
     KolibriAssociation assoc;
     association_set(&assoc, symbols, question, answer, source, timestamp);
+    if (symbols) {
+        (void)kolibri_symbol_table_flush(symbols);
+    }
 
     /* Обновляем существующую запись, если такой вопрос уже был */
-    for (size_t i = 0; i < pool->association_count; ++i) {
-        if (pool->associations[i].input_hash == assoc.input_hash &&
-            strcmp(pool->associations[i].question, assoc.question) == 0) {
-            pool->associations[i] = assoc;
-            return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
-        }
+    KolibriAssociation *existing = association_index_find(pool, &assoc);
+    if (existing) {
+        /* Same question, so the index entries stay valid. */
+        *existing = assoc;
+        return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
     }
 
-    if (pool->association_count >= KOLIBRI_POOL_MAX_ASSOCIATIONS) {
+    if (pool->association_count >= pool->association_capacity) {
         /* вытесняем самое старое знание */
         memmove(&pool->associations[0], &pool->associations[1],
-                (KOLIBRI_POOL_MAX_ASSOCIATIONS - 1U) * sizeof(KolibriAssociation));
-        pool->associations[KOLIBRI_POOL_MAX_ASSOCIATIONS - 1U] = assoc;
+                (pool->association_capacity - 1U) * sizeof(KolibriAssociation));
+        pool->associations[pool->association_capacity - 1U] = assoc;
+        association_index_rebuild(pool);
         return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
     }
 
     pool->associations[pool->association_count++] = assoc;
+    association_index_add(pool, pool->association_count - 1U);
     return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
 }
 
-void kf_pool_tick(KolibriFormulaPool *pool, size_t generations) {
-    if (!pool || pool->count == 0) {
-        return;
+static void association_reverse(KolibriAssociation *items, size_t first, size_t last,
+                                KolibriAssociation *spare) {
+    while (first + 1U < last) {
+        --last;
+        *spare = items[first];
+        items[first] = items[last];
+        items[last] = *spare;
+        ++first;
     }
+}
 
-    if (generations == 0) {
-        generations = 1;
+/*
+ * A full table turns into a ring for the batch: each new question replaces the
+ * oldest slot, and only the keys are kept current. The order and the trigram
+ * rows are restored once at the end.
+ */
+size_t kf_pool_add_associations_bulk(KolibriFormulaPool *pool,
+                                     KolibriSymbolTable *symbols,
+                                     const KolibriAssociationInput *items,
+                                     size_t count,
+                                     const char *source,
+                                     uint64_t timestamp) {
+    if (!pool || !items || pool->association_capacity == 0U) {
+        return 0U;
     }
+    KolibriAssociation assoc;
+    uint8_t answer_digits[KOLIBRI_ASSOC_DIGITS_MAX];
+    size_t answer_digits_length = 0U;
+    char answer_text[KOLIBRI_ASSOC_ANSWER_MAX];
+    answer_text[0] = '\0';
+    int answer_cached = 0;
+    size_t capacity = pool->association_capacity;
+    size_t head = 0U;
+    size_t stale = 0U;
+    int wrapped = 0;
+    size_t stored = 0U;
+    for (size_t i = 0; i < count; ++i) {
+        if (!items[i].question || !items[i].answer) {
+            continue;
+        }
+        association_set(&assoc, NULL, items[i].question, items[i].answer, source, timestamp);
+        if (symbols) {
+            assoc.question_digits_length = association_encode(symbols, assoc.question, assoc.question_digits);
+            /* N-grams of one question share its answer. */
+            if (!answer_cached || strcmp(answer_text, assoc.answer) != 0) {
+                answer_digits_length = association_encode(symbols, assoc.answer, answer_digits);
+                memcpy(answer_text, assoc.answer, sizeof(answer_text));
+                answer_cached = 1;
+            }
+            memcpy(assoc.answer_digits, answer_digits, answer_digits_length);
+            assoc.answer_digits_length = answer_digits_length;
+        }
 
-    clock_t start_clock = clock();
+        KolibriAssociation *existing = association_index_find(pool, &assoc);
+        if (existing) {
+            *existing = assoc;
+        } else if (pool->association_count < capacity) {
+            pool->associations[pool->association_count++] = assoc;
+            association_index_add(pool, pool->association_count - 1U);
+        } else {
+            pool->associations[head] = assoc;
+            association_key_add(pool, head);
+            head = (head + 1U) % capacity;
+            wrapped = 1;
+            /* The replaced question's key is left behind; sweep before the
+             * probe sequences run out of empty slots. */
+            if (++stale + capacity + 1U >= pool->association_key_slots) {
+                memset(pool->association_keys, 0, pool->association_key_slots * sizeof(uint32_t));
+                for (size_t slot = 0; slot < capacity; ++slot) {
+                    association_key_add(pool, slot);
+                }
+                stale = 0U;
+            }
+        }
+        (void)kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
+        ++stored;
+    }
+    /* New symbols of the whole batch reach the genome together. */
+    if (symbols) {
+        (void)kolibri_symbol_table_flush(symbols);
+    }
+    if (wrapped) {
+        association_reverse(pool->associations, 0U, head, &assoc);
+        association_reverse(pool->associations, head, capacity, &assoc);
+        association_reverse(pool->associations, 0U, capacity, &assoc);
+        association_index_rebuild(pool);
+    }
+    return stored;
+}
+
+/* Tracks the stop conditions of one kf_pool_tick_until call. */
+typedef struct {
+    const KolibriTickBudget *budget;
+    uint64_t start_ns;
+    double best_seen;
+    size_t stale;
+} KolibriTickWatch;
+
+static int tick_watch_stop(KolibriTickWatch *watch, double best) {
+    const KolibriTickBudget *budget = watch->budget;
+    if (budget->target_fitness > 0.0 && best >= budget->target_fitness) {
+        return 1;
+    }
+    if (budget->stagnation_generations > 0U) {
+        if (best > watch->best_seen) {
+            watch->best_seen = best;
+            watch->stale = 0U;
+        } else if (++watch->stale >= budget->stagnation_generations) {
+            return 1;
+        }
+    }
+    return budget->deadline_ms > 0U &&
+           monotonic_ns() - watch->start_ns >= (uint64_t)budget->deadline_ms * 1000000ULL;
+}
+
+size_t kf_pool_tick_until(KolibriFormulaPool *pool, const KolibriTickBudget *budget) {
+    if (!pool || !budget || pool->count == 0) {
+        return 0U;
+    }
+
+    size_t generations = budget->max_generations > 0U ? budget->max_generations : 1U;
+
+    KolibriTickScratch scratch;
+    if (tick_scratch_init(&scratch, pool->count) != 0) {
+        return 0U;
+    }
+    uint64_t start_ns = monotonic_ns();
+    KolibriTickWatch watch = {budget, start_ns, -INFINITY, 0U};
+    size_t completed = 0U;
     uint64_t evaluations = 0ULL;
+    size_t groups = beam_group_count(pool);
+
+#if defined(KOLIBRI_FORMULA_THREADS)
+    KolibriEvalCrew crew;
+    pthread_t workers[KOLIBRI_POOL_MAX_PARALLELISM];
+    size_t worker_count = 0U;
+    size_t threads = resolve_parallelism(pool);
+    if (threads > 1U) {
+        memset(&crew, 0, sizeof(crew));
+        crew.pool = pool;
+        crew.pass = &scratch.pass;
+        pthread_mutex_init(&crew.lock, NULL);
+        pthread_cond_init(&crew.wake, NULL);
+        pthread_cond_init(&crew.done, NULL);
+        /* The calling thread is the first worker. */
+        while (worker_count + 1U < threads &&
+               pthread_create(&workers[worker_count], NULL, crew_worker_main, &crew) == 0) {
+            ++worker_count;
+        }
+    }
+#endif
 
-    for (size_t g = 0; g < generations; ++g) {
-        size_t index = 0;
-        while (index < pool->count) {
-            KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
-            size_t lane_count = 0U;
-            while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
-                lanes[lane_count].formula = &pool->formulas[index];
-                lanes[lane_count].score = 0.0;
-                lanes[lane_count].evaluation.base_score = 0.0;
-                ++lane_count;
-                ++index;
+    for (size_t g = 0; g <= generations; ++g) {
+        cache_prefetch(pool, &scratch.pass);
+#if defined(KOLIBRI_FORMULA_THREADS)
+        if (worker_count > 0U) {
+            crew_evaluate(&crew);
+        } else
+#endif
+        {
+            for (size_t group = 0; group < groups; ++group) {
+                evaluate_group_at(pool, &scratch.pass, group);
             }
-            evaluate_beam_group(pool, lanes, lane_count);
         }
+        cache_commit(pool, &scratch.pass);
         evaluations += (uint64_t)pool->count;
-        qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
-        reproduce(pool);
-    }
-
-    size_t index = 0;
-    while (index < pool->count) {
-        KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
-        size_t lane_count = 0U;
-        while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
-            lanes[lane_count].formula = &pool->formulas[index];
-            lanes[lane_count].score = 0.0;
-            lanes[lane_count].evaluation.base_score = 0.0;
-            ++lane_count;
-            ++index;
+        /* The extra pass scores the last generation of children. */
+        if (g == generations) {
+            break;
         }
-        evaluate_beam_group(pool, lanes, lane_count);
+        uint64_t sort_start = monotonic_ns();
+        rank_formulas(pool, &scratch);
+        uint64_t reproduce_start = monotonic_ns();
+        pool->profile.sort_ns += reproduce_start - sort_start;
+        if (tick_watch_stop(&watch, pool->formulas[scratch.order[0]].fitness)) {
+            break;
+        }
+        reproduce(pool, scratch.order);
+        pool->profile.reproduce_ns += monotonic_ns() - reproduce_start;
+        ++completed;
+    }
+
+#if defined(KOLIBRI_FORMULA_THREADS)
+    if (threads > 1U) {
+        pthread_mutex_lock(&crew.lock);
+        crew.stop = 1;
+        pthread_cond_broadcast(&crew.wake);
+        pthread_mutex_unlock(&crew.lock);
+        for (size_t i = 0; i < worker_count; ++i) {
+            pthread_join(workers[i], NULL);
+        }
+        pthread_cond_destroy(&crew.done);
+        pthread_cond_destroy(&crew.wake);
+        pthread_mutex_destroy(&crew.lock);
     }
-    evaluations += (uint64_t)pool->count;
+#endif
 
-    qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
+    uint64_t sort_start = monotonic_ns();
+    rank_formulas(pool, &scratch);
+    apply_ranking(pool, &scratch);
+    pool->profile.sort_ns += monotonic_ns() - sort_start;
 
     if (pool->association_count > 0) {
         double assoc_fitness = evaluate_association_fitness(pool);
         size_t limit = pool->count < 3 ? pool->count : 3;
         for (size_t i = 0; i < limit; ++i) {
-            copy_dataset_into_formula(pool, &pool->formulas[i]);
+            share_dataset_with_formula(pool, &pool->formulas[i]);
             pool->formulas[i].fitness = assoc_fitness;
             pool->formulas[i].invariant_drift_b = 0.0;
             pool->formulas[i].invariant_drift_d = 0.0;
         }
-        qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
+        /* Scores are clamped to [0, 1], so the leaders only need re-ranking
+         * if the association score is below 1. */
+        if (assoc_fitness < 1.0) {
+            rank_formulas(pool, &scratch);
+            apply_ranking(pool, &scratch);
+        }
     }
 
-    clock_t end_clock = clock();
-    if (start_clock != (clock_t)-1 && end_clock != (clock_t)-1 && end_clock >= start_clock) {
-        double elapsed = ((double)(end_clock - start_clock) * 1000.0) / (double)CLOCKS_PER_SEC;
-        pool->profile.last_generation_ms = elapsed;
-    }
-    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.generation_steps, generations);
+    tick_scratch_release(&scratch);
+
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    pool->profile.last_tick_ns = elapsed_ns;
+    pool->profile.total_tick_ns += elapsed_ns;
+    pool->profile.last_generation_ms = (double)elapsed_ns / 1e6;
+    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.generation_steps, completed);
     KOLIBRI_ATOMIC_ADD_U64(&pool->profile.evaluation_calls, evaluations);
-    pool->profile.generation_steps += generations;
-    pool->profile.evaluation_calls += evaluations;
+    pool->profile.evaluations_per_sec =
+        pool->profile.total_tick_ns > 0ULL
+            ? (double)pool->profile.evaluation_calls * 1e9 / (double)pool->profile.total_tick_ns
+            : 0.0;
+    uint64_t lookups = pool->profile.cache_hits + pool->profile.cache_misses;
+    pool->profile.cache_hit_rate =
+        lookups > 0ULL ? (double)pool->profile.cache_hits / (double)lookups : 0.0;
+    return completed;
+}
+
+void kf_pool_tick(KolibriFormulaPool *pool, size_t generations) {
+    KOLIBRI_TRACE_SCOPE("kf_pool_tick");
+    KolibriTickBudget budget = {generations, 0U, 0.0, 0U};
+    kf_pool_tick_until(pool, &budget);
 }
 
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool) {
@@ -868,6 +2144,96 @@ const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool) {
     return &pool->formulas[0];
 }
 
+const KolibriAssociation *kf_pool_find_association(const KolibriFormulaPool *pool, int input_hash) {
+    if (!pool || pool->association_count == 0) {
+        return NULL;
+    }
+    size_t probe = association_key_home(pool, input_hash);
+    for (uint32_t entry; (entry = pool->association_keys[probe]) != 0U;
+         probe = (probe + 1U) & (pool->association_key_slots - 1U)) {
+        if (pool->associations[entry - 1U].input_hash == input_hash) {
+            return &pool->associations[entry - 1U];
+        }
+    }
+    return NULL;
+}
+
+int kf_pool_lookup_answer(const KolibriFormulaPool *pool, const KolibriFormula *formula,
+                          int input, char *buffer, size_t buffer_len) {
+    if (!pool || !formula || !buffer || buffer_len == 0) {
+        return -1;
+    }
+    if (formula->associations != pool->associations) {
+        return kf_formula_lookup_answer(formula, input, buffer, buffer_len);
+    }
+    /* The formula sees a prefix of the table and equal hashes resolve to the
+     * lowest slot, as in the linear scan. */
+    const KolibriAssociation *assoc = kf_pool_find_association(pool, input);
+    if (!assoc || (size_t)(assoc - pool->associations) >= formula->association_count) {
+        return -1;
+    }
+    strncpy(buffer, assoc->answer, buffer_len - 1U);
+    buffer[buffer_len - 1U] = '\0';
+    return 0;
+}
+
+const KolibriAssociation *kf_pool_match_association(const KolibriFormulaPool *pool,
+                                                    const char *question) {
+    if (!pool || !question || pool->association_count == 0) {
+        return NULL;
+    }
+    char folded[KOLIBRI_ASSOC_QUESTION_MAX];
+    size_t len = association_fold(question, folded, sizeof(folded));
+    size_t grams[KOLIBRI_ASSOC_QUESTION_MAX];
+    size_t gram_count = 0U;
+    uint64_t signature = 0ULL;
+    for (size_t i = 0; i + 3 <= len; ++i) {
+        grams[gram_count] = association_gram(&folded[i]);
+        signature |= 1ULL << (grams[gram_count] % 64U);
+        ++gram_count;
+    }
+    const uint64_t *keys = association_row(pool, 0);
+    const uint64_t *any = association_row(pool, KOLIBRI_ASSOC_GRAM_BUCKETS);
+    const uint64_t *shorts = association_row(pool, 2 * KOLIBRI_ASSOC_GRAM_BUCKETS);
+    size_t words = pool->association_words;
+    size_t best_len = 0U;
+    const KolibriAssociation *best = NULL;
+    for (size_t word = 0; word * 64U < pool->association_count; ++word) {
+        uint64_t inside = shorts[word];
+        uint64_t around = ~0ULL;
+        for (size_t i = 0; i < gram_count; ++i) {
+            inside |= keys[grams[i] * words + word];
+            around &= any[grams[i] * words + word];
+        }
+        uint64_t candidates = inside | around;
+        size_t live = pool->association_count - word * 64U;
+        if (live < 64U) {
+            candidates &= (1ULL << live) - 1ULL;
+        }
+        while (candidates != 0ULL) {
+            size_t slot = word * 64U + lowest_bit(candidates);
+            candidates &= candidates - 1ULL;
+            uint64_t candidate_signature = pool->association_signatures[slot];
+            if ((candidate_signature & ~signature) != 0ULL &&
+                (signature & ~candidate_signature) != 0ULL) {
+                continue;
+            }
+            const KolibriAssociation *assoc = &pool->associations[slot];
+            size_t candidate_len = strlen(assoc->question);
+            if (candidate_len <= best_len) {
+                continue;
+            }
+            char candidate[KOLIBRI_ASSOC_QUESTION_MAX];
+            association_fold(assoc->question, candidate, sizeof(candidate));
+            if (strstr(folded, candidate) || strstr(candidate, folded)) {
+                best_len = candidate_len;
+                best = assoc;
+            }
+        }
+    }
+    return best;
+}
+
 int kf_formula_lookup_answer(const KolibriFormula *formula, int input,
                              char *buffer, size_t buffer_len) {
     if (!formula || !buffer || buffer_len == 0) {
@@ -1057,6 +2423,43 @@ int kf_pool_feedback(KolibriFormulaPool *pool, const KolibriGene *gene, double d
     return -1;
 }
 
+static int pool_holds_gene(const KolibriFormulaPool *pool, const KolibriGene *gene) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        if (pool->formulas[i].gene.length == gene->length &&
+            memcmp(pool->formulas[i].gene.digits, gene->digits, gene->length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t kf_pool_immigrate(KolibriFormulaPool *pool, const KolibriFormula *migrants, size_t count) {
+    if (!pool || !migrants || pool->count == 0) {
+        return 0;
+    }
+    size_t accepted = 0;
+    for (size_t m = 0; m < count; ++m) {
+        if (migrants[m].gene.length > sizeof(migrants[m].gene.digits) ||
+            pool_holds_gene(pool, &migrants[m].gene)) {
+            continue;
+        }
+        size_t index = pool->count - 1U;
+        KolibriFormula *slot = &pool->formulas[index];
+        *slot = migrants[m];
+        slot->feedback = 0.0;
+        /* The migrant's associations belong to its home pool. */
+        formula_forget_dataset(slot);
+        while (index > 0 && pool->formulas[index].fitness > pool->formulas[index - 1].fitness) {
+            KolibriFormula tmp = pool->formulas[index - 1];
+            pool->formulas[index - 1] = pool->formulas[index];
+            pool->formulas[index] = tmp;
+            index--;
+        }
+        accepted++;
+    }
+    return accepted;
+}
+
 void kf_pool_set_penalties(KolibriFormulaPool *pool, double lambda_b, double lambda_d) {
     if (!pool) {
         return;
@@ -1075,6 +2478,10 @@ void kf_pool_set_targets(KolibriFormulaPool *pool, double target_b, double targe
     if (!pool) {
         return;
     }
+    double previous_b = pool->target_b;
+    double previous_d = pool->target_d;
+    int previous_custom_b = pool->use_custom_target_b;
+    int previous_custom_d = pool->use_custom_target_d;
     if (isfinite(target_b)) {
         pool->target_b = target_b;
         pool->use_custom_target_b = 1;
@@ -1087,6 +2494,20 @@ void kf_pool_set_targets(KolibriFormulaPool *pool, double target_b, double targe
     } else {
         pool->use_custom_target_d = 0;
     }
+    /* Drift metrics depend on the targets; scripts re-apply unchanged ones often. */
+    if (pool->use_custom_target_b != previous_custom_b || pool->use_custom_target_d != previous_custom_d ||
+        (pool->use_custom_target_b && pool->target_b != previous_b) ||
+        (pool->use_custom_target_d && pool->target_d != previous_d)) {
+        kf_pool_invalidate_cache(pool);
+    }
+}
+
+void kf_pool_invalidate_cache(KolibriFormulaPool *pool) {
+    if (!pool) {
+        return;
+    }
+    /* Bumping the version retires every entry without touching the table. */
+    pool->dataset_version++;
 }
 
 void kf_pool_set_coherence_gain(KolibriFormulaPool *pool, double gain) {
@@ -1116,16 +2537,55 @@ void kf_pool_set_sampling(KolibriFormulaPool *pool, double temperature, size_t t
     }
     pool->temperature = temperature;
 
-    size_t capacity = sizeof(pool->formulas) / sizeof(pool->formulas[0]);
-    if (top_k == 0U || top_k > capacity) {
-        top_k = capacity;
+    if (top_k == 0U || top_k > pool->count) {
+        top_k = pool->count;
     }
     pool->top_k = top_k;
 }
 
+void kf_pool_set_parallelism(KolibriFormulaPool *pool, size_t threads) {
+    if (!pool) {
+        return;
+    }
+    if (threads > KOLIBRI_POOL_MAX_PARALLELISM) {
+        threads = KOLIBRI_POOL_MAX_PARALLELISM;
+    }
+    pool->parallelism = threads;
+}
+
 const KolibriPoolProfile *kf_pool_profile(const KolibriFormulaPool *pool) {
     if (!pool) {
         return NULL;
     }
     return &pool->profile;
 }
+
+int kf_pool_profile_json(const KolibriPoolProfile *profile, char *buffer, size_t buffer_len) {
+    if (!profile || !buffer || buffer_len == 0) {
+        return -1;
+    }
+    int written = snprintf(buffer, buffer_len,
+                           "{\"generation_steps\":%llu,\"evaluation_calls\":%llu,"
+                           "\"last_generation_ms\":%.3f,\"last_tick_ns\":%llu,"
+                           "\"total_tick_ns\":%llu,\"evaluation_ns\":%llu,"
+                           "\"coherence_ns\":%llu,\"sort_ns\":%llu,\"reproduce_ns\":%llu,"
+                           "\"evaluations_per_sec\":%.1f,\"cache_hits\":%llu,"
+                           "\"cache_misses\":%llu,\"cache_hit_rate\":%.4f}",
+                           (unsigned long long)profile->generation_steps,
+                           (unsigned long long)profile->evaluation_calls,
+                           profile->last_generation_ms,
+                           (unsigned long long)profile->last_tick_ns,
+                           (unsigned long long)profile->total_tick_ns,
+                           (unsigned long long)profile->evaluation_ns,
+                           (unsigned long long)profile->coherence_ns,
+                           (unsigned long long)profile->sort_ns,
+                           (unsigned long long)profile->reproduce_ns,
+                           profile->evaluations_per_sec,
+                           (unsigned long long)profile->cache_hits,
+                           (unsigned long long)profile->cache_misses,
+                           profile->cache_hit_rate);
+    if (written < 0 || (size_t)written >= buffer_len) {
+        return -1;
+    }
+    return written;
+}
@@ -5,19 +5,51 @@
 #include "kolibri/genome.h"
 
 #include "kolibri/decimal.h"
+#include "kolibri/trace.h"
 
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 
 #define KOLIBRI_HMAC_INPUT_SIZE                                                \
   (KOLIBRI_BLOCK_SIZE - KOLIBRI_HASH_SIZE)
 
+/* Below this many blocks a single thread verifies faster than a pool. */
+#define KOLIBRI_VERIFY_PARALLEL_MIN 4096U
+#define KOLIBRI_VERIFY_THREADS_MAX 64U
+
+#define KOLIBRI_CHECKPOINT_MAGIC "KGCKPT1"
+#define KOLIBRI_CHECKPOINT_SIZE (8 + 8 + KOLIBRI_HASH_SIZE + KOLIBRI_HASH_SIZE)
+
+/* v2 record: u16 length, fixed head, event type, encoding, packed payload. */
+#define KOLIBRI_RECORD_HEAD (16 + KOLIBRI_HASH_SIZE * 2)
+#define KOLIBRI_RECORD_MIN_BODY (KOLIBRI_RECORD_HEAD + 2)
+#define KOLIBRI_RECORD_MAX                                                     \
+  (2 + KOLIBRI_RECORD_HEAD + 1 + KOLIBRI_EVENT_TYPE_SIZE + 1 +                 \
+   KOLIBRI_PAYLOAD_SIZE)
+
+enum {
+  KOLIBRI_PAYLOAD_TEXT = 0, /* one byte per digit triple */
+  KOLIBRI_PAYLOAD_BCD = 1   /* two digits per byte, odd tail padded with 0xF */
+};
+
 static void reset_context(KolibriGenome *ctx) {
   if (!ctx) {
     return;
@@ -30,6 +62,15 @@ static void reset_context(KolibriGenome *ctx) {
   memset(ctx->path, 0, sizeof(ctx->path));
   ctx->next_index = 0;
   ctx->has_last_block = 0;
+  ctx->sync.mode = KG_SYNC_FLUSH;
+  ctx->sync.every_blocks = 1;
+  ctx->sync.every_ms = 0;
+  ctx->unsynced_blocks = 0;
+  ctx->last_sync_ns = 0;
+  memset(ctx->chain_hash, 0, sizeof(ctx->chain_hash));
+  ctx->segment_blocks = 0;
+  ctx->segment_first = 0;
+  ctx->format = KOLIBRI_GENOME_FORMAT_V1;
 }
 
 static void encode_u64_be(uint64_t value, unsigned char *out) {
@@ -70,6 +111,103 @@ static void deserialize_block(const unsigned char *data, ReasonBlock *block) {
          KOLIBRI_PAYLOAD_SIZE);
 }
 
+/* Packs a block into a v2 record; returns the record length. The payload
+ * must already be a NUL-terminated digit string. */
+static size_t encode_record(const ReasonBlock *block, unsigned char *out) {
+  unsigned char *p = out + 2;
+  encode_u64_be(block->index, p);
+  encode_u64_be(block->timestamp, p + 8);
+  memcpy(p + 16, block->prev_hash, KOLIBRI_HASH_SIZE);
+  memcpy(p + 16 + KOLIBRI_HASH_SIZE, block->hmac, KOLIBRI_HASH_SIZE);
+  p += KOLIBRI_RECORD_HEAD;
+
+  size_t event_len = strnlen(block->event_type, KOLIBRI_EVENT_TYPE_SIZE);
+  *p++ = (unsigned char)event_len;
+  memcpy(p, block->event_type, event_len);
+  p += event_len;
+
+  const char *digits = block->payload;
+  size_t digit_count = strnlen(digits, KOLIBRI_PAYLOAD_SIZE);
+  int text = digit_count % 3 == 0;
+  for (size_t i = 0; text && i < digit_count; i += 3) {
+    text = (digits[i] - '0') * 100 + (digits[i + 1] - '0') * 10 +
+               (digits[i + 2] - '0') <=
+           255;
+  }
+  if (text) {
+    *p++ = KOLIBRI_PAYLOAD_TEXT;
+    for (size_t i = 0; i < digit_count; i += 3) {
+      *p++ = (unsigned char)((digits[i] - '0') * 100 +
+                             (digits[i + 1] - '0') * 10 + (digits[i + 2] - '0'));
+    }
+  } else {
+    *p++ = KOLIBRI_PAYLOAD_BCD;
+    for (size_t i = 0; i < digit_count; i += 2) {
+      unsigned int low = i + 1 < digit_count ? (unsigned int)(digits[i + 1] - '0')
+                                             : 0x0FU;
+      *p++ = (unsigned char)(((unsigned int)(digits[i] - '0') << 4) | low);
+    }
+  }
+  size_t body = (size_t)(p - out) - 2;
+  out[0] = (unsigned char)(body >> 8);
+  out[1] = (unsigned char)(body & 0xFFU);
+  return body + 2;
+}
+
+/* Unpacks the v2 record of exactly `len` bytes at data. */
+static int decode_record(const unsigned char *data, size_t len,
+                         ReasonBlock *block) {
+  if (len < 2 + KOLIBRI_RECORD_MIN_BODY ||
+      (((size_t)data[0] << 8) | data[1]) != len - 2) {
+    return -1;
+  }
+  const unsigned char *p = data + 2;
+  const unsigned char *end = data + len;
+  memset(block, 0, sizeof(*block));
+  block->index = decode_u64_be(p);
+  block->timestamp = decode_u64_be(p + 8);
+  memcpy(block->prev_hash, p + 16, KOLIBRI_HASH_SIZE);
+  memcpy(block->hmac, p + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE);
+  p += KOLIBRI_RECORD_HEAD;
+
+  size_t event_len = *p++;
+  if (event_len >= KOLIBRI_EVENT_TYPE_SIZE || (size_t)(end - p) < event_len + 1) {
+    return -1;
+  }
+  memcpy(block->event_type, p, event_len);
+  p += event_len;
+
+  unsigned char encoding = *p++;
+  size_t packed = (size_t)(end - p);
+  size_t out = 0;
+  if (encoding == KOLIBRI_PAYLOAD_TEXT) {
+    if (packed * 3 >= KOLIBRI_PAYLOAD_SIZE) {
+      return -1;
+    }
+    for (size_t i = 0; i < packed; ++i) {
+      block->payload[out++] = (char)('0' + p[i] / 100);
+      block->payload[out++] = (char)('0' + (p[i] / 10) % 10);
+      block->payload[out++] = (char)('0' + p[i] % 10);
+    }
+    return 0;
+  }
+  if (encoding != KOLIBRI_PAYLOAD_BCD || packed * 2 > KOLIBRI_PAYLOAD_SIZE) {
+    return -1;
+  }
+  for (size_t i = 0; i < packed; ++i) {
+    unsigned int high = p[i] >> 4;
+    unsigned int low = p[i] & 0x0FU;
+    if (high > 9 || (low > 9 && (low != 0x0FU || i + 1 != packed))) {
+      return -1;
+    }
+    block->payload[out++] = (char)('0' + high);
+    if (low <= 9) {
+      block->payload[out++] = (char)('0' + low);
+    }
+  }
+  return out < KOLIBRI_PAYLOAD_SIZE ? 0 : -1;
+}
+
 static void build_hmac_message(const ReasonBlock *block, unsigned char *out) {
   encode_u64_be(block->index, out);
   encode_u64_be(block->timestamp, out + 8);
@@ -161,8 +299,343 @@ static int parse_and_verify_block(const unsigned char *bytes,
   return 0;
 }
 
+/* Records are variable-length, so v2 readers keep every record's offset. */
+static int reader_index_records(KolibriGenomeReader *reader) {
+  reader->format = KOLIBRI_GENOME_FORMAT_V2;
+  size_t capacity = reader->size / (2 + KOLIBRI_RECORD_MIN_BODY) + 1;
+  reader->offsets = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+  if (!reader->offsets) {
+    return -1;
+  }
+  size_t offset = KOLIBRI_GENOME_V2_HEADER_SIZE;
+  uint64_t count = 0;
+  reader->offsets[0] = offset;
+  while (reader->size - offset >= 2) {
+    size_t body = ((size_t)reader->data[offset] << 8) | reader->data[offset + 1];
+    if (body < KOLIBRI_RECORD_MIN_BODY || reader->size - offset - 2 < body) {
+      break;
+    }
+    offset += 2 + body;
+    reader->offsets[++count] = offset;
+  }
+  reader->block_count = count;
+  return 0;
+}
+
+/* The v1 bytes of block `index`, which the chain hashes and MACs cover. */
+static const unsigned char *reader_canonical(const KolibriGenomeReader *reader,
+                                             uint64_t index,
+                                             unsigned char *scratch) {
+  if (reader->format == KOLIBRI_GENOME_FORMAT_V1) {
+    return reader->data + index * KOLIBRI_BLOCK_SIZE;
+  }
+  ReasonBlock block;
+  const uint64_t *offsets = reader->offsets;
+  if (decode_record(reader->data + offsets[index],
+                    (size_t)(offsets[index + 1] - offsets[index]),
+                    &block) != 0) {
+    return NULL;
+  }
+  serialize_block(&block, scratch);
+  return scratch;
+}
+
+static int reader_block_hash(const KolibriGenomeReader *reader, uint64_t index,
+                             unsigned char *out_hash) {
+  unsigned char scratch[KOLIBRI_BLOCK_SIZE];
+  const unsigned char *bytes = reader_canonical(reader, index, scratch);
+  return bytes && SHA256(bytes, KOLIBRI_BLOCK_SIZE, out_hash) ? 0 : -1;
+}
+
+static int reader_is_torn(const KolibriGenomeReader *reader) {
+  if (reader->format == KOLIBRI_GENOME_FORMAT_V1) {
+    return reader->size % KOLIBRI_BLOCK_SIZE != 0;
+  }
+  return reader->offsets[reader->block_count] != reader->size;
+}
+
+int kg_reader_open(KolibriGenomeReader *reader, const char *path) {
+  if (!reader || !path) {
+    return -1;
+  }
+  memset(reader, 0, sizeof(*reader));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno == ENOENT ? 1 : -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  reader->size = (size_t)st.st_size;
+  reader->format = KOLIBRI_GENOME_FORMAT_V1;
+  reader->block_count = (uint64_t)(reader->size / KOLIBRI_BLOCK_SIZE);
+  if (reader->size > 0) {
+    void *map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      memset(reader, 0, sizeof(*reader));
+      return -1;
+    }
+    reader->data = (const unsigned char *)map;
+  }
+  close(fd);
+  if (reader->size >= KOLIBRI_GENOME_V2_HEADER_SIZE &&
+      memcmp(reader->data, KOLIBRI_GENOME_V2_MAGIC,
+             KOLIBRI_GENOME_V2_HEADER_SIZE) == 0 &&
+      reader_index_records(reader) != 0) {
+    kg_reader_close(reader);
+    return -1;
+  }
+  return 0;
+}
+
+void kg_reader_close(KolibriGenomeReader *reader) {
+  if (!reader) {
+    return;
+  }
+  if (reader->data) {
+    munmap((void *)reader->data, reader->size);
+  }
+  free(reader->offsets);
+  memset(reader, 0, sizeof(*reader));
+}
+
+int kg_read_block(const KolibriGenomeReader *reader, uint64_t index,
+                  ReasonBlock *out_block) {
+  if (!reader || !out_block || index >= reader->block_count) {
+    return -1;
+  }
+  if (reader->format == KOLIBRI_GENOME_FORMAT_V2) {
+    return decode_record(reader->data + reader->offsets[index],
+                         (size_t)(reader->offsets[index + 1] -
+                                  reader->offsets[index]),
+                         out_block);
+  }
+  deserialize_block(reader->data + index * KOLIBRI_BLOCK_SIZE, out_block);
+  return 0;
+}
+
+/* Where a mapped run of blocks sits in the chain: a segment starts at
+ * base_index and links to first_prev (NULL for the genesis block). */
+typedef struct {
+  const unsigned char *key;
+  size_t key_len;
+  uint64_t base_index;
+  const unsigned char *first_prev;
+} VerifyChain;
+
+static int verify_block_at(const KolibriGenomeReader *reader, uint64_t index,
+                           const VerifyChain *chain) {
+  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
+  if (index > 0) {
+    if (reader_block_hash(reader, index - 1, expected_prev) != 0) {
+      return -1;
+    }
+  } else if (chain->first_prev) {
+    memcpy(expected_prev, chain->first_prev, KOLIBRI_HASH_SIZE);
+  } else {
+    memset(expected_prev, 0, sizeof(expected_prev));
+  }
+  unsigned char scratch[KOLIBRI_BLOCK_SIZE];
+  const unsigned char *bytes = reader_canonical(reader, index, scratch);
+  if (!bytes) {
+    return -1;
+  }
+  return parse_and_verify_block(bytes, chain->key, chain->key_len,
+                                chain->base_index + index, expected_prev, NULL,
+                                NULL);
+}
+
+/* Every block's MAC covers only its own bytes and prev_hash covers only the
+ * previous block, so disjoint ranges verify independently. */
+typedef struct {
+  const KolibriGenomeReader *reader;
+  const VerifyChain *chain;
+  uint64_t begin;
+  uint64_t end;
+  atomic_int *failed;
+} VerifyRange;
+
+static void *verify_range_main(void *arg) {
+  VerifyRange *range = (VerifyRange *)arg;
+  for (uint64_t i = range->begin; i < range->end; ++i) {
+    if ((i & 255U) == 0 && atomic_load(range->failed)) {
+      break;
+    }
+    if (verify_block_at(range->reader, i, range->chain) != 0) {
+      atomic_store(range->failed, 1);
+      break;
+    }
+  }
+  return NULL;
+}
+
+static int verify_blocks(const KolibriGenomeReader *reader, uint64_t start,
+                         const VerifyChain *chain, size_t threads) {
+  uint64_t count = reader->block_count - start;
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t)online : 1;
+  }
+  if (threads > KOLIBRI_VERIFY_THREADS_MAX) {
+    threads = KOLIBRI_VERIFY_THREADS_MAX;
+  }
+  if (count < KOLIBRI_VERIFY_PARALLEL_MIN) {
+    threads = 1;
+  }
+  atomic_int failed;
+  atomic_init(&failed, 0);
+  VerifyRange ranges[KOLIBRI_VERIFY_THREADS_MAX];
+  pthread_t workers[KOLIBRI_VERIFY_THREADS_MAX];
+  int started[KOLIBRI_VERIFY_THREADS_MAX];
+  uint64_t per_thread = (count + threads - 1) / threads;
+  for (size_t t = 0; t < threads; ++t) {
+    ranges[t].reader = reader;
+    ranges[t].chain = chain;
+    ranges[t].begin = start + per_thread * t;
+    ranges[t].end = ranges[t].begin + per_thread;
+    if (ranges[t].begin > reader->block_count) {
+      ranges[t].begin = reader->block_count;
+    }
+    if (ranges[t].end > reader->block_count) {
+      ranges[t].end = reader->block_count;
+    }
+    ranges[t].failed = &failed;
+  }
+  for (size_t t = 1; t < threads; ++t) {
+    started[t] =
+        pthread_create(&workers[t], NULL, verify_range_main, &ranges[t]) == 0;
+    if (!started[t]) {
+      verify_range_main(&ranges[t]);
+    }
+  }
+  verify_range_main(&ranges[0]);
+  for (size_t t = 1; t < threads; ++t) {
+    if (started[t]) {
+      pthread_join(workers[t], NULL);
+    }
+  }
+  return atomic_load(&failed) ? -1 : 0;
+}
+
+static int checkpoint_mac(const unsigned char *key, size_t key_len,
+                          const unsigned char *record, unsigned char *out) {
+  unsigned int mac_len = 0;
+  return HMAC(EVP_sha256(), key, (int)key_len, record,
+              KOLIBRI_CHECKPOINT_SIZE - KOLIBRI_HASH_SIZE, out, &mac_len) &&
+                 mac_len == KOLIBRI_HASH_SIZE
+             ? 0
+             : -1;
+}
+
+/* Returns how many leading blocks a valid checkpoint vouches for. */
+static uint64_t checkpoint_load(const char *path,
+                                const KolibriGenomeReader *reader,
+                                const unsigned char *key, size_t key_len) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+  unsigned char record[KOLIBRI_CHECKPOINT_SIZE];
+  size_t read = fread(record, 1, sizeof(record), file);
+  fclose(file);
+  if (read != sizeof(record) ||
+      memcmp(record, KOLIBRI_CHECKPOINT_MAGIC, 8) != 0) {
+    return 0;
+  }
+  unsigned char mac[KOLIBRI_HASH_SIZE];
+  if (checkpoint_mac(key, key_len, record, mac) != 0 ||
+      memcmp(mac, record + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE) != 0) {
+    return 0;
+  }
+  uint64_t verified = decode_u64_be(record + 8);
+  if (verified == 0 || verified > reader->block_count) {
+    return 0;
+  }
+  unsigned char hash[KOLIBRI_HASH_SIZE];
+  if (reader_block_hash(reader, verified - 1, hash) != 0 ||
+      memcmp(hash, record + 16, KOLIBRI_HASH_SIZE) != 0) {
+    return 0;
+  }
+  return verified;
+}
+
+static void checkpoint_store(const char *path,
+                             const KolibriGenomeReader *reader,
+                             const unsigned char *key, size_t key_len) {
+  unsigned char record[KOLIBRI_CHECKPOINT_SIZE];
+  memcpy(record, KOLIBRI_CHECKPOINT_MAGIC, 8);
+  encode_u64_be(reader->block_count, record + 8);
+  if (reader_block_hash(reader, reader->block_count - 1, record + 16) != 0 ||
+      checkpoint_mac(key, key_len, record, record + 16 + KOLIBRI_HASH_SIZE) !=
+          0) {
+    return;
+  }
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *file = fopen(tmp, "wb");
+  if (!file) {
+    return;
+  }
+  int ok = fwrite(record, 1, sizeof(record), file) == sizeof(record);
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    remove(tmp);
+  }
+}
+
+static int verify_reader(const KolibriGenomeReader *reader,
+                         const VerifyChain *chain,
+                         const KolibriGenomeVerifyOptions *options) {
+  if (reader_is_torn(reader)) {
+    return -1;
+  }
+  const char *checkpoint = options ? options->checkpoint_path : NULL;
+  uint64_t start = 0;
+  if (checkpoint && reader->block_count > 0) {
+    start = checkpoint_load(checkpoint, reader, chain->key, chain->key_len);
+  }
+  if (start < reader->block_count &&
+      verify_blocks(reader, start, chain, options ? options->threads : 0) !=
+          0) {
+    return -1;
+  }
+  if (checkpoint && reader->block_count > start) {
+    checkpoint_store(checkpoint, reader, chain->key, chain->key_len);
+  }
+  return 0;
+}
+
+/* Takes the format and chain tail of a verified active file. */
+static int adopt_reader(KolibriGenome *ctx, const KolibriGenomeReader *reader) {
+  if (reader->size > 0) {
+    ctx->format = reader->format;
+  }
+  if (reader->block_count == 0) {
+    return 0;
+  }
+  const unsigned char *last =
+      reader_canonical(reader, reader->block_count - 1, ctx->last_block);
+  if (!last) {
+    return -1;
+  }
+  if (last != ctx->last_block) {
+    memcpy(ctx->last_block, last, KOLIBRI_BLOCK_SIZE);
+  }
+  memcpy(ctx->last_hash, last + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE);
+  ctx->has_last_block = 1;
+  return SHA256(ctx->last_block, KOLIBRI_BLOCK_SIZE, ctx->chain_hash) ? 0 : -1;
+}
+
 int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
             size_t key_len) {
+  return kg_open_ex(ctx, path, key, key_len, NULL);
+}
+
+int kg_open_ex(KolibriGenome *ctx, const char *path, const unsigned char *key,
+               size_t key_len, const KolibriGenomeVerifyOptions *options) {
   if (!ctx || !path || !key || key_len == 0 ||
       key_len > sizeof(ctx->hmac_key)) {
     return -1;
@@ -183,40 +656,25 @@ int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
   memcpy(ctx->hmac_key, key, key_len);
   ctx->hmac_key_len = key_len;
 
-  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
-  memset(expected_prev, 0, sizeof(expected_prev));
-  uint64_t expected_index = 0;
-
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  size_t read = 0;
-  while ((read = fread(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file)) ==
-         KOLIBRI_BLOCK_SIZE) {
-    unsigned char block_hash[KOLIBRI_HASH_SIZE];
-    ReasonBlock block;
-    if (parse_and_verify_block(bytes, key, key_len, expected_index,
-                               expected_prev, &block, block_hash) != 0) {
-      kg_close(ctx);
-      return -1;
-    }
-
-    memcpy(ctx->last_hash, block.hmac, KOLIBRI_HASH_SIZE);
-    memcpy(ctx->last_block, bytes, KOLIBRI_BLOCK_SIZE);
-    ctx->has_last_block = 1;
-    memcpy(expected_prev, block_hash, KOLIBRI_HASH_SIZE);
-    expected_index = block.index + 1;
+  KolibriGenomeReader reader;
+  if (kg_reader_open(&reader, path) != 0) {
+    kg_close(ctx);
+    return -1;
   }
-
-  if (read != 0) {
+  VerifyChain chain = {key, key_len, 0, NULL};
+  if (verify_reader(&reader, &chain, options) != 0) {
+    kg_reader_close(&reader);
     kg_close(ctx);
     return -1;
   }
-
-  if (ferror(ctx->file)) {
+  if (adopt_reader(ctx, &reader) != 0) {
+    kg_reader_close(&reader);
     kg_close(ctx);
     return -1;
   }
-
-  ctx->next_index = expected_index;
+  ctx->next_index = reader.block_count;
+  kg_reader_close(&reader);
+  ctx->last_sync_ns = current_time_ns();
 
   if (fseek(ctx->file, 0, SEEK_END) != 0) {
     kg_close(ctx);
@@ -231,6 +689,7 @@ void kg_close(KolibriGenome *ctx) {
     return;
   }
   if (ctx->file) {
+    (void)kg_sync(ctx);
     fclose(ctx->file);
     ctx->file = NULL;
   }
@@ -258,118 +717,935 @@ int kg_encode_payload(const char *utf8, char *out, size_t out_len) {
   return k_encode_text(utf8, out, out_len);
 }
 
+/* Fills block from the entry, chaining it to prev_hash (NULL for the first
+ * block of the genome). */
+static int build_block(const KolibriGenome *ctx, const KolibriGenomeEntry *entry,
+                       uint64_t index, uint64_t timestamp,
+                       const unsigned char *prev_hash, ReasonBlock *block) {
+  memset(block, 0, sizeof(*block));
+  block->index = index;
+  block->timestamp = timestamp;
+
+  if (prev_hash) {
+    memcpy(block->prev_hash, prev_hash, KOLIBRI_HASH_SIZE);
+  }
+
+  size_t event_len = strnlen(entry->event_type, KOLIBRI_EVENT_TYPE_SIZE);
+  memcpy(block->event_type, entry->event_type, event_len);
+  const char *digits = entry->payload ? entry->payload : "";
+  memcpy(block->payload, digits, strnlen(digits, KOLIBRI_PAYLOAD_SIZE));
+
+  unsigned char message[KOLIBRI_HMAC_INPUT_SIZE];
+  build_hmac_message(block, message);
+
+  unsigned int hmac_len = 0;
+  if (!HMAC(EVP_sha256(), ctx->hmac_key, (int)ctx->hmac_key_len, message,
+            sizeof(message), block->hmac, &hmac_len) ||
+      hmac_len != KOLIBRI_HASH_SIZE) {
+    return -1;
+  }
+  return 0;
+}
+
+static int entry_is_valid(const KolibriGenomeEntry *entry) {
+  if (!entry->event_type ||
+      strnlen(entry->event_type, KOLIBRI_EVENT_TYPE_SIZE) >=
+          KOLIBRI_EVENT_TYPE_SIZE) {
+    return 0;
+  }
+  /* payload_is_digits also rejects payloads without room for the NUL. */
+  return payload_is_digits(entry->payload ? entry->payload : "");
+}
+
+void kg_set_sync_policy(KolibriGenome *ctx,
+                        const KolibriGenomeSyncPolicy *policy) {
+  if (!ctx || !policy) {
+    return;
+  }
+  ctx->sync = *policy;
+}
+
+int kg_sync(KolibriGenome *ctx) {
+  if (!ctx || !ctx->file) {
+    return -1;
+  }
+  if (fflush(ctx->file) != 0) {
+    return -1;
+  }
+  int fd = fileno(ctx->file);
+  if (ctx->sync.mode == KG_SYNC_FSYNC && fsync(fd) != 0) {
+    return -1;
+  }
+  if (ctx->sync.mode == KG_SYNC_FDATASYNC) {
+#if defined(__APPLE__)
+    if (fsync(fd) != 0) {
+      return -1;
+    }
+#else
+    if (fdatasync(fd) != 0) {
+      return -1;
+    }
+#endif
+  }
+  ctx->unsynced_blocks = 0;
+  ctx->last_sync_ns = current_time_ns();
+  return 0;
+}
+
+int kg_set_format(KolibriGenome *ctx, int format) {
+  if (!ctx || !ctx->file || (format != KOLIBRI_GENOME_FORMAT_V1 &&
+                             format != KOLIBRI_GENOME_FORMAT_V2)) {
+    return -1;
+  }
+  if (format == ctx->format) {
+    return 0;
+  }
+  long empty = ctx->format == KOLIBRI_GENOME_FORMAT_V2
+                   ? (long)KOLIBRI_GENOME_V2_HEADER_SIZE
+                   : 0L;
+  if (fflush(ctx->file) != 0 || fseek(ctx->file, 0, SEEK_END) != 0 ||
+      ftell(ctx->file) != empty) {
+    return -1;
+  }
+  if (ftruncate(fileno(ctx->file), 0) != 0 || fseek(ctx->file, 0, SEEK_SET) != 0) {
+    return -1;
+  }
+  if (format == KOLIBRI_GENOME_FORMAT_V2 &&
+      (fwrite(KOLIBRI_GENOME_V2_MAGIC, 1, KOLIBRI_GENOME_V2_HEADER_SIZE,
+              ctx->file) != KOLIBRI_GENOME_V2_HEADER_SIZE ||
+       fflush(ctx->file) != 0)) {
+    return -1;
+  }
+  ctx->format = format;
+  return 0;
+}
+
+static int sync_if_due(KolibriGenome *ctx, size_t appended, uint64_t now) {
+  ctx->unsynced_blocks += appended;
+  int due = ctx->sync.every_blocks > 0 &&
+            ctx->unsynced_blocks >= ctx->sync.every_blocks;
+  if (!due && ctx->sync.every_ms > 0) {
+    due = now - ctx->last_sync_ns >= (uint64_t)ctx->sync.every_ms * 1000000ULL;
+  }
+  return due ? kg_sync(ctx) : 0;
+}
+
+static int segment_rotate(KolibriGenome *ctx, uint64_t new_first,
+                          const unsigned char *sealed_last_hash);
+
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEntry *entries,
+                    size_t count, ReasonBlock *out_blocks) {
+  KOLIBRI_TRACE_SCOPE("kg_append");
+  if (!ctx || !ctx->file || (!entries && count > 0)) {
+    return -1;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (!entry_is_valid(&entries[i])) {
+      return -1;
+    }
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  /* bytes holds the v1 layout the chain hashes; v2 appends pack it into
+   * records, which offsets delimit for writing. */
+  int packed = ctx->format == KOLIBRI_GENOME_FORMAT_V2;
+  unsigned char *bytes = (unsigned char *)malloc(count * KOLIBRI_BLOCK_SIZE);
+  unsigned char *records =
+      packed ? (unsigned char *)malloc(count * KOLIBRI_RECORD_MAX) : bytes;
+  size_t *offsets = (size_t *)malloc((count + 1) * sizeof(size_t));
+  if (!bytes || !records || !offsets) {
+    free(bytes);
+    if (packed) {
+      free(records);
+    }
+    free(offsets);
+    return -1;
+  }
+  offsets[0] = 0;
+  uint64_t now = current_time_ns();
+  unsigned char prev_hash[KOLIBRI_HASH_SIZE];
+  memcpy(prev_hash, ctx->chain_hash, KOLIBRI_HASH_SIZE);
+  int status = 0;
+  for (size_t i = 0; i < count; ++i) {
+    ReasonBlock block;
+    unsigned char *out = bytes + i * KOLIBRI_BLOCK_SIZE;
+    uint64_t index = ctx->next_index + i;
+    if (build_block(ctx, &entries[i], index, now, index > 0 ? prev_hash : NULL,
+                    &block) != 0) {
+      status = -1;
+      break;
+    }
+    serialize_block(&block, out);
+    if (!SHA256(out, KOLIBRI_BLOCK_SIZE, prev_hash)) {
+      status = -1;
+      break;
+    }
+    offsets[i + 1] = packed ? offsets[i] + encode_record(&block, records + offsets[i])
+                            : offsets[i] + KOLIBRI_BLOCK_SIZE;
+    if (out_blocks) {
+      out_blocks[i] = block;
+    }
+  }
+
+  /* A segmented genome seals the active file once it holds segment_blocks. */
+  size_t written = 0;
+  while (status == 0 && written < count) {
+    size_t chunk = count - written;
+    if (ctx->segment_blocks > 0) {
+      uint64_t active = ctx->next_index + written - ctx->segment_first;
+      if (active >= ctx->segment_blocks) {
+        unsigned char sealed[KOLIBRI_HASH_SIZE];
+        if (written == 0) {
+          memcpy(sealed, ctx->chain_hash, KOLIBRI_HASH_SIZE);
+        } else if (!SHA256(bytes + (written - 1) * KOLIBRI_BLOCK_SIZE,
+                           KOLIBRI_BLOCK_SIZE, sealed)) {
+          status = -1;
+          break;
+        }
+        if (segment_rotate(ctx, ctx->next_index + written, sealed) != 0) {
+          status = -1;
+          break;
+        }
+        active = 0;
+      }
+      if (chunk > ctx->segment_blocks - active) {
+        chunk = (size_t)(ctx->segment_blocks - active);
+      }
+    }
+    size_t length = offsets[written + chunk] - offsets[written];
+    if (fwrite(records + offsets[written], 1, length, ctx->file) != length) {
+      status = -1;
+      break;
+    }
+    written += chunk;
+  }
+  if (packed) {
+    free(records);
+  }
+  free(offsets);
+  if (status != 0) {
+    free(bytes);
+    return -1;
+  }
+
+  const unsigned char *last = bytes + (count - 1) * KOLIBRI_BLOCK_SIZE;
+  memcpy(ctx->last_hash, last + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE);
+  memcpy(ctx->last_block, last, KOLIBRI_BLOCK_SIZE);
+  memcpy(ctx->chain_hash, prev_hash, KOLIBRI_HASH_SIZE);
+  ctx->has_last_block = 1;
+  ctx->next_index += count;
+  free(bytes);
+
+  return sync_if_due(ctx, count, now);
+}
+
 int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload,
               ReasonBlock *out_block) {
-  if (!ctx || !ctx->file || !event_type) {
+  KolibriGenomeEntry entry = {event_type, payload};
+  return kg_append_batch(ctx, &entry, 1, out_block);
+}
+
+int kg_verify_file(const char *path, const unsigned char *key,
+                   size_t key_len) {
+  return kg_verify_file_ex(path, key, key_len, NULL);
+}
+
+int kg_verify_file_ex(const char *path, const unsigned char *key,
+                      size_t key_len, const KolibriGenomeVerifyOptions *options) {
+  if (!path || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
+    return -1;
+  }
+
+  KolibriGenomeReader reader;
+  int status = kg_reader_open(&reader, path);
+  if (status != 0) {
+    return status;
+  }
+  VerifyChain chain = {key, key_len, 0, NULL};
+  status = verify_reader(&reader, &chain, options);
+  kg_reader_close(&reader);
+  return status;
+}
+
+/* Segmented genomes. */
+
+#define KOLIBRI_MANIFEST_NAME "MANIFEST"
+#define KOLIBRI_MANIFEST_LINE 256
+
+static void hex_encode(const unsigned char *data, size_t len, char *out) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; ++i) {
+    out[i * 2] = digits[data[i] >> 4];
+    out[i * 2 + 1] = digits[data[i] & 0x0FU];
+  }
+  out[len * 2] = '\0';
+}
+
+static int hex_decode(const char *text, unsigned char *out, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    unsigned int byte = 0;
+    if (sscanf(text + i * 2, "%2x", &byte) != 1) {
+      return -1;
+    }
+    out[i] = (unsigned char)byte;
+  }
+  return text[len * 2] == '\0' ? 0 : -1;
+}
+
+static void segment_file_name(uint64_t first_index, char *out, size_t out_size) {
+  snprintf(out, out_size, "segment-%020llu.dat", (unsigned long long)first_index);
+}
+
+/* "<first> <count> <last hash> <file or ->", followed by its HMAC. */
+static int segment_line(const KolibriGenomeSegment *segment,
+                        const unsigned char *key, size_t key_len, char *out,
+                        size_t out_size) {
+  char hash_hex[KOLIBRI_HASH_SIZE * 2 + 1];
+  hex_encode(segment->last_hash, KOLIBRI_HASH_SIZE, hash_hex);
+  int body = snprintf(out, out_size, "%llu %llu %s %s",
+                      (unsigned long long)segment->first_index,
+                      (unsigned long long)segment->block_count, hash_hex,
+                      segment->file[0] ? segment->file : "-");
+  if (body < 0 || (size_t)body + KOLIBRI_HASH_SIZE * 2 + 3 > out_size) {
+    return -1;
+  }
+  unsigned char mac[KOLIBRI_HASH_SIZE];
+  unsigned int mac_len = 0;
+  if (!HMAC(EVP_sha256(), key, (int)key_len, (const unsigned char *)out,
+            (size_t)body, mac, &mac_len) ||
+      mac_len != KOLIBRI_HASH_SIZE) {
+    return -1;
+  }
+  char mac_hex[KOLIBRI_HASH_SIZE * 2 + 1];
+  hex_encode(mac, KOLIBRI_HASH_SIZE, mac_hex);
+  snprintf(out + body, out_size - (size_t)body, " %s\n", mac_hex);
+  return 0;
+}
+
+int kg_segments_load(const char *dir, const unsigned char *key, size_t key_len,
+                     KolibriGenomeSegment **out_segments, size_t *out_count) {
+  if (!dir || !key || !out_segments || !out_count) {
     return -1;
   }
+  *out_segments = NULL;
+  *out_count = 0;
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, KOLIBRI_MANIFEST_NAME);
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  size_t capacity = 0;
+  char line[KOLIBRI_MANIFEST_LINE];
+  int status = 0;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long long first = 0;
+    unsigned long long blocks = 0;
+    char hash_hex[KOLIBRI_HASH_SIZE * 2 + 2];
+    char name[KOLIBRI_SEGMENT_NAME_SIZE];
+    char mac_hex[KOLIBRI_HASH_SIZE * 2 + 2];
+    if (sscanf(line, "%llu %llu %65s %47s %65s", &first, &blocks, hash_hex,
+               name, mac_hex) != 5) {
+      status = -1;
+      break;
+    }
+    KolibriGenomeSegment segment;
+    memset(&segment, 0, sizeof(segment));
+    segment.first_index = first;
+    segment.block_count = blocks;
+    if (strcmp(name, "-") != 0) {
+      snprintf(segment.file, sizeof(segment.file), "%s", name);
+    }
+    char expected[KOLIBRI_MANIFEST_LINE];
+    if (hex_decode(hash_hex, segment.last_hash, KOLIBRI_HASH_SIZE) != 0 ||
+        segment_line(&segment, key, key_len, expected, sizeof(expected)) != 0 ||
+        strcmp(expected, line) != 0 || blocks == 0 ||
+        first != (count > 0 ? segments[count - 1].first_index +
+                                  segments[count - 1].block_count
+                            : 0)) {
+      status = -1;
+      break;
+    }
+    if (count == capacity) {
+      size_t new_cap = capacity ? capacity * 2 : 16;
+      KolibriGenomeSegment *grown = (KolibriGenomeSegment *)realloc(
+          segments, new_cap * sizeof(KolibriGenomeSegment));
+      if (!grown) {
+        status = -1;
+        break;
+      }
+      segments = grown;
+      capacity = new_cap;
+    }
+    segments[count++] = segment;
+  }
+  fclose(file);
+  if (status != 0) {
+    free(segments);
+    return -1;
+  }
+  *out_segments = segments;
+  *out_count = count;
+  return 0;
+}
 
-  const char *digits = payload ? payload : "";
-  if (!payload_is_digits(digits)) {
+static int manifest_append(const char *dir, const KolibriGenomeSegment *segment,
+                           const unsigned char *key, size_t key_len) {
+  char line[KOLIBRI_MANIFEST_LINE];
+  if (segment_line(segment, key, key_len, line, sizeof(line)) != 0) {
+    return -1;
+  }
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, KOLIBRI_MANIFEST_NAME);
+  FILE *file = fopen(path, "ab");
+  if (!file) {
     return -1;
   }
+  int ok = fputs(line, file) >= 0;
+  ok = fflush(file) == 0 && ok;
+  ok = fsync(fileno(file)) == 0 && ok;
+  ok = fclose(file) == 0 && ok;
+  return ok ? 0 : -1;
+}
 
-  size_t event_len = strnlen(event_type, KOLIBRI_EVENT_TYPE_SIZE);
-  if (event_len >= KOLIBRI_EVENT_TYPE_SIZE) {
+static int segment_rotate(KolibriGenome *ctx, uint64_t new_first,
+                          const unsigned char *sealed_last_hash) {
+  if (kg_sync(ctx) != 0) {
+    return -1;
+  }
+  KolibriGenomeSegment sealed;
+  memset(&sealed, 0, sizeof(sealed));
+  sealed.first_index = ctx->segment_first;
+  sealed.block_count = new_first - ctx->segment_first;
+  memcpy(sealed.last_hash, sealed_last_hash, KOLIBRI_HASH_SIZE);
+  segment_file_name(ctx->segment_first, sealed.file, sizeof(sealed.file));
+  if (manifest_append(ctx->path, &sealed, ctx->hmac_key, ctx->hmac_key_len) !=
+      0) {
+    return -1;
+  }
+  char name[KOLIBRI_SEGMENT_NAME_SIZE];
+  char path[4096];
+  segment_file_name(new_first, name, sizeof(name));
+  snprintf(path, sizeof(path), "%s/%s", ctx->path, name);
+  FILE *next = fopen(path, "w+b");
+  if (!next) {
     return -1;
   }
+  if (ctx->format == KOLIBRI_GENOME_FORMAT_V2 &&
+      fwrite(KOLIBRI_GENOME_V2_MAGIC, 1, KOLIBRI_GENOME_V2_HEADER_SIZE, next) !=
+          KOLIBRI_GENOME_V2_HEADER_SIZE) {
+    fclose(next);
+    return -1;
+  }
+  fclose(ctx->file);
+  ctx->file = next;
+  ctx->segment_first = new_first;
+  return 0;
+}
 
-  ReasonBlock block;
-  memset(&block, 0, sizeof(block));
+int kg_open_segmented(KolibriGenome *ctx, const char *dir,
+                      const unsigned char *key, size_t key_len,
+                      uint64_t segment_blocks) {
+  if (!ctx || !dir || !key || key_len == 0 ||
+      key_len > sizeof(ctx->hmac_key) || segment_blocks == 0 ||
+      strlen(dir) >= sizeof(ctx->path)) {
+    return -1;
+  }
+  reset_context(ctx);
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    return -1;
+  }
 
-  block.index = ctx->next_index;
-  block.timestamp = current_time_ns();
+  KolibriGenomeSegment *segments = NULL;
+  size_t segment_count = 0;
+  if (kg_segments_load(dir, key, key_len, &segments, &segment_count) != 0) {
+    return -1;
+  }
+  uint64_t first = 0;
+  unsigned char prev[KOLIBRI_HASH_SIZE];
+  if (segment_count > 0) {
+    const KolibriGenomeSegment *last = &segments[segment_count - 1];
+    first = last->first_index + last->block_count;
+    memcpy(prev, last->last_hash, KOLIBRI_HASH_SIZE);
+  }
+  free(segments);
 
-  if (ctx->has_last_block) {
-    if (!SHA256(ctx->last_block, KOLIBRI_BLOCK_SIZE, block.prev_hash)) {
+  char name[KOLIBRI_SEGMENT_NAME_SIZE];
+  char path[4096];
+  segment_file_name(first, name, sizeof(name));
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *file = fopen(path, "r+b");
+  if (!file) {
+    file = fopen(path, "w+b");
+    if (!file) {
       return -1;
     }
-  } else {
-    memset(block.prev_hash, 0, KOLIBRI_HASH_SIZE);
   }
+  ctx->file = file;
+  snprintf(ctx->path, sizeof(ctx->path), "%s", dir);
+  memcpy(ctx->hmac_key, key, key_len);
+  ctx->hmac_key_len = key_len;
+  ctx->segment_blocks = segment_blocks;
+  ctx->segment_first = first;
 
-  memcpy(block.event_type, event_type, event_len);
-  size_t payload_len = strnlen(digits, KOLIBRI_PAYLOAD_SIZE);
-  if (payload_len >= KOLIBRI_PAYLOAD_SIZE) {
+  KolibriGenomeReader reader;
+  if (kg_reader_open(&reader, path) != 0) {
+    kg_close(ctx);
     return -1;
   }
-  memcpy(block.payload, digits, payload_len);
-
-  unsigned char message[KOLIBRI_HMAC_INPUT_SIZE];
-  build_hmac_message(&block, message);
+  VerifyChain chain = {key, key_len, first, first > 0 ? prev : NULL};
+  if (verify_reader(&reader, &chain, NULL) != 0) {
+    kg_reader_close(&reader);
+    kg_close(ctx);
+    return -1;
+  }
+  if (reader.block_count == 0 && first > 0) {
+    memcpy(ctx->chain_hash, prev, KOLIBRI_HASH_SIZE);
+  }
+  if (adopt_reader(ctx, &reader) != 0) {
+    kg_reader_close(&reader);
+    kg_close(ctx);
+    return -1;
+  }
+  ctx->next_index = first + reader.block_count;
+  kg_reader_close(&reader);
+  ctx->last_sync_ns = current_time_ns();
 
-  unsigned int hmac_len = 0;
-  if (!HMAC(EVP_sha256(), ctx->hmac_key, (int)ctx->hmac_key_len, message,
-            sizeof(message), block.hmac, &hmac_len) ||
-      hmac_len != KOLIBRI_HASH_SIZE) {
+  if (fseek(ctx->file, 0, SEEK_END) != 0) {
+    kg_close(ctx);
     return -1;
   }
+  return 0;
+}
 
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  serialize_block(&block, bytes);
+/* Verifies one segment file in place in the chain; expected_count 0 accepts
+ * any length (the active segment). */
+static int verify_segment_file(const char *dir, const char *name,
+                               uint64_t first, const unsigned char *prev,
+                               uint64_t expected_count,
+                               const unsigned char *expected_last_hash,
+                               const unsigned char *key, size_t key_len,
+                               const KolibriGenomeVerifyOptions *options) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  KolibriGenomeReader reader;
+  int status = kg_reader_open(&reader, path);
+  if (status != 0) {
+    return expected_count == 0 && status == 1 ? 0 : -1;
+  }
+  KolibriGenomeVerifyOptions threads_only = {options ? options->threads : 0,
+                                             NULL};
+  VerifyChain chain = {key, key_len, first, first > 0 ? prev : NULL};
+  status = verify_reader(&reader, &chain, &threads_only);
+  if (status == 0 && expected_count > 0) {
+    unsigned char hash[KOLIBRI_HASH_SIZE];
+    if (reader.block_count != expected_count ||
+        reader_block_hash(&reader, expected_count - 1, hash) != 0 ||
+        memcmp(hash, expected_last_hash, KOLIBRI_HASH_SIZE) != 0) {
+      status = -1;
+    }
+  }
+  kg_reader_close(&reader);
+  return status;
+}
 
-  if (fwrite(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file) != KOLIBRI_BLOCK_SIZE) {
+int kg_verify_segmented(const char *dir, const unsigned char *key,
+                        size_t key_len,
+                        const KolibriGenomeVerifyOptions *options) {
+  if (!dir || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
     return -1;
   }
+  struct stat st;
+  if (stat(dir, &st) != 0) {
+    return errno == ENOENT ? 1 : -1;
+  }
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  if (kg_segments_load(dir, key, key_len, &segments, &count) != 0) {
+    return -1;
+  }
+  int status = 0;
+  const unsigned char *prev = NULL;
+  for (size_t i = 0; i < count && status == 0; ++i) {
+    const KolibriGenomeSegment *segment = &segments[i];
+    if (segment->file[0]) {
+      status = verify_segment_file(dir, segment->file, segment->first_index,
+                                   prev, segment->block_count,
+                                   segment->last_hash, key, key_len, options);
+    }
+    prev = segment->last_hash;
+  }
+  if (status == 0) {
+    uint64_t first = count > 0 ? segments[count - 1].first_index +
+                                     segments[count - 1].block_count
+                               : 0;
+    char name[KOLIBRI_SEGMENT_NAME_SIZE];
+    segment_file_name(first, name, sizeof(name));
+    status = verify_segment_file(dir, name, first, prev, 0, NULL, key, key_len,
+                                 options);
+  }
+  free(segments);
+  return status;
+}
 
-  if (fflush(ctx->file) != 0) {
+int kg_compact(const char *dir, const unsigned char *key, size_t key_len,
+               size_t keep_segments) {
+  if (!dir || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
     return -1;
   }
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  if (kg_segments_load(dir, key, key_len, &segments, &count) != 0) {
+    return -1;
+  }
+  /* A previous summary, if any, is the first entry and absorbs the rest. */
+  size_t fold = count > keep_segments ? count - keep_segments : 0;
+  size_t folded_files = 0;
+  for (size_t i = 0; i < fold; ++i) {
+    folded_files += segments[i].file[0] ? 1 : 0;
+  }
+  if (folded_files == 0) {
+    free(segments);
+    return 0;
+  }
+  KolibriGenomeSegment summary;
+  memset(&summary, 0, sizeof(summary));
+  summary.first_index = segments[0].first_index;
+  summary.block_count = segments[fold - 1].first_index +
+                        segments[fold - 1].block_count - summary.first_index;
+  memcpy(summary.last_hash, segments[fold - 1].last_hash, KOLIBRI_HASH_SIZE);
 
-  memcpy(ctx->last_hash, block.hmac, KOLIBRI_HASH_SIZE);
-  memcpy(ctx->last_block, bytes, KOLIBRI_BLOCK_SIZE);
-  ctx->has_last_block = 1;
-  ctx->next_index = block.index + 1;
+  char path[4096];
+  char tmp[4096];
+  int path_len = snprintf(path, sizeof(path), "%s/%s", dir, KOLIBRI_MANIFEST_NAME);
+  int tmp_len = snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  /* A truncated name could replace some other file. */
+  if (path_len < 0 || (size_t)path_len >= sizeof(path) || tmp_len < 0 ||
+      (size_t)tmp_len >= sizeof(tmp)) {
+    free(segments);
+    return -1;
+  }
+  FILE *file = fopen(tmp, "wb");
+  int ok = file != NULL;
+  char line[KOLIBRI_MANIFEST_LINE];
+  for (size_t i = fold - 1; ok && i < count; ++i) {
+    const KolibriGenomeSegment *entry = i == fold - 1 ? &summary : &segments[i];
+    ok = segment_line(entry, key, key_len, line, sizeof(line)) == 0 &&
+         fputs(line, file) >= 0;
+  }
+  if (file) {
+    ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+  }
+  if (!ok || rename(tmp, path) != 0) {
+    remove(tmp);
+    free(segments);
+    return -1;
+  }
+  for (size_t i = 0; i < fold; ++i) {
+    if (segments[i].file[0]) {
+      snprintf(path, sizeof(path), "%s/%s", dir, segments[i].file);
+      remove(path);
+    }
+  }
+  free(segments);
+  return (int)folded_files;
+}
 
-  if (out_block) {
-    *out_block = block;
+/* Tail-follow. */
+
+#define KOLIBRI_FOLLOW_POLL_MS 50
+
+static void follow_reset_file(KolibriGenomeFollower *follower) {
+  if (follower->file) {
+    fclose(follower->file);
+    follower->file = NULL;
   }
+  follower->format = 0;
+  follower->offset = 0;
+}
 
+/* Finds the segment holding start_index and the hash it links to. */
+static int follow_locate_segment(KolibriGenomeFollower *follower) {
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  if (kg_segments_load(follower->path, follower->key, follower->key_len,
+                       &segments, &count) != 0) {
+    return -1;
+  }
+  memset(follower->prev_hash, 0, KOLIBRI_HASH_SIZE);
+  follower->segment_first = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t end = segments[i].first_index + segments[i].block_count;
+    if (follower->start_index >= end || !segments[i].file[0]) {
+      /* Folded blocks cannot be replayed; resume right after them. */
+      if (follower->start_index < end) {
+        follower->start_index = end;
+      }
+      follower->segment_first = end;
+      memcpy(follower->prev_hash, segments[i].last_hash, KOLIBRI_HASH_SIZE);
+      continue;
+    }
+    break;
+  }
+  follower->next_index = follower->segment_first;
+  free(segments);
   return 0;
 }
 
-int kg_verify_file(const char *path, const unsigned char *key,
-                   size_t key_len) {
-  if (!path || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
+/* Moves to the next segment once the active one is sealed and fully read:
+ * 1 when it moved, 0 when the active segment is still open, -1 on error. */
+static int follow_next_segment(KolibriGenomeFollower *follower) {
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  if (kg_segments_load(follower->path, follower->key, follower->key_len,
+                       &segments, &count) != 0) {
     return -1;
   }
+  int status = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (segments[i].first_index != follower->segment_first) {
+      continue;
+    }
+    uint64_t end = segments[i].first_index + segments[i].block_count;
+    if (!segments[i].file[0] || follower->next_index != end) {
+      status = -1;
+    } else if (follower->next_index <= follower->start_index) {
+      memcpy(follower->prev_hash, segments[i].last_hash, KOLIBRI_HASH_SIZE);
+      status = 1;
+    } else {
+      status = memcmp(follower->prev_hash, segments[i].last_hash,
+                      KOLIBRI_HASH_SIZE) == 0
+                   ? 1
+                   : -1;
+    }
+    if (status == 1) {
+      follower->segment_first = end;
+      follow_reset_file(follower);
+    }
+    break;
+  }
+  free(segments);
+  return status;
+}
 
-  FILE *file = fopen(path, "rb");
-  if (!file) {
-    if (errno == ENOENT) {
+/* Reads the record at offset into v1 layout: 0 with a block, 1 when it is
+ * not (fully) written yet, -1 when it is malformed. */
+static int follow_read(KolibriGenomeFollower *follower, unsigned char *bytes,
+                       size_t *consumed) {
+  FILE *file = follower->file;
+  clearerr(file);
+  if (fseeko(file, (off_t)follower->offset, SEEK_SET) != 0) {
+    return -1;
+  }
+  if (follower->format == KOLIBRI_GENOME_FORMAT_V1) {
+    if (fread(bytes, 1, KOLIBRI_BLOCK_SIZE, file) != KOLIBRI_BLOCK_SIZE) {
       return 1;
     }
+    *consumed = KOLIBRI_BLOCK_SIZE;
+    return 0;
+  }
+  unsigned char record[KOLIBRI_RECORD_MAX];
+  if (fread(record, 1, 2, file) != 2) {
+    return 1;
+  }
+  size_t body = ((size_t)record[0] << 8) | record[1];
+  if (body < KOLIBRI_RECORD_MIN_BODY || body > KOLIBRI_RECORD_MAX - 2) {
     return -1;
   }
+  if (fread(record + 2, 1, body, file) != body) {
+    return 1;
+  }
+  ReasonBlock block;
+  if (decode_record(record, body + 2, &block) != 0) {
+    return -1;
+  }
+  serialize_block(&block, bytes);
+  *consumed = body + 2;
+  return 0;
+}
 
-  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
-  memset(expected_prev, 0, sizeof(expected_prev));
-  uint64_t expected_index = 0;
-
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  size_t read = 0;
-  while ((read = fread(bytes, 1, KOLIBRI_BLOCK_SIZE, file)) ==
-         KOLIBRI_BLOCK_SIZE) {
-    unsigned char block_hash[KOLIBRI_HASH_SIZE];
-    if (parse_and_verify_block(bytes, key, key_len, expected_index,
-                               expected_prev, NULL, block_hash) != 0) {
-      fclose(file);
+/* Opens the active file and reads its format: 1 when ready, 0 otherwise. */
+static int follow_prepare_file(KolibriGenomeFollower *follower) {
+  if (!follower->file) {
+    char path[4096];
+    if (follower->segmented) {
+      char name[KOLIBRI_SEGMENT_NAME_SIZE];
+      segment_file_name(follower->segment_first, name, sizeof(name));
+      snprintf(path, sizeof(path), "%s/%s", follower->path, name);
+    } else {
+      snprintf(path, sizeof(path), "%s", follower->path);
+    }
+    follower->file = fopen(path, "rb");
+    if (!follower->file) {
+      return 0;
+    }
+  }
+  if (follower->format != 0) {
+    return 1;
+  }
+  unsigned char header[KOLIBRI_GENOME_V2_HEADER_SIZE];
+  clearerr(follower->file);
+  if (fseeko(follower->file, 0, SEEK_SET) != 0 ||
+      fread(header, 1, sizeof(header), follower->file) != sizeof(header)) {
+    return 0;
+  }
+  if (memcmp(header, KOLIBRI_GENOME_V2_MAGIC, sizeof(header)) == 0) {
+    follower->format = KOLIBRI_GENOME_FORMAT_V2;
+    follower->offset = KOLIBRI_GENOME_V2_HEADER_SIZE;
+  } else {
+    follower->format = KOLIBRI_GENOME_FORMAT_V1;
+    follower->offset = 0;
+  }
+  return 1;
+}
+
+/* 0 with a verified block, 1 when nothing new is readable, -1 on error. */
+static int follow_step(KolibriGenomeFollower *follower, ReasonBlock *out_block) {
+  for (;;) {
+    if (!follow_prepare_file(follower)) {
+      return 1;
+    }
+    /* v1 blocks are fixed-size, so skipping lands on the last skipped one. */
+    if (follower->format == KOLIBRI_GENOME_FORMAT_V1 &&
+        follower->next_index + 1 < follower->start_index) {
+      follower->next_index = follower->start_index - 1;
+      follower->offset =
+          (follower->next_index - follower->segment_first) * KOLIBRI_BLOCK_SIZE;
+    }
+    unsigned char bytes[KOLIBRI_BLOCK_SIZE];
+    size_t consumed = 0;
+    int rc = follow_read(follower, bytes, &consumed);
+    if (rc < 0) {
       return -1;
     }
-    memcpy(expected_prev, block_hash, KOLIBRI_HASH_SIZE);
-    expected_index += 1;
+    if (rc > 0) {
+      if (!follower->segmented) {
+        return 1;
+      }
+      rc = follow_next_segment(follower);
+      if (rc <= 0) {
+        return rc < 0 ? -1 : 1;
+      }
+      continue;
+    }
+    if (follower->next_index < follower->start_index) {
+      if (!SHA256(bytes, KOLIBRI_BLOCK_SIZE, follower->prev_hash)) {
+        return -1;
+      }
+    } else if (parse_and_verify_block(bytes, follower->key, follower->key_len,
+                                      follower->next_index, follower->prev_hash,
+                                      out_block, follower->prev_hash) != 0) {
+      return -1;
+    }
+    follower->offset += consumed;
+    follower->next_index += 1;
+    if (follower->next_index > follower->start_index) {
+      return 0;
+    }
   }
+}
 
-  if (read != 0) {
-    fclose(file);
-    return -1;
+static void follow_wait(KolibriGenomeFollower *follower, int timeout_ms) {
+#if defined(__linux__)
+  if (follower->notify_fd >= 0) {
+    struct pollfd pfd = {follower->notify_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+      char events[4096];
+      while (read(follower->notify_fd, events, sizeof(events)) > 0) {
+      }
+    }
+    return;
+  }
+#endif
+  if (timeout_ms < 0 || timeout_ms > KOLIBRI_FOLLOW_POLL_MS) {
+    timeout_ms = KOLIBRI_FOLLOW_POLL_MS;
   }
+  struct timespec delay = {0, (long)timeout_ms * 1000000L};
+  nanosleep(&delay, NULL);
+}
 
-  if (ferror(file)) {
-    fclose(file);
+int kg_follow_open(KolibriGenomeFollower *follower, const char *path,
+                   const unsigned char *key, size_t key_len,
+                   uint64_t start_index) {
+  if (!follower || !path || !key || key_len == 0 ||
+      key_len > KOLIBRI_HMAC_KEY_SIZE ||
+      strlen(path) >= sizeof(follower->path)) {
+    return -1;
+  }
+  memset(follower, 0, sizeof(*follower));
+  follower->notify_fd = -1;
+  snprintf(follower->path, sizeof(follower->path), "%s", path);
+  memcpy(follower->key, key, key_len);
+  follower->key_len = key_len;
+  follower->start_index = start_index;
+  struct stat st;
+  follower->segmented = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+  if (follower->segmented && follow_locate_segment(follower) != 0) {
     return -1;
   }
 
-  fclose(file);
+#if defined(__linux__)
+  /* Watching the directory also catches files created after this call. */
+  char dir[sizeof(follower->path)];
+  snprintf(dir, sizeof(dir), "%s", path);
+  if (!follower->segmented) {
+    char *slash = strrchr(dir, '/');
+    if (slash == dir) {
+      slash[1] = '\0';
+    } else if (slash) {
+      *slash = '\0';
+    } else {
+      snprintf(dir, sizeof(dir), ".");
+    }
+  }
+  follower->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (follower->notify_fd >= 0 &&
+      inotify_add_watch(follower->notify_fd, dir,
+                        IN_MODIFY | IN_CREATE | IN_MOVED_TO) < 0) {
+    close(follower->notify_fd);
+    follower->notify_fd = -1;
+  }
+#endif
   return 0;
 }
+
+int kg_follow(KolibriGenomeFollower *follower, ReasonBlock *out_block,
+              int timeout_ms) {
+  if (!follower || !out_block) {
+    return -1;
+  }
+  uint64_t deadline =
+      current_time_ns() + (uint64_t)(timeout_ms > 0 ? timeout_ms : 0) * 1000000ULL;
+  for (;;) {
+    int rc = follow_step(follower, out_block);
+    if (rc != 1) {
+      return rc;
+    }
+    int remaining = -1;
+    if (timeout_ms >= 0) {
+      uint64_t now = current_time_ns();
+      if (now >= deadline) {
+        return 1;
+      }
+      remaining = (int)((deadline - now + 999999ULL) / 1000000ULL);
+    }
+    follow_wait(follower, remaining);
+  }
+}
+
+void kg_follow_close(KolibriGenomeFollower *follower) {
+  if (!follower) {
+    return;
+  }
+  follow_reset_file(follower);
+  if (follower->notify_fd >= 0) {
+    close(follower->notify_fd);
+  }
+  memset(follower, 0, sizeof(*follower));
+  follower->notify_fd = -1;
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/island.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KOLIBRI_MIGRATION_INTERVAL_DEFAULT 8U
+#define KOLIBRI_MIGRATION_MIGRANTS_DEFAULT 2U
+
+void kf_migration_policy_default(KolibriMigrationPolicy *policy) {
+    if (!policy) {
+        return;
+    }
+    policy->topology = KOLIBRI_MIGRATION_RING;
+    policy->interval = KOLIBRI_MIGRATION_INTERVAL_DEFAULT;
+    policy->migrants = KOLIBRI_MIGRATION_MIGRANTS_DEFAULT;
+}
+
+int kf_migration_topology_parse(const char *text, KolibriMigrationTopology *out) {
+    if (!text || !out) {
+        return -1;
+    }
+    if (strcmp(text, "ring") == 0) {
+        *out = KOLIBRI_MIGRATION_RING;
+    } else if (strcmp(text, "random") == 0) {
+        *out = KOLIBRI_MIGRATION_RANDOM;
+    } else if (strcmp(text, "full") == 0) {
+        *out = KOLIBRI_MIGRATION_FULL;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+size_t kf_migration_targets(const KolibriMigrationPolicy *policy, size_t source,
+                            size_t member_count, uint64_t random,
+                            size_t *targets, size_t max_targets) {
+    if (!policy || !targets || max_targets == 0 || member_count < 2 || source >= member_count) {
+        return 0;
+    }
+    switch (policy->topology) {
+    case KOLIBRI_MIGRATION_RANDOM: {
+        size_t pick = (size_t)(random % (member_count - 1U));
+        targets[0] = pick >= source ? pick + 1U : pick;
+        return 1;
+    }
+    case KOLIBRI_MIGRATION_FULL: {
+        size_t written = 0;
+        for (size_t i = 1; i < member_count && written < max_targets; ++i) {
+            targets[written++] = (source + i) % member_count;
+        }
+        return written;
+    }
+    case KOLIBRI_MIGRATION_RING:
+    default:
+        targets[0] = (source + 1U) % member_count;
+        return 1;
+    }
+}
+
+/* Guests follow the home island's dataset and sampling settings. */
+static void island_sync(KolibriFormulaPool *guest, const KolibriFormulaPool *home) {
+    size_t examples = home->examples < guest->example_capacity ? home->examples
+                                                               : guest->example_capacity;
+    /* Rewriting an unchanged dataset would needlessly empty the fitness cache. */
+    if (guest->examples != examples ||
+        memcmp(guest->inputs, home->inputs, examples * sizeof(int)) != 0 ||
+        memcmp(guest->targets, home->targets, examples * sizeof(int)) != 0) {
+        memcpy(guest->inputs, home->inputs, examples * sizeof(int));
+        memcpy(guest->targets, home->targets, examples * sizeof(int));
+        guest->examples = examples;
+        guest->input_peak = home->input_peak;
+        kf_pool_invalidate_cache(guest);
+    }
+    guest->lambda_b = home->lambda_b;
+    guest->lambda_d = home->lambda_d;
+    kf_pool_set_targets(guest, home->use_custom_target_b ? home->target_b : NAN,
+                        home->use_custom_target_d ? home->target_d : NAN);
+    guest->coherence_gain = home->coherence_gain;
+    guest->temperature = home->temperature;
+    guest->top_k = home->top_k < guest->count ? home->top_k : guest->count;
+}
+
+int kf_archipelago_init(KolibriArchipelago *archipelago, KolibriFormulaPool *home,
+                        size_t count, const KolibriMigrationPolicy *policy, uint64_t seed) {
+    if (!archipelago || !home || count == 0 || count > KOLIBRI_ARCHIPELAGO_MAX_ISLANDS) {
+        return -1;
+    }
+    memset(archipelago, 0, sizeof(*archipelago));
+    if (policy) {
+        archipelago->policy = *policy;
+    } else {
+        kf_migration_policy_default(&archipelago->policy);
+    }
+    if (archipelago->policy.interval == 0) {
+        archipelago->policy.interval = 1;
+    }
+    if (archipelago->policy.migrants > KOLIBRI_MIGRATION_MAX_MIGRANTS) {
+        archipelago->policy.migrants = KOLIBRI_MIGRATION_MAX_MIGRANTS;
+    }
+    k_rng_seed(&archipelago->rng, seed);
+    archipelago->islands[0] = home;
+    archipelago->count = 1;
+    /* Associations stay on the home island, guests only hold a token table. */
+    KolibriPoolConfig config = {home->count, home->example_capacity, 1U, 0U};
+    for (size_t i = 1; i < count; ++i) {
+        config.seed = k_rng_next(&archipelago->rng);
+        KolibriFormulaPool *guest = kf_pool_create(&config);
+        if (!guest) {
+            kf_archipelago_free(archipelago);
+            return -1;
+        }
+        archipelago->islands[archipelago->count++] = guest;
+    }
+    return 0;
+}
+
+void kf_archipelago_free(KolibriArchipelago *archipelago) {
+    if (!archipelago) {
+        return;
+    }
+    for (size_t i = 1; i < archipelago->count; ++i) {
+        kf_pool_destroy(archipelago->islands[i]);
+        archipelago->islands[i] = NULL;
+    }
+    archipelago->count = archipelago->count > 0 ? 1 : 0;
+}
+
+typedef struct {
+    KolibriFormulaPool *pool;
+    size_t generations;
+} KolibriIslandRun;
+
+static void *island_run_main(void *arg) {
+    KolibriIslandRun *run = (KolibriIslandRun *)arg;
+    kf_pool_tick(run->pool, run->generations);
+    return NULL;
+}
+
+static void archipelago_evolve(KolibriArchipelago *archipelago, size_t generations) {
+    KolibriIslandRun runs[KOLIBRI_ARCHIPELAGO_MAX_ISLANDS];
+    pthread_t workers[KOLIBRI_ARCHIPELAGO_MAX_ISLANDS];
+    int started[KOLIBRI_ARCHIPELAGO_MAX_ISLANDS];
+    for (size_t i = 0; i < archipelago->count; ++i) {
+        runs[i].pool = archipelago->islands[i];
+        runs[i].generations = generations;
+    }
+    for (size_t i = 1; i < archipelago->count; ++i) {
+        started[i] = pthread_create(&workers[i], NULL, island_run_main, &runs[i]) == 0;
+        if (!started[i]) {
+            island_run_main(&runs[i]);
+        }
+    }
+    island_run_main(&runs[0]);
+    for (size_t i = 1; i < archipelago->count; ++i) {
+        if (started[i]) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+}
+
+/* Migrants are taken from every island before any arrive, so the order of
+ * the islands does not matter. */
+static void archipelago_migrate(KolibriArchipelago *archipelago) {
+    if (archipelago->count < 2 || archipelago->islands[0]->count < 2) {
+        return;
+    }
+    size_t migrants = archipelago->policy.migrants;
+    if (migrants >= archipelago->islands[0]->count) {
+        migrants = archipelago->islands[0]->count - 1U;
+    }
+    if (migrants == 0) {
+        return;
+    }
+    KolibriFormula *outgoing = malloc(archipelago->count * migrants * sizeof(KolibriFormula));
+    if (!outgoing) {
+        return;
+    }
+    for (size_t i = 0; i < archipelago->count; ++i) {
+        memcpy(&outgoing[i * migrants], archipelago->islands[i]->formulas,
+               migrants * sizeof(KolibriFormula));
+    }
+    size_t targets[KOLIBRI_ARCHIPELAGO_MAX_ISLANDS];
+    for (size_t i = 0; i < archipelago->count; ++i) {
+        size_t count = kf_migration_targets(&archipelago->policy, i, archipelago->count,
+                                            k_rng_next(&archipelago->rng), targets,
+                                            KOLIBRI_ARCHIPELAGO_MAX_ISLANDS);
+        for (size_t t = 0; t < count; ++t) {
+            kf_pool_immigrate(archipelago->islands[targets[t]], &outgoing[i * migrants],
+                              migrants);
+        }
+    }
+    free(outgoing);
+    archipelago->migrations++;
+}
+
+void kf_archipelago_tick(KolibriArchipelago *archipelago, size_t generations) {
+    if (!archipelago || archipelago->count == 0) {
+        return;
+    }
+    if (generations == 0) {
+        generations = 1;
+    }
+    const KolibriFormulaPool *home = archipelago->islands[0];
+    for (size_t i = 1; i < archipelago->count; ++i) {
+        island_sync(archipelago->islands[i], home);
+    }
+    while (generations > 0) {
+        size_t step = archipelago->policy.interval - archipelago->since_migration;
+        if (step > generations) {
+            step = generations;
+        }
+        archipelago_evolve(archipelago, step);
+        generations -= step;
+        archipelago->since_migration += step;
+        if (archipelago->since_migration >= archipelago->policy.interval) {
+            archipelago_migrate(archipelago);
+            archipelago->since_migration = 0;
+        }
+    }
+}
+
+const KolibriFormula *kf_archipelago_best(const KolibriArchipelago *archipelago) {
+    if (!archipelago || archipelago->count == 0) {
+        return NULL;
+    }
+    const KolibriFormula *best = kf_pool_best(archipelago->islands[0]);
+    for (size_t i = 1; i < archipelago->count; ++i) {
+        const KolibriFormula *candidate = kf_pool_best(archipelago->islands[i]);
+        if (candidate && (!best || candidate->fitness > best->fitness)) {
+            best = candidate;
+        }
+    }
+    return best;
+}
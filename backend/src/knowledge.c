@@ -3,11 +3,34 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+/* Query tokens are runs of ASCII letters and digits, so only grams made of
+ * those are indexed: g = c1 * 37^2 + c2 * 37 + c3 with codes 1..36 and 0
+ * padding the 1- and 2-character grams. */
+#define KOLIBRI_GRAM_BASE 37U
+#define KOLIBRI_GRAM_BUCKETS (KOLIBRI_GRAM_BASE * KOLIBRI_GRAM_BASE * KOLIBRI_GRAM_BASE)
+
+typedef struct {
+    size_t *offsets; /* KOLIBRI_GRAM_BUCKETS + 1 entries into docs */
+    uint32_t *docs;  /* ascending document indices per gram */
+    size_t covered;  /* documents [0, covered) are indexed */
+} KnowledgeGrams;
+
+#define KOLIBRI_STRING_CHUNK 65536U
+
+/* Bump arena for document strings: freeing the index releases whole chunks. */
+typedef struct KnowledgeChunk {
+    struct KnowledgeChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} KnowledgeChunk;
+
 static int ensure_capacity(KolibriKnowledgeIndex *index, size_t additional) {
     if (!index) {
         return -1;
@@ -37,64 +60,81 @@ int kolibri_knowledge_index_init(KolibriKnowledgeIndex *index) {
     index->documents = NULL;
     index->count = 0;
     index->capacity = 0;
+    index->grams = NULL;
+    index->strings = NULL;
     return 0;
 }
 
-static void free_document(KolibriKnowledgeDocument *doc) {
-    if (!doc) {
+static void grams_free(KnowledgeGrams *grams) {
+    if (!grams) {
         return;
     }
-    free(doc->id);
-    free(doc->title);
-    free(doc->content);
-    free(doc->content_lower);
-    free(doc->source);
-    doc->id = NULL;
-    doc->title = NULL;
-    doc->content = NULL;
-    doc->content_lower = NULL;
-    doc->source = NULL;
+    free(grams->offsets);
+    free(grams->docs);
+    free(grams);
+}
+
+static void strings_free(KnowledgeChunk *chunk) {
+    while (chunk) {
+        KnowledgeChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
 }
 
 void kolibri_knowledge_index_free(KolibriKnowledgeIndex *index) {
     if (!index) {
         return;
     }
-    for (size_t i = 0; i < index->count; ++i) {
-        free_document(&index->documents[i]);
-    }
     free(index->documents);
+    grams_free((KnowledgeGrams *)index->grams);
+    strings_free((KnowledgeChunk *)index->strings);
     index->documents = NULL;
     index->count = 0;
     index->capacity = 0;
+    index->grams = NULL;
+    index->strings = NULL;
 }
 
-static char *duplicate_string(const char *src) {
-    if (!src) {
-        return NULL;
-    }
-    size_t length = strlen(src);
-    char *copy = (char *)malloc(length + 1U);
-    if (!copy) {
-        return NULL;
+/* Returns length + 1 bytes with the terminator already in place. */
+static char *string_reserve(KolibriKnowledgeIndex *index, size_t length) {
+    KnowledgeChunk *chunk = (KnowledgeChunk *)index->strings;
+    if (!chunk || chunk->capacity - chunk->used < length + 1U) {
+        size_t capacity = length + 1U > KOLIBRI_STRING_CHUNK ? length + 1U : KOLIBRI_STRING_CHUNK;
+        chunk = (KnowledgeChunk *)malloc(sizeof(KnowledgeChunk) + capacity);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->used = 0U;
+        chunk->capacity = capacity;
+        chunk->next = (KnowledgeChunk *)index->strings;
+        index->strings = chunk;
     }
-    memcpy(copy, src, length + 1U);
+    char *copy = chunk->data + chunk->used;
+    copy[length] = '\0';
+    chunk->used += length + 1U;
     return copy;
 }
 
-static char *string_slice(const char *begin, size_t length) {
-    char *copy = (char *)malloc(length + 1U);
+static char *string_slice(KolibriKnowledgeIndex *index, const char *begin, size_t length) {
+    char *copy = string_reserve(index, length);
     if (!copy) {
         return NULL;
     }
     memcpy(copy, begin, length);
-    copy[length] = '\0';
     return copy;
 }
 
-static char *extract_title(const char *content) {
+static char *duplicate_string(KolibriKnowledgeIndex *index, const char *src) {
+    if (!src) {
+        return NULL;
+    }
+    return string_slice(index, src, strlen(src));
+}
+
+static char *extract_title(KolibriKnowledgeIndex *index, const char *content) {
     if (!content) {
-        return duplicate_string("Документ Kolibri");
+        return duplicate_string(index, "Документ Kolibri");
     }
     const char *line_start = content;
     while (*line_start) {
@@ -113,7 +153,7 @@ static char *extract_title(const char *content) {
                     ++line_start;
                     --length;
                 }
-                return string_slice(line_start, length);
+                return string_slice(index, line_start, length);
             }
         }
         if (!line_end) {
@@ -121,18 +161,18 @@ static char *extract_title(const char *content) {
         }
         line_start = line_end + 1;
     }
-    return duplicate_string("Документ Kolibri");
+    return duplicate_string(index, "Документ Kolibri");
 }
 
-static char *make_id_from_path(const char *path) {
+static char *make_id_from_path(KolibriKnowledgeIndex *index, const char *path) {
     if (!path) {
-        return duplicate_string("kolibri-doc");
+        return duplicate_string(index, "kolibri-doc");
     }
     const char *basename = strrchr(path, '/');
     basename = basename ? basename + 1 : path;
     const char *dot = strrchr(basename, '.');
     size_t length = dot ? (size_t)(dot - basename) : strlen(basename);
-    return string_slice(basename, length);
+    return string_slice(index, basename, length);
 }
 
 static char *read_file_contents(const char *path) {
@@ -164,30 +204,29 @@ static char *read_file_contents(const char *path) {
     return buffer;
 }
 
-static char *to_lowercase_copy(const char *text) {
+static char *to_lowercase_copy(KolibriKnowledgeIndex *index, const char *text) {
     if (!text) {
         return NULL;
     }
     size_t length = strlen(text);
-    char *copy = (char *)malloc(length + 1U);
+    char *copy = string_reserve(index, length);
     if (!copy) {
         return NULL;
     }
     for (size_t i = 0; i < length; ++i) {
         copy[i] = (char)tolower((unsigned char)text[i]);
     }
-    copy[length] = '\0';
     return copy;
 }
 
-static char *shorten_content(const char *content) {
+static char *shorten_content(KolibriKnowledgeIndex *index, const char *content) {
     if (!content) {
-        return duplicate_string("");
+        return duplicate_string(index, "");
     }
     const size_t limit = 512U;
     size_t length = strlen(content);
     if (length <= limit) {
-        return duplicate_string(content);
+        return string_slice(index, content, length);
     }
     size_t cut = limit;
     while (cut > 0 && !isspace((unsigned char)content[cut])) {
@@ -196,16 +235,122 @@ static char *shorten_content(const char *content) {
     if (cut == 0) {
         cut = limit;
     }
-    char *snippet = (char *)malloc(cut + 4U);
+    char *snippet = string_reserve(index, cut + 3U);
     if (!snippet) {
         return NULL;
     }
     memcpy(snippet, content, cut);
-    snippet[cut] = '\0';
-    strcat(snippet, "...");
+    memcpy(snippet + cut, "...", 3U);
     return snippet;
 }
 
+static size_t gram_code(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return (size_t)(c - '0') + 1U;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return (size_t)(c - 'a') + 11U;
+    }
+    return 0U;
+}
+
+static size_t gram_of(const char *text, size_t length) {
+    size_t gram = 0U;
+    size_t scale = KOLIBRI_GRAM_BASE * KOLIBRI_GRAM_BASE;
+    for (size_t i = 0; i < length; ++i) {
+        gram += gram_code((unsigned char)text[i]) * scale;
+        scale /= KOLIBRI_GRAM_BASE;
+    }
+    return gram;
+}
+
+typedef struct {
+    KnowledgeGrams *grams;
+    uint32_t *last_doc;
+    uint32_t doc;
+    size_t *fill; /* NULL while counting */
+} GramBuild;
+
+static void gram_visit(GramBuild *build, size_t gram) {
+    if (build->last_doc[gram] == build->doc) {
+        return;
+    }
+    build->last_doc[gram] = build->doc;
+    if (build->fill) {
+        build->grams->docs[build->fill[gram]++] = build->doc;
+    } else {
+        build->grams->offsets[gram + 1U] += 1U;
+    }
+}
+
+static void gram_scan(GramBuild *build, const char *text) {
+    for (const unsigned char *s = (const unsigned char *)text; *s; ++s) {
+        size_t c1 = gram_code(s[0]);
+        if (c1 == 0U) {
+            continue;
+        }
+        size_t gram = c1 * KOLIBRI_GRAM_BASE * KOLIBRI_GRAM_BASE;
+        gram_visit(build, gram);
+        size_t c2 = gram_code(s[1]);
+        if (c2 == 0U) {
+            continue;
+        }
+        gram += c2 * KOLIBRI_GRAM_BASE;
+        gram_visit(build, gram);
+        size_t c3 = gram_code(s[2]);
+        if (c3 != 0U) {
+            gram_visit(build, gram + c3);
+        }
+    }
+}
+
+/* Inverts every document's 1-, 2- and 3-grams; on allocation failure the
+ * previous postings stay and search scans the documents they miss. */
+static int grams_rebuild(KolibriKnowledgeIndex *index) {
+    KnowledgeGrams *grams = (KnowledgeGrams *)calloc(1, sizeof(KnowledgeGrams));
+    uint32_t *last_doc = (uint32_t *)malloc(KOLIBRI_GRAM_BUCKETS * sizeof(uint32_t));
+    size_t *fill = (size_t *)malloc(KOLIBRI_GRAM_BUCKETS * sizeof(size_t));
+    if (grams) {
+        grams->offsets = (size_t *)calloc(KOLIBRI_GRAM_BUCKETS + 1U, sizeof(size_t));
+    }
+    if (!grams || !grams->offsets || !last_doc || !fill) {
+        grams_free(grams);
+        free(last_doc);
+        free(fill);
+        return -1;
+    }
+    GramBuild build = {grams, last_doc, 0U, NULL};
+    memset(last_doc, 0xff, KOLIBRI_GRAM_BUCKETS * sizeof(uint32_t));
+    for (size_t i = 0; i < index->count; ++i) {
+        build.doc = (uint32_t)i;
+        gram_scan(&build, index->documents[i].content_lower);
+    }
+    for (size_t g = 0; g < KOLIBRI_GRAM_BUCKETS; ++g) {
+        grams->offsets[g + 1U] += grams->offsets[g];
+    }
+    size_t total = grams->offsets[KOLIBRI_GRAM_BUCKETS];
+    grams->docs = (uint32_t *)malloc((total ? total : 1U) * sizeof(uint32_t));
+    if (!grams->docs) {
+        grams_free(grams);
+        free(last_doc);
+        free(fill);
+        return -1;
+    }
+    memcpy(fill, grams->offsets, KOLIBRI_GRAM_BUCKETS * sizeof(size_t));
+    memset(last_doc, 0xff, KOLIBRI_GRAM_BUCKETS * sizeof(uint32_t));
+    build.fill = fill;
+    for (size_t i = 0; i < index->count; ++i) {
+        build.doc = (uint32_t)i;
+        gram_scan(&build, index->documents[i].content_lower);
+    }
+    free(last_doc);
+    free(fill);
+    grams->covered = index->count;
+    grams_free((KnowledgeGrams *)index->grams);
+    index->grams = grams;
+    return 0;
+}
+
 static int add_document(KolibriKnowledgeIndex *index, const char *path, const char *root) {
     char *content = read_file_contents(path);
     if (!content) {
@@ -228,14 +373,13 @@ static int add_document(KolibriKnowledgeIndex *index, const char *path, const ch
         return -1;
     }
     KolibriKnowledgeDocument *doc = &index->documents[index->count++];
-    doc->id = make_id_from_path(path);
-    doc->title = extract_title(content);
-    doc->content = shorten_content(content);
-    doc->content_lower = to_lowercase_copy(content);
-    doc->source = duplicate_string(relative);
+    doc->id = make_id_from_path(index, path);
+    doc->title = extract_title(index, content);
+    doc->content = shorten_content(index, content);
+    doc->content_lower = to_lowercase_copy(index, content);
+    doc->source = duplicate_string(index, relative);
     free(content);
     if (!doc->id || !doc->title || !doc->content || !doc->content_lower || !doc->source) {
-        free_document(doc);
         --index->count;
         return -1;
     }
@@ -282,7 +426,11 @@ int kolibri_knowledge_index_load_directory(KolibriKnowledgeIndex *index, const c
     if (!is_directory(root_path)) {
         return 0;
     }
-    return load_directory_recursive(index, root_path, root_path);
+    int status = load_directory_recursive(index, root_path, root_path);
+    if (status == 0) {
+        (void)grams_rebuild(index);
+    }
+    return status;
 }
 
 static size_t tokenize_query(const char *query, char tokens[][64], size_t max_tokens) {
@@ -338,6 +486,61 @@ static int compare_ranked(const void *lhs, const void *rhs) {
     return 0;
 }
 
+static int postings_contain(const uint32_t *docs, size_t count, uint32_t doc) {
+    size_t lo = 0U;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2U;
+        if (docs[mid] < doc) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && docs[lo] == doc;
+}
+
+/* Adds 1 to every indexed document containing token. Up to three characters
+ * the gram itself decides; longer tokens intersect their trigrams starting
+ * from the rarest and confirm the survivors with strstr. */
+static void grams_score_token(const KolibriKnowledgeIndex *index,
+                              const KnowledgeGrams *grams,
+                              const char *token,
+                              double *doc_scores) {
+    size_t length = strlen(token);
+    const size_t *offsets = grams->offsets;
+    if (length <= 3U) {
+        size_t gram = gram_of(token, length);
+        for (size_t i = offsets[gram]; i < offsets[gram + 1U]; ++i) {
+            doc_scores[grams->docs[i]] += 1.0;
+        }
+        return;
+    }
+    size_t rarest = 0U;
+    size_t rarest_count = SIZE_MAX;
+    for (size_t k = 0; k + 3U <= length; ++k) {
+        size_t gram = gram_of(token + k, 3U);
+        if (offsets[gram + 1U] - offsets[gram] < rarest_count) {
+            rarest = k;
+            rarest_count = offsets[gram + 1U] - offsets[gram];
+        }
+    }
+    size_t driver = gram_of(token + rarest, 3U);
+    for (size_t i = offsets[driver]; i < offsets[driver + 1U]; ++i) {
+        uint32_t doc = grams->docs[i];
+        int candidate = 1;
+        for (size_t k = 0; candidate && k + 3U <= length; ++k) {
+            size_t gram = gram_of(token + k, 3U);
+            if (k != rarest) {
+                candidate = postings_contain(grams->docs + offsets[gram], offsets[gram + 1U] - offsets[gram], doc);
+            }
+        }
+        if (candidate && strstr(index->documents[doc].content_lower, token) != NULL) {
+            doc_scores[doc] += 1.0;
+        }
+    }
+}
+
 size_t kolibri_knowledge_search(const KolibriKnowledgeIndex *index,
                                 const char *query,
                                 size_t limit,
@@ -354,25 +557,38 @@ size_t kolibri_knowledge_search(const KolibriKnowledgeIndex *index,
     if (token_count == 0) {
         return 0;
     }
+    double *doc_scores = (double *)calloc(index->count, sizeof(double));
     RankedDocument *ranked = (RankedDocument *)malloc(index->count * sizeof(RankedDocument));
-    if (!ranked) {
+    if (!doc_scores || !ranked) {
+        free(doc_scores);
+        free(ranked);
         return 0;
     }
-    size_t ranked_count = 0;
-    for (size_t i = 0; i < index->count; ++i) {
-        const KolibriKnowledgeDocument *doc = &index->documents[i];
-        double score = 0.0;
-        for (size_t t = 0; t < token_count; ++t) {
-            if (strstr(doc->content_lower, tokens[t]) != NULL) {
-                score += 1.0;
+    const KnowledgeGrams *grams = (const KnowledgeGrams *)index->grams;
+    size_t covered = grams ? grams->covered : 0U;
+    if (covered > index->count) {
+        covered = 0U;
+    }
+    for (size_t t = 0; t < token_count; ++t) {
+        if (covered > 0U) {
+            grams_score_token(index, grams, tokens[t], doc_scores);
+        }
+        /* Documents added after the last rebuild are scanned as before. */
+        for (size_t i = covered; i < index->count; ++i) {
+            if (strstr(index->documents[i].content_lower, tokens[t]) != NULL) {
+                doc_scores[i] += 1.0;
             }
         }
-        if (score > 0.0) {
-            ranked[ranked_count].score = score;
+    }
+    size_t ranked_count = 0;
+    for (size_t i = 0; i < index->count; ++i) {
+        if (doc_scores[i] > 0.0) {
+            ranked[ranked_count].score = doc_scores[i];
             ranked[ranked_count].index = i;
             ++ranked_count;
         }
     }
+    free(doc_scores);
     if (ranked_count == 0) {
         free(ranked);
         return 0;
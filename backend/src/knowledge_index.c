@@ -1,15 +1,68 @@
 #include "kolibri/knowledge_index.h"
 
+#include "kolibri/alloc.h"
+#include "kolibri/trace.h"
+
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define KOLIBRI_LANES_AVX2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KOLIBRI_LANES_NEON 1
+#endif
 
 #define KOLIBRI_TOP_TERMS 32U
+#define KOLIBRI_PREFIX_EXPANSIONS 16U
+#define KOLIBRI_PHRASE_MAX 16U
+#define KOLIBRI_ARENA_CHUNK 65536U
+#define KOLIBRI_DICT_MISSING ((size_t)-1)
+#define KOLIBRI_SNAPSHOT_MAGIC "KOLIBIDX"
+#define KOLIBRI_SNAPSHOT_VERSION 6U
+#define KOLIBRI_SNAPSHOT_STEMMING 1U
+#define KOLIBRI_SNAPSHOT_POSITIONS 2U
+#define KOLIBRI_SNAPSHOT_EMBEDDINGS 4U
+#define KOLIBRI_SNAPSHOT_QUANTIZED 8U
+#define KOLIBRI_SNAPSHOT_FILE "index.kbin"
+#define KOLIBRI_SNAPSHOT_NONE UINT64_MAX
+/* Files at least this large are mapped instead of read. */
+#define KOLIBRI_MMAP_MIN_BYTES 65536U
+/* How many files past the parse cursor may have readahead requested. */
+#define KOLIBRI_READAHEAD_WINDOW 32U
+/* Highest HNSW layer a node is drawn into. */
+#define KOLIBRI_ANN_MAX_LEVEL 16U
+/* Quantized ids are 24 bits; the top id marks an unused lane. */
+#define KOLIBRI_QUANT_ID_LIMIT 0xFFFFFFU
+#define KOLIBRI_QUANT_UNUSED (KOLIBRI_QUANT_ID_LIMIT << 8)
+/* Quantized candidates kept per requested result for the exact rescoring. */
+#define KOLIBRI_RESCORE_FACTOR 4U
+#define KOLIBRI_ANN_MAX_M 256U
+#define KOLIBRI_ANN_MAX_EF 65536U
+
+/*
+ * Where an index's memory comes from. Nothing here aborts: a failed
+ * allocation sets failed (shared by the build workers) and leaves the
+ * structure it was growing as it was, so a pass runs to its end and the
+ * public entry point reports ENOMEM.
+ */
+typedef struct {
+    KolibriAllocator allocator;
+    atomic_int failed;
+} IndexMemory;
 
 typedef struct {
     char *token;
@@ -18,51 +71,505 @@ typedef struct {
 } GlobalToken;
 
 typedef struct {
-    char *token;
+    size_t token_index;
     size_t count;
 } DocToken;
 
 typedef struct {
-    char *id;
-    char *title;
-    char *source;
-    char *content;
+    DocToken *items;
+    size_t count;
+    size_t capacity;
+    size_t *slots; /* item index + 1, 0 marks an empty slot */
+    size_t slot_capacity;
+    uint32_t *sequence; /* token ids in text order, kept for positional postings */
+    size_t sequence_count;
+    size_t sequence_capacity;
+    int keep_sequence;
+    IndexMemory *mem;
+} DocTokenList;
+
+typedef struct StringArenaChunk {
+    struct StringArenaChunk *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} StringArenaChunk;
+
+typedef struct {
+    StringArenaChunk *head;
+    IndexMemory *mem;
+} StringArena;
+
+typedef struct {
+    const char *key;
+    uint64_t hash;
+    size_t id;
+} TokenDictSlot;
+
+/* Open-addressing token -> id map; keys are interned in the arena. */
+typedef struct {
+    TokenDictSlot *slots;
+    size_t capacity;
+    size_t count;
+    StringArena arena; /* its mem serves the slots too */
+} TokenDict;
+
+/* Build-time vocabulary private to one worker; ids are local to it. */
+typedef struct {
+    TokenDict dict;
+    const char **keys;
+    size_t count;
+    size_t capacity;
+} BuildVocabulary;
+
+/* Strings live in the index string arena (or the snapshot mapping), so
+ * documents never own them. */
+typedef struct {
+    const char *id;
+    const char *title;
+    const char *source;
+    const char *content;
     KolibriKnowledgeVectorItem *vector;
     size_t vector_size;
     float norm;
+    const float *embedding; /* a row of the graph's vectors */
+    /* Incremental bookkeeping, present when the index keeps term counts. */
+    DocToken *terms;
+    size_t term_count;
+    unsigned long long file_size;
+    long long file_mtime;
+    unsigned long long content_hash;
+    int removed;
+    /* Token ids in text order, present when the index keeps positions. */
+    uint32_t *sequence;
+    size_t sequence_count;
 } Document;
 
+/* Posting weights are pre-divided by the document norm. */
+typedef struct {
+    uint32_t doc;
+    float weight;
+} Posting;
+
+/* Occurrences of one token in one document: positions[first .. first + count). */
+typedef struct {
+    uint32_t doc;
+    uint32_t count;
+    size_t first;
+} PositionEntry;
+
+/* Structure-of-arrays copy of a document vector: KOLIBRI_TOP_TERMS lanes
+ * of token ids and norm-divided weights, unused lanes hold UINT32_MAX/0. */
+typedef struct {
+    _Alignas(64) uint32_t ids[KOLIBRI_TOP_TERMS];
+    float weights[KOLIBRI_TOP_TERMS];
+} DocLanes;
+
+/* Quantized lanes: token id << 8 | 8-bit weight, unused lanes KOLIBRI_QUANT_UNUSED. */
+typedef struct {
+    _Alignas(64) uint32_t packed[KOLIBRI_TOP_TERMS];
+} QuantLanes;
+
+/*
+ * HNSW graph over the documents that carry an embedding. Node n stands for
+ * documents[docs[n]] (ascending) and owns vectors[n * dim ..], unit length,
+ * so cosine similarity is a dot product. A link list is a count followed by
+ * its slots: links0 holds 2 * m + 1 entries per node for the bottom layer,
+ * a node on level L > 0 has L lists of m + 1 entries in upper starting at
+ * upper_offsets[n] (node_count + 1 entries, so levels need no array).
+ */
+typedef struct {
+    size_t dim;
+    size_t node_count;
+    size_t m;
+    size_t ef_construction;
+    size_t ef_search;
+    uint64_t seed;
+    uint32_t entry;
+    uint32_t max_level;
+    float *vectors;
+    uint32_t *docs;
+    uint32_t *links0;
+    uint32_t *upper_offsets;
+    uint32_t *upper;
+} AnnGraph;
+
+typedef struct {
+    float distance; /* 1 - cosine similarity */
+    uint32_t node;
+} AnnCandidate;
+
+/* Working set of layer searches: visited[n] == epoch marks node n as seen,
+ * frontier is a min-heap and nearest a max-heap (at most ef) on distance. */
+typedef struct {
+    uint32_t *visited;
+    size_t visited_capacity;
+    uint32_t epoch;
+    AnnCandidate *frontier;
+    size_t frontier_count;
+    size_t frontier_capacity;
+    AnnCandidate *nearest;
+    size_t nearest_count;
+    size_t nearest_capacity;
+    const KolibriAllocator *allocator;
+} AnnWork;
+
+typedef struct {
+    size_t token_index;
+    double weight;
+    double upper_bound;
+    const Posting *cursor;
+    const Posting *end;
+    uint32_t qweight; /* 16-bit weight against the query scale, quantized indexes only */
+    const uint32_t *qcursor;
+    const uint32_t *qend;
+} QueryTerm;
+
+typedef struct {
+    QueryTerm *terms;
+    double *prefix_bound;
+    uint32_t *ids;
+    float *gathered;
+    uint32_t *qgathered;
+    size_t capacity;
+    /* Quoted phrases: token ids back to back, phrase_ends[i] closes phrase i. */
+    size_t *phrase_ids;
+    size_t phrase_id_count;
+    size_t phrase_id_capacity;
+    size_t *phrase_ends;
+    size_t phrase_count;
+    size_t phrase_capacity;
+    int phrase_missing; /* a phrase word is not in the dictionary */
+    uint32_t *matches;
+    size_t match_capacity;
+    AnnWork ann;
+    float *ann_query;
+    size_t ann_query_capacity;
+    size_t *rescore_indices;
+    size_t rescore_index_capacity;
+    float *rescore_scores;
+    size_t rescore_score_capacity;
+    int registered;
+    int failed; /* a buffer could not grow during the current query */
+    KolibriAllocator allocator; /* the default when the thread first grew a buffer */
+} QueryScratch;
+
+/* Grows per thread and is only released by the key destructor at thread exit. */
+static _Thread_local QueryScratch kolibri_query_scratch;
+static pthread_key_t kolibri_query_scratch_key;
+static pthread_once_t kolibri_query_scratch_once = PTHREAD_ONCE_INIT;
+
 struct KolibriKnowledgeIndex {
+    IndexMemory memory; /* every buffer below, the index itself included */
     Document *documents;
     size_t document_count;
     GlobalToken *tokens;
     size_t token_count;
     size_t token_capacity;
+    TokenDict dict;
+    StringArena strings; /* document ids, titles, sources and snippets */
+    size_t *posting_offsets; /* token_count + 1 entries into postings */
+    Posting *postings;
+    float *posting_max;
+    uint32_t *qpostings; /* doc << 8 | weight, in place of postings when quantized */
+    float *doc_scales;   /* quantized weight times scale is the norm-divided weight */
+    DocLanes *lanes; /* one per document covered by the postings */
+    QuantLanes *qlanes; /* in place of lanes when quantized */
+    void *lanes_block; /* allocation lanes or qlanes were aligned within */
+    size_t lane_count;
+    size_t *position_offsets; /* token_count + 1 entries into position_entries */
+    PositionEntry *position_entries;
+    uint32_t *positions;
+    uint32_t *token_order; /* token ids sorted by text, for prefix lookups */
+    size_t token_order_count;
+    void *mapping; /* binary snapshot backing strings, vectors and postings */
+    size_t mapping_size;
+    size_t document_capacity;
+    int term_counts;      /* every document carries terms, so DF can be maintained */
+    int stemming;         /* tokens were stemmed at build time, so queries are too */
+    int keep_positions;   /* documents carry sequences, the index positional postings */
+    int quantized;        /* 8-bit postings and lanes whenever ids fit in 24 bits */
+    size_t removed_count; /* tombstones awaiting commit */
+    size_t stale_updates; /* documents changed since IDF was last recomputed */
+    AnnGraph ann;         /* node_count 0 without embeddings */
 };
 
-static void *kolibri_alloc(size_t size) {
-    void *ptr = calloc(1, size);
+/* Binary snapshot layout: header, then 8-byte aligned sections. Vectors,
+ * postings and offsets use the in-memory layout, hence the size checks. */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    uint32_t vector_item_size;
+    uint32_t posting_size;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t document_count;
+    uint64_t token_count;
+    uint64_t vector_count;
+    uint64_t posting_count;
+    uint64_t strings_size;
+    uint64_t tokens_offset;
+    uint64_t documents_offset;
+    uint64_t vectors_offset;
+    uint64_t posting_offsets_offset;
+    uint64_t postings_offset;
+    uint64_t posting_max_offset;
+    uint64_t token_order_offset;
+    uint64_t position_entry_count;
+    uint64_t position_count;
+    uint64_t position_offsets_offset;
+    uint64_t position_entries_offset;
+    uint64_t positions_offset;
+    uint64_t embedding_dim;
+    uint64_t ann_node_count;
+    uint64_t ann_m;
+    uint64_t ann_ef_search;
+    uint64_t ann_entry;
+    uint64_t ann_max_level;
+    uint64_t ann_upper_count;
+    uint64_t ann_vectors_offset;
+    uint64_t ann_docs_offset;
+    uint64_t ann_links0_offset;
+    uint64_t ann_upper_offsets_offset;
+    uint64_t ann_upper_offset;
+    uint64_t doc_scales_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+} SnapshotHeader;
+
+typedef struct {
+    uint64_t string;
+    uint64_t df;
+    float idf;
+    uint32_t reserved;
+} SnapshotToken;
+
+typedef struct {
+    uint64_t id;
+    uint64_t title;
+    uint64_t source;
+    uint64_t content;
+    uint64_t vector_first;
+    uint64_t vector_count;
+    float norm;
+    uint32_t reserved;
+} SnapshotDocument;
+
+static void index_memory_init(IndexMemory *mem, const KolibriAllocator *allocator) {
+    kolibri_allocator_resolve(&mem->allocator, allocator);
+    atomic_init(&mem->failed, 0);
+}
+
+static int index_memory_failed(IndexMemory *mem) {
+    return atomic_load_explicit(&mem->failed, memory_order_relaxed);
+}
+
+static void *index_memory_check(IndexMemory *mem, void *ptr) {
     if (!ptr) {
-        fprintf(stderr, "[kolibri-knowledge] allocation failure\n");
-        abort();
+        atomic_store_explicit(&mem->failed, 1, memory_order_relaxed);
     }
     return ptr;
 }
 
-static char *kolibri_strdup(const char *text) {
-    if (!text) {
-        return NULL;
+static void *index_malloc(IndexMemory *mem, size_t size) {
+    return index_memory_check(mem, kolibri_mem_alloc(&mem->allocator, size));
+}
+
+static void *index_calloc(IndexMemory *mem, size_t count, size_t size) {
+    return index_memory_check(mem, kolibri_mem_calloc(&mem->allocator, count, size));
+}
+
+/* NULL on failure with ptr left valid, like realloc. */
+static void *index_realloc(IndexMemory *mem, void *ptr, size_t size) {
+    return index_memory_check(mem, kolibri_mem_realloc(&mem->allocator, ptr, size));
+}
+
+static void index_free(IndexMemory *mem, void *ptr) {
+    kolibri_mem_free(&mem->allocator, ptr);
+}
+
+static char *index_strdup(IndexMemory *mem, const char *text) {
+    return (char *)index_memory_check(mem, kolibri_mem_strdup(&mem->allocator, text));
+}
+
+static void string_arena_init(StringArena *arena, IndexMemory *mem) {
+    arena->head = NULL;
+    arena->mem = mem;
+}
+
+/* NULL when no chunk could be allocated. */
+static char *string_arena_reserve(StringArena *arena, size_t len) {
+    StringArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->capacity - chunk->used < len + 1U) {
+        size_t capacity = len + 1U > KOLIBRI_ARENA_CHUNK ? len + 1U : KOLIBRI_ARENA_CHUNK;
+        chunk = (StringArenaChunk *)index_malloc(arena->mem, sizeof(StringArenaChunk) + capacity);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->used = 0U;
+        chunk->capacity = capacity;
+        chunk->next = arena->head;
+        arena->head = chunk;
     }
-    size_t len = strlen(text);
-    char *copy = (char *)malloc(len + 1U);
+    char *copy = chunk->data + chunk->used;
+    copy[len] = '\0';
+    chunk->used += len + 1U;
+    return copy;
+}
+
+/* "" when the arena cannot grow; the failure is on the arena's memory. */
+static const char *string_arena_store(StringArena *arena, const char *text, size_t len) {
+    char *copy = string_arena_reserve(arena, len);
     if (!copy) {
-        fprintf(stderr, "[kolibri-knowledge] strdup failure\n");
-        abort();
+        return "";
     }
-    memcpy(copy, text, len + 1U);
+    memcpy(copy, text, len);
     return copy;
 }
 
+/* Moves every chunk of src into dst; the strings keep their addresses. */
+static void string_arena_adopt(StringArena *dst, StringArena *src) {
+    StringArenaChunk *tail = src->head;
+    if (!tail) {
+        return;
+    }
+    while (tail->next) {
+        tail = tail->next;
+    }
+    tail->next = dst->head;
+    dst->head = src->head;
+    src->head = NULL;
+}
+
+static void string_arena_free(StringArena *arena) {
+    StringArenaChunk *chunk = arena->head;
+    while (chunk) {
+        StringArenaChunk *next = chunk->next;
+        index_free(arena->mem, chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
+
+static uint64_t token_hash(const char *text, size_t len) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void token_dict_init(TokenDict *dict, IndexMemory *mem) {
+    dict->slots = NULL;
+    dict->capacity = 0U;
+    dict->count = 0U;
+    string_arena_init(&dict->arena, mem);
+}
+
+static void token_dict_free(TokenDict *dict) {
+    index_free(dict->arena.mem, dict->slots);
+    string_arena_free(&dict->arena);
+    token_dict_init(dict, dict->arena.mem);
+}
+
+static size_t token_dict_probe(const TokenDict *dict, const char *text, size_t len, uint64_t hash) {
+    size_t mask = dict->capacity - 1U;
+    size_t pos = (size_t)hash & mask;
+    while (dict->slots[pos].key) {
+        const TokenDictSlot *slot = &dict->slots[pos];
+        if (slot->hash == hash && strncmp(slot->key, text, len) == 0 && slot->key[len] == '\0') {
+            break;
+        }
+        pos = (pos + 1U) & mask;
+    }
+    return pos;
+}
+
+static int token_dict_grow(TokenDict *dict) {
+    size_t capacity = dict->capacity == 0U ? 256U : dict->capacity * 2U;
+    TokenDictSlot *slots = (TokenDictSlot *)index_calloc(dict->arena.mem, capacity, sizeof(TokenDictSlot));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < dict->capacity; ++i) {
+        const TokenDictSlot *slot = &dict->slots[i];
+        if (!slot->key) {
+            continue;
+        }
+        size_t pos = (size_t)slot->hash & (capacity - 1U);
+        while (slots[pos].key) {
+            pos = (pos + 1U) & (capacity - 1U);
+        }
+        slots[pos] = *slot;
+    }
+    index_free(dict->arena.mem, dict->slots);
+    dict->slots = slots;
+    dict->capacity = capacity;
+    return 0;
+}
+
+/* Grows ahead of an insert; a table that cannot grow still takes keys while
+ * one slot stays empty to end the probes. */
+static int token_dict_reserve(TokenDict *dict) {
+    if ((dict->count + 1U) * 4U > dict->capacity * 3U && token_dict_grow(dict) != 0) {
+        return dict->count + 1U < dict->capacity ? 0 : -1;
+    }
+    return 0;
+}
+
+static size_t token_dict_find(const TokenDict *dict, const char *text, size_t len) {
+    if (dict->count == 0U) {
+        return KOLIBRI_DICT_MISSING;
+    }
+    size_t pos = token_dict_probe(dict, text, len, token_hash(text, len));
+    return dict->slots[pos].key ? dict->slots[pos].id : KOLIBRI_DICT_MISSING;
+}
+
+/* Binds a key that outlives the dictionary (a mapped snapshot) without copying it. */
+static void token_dict_bind(TokenDict *dict, const char *key, size_t id) {
+    if (token_dict_reserve(dict) != 0) {
+        return;
+    }
+    size_t len = strlen(key);
+    uint64_t hash = token_hash(key, len);
+    size_t pos = token_dict_probe(dict, key, len, hash);
+    TokenDictSlot *slot = &dict->slots[pos];
+    if (!slot->key) {
+        slot->key = key;
+        slot->hash = hash;
+        slot->id = id;
+        dict->count += 1U;
+    }
+}
+
+/* Returns the id already bound to text, or binds it to new_id and interns the
+ * key; KOLIBRI_DICT_MISSING when a new key finds no memory. */
+static size_t token_dict_intern(TokenDict *dict, const char *text, size_t len, size_t new_id, const char **out_key) {
+    if (token_dict_reserve(dict) != 0) {
+        return KOLIBRI_DICT_MISSING;
+    }
+    uint64_t hash = token_hash(text, len);
+    size_t pos = token_dict_probe(dict, text, len, hash);
+    TokenDictSlot *slot = &dict->slots[pos];
+    if (!slot->key) {
+        char *key = string_arena_reserve(&dict->arena, len);
+        if (!key) {
+            return KOLIBRI_DICT_MISSING;
+        }
+        memcpy(key, text, len);
+        slot->key = key;
+        slot->hash = hash;
+        slot->id = new_id;
+        dict->count += 1U;
+    }
+    if (out_key) {
+        *out_key = slot->key;
+    }
+    return slot->id;
+}
+
 static int is_markdown_file(const char *path) {
     size_t len = strlen(path);
     return len > 3U && strcmp(path + len - 3U, ".md") == 0;
@@ -72,26 +579,36 @@ typedef struct {
     char **items;
     size_t count;
     size_t capacity;
+    IndexMemory *mem;
 } PathList;
 
-static void path_list_init(PathList *list) {
+static void path_list_init(PathList *list, IndexMemory *mem) {
     list->items = NULL;
     list->count = 0U;
     list->capacity = 0U;
+    list->mem = mem;
 }
 
-static void path_list_push(PathList *list, const char *path) {
+/* Appends path and takes ownership of it; a path that does not fit is freed. */
+static void path_list_take(PathList *list, char *path) {
+    if (!path) {
+        return;
+    }
     if (list->count == list->capacity) {
         size_t new_capacity = list->capacity == 0U ? 16U : list->capacity * 2U;
-        char **new_items = (char **)realloc(list->items, new_capacity * sizeof(char *));
+        char **new_items = (char **)index_realloc(list->mem, list->items, new_capacity * sizeof(char *));
         if (!new_items) {
-            fprintf(stderr, "[kolibri-knowledge] realloc failure\n");
-            abort();
+            index_free(list->mem, path);
+            return;
         }
         list->items = new_items;
         list->capacity = new_capacity;
     }
-    list->items[list->count++] = kolibri_strdup(path);
+    list->items[list->count++] = path;
+}
+
+static void path_list_push(PathList *list, const char *path) {
+    path_list_take(list, index_strdup(list->mem, path));
 }
 
 static void path_list_free(PathList *list) {
@@ -99,9 +616,9 @@ static void path_list_free(PathList *list) {
         return;
     }
     for (size_t i = 0; i < list->count; ++i) {
-        free(list->items[i]);
+        index_free(list->mem, list->items[i]);
     }
-    free(list->items);
+    index_free(list->mem, list->items);
     list->items = NULL;
     list->count = 0U;
     list->capacity = 0U;
@@ -115,29 +632,183 @@ static int path_is_directory(const char *path) {
     return S_ISDIR(st.st_mode);
 }
 
-static void collect_markdown_files(const char *root, PathList *list) {
-    if (path_is_directory(root)) {
-        DIR *dir = opendir(root);
-        if (!dir) {
+static int path_compare(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+typedef struct {
+    char *path;
+    size_t root;
+} CrawlDir;
+
+/* Directories still to be listed; workers take from the back. */
+typedef struct {
+    CrawlDir *dirs;
+    size_t dir_count;
+    size_t dir_capacity;
+    PathList *found; /* one list per root */
+    size_t busy;     /* workers listing a directory, which may add more */
+    IndexMemory *mem;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} CrawlQueue;
+
+/* Takes ownership of path; a directory that does not fit is skipped. */
+static void crawl_queue_push(CrawlQueue *queue, char *path, size_t root) {
+    if (!path) {
+        return;
+    }
+    if (queue->dir_count == queue->dir_capacity) {
+        size_t new_capacity = queue->dir_capacity == 0U ? 16U : queue->dir_capacity * 2U;
+        CrawlDir *new_dirs = (CrawlDir *)index_realloc(queue->mem, queue->dirs, new_capacity * sizeof(CrawlDir));
+        if (!new_dirs) {
+            index_free(queue->mem, path);
             return;
         }
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
-            char buffer[4096];
-            snprintf(buffer, sizeof(buffer), "%s/%s", root, entry->d_name);
-            if (path_is_directory(buffer)) {
-                collect_markdown_files(buffer, list);
-            } else if (is_markdown_file(buffer)) {
-                path_list_push(list, buffer);
-            }
+        queue->dirs = new_dirs;
+        queue->dir_capacity = new_capacity;
+    }
+    queue->dirs[queue->dir_count].path = path;
+    queue->dirs[queue->dir_count].root = root;
+    queue->dir_count++;
+}
+
+/* d_type saves a stat per entry; links and unknown types are still followed with stat. */
+static void crawl_directory(const char *path, PathList *dirs, PathList *files) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char buffer[4096];
+        snprintf(buffer, sizeof(buffer), "%s/%s", path, entry->d_name);
+        int is_dir;
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+            is_dir = entry->d_type == DT_DIR;
+        } else
+#endif
+        {
+            is_dir = path_is_directory(buffer);
+        }
+        if (is_dir) {
+            path_list_push(dirs, buffer);
+        } else if (is_markdown_file(buffer)) {
+            path_list_push(files, buffer);
+        }
+    }
+    closedir(dir);
+}
+
+static void *crawl_main(void *arg) {
+    CrawlQueue *queue = (CrawlQueue *)arg;
+    PathList dirs;
+    PathList files;
+    path_list_init(&dirs, queue->mem);
+    path_list_init(&files, queue->mem);
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->dir_count == 0U && queue->busy > 0U) {
+            pthread_cond_wait(&queue->wake, &queue->lock);
+        }
+        if (queue->dir_count == 0U) {
+            break;
+        }
+        CrawlDir dir = queue->dirs[--queue->dir_count];
+        queue->busy++;
+        pthread_mutex_unlock(&queue->lock);
+        crawl_directory(dir.path, &dirs, &files);
+        index_free(queue->mem, dir.path);
+        pthread_mutex_lock(&queue->lock);
+        for (size_t i = 0; i < dirs.count; ++i) {
+            crawl_queue_push(queue, dirs.items[i], dir.root);
+        }
+        for (size_t i = 0; i < files.count; ++i) {
+            path_list_take(&queue->found[dir.root], files.items[i]);
+        }
+        dirs.count = 0U;
+        files.count = 0U;
+        queue->busy--;
+        pthread_cond_broadcast(&queue->wake);
+    }
+    pthread_cond_broadcast(&queue->wake);
+    pthread_mutex_unlock(&queue->lock);
+    index_free(queue->mem, dirs.items);
+    index_free(queue->mem, files.items);
+    return NULL;
+}
+
+/*
+ * Lists the Markdown files under every root on up to threads workers sharing
+ * one queue of directories. Files come out root by root, each root's sorted
+ * by path, so the result does not depend on readdir() or thread timing.
+ * Without memory the list misses files and list->mem records the failure.
+ */
+static void collect_markdown_files(const char *const *roots, size_t root_count, size_t threads,
+                                   PathList *list) {
+    CrawlQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.mem = list->mem;
+    queue.found = (PathList *)index_calloc(list->mem, root_count, sizeof(PathList));
+    if (!queue.found) {
+        return;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.wake, NULL);
+    for (size_t r = 0; r < root_count; ++r) {
+        path_list_init(&queue.found[r], list->mem);
+        if (path_is_directory(roots[r])) {
+            crawl_queue_push(&queue, index_strdup(list->mem, roots[r]), r);
+        } else if (is_markdown_file(roots[r])) {
+            path_list_push(&queue.found[r], roots[r]);
+        }
+    }
+    if (threads > queue.dir_count) {
+        threads = queue.dir_count > 0U ? queue.dir_count : 1U;
+    }
+    /* Helper threads are optional: without their bookkeeping the caller crawls alone. */
+    pthread_t *workers = (pthread_t *)kolibri_mem_calloc(&list->mem->allocator, threads, sizeof(pthread_t));
+    unsigned char *started = (unsigned char *)kolibri_mem_calloc(&list->mem->allocator, threads, 1U);
+    if (!workers || !started) {
+        threads = 1U;
+    }
+    for (size_t w = 1; w < threads; ++w) {
+        started[w] = pthread_create(&workers[w], NULL, crawl_main, &queue) == 0;
+    }
+    crawl_main(&queue);
+    for (size_t w = 1; w < threads; ++w) {
+        if (started[w]) {
+            pthread_join(workers[w], NULL);
         }
-        closedir(dir);
-    } else if (is_markdown_file(root)) {
-        path_list_push(list, root);
     }
+    index_free(list->mem, started);
+    index_free(list->mem, workers);
+    for (size_t r = 0; r < root_count; ++r) {
+        PathList *found = &queue.found[r];
+        if (found->count > 1) {
+            qsort(found->items, found->count, sizeof(char *), path_compare);
+        }
+        for (size_t i = 0; i < found->count; ++i) {
+            path_list_take(list, found->items[i]);
+        }
+        index_free(list->mem, found->items);
+    }
+    index_free(list->mem, queue.found);
+    index_free(list->mem, queue.dirs);
+    pthread_cond_destroy(&queue.wake);
+    pthread_mutex_destroy(&queue.lock);
+}
+
+static size_t resolve_thread_count(size_t threads) {
+    if (threads == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1U;
+    }
+    return threads;
 }
 
 static char *read_file_utf8(const char *path) {
@@ -158,9 +829,10 @@ static char *read_file_utf8(const char *path) {
         fclose(file);
         return NULL;
     }
-    char *buffer = (char *)malloc((size_t)size + 1U);
+    char *buffer = (char *)kolibri_mem_alloc(NULL, (size_t)size + 1U);
     if (!buffer) {
         fclose(file);
+        errno = ENOMEM;
         return NULL;
     }
     size_t read = fread(buffer, 1, (size_t)size, file);
@@ -169,23 +841,156 @@ static char *read_file_utf8(const char *path) {
     return buffer;
 }
 
-static char *derive_id_from_path(const char *path) {
+/* Document text, NUL-terminated either way. */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t mapped; /* length of the mapping, 0 for a heap copy */
+    unsigned long long file_size;
+    long long file_mtime;
+    IndexMemory *mem;
+} FileText;
+
+/*
+ * Large files are mapped when their last page is partial: the kernel fills
+ * the rest of that page with zeros, which terminates the text without a copy.
+ * Everything else is read into a buffer.
+ */
+static int file_text_open(IndexMemory *mem, const char *path, FileText *out) {
+    memset(out, 0, sizeof(*out));
+    out->mem = mem;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    out->file_size = (unsigned long long)st.st_size;
+    out->file_mtime = (long long)st.st_mtime;
+    long page = sysconf(_SC_PAGESIZE);
+    if (size >= KOLIBRI_MMAP_MIN_BYTES && page > 0 && size % (size_t)page != 0U) {
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            (void)madvise(map, size, MADV_SEQUENTIAL);
+            close(fd);
+            out->data = (char *)map;
+            out->size = size;
+            out->mapped = size;
+            return 0;
+        }
+    }
+    char *buffer = (char *)index_malloc(mem, size + 1U);
+    if (!buffer) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    size_t used = 0U;
+    while (used < size) {
+        ssize_t got = read(fd, buffer + used, size - used);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            break;
+        }
+        used += (size_t)got;
+    }
+    close(fd);
+    buffer[used] = '\0';
+    out->data = buffer;
+    out->size = used;
+    return 0;
+}
+
+static void file_text_close(FileText *text) {
+    if (text->mapped) {
+        munmap(text->data, text->mapped);
+    } else {
+        index_free(text->mem, text->data);
+    }
+    text->data = NULL;
+}
+
+/* Starts reading a file into the page cache without waiting for it. */
+static void file_prefetch(const char *path) {
+#if defined(POSIX_FADV_WILLNEED)
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+static unsigned long long content_hash(const char *content) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const unsigned char *cursor = (const unsigned char *)content; *cursor; ++cursor) {
+        hash ^= (unsigned long long)*cursor;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* The document id is the file name without its .md suffix. */
+static const char *path_id_span(const char *path, size_t *out_len) {
     const char *slash = strrchr(path, '/');
     const char *name = slash ? slash + 1 : path;
     size_t len = strlen(name);
     if (len > 3U && name[len - 3U] == '.' && name[len - 2U] == 'm' && name[len - 1U] == 'd') {
         len -= 3U;
     }
-    char *id = (char *)malloc(len + 1U);
-    if (!id) {
-        return NULL;
+    *out_len = len;
+    return name;
+}
+
+static const char *derive_id_from_path(StringArena *arena, const char *path) {
+    size_t len = 0U;
+    const char *name = path_id_span(path, &len);
+    return string_arena_store(arena, name, len);
+}
+
+static size_t shard_of_span(const char *id, size_t len, size_t shard_count) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned long long)(unsigned char)id[i];
+        hash *= 1099511628211ULL;
     }
-    memcpy(id, name, len);
-    id[len] = '\0';
-    return id;
+    return (size_t)(hash % shard_count);
+}
+
+size_t kolibri_knowledge_index_shard_of(const char *id, size_t shard_count) {
+    if (!id || shard_count <= 1U) {
+        return 0U;
+    }
+    return shard_of_span(id, strlen(id), shard_count);
+}
+
+/* Drops the crawled paths whose ids belong to other shards. */
+static void path_list_keep_shard(PathList *list, const KolibriKnowledgeIndexOptions *options) {
+    if (options->shard_count <= 1U) {
+        return;
+    }
+    size_t kept = 0U;
+    for (size_t i = 0; i < list->count; ++i) {
+        size_t len = 0U;
+        const char *id = path_id_span(list->items[i], &len);
+        if (shard_of_span(id, len, options->shard_count) == options->shard_index) {
+            list->items[kept++] = list->items[i];
+        } else {
+            index_free(list->mem, list->items[i]);
+        }
+    }
+    list->count = kept;
 }
 
-static char *extract_title(const char *content) {
+static const char *extract_title(StringArena *arena, const char *content) {
     const char *cursor = content;
     while (*cursor != '\0') {
         const char *line_start = cursor;
@@ -198,25 +1003,19 @@ static char *extract_title(const char *content) {
                 line_start++;
                 line_len--;
             }
-            char *title = (char *)malloc(line_len + 1U);
-            if (!title) {
-                return kolibri_strdup("Документ");
-            }
-            memcpy(title, line_start, line_len);
-            title[line_len] = '\0';
-            return title;
+            return string_arena_store(arena, line_start, line_len);
         }
         if (*cursor == '\n') {
             cursor++;
         }
     }
-    return kolibri_strdup("Документ");
+    return string_arena_store(arena, "Документ", strlen("Документ"));
 }
 
-static char *shorten_content(const char *content, size_t max_length) {
+static const char *shorten_content(StringArena *arena, const char *content, size_t max_length) {
     size_t len = strlen(content);
     if (len <= max_length) {
-        return kolibri_strdup(content);
+        return string_arena_store(arena, content, len);
     }
     size_t end = max_length;
     while (end > 0 && !isspace((unsigned char)content[end])) {
@@ -225,73 +1024,158 @@ static char *shorten_content(const char *content, size_t max_length) {
     if (end == 0) {
         end = max_length;
     }
-    char *result = (char *)malloc(end + 4U);
+    static const char ellipsis[] = "…";
+    char *result = string_arena_reserve(arena, end + sizeof(ellipsis) - 1U);
     if (!result) {
-        return NULL;
+        return "";
     }
     memcpy(result, content, end);
-    result[end] = '\0';
-    strcat(result, "…");
+    memcpy(result + end, ellipsis, sizeof(ellipsis) - 1U);
     return result;
 }
 
-static void doc_token_list_add(DocToken **tokens, size_t *count, size_t *capacity, const char *token) {
-    for (size_t i = 0; i < *count; ++i) {
-        if (strcmp((*tokens)[i].token, token) == 0) {
-            (*tokens)[i].count += 1U;
+static void doc_token_list_init(DocTokenList *list, IndexMemory *mem) {
+    memset(list, 0, sizeof(*list));
+    list->mem = mem;
+}
+
+static void doc_token_list_free(DocTokenList *list) {
+    index_free(list->mem, list->items);
+    index_free(list->mem, list->slots);
+    index_free(list->mem, list->sequence);
+    doc_token_list_init(list, list->mem);
+}
+
+static void doc_token_list_record(DocTokenList *list, size_t token_index) {
+    if (!list->keep_sequence) {
+        return;
+    }
+    if (list->sequence_count == list->sequence_capacity) {
+        size_t new_cap = list->sequence_capacity == 0U ? 64U : list->sequence_capacity * 2U;
+        uint32_t *grown = (uint32_t *)index_realloc(list->mem, list->sequence, new_cap * sizeof(uint32_t));
+        if (!grown) {
             return;
         }
+        list->sequence = grown;
+        list->sequence_capacity = new_cap;
     }
-    if (*count == *capacity) {
-        size_t new_cap = (*capacity == 0U) ? 16U : (*capacity * 2U);
-        DocToken *new_tokens = (DocToken *)realloc(*tokens, new_cap * sizeof(DocToken));
-        if (!new_tokens) {
-            fprintf(stderr, "[kolibri-knowledge] realloc doc tokens failed\n");
-            abort();
+    list->sequence[list->sequence_count++] = (uint32_t)token_index;
+}
+
+static int doc_token_list_rehash(DocTokenList *list, size_t slot_capacity) {
+    size_t *slots = (size_t *)index_calloc(list->mem, slot_capacity, sizeof(size_t));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < list->count; ++i) {
+        size_t pos = (list->items[i].token_index * 0x9E3779B97F4A7C15ULL) & (slot_capacity - 1U);
+        while (slots[pos] != 0U) {
+            pos = (pos + 1U) & (slot_capacity - 1U);
         }
-        *tokens = new_tokens;
-        *capacity = new_cap;
+        slots[pos] = i + 1U;
     }
-    (*tokens)[*count].token = kolibri_strdup(token);
-    (*tokens)[*count].count = 1U;
-    *count += 1U;
+    index_free(list->mem, list->slots);
+    list->slots = slots;
+    list->slot_capacity = slot_capacity;
+    return 0;
 }
 
-static void global_register_tokens(GlobalToken **tokens, size_t *count, size_t *capacity, DocToken *doc_tokens, size_t doc_count) {
-    for (size_t i = 0; i < doc_count; ++i) {
-        const char *token = doc_tokens[i].token;
-        size_t j;
-        for (j = 0; j < *count; ++j) {
-            if (strcmp((*tokens)[j].token, token) == 0) {
-                (*tokens)[j].df += 1U;
-                break;
-            }
+/* A token that finds no memory is dropped; the failure is on list->mem. */
+static void doc_token_list_add(DocTokenList *list, size_t token_index) {
+    if ((list->count + 1U) * 2U > list->slot_capacity &&
+        doc_token_list_rehash(list, list->slot_capacity == 0U ? 32U : list->slot_capacity * 2U) != 0) {
+        return;
+    }
+    size_t mask = list->slot_capacity - 1U;
+    size_t pos = (token_index * 0x9E3779B97F4A7C15ULL) & mask;
+    while (list->slots[pos] != 0U) {
+        DocToken *item = &list->items[list->slots[pos] - 1U];
+        if (item->token_index == token_index) {
+            item->count += 1U;
+            return;
         }
-        if (j == *count) {
-            if (*count == *capacity) {
-                size_t new_cap = (*capacity == 0U) ? 64U : (*capacity * 2U);
-                GlobalToken *new_tokens = (GlobalToken *)realloc(*tokens, new_cap * sizeof(GlobalToken));
-                if (!new_tokens) {
-                    fprintf(stderr, "[kolibri-knowledge] realloc global tokens failed\n");
-                    abort();
-                }
-                *tokens = new_tokens;
-                *capacity = new_cap;
-            }
-            (*tokens)[*count].token = kolibri_strdup(token);
-            (*tokens)[*count].df = 1U;
-            (*tokens)[*count].idf = 0.0f;
-            *count += 1U;
+        pos = (pos + 1U) & mask;
+    }
+    if (list->count == list->capacity) {
+        size_t new_cap = (list->capacity == 0U) ? 16U : (list->capacity * 2U);
+        DocToken *new_items = (DocToken *)index_realloc(list->mem, list->items, new_cap * sizeof(DocToken));
+        if (!new_items) {
+            return;
         }
+        list->items = new_items;
+        list->capacity = new_cap;
     }
+    list->items[list->count].token_index = token_index;
+    list->items[list->count].count = 1U;
+    list->count += 1U;
+    list->slots[pos] = list->count;
 }
 
-static void free_doc_tokens(DocToken *tokens, size_t count) {
-    for (size_t i = 0; i < count; ++i) {
-        free(tokens[i].token);
+/* KOLIBRI_DICT_MISSING when a new token finds no memory. */
+static size_t global_token_intern(KolibriKnowledgeIndex *index, const char *text, size_t len) {
+    /* Room for a new id first, so the dictionary never names a missing token. */
+    if (index->token_count == index->token_capacity) {
+        size_t new_cap = (index->token_capacity == 0U) ? 64U : (index->token_capacity * 2U);
+        GlobalToken *new_tokens = (GlobalToken *)index_realloc(&index->memory, index->tokens,
+                                                               new_cap * sizeof(GlobalToken));
+        if (!new_tokens) {
+            return KOLIBRI_DICT_MISSING;
+        }
+        index->tokens = new_tokens;
+        index->token_capacity = new_cap;
     }
-    free(tokens);
-}
+    const char *key = NULL;
+    size_t id = token_dict_intern(&index->dict, text, len, index->token_count, &key);
+    if (id != index->token_count) {
+        return id;
+    }
+    index->tokens[id].token = (char *)key;
+    index->tokens[id].df = 0U;
+    index->tokens[id].idf = 0.0f;
+    index->token_count += 1U;
+    return id;
+}
+
+static void build_vocabulary_init(BuildVocabulary *vocab, IndexMemory *mem) {
+    token_dict_init(&vocab->dict, mem);
+    vocab->keys = NULL;
+    vocab->count = 0U;
+    vocab->capacity = 0U;
+}
+
+static void build_vocabulary_free(BuildVocabulary *vocab) {
+    IndexMemory *mem = vocab->dict.arena.mem;
+    token_dict_free(&vocab->dict);
+    index_free(mem, vocab->keys);
+    build_vocabulary_init(vocab, mem);
+}
+
+/* KOLIBRI_DICT_MISSING when a new token finds no memory. */
+static size_t build_vocabulary_intern(BuildVocabulary *vocab, const char *text, size_t len) {
+    if (vocab->count == vocab->capacity) {
+        size_t new_cap = (vocab->capacity == 0U) ? 64U : (vocab->capacity * 2U);
+        const char **keys = (const char **)index_realloc(vocab->dict.arena.mem, vocab->keys,
+                                                         new_cap * sizeof(const char *));
+        if (!keys) {
+            return KOLIBRI_DICT_MISSING;
+        }
+        vocab->keys = keys;
+        vocab->capacity = new_cap;
+    }
+    const char *key = NULL;
+    size_t id = token_dict_intern(&vocab->dict, text, len, vocab->count, &key);
+    if (id != vocab->count) {
+        return id;
+    }
+    vocab->keys[vocab->count++] = key;
+    return id;
+}
+
+static void global_register_tokens(GlobalToken *tokens, const DocTokenList *doc_tokens) {
+    for (size_t i = 0; i < doc_tokens->count; ++i) {
+        tokens[doc_tokens->items[i].token_index].df += 1U;
+    }
+}
 
 static void compute_idf(GlobalToken *tokens, size_t token_count, size_t total_docs) {
     for (size_t i = 0; i < token_count; ++i) {
@@ -299,393 +1183,3235 @@ static void compute_idf(GlobalToken *tokens, size_t token_count, size_t total_do
     }
 }
 
-static size_t find_global_token(const GlobalToken *tokens, size_t token_count, const char *token) {
-    for (size_t i = 0; i < token_count; ++i) {
-        if (strcmp(tokens[i].token, token) == 0) {
-            return i;
+static int vector_compare(const void *a, const void *b) {
+    const KolibriKnowledgeVectorItem *va = (const KolibriKnowledgeVectorItem *)a;
+    const KolibriKnowledgeVectorItem *vb = (const KolibriKnowledgeVectorItem *)b;
+    if (va->weight > vb->weight) {
+        return -1;
+    }
+    if (va->weight < vb->weight) {
+        return 1;
+    }
+    return 0;
+}
+
+/* NULL when even the index itself cannot be allocated. */
+static KolibriKnowledgeIndex *knowledge_index_new(const KolibriAllocator *allocator) {
+    KolibriAllocator resolved;
+    kolibri_allocator_resolve(&resolved, allocator);
+    KolibriKnowledgeIndex *index = (KolibriKnowledgeIndex *)kolibri_mem_calloc(&resolved, 1U,
+                                                                               sizeof(KolibriKnowledgeIndex));
+    if (!index) {
+        return NULL;
+    }
+    index_memory_init(&index->memory, &resolved);
+    index->documents = NULL;
+    index->document_count = 0U;
+    index->tokens = NULL;
+    index->token_count = 0U;
+    index->token_capacity = 0U;
+    token_dict_init(&index->dict, &index->memory);
+    index->posting_offsets = NULL;
+    index->postings = NULL;
+    index->posting_max = NULL;
+    index->qpostings = NULL;
+    index->doc_scales = NULL;
+    index->lanes = NULL;
+    index->qlanes = NULL;
+    index->lanes_block = NULL;
+    index->lane_count = 0U;
+    index->position_offsets = NULL;
+    index->position_entries = NULL;
+    index->positions = NULL;
+    index->token_order = NULL;
+    index->token_order_count = 0U;
+    index->mapping = NULL;
+    index->mapping_size = 0U;
+    memset(&index->ann, 0, sizeof(index->ann));
+    string_arena_init(&index->strings, &index->memory);
+    index->document_capacity = 0U;
+    index->term_counts = 0;
+    index->stemming = 0;
+    index->keep_positions = 0;
+    index->quantized = 0;
+    index->removed_count = 0U;
+    index->stale_updates = 0U;
+    return index;
+}
+
+static void document_free(IndexMemory *mem, Document *doc) {
+    index_free(mem, doc->vector);
+    index_free(mem, doc->terms);
+    index_free(mem, doc->sequence);
+    memset(doc, 0, sizeof(*doc));
+}
+
+static void documents_free(IndexMemory *mem, Document *docs, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        document_free(mem, &docs[i]);
+    }
+    index_free(mem, docs);
+}
+
+static void free_lanes(KolibriKnowledgeIndex *index) {
+    index_free(&index->memory, index->lanes_block);
+    index->lanes = NULL;
+    index->qlanes = NULL;
+    index->lanes_block = NULL;
+    index->lane_count = 0U;
+}
+
+static void free_postings(KolibriKnowledgeIndex *index) {
+    IndexMemory *mem = &index->memory;
+    index_free(mem, index->posting_offsets);
+    index_free(mem, index->postings);
+    index_free(mem, index->posting_max);
+    index_free(mem, index->qpostings);
+    index_free(mem, index->doc_scales);
+    free_lanes(index);
+    index_free(mem, index->position_offsets);
+    index_free(mem, index->position_entries);
+    index_free(mem, index->positions);
+    index_free(mem, index->token_order);
+    index->posting_offsets = NULL;
+    index->postings = NULL;
+    index->posting_max = NULL;
+    index->qpostings = NULL;
+    index->doc_scales = NULL;
+    index->position_offsets = NULL;
+    index->position_entries = NULL;
+    index->positions = NULL;
+    index->token_order = NULL;
+    index->token_order_count = 0U;
+}
+
+/* Largest norm-divided weight over 255, so a document's weights quantize to 1 .. 255. */
+static float document_scale(const Document *doc) {
+    float max = 0.0f;
+    for (size_t j = 0; doc->norm != 0.0f && j < doc->vector_size; ++j) {
+        float weight = doc->vector[j].weight / doc->norm;
+        max = weight > max ? weight : max;
+    }
+    return max / 255.0f;
+}
+
+/* A stored weight never rounds to 0, so a document still matches its terms. */
+static uint32_t quantize_weight(float weight, float scale) {
+    if (!(weight > 0.0f) || !(scale > 0.0f)) {
+        return 0U;
+    }
+    double q = floor((double)weight / (double)scale + 0.5);
+    return q < 1.0 ? 1U : (q > 255.0 ? 255U : (uint32_t)q);
+}
+
+static void build_quant_lanes(KolibriKnowledgeIndex *index) {
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        QuantLanes *lanes = &index->qlanes[i];
+        size_t used = doc->norm == 0.0f ? 0U : doc->vector_size;
+        if (used > KOLIBRI_TOP_TERMS) {
+            used = KOLIBRI_TOP_TERMS;
+        }
+        for (size_t j = 0; j < KOLIBRI_TOP_TERMS; ++j) {
+            lanes->packed[j] = j < used ? (doc->vector[j].token_index << 8) |
+                                              quantize_weight(doc->vector[j].weight / doc->norm, index->doc_scales[i])
+                                        : KOLIBRI_QUANT_UNUSED;
+        }
+    }
+}
+
+static int build_doc_lanes(KolibriKnowledgeIndex *index) {
+    free_lanes(index);
+    size_t count = index->document_count ? index->document_count : 1U;
+    size_t lane_size = index->qpostings ? sizeof(QuantLanes) : sizeof(DocLanes);
+    /* The allocator promises malloc alignment only, so the block is aligned by hand. */
+    void *block = index_malloc(&index->memory, count * lane_size + _Alignof(DocLanes) - 1U);
+    if (!block) {
+        return -1;
+    }
+    uintptr_t aligned = ((uintptr_t)block + _Alignof(DocLanes) - 1U) & ~(uintptr_t)(_Alignof(DocLanes) - 1U);
+    index->lanes_block = block;
+    index->lane_count = index->document_count;
+    if (index->qpostings) {
+        index->qlanes = (QuantLanes *)aligned;
+        build_quant_lanes(index);
+        return 0;
+    }
+    index->lanes = (DocLanes *)aligned;
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        DocLanes *lanes = &index->lanes[i];
+        size_t used = doc->norm == 0.0f ? 0U : doc->vector_size;
+        if (used > KOLIBRI_TOP_TERMS) {
+            used = KOLIBRI_TOP_TERMS;
+        }
+        for (size_t j = 0; j < KOLIBRI_TOP_TERMS; ++j) {
+            lanes->ids[j] = j < used ? doc->vector[j].token_index : UINT32_MAX;
+            lanes->weights[j] = j < used ? doc->vector[j].weight / doc->norm : 0.0f;
+        }
+    }
+    return 0;
+}
+
+/* Gather kernels: out[i] is the lane weight of ids[i] in the document, or 0. */
+static void lanes_gather_scalar(const DocLanes *lanes, const uint32_t *ids, size_t count, float *out) {
+    for (size_t i = 0; i < count; ++i) {
+        float weight = 0.0f;
+        for (size_t j = 0; j < KOLIBRI_TOP_TERMS; ++j) {
+            if (lanes->ids[j] == ids[i]) {
+                weight = lanes->weights[j];
+            }
+        }
+        out[i] = weight;
+    }
+}
+
+#if defined(KOLIBRI_LANES_AVX2)
+__attribute__((target("avx2"))) static void lanes_gather_avx2(const DocLanes *lanes,
+                                                              const uint32_t *ids,
+                                                              size_t count,
+                                                              float *out) {
+    __m256i lane_ids[KOLIBRI_TOP_TERMS / 8U];
+    __m256 lane_weights[KOLIBRI_TOP_TERMS / 8U];
+    for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 8U; ++k) {
+        lane_ids[k] = _mm256_load_si256((const __m256i *)&lanes->ids[k * 8U]);
+        lane_weights[k] = _mm256_load_ps(&lanes->weights[k * 8U]);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        __m256i needle = _mm256_set1_epi32((int)ids[i]);
+        __m256 hit = _mm256_setzero_ps();
+        for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 8U; ++k) {
+            __m256 mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(lane_ids[k], needle));
+            hit = _mm256_or_ps(hit, _mm256_and_ps(mask, lane_weights[k]));
+        }
+        /* Token ids are distinct within a document: at most one lane matches. */
+        __m128 folded = _mm_or_ps(_mm256_castps256_ps128(hit), _mm256_extractf128_ps(hit, 1));
+        folded = _mm_or_ps(folded, _mm_movehl_ps(folded, folded));
+        folded = _mm_or_ps(folded, _mm_shuffle_ps(folded, folded, 1));
+        out[i] = _mm_cvtss_f32(folded);
+    }
+}
+#elif defined(KOLIBRI_LANES_NEON)
+static void lanes_gather_neon(const DocLanes *lanes, const uint32_t *ids, size_t count, float *out) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32x4_t needle = vdupq_n_u32(ids[i]);
+        uint32x4_t hit = vdupq_n_u32(0U);
+        for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 4U; ++k) {
+            uint32x4_t mask = vceqq_u32(vld1q_u32(&lanes->ids[k * 4U]), needle);
+            hit = vorrq_u32(hit, vandq_u32(mask, vreinterpretq_u32_f32(vld1q_f32(&lanes->weights[k * 4U]))));
+        }
+        uint32x2_t folded = vorr_u32(vget_low_u32(hit), vget_high_u32(hit));
+        folded = vorr_u32(folded, vrev64_u32(folded));
+        out[i] = vget_lane_f32(vreinterpret_f32_u32(folded), 0);
+    }
+}
+#endif
+
+/* Quantized gathers: out[i] is the 8-bit lane weight of ids[i], or 0. */
+static void qlanes_gather_scalar(const QuantLanes *lanes, const uint32_t *ids, size_t count, uint32_t *out) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t weight = 0U;
+        for (size_t j = 0; j < KOLIBRI_TOP_TERMS; ++j) {
+            if ((lanes->packed[j] >> 8) == ids[i]) {
+                weight = lanes->packed[j] & 0xFFU;
+            }
+        }
+        out[i] = weight;
+    }
+}
+
+#if defined(KOLIBRI_LANES_AVX2)
+__attribute__((target("avx2"))) static void qlanes_gather_avx2(const QuantLanes *lanes,
+                                                               const uint32_t *ids,
+                                                               size_t count,
+                                                               uint32_t *out) {
+    __m256i packed[KOLIBRI_TOP_TERMS / 8U];
+    __m256i keys[KOLIBRI_TOP_TERMS / 8U];
+    __m256i id_mask = _mm256_set1_epi32((int)0xFFFFFF00U);
+    for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 8U; ++k) {
+        packed[k] = _mm256_load_si256((const __m256i *)&lanes->packed[k * 8U]);
+        keys[k] = _mm256_and_si256(packed[k], id_mask);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        __m256i needle = _mm256_set1_epi32((int)(ids[i] << 8));
+        __m256i hit = _mm256_setzero_si256();
+        for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 8U; ++k) {
+            hit = _mm256_or_si256(hit, _mm256_and_si256(_mm256_cmpeq_epi32(keys[k], needle), packed[k]));
+        }
+        __m128i folded = _mm_or_si128(_mm256_castsi256_si128(hit), _mm256_extracti128_si256(hit, 1));
+        folded = _mm_or_si128(folded, _mm_unpackhi_epi64(folded, folded));
+        folded = _mm_or_si128(folded, _mm_shuffle_epi32(folded, 1));
+        out[i] = (uint32_t)_mm_cvtsi128_si32(folded) & 0xFFU;
+    }
+}
+#elif defined(KOLIBRI_LANES_NEON)
+static void qlanes_gather_neon(const QuantLanes *lanes, const uint32_t *ids, size_t count, uint32_t *out) {
+    uint32x4_t id_mask = vdupq_n_u32(0xFFFFFF00U);
+    for (size_t i = 0; i < count; ++i) {
+        uint32x4_t needle = vdupq_n_u32(ids[i] << 8);
+        uint32x4_t hit = vdupq_n_u32(0U);
+        for (size_t k = 0; k < KOLIBRI_TOP_TERMS / 4U; ++k) {
+            uint32x4_t packed = vld1q_u32(&lanes->packed[k * 4U]);
+            hit = vorrq_u32(hit, vandq_u32(vceqq_u32(vandq_u32(packed, id_mask), needle), packed));
+        }
+        uint32x2_t folded = vorr_u32(vget_low_u32(hit), vget_high_u32(hit));
+        folded = vorr_u32(folded, vrev64_u32(folded));
+        out[i] = vget_lane_u32(folded, 0) & 0xFFU;
+    }
+}
+#endif
+
+/* Dot product kernels for the embedding graph. */
+static float dot_scalar(const float *a, const float *b, size_t dim) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < dim; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if defined(KOLIBRI_LANES_AVX2)
+__attribute__((target("avx2,fma"))) static float dot_avx2(const float *a, const float *b, size_t dim) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16U <= dim; i += 16U) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8U), _mm256_loadu_ps(b + i + 8U), acc1);
+    }
+    if (i + 8U <= dim) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        i += 8U;
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    folded = _mm_add_ps(folded, _mm_movehl_ps(folded, folded));
+    folded = _mm_add_ss(folded, _mm_shuffle_ps(folded, folded, 1));
+    float sum = _mm_cvtss_f32(folded);
+    for (; i < dim; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+#elif defined(KOLIBRI_LANES_NEON)
+static float dot_neon(const float *a, const float *b, size_t dim) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8U <= dim; i += 8U) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4U), vld1q_f32(b + i + 4U));
+    }
+    if (i + 4U <= dim) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        i += 4U;
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < dim; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+#endif
+
+static void (*kolibri_lanes_gather)(const DocLanes *, const uint32_t *, size_t, float *) = lanes_gather_scalar;
+static void (*kolibri_qlanes_gather)(const QuantLanes *, const uint32_t *, size_t, uint32_t *) = qlanes_gather_scalar;
+static float (*kolibri_dot)(const float *, const float *, size_t) = dot_scalar;
+static pthread_once_t kolibri_kernels_once = PTHREAD_ONCE_INIT;
+
+static void kernels_select(void) {
+    const char *override = getenv("KOLIBRI_KNOWLEDGE_SIMD");
+    if (override && strcmp(override, "scalar") == 0) {
+        return;
+    }
+#if defined(KOLIBRI_LANES_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kolibri_lanes_gather = lanes_gather_avx2;
+        kolibri_qlanes_gather = qlanes_gather_avx2;
+        if (__builtin_cpu_supports("fma")) {
+            kolibri_dot = dot_avx2;
+        }
+    }
+#elif defined(KOLIBRI_LANES_NEON)
+    kolibri_lanes_gather = lanes_gather_neon;
+    kolibri_qlanes_gather = qlanes_gather_neon;
+    kolibri_dot = dot_neon;
+#endif
+}
+
+/* Counting sort of document vectors into per-token lists ordered by doc id. */
+/* Inverts the document sequences: per token, the documents it occurs in
+ * (ascending) and, per document, its positions (ascending). */
+static int build_positions(KolibriKnowledgeIndex *index) {
+    IndexMemory *mem = &index->memory;
+    size_t token_count = index->token_count;
+    size_t slots = token_count ? token_count : 1U;
+    index->position_offsets = (size_t *)index_calloc(mem, token_count + 1U, sizeof(size_t));
+    uint32_t *last_doc = (uint32_t *)index_malloc(mem, slots * sizeof(uint32_t));
+    size_t *current = (size_t *)index_calloc(mem, slots, sizeof(size_t));
+    if (!index->position_offsets || !last_doc || !current) {
+        index_free(mem, current);
+        index_free(mem, last_doc);
+        return -1;
+    }
+    memset(last_doc, 0xff, slots * sizeof(uint32_t));
+    size_t total = 0U;
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        for (size_t j = 0; j < doc->sequence_count; ++j) {
+            uint32_t t = doc->sequence[j];
+            if (last_doc[t] != (uint32_t)i) {
+                last_doc[t] = (uint32_t)i;
+                index->position_offsets[t + 1U] += 1U;
+            }
+        }
+        total += doc->sequence_count;
+    }
+    for (size_t t = 0; t < token_count; ++t) {
+        index->position_offsets[t + 1U] += index->position_offsets[t];
+    }
+    size_t entry_count = index->position_offsets[token_count];
+    index->position_entries = (PositionEntry *)index_calloc(mem, entry_count ? entry_count : 1U, sizeof(PositionEntry));
+    index->positions = (uint32_t *)index_calloc(mem, total ? total : 1U, sizeof(uint32_t));
+    if (!index->position_entries || !index->positions) {
+        index_free(mem, current);
+        index_free(mem, last_doc);
+        return -1;
+    }
+    memset(last_doc, 0xff, slots * sizeof(uint32_t));
+    for (size_t t = 0; t < token_count; ++t) {
+        current[t] = index->position_offsets[t];
+    }
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        for (size_t j = 0; j < doc->sequence_count; ++j) {
+            uint32_t t = doc->sequence[j];
+            if (last_doc[t] != (uint32_t)i) {
+                last_doc[t] = (uint32_t)i;
+                index->position_entries[current[t]++].doc = (uint32_t)i;
+            }
+            index->position_entries[current[t] - 1U].count += 1U;
+        }
+    }
+    size_t first = 0U;
+    for (size_t e = 0; e < entry_count; ++e) {
+        index->position_entries[e].first = first;
+        first += index->position_entries[e].count;
+        index->position_entries[e].count = 0U;
+    }
+    memset(last_doc, 0xff, slots * sizeof(uint32_t));
+    for (size_t t = 0; t < token_count; ++t) {
+        current[t] = index->position_offsets[t];
+    }
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        for (size_t j = 0; j < doc->sequence_count; ++j) {
+            uint32_t t = doc->sequence[j];
+            if (last_doc[t] != (uint32_t)i) {
+                last_doc[t] = (uint32_t)i;
+                current[t] += 1U;
+            }
+            PositionEntry *entry = &index->position_entries[current[t] - 1U];
+            index->positions[entry->first + entry->count++] = (uint32_t)j;
+        }
+    }
+    index_free(mem, current);
+    index_free(mem, last_doc);
+    return 0;
+}
+
+typedef struct {
+    const char *token;
+    uint32_t id;
+} TokenOrderItem;
+
+static int token_order_compare(const void *a, const void *b) {
+    return strcmp(((const TokenOrderItem *)a)->token, ((const TokenOrderItem *)b)->token);
+}
+
+static int build_token_order(KolibriKnowledgeIndex *index) {
+    size_t count = index->token_count;
+    TokenOrderItem *items = (TokenOrderItem *)index_malloc(&index->memory, (count ? count : 1U) * sizeof(TokenOrderItem));
+    if (!items) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        items[i].token = index->tokens[i].token ? index->tokens[i].token : "";
+        items[i].id = (uint32_t)i;
+    }
+    qsort(items, count, sizeof(TokenOrderItem), token_order_compare);
+    index->token_order = (uint32_t *)index_malloc(&index->memory, (count ? count : 1U) * sizeof(uint32_t));
+    if (!index->token_order) {
+        index_free(&index->memory, items);
+        return -1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        index->token_order[i] = items[i].id;
+    }
+    index->token_order_count = count;
+    index_free(&index->memory, items);
+    return 0;
+}
+
+static int build_postings_into(KolibriKnowledgeIndex *index) {
+    IndexMemory *mem = &index->memory;
+    size_t token_count = index->token_count;
+    index->posting_offsets = (size_t *)index_calloc(mem, token_count + 1U, sizeof(size_t));
+    index->posting_max = (float *)index_calloc(mem, token_count ? token_count : 1U, sizeof(float));
+    if (!index->posting_offsets || !index->posting_max) {
+        return -1;
+    }
+    size_t total = 0U;
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        if (doc->norm == 0.0f) {
+            continue;
+        }
+        for (size_t j = 0; j < doc->vector_size; ++j) {
+            index->posting_offsets[doc->vector[j].token_index + 1U] += 1U;
+            total += 1U;
+        }
+    }
+    for (size_t t = 0; t < token_count; ++t) {
+        index->posting_offsets[t + 1U] += index->posting_offsets[t];
+    }
+    /* Too many documents or tokens for 24-bit ids keep the float layout. */
+    int quantized = index->quantized && index->document_count < KOLIBRI_QUANT_ID_LIMIT &&
+                    token_count < KOLIBRI_QUANT_ID_LIMIT;
+    if (quantized) {
+        index->qpostings = (uint32_t *)index_malloc(mem, (total ? total : 1U) * sizeof(uint32_t));
+        index->doc_scales = (float *)index_malloc(mem, (index->document_count ? index->document_count : 1U) *
+                                                           sizeof(float));
+    } else {
+        index->postings = (Posting *)index_malloc(mem, (total ? total : 1U) * sizeof(Posting));
+    }
+    size_t *fill = (size_t *)index_calloc(mem, token_count ? token_count : 1U, sizeof(size_t));
+    if ((quantized ? !index->qpostings || !index->doc_scales : !index->postings) || !fill) {
+        index_free(mem, fill);
+        return -1;
+    }
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        float scale = quantized ? document_scale(doc) : 0.0f;
+        if (quantized) {
+            index->doc_scales[i] = scale;
+        }
+        if (doc->norm == 0.0f) {
+            continue;
+        }
+        for (size_t j = 0; j < doc->vector_size; ++j) {
+            size_t t = doc->vector[j].token_index;
+            float weight = doc->vector[j].weight / doc->norm;
+            size_t pos = index->posting_offsets[t] + fill[t]++;
+            if (quantized) {
+                uint32_t q = quantize_weight(weight, scale);
+                index->qpostings[pos] = ((uint32_t)i << 8) | q;
+                /* Bounds hold for the quantized scores that MaxScore compares. */
+                weight = (float)q * scale;
+            } else {
+                index->postings[pos].doc = (uint32_t)i;
+                index->postings[pos].weight = weight;
+            }
+            if (weight > index->posting_max[t]) {
+                index->posting_max[t] = weight;
+            }
+        }
+    }
+    index_free(mem, fill);
+    if (build_doc_lanes(index) != 0 || build_token_order(index) != 0) {
+        return -1;
+    }
+    return index->keep_positions ? build_positions(index) : 0;
+}
+
+/* -1 without memory, leaving no postings: searches then find nothing
+ * until a rebuild succeeds. */
+static int build_postings(KolibriKnowledgeIndex *index) {
+    free_postings(index);
+    if (build_postings_into(index) != 0) {
+        free_postings(index);
+        return -1;
+    }
+    return 0;
+}
+
+/* ASCII folding table: lowercase letters and digits, 0 for separators. */
+static const unsigned char kolibri_ascii_fold[128] = {
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 0,   0,   0,   0,   0,   0,
+    0,   'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0,   0,   0,   0,   0,
+    0,   'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o',
+    'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', 0,   0,   0,   0,   0,
+};
+
+/* Decodes one UTF-8 sequence; malformed input yields 0 and consumes a byte. */
+static uint32_t utf8_decode(const unsigned char *s, size_t *out_len) {
+    size_t len;
+    uint32_t cp;
+    if (s[0] < 0xC2U || s[0] > 0xF4U) {
+        *out_len = 1U;
+        return 0U;
+    } else if (s[0] < 0xE0U) {
+        len = 2U;
+        cp = s[0] & 0x1FU;
+    } else if (s[0] < 0xF0U) {
+        len = 3U;
+        cp = s[0] & 0x0FU;
+    } else {
+        len = 4U;
+        cp = s[0] & 0x07U;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xC0U) != 0x80U) {
+            *out_len = i;
+            return 0U;
+        }
+        cp = (cp << 6) | (s[i] & 0x3FU);
+    }
+    *out_len = len;
+    if ((len == 3U && cp < 0x800U) || (len == 4U && (cp < 0x10000U || cp > 0x10FFFFU)) ||
+        (cp >= 0xD800U && cp <= 0xDFFFU)) {
+        return 0U;
+    }
+    return cp;
+}
+
+/* Simple case folding for Latin-1, Latin Extended-A and Cyrillic; returns 0
+ * for punctuation and symbols. Other scripts are kept as they are. */
+static uint32_t fold_codepoint(uint32_t cp) {
+    if (cp < 0xC0U) {
+        return 0U;
+    }
+    if (cp < 0x100U) {
+        if (cp == 0xD7U || cp == 0xF7U) {
+            return 0U;
+        }
+        return cp < 0xDFU ? cp + 0x20U : cp;
+    }
+    if (cp < 0x180U) {
+        if ((cp < 0x138U || (cp >= 0x14AU && cp < 0x178U)) && (cp & 1U) == 0U) {
+            return cp + 1U;
+        }
+        if (((cp >= 0x139U && cp < 0x149U) || (cp >= 0x179U && cp < 0x17FU)) && (cp & 1U) == 1U) {
+            return cp + 1U;
+        }
+        return cp == 0x178U ? 0xFFU : cp;
+    }
+    if (cp >= 0x400U && cp < 0x460U) {
+        if (cp < 0x410U) {
+            cp += 0x50U;
+        } else if (cp < 0x430U) {
+            cp += 0x20U;
+        }
+        return cp == 0x451U ? 0x435U : cp;
+    }
+    if ((cp >= 0x2000U && cp < 0x2C00U) || (cp >= 0x3000U && cp < 0x3040U) || cp == 0xFEFFU) {
+        return 0U;
+    }
+    return cp;
+}
+
+static size_t utf8_encode(uint32_t cp, char *out) {
+    if (cp < 0x80U) {
+        out[0] = (char)cp;
+        return 1U;
+    }
+    if (cp < 0x800U) {
+        out[0] = (char)(0xC0U | (cp >> 6));
+        out[1] = (char)(0x80U | (cp & 0x3FU));
+        return 2U;
+    }
+    if (cp < 0x10000U) {
+        out[0] = (char)(0xE0U | (cp >> 12));
+        out[1] = (char)(0x80U | ((cp >> 6) & 0x3FU));
+        out[2] = (char)(0x80U | (cp & 0x3FU));
+        return 3U;
+    }
+    out[0] = (char)(0xF0U | (cp >> 18));
+    out[1] = (char)(0x80U | ((cp >> 12) & 0x3FU));
+    out[2] = (char)(0x80U | ((cp >> 6) & 0x3FU));
+    out[3] = (char)(0x80U | (cp & 0x3FU));
+    return 4U;
+}
+
+static size_t utf8_length(const char *text, size_t len) {
+    size_t chars = 0U;
+    for (size_t i = 0; i < len; ++i) {
+        chars += ((unsigned char)text[i] & 0xC0U) != 0x80U;
+    }
+    return chars;
+}
+
+/* Longest first, so the first match is the longest suffix. */
+static const char *const kolibri_ru_suffixes[] = {
+    "иями", "ями", "ами", "ого", "его", "ому", "ему", "ыми", "ими", "ией",
+    "ий", "ый", "ой", "ая", "яя", "ое", "ее", "ые", "ие", "ую", "юю", "ам", "ям",
+    "ах", "ях", "ов", "ев", "ей", "ом", "ем", "ию", "ия", "ью",
+    "а", "я", "о", "е", "ы", "и", "у", "ю", "ь", "й",
+};
+
+static int token_ends_with(const char *text, size_t len, const char *suffix, size_t *out_suffix_len) {
+    size_t suffix_len = strlen(suffix);
+    if (suffix_len >= len || memcmp(text + len - suffix_len, suffix, suffix_len) != 0) {
+        return 0;
+    }
+    *out_suffix_len = suffix_len;
+    return 1;
+}
+
+/* Light stemming: strips one inflectional suffix, keeping a stem of at least
+ * three characters. Tokens are already folded. */
+static size_t stem_token(char *text, size_t len) {
+    size_t suffix_len = 0U;
+    if (len >= 2U && (unsigned char)text[0] >= 0xD0U && (unsigned char)text[0] <= 0xD1U) {
+        for (size_t i = 0; i < sizeof(kolibri_ru_suffixes) / sizeof(kolibri_ru_suffixes[0]); ++i) {
+            if (token_ends_with(text, len, kolibri_ru_suffixes[i], &suffix_len) &&
+                utf8_length(text, len - suffix_len) >= 3U) {
+                return len - suffix_len;
+            }
+        }
+        return len;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if ((unsigned char)text[i] >= 0x80U) {
+            return len;
+        }
+    }
+    if (token_ends_with(text, len, "ies", &suffix_len) && len - suffix_len >= 3U) {
+        text[len - suffix_len] = 'y';
+        return len - suffix_len + 1U;
+    }
+    if (token_ends_with(text, len, "sses", &suffix_len)) {
+        return len - 2U;
+    }
+    if ((token_ends_with(text, len, "ing", &suffix_len) || token_ends_with(text, len, "ed", &suffix_len)) &&
+        len - suffix_len >= 3U) {
+        return len - suffix_len;
+    }
+    if (len > 3U && text[len - 1U] == 's' && text[len - 2U] != 's' && text[len - 2U] != 'u' &&
+        text[len - 2U] != 'i') {
+        return len - 1U;
+    }
+    return len;
+}
+
+typedef void (*TokenSink)(void *ctx, const char *text, size_t len);
+
+/* The one tokenizer behind both indexing and queries: runs of letters and
+ * digits in text[0 .. len), case folded, optionally stemmed. */
+static void tokenize_text(const char *text, size_t len, int stemming, TokenSink sink, void *ctx) {
+    char buffer[128];
+    size_t buffer_len = 0U;
+    const unsigned char *cursor = (const unsigned char *)text;
+    const unsigned char *end = cursor + len;
+    while (1) {
+        char folded[4];
+        size_t folded_len = 0U;
+        size_t consumed = 1U;
+        if (cursor < end && *cursor < 0x80U) {
+            if (kolibri_ascii_fold[*cursor] != 0U) {
+                folded[0] = (char)kolibri_ascii_fold[*cursor];
+                folded_len = 1U;
+            }
+        } else if (cursor < end) {
+            uint32_t cp = fold_codepoint(utf8_decode(cursor, &consumed));
+            if (cp != 0U) {
+                folded_len = utf8_encode(cp, folded);
+            }
+        }
+        if (folded_len > 0U) {
+            /* Overlong tokens are cut at a character boundary. */
+            if (buffer_len + folded_len < sizeof(buffer)) {
+                memcpy(buffer + buffer_len, folded, folded_len);
+                buffer_len += folded_len;
+            }
+        } else if (buffer_len > 0U) {
+            sink(ctx, buffer, stemming ? stem_token(buffer, buffer_len) : buffer_len);
+            buffer_len = 0U;
+        }
+        if (cursor == end) {
+            break;
+        }
+        cursor += consumed > (size_t)(end - cursor) ? (size_t)(end - cursor) : consumed;
+    }
+}
+
+typedef struct {
+    BuildVocabulary *vocab;
+    DocTokenList *tokens;
+    size_t total;
+} DocumentSink;
+
+static void document_sink_add(void *ctx, const char *text, size_t len) {
+    DocumentSink *sink = (DocumentSink *)ctx;
+    size_t local = build_vocabulary_intern(sink->vocab, text, len);
+    if (local == KOLIBRI_DICT_MISSING) {
+        return;
+    }
+    doc_token_list_add(sink->tokens, local);
+    doc_token_list_record(sink->tokens, local);
+    sink->total += 1U;
+}
+
+static int parse_markdown_document(BuildVocabulary *vocab,
+                                   StringArena *strings,
+                                   const char *path,
+                                   size_t max_length,
+                                   int stemming,
+                                   Document *out_doc,
+                                   DocTokenList *out_tokens) {
+    FileText text;
+    if (file_text_open(strings->mem, path, &text) != 0) {
+        return -1;
+    }
+    const char *content = text.data;
+
+    unsigned long long hash = content_hash(content);
+    const char *title = extract_title(strings, content);
+    const char *short_content = shorten_content(strings, content, max_length);
+
+    DocumentSink sink = {vocab, out_tokens, 0U};
+    tokenize_text(content, strlen(content), stemming, document_sink_add, &sink);
+
+    file_text_close(&text);
+
+    out_doc->id = derive_id_from_path(strings, path);
+    out_doc->title = title;
+    out_doc->source = string_arena_store(strings, path, strlen(path));
+    out_doc->content = short_content;
+    out_doc->vector = NULL;
+    out_doc->vector_size = 0U;
+    out_doc->norm = 0.0f;
+    out_doc->content_hash = hash;
+    out_doc->file_size = text.file_size;
+    out_doc->file_mtime = text.file_mtime;
+    return (int)sink.total;
+}
+
+/* Without memory the document is left without a vector, flagged on mem. */
+static void compute_document_vector(IndexMemory *mem,
+                                    const GlobalToken *tokens,
+                                    const DocToken *doc_tokens,
+                                    size_t doc_token_count,
+                                    Document *doc) {
+    if (doc_token_count == 0U) {
+        return;
+    }
+    double total_terms = 0.0;
+    for (size_t i = 0; i < doc_token_count; ++i) {
+        total_terms += (double)doc_tokens[i].count;
+    }
+
+    KolibriKnowledgeVectorItem *vector = NULL;
+    size_t vector_count = 0U;
+
+    vector = (KolibriKnowledgeVectorItem *)index_malloc(mem, doc_token_count * sizeof(KolibriKnowledgeVectorItem));
+    if (!vector) {
+        return;
+    }
+
+    double norm = 0.0;
+    for (size_t i = 0; i < doc_token_count; ++i) {
+        size_t token_index = doc_tokens[i].token_index;
+        double tf = (double)doc_tokens[i].count / total_terms;
+        double weight = tf * (double)tokens[token_index].idf;
+        vector[vector_count].token_index = token_index;
+        vector[vector_count].weight = (float)weight;
+        norm += weight * weight;
+        vector_count += 1U;
+    }
+
+    if (vector_count == 0U) {
+        index_free(mem, vector);
+        doc->vector = NULL;
+        doc->vector_size = 0U;
+        doc->norm = 0.0f;
+        return;
+    }
+
+    qsort(vector, vector_count, sizeof(KolibriKnowledgeVectorItem), vector_compare);
+    if (vector_count > KOLIBRI_TOP_TERMS) {
+        vector_count = KOLIBRI_TOP_TERMS;
+    }
+
+    doc->vector = (KolibriKnowledgeVectorItem *)index_malloc(mem, vector_count * sizeof(KolibriKnowledgeVectorItem));
+    if (!doc->vector) {
+        index_free(mem, vector);
+        return;
+    }
+    memcpy(doc->vector, vector, vector_count * sizeof(KolibriKnowledgeVectorItem));
+    index_free(mem, vector);
+
+    doc->vector_size = vector_count;
+    doc->norm = (float)(sqrt(norm) ?: 1e-6);
+}
+
+/* Moves the (already global) term counts into the document. */
+static void document_keep_sequence(Document *doc, DocTokenList *list) {
+    index_free(list->mem, doc->sequence);
+    doc->sequence = list->sequence;
+    doc->sequence_count = list->sequence_count;
+    list->sequence = NULL;
+    list->sequence_count = 0U;
+    list->sequence_capacity = 0U;
+}
+
+static void document_keep_terms(Document *doc, DocTokenList *list) {
+    index_free(list->mem, doc->terms);
+    doc->terms = NULL;
+    doc->term_count = list->count;
+    if (list->count > 0U) {
+        /* A shrink that fails is no loss: the larger block is kept. */
+        DocToken *terms = (DocToken *)kolibri_mem_realloc(&list->mem->allocator, list->items,
+                                                          list->count * sizeof(DocToken));
+        doc->terms = terms ? terms : list->items;
+        list->items = NULL;
+        list->count = 0U;
+        list->capacity = 0U;
+    }
+}
+
+/* Rewrites a parsed document's vocabulary-local token ids to index ids;
+ * -1 when a token finds no memory, leaving the list half rewritten. */
+static int document_bind_tokens(KolibriKnowledgeIndex *index, const BuildVocabulary *vocab, size_t *map, DocTokenList *list) {
+    for (size_t j = 0; j < list->count; ++j) {
+        size_t local = list->items[j].token_index;
+        if (map[local] == KOLIBRI_DICT_MISSING) {
+            const char *key = vocab->keys[local];
+            map[local] = global_token_intern(index, key, strlen(key));
+            if (map[local] == KOLIBRI_DICT_MISSING) {
+                return -1;
+            }
+        }
+        list->items[j].token_index = map[local];
+    }
+    for (size_t j = 0; j < list->sequence_count; ++j) {
+        list->sequence[j] = (uint32_t)map[list->sequence[j]];
+    }
+    index_free(list->mem, list->slots);
+    list->slots = NULL;
+    list->slot_capacity = 0U;
+    return 0;
+}
+
+typedef struct {
+    const PathList *paths;
+    size_t max_length;
+    Document *documents;
+    DocTokenList *doc_tokens;
+    size_t *owners;
+    const GlobalToken *tokens;
+    IndexMemory *mem;
+    int keep_terms;
+    int stemming;
+    int keep_positions;
+    atomic_size_t next;
+    atomic_size_t prefetched; /* files before this one have had readahead requested */
+} BuildShared;
+
+typedef struct {
+    BuildShared *shared;
+    BuildVocabulary vocab;
+    StringArena strings; /* adopted by the index after the merge */
+    size_t id;
+} BuildWorker;
+
+static void *build_parse_main(void *arg) {
+    BuildWorker *worker = (BuildWorker *)arg;
+    BuildShared *shared = worker->shared;
+    size_t i;
+    while ((i = atomic_fetch_add(&shared->next, 1U)) < shared->paths->count) {
+        /* Keep up to KOLIBRI_READAHEAD_WINDOW reads in flight ahead of the parsers. */
+        size_t limit = i + KOLIBRI_READAHEAD_WINDOW;
+        if (limit > shared->paths->count) {
+            limit = shared->paths->count;
+        }
+        size_t ahead = atomic_load(&shared->prefetched);
+        while (ahead < limit) {
+            if (atomic_compare_exchange_weak(&shared->prefetched, &ahead, ahead + 1U)) {
+                if (ahead > i) {
+                    file_prefetch(shared->paths->items[ahead]);
+                }
+                ahead++;
+            }
+        }
+        doc_token_list_init(&shared->doc_tokens[i], shared->mem);
+        shared->doc_tokens[i].keep_sequence = shared->keep_positions;
+        shared->owners[i] = worker->id;
+        (void)parse_markdown_document(&worker->vocab, &worker->strings, shared->paths->items[i], shared->max_length,
+                                      shared->stemming, &shared->documents[i], &shared->doc_tokens[i]);
+    }
+    return NULL;
+}
+
+static void *build_vector_main(void *arg) {
+    BuildShared *shared = ((BuildWorker *)arg)->shared;
+    size_t i;
+    while ((i = atomic_fetch_add(&shared->next, 1U)) < shared->paths->count) {
+        DocTokenList *list = &shared->doc_tokens[i];
+        compute_document_vector(shared->mem, shared->tokens, list->items, list->count, &shared->documents[i]);
+        if (shared->keep_terms) {
+            document_keep_terms(&shared->documents[i], list);
+        }
+        doc_token_list_free(list);
+    }
+    return NULL;
+}
+
+/* Runs fn on every worker, the first one on the calling thread, which takes
+ * the whole queue when there is no memory to start the others. */
+static void build_run_workers(IndexMemory *mem, BuildWorker *workers, size_t count, void *(*fn)(void *)) {
+    pthread_t *threads = (pthread_t *)kolibri_mem_calloc(&mem->allocator, count, sizeof(pthread_t));
+    unsigned char *started = (unsigned char *)kolibri_mem_calloc(&mem->allocator, count, 1U);
+    if (!threads || !started) {
+        count = 1U;
+    }
+    for (size_t w = 1; w < count; ++w) {
+        started[w] = pthread_create(&threads[w], NULL, fn, &workers[w]) == 0;
+    }
+    fn(&workers[0]);
+    for (size_t w = 1; w < count; ++w) {
+        if (started[w]) {
+            pthread_join(threads[w], NULL);
+        }
+    }
+    index_free(mem, started);
+    index_free(mem, threads);
+}
+
+void kolibri_knowledge_index_options_init(KolibriKnowledgeIndexOptions *options) {
+    if (!options) {
+        return;
+    }
+    options->max_length = 1024U;
+    options->threads = 1U;
+    options->keep_term_counts = 0;
+    options->idf_staleness = 0.1;
+    options->stemming = 0;
+    options->keep_positions = 0;
+    options->quantize = 0;
+    options->shard_count = 0U;
+    options->shard_index = 0U;
+    options->allocator = NULL;
+}
+
+int kolibri_knowledge_index_create(const char *const *roots,
+                                   size_t root_count,
+                                   size_t max_length,
+                                   KolibriKnowledgeIndex **out_index) {
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = max_length;
+    return kolibri_knowledge_index_create_ex(roots, root_count, &options, out_index);
+}
+
+/* Parses paths into the index's documents on thread_count workers and
+ * computes their vectors; on ENOMEM whatever was built is left for
+ * kolibri_knowledge_index_destroy. */
+static int build_documents(KolibriKnowledgeIndex *index,
+                           const PathList *paths,
+                           size_t thread_count,
+                           size_t max_length) {
+    IndexMemory *mem = &index->memory;
+    if (thread_count > paths->count) {
+        thread_count = paths->count;
+    }
+    index->documents = (Document *)index_calloc(mem, paths->count, sizeof(Document));
+    BuildShared shared;
+    shared.paths = paths;
+    shared.max_length = max_length;
+    shared.documents = index->documents;
+    shared.doc_tokens = (DocTokenList *)index_calloc(mem, paths->count, sizeof(DocTokenList));
+    shared.owners = (size_t *)index_calloc(mem, paths->count, sizeof(size_t));
+    shared.tokens = NULL;
+    shared.mem = mem;
+    shared.keep_terms = index->term_counts;
+    shared.stemming = index->stemming;
+    shared.keep_positions = index->keep_positions;
+    atomic_init(&shared.next, 0U);
+    atomic_init(&shared.prefetched, 0U);
+    BuildWorker *workers = (BuildWorker *)index_calloc(mem, thread_count, sizeof(BuildWorker));
+    size_t **local_to_global = (size_t **)index_calloc(mem, thread_count, sizeof(size_t *));
+    if (!index->documents || !shared.doc_tokens || !shared.owners || !workers || !local_to_global) {
+        index_free(mem, local_to_global);
+        index_free(mem, workers);
+        index_free(mem, shared.owners);
+        index_free(mem, shared.doc_tokens);
+        return ENOMEM;
+    }
+    index->document_count = paths->count;
+    index->document_capacity = paths->count;
+    for (size_t w = 0; w < thread_count; ++w) {
+        workers[w].shared = &shared;
+        workers[w].id = w;
+        build_vocabulary_init(&workers[w].vocab, mem);
+        string_arena_init(&workers[w].strings, mem);
+    }
+    build_run_workers(mem, workers, thread_count, build_parse_main);
+
+    /* Merge in document order so token ids match a single-threaded build. */
+    int failed = index_memory_failed(mem);
+    for (size_t w = 0; w < thread_count && !failed; ++w) {
+        size_t count = workers[w].vocab.count ? workers[w].vocab.count : 1U;
+        local_to_global[w] = (size_t *)index_malloc(mem, count * sizeof(size_t));
+        if (!local_to_global[w]) {
+            failed = 1;
+            break;
+        }
+        memset(local_to_global[w], 0xff, count * sizeof(size_t));
+    }
+    for (size_t i = 0; i < paths->count && !failed; ++i) {
+        const BuildWorker *worker = &workers[shared.owners[i]];
+        DocTokenList *list = &shared.doc_tokens[i];
+        if (document_bind_tokens(index, &worker->vocab, local_to_global[worker->id], list) != 0) {
+            failed = 1;
+            break;
+        }
+        global_register_tokens(index->tokens, list);
+        document_keep_sequence(&index->documents[i], list);
+    }
+    for (size_t w = 0; w < thread_count; ++w) {
+        index_free(mem, local_to_global[w]);
+        build_vocabulary_free(&workers[w].vocab);
+        string_arena_adopt(&index->strings, &workers[w].strings);
+    }
+    index_free(mem, local_to_global);
+
+    if (!failed) {
+        compute_idf(index->tokens, index->token_count, index->document_count);
+        shared.tokens = index->tokens;
+        atomic_store(&shared.next, 0U);
+        build_run_workers(mem, workers, thread_count, build_vector_main);
+        failed = index_memory_failed(mem);
+    }
+    for (size_t i = 0; i < paths->count; ++i) {
+        doc_token_list_free(&shared.doc_tokens[i]);
+    }
+    index_free(mem, workers);
+    index_free(mem, shared.doc_tokens);
+    index_free(mem, shared.owners);
+    return failed ? ENOMEM : 0;
+}
+
+int kolibri_knowledge_index_create_ex(const char *const *roots,
+                                      size_t root_count,
+                                      const KolibriKnowledgeIndexOptions *options,
+                                      KolibriKnowledgeIndex **out_index) {
+    if (!roots || root_count == 0U || !options || !out_index ||
+        (options->shard_count > 1U && options->shard_index >= options->shard_count)) {
+        return EINVAL;
+    }
+
+    KolibriKnowledgeIndex *index = knowledge_index_new(options->allocator);
+    if (!index) {
+        return ENOMEM;
+    }
+    index->term_counts = options->keep_term_counts != 0;
+    index->stemming = options->stemming != 0;
+    index->keep_positions = options->keep_positions != 0;
+    index->quantized = options->quantize != 0;
+
+    size_t thread_count = resolve_thread_count(options->threads);
+    PathList paths;
+    path_list_init(&paths, &index->memory);
+    collect_markdown_files(roots, root_count, thread_count, &paths);
+    path_list_keep_shard(&paths, options);
+    int err = index_memory_failed(&index->memory) ? ENOMEM : 0;
+    if (err == 0 && paths.count > 0U) {
+        err = build_documents(index, &paths, thread_count, options->max_length);
+    }
+    path_list_free(&paths);
+    if (err == 0 && build_postings(index) != 0) {
+        err = ENOMEM;
+    }
+    if (err != 0) {
+        kolibri_knowledge_index_destroy(index);
+        return err;
+    }
+    *out_index = index;
+    return 0;
+}
+
+static void ann_graph_free(IndexMemory *mem, AnnGraph *graph) {
+    index_free(mem, graph->vectors);
+    index_free(mem, graph->docs);
+    index_free(mem, graph->links0);
+    index_free(mem, graph->upper_offsets);
+    index_free(mem, graph->upper);
+    memset(graph, 0, sizeof(*graph));
+}
+
+static uint32_t *ann_links(const AnnGraph *graph, uint32_t node, uint32_t level) {
+    if (level == 0U) {
+        return graph->links0 + (size_t)node * (2U * graph->m + 1U);
+    }
+    return graph->upper + graph->upper_offsets[node] + (size_t)(level - 1U) * (graph->m + 1U);
+}
+
+static float ann_distance(const AnnGraph *graph, const float *query, uint32_t node) {
+    return 1.0f - kolibri_dot(query, graph->vectors + (size_t)node * graph->dim, graph->dim);
+}
+
+/* Distance, then node id, so builds and queries are deterministic. */
+static int ann_closer(const AnnCandidate *a, const AnnCandidate *b) {
+    return a->distance < b->distance || (a->distance == b->distance && a->node < b->node);
+}
+
+static int ann_candidate_compare(const void *a, const void *b) {
+    const AnnCandidate *ca = (const AnnCandidate *)a;
+    const AnnCandidate *cb = (const AnnCandidate *)b;
+    return ann_closer(ca, cb) ? -1 : (ann_closer(cb, ca) ? 1 : 0);
+}
+
+/* Binary heaps over candidates: the closest on top, or the farthest with far_top. */
+static int ann_heap_above(const AnnCandidate *heap, size_t a, size_t b, int far_top) {
+    return far_top ? ann_closer(&heap[b], &heap[a]) : ann_closer(&heap[a], &heap[b]);
+}
+
+static void ann_heap_push(AnnCandidate *heap, size_t *count, AnnCandidate item, int far_top) {
+    size_t pos = (*count)++;
+    heap[pos] = item;
+    while (pos > 0U) {
+        size_t parent = (pos - 1U) / 2U;
+        if (!ann_heap_above(heap, pos, parent, far_top)) {
+            break;
+        }
+        AnnCandidate swap = heap[pos];
+        heap[pos] = heap[parent];
+        heap[parent] = swap;
+        pos = parent;
+    }
+}
+
+static AnnCandidate ann_heap_pop(AnnCandidate *heap, size_t *count, int far_top) {
+    AnnCandidate top = heap[0];
+    heap[0] = heap[--(*count)];
+    size_t pos = 0U;
+    while (1) {
+        size_t left = pos * 2U + 1U;
+        size_t best = pos;
+        if (left < *count && ann_heap_above(heap, left, best, far_top)) {
+            best = left;
+        }
+        if (left + 1U < *count && ann_heap_above(heap, left + 1U, best, far_top)) {
+            best = left + 1U;
+        }
+        if (best == pos) {
+            break;
+        }
+        AnnCandidate swap = heap[pos];
+        heap[pos] = heap[best];
+        heap[best] = swap;
+        pos = best;
+    }
+    return top;
+}
+
+static void ann_work_release(AnnWork *work) {
+    kolibri_mem_free(work->allocator, work->visited);
+    kolibri_mem_free(work->allocator, work->frontier);
+    kolibri_mem_free(work->allocator, work->nearest);
+    work->visited = NULL;
+    work->frontier = NULL;
+    work->nearest = NULL;
+    work->visited_capacity = 0U;
+    work->frontier_capacity = 0U;
+    work->nearest_capacity = 0U;
+}
+
+/* Readies work for node_count nodes and ef nearest; -1 without memory, the
+ * buffers that did grow are kept. */
+static int ann_work_reserve(AnnWork *work, size_t node_count, size_t ef) {
+    if (node_count > work->visited_capacity) {
+        uint32_t *visited = (uint32_t *)kolibri_mem_realloc(work->allocator, work->visited,
+                                                            node_count * sizeof(uint32_t));
+        if (!visited) {
+            return -1;
+        }
+        memset(visited + work->visited_capacity, 0, (node_count - work->visited_capacity) * sizeof(uint32_t));
+        work->visited = visited;
+        work->visited_capacity = node_count;
+    }
+    if (ef + 1U > work->nearest_capacity) {
+        AnnCandidate *nearest = (AnnCandidate *)kolibri_mem_realloc(work->allocator, work->nearest,
+                                                                    (ef + 1U) * sizeof(AnnCandidate));
+        if (!nearest) {
+            return -1;
+        }
+        work->nearest = nearest;
+        work->nearest_capacity = ef + 1U;
+    }
+    return 0;
+}
+
+static int ann_frontier_push(AnnWork *work, AnnCandidate item) {
+    if (work->frontier_count == work->frontier_capacity) {
+        size_t capacity = work->frontier_capacity ? work->frontier_capacity * 2U : 64U;
+        AnnCandidate *frontier = (AnnCandidate *)kolibri_mem_realloc(work->allocator, work->frontier,
+                                                                     capacity * sizeof(AnnCandidate));
+        if (!frontier) {
+            return -1;
+        }
+        work->frontier = frontier;
+        work->frontier_capacity = capacity;
+    }
+    ann_heap_push(work->frontier, &work->frontier_count, item, 0);
+    return 0;
+}
+
+/* Starts a layer search from the nodes left in work->nearest. */
+static void ann_restart(AnnWork *work) {
+    work->epoch += 1U;
+    if (work->epoch == 0U) {
+        memset(work->visited, 0, work->visited_capacity * sizeof(uint32_t));
+        work->epoch = 1U;
+    }
+    for (size_t i = 0; i < work->nearest_count; ++i) {
+        work->visited[work->nearest[i].node] = work->epoch;
+    }
+}
+
+/* Best-first search of one layer; leaves the ef closest nodes it reached in
+ * work->nearest. -1 without memory. */
+static int ann_search_layer(const AnnGraph *graph, AnnWork *work, const float *query, size_t ef, uint32_t level) {
+    work->frontier_count = 0U;
+    for (size_t i = 0; i < work->nearest_count; ++i) {
+        if (ann_frontier_push(work, work->nearest[i]) != 0) {
+            return -1;
+        }
+    }
+    while (work->frontier_count > 0U) {
+        AnnCandidate current = ann_heap_pop(work->frontier, &work->frontier_count, 0);
+        if (work->nearest_count >= ef && current.distance > work->nearest[0].distance) {
+            break;
+        }
+        const uint32_t *links = ann_links(graph, current.node, level);
+        for (uint32_t i = 1U; i <= links[0]; ++i) {
+            uint32_t next = links[i];
+            if (work->visited[next] == work->epoch) {
+                continue;
+            }
+            work->visited[next] = work->epoch;
+            AnnCandidate item = {ann_distance(graph, query, next), next};
+            if (work->nearest_count >= ef && !ann_closer(&item, &work->nearest[0])) {
+                continue;
+            }
+            if (ann_frontier_push(work, item) != 0) {
+                return -1;
+            }
+            ann_heap_push(work->nearest, &work->nearest_count, item, 1);
+            if (work->nearest_count > ef) {
+                (void)ann_heap_pop(work->nearest, &work->nearest_count, 1);
+            }
+        }
+    }
+    return 0;
+}
+
+/* Greedy descent through the upper layers, then the bottom one with ef. */
+static int ann_query(const AnnGraph *graph, AnnWork *work, const float *query, size_t ef) {
+    work->nearest_count = 0U;
+    AnnCandidate start = {ann_distance(graph, query, graph->entry), graph->entry};
+    ann_heap_push(work->nearest, &work->nearest_count, start, 1);
+    for (uint32_t level = graph->max_level; level > 0U; --level) {
+        ann_restart(work);
+        if (ann_search_layer(graph, work, query, 1U, level) != 0) {
+            return -1;
+        }
+    }
+    ann_restart(work);
+    return ann_search_layer(graph, work, query, ef, 0U);
+}
+
+/* Keeps a candidate only when it is closer to the base node than to every
+ * candidate kept before it, so links spread across clusters instead of
+ * bunching in the nearest one. Returns how many stay at the front. */
+static size_t ann_select(const AnnGraph *graph, AnnCandidate *candidates, size_t count, size_t max_links) {
+    qsort(candidates, count, sizeof(AnnCandidate), ann_candidate_compare);
+    size_t kept = 0U;
+    for (size_t i = 0; i < count && kept < max_links; ++i) {
+        const float *vector = graph->vectors + (size_t)candidates[i].node * graph->dim;
+        int diverse = 1;
+        for (size_t j = 0; j < kept && diverse; ++j) {
+            if (ann_distance(graph, vector, candidates[j].node) < candidates[i].distance) {
+                diverse = 0;
+            }
+        }
+        if (diverse) {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    return kept;
+}
+
+/* Adds the back link from -> to; a full list is re-selected with to among its candidates. */
+static void ann_link(const AnnGraph *graph, AnnCandidate *pool, uint32_t from, uint32_t to, uint32_t level) {
+    uint32_t *links = ann_links(graph, from, level);
+    size_t capacity = level == 0U ? 2U * graph->m : graph->m;
+    if (links[0] < capacity) {
+        links[++links[0]] = to;
+        return;
+    }
+    const float *vector = graph->vectors + (size_t)from * graph->dim;
+    for (size_t i = 0; i < capacity; ++i) {
+        pool[i].node = links[i + 1U];
+        pool[i].distance = ann_distance(graph, vector, links[i + 1U]);
+    }
+    pool[capacity].node = to;
+    pool[capacity].distance = ann_distance(graph, vector, to);
+    size_t kept = ann_select(graph, pool, capacity + 1U, capacity);
+    links[0] = (uint32_t)kept;
+    for (size_t i = 0; i < kept; ++i) {
+        links[i + 1U] = pool[i].node;
+    }
+}
+
+/* pool holds ef_construction + 1 candidates, then 2 * m + 1 for ann_link. */
+static int ann_insert(AnnGraph *graph, AnnWork *work, AnnCandidate *pool, uint32_t node, uint32_t level) {
+    const float *vector = graph->vectors + (size_t)node * graph->dim;
+    AnnCandidate *shrink = pool + graph->ef_construction + 1U;
+    work->nearest_count = 0U;
+    AnnCandidate start = {ann_distance(graph, vector, graph->entry), graph->entry};
+    ann_heap_push(work->nearest, &work->nearest_count, start, 1);
+    for (uint32_t l = graph->max_level; l > level; --l) {
+        ann_restart(work);
+        if (ann_search_layer(graph, work, vector, 1U, l) != 0) {
+            return -1;
+        }
+    }
+    for (uint32_t l = (level < graph->max_level ? level : graph->max_level) + 1U; l-- > 0U;) {
+        ann_restart(work);
+        if (ann_search_layer(graph, work, vector, graph->ef_construction, l) != 0) {
+            return -1;
+        }
+        /* nearest stays intact: it seeds the layer below. */
+        memcpy(pool, work->nearest, work->nearest_count * sizeof(AnnCandidate));
+        size_t kept = ann_select(graph, pool, work->nearest_count, graph->m);
+        uint32_t *links = ann_links(graph, node, l);
+        links[0] = (uint32_t)kept;
+        for (size_t i = 0; i < kept; ++i) {
+            links[i + 1U] = pool[i].node;
+            ann_link(graph, shrink, pool[i].node, node, l);
+        }
+    }
+    if (level > graph->max_level) {
+        graph->entry = node;
+        graph->max_level = level;
+    }
+    return 0;
+}
+
+static uint64_t ann_splitmix(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Builds a graph over rows[0 .. row_count), one per document; a NULL row,
+ * or one without a finite non-zero norm, leaves that document out. The
+ * vectors are copied and normalized. Nodes are inserted in document order
+ * on one thread, so a build is reproducible. -1 without memory.
+ */
+static int ann_graph_build(IndexMemory *mem,
+                           AnnGraph *graph,
+                           const float *const *rows,
+                           size_t row_count,
+                           size_t dim,
+                           const KolibriKnowledgeAnnOptions *options) {
+    memset(graph, 0, sizeof(*graph));
+    graph->m = options->m;
+    graph->ef_construction = options->ef_construction;
+    graph->ef_search = options->ef_search;
+    graph->seed = options->seed;
+    size_t node_count = 0U;
+    for (size_t i = 0; i < row_count; ++i) {
+        if (rows[i] && node_count < UINT32_MAX) {
+            node_count += 1U;
+        }
+    }
+    if (node_count == 0U) {
+        return 0;
+    }
+    graph->dim = dim;
+    graph->vectors = (float *)index_malloc(mem, node_count * dim * sizeof(float));
+    graph->docs = (uint32_t *)index_malloc(mem, node_count * sizeof(uint32_t));
+    graph->upper_offsets = (uint32_t *)index_malloc(mem, (node_count + 1U) * sizeof(uint32_t));
+    if (!graph->vectors || !graph->docs || !graph->upper_offsets) {
+        ann_graph_free(mem, graph);
+        return -1;
+    }
+    size_t nodes = 0U;
+    for (size_t i = 0; i < row_count && nodes < node_count; ++i) {
+        if (!rows[i]) {
+            continue;
+        }
+        double norm = 0.0;
+        for (size_t d = 0; d < dim; ++d) {
+            norm += (double)rows[i][d] * (double)rows[i][d];
+        }
+        norm = sqrt(norm);
+        if (!(norm > 0.0) || !isfinite(norm)) {
+            continue;
+        }
+        float *vector = graph->vectors + nodes * dim;
+        for (size_t d = 0; d < dim; ++d) {
+            vector[d] = (float)((double)rows[i][d] / norm);
+        }
+        graph->docs[nodes++] = (uint32_t)i;
+    }
+    graph->node_count = nodes;
+    if (nodes == 0U) {
+        ann_graph_free(mem, graph);
+        return 0;
+    }
+
+    /* Layers are drawn geometrically with ratio 1/m, as in the HNSW paper. */
+    double level_scale = 1.0 / log((double)graph->m);
+    uint64_t state = graph->seed;
+    size_t upper_count = 0U;
+    graph->upper_offsets[0] = 0U;
+    for (size_t n = 0; n < nodes; ++n) {
+        double uniform = (double)((ann_splitmix(&state) >> 11) + 1U) * (1.0 / 9007199254740992.0);
+        double drawn = -log(uniform) * level_scale;
+        uint32_t level = drawn >= (double)KOLIBRI_ANN_MAX_LEVEL ? KOLIBRI_ANN_MAX_LEVEL : (uint32_t)drawn;
+        upper_count += (size_t)level * (graph->m + 1U);
+        if (upper_count > UINT32_MAX) {
+            ann_graph_free(mem, graph);
+            return -1;
+        }
+        graph->upper_offsets[n + 1U] = (uint32_t)upper_count;
+    }
+    graph->links0 = (uint32_t *)index_calloc(mem, nodes * (2U * graph->m + 1U), sizeof(uint32_t));
+    graph->upper = (uint32_t *)index_calloc(mem, upper_count ? upper_count : 1U, sizeof(uint32_t));
+    AnnCandidate *pool = (AnnCandidate *)index_malloc(mem, (graph->ef_construction + 2U * graph->m + 2U) *
+                                                               sizeof(AnnCandidate));
+    AnnWork work;
+    memset(&work, 0, sizeof(work));
+    work.allocator = &mem->allocator;
+    int failed = !graph->links0 || !graph->upper || !pool || ann_work_reserve(&work, nodes, graph->ef_construction) != 0;
+    pthread_once(&kolibri_kernels_once, kernels_select);
+    graph->entry = 0U;
+    graph->max_level = (graph->upper_offsets[1] - graph->upper_offsets[0]) / (uint32_t)(graph->m + 1U);
+    for (size_t n = 1U; n < nodes && !failed; ++n) {
+        uint32_t level = (graph->upper_offsets[n + 1U] - graph->upper_offsets[n]) / (uint32_t)(graph->m + 1U);
+        failed = ann_insert(graph, &work, pool, (uint32_t)n, level) != 0;
+    }
+    ann_work_release(&work);
+    index_free(mem, pool);
+    if (failed) {
+        ann_graph_free(mem, graph);
+        return -1;
+    }
+    return 0;
+}
+
+/* Replaces the index graph (NULL drops it) and points documents at their rows. */
+static void index_adopt_graph(KolibriKnowledgeIndex *index, AnnGraph *graph) {
+    ann_graph_free(&index->memory, &index->ann);
+    for (size_t i = 0; i < index->document_count; ++i) {
+        index->documents[i].embedding = NULL;
+    }
+    if (!graph) {
+        return;
+    }
+    index->ann = *graph;
+    for (size_t n = 0; n < graph->node_count; ++n) {
+        index->documents[graph->docs[n]].embedding = graph->vectors + n * graph->dim;
+    }
+}
+
+/* After documents were renumbered; without memory the graph is dropped. */
+static int ann_rebuild(KolibriKnowledgeIndex *index) {
+    IndexMemory *mem = &index->memory;
+    const float **rows = (const float **)index_malloc(mem, (index->document_count ? index->document_count : 1U) *
+                                                               sizeof(const float *));
+    KolibriKnowledgeAnnOptions options = {index->ann.m, index->ann.ef_construction, index->ann.ef_search,
+                                          index->ann.seed};
+    AnnGraph graph;
+    int ok = rows != NULL;
+    if (ok) {
+        for (size_t i = 0; i < index->document_count; ++i) {
+            rows[i] = index->documents[i].embedding;
+        }
+        ok = ann_graph_build(mem, &graph, rows, index->document_count, index->ann.dim, &options) == 0;
+    }
+    index_free(mem, rows);
+    index_adopt_graph(index, ok ? &graph : NULL);
+    return ok ? 0 : -1;
+}
+
+static size_t live_document_count(const KolibriKnowledgeIndex *index) {
+    return index->document_count - index->removed_count;
+}
+
+/* ENOMEM leaves the index as it was, bar tokens and strings nothing refers to. */
+static int document_append(KolibriKnowledgeIndex *index, const char *path, size_t max_length) {
+    IndexMemory *mem = &index->memory;
+    atomic_store_explicit(&mem->failed, 0, memory_order_relaxed);
+    if (index->document_count == index->document_capacity) {
+        size_t new_cap = index->document_capacity == 0U ? 16U : index->document_capacity * 2U;
+        Document *docs = (Document *)index_realloc(mem, index->documents, new_cap * sizeof(Document));
+        if (!docs) {
+            return ENOMEM;
+        }
+        index->documents = docs;
+        index->document_capacity = new_cap;
+    }
+    Document doc;
+    memset(&doc, 0, sizeof(doc));
+    DocTokenList list;
+    doc_token_list_init(&list, mem);
+    list.keep_sequence = index->keep_positions;
+    BuildVocabulary vocab;
+    build_vocabulary_init(&vocab, mem);
+    if (parse_markdown_document(&vocab, &index->strings, path, max_length, index->stemming, &doc, &list) < 0) {
+        doc_token_list_free(&list);
+        build_vocabulary_free(&vocab);
+        return errno ? errno : EIO;
+    }
+    size_t *map = (size_t *)index_malloc(mem, (vocab.count ? vocab.count : 1U) * sizeof(size_t));
+    size_t first_new_token = index->token_count;
+    int failed = !map || index_memory_failed(mem);
+    if (!failed) {
+        memset(map, 0xff, (vocab.count ? vocab.count : 1U) * sizeof(size_t));
+        failed = document_bind_tokens(index, &vocab, map, &list) != 0;
+    }
+    index_free(mem, map);
+    build_vocabulary_free(&vocab);
+    if (failed) {
+        doc_token_list_free(&list);
+        return ENOMEM;
+    }
+    document_keep_sequence(&doc, &list);
+    global_register_tokens(index->tokens, &list);
+
+    /* Known tokens keep their IDF until the next renormalization; new ones
+     * are weighted against the current corpus size straight away. */
+    compute_idf(index->tokens + first_new_token, index->token_count - first_new_token,
+                live_document_count(index) + 1U);
+    compute_document_vector(mem, index->tokens, list.items, list.count, &doc);
+    if (index_memory_failed(mem)) {
+        for (size_t i = 0; i < list.count; ++i) {
+            index->tokens[list.items[i].token_index].df -= 1U;
+        }
+        doc_token_list_free(&list);
+        document_free(mem, &doc);
+        return ENOMEM;
+    }
+    document_keep_terms(&doc, &list);
+    doc_token_list_free(&list);
+    index->documents[index->document_count++] = doc;
+    index->stale_updates += 1U;
+    return 0;
+}
+
+static void document_remove_at(KolibriKnowledgeIndex *index, size_t idx) {
+    Document *doc = &index->documents[idx];
+    for (size_t i = 0; i < doc->term_count; ++i) {
+        GlobalToken *token = &index->tokens[doc->terms[i].token_index];
+        if (token->df > 0U) {
+            token->df -= 1U;
+        }
+    }
+    document_free(&index->memory, doc);
+    doc->removed = 1;
+    index->removed_count += 1U;
+    index->stale_updates += 1U;
+}
+
+static size_t find_live_document(const KolibriKnowledgeIndex *index, const char *source) {
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        if (!doc->removed && doc->source && strcmp(doc->source, source) == 0) {
+            return i;
+        }
+    }
+    return KOLIBRI_DICT_MISSING;
+}
+
+static int index_check_mutable(const KolibriKnowledgeIndex *index) {
+    if (index->mapping) {
+        return EROFS;
+    }
+    return index->term_counts ? 0 : ENOTSUP;
+}
+
+int kolibri_knowledge_index_add_document(KolibriKnowledgeIndex *index,
+                                         const char *path,
+                                         const KolibriKnowledgeIndexOptions *options) {
+    if (!index || !path || !options) {
+        return EINVAL;
+    }
+    int err = index_check_mutable(index);
+    if (err != 0) {
+        return err;
+    }
+    size_t existing = find_live_document(index, path);
+    if (existing != KOLIBRI_DICT_MISSING) {
+        document_remove_at(index, existing);
+    }
+    return document_append(index, path, options->max_length);
+}
+
+int kolibri_knowledge_index_remove_document(KolibriKnowledgeIndex *index, const char *source) {
+    if (!index || !source) {
+        return EINVAL;
+    }
+    int err = index_check_mutable(index);
+    if (err != 0) {
+        return err;
+    }
+    size_t existing = find_live_document(index, source);
+    if (existing == KOLIBRI_DICT_MISSING) {
+        return ENOENT;
+    }
+    document_remove_at(index, existing);
+    return 0;
+}
+
+int kolibri_knowledge_index_commit(KolibriKnowledgeIndex *index,
+                                   const KolibriKnowledgeIndexOptions *options) {
+    if (!index || !options) {
+        return EINVAL;
+    }
+    if (index->mapping) {
+        return EROFS;
+    }
+    int graph_err = 0;
+    if (index->removed_count > 0U) {
+        size_t live = 0U;
+        for (size_t i = 0; i < index->document_count; ++i) {
+            if (!index->documents[i].removed) {
+                index->documents[live++] = index->documents[i];
+            }
+        }
+        index->document_count = live;
+        index->removed_count = 0U;
+        /* Graph nodes name documents by their old numbers. */
+        if (index->ann.node_count > 0U && ann_rebuild(index) != 0) {
+            graph_err = ENOMEM;
+        }
+    }
+    if (index->term_counts && index->stale_updates > 0U &&
+        (double)index->stale_updates > options->idf_staleness * (double)index->document_count) {
+        atomic_store_explicit(&index->memory.failed, 0, memory_order_relaxed);
+        compute_idf(index->tokens, index->token_count, index->document_count);
+        for (size_t i = 0; i < index->document_count; ++i) {
+            Document *doc = &index->documents[i];
+            index_free(&index->memory, doc->vector);
+            doc->vector = NULL;
+            doc->vector_size = 0U;
+            doc->norm = 0.0f;
+            compute_document_vector(&index->memory, index->tokens, doc->terms, doc->term_count, doc);
+        }
+        /* Documents left without a vector are retried by the next recompute. */
+        index->stale_updates = index_memory_failed(&index->memory) ? index->document_count : 0U;
+        if (index->stale_updates > 0U) {
+            (void)build_postings(index);
+            return ENOMEM;
+        }
+    }
+    return build_postings(index) == 0 ? graph_err : ENOMEM;
+}
+
+int kolibri_knowledge_index_update(KolibriKnowledgeIndex *index,
+                                   const char *const *roots,
+                                   size_t root_count,
+                                   const KolibriKnowledgeIndexOptions *options,
+                                   size_t *out_changed) {
+    if (!index || !roots || root_count == 0U || !options ||
+        (options->shard_count > 1U && options->shard_index >= options->shard_count)) {
+        return EINVAL;
+    }
+    int err = index_check_mutable(index);
+    if (err != 0) {
+        return err;
+    }
+    if ((options->stemming != 0) != index->stemming) {
+        return EINVAL;
+    }
+    IndexMemory *mem = &index->memory;
+    atomic_store_explicit(&mem->failed, 0, memory_order_relaxed);
+    PathList paths;
+    path_list_init(&paths, mem);
+    collect_markdown_files(roots, root_count, resolve_thread_count(options->threads), &paths);
+    path_list_keep_shard(&paths, options);
+
+    size_t known = index->document_count;
+    TokenDict by_source;
+    token_dict_init(&by_source, mem);
+    for (size_t i = 0; i < known; ++i) {
+        const Document *doc = &index->documents[i];
+        if (!doc->removed && doc->source) {
+            token_dict_intern(&by_source, doc->source, strlen(doc->source), i, NULL);
+        }
+    }
+    unsigned char *seen = (unsigned char *)index_calloc(mem, known ? known : 1U, 1U);
+    /* A partial crawl or source map would remove documents that still exist. */
+    if (index_memory_failed(mem)) {
+        index_free(mem, seen);
+        token_dict_free(&by_source);
+        path_list_free(&paths);
+        if (out_changed) {
+            *out_changed = 0U;
+        }
+        return ENOMEM;
+    }
+    size_t changed = 0U;
+    for (size_t p = 0; p < paths.count && err == 0; ++p) {
+        const char *path = paths.items[p];
+        size_t idx = token_dict_find(&by_source, path, strlen(path));
+        if (idx != KOLIBRI_DICT_MISSING) {
+            Document *doc = &index->documents[idx];
+            seen[idx] = 1U;
+            struct stat st;
+            if (stat(path, &st) == 0 && (unsigned long long)st.st_size == doc->file_size) {
+                if ((long long)st.st_mtime == doc->file_mtime) {
+                    continue;
+                }
+                /* Touched but possibly unchanged: the content hash decides. */
+                FileText text;
+                int same = file_text_open(mem, path, &text) == 0 && content_hash(text.data) == doc->content_hash;
+                if (text.data) {
+                    file_text_close(&text);
+                }
+                if (same) {
+                    doc->file_mtime = (long long)st.st_mtime;
+                    continue;
+                }
+            }
+            document_remove_at(index, idx);
+        }
+        int add_err = document_append(index, path, options->max_length);
+        if (add_err != 0 && add_err != ENOENT) {
+            err = add_err;
+        }
+        changed += 1U;
+    }
+    for (size_t i = 0; i < known && err == 0; ++i) {
+        if (!seen[i] && !index->documents[i].removed) {
+            document_remove_at(index, i);
+            changed += 1U;
+        }
+    }
+    index_free(mem, seen);
+    token_dict_free(&by_source);
+    path_list_free(&paths);
+    if (err == 0) {
+        err = kolibri_knowledge_index_commit(index, options);
+    }
+    if (out_changed) {
+        *out_changed = changed;
+    }
+    return err;
+}
+
+int kolibri_knowledge_index_fingerprint(const char *const *roots,
+                                        size_t root_count,
+                                        unsigned long long *out_fingerprint) {
+    if (!roots || root_count == 0U || !out_fingerprint) {
+        return EINVAL;
+    }
+    IndexMemory mem;
+    index_memory_init(&mem, NULL);
+    PathList paths;
+    path_list_init(&paths, &mem);
+    collect_markdown_files(roots, root_count, 1U, &paths);
+    if (index_memory_failed(&mem)) {
+        path_list_free(&paths);
+        return ENOMEM;
+    }
+    /* Per-file hashes are summed so readdir() order does not matter. */
+    unsigned long long fingerprint = (unsigned long long)paths.count;
+    for (size_t i = 0; i < paths.count; ++i) {
+        struct stat st;
+        unsigned long long hash = 1469598103934665603ULL;
+        for (const unsigned char *cursor = (const unsigned char *)paths.items[i]; *cursor; ++cursor) {
+            hash ^= (unsigned long long)*cursor;
+            hash *= 1099511628211ULL;
+        }
+        if (stat(paths.items[i], &st) == 0) {
+            hash ^= (unsigned long long)st.st_size * 0x9E3779B97F4A7C15ULL;
+            hash ^= (unsigned long long)st.st_mtime * 0xC2B2AE3D27D4EB4FULL;
+        }
+        fingerprint += hash;
+    }
+    path_list_free(&paths);
+    *out_fingerprint = fingerprint;
+    return 0;
+}
+
+void kolibri_knowledge_index_destroy(KolibriKnowledgeIndex *index) {
+    if (!index) {
+        return;
+    }
+    /* The index is freed last, through a copy of the allocator it holds. */
+    KolibriAllocator allocator = index->memory.allocator;
+    if (index->mapping) {
+        index_free(&index->memory, index->documents);
+        index_free(&index->memory, index->tokens);
+        free_lanes(index);
+        token_dict_free(&index->dict);
+        munmap(index->mapping, index->mapping_size);
+        kolibri_mem_free(&allocator, index);
+        return;
+    }
+    documents_free(&index->memory, index->documents, index->document_count);
+    index_free(&index->memory, index->tokens);
+    token_dict_free(&index->dict);
+    string_arena_free(&index->strings);
+    free_postings(index);
+    ann_graph_free(&index->memory, &index->ann);
+    kolibri_mem_free(&allocator, index);
+}
+
+size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index) {
+    return index ? index->document_count : 0U;
+}
+
+const KolibriKnowledgeDoc *kolibri_knowledge_index_document(const KolibriKnowledgeIndex *index,
+                                                            size_t idx) {
+    if (!index || idx >= index->document_count) {
+        return NULL;
+    }
+    return (const KolibriKnowledgeDoc *)&index->documents[idx];
+}
+
+size_t kolibri_knowledge_index_token_count(const KolibriKnowledgeIndex *index) {
+    return index ? index->token_count : 0U;
+}
+
+const KolibriKnowledgeToken *kolibri_knowledge_index_token(const KolibriKnowledgeIndex *index,
+                                                           size_t idx) {
+    if (!index || idx >= index->token_count) {
+        return NULL;
+    }
+    return (const KolibriKnowledgeToken *)&index->tokens[idx];
+}
+
+static void query_scratch_release(void *arg) {
+    QueryScratch *scratch = (QueryScratch *)arg;
+    const KolibriAllocator *allocator = &scratch->allocator;
+    kolibri_mem_free(allocator, scratch->terms);
+    kolibri_mem_free(allocator, scratch->prefix_bound);
+    kolibri_mem_free(allocator, scratch->ids);
+    kolibri_mem_free(allocator, scratch->gathered);
+    kolibri_mem_free(allocator, scratch->qgathered);
+    kolibri_mem_free(allocator, scratch->phrase_ids);
+    kolibri_mem_free(allocator, scratch->phrase_ends);
+    kolibri_mem_free(allocator, scratch->matches);
+    kolibri_mem_free(allocator, scratch->ann.visited);
+    kolibri_mem_free(allocator, scratch->ann.frontier);
+    kolibri_mem_free(allocator, scratch->ann.nearest);
+    kolibri_mem_free(allocator, scratch->ann_query);
+    kolibri_mem_free(allocator, scratch->rescore_indices);
+    kolibri_mem_free(allocator, scratch->rescore_scores);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+static void query_scratch_key_init(void) {
+    (void)pthread_key_create(&kolibri_query_scratch_key, query_scratch_release);
+}
+
+static void query_scratch_register(QueryScratch *scratch) {
+    if (!scratch->registered) {
+        pthread_once(&kolibri_query_scratch_once, query_scratch_key_init);
+        (void)pthread_setspecific(kolibri_query_scratch_key, scratch);
+        kolibri_allocator_resolve(&scratch->allocator, NULL);
+        scratch->registered = 1;
+    }
+}
+
+/* items grown to hold needed entries; NULL (and scratch->failed) without
+ * memory, items and *capacity then stay as they were. */
+static void *query_scratch_grow(QueryScratch *scratch, void *items, size_t *capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return items;
+    }
+    query_scratch_register(scratch);
+    size_t new_capacity = *capacity == 0U ? 16U : *capacity;
+    while (new_capacity < needed) {
+        new_capacity *= 2U;
+    }
+    void *grown = kolibri_mem_realloc(&scratch->allocator, items, new_capacity * item_size);
+    if (!grown) {
+        scratch->failed = 1;
+        return NULL;
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+static int query_scratch_reserve(QueryScratch *scratch, size_t count) {
+    if (count <= scratch->capacity) {
+        return 0;
+    }
+    query_scratch_register(scratch);
+    size_t capacity = scratch->capacity == 0U ? 16U : scratch->capacity;
+    while (capacity < count) {
+        capacity *= 2U;
+    }
+    /* Buffers that did grow are kept; capacity moves only once all of them have. */
+    const KolibriAllocator *allocator = &scratch->allocator;
+    QueryTerm *terms = (QueryTerm *)kolibri_mem_realloc(allocator, scratch->terms, capacity * sizeof(QueryTerm));
+    scratch->terms = terms ? terms : scratch->terms;
+    double *prefix = (double *)kolibri_mem_realloc(allocator, scratch->prefix_bound, (capacity + 1U) * sizeof(double));
+    scratch->prefix_bound = prefix ? prefix : scratch->prefix_bound;
+    uint32_t *ids = (uint32_t *)kolibri_mem_realloc(allocator, scratch->ids, capacity * sizeof(uint32_t));
+    scratch->ids = ids ? ids : scratch->ids;
+    float *gathered = (float *)kolibri_mem_realloc(allocator, scratch->gathered, capacity * sizeof(float));
+    scratch->gathered = gathered ? gathered : scratch->gathered;
+    uint32_t *qgathered = (uint32_t *)kolibri_mem_realloc(allocator, scratch->qgathered, capacity * sizeof(uint32_t));
+    scratch->qgathered = qgathered ? qgathered : scratch->qgathered;
+    if (!terms || !prefix || !ids || !gathered || !qgathered) {
+        scratch->failed = 1;
+        return -1;
+    }
+    scratch->capacity = capacity;
+    return 0;
+}
+
+static void query_add_token(QueryScratch *scratch, size_t *count, size_t token_index, double weight) {
+    /* Queries are a handful of words, a linear dedupe beats hashing here. */
+    for (size_t i = 0; i < *count; ++i) {
+        if (scratch->terms[i].token_index == token_index) {
+            scratch->terms[i].weight += weight;
+            return;
+        }
+    }
+    if (query_scratch_reserve(scratch, *count + 1U) != 0) {
+        return;
+    }
+    scratch->terms[*count].token_index = token_index;
+    scratch->terms[*count].weight = weight;
+    *count += 1U;
+}
+
+/* Dictionary tokens starting with prefix form one range of token_order. */
+static void token_prefix_range(const KolibriKnowledgeIndex *index,
+                               const char *prefix,
+                               size_t len,
+                               size_t *out_begin,
+                               size_t *out_end) {
+    size_t lo = 0U;
+    size_t hi = index->token_order_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2U;
+        if (strncmp(index->tokens[index->token_order[mid]].token, prefix, len) < 0) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    *out_begin = lo;
+    hi = index->token_order_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2U;
+        if (strncmp(index->tokens[index->token_order[mid]].token, prefix, len) <= 0) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    *out_end = lo;
+}
+
+/* Up to limit tokens of token_order[begin, end), most frequent (lowest IDF)
+ * first; ties keep dictionary order. */
+static size_t token_prefix_select(const KolibriKnowledgeIndex *index,
+                                  size_t begin,
+                                  size_t end,
+                                  size_t limit,
+                                  uint32_t *out) {
+    size_t count = 0U;
+    for (size_t i = begin; i < end && limit > 0U; ++i) {
+        uint32_t id = index->token_order[i];
+        float idf = index->tokens[id].idf;
+        if (index->term_counts && index->tokens[id].df == 0U) {
+            continue;
+        }
+        if (count == limit && idf >= index->tokens[out[count - 1U]].idf) {
+            continue;
+        }
+        size_t pos = count < limit ? count++ : limit - 1U;
+        while (pos > 0U && index->tokens[out[pos - 1U]].idf > idf) {
+            out[pos] = out[pos - 1U];
+            pos -= 1U;
+        }
+        out[pos] = id;
+    }
+    return count;
+}
+
+typedef struct {
+    const KolibriKnowledgeIndex *index;
+    QueryScratch *scratch;
+    size_t count;
+    size_t total;
+    int phrase;         /* words also extend the current phrase */
+    int phrase_missing;
+    int prefix;         /* the last word is held back for prefix expansion */
+    char pending[128];
+    size_t pending_len;
+} QuerySink;
+
+static void query_sink_term(QuerySink *sink, const char *text, size_t len) {
+    QueryScratch *scratch = sink->scratch;
+    size_t idx = token_dict_find(&sink->index->dict, text, len);
+    if (sink->phrase) {
+        size_t *ids = (size_t *)query_scratch_grow(scratch, scratch->phrase_ids, &scratch->phrase_id_capacity,
+                                                   scratch->phrase_id_count + 1U, sizeof(size_t));
+        if (ids) {
+            scratch->phrase_ids = ids;
+            scratch->phrase_ids[scratch->phrase_id_count++] = idx;
+            sink->phrase_missing |= idx == KOLIBRI_DICT_MISSING;
+        }
+    }
+    if (idx != KOLIBRI_DICT_MISSING) {
+        query_add_token(scratch, &sink->count, idx, 1.0);
+        sink->total += 1U;
+    }
+}
+
+static void query_sink_add(void *ctx, const char *text, size_t len) {
+    QuerySink *sink = (QuerySink *)ctx;
+    if (!sink->prefix) {
+        query_sink_term(sink, text, len);
+        return;
+    }
+    if (sink->pending_len > 0U) {
+        query_sink_term(sink, sink->pending, sink->pending_len);
+    }
+    memcpy(sink->pending, text, len);
+    sink->pending_len = len;
+}
+
+/* "term*" counts as one query word spread over its most frequent completions. */
+static void query_expand_prefix(QuerySink *sink) {
+    uint32_t expansions[KOLIBRI_PREFIX_EXPANSIONS];
+    size_t begin = 0U;
+    size_t end = 0U;
+    token_prefix_range(sink->index, sink->pending, sink->pending_len, &begin, &end);
+    size_t count = token_prefix_select(sink->index, begin, end, KOLIBRI_PREFIX_EXPANSIONS, expansions);
+    for (size_t i = 0; i < count; ++i) {
+        query_add_token(sink->scratch, &sink->count, expansions[i], 1.0 / (double)count);
+    }
+    sink->total += count > 0U ? 1U : 0U;
+    sink->pending_len = 0U;
+}
+
+static void query_parse_phrase(QuerySink *sink, const char *text, size_t len) {
+    QueryScratch *scratch = sink->scratch;
+    size_t first = scratch->phrase_id_count;
+    sink->phrase = 1;
+    sink->phrase_missing = 0;
+    tokenize_text(text, len, sink->index->stemming, query_sink_add, sink);
+    sink->phrase = 0;
+    size_t words = scratch->phrase_id_count - first;
+    if (words < 2U) {
+        /* A single quoted word is an ordinary term. */
+        scratch->phrase_id_count = first;
+        return;
+    }
+    if (words > KOLIBRI_PHRASE_MAX) {
+        scratch->phrase_id_count = first + KOLIBRI_PHRASE_MAX;
+    }
+    scratch->phrase_missing |= sink->phrase_missing;
+    size_t *ends = (size_t *)query_scratch_grow(scratch, scratch->phrase_ends, &scratch->phrase_capacity,
+                                                scratch->phrase_count + 1U, sizeof(size_t));
+    if (ends) {
+        scratch->phrase_ends = ends;
+        scratch->phrase_ends[scratch->phrase_count++] = scratch->phrase_id_count;
+    }
+}
+
+/* Fills scratch with the distinct query terms that have postings, weighted by
+ * tf-idf over the query norm, and with the quoted phrases; returns the term
+ * count. Words ending in '*' expand to dictionary completions. */
+static size_t tokenize_query(const KolibriKnowledgeIndex *index, const char *query, QueryScratch *scratch) {
+    QuerySink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.index = index;
+    sink.scratch = scratch;
+    scratch->phrase_id_count = 0U;
+    scratch->phrase_count = 0U;
+    scratch->phrase_missing = 0;
+    scratch->failed = 0;
+    if (!index->posting_offsets) {
+        /* Postings lost to a failed rebuild: nothing can match. */
+        return 0U;
+    }
+    const char *cursor = query;
+    while (*cursor != '\0') {
+        if (*cursor == '"') {
+            const char *close = strchr(cursor + 1, '"');
+            size_t len = close ? (size_t)(close - cursor - 1) : strlen(cursor + 1);
+            query_parse_phrase(&sink, cursor + 1, len);
+            cursor += len + (close ? 2U : 1U);
+            continue;
+        }
+        if (isspace((unsigned char)*cursor)) {
+            cursor++;
+            continue;
+        }
+        const char *word_end = cursor;
+        while (*word_end != '\0' && *word_end != '"' && !isspace((unsigned char)*word_end)) {
+            word_end++;
+        }
+        size_t len = (size_t)(word_end - cursor);
+        if (len > 1U && cursor[len - 1U] == '*') {
+            /* Completions are matched against unstemmed text. */
+            sink.prefix = 1;
+            tokenize_text(cursor, len - 1U, 0, query_sink_add, &sink);
+            sink.prefix = 0;
+            if (sink.pending_len > 0U) {
+                query_expand_prefix(&sink);
+            }
+        } else {
+            tokenize_text(cursor, len, index->stemming, query_sink_add, &sink);
+        }
+        cursor = word_end;
+    }
+    size_t count = sink.count;
+    size_t total_tokens = sink.total;
+    if (total_tokens == 0U) {
+        return 0U;
+    }
+
+    double norm = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        double tf = scratch->terms[i].weight / (double)total_tokens;
+        scratch->terms[i].weight = tf * (double)index->tokens[scratch->terms[i].token_index].idf;
+        norm += scratch->terms[i].weight * scratch->terms[i].weight;
+    }
+    norm = sqrt(norm);
+    if (norm == 0.0) {
+        return 0U;
+    }
+
+    size_t kept = 0U;
+    for (size_t i = 0; i < count; ++i) {
+        QueryTerm term = scratch->terms[i];
+        size_t begin = index->posting_offsets[term.token_index];
+        size_t end = index->posting_offsets[term.token_index + 1U];
+        if (begin == end) {
+            continue;
+        }
+        term.weight /= norm;
+        term.upper_bound = term.weight * (double)index->posting_max[term.token_index];
+        if (index->qpostings) {
+            term.qcursor = index->qpostings + begin;
+            term.qend = index->qpostings + end;
+        } else {
+            term.cursor = index->postings + begin;
+            term.end = index->postings + end;
+        }
+        scratch->terms[kept++] = term;
+    }
+    return kept;
+}
+
+static int query_term_compare(const void *a, const void *b) {
+    const QueryTerm *ta = (const QueryTerm *)a;
+    const QueryTerm *tb = (const QueryTerm *)b;
+    if (ta->upper_bound < tb->upper_bound) {
+        return -1;
+    }
+    if (ta->upper_bound > tb->upper_bound) {
+        return 1;
+    }
+    return 0;
+}
+
+/* Bounded min-heap over caller arrays: the root is the weakest kept result,
+ * ties prefer the lower document index. */
+typedef struct {
+    size_t *indices;
+    float *scores;
+    size_t count;
+    size_t limit;
+} TopK;
+
+static int topk_worse(const TopK *heap, size_t a, size_t b) {
+    if (heap->scores[a] != heap->scores[b]) {
+        return heap->scores[a] < heap->scores[b];
+    }
+    return heap->indices[a] > heap->indices[b];
+}
+
+static void topk_swap(TopK *heap, size_t a, size_t b) {
+    float score = heap->scores[a];
+    size_t idx = heap->indices[a];
+    heap->scores[a] = heap->scores[b];
+    heap->indices[a] = heap->indices[b];
+    heap->scores[b] = score;
+    heap->indices[b] = idx;
+}
+
+static void topk_sift_down(TopK *heap, size_t pos, size_t count) {
+    while (1) {
+        size_t left = pos * 2U + 1U;
+        size_t weakest = pos;
+        if (left < count && topk_worse(heap, left, weakest)) {
+            weakest = left;
+        }
+        if (left + 1U < count && topk_worse(heap, left + 1U, weakest)) {
+            weakest = left + 1U;
+        }
+        if (weakest == pos) {
+            return;
+        }
+        topk_swap(heap, pos, weakest);
+        pos = weakest;
+    }
+}
+
+static void topk_push(TopK *heap, size_t doc, float score) {
+    if (heap->count < heap->limit) {
+        size_t pos = heap->count++;
+        heap->indices[pos] = doc;
+        heap->scores[pos] = score;
+        while (pos > 0U) {
+            size_t parent = (pos - 1U) / 2U;
+            if (!topk_worse(heap, pos, parent)) {
+                break;
+            }
+            topk_swap(heap, pos, parent);
+            pos = parent;
+        }
+        return;
+    }
+    if (score < heap->scores[0] || (score == heap->scores[0] && doc >= heap->indices[0])) {
+        return;
+    }
+    heap->indices[0] = doc;
+    heap->scores[0] = score;
+    topk_sift_down(heap, 0U, heap->count);
+}
+
+static float topk_threshold(const TopK *heap) {
+    return heap->count < heap->limit ? 0.0f : heap->scores[0];
+}
+
+/* Heap-sort in place; a min-heap leaves the best result first. */
+static void topk_finish(TopK *heap) {
+    for (size_t end = heap->count; end > 1U; --end) {
+        topk_swap(heap, 0U, end - 1U);
+        topk_sift_down(heap, 0U, end - 1U);
+    }
+}
+
+static const PositionEntry *position_entry_find(const KolibriKnowledgeIndex *index, size_t token, uint32_t doc) {
+    size_t lo = index->position_offsets[token];
+    size_t hi = index->position_offsets[token + 1U];
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2U;
+        if (index->position_entries[mid].doc < doc) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < index->position_offsets[token + 1U] && index->position_entries[lo].doc == doc) {
+        return &index->position_entries[lo];
+    }
+    return NULL;
+}
+
+static int phrase_in_document(const KolibriKnowledgeIndex *index, const size_t *ids, size_t count, uint32_t doc) {
+    const PositionEntry *entries[KOLIBRI_PHRASE_MAX];
+    size_t cursors[KOLIBRI_PHRASE_MAX];
+    for (size_t i = 0; i < count; ++i) {
+        entries[i] = position_entry_find(index, ids[i], doc);
+        if (!entries[i]) {
+            return 0;
+        }
+        cursors[i] = 0U;
+    }
+    const uint32_t *starts = index->positions + entries[0]->first;
+    for (size_t k = 0; k < entries[0]->count; ++k) {
+        size_t i = 1U;
+        for (; i < count; ++i) {
+            const uint32_t *positions = index->positions + entries[i]->first;
+            uint32_t wanted = starts[k] + (uint32_t)i;
+            while (cursors[i] < entries[i]->count && positions[cursors[i]] < wanted) {
+                cursors[i]++;
+            }
+            if (cursors[i] == entries[i]->count) {
+                return 0;
+            }
+            if (positions[cursors[i]] != wanted) {
+                break;
+            }
+        }
+        if (i == count) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Documents containing every quoted phrase, ascending, in scratch->matches.
+ * The first phrase is driven by its rarest word; later ones filter. */
+static size_t phrase_matches(const KolibriKnowledgeIndex *index, QueryScratch *scratch) {
+    size_t match_count = 0U;
+    size_t begin = 0U;
+    for (size_t p = 0; p < scratch->phrase_count; ++p) {
+        const size_t *ids = scratch->phrase_ids + begin;
+        size_t count = scratch->phrase_ends[p] - begin;
+        begin = scratch->phrase_ends[p];
+        if (p == 0U) {
+            size_t rarest = ids[0];
+            for (size_t i = 1; i < count; ++i) {
+                if (index->position_offsets[ids[i] + 1U] - index->position_offsets[ids[i]] <
+                    index->position_offsets[rarest + 1U] - index->position_offsets[rarest]) {
+                    rarest = ids[i];
+                }
+            }
+            size_t first = index->position_offsets[rarest];
+            size_t last = index->position_offsets[rarest + 1U];
+            uint32_t *matches = (uint32_t *)query_scratch_grow(scratch, scratch->matches, &scratch->match_capacity,
+                                                               last - first, sizeof(uint32_t));
+            if (!matches) {
+                return 0U;
+            }
+            scratch->matches = matches;
+            for (size_t e = first; e < last; ++e) {
+                uint32_t doc = index->position_entries[e].doc;
+                if (phrase_in_document(index, ids, count, doc)) {
+                    scratch->matches[match_count++] = doc;
+                }
+            }
+        } else {
+            size_t kept = 0U;
+            for (size_t m = 0; m < match_count; ++m) {
+                if (phrase_in_document(index, ids, count, scratch->matches[m])) {
+                    scratch->matches[kept++] = scratch->matches[m];
+                }
+            }
+            match_count = kept;
+        }
+        if (match_count == 0U) {
+            break;
+        }
+    }
+    return match_count;
+}
+
+/* The float score of doc, taken from its exact vector rather than the 8-bit lanes. */
+static double document_exact_score(const Document *doc, const QueryTerm *terms, size_t term_count) {
+    double score = 0.0;
+    for (size_t i = 0; doc->norm != 0.0f && i < term_count; ++i) {
+        for (size_t j = 0; j < doc->vector_size; ++j) {
+            if (doc->vector[j].token_index == terms[i].token_index) {
+                score += terms[i].weight * (double)(doc->vector[j].weight / doc->norm);
+                break;
+            }
+        }
+    }
+    return score;
+}
+
+/* Phrase hits are few, so each is scored directly against its lanes. */
+static void search_phrases(const KolibriKnowledgeIndex *index, QueryScratch *scratch, size_t term_count, TopK *heap) {
+    if (scratch->phrase_missing) {
+        return;
+    }
+    size_t match_count = phrase_matches(index, scratch);
+    for (size_t m = 0; m < match_count; ++m) {
+        uint32_t doc = scratch->matches[m];
+        if (index->documents[doc].removed) {
+            continue;
+        }
+        double score = 0.0;
+        if (index->qlanes) {
+            score = document_exact_score(&index->documents[doc], scratch->terms, term_count);
+        } else if (term_count > 0U && doc < index->lane_count) {
+            kolibri_lanes_gather(&index->lanes[doc], scratch->ids, term_count, scratch->gathered);
+            for (size_t i = 0; i < term_count; ++i) {
+                score += scratch->terms[i].weight * (double)scratch->gathered[i];
+            }
+        }
+        topk_push(heap, doc, (float)score);
+    }
+}
+
+/* 16-bit query weights against a shared scale; the bounds become those of
+ * the integer scores. Returns the scale. */
+static double query_quantize(const KolibriKnowledgeIndex *index, QueryTerm *terms, size_t term_count) {
+    double max = 0.0;
+    for (size_t i = 0; i < term_count; ++i) {
+        max = terms[i].weight > max ? terms[i].weight : max;
+    }
+    double qscale = max > 0.0 ? max / 65535.0 : 1.0;
+    for (size_t i = 0; i < term_count; ++i) {
+        double q = terms[i].weight > 0.0 ? floor(terms[i].weight / qscale + 0.5) : 0.0;
+        terms[i].qweight = q > 65535.0 ? 65535U : (uint32_t)q;
+        if (terms[i].qweight == 0U && terms[i].weight > 0.0) {
+            terms[i].qweight = 1U;
+        }
+        terms[i].upper_bound = (double)terms[i].qweight * qscale * (double)index->posting_max[terms[i].token_index];
+    }
+    return qscale;
+}
+
+/* MaxScore over the quantized postings with integer dot products: the best
+ * KOLIBRI_RESCORE_FACTOR * limit candidates are then rescored exactly, so
+ * quantization only decides which documents reach the rescoring. */
+static int search_quantized(const KolibriKnowledgeIndex *index,
+                            QueryScratch *scratch,
+                            size_t term_count,
+                            double qscale,
+                            TopK *heap) {
+    size_t wanted = heap->limit > SIZE_MAX / KOLIBRI_RESCORE_FACTOR ? SIZE_MAX : heap->limit * KOLIBRI_RESCORE_FACTOR;
+    if (wanted > index->document_count) {
+        wanted = index->document_count > heap->limit ? index->document_count : heap->limit;
+    }
+    size_t *indices = (size_t *)query_scratch_grow(scratch, scratch->rescore_indices,
+                                                   &scratch->rescore_index_capacity, wanted, sizeof(size_t));
+    if (!indices) {
+        return ENOMEM;
+    }
+    scratch->rescore_indices = indices;
+    float *scores = (float *)query_scratch_grow(scratch, scratch->rescore_scores, &scratch->rescore_score_capacity,
+                                                wanted, sizeof(float));
+    if (!scores) {
+        return ENOMEM;
+    }
+    scratch->rescore_scores = scores;
+
+    QueryTerm *terms = scratch->terms;
+    const double *prefix_bound = scratch->prefix_bound;
+    TopK approx = {indices, scores, 0U, wanted};
+    float threshold = 0.0f;
+    size_t essential = 0U;
+    while (essential < term_count) {
+        uint32_t doc = UINT32_MAX;
+        for (size_t i = essential; i < term_count; ++i) {
+            if (terms[i].qcursor < terms[i].qend && (*terms[i].qcursor >> 8) < doc) {
+                doc = *terms[i].qcursor >> 8;
+            }
+        }
+        if (doc == UINT32_MAX) {
+            break;
+        }
+        uint64_t dot = 0U;
+        for (size_t i = essential; i < term_count; ++i) {
+            if (terms[i].qcursor < terms[i].qend && (*terms[i].qcursor >> 8) == doc) {
+                dot += (uint64_t)terms[i].qweight * (*terms[i].qcursor & 0xFFU);
+                terms[i].qcursor++;
+            }
+        }
+        double unit = qscale * (double)index->doc_scales[doc];
+        if (essential > 0U && (approx.count < wanted || (double)dot * unit + prefix_bound[essential] > (double)threshold)) {
+            kolibri_qlanes_gather(&index->qlanes[doc], scratch->ids, essential, scratch->qgathered);
+            for (size_t i = essential; i-- > 0;) {
+                if (approx.count == wanted && (double)dot * unit + prefix_bound[i + 1U] <= (double)threshold) {
+                    break;
+                }
+                dot += (uint64_t)terms[i].qweight * scratch->qgathered[i];
+            }
+        }
+        double score = (double)dot * unit;
+        if (score <= 0.0) {
+            continue;
+        }
+        if ((approx.count == wanted && score <= (double)threshold) || index->documents[doc].removed) {
+            continue;
+        }
+        topk_push(&approx, doc, (float)score);
+        threshold = topk_threshold(&approx);
+        while (essential < term_count && prefix_bound[essential + 1U] <= (double)threshold) {
+            essential += 1U;
+        }
+    }
+    for (size_t i = 0; i < approx.count; ++i) {
+        double score = document_exact_score(&index->documents[indices[i]], terms, term_count);
+        if (score > 0.0) {
+            topk_push(heap, indices[i], (float)score);
+        }
+    }
+    return 0;
+}
+
+int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
+                                   const char *query,
+                                   size_t limit,
+                                   size_t *out_indices,
+                                   float *out_scores,
+                                   size_t *out_result_count) {
+    if (!index || !query || limit == 0U || !out_indices || !out_scores || !out_result_count) {
+        return EINVAL;
+    }
+    KOLIBRI_TRACE_SCOPE("knowledge_index_search");
+    QueryScratch *scratch = &kolibri_query_scratch;
+    size_t term_count = tokenize_query(index, query, scratch);
+    int phrases = scratch->phrase_count > 0U && index->position_offsets != NULL;
+    if (scratch->failed || (term_count == 0U && !phrases)) {
+        *out_result_count = 0U;
+        return scratch->failed ? ENOMEM : 0;
+    }
+    QueryTerm *terms = scratch->terms;
+    double *prefix_bound = scratch->prefix_bound;
+    double qscale = index->qpostings ? query_quantize(index, terms, term_count) : 0.0;
+    qsort(terms, term_count, sizeof(QueryTerm), query_term_compare);
+    prefix_bound[0] = 0.0;
+    for (size_t i = 0; i < term_count; ++i) {
+        prefix_bound[i + 1U] = prefix_bound[i] + terms[i].upper_bound;
+        scratch->ids[i] = (uint32_t)terms[i].token_index;
+    }
+    pthread_once(&kolibri_kernels_once, kernels_select);
+    TopK heap = {out_indices, out_scores, 0U, limit};
+    if (phrases) {
+        search_phrases(index, scratch, term_count, &heap);
+        topk_finish(&heap);
+        *out_result_count = heap.count;
+        return scratch->failed ? ENOMEM : 0;
+    }
+    if (index->qpostings) {
+        int err = search_quantized(index, scratch, term_count, qscale, &heap);
+        topk_finish(&heap);
+        *out_result_count = err == 0 ? heap.count : 0U;
+        return err;
+    }
+
+    /* MaxScore: terms whose summed bounds cannot beat the current k-th score
+     * only refine candidates produced by the remaining (essential) terms. */
+    float threshold = 0.0f;
+    size_t essential = 0U;
+    while (essential < term_count) {
+        uint32_t doc = UINT32_MAX;
+        for (size_t i = essential; i < term_count; ++i) {
+            if (terms[i].cursor < terms[i].end && terms[i].cursor->doc < doc) {
+                doc = terms[i].cursor->doc;
+            }
+        }
+        if (doc == UINT32_MAX) {
+            break;
+        }
+        double score = 0.0;
+        for (size_t i = essential; i < term_count; ++i) {
+            if (terms[i].cursor < terms[i].end && terms[i].cursor->doc == doc) {
+                score += terms[i].weight * (double)terms[i].cursor->weight;
+                terms[i].cursor++;
+            }
+        }
+        if (essential > 0U && (heap.count < limit || score + prefix_bound[essential] > (double)threshold)) {
+            /* Non-essential terms are looked up in the candidate's own lanes. */
+            kolibri_lanes_gather(&index->lanes[doc], scratch->ids, essential, scratch->gathered);
+            for (size_t i = essential; i-- > 0;) {
+                if (heap.count == limit && score + prefix_bound[i + 1U] <= (double)threshold) {
+                    break;
+                }
+                score += terms[i].weight * (double)scratch->gathered[i];
+            }
+        }
+        if (score <= 0.0) {
+            continue;
+        }
+        if ((heap.count == limit && score <= (double)threshold) || index->documents[doc].removed) {
+            continue;
+        }
+        topk_push(&heap, doc, (float)score);
+        threshold = topk_threshold(&heap);
+        while (essential < term_count && prefix_bound[essential + 1U] <= (double)threshold) {
+            essential += 1U;
         }
     }
-    return (size_t)-1;
+    topk_finish(&heap);
+    *out_result_count = heap.count;
+    return 0;
 }
 
-static int vector_compare(const void *a, const void *b) {
-    const KolibriKnowledgeVectorItem *va = (const KolibriKnowledgeVectorItem *)a;
-    const KolibriKnowledgeVectorItem *vb = (const KolibriKnowledgeVectorItem *)b;
-    if (va->weight > vb->weight) {
-        return -1;
-    }
-    if (va->weight < vb->weight) {
-        return 1;
+typedef struct {
+    size_t token_index;
+    size_t query;
+    double weight;
+    const Posting *cursor;
+    const Posting *end;
+} BatchTerm;
+
+static int batch_term_compare(const void *a, const void *b) {
+    const BatchTerm *ta = (const BatchTerm *)a;
+    const BatchTerm *tb = (const BatchTerm *)b;
+    if (ta->token_index != tb->token_index) {
+        return ta->token_index < tb->token_index ? -1 : 1;
     }
-    return 0;
+    return ta->query < tb->query ? -1 : (ta->query > tb->query ? 1 : 0);
 }
 
-static KolibriKnowledgeIndex *knowledge_index_new(void) {
-    KolibriKnowledgeIndex *index = (KolibriKnowledgeIndex *)kolibri_alloc(sizeof(KolibriKnowledgeIndex));
-    index->documents = NULL;
-    index->document_count = 0U;
-    index->tokens = NULL;
-    index->token_count = 0U;
-    index->token_capacity = 0U;
-    return index;
-}
+typedef struct {
+    size_t first; /* range of BatchTerm sharing one token */
+    size_t last;
+    const Posting *cursor;
+    const Posting *end;
+} BatchCursor;
 
-static int parse_markdown_document(const char *path,
-                                   size_t max_length,
-                                   Document *out_doc,
-                                   DocToken **out_tokens,
-                                   size_t *out_token_count) {
-    char *content = read_file_utf8(path);
-    if (!content) {
-        return -1;
+static void batch_cursor_sift_down(BatchCursor *cursors, size_t pos, size_t count) {
+    while (1) {
+        size_t left = pos * 2U + 1U;
+        size_t lowest = pos;
+        if (left < count && cursors[left].cursor->doc < cursors[lowest].cursor->doc) {
+            lowest = left;
+        }
+        if (left + 1U < count && cursors[left + 1U].cursor->doc < cursors[lowest].cursor->doc) {
+            lowest = left + 1U;
+        }
+        if (lowest == pos) {
+            return;
+        }
+        BatchCursor tmp = cursors[pos];
+        cursors[pos] = cursors[lowest];
+        cursors[lowest] = tmp;
+        pos = lowest;
     }
+}
 
-    char *title = extract_title(content);
-    char *short_content = shorten_content(content, max_length);
-    if (!short_content) {
-        short_content = kolibri_strdup(content);
+int kolibri_knowledge_index_search_batch(const KolibriKnowledgeIndex *index,
+                                         const char *const *queries,
+                                         size_t query_count,
+                                         size_t limit,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_counts) {
+    if (!index || !queries || limit == 0U || !out_indices || !out_scores || !out_result_counts) {
+        return EINVAL;
     }
-
-    DocToken *doc_tokens = NULL;
-    size_t token_count = 0U;
-    size_t token_capacity = 0U;
-    size_t total_tokens = 0U;
-
-    char buffer[128];
-    size_t buffer_len = 0U;
-    const unsigned char *cursor = (const unsigned char *)content;
-    while (*cursor != '\0') {
-        if (isalnum(*cursor)) {
-            if (buffer_len < sizeof(buffer) - 1U) {
-                buffer[buffer_len++] = (char)tolower(*cursor);
-            }
-        } else {
-            if (buffer_len > 0U) {
-                buffer[buffer_len] = '\0';
-                doc_token_list_add(&doc_tokens, &token_count, &token_capacity, buffer);
-                total_tokens += 1U;
-                buffer_len = 0U;
-            }
+    for (size_t q = 0; q < query_count; ++q) {
+        if (!queries[q]) {
+            return EINVAL;
         }
-        cursor++;
     }
-    if (buffer_len > 0U) {
-        buffer[buffer_len] = '\0';
-        doc_token_list_add(&doc_tokens, &token_count, &token_capacity, buffer);
-        total_tokens += 1U;
+    if (query_count == 0U) {
+        return 0;
     }
 
-    free(content);
-
-    out_doc->id = derive_id_from_path(path);
-    out_doc->title = title;
-    out_doc->source = kolibri_strdup(path);
-    out_doc->content = short_content;
-    out_doc->vector = NULL;
-    out_doc->vector_size = 0U;
-    out_doc->norm = 0.0f;
-
-    *out_tokens = doc_tokens;
-    *out_token_count = token_count;
-    return (int)total_tokens;
-}
-
-static void compute_document_vector(const GlobalToken *tokens,
-                                    size_t token_count,
-                                    const DocToken *doc_tokens,
-                                    size_t doc_token_count,
-                                    size_t total_docs,
-                                    Document *doc) {
-    if (doc_token_count == 0U) {
-        return;
+    const KolibriAllocator *allocator = &index->memory.allocator;
+    QueryScratch *scratch = &kolibri_query_scratch;
+    BatchTerm *terms = NULL;
+    size_t term_count = 0U;
+    size_t term_capacity = 0U;
+    /* Phrase queries, and every query of a quantized index, are answered one
+     * by one after the shared pass. */
+    unsigned char *single = (unsigned char *)kolibri_mem_calloc(allocator, query_count, 1U);
+    if (!single) {
+        return ENOMEM;
     }
-    double total_terms = 0.0;
-    for (size_t i = 0; i < doc_token_count; ++i) {
-        total_terms += (double)doc_tokens[i].count;
+    for (size_t q = 0; q < query_count; ++q) {
+        size_t count = tokenize_query(index, queries[q], scratch);
+        if (scratch->failed) {
+            kolibri_mem_free(allocator, terms);
+            kolibri_mem_free(allocator, single);
+            return ENOMEM;
+        }
+        if ((scratch->phrase_count > 0U && index->position_offsets) || index->qpostings) {
+            single[q] = 1U;
+            continue;
+        }
+        if (term_count + count > term_capacity) {
+            term_capacity = (term_count + count) * 2U;
+            BatchTerm *grown = (BatchTerm *)kolibri_mem_realloc(allocator, terms, term_capacity * sizeof(BatchTerm));
+            if (!grown) {
+                kolibri_mem_free(allocator, terms);
+                kolibri_mem_free(allocator, single);
+                return ENOMEM;
+            }
+            terms = grown;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            BatchTerm *term = &terms[term_count++];
+            term->token_index = scratch->terms[i].token_index;
+            term->query = q;
+            term->weight = scratch->terms[i].weight;
+            term->cursor = scratch->terms[i].cursor;
+            term->end = scratch->terms[i].end;
+        }
     }
-
-    KolibriKnowledgeVectorItem *vector = NULL;
-    size_t vector_count = 0U;
-
-    vector = (KolibriKnowledgeVectorItem *)malloc(doc_token_count * sizeof(KolibriKnowledgeVectorItem));
-    if (!vector) {
-        fprintf(stderr, "[kolibri-knowledge] alloc vector failed\n");
-        abort();
+    if (term_count > 0U) {
+        qsort(terms, term_count, sizeof(BatchTerm), batch_term_compare);
     }
 
-    double norm = 0.0;
-    for (size_t i = 0; i < doc_token_count; ++i) {
-        size_t token_index = find_global_token(tokens, token_count, doc_tokens[i].token);
-        if (token_index == (size_t)-1) {
+    BatchCursor *cursors = (BatchCursor *)kolibri_mem_alloc(allocator, (term_count ? term_count : 1U) * sizeof(BatchCursor));
+    TopK *heaps = (TopK *)kolibri_mem_alloc(allocator, query_count * sizeof(TopK));
+    double *partial = (double *)kolibri_mem_calloc(allocator, query_count, sizeof(double));
+    size_t *touched = (size_t *)kolibri_mem_alloc(allocator, query_count * sizeof(size_t));
+    unsigned char *seen = (unsigned char *)kolibri_mem_calloc(allocator, query_count, 1U);
+    int err = cursors && heaps && partial && touched && seen ? 0 : ENOMEM;
+    if (err != 0) {
+        term_count = 0U;
+        query_count = 0U;
+    }
+    size_t cursor_count = 0U;
+    for (size_t i = 0; i < term_count; ++i) {
+        if (cursor_count > 0U && terms[cursors[cursor_count - 1U].first].token_index == terms[i].token_index) {
+            cursors[cursor_count - 1U].last = i + 1U;
             continue;
         }
-        double tf = (double)doc_tokens[i].count / total_terms;
-        double weight = tf * (double)tokens[token_index].idf;
-        vector[vector_count].token_index = token_index;
-        vector[vector_count].weight = (float)weight;
-        norm += weight * weight;
-        vector_count += 1U;
+        cursors[cursor_count].first = i;
+        cursors[cursor_count].last = i + 1U;
+        cursors[cursor_count].cursor = terms[i].cursor;
+        cursors[cursor_count].end = terms[i].end;
+        cursor_count += 1U;
+    }
+    for (size_t i = cursor_count / 2U; i-- > 0;) {
+        batch_cursor_sift_down(cursors, i, cursor_count);
     }
 
-    if (vector_count == 0U) {
-        free(vector);
-        doc->vector = NULL;
-        doc->vector_size = 0U;
-        doc->norm = 0.0f;
-        return;
+    for (size_t q = 0; q < query_count; ++q) {
+        heaps[q].indices = out_indices + q * limit;
+        heaps[q].scores = out_scores + q * limit;
+        heaps[q].count = 0U;
+        heaps[q].limit = limit;
     }
 
-    qsort(vector, vector_count, sizeof(KolibriKnowledgeVectorItem), vector_compare);
-    if (vector_count > KOLIBRI_TOP_TERMS) {
-        vector_count = KOLIBRI_TOP_TERMS;
+    /* Each posting of every distinct token is read exactly once; documents
+     * arrive in id order, so per-query partial sums flush on doc change. */
+    while (cursor_count > 0U) {
+        uint32_t doc = cursors[0].cursor->doc;
+        size_t touched_count = 0U;
+        while (cursor_count > 0U && cursors[0].cursor->doc == doc) {
+            BatchCursor *top = &cursors[0];
+            for (size_t i = top->first; i < top->last; ++i) {
+                size_t q = terms[i].query;
+                if (!seen[q]) {
+                    seen[q] = 1U;
+                    touched[touched_count++] = q;
+                }
+                partial[q] += terms[i].weight * (double)top->cursor->weight;
+            }
+            top->cursor++;
+            if (top->cursor == top->end) {
+                cursors[0] = cursors[--cursor_count];
+            }
+            batch_cursor_sift_down(cursors, 0U, cursor_count);
+        }
+        for (size_t i = 0; i < touched_count; ++i) {
+            size_t q = touched[i];
+            if (partial[q] > 0.0 && !index->documents[doc].removed) {
+                topk_push(&heaps[q], doc, (float)partial[q]);
+            }
+            partial[q] = 0.0;
+            seen[q] = 0U;
+        }
     }
 
-    doc->vector = (KolibriKnowledgeVectorItem *)malloc(vector_count * sizeof(KolibriKnowledgeVectorItem));
-    if (!doc->vector) {
-        fprintf(stderr, "[kolibri-knowledge] alloc doc vector failed\n");
-        abort();
+    for (size_t q = 0; q < query_count; ++q) {
+        if (single[q]) {
+            int single_err = kolibri_knowledge_index_search(index, queries[q], limit, heaps[q].indices,
+                                                            heaps[q].scores, &out_result_counts[q]);
+            if (single_err != 0) {
+                out_result_counts[q] = 0U;
+                err = single_err == ENOMEM ? ENOMEM : err;
+            }
+            continue;
+        }
+        topk_finish(&heaps[q]);
+        out_result_counts[q] = heaps[q].count;
     }
-    memcpy(doc->vector, vector, vector_count * sizeof(KolibriKnowledgeVectorItem));
-    free(vector);
+    kolibri_mem_free(allocator, single);
+    kolibri_mem_free(allocator, heaps);
+    kolibri_mem_free(allocator, partial);
+    kolibri_mem_free(allocator, touched);
+    kolibri_mem_free(allocator, seen);
+    kolibri_mem_free(allocator, cursors);
+    kolibri_mem_free(allocator, terms);
+    return err;
+}
 
-    doc->vector_size = vector_count;
-    doc->norm = (float)(sqrt(norm) ?: 1e-6);
+typedef struct {
+    char text[128];
+    size_t len;
+} LastToken;
+
+static void last_token_keep(void *ctx, const char *text, size_t len) {
+    LastToken *last = (LastToken *)ctx;
+    memcpy(last->text, text, len);
+    last->len = len;
 }
 
-int kolibri_knowledge_index_create(const char *const *roots,
-                                   size_t root_count,
-                                   size_t max_length,
-                                   KolibriKnowledgeIndex **out_index) {
-    if (!roots || root_count == 0U || !out_index) {
+int kolibri_knowledge_index_suggest(const KolibriKnowledgeIndex *index,
+                                    const char *prefix,
+                                    size_t limit,
+                                    const char **out_tokens,
+                                    size_t *out_count) {
+    if (!index || !prefix || !out_tokens || !out_count) {
         return EINVAL;
     }
-
-    PathList paths;
-    path_list_init(&paths);
-    for (size_t i = 0; i < root_count; ++i) {
-        collect_markdown_files(roots[i], &paths);
+    *out_count = 0U;
+    size_t len = strlen(prefix);
+    /* Only a word still being typed is completed. */
+    if (limit == 0U || len == 0U || isspace((unsigned char)prefix[len - 1U])) {
+        return 0;
     }
-    KolibriKnowledgeIndex *index = knowledge_index_new();
-
-    if (paths.count == 0U) {
-        path_list_free(&paths);
-        *out_index = index;
+    LastToken last;
+    last.len = 0U;
+    tokenize_text(prefix, len, 0, last_token_keep, &last);
+    if (last.len == 0U || !index->token_order) {
         return 0;
     }
-
-    index->documents = (Document *)kolibri_alloc(paths.count * sizeof(Document));
-    index->document_count = paths.count;
-
-    GlobalToken *global_tokens = NULL;
-    size_t global_token_count = 0U;
-    size_t global_token_capacity = 0U;
-
-    DocToken **all_doc_tokens = (DocToken **)kolibri_alloc(paths.count * sizeof(DocToken *));
-    size_t *doc_token_counts = (size_t *)kolibri_alloc(paths.count * sizeof(size_t));
-
-    for (size_t i = 0; i < paths.count; ++i) {
-        size_t doc_token_count = 0U;
-        DocToken *doc_tokens = NULL;
-        int total_tokens = parse_markdown_document(paths.items[i], max_length, &index->documents[i], &doc_tokens, &doc_token_count);
-        (void)total_tokens;
-        all_doc_tokens[i] = doc_tokens;
-        doc_token_counts[i] = doc_token_count;
-        if (doc_token_count > 0U) {
-            global_register_tokens(&global_tokens, &global_token_count, &global_token_capacity, doc_tokens, doc_token_count);
-        }
+    size_t begin = 0U;
+    size_t end = 0U;
+    token_prefix_range(index, last.text, last.len, &begin, &end);
+    QueryScratch *scratch = &kolibri_query_scratch;
+    uint32_t *matches = (uint32_t *)query_scratch_grow(scratch, scratch->matches, &scratch->match_capacity, limit,
+                                                       sizeof(uint32_t));
+    if (!matches) {
+        return ENOMEM;
     }
-
-    compute_idf(global_tokens, global_token_count, index->document_count);
-
-    index->tokens = global_tokens;
-    index->token_count = global_token_count;
-    index->token_capacity = global_token_capacity;
-
-    for (size_t i = 0; i < paths.count; ++i) {
-        compute_document_vector(global_tokens, global_token_count, all_doc_tokens[i], doc_token_counts[i], index->document_count, &index->documents[i]);
-        free_doc_tokens(all_doc_tokens[i], doc_token_counts[i]);
+    scratch->matches = matches;
+    size_t count = token_prefix_select(index, begin, end, limit, scratch->matches);
+    for (size_t i = 0; i < count; ++i) {
+        out_tokens[i] = index->tokens[scratch->matches[i]].token;
     }
-
-    free(all_doc_tokens);
-    free(doc_token_counts);
-    path_list_free(&paths);
-
-    *out_index = index;
+    *out_count = count;
     return 0;
 }
 
-void kolibri_knowledge_index_destroy(KolibriKnowledgeIndex *index) {
-    if (!index) {
+void kolibri_knowledge_index_ann_options_init(KolibriKnowledgeAnnOptions *options) {
+    if (!options) {
         return;
     }
-    for (size_t i = 0; i < index->document_count; ++i) {
-        free(index->documents[i].id);
-        free(index->documents[i].title);
-        free(index->documents[i].source);
-        free(index->documents[i].content);
-        free(index->documents[i].vector);
-    }
-    free(index->documents);
-    for (size_t i = 0; i < index->token_count; ++i) {
-        free(index->tokens[i].token);
-    }
-    free(index->tokens);
-    free(index);
+    options->m = 16U;
+    options->ef_construction = 200U;
+    options->ef_search = 64U;
+    options->seed = 0U;
 }
 
-size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index) {
-    return index ? index->document_count : 0U;
+void kolibri_knowledge_index_hybrid_options_init(KolibriKnowledgeHybridOptions *options) {
+    if (!options) {
+        return;
+    }
+    options->candidates = 0U;
+    options->ef = 0U;
+    options->rrf_k = 60.0f;
+    options->lexical_weight = 1.0f;
+    options->dense_weight = 1.0f;
 }
 
-const KolibriKnowledgeDoc *kolibri_knowledge_index_document(const KolibriKnowledgeIndex *index,
-                                                            size_t idx) {
-    if (!index || idx >= index->document_count) {
-        return NULL;
+static int ann_options_resolve(const KolibriKnowledgeAnnOptions *options, KolibriKnowledgeAnnOptions *out) {
+    kolibri_knowledge_index_ann_options_init(out);
+    if (options) {
+        *out = *options;
     }
-    return (const KolibriKnowledgeDoc *)&index->documents[idx];
+    if (out->m < 2U || out->m > KOLIBRI_ANN_MAX_M || out->ef_construction == 0U ||
+        out->ef_construction > KOLIBRI_ANN_MAX_EF || out->ef_search == 0U) {
+        return EINVAL;
+    }
+    return 0;
 }
 
-size_t kolibri_knowledge_index_token_count(const KolibriKnowledgeIndex *index) {
-    return index ? index->token_count : 0U;
+/* Builds from rows (one per document, tombstones already NULL) and swaps the graph in. */
+static int index_set_rows(KolibriKnowledgeIndex *index, const float **rows, size_t dim,
+                          const KolibriKnowledgeAnnOptions *options) {
+    AnnGraph graph;
+    if (ann_graph_build(&index->memory, &graph, rows, index->document_count, dim, options) != 0) {
+        return ENOMEM;
+    }
+    index_adopt_graph(index, &graph);
+    return 0;
 }
 
-const KolibriKnowledgeToken *kolibri_knowledge_index_token(const KolibriKnowledgeIndex *index,
-                                                           size_t idx) {
-    if (!index || idx >= index->token_count) {
-        return NULL;
+int kolibri_knowledge_index_set_embeddings(KolibriKnowledgeIndex *index,
+                                           const float *vectors,
+                                           size_t dim,
+                                           const KolibriKnowledgeAnnOptions *options) {
+    KolibriKnowledgeAnnOptions resolved;
+    if (!index || !vectors || dim == 0U || ann_options_resolve(options, &resolved) != 0) {
+        return EINVAL;
     }
-    return (const KolibriKnowledgeToken *)&index->tokens[idx];
+    if (index->mapping) {
+        return EROFS;
+    }
+    KOLIBRI_TRACE_SCOPE("knowledge_index_set_embeddings");
+    const float **rows = (const float **)index_malloc(&index->memory, (index->document_count ? index->document_count : 1U) *
+                                                                          sizeof(const float *));
+    if (!rows) {
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < index->document_count; ++i) {
+        rows[i] = index->documents[i].removed ? NULL : vectors + i * dim;
+    }
+    int err = index_set_rows(index, rows, dim, &resolved);
+    index_free(&index->memory, rows);
+    return err;
 }
 
-static void tokenize_query(const char *query,
-                           const GlobalToken *tokens,
-                           size_t token_count,
-                           float **out_weights,
-                           float *out_norm) {
-    float *weights = (float *)calloc(token_count, sizeof(float));
-    if (!weights) {
-        fprintf(stderr, "[kolibri-knowledge] alloc query weights failed\n");
-        abort();
+int kolibri_knowledge_index_load_embeddings(KolibriKnowledgeIndex *index,
+                                            const char *path,
+                                            const KolibriKnowledgeAnnOptions *options) {
+    KolibriKnowledgeAnnOptions resolved;
+    if (!index || !path || ann_options_resolve(options, &resolved) != 0) {
+        return EINVAL;
     }
-    double norm = 0.0;
-    size_t total_tokens = 0U;
-    char buffer[128];
-    size_t buffer_len = 0U;
-    const unsigned char *cursor = (const unsigned char *)query;
-    while (*cursor != '\0') {
-        if (isalnum(*cursor)) {
-            if (buffer_len < sizeof(buffer) - 1U) {
-                buffer[buffer_len++] = (char)tolower(*cursor);
+    if (index->mapping) {
+        return EROFS;
+    }
+    KOLIBRI_TRACE_SCOPE("knowledge_index_load_embeddings");
+    errno = 0;
+    char *text = read_file_utf8(path);
+    if (!text) {
+        return errno ? errno : EIO;
+    }
+    IndexMemory *mem = &index->memory;
+    atomic_store_explicit(&mem->failed, 0, memory_order_relaxed);
+    /* Sources win over ids when a document's id is another one's source. */
+    TokenDict keys;
+    token_dict_init(&keys, mem);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < index->document_count; ++i) {
+            const Document *doc = &index->documents[i];
+            const char *key = pass == 0 ? doc->source : doc->id;
+            if (!doc->removed && key) {
+                token_dict_intern(&keys, key, strlen(key), i, NULL);
             }
-        } else {
-            if (buffer_len > 0U) {
-                buffer[buffer_len] = '\0';
-                size_t idx = find_global_token(tokens, token_count, buffer);
-                if (idx != (size_t)-1) {
-                    weights[idx] += 1.0f;
-                    total_tokens += 1U;
+        }
+    }
+    size_t doc_slots = index->document_count ? index->document_count : 1U;
+    size_t *row_offsets = (size_t *)index_malloc(mem, doc_slots * sizeof(size_t));
+    const float **rows = (const float **)index_malloc(mem, doc_slots * sizeof(const float *));
+    float *values = NULL;
+    size_t value_count = 0U;
+    size_t value_capacity = 0U;
+    size_t dim = 0U;
+    int err = index_memory_failed(mem) ? ENOMEM : 0;
+    if (err == 0) {
+        memset(row_offsets, 0xff, doc_slots * sizeof(size_t));
+    }
+    char *cursor = text;
+    while (err == 0 && *cursor) {
+        char *line = cursor;
+        char *newline = strchr(line, '\n');
+        size_t len = newline ? (size_t)(newline - line) : strlen(line);
+        cursor = newline ? newline + 1 : line + len;
+        if (len > 0U && line[len - 1U] == '\r') {
+            len -= 1U;
+        }
+        if (len == 0U || line[0] == '#') {
+            continue;
+        }
+        line[len] = '\0';
+        char *tab = strchr(line, '\t');
+        if (!tab) {
+            err = EINVAL;
+            break;
+        }
+        size_t first = value_count;
+        char *number = tab + 1;
+        while (err == 0) {
+            while (*number == ' ' || *number == '\t') {
+                ++number;
+            }
+            if (*number == '\0') {
+                break;
+            }
+            char *end = NULL;
+            float value = strtof(number, &end);
+            if (end == number) {
+                err = EINVAL;
+                break;
+            }
+            number = end;
+            if (value_count == value_capacity) {
+                size_t capacity = value_capacity ? value_capacity * 2U : 1024U;
+                float *grown = (float *)index_realloc(mem, values, capacity * sizeof(float));
+                if (!grown) {
+                    err = ENOMEM;
+                    break;
                 }
-                buffer_len = 0U;
+                values = grown;
+                value_capacity = capacity;
             }
+            values[value_count++] = value;
         }
-        cursor++;
-    }
-    if (buffer_len > 0U) {
-        buffer[buffer_len] = '\0';
-        size_t idx = find_global_token(tokens, token_count, buffer);
-        if (idx != (size_t)-1) {
-            weights[idx] += 1.0f;
-            total_tokens += 1U;
+        size_t count = value_count - first;
+        if (err == 0 && (count == 0U || (dim != 0U && count != dim))) {
+            err = EINVAL;
+        }
+        if (err != 0) {
+            break;
+        }
+        dim = count;
+        size_t doc = token_dict_find(&keys, line, (size_t)(tab - line));
+        if (doc == KOLIBRI_DICT_MISSING) {
+            value_count = first;
+        } else {
+            row_offsets[doc] = first;
         }
     }
-
-    if (total_tokens == 0U) {
-        *out_weights = weights;
-        *out_norm = 0.0f;
-        return;
+    if (err == 0 && dim == 0U) {
+        err = EINVAL;
     }
-
-    for (size_t i = 0; i < token_count; ++i) {
-        if (weights[i] == 0.0f) {
-            continue;
+    if (err == 0) {
+        for (size_t i = 0; i < index->document_count; ++i) {
+            rows[i] = row_offsets[i] == (size_t)-1 ? NULL : values + row_offsets[i];
         }
-        double tf = (double)weights[i] / (double)total_tokens;
-        double weight = tf * (double)tokens[i].idf;
-        weights[i] = (float)weight;
-        norm += weight * weight;
+        err = index_set_rows(index, rows, dim, &resolved);
     }
+    index_free(mem, values);
+    index_free(mem, rows);
+    index_free(mem, row_offsets);
+    token_dict_free(&keys);
+    kolibri_mem_free(NULL, text);
+    return err;
+}
 
-    *out_weights = weights;
-    *out_norm = (float)(sqrt(norm) ?: 0.0);
+size_t kolibri_knowledge_index_embedding_dim(const KolibriKnowledgeIndex *index) {
+    return index ? index->ann.dim : 0U;
 }
 
-int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
-                                   const char *query,
-                                   size_t limit,
-                                   size_t *out_indices,
-                                   float *out_scores,
-                                   size_t *out_result_count) {
+int kolibri_knowledge_index_search_dense(const KolibriKnowledgeIndex *index,
+                                         const float *query,
+                                         size_t dim,
+                                         size_t limit,
+                                         size_t ef,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_count) {
     if (!index || !query || limit == 0U || !out_indices || !out_scores || !out_result_count) {
         return EINVAL;
     }
-    float *query_weights = NULL;
-    float query_norm = 0.0f;
-    tokenize_query(query, index->tokens, index->token_count, &query_weights, &query_norm);
-    if (query_norm == 0.0f) {
-        free(query_weights);
-        *out_result_count = 0U;
+    *out_result_count = 0U;
+    const AnnGraph *graph = &index->ann;
+    if (graph->node_count == 0U) {
         return 0;
     }
-
-    size_t result_count = 0U;
-    for (size_t i = 0; i < index->document_count; ++i) {
-        const Document *doc = &index->documents[i];
-        if (doc->vector_size == 0U || doc->norm == 0.0f) {
-            continue;
-        }
-        double dot = 0.0;
-        for (size_t j = 0; j < doc->vector_size; ++j) {
-            size_t token_index = doc->vector[j].token_index;
-            dot += (double)doc->vector[j].weight * (double)query_weights[token_index];
-        }
-        double score = dot / ((double)doc->norm * (double)query_norm);
-        if (score <= 0.0) {
-            continue;
-        }
-        if (result_count < limit) {
-            out_indices[result_count] = i;
-            out_scores[result_count] = (float)score;
-            result_count += 1U;
-        } else {
-            size_t min_idx = 0U;
-            for (size_t k = 1; k < limit; ++k) {
-                if (out_scores[k] < out_scores[min_idx]) {
-                    min_idx = k;
-                }
-            }
-            if (score > out_scores[min_idx]) {
-                out_indices[min_idx] = i;
-                out_scores[min_idx] = (float)score;
-            }
+    if (dim != graph->dim) {
+        return EINVAL;
+    }
+    KOLIBRI_TRACE_SCOPE("knowledge_index_search_dense");
+    QueryScratch *scratch = &kolibri_query_scratch;
+    query_scratch_register(scratch);
+    scratch->ann.allocator = &scratch->allocator;
+    if (ef == 0U) {
+        ef = graph->ef_search;
+    }
+    if (ef < limit) {
+        ef = limit;
+    }
+    float *normalized = (float *)query_scratch_grow(scratch, scratch->ann_query, &scratch->ann_query_capacity, dim,
+                                                    sizeof(float));
+    if (!normalized || ann_work_reserve(&scratch->ann, graph->node_count, ef) != 0) {
+        return ENOMEM;
+    }
+    scratch->ann_query = normalized;
+    double norm = 0.0;
+    for (size_t d = 0; d < dim; ++d) {
+        norm += (double)query[d] * (double)query[d];
+    }
+    norm = sqrt(norm);
+    if (!(norm > 0.0) || !isfinite(norm)) {
+        return 0;
+    }
+    for (size_t d = 0; d < dim; ++d) {
+        normalized[d] = (float)((double)query[d] / norm);
+    }
+    pthread_once(&kolibri_kernels_once, kernels_select);
+    if (ann_query(graph, &scratch->ann, normalized, ef) != 0) {
+        return ENOMEM;
+    }
+    TopK heap = {out_indices, out_scores, 0U, limit};
+    for (size_t i = 0; i < scratch->ann.nearest_count; ++i) {
+        const AnnCandidate *candidate = &scratch->ann.nearest[i];
+        uint32_t doc = graph->docs[candidate->node];
+        /* Removed ahead of a commit: the graph still holds the node. */
+        if (!index->documents[doc].removed) {
+            topk_push(&heap, doc, 1.0f - candidate->distance);
         }
     }
+    topk_finish(&heap);
+    *out_result_count = heap.count;
+    return 0;
+}
+
+typedef struct {
+    size_t doc;
+    float score;
+} FusedHit;
+
+static int fused_hit_compare(const void *a, const void *b) {
+    const FusedHit *ha = (const FusedHit *)a;
+    const FusedHit *hb = (const FusedHit *)b;
+    return ha->doc < hb->doc ? -1 : (ha->doc > hb->doc ? 1 : 0);
+}
 
-    for (size_t i = 0; i + 1 < result_count; ++i) {
-        for (size_t j = i + 1; j < result_count; ++j) {
-            if (out_scores[j] > out_scores[i]) {
-                float tmp_score = out_scores[i];
-                size_t tmp_idx = out_indices[i];
-                out_scores[i] = out_scores[j];
-                out_indices[i] = out_indices[j];
-                out_scores[j] = tmp_score;
-                out_indices[j] = tmp_idx;
+int kolibri_knowledge_index_search_hybrid(const KolibriKnowledgeIndex *index,
+                                          const char *query,
+                                          const float *embedding,
+                                          size_t dim,
+                                          const KolibriKnowledgeHybridOptions *options,
+                                          size_t limit,
+                                          size_t *out_indices,
+                                          float *out_scores,
+                                          size_t *out_result_count) {
+    KolibriKnowledgeHybridOptions resolved;
+    kolibri_knowledge_index_hybrid_options_init(&resolved);
+    if (options) {
+        resolved = *options;
+    }
+    if (!index || (!query && !embedding) || limit == 0U || !out_indices || !out_scores || !out_result_count ||
+        !(resolved.rrf_k >= 0.0f) || !(resolved.lexical_weight >= 0.0f) || !(resolved.dense_weight >= 0.0f) ||
+        !isfinite(resolved.rrf_k) || !isfinite(resolved.lexical_weight) || !isfinite(resolved.dense_weight)) {
+        return EINVAL;
+    }
+    *out_result_count = 0U;
+    size_t candidates = resolved.candidates;
+    if (candidates == 0U) {
+        candidates = limit > SIZE_MAX / 4U ? limit : limit * 4U;
+    }
+    if (candidates < limit) {
+        candidates = limit;
+    }
+    if (candidates > SIZE_MAX / (2U * sizeof(FusedHit))) {
+        return EINVAL;
+    }
+    KOLIBRI_TRACE_SCOPE("knowledge_index_search_hybrid");
+    const KolibriAllocator *allocator = &index->memory.allocator;
+    size_t *indices = (size_t *)kolibri_mem_alloc(allocator, 2U * candidates * sizeof(size_t));
+    float *scores = (float *)kolibri_mem_alloc(allocator, 2U * candidates * sizeof(float));
+    FusedHit *hits = (FusedHit *)kolibri_mem_alloc(allocator, 2U * candidates * sizeof(FusedHit));
+    int err = indices && scores && hits ? 0 : ENOMEM;
+    size_t lexical_count = 0U;
+    size_t dense_count = 0U;
+    if (err == 0 && query) {
+        err = kolibri_knowledge_index_search(index, query, candidates, indices, scores, &lexical_count);
+    }
+    if (err == 0 && embedding) {
+        err = kolibri_knowledge_index_search_dense(index, embedding, dim, candidates, resolved.ef,
+                                                   indices + lexical_count, scores + lexical_count, &dense_count);
+    }
+    if (err == 0) {
+        /* Ranks, not scores, are fused: cosine and TF-IDF values are not comparable. */
+        size_t count = lexical_count + dense_count;
+        for (size_t i = 0; i < count; ++i) {
+            int lexical = i < lexical_count;
+            size_t rank = lexical ? i : i - lexical_count;
+            float weight = lexical ? resolved.lexical_weight : resolved.dense_weight;
+            hits[i].doc = indices[i];
+            hits[i].score = weight / (resolved.rrf_k + (float)(rank + 1U));
+        }
+        qsort(hits, count, sizeof(FusedHit), fused_hit_compare);
+        TopK heap = {out_indices, out_scores, 0U, limit};
+        for (size_t i = 0; i < count;) {
+            size_t doc = hits[i].doc;
+            float score = 0.0f;
+            for (; i < count && hits[i].doc == doc; ++i) {
+                score += hits[i].score;
             }
+            topk_push(&heap, doc, score);
         }
+        topk_finish(&heap);
+        *out_result_count = heap.count;
     }
-
-    free(query_weights);
-    *out_result_count = result_count;
-    return 0;
+    kolibri_mem_free(allocator, indices);
+    kolibri_mem_free(allocator, scores);
+    kolibri_mem_free(allocator, hits);
+    return err;
 }
 
 static void json_escape(FILE *file, const char *text) {
@@ -739,6 +4465,9 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
     if (!index || !output_dir) {
         return EINVAL;
     }
+    if (index->removed_count > 0U) {
+        return EBUSY;
+    }
     int err = ensure_directory(output_dir);
     if (err != 0) {
         return err;
@@ -754,6 +4483,15 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
     fprintf(index_file, "{\n");
     fprintf(index_file, "  \"version\": 1,\n");
     fprintf(index_file, "  \"document_count\": %zu,\n", index->document_count);
+    if (index->stemming) {
+        fprintf(index_file, "  \"stemming\": true,\n");
+    }
+    if (index->keep_positions) {
+        fprintf(index_file, "  \"positions\": true,\n");
+    }
+    if (index->quantized) {
+        fprintf(index_file, "  \"quantized\": true,\n");
+    }
     fprintf(index_file, "  \"tokens\": [\n");
     for (size_t i = 0; i < index->token_count; ++i) {
         const GlobalToken *token = &index->tokens[i];
@@ -793,6 +4531,23 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
             fprintf(index_file, ", \"weight\": %.6f}", doc->vector[j].weight);
         }
         fprintf(index_file, "],\n");
+        if (index->term_counts) {
+            fprintf(index_file, "      \"counts\": [");
+            for (size_t j = 0; j < doc->term_count; ++j) {
+                fprintf(index_file, "%s[%zu, %zu]", j > 0 ? ", " : "", doc->terms[j].token_index, doc->terms[j].count);
+            }
+            fprintf(index_file, "],\n");
+            fprintf(index_file, "      \"size\": %llu,\n", doc->file_size);
+            fprintf(index_file, "      \"mtime\": %lld,\n", doc->file_mtime);
+            fprintf(index_file, "      \"hash\": \"%016llx\",\n", doc->content_hash);
+        }
+        if (index->keep_positions) {
+            fprintf(index_file, "      \"sequence\": [");
+            for (size_t j = 0; j < doc->sequence_count; ++j) {
+                fprintf(index_file, "%s%u", j > 0 ? ", " : "", doc->sequence[j]);
+            }
+            fprintf(index_file, "],\n");
+        }
         fprintf(index_file, "      \"norm\": %.6f\n", doc->norm);
         fprintf(index_file, "    }");
         if (i + 1 < index->document_count) {
@@ -874,7 +4629,7 @@ static char *json_parse_string(const char **cursor) {
     (*cursor)++;
     size_t capacity = 64U;
     size_t length = 0U;
-    char *buffer = (char *)malloc(capacity);
+    char *buffer = (char *)kolibri_mem_alloc(NULL, capacity);
     if (!buffer) {
         return NULL;
     }
@@ -883,7 +4638,7 @@ static char *json_parse_string(const char **cursor) {
         if (ch == '\\') {
             (*cursor)++;
             if (json_unescape_char(cursor, &ch) != 0) {
-                free(buffer);
+                kolibri_mem_free(NULL, buffer);
                 return NULL;
             }
         } else {
@@ -891,9 +4646,9 @@ static char *json_parse_string(const char **cursor) {
         }
         if (length + 1U >= capacity) {
             size_t new_capacity = capacity * 2U;
-            char *tmp = (char *)realloc(buffer, new_capacity);
+            char *tmp = (char *)kolibri_mem_realloc(NULL, buffer, new_capacity);
             if (!tmp) {
-                free(buffer);
+                kolibri_mem_free(NULL, buffer);
                 return NULL;
             }
             buffer = tmp;
@@ -902,7 +4657,7 @@ static char *json_parse_string(const char **cursor) {
         buffer[length++] = ch;
     }
     if (**cursor != '"') {
-        free(buffer);
+        kolibri_mem_free(NULL, buffer);
         return NULL;
     }
     (*cursor)++;
@@ -910,6 +4665,16 @@ static char *json_parse_string(const char **cursor) {
     return buffer;
 }
 
+static const char *json_parse_arena_string(const char **cursor, StringArena *arena) {
+    char *parsed = json_parse_string(cursor);
+    if (!parsed) {
+        return NULL;
+    }
+    const char *kept = string_arena_store(arena, parsed, strlen(parsed));
+    kolibri_mem_free(NULL, parsed);
+    return kept;
+}
+
 static double json_parse_number(const char **cursor, int *err) {
     json_skip_ws(cursor);
     char *end = NULL;
@@ -938,7 +4703,7 @@ static int json_skip_value(const char **cursor) {
                 if (!tmp) {
                     return EINVAL;
                 }
-                free(tmp);
+                kolibri_mem_free(NULL, tmp);
             } else if (**cursor == '{') {
                 depth++;
                 (*cursor)++;
@@ -960,7 +4725,7 @@ static int json_skip_value(const char **cursor) {
                 if (!tmp) {
                     return EINVAL;
                 }
-                free(tmp);
+                kolibri_mem_free(NULL, tmp);
             } else if (**cursor == '[') {
                 depth++;
                 (*cursor)++;
@@ -978,7 +4743,7 @@ static int json_skip_value(const char **cursor) {
         if (!tmp) {
             return EINVAL;
         }
-        free(tmp);
+        kolibri_mem_free(NULL, tmp);
         return 0;
     }
     if (**cursor == '-' || isdigit((unsigned char)**cursor)) {
@@ -1001,18 +4766,8 @@ static int json_skip_value(const char **cursor) {
     return EINVAL;
 }
 
-static size_t locate_token(const GlobalToken *tokens, size_t count, const char *token) {
-    for (size_t i = 0; i < count; ++i) {
-        if (tokens[i].token && strcmp(tokens[i].token, token) == 0) {
-            return i;
-        }
-    }
-    return (size_t)-1;
-}
-
 static int parse_terms_array(const char **cursor,
-                             const GlobalToken *tokens,
-                             size_t token_count,
+                             const TokenDict *dict,
                              KolibriKnowledgeVectorItem **out_items,
                              size_t *out_count) {
     if (!out_items || !out_count) {
@@ -1032,7 +4787,7 @@ static int parse_terms_array(const char **cursor,
             break;
         }
         if (json_expect(cursor, '{') != 0) {
-            free(items);
+            kolibri_mem_free(NULL, items);
             return EINVAL;
         }
         char *term_token = NULL;
@@ -1047,22 +4802,22 @@ static int parse_terms_array(const char **cursor,
             }
             char *key = json_parse_string(cursor);
             if (!key) {
-                free(term_token);
-                free(items);
+                kolibri_mem_free(NULL, term_token);
+                kolibri_mem_free(NULL, items);
                 return ENOMEM;
             }
             if (json_expect(cursor, ':') != 0) {
-                free(key);
-                free(term_token);
-                free(items);
+                kolibri_mem_free(NULL, key);
+                kolibri_mem_free(NULL, term_token);
+                kolibri_mem_free(NULL, items);
                 return EINVAL;
             }
             if (strcmp(key, "token") == 0) {
-                free(term_token);
+                kolibri_mem_free(NULL, term_token);
                 term_token = json_parse_string(cursor);
                 if (!term_token) {
-                    free(key);
-                    free(items);
+                    kolibri_mem_free(NULL, key);
+                    kolibri_mem_free(NULL, items);
                     return ENOMEM;
                 }
                 have_token = 1;
@@ -1070,21 +4825,21 @@ static int parse_terms_array(const char **cursor,
                 int err = 0;
                 weight = json_parse_number(cursor, &err);
                 if (err != 0) {
-                    free(term_token);
-                    free(key);
-                    free(items);
+                    kolibri_mem_free(NULL, term_token);
+                    kolibri_mem_free(NULL, key);
+                    kolibri_mem_free(NULL, items);
                     return err;
                 }
                 have_weight = 1;
             } else {
                 if (json_skip_value(cursor) != 0) {
-                    free(term_token);
-                    free(key);
-                    free(items);
+                    kolibri_mem_free(NULL, term_token);
+                    kolibri_mem_free(NULL, key);
+                    kolibri_mem_free(NULL, items);
                     return EINVAL;
                 }
             }
-            free(key);
+            kolibri_mem_free(NULL, key);
             json_skip_ws(cursor);
             if (**cursor == ',') {
                 (*cursor)++;
@@ -1092,14 +4847,14 @@ static int parse_terms_array(const char **cursor,
             }
         }
         if (!have_token) {
-            free(term_token);
-            free(items);
+            kolibri_mem_free(NULL, term_token);
+            kolibri_mem_free(NULL, items);
             return EINVAL;
         }
-        size_t token_index = locate_token(tokens, token_count, term_token);
-        free(term_token);
-        if (token_index == (size_t)-1) {
-            free(items);
+        size_t token_index = token_dict_find(dict, term_token, strlen(term_token));
+        kolibri_mem_free(NULL, term_token);
+        if (token_index == KOLIBRI_DICT_MISSING) {
+            kolibri_mem_free(NULL, items);
             return EINVAL;
         }
         if (!have_weight) {
@@ -1107,10 +4862,10 @@ static int parse_terms_array(const char **cursor,
         }
         if (*out_count == capacity) {
             size_t new_capacity = capacity == 0U ? 8U : capacity * 2U;
-            KolibriKnowledgeVectorItem *tmp = (KolibriKnowledgeVectorItem *)realloc(items,
+            KolibriKnowledgeVectorItem *tmp = (KolibriKnowledgeVectorItem *)kolibri_mem_realloc(NULL, items,
                                                                                    new_capacity * sizeof(*items));
             if (!tmp) {
-                free(items);
+                kolibri_mem_free(NULL, items);
                 return ENOMEM;
             }
             items = tmp;
@@ -1128,16 +4883,110 @@ static int parse_terms_array(const char **cursor,
     return 0;
 }
 
+static int parse_counts_array(const char **cursor, size_t token_count, DocToken **out_terms, size_t *out_count) {
+    *out_terms = NULL;
+    *out_count = 0U;
+    if (json_expect(cursor, '[') != 0) {
+        return EINVAL;
+    }
+    size_t capacity = 0U;
+    DocToken *terms = NULL;
+    while (1) {
+        json_skip_ws(cursor);
+        if (**cursor == ']') {
+            (*cursor)++;
+            break;
+        }
+        int err = 0;
+        int num_err = 0;
+        DocToken term;
+        if (json_expect(cursor, '[') != 0) {
+            err = EINVAL;
+        } else {
+            term.token_index = (size_t)json_parse_number(cursor, &num_err);
+            err = num_err != 0 || json_expect(cursor, ',') != 0 ? EINVAL : 0;
+        }
+        if (err == 0) {
+            term.count = (size_t)json_parse_number(cursor, &num_err);
+            err = num_err != 0 || json_expect(cursor, ']') != 0 || term.token_index >= token_count ? EINVAL : 0;
+        }
+        if (err != 0) {
+            kolibri_mem_free(NULL, terms);
+            return err;
+        }
+        if (*out_count == capacity) {
+            size_t new_capacity = capacity == 0U ? 16U : capacity * 2U;
+            DocToken *tmp = (DocToken *)kolibri_mem_realloc(NULL, terms, new_capacity * sizeof(*terms));
+            if (!tmp) {
+                kolibri_mem_free(NULL, terms);
+                return ENOMEM;
+            }
+            terms = tmp;
+            capacity = new_capacity;
+        }
+        terms[(*out_count)++] = term;
+        json_skip_ws(cursor);
+        if (**cursor == ',') {
+            (*cursor)++;
+        }
+    }
+    *out_terms = terms;
+    return 0;
+}
+
+static int parse_sequence_array(const char **cursor, size_t token_count, uint32_t **out_ids, size_t *out_count) {
+    *out_ids = NULL;
+    *out_count = 0U;
+    if (json_expect(cursor, '[') != 0) {
+        return EINVAL;
+    }
+    size_t capacity = 0U;
+    uint32_t *ids = NULL;
+    while (1) {
+        json_skip_ws(cursor);
+        if (**cursor == ']') {
+            (*cursor)++;
+            break;
+        }
+        int num_err = 0;
+        double value = json_parse_number(cursor, &num_err);
+        if (num_err != 0 || value < 0.0 || (size_t)value >= token_count) {
+            kolibri_mem_free(NULL, ids);
+            return EINVAL;
+        }
+        if (*out_count == capacity) {
+            size_t new_capacity = capacity == 0U ? 64U : capacity * 2U;
+            uint32_t *tmp = (uint32_t *)kolibri_mem_realloc(NULL, ids, new_capacity * sizeof(*ids));
+            if (!tmp) {
+                kolibri_mem_free(NULL, ids);
+                return ENOMEM;
+            }
+            ids = tmp;
+            capacity = new_capacity;
+        }
+        ids[(*out_count)++] = (uint32_t)value;
+        json_skip_ws(cursor);
+        if (**cursor == ',') {
+            (*cursor)++;
+        }
+    }
+    *out_ids = ids;
+    return 0;
+}
+
 static int parse_documents_array(const char **cursor,
-                                 const GlobalToken *tokens,
+                                 StringArena *strings,
+                                 const TokenDict *dict,
                                  size_t token_count,
                                  Document **out_docs,
-                                 size_t *out_count) {
+                                 size_t *out_count,
+                                 size_t *out_with_counts) {
     if (!out_docs || !out_count) {
         return EINVAL;
     }
     *out_docs = NULL;
     *out_count = 0U;
+    *out_with_counts = 0U;
     if (json_expect(cursor, '[') != 0) {
         return EINVAL;
     }
@@ -1150,20 +4999,12 @@ static int parse_documents_array(const char **cursor,
             break;
         }
         if (json_expect(cursor, '{') != 0) {
-            if (docs) {
-                for (size_t i = 0; i < *out_count; ++i) {
-                    free(docs[i].id);
-                    free(docs[i].title);
-                    free(docs[i].source);
-                    free(docs[i].content);
-                    free(docs[i].vector);
-                }
-            }
-            free(docs);
+            documents_free(strings->mem, docs, *out_count);
             return EINVAL;
         }
         Document doc;
         memset(&doc, 0, sizeof(doc));
+        int have_counts = 0;
         while (1) {
             json_skip_ws(cursor);
             if (**cursor == '}') {
@@ -1172,112 +5013,62 @@ static int parse_documents_array(const char **cursor,
             }
             char *key = json_parse_string(cursor);
             if (!key) {
-                if (doc.vector) {
-                    free(doc.vector);
-                }
-                free(doc.id);
-                free(doc.title);
-                free(doc.source);
-                free(doc.content);
-                if (docs) {
-                    for (size_t i = 0; i < *out_count; ++i) {
-                        free(docs[i].id);
-                        free(docs[i].title);
-                        free(docs[i].source);
-                        free(docs[i].content);
-                        free(docs[i].vector);
-                    }
-                }
-                free(docs);
+                document_free(strings->mem, &doc);
+                documents_free(strings->mem, docs, *out_count);
                 return ENOMEM;
             }
+            int err = 0;
             if (json_expect(cursor, ':') != 0) {
-                free(key);
-                if (doc.vector) {
-                    free(doc.vector);
-                }
-                free(doc.id);
-                free(doc.title);
-                free(doc.source);
-                free(doc.content);
-                if (docs) {
-                    for (size_t i = 0; i < *out_count; ++i) {
-                        free(docs[i].id);
-                        free(docs[i].title);
-                        free(docs[i].source);
-                        free(docs[i].content);
-                        free(docs[i].vector);
-                    }
-                }
-                free(docs);
-                return EINVAL;
-            }
-            if (strcmp(key, "id") == 0) {
-                free(doc.id);
-                doc.id = json_parse_string(cursor);
+                err = EINVAL;
+            } else if (strcmp(key, "id") == 0) {
+                doc.id = json_parse_arena_string(cursor, strings);
             } else if (strcmp(key, "title") == 0) {
-                free(doc.title);
-                doc.title = json_parse_string(cursor);
+                doc.title = json_parse_arena_string(cursor, strings);
             } else if (strcmp(key, "source") == 0) {
-                free(doc.source);
-                doc.source = json_parse_string(cursor);
+                doc.source = json_parse_arena_string(cursor, strings);
             } else if (strcmp(key, "content") == 0) {
-                free(doc.content);
-                doc.content = json_parse_string(cursor);
+                doc.content = json_parse_arena_string(cursor, strings);
             } else if (strcmp(key, "terms") == 0) {
-                if (doc.vector) {
-                    free(doc.vector);
-                    doc.vector = NULL;
-                    doc.vector_size = 0U;
+                kolibri_mem_free(NULL, doc.vector);
+                doc.vector = NULL;
+                doc.vector_size = 0U;
+                if (parse_terms_array(cursor, dict, &doc.vector, &doc.vector_size) != 0) {
+                    err = EINVAL;
                 }
-                if (parse_terms_array(cursor, tokens, token_count, &doc.vector, &doc.vector_size) != 0) {
-                    free(key);
-                    free(doc.id);
-                    free(doc.title);
-                    free(doc.source);
-                    free(doc.content);
-                    if (docs) {
-                        for (size_t i = 0; i < *out_count; ++i) {
-                            free(docs[i].id);
-                            free(docs[i].title);
-                            free(docs[i].source);
-                            free(docs[i].content);
-                            free(docs[i].vector);
-                        }
-                    }
-                    free(docs);
-                    return EINVAL;
+            } else if (strcmp(key, "counts") == 0) {
+                kolibri_mem_free(NULL, doc.terms);
+                err = parse_counts_array(cursor, token_count, &doc.terms, &doc.term_count);
+                have_counts = err == 0;
+            } else if (strcmp(key, "sequence") == 0) {
+                kolibri_mem_free(NULL, doc.sequence);
+                err = parse_sequence_array(cursor, token_count, &doc.sequence, &doc.sequence_count);
+            } else if (strcmp(key, "size") == 0) {
+                doc.file_size = (unsigned long long)json_parse_number(cursor, &err);
+            } else if (strcmp(key, "mtime") == 0) {
+                doc.file_mtime = (long long)json_parse_number(cursor, &err);
+            } else if (strcmp(key, "hash") == 0) {
+                char *hex = json_parse_string(cursor);
+                if (hex) {
+                    doc.content_hash = strtoull(hex, NULL, 16);
+                    kolibri_mem_free(NULL, hex);
+                } else {
+                    err = EINVAL;
                 }
             } else if (strcmp(key, "norm") == 0) {
-                int err = 0;
-                double norm = json_parse_number(cursor, &err);
-                if (err == 0) {
+                int num_err = 0;
+                double norm = json_parse_number(cursor, &num_err);
+                if (num_err == 0) {
                     doc.norm = (float)norm;
                 }
-            } else {
-                if (json_skip_value(cursor) != 0) {
-                    free(key);
-                    free(doc.id);
-                    free(doc.title);
-                    free(doc.source);
-                    free(doc.content);
-                    if (doc.vector) {
-                        free(doc.vector);
-                    }
-                    if (docs) {
-                        for (size_t i = 0; i < *out_count; ++i) {
-                            free(docs[i].id);
-                            free(docs[i].title);
-                            free(docs[i].source);
-                            free(docs[i].content);
-                            free(docs[i].vector);
-                        }
-                    }
-                    free(docs);
-                    return EINVAL;
-                }
+            } else if (json_skip_value(cursor) != 0) {
+                err = EINVAL;
+            }
+            kolibri_mem_free(NULL, key);
+            if (err != 0) {
+                document_free(strings->mem, &doc);
+                documents_free(strings->mem, docs, *out_count);
+                return err;
             }
-            free(key);
             json_skip_ws(cursor);
             if (**cursor == ',') {
                 (*cursor)++;
@@ -1286,23 +5077,10 @@ static int parse_documents_array(const char **cursor,
         }
         if (*out_count == capacity) {
             size_t new_capacity = capacity == 0U ? 8U : capacity * 2U;
-            Document *tmp = (Document *)realloc(docs, new_capacity * sizeof(*docs));
+            Document *tmp = (Document *)kolibri_mem_realloc(NULL, docs, new_capacity * sizeof(*docs));
             if (!tmp) {
-                free(doc.id);
-                free(doc.title);
-                free(doc.source);
-                free(doc.content);
-                free(doc.vector);
-                if (docs) {
-                    for (size_t i = 0; i < *out_count; ++i) {
-                        free(docs[i].id);
-                        free(docs[i].title);
-                        free(docs[i].source);
-                        free(docs[i].content);
-                        free(docs[i].vector);
-                    }
-                }
-                free(docs);
+                document_free(strings->mem, &doc);
+                documents_free(strings->mem, docs, *out_count);
                 return ENOMEM;
             }
             docs = tmp;
@@ -1310,6 +5088,7 @@ static int parse_documents_array(const char **cursor,
         }
         docs[*out_count] = doc;
         *out_count += 1U;
+        *out_with_counts += have_counts ? 1U : 0U;
         json_skip_ws(cursor);
         if (**cursor == ',') {
             (*cursor)++;
@@ -1339,7 +5118,7 @@ static int parse_tokens_array(const char **cursor,
             break;
         }
         if (json_expect(cursor, '{') != 0) {
-            free(tokens);
+            kolibri_mem_free(NULL, tokens);
             return EINVAL;
         }
         GlobalToken token;
@@ -1352,47 +5131,47 @@ static int parse_tokens_array(const char **cursor,
             }
             char *key = json_parse_string(cursor);
             if (!key) {
-                free(tokens);
+                kolibri_mem_free(NULL, tokens);
                 return ENOMEM;
             }
             if (json_expect(cursor, ':') != 0) {
-                free(key);
+                kolibri_mem_free(NULL, key);
                 if (token.token) {
-                    free(token.token);
+                    kolibri_mem_free(NULL, token.token);
                 }
-                free(tokens);
+                kolibri_mem_free(NULL, tokens);
                 return EINVAL;
             }
             if (strcmp(key, "token") == 0) {
-                free(token.token);
+                kolibri_mem_free(NULL, token.token);
                 token.token = json_parse_string(cursor);
                 if (!token.token) {
-                    free(key);
-                    free(tokens);
+                    kolibri_mem_free(NULL, key);
+                    kolibri_mem_free(NULL, tokens);
                     return ENOMEM;
                 }
             } else if (strcmp(key, "idf") == 0) {
                 int err = 0;
                 token.idf = (float)json_parse_number(cursor, &err);
                 if (err != 0) {
-                    free(key);
+                    kolibri_mem_free(NULL, key);
                     if (token.token) {
-                        free(token.token);
+                        kolibri_mem_free(NULL, token.token);
                     }
-                    free(tokens);
+                    kolibri_mem_free(NULL, tokens);
                     return err;
                 }
             } else {
                 if (json_skip_value(cursor) != 0) {
-                    free(key);
+                    kolibri_mem_free(NULL, key);
                     if (token.token) {
-                        free(token.token);
+                        kolibri_mem_free(NULL, token.token);
                     }
-                    free(tokens);
+                    kolibri_mem_free(NULL, tokens);
                     return EINVAL;
                 }
             }
-            free(key);
+            kolibri_mem_free(NULL, key);
             json_skip_ws(cursor);
             if (**cursor == ',') {
                 (*cursor)++;
@@ -1400,12 +5179,12 @@ static int parse_tokens_array(const char **cursor,
         }
         if (*out_count == capacity) {
             size_t new_capacity = capacity == 0U ? 8U : capacity * 2U;
-            GlobalToken *tmp = (GlobalToken *)realloc(tokens, new_capacity * sizeof(*tokens));
+            GlobalToken *tmp = (GlobalToken *)kolibri_mem_realloc(NULL, tokens, new_capacity * sizeof(*tokens));
             if (!tmp) {
                 if (token.token) {
-                    free(token.token);
+                    kolibri_mem_free(NULL, token.token);
                 }
-                free(tokens);
+                kolibri_mem_free(NULL, tokens);
                 return ENOMEM;
             }
             tokens = tmp;
@@ -1438,7 +5217,7 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
 
     const char *cursor = manifest;
     if (json_expect(&cursor, '{') != 0) {
-        free(manifest);
+        kolibri_mem_free(NULL, manifest);
         return EINVAL;
     }
     char *index_rel = NULL;
@@ -1450,47 +5229,50 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
         }
         char *key = json_parse_string(&cursor);
         if (!key) {
-            free(index_rel);
-            free(manifest);
+            kolibri_mem_free(NULL, index_rel);
+            kolibri_mem_free(NULL, manifest);
             return ENOMEM;
         }
         if (json_expect(&cursor, ':') != 0) {
-            free(key);
-            free(index_rel);
-            free(manifest);
+            kolibri_mem_free(NULL, key);
+            kolibri_mem_free(NULL, index_rel);
+            kolibri_mem_free(NULL, manifest);
             return EINVAL;
         }
         if (strcmp(key, "index_path") == 0) {
-            free(index_rel);
+            kolibri_mem_free(NULL, index_rel);
             index_rel = json_parse_string(&cursor);
             if (!index_rel) {
-                free(key);
-                free(manifest);
+                kolibri_mem_free(NULL, key);
+                kolibri_mem_free(NULL, manifest);
                 return ENOMEM;
             }
         } else {
             if (json_skip_value(&cursor) != 0) {
-                free(key);
-                free(index_rel);
-                free(manifest);
+                kolibri_mem_free(NULL, key);
+                kolibri_mem_free(NULL, index_rel);
+                kolibri_mem_free(NULL, manifest);
                 return EINVAL;
             }
         }
-        free(key);
+        kolibri_mem_free(NULL, key);
         json_skip_ws(&cursor);
         if (*cursor == ',') {
             cursor++;
         }
     }
-    free(manifest);
+    kolibri_mem_free(NULL, manifest);
 
     if (!index_rel) {
-        index_rel = kolibri_strdup("index.json");
+        index_rel = kolibri_mem_strdup(NULL, "index.json");
+        if (!index_rel) {
+            return ENOMEM;
+        }
     }
 
     char index_path[4096];
     snprintf(index_path, sizeof(index_path), "%s/%s", input_dir, index_rel);
-    free(index_rel);
+    kolibri_mem_free(NULL, index_rel);
 
     char *index_data = read_file_utf8(index_path);
     if (!index_data) {
@@ -1499,11 +5281,16 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
 
     cursor = index_data;
     if (json_expect(&cursor, '{') != 0) {
-        free(index_data);
+        kolibri_mem_free(NULL, index_data);
         return EINVAL;
     }
 
-    KolibriKnowledgeIndex *index = knowledge_index_new();
+    /* Loaded indexes use the process default, which the parsers above allocate from. */
+    KolibriKnowledgeIndex *index = knowledge_index_new(NULL);
+    if (!index) {
+        kolibri_mem_free(NULL, index_data);
+        return ENOMEM;
+    }
     while (1) {
         json_skip_ws(&cursor);
         if (*cursor == '}') {
@@ -1513,13 +5300,13 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
         char *key = json_parse_string(&cursor);
         if (!key) {
             kolibri_knowledge_index_destroy(index);
-            free(index_data);
+            kolibri_mem_free(NULL, index_data);
             return ENOMEM;
         }
         if (json_expect(&cursor, ':') != 0) {
-            free(key);
+            kolibri_mem_free(NULL, key);
             kolibri_knowledge_index_destroy(index);
-            free(index_data);
+            kolibri_mem_free(NULL, index_data);
             return EINVAL;
         }
         if (strcmp(key, "tokens") == 0) {
@@ -1527,49 +5314,593 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
             size_t token_count = 0U;
             int err = parse_tokens_array(&cursor, &tokens, &token_count);
             if (err != 0) {
-                free(key);
+                kolibri_mem_free(NULL, key);
                 kolibri_knowledge_index_destroy(index);
-                free(index_data);
+                kolibri_mem_free(NULL, index_data);
                 return err;
             }
-            free(index->tokens);
+            index_free(&index->memory, index->tokens);
+            token_dict_free(&index->dict);
+            for (size_t i = 0; i < token_count; ++i) {
+                char *parsed = tokens[i].token;
+                const char *key = NULL;
+                token_dict_intern(&index->dict, parsed ? parsed : "", parsed ? strlen(parsed) : 0U, i, &key);
+                tokens[i].token = (char *)key;
+                kolibri_mem_free(NULL, parsed);
+            }
             index->tokens = tokens;
             index->token_count = token_count;
             index->token_capacity = token_count;
+            if (index_memory_failed(&index->memory)) {
+                kolibri_mem_free(NULL, key);
+                kolibri_knowledge_index_destroy(index);
+                kolibri_mem_free(NULL, index_data);
+                return ENOMEM;
+            }
         } else if (strcmp(key, "documents") == 0) {
             Document *docs = NULL;
             size_t doc_count = 0U;
+            size_t with_counts = 0U;
             int err = parse_documents_array(&cursor,
-                                            index->tokens,
+                                            &index->strings,
+                                            &index->dict,
                                             index->token_count,
                                             &docs,
-                                            &doc_count);
+                                            &doc_count,
+                                            &with_counts);
             if (err != 0) {
-                free(key);
+                kolibri_mem_free(NULL, key);
                 kolibri_knowledge_index_destroy(index);
-                free(index_data);
+                kolibri_mem_free(NULL, index_data);
                 return err;
             }
-            free(index->documents);
+            documents_free(&index->memory, index->documents, index->document_count);
             index->documents = docs;
             index->document_count = doc_count;
+            index->document_capacity = doc_count;
+            index->term_counts = with_counts == doc_count;
+        } else if (strcmp(key, "stemming") == 0 || strcmp(key, "positions") == 0 || strcmp(key, "quantized") == 0) {
+            int *flag = strcmp(key, "stemming") == 0   ? &index->stemming
+                        : strcmp(key, "positions") == 0 ? &index->keep_positions
+                                                        : &index->quantized;
+            json_skip_ws(&cursor);
+            *flag = strncmp(cursor, "true", 4U) == 0;
+            if (json_skip_value(&cursor) != 0) {
+                kolibri_mem_free(NULL, key);
+                kolibri_knowledge_index_destroy(index);
+                kolibri_mem_free(NULL, index_data);
+                return EINVAL;
+            }
         } else {
             if (json_skip_value(&cursor) != 0) {
-                free(key);
+                kolibri_mem_free(NULL, key);
                 kolibri_knowledge_index_destroy(index);
-                free(index_data);
+                kolibri_mem_free(NULL, index_data);
                 return EINVAL;
             }
         }
-        free(key);
+        kolibri_mem_free(NULL, key);
         json_skip_ws(&cursor);
         if (*cursor == ',') {
             cursor++;
         }
     }
 
-    free(index_data);
+    kolibri_mem_free(NULL, index_data);
+    if (index->term_counts) {
+        /* JSON carries IDF only; DF is rebuilt from the stored counts. */
+        for (size_t i = 0; i < index->token_count; ++i) {
+            index->tokens[i].df = 0U;
+        }
+        for (size_t i = 0; i < index->document_count; ++i) {
+            const Document *doc = &index->documents[i];
+            for (size_t j = 0; j < doc->term_count; ++j) {
+                index->tokens[doc->terms[j].token_index].df += 1U;
+            }
+        }
+    }
+    if (build_postings(index) != 0) {
+        kolibri_knowledge_index_destroy(index);
+        return ENOMEM;
+    }
     *out_index = index;
     return 0;
 }
 
+/* A buffer that cannot grow turns failed and drops later writes. */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    IndexMemory *mem;
+    int failed;
+} SnapshotBuffer;
+
+static int snapshot_reserve(SnapshotBuffer *buffer, size_t extra) {
+    if (buffer->failed) {
+        return -1;
+    }
+    if (buffer->size + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096U;
+    while (capacity < buffer->size + extra) {
+        capacity *= 2U;
+    }
+    char *data = (char *)index_realloc(buffer->mem, buffer->data, capacity);
+    if (!data) {
+        buffer->failed = 1;
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static uint64_t snapshot_append(SnapshotBuffer *buffer, const void *data, size_t size) {
+    if (snapshot_reserve(buffer, size + 8U) != 0) {
+        return 0U;
+    }
+    while (buffer->size % 8U != 0U) {
+        buffer->data[buffer->size++] = 0;
+    }
+    uint64_t offset = buffer->size;
+    if (size > 0U) {
+        memcpy(buffer->data + buffer->size, data, size);
+    }
+    buffer->size += size;
+    return offset;
+}
+
+static uint64_t snapshot_string(SnapshotBuffer *pool, const char *text) {
+    if (!text) {
+        return KOLIBRI_SNAPSHOT_NONE;
+    }
+    size_t len = strlen(text) + 1U;
+    if (snapshot_reserve(pool, len) != 0) {
+        return 0U;
+    }
+    uint64_t offset = pool->size;
+    memcpy(pool->data + pool->size, text, len);
+    pool->size += len;
+    return offset;
+}
+
+int kolibri_knowledge_index_write_binary(const KolibriKnowledgeIndex *index,
+                                         const char *output_dir) {
+    if (!index || !output_dir) {
+        return EINVAL;
+    }
+    if (index->removed_count > 0U) {
+        return EBUSY;
+    }
+    int err = ensure_directory(output_dir);
+    if (err != 0) {
+        return err;
+    }
+
+    /* The index is const here; its allocator is only read, the failure flag lives in the buffers. */
+    IndexMemory mem;
+    index_memory_init(&mem, &index->memory.allocator);
+    SnapshotBuffer pool = {NULL, 0U, 0U, &mem, 0};
+    SnapshotToken *tokens = (SnapshotToken *)index_calloc(&mem, index->token_count ? index->token_count : 1U,
+                                                          sizeof(SnapshotToken));
+    SnapshotDocument *docs = (SnapshotDocument *)index_calloc(&mem, index->document_count ? index->document_count : 1U,
+                                                              sizeof(SnapshotDocument));
+    if (!tokens || !docs) {
+        index_free(&mem, tokens);
+        index_free(&mem, docs);
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < index->token_count; ++i) {
+        tokens[i].string = snapshot_string(&pool, index->tokens[i].token ? index->tokens[i].token : "");
+        tokens[i].df = index->tokens[i].df;
+        tokens[i].idf = index->tokens[i].idf;
+    }
+    size_t vector_count = 0U;
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        docs[i].id = snapshot_string(&pool, doc->id);
+        docs[i].title = snapshot_string(&pool, doc->title);
+        docs[i].source = snapshot_string(&pool, doc->source);
+        docs[i].content = snapshot_string(&pool, doc->content);
+        docs[i].vector_first = vector_count;
+        docs[i].vector_count = doc->vector_size;
+        docs[i].norm = doc->norm;
+        vector_count += doc->vector_size;
+    }
+
+    SnapshotBuffer out = {NULL, 0U, 0U, &mem, 0};
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    snapshot_append(&out, &header, sizeof(header));
+    memcpy(header.magic, KOLIBRI_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = KOLIBRI_SNAPSHOT_VERSION;
+    header.word_size = (uint32_t)sizeof(size_t);
+    header.vector_item_size = (uint32_t)sizeof(KolibriKnowledgeVectorItem);
+    header.posting_size = (uint32_t)(index->qpostings ? sizeof(uint32_t) : sizeof(Posting));
+    header.flags = index->stemming ? KOLIBRI_SNAPSHOT_STEMMING : 0U;
+    header.document_count = index->document_count;
+    header.token_count = index->token_count;
+    header.vector_count = vector_count;
+    header.posting_count = index->posting_offsets ? index->posting_offsets[index->token_count] : 0U;
+    header.strings_size = pool.size;
+    header.tokens_offset = snapshot_append(&out, tokens, index->token_count * sizeof(SnapshotToken));
+    header.documents_offset = snapshot_append(&out, docs, index->document_count * sizeof(SnapshotDocument));
+    header.vectors_offset = snapshot_append(&out, NULL, 0U);
+    for (size_t i = 0; i < index->document_count; ++i) {
+        const Document *doc = &index->documents[i];
+        if (doc->vector_size == 0U) {
+            continue;
+        }
+        if (snapshot_reserve(&out, doc->vector_size * sizeof(KolibriKnowledgeVectorItem)) != 0) {
+            break;
+        }
+        memcpy(out.data + out.size, doc->vector, doc->vector_size * sizeof(KolibriKnowledgeVectorItem));
+        out.size += doc->vector_size * sizeof(KolibriKnowledgeVectorItem);
+    }
+    if (index->posting_offsets) {
+        header.posting_offsets_offset = snapshot_append(&out, index->posting_offsets,
+                                                        (index->token_count + 1U) * sizeof(size_t));
+        if (index->qpostings) {
+            header.flags |= KOLIBRI_SNAPSHOT_QUANTIZED;
+            header.postings_offset = snapshot_append(&out, index->qpostings, header.posting_count * sizeof(uint32_t));
+            header.doc_scales_offset = snapshot_append(&out, index->doc_scales, index->document_count * sizeof(float));
+        } else {
+            header.postings_offset = snapshot_append(&out, index->postings, header.posting_count * sizeof(Posting));
+        }
+        header.posting_max_offset = snapshot_append(&out, index->posting_max, index->token_count * sizeof(float));
+    } else {
+        size_t zero = 0U;
+        header.posting_offsets_offset = snapshot_append(&out, &zero, sizeof(zero));
+        header.postings_offset = snapshot_append(&out, NULL, 0U);
+        header.posting_max_offset = snapshot_append(&out, NULL, 0U);
+    }
+    header.token_order_offset = snapshot_append(&out, index->token_order, index->token_order_count * sizeof(uint32_t));
+    if (index->keep_positions && index->position_offsets) {
+        header.flags |= KOLIBRI_SNAPSHOT_POSITIONS;
+        header.position_entry_count = index->position_offsets[index->token_count];
+        size_t last = header.position_entry_count;
+        if (last > 0U) {
+            header.position_count = index->position_entries[last - 1U].first + index->position_entries[last - 1U].count;
+        }
+        header.position_offsets_offset = snapshot_append(&out, index->position_offsets,
+                                                         (index->token_count + 1U) * sizeof(size_t));
+        header.position_entries_offset = snapshot_append(&out, index->position_entries,
+                                                         header.position_entry_count * sizeof(PositionEntry));
+        header.positions_offset = snapshot_append(&out, index->positions, header.position_count * sizeof(uint32_t));
+    }
+    const AnnGraph *graph = &index->ann;
+    if (graph->node_count > 0U) {
+        header.flags |= KOLIBRI_SNAPSHOT_EMBEDDINGS;
+        header.embedding_dim = graph->dim;
+        header.ann_node_count = graph->node_count;
+        header.ann_m = graph->m;
+        header.ann_ef_search = graph->ef_search;
+        header.ann_entry = graph->entry;
+        header.ann_max_level = graph->max_level;
+        header.ann_upper_count = graph->upper_offsets[graph->node_count];
+        header.ann_vectors_offset = snapshot_append(&out, graph->vectors,
+                                                    graph->node_count * graph->dim * sizeof(float));
+        header.ann_docs_offset = snapshot_append(&out, graph->docs, graph->node_count * sizeof(uint32_t));
+        header.ann_links0_offset = snapshot_append(&out, graph->links0,
+                                                   graph->node_count * (2U * graph->m + 1U) * sizeof(uint32_t));
+        header.ann_upper_offsets_offset = snapshot_append(&out, graph->upper_offsets,
+                                                          (graph->node_count + 1U) * sizeof(uint32_t));
+        header.ann_upper_offset = snapshot_append(&out, graph->upper, header.ann_upper_count * sizeof(uint32_t));
+    }
+    header.strings_offset = snapshot_append(&out, pool.data, pool.size);
+    header.file_size = out.size;
+    index_free(&mem, tokens);
+    index_free(&mem, docs);
+    index_free(&mem, pool.data);
+    if (pool.failed || out.failed) {
+        index_free(&mem, out.data);
+        return ENOMEM;
+    }
+    memcpy(out.data, &header, sizeof(header));
+
+    char path[4096];
+    char tmp_path[4096];
+    int path_len = snprintf(path, sizeof(path), "%s/%s", output_dir, KOLIBRI_SNAPSHOT_FILE);
+    int tmp_len = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    /* A truncated name could replace some other file. */
+    if (path_len < 0 || (size_t)path_len >= sizeof(path) || tmp_len < 0 ||
+        (size_t)tmp_len >= sizeof(tmp_path)) {
+        index_free(&mem, out.data);
+        return ENAMETOOLONG;
+    }
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        err = errno;
+        index_free(&mem, out.data);
+        return err;
+    }
+    size_t written = fwrite(out.data, 1, out.size, file);
+    index_free(&mem, out.data);
+    if (fclose(file) != 0 || written != header.file_size) {
+        remove(tmp_path);
+        return EIO;
+    }
+    /* Readers may still map the previous snapshot; rename keeps their inode alive. */
+    if (rename(tmp_path, path) != 0) {
+        err = errno;
+        remove(tmp_path);
+        return err;
+    }
+    return 0;
+}
+
+static int snapshot_section_ok(const SnapshotHeader *header, uint64_t offset, uint64_t count, uint64_t size) {
+    if (offset % 8U != 0U || offset > header->file_size) {
+        return 0;
+    }
+    if (count != 0U && size > (header->file_size - offset) / count) {
+        return 0;
+    }
+    return 1;
+}
+
+/* The graph sections of a snapshot: every link, level and document in range. */
+static int snapshot_ann_ok(const SnapshotHeader *header, const char *base) {
+    uint64_t nodes = header->ann_node_count;
+    uint64_t m = header->ann_m;
+    uint64_t dim = header->embedding_dim;
+    if (nodes == 0U || nodes > header->document_count || dim == 0U || dim > UINT32_MAX || m < 2U ||
+        m > KOLIBRI_ANN_MAX_M || header->ann_ef_search == 0U || header->ann_entry >= nodes ||
+        header->ann_max_level > KOLIBRI_ANN_MAX_LEVEL || header->ann_upper_count > UINT32_MAX ||
+        !snapshot_section_ok(header, header->ann_vectors_offset, nodes, dim * sizeof(float)) ||
+        !snapshot_section_ok(header, header->ann_docs_offset, nodes, sizeof(uint32_t)) ||
+        !snapshot_section_ok(header, header->ann_links0_offset, nodes, (2U * m + 1U) * sizeof(uint32_t)) ||
+        !snapshot_section_ok(header, header->ann_upper_offsets_offset, nodes + 1U, sizeof(uint32_t)) ||
+        !snapshot_section_ok(header, header->ann_upper_offset, header->ann_upper_count, sizeof(uint32_t))) {
+        return 0;
+    }
+    const uint32_t *docs = (const uint32_t *)(base + header->ann_docs_offset);
+    const uint32_t *links0 = (const uint32_t *)(base + header->ann_links0_offset);
+    const uint32_t *offsets = (const uint32_t *)(base + header->ann_upper_offsets_offset);
+    const uint32_t *upper = (const uint32_t *)(base + header->ann_upper_offset);
+    if (offsets[0] != 0U || offsets[nodes] != header->ann_upper_count) {
+        return 0;
+    }
+    for (uint64_t n = 0; n < nodes; ++n) {
+        if (docs[n] >= header->document_count || (n > 0U && docs[n] <= docs[n - 1U]) || offsets[n] > offsets[n + 1U]) {
+            return 0;
+        }
+        uint64_t span = offsets[n + 1U] - offsets[n];
+        uint64_t level = span / (m + 1U);
+        if (span % (m + 1U) != 0U || level > header->ann_max_level ||
+            (n == header->ann_entry && level != header->ann_max_level)) {
+            return 0;
+        }
+        const uint32_t *list = links0 + n * (2U * m + 1U);
+        for (uint64_t l = 0; l <= level; ++l) {
+            uint64_t capacity = l == 0U ? 2U * m : m;
+            if (list[0] > capacity) {
+                return 0;
+            }
+            for (uint32_t i = 1U; i <= list[0]; ++i) {
+                if (list[i] >= nodes) {
+                    return 0;
+                }
+            }
+            list = upper + offsets[n] + l * (m + 1U);
+        }
+    }
+    return 1;
+}
+
+static const char *snapshot_string_at(const char *strings, const SnapshotHeader *header, uint64_t offset, int *ok) {
+    if (offset == KOLIBRI_SNAPSHOT_NONE) {
+        return NULL;
+    }
+    if (offset >= header->strings_size) {
+        *ok = 0;
+        return NULL;
+    }
+    return strings + offset;
+}
+
+int kolibri_knowledge_index_load_binary(const char *input_dir,
+                                        KolibriKnowledgeIndex **out_index) {
+    if (!input_dir || !out_index) {
+        return EINVAL;
+    }
+    *out_index = NULL;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", input_dir, KOLIBRI_SNAPSHOT_FILE);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return EINVAL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return errno;
+    }
+    const char *base = (const char *)mapping;
+    const SnapshotHeader *header = (const SnapshotHeader *)mapping;
+    int quantized = (header->flags & KOLIBRI_SNAPSHOT_QUANTIZED) != 0U;
+    size_t posting_size = quantized ? sizeof(uint32_t) : sizeof(Posting);
+    if (memcmp(header->magic, KOLIBRI_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != KOLIBRI_SNAPSHOT_VERSION || header->word_size != sizeof(size_t) ||
+        header->vector_item_size != sizeof(KolibriKnowledgeVectorItem) || header->posting_size != posting_size ||
+        header->file_size != size ||
+        header->document_count > UINT32_MAX ||
+        !snapshot_section_ok(header, header->tokens_offset, header->token_count, sizeof(SnapshotToken)) ||
+        !snapshot_section_ok(header, header->documents_offset, header->document_count, sizeof(SnapshotDocument)) ||
+        !snapshot_section_ok(header, header->vectors_offset, header->vector_count, sizeof(KolibriKnowledgeVectorItem)) ||
+        !snapshot_section_ok(header, header->posting_offsets_offset, header->token_count + 1U, sizeof(size_t)) ||
+        !snapshot_section_ok(header, header->postings_offset, header->posting_count, posting_size) ||
+        (quantized && (header->document_count >= KOLIBRI_QUANT_ID_LIMIT || header->token_count >= KOLIBRI_QUANT_ID_LIMIT ||
+                       !snapshot_section_ok(header, header->doc_scales_offset, header->document_count, sizeof(float)))) ||
+        !snapshot_section_ok(header, header->posting_max_offset, header->token_count, sizeof(float)) ||
+        !snapshot_section_ok(header, header->token_order_offset, header->token_count, sizeof(uint32_t)) ||
+        !snapshot_section_ok(header, header->strings_offset, header->strings_size, 1U) ||
+        (header->strings_size > 0U && base[header->strings_offset + header->strings_size - 1U] != '\0')) {
+        munmap(mapping, size);
+        return EINVAL;
+    }
+
+    const char *strings = base + header->strings_offset;
+    const SnapshotToken *tokens = (const SnapshotToken *)(base + header->tokens_offset);
+    const SnapshotDocument *docs = (const SnapshotDocument *)(base + header->documents_offset);
+    KolibriKnowledgeVectorItem *vectors = (KolibriKnowledgeVectorItem *)(base + header->vectors_offset);
+    size_t *posting_offsets = (size_t *)(base + header->posting_offsets_offset);
+    Posting *postings = quantized ? NULL : (Posting *)(base + header->postings_offset);
+    uint32_t *qpostings = quantized ? (uint32_t *)(base + header->postings_offset) : NULL;
+    int ok = 1;
+    if (posting_offsets[0] != 0U || posting_offsets[header->token_count] != header->posting_count) {
+        ok = 0;
+    }
+    for (size_t t = 0; ok && t < header->token_count; ++t) {
+        if (posting_offsets[t] > posting_offsets[t + 1U]) {
+            ok = 0;
+        }
+    }
+    for (size_t i = 0; ok && i < header->posting_count; ++i) {
+        uint32_t doc = quantized ? qpostings[i] >> 8 : postings[i].doc;
+        if (doc >= header->document_count) {
+            ok = 0;
+        }
+    }
+    for (size_t i = 0; ok && i < header->vector_count; ++i) {
+        if (vectors[i].token_index >= header->token_count) {
+            ok = 0;
+        }
+    }
+    uint32_t *token_order = (uint32_t *)(base + header->token_order_offset);
+    for (size_t i = 0; ok && i < header->token_count; ++i) {
+        if (token_order[i] >= header->token_count) {
+            ok = 0;
+        }
+    }
+    int positions = (header->flags & KOLIBRI_SNAPSHOT_POSITIONS) != 0U;
+    size_t *position_offsets = NULL;
+    PositionEntry *position_entries = NULL;
+    if (ok && positions) {
+        position_offsets = (size_t *)(base + header->position_offsets_offset);
+        position_entries = (PositionEntry *)(base + header->position_entries_offset);
+        ok = snapshot_section_ok(header, header->position_offsets_offset, header->token_count + 1U, sizeof(size_t)) &&
+             snapshot_section_ok(header, header->position_entries_offset, header->position_entry_count,
+                                 sizeof(PositionEntry)) &&
+             snapshot_section_ok(header, header->positions_offset, header->position_count, sizeof(uint32_t)) &&
+             position_offsets[0] == 0U && position_offsets[header->token_count] == header->position_entry_count;
+        for (size_t t = 0; ok && t < header->token_count; ++t) {
+            if (position_offsets[t] > position_offsets[t + 1U]) {
+                ok = 0;
+            }
+        }
+        for (size_t e = 0; ok && e < header->position_entry_count; ++e) {
+            const PositionEntry *entry = &position_entries[e];
+            if (entry->doc >= header->document_count || entry->first > header->position_count ||
+                entry->count > header->position_count - entry->first) {
+                ok = 0;
+            }
+        }
+    }
+    int embeddings = (header->flags & KOLIBRI_SNAPSHOT_EMBEDDINGS) != 0U;
+    if (ok && embeddings) {
+        ok = snapshot_ann_ok(header, base);
+    }
+    if (!ok) {
+        munmap(mapping, size);
+        return EINVAL;
+    }
+
+    KolibriKnowledgeIndex *index = knowledge_index_new(NULL);
+    if (!index) {
+        munmap(mapping, size);
+        return ENOMEM;
+    }
+    index->mapping = mapping;
+    index->mapping_size = size;
+    index->stemming = (header->flags & KOLIBRI_SNAPSHOT_STEMMING) != 0U;
+    index->keep_positions = positions;
+    index->token_count = header->token_count;
+    index->token_capacity = header->token_count;
+    index->tokens = (GlobalToken *)index_calloc(&index->memory, header->token_count ? header->token_count : 1U,
+                                                sizeof(GlobalToken));
+    index->documents = (Document *)index_calloc(&index->memory, header->document_count ? header->document_count : 1U,
+                                                sizeof(Document));
+    if (!index->tokens || !index->documents) {
+        kolibri_knowledge_index_destroy(index);
+        return ENOMEM;
+    }
+    for (size_t t = 0; ok && t < header->token_count; ++t) {
+        const char *key = snapshot_string_at(strings, header, tokens[t].string, &ok);
+        if (!key) {
+            ok = 0;
+            break;
+        }
+        index->tokens[t].token = (char *)key;
+        index->tokens[t].df = (size_t)tokens[t].df;
+        index->tokens[t].idf = tokens[t].idf;
+        token_dict_bind(&index->dict, key, t);
+    }
+    index->document_count = header->document_count;
+    index->document_capacity = header->document_count;
+    for (size_t i = 0; ok && i < header->document_count; ++i) {
+        Document *doc = &index->documents[i];
+        if (docs[i].vector_first > header->vector_count ||
+            docs[i].vector_count > header->vector_count - docs[i].vector_first) {
+            ok = 0;
+            break;
+        }
+        doc->id = snapshot_string_at(strings, header, docs[i].id, &ok);
+        doc->title = snapshot_string_at(strings, header, docs[i].title, &ok);
+        doc->source = snapshot_string_at(strings, header, docs[i].source, &ok);
+        doc->content = snapshot_string_at(strings, header, docs[i].content, &ok);
+        doc->vector = docs[i].vector_count ? vectors + docs[i].vector_first : NULL;
+        doc->vector_size = (size_t)docs[i].vector_count;
+        doc->norm = docs[i].norm;
+    }
+    if (!ok || index_memory_failed(&index->memory)) {
+        kolibri_knowledge_index_destroy(index);
+        return ok ? ENOMEM : EINVAL;
+    }
+    index->posting_offsets = posting_offsets;
+    index->postings = postings;
+    index->quantized = quantized;
+    if (quantized) {
+        index->qpostings = qpostings;
+        index->doc_scales = (float *)(base + header->doc_scales_offset);
+    }
+    index->posting_max = (float *)(base + header->posting_max_offset);
+    index->token_order = token_order;
+    index->token_order_count = header->token_count;
+    if (positions) {
+        index->position_offsets = position_offsets;
+        index->position_entries = position_entries;
+        index->positions = (uint32_t *)(base + header->positions_offset);
+    }
+    if (embeddings) {
+        AnnGraph *graph = &index->ann;
+        graph->dim = (size_t)header->embedding_dim;
+        graph->node_count = (size_t)header->ann_node_count;
+        graph->m = (size_t)header->ann_m;
+        graph->ef_search = (size_t)header->ann_ef_search;
+        graph->entry = (uint32_t)header->ann_entry;
+        graph->max_level = (uint32_t)header->ann_max_level;
+        graph->vectors = (float *)(base + header->ann_vectors_offset);
+        graph->docs = (uint32_t *)(base + header->ann_docs_offset);
+        graph->links0 = (uint32_t *)(base + header->ann_links0_offset);
+        graph->upper_offsets = (uint32_t *)(base + header->ann_upper_offsets_offset);
+        graph->upper = (uint32_t *)(base + header->ann_upper_offset);
+        for (size_t n = 0; n < graph->node_count; ++n) {
+            index->documents[graph->docs[n]].embedding = graph->vectors + n * graph->dim;
+        }
+    }
+    if (build_doc_lanes(index) != 0) {
+        kolibri_knowledge_index_destroy(index);
+        return ENOMEM;
+    }
+    *out_index = index;
+    return 0;
+}
@@ -1,13 +1,18 @@
 #include "kolibri/knowledge_queue.h"
 
+#include "kolibri/alloc.h"
+
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sqlite3.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -16,8 +21,53 @@
 #define kolibri_mkdir(path) mkdir(path, 0777)
 #endif
 
+/* Statements are prepared on first use and kept until the queue is closed. */
+typedef enum {
+    QUEUE_STMT_INSERT,
+    QUEUE_STMT_FETCH,
+    QUEUE_STMT_MODERATE,
+    QUEUE_STMT_BEGIN,
+    QUEUE_STMT_COMMIT,
+    QUEUE_STMT_ROLLBACK,
+    QUEUE_STMT_COUNT
+} QueueStatement;
+
+static const char *QUEUE_STATEMENT_SQL[QUEUE_STMT_COUNT] = {
+    "INSERT INTO submissions (created_at, title, content, source, metadata, status) "
+    "VALUES (?, ?, ?, ?, ?, ?)",
+    "SELECT id, created_at, title, content, source, metadata, status, "
+    "moderator, moderation_note, moderated_at "
+    "FROM submissions WHERE status = ? ORDER BY created_at ASC, id ASC LIMIT ?",
+    "UPDATE submissions SET status = ?, moderator = ?, moderation_note = ?, moderated_at = ? "
+    "WHERE id = ?",
+    "BEGIN IMMEDIATE",
+    "COMMIT",
+    "ROLLBACK",
+};
+
+#define KOLIBRI_QUEUE_EXPORT_THREADS_MAX 16U
+
 struct KolibriQueue {
     sqlite3 *db;
+    sqlite3_stmt *statements[QUEUE_STMT_COUNT];
+    size_t export_threads;
+};
+
+#define KOLIBRI_QUEUE_PAGE_DEFAULT 256U
+
+static const char *QUEUE_PAGE_SQL =
+    "SELECT id, created_at, title, content, source, metadata, status, "
+    "moderator, moderation_note, moderated_at "
+    "FROM submissions WHERE status = ? AND id > ? ORDER BY id ASC LIMIT ?";
+
+struct KolibriQueueIter {
+    sqlite3_stmt *stmt; /* owned, so several iterators can be open at once */
+    KolibriQueueStatus status;
+    long long last_id;
+    size_t page_size;
+    size_t page_rows;
+    int page_open;
+    int done;
 };
 
 static const char *QUEUE_SCHEMA =
@@ -33,7 +83,9 @@ static const char *QUEUE_SCHEMA =
     "moderation_note TEXT,"
     "moderated_at TEXT"
     ");"
-    "CREATE INDEX IF NOT EXISTS submissions_status_idx ON submissions(status);";
+    "DROP INDEX IF EXISTS submissions_status_idx;"
+    "CREATE INDEX IF NOT EXISTS submissions_status_created_idx ON submissions(status, created_at, id);"
+    "CREATE INDEX IF NOT EXISTS submissions_status_id_idx ON submissions(status, id);";
 
 static const char *STATUS_PENDING = "pending";
 static const char *STATUS_APPROVED = "approved";
@@ -70,19 +122,6 @@ int kolibri_queue_status_from_string(const char *text, KolibriQueueStatus *out_s
     return 1;
 }
 
-static char *kolibri_strdup(const char *text) {
-    if (!text) {
-        return NULL;
-    }
-    size_t len = strlen(text);
-    char *copy = (char *)malloc(len + 1U);
-    if (!copy) {
-        return NULL;
-    }
-    memcpy(copy, text, len + 1U);
-    return copy;
-}
-
 static int ensure_directory(const char *path) {
     struct stat st;
     if (stat(path, &st) == 0) {
@@ -97,26 +136,74 @@ static int ensure_directory(const char *path) {
     return 0;
 }
 
+void kolibri_queue_options_init(KolibriQueueOptions *options) {
+    if (!options) {
+        return;
+    }
+    options->journal_mode = KOLIBRI_QUEUE_JOURNAL_WAL;
+    options->cache_size_kib = 8192;
+    options->mmap_size = 64LL * 1024LL * 1024LL;
+    options->busy_timeout_ms = 5000;
+    options->export_threads = 0U;
+}
+
+static int queue_apply_options(sqlite3 *db, const KolibriQueueOptions *options) {
+    int rc = sqlite3_busy_timeout(db, options->busy_timeout_ms > 0 ? options->busy_timeout_ms : 0);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    const char *journal = options->journal_mode == KOLIBRI_QUEUE_JOURNAL_WAL
+                              ? "PRAGMA journal_mode=WAL;PRAGMA synchronous=NORMAL;"
+                              : "PRAGMA journal_mode=DELETE;PRAGMA synchronous=FULL;";
+    rc = sqlite3_exec(db, journal, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    char pragmas[128];
+    int written = 0;
+    if (options->cache_size_kib > 0) {
+        written += snprintf(pragmas + written, sizeof(pragmas) - (size_t)written,
+                            "PRAGMA cache_size=-%d;", options->cache_size_kib);
+    }
+    snprintf(pragmas + written, sizeof(pragmas) - (size_t)written,
+             "PRAGMA mmap_size=%lld;", options->mmap_size > 0 ? options->mmap_size : 0LL);
+    return sqlite3_exec(db, pragmas, NULL, NULL, NULL);
+}
+
 int kolibri_queue_open(const char *database_path, KolibriQueue **out_queue) {
-    if (!database_path || !out_queue) {
+    KolibriQueueOptions options;
+    kolibri_queue_options_init(&options);
+    return kolibri_queue_open_ex(database_path, &options, out_queue);
+}
+
+int kolibri_queue_open_ex(const char *database_path,
+                          const KolibriQueueOptions *options,
+                          KolibriQueue **out_queue) {
+    if (!database_path || !options || !out_queue) {
         return SQLITE_MISUSE;
     }
-    KolibriQueue *queue = (KolibriQueue *)calloc(1, sizeof(KolibriQueue));
+    KolibriQueue *queue = (KolibriQueue *)kolibri_mem_calloc(NULL, 1, sizeof(KolibriQueue));
     if (!queue) {
         return SQLITE_NOMEM;
     }
     int rc = sqlite3_open(database_path, &queue->db);
-    if (rc != SQLITE_OK) {
-        sqlite3_close(queue->db);
-        free(queue);
-        return rc;
+    if (rc == SQLITE_OK) {
+        rc = queue_apply_options(queue->db, options);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(queue->db, QUEUE_SCHEMA, NULL, NULL, NULL);
     }
-    rc = sqlite3_exec(queue->db, QUEUE_SCHEMA, NULL, NULL, NULL);
     if (rc != SQLITE_OK) {
         sqlite3_close(queue->db);
-        free(queue);
+        kolibri_mem_free(NULL, queue);
         return rc;
     }
+    size_t threads = options->export_threads;
+    if (threads == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1U;
+    }
+    queue->export_threads = threads < KOLIBRI_QUEUE_EXPORT_THREADS_MAX ? threads : KOLIBRI_QUEUE_EXPORT_THREADS_MAX;
     *out_queue = queue;
     return SQLITE_OK;
 }
@@ -125,8 +212,11 @@ void kolibri_queue_close(KolibriQueue *queue) {
     if (!queue) {
         return;
     }
+    for (size_t i = 0; i < QUEUE_STMT_COUNT; ++i) {
+        sqlite3_finalize(queue->statements[i]);
+    }
     sqlite3_close(queue->db);
-    free(queue);
+    kolibri_mem_free(NULL, queue);
 }
 
 static char *current_iso8601(void) {
@@ -139,56 +229,124 @@ static char *current_iso8601(void) {
 #endif
     char buffer[32];
     strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &t);
-    return kolibri_strdup(buffer);
+    return kolibri_mem_strdup(NULL, buffer);
 }
 
-int kolibri_queue_enqueue(KolibriQueue *queue,
-                          const char *title,
-                          const char *content,
-                          const char *source,
-                          const char *metadata_json,
-                          long long *out_submission_id) {
-    if (!queue || !title || !content) {
-        return SQLITE_MISUSE;
+static int queue_statement(KolibriQueue *queue, QueueStatement which, sqlite3_stmt **out_stmt) {
+    if (!queue->statements[which]) {
+        int rc = sqlite3_prepare_v2(queue->db, QUEUE_STATEMENT_SQL[which], -1, &queue->statements[which], NULL);
+        if (rc != SQLITE_OK) {
+            queue->statements[which] = NULL;
+            return rc;
+        }
     }
-    char *created = current_iso8601();
-    const char *sql =
-        "INSERT INTO submissions (created_at, title, content, source, metadata, status) "
-        "VALUES (?, ?, ?, ?, ?, ?)";
+    *out_stmt = queue->statements[which];
+    return SQLITE_OK;
+}
+
+static int queue_run(KolibriQueue *queue, QueueStatement which) {
+    sqlite3_stmt *stmt = NULL;
+    int rc = queue_statement(queue, which, &stmt);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+static int queue_insert(KolibriQueue *queue,
+                        const char *created,
+                        const KolibriQueueSubmission *submission,
+                        long long *out_submission_id) {
     sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
+    int rc = queue_statement(queue, QUEUE_STMT_INSERT, &stmt);
     if (rc != SQLITE_OK) {
-        free(created);
         return rc;
     }
-    sqlite3_bind_text(stmt, 1, created, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, title, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, content, -1, SQLITE_TRANSIENT);
-    if (source) {
-        sqlite3_bind_text(stmt, 4, source, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 1, created, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, submission->title, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, submission->content, -1, SQLITE_STATIC);
+    if (submission->source) {
+        sqlite3_bind_text(stmt, 4, submission->source, -1, SQLITE_STATIC);
     } else {
         sqlite3_bind_null(stmt, 4);
     }
-    if (metadata_json) {
-        sqlite3_bind_text(stmt, 5, metadata_json, -1, SQLITE_TRANSIENT);
+    if (submission->metadata_json) {
+        sqlite3_bind_text(stmt, 5, submission->metadata_json, -1, SQLITE_STATIC);
     } else {
         sqlite3_bind_null(stmt, 5);
     }
-    sqlite3_bind_text(stmt, 6, STATUS_PENDING, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 6, STATUS_PENDING, -1, SQLITE_STATIC);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
     if (rc != SQLITE_DONE) {
-        free(created);
         return rc;
     }
     if (out_submission_id) {
         *out_submission_id = sqlite3_last_insert_rowid(queue->db);
     }
-    free(created);
     return SQLITE_OK;
 }
 
+int kolibri_queue_enqueue(KolibriQueue *queue,
+                          const char *title,
+                          const char *content,
+                          const char *source,
+                          const char *metadata_json,
+                          long long *out_submission_id) {
+    if (!queue || !title || !content) {
+        return SQLITE_MISUSE;
+    }
+    char *created = current_iso8601();
+    if (!created) {
+        return SQLITE_NOMEM;
+    }
+    KolibriQueueSubmission submission = {title, content, source, metadata_json};
+    int rc = queue_insert(queue, created, &submission, out_submission_id);
+    kolibri_mem_free(NULL, created);
+    return rc;
+}
+
+int kolibri_queue_enqueue_batch(KolibriQueue *queue,
+                                const KolibriQueueSubmission *submissions,
+                                size_t count,
+                                long long *out_submission_ids) {
+    if (!queue || (!submissions && count > 0U)) {
+        return SQLITE_MISUSE;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!submissions[i].title || !submissions[i].content) {
+            return SQLITE_MISUSE;
+        }
+    }
+    if (count == 0U) {
+        return SQLITE_OK;
+    }
+    char *created = current_iso8601();
+    if (!created) {
+        return SQLITE_NOMEM;
+    }
+    int rc = queue_run(queue, QUEUE_STMT_BEGIN);
+    if (rc != SQLITE_OK) {
+        kolibri_mem_free(NULL, created);
+        return rc;
+    }
+    for (size_t i = 0; i < count && rc == SQLITE_OK; ++i) {
+        rc = queue_insert(queue, created, &submissions[i], out_submission_ids ? &out_submission_ids[i] : NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = queue_run(queue, QUEUE_STMT_COMMIT);
+    }
+    if (rc != SQLITE_OK && !sqlite3_get_autocommit(queue->db)) {
+        (void)queue_run(queue, QUEUE_STMT_ROLLBACK);
+    }
+    kolibri_mem_free(NULL, created);
+    return rc;
+}
+
 int kolibri_queue_fetch(KolibriQueue *queue,
                         KolibriQueueStatus status,
                         size_t limit,
@@ -199,17 +357,13 @@ int kolibri_queue_fetch(KolibriQueue *queue,
     }
     *out_records = NULL;
     *out_count = 0U;
-    const char *sql =
-        "SELECT id, created_at, title, content, source, metadata, status, "
-        "moderator, moderation_note, moderated_at "
-        "FROM submissions WHERE status = ? ORDER BY created_at ASC LIMIT ?";
     sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
+    int rc = queue_statement(queue, QUEUE_STMT_FETCH, &stmt);
     if (rc != SQLITE_OK) {
         return rc;
     }
-    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, (int)limit);
+    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)limit);
 
     KolibriQueueRecord *records = NULL;
     size_t capacity = 0U;
@@ -218,10 +372,10 @@ int kolibri_queue_fetch(KolibriQueue *queue,
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
         if (count == capacity) {
             size_t new_cap = capacity == 0U ? 16U : capacity * 2U;
-            KolibriQueueRecord *new_records = (KolibriQueueRecord *)realloc(records, new_cap * sizeof(KolibriQueueRecord));
+            KolibriQueueRecord *new_records = (KolibriQueueRecord *)kolibri_mem_realloc(NULL, records, new_cap * sizeof(KolibriQueueRecord));
             if (!new_records) {
-                sqlite3_finalize(stmt);
-                free(records);
+                sqlite3_reset(stmt);
+                kolibri_queue_free_records(records, count);
                 return SQLITE_NOMEM;
             }
             records = new_records;
@@ -229,22 +383,22 @@ int kolibri_queue_fetch(KolibriQueue *queue,
         }
         KolibriQueueRecord *rec = &records[count++];
         rec->submission_id = sqlite3_column_int64(stmt, 0);
-        rec->created_at = kolibri_strdup((const char *)sqlite3_column_text(stmt, 1));
-        rec->title = kolibri_strdup((const char *)sqlite3_column_text(stmt, 2));
-        rec->content = kolibri_strdup((const char *)sqlite3_column_text(stmt, 3));
-        rec->source = kolibri_strdup((const char *)sqlite3_column_text(stmt, 4));
-        rec->metadata = kolibri_strdup((const char *)sqlite3_column_text(stmt, 5));
+        rec->created_at = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 1));
+        rec->title = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 2));
+        rec->content = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 3));
+        rec->source = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 4));
+        rec->metadata = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 5));
         KolibriQueueStatus st;
         if (kolibri_queue_status_from_string((const char *)sqlite3_column_text(stmt, 6), &st) != 0) {
             st = KOLIBRI_QUEUE_STATUS_PENDING;
         }
         rec->status = st;
-        rec->moderator = kolibri_strdup((const char *)sqlite3_column_text(stmt, 7));
-        rec->moderation_note = kolibri_strdup((const char *)sqlite3_column_text(stmt, 8));
-        rec->moderated_at = kolibri_strdup((const char *)sqlite3_column_text(stmt, 9));
+        rec->moderator = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 7));
+        rec->moderation_note = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 8));
+        rec->moderated_at = kolibri_mem_strdup(NULL, (const char *)sqlite3_column_text(stmt, 9));
     }
 
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     if (rc != SQLITE_DONE) {
         kolibri_queue_free_records(records, count);
         return rc;
@@ -259,16 +413,91 @@ void kolibri_queue_free_records(KolibriQueueRecord *records, size_t count) {
         return;
     }
     for (size_t i = 0; i < count; ++i) {
-        free(records[i].created_at);
-        free(records[i].title);
-        free(records[i].content);
-        free(records[i].source);
-        free(records[i].metadata);
-        free(records[i].moderator);
-        free(records[i].moderation_note);
-        free(records[i].moderated_at);
+        kolibri_mem_free(NULL, records[i].created_at);
+        kolibri_mem_free(NULL, records[i].title);
+        kolibri_mem_free(NULL, records[i].content);
+        kolibri_mem_free(NULL, records[i].source);
+        kolibri_mem_free(NULL, records[i].metadata);
+        kolibri_mem_free(NULL, records[i].moderator);
+        kolibri_mem_free(NULL, records[i].moderation_note);
+        kolibri_mem_free(NULL, records[i].moderated_at);
+    }
+    kolibri_mem_free(NULL, records);
+}
+
+int kolibri_queue_iter_open(KolibriQueue *queue,
+                            KolibriQueueStatus status,
+                            long long after_id,
+                            size_t page_size,
+                            KolibriQueueIter **out_iter) {
+    if (!queue || !out_iter) {
+        return SQLITE_MISUSE;
+    }
+    KolibriQueueIter *iter = (KolibriQueueIter *)kolibri_mem_calloc(NULL, 1, sizeof(KolibriQueueIter));
+    if (!iter) {
+        return SQLITE_NOMEM;
+    }
+    int rc = sqlite3_prepare_v2(queue->db, QUEUE_PAGE_SQL, -1, &iter->stmt, NULL);
+    if (rc != SQLITE_OK) {
+        kolibri_mem_free(NULL, iter);
+        return rc;
+    }
+    iter->status = status;
+    iter->last_id = after_id;
+    iter->page_size = page_size ? page_size : KOLIBRI_QUEUE_PAGE_DEFAULT;
+    *out_iter = iter;
+    return SQLITE_OK;
+}
+
+int kolibri_queue_iter_next(KolibriQueueIter *iter, KolibriQueueRow *out_row) {
+    if (!iter || !out_row) {
+        return SQLITE_MISUSE;
+    }
+    while (!iter->done) {
+        if (!iter->page_open) {
+            sqlite3_bind_text(iter->stmt, 1, kolibri_queue_status_to_string(iter->status), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(iter->stmt, 2, iter->last_id);
+            sqlite3_bind_int64(iter->stmt, 3, (sqlite3_int64)iter->page_size);
+            iter->page_open = 1;
+            iter->page_rows = 0U;
+        }
+        int rc = sqlite3_step(iter->stmt);
+        if (rc == SQLITE_ROW) {
+            sqlite3_stmt *stmt = iter->stmt;
+            iter->page_rows += 1U;
+            iter->last_id = sqlite3_column_int64(stmt, 0);
+            out_row->submission_id = iter->last_id;
+            out_row->created_at = (const char *)sqlite3_column_text(stmt, 1);
+            out_row->title = (const char *)sqlite3_column_text(stmt, 2);
+            out_row->content = (const char *)sqlite3_column_text(stmt, 3);
+            out_row->source = (const char *)sqlite3_column_text(stmt, 4);
+            out_row->metadata = (const char *)sqlite3_column_text(stmt, 5);
+            if (kolibri_queue_status_from_string((const char *)sqlite3_column_text(stmt, 6), &out_row->status) != 0) {
+                out_row->status = KOLIBRI_QUEUE_STATUS_PENDING;
+            }
+            out_row->moderator = (const char *)sqlite3_column_text(stmt, 7);
+            out_row->moderation_note = (const char *)sqlite3_column_text(stmt, 8);
+            out_row->moderated_at = (const char *)sqlite3_column_text(stmt, 9);
+            return SQLITE_ROW;
+        }
+        sqlite3_reset(iter->stmt);
+        iter->page_open = 0;
+        if (rc != SQLITE_DONE) {
+            return rc;
+        }
+        if (iter->page_rows < iter->page_size) {
+            iter->done = 1;
+        }
     }
-    free(records);
+    return SQLITE_DONE;
+}
+
+void kolibri_queue_iter_close(KolibriQueueIter *iter) {
+    if (!iter) {
+        return;
+    }
+    sqlite3_finalize(iter->stmt);
+    kolibri_mem_free(NULL, iter);
 }
 
 int kolibri_queue_moderate(KolibriQueue *queue,
@@ -280,13 +509,13 @@ int kolibri_queue_moderate(KolibriQueue *queue,
         return SQLITE_MISUSE;
     }
     char *timestamp = current_iso8601();
-    const char *sql =
-        "UPDATE submissions SET status = ?, moderator = ?, moderation_note = ?, moderated_at = ? "
-        "WHERE id = ?";
+    if (!timestamp) {
+        return SQLITE_NOMEM;
+    }
     sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
+    int rc = queue_statement(queue, QUEUE_STMT_MODERATE, &stmt);
     if (rc != SQLITE_OK) {
-        free(timestamp);
+        kolibri_mem_free(NULL, timestamp);
         return rc;
     }
     sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_TRANSIENT);
@@ -304,8 +533,9 @@ int kolibri_queue_moderate(KolibriQueue *queue,
     sqlite3_bind_int64(stmt, 5, submission_id);
 
     rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    free(timestamp);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    kolibri_mem_free(NULL, timestamp);
     if (rc != SQLITE_DONE) {
         return rc;
     }
@@ -335,7 +565,125 @@ static void delete_markdown_files(const char *dir) {
     closedir(d);
 }
 
-static void write_markdown_file(const KolibriQueueRecord *record, const char *dir, size_t index) {
+/*
+ * Incremental export: files are named by submission id and the manifest
+ * remembers a hash of each rendered file, so unchanged records are neither
+ * rewritten nor touched and keep their mtime for the incremental indexer.
+ */
+#define KOLIBRI_EXPORT_MANIFEST ".kolibri_export"
+#define KOLIBRI_EXPORT_BATCH 256U
+#define KOLIBRI_EXPORT_NAME_MAX 80U
+
+typedef struct {
+    long long id;
+    unsigned long long hash;
+    char name[KOLIBRI_EXPORT_NAME_MAX];
+} ExportEntry;
+
+typedef struct {
+    ExportEntry *items;
+    size_t count;
+    size_t capacity;
+} ExportManifest;
+
+typedef struct {
+    char name[KOLIBRI_EXPORT_NAME_MAX];
+    char *body;
+    size_t length;
+    int failed;
+} ExportJob;
+
+typedef struct {
+    const char *dir;
+    ExportJob *jobs;
+    size_t count;
+    atomic_size_t next;
+} ExportPool;
+
+static unsigned long long export_hash(const char *data, size_t length) {
+    unsigned long long hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int manifest_push(ExportManifest *manifest, const ExportEntry *entry) {
+    if (manifest->count == manifest->capacity) {
+        size_t new_cap = manifest->capacity ? manifest->capacity * 2U : 64U;
+        ExportEntry *items = (ExportEntry *)kolibri_mem_realloc(NULL, manifest->items, new_cap * sizeof(ExportEntry));
+        if (!items) {
+            return -1;
+        }
+        manifest->items = items;
+        manifest->capacity = new_cap;
+    }
+    manifest->items[manifest->count++] = *entry;
+    return 0;
+}
+
+static int manifest_compare(const void *a, const void *b) {
+    long long left = ((const ExportEntry *)a)->id;
+    long long right = ((const ExportEntry *)b)->id;
+    return (left > right) - (left < right);
+}
+
+/* Returns 0 when the manifest is missing, so the caller can clean up. */
+static int manifest_load(const char *dir, ExportManifest *manifest) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, KOLIBRI_EXPORT_MANIFEST);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    ExportEntry entry;
+    while (fscanf(file, "%lld %llx %79s", &entry.id, &entry.hash, entry.name) == 3) {
+        if (manifest_push(manifest, &entry) != 0) {
+            break;
+        }
+    }
+    fclose(file);
+    qsort(manifest->items, manifest->count, sizeof(ExportEntry), manifest_compare);
+    return 1;
+}
+
+static int write_atomically(const char *dir, const char *name, const char *data, size_t length) {
+    char path[4096];
+    char tmp[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(tmp, sizeof(tmp), "%s/.%s.tmp", dir, name);
+    FILE *file = fopen(tmp, "wb");
+    if (!file) {
+        return -1;
+    }
+    int ok = fwrite(data, 1U, length, file) == length;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int manifest_store(const char *dir, const ExportManifest *manifest) {
+    size_t capacity = manifest->count * (KOLIBRI_EXPORT_NAME_MAX + 48U) + 1U;
+    char *buffer = (char *)kolibri_mem_alloc(NULL, capacity);
+    if (!buffer) {
+        return -1;
+    }
+    size_t length = 0U;
+    for (size_t i = 0; i < manifest->count; ++i) {
+        const ExportEntry *entry = &manifest->items[i];
+        length += (size_t)snprintf(buffer + length, capacity - length, "%lld %016llx %s\n",
+                                   entry->id, entry->hash, entry->name);
+    }
+    int rc = write_atomically(dir, KOLIBRI_EXPORT_MANIFEST, buffer, length);
+    kolibri_mem_free(NULL, buffer);
+    return rc;
+}
+
+static void export_file_name(const KolibriQueueRow *record, char *out, size_t out_size) {
     char slug[64];
     size_t pos = 0U;
     const char *src = record->title ? record->title : "submission";
@@ -347,18 +695,75 @@ static void write_markdown_file(const KolibriQueueRecord *record, const char *di
         }
     }
     slug[pos] = '\0';
-    char filename[256];
-    snprintf(filename, sizeof(filename), "%s/%06zu_%s.md", dir, index + 1U, slug[0] ? slug : "submission");
-    FILE *file = fopen(filename, "wb");
-    if (!file) {
-        return;
+    snprintf(out, out_size, "%06lld_%s.md", record->submission_id, slug[0] ? slug : "submission");
+}
+
+static char *render_markdown(const KolibriQueueRow *record, size_t *out_length) {
+    const char *title = record->title ? record->title : "Без названия";
+    const char *source = record->source && record->source[0] ? record->source : NULL;
+    const char *content = record->content ? record->content : "";
+    size_t capacity = strlen(title) + strlen(content) + (source ? strlen(source) : 0U) + 64U;
+    char *body = (char *)kolibri_mem_alloc(NULL, capacity);
+    if (!body) {
+        return NULL;
     }
-    fprintf(file, "# %s\n\n", record->title ? record->title : "Без названия");
-    if (record->source && record->source[0]) {
-        fprintf(file, "Источник: %s\n\n", record->source);
+    int length = source ? snprintf(body, capacity, "# %s\n\nИсточник: %s\n\n%s\n", title, source, content)
+                        : snprintf(body, capacity, "# %s\n\n%s\n", title, content);
+    *out_length = (size_t)length;
+    return body;
+}
+
+static void *export_worker_main(void *arg) {
+    ExportPool *pool = (ExportPool *)arg;
+    size_t i;
+    while ((i = atomic_fetch_add(&pool->next, 1U)) < pool->count) {
+        ExportJob *job = &pool->jobs[i];
+        job->failed = write_atomically(pool->dir, job->name, job->body, job->length) != 0;
+    }
+    return NULL;
+}
+
+static void export_run_pool(ExportPool *pool, size_t threads) {
+    if (threads > pool->count) {
+        threads = pool->count;
+    }
+    pthread_t workers[KOLIBRI_QUEUE_EXPORT_THREADS_MAX];
+    unsigned char started[KOLIBRI_QUEUE_EXPORT_THREADS_MAX];
+    atomic_store(&pool->next, 0U);
+    for (size_t w = 1; w < threads; ++w) {
+        started[w] = pthread_create(&workers[w], NULL, export_worker_main, pool) == 0;
+    }
+    export_worker_main(pool);
+    for (size_t w = 1; w < threads; ++w) {
+        if (started[w]) {
+            pthread_join(workers[w], NULL);
+        }
     }
-    fprintf(file, "%s\n", record->content ? record->content : "");
-    fclose(file);
+}
+
+/* Writes the pending jobs and records the ones that landed in the manifest. */
+static int export_flush(KolibriQueue *queue, ExportPool *pool, ExportManifest *next, const long long *ids,
+                        const unsigned long long *hashes) {
+    export_run_pool(pool, queue->export_threads);
+    int rc = 0;
+    for (size_t i = 0; i < pool->count; ++i) {
+        ExportJob *job = &pool->jobs[i];
+        if (job->failed) {
+            rc = -1;
+        } else {
+            ExportEntry entry;
+            entry.id = ids[i];
+            entry.hash = hashes[i];
+            memcpy(entry.name, job->name, sizeof(entry.name));
+            if (manifest_push(next, &entry) != 0) {
+                rc = -1;
+            }
+        }
+        kolibri_mem_free(NULL, job->body);
+        job->body = NULL;
+    }
+    pool->count = 0U;
+    return rc;
 }
 
 int kolibri_queue_export_markdown(KolibriQueue *queue,
@@ -371,17 +776,108 @@ int kolibri_queue_export_markdown(KolibriQueue *queue,
     if (ensure_directory(destination_dir) != 0) {
         return SQLITE_ERROR;
     }
-    delete_markdown_files(destination_dir);
-    KolibriQueueRecord *records = NULL;
-    size_t count = 0U;
-    int rc = kolibri_queue_fetch(queue, status, 10000U, &records, &count);
+    ExportManifest previous = {NULL, 0U, 0U};
+    ExportManifest next = {NULL, 0U, 0U};
+    if (!manifest_load(destination_dir, &previous)) {
+        /* Exports from before the manifest used positional names. */
+        delete_markdown_files(destination_dir);
+    }
+    KolibriQueueIter *iter = NULL;
+    int rc = kolibri_queue_iter_open(queue, status, 0, 0U, &iter);
     if (rc != SQLITE_OK) {
+        kolibri_mem_free(NULL, previous.items);
         return rc;
     }
-    for (size_t i = 0; i < count; ++i) {
-        write_markdown_file(&records[i], destination_dir, i);
+    ExportJob jobs[KOLIBRI_EXPORT_BATCH];
+    long long ids[KOLIBRI_EXPORT_BATCH];
+    unsigned long long hashes[KOLIBRI_EXPORT_BATCH];
+    ExportPool pool;
+    pool.dir = destination_dir;
+    pool.jobs = jobs;
+    pool.count = 0U;
+    atomic_init(&pool.next, 0U);
+    int io_failed = 0;
+    size_t cursor = 0U;
+    size_t count = 0U;
+    KolibriQueueRow row;
+    while ((rc = kolibri_queue_iter_next(iter, &row)) == SQLITE_ROW) {
+        count++;
+        ExportEntry entry;
+        entry.id = row.submission_id;
+        export_file_name(&row, entry.name, sizeof(entry.name));
+        size_t length = 0U;
+        char *body = render_markdown(&row, &length);
+        if (!body) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        entry.hash = export_hash(body, length);
+        while (cursor < previous.count && previous.items[cursor].id < entry.id) {
+            cursor++;
+        }
+        const ExportEntry *known = cursor < previous.count && previous.items[cursor].id == entry.id
+                                       ? &previous.items[cursor]
+                                       : NULL;
+        if (known && known->hash == entry.hash && strcmp(known->name, entry.name) == 0) {
+            char path[4096];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", destination_dir, entry.name);
+            if (stat(path, &st) == 0 && (size_t)st.st_size == length) {
+                kolibri_mem_free(NULL, body);
+                if (manifest_push(&next, &entry) != 0) {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                continue;
+            }
+        }
+        ExportJob *job = &jobs[pool.count];
+        memcpy(job->name, entry.name, sizeof(job->name));
+        job->body = body;
+        job->length = length;
+        job->failed = 0;
+        ids[pool.count] = entry.id;
+        hashes[pool.count] = entry.hash;
+        pool.count++;
+        if (pool.count == KOLIBRI_EXPORT_BATCH) {
+            io_failed |= export_flush(queue, &pool, &next, ids, hashes) != 0;
+        }
+    }
+    kolibri_queue_iter_close(iter);
+    if (pool.count > 0U) {
+        if (rc == SQLITE_DONE) {
+            io_failed |= export_flush(queue, &pool, &next, ids, hashes) != 0;
+        } else {
+            for (size_t i = 0; i < pool.count; ++i) {
+                kolibri_mem_free(NULL, jobs[i].body);
+            }
+        }
+    }
+    if (rc == SQLITE_DONE) {
+        /* Drop files of records that left the status or were renamed. */
+        size_t j = 0U;
+        for (size_t i = 0; i < previous.count; ++i) {
+            const ExportEntry *old = &previous.items[i];
+            while (j < next.count && next.items[j].id < old->id) {
+                j++;
+            }
+            if (j < next.count && next.items[j].id == old->id && strcmp(next.items[j].name, old->name) == 0) {
+                continue;
+            }
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", destination_dir, old->name);
+            remove(path);
+        }
+        if (manifest_store(destination_dir, &next) != 0) {
+            io_failed = 1;
+        }
+        rc = io_failed ? SQLITE_IOERR : SQLITE_OK;
+    }
+    kolibri_mem_free(NULL, previous.items);
+    kolibri_mem_free(NULL, next.items);
+    if (rc != SQLITE_OK) {
+        return rc;
     }
-    kolibri_queue_free_records(records, count);
     if (out_exported) {
         *out_exported = count;
     }
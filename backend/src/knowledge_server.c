@@ -1,13 +1,21 @@
 #include "kolibri/knowledge_index.h"
 #include "kolibri/genome.h"
 #include "kolibri/swarm.h"
+#include "kolibri/script.h"
+#include "kolibri/trace.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <strings.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,27 +23,77 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define KOLIBRI_HAVE_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/event.h>
+#define KOLIBRI_HAVE_KQUEUE 1
+#endif
+
+#if defined(KOLIBRI_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
 #define KOLIBRI_DEFAULT_PORT 8000
 #define KOLIBRI_SERVER_BACKLOG 16
 #define KOLIBRI_REQUEST_BUFFER 8192
-#define KOLIBRI_RESPONSE_BUFFER 32768
+#define KOLIBRI_RESPONSE_PREALLOC 4096U
+#define KOLIBRI_RESPONSE_RETAIN 65536U
+#define KOLIBRI_SEARCH_LIMIT_MAX 100U
+#define KOLIBRI_SUGGEST_LIMIT_MAX 20U
+/* Bumped when server-built caches gain data older ones lack (positions). */
+#define KOLIBRI_INDEX_CACHE_FORMAT 2ULL
+#define KOLIBRI_STREAM_CHUNK 16384U
+#define KOLIBRI_DEFAULT_QUERY_CACHE 256U
+#define KOLIBRI_MAX_QUERY_CACHE 65536U
+#define KOLIBRI_QUERY_REPLAY 3U
 #define KOLIBRI_MAX_CONTENT_LENGTH 2048
 #define KOLIBRI_RATE_LIMIT_WINDOW 60
 #define KOLIBRI_RATE_LIMIT_BURST 30
+#define KOLIBRI_RATE_SHARDS 16U
+#define KOLIBRI_RATE_SHARD_SLOTS 128U
+#define KOLIBRI_RATE_PROBE 8U
 #define KOLIBRI_DEFAULT_INDEX_CACHE ".kolibri/index"
 #define KOLIBRI_BOOTSTRAP_SCRIPT "knowledge_bootstrap.ks"
 #define KOLIBRI_KNOWLEDGE_GENOME ".kolibri/knowledge_genome.dat"
+#define KOLIBRI_KNOWLEDGE_GENOME_DIR ".kolibri/knowledge_genome"
+#define KOLIBRI_MAX_SEGMENT_BLOCKS (1U << 30)
+#define KOLIBRI_DEFAULT_WORKERS 4U
+#define KOLIBRI_MAX_WORKERS 64U
+#define KOLIBRI_WORKER_QUEUE 128U
+#define KOLIBRI_REQUEST_TIMEOUT 5
+#define KOLIBRI_DEFAULT_KEEPALIVE_TIMEOUT 5U
+#define KOLIBRI_DEFAULT_KEEPALIVE_MAX 100U
+#define KOLIBRI_MAX_KEEPALIVE_TIMEOUT 3600U
+#define KOLIBRI_MAX_KEEPALIVE_REQUESTS 100000U
+#define KOLIBRI_MAX_SNDBUF (64U * 1024U * 1024U)
+#define KOLIBRI_EVENT_BATCH 64
+#define KOLIBRI_EVENT_MAX_CONNECTIONS 8192U
+#define KOLIBRI_GENOME_QUEUE 1024U
+#define KOLIBRI_GENOME_BATCH 64U
+#define KOLIBRI_WARM_BATCH 64U
+#define KOLIBRI_WARM_ASSOCIATIONS_MAX 65536U
+#define KOLIBRI_WARM_SNIPPET 360U
+#define KOLIBRI_MAX_SHARDS 64U
+#define KOLIBRI_DEFAULT_SHARD_TIMEOUT_MS 250U
+#define KOLIBRI_MAX_SHARD_TIMEOUT_MS 60000U
+#define KOLIBRI_SHARD_RESPONSE_MAX (4U << 20)
+#define KOLIBRI_DEFAULT_COMPRESS_MIN 1024U
+#define KOLIBRI_MAX_COMPRESS_MIN (1U << 20)
+#define KOLIBRI_COMPRESS_LEVEL 6
 
 static volatile sig_atomic_t kolibri_server_running = 1;
-static size_t kolibri_requests_total = 0U;
-static size_t kolibri_search_hits = 0U;
-static size_t kolibri_search_misses = 0U;
-static time_t kolibri_bootstrap_timestamp = 0;
-static time_t kolibri_index_timestamp = 0;
+static atomic_size_t kolibri_requests_total = 0U;
+static atomic_size_t kolibri_search_hits = 0U;
+static atomic_size_t kolibri_search_misses = 0U;
+static atomic_llong kolibri_bootstrap_timestamp = 0;
+static volatile sig_atomic_t kolibri_reload_requested = 0;
 static time_t kolibri_server_started_at = 0;
 
 static int kolibri_server_port = KOLIBRI_DEFAULT_PORT;
@@ -45,10 +103,30 @@ static size_t kolibri_knowledge_directory_count = 0U;
 static char kolibri_index_json_path[512];
 static char kolibri_index_cache_dir[512] = KOLIBRI_DEFAULT_INDEX_CACHE;
 static char kolibri_admin_token[256];
-static char kolibri_index_source[64] = "directories";
+static size_t kolibri_worker_count = KOLIBRI_DEFAULT_WORKERS;
+static int kolibri_event_loop_mode = 0;
+static size_t kolibri_keepalive_timeout = KOLIBRI_DEFAULT_KEEPALIVE_TIMEOUT;
+static size_t kolibri_keepalive_max = KOLIBRI_DEFAULT_KEEPALIVE_MAX;
+/* SO_SNDBUF for client sockets; 0 leaves the kernel autotuning it. */
+static size_t kolibri_client_sndbuf = 0U;
+static size_t kolibri_query_cache_capacity = KOLIBRI_DEFAULT_QUERY_CACHE;
+static int kolibri_knowledge_stemming = 0;
+static int kolibri_knowledge_quantize = 0;
+/* Smallest whole body sent compressed to a client that accepts it; 0 never compresses. */
+static size_t kolibri_compress_min = KOLIBRI_DEFAULT_COMPRESS_MIN;
+static atomic_size_t kolibri_not_modified_total = 0U;
+static atomic_size_t kolibri_compressed_responses = 0U;
+static atomic_size_t kolibri_compress_runs = 0U;
+/* Bumped whenever a different index starts serving; cached answers die with it. */
+static atomic_ulong kolibri_index_generation = 0UL;
 
 static KolibriGenome kolibri_genome;
 static int kolibri_genome_ready = 0;
+/* 0: teach/feedback answer after their event is written; 1: as soon as it is queued. */
+static int kolibri_genome_ack_on_enqueue = 0;
+static KolibriGenomeSyncMode kolibri_genome_sync_mode = KG_SYNC_FLUSH;
+/* Non-zero switches to a segmented genome in KOLIBRI_KNOWLEDGE_GENOME_DIR. */
+static size_t kolibri_genome_segment_blocks = 0U;
 static unsigned char kolibri_hmac_key[KOLIBRI_HMAC_KEY_SIZE];
 static size_t kolibri_hmac_key_len = 0U;
 static char kolibri_hmac_key_origin[128];
@@ -57,21 +135,381 @@ static int kolibri_swarm_ready = 0;
 static char kolibri_swarm_nodes_config[1024];
 static char kolibri_swarm_node_id[KOLIBRI_SWARM_ID_MAX];
 
+/* Sharded mode: this instance indexes partition shard_index of shard_count,
+ * a coordinator fans searches out to the peers listed in --shards. */
 typedef struct {
-    time_t window_start;
-    size_t count;
+    char endpoint[KOLIBRI_SWARM_ENDPOINT_MAX];
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+} KolibriShardPeer;
+
+static size_t kolibri_shard_count = 0U;
+static size_t kolibri_shard_index = 0U;
+static char kolibri_shard_peers_config[1024];
+static KolibriShardPeer kolibri_shard_peers[KOLIBRI_MAX_SHARDS];
+static size_t kolibri_shard_peer_count = 0U;
+static size_t kolibri_shard_timeout_ms = KOLIBRI_DEFAULT_SHARD_TIMEOUT_MS;
+static atomic_size_t kolibri_shard_requests = 0U;
+static atomic_size_t kolibri_shard_failures = 0U;
+static atomic_size_t kolibri_shard_partial = 0U;
+
+/*
+ * Immutable index snapshot. Requests pin it with a reference, so a reload
+ * swaps in a new snapshot and the old one is freed by its last reader.
+ */
+typedef struct {
+    KolibriKnowledgeIndex *index;
+    atomic_size_t refs;
+    unsigned long generation;
+    time_t timestamp;
+    char source[64];
+    unsigned long long fingerprint;
+    time_t manifest_mtime;
+} KolibriServingIndex;
+
+static KolibriServingIndex *kolibri_serving_index = NULL;
+static pthread_mutex_t kolibri_serving_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t kolibri_reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t kolibri_reload_thread;
+static int kolibri_reload_joinable = 0;
+static atomic_int kolibri_reload_active = 0;
+
+typedef enum {
+    KOLIBRI_WARM_IDLE = 0,
+    KOLIBRI_WARM_RUNNING,
+    KOLIBRI_WARM_DONE,
+    KOLIBRI_WARM_FAILED,
+} KolibriWarmState;
+
+static const char *const kolibri_warm_state_names[] = {"idle", "running", "done", "failed"};
+
+/*
+ * Warm training: a worker writes the bootstrap script and feeds every
+ * document of one snapshot through the bulk association path into a
+ * server-side pool, while the listener already serves search. The pool
+ * belongs to the worker until it is joined; a reload cancels the running
+ * stage and starts over on the new snapshot.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int joinable;
+    atomic_int cancel;
+    atomic_int state;
+    atomic_size_t trained;
+    atomic_size_t total;
+    atomic_ulong generation;
+    KolibriServingIndex *serving;
+    KolibriFormulaPool *pool;
+} KolibriWarmTrainer;
+
+static KolibriWarmTrainer kolibri_warm = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Per-client token buckets, striped over independently locked shards so
+ * clients hashing to different shards never contend. A bucket untouched
+ * for a whole window has refilled completely and is dropped.
+ */
+typedef struct {
+    uint32_t addr;
+    int used;
+    double tokens;
+    uint64_t last_ns;
+} KolibriRateBucket;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t last_sweep_ns;
+    KolibriRateBucket slots[KOLIBRI_RATE_SHARD_SLOTS];
+} KolibriRateShard;
+
+typedef struct {
+    KolibriRateShard shards[KOLIBRI_RATE_SHARDS];
+    atomic_size_t rejected;
 } KolibriRateLimiter;
 
-static KolibriRateLimiter kolibri_feedback_rate = { 0, 0 };
-static KolibriRateLimiter kolibri_teach_rate = { 0, 0 };
+static KolibriRateLimiter kolibri_feedback_rate;
+static KolibriRateLimiter kolibri_teach_rate;
+
+/* Content codings a response body can be sent in; only identity without zlib. */
+typedef enum {
+    KOLIBRI_ENCODING_IDENTITY,
+    KOLIBRI_ENCODING_GZIP,
+    KOLIBRI_ENCODING_DEFLATE,
+    KOLIBRI_ENCODING_COUNT
+} KolibriEncoding;
+
+static const char *const kolibri_encoding_names[KOLIBRI_ENCODING_COUNT] = {"identity", "gzip", "deflate"};
+
+/*
+ * Serialized /api/knowledge/search answer for one normalized query + limit.
+ * etag hashes the identity body; packed holds the same body in the other
+ * codings, each compressed once by the first client that asked for it.
+ */
+typedef struct KolibriCachedQuery {
+    char *key;
+    uint64_t hash;
+    char *body;
+    size_t body_len;
+    uint64_t etag;
+    char *packed[KOLIBRI_ENCODING_COUNT];
+    size_t packed_len[KOLIBRI_ENCODING_COUNT];
+    size_t result_count;
+    size_t replay[KOLIBRI_QUERY_REPLAY];
+    size_t replay_count;
+    unsigned long generation;
+    struct KolibriCachedQuery *prev;
+    struct KolibriCachedQuery *next;
+    struct KolibriCachedQuery *chain;
+} KolibriCachedQuery;
+
+typedef struct {
+    KolibriCachedQuery **buckets;
+    size_t bucket_count;
+    KolibriCachedQuery *head;
+    KolibriCachedQuery *tail;
+    size_t count;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    pthread_mutex_t lock;
+} KolibriQueryCache;
+
+static KolibriQueryCache kolibri_query_cache = {
+    .buckets = NULL,
+    .bucket_count = 0U,
+    .head = NULL,
+    .tail = NULL,
+    .count = 0U,
+    .hits = 0U,
+    .misses = 0U,
+    .evictions = 0U,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Log-scale latency histograms: counters are plain relaxed atomics so
+ * workers and the event loop record without taking a lock. Buckets are
+ * stored per range and made cumulative only when /metrics renders them.
+ */
+#define KOLIBRI_LATENCY_BOUNDS 16U
+
+static const uint64_t kolibri_latency_bounds_ns[KOLIBRI_LATENCY_BOUNDS] = {
+    25000ULL,     50000ULL,     100000ULL,    250000ULL,     500000ULL,     1000000ULL,
+    2500000ULL,   5000000ULL,   10000000ULL,  25000000ULL,   50000000ULL,   100000000ULL,
+    250000000ULL, 500000000ULL, 1000000000ULL, 5000000000ULL,
+};
+static const char *const kolibri_latency_labels[KOLIBRI_LATENCY_BOUNDS] = {
+    "0.000025", "0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005",
+    "0.01",     "0.025",   "0.05",   "0.1",     "0.25",   "0.5",   "1",      "5",
+};
+
+typedef struct {
+    atomic_ulong buckets[KOLIBRI_LATENCY_BOUNDS + 1U];
+    atomic_ullong sum_ns;
+    atomic_ulong count;
+} KolibriLatencyHistogram;
+
+typedef enum {
+    KOLIBRI_ROUTE_SEARCH,
+    KOLIBRI_ROUTE_SUGGEST,
+    KOLIBRI_ROUTE_TEACH,
+    KOLIBRI_ROUTE_FEEDBACK,
+    KOLIBRI_ROUTE_HEALTHZ,
+    KOLIBRI_ROUTE_METRICS,
+    KOLIBRI_ROUTE_RELOAD,
+    KOLIBRI_ROUTE_SWARM,
+    KOLIBRI_ROUTE_OTHER,
+    KOLIBRI_ROUTE_COUNT
+} KolibriRoute;
+
+typedef enum {
+    KOLIBRI_PHASE_RECEIVE,
+    KOLIBRI_PHASE_PARSE,
+    KOLIBRI_PHASE_SEARCH,
+    KOLIBRI_PHASE_SERIALIZE,
+    KOLIBRI_PHASE_SEND,
+    KOLIBRI_PHASE_COUNT
+} KolibriPhase;
+
+static const char *const kolibri_route_names[KOLIBRI_ROUTE_COUNT] = {
+    "search", "suggest", "teach", "feedback", "healthz", "metrics", "reload", "swarm", "other",
+};
+static const char *const kolibri_phase_names[KOLIBRI_PHASE_COUNT] = {
+    "receive", "parse", "search", "serialize", "send",
+};
+/* Span names for kolibri_trace; the histograms above keep the short labels. */
+static const char *const kolibri_route_spans[KOLIBRI_ROUTE_COUNT] = {
+    "http.search", "http.suggest", "http.teach", "http.feedback", "http.healthz",
+    "http.metrics", "http.reload", "http.swarm", "http.other",
+};
+static const char *const kolibri_phase_spans[KOLIBRI_PHASE_COUNT] = {
+    "http.receive", "http.parse", "http.search_index", "http.serialize", "http.send",
+};
+/* Output path from KOLIBRI_TRACE; the trace is written at shutdown. */
+static const char *kolibri_trace_path = NULL;
+
+static KolibriLatencyHistogram kolibri_route_latency[KOLIBRI_ROUTE_COUNT];
+static KolibriLatencyHistogram kolibri_phase_latency[KOLIBRI_PHASE_COUNT];
+
+/*
+ * Genome events queued by request threads and appended by one writer
+ * thread in batches, so teach/feedback never wait on the disk directly.
+ * Sequence numbers let a producer wait until its own event is written.
+ */
+typedef struct {
+    char event[KOLIBRI_EVENT_TYPE_SIZE];
+    char payload[KOLIBRI_PAYLOAD_SIZE];
+} KolibriGenomeEvent;
+
+typedef struct {
+    KolibriGenomeEvent events[KOLIBRI_GENOME_QUEUE];
+    size_t head;
+    size_t count;
+    uint64_t enqueued;
+    uint64_t written;
+    int running;
+    int stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t flushed;
+} KolibriGenomeWriter;
+
+static KolibriGenomeWriter kolibri_genome_writer = {
+    .head = 0U,
+    .count = 0U,
+    .enqueued = 0U,
+    .written = 0U,
+    .running = 0,
+    .stopping = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+    .flushed = PTHREAD_COND_INITIALIZER,
+};
+static atomic_size_t kolibri_genome_events_written = 0U;
+static atomic_size_t kolibri_genome_append_errors = 0U;
+/* Fire-and-forget events discarded because the writer queue was full. */
+static atomic_size_t kolibri_genome_events_dropped = 0U;
+static KolibriLatencyHistogram kolibri_genome_flush_latency;
+
+/* Bounded hand-off queue between the accept loop and the worker threads. */
+typedef struct {
+    int fds[KOLIBRI_WORKER_QUEUE];
+    uint32_t addrs[KOLIBRI_WORKER_QUEUE];
+    /* Requests already served on the socket, nonzero for a parked keep-alive. */
+    size_t served[KOLIBRI_WORKER_QUEUE];
+    size_t head;
+    size_t count;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} KolibriClientQueue;
+
+static KolibriClientQueue kolibri_client_queue = {
+    .head = 0U,
+    .count = 0U,
+    .stopping = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .not_empty = PTHREAD_COND_INITIALIZER,
+    .not_full = PTHREAD_COND_INITIALIZER,
+};
+
+/* Idle keep-alive sockets handed from the workers to the parking thread. */
+static atomic_size_t kolibri_keepalive_parked = 0U;
+
+/*
+ * One client socket: the request being framed, the response body being
+ * built (reused across keep-alive requests) and any bytes the socket has
+ * not accepted yet.
+ */
+typedef struct {
+    int fd;
+    char in[KOLIBRI_REQUEST_BUFFER];
+    size_t in_len;
+    char *out;
+    size_t out_len;
+    size_t out_cap;
+    size_t out_sent;
+    char *body;
+    size_t body_len;
+    size_t body_cap;
+    int failed;
+    time_t last_active;
+    size_t served;
+    int keep_alive;
+    int watching_write;
+    int chunked_ok;
+    int stream_armed;
+    int streaming;
+    int stream_status;
+    const char *stream_type;
+    /* Negotiated from Accept-Encoding and If-None-Match for this request. */
+    KolibriEncoding accept_encoding;
+    char if_none_match[128];
+    /* Set by the handler: the whole 200 body gets an ETag and may be a 304. */
+    int cacheable;
+    int not_modified;
+    uint64_t etag;
+    int etag_ready;
+    KolibriEncoding body_encoding;
+    /* Compressed copy of the last body, kept until the next response begins. */
+    char *packed;
+    size_t packed_len;
+    size_t packed_cap;
+    KolibriEncoding packed_encoding;
+    uint64_t receive_started;
+    uint64_t send_ns;
+    KolibriRoute route;
+    uint32_t peer_addr;
+} KolibriConnection;
 
 static int load_admin_token_from_file(const char *path, char *out, size_t out_size);
 
 static void handle_signal(int sig) {
-    (void)sig;
+    if (sig == SIGHUP) {
+        kolibri_reload_requested = 1;
+        return;
+    }
     kolibri_server_running = 0;
 }
 
+static void block_server_signals(sigset_t *previous) {
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blocked, previous);
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void latency_record(KolibriLatencyHistogram *histogram, uint64_t elapsed_ns) {
+    size_t bucket = 0U;
+    while (bucket < KOLIBRI_LATENCY_BOUNDS && elapsed_ns > kolibri_latency_bounds_ns[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1UL, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, elapsed_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1UL, memory_order_relaxed);
+}
+
+static void record_phase(KolibriPhase phase, uint64_t started_ns) {
+    uint64_t now = monotonic_ns();
+    latency_record(&kolibri_phase_latency[phase], now - started_ns);
+    KOLIBRI_TRACE_COMPLETE(kolibri_phase_spans[phase], started_ns, now);
+}
+
 static void escape_script_string(const char *input, char *output, size_t out_size) {
     if (!output || out_size == 0) {
         return;
@@ -211,6 +649,86 @@ static void configure_swarm_from_config(void) {
             kolibri_swarm.node_count);
 }
 
+/* "I/N" with I < N <= KOLIBRI_MAX_SHARDS * 16; 0 on success. */
+static int parse_shard_option(const char *text, size_t *out_index, size_t *out_count) {
+    if (!text || !*text) {
+        return -1;
+    }
+    char *slash = NULL;
+    unsigned long index = strtoul(text, &slash, 10);
+    if (!slash || slash == text || *slash != '/' || !isdigit((unsigned char)slash[1])) {
+        return -1;
+    }
+    char *end = NULL;
+    unsigned long count = strtoul(slash + 1, &end, 10);
+    if (!end || *end != '\0' || count == 0UL || count > KOLIBRI_MAX_SHARDS * 16UL || index >= count) {
+        return -1;
+    }
+    *out_index = (size_t)index;
+    *out_count = (size_t)count;
+    return 0;
+}
+
+/* Resolves the comma-separated host:port list once, so searches never wait on DNS. */
+static int configure_shard_peers(void) {
+    kolibri_shard_peer_count = 0U;
+    if (kolibri_shard_peers_config[0] == '\0') {
+        return 0;
+    }
+    char copy[sizeof(kolibri_shard_peers_config)];
+    strncpy(copy, kolibri_shard_peers_config, sizeof(copy) - 1U);
+    copy[sizeof(copy) - 1U] = '\0';
+    char *saveptr = NULL;
+    for (char *token = strtok_r(copy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        trim_whitespace(token);
+        if (strncmp(token, "http://", 7U) == 0) {
+            token += 7;
+        }
+        size_t len = strlen(token);
+        while (len > 0U && token[len - 1U] == '/') {
+            token[--len] = '\0';
+        }
+        if (len == 0U) {
+            continue;
+        }
+        char *colon = strrchr(token, ':');
+        if (!colon || colon == token || colon[1] == '\0' || kolibri_shard_peer_count == KOLIBRI_MAX_SHARDS) {
+            fprintf(stderr, "[kolibri-knowledge] invalid shard peer: %s\n", token);
+            return -1;
+        }
+        KolibriShardPeer *peer = &kolibri_shard_peers[kolibri_shard_peer_count];
+        snprintf(peer->endpoint, sizeof(peer->endpoint), "%s", token);
+        *colon = '\0';
+        char *host = token;
+        if (*host == '[' && colon[-1] == ']') {
+            colon[-1] = '\0';
+            host++;
+        }
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *found = NULL;
+        int rc = getaddrinfo(host, colon + 1, &hints, &found);
+        if (rc != 0 || !found || found->ai_addrlen > sizeof(peer->addr)) {
+            fprintf(stderr, "[kolibri-knowledge] cannot resolve shard peer %s: %s\n", peer->endpoint,
+                    rc != 0 ? gai_strerror(rc) : "no address");
+            if (found) {
+                freeaddrinfo(found);
+            }
+            return -1;
+        }
+        memcpy(&peer->addr, found->ai_addr, found->ai_addrlen);
+        peer->addr_len = found->ai_addrlen;
+        freeaddrinfo(found);
+        kolibri_shard_peer_count += 1U;
+    }
+    if (kolibri_shard_peer_count > 0U) {
+        fprintf(stdout, "[kolibri-knowledge] coordinating %zu shard peers\n", kolibri_shard_peer_count);
+    }
+    return 0;
+}
+
 static int add_knowledge_directory(const char *path) {
     if (!path || *path == '\0') {
         return 0;
@@ -284,35 +802,128 @@ static int parse_port_number(const char *text, int *out) {
     return 0;
 }
 
-static void set_index_timestamp_from_path(const char *path) {
-    if (!path) {
-        kolibri_index_timestamp = time(NULL);
-        return;
-    }
+static time_t path_mtime(const char *path) {
     struct stat st;
-    if (stat(path, &st) == 0) {
-        kolibri_index_timestamp = st.st_mtime;
-    } else {
-        kolibri_index_timestamp = time(NULL);
+    if (!path || path[0] == '\0' || stat(path, &st) != 0) {
+        return 0;
     }
+    return st.st_mtime;
 }
 
-static int rate_limiter_allow(KolibriRateLimiter *limiter, time_t now, size_t limit) {
-    if (!limiter || limit == 0U) {
+static int parse_durability_option(const char *text, int *ack_on_enqueue) {
+    if (strcmp(text, "flush") == 0) {
+        *ack_on_enqueue = 0;
         return 0;
     }
-    if (limiter->window_start == 0 || now - limiter->window_start >= KOLIBRI_RATE_LIMIT_WINDOW) {
-        limiter->window_start = now;
-        limiter->count = 0U;
+    if (strcmp(text, "enqueue") == 0) {
+        *ack_on_enqueue = 1;
+        return 0;
+    }
+    return -1;
+}
+
+static int parse_sync_option(const char *text, KolibriGenomeSyncMode *mode) {
+    if (strcmp(text, "flush") == 0) {
+        *mode = KG_SYNC_FLUSH;
+    } else if (strcmp(text, "fdatasync") == 0) {
+        *mode = KG_SYNC_FDATASYNC;
+    } else if (strcmp(text, "fsync") == 0) {
+        *mode = KG_SYNC_FSYNC;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_size_option(const char *text, size_t max_value, size_t *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
+    }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0') {
+        return -1;
+    }
+    if (value < 0L || (unsigned long)value > max_value) {
+        return -1;
+    }
+    *out = (size_t)value;
+    return 0;
+}
+
+static void rate_limiter_init(KolibriRateLimiter *limiter) {
+    memset(limiter, 0, sizeof(*limiter));
+    for (size_t i = 0; i < KOLIBRI_RATE_SHARDS; ++i) {
+        pthread_mutex_init(&limiter->shards[i].lock, NULL);
+    }
+    atomic_init(&limiter->rejected, 0U);
+}
+
+static void rate_limiter_destroy(KolibriRateLimiter *limiter) {
+    for (size_t i = 0; i < KOLIBRI_RATE_SHARDS; ++i) {
+        pthread_mutex_destroy(&limiter->shards[i].lock);
+    }
+}
+
+static void rate_shard_expire(KolibriRateShard *shard, uint64_t now_ns, uint64_t idle_ns) {
+    for (size_t i = 0; i < KOLIBRI_RATE_SHARD_SLOTS; ++i) {
+        if (shard->slots[i].used && now_ns - shard->slots[i].last_ns >= idle_ns) {
+            shard->slots[i].used = 0;
+        }
     }
-    if (limiter->count >= limit) {
+    shard->last_sweep_ns = now_ns;
+}
+
+/* Token bucket of `limit` requests refilled evenly over KOLIBRI_RATE_LIMIT_WINDOW, per client address. */
+static int rate_limiter_allow(KolibriRateLimiter *limiter, uint32_t addr, size_t limit) {
+    if (!limiter || limit == 0U) {
         return 0;
     }
-    limiter->count += 1U;
-    return 1;
+    const uint64_t window_ns = (uint64_t)KOLIBRI_RATE_LIMIT_WINDOW * 1000000000ULL;
+    uint32_t hash = addr * 2654435761U;
+    KolibriRateShard *shard = &limiter->shards[(hash >> 16) % KOLIBRI_RATE_SHARDS];
+    size_t start = (size_t)(hash & (KOLIBRI_RATE_SHARD_SLOTS - 1U));
+    uint64_t now_ns = monotonic_ns();
+
+    pthread_mutex_lock(&shard->lock);
+    if (now_ns - shard->last_sweep_ns >= window_ns) {
+        rate_shard_expire(shard, now_ns, window_ns);
+    }
+    KolibriRateBucket *bucket = NULL;
+    KolibriRateBucket *victim = NULL;
+    for (size_t probe = 0; probe < KOLIBRI_RATE_PROBE; ++probe) {
+        KolibriRateBucket *slot = &shard->slots[(start + probe) % KOLIBRI_RATE_SHARD_SLOTS];
+        if (slot->used && slot->addr == addr) {
+            bucket = slot;
+            break;
+        }
+        if (!victim || !slot->used || (victim->used && slot->last_ns < victim->last_ns)) {
+            victim = slot;
+        }
+    }
+    if (!bucket) {
+        /* A full probe window recycles its least recently seen client. */
+        bucket = victim;
+        bucket->addr = addr;
+        bucket->used = 1;
+        bucket->tokens = (double)limit;
+        bucket->last_ns = now_ns;
+    }
+    double refill = (double)(now_ns - bucket->last_ns) * (double)limit / (double)window_ns;
+    bucket->tokens = bucket->tokens + refill > (double)limit ? (double)limit : bucket->tokens + refill;
+    bucket->last_ns = now_ns;
+    int allowed = bucket->tokens >= 1.0;
+    if (allowed) {
+        bucket->tokens -= 1.0;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if (!allowed) {
+        atomic_fetch_add(&limiter->rejected, 1U);
+    }
+    return allowed;
 }
 
-static void compose_manifest_path(char *buffer, size_t buffer_size, const char *base) {
+static void compose_cache_path(char *buffer, size_t buffer_size, const char *base, const char *suffix) {
     if (!buffer || buffer_size == 0U) {
         return;
     }
@@ -320,7 +931,6 @@ static void compose_manifest_path(char *buffer, size_t buffer_size, const char *
     if (!base || *base == '\0') {
         return;
     }
-    const char *suffix = "/manifest.json";
     size_t base_len = strlen(base);
     size_t suffix_len = strlen(suffix);
     if (base_len + suffix_len + 1U > buffer_size) {
@@ -329,6 +939,16 @@ static void compose_manifest_path(char *buffer, size_t buffer_size, const char *
     snprintf(buffer, buffer_size, "%s%s", base, suffix);
 }
 
+static void compose_manifest_path(char *buffer, size_t buffer_size, const char *base) {
+    compose_cache_path(buffer, buffer_size, base, "/manifest.json");
+}
+
+static time_t manifest_mtime(const char *base) {
+    char manifest_path[512];
+    compose_manifest_path(manifest_path, sizeof(manifest_path), base);
+    return path_mtime(manifest_path);
+}
+
 static void apply_environment_configuration(void) {
     const char *port_env = getenv("KOLIBRI_KNOWLEDGE_PORT");
     if (port_env && *port_env) {
@@ -394,6 +1014,124 @@ static void apply_environment_configuration(void) {
         strncpy(kolibri_swarm_node_id, swarm_id_env, sizeof(kolibri_swarm_node_id) - 1U);
         kolibri_swarm_node_id[sizeof(kolibri_swarm_node_id) - 1U] = '\0';
     }
+
+    const char *workers_env = getenv("KOLIBRI_KNOWLEDGE_WORKERS");
+    if (workers_env && *workers_env) {
+        size_t parsed_workers = 0U;
+        if (parse_size_option(workers_env, KOLIBRI_MAX_WORKERS, &parsed_workers) == 0) {
+            kolibri_worker_count = parsed_workers;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_WORKERS value: %s\n", workers_env);
+        }
+    }
+
+    const char *keepalive_env = getenv("KOLIBRI_KNOWLEDGE_KEEPALIVE_TIMEOUT");
+    if (keepalive_env && *keepalive_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(keepalive_env, KOLIBRI_MAX_KEEPALIVE_TIMEOUT, &parsed) == 0) {
+            kolibri_keepalive_timeout = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_KEEPALIVE_TIMEOUT value: %s\n", keepalive_env);
+        }
+    }
+
+    const char *keepalive_max_env = getenv("KOLIBRI_KNOWLEDGE_KEEPALIVE_MAX");
+    if (keepalive_max_env && *keepalive_max_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(keepalive_max_env, KOLIBRI_MAX_KEEPALIVE_REQUESTS, &parsed) == 0) {
+            kolibri_keepalive_max = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_KEEPALIVE_MAX value: %s\n", keepalive_max_env);
+        }
+    }
+
+    const char *sndbuf_env = getenv("KOLIBRI_KNOWLEDGE_SNDBUF");
+    if (sndbuf_env && *sndbuf_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(sndbuf_env, KOLIBRI_MAX_SNDBUF, &parsed) == 0) {
+            kolibri_client_sndbuf = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SNDBUF value: %s\n", sndbuf_env);
+        }
+    }
+
+    const char *query_cache_env = getenv("KOLIBRI_KNOWLEDGE_QUERY_CACHE");
+    if (query_cache_env && *query_cache_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(query_cache_env, KOLIBRI_MAX_QUERY_CACHE, &parsed) == 0) {
+            kolibri_query_cache_capacity = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_QUERY_CACHE value: %s\n", query_cache_env);
+        }
+    }
+
+    const char *compress_min_env = getenv("KOLIBRI_KNOWLEDGE_COMPRESS_MIN");
+    if (compress_min_env && *compress_min_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(compress_min_env, KOLIBRI_MAX_COMPRESS_MIN, &parsed) == 0) {
+            kolibri_compress_min = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_COMPRESS_MIN value: %s\n", compress_min_env);
+        }
+    }
+
+    const char *event_loop_env = getenv("KOLIBRI_KNOWLEDGE_EVENT_LOOP");
+    if (event_loop_env && *event_loop_env) {
+        kolibri_event_loop_mode = strcmp(event_loop_env, "0") != 0;
+    }
+
+    const char *stemming_env = getenv("KOLIBRI_KNOWLEDGE_STEMMING");
+    if (stemming_env && *stemming_env) {
+        kolibri_knowledge_stemming = strcmp(stemming_env, "0") != 0;
+    }
+
+    const char *quantize_env = getenv("KOLIBRI_KNOWLEDGE_QUANTIZE");
+    if (quantize_env && *quantize_env) {
+        kolibri_knowledge_quantize = strcmp(quantize_env, "0") != 0;
+    }
+
+    const char *shard_env = getenv("KOLIBRI_KNOWLEDGE_SHARD");
+    if (shard_env && *shard_env && parse_shard_option(shard_env, &kolibri_shard_index, &kolibri_shard_count) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SHARD value: %s\n", shard_env);
+    }
+
+    const char *shard_peers_env = getenv("KOLIBRI_KNOWLEDGE_SHARDS");
+    if (shard_peers_env && *shard_peers_env) {
+        strncpy(kolibri_shard_peers_config, shard_peers_env, sizeof(kolibri_shard_peers_config) - 1U);
+        kolibri_shard_peers_config[sizeof(kolibri_shard_peers_config) - 1U] = '\0';
+    }
+
+    const char *shard_timeout_env = getenv("KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS");
+    if (shard_timeout_env && *shard_timeout_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(shard_timeout_env, KOLIBRI_MAX_SHARD_TIMEOUT_MS, &parsed) == 0 && parsed > 0U) {
+            kolibri_shard_timeout_ms = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS value: %s\n",
+                    shard_timeout_env);
+        }
+    }
+
+    const char *durability_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_DURABILITY");
+    if (durability_env && *durability_env && parse_durability_option(durability_env, &kolibri_genome_ack_on_enqueue) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_DURABILITY value: %s\n", durability_env);
+    }
+
+    const char *sync_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_SYNC");
+    if (sync_env && *sync_env && parse_sync_option(sync_env, &kolibri_genome_sync_mode) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_SYNC value: %s\n", sync_env);
+    }
+
+    const char *segment_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_BLOCKS");
+    if (segment_env && *segment_env) {
+        size_t parsed = 0U;
+        if (parse_size_option(segment_env, KOLIBRI_MAX_SEGMENT_BLOCKS, &parsed) == 0) {
+            kolibri_genome_segment_blocks = parsed;
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_BLOCKS value: %s\n",
+                    segment_env);
+        }
+    }
 }
 
 static int apply_cli_arguments(int argc, char **argv) {
@@ -463,14 +1201,156 @@ static int apply_cli_arguments(int argc, char **argv) {
                 return -1;
             }
             i += 1;
+        } else if (strcmp(arg, "--workers") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --workers requires a value\n");
+                return -1;
+            }
+            size_t parsed_workers = 0U;
+            if (parse_size_option(argv[i + 1], KOLIBRI_MAX_WORKERS, &parsed_workers) != 0) {
+                fprintf(stderr,
+                        "[kolibri-knowledge] invalid worker count: %s (0..%u)\n",
+                        argv[i + 1],
+                        KOLIBRI_MAX_WORKERS);
+                return -1;
+            }
+            kolibri_worker_count = parsed_workers;
+            i += 1;
+        } else if (strcmp(arg, "--query-cache") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --query-cache requires a value\n");
+                return -1;
+            }
+            size_t parsed = 0U;
+            if (parse_size_option(argv[i + 1], KOLIBRI_MAX_QUERY_CACHE, &parsed) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid query cache size: %s\n", argv[i + 1]);
+                return -1;
+            }
+            kolibri_query_cache_capacity = parsed;
+            i += 1;
+        } else if (strcmp(arg, "--compress-min") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --compress-min requires a value\n");
+                return -1;
+            }
+            size_t parsed = 0U;
+            if (parse_size_option(argv[i + 1], KOLIBRI_MAX_COMPRESS_MIN, &parsed) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid compression threshold: %s\n", argv[i + 1]);
+                return -1;
+            }
+            kolibri_compress_min = parsed;
+            i += 1;
+        } else if (strcmp(arg, "--event-loop") == 0) {
+            kolibri_event_loop_mode = 1;
+        } else if (strcmp(arg, "--stemming") == 0) {
+            kolibri_knowledge_stemming = 1;
+        } else if (strcmp(arg, "--quantize") == 0) {
+            kolibri_knowledge_quantize = 1;
+        } else if (strcmp(arg, "--shard") == 0) {
+            if (i + 1 >= argc || parse_shard_option(argv[i + 1], &kolibri_shard_index, &kolibri_shard_count) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] --shard requires INDEX/COUNT\n");
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--shards") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --shards requires a host:port list\n");
+                return -1;
+            }
+            strncpy(kolibri_shard_peers_config, argv[i + 1], sizeof(kolibri_shard_peers_config) - 1U);
+            kolibri_shard_peers_config[sizeof(kolibri_shard_peers_config) - 1U] = '\0';
+            i += 1;
+        } else if (strcmp(arg, "--shard-timeout-ms") == 0) {
+            size_t parsed = 0U;
+            if (i + 1 >= argc || parse_size_option(argv[i + 1], KOLIBRI_MAX_SHARD_TIMEOUT_MS, &parsed) != 0 ||
+                parsed == 0U) {
+                fprintf(stderr, "[kolibri-knowledge] --shard-timeout-ms requires 1..%u\n", KOLIBRI_MAX_SHARD_TIMEOUT_MS);
+                return -1;
+            }
+            kolibri_shard_timeout_ms = parsed;
+            i += 1;
+        } else if (strcmp(arg, "--genome-durability") == 0) {
+            if (i + 1 >= argc || parse_durability_option(argv[i + 1], &kolibri_genome_ack_on_enqueue) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-durability requires flush or enqueue\n");
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--genome-sync") == 0) {
+            if (i + 1 >= argc || parse_sync_option(argv[i + 1], &kolibri_genome_sync_mode) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-sync requires flush, fdatasync or fsync\n");
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--genome-segment-blocks") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-segment-blocks requires a value\n");
+                return -1;
+            }
+            size_t parsed = 0U;
+            if (parse_size_option(argv[i + 1], KOLIBRI_MAX_SEGMENT_BLOCKS, &parsed) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid genome segment size: %s\n", argv[i + 1]);
+                return -1;
+            }
+            kolibri_genome_segment_blocks = parsed;
+            i += 1;
+        } else if (strcmp(arg, "--keepalive-timeout") == 0 || strcmp(arg, "--keepalive-max") == 0) {
+            int is_timeout = strcmp(arg, "--keepalive-timeout") == 0;
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] %s requires a value\n", arg);
+                return -1;
+            }
+            size_t parsed = 0U;
+            size_t max_value = is_timeout ? KOLIBRI_MAX_KEEPALIVE_TIMEOUT : KOLIBRI_MAX_KEEPALIVE_REQUESTS;
+            if (parse_size_option(argv[i + 1], max_value, &parsed) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid %s value: %s\n", arg, argv[i + 1]);
+                return -1;
+            }
+            if (is_timeout) {
+                kolibri_keepalive_timeout = parsed;
+            } else {
+                kolibri_keepalive_max = parsed;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--sndbuf") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --sndbuf requires a value\n");
+                return -1;
+            }
+            size_t parsed = 0U;
+            if (parse_size_option(argv[i + 1], KOLIBRI_MAX_SNDBUF, &parsed) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid --sndbuf value: %s\n", argv[i + 1]);
+                return -1;
+            }
+            kolibri_client_sndbuf = parsed;
+            i += 1;
         } else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
             fprintf(stdout,
                     "Usage: %s [--port PORT] [--bind ADDRESS] [--knowledge-dir PATH]\n"
                     "             [--index-json DIR] [--index-cache DIR] [--admin-token TOKEN]\n"
+                    "             [--workers N] [--event-loop] [--keepalive-timeout SEC] [--keepalive-max N]\n"
+                    "             [--query-cache ENTRIES] [--compress-min BYTES] [--genome-durability flush|enqueue]\n"
+                    "             [--genome-sync flush|fdatasync|fsync] [--genome-segment-blocks N]\n"
+                    "             [--stemming] [--quantize] [--shard INDEX/COUNT] [--shards HOST:PORT,...]\n"
+                    "             [--shard-timeout-ms MS] [--sndbuf BYTES]\n"
                     "       Environment overrides: KOLIBRI_KNOWLEDGE_PORT, KOLIBRI_KNOWLEDGE_BIND,"
                     " KOLIBRI_KNOWLEDGE_DIRS (colon-separated),\n"
                     "         KOLIBRI_KNOWLEDGE_INDEX_JSON, KOLIBRI_KNOWLEDGE_INDEX_CACHE,"
-                    " KOLIBRI_KNOWLEDGE_ADMIN_TOKEN\n",
+                    " KOLIBRI_KNOWLEDGE_ADMIN_TOKEN,\n"
+                    "         KOLIBRI_KNOWLEDGE_WORKERS (0 handles clients on the accept thread),\n"
+                    "         KOLIBRI_KNOWLEDGE_EVENT_LOOP (1 multiplexes clients with epoll/kqueue),\n"
+                    "         KOLIBRI_KNOWLEDGE_KEEPALIVE_TIMEOUT (0 disables keep-alive), KOLIBRI_KNOWLEDGE_KEEPALIVE_MAX,\n"
+                    "         KOLIBRI_KNOWLEDGE_SNDBUF (client socket send buffer, 0 leaves it to the kernel),\n"
+                    "         KOLIBRI_KNOWLEDGE_QUERY_CACHE (0 disables the search cache),\n"
+                    "         KOLIBRI_KNOWLEDGE_COMPRESS_MIN (smallest body sent gzip/deflate, 0 disables compression),\n"
+                    "         KOLIBRI_KNOWLEDGE_GENOME_DURABILITY (flush waits for the genome write, enqueue does not),\n"
+                    "         KOLIBRI_KNOWLEDGE_GENOME_SYNC (how each genome batch is made durable),\n"
+                    "         KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_BLOCKS (0 keeps a single genome file),\n"
+                    "         KOLIBRI_KNOWLEDGE_STEMMING (1 strips Russian/English word endings),\n"
+                    "         KOLIBRI_KNOWLEDGE_QUANTIZE (1 scores 8-bit postings, rescoring the best exactly),\n"
+                    "         KOLIBRI_KNOWLEDGE_SHARD (INDEX/COUNT: index only that partition of the document ids),\n"
+                    "         KOLIBRI_KNOWLEDGE_SHARDS (peers searches fan out to, not with\n"
+                    "         the event loop), KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS,\n"
+                    "         KOLIBRI_TRACE (Chrome trace JSON written there at shutdown)\n",
                     argv[0]);
             return 1;
         } else {
@@ -494,21 +1374,82 @@ static int ensure_default_directories(void) {
     return 0;
 }
 
-static int load_index_from_cache(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
-        return EINVAL;
+static void serving_index_set_source(KolibriServingIndex *serving, const char *source) {
+    strncpy(serving->source, source, sizeof(serving->source) - 1U);
+    serving->source[sizeof(serving->source) - 1U] = '\0';
+}
+
+static unsigned long long knowledge_sources_fingerprint(void) {
+    unsigned long long fingerprint = 0ULL;
+    if (kolibri_knowledge_directory_count == 0U ||
+        kolibri_knowledge_index_fingerprint((const char *const *)kolibri_knowledge_directories,
+                                            kolibri_knowledge_directory_count,
+                                            &fingerprint) != 0) {
+        return 0ULL;
+    }
+    /* A cache in an older layout or built with the other tokenizer or
+     * posting setting must not be reused. */
+    fingerprint ^= KOLIBRI_INDEX_CACHE_FORMAT * 0xC2B2AE3D27D4EB4FULL;
+    if (kolibri_knowledge_quantize) {
+        fingerprint ^= 0xD6E8FEB86659FD93ULL;
+    }
+    if (kolibri_shard_count > 1U) {
+        fingerprint ^= ((unsigned long long)kolibri_shard_count * 0x100000001B3ULL + kolibri_shard_index + 1U) *
+                       0xFF51AFD7ED558CCDULL;
+    }
+    return kolibri_knowledge_stemming ? fingerprint ^ 0x9E3779B97F4A7C15ULL : fingerprint;
+}
+
+/* The cache remembers which sources it was built from, so stale JSON is not served. */
+static int read_cache_fingerprint(unsigned long long *out) {
+    char path[512];
+    compose_cache_path(path, sizeof(path), kolibri_index_cache_dir, "/sources.fingerprint");
+    FILE *file = path[0] != '\0' ? fopen(path, "r") : NULL;
+    if (!file) {
+        return -1;
     }
-    *out_index = NULL;
-    if (kolibri_index_json_path[0] != '\0') {
-        int err = kolibri_knowledge_index_load_json(kolibri_index_json_path, out_index);
+    int ok = fscanf(file, "%llx", out) == 1;
+    fclose(file);
+    return ok ? 0 : -1;
+}
+
+static void write_cache_fingerprint(unsigned long long fingerprint) {
+    char path[512];
+    compose_cache_path(path, sizeof(path), kolibri_index_cache_dir, "/sources.fingerprint");
+    FILE *file = path[0] != '\0' ? fopen(path, "w") : NULL;
+    if (!file) {
+        return;
+    }
+    fprintf(file, "%016llx\n", fingerprint);
+    fclose(file);
+}
+
+/* Prefers the mapped binary snapshot unless it predates the JSON manifest. */
+static int load_index_snapshot(const char *dir, KolibriKnowledgeIndex **out_index) {
+    char binary_path[512];
+    compose_cache_path(binary_path, sizeof(binary_path), dir, "/index.kbin");
+    time_t binary_mtime = path_mtime(binary_path);
+    if (binary_mtime != 0 && binary_mtime >= manifest_mtime(dir)) {
+        int err = kolibri_knowledge_index_load_binary(dir, out_index);
         if (err == 0 && *out_index) {
-            strncpy(kolibri_index_source, "prebuilt", sizeof(kolibri_index_source) - 1U);
-            kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-            char manifest_path[512];
-            compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_json_path);
-            if (manifest_path[0] != '\0') {
-                set_index_timestamp_from_path(manifest_path);
-            }
+            return 0;
+        }
+        fprintf(stderr, "[kolibri-knowledge] ignoring binary index in %s (err=%d)\n", dir, err);
+    }
+    return kolibri_knowledge_index_load_json(dir, out_index);
+}
+
+static int load_index_from_cache(KolibriServingIndex *out, unsigned long long fingerprint) {
+    if (!out) {
+        return EINVAL;
+    }
+    out->index = NULL;
+    if (kolibri_index_json_path[0] != '\0') {
+        int err = load_index_snapshot(kolibri_index_json_path, &out->index);
+        if (err == 0 && out->index) {
+            serving_index_set_source(out, "prebuilt");
+            out->manifest_mtime = manifest_mtime(kolibri_index_json_path);
+            out->timestamp = out->manifest_mtime != 0 ? out->manifest_mtime : time(NULL);
             return 0;
         }
         fprintf(stderr,
@@ -517,15 +1458,20 @@ static int load_index_from_cache(KolibriKnowledgeIndex **out_index) {
                 err);
     }
     if (kolibri_index_cache_dir[0] != '\0') {
-        char manifest_path[512];
-        compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
-        struct stat st;
-        if (manifest_path[0] != '\0' && stat(manifest_path, &st) == 0) {
-            int err = kolibri_knowledge_index_load_json(kolibri_index_cache_dir, out_index);
-            if (err == 0 && *out_index) {
-                strncpy(kolibri_index_source, "cache", sizeof(kolibri_index_source) - 1U);
-                kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-                kolibri_index_timestamp = st.st_mtime;
+        time_t mtime = manifest_mtime(kolibri_index_cache_dir);
+        unsigned long long cached_fingerprint = 0ULL;
+        if (mtime != 0 && fingerprint != 0ULL && read_cache_fingerprint(&cached_fingerprint) == 0 &&
+            cached_fingerprint != fingerprint) {
+            fprintf(stdout, "[kolibri-knowledge] index cache is stale, rebuilding\n");
+            return ENOENT;
+        }
+        if (mtime != 0) {
+            int err = load_index_snapshot(kolibri_index_cache_dir, &out->index);
+            if (err == 0 && out->index) {
+                serving_index_set_source(out, "cache");
+                out->timestamp = mtime;
+                out->manifest_mtime = mtime;
+                out->fingerprint = fingerprint;
                 return 0;
             }
             fprintf(stderr,
@@ -537,38 +1483,48 @@ static int load_index_from_cache(KolibriKnowledgeIndex **out_index) {
     return ENOENT;
 }
 
-static int build_index_from_directories(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
+static int build_index_from_directories(KolibriServingIndex *out, unsigned long long fingerprint) {
+    if (!out) {
         return EINVAL;
     }
-    *out_index = NULL;
+    out->index = NULL;
     if (kolibri_knowledge_directory_count == 0U) {
         return ENOENT;
     }
-    int err = kolibri_knowledge_index_create((const char *const *)kolibri_knowledge_directories,
-                                             kolibri_knowledge_directory_count,
-                                             1024U,
-                                             out_index);
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.stemming = kolibri_knowledge_stemming;
+    options.keep_positions = 1;
+    options.quantize = kolibri_knowledge_quantize;
+    options.shard_count = kolibri_shard_count;
+    options.shard_index = kolibri_shard_index;
+    int err = kolibri_knowledge_index_create_ex((const char *const *)kolibri_knowledge_directories,
+                                                kolibri_knowledge_directory_count,
+                                                &options,
+                                                &out->index);
     if (err != 0) {
         return err;
     }
-    if (*out_index) {
-        strncpy(kolibri_index_source, "directories", sizeof(kolibri_index_source) - 1U);
-        kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-        kolibri_index_timestamp = time(NULL);
+    if (out->index) {
+        serving_index_set_source(out, "directories");
+        out->timestamp = time(NULL);
+        out->fingerprint = fingerprint;
         if (kolibri_index_cache_dir[0] != '\0') {
             ensure_dir_exists(kolibri_index_cache_dir);
-            int write_err = kolibri_knowledge_index_write_json(*out_index, kolibri_index_cache_dir);
+            int write_err = kolibri_knowledge_index_write_json(out->index, kolibri_index_cache_dir);
+            if (write_err == 0) {
+                write_err = kolibri_knowledge_index_write_binary(out->index, kolibri_index_cache_dir);
+            }
             if (write_err != 0) {
                 fprintf(stderr,
                         "[kolibri-knowledge] failed to write index cache to %s (err=%d)\n",
                         kolibri_index_cache_dir,
                         write_err);
             } else {
-                char manifest_path[512];
-                compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
-                if (manifest_path[0] != '\0') {
-                    set_index_timestamp_from_path(manifest_path);
+                write_cache_fingerprint(fingerprint);
+                out->manifest_mtime = manifest_mtime(kolibri_index_cache_dir);
+                if (out->manifest_mtime != 0) {
+                    out->timestamp = out->manifest_mtime;
                 }
             }
         }
@@ -576,17 +1532,45 @@ static int build_index_from_directories(KolibriKnowledgeIndex **out_index) {
     return 0;
 }
 
-static int load_or_build_index(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
+static int load_or_build_index(KolibriServingIndex *out, unsigned long long fingerprint) {
+    if (!out) {
         return EINVAL;
     }
-    *out_index = NULL;
-    int err = load_index_from_cache(out_index);
-    if (err == 0 && *out_index) {
+    int err = load_index_from_cache(out, fingerprint);
+    if (err == 0 && out->index) {
         return 0;
     }
-    err = build_index_from_directories(out_index);
-    return err;
+    return build_index_from_directories(out, fingerprint);
+}
+
+static KolibriServingIndex *serving_index_acquire(void) {
+    pthread_mutex_lock(&kolibri_serving_lock);
+    KolibriServingIndex *serving = kolibri_serving_index;
+    if (serving) {
+        atomic_fetch_add(&serving->refs, 1U);
+    }
+    pthread_mutex_unlock(&kolibri_serving_lock);
+    return serving;
+}
+
+static void serving_index_release(KolibriServingIndex *serving) {
+    if (serving && atomic_fetch_sub(&serving->refs, 1U) == 1U) {
+        kolibri_knowledge_index_destroy(serving->index);
+        free(serving);
+    }
+}
+
+/* Publishes next (or nothing) and drops the server's reference to the old snapshot. */
+static void serving_index_install(KolibriServingIndex *next) {
+    if (next) {
+        next->generation = atomic_fetch_add(&kolibri_index_generation, 1UL) + 1UL;
+        atomic_init(&next->refs, 1U);
+    }
+    pthread_mutex_lock(&kolibri_serving_lock);
+    KolibriServingIndex *previous = kolibri_serving_index;
+    kolibri_serving_index = next;
+    pthread_mutex_unlock(&kolibri_serving_lock);
+    serving_index_release(previous);
 }
 
 static int load_hmac_key_from_file(const char *path, unsigned char *out, size_t *out_len) {
@@ -660,6 +1644,89 @@ static int load_hmac_key_from_environment(void) {
     return -1;
 }
 
+static void *genome_writer_main(void *arg) {
+    KolibriGenomeWriter *writer = (KolibriGenomeWriter *)arg;
+    KolibriGenomeEvent batch[KOLIBRI_GENOME_BATCH];
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->count == 0U && !writer->stopping) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->count == 0U) {
+            break;
+        }
+        size_t taken = 0U;
+        while (taken < KOLIBRI_GENOME_BATCH && writer->count > 0U) {
+            batch[taken++] = writer->events[writer->head];
+            writer->head = (writer->head + 1U) % KOLIBRI_GENOME_QUEUE;
+            writer->count -= 1U;
+        }
+        pthread_cond_broadcast(&writer->not_full);
+        pthread_mutex_unlock(&writer->lock);
+
+        uint64_t started = monotonic_ns();
+        KolibriGenomeEntry entries[KOLIBRI_GENOME_BATCH];
+        for (size_t i = 0; i < taken; ++i) {
+            entries[i].event_type = batch[i].event;
+            entries[i].payload = batch[i].payload;
+        }
+        uint64_t next_index = kolibri_genome.next_index;
+        int rc = kg_append_batch(&kolibri_genome, entries, taken, NULL);
+        if (rc == 0 || kolibri_genome.next_index != next_index) {
+            /* A failed sync leaves the blocks appended; count it once. */
+            atomic_fetch_add(&kolibri_genome_events_written, taken);
+            if (rc != 0) {
+                atomic_fetch_add(&kolibri_genome_append_errors, 1U);
+            }
+        } else {
+            /* Nothing was written: retry one by one so a single bad event
+             * does not drop the whole batch. */
+            for (size_t i = 0; i < taken; ++i) {
+                if (kg_append(&kolibri_genome, batch[i].event, batch[i].payload, NULL) == 0) {
+                    atomic_fetch_add(&kolibri_genome_events_written, 1U);
+                } else {
+                    atomic_fetch_add(&kolibri_genome_append_errors, 1U);
+                }
+            }
+        }
+        latency_record(&kolibri_genome_flush_latency, monotonic_ns() - started);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->written += taken;
+        pthread_cond_broadcast(&writer->flushed);
+    }
+    writer->running = 0;
+    pthread_cond_broadcast(&writer->flushed);
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+static int genome_writer_start(KolibriGenomeWriter *writer) {
+    sigset_t previous;
+    block_server_signals(&previous);
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = 0;
+    writer->running = pthread_create(&writer->thread, NULL, genome_writer_main, writer) == 0;
+    int running = writer->running;
+    pthread_mutex_unlock(&writer->lock);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return running ? 0 : -1;
+}
+
+/* Writes out everything already queued, then joins the writer thread. */
+static void genome_writer_stop(KolibriGenomeWriter *writer) {
+    pthread_mutex_lock(&writer->lock);
+    if (!writer->running) {
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    writer->stopping = 1;
+    pthread_cond_broadcast(&writer->not_empty);
+    pthread_cond_broadcast(&writer->not_full);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+}
+
 static int kolibri_genome_init_or_open(void) {
     if (load_hmac_key_from_environment() != 0) {
         fprintf(stderr,
@@ -668,14 +1735,29 @@ static int kolibri_genome_init_or_open(void) {
     }
 
     ensure_dir_exists(".kolibri");
-    if (kg_open(&kolibri_genome, KOLIBRI_KNOWLEDGE_GENOME, kolibri_hmac_key, kolibri_hmac_key_len) == 0) {
+    int opened = kolibri_genome_segment_blocks > 0U
+                     ? kg_open_segmented(&kolibri_genome, KOLIBRI_KNOWLEDGE_GENOME_DIR, kolibri_hmac_key,
+                                         kolibri_hmac_key_len, kolibri_genome_segment_blocks)
+                     : kg_open(&kolibri_genome, KOLIBRI_KNOWLEDGE_GENOME, kolibri_hmac_key, kolibri_hmac_key_len);
+    if (opened == 0) {
         kolibri_genome_ready = 1;
+        /* New genomes use the packed v2 records; existing files keep theirs. */
+        (void)kg_set_format(&kolibri_genome, KOLIBRI_GENOME_FORMAT_V2);
+        /* The writer appends whole batches, so one sync per kg_append_batch. */
+        KolibriGenomeSyncPolicy policy = {kolibri_genome_sync_mode, 1U, 0U};
+        kg_set_sync_policy(&kolibri_genome, &policy);
         char payload[KOLIBRI_PAYLOAD_SIZE];
         snprintf(payload, sizeof(payload), "knowledge_server стартовал (ключ: %s)", kolibri_hmac_key_origin);
         char encoded[KOLIBRI_PAYLOAD_SIZE];
         if (kg_encode_payload(payload, encoded, sizeof(encoded)) == 0) {
             kg_append(&kolibri_genome, "BOOT", encoded, NULL);
         }
+        if (genome_writer_start(&kolibri_genome_writer) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] failed to start genome writer\n");
+            kg_close(&kolibri_genome);
+            kolibri_genome_ready = 0;
+            return -1;
+        }
         return 0;
     }
 
@@ -686,20 +1768,62 @@ static int kolibri_genome_init_or_open(void) {
 
 static void kolibri_genome_close(void) {
     if (kolibri_genome_ready) {
+        genome_writer_stop(&kolibri_genome_writer);
         kg_close(&kolibri_genome);
         kolibri_genome_ready = 0;
     }
 }
 
-static void knowledge_record_event(const char *event, const char *payload) {
+/*
+ * Queues the event for the writer thread; returns its sequence number, 0 when
+ * nothing was queued. With `wait` unset a full queue drops the event instead
+ * of blocking, so only callers that go on to knowledge_wait_durable wait.
+ */
+static uint64_t knowledge_record_event(const char *event, const char *payload, int wait) {
     if (!kolibri_genome_ready || !event || !payload) {
-        return;
+        return 0U;
     }
     char encoded[KOLIBRI_PAYLOAD_SIZE];
     if (kg_encode_payload(payload, encoded, sizeof(encoded)) != 0) {
+        return 0U;
+    }
+    KolibriGenomeWriter *writer = &kolibri_genome_writer;
+    pthread_mutex_lock(&writer->lock);
+    if (!wait && writer->count == KOLIBRI_GENOME_QUEUE && writer->running && !writer->stopping) {
+        pthread_mutex_unlock(&writer->lock);
+        atomic_fetch_add(&kolibri_genome_events_dropped, 1U);
+        return 0U;
+    }
+    while (writer->count == KOLIBRI_GENOME_QUEUE && writer->running && !writer->stopping) {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    if (!writer->running || writer->stopping) {
+        pthread_mutex_unlock(&writer->lock);
+        return 0U;
+    }
+    KolibriGenomeEvent *slot = &writer->events[(writer->head + writer->count) % KOLIBRI_GENOME_QUEUE];
+    strncpy(slot->event, event, sizeof(slot->event) - 1U);
+    slot->event[sizeof(slot->event) - 1U] = '\0';
+    memcpy(slot->payload, encoded, sizeof(slot->payload));
+    writer->count += 1U;
+    uint64_t sequence = ++writer->enqueued;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    return sequence;
+}
+
+/* In flush durability, blocks until the writer has appended event `sequence`. */
+static void knowledge_wait_durable(uint64_t sequence) {
+    if (kolibri_genome_ack_on_enqueue || sequence == 0U) {
         return;
     }
-    kg_append(&kolibri_genome, event, encoded, NULL);
+    KOLIBRI_TRACE_SCOPE("genome.wait_durable");
+    KolibriGenomeWriter *writer = &kolibri_genome_writer;
+    pthread_mutex_lock(&writer->lock);
+    while (writer->written < sequence && writer->running) {
+        pthread_cond_wait(&writer->flushed, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
 }
 
 static void write_bootstrap_script(const KolibriKnowledgeIndex *index, const char *path) {
@@ -741,7 +1865,7 @@ static void write_bootstrap_script(const KolibriKnowledgeIndex *index, const cha
     fprintf(file, "конец.\n");
     fclose(file);
     fprintf(stdout, "[kolibri-knowledge] bootstrap script written to %s\n", path);
-    kolibri_bootstrap_timestamp = time(NULL);
+    atomic_store(&kolibri_bootstrap_timestamp, (long long)time(NULL));
 }
 
 static int starts_with(const char *text, const char *prefix) {
@@ -913,65 +2037,64 @@ static int require_admin_token(const char *headers, size_t header_len) {
     return 0;
 }
 
-static ssize_t receive_http_request(int fd,
-                                    char *buffer,
-                                    size_t buffer_size,
-                                    size_t *header_len_out,
-                                    size_t *content_len_out) {
-    if (!buffer || buffer_size == 0U) {
-        return -1;
+/*
+ * Checks whether conn->in holds a complete request. Returns 0 when the
+ * request is framed, 1 when more bytes are needed and a negative status
+ * (see respond_receive_error) when the request can never be satisfied.
+ */
+static int frame_http_request(const KolibriConnection *conn, size_t *header_len_out, size_t *content_len_out) {
+    const char *marker = strstr(conn->in, "\r\n\r\n");
+    if (!marker) {
+        return conn->in_len >= sizeof(conn->in) - 1U ? -5 : 1;
+    }
+    size_t header_len = (size_t)(marker - conn->in) + 4U;
+    size_t content_length = parse_content_length_header(conn->in, header_len, NULL);
+    if (content_length > KOLIBRI_MAX_CONTENT_LENGTH) {
+        return -3;
+    }
+    if (header_len + content_length > sizeof(conn->in) - 1U) {
+        return -5;
     }
-    size_t total = 0U;
-    size_t header_len = 0U;
-    size_t content_length = 0U;
-    int content_length_present = 0;
-    while (total < buffer_size - 1U) {
-        ssize_t received = recv(fd, buffer + total, buffer_size - 1U - total, 0);
+    if (conn->in_len < header_len + content_length) {
+        return 1;
+    }
+    if (header_len_out) {
+        *header_len_out = header_len;
+    }
+    if (content_len_out) {
+        *content_len_out = content_length;
+    }
+    return 0;
+}
+
+static ssize_t receive_http_request(KolibriConnection *conn, size_t *header_len_out, size_t *content_len_out) {
+    for (;;) {
+        int framed = frame_http_request(conn, header_len_out, content_len_out);
+        if (framed == 0) {
+            return (ssize_t)conn->in_len;
+        }
+        if (framed < 0) {
+            return framed;
+        }
+        ssize_t received = recv(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - 1U - conn->in_len, 0);
         if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
             if (errno == EWOULDBLOCK || errno == EAGAIN) {
                 return -2;
             }
             return -1;
         }
         if (received == 0) {
-            break;
+            return -4;
         }
-        total += (size_t)received;
-        buffer[total] = '\0';
-        if (header_len == 0U) {
-            char *marker = strstr(buffer, "\r\n\r\n");
-            if (marker) {
-                header_len = (size_t)(marker - buffer) + 4U;
-                content_length = parse_content_length_header(buffer, header_len, &content_length_present);
-                if (content_length > KOLIBRI_MAX_CONTENT_LENGTH) {
-                    return -3;
-                }
-                if (total >= header_len + content_length) {
-                    break;
-                }
-            }
-        } else if (total >= header_len + content_length) {
-            break;
+        if (conn->in_len == 0U) {
+            conn->receive_started = monotonic_ns();
         }
+        conn->in_len += (size_t)received;
+        conn->in[conn->in_len] = '\0';
     }
-    if (header_len == 0U) {
-        return -4;
-    }
-    if (total >= buffer_size - 1U) {
-        return -5;
-    }
-    if (total < header_len + content_length) {
-        return -6;
-    }
-    (void)content_length_present;
-    buffer[total] = '\0';
-    if (header_len_out) {
-        *header_len_out = header_len;
-    }
-    if (content_len_out) {
-        *content_len_out = content_length;
-    }
-    return (ssize_t)total;
 }
 
 static int format_iso8601_utc(time_t value, char *output, size_t out_size) {
@@ -994,19 +2117,207 @@ static int format_iso8601_utc(time_t value, char *output, size_t out_size) {
     return 0;
 }
 
-static void send_response(int client_fd, int status_code, const char *content_type, const char *body) {
-    char header[256];
-    int header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+static void connection_init(KolibriConnection *conn, int fd, uint32_t peer_addr) {
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = fd;
+    conn->peer_addr = peer_addr;
+    conn->last_active = time(NULL);
+}
+
+static void connection_release(KolibriConnection *conn) {
+    free(conn->out);
+    conn->out = NULL;
+    conn->out_len = 0U;
+    conn->out_cap = 0U;
+    conn->out_sent = 0U;
+    free(conn->body);
+    conn->body = NULL;
+    conn->body_len = 0U;
+    conn->body_cap = 0U;
+    free(conn->packed);
+    conn->packed = NULL;
+    conn->packed_len = 0U;
+    conn->packed_cap = 0U;
+}
+
+static int connection_append(KolibriConnection *conn, const char *data, size_t length) {
+    if (conn->out_len + length > conn->out_cap) {
+        size_t capacity = conn->out_cap ? conn->out_cap : 1024U;
+        while (capacity < conn->out_len + length) {
+            capacity *= 2U;
+        }
+        char *next = realloc(conn->out, capacity);
+        if (!next) {
+            return -1;
+        }
+        conn->out = next;
+        conn->out_cap = capacity;
+    }
+    memcpy(conn->out + conn->out_len, data, length);
+    conn->out_len += length;
+    return 0;
+}
+
+/* Sends what is pending without blocking; returns 1 when drained, 0 on EAGAIN. */
+static int connection_flush(KolibriConnection *conn) {
+    if (conn->failed) {
+        return -1;
+    }
+    while (conn->out_sent < conn->out_len) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_sent, conn->out_len - conn->out_sent, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                return 0;
+            }
+            conn->failed = 1;
+            return -1;
+        }
+        conn->out_sent += (size_t)sent;
+    }
+    conn->out_len = 0U;
+    conn->out_sent = 0U;
+    return 1;
+}
+
+/*
+ * Writes header and body with one writev() when nothing is queued ahead of
+ * them; only the part the socket does not take is copied into conn->out.
+ */
+static void connection_transmit(KolibriConnection *conn,
+                                const char *header,
+                                size_t header_len,
+                                const char *body,
+                                size_t body_len) {
+    size_t written = 0U;
+    size_t total = header_len + body_len;
+    uint64_t started = monotonic_ns();
+    if (conn->out_len == 0U && !conn->failed) {
+        while (written < total) {
+            struct iovec iov[2];
+            int iov_count = 0;
+            if (written < header_len) {
+                iov[iov_count].iov_base = (void *)(header + written);
+                iov[iov_count].iov_len = header_len - written;
+                iov_count++;
+            }
+            size_t body_offset = written > header_len ? written - header_len : 0U;
+            if (body_len > body_offset) {
+                iov[iov_count].iov_base = (void *)(body + body_offset);
+                iov[iov_count].iov_len = body_len - body_offset;
+                iov_count++;
+            }
+            ssize_t sent = writev(conn->fd, iov, iov_count);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                    conn->failed = 1;
+                    return;
+                }
+                break;
+            }
+            written += (size_t)sent;
+        }
+    }
+    /* A tail that cannot be queued would leave a cut-off response behind. */
+    if (written < header_len) {
+        if (connection_append(conn, header + written, header_len - written) != 0) {
+            conn->failed = 1;
+        }
+        written = header_len;
+    }
+    if (written < total && !conn->failed &&
+        connection_append(conn, body + (written - header_len), total - written) != 0) {
+        conn->failed = 1;
+    }
+    uint64_t finished = monotonic_ns();
+    conn->send_ns += finished - started;
+    KOLIBRI_TRACE_COMPLETE(kolibri_phase_spans[KOLIBRI_PHASE_SEND], started, finished);
+}
+
+static const char *http_reason(int status_code) {
+    switch (status_code) {
+    case 200:
+        return "OK";
+    case 304:
+        return "Not Modified";
+    default:
+        return "Error";
+    }
+}
+
+/*
+ * Formats the status line and headers; framing is a Content-Length or a
+ * Transfer-Encoding line, optionally followed by more header lines. A NULL
+ * content_type leaves Content-Type out (304 answers).
+ */
+static int format_response_header(const KolibriConnection *conn,
+                                  int status_code,
+                                  const char *content_type,
+                                  const char *framing,
+                                  char *header,
+                                  size_t header_size) {
+    char connection_field[96];
+    if (conn->keep_alive) {
+        snprintf(connection_field,
+                 sizeof(connection_field),
+                 "keep-alive\r\nKeep-Alive: timeout=%zu, max=%zu",
+                 kolibri_keepalive_timeout,
+                 kolibri_keepalive_max - conn->served - 1U);
+    } else {
+        strcpy(connection_field, "close");
+    }
+    int header_len = snprintf(header, header_size,
+                              "HTTP/1.1 %d %s\r\n%s%s%s%s\r\nConnection: %s\r\n\r\n",
                               status_code,
-                              status_code == 200 ? "OK" : "Error",
-                              content_type,
-                              body ? strlen(body) : 0U);
-    if (header_len > 0) {
-        send(client_fd, header, (size_t)header_len, 0);
+                              http_reason(status_code),
+                              content_type ? "Content-Type: " : "",
+                              content_type ? content_type : "",
+                              content_type ? "\r\n" : "",
+                              framing,
+                              connection_field);
+    if (header_len <= 0 || (size_t)header_len >= header_size) {
+        return -1;
+    }
+    return header_len;
+}
+
+/* fields: extra header lines after Content-Length, without the final CRLF; may be NULL. */
+static void send_response_bytes(KolibriConnection *conn,
+                                int status_code,
+                                const char *content_type,
+                                const char *body,
+                                size_t body_len,
+                                const char *fields) {
+    char framing[224];
+    snprintf(framing, sizeof(framing), "Content-Length: %zu%s%s", body_len, fields ? "\r\n" : "",
+             fields ? fields : "");
+    char header[512];
+    int header_len = format_response_header(conn, status_code, content_type, framing, header, sizeof(header));
+    if (header_len < 0) {
+        conn->failed = 1;
+        return;
     }
-    if (body && *body) {
-        send(client_fd, body, strlen(body), 0);
+    connection_transmit(conn, header, (size_t)header_len, body, body_len);
+}
+
+static void send_response(KolibriConnection *conn, int status_code, const char *content_type, const char *body) {
+    send_response_bytes(conn, status_code, content_type, body ? body : "", body ? strlen(body) : 0U, NULL);
+}
+
+static void respond_receive_error(KolibriConnection *conn, ssize_t status) {
+    /* The stream cannot be resynchronised after a framing error. */
+    conn->keep_alive = 0;
+    if (status == -2) {
+        send_response(conn, 408, "application/json", "{\"error\":\"timeout\"}");
+    } else if (status == -3 || status == -5) {
+        send_response(conn, 413, "application/json", "{\"error\":\"payload too large\"}");
+    } else {
+        send_response(conn, 400, "application/json", "{\"error\":\"bad request\"}");
     }
 }
 
@@ -1058,499 +2369,2765 @@ static size_t json_escape_char(char ch, char *output, size_t out_size) {
     }
 }
 
-static void json_escape(const char *input, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
-        return;
+/*
+ * Picks the coding for an Accept-Encoding value: the higher q of gzip and
+ * deflate ("*" stands in for an unlisted one), gzip on a tie; q=0 refuses.
+ */
+static KolibriEncoding negotiate_encoding(const char *value) {
+#if defined(KOLIBRI_HAVE_ZLIB)
+    if (kolibri_compress_min == 0U) {
+        return KOLIBRI_ENCODING_IDENTITY;
+    }
+    double gzip_q = -1.0;
+    double deflate_q = -1.0;
+    double star_q = -1.0;
+    const char *cursor = value;
+    while (*cursor) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == ',') {
+            cursor++;
+        }
+        const char *name = cursor;
+        while (*cursor && *cursor != ',' && *cursor != ';' && *cursor != ' ' && *cursor != '\t') {
+            cursor++;
+        }
+        size_t name_len = (size_t)(cursor - name);
+        double q = 1.0;
+        while (*cursor && *cursor != ',') {
+            if (*cursor == ';') {
+                const char *param = cursor + 1;
+                while (*param == ' ' || *param == '\t') {
+                    param++;
+                }
+                if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                    q = strtod(param + 2, NULL);
+                }
+            }
+            cursor++;
+        }
+        if ((name_len == 4U && strncasecmp(name, "gzip", 4U) == 0) ||
+            (name_len == 6U && strncasecmp(name, "x-gzip", 6U) == 0)) {
+            gzip_q = q;
+        } else if (name_len == 7U && strncasecmp(name, "deflate", 7U) == 0) {
+            deflate_q = q;
+        } else if (name_len == 1U && name[0] == '*') {
+            star_q = q;
+        }
     }
-    if (!input) {
-        output[0] = '\0';
-        return;
+    if (gzip_q < 0.0) {
+        gzip_q = star_q;
     }
-    size_t out_index = 0;
-    for (size_t i = 0; input[i] != '\0' && out_index + 1 < out_size; ++i) {
-        size_t written = json_escape_char(input[i], output + out_index, out_size - out_index - 1U);
-        if (written == 0) {
-            break;
-        }
-        out_index += written;
+    if (deflate_q < 0.0) {
+        deflate_q = star_q;
     }
-    output[out_index] = '\0';
+    if (gzip_q > 0.0 && gzip_q >= deflate_q) {
+        return KOLIBRI_ENCODING_GZIP;
+    }
+    if (deflate_q > 0.0) {
+        return KOLIBRI_ENCODING_DEFLATE;
+    }
+#else
+    (void)value;
+#endif
+    return KOLIBRI_ENCODING_IDENTITY;
 }
 
-static void build_directories_json(char *buffer, size_t buffer_size) {
-    if (!buffer || buffer_size == 0) {
-        return;
-    }
-    if (buffer_size < 3U) {
-        buffer[0] = '\0';
-        return;
+static uint64_t body_fingerprint(const char *data, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint64_t)(unsigned char)data[i];
+        hash *= 1099511628211ULL;
     }
-    size_t offset = 0U;
-    buffer[offset++] = '[';
-    for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
-        if (offset + 2U >= buffer_size) {
-            break;
+    return hash;
+}
+
+/* Strong tag of one coding of a body: the hash names the content, the suffix the coding. */
+static void etag_format(uint64_t etag, KolibriEncoding encoding, char *output, size_t out_size) {
+    snprintf(output, out_size, "\"%016llx%s%s\"", (unsigned long long)etag,
+             encoding != KOLIBRI_ENCODING_IDENTITY ? "-" : "",
+             encoding != KOLIBRI_ENCODING_IDENTITY ? kolibri_encoding_names[encoding] : "");
+}
+
+/*
+ * Whether an If-None-Match list names this content. A tag of any coding
+ * counts: they all carry the same body, so the client's copy is current.
+ */
+static int etag_listed(const char *list, uint64_t etag) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)etag);
+    const char *cursor = list;
+    while (*cursor) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == ',') {
+            cursor++;
         }
-        if (i > 0U) {
-            buffer[offset++] = ',';
-            if (offset >= buffer_size) {
-                break;
-            }
+        if (*cursor == '*') {
+            return 1;
         }
-        buffer[offset++] = '"';
-        if (offset >= buffer_size) {
-            break;
+        if (strncmp(cursor, "W/", 2U) == 0) {
+            cursor += 2;
         }
-        char escaped[256];
-        json_escape(kolibri_knowledge_directories[i], escaped, sizeof(escaped));
-        size_t len = strlen(escaped);
-        if (len > buffer_size - offset - 2U) {
-            len = buffer_size - offset - 2U;
+        if (*cursor == '"' && strncmp(cursor + 1, hex, 16U) == 0 && (cursor[17] == '"' || cursor[17] == '-')) {
+            return 1;
         }
-        memcpy(buffer + offset, escaped, len);
-        offset += len;
-        if (offset < buffer_size) {
-            buffer[offset++] = '"';
+        while (*cursor && *cursor != ',') {
+            cursor++;
         }
     }
-    if (offset >= buffer_size - 1U) {
-        buffer[buffer_size - 1U] = '\0';
-        return;
-    }
-    buffer[offset++] = ']';
-    if (offset < buffer_size) {
-        buffer[offset] = '\0';
-    } else {
-        buffer[buffer_size - 1U] = '\0';
-    }
+    return 0;
 }
 
-static void prometheus_escape_label(const char *input, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
-        return;
+/* Compresses data into conn->packed; -1 when zlib fails or saves nothing. */
+static int response_compress(KolibriConnection *conn, KolibriEncoding encoding, const char *data, size_t length) {
+#if defined(KOLIBRI_HAVE_ZLIB)
+    if (length > (size_t)(uInt)-1) {
+        return -1;
     }
-    if (!input) {
-        output[0] = '\0';
-        return;
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    /* Window bits 31 add the gzip wrapper, 15 the zlib one HTTP calls deflate. */
+    if (deflateInit2(&stream, KOLIBRI_COMPRESS_LEVEL, Z_DEFLATED, encoding == KOLIBRI_ENCODING_GZIP ? 31 : 15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
     }
-    size_t out_index = 0U;
-    for (size_t i = 0; input[i] != '\0' && out_index + 1U < out_size; ++i) {
-        char ch = input[i];
-        if (ch == '\\' || ch == '"') {
-            if (out_index + 2U >= out_size) {
-                break;
-            }
-            output[out_index++] = '\\';
-            output[out_index++] = ch;
-        } else if (ch == '\n') {
-            if (out_index + 2U >= out_size) {
-                break;
-            }
-            output[out_index++] = '\\';
-            output[out_index++] = 'n';
-        } else {
-            output[out_index++] = ch;
+    size_t bound = (size_t)deflateBound(&stream, (uLong)length);
+    if (bound > conn->packed_cap) {
+        char *next = realloc(conn->packed, bound);
+        if (!next) {
+            deflateEnd(&stream);
+            return -1;
         }
+        conn->packed = next;
+        conn->packed_cap = bound;
+    }
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)length;
+    stream.next_out = (Bytef *)conn->packed;
+    stream.avail_out = (uInt)bound;
+    int status = deflate(&stream, Z_FINISH);
+    size_t packed_len = (size_t)stream.total_out;
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END || packed_len >= length) {
+        return -1;
     }
-    output[out_index] = '\0';
+    conn->packed_len = packed_len;
+    conn->packed_encoding = encoding;
+    atomic_fetch_add(&kolibri_compress_runs, 1U);
+    return 0;
+#else
+    (void)conn;
+    (void)encoding;
+    (void)data;
+    (void)length;
+    return -1;
+#endif
 }
 
+/*
+ * Sends a whole body. A cacheable 200 carries an ETag and shrinks to a 304
+ * when If-None-Match already names its content; a body of at least
+ * kolibri_compress_min goes out in the negotiated coding if that is smaller.
+ */
+static void response_send_whole(KolibriConnection *conn, int status_code, const char *content_type) {
+    const char *data = conn->body ? conn->body : "";
+    size_t length = conn->body_len;
+    int cacheable = conn->cacheable && status_code == 200;
+    KolibriEncoding encoding = conn->body_encoding;
+    KolibriEncoding wanted = encoding;
+    if (wanted == KOLIBRI_ENCODING_IDENTITY && length >= kolibri_compress_min) {
+        wanted = conn->accept_encoding;
+    }
+    char tag[48];
+    if (cacheable) {
+        if (!conn->etag_ready) {
+            conn->etag = body_fingerprint(data, length);
+            conn->etag_ready = 1;
+        }
+        if (conn->not_modified || etag_listed(conn->if_none_match, conn->etag)) {
+            etag_format(conn->etag, wanted, tag, sizeof(tag));
+            char fields[96];
+            snprintf(fields, sizeof(fields), "ETag: %s\r\nVary: Accept-Encoding", tag);
+            char header[512];
+            int header_len = format_response_header(conn, 304, NULL, fields, header, sizeof(header));
+            if (header_len < 0) {
+                conn->failed = 1;
+                return;
+            }
+            atomic_fetch_add(&kolibri_not_modified_total, 1U);
+            connection_transmit(conn, header, (size_t)header_len, NULL, 0U);
+            return;
+        }
+    }
+    if (wanted != encoding && response_compress(conn, wanted, data, length) == 0) {
+        data = conn->packed;
+        length = conn->packed_len;
+        encoding = wanted;
+    }
+    char fields[160];
+    size_t used = 0U;
+    fields[0] = '\0';
+    if (encoding != KOLIBRI_ENCODING_IDENTITY) {
+        atomic_fetch_add(&kolibri_compressed_responses, 1U);
+        used += (size_t)snprintf(fields, sizeof(fields), "Content-Encoding: %s\r\n",
+                                 kolibri_encoding_names[encoding]);
+    }
+    if (cacheable) {
+        etag_format(conn->etag, encoding, tag, sizeof(tag));
+        used += (size_t)snprintf(fields + used, sizeof(fields) - used, "ETag: %s\r\n", tag);
+    }
+    if (used > 0U) {
+        snprintf(fields + used, sizeof(fields) - used, "Vary: Accept-Encoding");
+    }
+    send_response_bytes(conn, status_code, content_type, data, length, used > 0U ? fields : NULL);
+}
 
-static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
-    char buffer[KOLIBRI_REQUEST_BUFFER];
-    kolibri_requests_total += 1U;
-
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+/* Response builder: the body is assembled in place in conn->body. */
+static void response_begin(KolibriConnection *conn) {
+    conn->body_len = 0U;
+    conn->stream_armed = 0;
+    conn->cacheable = 0;
+    conn->not_modified = 0;
+    conn->etag_ready = 0;
+    conn->body_encoding = KOLIBRI_ENCODING_IDENTITY;
+    if (!conn->body) {
+        conn->body = (char *)malloc(KOLIBRI_RESPONSE_PREALLOC);
+        conn->body_cap = conn->body ? KOLIBRI_RESPONSE_PREALLOC : 0U;
+    }
+}
 
-    size_t header_len = 0U;
-    size_t content_len = 0U;
-    ssize_t total = receive_http_request(client_fd, buffer, sizeof(buffer), &header_len, &content_len);
-    if (total < 0) {
-        if (total == -2) {
-            send_response(client_fd, 408, "application/json", "{\"error\":\"timeout\"}");
-        } else if (total == -3 || total == -5) {
-            send_response(client_fd, 413, "application/json", "{\"error\":\"payload too large\"}");
-        } else {
-            send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
+/*
+ * Sends the body built so far as one chunk of a chunked response; the
+ * headers go out with the first chunk. Each chunk's trailing CRLF is sent
+ * with the next size line, so the data itself is never copied.
+ */
+static void response_stream_flush(KolibriConnection *conn) {
+    char prefix[448];
+    size_t prefix_len = 0U;
+    if (!conn->streaming) {
+        int header_len = format_response_header(conn,
+                                                conn->stream_status,
+                                                conn->stream_type,
+                                                "Transfer-Encoding: chunked",
+                                                prefix,
+                                                sizeof(prefix));
+        if (header_len < 0) {
+            conn->failed = 1;
+            return;
         }
-        return;
+        prefix_len = (size_t)header_len;
+        conn->streaming = 1;
+    } else {
+        memcpy(prefix, "\r\n", 2U);
+        prefix_len = 2U;
     }
+    prefix_len += (size_t)snprintf(prefix + prefix_len, sizeof(prefix) - prefix_len, "%zx\r\n", conn->body_len);
+    connection_transmit(conn, prefix, prefix_len, conn->body, conn->body_len);
+    conn->body_len = 0U;
+}
 
-    char *line_end = strstr(buffer, "\r\n");
-    if (!line_end) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        return;
+static int response_reserve(KolibriConnection *conn, size_t extra) {
+    if (conn->body_len + extra <= conn->body_cap) {
+        return 0;
     }
-    *line_end = '\0';
-
-    char method[8];
-    char *method_end = strchr(buffer, ' ');
-    if (!method_end) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        return;
+    if (conn->stream_armed && conn->body_len >= KOLIBRI_STREAM_CHUNK) {
+        response_stream_flush(conn);
+        if (extra <= conn->body_cap) {
+            return 0;
+        }
     }
-    size_t method_len = (size_t)(method_end - buffer);
-    if (method_len >= sizeof(method)) {
-        method_len = sizeof(method) - 1U;
+    size_t capacity = conn->body_cap ? conn->body_cap : KOLIBRI_RESPONSE_PREALLOC;
+    while (capacity < conn->body_len + extra) {
+        capacity *= 2U;
     }
-    memcpy(method, buffer, method_len);
-    method[method_len] = '\0';
+    char *next = realloc(conn->body, capacity);
+    if (!next) {
+        conn->failed = 1;
+        return -1;
+    }
+    conn->body = next;
+    conn->body_cap = capacity;
+    return 0;
+}
 
-    char *path_start = method_end + 1;
-    char *version_start = strchr(path_start, ' ');
-    if (!version_start) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
+static void response_append(KolibriConnection *conn, const char *data, size_t length) {
+    if (response_reserve(conn, length) != 0) {
         return;
     }
-    *version_start = '\0';
+    memcpy(conn->body + conn->body_len, data, length);
+    conn->body_len += length;
+}
 
-    const char *header_start = line_end + 2;
-    size_t header_bytes = header_len > (size_t)(header_start - buffer) ? header_len - (size_t)(header_start - buffer) : 0U;
+static void response_appendf(KolibriConnection *conn, const char *format, ...) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        size_t room = conn->body_cap - conn->body_len;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(conn->body ? conn->body + conn->body_len : NULL, room, format, args);
+        va_end(args);
+        if (written < 0) {
+            return;
+        }
+        if ((size_t)written < room) {
+            conn->body_len += (size_t)written;
+            return;
+        }
+        if (response_reserve(conn, (size_t)written + 1U) != 0) {
+            return;
+        }
+    }
+}
+
+static void response_append_json(KolibriConnection *conn, const char *text) {
+    if (!text) {
+        return;
+    }
+    char escaped[8];
+    for (size_t i = 0; text[i] != '\0'; ++i) {
+        size_t written = json_escape_char(text[i], escaped, sizeof(escaped));
+        if (response_reserve(conn, written) != 0) {
+            return;
+        }
+        memcpy(conn->body + conn->body_len, escaped, written);
+        conn->body_len += written;
+    }
+}
+
+static int swarm_export_writer(void *context, const void *data, size_t length) {
+    KolibriConnection *conn = (KolibriConnection *)context;
+    response_append(conn, (const char *)data, length);
+    return conn->failed;
+}
+
+/*
+ * Lets the body under construction leave as chunked output once it
+ * outgrows KOLIBRI_STREAM_CHUNK, so large answers need a bounded buffer.
+ * Smaller bodies still go out whole with a Content-Length, and so does
+ * every body for a client that takes compression: it is compressed whole.
+ */
+static void response_stream(KolibriConnection *conn, int status_code, const char *content_type) {
+    conn->stream_armed = conn->chunked_ok && conn->accept_encoding == KOLIBRI_ENCODING_IDENTITY;
+    conn->stream_status = status_code;
+    conn->stream_type = content_type;
+}
+
+static void response_finish(KolibriConnection *conn, int status_code, const char *content_type) {
+    conn->stream_armed = 0;
+    if (conn->streaming) {
+        if (conn->body_len > 0U) {
+            response_stream_flush(conn);
+        }
+        connection_transmit(conn, "\r\n0\r\n\r\n", 7U, NULL, 0U);
+        conn->streaming = 0;
+    } else {
+        response_send_whole(conn, status_code, content_type);
+    }
+    conn->body_len = 0U;
+    if (conn->body_cap > KOLIBRI_RESPONSE_RETAIN) {
+        free(conn->body);
+        conn->body = NULL;
+        conn->body_cap = 0U;
+    }
+}
+
+/*
+ * Cache key: ASCII-lowercased query with whitespace runs collapsed, which
+ * the tokenizer treats identically, followed by the result limit.
+ */
+static void query_cache_key(const char *query, size_t limit, char *output, size_t out_size) {
+    size_t out_index = 0U;
+    int pending_space = 0;
+    for (const unsigned char *cursor = (const unsigned char *)query; *cursor; ++cursor) {
+        if (isspace(*cursor)) {
+            pending_space = out_index > 0U;
+            continue;
+        }
+        if (pending_space && out_index + 1U < out_size) {
+            output[out_index++] = ' ';
+        }
+        pending_space = 0;
+        if (out_index + 1U < out_size) {
+            output[out_index++] = (char)tolower(*cursor);
+        }
+    }
+    output[out_index] = '\0';
+    snprintf(output + out_index, out_size - out_index, "\x1f%zu", limit);
+}
+
+static uint64_t query_cache_hash(const char *key) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *cursor = (const unsigned char *)key; *cursor; ++cursor) {
+        hash ^= (uint64_t)*cursor;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void query_cache_unlink(KolibriQueryCache *cache, KolibriCachedQuery *entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void query_cache_push_front(KolibriQueryCache *cache, KolibriCachedQuery *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (!cache->tail) {
+        cache->tail = entry;
+    }
+}
+
+static void query_cache_remove(KolibriQueryCache *cache, KolibriCachedQuery *entry) {
+    KolibriCachedQuery **slot = &cache->buckets[entry->hash % cache->bucket_count];
+    while (*slot && *slot != entry) {
+        slot = &(*slot)->chain;
+    }
+    if (*slot) {
+        *slot = entry->chain;
+    }
+    query_cache_unlink(cache, entry);
+    free(entry->key);
+    free(entry->body);
+    for (size_t i = 0; i < KOLIBRI_ENCODING_COUNT; ++i) {
+        free(entry->packed[i]);
+    }
+    free(entry);
+    cache->count -= 1U;
+}
+
+/*
+ * Copies a cached answer built from this generation into conn->body, in the
+ * client's coding when the entry already holds it; returns 1 on a hit. A
+ * client whose If-None-Match names the answer gets no body, only a 304.
+ */
+static int query_cache_lookup(const char *key,
+                              unsigned long generation,
+                              KolibriConnection *conn,
+                              KolibriCachedQuery *meta) {
+    KolibriQueryCache *cache = &kolibri_query_cache;
+    if (kolibri_query_cache_capacity == 0U) {
+        return 0;
+    }
+    uint64_t hash = query_cache_hash(key);
+    int hit = 0;
+    pthread_mutex_lock(&cache->lock);
+    KolibriCachedQuery *entry = cache->bucket_count ? cache->buckets[hash % cache->bucket_count] : NULL;
+    while (entry && !(entry->hash == hash && strcmp(entry->key, key) == 0)) {
+        entry = entry->chain;
+    }
+    if (entry && entry->generation != generation) {
+        query_cache_remove(cache, entry);
+        entry = NULL;
+    }
+    if (entry) {
+        response_begin(conn);
+        conn->cacheable = 1;
+        conn->etag = entry->etag;
+        conn->etag_ready = 1;
+        if (entry->packed[conn->accept_encoding]) {
+            conn->body_encoding = conn->accept_encoding;
+        }
+        if (etag_listed(conn->if_none_match, entry->etag)) {
+            conn->not_modified = 1;
+        } else if (conn->body_encoding != KOLIBRI_ENCODING_IDENTITY) {
+            response_append(conn, entry->packed[conn->body_encoding], entry->packed_len[conn->body_encoding]);
+        } else {
+            response_append(conn, entry->body, entry->body_len);
+        }
+        meta->result_count = entry->result_count;
+        meta->replay_count = entry->replay_count;
+        memcpy(meta->replay, entry->replay, sizeof(meta->replay));
+        query_cache_unlink(cache, entry);
+        query_cache_push_front(cache, entry);
+        cache->hits += 1U;
+        hit = !conn->failed;
+    } else {
+        cache->misses += 1U;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+static void query_cache_store(const char *key,
+                              const char *body,
+                              size_t body_len,
+                              const KolibriCachedQuery *meta,
+                              unsigned long generation) {
+    KolibriQueryCache *cache = &kolibri_query_cache;
+    if (kolibri_query_cache_capacity == 0U) {
+        return;
+    }
+    KolibriCachedQuery *entry = (KolibriCachedQuery *)calloc(1U, sizeof(*entry));
+    char *key_copy = strdup(key);
+    char *body_copy = (char *)malloc(body_len ? body_len : 1U);
+    if (!entry || !key_copy || !body_copy) {
+        free(entry);
+        free(key_copy);
+        free(body_copy);
+        return;
+    }
+    memcpy(body_copy, body, body_len);
+    entry->key = key_copy;
+    entry->hash = query_cache_hash(key);
+    entry->body = body_copy;
+    entry->body_len = body_len;
+    entry->etag = body_fingerprint(body, body_len);
+    entry->result_count = meta->result_count;
+    entry->replay_count = meta->replay_count;
+    memcpy(entry->replay, meta->replay, sizeof(entry->replay));
+    entry->generation = generation;
+
+    pthread_mutex_lock(&cache->lock);
+    if (!cache->buckets) {
+        size_t buckets = 16U;
+        while (buckets < kolibri_query_cache_capacity) {
+            buckets *= 2U;
+        }
+        cache->buckets = (KolibriCachedQuery **)calloc(buckets, sizeof(*cache->buckets));
+        cache->bucket_count = cache->buckets ? buckets : 0U;
+    }
+    if (!cache->buckets) {
+        pthread_mutex_unlock(&cache->lock);
+        free(entry->key);
+        free(entry->body);
+        free(entry);
+        return;
+    }
+    KolibriCachedQuery *existing = cache->buckets[entry->hash % cache->bucket_count];
+    while (existing && !(existing->hash == entry->hash && strcmp(existing->key, key) == 0)) {
+        existing = existing->chain;
+    }
+    if (existing) {
+        /* Another worker raced us to the same query. */
+        query_cache_remove(cache, existing);
+    }
+    while (cache->count >= kolibri_query_cache_capacity && cache->tail) {
+        query_cache_remove(cache, cache->tail);
+        cache->evictions += 1U;
+    }
+    KolibriCachedQuery **slot = &cache->buckets[entry->hash % cache->bucket_count];
+    entry->chain = *slot;
+    *slot = entry;
+    query_cache_push_front(cache, entry);
+    cache->count += 1U;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Keeps a coding of a cached answer so later clients skip the compression. */
+static void query_cache_attach(const char *key,
+                               unsigned long generation,
+                               KolibriEncoding encoding,
+                               const char *data,
+                               size_t length) {
+    KolibriQueryCache *cache = &kolibri_query_cache;
+    if (kolibri_query_cache_capacity == 0U || encoding == KOLIBRI_ENCODING_IDENTITY) {
+        return;
+    }
+    char *copy = (char *)malloc(length);
+    if (!copy) {
+        return;
+    }
+    memcpy(copy, data, length);
+    uint64_t hash = query_cache_hash(key);
+    pthread_mutex_lock(&cache->lock);
+    KolibriCachedQuery *entry = cache->bucket_count ? cache->buckets[hash % cache->bucket_count] : NULL;
+    while (entry && !(entry->hash == hash && strcmp(entry->key, key) == 0)) {
+        entry = entry->chain;
+    }
+    if (entry && entry->generation == generation && !entry->packed[encoding]) {
+        entry->packed[encoding] = copy;
+        entry->packed_len[encoding] = length;
+        copy = NULL;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(copy);
+}
+
+static void query_cache_destroy(void) {
+    KolibriQueryCache *cache = &kolibri_query_cache;
+    pthread_mutex_lock(&cache->lock);
+    while (cache->head) {
+        query_cache_remove(cache, cache->head);
+    }
+    free(cache->buckets);
+    cache->buckets = NULL;
+    cache->bucket_count = 0U;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void response_append_directories(KolibriConnection *conn) {
+    response_append(conn, "[", 1U);
+    for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
+        response_append(conn, i > 0U ? ",\"" : "\"", i > 0U ? 2U : 1U);
+        response_append_json(conn, kolibri_knowledge_directories[i]);
+        response_append(conn, "\"", 1U);
+    }
+    response_append(conn, "]", 1U);
+}
+
+static void prometheus_escape_label(const char *input, char *output, size_t out_size) {
+    if (!output || out_size == 0) {
+        return;
+    }
+    if (!input) {
+        output[0] = '\0';
+        return;
+    }
+    size_t out_index = 0U;
+    for (size_t i = 0; input[i] != '\0' && out_index + 1U < out_size; ++i) {
+        char ch = input[i];
+        if (ch == '\\' || ch == '"') {
+            if (out_index + 2U >= out_size) {
+                break;
+            }
+            output[out_index++] = '\\';
+            output[out_index++] = ch;
+        } else if (ch == '\n') {
+            if (out_index + 2U >= out_size) {
+                break;
+            }
+            output[out_index++] = '\\';
+            output[out_index++] = 'n';
+        } else {
+            output[out_index++] = ch;
+        }
+    }
+    output[out_index] = '\0';
+}
+
+
+static int serving_index_unchanged(const KolibriServingIndex *current, unsigned long long fingerprint) {
+    if (!current) {
+        return 0;
+    }
+    if (kolibri_index_json_path[0] != '\0') {
+        return strcmp(current->source, "prebuilt") == 0 &&
+               manifest_mtime(kolibri_index_json_path) == current->manifest_mtime;
+    }
+    return current->fingerprint == fingerprint && manifest_mtime(kolibri_index_cache_dir) == current->manifest_mtime;
+}
+
+static void *warm_training_main(void *arg) {
+    KolibriWarmTrainer *warm = (KolibriWarmTrainer *)arg;
+    const KolibriKnowledgeIndex *index = warm->serving->index;
+    size_t total = atomic_load(&warm->total);
+    write_bootstrap_script(index, KOLIBRI_BOOTSTRAP_SCRIPT);
+
+    KolibriPoolConfig config = {
+        .association_capacity = total < KOLIBRI_WARM_ASSOCIATIONS_MAX ? total : KOLIBRI_WARM_ASSOCIATIONS_MAX,
+        .seed = (uint64_t)warm->serving->timestamp,
+    };
+    warm->pool = kf_pool_create(&config);
+    KolibriScript script;
+    if (!warm->pool || ks_init(&script, warm->pool, NULL) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] warm training failed: out of memory\n");
+        atomic_store(&warm->state, KOLIBRI_WARM_FAILED);
+        return NULL;
+    }
+
+    KolibriAssociationInput pairs[KOLIBRI_WARM_BATCH];
+    char *previews[KOLIBRI_WARM_BATCH];
+    uint64_t started = monotonic_ns();
+    int status = 0;
+    size_t next = 0U;
+    while (next < total && status == 0 && !atomic_load(&warm->cancel)) {
+        size_t count = 0U;
+        for (; next < total && count < KOLIBRI_WARM_BATCH; ++next) {
+            const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, next);
+            if (!doc) {
+                continue;
+            }
+            previews[count] = snippet_preview(doc->content, KOLIBRI_WARM_SNIPPET);
+            pairs[count].question = doc->title ? doc->title : doc->id;
+            pairs[count].answer = previews[count];
+            count++;
+        }
+        status = ks_teach_bulk(&script, pairs, count);
+        for (size_t i = 0; i < count; ++i) {
+            free(previews[i]);
+        }
+        atomic_store(&warm->trained, next);
+    }
+    size_t associations = warm->pool->association_count;
+    ks_free(&script);
+
+    if (status != 0) {
+        fprintf(stderr, "[kolibri-knowledge] warm training failed after %zu documents\n", next);
+        atomic_store(&warm->state, KOLIBRI_WARM_FAILED);
+    } else if (atomic_load(&warm->cancel)) {
+        atomic_store(&warm->state, KOLIBRI_WARM_IDLE);
+    } else {
+        fprintf(stdout,
+                "[kolibri-knowledge] warm training: %zu documents, %zu associations in %.1f ms\n",
+                total,
+                associations,
+                (double)(monotonic_ns() - started) / 1e6);
+        atomic_store(&warm->state, KOLIBRI_WARM_DONE);
+    }
+    return NULL;
+}
+
+/* Stops the running stage and frees its pool; callers hold warm->lock. */
+static void warm_training_join_locked(KolibriWarmTrainer *warm) {
+    if (warm->joinable) {
+        atomic_store(&warm->cancel, 1);
+        pthread_join(warm->thread, NULL);
+        warm->joinable = 0;
+    }
+    kf_pool_destroy(warm->pool);
+    warm->pool = NULL;
+    serving_index_release(warm->serving);
+    warm->serving = NULL;
+}
+
+/* Starts warm training on the serving snapshot, replacing any earlier stage. */
+static void start_warm_training(void) {
+    KolibriWarmTrainer *warm = &kolibri_warm;
+    pthread_mutex_lock(&warm->lock);
+    warm_training_join_locked(warm);
+    warm->serving = serving_index_acquire();
+    size_t total = warm->serving ? kolibri_knowledge_index_document_count(warm->serving->index) : 0U;
+    atomic_store(&warm->cancel, 0);
+    atomic_store(&warm->trained, 0U);
+    atomic_store(&warm->total, total);
+    atomic_store(&warm->generation, warm->serving ? warm->serving->generation : 0UL);
+    if (total == 0U) {
+        atomic_store(&warm->state, KOLIBRI_WARM_DONE);
+        serving_index_release(warm->serving);
+        warm->serving = NULL;
+        pthread_mutex_unlock(&warm->lock);
+        return;
+    }
+    atomic_store(&warm->state, KOLIBRI_WARM_RUNNING);
+    sigset_t previous;
+    block_server_signals(&previous);
+    int err = pthread_create(&warm->thread, NULL, warm_training_main, warm);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (err != 0) {
+        fprintf(stderr, "[kolibri-knowledge] warm training not started (err=%d)\n", err);
+        atomic_store(&warm->state, KOLIBRI_WARM_FAILED);
+    } else {
+        warm->joinable = 1;
+    }
+    pthread_mutex_unlock(&warm->lock);
+}
+
+static void finish_warm_training(void) {
+    pthread_mutex_lock(&kolibri_warm.lock);
+    warm_training_join_locked(&kolibri_warm);
+    pthread_mutex_unlock(&kolibri_warm.lock);
+}
+
+/* Builds the replacement index off the request path; readers keep the old one meanwhile. */
+static void *index_reload_main(void *arg) {
+    (void)arg;
+    unsigned long long fingerprint = knowledge_sources_fingerprint();
+    KolibriServingIndex *current = serving_index_acquire();
+    if (serving_index_unchanged(current, fingerprint)) {
+        fprintf(stdout, "[kolibri-knowledge] reload skipped: index sources unchanged\n");
+    } else {
+        KolibriServingIndex *next = (KolibriServingIndex *)calloc(1U, sizeof(*next));
+        int err = next ? load_or_build_index(next, fingerprint) : ENOMEM;
+        if (err == 0 && next->index) {
+            size_t document_count = kolibri_knowledge_index_document_count(next->index);
+            serving_index_install(next);
+            fprintf(stdout, "[kolibri-knowledge] reloaded %zu documents (%s)\n", document_count, next->source);
+            start_warm_training();
+        } else {
+            fprintf(stderr, "[kolibri-knowledge] reload failed, keeping current index (err=%d)\n", err);
+            if (next) {
+                kolibri_knowledge_index_destroy(next->index);
+            }
+            free(next);
+        }
+    }
+    serving_index_release(current);
+    atomic_store(&kolibri_reload_active, 0);
+    return NULL;
+}
+
+/* Returns 0 when a reload was started, EBUSY while another one is still running. */
+static int start_index_reload(void) {
+    pthread_mutex_lock(&kolibri_reload_lock);
+    if (atomic_load(&kolibri_reload_active)) {
+        pthread_mutex_unlock(&kolibri_reload_lock);
+        return EBUSY;
+    }
+    if (kolibri_reload_joinable) {
+        pthread_join(kolibri_reload_thread, NULL);
+        kolibri_reload_joinable = 0;
+    }
+    atomic_store(&kolibri_reload_active, 1);
+    sigset_t previous;
+    block_server_signals(&previous);
+    int err = pthread_create(&kolibri_reload_thread, NULL, index_reload_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (err != 0) {
+        atomic_store(&kolibri_reload_active, 0);
+    } else {
+        kolibri_reload_joinable = 1;
+    }
+    pthread_mutex_unlock(&kolibri_reload_lock);
+    return err;
+}
+
+static void finish_index_reload(void) {
+    pthread_mutex_lock(&kolibri_reload_lock);
+    if (kolibri_reload_joinable) {
+        pthread_join(kolibri_reload_thread, NULL);
+        kolibri_reload_joinable = 0;
+    }
+    pthread_mutex_unlock(&kolibri_reload_lock);
+}
+
+static void poll_reload_request(void) {
+    if (!kolibri_reload_requested) {
+        return;
+    }
+    kolibri_reload_requested = 0;
+    if (start_index_reload() == EBUSY) {
+        fprintf(stdout, "[kolibri-knowledge] reload already in progress\n");
+    }
+}
+
+static void build_search_response(KolibriConnection *conn,
+                                  const KolibriKnowledgeIndex *index,
+                                  const size_t *indices,
+                                  const float *scores,
+                                  size_t result_count) {
+    response_begin(conn);
+    response_stream(conn, 200, "application/json");
+    response_append(conn, "{\"snippets\":[", 13U);
+    int first = 1;
+    for (size_t i = 0; i < result_count; ++i) {
+        const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
+        if (!doc) {
+            continue;
+        }
+        response_append(conn, first ? "{\"id\":\"" : ",{\"id\":\"", first ? 7U : 8U);
+        first = 0;
+        response_append_json(conn, doc->id);
+        response_append(conn, "\",\"title\":\"", 11U);
+        response_append_json(conn, doc->title);
+        response_append(conn, "\",\"content\":\"", 13U);
+        response_append_json(conn, doc->content);
+        response_append(conn, "\",\"source\":\"", 12U);
+        response_append_json(conn, doc->source);
+        response_appendf(conn, "\",\"score\":%.3f}", scores[i]);
+    }
+    response_append(conn, "]}", 2U);
+}
+
+/* ASK for the query, then TEACH pairing it with each answer's preview. */
+static void record_search_events(const char *query, const char *const *answers, size_t count) {
+    char ask_payload[512];
+    int query_limit = (int)sizeof(ask_payload) - 3;
+    if (query_limit < 0) {
+        query_limit = 0;
+    }
+    snprintf(ask_payload, sizeof(ask_payload), "q=%.*s", query_limit, query);
+    knowledge_record_event("ASK", ask_payload, 0);
+    for (size_t i = 0; i < count; ++i) {
+        char *preview = snippet_preview(answers[i] ? answers[i] : "", 200U);
+        char teach_payload[512];
+        int remaining = (int)sizeof(teach_payload) - 1 - 5;
+        if (remaining < 0) {
+            remaining = 0;
+        }
+        int teach_q_limit = remaining > 0 ? remaining / 2 : 0;
+        int teach_a_limit = remaining - teach_q_limit;
+        snprintf(teach_payload,
+                 sizeof(teach_payload),
+                 "q=%.*s a=%.*s",
+                 teach_q_limit,
+                 query,
+                 teach_a_limit,
+                 preview ? preview : "");
+        knowledge_record_event("TEACH", teach_payload, 0);
+        free(preview);
+    }
+}
+
+/* Non-blocking HTTP/1.0 exchange with one shard peer. */
+typedef enum {
+    KOLIBRI_SHARD_CONNECTING,
+    KOLIBRI_SHARD_SENDING,
+    KOLIBRI_SHARD_READING,
+    KOLIBRI_SHARD_DONE,
+    KOLIBRI_SHARD_FAILED
+} KolibriShardStage;
+
+typedef struct {
+    int fd;
+    KolibriShardStage stage;
+    size_t sent;
+    char *response;
+    size_t response_len;
+    size_t response_cap;
+} KolibriShardCall;
+
+typedef struct {
+    const char *id;
+    const char *title;
+    const char *content;
+    const char *source;
+    float score;
+    size_t origin; /* 0 is the local index, peer p is p + 1 */
+    size_t rank;
+} KolibriShardHit;
+
+static void shard_call_fail(KolibriShardCall *call) {
+    if (call->fd >= 0) {
+        close(call->fd);
+        call->fd = -1;
+    }
+    call->stage = KOLIBRI_SHARD_FAILED;
+}
+
+static void shard_calls_start(KolibriShardCall *calls, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const KolibriShardPeer *peer = &kolibri_shard_peers[i];
+        KolibriShardCall *call = &calls[i];
+        call->stage = KOLIBRI_SHARD_CONNECTING;
+        call->fd = socket(peer->addr.ss_family, SOCK_STREAM, 0);
+        if (call->fd < 0) {
+            shard_call_fail(call);
+            continue;
+        }
+        int flags = fcntl(call->fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(call->fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+            shard_call_fail(call);
+            continue;
+        }
+        if (connect(call->fd, (const struct sockaddr *)&peer->addr, peer->addr_len) == 0) {
+            call->stage = KOLIBRI_SHARD_SENDING;
+        } else if (errno != EINPROGRESS) {
+            shard_call_fail(call);
+        }
+    }
+}
+
+static void shard_call_progress(KolibriShardCall *call, const char *request, size_t request_len) {
+    if (call->stage == KOLIBRI_SHARD_CONNECTING) {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(call->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+            shard_call_fail(call);
+            return;
+        }
+        call->stage = KOLIBRI_SHARD_SENDING;
+    }
+    while (call->stage == KOLIBRI_SHARD_SENDING) {
+        ssize_t sent = send(call->fd, request + call->sent, request_len - call->sent, 0);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                shard_call_fail(call);
+            }
+            return;
+        }
+        call->sent += (size_t)sent;
+        if (call->sent == request_len) {
+            call->stage = KOLIBRI_SHARD_READING;
+            return;
+        }
+    }
+    while (call->stage == KOLIBRI_SHARD_READING) {
+        if (call->response_cap - call->response_len < 4096U) {
+            size_t capacity = call->response_cap ? call->response_cap * 2U : 16384U;
+            char *grown = capacity <= KOLIBRI_SHARD_RESPONSE_MAX ? (char *)realloc(call->response, capacity + 1U) : NULL;
+            if (!grown) {
+                shard_call_fail(call);
+                return;
+            }
+            call->response = grown;
+            call->response_cap = capacity;
+        }
+        ssize_t got = recv(call->fd, call->response + call->response_len, call->response_cap - call->response_len, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                shard_call_fail(call);
+            }
+            return;
+        }
+        if (got == 0) {
+            call->response[call->response_len] = '\0';
+            close(call->fd);
+            call->fd = -1;
+            call->stage = KOLIBRI_SHARD_DONE;
+            return;
+        }
+        call->response_len += (size_t)got;
+    }
+}
+
+/* Drives every call until it answers or deadline_ns passes; late ones fail. */
+static void shard_calls_wait(KolibriShardCall *calls, size_t count, const char *request, size_t request_len,
+                             uint64_t deadline_ns) {
+    struct pollfd polls[KOLIBRI_MAX_SHARDS];
+    size_t owners[KOLIBRI_MAX_SHARDS];
+    while (1) {
+        size_t active = 0U;
+        for (size_t i = 0; i < count; ++i) {
+            KolibriShardStage stage = calls[i].stage;
+            if (stage == KOLIBRI_SHARD_DONE || stage == KOLIBRI_SHARD_FAILED) {
+                continue;
+            }
+            polls[active].fd = calls[i].fd;
+            polls[active].events = stage == KOLIBRI_SHARD_READING ? POLLIN : POLLOUT;
+            polls[active].revents = 0;
+            owners[active++] = i;
+        }
+        uint64_t now = monotonic_ns();
+        if (active == 0U || now >= deadline_ns) {
+            break;
+        }
+        int timeout_ms = (int)((deadline_ns - now + 999999U) / 1000000U);
+        int ready = poll(polls, (nfds_t)active, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        for (size_t k = 0; ready > 0 && k < active; ++k) {
+            if (polls[k].revents != 0) {
+                shard_call_progress(&calls[owners[k]], request, request_len);
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (calls[i].stage != KOLIBRI_SHARD_DONE) {
+            shard_call_fail(&calls[i]);
+        }
+    }
+}
+
+static size_t shard_utf8_encode(unsigned long cp, char *out) {
+    if (cp < 0x80UL) {
+        out[0] = (char)cp;
+        return 1U;
+    }
+    if (cp < 0x800UL) {
+        out[0] = (char)(0xC0UL | (cp >> 6));
+        out[1] = (char)(0x80UL | (cp & 0x3FUL));
+        return 2U;
+    }
+    if (cp < 0x10000UL) {
+        out[0] = (char)(0xE0UL | (cp >> 12));
+        out[1] = (char)(0x80UL | ((cp >> 6) & 0x3FUL));
+        out[2] = (char)(0x80UL | (cp & 0x3FUL));
+        return 3U;
+    }
+    out[0] = (char)(0xF0UL | (cp >> 18));
+    out[1] = (char)(0x80UL | ((cp >> 12) & 0x3FUL));
+    out[2] = (char)(0x80UL | ((cp >> 6) & 0x3FUL));
+    out[3] = (char)(0x80UL | (cp & 0x3FUL));
+    return 4U;
+}
+
+static int shard_hex4(const char *text, unsigned long *out) {
+    char digits[5];
+    for (size_t i = 0; i < 4U; ++i) {
+        if (!isxdigit((unsigned char)text[i])) {
+            return -1;
+        }
+        digits[i] = text[i];
+    }
+    digits[4] = '\0';
+    *out = strtoul(digits, NULL, 16);
+    return 0;
+}
+
+/* Unescapes the JSON string opening at *cursor in place; NULL when malformed.
+ * An escape never encodes to more bytes than it spans, so the text fits. */
+static char *shard_json_string(char **cursor) {
+    char *src = *cursor;
+    if (*src != '"') {
+        return NULL;
+    }
+    char *start = ++src;
+    char *dst = start;
+    while (*src != '"') {
+        if (*src == '\0') {
+            return NULL;
+        }
+        if (*src != '\\') {
+            *dst++ = *src++;
+            continue;
+        }
+        char escape = src[1];
+        src += 2;
+        switch (escape) {
+        case '"':
+        case '\\':
+        case '/':
+            *dst++ = escape;
+            break;
+        case 'b':
+            *dst++ = '\b';
+            break;
+        case 'f':
+            *dst++ = '\f';
+            break;
+        case 'n':
+            *dst++ = '\n';
+            break;
+        case 'r':
+            *dst++ = '\r';
+            break;
+        case 't':
+            *dst++ = '\t';
+            break;
+        case 'u': {
+            unsigned long cp = 0UL;
+            if (shard_hex4(src, &cp) != 0) {
+                return NULL;
+            }
+            src += 4;
+            unsigned long low = 0UL;
+            if (cp >= 0xD800UL && cp < 0xDC00UL && src[0] == '\\' && src[1] == 'u' && shard_hex4(src + 2, &low) == 0 &&
+                low >= 0xDC00UL && low < 0xE000UL) {
+                cp = 0x10000UL + ((cp - 0xD800UL) << 10) + (low - 0xDC00UL);
+                src += 6;
+            } else if (cp >= 0xD800UL && cp < 0xE000UL) {
+                cp = 0xFFFDUL;
+            }
+            dst += shard_utf8_encode(cp, dst);
+            break;
+        }
+        default:
+            return NULL;
+        }
+    }
+    *dst = '\0';
+    *cursor = src + 1;
+    return start;
+}
+
+/* Decodes a chunked body in place; -1 when the framing is broken. */
+static int shard_dechunk(char *body, size_t *len) {
+    char *src = body;
+    char *end = body + *len;
+    char *dst = body;
+    while (src < end) {
+        char *size_end = NULL;
+        unsigned long size = strtoul(src, &size_end, 16);
+        char *line_end = strstr(src, "\r\n");
+        if (!line_end || size_end == src || (size_t)(end - line_end - 2) < size) {
+            return -1;
+        }
+        if (size == 0UL) {
+            *dst = '\0';
+            *len = (size_t)(dst - body);
+            return 0;
+        }
+        memmove(dst, line_end + 2, size);
+        dst += size;
+        src = line_end + 2 + size;
+        if (end - src >= 2 && src[0] == '\r' && src[1] == '\n') {
+            src += 2;
+        }
+    }
+    return -1;
+}
+
+/* Appends the snippets of a shard's answer to hits; -1 on a bad answer. */
+static int shard_parse_response(KolibriShardCall *call, size_t origin, KolibriShardHit *hits, size_t *hit_count,
+                                size_t limit) {
+    char *response = call->response;
+    if (!response || strncmp(response, "HTTP/1.", 7U) != 0 || strncmp(response + 8, " 200", 4U) != 0) {
+        return -1;
+    }
+    char *body = strstr(response, "\r\n\r\n");
+    if (!body) {
+        return -1;
+    }
+    size_t header_len = (size_t)(body - response) + 4U;
+    body += 4;
+    size_t body_len = call->response_len - header_len;
+    char framing[32];
+    if (extract_header_value(response, header_len, "Transfer-Encoding", framing, sizeof(framing)) == 0 &&
+        strcasecmp(framing, "chunked") == 0 && shard_dechunk(body, &body_len) != 0) {
+        return -1;
+    }
+    char *cursor = strstr(body, "\"snippets\":[");
+    if (!cursor) {
+        return -1;
+    }
+    cursor += 12;
+    size_t rank = 0U;
+    while (1) {
+        while (isspace((unsigned char)*cursor) || *cursor == ',') {
+            cursor++;
+        }
+        if (*cursor == ']') {
+            return 0;
+        }
+        if (*cursor != '{') {
+            return -1;
+        }
+        cursor++;
+        KolibriShardHit hit;
+        memset(&hit, 0, sizeof(hit));
+        while (1) {
+            while (isspace((unsigned char)*cursor) || *cursor == ',') {
+                cursor++;
+            }
+            if (*cursor == '}') {
+                cursor++;
+                break;
+            }
+            char *key = shard_json_string(&cursor);
+            while (key && isspace((unsigned char)*cursor)) {
+                cursor++;
+            }
+            if (!key || *cursor != ':') {
+                return -1;
+            }
+            cursor++;
+            while (isspace((unsigned char)*cursor)) {
+                cursor++;
+            }
+            if (*cursor == '"') {
+                char *value = shard_json_string(&cursor);
+                if (!value) {
+                    return -1;
+                }
+                if (strcmp(key, "id") == 0) {
+                    hit.id = value;
+                } else if (strcmp(key, "title") == 0) {
+                    hit.title = value;
+                } else if (strcmp(key, "content") == 0) {
+                    hit.content = value;
+                } else if (strcmp(key, "source") == 0) {
+                    hit.source = value;
+                }
+            } else {
+                char *number_end = NULL;
+                double value = strtod(cursor, &number_end);
+                if (!number_end || number_end == cursor) {
+                    return -1;
+                }
+                if (strcmp(key, "score") == 0) {
+                    hit.score = (float)value;
+                }
+                cursor = number_end;
+            }
+        }
+        if (hit.id && rank < limit) {
+            hit.origin = origin;
+            hit.rank = rank++;
+            hits[(*hit_count)++] = hit;
+        }
+    }
+}
+
+static int shard_hit_compare(const void *a, const void *b) {
+    const KolibriShardHit *ha = (const KolibriShardHit *)a;
+    const KolibriShardHit *hb = (const KolibriShardHit *)b;
+    if (ha->score != hb->score) {
+        return ha->score > hb->score ? -1 : 1;
+    }
+    if (ha->origin != hb->origin) {
+        return ha->origin < hb->origin ? -1 : 1;
+    }
+    return ha->rank < hb->rank ? -1 : (ha->rank > hb->rank ? 1 : 0);
+}
+
+static size_t url_encode(const char *text, char *output, size_t out_size) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t len = 0U;
+    for (const unsigned char *cursor = (const unsigned char *)text; *cursor; ++cursor) {
+        if (isalnum(*cursor) || *cursor == '-' || *cursor == '_' || *cursor == '.' || *cursor == '~') {
+            if (len + 1U >= out_size) {
+                break;
+            }
+            output[len++] = (char)*cursor;
+        } else {
+            if (len + 3U >= out_size) {
+                break;
+            }
+            output[len++] = '%';
+            output[len++] = hex[*cursor >> 4];
+            output[len++] = hex[*cursor & 0x0FU];
+        }
+    }
+    output[len] = '\0';
+    return len;
+}
+
+/*
+ * Coordinator search: the query goes to every shard peer at once with
+ * local=1 (so a peer never fans out again) while the local index, one more
+ * shard when it holds documents, is searched meanwhile. Peers that have not
+ * answered within kolibri_shard_timeout_ms are left out and the answer is
+ * marked partial; the top limit snippets of the rest are merged by score.
+ */
+static void sharded_search(KolibriConnection *conn, const KolibriKnowledgeIndex *index, const char *query,
+                           size_t limit) {
+    size_t peers = kolibri_shard_peer_count;
+    KolibriShardCall *calls = (KolibriShardCall *)calloc(peers, sizeof(KolibriShardCall));
+    KolibriShardHit *hits = (KolibriShardHit *)malloc((peers + 1U) * limit * sizeof(KolibriShardHit));
+    char encoded[1600];
+    url_encode(query, encoded, sizeof(encoded));
+    char request[2048];
+    int request_len = snprintf(request, sizeof(request),
+                               "GET /api/knowledge/search?q=%s&limit=%zu&local=1 HTTP/1.0\r\n"
+                               "Connection: close\r\n\r\n",
+                               encoded, limit);
+    if (!calls || !hits || request_len <= 0 || (size_t)request_len >= sizeof(request)) {
+        free(calls);
+        free(hits);
+        send_response(conn, 500, "application/json", "{\"error\":\"search failed\"}");
+        return;
+    }
+    uint64_t started = monotonic_ns();
+    for (size_t i = 0; i < peers; ++i) {
+        calls[i].fd = -1;
+    }
+    shard_calls_start(calls, peers);
+
+    size_t hit_count = 0U;
+    size_t shards = peers;
+    size_t answered = 0U;
+    if (index && kolibri_knowledge_index_document_count(index) > 0U) {
+        size_t indices[KOLIBRI_SEARCH_LIMIT_MAX];
+        float scores[KOLIBRI_SEARCH_LIMIT_MAX];
+        size_t result_count = 0U;
+        shards += 1U;
+        if (kolibri_knowledge_index_search(index, query, limit, indices, scores, &result_count) == 0) {
+            answered += 1U;
+            for (size_t i = 0; i < result_count; ++i) {
+                const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
+                if (doc) {
+                    KolibriShardHit hit = {doc->id, doc->title, doc->content, doc->source, scores[i], 0U, i};
+                    hits[hit_count++] = hit;
+                }
+            }
+        }
+    }
+    shard_calls_wait(calls, peers, request, (size_t)request_len, started + (uint64_t)kolibri_shard_timeout_ms * 1000000ULL);
+    for (size_t i = 0; i < peers; ++i) {
+        size_t before = hit_count;
+        if (calls[i].stage == KOLIBRI_SHARD_DONE && shard_parse_response(&calls[i], i + 1U, hits, &hit_count, limit) == 0) {
+            answered += 1U;
+        } else {
+            hit_count = before;
+            atomic_fetch_add(&kolibri_shard_failures, 1U);
+        }
+    }
+    atomic_fetch_add(&kolibri_shard_requests, peers);
+    if (answered < shards) {
+        atomic_fetch_add(&kolibri_shard_partial, 1U);
+    }
+    record_phase(KOLIBRI_PHASE_SEARCH, started);
+
+    uint64_t phase_started = monotonic_ns();
+    qsort(hits, hit_count, sizeof(KolibriShardHit), shard_hit_compare);
+    /* A document seen twice (shards being re-partitioned) keeps its best hit. */
+    size_t kept = 0U;
+    for (size_t i = 0; i < hit_count && kept < limit; ++i) {
+        int duplicate = 0;
+        for (size_t j = 0; j < kept && !duplicate; ++j) {
+            duplicate = strcmp(hits[j].id, hits[i].id) == 0 &&
+                        strcmp(hits[j].source ? hits[j].source : "", hits[i].source ? hits[i].source : "") == 0;
+        }
+        if (!duplicate) {
+            hits[kept++] = hits[i];
+        }
+    }
+    response_begin(conn);
+    response_stream(conn, 200, "application/json");
+    response_append(conn, "{\"snippets\":[", 13U);
+    for (size_t i = 0; i < kept; ++i) {
+        response_append(conn, i == 0U ? "{\"id\":\"" : ",{\"id\":\"", i == 0U ? 7U : 8U);
+        response_append_json(conn, hits[i].id);
+        response_append(conn, "\",\"title\":\"", 11U);
+        response_append_json(conn, hits[i].title ? hits[i].title : "");
+        response_append(conn, "\",\"content\":\"", 13U);
+        response_append_json(conn, hits[i].content ? hits[i].content : "");
+        response_append(conn, "\",\"source\":\"", 12U);
+        response_append_json(conn, hits[i].source ? hits[i].source : "");
+        response_appendf(conn, "\",\"score\":%.3f}", hits[i].score);
+    }
+    response_appendf(conn, "],\"shards\":{\"total\":%zu,\"answered\":%zu}%s}", shards, answered,
+                     answered < shards ? ",\"partial\":true" : "");
+    record_phase(KOLIBRI_PHASE_SERIALIZE, phase_started);
+    atomic_fetch_add(kept == 0U ? &kolibri_search_misses : &kolibri_search_hits, 1U);
+    response_finish(conn, 200, "application/json");
+
+    if (kolibri_genome_ready) {
+        const char *answers[KOLIBRI_QUERY_REPLAY];
+        size_t replay = kept < KOLIBRI_QUERY_REPLAY ? kept : KOLIBRI_QUERY_REPLAY;
+        for (size_t i = 0; i < replay; ++i) {
+            answers[i] = hits[i].content;
+        }
+        record_search_events(query, answers, replay);
+    }
+    for (size_t i = 0; i < peers; ++i) {
+        free(calls[i].response);
+    }
+    free(calls);
+    free(hits);
+}
+
+static KolibriRoute classify_route(const char *method, const char *path) {
+    if (strcmp(method, "GET") == 0) {
+        if (strcmp(path, "/healthz") == 0 || starts_with(path, "/api/knowledge/healthz")) {
+            return KOLIBRI_ROUTE_HEALTHZ;
+        }
+        if (strcmp(path, "/metrics") == 0 || starts_with(path, "/api/knowledge/metrics")) {
+            return KOLIBRI_ROUTE_METRICS;
+        }
+        if (starts_with(path, "/api/knowledge/search")) {
+            return KOLIBRI_ROUTE_SEARCH;
+        }
+        if (starts_with(path, "/api/knowledge/suggest")) {
+            return KOLIBRI_ROUTE_SUGGEST;
+        }
+        if (starts_with(path, "/api/knowledge/swarm")) {
+            return KOLIBRI_ROUTE_SWARM;
+        }
+    } else if (strcmp(method, "POST") == 0) {
+        if (strcmp(path, "/api/knowledge/feedback") == 0) {
+            return KOLIBRI_ROUTE_FEEDBACK;
+        }
+        if (strcmp(path, "/api/knowledge/teach") == 0) {
+            return KOLIBRI_ROUTE_TEACH;
+        }
+        if (strcmp(path, "/api/knowledge/reload") == 0) {
+            return KOLIBRI_ROUTE_RELOAD;
+        }
+    }
+    return KOLIBRI_ROUTE_OTHER;
+}
+
+static void response_append_histograms(KolibriConnection *conn,
+                                       const char *name,
+                                       const char *help,
+                                       const char *label,
+                                       const char *const *label_values,
+                                       KolibriLatencyHistogram *histograms,
+                                       size_t count) {
+    response_appendf(conn, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (size_t i = 0; i < count; ++i) {
+        KolibriLatencyHistogram *histogram = &histograms[i];
+        /* label may be NULL for a single unlabelled series. */
+        char pair[96] = "";
+        if (label) {
+            snprintf(pair, sizeof(pair), "%s=\"%s\"", label, label_values[i]);
+        }
+        unsigned long cumulative = 0UL;
+        for (size_t bucket = 0; bucket <= KOLIBRI_LATENCY_BOUNDS; ++bucket) {
+            cumulative += atomic_load_explicit(&histogram->buckets[bucket], memory_order_relaxed);
+            response_appendf(conn,
+                             "%s_bucket{%s%sle=\"%s\"} %lu\n",
+                             name,
+                             pair,
+                             label ? "," : "",
+                             bucket < KOLIBRI_LATENCY_BOUNDS ? kolibri_latency_labels[bucket] : "+Inf",
+                             cumulative);
+        }
+        /* Racing writers may leave _count a step apart from +Inf; scrapes tolerate that. */
+        double sum = (double)atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed) / 1e9;
+        response_appendf(conn,
+                         label ? "%s_sum{%s} %.6f\n%s_count{%s} %lu\n" : "%s_sum%s %.6f\n%s_count%s %lu\n",
+                         name,
+                         pair,
+                         sum,
+                         name,
+                         pair,
+                         atomic_load_explicit(&histogram->count, memory_order_relaxed));
+    }
+}
+
+static void handle_request(KolibriConnection *conn, size_t header_len, const KolibriServingIndex *serving) {
+    uint64_t parse_started = monotonic_ns();
+    const KolibriKnowledgeIndex *index = serving ? serving->index : NULL;
+    time_t index_timestamp = serving ? serving->timestamp : 0;
+    unsigned long index_generation = serving ? serving->generation : 0UL;
+    char *buffer = conn->in;
+    atomic_fetch_add(&kolibri_requests_total, 1U);
+
+    char *line_end = strstr(buffer, "\r\n");
+    if (!line_end) {
+        send_response(conn, 400, "application/json", "{\"error\":\"bad request\"}");
+        return;
+    }
+    *line_end = '\0';
+
+    char method[8];
+    char *method_end = strchr(buffer, ' ');
+    if (!method_end) {
+        send_response(conn, 400, "application/json", "{\"error\":\"bad request\"}");
+        return;
+    }
+    size_t method_len = (size_t)(method_end - buffer);
+    if (method_len >= sizeof(method)) {
+        method_len = sizeof(method) - 1U;
+    }
+    memcpy(method, buffer, method_len);
+    method[method_len] = '\0';
+
+    char *path_start = method_end + 1;
+    char *version_start = strchr(path_start, ' ');
+    if (!version_start) {
+        send_response(conn, 400, "application/json", "{\"error\":\"bad request\"}");
+        return;
+    }
+    *version_start = '\0';
+
+    const char *header_start = line_end + 2;
+    size_t header_bytes = header_len > (size_t)(header_start - buffer) ? header_len - (size_t)(header_start - buffer) : 0U;
     const char *body = buffer + header_len;
 
-    size_t document_count = index ? kolibri_knowledge_index_document_count(index) : 0U;
+    size_t document_count = index ? kolibri_knowledge_index_document_count(index) : 0U;
+    conn->route = classify_route(method, path_start);
+    if (conn->route != KOLIBRI_ROUTE_SEARCH) {
+        record_phase(KOLIBRI_PHASE_PARSE, parse_started);
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_HEALTHZ) {
+        char generated_iso[64];
+        char bootstrap_iso[64];
+        char generated_field[72];
+        char bootstrap_field[72];
+        if (format_iso8601_utc(index_timestamp, generated_iso, sizeof(generated_iso)) == 0) {
+            snprintf(generated_field, sizeof(generated_field), "\"%s\"", generated_iso);
+        } else {
+            strcpy(generated_field, "null");
+        }
+        if (format_iso8601_utc((time_t)atomic_load(&kolibri_bootstrap_timestamp), bootstrap_iso, sizeof(bootstrap_iso)) == 0) {
+            snprintf(bootstrap_field, sizeof(bootstrap_field), "\"%s\"", bootstrap_iso);
+        } else {
+            strcpy(bootstrap_field, "null");
+        }
+        double uptime = 0.0;
+        if (kolibri_server_started_at > 0) {
+            uptime = difftime(time(NULL), kolibri_server_started_at);
+            if (uptime < 0.0) {
+                uptime = 0.0;
+            }
+        }
+        response_begin(conn);
+        response_stream(conn, 200, "application/json");
+        response_appendf(conn,
+                         "{\"status\":\"ok\",\"documents\":%zu,\"generatedAt\":%s,\"bootstrapGeneratedAt\":%s,"
+                         "\"requests\":%zu,\"hits\":%zu,\"misses\":%zu,\"uptimeSeconds\":%.0f,\"keyOrigin\":",
+                         document_count,
+                         generated_field,
+                         bootstrap_field,
+                         atomic_load(&kolibri_requests_total),
+                         atomic_load(&kolibri_search_hits),
+                         atomic_load(&kolibri_search_misses),
+                         uptime);
+        if (kolibri_hmac_key_origin[0] != '\0') {
+            response_append(conn, "\"", 1U);
+            response_append_json(conn, kolibri_hmac_key_origin);
+            response_append(conn, "\"", 1U);
+        } else {
+            response_append(conn, "null", 4U);
+        }
+        response_append(conn, ",\"indexRoots\":", 14U);
+        response_append_directories(conn);
+        response_append(conn, ",\"indexSource\":\"", 16U);
+        response_append_json(conn, serving ? serving->source : "none");
+        response_append(conn, "\",\"indexCache\":\"", 16U);
+        response_append_json(conn, kolibri_index_cache_dir);
+        response_appendf(conn,
+                         "\",\"indexGeneration\":%lu,\"reloading\":%s,"
+                         "\"warmTraining\":{\"state\":\"%s\",\"trained\":%zu,\"documents\":%zu,\"indexGeneration\":%lu}}",
+                         index_generation,
+                         atomic_load(&kolibri_reload_active) ? "true" : "false",
+                         kolibri_warm_state_names[atomic_load(&kolibri_warm.state)],
+                         atomic_load(&kolibri_warm.trained),
+                         atomic_load(&kolibri_warm.total),
+                         atomic_load(&kolibri_warm.generation));
+        if (conn->failed) {
+            return;
+        }
+        response_finish(conn, 200, "application/json");
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_METRICS) {
+        long long bootstrap_timestamp = atomic_load(&kolibri_bootstrap_timestamp);
+        double bootstrap_generated = bootstrap_timestamp > 0 ? (double)bootstrap_timestamp : 0.0;
+        double index_generated = index_timestamp > 0 ? (double)index_timestamp : 0.0;
+        double uptime = 0.0;
+        if (kolibri_server_started_at > 0) {
+            uptime = difftime(time(NULL), kolibri_server_started_at);
+            if (uptime < 0.0) {
+                uptime = 0.0;
+            }
+        }
+        response_begin(conn);
+        response_appendf(conn,
+                         "# HELP kolibri_knowledge_documents Number of documents in knowledge index\n"
+                         "# TYPE kolibri_knowledge_documents gauge\n"
+                         "kolibri_knowledge_documents %zu\n"
+                         "# HELP kolibri_requests_total Total HTTP requests handled\n"
+                         "# TYPE kolibri_requests_total counter\n"
+                         "kolibri_requests_total %zu\n"
+                         "# HELP kolibri_search_hits_success Total search queries with results\n"
+                         "# TYPE kolibri_search_hits_success counter\n"
+                         "kolibri_search_hits_success %zu\n"
+                         "# HELP kolibri_search_misses_total Total search queries without results\n"
+                         "# TYPE kolibri_search_misses_total counter\n"
+                         "kolibri_search_misses_total %zu\n"
+                         "# HELP kolibri_bootstrap_generated_unixtime Timestamp of last bootstrap script generation\n"
+                         "# TYPE kolibri_bootstrap_generated_unixtime gauge\n"
+                         "kolibri_bootstrap_generated_unixtime %.0f\n"
+                         "# HELP kolibri_knowledge_generated_unixtime Timestamp of last knowledge index build\n"
+                         "# TYPE kolibri_knowledge_generated_unixtime gauge\n"
+                         "kolibri_knowledge_generated_unixtime %.0f\n"
+                         "# HELP kolibri_knowledge_uptime_seconds Knowledge server uptime\n"
+                         "# TYPE kolibri_knowledge_uptime_seconds gauge\n"
+                         "kolibri_knowledge_uptime_seconds %.0f\n"
+                         "# HELP kolibri_knowledge_key_length_bytes Length of configured HMAC key\n"
+                         "# TYPE kolibri_knowledge_key_length_bytes gauge\n"
+                         "kolibri_knowledge_key_length_bytes %zu\n"
+                         "# HELP kolibri_knowledge_directories_total Number of knowledge directories\n"
+                         "# TYPE kolibri_knowledge_directories_total gauge\n"
+                         "kolibri_knowledge_directories_total %zu\n",
+                         document_count,
+                         atomic_load(&kolibri_requests_total),
+                         atomic_load(&kolibri_search_hits),
+                         atomic_load(&kolibri_search_misses),
+                         bootstrap_generated,
+                         index_generated,
+                         uptime,
+                         kolibri_hmac_key_len,
+                         kolibri_knowledge_directory_count);
+        for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
+            char label[256];
+            prometheus_escape_label(kolibri_knowledge_directories[i], label, sizeof(label));
+            response_appendf(conn, "kolibri_knowledge_directory_info{path=\"%s\"} 1\n", label);
+        }
+        if (kolibri_hmac_key_origin[0] != '\0') {
+            char origin_label[256];
+            prometheus_escape_label(kolibri_hmac_key_origin, origin_label, sizeof(origin_label));
+            response_appendf(conn, "kolibri_knowledge_hmac_key_info{origin=\"%s\"} 1\n", origin_label);
+        }
+        pthread_mutex_lock(&kolibri_query_cache.lock);
+        size_t cache_entries = kolibri_query_cache.count;
+        size_t cache_hits = kolibri_query_cache.hits;
+        size_t cache_misses = kolibri_query_cache.misses;
+        size_t cache_evictions = kolibri_query_cache.evictions;
+        pthread_mutex_unlock(&kolibri_query_cache.lock);
+        response_appendf(conn,
+                         "# HELP kolibri_search_cache_entries Cached search responses\n"
+                         "# TYPE kolibri_search_cache_entries gauge\n"
+                         "kolibri_search_cache_entries %zu\n"
+                         "# HELP kolibri_search_cache_capacity Maximum cached search responses\n"
+                         "# TYPE kolibri_search_cache_capacity gauge\n"
+                         "kolibri_search_cache_capacity %zu\n"
+                         "# HELP kolibri_search_cache_hits_total Search requests answered from cache\n"
+                         "# TYPE kolibri_search_cache_hits_total counter\n"
+                         "kolibri_search_cache_hits_total %zu\n"
+                         "# HELP kolibri_search_cache_misses_total Search requests that ran the index\n"
+                         "# TYPE kolibri_search_cache_misses_total counter\n"
+                         "kolibri_search_cache_misses_total %zu\n"
+                         "# HELP kolibri_search_cache_evictions_total Cached responses evicted by LRU\n"
+                         "# TYPE kolibri_search_cache_evictions_total counter\n"
+                         "kolibri_search_cache_evictions_total %zu\n"
+                         "# HELP kolibri_knowledge_index_generation Generation of the serving index\n"
+                         "# TYPE kolibri_knowledge_index_generation gauge\n"
+                         "kolibri_knowledge_index_generation %lu\n"
+                         "# HELP kolibri_warm_training_documents Documents of the snapshot under warm training\n"
+                         "# TYPE kolibri_warm_training_documents gauge\n"
+                         "kolibri_warm_training_documents %zu\n"
+                         "# HELP kolibri_warm_training_trained Documents already fed to the server pool\n"
+                         "# TYPE kolibri_warm_training_trained gauge\n"
+                         "kolibri_warm_training_trained %zu\n",
+                         cache_entries,
+                         kolibri_query_cache_capacity,
+                         cache_hits,
+                         cache_misses,
+                         cache_evictions,
+                         index_generation,
+                         atomic_load(&kolibri_warm.total),
+                         atomic_load(&kolibri_warm.trained));
+        response_appendf(conn,
+                         "# HELP kolibri_shard_requests_total Searches sent to shard peers\n"
+                         "# TYPE kolibri_shard_requests_total counter\n"
+                         "kolibri_shard_requests_total %zu\n"
+                         "# HELP kolibri_shard_failures_total Shard searches that failed or missed the deadline\n"
+                         "# TYPE kolibri_shard_failures_total counter\n"
+                         "kolibri_shard_failures_total %zu\n"
+                         "# HELP kolibri_shard_partial_total Coordinated searches answered without every shard\n"
+                         "# TYPE kolibri_shard_partial_total counter\n"
+                         "kolibri_shard_partial_total %zu\n",
+                         atomic_load(&kolibri_shard_requests),
+                         atomic_load(&kolibri_shard_failures),
+                         atomic_load(&kolibri_shard_partial));
+        response_appendf(conn,
+                         "# HELP kolibri_rate_limited_total Requests rejected by the per-client rate limiter\n"
+                         "# TYPE kolibri_rate_limited_total counter\n"
+                         "kolibri_rate_limited_total{route=\"feedback\"} %zu\n"
+                         "kolibri_rate_limited_total{route=\"teach\"} %zu\n",
+                         atomic_load(&kolibri_feedback_rate.rejected),
+                         atomic_load(&kolibri_teach_rate.rejected));
+        response_appendf(conn,
+                         "# HELP kolibri_http_not_modified_total Cacheable responses answered 304 by If-None-Match\n"
+                         "# TYPE kolibri_http_not_modified_total counter\n"
+                         "kolibri_http_not_modified_total %zu\n"
+                         "# HELP kolibri_http_compressed_responses_total Bodies sent with a gzip or deflate coding\n"
+                         "# TYPE kolibri_http_compressed_responses_total counter\n"
+                         "kolibri_http_compressed_responses_total %zu\n"
+                         "# HELP kolibri_http_compressions_total Bodies compressed; cached search codings are reused\n"
+                         "# TYPE kolibri_http_compressions_total counter\n"
+                         "kolibri_http_compressions_total %zu\n"
+                         "# HELP kolibri_keepalive_parked_connections Idle keep-alive sockets waiting without a worker\n"
+                         "# TYPE kolibri_keepalive_parked_connections gauge\n"
+                         "kolibri_keepalive_parked_connections %zu\n",
+                         atomic_load(&kolibri_not_modified_total),
+                         atomic_load(&kolibri_compressed_responses),
+                         atomic_load(&kolibri_compress_runs),
+                         atomic_load(&kolibri_keepalive_parked));
+        pthread_mutex_lock(&kolibri_genome_writer.lock);
+        size_t genome_depth = kolibri_genome_writer.count;
+        pthread_mutex_unlock(&kolibri_genome_writer.lock);
+        response_appendf(conn,
+                         "# HELP kolibri_genome_queue_depth Genome events waiting for the writer thread\n"
+                         "# TYPE kolibri_genome_queue_depth gauge\n"
+                         "kolibri_genome_queue_depth %zu\n"
+                         "# HELP kolibri_genome_queue_capacity Maximum queued genome events\n"
+                         "# TYPE kolibri_genome_queue_capacity gauge\n"
+                         "kolibri_genome_queue_capacity %u\n"
+                         "# HELP kolibri_genome_events_written_total Genome events appended by the writer\n"
+                         "# TYPE kolibri_genome_events_written_total counter\n"
+                         "kolibri_genome_events_written_total %zu\n"
+                         "# HELP kolibri_genome_append_errors_total Genome appends that failed\n"
+                         "# TYPE kolibri_genome_append_errors_total counter\n"
+                         "kolibri_genome_append_errors_total %zu\n"
+                         "# HELP kolibri_genome_events_dropped_total Search events dropped on a full genome queue\n"
+                         "# TYPE kolibri_genome_events_dropped_total counter\n"
+                         "kolibri_genome_events_dropped_total %zu\n",
+                         genome_depth,
+                         KOLIBRI_GENOME_QUEUE,
+                         atomic_load(&kolibri_genome_events_written),
+                         atomic_load(&kolibri_genome_append_errors),
+                         atomic_load(&kolibri_genome_events_dropped));
+        response_append_histograms(conn,
+                                   "kolibri_genome_flush_duration_seconds",
+                                   "Time the writer spends appending one batch",
+                                   NULL,
+                                   NULL,
+                                   &kolibri_genome_flush_latency,
+                                   1U);
+        response_append_histograms(conn,
+                                   "kolibri_http_request_duration_seconds",
+                                   "Time from a framed request to its response reaching the socket",
+                                   "route",
+                                   kolibri_route_names,
+                                   kolibri_route_latency,
+                                   KOLIBRI_ROUTE_COUNT);
+        response_append_histograms(conn,
+                                   "kolibri_http_phase_duration_seconds",
+                                   "Request time spent per processing phase",
+                                   "phase",
+                                   kolibri_phase_names,
+                                   kolibri_phase_latency,
+                                   KOLIBRI_PHASE_COUNT);
+        response_finish(conn, 200, "text/plain; version=0.0.4");
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_FEEDBACK) {
+        int auth_status = require_admin_token(header_start, header_bytes);
+        if (auth_status != 0) {
+            if (auth_status == 503) {
+                send_response(conn, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+            } else if (auth_status == 401) {
+                send_response(conn, 401, "application/json", "{\"error\":\"unauthorized\"}");
+            } else {
+                send_response(conn, 403, "application/json", "{\"error\":\"forbidden\"}");
+            }
+            return;
+        }
+        if (!rate_limiter_allow(&kolibri_feedback_rate, conn->peer_addr, KOLIBRI_RATE_LIMIT_BURST)) {
+            send_response(conn, 429, "application/json", "{\"error\":\"rate limited\"}");
+            return;
+        }
+        char rating[64];
+        char question[512];
+        char answer[512];
+        parse_form_field(body, "rating", rating, sizeof(rating));
+        parse_form_field(body, "q", question, sizeof(question));
+        parse_form_field(body, "a", answer, sizeof(answer));
+        char decoded_q[512];
+        char decoded_a[512];
+        strncpy(decoded_q, question, sizeof(decoded_q) - 1U);
+        decoded_q[sizeof(decoded_q) - 1U] = '\0';
+        strncpy(decoded_a, answer, sizeof(decoded_a) - 1U);
+        decoded_a[sizeof(decoded_a) - 1U] = '\0';
+        url_decode(decoded_q);
+        url_decode(decoded_a);
+        const char *rating_value = rating[0] ? rating : "unknown";
+        char payload[512];
+        snprintf(payload,
+                 sizeof(payload),
+                 "rating=%.*s q=%.*s a=%.*s",
+                 64,
+                 rating_value,
+                 192,
+                 decoded_q,
+                 192,
+                 decoded_a);
+        knowledge_wait_durable(knowledge_record_event("USER_FEEDBACK", payload, 1));
+        send_response(conn, 200, "application/json", "{\"status\":\"ok\"}");
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_TEACH) {
+        int auth_status = require_admin_token(header_start, header_bytes);
+        if (auth_status != 0) {
+            if (auth_status == 503) {
+                send_response(conn, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+            } else if (auth_status == 401) {
+                send_response(conn, 401, "application/json", "{\"error\":\"unauthorized\"}");
+            } else {
+                send_response(conn, 403, "application/json", "{\"error\":\"forbidden\"}");
+            }
+            return;
+        }
+        if (!rate_limiter_allow(&kolibri_teach_rate, conn->peer_addr, KOLIBRI_RATE_LIMIT_BURST)) {
+            send_response(conn, 429, "application/json", "{\"error\":\"rate limited\"}");
+            return;
+        }
+        char question[512];
+        char answer[512];
+        parse_form_field(body, "q", question, sizeof(question));
+        parse_form_field(body, "a", answer, sizeof(answer));
+        if (question[0] == '\0' || answer[0] == '\0') {
+            send_response(conn, 400, "application/json", "{\"error\":\"missing q or a\"}");
+            return;
+        }
+        char payload[512];
+        snprintf(payload, sizeof(payload), "q=%.*s a=%.*s", 200, question, 200, answer);
+        knowledge_wait_durable(knowledge_record_event("TEACH", payload, 1));
+        send_response(conn, 200, "application/json", "{\"status\":\"ok\"}");
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_RELOAD) {
+        int auth_status = require_admin_token(header_start, header_bytes);
+        if (auth_status != 0) {
+            if (auth_status == 503) {
+                send_response(conn, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+            } else if (auth_status == 401) {
+                send_response(conn, 401, "application/json", "{\"error\":\"unauthorized\"}");
+            } else {
+                send_response(conn, 403, "application/json", "{\"error\":\"forbidden\"}");
+            }
+            return;
+        }
+        int reload_err = start_index_reload();
+        if (reload_err == EBUSY) {
+            send_response(conn, 409, "application/json", "{\"error\":\"reload in progress\"}");
+        } else if (reload_err != 0) {
+            send_response(conn, 500, "application/json", "{\"error\":\"reload failed\"}");
+        } else {
+            send_response(conn, 202, "application/json", "{\"status\":\"reloading\"}");
+        }
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_SWARM) {
+        if (!kolibri_swarm_ready) {
+            send_response(conn, 503, "application/json", "{\"error\":\"swarm disabled\"}");
+            return;
+        }
+        const char *params = strchr(path_start, '?');
+        int binary = params && (strstr(params, "?format=binary") || strstr(params, "&format=binary"));
+        const char *content_type = binary ? "application/octet-stream" : "application/json";
+        response_begin(conn);
+        conn->cacheable = 1;
+        response_stream(conn, 200, content_type);
+        if (binary) {
+            kolibri_swarm_export_binary(&kolibri_swarm, swarm_export_writer, conn);
+        } else {
+            kolibri_swarm_export_json(&kolibri_swarm, swarm_export_writer, conn);
+        }
+        if (conn->failed) {
+            return;
+        }
+        response_finish(conn, 200, content_type);
+        return;
+    }
+
+    if (conn->route == KOLIBRI_ROUTE_SUGGEST) {
+        char prefix[256];
+        size_t limit = 3U;
+        parse_query(path_start, prefix, sizeof(prefix), &limit);
+        if (limit > KOLIBRI_SUGGEST_LIMIT_MAX) {
+            limit = KOLIBRI_SUGGEST_LIMIT_MAX;
+        }
+        const char *suggestions[KOLIBRI_SUGGEST_LIMIT_MAX];
+        size_t suggestion_count = 0U;
+        if (index) {
+            uint64_t phase_started = monotonic_ns();
+            kolibri_knowledge_index_suggest(index, prefix, limit, suggestions, &suggestion_count);
+            record_phase(KOLIBRI_PHASE_SEARCH, phase_started);
+        }
+        response_begin(conn);
+        conn->cacheable = 1;
+        response_append(conn, "{\"prefix\":\"", 11U);
+        response_append_json(conn, prefix);
+        response_append(conn, "\",\"suggestions\":[", 17U);
+        for (size_t i = 0; i < suggestion_count; ++i) {
+            response_append(conn, i > 0U ? ",\"" : "\"", i > 0U ? 2U : 1U);
+            response_append_json(conn, suggestions[i]);
+            response_append(conn, "\"", 1U);
+        }
+        response_append(conn, "]}", 2U);
+        response_finish(conn, 200, "application/json");
+        return;
+    }
+
+    if (conn->route != KOLIBRI_ROUTE_SEARCH) {
+        send_response(conn, 404, "application/json", "{\"error\":\"not found\"}");
+        return;
+    }
+
+    char query[512];
+    size_t limit = 3U;
+    parse_query(path_start, query, sizeof(query), &limit);
+    const char *params = strchr(path_start, '?');
+    int shard_local = params && (strstr(params, "&local=1") || strncmp(params, "?local=1", 8U) == 0);
+    int fan_out = kolibri_shard_peer_count > 0U && !shard_local;
+    record_phase(KOLIBRI_PHASE_PARSE, parse_started);
+    if (!*query || (!index && !fan_out)) {
+        atomic_fetch_add(&kolibri_search_misses, 1U);
+        send_response(conn, 200, "application/json", "{\"snippets\":[]}");
+        return;
+    }
+    if (limit > KOLIBRI_SEARCH_LIMIT_MAX) {
+        limit = KOLIBRI_SEARCH_LIMIT_MAX;
+    }
+    /* Remote shards change behind the local generation, so nothing is cached. */
+    if (fan_out) {
+        sharded_search(conn, index, query, limit);
+        return;
+    }
+
+    size_t indices[KOLIBRI_SEARCH_LIMIT_MAX];
+    float scores[KOLIBRI_SEARCH_LIMIT_MAX];
+    size_t result_count = 0U;
+    char cache_key[sizeof(query) + 32U];
+    query_cache_key(query, limit, cache_key, sizeof(cache_key));
+    KolibriCachedQuery cached;
+    memset(&cached, 0, sizeof(cached));
+    if (query_cache_lookup(cache_key, index_generation, conn, &cached)) {
+        result_count = cached.result_count;
+        memcpy(indices, cached.replay, cached.replay_count * sizeof(indices[0]));
+    } else {
+        uint64_t phase_started = monotonic_ns();
+        int search_err = kolibri_knowledge_index_search(index, query, limit, indices, scores, &result_count);
+        record_phase(KOLIBRI_PHASE_SEARCH, phase_started);
+        if (search_err != 0) {
+            send_response(conn, 500, "application/json", "{\"error\":\"search failed\"}");
+            return;
+        }
+        phase_started = monotonic_ns();
+        build_search_response(conn, index, indices, scores, result_count);
+        conn->cacheable = 1;
+        record_phase(KOLIBRI_PHASE_SERIALIZE, phase_started);
+        cached.result_count = result_count;
+        cached.replay_count = result_count < KOLIBRI_QUERY_REPLAY ? result_count : KOLIBRI_QUERY_REPLAY;
+        memcpy(cached.replay, indices, cached.replay_count * sizeof(indices[0]));
+        /* A streamed answer already left in pieces; only whole bodies are cached. */
+        if (!conn->failed && !conn->streaming) {
+            query_cache_store(cache_key, conn->body, conn->body_len, &cached, index_generation);
+        }
+    }
+
+    if (result_count == 0U) {
+        atomic_fetch_add(&kolibri_search_misses, 1U);
+    } else {
+        atomic_fetch_add(&kolibri_search_hits, 1U);
+    }
+
+    response_finish(conn, 200, "application/json");
+    if (conn->packed_len > 0U) {
+        query_cache_attach(cache_key, index_generation, conn->packed_encoding, conn->packed, conn->packed_len);
+    }
+
+    /* The coordinator that asked a shard records the exchange itself. */
+    if (kolibri_genome_ready && !shard_local) {
+        const char *answers[KOLIBRI_QUERY_REPLAY];
+        size_t replay = 0U;
+        for (size_t i = 0; i < result_count && replay < KOLIBRI_QUERY_REPLAY; ++i) {
+            const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
+            if (doc) {
+                answers[replay++] = doc->content;
+            }
+        }
+        record_search_events(query, answers, replay);
+    }
+}
+
+static int connection_token_listed(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    const char *cursor = value;
+    while (*cursor) {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == ',') {
+            cursor++;
+        }
+        const char *end = cursor;
+        while (*end && *end != ',') {
+            end++;
+        }
+        const char *trimmed = end;
+        while (trimmed > cursor && (trimmed[-1] == ' ' || trimmed[-1] == '\t')) {
+            trimmed--;
+        }
+        if ((size_t)(trimmed - cursor) == token_len && strncasecmp(cursor, token, token_len) == 0) {
+            return 1;
+        }
+        cursor = end;
+    }
+    return 0;
+}
+
+static int request_is_http10(const char *request) {
+    const char *line_end = strstr(request, "\r\n");
+    return line_end && line_end - request >= 8 && strncmp(line_end - 8, "HTTP/1.0", 8) == 0;
+}
+
+static int request_wants_keep_alive(const char *request, size_t header_len) {
+    int http10 = request_is_http10(request);
+    char value[128];
+    if (extract_header_value(request, header_len, "Connection", value, sizeof(value)) == 0) {
+        if (connection_token_listed(value, "close")) {
+            return 0;
+        }
+        if (connection_token_listed(value, "keep-alive")) {
+            return 1;
+        }
+    }
+    return !http10;
+}
+
+/*
+ * Serves the framed request at the head of conn->in and shifts any
+ * pipelined bytes that follow it to the front of the buffer.
+ */
+static void connection_dispatch(KolibriConnection *conn,
+                                size_t header_len,
+                                size_t content_len) {
+    size_t consumed = header_len + content_len;
+    conn->keep_alive = kolibri_keepalive_timeout > 0U && conn->served + 1U < kolibri_keepalive_max &&
+                       request_wants_keep_alive(conn->in, header_len);
+    conn->chunked_ok = !request_is_http10(conn->in);
+    /* Terminate the body so form parsing cannot run into the next request. */
+    char saved = conn->in[consumed];
+    conn->in[consumed] = '\0';
+    uint64_t started = monotonic_ns();
+    if (conn->receive_started != 0U) {
+        latency_record(&kolibri_phase_latency[KOLIBRI_PHASE_RECEIVE], started - conn->receive_started);
+        KOLIBRI_TRACE_COMPLETE(kolibri_phase_spans[KOLIBRI_PHASE_RECEIVE], conn->receive_started, started);
+    }
+    conn->route = KOLIBRI_ROUTE_OTHER;
+    conn->send_ns = 0U;
+    char accept[128];
+    conn->accept_encoding = extract_header_value(conn->in, header_len, "Accept-Encoding", accept, sizeof(accept)) == 0
+                                ? negotiate_encoding(accept)
+                                : KOLIBRI_ENCODING_IDENTITY;
+    if (extract_header_value(conn->in, header_len, "If-None-Match", conn->if_none_match,
+                             sizeof(conn->if_none_match)) != 0) {
+        conn->if_none_match[0] = '\0';
+    }
+    conn->cacheable = 0;
+    conn->packed_len = 0U;
+    if (conn->packed_cap > KOLIBRI_RESPONSE_RETAIN) {
+        free(conn->packed);
+        conn->packed = NULL;
+        conn->packed_cap = 0U;
+    }
+    KolibriServingIndex *serving = serving_index_acquire();
+    handle_request(conn, header_len, serving);
+    serving_index_release(serving);
+    uint64_t finished = monotonic_ns();
+    latency_record(&kolibri_route_latency[conn->route], finished - started);
+    KOLIBRI_TRACE_COMPLETE(kolibri_route_spans[conn->route], started, finished);
+    latency_record(&kolibri_phase_latency[KOLIBRI_PHASE_SEND], conn->send_ns);
+    conn->in[consumed] = saved;
+    memmove(conn->in, conn->in + consumed, conn->in_len - consumed + 1U);
+    conn->in_len -= consumed;
+    /* Pipelined bytes already buffered start the next request's receive phase. */
+    conn->receive_started = conn->in_len > 0U ? finished : 0U;
+    conn->served += 1U;
+    conn->last_active = time(NULL);
+}
+
+/* A fixed send buffer bounds the kernel memory a slow reader can pin. */
+static void configure_client_socket(int client_fd) {
+    if (kolibri_client_sndbuf > 0U) {
+        int size = (int)kolibri_client_sndbuf;
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+}
+
+/*
+ * Serves requests on the socket until it closes. With `park` set it instead
+ * returns 1 as soon as a keep-alive connection goes idle, so the caller can
+ * park the socket rather than hold a worker waiting on it; `served` carries
+ * the request count across parking.
+ */
+static int handle_client(int client_fd, uint32_t peer_addr, size_t *served, int park) {
+    KolibriConnection conn;
+    connection_init(&conn, client_fd, peer_addr);
+    conn.served = *served;
+
+    struct timeval timeout;
+    timeout.tv_sec = KOLIBRI_REQUEST_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    for (;;) {
+        size_t header_len = 0U;
+        size_t content_len = 0U;
+        ssize_t total = receive_http_request(&conn, &header_len, &content_len);
+        if (total < 0) {
+            /* An idle keep-alive connection that goes quiet is closed silently. */
+            if (conn.served == 0U || conn.in_len > 0U || (total != -2 && total != -4)) {
+                atomic_fetch_add(&kolibri_requests_total, 1U);
+                respond_receive_error(&conn, total);
+                connection_flush(&conn);
+            }
+            break;
+        }
+        connection_dispatch(&conn, header_len, content_len);
+        /* 0 means the send timed out with part of the response still unsent. */
+        if (connection_flush(&conn) <= 0 || !conn.keep_alive) {
+            break;
+        }
+        if (park && conn.in_len == 0U) {
+            *served = conn.served;
+            connection_release(&conn);
+            return 1;
+        }
+        if (!park && conn.served == 1U) {
+            timeout.tv_sec = (time_t)kolibri_keepalive_timeout;
+            setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
+    }
+    connection_release(&conn);
+    return 0;
+}
+
+/*
+ * Event-loop mode: a single thread multiplexes every client socket through
+ * epoll (kqueue on BSD/macOS). Requests are framed incrementally into the
+ * per-connection buffer and responses resume when the socket is writable.
+ */
+typedef struct {
+    int fd;
+    int readable;
+    int writable;
+    int failed;
+} KolibriPollEvent;
+
+#if defined(KOLIBRI_HAVE_EPOLL)
+static int poller_open(void) {
+    return epoll_create1(EPOLL_CLOEXEC);
+}
+
+static int poller_watch(int poller, int fd, int want_write, int is_new) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (uint32_t)(want_write ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+    ev.data.fd = fd;
+    return epoll_ctl(poller, is_new ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void poller_forget(int poller, int fd) {
+    epoll_ctl(poller, EPOLL_CTL_DEL, fd, NULL);
+}
+
+static int poller_wait(int poller, KolibriPollEvent *events, int capacity, int timeout_ms) {
+    struct epoll_event raw[KOLIBRI_EVENT_BATCH];
+    if (capacity > KOLIBRI_EVENT_BATCH) {
+        capacity = KOLIBRI_EVENT_BATCH;
+    }
+    int count = epoll_wait(poller, raw, capacity, timeout_ms);
+    for (int i = 0; i < count; ++i) {
+        events[i].fd = raw[i].data.fd;
+        events[i].readable = (raw[i].events & (EPOLLIN | EPOLLRDHUP)) != 0;
+        events[i].writable = (raw[i].events & EPOLLOUT) != 0;
+        events[i].failed = (raw[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+    }
+    return count;
+}
+#elif defined(KOLIBRI_HAVE_KQUEUE)
+static int poller_open(void) {
+    return kqueue();
+}
+
+static int poller_watch(int poller, int fd, int want_write, int is_new) {
+    struct kevent changes[2];
+    int count = 0;
+    if (want_write) {
+        EV_SET(&changes[count++], fd, EVFILT_READ, EV_DISABLE, 0, 0, NULL);
+        EV_SET(&changes[count++], fd, EVFILT_WRITE, EV_ADD | EV_ENABLE, 0, 0, NULL);
+    } else {
+        EV_SET(&changes[count++], fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+        if (!is_new) {
+            EV_SET(&changes[count++], fd, EVFILT_WRITE, EV_DISABLE, 0, 0, NULL);
+        }
+    }
+    return kevent(poller, changes, count, NULL, 0, NULL);
+}
 
-    if (strcmp(method, "GET") == 0 &&
-        (strcmp(path_start, "/healthz") == 0 || starts_with(path_start, "/api/knowledge/healthz"))) {
-        char generated_iso[64];
-        char bootstrap_iso[64];
-        char generated_field[72];
-        char bootstrap_field[72];
-        if (format_iso8601_utc(kolibri_index_timestamp, generated_iso, sizeof(generated_iso)) == 0) {
-            snprintf(generated_field, sizeof(generated_field), "\"%s\"", generated_iso);
-        } else {
-            strcpy(generated_field, "null");
+static void poller_forget(int poller, int fd) {
+    /* kqueue drops the write filter of a closed descriptor on its own; the
+     * read filter goes explicitly for sockets the keep-alive park hands on. */
+    struct kevent change;
+    EV_SET(&change, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    (void)kevent(poller, &change, 1, NULL, 0, NULL);
+}
+
+static int poller_wait(int poller, KolibriPollEvent *events, int capacity, int timeout_ms) {
+    struct kevent raw[KOLIBRI_EVENT_BATCH];
+    if (capacity > KOLIBRI_EVENT_BATCH) {
+        capacity = KOLIBRI_EVENT_BATCH;
+    }
+    struct timespec timeout = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    int count = kevent(poller, NULL, 0, raw, capacity, &timeout);
+    for (int i = 0; i < count; ++i) {
+        events[i].fd = (int)raw[i].ident;
+        events[i].readable = raw[i].filter == EVFILT_READ;
+        events[i].writable = raw[i].filter == EVFILT_WRITE;
+        events[i].failed = (raw[i].flags & EV_ERROR) != 0;
+    }
+    return count;
+}
+#endif
+
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+typedef struct {
+    int poller;
+    KolibriConnection **slots;
+    size_t slot_count;
+    size_t open_count;
+} KolibriEventLoop;
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void event_loop_close(KolibriEventLoop *loop, KolibriConnection *conn) {
+    poller_forget(loop->poller, conn->fd);
+    if ((size_t)conn->fd < loop->slot_count) {
+        loop->slots[conn->fd] = NULL;
+    }
+    close(conn->fd);
+    connection_release(conn);
+    free(conn);
+    loop->open_count -= 1U;
+}
+
+static int event_loop_track(KolibriEventLoop *loop, int fd, uint32_t peer_addr) {
+    if ((size_t)fd >= loop->slot_count) {
+        size_t count = loop->slot_count ? loop->slot_count : 64U;
+        while (count <= (size_t)fd) {
+            count *= 2U;
         }
-        if (format_iso8601_utc(kolibri_bootstrap_timestamp, bootstrap_iso, sizeof(bootstrap_iso)) == 0) {
-            snprintf(bootstrap_field, sizeof(bootstrap_field), "\"%s\"", bootstrap_iso);
-        } else {
-            strcpy(bootstrap_field, "null");
+        KolibriConnection **slots = realloc(loop->slots, count * sizeof(*slots));
+        if (!slots) {
+            return -1;
         }
-        double uptime = 0.0;
-        if (kolibri_server_started_at > 0) {
-            uptime = difftime(time(NULL), kolibri_server_started_at);
-            if (uptime < 0.0) {
-                uptime = 0.0;
+        memset(slots + loop->slot_count, 0, (count - loop->slot_count) * sizeof(*slots));
+        loop->slots = slots;
+        loop->slot_count = count;
+    }
+    KolibriConnection *conn = (KolibriConnection *)malloc(sizeof(*conn));
+    if (!conn) {
+        return -1;
+    }
+    connection_init(conn, fd, peer_addr);
+    if (poller_watch(loop->poller, fd, 0, 1) != 0) {
+        free(conn);
+        return -1;
+    }
+    loop->slots[fd] = conn;
+    loop->open_count += 1U;
+    return 0;
+}
+
+static void event_loop_accept(KolibriEventLoop *loop, int server_fd) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
             }
+            return;
         }
-        char directories_json[512];
-        build_directories_json(directories_json, sizeof(directories_json));
-        if (directories_json[0] == '\0') {
-            strncpy(directories_json, "[]", sizeof(directories_json) - 1U);
-            directories_json[sizeof(directories_json) - 1U] = '\0';
+        configure_client_socket(client_fd);
+        if (loop->open_count >= KOLIBRI_EVENT_MAX_CONNECTIONS || set_nonblocking(client_fd) != 0 ||
+            event_loop_track(loop, client_fd, client_addr.sin_addr.s_addr) != 0) {
+            close(client_fd);
         }
-        char key_origin_field[256];
-        if (kolibri_hmac_key_origin[0] != '\0') {
-            char escaped_origin[192];
-            json_escape(kolibri_hmac_key_origin, escaped_origin, sizeof(escaped_origin));
-            snprintf(key_origin_field, sizeof(key_origin_field), "\"%s\"", escaped_origin);
-        } else {
-            strcpy(key_origin_field, "null");
-        }
-        char escaped_source[128];
-        json_escape(kolibri_index_source, escaped_source, sizeof(escaped_source));
-        char escaped_cache[256];
-        json_escape(kolibri_index_cache_dir, escaped_cache, sizeof(escaped_cache));
-        char body_json[1280];
-        int len = snprintf(body_json,
-                           sizeof(body_json),
-                           "{\"status\":\"ok\",\"documents\":%zu,\"generatedAt\":%s,\"bootstrapGeneratedAt\":%s,"
-                           "\"requests\":%zu,\"hits\":%zu,\"misses\":%zu,\"uptimeSeconds\":%.0f,\"keyOrigin\":%s,\"indexRoots\":%s,\"indexSource\":\"%s\",\"indexCache\":\"%s\"}",
-                           document_count,
-                           generated_field,
-                           bootstrap_field,
-                           kolibri_requests_total,
-                           kolibri_search_hits,
-                           kolibri_search_misses,
-                           uptime,
-                           key_origin_field,
-                           directories_json,
-                           escaped_source,
-                           escaped_cache);
-        if (len < 0 || (size_t)len >= sizeof(body_json)) {
-            send_response(client_fd, 500, "application/json", "{\"error\":\"internal\"}");
+    }
+}
+
+/* Switches the connection to writing; closes it once the response is out. */
+static void event_loop_write(KolibriEventLoop *loop, KolibriConnection *conn) {
+    conn->last_active = time(NULL);
+    int flushed = connection_flush(conn);
+    if (flushed < 0 || (flushed > 0 && !conn->keep_alive)) {
+        event_loop_close(loop, conn);
+        return;
+    }
+    int want_write = flushed == 0;
+    if (want_write != conn->watching_write) {
+        if (poller_watch(loop->poller, conn->fd, want_write, 0) != 0) {
+            event_loop_close(loop, conn);
             return;
         }
-        send_response(client_fd, 200, "application/json", body_json);
-        return;
+        conn->watching_write = want_write;
     }
+}
 
-    if (strcmp(method, "GET") == 0 &&
-        (strcmp(path_start, "/metrics") == 0 || starts_with(path_start, "/api/knowledge/metrics"))) {
-        double bootstrap_generated = kolibri_bootstrap_timestamp > 0 ? (double)kolibri_bootstrap_timestamp : 0.0;
-        double index_generated = kolibri_index_timestamp > 0 ? (double)kolibri_index_timestamp : 0.0;
-        double uptime = 0.0;
-        if (kolibri_server_started_at > 0) {
-            uptime = difftime(time(NULL), kolibri_server_started_at);
-            if (uptime < 0.0) {
-                uptime = 0.0;
+static void event_loop_read(KolibriEventLoop *loop, KolibriConnection *conn) {
+    for (;;) {
+        size_t header_len = 0U;
+        size_t content_len = 0U;
+        int framed = frame_http_request(conn, &header_len, &content_len);
+        if (framed == 0) {
+            connection_dispatch(conn, header_len, content_len);
+            if (conn->keep_alive && conn->in_len > 0U) {
+                /* Answer every pipelined request already buffered. */
+                continue;
             }
+            event_loop_write(loop, conn);
+            return;
         }
-        char body_metrics[4096];
-        int len = snprintf(body_metrics,
-                           sizeof(body_metrics),
-                           "# HELP kolibri_knowledge_documents Number of documents in knowledge index\n"
-                           "# TYPE kolibri_knowledge_documents gauge\n"
-                           "kolibri_knowledge_documents %zu\n"
-                           "# HELP kolibri_requests_total Total HTTP requests handled\n"
-                           "# TYPE kolibri_requests_total counter\n"
-                           "kolibri_requests_total %zu\n"
-                           "# HELP kolibri_search_hits_success Total search queries with results\n"
-                           "# TYPE kolibri_search_hits_success counter\n"
-                           "kolibri_search_hits_success %zu\n"
-                           "# HELP kolibri_search_misses_total Total search queries without results\n"
-                           "# TYPE kolibri_search_misses_total counter\n"
-                           "kolibri_search_misses_total %zu\n"
-                           "# HELP kolibri_bootstrap_generated_unixtime Timestamp of last bootstrap script generation\n"
-                           "# TYPE kolibri_bootstrap_generated_unixtime gauge\n"
-                           "kolibri_bootstrap_generated_unixtime %.0f\n"
-                           "# HELP kolibri_knowledge_generated_unixtime Timestamp of last knowledge index build\n"
-                           "# TYPE kolibri_knowledge_generated_unixtime gauge\n"
-                           "kolibri_knowledge_generated_unixtime %.0f\n"
-                           "# HELP kolibri_knowledge_uptime_seconds Knowledge server uptime\n"
-                           "# TYPE kolibri_knowledge_uptime_seconds gauge\n"
-                           "kolibri_knowledge_uptime_seconds %.0f\n"
-                           "# HELP kolibri_knowledge_key_length_bytes Length of configured HMAC key\n"
-                           "# TYPE kolibri_knowledge_key_length_bytes gauge\n"
-                           "kolibri_knowledge_key_length_bytes %zu\n"
-                           "# HELP kolibri_knowledge_directories_total Number of knowledge directories\n"
-                           "# TYPE kolibri_knowledge_directories_total gauge\n"
-                           "kolibri_knowledge_directories_total %zu\n",
-                           document_count,
-                           kolibri_requests_total,
-                           kolibri_search_hits,
-                           kolibri_search_misses,
-                           bootstrap_generated,
-                           index_generated,
-                           uptime,
-                           kolibri_hmac_key_len,
-                           kolibri_knowledge_directory_count);
-        if (len < 0) {
-            send_response(client_fd, 500, "text/plain", "error");
+        if (framed < 0) {
+            atomic_fetch_add(&kolibri_requests_total, 1U);
+            respond_receive_error(conn, framed);
+            event_loop_write(loop, conn);
             return;
         }
-        size_t offset = (size_t)len;
-        for (size_t i = 0; i < kolibri_knowledge_directory_count && offset < sizeof(body_metrics); ++i) {
-            char label[256];
-            prometheus_escape_label(kolibri_knowledge_directories[i], label, sizeof(label));
-            int written = snprintf(body_metrics + offset,
-                                   sizeof(body_metrics) - offset,
-                                   "kolibri_knowledge_directory_info{path=\"%s\"} 1\n",
-                                   label);
-            if (written < 0 || (size_t)written >= sizeof(body_metrics) - offset) {
-                send_response(client_fd, 500, "text/plain", "error");
-                return;
-            }
-            offset += (size_t)written;
+        if (conn->out_len > 0U) {
+            event_loop_write(loop, conn);
+            return;
         }
-        if (kolibri_hmac_key_origin[0] != '\0') {
-            char origin_label[256];
-            prometheus_escape_label(kolibri_hmac_key_origin, origin_label, sizeof(origin_label));
-            int written = snprintf(body_metrics + offset,
-                                   sizeof(body_metrics) - offset,
-                                   "kolibri_knowledge_hmac_key_info{origin=\"%s\"} 1\n",
-                                   origin_label);
-            if (written < 0 || (size_t)written >= sizeof(body_metrics) - offset) {
-                send_response(client_fd, 500, "text/plain", "error");
-                return;
+        ssize_t received = recv(conn->fd, conn->in + conn->in_len, sizeof(conn->in) - 1U - conn->in_len, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            offset += (size_t)written;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                event_loop_close(loop, conn);
+            }
+            return;
         }
-        send_response(client_fd, 200, "text/plain; version=0.0.4", body_metrics);
-        return;
-    }
-
-    if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/feedback") == 0) {
-        int auth_status = require_admin_token(header_start, header_bytes);
-        if (auth_status != 0) {
-            if (auth_status == 503) {
-                send_response(client_fd, 503, "application/json", "{\"error\":\"admin token not configured\"}");
-            } else if (auth_status == 401) {
-                send_response(client_fd, 401, "application/json", "{\"error\":\"unauthorized\"}");
+        if (received == 0) {
+            if (conn->in_len == 0U) {
+                /* Orderly close, including after the last keep-alive response. */
+                event_loop_close(loop, conn);
             } else {
-                send_response(client_fd, 403, "application/json", "{\"error\":\"forbidden\"}");
+                atomic_fetch_add(&kolibri_requests_total, 1U);
+                respond_receive_error(conn, -4);
+                event_loop_write(loop, conn);
             }
             return;
         }
-        time_t now = time(NULL);
-        if (!rate_limiter_allow(&kolibri_feedback_rate, now, KOLIBRI_RATE_LIMIT_BURST)) {
-            send_response(client_fd, 429, "application/json", "{\"error\":\"rate limited\"}");
-            return;
+        if (conn->in_len == 0U) {
+            conn->receive_started = monotonic_ns();
         }
-        char rating[64];
-        char question[512];
-        char answer[512];
-        parse_form_field(body, "rating", rating, sizeof(rating));
-        parse_form_field(body, "q", question, sizeof(question));
-        parse_form_field(body, "a", answer, sizeof(answer));
-        char decoded_q[512];
-        char decoded_a[512];
-        strncpy(decoded_q, question, sizeof(decoded_q) - 1U);
-        decoded_q[sizeof(decoded_q) - 1U] = '\0';
-        strncpy(decoded_a, answer, sizeof(decoded_a) - 1U);
-        decoded_a[sizeof(decoded_a) - 1U] = '\0';
-        url_decode(decoded_q);
-        url_decode(decoded_a);
-        const char *rating_value = rating[0] ? rating : "unknown";
-        char payload[512];
-        snprintf(payload,
-                 sizeof(payload),
-                 "rating=%.*s q=%.*s a=%.*s",
-                 64,
-                 rating_value,
-                 192,
-                 decoded_q,
-                 192,
-                 decoded_a);
-        knowledge_record_event("USER_FEEDBACK", payload);
-        send_response(client_fd, 200, "application/json", "{\"status\":\"ok\"}");
-        return;
+        conn->in_len += (size_t)received;
+        conn->in[conn->in_len] = '\0';
+        conn->last_active = time(NULL);
     }
+}
 
-    if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/teach") == 0) {
-        int auth_status = require_admin_token(header_start, header_bytes);
-        if (auth_status != 0) {
-            if (auth_status == 503) {
-                send_response(client_fd, 503, "application/json", "{\"error\":\"admin token not configured\"}");
-            } else if (auth_status == 401) {
-                send_response(client_fd, 401, "application/json", "{\"error\":\"unauthorized\"}");
-            } else {
-                send_response(client_fd, 403, "application/json", "{\"error\":\"forbidden\"}");
+static void event_loop_expire(KolibriEventLoop *loop, time_t now) {
+    for (size_t fd = 0; fd < loop->slot_count; ++fd) {
+        KolibriConnection *conn = loop->slots[fd];
+        if (!conn) {
+            continue;
+        }
+        int idle = conn->served > 0U && conn->in_len == 0U && conn->out_len == 0U;
+        time_t limit = idle ? (time_t)kolibri_keepalive_timeout : KOLIBRI_REQUEST_TIMEOUT;
+        if (now - conn->last_active < limit) {
+            continue;
+        }
+        if (idle || conn->out_len > 0U) {
+            /* Idle keep-alive, or the peer stopped reading its response. */
+            event_loop_close(loop, conn);
+            continue;
+        }
+        atomic_fetch_add(&kolibri_requests_total, 1U);
+        respond_receive_error(conn, -2);
+        event_loop_write(loop, conn);
+    }
+}
+
+static int run_event_loop(int server_fd) {
+    KolibriEventLoop loop;
+    memset(&loop, 0, sizeof(loop));
+    loop.poller = poller_open();
+    if (loop.poller < 0) {
+        perror("[kolibri-knowledge] event poller");
+        return -1;
+    }
+    if (set_nonblocking(server_fd) != 0 || poller_watch(loop.poller, server_fd, 0, 1) != 0) {
+        perror("[kolibri-knowledge] watch listener");
+        close(loop.poller);
+        return -1;
+    }
+    KolibriPollEvent events[KOLIBRI_EVENT_BATCH];
+    time_t last_sweep = time(NULL);
+    while (kolibri_server_running) {
+        int count = poller_wait(loop.poller, events, KOLIBRI_EVENT_BATCH, 1000);
+        if (count < 0 && errno != EINTR) {
+            perror("[kolibri-knowledge] event wait");
+            break;
+        }
+        poll_reload_request();
+        for (int i = 0; i < count; ++i) {
+            if (events[i].fd == server_fd) {
+                event_loop_accept(&loop, server_fd);
+                continue;
+            }
+            if (events[i].fd < 0 || (size_t)events[i].fd >= loop.slot_count) {
+                continue;
+            }
+            KolibriConnection *conn = loop.slots[events[i].fd];
+            if (!conn) {
+                continue;
+            }
+            if (events[i].failed) {
+                event_loop_close(&loop, conn);
+            } else if (conn->out_len > 0U) {
+                if (events[i].writable) {
+                    event_loop_write(&loop, conn);
+                }
+            } else if (events[i].readable) {
+                event_loop_read(&loop, conn);
             }
-            return;
         }
         time_t now = time(NULL);
-        if (!rate_limiter_allow(&kolibri_teach_rate, now, KOLIBRI_RATE_LIMIT_BURST)) {
-            send_response(client_fd, 429, "application/json", "{\"error\":\"rate limited\"}");
-            return;
+        if (now != last_sweep) {
+            event_loop_expire(&loop, now);
+            last_sweep = now;
         }
-        char question[512];
-        char answer[512];
-        parse_form_field(body, "q", question, sizeof(question));
-        parse_form_field(body, "a", answer, sizeof(answer));
-        if (question[0] == '\0' || answer[0] == '\0') {
-            send_response(client_fd, 400, "application/json", "{\"error\":\"missing q or a\"}");
-            return;
+    }
+    for (size_t fd = 0; fd < loop.slot_count; ++fd) {
+        if (loop.slots[fd]) {
+            event_loop_close(&loop, loop.slots[fd]);
         }
-        char payload[512];
-        snprintf(payload, sizeof(payload), "q=%.*s a=%.*s", 200, question, 200, answer);
-        knowledge_record_event("TEACH", payload);
-        send_response(client_fd, 200, "application/json", "{\"status\":\"ok\"}");
-        return;
     }
+    free(loop.slots);
+    close(loop.poller);
+    return 0;
+}
+#endif
 
-    if (!(strcmp(method, "GET") == 0 && starts_with(path_start, "/api/knowledge/search"))) {
-        send_response(client_fd, 404, "application/json", "{\"error\":\"not found\"}");
-        return;
+static int client_queue_push(KolibriClientQueue *queue, int client_fd, uint32_t peer_addr, size_t served) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == KOLIBRI_WORKER_QUEUE && !queue->stopping) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->stopping) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
     }
+    queue->fds[(queue->head + queue->count) % KOLIBRI_WORKER_QUEUE] = client_fd;
+    queue->addrs[(queue->head + queue->count) % KOLIBRI_WORKER_QUEUE] = peer_addr;
+    queue->served[(queue->head + queue->count) % KOLIBRI_WORKER_QUEUE] = served;
+    queue->count += 1U;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
 
-    char query[512];
-    size_t limit = 3U;
-    parse_query(path_start, query, sizeof(query), &limit);
-    if (!*query || !index) {
-        kolibri_search_misses += 1U;
-        send_response(client_fd, 200, "application/json", "{\"snippets\":[]}");
-        return;
+static int client_queue_pop(KolibriClientQueue *queue, uint32_t *peer_addr, size_t *served) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0U && !queue->stopping) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
     }
-    if (limit > 16U) {
-        limit = 16U;
+    if (queue->count == 0U) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
     }
+    int client_fd = queue->fds[queue->head];
+    *peer_addr = queue->addrs[queue->head];
+    *served = queue->served[queue->head];
+    queue->head = (queue->head + 1U) % KOLIBRI_WORKER_QUEUE;
+    queue->count -= 1U;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return client_fd;
+}
 
-    size_t indices[16];
-    float scores[16];
-    size_t result_count = 0U;
-    int search_err = kolibri_knowledge_index_search(index, query, limit, indices, scores, &result_count);
-    if (search_err != 0) {
-        send_response(client_fd, 500, "application/json", "{\"error\":\"search failed\"}");
-        return;
+static void client_queue_stop(KolibriClientQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+/*
+ * Worker mode parks idle keep-alive sockets here instead of letting each
+ * one pin a worker for the whole keep-alive timeout. One thread watches
+ * them, hands a socket back to the worker queue once it turns readable and
+ * closes those left idle past the timeout.
+ */
+typedef struct {
+    uint32_t peer_addr;
+    size_t served;
+    time_t parked_at;
+    int parked;
+} KolibriParkedClient;
+
+typedef struct {
+    int poller;
+    KolibriParkedClient *slots;
+    size_t slot_count;
+    int running;
+    int stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+} KolibriKeepAlivePark;
+
+static KolibriKeepAlivePark kolibri_keepalive_park = {
+    .poller = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+/* Set before the workers start and left alone while they run. */
+static int kolibri_keepalive_parking = 0;
+
+/* Caller holds park->lock. */
+static void keepalive_park_release(KolibriKeepAlivePark *park, int fd) {
+    park->slots[fd].parked = 0;
+    poller_forget(park->poller, fd);
+    atomic_fetch_sub(&kolibri_keepalive_parked, 1U);
+}
+
+static int keepalive_park_add(KolibriKeepAlivePark *park, int fd, uint32_t peer_addr, size_t served) {
+    pthread_mutex_lock(&park->lock);
+    if (!park->running || park->stopping) {
+        pthread_mutex_unlock(&park->lock);
+        return -1;
+    }
+    if ((size_t)fd >= park->slot_count) {
+        size_t count = park->slot_count ? park->slot_count : 64U;
+        while (count <= (size_t)fd) {
+            count *= 2U;
+        }
+        KolibriParkedClient *slots = realloc(park->slots, count * sizeof(*slots));
+        if (!slots) {
+            pthread_mutex_unlock(&park->lock);
+            return -1;
+        }
+        memset(slots + park->slot_count, 0, (count - park->slot_count) * sizeof(*slots));
+        park->slots = slots;
+        park->slot_count = count;
+    }
+    KolibriParkedClient *slot = &park->slots[fd];
+    slot->peer_addr = peer_addr;
+    slot->served = served;
+    slot->parked_at = time(NULL);
+    if (poller_watch(park->poller, fd, 0, 1) != 0) {
+        pthread_mutex_unlock(&park->lock);
+        return -1;
     }
+    slot->parked = 1;
+    atomic_fetch_add(&kolibri_keepalive_parked, 1U);
+    pthread_mutex_unlock(&park->lock);
+    return 0;
+}
 
-    char response[KOLIBRI_RESPONSE_BUFFER];
-    size_t offset = 0U;
-    offset += (size_t)snprintf(response + offset, sizeof(response) - offset, "{\"snippets\":[");
-    for (size_t i = 0; i < result_count && offset < sizeof(response); ++i) {
-        const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
-        if (!doc) {
+static void *keepalive_park_main(void *arg) {
+    KolibriKeepAlivePark *park = (KolibriKeepAlivePark *)arg;
+    KolibriPollEvent events[KOLIBRI_EVENT_BATCH];
+    time_t last_sweep = time(NULL);
+    for (;;) {
+        pthread_mutex_lock(&park->lock);
+        int stopping = park->stopping;
+        pthread_mutex_unlock(&park->lock);
+        if (stopping) {
+            break;
+        }
+        int count = poller_wait(park->poller, events, KOLIBRI_EVENT_BATCH, 1000);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].fd;
+            pthread_mutex_lock(&park->lock);
+            if (fd < 0 || (size_t)fd >= park->slot_count || !park->slots[fd].parked) {
+                pthread_mutex_unlock(&park->lock);
+                continue;
+            }
+            KolibriParkedClient client = park->slots[fd];
+            keepalive_park_release(park, fd);
+            pthread_mutex_unlock(&park->lock);
+            /* A peer that hung up is closed by the worker as an idle keep-alive. */
+            if (client_queue_push(&kolibri_client_queue, fd, client.peer_addr, client.served) != 0) {
+                close(fd);
+            }
+        }
+        time_t now = time(NULL);
+        if (now == last_sweep) {
             continue;
         }
-        const char *separator = (i + 1U < result_count) ? "," : "";
-        char id_buf[256];
-        char title_buf[512];
-        char content_buf[1024];
-        char source_buf[512];
-        json_escape(doc->id ? doc->id : "", id_buf, sizeof(id_buf));
-        json_escape(doc->title ? doc->title : "", title_buf, sizeof(title_buf));
-        json_escape(doc->content ? doc->content : "", content_buf, sizeof(content_buf));
-        json_escape(doc->source ? doc->source : "", source_buf, sizeof(source_buf));
-        offset += (size_t)snprintf(response + offset,
-                                   sizeof(response) - offset,
-                                   "{\"id\":\"%s\",\"title\":\"%s\",\"content\":\"%s\",\"source\":\"%s\",\"score\":%.3f}%s",
-                                   id_buf,
-                                   title_buf,
-                                   content_buf,
-                                   source_buf,
-                                   scores[i],
-                                   separator);
+        last_sweep = now;
+        pthread_mutex_lock(&park->lock);
+        for (size_t fd = 0; fd < park->slot_count; ++fd) {
+            if (park->slots[fd].parked && now - park->slots[fd].parked_at >= (time_t)kolibri_keepalive_timeout) {
+                keepalive_park_release(park, (int)fd);
+                close((int)fd);
+            }
+        }
+        pthread_mutex_unlock(&park->lock);
     }
-    if (result_count == 0U) {
-        kolibri_search_misses += 1U;
-    } else {
-        kolibri_search_hits += 1U;
+    pthread_mutex_lock(&park->lock);
+    for (size_t fd = 0; fd < park->slot_count; ++fd) {
+        if (park->slots[fd].parked) {
+            keepalive_park_release(park, (int)fd);
+            close((int)fd);
+        }
     }
+    park->running = 0;
+    pthread_mutex_unlock(&park->lock);
+    return NULL;
+}
 
-    if (offset >= sizeof(response) - 2U) {
-        offset = sizeof(response) - 3U;
+static int keepalive_park_start(KolibriKeepAlivePark *park) {
+    park->poller = poller_open();
+    if (park->poller < 0) {
+        return -1;
+    }
+    sigset_t previous;
+    block_server_signals(&previous);
+    pthread_mutex_lock(&park->lock);
+    park->stopping = 0;
+    park->running = pthread_create(&park->thread, NULL, keepalive_park_main, park) == 0;
+    int running = park->running;
+    pthread_mutex_unlock(&park->lock);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (!running) {
+        close(park->poller);
+        park->poller = -1;
+        return -1;
     }
-    offset += (size_t)snprintf(response + offset, sizeof(response) - offset, "]}");
-    response[sizeof(response) - 1U] = '\0';
+    return 0;
+}
 
-    send_response(client_fd, 200, "application/json", response);
+/* Closes every parked socket; later keep-alive connections close after their response. */
+static void keepalive_park_stop(KolibriKeepAlivePark *park) {
+    pthread_mutex_lock(&park->lock);
+    if (park->poller < 0) {
+        pthread_mutex_unlock(&park->lock);
+        return;
+    }
+    park->stopping = 1;
+    pthread_mutex_unlock(&park->lock);
+    pthread_join(park->thread, NULL);
+    pthread_mutex_lock(&park->lock);
+    close(park->poller);
+    park->poller = -1;
+    free(park->slots);
+    park->slots = NULL;
+    park->slot_count = 0U;
+    pthread_mutex_unlock(&park->lock);
+}
+#endif
 
-    if (kolibri_genome_ready) {
-        char ask_payload[512];
-        int query_limit = (int)sizeof(ask_payload) - 3;
-        if (query_limit < 0) {
-            query_limit = 0;
-        }
-        snprintf(ask_payload, sizeof(ask_payload), "q=%.*s", query_limit, query);
-        knowledge_record_event("ASK", ask_payload);
-        size_t replay = result_count < 3U ? result_count : 3U;
-        for (size_t i = 0; i < replay; ++i) {
-            const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
-            if (!doc) {
-                continue;
-            }
-            const char *answer_src = doc->content ? doc->content : "";
-            char *preview = snippet_preview(answer_src, 200U);
-            char teach_payload[512];
-            int remaining = (int)sizeof(teach_payload) - 1 - 5;
-            if (remaining < 0) {
-                remaining = 0;
-            }
-            int teach_q_limit = remaining > 0 ? remaining / 2 : 0;
-            int teach_a_limit = remaining - teach_q_limit;
-            snprintf(teach_payload,
-                     sizeof(teach_payload),
-                     "q=%.*s a=%.*s",
-                     teach_q_limit,
-                     query,
-                     teach_a_limit,
-                     preview ? preview : "");
-            knowledge_record_event("TEACH", teach_payload);
-            free(preview);
+static void *client_worker_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        /* Drains already accepted sockets after stop, then exits. */
+        uint32_t peer_addr = 0U;
+        size_t served = 0U;
+        int client_fd = client_queue_pop(&kolibri_client_queue, &peer_addr, &served);
+        if (client_fd < 0) {
+            break;
+        }
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+        if (handle_client(client_fd, peer_addr, &served, kolibri_keepalive_parking) &&
+            keepalive_park_add(&kolibri_keepalive_park, client_fd, peer_addr, served) == 0) {
+            continue;
+        }
+#else
+        handle_client(client_fd, peer_addr, &served, 0);
+#endif
+        close(client_fd);
+    }
+    return NULL;
+}
+
+static size_t start_client_workers(pthread_t *threads, size_t requested) {
+    /* Signals must land on the accept thread so accept() sees EINTR. */
+    sigset_t previous;
+    block_server_signals(&previous);
+    size_t started = 0U;
+    for (; started < requested; ++started) {
+        if (pthread_create(&threads[started], NULL, client_worker_main, NULL) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] failed to start worker %zu\n", started);
+            break;
         }
     }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return started;
+}
+
+static void stop_client_workers(pthread_t *threads, size_t count) {
+    client_queue_stop(&kolibri_client_queue);
+    for (size_t i = 0; i < count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
 }
 
+static void write_trace_file(void) {
+    if (!kolibri_trace_path) {
+        return;
+    }
+    kolibri_trace_stop();
+    if (kolibri_trace_write_file(kolibri_trace_path) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] failed to write trace to %s\n", kolibri_trace_path);
+        return;
+    }
+    fprintf(stdout,
+            "[kolibri-knowledge] trace: %zu spans (%llu dropped) written to %s\n",
+            kolibri_trace_span_count(),
+            (unsigned long long)kolibri_trace_dropped(),
+            kolibri_trace_path);
+}
 
 int main(int argc, char **argv) {
     kolibri_server_started_at = time(NULL);
+    rate_limiter_init(&kolibri_feedback_rate);
+    rate_limiter_init(&kolibri_teach_rate);
 
     apply_environment_configuration();
+    kolibri_trace_path = kolibri_trace_start_from_env();
     int cli_status = apply_cli_arguments(argc, argv);
     if (cli_status > 0) {
         free_knowledge_directories();
@@ -1566,35 +5143,56 @@ int main(int argc, char **argv) {
         free_knowledge_directories();
         return 1;
     }
+    if (configure_shard_peers() != 0) {
+        free_knowledge_directories();
+        return 1;
+    }
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+    /* Scatter-gather waits on the serving thread, and the event loop has only one. */
+    if (kolibri_event_loop_mode && kolibri_shard_peer_count > 0U) {
+        fprintf(stderr, "[kolibri-knowledge] --shards needs worker threads and cannot run with --event-loop\n");
+        free_knowledge_directories();
+        return 1;
+    }
+#endif
 
-    KolibriKnowledgeIndex *index = NULL;
-    int index_status = load_or_build_index(&index);
-    if (index_status != 0 || !index) {
+    KolibriServingIndex *initial = (KolibriServingIndex *)calloc(1U, sizeof(*initial));
+    int index_status = initial ? load_or_build_index(initial, knowledge_sources_fingerprint()) : ENOMEM;
+    if (index_status != 0 || !initial->index) {
         fprintf(stderr, "[kolibri-knowledge] failed to prepare knowledge index (err=%d)\n", index_status);
+        free(initial);
         free_knowledge_directories();
         return 1;
     }
 
-    size_t document_count = kolibri_knowledge_index_document_count(index);
-    fprintf(stdout, "[kolibri-knowledge] loaded %zu documents (%s)\n", document_count, kolibri_index_source);
-    if (document_count > 0U) {
-        write_bootstrap_script(index, KOLIBRI_BOOTSTRAP_SCRIPT);
-    }
+    size_t document_count = kolibri_knowledge_index_document_count(initial->index);
+    fprintf(stdout, "[kolibri-knowledge] loaded %zu documents (%s)\n", document_count, initial->source);
+    serving_index_install(initial);
 
     if (kolibri_genome_init_or_open() != 0) {
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
 
+    if (kolibri_swarm_init(&kolibri_swarm, kolibri_swarm_node_id, 0U) == 0) {
+        kolibri_swarm_ready = 1;
+        configure_swarm_from_config();
+    }
+
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handle_signal;
     sigemptyset(&sa.sa_mask);
-    if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0) {
+    struct sigaction ignore;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0 ||
+        sigaction(SIGHUP, &sa, NULL) != 0 || sigaction(SIGPIPE, &ignore, NULL) != 0) {
         perror("sigaction");
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1603,7 +5201,7 @@ int main(int argc, char **argv) {
     if (server_fd < 0) {
         perror("socket");
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1617,7 +5215,7 @@ int main(int argc, char **argv) {
         fprintf(stderr, "[kolibri-knowledge] invalid bind address: %s\n", kolibri_bind_address);
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1626,7 +5224,7 @@ int main(int argc, char **argv) {
         perror("bind");
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1634,15 +5232,54 @@ int main(int argc, char **argv) {
         perror("listen");
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        serving_index_install(NULL);
         free_knowledge_directories();
         return 1;
     }
 
+    start_warm_training();
+
+    if (kolibri_event_loop_mode) {
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+        fprintf(stdout,
+                "[kolibri-knowledge] listening on http://%s:%d (event loop)\n",
+                kolibri_bind_address,
+                kolibri_server_port);
+        int loop_status = run_event_loop(server_fd);
+        finish_index_reload();
+        finish_warm_training();
+        query_cache_destroy();
+        rate_limiter_destroy(&kolibri_feedback_rate);
+        rate_limiter_destroy(&kolibri_teach_rate);
+        close(server_fd);
+        kolibri_genome_close();
+        kolibri_swarm_free(&kolibri_swarm);
+        serving_index_install(NULL);
+        free_knowledge_directories();
+        write_trace_file();
+        fprintf(stdout, "[kolibri-knowledge] shutdown\n");
+        return loop_status == 0 ? 0 : 1;
+#else
+        fprintf(stderr, "[kolibri-knowledge] event loop is not supported on this platform, using workers\n");
+#endif
+    }
+
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+    if (kolibri_worker_count > 0U && kolibri_keepalive_timeout > 0U) {
+        kolibri_keepalive_parking = keepalive_park_start(&kolibri_keepalive_park) == 0;
+        if (!kolibri_keepalive_parking) {
+            fprintf(stderr, "[kolibri-knowledge] failed to start keep-alive parking, idle clients hold workers\n");
+        }
+    }
+#endif
+    pthread_t workers[KOLIBRI_MAX_WORKERS];
+    size_t worker_count = start_client_workers(workers, kolibri_worker_count);
+
     fprintf(stdout,
-            "[kolibri-knowledge] listening on http://%s:%d\n",
+            "[kolibri-knowledge] listening on http://%s:%d (%zu workers)\n",
             kolibri_bind_address,
-            kolibri_server_port);
+            kolibri_server_port,
+            worker_count);
 
     while (kolibri_server_running) {
         struct sockaddr_in client_addr;
@@ -1650,19 +5287,37 @@ int main(int argc, char **argv) {
         int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
         if (client_fd < 0) {
             if (errno == EINTR) {
+                poll_reload_request();
                 continue;
             }
             perror("accept");
             break;
         }
-        handle_client(client_fd, index);
-        close(client_fd);
+        configure_client_socket(client_fd);
+        if (worker_count == 0U) {
+            size_t served = 0U;
+            handle_client(client_fd, client_addr.sin_addr.s_addr, &served, 0);
+            close(client_fd);
+        } else if (client_queue_push(&kolibri_client_queue, client_fd, client_addr.sin_addr.s_addr, 0U) != 0) {
+            close(client_fd);
+        }
     }
 
+#if defined(KOLIBRI_HAVE_EPOLL) || defined(KOLIBRI_HAVE_KQUEUE)
+    keepalive_park_stop(&kolibri_keepalive_park);
+#endif
+    stop_client_workers(workers, worker_count);
+    finish_index_reload();
+    finish_warm_training();
+    query_cache_destroy();
+    rate_limiter_destroy(&kolibri_feedback_rate);
+    rate_limiter_destroy(&kolibri_teach_rate);
     close(server_fd);
     kolibri_genome_close();
-    kolibri_knowledge_index_destroy(index);
+    kolibri_swarm_free(&kolibri_swarm);
+    serving_index_install(NULL);
     free_knowledge_directories();
+    write_trace_file();
     fprintf(stdout, "[kolibri-knowledge] shutdown\n");
     return 0;
 }
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/log.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_LIMITER_SLOTS 256U
+#define LOG_MODULE_NAME_MAX 32U
+#define LOG_CAPACITY_MAX (1U << 20)
+
+/*
+ * Bounded multi-producer ring with one sequence number per slot (Vyukov):
+ * a producer claims position pos when the slot's sequence equals pos,
+ * formats into it and publishes pos + 1; the drain thread hands the slot
+ * back as pos + capacity once the record is written.
+ */
+typedef struct {
+    atomic_size_t sequence;
+    uint64_t time_ns;
+    const char *module;
+    uint8_t level;
+    uint16_t length;
+    char message[KOLIBRI_LOG_MESSAGE_MAX];
+} KolibriLogSlot;
+
+/* Records of one call-site bucket within the current second. */
+typedef struct {
+    atomic_uint_least64_t second;
+    atomic_uint count;
+    atomic_uint suppressed;
+    atomic_int level;
+    _Atomic(const char *) module;
+} KolibriLogLimiter;
+
+typedef struct {
+    char name[LOG_MODULE_NAME_MAX];
+    atomic_int level;
+} KolibriLogModule;
+
+static atomic_int log_level = KOLIBRI_LOG_LEVEL_INFO;
+static atomic_uint log_rate_limit = 0U;
+static atomic_int log_running = 0;
+static atomic_int log_writers = 0;
+static atomic_int log_stopping = 0;
+
+/* Guards start/stop, module table updates and synchronous writes. */
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t log_thread;
+static KolibriLogSlot *log_slots = NULL;
+static size_t log_mask = 0U;
+static atomic_size_t log_enqueue_pos = 0U;
+static atomic_size_t log_dequeue_pos = 0U;
+static atomic_size_t log_flushed_pos = 0U;
+static KolibriLogFormat log_format = KOLIBRI_LOG_FORMAT_TEXT;
+static FILE *log_out = NULL;
+
+static KolibriLogModule log_modules[KOLIBRI_LOG_MODULES_MAX];
+static atomic_size_t log_module_count = 0U;
+static KolibriLogLimiter log_limiters[LOG_LIMITER_SLOTS];
+
+static atomic_uint_least64_t log_written = 0U;
+static atomic_uint_least64_t log_dropped = 0U;
+static atomic_uint_least64_t log_suppressed = 0U;
+
+static const char *const log_level_names[] = {"debug", "info", "warn", "error", "off"};
+static const char *const log_format_names[] = {"text", "jsonl", "binary"};
+
+static uint64_t log_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void log_sleep_ns(long ns) {
+    struct timespec ts = {0, ns};
+    nanosleep(&ts, NULL);
+}
+
+static void log_put_le(uint8_t *out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out[i] = (uint8_t)(value >> (8U * i));
+    }
+}
+
+static void log_json_string(FILE *out, const char *text, size_t length) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c == '\n') {
+            fputs("\\n", out);
+        } else if (c < 0x20U) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Writes one record in the current format; the caller serialises writers. */
+static void log_emit(uint8_t level, uint64_t time_ns, const char *module,
+                     const char *message, size_t length) {
+    if (!module) {
+        module = "";
+    }
+    if (log_format == KOLIBRI_LOG_FORMAT_TEXT) {
+        FILE *out = log_out ? log_out : (level >= KOLIBRI_LOG_LEVEL_WARN ? stderr : stdout);
+        if (module[0]) {
+            fprintf(out, "[%s] %.*s\n", module, (int)length, message);
+        } else {
+            fprintf(out, "%.*s\n", (int)length, message);
+        }
+        return;
+    }
+    FILE *out = log_out ? log_out : stdout;
+    if (log_format == KOLIBRI_LOG_FORMAT_JSONL) {
+        fprintf(out, "{\"ts_ns\":%llu,\"level\":\"%s\",\"module\":", (unsigned long long)time_ns,
+                log_level_names[level]);
+        log_json_string(out, module, strlen(module));
+        fputs(",\"message\":", out);
+        log_json_string(out, message, length);
+        fputs("}\n", out);
+        return;
+    }
+    size_t module_length = strlen(module);
+    if (module_length > UINT16_MAX) {
+        module_length = UINT16_MAX;
+    }
+    uint8_t header[13];
+    log_put_le(header, time_ns, 8U);
+    header[8] = level;
+    log_put_le(header + 9, module_length, 2U);
+    log_put_le(header + 11, length, 2U);
+    fwrite(header, 1U, sizeof(header), out);
+    fwrite(module, 1U, module_length, out);
+    fwrite(message, 1U, length, out);
+}
+
+static void log_flush_streams(void) {
+    if (log_out) {
+        fflush(log_out);
+    } else {
+        fflush(stdout);
+        fflush(stderr);
+    }
+}
+
+static size_t log_drain(void) {
+    size_t drained = 0U;
+    size_t pos = atomic_load_explicit(&log_dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        KolibriLogSlot *slot = &log_slots[pos & log_mask];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != pos + 1U) {
+            break;
+        }
+        log_emit(slot->level, slot->time_ns, slot->module, slot->message, slot->length);
+        atomic_store_explicit(&slot->sequence, pos + log_mask + 1U, memory_order_release);
+        pos++;
+        atomic_store_explicit(&log_dequeue_pos, pos, memory_order_release);
+        drained++;
+    }
+    if (drained) {
+        log_flush_streams();
+        atomic_fetch_add_explicit(&log_written, drained, memory_order_relaxed);
+        atomic_store_explicit(&log_flushed_pos, pos, memory_order_release);
+    }
+    return drained;
+}
+
+static void *log_drain_main(void *arg) {
+    (void)arg;
+    unsigned idle = 0U;
+    for (;;) {
+        if (log_drain() != 0U) {
+            idle = 0U;
+            continue;
+        }
+        /* Producers are gone once stopping is set, so an empty ring is final. */
+        if (atomic_load(&log_stopping)) {
+            break;
+        }
+        if (++idle < 64U) {
+            sched_yield();
+        } else {
+            log_sleep_ns(1000000L);
+        }
+    }
+    return NULL;
+}
+
+static void log_enqueue(uint8_t level, uint64_t time_ns, const char *module,
+                        const char *format, va_list args) {
+    size_t pos = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+    KolibriLogSlot *slot;
+    for (;;) {
+        slot = &log_slots[pos & log_mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&log_enqueue_pos, &pos, pos + 1U,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&log_dropped, 1U, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+        }
+    }
+    slot->time_ns = time_ns;
+    slot->module = module;
+    slot->level = level;
+    int length = vsnprintf(slot->message, sizeof(slot->message), format, args);
+    if (length < 0) {
+        length = 0;
+    } else if ((size_t)length >= sizeof(slot->message)) {
+        length = (int)sizeof(slot->message) - 1;
+    }
+    slot->length = (uint16_t)length;
+    atomic_store_explicit(&slot->sequence, pos + 1U, memory_order_release);
+}
+
+static void log_submit(uint8_t level, uint64_t time_ns, const char *module,
+                       const char *format, va_list args) {
+    /* Pairs with kolibri_log_stop: either this writer sees the ring stopped
+     * or the stop waits for it to publish. */
+    atomic_fetch_add(&log_writers, 1);
+    if (atomic_load(&log_running)) {
+        log_enqueue(level, time_ns, module, format, args);
+        atomic_fetch_sub(&log_writers, 1);
+        return;
+    }
+    atomic_fetch_sub(&log_writers, 1);
+
+    char message[KOLIBRI_LOG_MESSAGE_MAX];
+    int length = vsnprintf(message, sizeof(message), format, args);
+    if (length < 0) {
+        length = 0;
+    } else if ((size_t)length >= sizeof(message)) {
+        length = (int)sizeof(message) - 1;
+    }
+    pthread_mutex_lock(&log_lock);
+    log_emit(level, time_ns, module, message, (size_t)length);
+    pthread_mutex_unlock(&log_lock);
+    atomic_fetch_add_explicit(&log_written, 1U, memory_order_relaxed);
+}
+
+static void log_submitf(uint8_t level, uint64_t time_ns, const char *module, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    log_submit(level, time_ns, module, format, args);
+    va_end(args);
+}
+
+static KolibriLogLimiter *log_limiter(const char *format) {
+    uint64_t h = (uint64_t)(uintptr_t)format * 0x9E3779B97F4A7C15ULL;
+    return &log_limiters[(h >> 32) & (LOG_LIMITER_SLOTS - 1U)];
+}
+
+static void log_report_suppressed(KolibriLogLimiter *limiter, uint64_t time_ns) {
+    unsigned held = atomic_exchange(&limiter->suppressed, 0U);
+    if (held) {
+        log_submitf((uint8_t)atomic_load(&limiter->level), time_ns, atomic_load(&limiter->module),
+                    "%u similar records suppressed", held);
+    }
+}
+
+/* 1 when the record fits its call site's budget for this second. */
+static int log_admit(const char *format, const char *module, KolibriLogLevel level,
+                     uint64_t time_ns, uint32_t limit) {
+    KolibriLogLimiter *limiter = log_limiter(format);
+    uint64_t second = time_ns / 1000000000ULL;
+    uint_least64_t seen = atomic_load_explicit(&limiter->second, memory_order_relaxed);
+    if (seen != second && atomic_compare_exchange_strong(&limiter->second, &seen, second)) {
+        atomic_store(&limiter->count, 0U);
+        log_report_suppressed(limiter, time_ns);
+    }
+    if (atomic_fetch_add_explicit(&limiter->count, 1U, memory_order_relaxed) < limit) {
+        return 1;
+    }
+    atomic_store(&limiter->module, module);
+    atomic_store(&limiter->level, (int)level);
+    atomic_fetch_add(&limiter->suppressed, 1U);
+    atomic_fetch_add_explicit(&log_suppressed, 1U, memory_order_relaxed);
+    return 0;
+}
+
+int kolibri_log_enabled(KolibriLogLevel level, const char *module) {
+    if ((int)level < 0 || level >= KOLIBRI_LOG_LEVEL_OFF) {
+        return 0;
+    }
+    int threshold = atomic_load_explicit(&log_level, memory_order_relaxed);
+    size_t count = atomic_load_explicit(&log_module_count, memory_order_acquire);
+    if (count && module) {
+        for (size_t i = 0; i < count; ++i) {
+            if (strcmp(log_modules[i].name, module) == 0) {
+                threshold = atomic_load_explicit(&log_modules[i].level, memory_order_relaxed);
+                break;
+            }
+        }
+    }
+    return (int)level >= threshold;
+}
+
+void kolibri_log_vwrite(KolibriLogLevel level, const char *module, const char *format, va_list args) {
+    if (!format || !kolibri_log_enabled(level, module)) {
+        return;
+    }
+    uint64_t now = log_now_ns();
+    uint32_t limit = atomic_load_explicit(&log_rate_limit, memory_order_relaxed);
+    if (limit && !log_admit(format, module, level, now, limit)) {
+        return;
+    }
+    log_submit((uint8_t)level, now, module, format, args);
+}
+
+void kolibri_log_write(KolibriLogLevel level, const char *module, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    kolibri_log_vwrite(level, module, format, args);
+    va_end(args);
+}
+
+void kolibri_log_set_level(KolibriLogLevel level) {
+    if ((int)level >= 0 && level <= KOLIBRI_LOG_LEVEL_OFF) {
+        atomic_store(&log_level, (int)level);
+    }
+}
+
+int kolibri_log_set_module_level(const char *module, KolibriLogLevel level) {
+    if (!module || strlen(module) >= LOG_MODULE_NAME_MAX || (int)level < 0 ||
+        level > KOLIBRI_LOG_LEVEL_OFF) {
+        return -1;
+    }
+    pthread_mutex_lock(&log_lock);
+    size_t count = atomic_load(&log_module_count);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(log_modules[i].name, module) == 0) {
+            atomic_store(&log_modules[i].level, (int)level);
+            pthread_mutex_unlock(&log_lock);
+            return 0;
+        }
+    }
+    if (count == KOLIBRI_LOG_MODULES_MAX) {
+        pthread_mutex_unlock(&log_lock);
+        return -1;
+    }
+    strcpy(log_modules[count].name, module);
+    atomic_store(&log_modules[count].level, (int)level);
+    atomic_store_explicit(&log_module_count, count + 1U, memory_order_release);
+    pthread_mutex_unlock(&log_lock);
+    return 0;
+}
+
+void kolibri_log_stop(void) {
+    pthread_mutex_lock(&log_lock);
+    if (atomic_load(&log_running)) {
+        atomic_store(&log_running, 0);
+        while (atomic_load(&log_writers) != 0) {
+            sched_yield();
+        }
+        atomic_store(&log_stopping, 1);
+        pthread_join(log_thread, NULL);
+        free(log_slots);
+        log_slots = NULL;
+        log_mask = 0U;
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    // Summaries still held by the limiter go out synchronously
+    uint64_t now = log_now_ns();
+    for (size_t i = 0; i < LOG_LIMITER_SLOTS; ++i) {
+        log_report_suppressed(&log_limiters[i], now);
+    }
+
+    pthread_mutex_lock(&log_lock);
+    if (log_out) {
+        fflush(log_out);
+    }
+    log_format = KOLIBRI_LOG_FORMAT_TEXT;
+    log_out = NULL;
+    pthread_mutex_unlock(&log_lock);
+}
+
+int kolibri_log_start(const KolibriLogConfig *config) {
+    KolibriLogConfig defaults = {KOLIBRI_LOG_LEVEL_INFO, KOLIBRI_LOG_FORMAT_TEXT, NULL, 0U, 0U};
+    if (!config) {
+        config = &defaults;
+    }
+    if ((int)config->level < 0 || config->level > KOLIBRI_LOG_LEVEL_OFF ||
+        (int)config->format < 0 || config->format > KOLIBRI_LOG_FORMAT_BINARY ||
+        config->capacity > LOG_CAPACITY_MAX) {
+        return -1;
+    }
+    size_t capacity = 2U;
+    size_t wanted = config->capacity ? config->capacity : KOLIBRI_LOG_DEFAULT_CAPACITY;
+    while (capacity < wanted) {
+        capacity <<= 1U;
+    }
+
+    kolibri_log_stop();
+    KolibriLogSlot *slots = (KolibriLogSlot *)malloc(capacity * sizeof(KolibriLogSlot));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        atomic_init(&slots[i].sequence, i);
+    }
+
+    pthread_mutex_lock(&log_lock);
+    log_slots = slots;
+    log_mask = capacity - 1U;
+    log_format = config->format;
+    log_out = config->out;
+    atomic_store(&log_enqueue_pos, 0U);
+    atomic_store(&log_dequeue_pos, 0U);
+    atomic_store(&log_flushed_pos, 0U);
+    atomic_store(&log_stopping, 0);
+    atomic_store(&log_written, 0U);
+    atomic_store(&log_dropped, 0U);
+    atomic_store(&log_suppressed, 0U);
+    for (size_t i = 0; i < LOG_LIMITER_SLOTS; ++i) {
+        atomic_store(&log_limiters[i].second, 0U);
+        atomic_store(&log_limiters[i].count, 0U);
+        atomic_store(&log_limiters[i].suppressed, 0U);
+    }
+    atomic_store(&log_level, (int)config->level);
+    atomic_store(&log_rate_limit, config->rate_limit);
+    if (log_format == KOLIBRI_LOG_FORMAT_BINARY) {
+        fwrite("KLG1", 1U, 4U, log_out ? log_out : stdout);
+    }
+    if (pthread_create(&log_thread, NULL, log_drain_main, NULL) != 0) {
+        free(log_slots);
+        log_slots = NULL;
+        log_mask = 0U;
+        log_format = KOLIBRI_LOG_FORMAT_TEXT;
+        log_out = NULL;
+        pthread_mutex_unlock(&log_lock);
+        return -1;
+    }
+    atomic_store(&log_running, 1);
+    pthread_mutex_unlock(&log_lock);
+    return 0;
+}
+
+void kolibri_log_flush(void) {
+    size_t target = atomic_load(&log_enqueue_pos);
+    while (atomic_load(&log_running) &&
+           atomic_load_explicit(&log_flushed_pos, memory_order_acquire) < target) {
+        log_sleep_ns(100000L);
+    }
+}
+
+void kolibri_log_stats(KolibriLogStats *stats) {
+    if (!stats) {
+        return;
+    }
+    stats->written = atomic_load(&log_written);
+    stats->dropped = atomic_load(&log_dropped);
+    stats->suppressed = atomic_load(&log_suppressed);
+}
+
+int kolibri_log_parse_level(const char *text, KolibriLogLevel *level) {
+    for (size_t i = 0; text && i < sizeof(log_level_names) / sizeof(log_level_names[0]); ++i) {
+        if (strcmp(text, log_level_names[i]) == 0) {
+            *level = (KolibriLogLevel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int kolibri_log_parse_format(const char *text, KolibriLogFormat *format) {
+    for (size_t i = 0; text && i < sizeof(log_format_names) / sizeof(log_format_names[0]); ++i) {
+        if (strcmp(text, log_format_names[i]) == 0) {
+            *format = (KolibriLogFormat)i;
+            return 0;
+        }
+    }
+    return -1;
+}
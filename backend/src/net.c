@@ -6,7 +6,11 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,10 +18,27 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #define KOLIBRI_HEADER_SIZE 3U
 #define KOLIBRI_MAX_PAYLOAD 256U
+#define KOLIBRI_NET_BACKOFF_MS 100U
+#define KOLIBRI_NET_BACKOFF_MAX_MS 30000U
+#define KOLIBRI_NET_CONNECT_TIMEOUT_MS 1000
+#define KOLIBRI_NET_SEND_TIMEOUT_MS 1000
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define KOLIBRI_NET_EPOLL 1
+#else
+#define KOLIBRI_NET_EPOLL 0
+#endif
+#define KOLIBRI_NET_EVENT_BATCH 64
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 static uint64_t kolibri_htonll(uint64_t value) {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
@@ -52,7 +73,7 @@ static size_t kolibri_write_header(uint8_t *buffer, size_t buffer_len,
 static int kolibri_send_all(int sockfd, const uint8_t *data, size_t len) {
   size_t sent_total = 0;
   while (sent_total < len) {
-    ssize_t sent = send(sockfd, data + sent_total, len - sent_total, 0);
+    ssize_t sent = send(sockfd, data + sent_total, len - sent_total, MSG_NOSIGNAL);
     if (sent < 0) {
       if (errno == EINTR) {
         continue;
@@ -67,21 +88,30 @@ static int kolibri_send_all(int sockfd, const uint8_t *data, size_t len) {
   return 0;
 }
 
-static int kolibri_recv_all(int sockfd, uint8_t *data, size_t len) {
-  size_t received_total = 0;
-  while (received_total < len) {
-    ssize_t received = recv(sockfd, data + received_total,
-                            len - received_total, 0);
-    if (received < 0) {
+/* Gathers the iovecs in one sendmsg per attempt; iov is consumed. */
+static int kolibri_send_iov(int sockfd, struct iovec *iov, size_t iov_count) {
+  while (iov_count > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+    ssize_t sent = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    if (sent < 0) {
       if (errno == EINTR) {
         continue;
       }
       return -1;
     }
-    if (received == 0) {
-      return -1;
+    size_t left = (size_t)sent;
+    while (iov_count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      iov_count--;
+    }
+    if (iov_count > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + left;
+      iov->iov_len -= left;
     }
-    received_total += (size_t)received;
   }
   return 0;
 }
@@ -225,37 +255,134 @@ int kn_message_decode(const uint8_t *buffer, size_t buffer_len,
   return 0;
 }
 
-static int kn_send_message(int sockfd, const uint8_t *buffer, size_t len) {
-  if (!buffer || len == 0) {
-    return -1;
+static KolibriNetBlob *kn_blob_wrap(const uint8_t *frame, size_t length) {
+  if (length < KOLIBRI_HEADER_SIZE || length > KOLIBRI_NET_FRAME_MAX) {
+    return NULL;
   }
-  return kolibri_send_all(sockfd, buffer, len);
+  KolibriNetBlob *blob = malloc(sizeof(*blob));
+  if (!blob) {
+    return NULL;
+  }
+  blob->refs = 1;
+  blob->length = length;
+  memcpy(blob->frame, frame, length);
+  return blob;
 }
 
-int kn_share_formula(const char *host, uint16_t port, uint32_t node_id,
-                     const KolibriFormula *formula) {
-  if (!host || !formula) {
-    return -1;
+KolibriNetBlob *kn_blob_hello(uint32_t node_id) {
+  uint8_t frame[KOLIBRI_NET_FRAME_MAX];
+  size_t len = kn_message_encode_hello(frame, sizeof(frame), node_id);
+  return len ? kn_blob_wrap(frame, len) : NULL;
+}
+
+KolibriNetBlob *kn_blob_formula(uint32_t node_id, const KolibriFormula *formula) {
+  uint8_t frame[KOLIBRI_NET_FRAME_MAX];
+  size_t len = kn_message_encode_formula(frame, sizeof(frame), node_id, formula);
+  return len ? kn_blob_wrap(frame, len) : NULL;
+}
+
+KolibriNetBlob *kn_blob_retain(KolibriNetBlob *blob) {
+  if (blob) {
+    __atomic_add_fetch(&blob->refs, 1U, __ATOMIC_RELAXED);
   }
+  return blob;
+}
 
-  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd < 0) {
+void kn_blob_release(KolibriNetBlob *blob) {
+  if (blob && __atomic_sub_fetch(&blob->refs, 1U, __ATOMIC_ACQ_REL) == 0) {
+    free(blob);
+  }
+}
+
+size_t kn_blob_iov(const KolibriNetBlob *blob, struct iovec iov[2]) {
+  iov[0].iov_base = (void *)blob->frame;
+  iov[0].iov_len = KOLIBRI_HEADER_SIZE;
+  iov[1].iov_base = (void *)(blob->frame + KOLIBRI_HEADER_SIZE);
+  iov[1].iov_len = blob->length - KOLIBRI_HEADER_SIZE;
+  return 2;
+}
+
+static int kn_send_message(int sockfd, const uint8_t *buffer, size_t len) {
+  if (!buffer || len == 0) {
     return -1;
   }
+  return kolibri_send_all(sockfd, buffer, len);
+}
 
+/* Issues a non-blocking connect; the caller waits for POLLOUT. */
+static int kn_connect_begin(const char *host, uint16_t port) {
   struct sockaddr_in addr;
   memset(&addr, 0, sizeof(addr));
   addr.sin_family = AF_INET;
   addr.sin_port = htons(port);
   if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
+    return -1;
+  }
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd < 0) {
+    return -1;
+  }
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    close(sockfd);
+    return -1;
+  }
+  if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+      errno != EINPROGRESS) {
     close(sockfd);
     return -1;
   }
+  return sockfd;
+}
+
+/* Checks the connect result and makes the socket blocking with a send timeout. */
+static int kn_connect_finish(int sockfd) {
+  int error = 0;
+  socklen_t error_len = sizeof(error);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 ||
+      error != 0) {
+    return -1;
+  }
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0 || fcntl(sockfd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  struct timeval timeout = {KOLIBRI_NET_SEND_TIMEOUT_MS / 1000,
+                            (KOLIBRI_NET_SEND_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  return 0;
+}
 
-  if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+/* Connects within KOLIBRI_NET_CONNECT_TIMEOUT_MS. */
+static int kn_connect(const char *host, uint16_t port) {
+  int sockfd = kn_connect_begin(host, port);
+  if (sockfd < 0) {
+    return -1;
+  }
+  struct pollfd wait = {sockfd, POLLOUT, 0};
+  int ready;
+  do {
+    ready = poll(&wait, 1, KOLIBRI_NET_CONNECT_TIMEOUT_MS);
+  } while (ready < 0 && errno == EINTR);
+  if (ready <= 0 || kn_connect_finish(sockfd) != 0) {
     close(sockfd);
     return -1;
   }
+  return sockfd;
+}
+
+int kn_share_formula(const char *host, uint16_t port, uint32_t node_id,
+                     const KolibriFormula *formula) {
+  if (!host || !formula) {
+    return -1;
+  }
+
+  int sockfd = kn_connect(host, port);
+  if (sockfd < 0) {
+    return -1;
+  }
 
   uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
   size_t len = kn_message_encode_hello(buffer, sizeof(buffer), node_id);
@@ -274,10 +401,380 @@ int kn_share_formula(const char *host, uint16_t port, uint32_t node_id,
   return 0;
 }
 
+static int kn_compare_desc(const void *lhs, const void *rhs) {
+  uint64_t a = *(const uint64_t *)lhs;
+  uint64_t b = *(const uint64_t *)rhs;
+  return a < b ? 1 : (a > b ? -1 : 0);
+}
+
+static uint64_t kn_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+static uint64_t kn_now_ms(void) { return kn_now_us() / 1000U; }
+
+static uint32_t kn_clamp_u32(uint64_t value) {
+  return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+static void kn_peer_fail(KolibriNetPeer *peer) {
+  if (peer->socket_fd >= 0) {
+    close(peer->socket_fd);
+    peer->socket_fd = -1;
+  }
+  uint32_t shift = peer->failures < 8U ? peer->failures : 8U;
+  uint64_t delay = (uint64_t)KOLIBRI_NET_BACKOFF_MS << shift;
+  if (delay > KOLIBRI_NET_BACKOFF_MAX_MS) {
+    delay = KOLIBRI_NET_BACKOFF_MAX_MS;
+  }
+  peer->failures++;
+  peer->errors++;
+  peer->retry_at_ms = kn_now_ms() + delay;
+}
+
+/* Takes over a connected socket and sends HELLO on it. */
+static int kn_peer_attach(KolibriNetPeers *peers, KolibriNetPeer *peer,
+                          int sockfd, uint64_t started_us) {
+  peer->socket_fd = sockfd;
+  peer->connect_us = kn_clamp_u32(kn_now_us() - started_us);
+  uint8_t buffer[KOLIBRI_HEADER_SIZE + sizeof(uint32_t)];
+  size_t len = kn_message_encode_hello(buffer, sizeof(buffer), peers->node_id);
+  if (len == 0 || kolibri_send_all(sockfd, buffer, len) != 0) {
+    kn_peer_fail(peer);
+    return -1;
+  }
+  return 0;
+}
+
+static bool kn_peer_due(const KolibriNetPeer *peer, uint64_t now_ms) {
+  return peer->socket_fd < 0 &&
+         (peer->failures == 0 || now_ms >= peer->retry_at_ms);
+}
+
+/* Opens the connection if needed; HELLO goes out once per connection. */
+static int kn_peer_ready(KolibriNetPeers *peers, KolibriNetPeer *peer) {
+  if (peer->socket_fd >= 0) {
+    return 0;
+  }
+  if (!kn_peer_due(peer, kn_now_ms())) {
+    return -1;
+  }
+  uint64_t started_us = kn_now_us();
+  int sockfd = kn_connect(peer->host, peer->port);
+  if (sockfd < 0) {
+    kn_peer_fail(peer);
+    return -1;
+  }
+  return kn_peer_attach(peers, peer, sockfd, started_us);
+}
+
+/*
+ * Connects every closed peer that is not backing off at once, so a round
+ * waits for the slowest connect (at most KOLIBRI_NET_CONNECT_TIMEOUT_MS)
+ * rather than for their sum.
+ */
+static void kn_peers_connect_all(KolibriNetPeers *peers) {
+  uint64_t now_ms = kn_now_ms();
+  size_t due = 0;
+  for (size_t i = 0; i < peers->count; ++i) {
+    due += kn_peer_due(&peers->items[i], now_ms);
+  }
+  if (due == 0) {
+    return;
+  }
+  struct pollfd *waits = malloc(due * sizeof(*waits));
+  size_t *owners = malloc(due * sizeof(*owners));
+  if (!waits || !owners) {
+    /* Sends will connect one by one instead. */
+    free(waits);
+    free(owners);
+    return;
+  }
+  uint64_t started_us = kn_now_us();
+  size_t pending = 0;
+  for (size_t i = 0; i < peers->count; ++i) {
+    KolibriNetPeer *peer = &peers->items[i];
+    if (!kn_peer_due(peer, now_ms)) {
+      continue;
+    }
+    int sockfd = kn_connect_begin(peer->host, peer->port);
+    if (sockfd < 0) {
+      kn_peer_fail(peer);
+      continue;
+    }
+    waits[pending].fd = sockfd;
+    waits[pending].events = POLLOUT;
+    waits[pending].revents = 0;
+    owners[pending++] = i;
+  }
+  size_t open = pending;
+  uint64_t deadline_ms = now_ms + KOLIBRI_NET_CONNECT_TIMEOUT_MS;
+  while (open > 0) {
+    uint64_t current_ms = kn_now_ms();
+    int timeout = current_ms < deadline_ms ? (int)(deadline_ms - current_ms) : 0;
+    int ready = poll(waits, (nfds_t)pending, timeout);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      break;
+    }
+    for (size_t w = 0; w < pending; ++w) {
+      if (waits[w].fd < 0 || waits[w].revents == 0) {
+        continue;
+      }
+      int sockfd = waits[w].fd;
+      KolibriNetPeer *peer = &peers->items[owners[w]];
+      waits[w].fd = -1;
+      open--;
+      if (kn_connect_finish(sockfd) != 0) {
+        close(sockfd);
+        kn_peer_fail(peer);
+        continue;
+      }
+      kn_peer_attach(peers, peer, sockfd, started_us);
+    }
+  }
+  for (size_t w = 0; w < pending; ++w) {
+    if (waits[w].fd >= 0) {
+      close(waits[w].fd);
+      kn_peer_fail(&peers->items[owners[w]]);
+    }
+  }
+  free(waits);
+  free(owners);
+}
+
+void kn_peers_init(KolibriNetPeers *peers, uint32_t node_id) {
+  if (!peers) {
+    return;
+  }
+  peers->items = NULL;
+  peers->count = 0;
+  peers->capacity = 0;
+  peers->node_id = node_id;
+}
+
+int kn_peers_add(KolibriNetPeers *peers, const char *host, uint16_t port) {
+  if (!peers || !host || strlen(host) >= sizeof(peers->items[0].host)) {
+    return -1;
+  }
+  if (peers->count == peers->capacity) {
+    size_t capacity = peers->capacity ? peers->capacity * 2U : 8U;
+    KolibriNetPeer *items = realloc(peers->items, capacity * sizeof(*items));
+    if (!items) {
+      return -1;
+    }
+    peers->items = items;
+    peers->capacity = capacity;
+  }
+  KolibriNetPeer *peer = &peers->items[peers->count];
+  memset(peer, 0, sizeof(*peer));
+  strcpy(peer->host, host);
+  peer->port = port;
+  peer->socket_fd = -1;
+  return (int)peers->count++;
+}
+
+/* Sends one frame given as iovecs; a failed send closes and backs off. */
+static int kn_peer_send_iov(KolibriNetPeers *peers, size_t index,
+                            struct iovec *iov, size_t iov_count) {
+  KolibriNetPeer *peer = &peers->items[index];
+  if (kn_peer_ready(peers, peer) != 0) {
+    return -1;
+  }
+  uint64_t started_us = kn_now_us();
+  if (kolibri_send_iov(peer->socket_fd, iov, iov_count) != 0) {
+    kn_peer_fail(peer);
+    return -1;
+  }
+  peer->send_us = kn_clamp_u32(kn_now_us() - started_us);
+  peer->sent++;
+  peer->failures = 0;
+  return 0;
+}
+
+int kn_peers_send_formula(KolibriNetPeers *peers, size_t index,
+                          const KolibriFormula *formula) {
+  if (!peers || index >= peers->count || !formula) {
+    return -1;
+  }
+  uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
+  size_t len = kn_message_encode_formula(buffer, sizeof(buffer), peers->node_id,
+                                         formula);
+  if (len == 0) {
+    return -1;
+  }
+  struct iovec iov = {buffer, len};
+  return kn_peer_send_iov(peers, index, &iov, 1U);
+}
+
+int kn_peers_send_blob(KolibriNetPeers *peers, size_t index,
+                       const KolibriNetBlob *blob) {
+  if (!peers || index >= peers->count || !blob) {
+    return -1;
+  }
+  struct iovec iov[2];
+  size_t iov_count = kn_blob_iov(blob, iov);
+  return kn_peer_send_iov(peers, index, iov, iov_count);
+}
+
+size_t kn_peers_broadcast_blob(KolibriNetPeers *peers,
+                               const KolibriNetBlob *blob) {
+  size_t delivered = 0;
+  if (!peers || !blob) {
+    return 0;
+  }
+  kn_peers_connect_all(peers);
+  struct iovec iov[2];
+  for (size_t i = 0; i < peers->count; ++i) {
+    /* Peers still closed just failed to connect or are backing off. */
+    if (peers->items[i].socket_fd < 0) {
+      continue;
+    }
+    size_t iov_count = kn_blob_iov(blob, iov);
+    if (kn_peer_send_iov(peers, i, iov, iov_count) == 0) {
+      delivered++;
+    }
+  }
+  return delivered;
+}
+
+size_t kn_peers_broadcast_formula(KolibriNetPeers *peers,
+                                  const KolibriFormula *formula) {
+  if (!peers) {
+    return 0;
+  }
+  KolibriNetBlob *blob = kn_blob_formula(peers->node_id, formula);
+  size_t delivered = kn_peers_broadcast_blob(peers, blob);
+  kn_blob_release(blob);
+  return delivered;
+}
+
+static int kn_append(char *buffer, size_t buffer_len, size_t *used,
+                     const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + *used, buffer_len - *used, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= buffer_len - *used) {
+    return -1;
+  }
+  *used += (size_t)written;
+  return 0;
+}
+
+static uint64_t kn_peer_backoff_ms(const KolibriNetPeer *peer, uint64_t now_ms) {
+  if (peer->socket_fd >= 0 || peer->failures == 0 || now_ms >= peer->retry_at_ms) {
+    return 0;
+  }
+  return peer->retry_at_ms - now_ms;
+}
+
+int kn_peers_stats_json(const KolibriNetPeers *peers, char *buffer,
+                        size_t buffer_len) {
+  if (!peers || !buffer || buffer_len == 0) {
+    return -1;
+  }
+  uint64_t now_ms = kn_now_ms();
+  size_t used = 0;
+  if (kn_append(buffer, buffer_len, &used, "{\"peers\":[") != 0) {
+    return -1;
+  }
+  for (size_t i = 0; i < peers->count; ++i) {
+    const KolibriNetPeer *peer = &peers->items[i];
+    if (kn_append(buffer, buffer_len, &used,
+                  "%s{\"target\":\"%s:%u\",\"connected\":%s,\"sent\":%llu,"
+                  "\"errors\":%llu,\"failures\":%u,\"connect_us\":%u,"
+                  "\"send_us\":%u,\"backoff_ms\":%llu}",
+                  i ? "," : "", peer->host, (unsigned)peer->port,
+                  peer->socket_fd >= 0 ? "true" : "false",
+                  (unsigned long long)peer->sent,
+                  (unsigned long long)peer->errors, peer->failures,
+                  peer->connect_us, peer->send_us,
+                  (unsigned long long)kn_peer_backoff_ms(peer, now_ms)) != 0) {
+      return -1;
+    }
+  }
+  if (kn_append(buffer, buffer_len, &used, "]}") != 0) {
+    return -1;
+  }
+  return (int)used;
+}
+
+int kn_peers_stats_prometheus(const KolibriNetPeers *peers, char *buffer,
+                              size_t buffer_len) {
+  if (!peers || !buffer || buffer_len == 0) {
+    return -1;
+  }
+  static const struct {
+    const char *name;
+    const char *type;
+  } metrics[] = {
+      {"kolibri_peer_sent_total", "counter"},
+      {"kolibri_peer_errors_total", "counter"},
+      {"kolibri_peer_failures", "gauge"},
+      {"kolibri_peer_connected", "gauge"},
+      {"kolibri_peer_connect_seconds", "gauge"},
+      {"kolibri_peer_send_seconds", "gauge"},
+      {"kolibri_peer_backoff_seconds", "gauge"},
+  };
+  uint64_t now_ms = kn_now_ms();
+  size_t used = 0;
+  buffer[0] = '\0';
+  for (size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); ++m) {
+    if (kn_append(buffer, buffer_len, &used, "# TYPE %s %s\n", metrics[m].name,
+                  metrics[m].type) != 0) {
+      return -1;
+    }
+    for (size_t i = 0; i < peers->count; ++i) {
+      const KolibriNetPeer *peer = &peers->items[i];
+      double value = 0.0;
+      switch (m) {
+      case 0: value = (double)peer->sent; break;
+      case 1: value = (double)peer->errors; break;
+      case 2: value = (double)peer->failures; break;
+      case 3: value = peer->socket_fd >= 0 ? 1.0 : 0.0; break;
+      case 4: value = (double)peer->connect_us / 1e6; break;
+      case 5: value = (double)peer->send_us / 1e6; break;
+      default: value = (double)kn_peer_backoff_ms(peer, now_ms) / 1e3; break;
+      }
+      if (kn_append(buffer, buffer_len, &used, "%s{target=\"%s:%u\"} %.6g\n",
+                    metrics[m].name, peer->host, (unsigned)peer->port,
+                    value) != 0) {
+        return -1;
+      }
+    }
+  }
+  return (int)used;
+}
+
+void kn_peers_close(KolibriNetPeers *peers) {
+  if (!peers) {
+    return;
+  }
+  for (size_t i = 0; i < peers->count; ++i) {
+    if (peers->items[i].socket_fd >= 0) {
+      close(peers->items[i].socket_fd);
+    }
+  }
+  free(peers->items);
+  peers->items = NULL;
+  peers->count = 0;
+  peers->capacity = 0;
+}
+
 int kn_listener_start(KolibriNetListener *listener, uint16_t port) {
   if (!listener) {
     return -1;
   }
+  listener->clients = NULL;
+  listener->client_count = 0;
+  listener->client_capacity = 0;
+  listener->next_client = 0;
+  listener->poller = -1;
 
   int sockfd = socket(AF_INET, SOCK_STREAM, 0);
   if (sockfd < 0) {
@@ -304,103 +801,267 @@ int kn_listener_start(KolibriNetListener *listener, uint16_t port) {
     return -1;
   }
 
-  if (listen(sockfd, 4) < 0) {
+  if (listen(sockfd, 64) < 0) {
     close(sockfd);
     listener->socket_fd = -1;
     return -1;
   }
+  fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+#if KOLIBRI_NET_EPOLL
+  /* Event data is the client index + 1; 0 marks the listening socket. */
+  listener->poller = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = 0;
+  if (listener->poller < 0 ||
+      epoll_ctl(listener->poller, EPOLL_CTL_ADD, sockfd, &ev) != 0) {
+    if (listener->poller >= 0) {
+      close(listener->poller);
+      listener->poller = -1;
+    }
+    close(sockfd);
+    listener->socket_fd = -1;
+    return -1;
+  }
+#endif
 
   listener->socket_fd = sockfd;
   listener->port = port;
   return 0;
 }
 
-int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms,
-                     KolibriNetMessage *out_message) {
-  if (!listener || listener->socket_fd < 0 || !out_message) {
-    return -1;
+static void kn_listener_drop(KolibriNetListener *listener, size_t index) {
+  close(listener->clients[index].fd);
+  listener->client_count--;
+  if (index != listener->client_count) {
+    listener->clients[index] = listener->clients[listener->client_count];
+#if KOLIBRI_NET_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = index + 1U;
+    epoll_ctl(listener->poller, EPOLL_CTL_MOD, listener->clients[index].fd, &ev);
+#endif
+  }
+}
+
+/*
+ * Takes the next complete frame from the buffered clients, round robin.
+ * Frames that do not decode are skipped; a client announcing an oversized
+ * frame is dropped since its stream can no longer be framed.
+ */
+static int kn_listener_take(KolibriNetListener *listener,
+                            KolibriNetMessage *out_message) {
+  for (size_t step = 0; step < listener->client_count;) {
+    size_t index = (listener->next_client + step) % listener->client_count;
+    KolibriNetConnection *client = &listener->clients[index];
+    if (client->used < KOLIBRI_HEADER_SIZE) {
+      step++;
+      continue;
+    }
+    uint16_t payload_len;
+    memcpy(&payload_len, &client->buffer[1], sizeof(payload_len));
+    payload_len = ntohs(payload_len);
+    if (payload_len > KOLIBRI_MAX_PAYLOAD) {
+      kn_listener_drop(listener, index);
+      continue;
+    }
+    size_t frame_len = KOLIBRI_HEADER_SIZE + payload_len;
+    if (client->used < frame_len) {
+      step++;
+      continue;
+    }
+    int status = kn_message_decode(client->buffer, frame_len, out_message);
+    client->used -= frame_len;
+    memmove(client->buffer, client->buffer + frame_len, client->used);
+    if (status == 0) {
+      listener->next_client = index + 1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static size_t kn_listener_take_many(KolibriNetListener *listener,
+                                    KolibriNetMessage *messages,
+                                    size_t capacity) {
+  size_t count = 0;
+  while (count < capacity && kn_listener_take(listener, &messages[count])) {
+    count++;
   }
+  return count;
+}
 
+static void kn_listener_accept(KolibriNetListener *listener) {
+  for (;;) {
+    int client_fd = accept(listener->socket_fd, NULL, NULL);
+    if (client_fd < 0) {
+      return;
+    }
+    if (listener->client_count == listener->client_capacity) {
+      size_t capacity =
+          listener->client_capacity ? listener->client_capacity * 2U : 8U;
+      KolibriNetConnection *clients =
+          realloc(listener->clients, capacity * sizeof(*clients));
+      if (!clients) {
+        close(client_fd);
+        return;
+      }
+      listener->clients = clients;
+      listener->client_capacity = capacity;
+    }
+#if !KOLIBRI_NET_EPOLL
+    if (client_fd >= FD_SETSIZE) {
+      close(client_fd);
+      continue;
+    }
+#endif
+    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL, 0) | O_NONBLOCK);
+    size_t index = listener->client_count;
+#if KOLIBRI_NET_EPOLL
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = index + 1U;
+    if (epoll_ctl(listener->poller, EPOLL_CTL_ADD, client_fd, &ev) != 0) {
+      close(client_fd);
+      continue;
+    }
+#endif
+    listener->clients[index].fd = client_fd;
+    listener->clients[index].used = 0;
+    listener->client_count++;
+  }
+}
+
+/* Reads what fits into the client's frame buffer; drops closed peers. */
+static void kn_listener_read(KolibriNetListener *listener, size_t index) {
+  KolibriNetConnection *client = &listener->clients[index];
+  if (client->used == sizeof(client->buffer)) {
+    return;
+  }
+  ssize_t received = recv(client->fd, client->buffer + client->used,
+                          sizeof(client->buffer) - client->used, 0);
+  if (received > 0) {
+    client->used += (size_t)received;
+  } else if (received == 0 ||
+             (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    kn_listener_drop(listener, index);
+  }
+}
+
+size_t kn_listener_poll_many(KolibriNetListener *listener, uint32_t timeout_ms,
+                             KolibriNetMessage *messages, size_t capacity) {
+  if (!listener || listener->socket_fd < 0 || !messages || capacity == 0) {
+    return 0;
+  }
+  size_t count = kn_listener_take_many(listener, messages, capacity);
+  if (count > 0) {
+    return count;
+  }
+
+  /* UINT32_MAX waits indefinitely; 0 only checks what is ready. */
+#if KOLIBRI_NET_EPOLL
+  int timeout = timeout_ms == UINT32_MAX  ? -1
+                : timeout_ms > INT32_MAX ? INT32_MAX
+                                         : (int)timeout_ms;
+  struct epoll_event events[KOLIBRI_NET_EVENT_BATCH];
+  int ready = epoll_wait(listener->poller, events, KOLIBRI_NET_EVENT_BATCH,
+                         timeout);
+  if (ready <= 0) {
+    return 0;
+  }
+  bool accept_pending = false;
+  /* Highest index first, so a drop never moves a client still to be read. */
+  uint64_t order[KOLIBRI_NET_EVENT_BATCH];
+  size_t pending = 0;
+  for (int i = 0; i < ready; ++i) {
+    if (events[i].data.u64 == 0) {
+      accept_pending = true;
+    } else {
+      order[pending++] = events[i].data.u64;
+    }
+  }
+  qsort(order, pending, sizeof(order[0]), kn_compare_desc);
+  for (size_t i = 0; i < pending; ++i) {
+    size_t index = (size_t)order[i] - 1U;
+    if (index < listener->client_count) {
+      kn_listener_read(listener, index);
+    }
+  }
+  if (accept_pending) {
+    kn_listener_accept(listener);
+  }
+#else
   fd_set readfds;
   FD_ZERO(&readfds);
   FD_SET(listener->socket_fd, &readfds);
+  int max_fd = listener->socket_fd;
+  for (size_t i = 0; i < listener->client_count; ++i) {
+    FD_SET(listener->clients[i].fd, &readfds);
+    if (listener->clients[i].fd > max_fd) {
+      max_fd = listener->clients[i].fd;
+    }
+  }
 
   struct timeval tv;
   struct timeval *timeout_ptr = NULL;
   if (timeout_ms != UINT32_MAX) {
-    /* Pass an explicit zeroed timeval when timeout_ms == 0 to preserve
-       non-blocking semantics. UINT32_MAX can be used to wait indefinitely. */
     tv.tv_sec = timeout_ms / 1000U;
     tv.tv_usec = (timeout_ms % 1000U) * 1000U;
     timeout_ptr = &tv;
   }
 
-  int ready = select(listener->socket_fd + 1, &readfds, NULL, NULL, timeout_ptr);
-  if (ready < 0) {
-    if (errno == EINTR) {
-      return 0;
-    }
-    return -1;
-  }
-  if (ready == 0) {
+  int ready = select(max_fd + 1, &readfds, NULL, NULL, timeout_ptr);
+  if (ready <= 0) {
     return 0;
   }
-
-  struct sockaddr_in client_addr;
-  socklen_t client_len = sizeof(client_addr);
-  int client_fd = accept(listener->socket_fd, (struct sockaddr *)&client_addr,
-                         &client_len);
-  if (client_fd < 0) {
-    return -1;
-  }
-
-  uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
-
-  KolibriNetMessage last_message;
-  bool has_last = false;
-
-  while (true) {
-    if (kolibri_recv_all(client_fd, buffer, KOLIBRI_HEADER_SIZE) != 0) {
-      break;
-    }
-    uint16_t payload_len;
-    memcpy(&payload_len, &buffer[1], sizeof(payload_len));
-    payload_len = ntohs(payload_len);
-    if (payload_len > KOLIBRI_MAX_PAYLOAD) {
-      break;
-    }
-    if (kolibri_recv_all(client_fd, buffer + KOLIBRI_HEADER_SIZE,
-                         payload_len) != 0) {
-      break;
-    }
-    size_t message_len = KOLIBRI_HEADER_SIZE + payload_len;
-    KolibriNetMessage decoded;
-    if (kn_message_decode(buffer, message_len, &decoded) == 0) {
-      has_last = true;
-      last_message = decoded;
-      if (decoded.type == KOLIBRI_MSG_MIGRATE_RULE) {
-        *out_message = decoded;
-        close(client_fd);
-        return 1;
-      }
-      continue;
+  for (size_t i = listener->client_count; i-- > 0;) {
+    if (FD_ISSET(listener->clients[i].fd, &readfds)) {
+      kn_listener_read(listener, i);
     }
   }
+  if (FD_ISSET(listener->socket_fd, &readfds)) {
+    kn_listener_accept(listener);
+  }
+#endif
+  return kn_listener_take_many(listener, messages, capacity);
+}
 
-  if (has_last) {
-    *out_message = last_message;
-    close(client_fd);
-    return 1;
+int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms,
+                     KolibriNetMessage *out_message) {
+  if (!listener || listener->socket_fd < 0 || !out_message) {
+    return -1;
   }
+  return kn_listener_poll_many(listener, timeout_ms, out_message, 1U) > 0 ? 1 : 0;
+}
 
-  close(client_fd);
+int kn_listener_fd(const KolibriNetListener *listener) {
+#if KOLIBRI_NET_EPOLL
+  return listener && listener->socket_fd >= 0 ? listener->poller : -1;
+#else
+  (void)listener;
   return -1;
+#endif
 }
 
 void kn_listener_close(KolibriNetListener *listener) {
   if (!listener) {
     return;
   }
+  for (size_t i = 0; i < listener->client_count; ++i) {
+    close(listener->clients[i].fd);
+  }
+  free(listener->clients);
+  listener->clients = NULL;
+  listener->client_count = 0;
+  listener->client_capacity = 0;
+  if (listener->poller >= 0) {
+    close(listener->poller);
+  }
+  listener->poller = -1;
   if (listener->socket_fd >= 0) {
     close(listener->socket_fd);
   }
@@ -2,10 +2,15 @@
  * Copyright (c) 2025 Кочуров Владислав Евгеньевич
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
 #include "kolibri/roy.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <pthread.h>
 #include <stdio.h>
@@ -16,10 +21,33 @@
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define KOLIBRI_ROY_EPOLL 1
+#define KOLIBRI_ROY_MMSG 1
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#define KOLIBRI_ROY_EVP_MAC 1
+#endif
+
 #define KOLIBRI_ROY_VERSIYA 1U
 #define KOLIBRI_ROY_TYP_HELLO 1U
 #define KOLIBRI_ROY_TYP_FORMULA 2U
+#define KOLIBRI_ROY_TYP_OBMEN 3U
+#define KOLIBRI_ROY_TYP_ANONS 4U
+#define KOLIBRI_ROY_TYP_ZAPROS 5U
+#define KOLIBRI_ROY_TYP_GENY 6U
+/* Первый байт нагрузки анонса, запроса и пачки генов — версия их формата. */
+#define KOLIBRI_ROY_FORMAT_ANONSA 1U
 #define KOLIBRI_ROY_MAKSIMALNYJ_PAKET 512U
+/* Датаграмм на один вызов recvmmsg/sendmmsg. */
+#define KOLIBRI_ROY_PACHKA 16U
+/* Соседей в одной выборке обмена видами; запись — id, IPv4 и порт. */
+#define KOLIBRI_ROY_OBMEN_DLINA 8U
+#define KOLIBRI_ROY_OBMEN_ZAPIS 10U
 
 /* Преобразует число из хоста в сетевой порядок для 64 бит. */
 static uint64_t kolibri_htonll(uint64_t znachenie) {
@@ -43,21 +71,107 @@ static uint64_t kolibri_ntohll(uint64_t znachenie) {
 #endif
 }
 
-/* Внутренний помощник для записи события в очередь. */
+/* Внутренний помощник для записи события в очередь; пишет только поток приёма. */
 static void kolibri_roy_postavit_sobytie(KolibriRoy *roy,
                                          const KolibriRoySobytie *sobytie) {
 
-    pthread_mutex_lock(&roy->ochered_zamek);
-    if (roy->ochered_schetchik == KOLIBRI_ROY_MAX_OCHERED) {
-        /* Переполнение очереди: перезаписываем самое старое событие. */
-        roy->ochered_golova =
-            (roy->ochered_golova + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-        roy->ochered_schetchik--;
+    size_t hvost = roy->ochered_hvost;
+    size_t golova = __atomic_load_n(&roy->ochered_golova, __ATOMIC_ACQUIRE);
+    if (hvost - golova >= roy->ochered_glubina) {
+        /* Очередь полна: новое событие теряется, старые остаются. */
+        __atomic_add_fetch(&roy->ochered_poteri, 1U, __ATOMIC_RELAXED);
+        return;
+    }
+    roy->ochered[hvost & (roy->ochered_glubina - 1U)] = *sobytie;
+    __atomic_store_n(&roy->ochered_hvost, hvost + 1U, __ATOMIC_RELEASE);
+}
+
+/* Ключевой контекст HMAC-SHA256: пады ключа считаются один раз при запуске. */
+static void *kolibri_roy_hmac_sozdat(const KolibriRoy *roy) {
+
+#if defined(KOLIBRI_ROY_EVP_MAC)
+    EVP_MAC *mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    if (!mac) {
+        return NULL;
+    }
+    EVP_MAC_CTX *kontekst = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    if (!kontekst) {
+        return NULL;
+    }
+    OSSL_PARAM parametry[2];
+    parametry[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                    (char *)"SHA256", 0);
+    parametry[1] = OSSL_PARAM_construct_end();
+    if (EVP_MAC_init(kontekst, roy->klyuch, roy->dlina_klyucha, parametry) != 1) {
+        EVP_MAC_CTX_free(kontekst);
+        return NULL;
+    }
+    return kontekst;
+#else
+    HMAC_CTX *kontekst = HMAC_CTX_new();
+    if (!kontekst) {
+        return NULL;
+    }
+    if (HMAC_Init_ex(kontekst, roy->klyuch, (int)roy->dlina_klyucha, EVP_sha256(),
+                     NULL) != 1) {
+        HMAC_CTX_free(kontekst);
+        return NULL;
+    }
+    return kontekst;
+#endif
+}
+
+static void kolibri_roy_hmac_osvobodit(void *kontekst) {
+
+#if defined(KOLIBRI_ROY_EVP_MAC)
+    EVP_MAC_CTX_free((EVP_MAC_CTX *)kontekst);
+#else
+    HMAC_CTX_free((HMAC_CTX *)kontekst);
+#endif
+}
+
+/* Копия ключевого контекста для одного сообщения; NULL без памяти. */
+static void *kolibri_roy_hmac_kopiya(const void *shablon) {
+
+#if defined(KOLIBRI_ROY_EVP_MAC)
+    return EVP_MAC_CTX_dup((const EVP_MAC_CTX *)shablon);
+#else
+    HMAC_CTX *kontekst = HMAC_CTX_new();
+    if (kontekst && HMAC_CTX_copy(kontekst, (HMAC_CTX *)shablon) != 1) {
+        HMAC_CTX_free(kontekst);
+        return NULL;
     }
-    roy->ochered[roy->ochered_hvost] = *sobytie;
-    roy->ochered_hvost = (roy->ochered_hvost + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-    roy->ochered_schetchik++;
-    pthread_mutex_unlock(&roy->ochered_zamek);
+    return kontekst;
+#endif
+}
+
+/*
+ * Считает HMAC сообщения. zanovo перезапускает уже использованный контекст с
+ * сохранёнными падами ключа, без повторного вывода ключа.
+ */
+static int kolibri_roy_hmac_vychislit(void *kontekst, int zanovo,
+                                      const uint8_t *dannye, size_t dlina,
+                                      unsigned char *rezultat) {
+
+#if defined(KOLIBRI_ROY_EVP_MAC)
+    EVP_MAC_CTX *mac = (EVP_MAC_CTX *)kontekst;
+    size_t gotovo = 0U;
+    if ((zanovo && EVP_MAC_init(mac, NULL, 0U, NULL) != 1) ||
+        EVP_MAC_update(mac, dannye, dlina) != 1 ||
+        EVP_MAC_final(mac, rezultat, &gotovo, KOLIBRI_ROY_HMAC_SIZE) != 1) {
+        return -1;
+    }
+#else
+    HMAC_CTX *mac = (HMAC_CTX *)kontekst;
+    unsigned int gotovo = 0U;
+    if ((zanovo && HMAC_Init_ex(mac, NULL, 0, NULL, NULL) != 1) ||
+        HMAC_Update(mac, dannye, dlina) != 1 ||
+        HMAC_Final(mac, rezultat, &gotovo) != 1) {
+        return -1;
+    }
+#endif
+    return gotovo == KOLIBRI_ROY_HMAC_SIZE ? 0 : -1;
 }
 
 /* Сравнивает два HMAC и защищает от атак по времени. */
@@ -71,31 +185,238 @@ static int kolibri_roy_sravnit_hmac(const unsigned char *levyj,
     return rezultat == 0U ? 0 : -1;
 }
 
-/* Обновляет или создаёт запись о соседе. */
+static uint32_t kolibri_roy_hesh(uint64_t klyuch) {
+
+    klyuch ^= klyuch >> 33;
+    klyuch *= 0xff51afd7ed558ccdULL;
+    klyuch ^= klyuch >> 33;
+    return (uint32_t)klyuch;
+}
+
+static uint64_t kolibri_roy_klyuch_adresa(const struct sockaddr_in *adres) {
+
+    return ((uint64_t)adres->sin_addr.s_addr << 16) | adres->sin_port;
+}
+
+/* Номер соседа с этим идентификатором или SIZE_MAX. */
+static size_t kolibri_roy_najti_id(const KolibriRoy *roy, uint32_t identifikator) {
+
+    if (!roy->indeks_id) {
+        return SIZE_MAX;
+    }
+    size_t maska = roy->chislo_yacheek - 1U;
+    for (size_t yachejka = kolibri_roy_hesh(identifikator) & maska;;
+         yachejka = (yachejka + 1U) & maska) {
+        uint32_t zapis = roy->indeks_id[yachejka];
+        if (zapis == 0U) {
+            return SIZE_MAX;
+        }
+        if (roy->sosedi[zapis - 1U].identifikator == identifikator) {
+            return zapis - 1U;
+        }
+    }
+}
+
+/* Номер соседа с этим адресом и портом или SIZE_MAX. */
+static size_t kolibri_roy_najti_adres(const KolibriRoy *roy,
+                                      const struct sockaddr_in *adres) {
+
+    if (!roy->indeks_adres) {
+        return SIZE_MAX;
+    }
+    uint64_t klyuch = kolibri_roy_klyuch_adresa(adres);
+    size_t maska = roy->chislo_yacheek - 1U;
+    for (size_t yachejka = kolibri_roy_hesh(klyuch) & maska;;
+         yachejka = (yachejka + 1U) & maska) {
+        uint32_t zapis = roy->indeks_adres[yachejka];
+        if (zapis == 0U) {
+            return SIZE_MAX;
+        }
+        if (kolibri_roy_klyuch_adresa(&roy->sosedi[zapis - 1U].adres) == klyuch) {
+            return zapis - 1U;
+        }
+    }
+}
+
+static void kolibri_roy_vstavit_v_indeks(KolibriRoy *roy, size_t nomer) {
+
+    size_t maska = roy->chislo_yacheek - 1U;
+    size_t yachejka = kolibri_roy_hesh(roy->sosedi[nomer].identifikator) & maska;
+    while (roy->indeks_id[yachejka] != 0U) {
+        yachejka = (yachejka + 1U) & maska;
+    }
+    roy->indeks_id[yachejka] = (uint32_t)nomer + 1U;
+    yachejka = kolibri_roy_hesh(kolibri_roy_klyuch_adresa(&roy->sosedi[nomer].adres)) & maska;
+    while (roy->indeks_adres[yachejka] != 0U) {
+        yachejka = (yachejka + 1U) & maska;
+    }
+    roy->indeks_adres[yachejka] = (uint32_t)nomer + 1U;
+}
+
+static void kolibri_roy_perestroit_indeks(KolibriRoy *roy) {
+
+    memset(roy->indeks_id, 0, roy->chislo_yacheek * sizeof(uint32_t));
+    memset(roy->indeks_adres, 0, roy->chislo_yacheek * sizeof(uint32_t));
+    for (size_t nomer = 0U; nomer < roy->chislo_sosedey; ++nomer) {
+        kolibri_roy_vstavit_v_indeks(roy, nomer);
+    }
+}
+
+/* Удваивает таблицу соседей и её индексы; -1 на пределе или без памяти. */
+static int kolibri_roy_rasshirit(KolibriRoy *roy) {
+
+    size_t emkost = roy->emkost_sosedey ? roy->emkost_sosedey * 2U
+                                        : KOLIBRI_ROY_MAX_SOSSEDI;
+    if (emkost > KOLIBRI_ROY_PREDEL_SOSEDEJ) {
+        emkost = KOLIBRI_ROY_PREDEL_SOSEDEJ;
+    }
+    if (emkost <= roy->emkost_sosedey) {
+        return -1;
+    }
+    KolibriRoySosed *sosedi = realloc(roy->sosedi, emkost * sizeof(*sosedi));
+    if (!sosedi) {
+        return -1;
+    }
+    roy->sosedi = sosedi;
+    uint32_t *po_id = calloc(emkost * 2U, sizeof(uint32_t));
+    uint32_t *po_adresu = calloc(emkost * 2U, sizeof(uint32_t));
+    if (!po_id || !po_adresu) {
+        free(po_id);
+        free(po_adresu);
+        return -1;
+    }
+    free(roy->indeks_id);
+    free(roy->indeks_adres);
+    roy->indeks_id = po_id;
+    roy->indeks_adres = po_adresu;
+    roy->chislo_yacheek = emkost * 2U;
+    roy->emkost_sosedey = emkost;
+    kolibri_roy_perestroit_indeks(roy);
+    return 0;
+}
+
+/* xorshift64* для выбора соседей вида; вызывается под zamek. */
+static uint64_t kolibri_roy_sluchajnoe(KolibriRoy *roy) {
+
+    uint64_t x = roy->sluchaj ? roy->sluchaj : 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    roy->sluchaj = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* Желаемый размер вида: число бит в N плюс один, но не больше N. */
+static size_t kolibri_roy_celevoj_vid(size_t chislo) {
+
+    size_t bity = 0U;
+    for (size_t ostatok = chislo; ostatok > 0U; ostatok >>= 1) {
+        bity++;
+    }
+    size_t razmer = bity + 1U;
+    if (razmer > chislo) {
+        razmer = chislo;
+    }
+    return razmer < KOLIBRI_ROY_MAX_VID ? razmer : KOLIBRI_ROY_MAX_VID;
+}
+
+static size_t kolibri_roy_v_vide(const KolibriRoy *roy, uint32_t identifikator) {
+
+    for (size_t pozitsiya = 0U; pozitsiya < roy->razmer_vida; ++pozitsiya) {
+        if (roy->vid[pozitsiya] == identifikator) {
+            return pozitsiya;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static void kolibri_roy_vid_udalit(KolibriRoy *roy, size_t pozitsiya) {
+
+    roy->razmer_vida--;
+    roy->vid[pozitsiya] = roy->vid[roy->razmer_vida];
+    roy->vid_vozrast[pozitsiya] = roy->vid_vozrast[roy->razmer_vida];
+}
+
+/* Берёт соседа в вид, если там есть место. */
+static void kolibri_roy_vid_dobavit(KolibriRoy *roy, uint32_t identifikator) {
+
+    if (roy->razmer_vida >= kolibri_roy_celevoj_vid(roy->chislo_sosedey) ||
+        kolibri_roy_v_vide(roy, identifikator) != SIZE_MAX) {
+        return;
+    }
+    roy->vid[roy->razmer_vida] = identifikator;
+    roy->vid_vozrast[roy->razmer_vida] = 0U;
+    roy->razmer_vida++;
+}
+
+/*
+ * Убирает из вида забытых соседей, старейших сверх желаемого размера и
+ * добирает недостающих случайными соседями из таблицы.
+ */
+static void kolibri_roy_vid_popolnit(KolibriRoy *roy) {
+
+    for (size_t pozitsiya = 0U; pozitsiya < roy->razmer_vida;) {
+        if (kolibri_roy_najti_id(roy, roy->vid[pozitsiya]) == SIZE_MAX) {
+            kolibri_roy_vid_udalit(roy, pozitsiya);
+        } else {
+            pozitsiya++;
+        }
+    }
+    size_t cel = kolibri_roy_celevoj_vid(roy->chislo_sosedey);
+    while (roy->razmer_vida > cel) {
+        size_t starejshij = 0U;
+        for (size_t pozitsiya = 1U; pozitsiya < roy->razmer_vida; ++pozitsiya) {
+            if (roy->vid_vozrast[pozitsiya] > roy->vid_vozrast[starejshij]) {
+                starejshij = pozitsiya;
+            }
+        }
+        kolibri_roy_vid_udalit(roy, starejshij);
+    }
+    for (size_t popytka = 0U; roy->razmer_vida < cel && popytka < 4U * cel; ++popytka) {
+        size_t nomer = (size_t)(kolibri_roy_sluchajnoe(roy) % roy->chislo_sosedey);
+        kolibri_roy_vid_dobavit(roy, roy->sosedi[nomer].identifikator);
+    }
+}
+
+/*
+ * Обновляет или создаёт запись о соседе. Сосед, услышанный от третьего узла
+ * (otklik == 0), только добавляется: его срок продлевает лишь он сам.
+ */
 static void kolibri_roy_obnovit_soseda(KolibriRoy *roy, uint32_t identifikator,
-                                       const struct sockaddr_in *adres) {
+                                       const struct sockaddr_in *adres,
+                                       int otklik) {
 
     pthread_mutex_lock(&roy->zamek);
-    size_t indeks = 0U;
-    for (; indeks < roy->chislo_sosedey; ++indeks) {
-        if (roy->sosedi[indeks].identifikator == identifikator ||
-            (roy->sosedi[indeks].adres.sin_addr.s_addr ==
-                 adres->sin_addr.s_addr &&
-             roy->sosedi[indeks].adres.sin_port == adres->sin_port)) {
-            roy->sosedi[indeks].identifikator = identifikator;
-            roy->sosedi[indeks].adres = *adres;
-            roy->sosedi[indeks].poslednij_otklik = time(NULL);
-            roy->sosedi[indeks].neudachi = 0U;
-            pthread_mutex_unlock(&roy->zamek);
-            return;
+    size_t nomer = kolibri_roy_najti_id(roy, identifikator);
+    if (nomer == SIZE_MAX) {
+        nomer = kolibri_roy_najti_adres(roy, adres);
+    }
+    if (nomer != SIZE_MAX) {
+        if (otklik) {
+            KolibriRoySosed *sosed = &roy->sosedi[nomer];
+            int perestroit = sosed->identifikator != identifikator ||
+                             kolibri_roy_klyuch_adresa(&sosed->adres) !=
+                                 kolibri_roy_klyuch_adresa(adres);
+            sosed->identifikator = identifikator;
+            sosed->adres = *adres;
+            sosed->poslednij_otklik = time(NULL);
+            sosed->neudachi = 0U;
+            if (perestroit) {
+                kolibri_roy_perestroit_indeks(roy);
+            }
         }
+        pthread_mutex_unlock(&roy->zamek);
+        return;
     }
-    if (roy->chislo_sosedey < KOLIBRI_ROY_MAX_SOSSEDI) {
-        roy->sosedi[roy->chislo_sosedey].identifikator = identifikator;
-        roy->sosedi[roy->chislo_sosedey].adres = *adres;
-        roy->sosedi[roy->chislo_sosedey].poslednij_otklik = time(NULL);
-        roy->sosedi[roy->chislo_sosedey].neudachi = 0U;
-        roy->chislo_sosedey++;
+    if (roy->chislo_sosedey < roy->emkost_sosedey ||
+        kolibri_roy_rasshirit(roy) == 0) {
+        nomer = roy->chislo_sosedey++;
+        roy->sosedi[nomer].identifikator = identifikator;
+        roy->sosedi[nomer].adres = *adres;
+        roy->sosedi[nomer].poslednij_otklik = time(NULL);
+        roy->sosedi[nomer].neudachi = 0U;
+        kolibri_roy_vstavit_v_indeks(roy, nomer);
+        kolibri_roy_vid_dobavit(roy, identifikator);
     }
     pthread_mutex_unlock(&roy->zamek);
 }
@@ -116,7 +437,11 @@ static void kolibri_roy_ochistit_sosedey(KolibriRoy *roy) {
         }
         zapis++;
     }
-    roy->chislo_sosedey = zapis;
+    if (zapis != roy->chislo_sosedey) {
+        roy->chislo_sosedey = zapis;
+        kolibri_roy_perestroit_indeks(roy);
+        kolibri_roy_vid_popolnit(roy);
+    }
     pthread_mutex_unlock(&roy->zamek);
 }
 
@@ -145,20 +470,25 @@ static size_t kolibri_roy_zapolnit_zagolovok(const KolibriRoy *roy, uint8_t tip,
     return offset;
 }
 
-/* Вычисляет и присоединяет HMAC к концу пакета. */
+/*
+ * Вычисляет и присоединяет HMAC к концу пакета. Отправляют разные потоки,
+ * поэтому каждое сообщение подписывает своя копия ключевого контекста.
+ */
 static size_t kolibri_roy_prisoedinit_hmac(const KolibriRoy *roy,
                                            uint8_t *buffer,
                                            size_t tekushchaya_dlina) {
 
-    unsigned int hmac_dlina = 0U;
-    unsigned char hmac[KOLIBRI_ROY_HMAC_SIZE];
-    unsigned char *result =
-        HMAC(EVP_sha256(), roy->klyuch, (int)roy->dlina_klyucha, buffer,
-             tekushchaya_dlina, hmac, &hmac_dlina);
-    if (!result || hmac_dlina < KOLIBRI_ROY_HMAC_SIZE) {
+    void *kontekst = roy->hmac_shablon ? kolibri_roy_hmac_kopiya(roy->hmac_shablon)
+                                       : NULL;
+    if (!kontekst) {
+        return 0U;
+    }
+    int oshibka = kolibri_roy_hmac_vychislit(kontekst, 0, buffer, tekushchaya_dlina,
+                                             buffer + tekushchaya_dlina);
+    kolibri_roy_hmac_osvobodit(kontekst);
+    if (oshibka != 0) {
         return 0U;
     }
-    memcpy(buffer + tekushchaya_dlina, hmac, KOLIBRI_ROY_HMAC_SIZE);
     return tekushchaya_dlina + KOLIBRI_ROY_HMAC_SIZE;
 }
 
@@ -203,21 +533,19 @@ kolibri_roy_soobshchenie_privet(KolibriRoy *roy,
     return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
 }
 
-/* Собирает и отправляет формулу. */
-static int
-kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
-                                 const struct sockaddr_in *naznachenie,
-                                 const KolibriFormula *formula) {
+/* Собирает пакет с формулой; возвращает его длину или 0. */
+static size_t kolibri_roy_sobrat_formulu(const KolibriRoy *roy,
+                                         const KolibriFormula *formula,
+                                         uint8_t *paket, size_t razmer) {
 
-    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
     uint8_t payload[64];
     size_t offset = 0U;
     if (!formula) {
-        return -1;
+        return 0U;
     }
     uint8_t dlina = (uint8_t)formula->gene.length;
     if (dlina == 0U || dlina > sizeof(formula->gene.digits)) {
-        return -1;
+        return 0U;
     }
     payload[offset++] = dlina;
     memcpy(payload + offset, formula->gene.digits, dlina);
@@ -229,9 +557,74 @@ kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
     offset += sizeof(kody);
 
     size_t zagolovok = kolibri_roy_zapolnit_zagolovok(
-        roy, KOLIBRI_ROY_TYP_FORMULA, paket, sizeof(paket), (uint16_t)offset);
+        roy, KOLIBRI_ROY_TYP_FORMULA, paket, razmer, (uint16_t)offset);
     if (zagolovok == 0U ||
-        zagolovok + offset + KOLIBRI_ROY_HMAC_SIZE > sizeof(paket)) {
+        zagolovok + offset + KOLIBRI_ROY_HMAC_SIZE > razmer) {
+        return 0U;
+    }
+    memcpy(paket + zagolovok, payload, offset);
+    return kolibri_roy_prisoedinit_hmac(roy, paket, zagolovok + offset);
+}
+
+/* Собирает и отправляет формулу. */
+static int
+kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
+                                 const struct sockaddr_in *naznachenie,
+                                 const KolibriFormula *formula) {
+
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t polnaja_dlina =
+        kolibri_roy_sobrat_formulu(roy, formula, paket, sizeof(paket));
+    if (polnaja_dlina == 0U) {
+        return -1;
+    }
+    return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
+}
+
+/* До KOLIBRI_ROY_OBMEN_DLINA соседей вида, кроме krome; вызывается под zamek. */
+static size_t kolibri_roy_vyborka(KolibriRoy *roy, uint32_t krome,
+                                  KolibriRoySosed *vyborka) {
+
+    size_t chislo = 0U;
+    if (roy->razmer_vida == 0U) {
+        return 0U;
+    }
+    size_t nachalo = (size_t)(kolibri_roy_sluchajnoe(roy) % roy->razmer_vida);
+    for (size_t shag = 0U; shag < roy->razmer_vida && chislo < KOLIBRI_ROY_OBMEN_DLINA;
+         ++shag) {
+        uint32_t identifikator = roy->vid[(nachalo + shag) % roy->razmer_vida];
+        size_t nomer = kolibri_roy_najti_id(roy, identifikator);
+        if (identifikator != krome && nomer != SIZE_MAX) {
+            vyborka[chislo++] = roy->sosedi[nomer];
+        }
+    }
+    return chislo;
+}
+
+/* Собирает и отправляет выборку вида: запрос обмена или ответ на него. */
+static int kolibri_roy_soobshchenie_obmen(KolibriRoy *roy,
+                                          const struct sockaddr_in *naznachenie,
+                                          uint8_t otvet,
+                                          const KolibriRoySosed *vyborka,
+                                          size_t chislo) {
+
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    uint8_t payload[2U + KOLIBRI_ROY_OBMEN_DLINA * KOLIBRI_ROY_OBMEN_ZAPIS];
+    size_t offset = 0U;
+    payload[offset++] = otvet;
+    payload[offset++] = (uint8_t)chislo;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        uint32_t id = htonl(vyborka[indeks].identifikator);
+        memcpy(payload + offset, &id, sizeof(id));
+        offset += sizeof(id);
+        memcpy(payload + offset, &vyborka[indeks].adres.sin_addr.s_addr, 4U);
+        offset += 4U;
+        memcpy(payload + offset, &vyborka[indeks].adres.sin_port, 2U);
+        offset += 2U;
+    }
+    size_t zagolovok = kolibri_roy_zapolnit_zagolovok(
+        roy, KOLIBRI_ROY_TYP_OBMEN, paket, sizeof(paket), (uint16_t)offset);
+    if (zagolovok == 0U) {
         return -1;
     }
     memcpy(paket + zagolovok, payload, offset);
@@ -243,128 +636,580 @@ kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
     return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
 }
 
-/* Главная петля фонового потока: слушает UDP и отправляет приветствия. */
-static void *kolibri_roy_potok(void *argument) {
+/*
+ * Раунд обмена видами: все соседи вида стареют, старейший получает выборку и
+ * покидает вид, а место занимают соседи из его ответа.
+ */
+static void kolibri_roy_peremeshat(KolibriRoy *roy) {
 
-    KolibriRoy *roy = (KolibriRoy *)argument;
-    struct sockaddr_in otkuda;
-    socklen_t otkuda_dlina = sizeof(otkuda);
-    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
-    while (roy->zapushchen) {
-        struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        fd_set nabor;
-        FD_ZERO(&nabor);
-        FD_SET(roy->soket, &nabor);
-        int gotov = select(roy->soket + 1, &nabor, NULL, NULL, &tv);
-        if (!roy->zapushchen) {
-            break;
+    KolibriRoySosed vyborka[KOLIBRI_ROY_OBMEN_DLINA];
+    pthread_mutex_lock(&roy->zamek);
+    kolibri_roy_vid_popolnit(roy);
+    if (roy->razmer_vida == 0U) {
+        pthread_mutex_unlock(&roy->zamek);
+        return;
+    }
+    size_t starejshij = 0U;
+    for (size_t pozitsiya = 0U; pozitsiya < roy->razmer_vida; ++pozitsiya) {
+        roy->vid_vozrast[pozitsiya]++;
+        if (roy->vid_vozrast[pozitsiya] > roy->vid_vozrast[starejshij]) {
+            starejshij = pozitsiya;
         }
-        if (gotov < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
+    }
+    uint32_t identifikator = roy->vid[starejshij];
+    struct sockaddr_in cel = roy->sosedi[kolibri_roy_najti_id(roy, identifikator)].adres;
+    kolibri_roy_vid_udalit(roy, starejshij);
+    size_t chislo = kolibri_roy_vyborka(roy, identifikator, vyborka);
+    pthread_mutex_unlock(&roy->zamek);
+    kolibri_roy_soobshchenie_obmen(roy, &cel, 0U, vyborka, chislo);
+}
+
+/* Принимает выборку соседа; на запрос отвечает своей, снятой до слияния. */
+static void kolibri_roy_prinyat_obmen(KolibriRoy *roy, uint32_t otpravitel,
+                                      const struct sockaddr_in *otkuda,
+                                      const uint8_t *dannye, size_t payload) {
+
+    if (payload < 2U) {
+        return;
+    }
+    uint8_t otvet = dannye[0];
+    size_t chislo = dannye[1];
+    if (chislo > KOLIBRI_ROY_OBMEN_DLINA ||
+        payload < 2U + chislo * KOLIBRI_ROY_OBMEN_ZAPIS) {
+        return;
+    }
+    if (otvet == 0U) {
+        KolibriRoySosed vyborka[KOLIBRI_ROY_OBMEN_DLINA];
+        pthread_mutex_lock(&roy->zamek);
+        size_t svoih = kolibri_roy_vyborka(roy, otpravitel, vyborka);
+        pthread_mutex_unlock(&roy->zamek);
+        kolibri_roy_soobshchenie_obmen(roy, otkuda, 1U, vyborka, svoih);
+    }
+    uint32_t prishedshie[KOLIBRI_ROY_OBMEN_DLINA];
+    size_t prinyato = 0U;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        const uint8_t *zapis = dannye + 2U + indeks * KOLIBRI_ROY_OBMEN_ZAPIS;
+        uint32_t identifikator;
+        memcpy(&identifikator, zapis, sizeof(identifikator));
+        identifikator = ntohl(identifikator);
+        if (identifikator == roy->sobstvennyj_id) {
             continue;
         }
-        if (gotov > 0 && FD_ISSET(roy->soket, &nabor)) {
-            ssize_t prinyato =
-                recvfrom(roy->soket, paket, sizeof(paket), 0,
-                         (struct sockaddr *)&otkuda, &otkuda_dlina);
-            if (prinyato <= 0) {
-                continue;
-            }
-            if ((size_t)prinyato <= KOLIBRI_ROY_HMAC_SIZE + 10U) {
-                continue;
-            }
-            size_t dlina = (size_t)prinyato;
-            unsigned char prisoyedennyj[KOLIBRI_ROY_HMAC_SIZE];
-            memcpy(prisoyedennyj, paket + dlina - KOLIBRI_ROY_HMAC_SIZE,
-                   KOLIBRI_ROY_HMAC_SIZE);
-            dlina -= KOLIBRI_ROY_HMAC_SIZE;
-            unsigned int hmac_dlina = 0U;
-            unsigned char rasschet[KOLIBRI_ROY_HMAC_SIZE];
-            unsigned char *result =
-                HMAC(EVP_sha256(), roy->klyuch, (int)roy->dlina_klyucha, paket,
-                     dlina, rasschet, &hmac_dlina);
-            if (!result || hmac_dlina < KOLIBRI_ROY_HMAC_SIZE) {
-                continue;
-            }
-            if (kolibri_roy_sravnit_hmac(prisoyedennyj, rasschet) != 0) {
-                continue;
-            }
-            if (memcmp(paket, KOLIBRI_ROY_MAGIC, 4U) != 0) {
-                continue;
-            }
-            uint8_t versiya = paket[4];
-            if (versiya != KOLIBRI_ROY_VERSIYA) {
-                continue;
-            }
-            uint8_t tip = paket[5];
-            uint32_t identifikator;
-            memcpy(&identifikator, paket + 6U, sizeof(identifikator));
-            identifikator = ntohl(identifikator);
-            if (identifikator == roy->sobstvennyj_id) {
-                continue;
-            }
-            uint16_t port;
-            memcpy(&port, paket + 10U, sizeof(port));
-            port = ntohs(port);
-            uint16_t payload;
-            memcpy(&payload, paket + 12U, sizeof(payload));
-            payload = ntohs(payload);
-            if (12U + payload > dlina) {
+        struct sockaddr_in adres;
+        memset(&adres, 0, sizeof(adres));
+        adres.sin_family = AF_INET;
+        memcpy(&adres.sin_addr.s_addr, zapis + 4U, 4U);
+        memcpy(&adres.sin_port, zapis + 8U, 2U);
+        kolibri_roy_obnovit_soseda(roy, identifikator, &adres, 0);
+        prishedshie[prinyato++] = identifikator;
+    }
+    pthread_mutex_lock(&roy->zamek);
+    for (size_t indeks = 0U; indeks < prinyato; ++indeks) {
+        if (kolibri_roy_najti_id(roy, prishedshie[indeks]) != SIZE_MAX) {
+            kolibri_roy_vid_dobavit(roy, prishedshie[indeks]);
+        }
+    }
+    kolibri_roy_vid_popolnit(roy);
+    pthread_mutex_unlock(&roy->zamek);
+}
+
+/* FNV-1a по длине и цифрам гена: «отпечаток», по которому гены анонсируют. */
+static uint64_t kolibri_roy_hesh_gena(const KolibriGene *gene) {
+
+    uint64_t hesh = 1469598103934665603ULL;
+    size_t dlina = gene->length < sizeof(gene->digits) ? gene->length
+                                                       : sizeof(gene->digits);
+    hesh ^= (uint64_t)dlina;
+    hesh *= 1099511628211ULL;
+    for (size_t indeks = 0U; indeks < dlina; ++indeks) {
+        hesh ^= gene->digits[indeks];
+        hesh *= 1099511628211ULL;
+    }
+    return hesh;
+}
+
+static void kolibri_roy_zapisat_u32(uint8_t *kuda, uint32_t znachenie) {
+
+    znachenie = htonl(znachenie);
+    memcpy(kuda, &znachenie, sizeof(znachenie));
+}
+
+static void kolibri_roy_zapisat_u64(uint8_t *kuda, uint64_t znachenie) {
+
+    znachenie = kolibri_htonll(znachenie);
+    memcpy(kuda, &znachenie, sizeof(znachenie));
+}
+
+static uint32_t kolibri_roy_prochitat_u32(const uint8_t *otkuda) {
+
+    uint32_t znachenie;
+    memcpy(&znachenie, otkuda, sizeof(znachenie));
+    return ntohl(znachenie);
+}
+
+static uint64_t kolibri_roy_prochitat_u64(const uint8_t *otkuda) {
+
+    uint64_t znachenie;
+    memcpy(&znachenie, otkuda, sizeof(znachenie));
+    return kolibri_ntohll(znachenie);
+}
+
+/* Собирает пакет с произвольной полезной нагрузкой и HMAC; длина или 0. */
+static size_t kolibri_roy_sobrat(const KolibriRoy *roy, uint8_t tip,
+                                 const uint8_t *payload, size_t dlina,
+                                 uint8_t *paket, size_t razmer) {
+
+    size_t zagolovok = kolibri_roy_zapolnit_zagolovok(roy, tip, paket, razmer,
+                                                      (uint16_t)dlina);
+    if (zagolovok == 0U || zagolovok + dlina + KOLIBRI_ROY_HMAC_SIZE > razmer) {
+        return 0U;
+    }
+    memcpy(paket + zagolovok, payload, dlina);
+    return kolibri_roy_prisoedinit_hmac(roy, paket, zagolovok + dlina);
+}
+
+/* Виден ли отпечаток недавно; смотрит только поток приёма. */
+static int kolibri_roy_videl(const KolibriRoy *roy, uint64_t hesh) {
+
+    for (size_t indeks = 0U; indeks < KOLIBRI_ROY_VIDENNYE; ++indeks) {
+        if (roy->vidennye[indeks] == hesh) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void kolibri_roy_zapomnit(KolibriRoy *roy, uint64_t hesh) {
+
+    roy->vidennye[roy->vidennye_pozitsiya] = hesh;
+    roy->vidennye_pozitsiya = (roy->vidennye_pozitsiya + 1U) % KOLIBRI_ROY_VIDENNYE;
+}
+
+/* Запрашивает у анонсировавшего соседа гены, которых узел ещё не видел. */
+static void kolibri_roy_prinyat_anons(KolibriRoy *roy,
+                                      const struct sockaddr_in *otkuda,
+                                      const uint8_t *dannye, size_t payload) {
+
+    if (payload < 2U || dannye[0] != KOLIBRI_ROY_FORMAT_ANONSA) {
+        return;
+    }
+    size_t chislo = dannye[1];
+    if (chislo > KOLIBRI_ROY_VITRINA || payload < 2U + chislo * 12U) {
+        return;
+    }
+    uint8_t zapros[2U + KOLIBRI_ROY_VITRINA * 8U];
+    size_t novyh = 0U;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        uint64_t hesh = kolibri_roy_prochitat_u64(dannye + 2U + indeks * 12U + 4U);
+        if (kolibri_roy_videl(roy, hesh)) {
+            continue;
+        }
+        /* Запомненный сразу отпечаток не тянется второй раз от другого соседа. */
+        kolibri_roy_zapomnit(roy, hesh);
+        kolibri_roy_zapisat_u64(zapros + 2U + novyh * 8U, hesh);
+        novyh++;
+    }
+    if (novyh == 0U) {
+        return;
+    }
+    zapros[0] = KOLIBRI_ROY_FORMAT_ANONSA;
+    zapros[1] = (uint8_t)novyh;
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina = kolibri_roy_sobrat(roy, KOLIBRI_ROY_TYP_ZAPROS, zapros,
+                                      2U + novyh * 8U, paket, sizeof(paket));
+    if (dlina != 0U) {
+        kolibri_roy_otpravit_paket(roy, otkuda, paket, dlina);
+    }
+}
+
+/* Отвечает на запрос генами витрины, сколько поместится в датаграмму. */
+static void kolibri_roy_prinyat_zapros(KolibriRoy *roy,
+                                       const struct sockaddr_in *otkuda,
+                                       const uint8_t *dannye, size_t payload) {
+
+    if (payload < 2U || dannye[0] != KOLIBRI_ROY_FORMAT_ANONSA) {
+        return;
+    }
+    size_t chislo = dannye[1];
+    if (chislo > KOLIBRI_ROY_VITRINA || payload < 2U + chislo * 8U) {
+        return;
+    }
+    /* Заголовок, HMAC и два байта счётчика оставляют место под гены. */
+    uint8_t geny[KOLIBRI_ROY_MAKSIMALNYJ_PAKET - 14U - KOLIBRI_ROY_HMAC_SIZE];
+    size_t offset = 2U;
+    size_t vlozheno = 0U;
+    pthread_mutex_lock(&roy->zamek);
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        uint64_t hesh = kolibri_roy_prochitat_u64(dannye + 2U + indeks * 8U);
+        for (size_t nomer = 0U; nomer < roy->vitrina_chislo; ++nomer) {
+            const KolibriRoyVitrina *tovar = &roy->vitrina[nomer];
+            size_t dlina = tovar->gene.length;
+            if (tovar->hesh != hesh || offset + 4U + 1U + dlina + 8U > sizeof(geny)) {
                 continue;
             }
-            otkuda.sin_port = htons(port);
-            kolibri_roy_obnovit_soseda(roy, identifikator, &otkuda);
-            KolibriRoySobytie sobytie;
-            memset(&sobytie, 0, sizeof(sobytie));
-            sobytie.identifikator = identifikator;
-            sobytie.adres = otkuda;
-            if (tip == KOLIBRI_ROY_TYP_HELLO) {
-                sobytie.tip = KOLIBRI_ROY_SOBYTIE_HELLO;
-                kolibri_roy_postavit_sobytie(roy, &sobytie);
-            } else if (tip == KOLIBRI_ROY_TYP_FORMULA) {
-                if (payload < 1U + sizeof(uint64_t)) {
-                    continue;
-                }
-                const uint8_t *dannye = paket + 14U;
-                uint8_t dlina_gena = dannye[0];
-                if (dlina_gena == 0U || dlina_gena > 32U ||
-                    payload < 1U + dlina_gena + sizeof(uint64_t)) {
-                    continue;
-                }
-                memcpy(sobytie.formula.gene.digits, dannye + 1U, dlina_gena);
-                sobytie.formula.gene.length = dlina_gena;
-                uint64_t syrjoj;
-                memcpy(&syrjoj, dannye + 1U + dlina_gena, sizeof(syrjoj));
-                syrjoj = kolibri_ntohll(syrjoj);
-                memcpy(&sobytie.formula.fitness, &syrjoj, sizeof(syrjoj));
-                sobytie.formula.feedback = 0.0;
-                sobytie.tip = KOLIBRI_ROY_SOBYTIE_FORMULA;
-                kolibri_roy_postavit_sobytie(roy, &sobytie);
+            kolibri_roy_zapisat_u32(geny + offset, tovar->pokolenie);
+            offset += 4U;
+            geny[offset++] = (uint8_t)dlina;
+            memcpy(geny + offset, tovar->gene.digits, dlina);
+            offset += dlina;
+            uint64_t kody;
+            memcpy(&kody, &tovar->fitness, sizeof(kody));
+            kolibri_roy_zapisat_u64(geny + offset, kody);
+            offset += 8U;
+            vlozheno++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    if (vlozheno == 0U) {
+        return;
+    }
+    geny[0] = KOLIBRI_ROY_FORMAT_ANONSA;
+    geny[1] = (uint8_t)vlozheno;
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina = kolibri_roy_sobrat(roy, KOLIBRI_ROY_TYP_GENY, geny, offset,
+                                      paket, sizeof(paket));
+    if (dlina != 0U) {
+        kolibri_roy_otpravit_paket(roy, otkuda, paket, dlina);
+    }
+}
+
+/* Каждый присланный ген становится событием FORMULA. */
+static void kolibri_roy_prinyat_geny(KolibriRoy *roy, KolibriRoySobytie *sobytie,
+                                     const uint8_t *dannye, size_t payload) {
+
+    if (payload < 2U || dannye[0] != KOLIBRI_ROY_FORMAT_ANONSA) {
+        return;
+    }
+    size_t chislo = dannye[1];
+    size_t offset = 2U;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        if (offset + 5U > payload) {
+            return;
+        }
+        uint32_t pokolenie = kolibri_roy_prochitat_u32(dannye + offset);
+        size_t dlina = dannye[offset + 4U];
+        offset += 5U;
+        if (dlina == 0U || dlina > sizeof(sobytie->gene.digits) ||
+            offset + dlina + 8U > payload) {
+            return;
+        }
+        memcpy(sobytie->gene.digits, dannye + offset, dlina);
+        sobytie->gene.length = dlina;
+        offset += dlina;
+        uint64_t kody = kolibri_roy_prochitat_u64(dannye + offset);
+        memcpy(&sobytie->fitness, &kody, sizeof(kody));
+        offset += 8U;
+        sobytie->pokolenie = pokolenie;
+        sobytie->tip = KOLIBRI_ROY_SOBYTIE_FORMULA;
+        uint64_t hesh = kolibri_roy_hesh_gena(&sobytie->gene);
+        if (!kolibri_roy_videl(roy, hesh)) {
+            kolibri_roy_zapomnit(roy, hesh);
+        }
+        kolibri_roy_postavit_sobytie(roy, sobytie);
+    }
+}
+
+/*
+ * Отправляет один готовый пакет по списку адресов. Тело и HMAC от адресата не
+ * зависят, поэтому на Linux пачка уходит одним sendmmsg. Возвращает число
+ * удачных отправок; неудачный адрес пропускается.
+ */
+static size_t kolibri_roy_razoslat(const KolibriRoy *roy,
+                                   const struct sockaddr_in *adresa,
+                                   size_t chislo, const uint8_t *paket,
+                                   size_t dlina) {
+
+    size_t otpravleno = 0U;
+#if defined(KOLIBRI_ROY_MMSG)
+    struct mmsghdr soobshcheniya[KOLIBRI_ROY_PACHKA];
+    struct iovec chast;
+    chast.iov_base = (void *)paket;
+    chast.iov_len = dlina;
+    size_t indeks = 0U;
+    while (indeks < chislo) {
+        size_t pachka = chislo - indeks < KOLIBRI_ROY_PACHKA
+                            ? chislo - indeks
+                            : KOLIBRI_ROY_PACHKA;
+        memset(soobshcheniya, 0, pachka * sizeof(soobshcheniya[0]));
+        for (size_t nomer = 0U; nomer < pachka; ++nomer) {
+            soobshcheniya[nomer].msg_hdr.msg_name = (void *)&adresa[indeks + nomer];
+            soobshcheniya[nomer].msg_hdr.msg_namelen = sizeof(adresa[0]);
+            soobshcheniya[nomer].msg_hdr.msg_iov = &chast;
+            soobshcheniya[nomer].msg_hdr.msg_iovlen = 1U;
+        }
+        int ushlo = sendmmsg(roy->soket, soobshcheniya, (unsigned int)pachka, 0);
+        if (ushlo < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ushlo <= 0) {
+            /* Ошибка относится к первому адресу пачки. */
+            indeks++;
+            continue;
+        }
+        for (int nomer = 0; nomer < ushlo; ++nomer) {
+            if (soobshcheniya[nomer].msg_len == dlina) {
+                otpravleno++;
             }
         }
+        indeks += (size_t)ushlo;
+    }
+#else
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        if (kolibri_roy_otpravit_paket(roy, &adresa[indeks], paket, dlina) == 0) {
+            otpravleno++;
+        }
+    }
+#endif
+    return otpravleno;
+}
+
+/* Проверяет и разбирает одну принятую датаграмму. */
+static void kolibri_roy_razobrat_paket(KolibriRoy *roy, const uint8_t *paket,
+                                       size_t prinyato,
+                                       struct sockaddr_in otkuda) {
+
+    if (prinyato <= KOLIBRI_ROY_HMAC_SIZE + 10U) {
+        return;
+    }
+    size_t dlina = prinyato - KOLIBRI_ROY_HMAC_SIZE;
+    unsigned char rasschet[KOLIBRI_ROY_HMAC_SIZE];
+    /* Проверяет только поток приёма, его контекст перезапускается на месте. */
+    if (kolibri_roy_hmac_vychislit(roy->hmac_priem, 1, paket, dlina, rasschet) != 0) {
+        return;
+    }
+    if (kolibri_roy_sravnit_hmac(paket + dlina, rasschet) != 0) {
+        return;
+    }
+    if (memcmp(paket, KOLIBRI_ROY_MAGIC, 4U) != 0) {
+        return;
+    }
+    uint8_t versiya = paket[4];
+    if (versiya != KOLIBRI_ROY_VERSIYA) {
+        return;
+    }
+    uint8_t tip = paket[5];
+    uint32_t identifikator;
+    memcpy(&identifikator, paket + 6U, sizeof(identifikator));
+    identifikator = ntohl(identifikator);
+    if (identifikator == roy->sobstvennyj_id) {
+        return;
+    }
+    uint16_t port;
+    memcpy(&port, paket + 10U, sizeof(port));
+    port = ntohs(port);
+    uint16_t payload;
+    memcpy(&payload, paket + 12U, sizeof(payload));
+    payload = ntohs(payload);
+    if (14U + payload > dlina) {
+        return;
+    }
+    otkuda.sin_port = htons(port);
+    kolibri_roy_obnovit_soseda(roy, identifikator, &otkuda, 1);
+    KolibriRoySobytie sobytie;
+    memset(&sobytie, 0, sizeof(sobytie));
+    sobytie.identifikator = identifikator;
+    sobytie.adres = otkuda;
+    if (tip == KOLIBRI_ROY_TYP_HELLO) {
+        sobytie.tip = KOLIBRI_ROY_SOBYTIE_HELLO;
+        kolibri_roy_postavit_sobytie(roy, &sobytie);
+    } else if (tip == KOLIBRI_ROY_TYP_OBMEN) {
+        kolibri_roy_prinyat_obmen(roy, identifikator, &otkuda, paket + 14U, payload);
+    } else if (tip == KOLIBRI_ROY_TYP_ANONS) {
+        kolibri_roy_prinyat_anons(roy, &otkuda, paket + 14U, payload);
+    } else if (tip == KOLIBRI_ROY_TYP_ZAPROS) {
+        kolibri_roy_prinyat_zapros(roy, &otkuda, paket + 14U, payload);
+    } else if (tip == KOLIBRI_ROY_TYP_GENY) {
+        kolibri_roy_prinyat_geny(roy, &sobytie, paket + 14U, payload);
+    } else if (tip == KOLIBRI_ROY_TYP_FORMULA) {
+        if (payload < 1U + sizeof(uint64_t)) {
+            return;
+        }
+        const uint8_t *dannye = paket + 14U;
+        uint8_t dlina_gena = dannye[0];
+        if (dlina_gena == 0U || dlina_gena > 32U ||
+            payload < 1U + dlina_gena + sizeof(uint64_t)) {
+            return;
+        }
+        memcpy(sobytie.gene.digits, dannye + 1U, dlina_gena);
+        sobytie.gene.length = dlina_gena;
+        uint64_t syrjoj;
+        memcpy(&syrjoj, dannye + 1U + dlina_gena, sizeof(syrjoj));
+        syrjoj = kolibri_ntohll(syrjoj);
+        memcpy(&sobytie.fitness, &syrjoj, sizeof(syrjoj));
+        sobytie.tip = KOLIBRI_ROY_SOBYTIE_FORMULA;
+        kolibri_roy_postavit_sobytie(roy, &sobytie);
+    }
+}
+
+/* Читает до KOLIBRI_ROY_PACHKA ожидающих датаграмм за одно пробуждение. */
+static void kolibri_roy_prinyat_pachku(KolibriRoy *roy) {
+
+    uint8_t pakety[KOLIBRI_ROY_PACHKA][KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    struct sockaddr_in otkuda[KOLIBRI_ROY_PACHKA];
+#if defined(KOLIBRI_ROY_MMSG)
+    struct mmsghdr soobshcheniya[KOLIBRI_ROY_PACHKA];
+    struct iovec chasti[KOLIBRI_ROY_PACHKA];
+    memset(soobshcheniya, 0, sizeof(soobshcheniya));
+    for (size_t nomer = 0U; nomer < KOLIBRI_ROY_PACHKA; ++nomer) {
+        chasti[nomer].iov_base = pakety[nomer];
+        chasti[nomer].iov_len = sizeof(pakety[nomer]);
+        soobshcheniya[nomer].msg_hdr.msg_name = &otkuda[nomer];
+        soobshcheniya[nomer].msg_hdr.msg_namelen = sizeof(otkuda[nomer]);
+        soobshcheniya[nomer].msg_hdr.msg_iov = &chasti[nomer];
+        soobshcheniya[nomer].msg_hdr.msg_iovlen = 1U;
+    }
+    int chislo = recvmmsg(roy->soket, soobshcheniya, KOLIBRI_ROY_PACHKA,
+                          MSG_DONTWAIT, NULL);
+    for (int nomer = 0; nomer < chislo; ++nomer) {
+        kolibri_roy_razobrat_paket(roy, pakety[nomer], soobshcheniya[nomer].msg_len,
+                                   otkuda[nomer]);
+    }
+#else
+    for (size_t nomer = 0U; nomer < KOLIBRI_ROY_PACHKA; ++nomer) {
+        socklen_t otkuda_dlina = sizeof(otkuda[nomer]);
+        ssize_t prinyato =
+            recvfrom(roy->soket, pakety[nomer], sizeof(pakety[nomer]), MSG_DONTWAIT,
+                     (struct sockaddr *)&otkuda[nomer], &otkuda_dlina);
+        if (prinyato <= 0) {
+            break;
+        }
+        kolibri_roy_razobrat_paket(roy, pakety[nomer], (size_t)prinyato, otkuda[nomer]);
+    }
+#endif
+}
+
+/* Ждёт датаграмм до срока приветствия; 1 — сокет готов к чтению. */
+static int kolibri_roy_zhdat(KolibriRoy *roy, int ozhidanie_ms) {
+
+#if defined(KOLIBRI_ROY_EPOLL)
+    struct epoll_event gotovye[2];
+    int chislo = epoll_wait(roy->opros, gotovye, 2, ozhidanie_ms);
+    int gotov = 0;
+    for (int nomer = 0; nomer < chislo; ++nomer) {
+        if (gotovye[nomer].data.fd == roy->soket) {
+            gotov = 1;
+        }
+    }
+    return gotov;
+#else
+    struct timeval tv;
+    tv.tv_sec = ozhidanie_ms / 1000;
+    tv.tv_usec = (ozhidanie_ms % 1000) * 1000;
+    fd_set nabor;
+    FD_ZERO(&nabor);
+    FD_SET(roy->soket, &nabor);
+    int gotov = select(roy->soket + 1, &nabor, NULL, NULL, &tv);
+    return gotov > 0 && FD_ISSET(roy->soket, &nabor);
+#endif
+}
+
+/*
+ * Главная петля фонового потока: слушает UDP и отправляет приветствия.
+ * Поток спит до прихода датаграммы или до следующего приветствия; остановку
+ * будит eventfd, без epoll — короткий select.
+ */
+static void *kolibri_roy_potok(void *argument) {
+
+    KolibriRoy *roy = (KolibriRoy *)argument;
+    while (roy->zapushchen) {
+        time_t ostalos = roy->poslednij_privet +
+                         (time_t)KOLIBRI_ROY_PRIVET_INTERVAL - time(NULL);
+        if (ostalos < 0) {
+            ostalos = 0;
+        }
+        int ozhidanie_ms = (int)ostalos * 1000;
+#if !defined(KOLIBRI_ROY_EPOLL)
+        if (ozhidanie_ms > 1000) {
+            ozhidanie_ms = 1000;
+        }
+#endif
+        int gotov = kolibri_roy_zhdat(roy, ozhidanie_ms);
+        if (!roy->zapushchen) {
+            break;
+        }
+        if (gotov) {
+            kolibri_roy_prinyat_pachku(roy);
+        }
         time_t seichas = time(NULL);
         if (seichas - roy->poslednij_privet >=
             (time_t)KOLIBRI_ROY_PRIVET_INTERVAL) {
             struct sockaddr_in broadcast;
             kolibri_roy_shirokoveshchatel(&broadcast, roy->port);
             kolibri_roy_soobshchenie_privet(roy, &broadcast);
+            kolibri_roy_peremeshat(roy);
             roy->poslednij_privet = seichas;
         }
-        kolibri_roy_ochistit_sosedey(roy);
+        if (seichas != roy->poslednyaya_chistka) {
+            kolibri_roy_ochistit_sosedey(roy);
+            roy->poslednyaya_chistka = seichas;
+        }
     }
     return NULL;
 }
 
+/* Закрывает дескрипторы и освобождает очередь. */
+static void kolibri_roy_osvobodit(KolibriRoy *roy) {
+
+    if (roy->soket >= 0) {
+        close(roy->soket);
+        roy->soket = -1;
+    }
+    if (roy->opros >= 0) {
+        close(roy->opros);
+        roy->opros = -1;
+    }
+    if (roy->budilnik >= 0) {
+        close(roy->budilnik);
+        roy->budilnik = -1;
+    }
+    free(roy->ochered);
+    roy->ochered = NULL;
+    roy->ochered_glubina = 0U;
+    if (roy->hmac_shablon) {
+        kolibri_roy_hmac_osvobodit(roy->hmac_shablon);
+        roy->hmac_shablon = NULL;
+    }
+    if (roy->hmac_priem) {
+        kolibri_roy_hmac_osvobodit(roy->hmac_priem);
+        roy->hmac_priem = NULL;
+    }
+    free(roy->sosedi);
+    free(roy->indeks_id);
+    free(roy->indeks_adres);
+    roy->sosedi = NULL;
+    roy->indeks_id = NULL;
+    roy->indeks_adres = NULL;
+    roy->chislo_sosedey = 0U;
+    roy->emkost_sosedey = 0U;
+    roy->chislo_yacheek = 0U;
+    roy->razmer_vida = 0U;
+}
+
 int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
                          const unsigned char *klyuch, size_t dlina_klyucha) {
 
+    return kolibri_roy_zapustit_s_glubinoj(roy, identifikator, port, klyuch,
+                                           dlina_klyucha, KOLIBRI_ROY_MAX_OCHERED);
+}
+
+int kolibri_roy_zapustit_s_glubinoj(KolibriRoy *roy, uint32_t identifikator,
+                                    uint16_t port, const unsigned char *klyuch,
+                                    size_t dlina_klyucha, size_t glubina) {
+
     if (!roy || !klyuch || dlina_klyucha == 0U) {
         return -1;
     }
+    if (glubina == 0U) {
+        glubina = KOLIBRI_ROY_MAX_OCHERED;
+    }
+    if (glubina > (SIZE_MAX >> 1) + 1U) {
+        return -1;
+    }
+    size_t stepen = 1U;
+    while (stepen < glubina) {
+        stepen <<= 1;
+    }
     memset(roy, 0, sizeof(*roy));
     roy->sobstvennyj_id = identifikator;
     roy->port = port;
@@ -372,22 +1217,37 @@ int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
                              ? KOLIBRI_ROY_HMAC_SIZE
                              : dlina_klyucha;
     memcpy(roy->klyuch, klyuch, roy->dlina_klyucha);
+    roy->sluchaj = ((uint64_t)identifikator << 32) ^ (uint64_t)time(NULL) ^ port;
     pthread_mutex_init(&roy->zamek, NULL);
-    pthread_mutex_init(&roy->ochered_zamek, NULL);
+    roy->soket = -1;
+    roy->opros = -1;
+    roy->budilnik = -1;
+    roy->ochered = calloc(stepen, sizeof(KolibriRoySobytie));
+    if (!roy->ochered) {
+        return -1;
+    }
+    roy->ochered_glubina = stepen;
+    roy->hmac_shablon = kolibri_roy_hmac_sozdat(roy);
+    roy->hmac_priem = kolibri_roy_hmac_sozdat(roy);
+    if (!roy->hmac_shablon || !roy->hmac_priem) {
+        kolibri_roy_osvobodit(roy);
+        return -1;
+    }
     roy->soket = socket(AF_INET, SOCK_DGRAM, 0);
     if (roy->soket < 0) {
+        kolibri_roy_osvobodit(roy);
         return -1;
     }
     int reuse = 1;
     if (setsockopt(roy->soket, SOL_SOCKET, SO_REUSEADDR, &reuse,
                    sizeof(reuse)) < 0) {
-        close(roy->soket);
+        kolibri_roy_osvobodit(roy);
         return -1;
     }
     int broadcast = 1;
     if (setsockopt(roy->soket, SOL_SOCKET, SO_BROADCAST, &broadcast,
                    sizeof(broadcast)) < 0) {
-        close(roy->soket);
+        kolibri_roy_osvobodit(roy);
         return -1;
     }
     struct sockaddr_in adres;
@@ -396,13 +1256,29 @@ int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
     adres.sin_addr.s_addr = htonl(INADDR_ANY);
     adres.sin_port = htons(port);
     if (bind(roy->soket, (struct sockaddr *)&adres, sizeof(adres)) < 0) {
-        close(roy->soket);
+        kolibri_roy_osvobodit(roy);
         return -1;
     }
+#if defined(KOLIBRI_ROY_EPOLL)
+    roy->opros = epoll_create1(EPOLL_CLOEXEC);
+    roy->budilnik = eventfd(0U, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event podpiska;
+    memset(&podpiska, 0, sizeof(podpiska));
+    podpiska.events = EPOLLIN;
+    podpiska.data.fd = roy->soket;
+    int oshibka = roy->opros < 0 || roy->budilnik < 0 ||
+                  epoll_ctl(roy->opros, EPOLL_CTL_ADD, roy->soket, &podpiska) != 0;
+    podpiska.data.fd = roy->budilnik;
+    if (oshibka ||
+        epoll_ctl(roy->opros, EPOLL_CTL_ADD, roy->budilnik, &podpiska) != 0) {
+        kolibri_roy_osvobodit(roy);
+        return -1;
+    }
+#endif
     roy->zapushchen = 1;
     roy->poslednij_privet = time(NULL);
     if (pthread_create(&roy->potok, NULL, kolibri_roy_potok, roy) != 0) {
-        close(roy->soket);
+        kolibri_roy_osvobodit(roy);
         roy->zapushchen = 0;
         return -1;
     }
@@ -418,37 +1294,44 @@ void kolibri_roy_ostanovit(KolibriRoy *roy) {
         return;
     }
     roy->zapushchen = 0;
+    if (roy->budilnik >= 0) {
+        uint64_t edinica = 1U;
+        ssize_t zapisano = write(roy->budilnik, &edinica, sizeof(edinica));
+        (void)zapisano;
+    }
     if (roy->soket >= 0) {
         shutdown(roy->soket, SHUT_RDWR);
     }
     if (roy->potok) {
         pthread_join(roy->potok, NULL);
     }
-    if (roy->soket >= 0) {
-        close(roy->soket);
-        roy->soket = -1;
-    }
+    kolibri_roy_osvobodit(roy);
     pthread_mutex_destroy(&roy->zamek);
-    pthread_mutex_destroy(&roy->ochered_zamek);
 }
 
 int kolibri_roy_poluchit_sobytie(KolibriRoy *roy, KolibriRoySobytie *sobytie) {
 
-    if (!roy || !sobytie) {
+    if (!roy || !sobytie || !roy->ochered) {
         return -1;
     }
-    pthread_mutex_lock(&roy->ochered_zamek);
-    if (roy->ochered_schetchik == 0U) {
-        pthread_mutex_unlock(&roy->ochered_zamek);
+    size_t golova = roy->ochered_golova;
+    size_t hvost = __atomic_load_n(&roy->ochered_hvost, __ATOMIC_ACQUIRE);
+    if (golova == hvost) {
         return 0;
     }
-    *sobytie = roy->ochered[roy->ochered_golova];
-    roy->ochered_golova = (roy->ochered_golova + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-    roy->ochered_schetchik--;
-    pthread_mutex_unlock(&roy->ochered_zamek);
+    *sobytie = roy->ochered[golova & (roy->ochered_glubina - 1U)];
+    __atomic_store_n(&roy->ochered_golova, golova + 1U, __ATOMIC_RELEASE);
     return 1;
 }
 
+uint64_t kolibri_roy_poteri(const KolibriRoy *roy) {
+
+    if (!roy) {
+        return 0U;
+    }
+    return __atomic_load_n(&roy->ochered_poteri, __ATOMIC_RELAXED);
+}
+
 size_t kolibri_roy_spisok_sosedey(KolibriRoy *roy, KolibriRoySosed *naznachenie,
                                   size_t maksimalno) {
 
@@ -465,6 +1348,25 @@ size_t kolibri_roy_spisok_sosedey(KolibriRoy *roy, KolibriRoySosed *naznachenie,
     return kopiruem;
 }
 
+size_t kolibri_roy_vid(KolibriRoy *roy, KolibriRoySosed *naznachenie,
+                       size_t maksimalno) {
+
+    if (!roy || !naznachenie || maksimalno == 0U) {
+        return 0U;
+    }
+    pthread_mutex_lock(&roy->zamek);
+    size_t kopiruem = 0U;
+    for (size_t pozitsiya = 0U; pozitsiya < roy->razmer_vida && kopiruem < maksimalno;
+         ++pozitsiya) {
+        size_t nomer = kolibri_roy_najti_id(roy, roy->vid[pozitsiya]);
+        if (nomer != SIZE_MAX) {
+            naznachenie[kopiruem++] = roy->sosedi[nomer];
+        }
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    return kopiruem;
+}
+
 int kolibri_roy_otpravit_privet(KolibriRoy *roy) {
 
     if (!roy) {
@@ -482,7 +1384,7 @@ int kolibri_roy_dobavit_soseda(KolibriRoy *roy, const struct sockaddr_in *adres,
     if (!roy || !adres) {
         return -1;
     }
-    kolibri_roy_obnovit_soseda(roy, identifikator, adres);
+    kolibri_roy_obnovit_soseda(roy, identifikator, adres, 1);
     return kolibri_roy_soobshchenie_privet(roy, adres);
 }
 
@@ -493,12 +1395,20 @@ int kolibri_roy_otpravit_sluchajnomu(KolibriRoy *roy, uint64_t sluchajnoe,
         return -1;
     }
     pthread_mutex_lock(&roy->zamek);
-    if (roy->chislo_sosedey == 0U) {
+    if (roy->razmer_vida == 0U) {
+        kolibri_roy_vid_popolnit(roy);
+    }
+    if (roy->razmer_vida == 0U) {
+        pthread_mutex_unlock(&roy->zamek);
+        return -1;
+    }
+    uint32_t identifikator = roy->vid[(size_t)(sluchajnoe % roy->razmer_vida)];
+    size_t nomer = kolibri_roy_najti_id(roy, identifikator);
+    if (nomer == SIZE_MAX) {
         pthread_mutex_unlock(&roy->zamek);
         return -1;
     }
-    size_t indeks = (size_t)(sluchajnoe % roy->chislo_sosedey);
-    KolibriRoySosed sosed = roy->sosedi[indeks];
+    KolibriRoySosed sosed = roy->sosedi[nomer];
     pthread_mutex_unlock(&roy->zamek);
     if (kolibri_roy_soobshchenie_formula(roy, &sosed.adres, formula) != 0) {
         return -1;
@@ -511,18 +1421,155 @@ int kolibri_roy_otpravit_vsem(KolibriRoy *roy, const KolibriFormula *formula) {
     if (!roy || !formula) {
         return -1;
     }
-    struct sockaddr_in broadcast_adres;
-    kolibri_roy_shirokoveshchatel(&broadcast_adres, roy->port);
-    kolibri_roy_soobshchenie_formula(roy, &broadcast_adres, formula);
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina = kolibri_roy_sobrat_formulu(roy, formula, paket, sizeof(paket));
+    if (dlina == 0U) {
+        return -1;
+    }
     pthread_mutex_lock(&roy->zamek);
     size_t chislo = roy->chislo_sosedey;
-    KolibriRoySosed lokalnye[KOLIBRI_ROY_MAX_SOSSEDI];
-    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
-        lokalnye[indeks] = roy->sosedi[indeks];
+    struct sockaddr_in *adresa = malloc((chislo + 1U) * sizeof(*adresa));
+    if (!adresa) {
+        pthread_mutex_unlock(&roy->zamek);
+        return -1;
     }
-    pthread_mutex_unlock(&roy->zamek);
     for (size_t indeks = 0U; indeks < chislo; ++indeks) {
-        kolibri_roy_soobshchenie_formula(roy, &lokalnye[indeks].adres, formula);
+        adresa[indeks + 1U] = roy->sosedi[indeks].adres;
     }
+    pthread_mutex_unlock(&roy->zamek);
+    kolibri_roy_shirokoveshchatel(&adresa[0], roy->port);
+    kolibri_roy_razoslat(roy, adresa, chislo + 1U, paket, dlina);
+    free(adresa);
     return 0;
 }
+
+int kolibri_roy_anonsirovat(KolibriRoy *roy, const KolibriFormula *formuly,
+                            size_t chislo, uint32_t pokolenie) {
+
+    if (!roy || (!formuly && chislo > 0U)) {
+        return -1;
+    }
+    KolibriRoyVitrina novaya[KOLIBRI_ROY_VITRINA];
+    size_t prinyato = 0U;
+    for (size_t indeks = 0U; indeks < chislo && prinyato < KOLIBRI_ROY_VITRINA; ++indeks) {
+        const KolibriGene *gene = &formuly[indeks].gene;
+        if (gene->length == 0U || gene->length > sizeof(gene->digits)) {
+            continue;
+        }
+        uint64_t hesh = kolibri_roy_hesh_gena(gene);
+        size_t povtor = 0U;
+        while (povtor < prinyato && novaya[povtor].hesh != hesh) {
+            povtor++;
+        }
+        if (povtor < prinyato) {
+            continue;
+        }
+        novaya[prinyato].hesh = hesh;
+        novaya[prinyato].pokolenie = pokolenie;
+        novaya[prinyato].gene = *gene;
+        novaya[prinyato].fitness = formuly[indeks].fitness;
+        prinyato++;
+    }
+    uint8_t anons[2U + KOLIBRI_ROY_VITRINA * 12U];
+    size_t novyh = 0U;
+    struct sockaddr_in adresa[KOLIBRI_ROY_MAX_VID];
+    size_t chislo_adresov = 0U;
+    pthread_mutex_lock(&roy->zamek);
+    for (size_t indeks = 0U; indeks < prinyato; ++indeks) {
+        size_t staryj = 0U;
+        while (staryj < roy->vitrina_chislo &&
+               roy->vitrina[staryj].hesh != novaya[indeks].hesh) {
+            staryj++;
+        }
+        if (staryj < roy->vitrina_chislo) {
+            /* Уже анонсированный ген сохраняет своё поколение и не повторяется. */
+            novaya[indeks].pokolenie = roy->vitrina[staryj].pokolenie;
+            continue;
+        }
+        kolibri_roy_zapisat_u32(anons + 2U + novyh * 12U, pokolenie);
+        kolibri_roy_zapisat_u64(anons + 2U + novyh * 12U + 4U, novaya[indeks].hesh);
+        novyh++;
+    }
+    memcpy(roy->vitrina, novaya, prinyato * sizeof(novaya[0]));
+    roy->vitrina_chislo = prinyato;
+    if (novyh > 0U) {
+        if (roy->razmer_vida == 0U) {
+            kolibri_roy_vid_popolnit(roy);
+        }
+        for (size_t pozitsiya = 0U; pozitsiya < roy->razmer_vida; ++pozitsiya) {
+            size_t nomer = kolibri_roy_najti_id(roy, roy->vid[pozitsiya]);
+            if (nomer != SIZE_MAX) {
+                adresa[chislo_adresov++] = roy->sosedi[nomer].adres;
+            }
+        }
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    if (novyh == 0U) {
+        return 0;
+    }
+    anons[0] = KOLIBRI_ROY_FORMAT_ANONSA;
+    anons[1] = (uint8_t)novyh;
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina = kolibri_roy_sobrat(roy, KOLIBRI_ROY_TYP_ANONS, anons,
+                                      2U + novyh * 12U, paket, sizeof(paket));
+    if (dlina == 0U) {
+        return -1;
+    }
+    kolibri_roy_razoslat(roy, adresa, chislo_adresov, paket, dlina);
+    return (int)novyh;
+}
+
+static int kolibri_roy_sravnit_id(const void *levyj, const void *pravyj) {
+
+    uint32_t a = ((const KolibriRoySosed *)levyj)->identifikator;
+    uint32_t b = ((const KolibriRoySosed *)pravyj)->identifikator;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+int kolibri_roy_migrirovat(KolibriRoy *roy, const KolibriMigrationPolicy *politika,
+                           uint64_t sluchajnoe, const KolibriFormula *formula) {
+
+    if (!roy || !politika || !formula) {
+        return -1;
+    }
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina = kolibri_roy_sobrat_formulu(roy, formula, paket, sizeof(paket));
+    if (dlina == 0U) {
+        return 0;
+    }
+    pthread_mutex_lock(&roy->zamek);
+    size_t chislo = roy->chislo_sosedey;
+    if (chislo == 0U) {
+        pthread_mutex_unlock(&roy->zamek);
+        return 0;
+    }
+    KolibriRoySosed *lokalnye = malloc(chislo * sizeof(*lokalnye));
+    size_t *celi = malloc((chislo + 1U) * sizeof(*celi));
+    struct sockaddr_in *adresa = malloc((chislo + 1U) * sizeof(*adresa));
+    if (!lokalnye || !celi || !adresa) {
+        pthread_mutex_unlock(&roy->zamek);
+        free(lokalnye);
+        free(celi);
+        free(adresa);
+        return -1;
+    }
+    memcpy(lokalnye, roy->sosedi, chislo * sizeof(*lokalnye));
+    pthread_mutex_unlock(&roy->zamek);
+    qsort(lokalnye, chislo, sizeof(KolibriRoySosed), kolibri_roy_sravnit_id);
+    /* Свой номер среди участников — число соседей с меньшим идентификатором. */
+    size_t svoj = 0U;
+    while (svoj < chislo && lokalnye[svoj].identifikator < roy->sobstvennyj_id) {
+        svoj++;
+    }
+    size_t chislo_celej = kf_migration_targets(politika, svoj, chislo + 1U, sluchajnoe,
+                                               celi, chislo + 1U);
+    for (size_t indeks = 0U; indeks < chislo_celej; ++indeks) {
+        size_t uchastnik = celi[indeks];
+        adresa[indeks] = lokalnye[uchastnik > svoj ? uchastnik - 1U : uchastnik].adres;
+    }
+    int otpravleno = (int)kolibri_roy_razoslat(roy, adresa, chislo_celej, paket, dlina);
+    free(lokalnye);
+    free(celi);
+    free(adresa);
+    return otpravleno;
+}
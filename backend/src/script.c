@@ -5,17 +5,25 @@
 
 #include "kolibri/script.h"
 #include "kolibri/decimal.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#define KOLIBRI_SCRIPT_THREADS 1
+#include <pthread.h>
+#endif
+
 #define KOLIBRI_MAX_LOOP_ITERATIONS 1024
 #define KOLIBRI_ARRAY_GROWTH_FACTOR 2U
 
@@ -58,6 +66,7 @@ typedef struct {
     KolibriToken *data;
     size_t count;
     size_t capacity;
+    const KolibriAllocator *allocator;
 } KolibriTokenBuffer;
 
 typedef struct {
@@ -69,22 +78,21 @@ typedef struct {
     KolibriDiagnostic *data;
     size_t count;
     size_t capacity;
+    const KolibriAllocator *allocator;
 } KolibriDiagnosticBuffer;
 
-static void kolibri_token_buffer_init(KolibriTokenBuffer *buffer) {
+static void kolibri_token_buffer_init(KolibriTokenBuffer *buffer, const KolibriAllocator *allocator) {
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
+    buffer->allocator = allocator;
 }
 
 static void kolibri_token_buffer_free(KolibriTokenBuffer *buffer) {
     if (!buffer) {
         return;
     }
-    for (size_t i = 0; i < buffer->count; ++i) {
-        free(buffer->data[i].lexeme);
-    }
-    free(buffer->data);
+    kolibri_mem_free(buffer->allocator, buffer->data);
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
@@ -93,7 +101,7 @@ static void kolibri_token_buffer_free(KolibriTokenBuffer *buffer) {
 static int kolibri_token_buffer_push(KolibriTokenBuffer *buffer, KolibriToken token) {
     if (buffer->count == buffer->capacity) {
         size_t new_capacity = buffer->capacity == 0 ? 32U : buffer->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriToken *new_data = (KolibriToken *)realloc(buffer->data, new_capacity * sizeof(KolibriToken));
+        KolibriToken *new_data = (KolibriToken *)kolibri_mem_realloc(buffer->allocator, buffer->data, new_capacity * sizeof(KolibriToken));
         if (!new_data) {
             return -1;
         }
@@ -104,10 +112,11 @@ static int kolibri_token_buffer_push(KolibriTokenBuffer *buffer, KolibriToken to
     return 0;
 }
 
-static void kolibri_diagnostic_buffer_init(KolibriDiagnosticBuffer *buffer) {
+static void kolibri_diagnostic_buffer_init(KolibriDiagnosticBuffer *buffer, const KolibriAllocator *allocator) {
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
+    buffer->allocator = allocator;
 }
 
 static void kolibri_diagnostic_buffer_free(KolibriDiagnosticBuffer *buffer) {
@@ -115,9 +124,9 @@ static void kolibri_diagnostic_buffer_free(KolibriDiagnosticBuffer *buffer) {
         return;
     }
     for (size_t i = 0; i < buffer->count; ++i) {
-        free(buffer->data[i].message);
+        kolibri_mem_free(buffer->allocator, buffer->data[i].message);
     }
-    free(buffer->data);
+    kolibri_mem_free(buffer->allocator, buffer->data);
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
@@ -126,7 +135,7 @@ static void kolibri_diagnostic_buffer_free(KolibriDiagnosticBuffer *buffer) {
 static int kolibri_diagnostic_buffer_push(KolibriDiagnosticBuffer *buffer, const char *message, KolibriSourceSpan span) {
     if (buffer->count == buffer->capacity) {
         size_t new_capacity = buffer->capacity == 0 ? 8U : buffer->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriDiagnostic *new_data = (KolibriDiagnostic *)realloc(buffer->data, new_capacity * sizeof(KolibriDiagnostic));
+        KolibriDiagnostic *new_data = (KolibriDiagnostic *)kolibri_mem_realloc(buffer->allocator, buffer->data, new_capacity * sizeof(KolibriDiagnostic));
         if (!new_data) {
             return -1;
         }
@@ -135,7 +144,7 @@ static int kolibri_diagnostic_buffer_push(KolibriDiagnosticBuffer *buffer, const
     }
     char *dup = NULL;
     if (message) {
-        dup = strdup(message);
+        dup = kolibri_mem_strdup(buffer->allocator, message);
         if (!dup) {
             return -1;
         }
@@ -195,6 +204,7 @@ static const char *const KOLIBRI_KEYWORDS[] = {
 };
 
 static void kolibri_to_lower_ascii(const char *src, char *dst, size_t dst_len);
+static uint64_t kolibri_text_hash(const char *text);
 static void kolibri_script_set_mode(KolibriScript *script, const char *mode);
 static void kolibri_apply_mode(KolibriScript *script, char *answer);
 
@@ -283,8 +293,49 @@ static void kolibri_generate_text_from_gene(const KolibriFormula *formula,
 }
 
 
-static char *kolibri_strndup(const char *src, size_t len) {
-    char *copy = (char *)malloc(len + 1U);
+/*
+ * Bump allocator behind a program (tokens, AST, compiled constants) and
+ * behind one execution (values, variables, bindings). Nothing in it is freed
+ * on its own: a reset keeps only the newest, largest chunk for reuse, and
+ * freeing returns every chunk.
+ */
+#define KOLIBRI_ARENA_CHUNK 4096U
+
+struct KolibriScriptArenaChunk {
+    struct KolibriScriptArenaChunk *next;
+    size_t used;
+    size_t size;
+    max_align_t data[];
+};
+
+static void *kolibri_arena_alloc(KolibriScriptArena *arena, size_t size) {
+    const size_t align = _Alignof(max_align_t);
+    size = (size + align - 1U) & ~(align - 1U);
+    KolibriScriptArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk ? chunk->size * KOLIBRI_ARRAY_GROWTH_FACTOR : KOLIBRI_ARENA_CHUNK;
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+        KolibriScriptArenaChunk *grown =
+            (KolibriScriptArenaChunk *)kolibri_mem_alloc(arena->allocator, sizeof(KolibriScriptArenaChunk) + chunk_size);
+        if (!grown) {
+            return NULL;
+        }
+        grown->next = chunk;
+        grown->used = 0;
+        grown->size = chunk_size;
+        arena->head = grown;
+        chunk = grown;
+    }
+    void *memory = (unsigned char *)chunk->data + chunk->used;
+    chunk->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+static char *kolibri_arena_strndup(KolibriScriptArena *arena, const char *src, size_t len) {
+    char *copy = (char *)kolibri_arena_alloc(arena, len + 1U);
     if (!copy) {
         return NULL;
     }
@@ -293,6 +344,199 @@ static char *kolibri_strndup(const char *src, size_t len) {
     return copy;
 }
 
+static char *kolibri_arena_strdup(KolibriScriptArena *arena, const char *text) {
+    return kolibri_arena_strndup(arena, text, strlen(text));
+}
+
+static void kolibri_arena_reset(KolibriScriptArena *arena) {
+    KolibriScriptArenaChunk *head = arena->head;
+    if (!head) {
+        return;
+    }
+    KolibriScriptArenaChunk *chunk = head->next;
+    while (chunk) {
+        KolibriScriptArenaChunk *next = chunk->next;
+        kolibri_mem_free(arena->allocator, chunk);
+        chunk = next;
+    }
+    head->next = NULL;
+    head->used = 0;
+}
+
+static void kolibri_arena_free(KolibriScriptArena *arena) {
+    kolibri_arena_reset(arena);
+    kolibri_mem_free(arena->allocator, arena->head);
+    arena->head = NULL;
+}
+
+/* Hands every chunk of from to arena, behind the chunk arena allocates from. */
+static void kolibri_arena_adopt(KolibriScriptArena *arena, KolibriScriptArena *from) {
+    KolibriScriptArenaChunk *first = from->head;
+    if (!first) {
+        return;
+    }
+    from->head = NULL;
+    if (!arena->head) {
+        arena->head = first;
+        return;
+    }
+    KolibriScriptArenaChunk *last = first;
+    while (last->next) {
+        last = last->next;
+    }
+    last->next = arena->head->next;
+    arena->head->next = first;
+}
+
+/* ===================== Shared pool ===================== */
+
+/* Best formulas an evolved snapshot offers the shared pool, as many as an
+ * island sends by default. */
+#define KOLIBRI_SHARED_MIGRANTS 2U
+#define KOLIBRI_SHARED_MERGE_BATCH 64U
+
+struct KolibriSharedPool {
+    KolibriFormulaPool *pool;
+    KolibriGenome *genome;
+    KolibriSymbolTable symbols;
+#ifdef KOLIBRI_SCRIPT_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+/* An association (event == NULL) or a genome event left for the merge. */
+typedef struct KolibriScriptChange {
+    struct KolibriScriptChange *next;
+    const char *event;
+    const char *text;
+    const char *answer;
+    const char *source;
+    uint64_t timestamp;
+} KolibriScriptChange;
+
+/*
+ * A script's snapshot of the shared pool and what its runs would have
+ * written to the shared pool and genome. The changes have their own arena:
+ * the script's is reset at the start of the very run that produces them.
+ */
+typedef struct KolibriScriptChanges {
+    KolibriSharedPool *shared;
+    KolibriFormulaPool *snapshot;
+    KolibriFormulaPool *home_pool;
+    KolibriGenome *home_genome;
+    KolibriScriptArena arena;
+    KolibriScriptChange *head;
+    KolibriScriptChange **tail;
+} KolibriScriptChanges;
+
+static int kolibri_changes_push(KolibriScriptChanges *changes, const char *event, const char *text,
+                                const char *answer, const char *source, uint64_t timestamp) {
+    KolibriScriptChange *change =
+        (KolibriScriptChange *)kolibri_arena_alloc(&changes->arena, sizeof(KolibriScriptChange));
+    if (!change) {
+        return -1;
+    }
+    change->event = event ? kolibri_arena_strdup(&changes->arena, event) : NULL;
+    change->text = kolibri_arena_strdup(&changes->arena, text);
+    change->answer = answer ? kolibri_arena_strdup(&changes->arena, answer) : NULL;
+    change->source = kolibri_arena_strdup(&changes->arena, source ? source : "");
+    change->timestamp = timestamp;
+    if ((event && !change->event) || !change->text || (answer && !change->answer) || !change->source) {
+        return -1;
+    }
+    *changes->tail = change;
+    changes->tail = &change->next;
+    return 0;
+}
+
+/* Refreshes the snapshot from the shared pool before a run. */
+static int kolibri_shared_begin(KolibriScript *script) {
+    KolibriScriptChanges *changes = script->changes;
+    if (!changes) {
+        return 0;
+    }
+    KolibriSharedPool *shared = changes->shared;
+    int status;
+    ks_shared_lock(shared);
+    if (!changes->snapshot) {
+        changes->snapshot = kf_pool_clone(shared->pool);
+        status = changes->snapshot ? 0 : -1;
+    } else {
+        status = kf_pool_copy(changes->snapshot, shared->pool);
+    }
+    if (kolibri_symbol_table_copy(&script->symbol_table, &shared->symbols) != 0) {
+        status = -1;
+    }
+    ks_shared_unlock(shared);
+    /* New symbols reach the genome through the shared table at the merge. */
+    script->symbol_table.genome = NULL;
+    script->pool = changes->snapshot;
+    return status;
+}
+
+/*
+ * Replays the run's changes on the shared pool in the order they were made.
+ * Associations are encoded again with the shared symbol table, so every
+ * script's pairs end up with the same digits.
+ */
+static void kolibri_shared_merge(KolibriScript *script) {
+    KolibriScriptChanges *changes = script->changes;
+    if (!changes) {
+        return;
+    }
+    KolibriSharedPool *shared = changes->shared;
+    KolibriFormulaPool *master = shared->pool;
+    KolibriAssociationInput pairs[KOLIBRI_SHARED_MERGE_BATCH];
+    ks_shared_lock(shared);
+    const KolibriScriptChange *change = changes->head;
+    while (change) {
+        if (change->event) {
+            if (shared->genome) {
+                kg_append(shared->genome, change->event, change->text, NULL);
+            }
+            change = change->next;
+            continue;
+        }
+        const KolibriScriptChange *first = change;
+        size_t count = 0;
+        while (change && !change->event && count < KOLIBRI_SHARED_MERGE_BATCH &&
+               change->timestamp == first->timestamp && strcmp(change->source, first->source) == 0) {
+            pairs[count].question = change->text;
+            pairs[count].answer = change->answer;
+            count++;
+            change = change->next;
+        }
+        (void)kf_pool_add_associations_bulk(master, &shared->symbols, pairs, count, first->source,
+                                            first->timestamp);
+    }
+    const KolibriFormulaPool *snapshot = changes->snapshot;
+    if (snapshot && snapshot->profile.generation_steps > 0 && master->count > 1U) {
+        size_t migrants = KOLIBRI_SHARED_MIGRANTS;
+        if (migrants >= master->count) {
+            migrants = master->count - 1U;
+        }
+        (void)kf_pool_immigrate(master, snapshot->formulas, migrants);
+    }
+    ks_shared_unlock(shared);
+    kolibri_arena_reset(&changes->arena);
+    changes->head = NULL;
+    changes->tail = &changes->head;
+}
+
+static void kolibri_shared_detach(KolibriScript *script) {
+    KolibriScriptChanges *changes = script->changes;
+    if (!changes) {
+        return;
+    }
+    script->pool = changes->home_pool;
+    script->genome = changes->home_genome;
+    kf_pool_destroy(changes->snapshot);
+    kolibri_arena_free(&changes->arena);
+    kolibri_mem_free(&script->allocator, changes);
+    script->changes = NULL;
+}
+
+
 typedef struct {
     const char *source;
     size_t length;
@@ -301,10 +545,11 @@ typedef struct {
     size_t column;
     KolibriTokenBuffer *tokens;
     KolibriDiagnosticBuffer *diagnostics;
+    KolibriScriptArena *arena;
 } KolibriLexer;
 
 static void kolibri_lexer_init(KolibriLexer *lexer, const char *source, KolibriTokenBuffer *tokens,
-                               KolibriDiagnosticBuffer *diagnostics) {
+                               KolibriDiagnosticBuffer *diagnostics, KolibriScriptArena *arena) {
     lexer->source = source ? source : "";
     lexer->length = source ? strlen(source) : 0;
     lexer->index = 0;
@@ -312,6 +557,7 @@ static void kolibri_lexer_init(KolibriLexer *lexer, const char *source, KolibriT
     lexer->column = 1;
     lexer->tokens = tokens;
     lexer->diagnostics = diagnostics;
+    lexer->arena = arena;
 }
 
 static KolibriSourceLocation kolibri_lexer_location(const KolibriLexer *lexer) {
@@ -344,16 +590,12 @@ static int kolibri_lexer_emit_token(KolibriLexer *lexer, KolibriTokenType type,
                                     KolibriSourceLocation start_loc, KolibriSourceLocation end_loc) {
     KolibriToken token;
     token.type = type;
-    token.lexeme = lexeme_length > 0 ? kolibri_strndup(lexeme_start, lexeme_length) : NULL;
+    token.lexeme = lexeme_length > 0 ? kolibri_arena_strndup(lexer->arena, lexeme_start, lexeme_length) : NULL;
     if (lexeme_length > 0 && !token.lexeme) {
         return -1;
     }
     token.span = kolibri_make_span(start_loc, end_loc);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(token.lexeme);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_emit_simple(KolibriLexer *lexer, KolibriTokenType type, size_t length) {
@@ -438,14 +680,10 @@ static int kolibri_lexer_read_string(KolibriLexer *lexer) {
     if (end.column > 0) {
         end.column -= 1U;
     }
-    char *raw = kolibri_strndup(lexer->source + begin, literal_len);
-    if (!raw) {
-        return -1;
-    }
+    const char *raw = lexer->source + begin;
     /* Strip escapes */
-    char *decoded = (char *)malloc(literal_len + 1U);
+    char *decoded = (char *)kolibri_arena_alloc(lexer->arena, literal_len + 1U);
     if (!decoded) {
-        free(raw);
         return -1;
     }
     size_t write = 0U;
@@ -468,16 +706,11 @@ static int kolibri_lexer_read_string(KolibriLexer *lexer) {
         }
     }
     decoded[write] = '\0';
-    free(raw);
     KolibriToken token;
     token.type = KOLIBRI_TOKEN_STRING;
     token.lexeme = decoded;
     token.span = kolibri_make_span(start, end);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(decoded);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_read_word(KolibriLexer *lexer) {
@@ -501,7 +734,7 @@ static int kolibri_lexer_read_word(KolibriLexer *lexer) {
     if (end.column > 0) {
         end.column -= 1U;
     }
-    char *word = kolibri_strndup(lexer->source + begin, len);
+    char *word = kolibri_arena_strndup(lexer->arena, lexer->source + begin, len);
     if (!word) {
         return -1;
     }
@@ -510,11 +743,7 @@ static int kolibri_lexer_read_word(KolibriLexer *lexer) {
     token.type = type;
     token.lexeme = word;
     token.span = kolibri_make_span(start, end);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(word);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_run(KolibriLexer *lexer) {
@@ -621,9 +850,40 @@ static int kolibri_lexer_run(KolibriLexer *lexer) {
 
 /* ===================== AST ===================== */
 
-typedef struct {
+typedef enum {
+    KOLIBRI_EXPR_TEXT = 0,
+    KOLIBRI_EXPR_NUMBER,
+    KOLIBRI_EXPR_FITNESS
+} KolibriExpressionKind;
+
+typedef enum {
+    KOLIBRI_COMPARE_NONE = 0,
+    KOLIBRI_COMPARE_GE,
+    KOLIBRI_COMPARE_LE,
+    KOLIBRI_COMPARE_EQ,
+    KOLIBRI_COMPARE_NE,
+    KOLIBRI_COMPARE_GT,
+    KOLIBRI_COMPARE_LT
+} KolibriComparator;
+
+/*
+ * Expressions are resolved once at parse time. name is set when the text
+ * could name a variable, which then takes precedence over kind; string is
+ * the text constant or the binding name of a fitness lookup. A comparison
+ * keeps its two operands for conditions. slot is the 1-based variable slot
+ * ks_compile assigns to name, 0 for the tree-walking interpreter.
+ */
+typedef struct KolibriExpression {
     char *text;
     KolibriSourceSpan span;
+    KolibriExpressionKind kind;
+    char *name;
+    char *string;
+    double number;
+    bool numeric;
+    KolibriComparator comparator;
+    struct KolibriExpression *operands;
+    size_t slot;
 } KolibriExpression;
 
 typedef enum {
@@ -697,8 +957,10 @@ struct KolibriStatement {
     } data;
 };
 
+/* Tokens and every node of the tree live in arena. */
 typedef struct {
     KolibriStatementList statements;
+    KolibriScriptArena arena;
 } KolibriProgram;
 
 static void kolibri_statement_list_init(KolibriStatementList *list) {
@@ -707,36 +969,18 @@ static void kolibri_statement_list_init(KolibriStatementList *list) {
     list->capacity = 0;
 }
 
-static void kolibri_free_expression(KolibriExpression *expr) {
-    if (!expr) {
-        return;
-    }
-    free(expr->text);
-    expr->text = NULL;
-}
-
-static void kolibri_free_statement(KolibriStatement *stmt);
-
-static void kolibri_statement_list_free(KolibriStatementList *list) {
-    if (!list) {
-        return;
-    }
-    for (size_t i = 0; i < list->count; ++i) {
-        kolibri_free_statement(list->items[i]);
-    }
-    free(list->items);
-    list->items = NULL;
-    list->count = 0;
-    list->capacity = 0;
-}
-
-static int kolibri_statement_list_push(KolibriStatementList *list, KolibriStatement *stmt) {
+static int kolibri_statement_list_push(KolibriScriptArena *arena, KolibriStatementList *list,
+                                       KolibriStatement *stmt) {
     if (list->count == list->capacity) {
         size_t new_capacity = list->capacity == 0 ? 8U : list->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriStatement **new_items = (KolibriStatement **)realloc(list->items, new_capacity * sizeof(KolibriStatement *));
+        KolibriStatement **new_items =
+            (KolibriStatement **)kolibri_arena_alloc(arena, new_capacity * sizeof(KolibriStatement *));
         if (!new_items) {
             return -1;
         }
+        if (list->count > 0) {
+            memcpy(new_items, list->items, list->count * sizeof(KolibriStatement *));
+        }
         list->items = new_items;
         list->capacity = new_capacity;
     }
@@ -744,63 +988,12 @@ static int kolibri_statement_list_push(KolibriStatementList *list, KolibriStatem
     return 0;
 }
 
-static void kolibri_free_statement(KolibriStatement *stmt) {
-    if (!stmt) {
-        return;
-    }
-    switch (stmt->kind) {
-    case KOLIBRI_NODE_SHOW:
-        kolibri_free_expression(&stmt->data.show.value);
-        break;
-    case KOLIBRI_NODE_VARIABLE:
-        free(stmt->data.variable.name);
-        kolibri_free_expression(&stmt->data.variable.value);
-        break;
-    case KOLIBRI_NODE_TEACH:
-        kolibri_free_expression(&stmt->data.teach.left);
-        kolibri_free_expression(&stmt->data.teach.right);
-        break;
-    case KOLIBRI_NODE_CREATE_FORMULA:
-        free(stmt->data.create_formula.name);
-        kolibri_free_expression(&stmt->data.create_formula.expression);
-        break;
-    case KOLIBRI_NODE_EVALUATE_FORMULA:
-        free(stmt->data.evaluate_formula.name);
-        kolibri_free_expression(&stmt->data.evaluate_formula.task);
-        break;
-    case KOLIBRI_NODE_SAVE_FORMULA:
-        free(stmt->data.save_formula.name);
-        break;
-    case KOLIBRI_NODE_DROP_FORMULA:
-        free(stmt->data.drop_formula.name);
-        break;
-    case KOLIBRI_NODE_SWARM_SEND:
-        free(stmt->data.swarm_send.name);
-        break;
-    case KOLIBRI_NODE_IF:
-        kolibri_free_expression(&stmt->data.if_stmt.condition);
-        kolibri_statement_list_free(&stmt->data.if_stmt.then_body);
-        kolibri_statement_list_free(&stmt->data.if_stmt.else_body);
-        break;
-    case KOLIBRI_NODE_WHILE:
-        kolibri_free_expression(&stmt->data.while_stmt.condition);
-        kolibri_statement_list_free(&stmt->data.while_stmt.body);
-        break;
-    case KOLIBRI_NODE_MODE:
-        kolibri_free_expression(&stmt->data.mode_stmt.value);
-        break;
-    case KOLIBRI_NODE_CALL_EVOLUTION:
-    case KOLIBRI_NODE_PRINT_CANVAS:
-        break;
-    }
-    free(stmt);
-}
-
 static void kolibri_program_free(KolibriProgram *program) {
     if (!program) {
         return;
     }
-    kolibri_statement_list_free(&program->statements);
+    kolibri_arena_free(&program->arena);
+    kolibri_statement_list_init(&program->statements);
 }
 
 /* ===================== Parser ===================== */
@@ -810,13 +1003,15 @@ typedef struct {
     size_t count;
     size_t index;
     KolibriDiagnosticBuffer *diagnostics;
+    KolibriScriptArena *arena;
 } KolibriParser;
 
 static void kolibri_parser_init(KolibriParser *parser, const KolibriTokenBuffer *buffer,
-                                KolibriDiagnosticBuffer *diagnostics) {
+                                KolibriDiagnosticBuffer *diagnostics, KolibriScriptArena *arena) {
     parser->tokens = buffer->data;
     parser->count = buffer->count;
     parser->index = 0;
+    parser->arena = arena;
     parser->diagnostics = diagnostics;
 }
 
@@ -874,42 +1069,36 @@ static void kolibri_parser_skip_newlines(KolibriParser *parser) {
     }
 }
 
-static char *kolibri_expression_build_string(const KolibriToken *start, const KolibriToken *end) {
+static char *kolibri_expression_build_string(KolibriScriptArena *arena, const KolibriToken *start,
+                                             const KolibriToken *end) {
     if (!start || !end) {
         return NULL;
     }
-    size_t capacity = 64U;
-    char *buffer = (char *)malloc(capacity);
+    size_t length = 0U;
+    for (const KolibriToken *token = start;; ++token) {
+        length += (token->lexeme ? strlen(token->lexeme) : 0U) + 1U;
+        if (token == end) {
+            break;
+        }
+    }
+    char *buffer = (char *)kolibri_arena_alloc(arena, length + 1U);
     if (!buffer) {
         return NULL;
     }
-    buffer[0] = '\0';
-    size_t length = 0U;
-    const KolibriToken *token = start;
-    while (true) {
+    size_t written = 0U;
+    for (const KolibriToken *token = start;; ++token) {
+        if (written > 0) {
+            buffer[written++] = ' ';
+        }
         const char *fragment = token->lexeme ? token->lexeme : "";
         size_t fragment_len = strlen(fragment);
-        if (length + fragment_len + 2U >= capacity) {
-            size_t new_capacity = capacity * KOLIBRI_ARRAY_GROWTH_FACTOR + fragment_len + 8U;
-            char *new_buffer = (char *)realloc(buffer, new_capacity);
-            if (!new_buffer) {
-                free(buffer);
-                return NULL;
-            }
-            buffer = new_buffer;
-            capacity = new_capacity;
-        }
-        if (length > 0) {
-            buffer[length++] = ' ';
-        }
-        memcpy(buffer + length, fragment, fragment_len);
-        length += fragment_len;
-        buffer[length] = '\0';
+        memcpy(buffer + written, fragment, fragment_len);
+        written += fragment_len;
         if (token == end) {
             break;
         }
-        token += 1;
     }
+    buffer[written] = '\0';
     return buffer;
 }
 
@@ -1116,30 +1305,6 @@ static void kolibri_to_lower_ascii(const char *src, char *dst, size_t dst_len) {
     dst[i] = '\0';
 }
 
-static const KolibriAssociation *kolibri_find_partial_association(const KolibriFormulaPool *pool,
-                                                                  const char *question) {
-    if (!pool || !question) {
-        return NULL;
-    }
-    char lowered_question[256];
-    kolibri_to_lower_ascii(question, lowered_question, sizeof(lowered_question));
-    size_t best_len = 0U;
-    const KolibriAssociation *best = NULL;
-    for (size_t i = 0; i < pool->association_count; ++i) {
-        const KolibriAssociation *assoc = &pool->associations[i];
-        char lowered_assoc[256];
-        kolibri_to_lower_ascii(assoc->question, lowered_assoc, sizeof(lowered_assoc));
-        if (strstr(lowered_question, lowered_assoc) || strstr(lowered_assoc, lowered_question)) {
-            size_t len = strlen(assoc->question);
-            if (len > best_len) {
-                best_len = len;
-                best = assoc;
-            }
-        }
-    }
-    return best;
-}
-
 static bool kolibri_try_calculate(const char *question, char *buffer, size_t buffer_len) {
     if (!question || !buffer || buffer_len == 0) {
         return false;
@@ -1181,68 +1346,121 @@ static bool kolibri_try_calculate(const char *question, char *buffer, size_t buf
     return false;
 }
 
-static void kolibri_record_ngrams(KolibriScript *script,
-                                  const char *question,
-                                  const char *answer,
-                                  const char *source,
-                                  uint64_t timestamp) {
-    if (!script || !script->pool || !question || !answer) {
+/*
+ * Associations on their way to kf_pool_add_associations_bulk. A pair takes
+ * at most one item for itself and one per distinct 2- or 3-word n-gram of
+ * its first 32 words, and its n-grams fit in a few copies of the question.
+ */
+#define KOLIBRI_NGRAM_TOKENS 32U
+#define KOLIBRI_TEACH_PAIR_ITEMS (1U + 2U * KOLIBRI_NGRAM_TOKENS)
+#define KOLIBRI_NGRAM_SLOTS 128U
+#define KOLIBRI_TEACH_PAIR_TEXT (6U * KOLIBRI_ASSOC_QUESTION_MAX)
+#define KOLIBRI_TEACH_BATCH_ITEMS 256U
+#define KOLIBRI_TEACH_BATCH_TEXT (16U * KOLIBRI_TEACH_PAIR_TEXT)
+
+typedef struct KolibriTeachBatch {
+    KolibriAssociationInput items[KOLIBRI_TEACH_BATCH_ITEMS];
+    size_t count;
+    char text[KOLIBRI_TEACH_BATCH_TEXT];
+    size_t text_used;
+} KolibriTeachBatch;
+
+static void kolibri_teach_batch_flush(KolibriScript *script, const char *source) {
+    KolibriTeachBatch *batch = script->teach;
+    if (!batch || batch->count == 0) {
         return;
     }
-    char copy[256];
-    strncpy(copy, question, sizeof(copy) - 1U);
-    copy[sizeof(copy) - 1U] = '\0';
-    kolibri_trim_spaces(copy);
-    if (copy[0] == '\0') {
-        return;
+    uint64_t timestamp = (uint64_t)time(NULL);
+    if (script->pool) {
+        (void)kf_pool_add_associations_bulk(script->pool, &script->symbol_table, batch->items, batch->count,
+                                            source, timestamp);
+    }
+    if (script->changes) {
+        for (size_t i = 0; i < batch->count; ++i) {
+            (void)kolibri_changes_push(script->changes, NULL, batch->items[i].question, batch->items[i].answer,
+                                       source, timestamp);
+        }
+    }
+    batch->count = 0;
+    batch->text_used = 0;
+}
+
+/*
+ * Queues question -> answer and then every distinct n-gram of the trimmed
+ * question. Trimming leaves single spaces between words, so an n-gram is a
+ * plain substring of the copy. Both strings must outlive the next flush.
+ */
+static int kolibri_teach_batch_add(KolibriScript *script, const char *question, const char *answer,
+                                   const char *source) {
+    if (!script->teach) {
+        script->teach = (KolibriTeachBatch *)kolibri_arena_alloc(&script->arena, sizeof(KolibriTeachBatch));
+        if (!script->teach) {
+            return -1;
+        }
     }
-    char *tokens[32];
+    KolibriTeachBatch *batch = script->teach;
+    if (batch->count + KOLIBRI_TEACH_PAIR_ITEMS > KOLIBRI_TEACH_BATCH_ITEMS ||
+        batch->text_used + KOLIBRI_TEACH_PAIR_TEXT > KOLIBRI_TEACH_BATCH_TEXT) {
+        kolibri_teach_batch_flush(script, source);
+    }
+    batch->items[batch->count].question = question;
+    batch->items[batch->count].answer = answer;
+    batch->count++;
+
+    char *copy = &batch->text[batch->text_used];
+    strncpy(copy, question, KOLIBRI_ASSOC_QUESTION_MAX - 1U);
+    copy[KOLIBRI_ASSOC_QUESTION_MAX - 1U] = '\0';
+    kolibri_trim_spaces(copy);
+    size_t copy_len = strlen(copy);
+    size_t starts[KOLIBRI_NGRAM_TOKENS];
+    size_t ends[KOLIBRI_NGRAM_TOKENS];
     size_t token_count = 0;
-    char *saveptr = NULL;
-    for (char *tok = strtok_r(copy, " ", &saveptr);
-         tok && token_count < sizeof(tokens) / sizeof(tokens[0]);
-         tok = strtok_r(NULL, " ", &saveptr)) {
-        tokens[token_count++] = tok;
+    for (size_t pos = 0; pos < copy_len && token_count < KOLIBRI_NGRAM_TOKENS;) {
+        size_t end = pos;
+        while (end < copy_len && copy[end] != ' ') {
+            end++;
+        }
+        starts[token_count] = pos;
+        ends[token_count++] = end;
+        pos = end + 1U;
     }
     if (token_count < 2) {
-        return;
+        return 0;
     }
-    char recorded[64][256];
-    size_t recorded_count = 0;
+    batch->text_used += copy_len + 1U;
+
+    /* Open addressing over this pair's n-grams, keyed by their hashes. */
+    uint64_t hashes[KOLIBRI_NGRAM_SLOTS];
+    size_t slots[KOLIBRI_NGRAM_SLOTS];
+    const size_t mask = KOLIBRI_NGRAM_SLOTS - 1U;
+    memset(slots, 0, sizeof(slots));
     for (size_t n = 2; n <= 3 && n <= token_count; ++n) {
         for (size_t i = 0; i + n <= token_count; ++i) {
-            char ngram[256];
-            ngram[0] = '\0';
-            for (size_t j = 0; j < n; ++j) {
-                if (j > 0) {
-                    strncat(ngram, " ", sizeof(ngram) - strlen(ngram) - 1U);
-                }
-                strncat(ngram, tokens[i + j], sizeof(ngram) - strlen(ngram) - 1U);
-            }
-            if (ngram[0] == '\0') {
-                continue;
-            }
+            size_t len = ends[i + n - 1U] - starts[i];
+            char *ngram = &batch->text[batch->text_used];
+            memcpy(ngram, copy + starts[i], len);
+            ngram[len] = '\0';
+            uint64_t hash = kolibri_text_hash(ngram);
+            size_t pos = (size_t)hash & mask;
             bool seen = false;
-            for (size_t r = 0; r < recorded_count; ++r) {
-                if (strcmp(recorded[r], ngram) == 0) {
+            for (; slots[pos] != 0U; pos = (pos + 1U) & mask) {
+                if (hashes[pos] == hash && strcmp(batch->items[slots[pos] - 1U].question, ngram) == 0) {
                     seen = true;
                     break;
                 }
             }
-            if (seen || recorded_count >= sizeof(recorded) / sizeof(recorded[0])) {
+            if (seen) {
                 continue;
             }
-            strncpy(recorded[recorded_count], ngram, sizeof(recorded[recorded_count]) - 1U);
-            recorded[recorded_count][sizeof(recorded[recorded_count]) - 1U] = '\0';
-            recorded_count++;
-            (void)kf_pool_add_association(script->pool,
-                                          &script->symbol_table,
-                                          ngram,
-                                          answer,
-                                          source ? source : "ngram",
-                                          timestamp);
+            hashes[pos] = hash;
+            slots[pos] = batch->count + 1U;
+            batch->items[batch->count].question = ngram;
+            batch->items[batch->count].answer = answer;
+            batch->count++;
+            batch->text_used += len + 1U;
         }
     }
+    return 0;
 }
 
 static bool kolibri_token_is_terminator(const KolibriToken *token, const char *const *keywords, size_t keyword_count,
@@ -1262,6 +1480,9 @@ static bool kolibri_token_is_terminator(const KolibriToken *token, const char *c
     return false;
 }
 
+static bool kolibri_compile_expression(KolibriScriptArena *arena, KolibriExpression *expr,
+                                       bool with_comparison);
+
 static bool kolibri_parser_parse_expression_until(KolibriParser *parser, KolibriExpression *expr,
                                                   const char *const *keywords, size_t keyword_count,
                                                   const KolibriTokenType *types, size_t type_count) {
@@ -1286,17 +1507,18 @@ static bool kolibri_parser_parse_expression_until(KolibriParser *parser, Kolibri
         kolibri_parser_report(parser, "Ожидалось выражение", start);
         return false;
     }
-    char *text = kolibri_expression_build_string(first, last);
+    char *text = kolibri_expression_build_string(parser->arena, first, last);
     if (!text) {
         return false;
     }
     expr->text = text;
     expr->span = kolibri_make_span(first->span.start, last->span.end);
-    return true;
+    return kolibri_compile_expression(parser->arena, expr, true);
 }
 
-static KolibriStatement *kolibri_parser_make_statement(KolibriNodeKind kind, KolibriSourceSpan span) {
-    KolibriStatement *stmt = (KolibriStatement *)calloc(1U, sizeof(KolibriStatement));
+static KolibriStatement *kolibri_parser_make_statement(KolibriParser *parser, KolibriNodeKind kind,
+                                                       KolibriSourceSpan span) {
+    KolibriStatement *stmt = (KolibriStatement *)kolibri_arena_alloc(parser->arena, sizeof(KolibriStatement));
     if (!stmt) {
         return NULL;
     }
@@ -1344,9 +1566,8 @@ static KolibriStatement *kolibri_parser_parse_show(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SHOW, kolibri_make_span(start->span.start, expr.span.end));
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SHOW, kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
     stmt->data.show.value = expr;
@@ -1369,16 +1590,13 @@ static KolibriStatement *kolibri_parser_parse_variable(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_VARIABLE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_VARIABLE,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
-    stmt->data.variable.name = strdup(name_token->lexeme);
+    stmt->data.variable.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.variable.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
     stmt->data.variable.value = expr;
@@ -1393,10 +1611,9 @@ static KolibriStatement *kolibri_parser_parse_mode(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_MODE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_MODE,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
     stmt->data.mode_stmt.value = expr;
@@ -1416,21 +1633,17 @@ static KolibriStatement *kolibri_parser_parse_teach(KolibriParser *parser) {
     }
     if (!kolibri_parser_match_token(parser, KOLIBRI_TOKEN_ARROW)) {
         kolibri_parser_report(parser, "Ожидался символ '->'", kolibri_parser_current(parser));
-        kolibri_free_expression(&left);
         return NULL;
     }
     const char *terminator_keywords[] = { NULL };
     KolibriTokenType terminator_types[] = { KOLIBRI_TOKEN_NEWLINE, KOLIBRI_TOKEN_EOF };
     KolibriExpression right = { 0 };
     if (!kolibri_parser_parse_expression_until(parser, &right, terminator_keywords, 0, terminator_types, 2U)) {
-        kolibri_free_expression(&left);
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_TEACH,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_TEACH,
                                                            kolibri_make_span(start->span.start, right.span.end));
     if (!stmt) {
-        kolibri_free_expression(&left);
-        kolibri_free_expression(&right);
         return NULL;
     }
     stmt->data.teach.left = left;
@@ -1456,16 +1669,13 @@ static KolibriStatement *kolibri_parser_parse_create_formula(KolibriParser *pars
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_CREATE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_CREATE_FORMULA,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
-    stmt->data.create_formula.name = strdup(name_token->lexeme);
+    stmt->data.create_formula.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.create_formula.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
     stmt->data.create_formula.expression = expr;
@@ -1487,16 +1697,13 @@ static KolibriStatement *kolibri_parser_parse_evaluate_formula(KolibriParser *pa
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_EVALUATE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_EVALUATE_FORMULA,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
-    stmt->data.evaluate_formula.name = strdup(name_token->lexeme);
+    stmt->data.evaluate_formula.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.evaluate_formula.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
     stmt->data.evaluate_formula.task = expr;
@@ -1512,14 +1719,13 @@ static KolibriStatement *kolibri_parser_parse_save_formula(KolibriParser *parser
     if (!kolibri_parser_expect_keyword(parser, "в") || !kolibri_parser_expect_keyword(parser, "геном")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SAVE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SAVE_FORMULA,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.save_formula.name = strdup(name_token->lexeme);
+    stmt->data.save_formula.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.save_formula.name) {
-        free(stmt);
         return NULL;
     }
     return stmt;
@@ -1531,14 +1737,13 @@ static KolibriStatement *kolibri_parser_parse_drop_formula(KolibriParser *parser
     if (!kolibri_parser_expect_identifier(parser, &name_token)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_DROP_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_DROP_FORMULA,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.drop_formula.name = strdup(name_token->lexeme);
+    stmt->data.drop_formula.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.drop_formula.name) {
-        free(stmt);
         return NULL;
     }
     return stmt;
@@ -1553,14 +1758,13 @@ static KolibriStatement *kolibri_parser_parse_swarm(KolibriParser *parser) {
     if (!kolibri_parser_expect_identifier(parser, &name_token)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SWARM_SEND,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SWARM_SEND,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.swarm_send.name = strdup(name_token->lexeme);
+    stmt->data.swarm_send.name = kolibri_arena_strdup(parser->arena, name_token->lexeme);
     if (!stmt->data.swarm_send.name) {
-        free(stmt);
         return NULL;
     }
     return stmt;
@@ -1571,7 +1775,7 @@ static KolibriStatement *kolibri_parser_parse_call_evolution(KolibriParser *pars
     if (!kolibri_parser_expect_keyword(parser, "эволюцию")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_CALL_EVOLUTION, start->span);
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_CALL_EVOLUTION, start->span);
     return stmt;
 }
 
@@ -1580,7 +1784,7 @@ static KolibriStatement *kolibri_parser_parse_print_canvas(KolibriParser *parser
     if (!kolibri_parser_expect_keyword(parser, "канву")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_PRINT_CANVAS, start->span);
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_PRINT_CANVAS, start->span);
     return stmt;
 }
 
@@ -1593,7 +1797,6 @@ static KolibriStatement *kolibri_parser_parse_if(KolibriParser *parser) {
         return NULL;
     }
     if (!kolibri_parser_expect_keyword(parser, "тогда")) {
-        kolibri_free_expression(&condition);
         return NULL;
     }
     kolibri_parser_skip_newlines(parser);
@@ -1611,18 +1814,12 @@ static KolibriStatement *kolibri_parser_parse_if(KolibriParser *parser) {
         end_token = kolibri_parser_current(parser);
     }
     if (!kolibri_parser_expect_keyword(parser, "конец")) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&then_body);
-        kolibri_statement_list_free(&else_body);
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_IF,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_IF,
                                                            kolibri_make_span(start->span.start,
                                                                              has_else ? end_token->span.end : kolibri_parser_previous(parser)->span.end));
     if (!stmt) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&then_body);
-        kolibri_statement_list_free(&else_body);
         return NULL;
     }
     stmt->data.if_stmt.condition = condition;
@@ -1640,23 +1837,18 @@ static KolibriStatement *kolibri_parser_parse_while(KolibriParser *parser) {
         return NULL;
     }
     if (!kolibri_parser_expect_keyword(parser, "делать")) {
-        kolibri_free_expression(&condition);
         return NULL;
     }
     kolibri_parser_skip_newlines(parser);
     const char *terminators[] = { "конец" };
     KolibriStatementList body = kolibri_parser_parse_statements(parser, terminators, 1U);
     if (!kolibri_parser_expect_keyword(parser, "конец")) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&body);
         return NULL;
     }
     const KolibriToken *end_token = kolibri_parser_previous(parser);
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_WHILE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_WHILE,
                                                            kolibri_make_span(start->span.start, end_token->span.end));
     if (!stmt) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&body);
         return NULL;
     }
     stmt->data.while_stmt.condition = condition;
@@ -1748,8 +1940,7 @@ static KolibriStatementList kolibri_parser_parse_statements(KolibriParser *parse
             kolibri_parser_match_token(parser, KOLIBRI_TOKEN_NEWLINE);
             continue;
         }
-        if (kolibri_statement_list_push(&list, stmt) != 0) {
-            kolibri_free_statement(stmt);
+        if (kolibri_statement_list_push(parser->arena, &list, stmt) != 0) {
             break;
         }
         kolibri_parser_match_token(parser, KOLIBRI_TOKEN_NEWLINE);
@@ -1809,22 +2000,22 @@ typedef struct KolibriScriptFormulaBinding {
     double last_fitness;
 } KolibriScriptFormulaBinding;
 
-static void kolibri_value_free(KolibriValue *value) {
-    if (!value) {
-        return;
-    }
-    if (value->type == KOLIBRI_VALUE_STRING) {
-        free(value->string_value);
-    }
-    value->string_value = NULL;
-    value->number_value = 0.0;
-    value->type = KOLIBRI_VALUE_NONE;
-}
-
-static KolibriValue kolibri_value_from_string(const char *text) {
+/*
+ * Per-run state of ks_execute_compiled. Variables are only appended during
+ * a run, so a slot caches the index of its variable (plus one) from the
+ * first hit on.
+ */
+typedef struct KolibriScriptFrame {
+    size_t *variables;
+    size_t *loops;
+} KolibriScriptFrame;
+
+/* Value strings live in the execution arena, so values are copied freely
+ * and never freed one by one. */
+static KolibriValue kolibri_value_from_string(KolibriScript *script, const char *text) {
     KolibriValue value;
     value.type = KOLIBRI_VALUE_STRING;
-    value.string_value = text ? strdup(text) : NULL;
+    value.string_value = text ? kolibri_arena_strdup(&script->arena, text) : NULL;
     value.number_value = 0.0;
     return value;
 }
@@ -1837,47 +2028,150 @@ static KolibriValue kolibri_value_from_number(double number) {
     return value;
 }
 
+static uint64_t kolibri_text_hash(const char *text) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Open-addressing index over an array whose elements start with their name
+ * (a char *). Slots hold element index + 1, so the array keeps its order and
+ * the index can always be rebuilt from it. An index that could not grow is
+ * dropped, and lookups fall back to scanning the array.
+ */
+static const char *kolibri_name_at(const void *items, size_t stride, size_t index) {
+    return *(char *const *)((const char *)items + index * stride);
+}
+
+static void kolibri_name_index_free(KolibriScriptNameIndex *index) {
+    kolibri_mem_free(index->allocator, index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+}
+
+static size_t kolibri_name_index_find(const KolibriScriptNameIndex *index, const void *items,
+                                      size_t stride, size_t count, const char *name) {
+    if (index->capacity == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (strcmp(kolibri_name_at(items, stride, i), name) == 0) {
+                return i;
+            }
+        }
+        return SIZE_MAX;
+    }
+    size_t mask = index->capacity - 1U;
+    for (size_t pos = (size_t)kolibri_text_hash(name) & mask;; pos = (pos + 1U) & mask) {
+        size_t slot = index->slots[pos];
+        if (slot == 0) {
+            return SIZE_MAX;
+        }
+        if (strcmp(kolibri_name_at(items, stride, slot - 1U), name) == 0) {
+            return slot - 1U;
+        }
+    }
+}
+
+static void kolibri_name_index_place(KolibriScriptNameIndex *index, const void *items,
+                                     size_t stride, size_t item) {
+    size_t mask = index->capacity - 1U;
+    size_t pos = (size_t)kolibri_text_hash(kolibri_name_at(items, stride, item)) & mask;
+    while (index->slots[pos] != 0) {
+        pos = (pos + 1U) & mask;
+    }
+    index->slots[pos] = item + 1U;
+}
+
+static int kolibri_name_index_rebuild(KolibriScriptNameIndex *index, const void *items,
+                                      size_t stride, size_t count) {
+    size_t capacity = 16U;
+    while (capacity < count * 2U) {
+        capacity *= 2U;
+    }
+    if (capacity != index->capacity) {
+        size_t *slots = (size_t *)kolibri_mem_alloc(index->allocator, capacity * sizeof(size_t));
+        if (!slots) {
+            kolibri_name_index_free(index);
+            return -1;
+        }
+        kolibri_mem_free(index->allocator, index->slots);
+        index->slots = slots;
+        index->capacity = capacity;
+    }
+    memset(index->slots, 0, index->capacity * sizeof(size_t));
+    for (size_t i = 0; i < count; ++i) {
+        kolibri_name_index_place(index, items, stride, i);
+    }
+    return 0;
+}
+
+/* Indexes items[count - 1], just appended; the load stays at or below 1/2. */
+static int kolibri_name_index_add(KolibriScriptNameIndex *index, const void *items,
+                                  size_t stride, size_t count) {
+    if (count * 2U > index->capacity) {
+        return kolibri_name_index_rebuild(index, items, stride, count);
+    }
+    kolibri_name_index_place(index, items, stride, count - 1U);
+    return 0;
+}
+
 static KolibriScriptVariable *kolibri_script_find_variable(KolibriScript *script, const char *name) {
     if (!script || !name) {
         return NULL;
     }
-    for (size_t i = 0; i < script->variables_count; ++i) {
-        if (strcmp(script->variables[i].name, name) == 0) {
-            return &script->variables[i];
-        }
+    size_t index = kolibri_name_index_find(&script->variables_index, script->variables,
+                                           sizeof(KolibriScriptVariable), script->variables_count, name);
+    return index == SIZE_MAX ? NULL : &script->variables[index];
+}
+
+static KolibriScriptVariable *kolibri_script_lookup(KolibriScript *script, const KolibriExpression *expr) {
+    if (!expr->name) {
+        return NULL;
     }
-    return NULL;
+    if (!script->frame || expr->slot == 0) {
+        return kolibri_script_find_variable(script, expr->name);
+    }
+    size_t *cached = &script->frame->variables[expr->slot - 1U];
+    if (*cached != 0) {
+        return &script->variables[*cached - 1U];
+    }
+    KolibriScriptVariable *var = kolibri_script_find_variable(script, expr->name);
+    if (var) {
+        *cached = (size_t)(var - script->variables) + 1U;
+    }
+    return var;
 }
 
 static int kolibri_script_set_variable(KolibriScript *script, const char *name, KolibriValue value) {
     if (!script || !name) {
-        kolibri_value_free(&value);
         return -1;
     }
     KolibriScriptVariable *existing = kolibri_script_find_variable(script, name);
     if (existing) {
-        kolibri_value_free(&existing->value);
         existing->value = value;
         return 0;
     }
     if (script->variables_count == script->variables_capacity) {
         size_t new_capacity = script->variables_capacity == 0 ? 8U : script->variables_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriScriptVariable *new_items = (KolibriScriptVariable *)realloc(script->variables, new_capacity * sizeof(KolibriScriptVariable));
+        KolibriScriptVariable *new_items = (KolibriScriptVariable *)kolibri_mem_realloc(&script->allocator, script->variables, new_capacity * sizeof(KolibriScriptVariable));
         if (!new_items) {
-            kolibri_value_free(&value);
             return -1;
         }
         script->variables = new_items;
         script->variables_capacity = new_capacity;
     }
     KolibriScriptVariable *slot = &script->variables[script->variables_count++];
-    slot->name = strdup(name);
+    slot->name = kolibri_arena_strdup(&script->arena, name);
     if (!slot->name) {
         --script->variables_count;
-        kolibri_value_free(&value);
         return -1;
     }
     slot->value = value;
+    (void)kolibri_name_index_add(&script->variables_index, script->variables,
+                                 sizeof(KolibriScriptVariable), script->variables_count);
     return 0;
 }
 
@@ -1885,26 +2179,18 @@ static void kolibri_script_clear_variables(KolibriScript *script) {
     if (!script) {
         return;
     }
-    for (size_t i = 0; i < script->variables_count; ++i) {
-        free(script->variables[i].name);
-        kolibri_value_free(&script->variables[i].value);
-    }
-    free(script->variables);
+    kolibri_mem_free(&script->allocator, script->variables);
     script->variables = NULL;
     script->variables_count = 0;
     script->variables_capacity = 0;
+    kolibri_name_index_free(&script->variables_index);
 }
 
 static void kolibri_script_clear_associations(KolibriScript *script) {
     if (!script) {
         return;
     }
-    for (size_t i = 0; i < script->associations_count; ++i) {
-        KolibriScriptAssociation *assoc = &script->associations[i];
-        free(assoc->stimulus);
-        free(assoc->response);
-    }
-    free(script->associations);
+    kolibri_mem_free(&script->allocator, script->associations);
     script->associations = NULL;
     script->associations_count = 0;
     script->associations_capacity = 0;
@@ -1914,27 +2200,20 @@ static void kolibri_script_clear_formulas(KolibriScript *script) {
     if (!script) {
         return;
     }
-    for (size_t i = 0; i < script->formulas_count; ++i) {
-        KolibriScriptFormulaBinding *binding = &script->formulas[i];
-        free(binding->name);
-        free(binding->expression);
-    }
-    free(script->formulas);
+    kolibri_mem_free(&script->allocator, script->formulas);
     script->formulas = NULL;
     script->formulas_count = 0;
     script->formulas_capacity = 0;
+    kolibri_name_index_free(&script->formulas_index);
 }
 
 static KolibriScriptFormulaBinding *kolibri_script_find_formula(KolibriScript *script, const char *name) {
     if (!script || !name) {
         return NULL;
     }
-    for (size_t i = 0; i < script->formulas_count; ++i) {
-        if (strcmp(script->formulas[i].name, name) == 0) {
-            return &script->formulas[i];
-        }
-    }
-    return NULL;
+    size_t index = kolibri_name_index_find(&script->formulas_index, script->formulas,
+                                           sizeof(KolibriScriptFormulaBinding), script->formulas_count, name);
+    return index == SIZE_MAX ? NULL : &script->formulas[index];
 }
 
 static int kolibri_script_bind_formula(KolibriScript *script, const char *name, const char *expression) {
@@ -1943,14 +2222,13 @@ static int kolibri_script_bind_formula(KolibriScript *script, const char *name,
     }
     KolibriScriptFormulaBinding *existing = kolibri_script_find_formula(script, name);
     if (existing) {
-        free(existing->expression);
-        existing->expression = expression ? strdup(expression) : NULL;
+        existing->expression = expression ? kolibri_arena_strdup(&script->arena, expression) : NULL;
         existing->last_fitness = 0.0;
         return (!existing->expression && expression) ? -1 : 0;
     }
     if (script->formulas_count == script->formulas_capacity) {
         size_t new_capacity = script->formulas_capacity == 0 ? 4U : script->formulas_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriScriptFormulaBinding *new_items = (KolibriScriptFormulaBinding *)realloc(script->formulas, new_capacity * sizeof(KolibriScriptFormulaBinding));
+        KolibriScriptFormulaBinding *new_items = (KolibriScriptFormulaBinding *)kolibri_mem_realloc(&script->allocator, script->formulas, new_capacity * sizeof(KolibriScriptFormulaBinding));
         if (!new_items) {
             return -1;
         }
@@ -1958,16 +2236,16 @@ static int kolibri_script_bind_formula(KolibriScript *script, const char *name,
         script->formulas_capacity = new_capacity;
     }
     KolibriScriptFormulaBinding *slot = &script->formulas[script->formulas_count++];
-    slot->name = strdup(name);
-    slot->expression = expression ? strdup(expression) : NULL;
+    slot->name = kolibri_arena_strdup(&script->arena, name);
+    slot->expression = expression ? kolibri_arena_strdup(&script->arena, expression) : NULL;
     slot->pool_index = 0;
     slot->last_fitness = 0.0;
     if (!slot->name || (expression && !slot->expression)) {
-        free(slot->name);
-        free(slot->expression);
         --script->formulas_count;
         return -1;
     }
+    (void)kolibri_name_index_add(&script->formulas_index, script->formulas,
+                                 sizeof(KolibriScriptFormulaBinding), script->formulas_count);
     return 0;
 }
 
@@ -1975,23 +2253,24 @@ static int kolibri_script_remove_formula(KolibriScript *script, const char *name
     if (!script || !name) {
         return -1;
     }
-    for (size_t i = 0; i < script->formulas_count; ++i) {
-        if (strcmp(script->formulas[i].name, name) == 0) {
-            free(script->formulas[i].name);
-            free(script->formulas[i].expression);
-            if (i + 1U < script->formulas_count) {
-                memmove(&script->formulas[i], &script->formulas[i + 1U], (script->formulas_count - i - 1U) * sizeof(KolibriScriptFormulaBinding));
-            }
-            script->formulas_count -= 1U;
-            return 0;
-        }
+    size_t i = kolibri_name_index_find(&script->formulas_index, script->formulas,
+                                       sizeof(KolibriScriptFormulaBinding), script->formulas_count, name);
+    if (i == SIZE_MAX) {
+        return -1;
     }
-    return -1;
+    if (i + 1U < script->formulas_count) {
+        memmove(&script->formulas[i], &script->formulas[i + 1U], (script->formulas_count - i - 1U) * sizeof(KolibriScriptFormulaBinding));
+    }
+    script->formulas_count -= 1U;
+    /* Later bindings moved down one place. */
+    (void)kolibri_name_index_rebuild(&script->formulas_index, script->formulas,
+                                     sizeof(KolibriScriptFormulaBinding), script->formulas_count);
+    return 0;
 }
 
 /* ===================== Utilities ===================== */
 
-static char *kolibri_trim_copy(const char *text) {
+static char *kolibri_trim_copy(KolibriScriptArena *arena, const char *text) {
     if (!text) {
         return NULL;
     }
@@ -2004,7 +2283,7 @@ static char *kolibri_trim_copy(const char *text) {
         --end;
     }
     size_t len = (size_t)(end - start);
-    return kolibri_strndup(start, len);
+    return kolibri_arena_strndup(arena, start, len);
 }
 
 static bool kolibri_is_string_literal(const char *text) {
@@ -2012,15 +2291,15 @@ static bool kolibri_is_string_literal(const char *text) {
     return len >= 2U && text[0] == '"' && text[len - 1U] == '"';
 }
 
-static char *kolibri_strip_quotes(const char *text) {
+static char *kolibri_strip_quotes(KolibriScriptArena *arena, const char *text) {
     if (!text) {
         return NULL;
     }
     size_t len = strlen(text);
     if (len < 2U || text[0] != '"' || text[len - 1U] != '"') {
-        return strdup(text);
+        return kolibri_arena_strdup(arena, text);
     }
-    char *result = (char *)malloc(len - 1U);
+    char *result = (char *)kolibri_arena_alloc(arena, len - 1U);
     if (!result) {
         return NULL;
     }
@@ -2057,15 +2336,103 @@ static double kolibri_parse_number(const char *text, bool *ok) {
     return value;
 }
 
-static int kolibri_value_to_string(const KolibriValue *value, char **out) {
-    if (!value || !out) {
-        return -1;
+static bool kolibri_has_space(const char *text) {
+    for (const char *p = text; *p; ++p) {
+        if (isspace((unsigned char)*p)) {
+            return true;
+        }
     }
-    if (value->type == KOLIBRI_VALUE_STRING) {
-        *out = value->string_value ? strdup(value->string_value) : strdup("");
-        return *out ? 0 : -1;
+    return false;
+}
+
+/* Resolves expr->text into the typed fields; false only when out of memory. */
+static bool kolibri_compile_expression(KolibriScriptArena *arena, KolibriExpression *expr,
+                                       bool with_comparison) {
+    char *trimmed = kolibri_trim_copy(arena, expr->text);
+    if (!trimmed) {
+        return false;
     }
-    if (value->type == KOLIBRI_VALUE_NUMBER) {
+    expr->kind = KOLIBRI_EXPR_TEXT;
+    expr->numeric = false;
+    expr->number = 0.0;
+    if (kolibri_is_string_literal(trimmed)) {
+        expr->string = kolibri_strip_quotes(arena, trimmed);
+        if (!expr->string) {
+            return false;
+        }
+        expr->number = kolibri_parse_number(expr->string, &expr->numeric);
+    } else {
+        /* Variable names are single identifiers, so text with spaces never
+         * resolves to one. */
+        if (!kolibri_has_space(trimmed)) {
+            expr->name = trimmed;
+        }
+        bool ok = false;
+        double numeric = kolibri_parse_number(trimmed, &ok);
+        if (strncmp(trimmed, "фитнес", strlen("фитнес")) == 0) {
+            const char *name_start = trimmed + strlen("фитнес");
+            while (*name_start && isspace((unsigned char)*name_start)) {
+                ++name_start;
+            }
+            expr->kind = KOLIBRI_EXPR_FITNESS;
+            expr->string = (char *)name_start;
+        } else if (ok) {
+            expr->kind = KOLIBRI_EXPR_NUMBER;
+            expr->number = numeric;
+            expr->numeric = true;
+            return true;
+        } else {
+            expr->string = trimmed;
+        }
+    }
+    expr->comparator = KOLIBRI_COMPARE_NONE;
+    if (!with_comparison) {
+        return true;
+    }
+    /* Same search order as the comparators were always tried in. */
+    static const struct {
+        const char *token;
+        KolibriComparator comparator;
+    } comparators[] = {
+        { ">=", KOLIBRI_COMPARE_GE }, { "<=", KOLIBRI_COMPARE_LE }, { "==", KOLIBRI_COMPARE_EQ },
+        { "!=", KOLIBRI_COMPARE_NE }, { ">", KOLIBRI_COMPARE_GT },  { "<", KOLIBRI_COMPARE_LT },
+    };
+    const char *text = trimmed;
+    const char *found = NULL;
+    size_t index = 0;
+    for (; index < sizeof(comparators) / sizeof(comparators[0]); ++index) {
+        found = strstr(text, comparators[index].token);
+        if (found) {
+            break;
+        }
+    }
+    if (!found) {
+        return true;
+    }
+    expr->operands = (KolibriExpression *)kolibri_arena_alloc(arena, 2U * sizeof(KolibriExpression));
+    if (!expr->operands) {
+        return false;
+    }
+    expr->operands[0].text = kolibri_arena_strndup(arena, text, (size_t)(found - text));
+    expr->operands[1].text = kolibri_arena_strdup(arena, found + strlen(comparators[index].token));
+    if (!expr->operands[0].text || !expr->operands[1].text ||
+        !kolibri_compile_expression(arena, &expr->operands[0], false) ||
+        !kolibri_compile_expression(arena, &expr->operands[1], false)) {
+        return false;
+    }
+    expr->comparator = comparators[index].comparator;
+    return true;
+}
+
+static int kolibri_value_to_string(KolibriScript *script, const KolibriValue *value, char **out) {
+    if (!value || !out) {
+        return -1;
+    }
+    if (value->type == KOLIBRI_VALUE_STRING) {
+        *out = kolibri_arena_strdup(&script->arena, value->string_value ? value->string_value : "");
+        return *out ? 0 : -1;
+    }
+    if (value->type == KOLIBRI_VALUE_NUMBER) {
         char buffer[64];
         int written = snprintf(buffer, sizeof(buffer), "%.6f", value->number_value);
         if (written < 0) {
@@ -2082,162 +2449,98 @@ static int kolibri_value_to_string(const KolibriValue *value, char **out) {
                 break;
             }
         }
-        *out = strdup(buffer);
+        *out = kolibri_arena_strdup(&script->arena, buffer);
         return *out ? 0 : -1;
     }
-    *out = strdup("");
+    *out = kolibri_arena_strdup(&script->arena, "");
     return *out ? 0 : -1;
 }
 
-static int kolibri_value_to_number(const KolibriValue *value, double *out) {
-    if (!value || !out) {
-        return -1;
+static int kolibri_evaluate_expression(KolibriScript *script, const KolibriExpression *expr, KolibriValue *out_value) {
+    KolibriScriptVariable *var = kolibri_script_lookup(script, expr);
+    if (var) {
+        *out_value = var->value.type == KOLIBRI_VALUE_NONE ? kolibri_value_from_string(script, "") : var->value;
+        return 0;
     }
-    if (value->type == KOLIBRI_VALUE_NUMBER) {
-        *out = value->number_value;
+    switch (expr->kind) {
+    case KOLIBRI_EXPR_NUMBER:
+        *out_value = kolibri_value_from_number(expr->number);
+        return 0;
+    case KOLIBRI_EXPR_FITNESS: {
+        KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, expr->string);
+        *out_value = kolibri_value_from_number(binding ? binding->last_fitness : 0.0);
         return 0;
     }
-    if (value->type == KOLIBRI_VALUE_STRING && value->string_value) {
-        bool ok = false;
-        double parsed = kolibri_parse_number(value->string_value, &ok);
-        if (ok) {
-            *out = parsed;
-            return 0;
-        }
+    case KOLIBRI_EXPR_TEXT:
+    default:
+        *out_value = kolibri_value_from_string(script, expr->string);
+        return out_value->string_value ? 0 : -1;
     }
-    return -1;
 }
 
-static int kolibri_evaluate_expression(KolibriScript *script, const KolibriExpression *expr, KolibriValue *out_value) {
-    char *trimmed = kolibri_trim_copy(expr->text);
-    if (!trimmed) {
-        return -1;
-    }
-    if (kolibri_is_string_literal(trimmed)) {
-        char *stripped = kolibri_strip_quotes(trimmed);
-        free(trimmed);
-        if (!stripped) {
-            return -1;
-        }
-        *out_value = kolibri_value_from_string(stripped);
-        if (!out_value->string_value && stripped) {
-            free(stripped);
-            return -1;
-        }
-        free(stripped);
-        return 0;
-    }
-    KolibriScriptVariable *var = kolibri_script_find_variable(script, trimmed);
+/* Numeric value of an operand without building a KolibriValue. */
+static int kolibri_evaluate_number(KolibriScript *script, const KolibriExpression *expr, double *out) {
+    KolibriScriptVariable *var = kolibri_script_lookup(script, expr);
     if (var) {
-        if (var->value.type == KOLIBRI_VALUE_STRING) {
-            *out_value = kolibri_value_from_string(var->value.string_value);
-        } else if (var->value.type == KOLIBRI_VALUE_NUMBER) {
-            *out_value = kolibri_value_from_number(var->value.number_value);
-        } else {
-            *out_value = kolibri_value_from_string("");
-        }
-        free(trimmed);
-        return 0;
-    }
-    if (strncmp(trimmed, "фитнес", strlen("фитнес")) == 0) {
-        const char *name_start = trimmed + strlen("фитнес");
-        while (*name_start && isspace((unsigned char)*name_start)) {
-            ++name_start;
-        }
-        KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, name_start);
-        free(trimmed);
-        if (binding) {
-            *out_value = kolibri_value_from_number(binding->last_fitness);
+        if (var->value.type == KOLIBRI_VALUE_NUMBER) {
+            *out = var->value.number_value;
             return 0;
         }
-        *out_value = kolibri_value_from_number(0.0);
-        return 0;
-    }
-    bool ok = false;
-    double numeric = kolibri_parse_number(trimmed, &ok);
-    if (ok) {
-        *out_value = kolibri_value_from_number(numeric);
-        free(trimmed);
+        bool ok = false;
+        const char *text = var->value.type == KOLIBRI_VALUE_STRING && var->value.string_value
+                               ? var->value.string_value
+                               : "";
+        *out = kolibri_parse_number(text, &ok);
+        return ok ? 0 : -1;
+    }
+    if (expr->kind == KOLIBRI_EXPR_FITNESS) {
+        KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, expr->string);
+        *out = binding ? binding->last_fitness : 0.0;
         return 0;
     }
-    *out_value = kolibri_value_from_string(trimmed);
-    if (!out_value->string_value) {
-        free(trimmed);
+    if (!expr->numeric) {
         return -1;
     }
+    *out = expr->number;
     return 0;
 }
 
 static bool kolibri_evaluate_condition(KolibriScript *script, const KolibriExpression *expr, bool *result) {
-    char *text = kolibri_trim_copy(expr->text);
-    if (!text) {
-        return false;
-    }
-    const char *comparators[] = { ">=", "<=", "==", "!=", ">", "<" };
-    const char *found = NULL;
-    const char *comp = NULL;
-    for (size_t i = 0; i < sizeof(comparators) / sizeof(comparators[0]); ++i) {
-        comp = comparators[i];
-        found = strstr(text, comp);
-        if (found) {
-            break;
-        }
-    }
-    if (!found) {
-        free(text);
-        return false;
-    }
-    size_t left_len = (size_t)(found - text);
-    char *left = kolibri_strndup(text, left_len);
-    char *right = kolibri_trim_copy(found + strlen(comp));
-    free(text);
-    if (!left || !right) {
-        free(left);
-        free(right);
-        return false;
-    }
-    KolibriExpression left_expr = { left, expr->span };
-    KolibriExpression right_expr = { right, expr->span };
-    KolibriValue left_value;
-    KolibriValue right_value;
-    if (kolibri_evaluate_expression(script, &left_expr, &left_value) != 0 ||
-        kolibri_evaluate_expression(script, &right_expr, &right_value) != 0) {
-        free(left);
-        free(right);
+    if (expr->comparator == KOLIBRI_COMPARE_NONE) {
         return false;
     }
     double left_num = 0.0;
     double right_num = 0.0;
-    bool numeric = kolibri_value_to_number(&left_value, &left_num) == 0 && kolibri_value_to_number(&right_value, &right_num) == 0;
-    if (!numeric) {
-        kolibri_value_free(&left_value);
-        kolibri_value_free(&right_value);
-        free(left);
-        free(right);
+    if (kolibri_evaluate_number(script, &expr->operands[0], &left_num) != 0 ||
+        kolibri_evaluate_number(script, &expr->operands[1], &right_num) != 0) {
         return false;
     }
-    if (strcmp(comp, ">=") == 0) {
+    switch (expr->comparator) {
+    case KOLIBRI_COMPARE_GE:
         *result = left_num >= right_num;
-    } else if (strcmp(comp, "<=") == 0) {
+        break;
+    case KOLIBRI_COMPARE_LE:
         *result = left_num <= right_num;
-    } else if (strcmp(comp, "==") == 0) {
+        break;
+    case KOLIBRI_COMPARE_EQ:
         *result = fabs(left_num - right_num) <= 1e-9;
-    } else if (strcmp(comp, "!=") == 0) {
+        break;
+    case KOLIBRI_COMPARE_NE:
         *result = fabs(left_num - right_num) > 1e-9;
-    } else if (strcmp(comp, ">") == 0) {
+        break;
+    case KOLIBRI_COMPARE_GT:
         *result = left_num > right_num;
-    } else {
+        break;
+    case KOLIBRI_COMPARE_LT:
+    default:
         *result = left_num < right_num;
+        break;
     }
-    kolibri_value_free(&left_value);
-    kolibri_value_free(&right_value);
-    free(left);
-    free(right);
     return true;
 }
 
 static void kolibri_script_log(KolibriScript *script, const char *event, const char *message) {
-    if (!script || !script->genome) {
+    if (!script || (!script->genome && !script->changes)) {
         return;
     }
     if (!event) {
@@ -2248,20 +2551,186 @@ static void kolibri_script_log(KolibriScript *script, const char *event, const c
         message = "";
     }
     snprintf(payload, sizeof(payload), "%s", message);
+    if (script->changes) {
+        (void)kolibri_changes_push(script->changes, event, payload, NULL, NULL, 0U);
+        return;
+    }
     kg_append(script->genome, event, payload, NULL);
 }
 
+/* ===================== Profiler ===================== */
+
+/*
+ * Entries are keyed by where a statement starts and hold its own time, so
+ * the tree walker (which nests) and the VM (which runs flat instructions)
+ * fill them the same way. Reports add the children back up through parent.
+ */
+typedef struct KolibriScriptProfiler {
+    KolibriScriptProfileEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t *index;
+    size_t index_capacity;
+    /* Tree walker: entry of the running statement plus one, and the time
+     * its nested statements took so far. */
+    size_t current;
+    uint64_t child_ns;
+    /* kf_pool_tick time not yet charged to an entry. */
+    uint64_t evolution_ns;
+    KolibriScriptTraceHook trace;
+    void *trace_user;
+    char *report_path;
+    bool report_stderr;
+    const KolibriAllocator *allocator; /* the script's */
+} KolibriScriptProfiler;
+
+static uint64_t kolibri_now_ns(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+#endif
+    return (uint64_t)((double)clock() * 1e9 / (double)CLOCKS_PER_SEC);
+}
+
+static const char *kolibri_node_keyword(KolibriNodeKind kind) {
+    static const char *const keywords[] = {
+        [KOLIBRI_NODE_SHOW] = "показать",
+        [KOLIBRI_NODE_VARIABLE] = "переменная",
+        [KOLIBRI_NODE_TEACH] = "обучить связь",
+        [KOLIBRI_NODE_CREATE_FORMULA] = "создать формулу",
+        [KOLIBRI_NODE_EVALUATE_FORMULA] = "оценить",
+        [KOLIBRI_NODE_SAVE_FORMULA] = "сохранить",
+        [KOLIBRI_NODE_DROP_FORMULA] = "отбросить",
+        [KOLIBRI_NODE_CALL_EVOLUTION] = "вызвать эволюцию",
+        [KOLIBRI_NODE_PRINT_CANVAS] = "распечатать канву",
+        [KOLIBRI_NODE_SWARM_SEND] = "рой",
+        [KOLIBRI_NODE_IF] = "если",
+        [KOLIBRI_NODE_WHILE] = "пока",
+        [KOLIBRI_NODE_MODE] = "режим",
+    };
+    return (size_t)kind < sizeof(keywords) / sizeof(keywords[0]) ? keywords[kind] : "?";
+}
+
+static size_t kolibri_profile_home(size_t line, size_t column, size_t mask) {
+    uint64_t h = (((uint64_t)line << 20) ^ (uint64_t)column) * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & mask;
+}
+
+static void kolibri_profile_place(KolibriScriptProfiler *profiler, size_t entry) {
+    const KolibriScriptProfileEntry *item = &profiler->entries[entry - 1U];
+    size_t mask = profiler->index_capacity - 1U;
+    size_t pos = kolibri_profile_home(item->line, item->column, mask);
+    while (profiler->index[pos] != 0U) {
+        pos = (pos + 1U) & mask;
+    }
+    profiler->index[pos] = entry;
+}
+
+/* Entry of the statement starting at start, plus one; 0 when out of memory. */
+static size_t kolibri_profile_entry(KolibriScriptProfiler *profiler, KolibriSourceLocation start,
+                                    KolibriNodeKind kind, size_t parent) {
+    if (profiler->index_capacity > 0) {
+        size_t mask = profiler->index_capacity - 1U;
+        for (size_t pos = kolibri_profile_home(start.line, start.column, mask); profiler->index[pos] != 0U;
+             pos = (pos + 1U) & mask) {
+            const KolibriScriptProfileEntry *item = &profiler->entries[profiler->index[pos] - 1U];
+            if (item->line == start.line && item->column == start.column) {
+                return profiler->index[pos];
+            }
+        }
+    }
+    if (profiler->count == profiler->capacity) {
+        size_t capacity = profiler->capacity == 0 ? 16U : profiler->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
+        KolibriScriptProfileEntry *grown =
+            (KolibriScriptProfileEntry *)kolibri_mem_realloc(profiler->allocator, profiler->entries, capacity * sizeof(KolibriScriptProfileEntry));
+        if (!grown) {
+            return 0U;
+        }
+        profiler->entries = grown;
+        profiler->capacity = capacity;
+    }
+    if ((profiler->count + 1U) * 2U > profiler->index_capacity) {
+        size_t capacity = profiler->index_capacity == 0 ? 32U : profiler->index_capacity * 2U;
+        size_t *index = (size_t *)kolibri_mem_calloc(profiler->allocator, capacity, sizeof(size_t));
+        if (!index) {
+            return 0U;
+        }
+        kolibri_mem_free(profiler->allocator, profiler->index);
+        profiler->index = index;
+        profiler->index_capacity = capacity;
+        for (size_t i = 0; i < profiler->count; ++i) {
+            kolibri_profile_place(profiler, i + 1U);
+        }
+    }
+    KolibriScriptProfileEntry *item = &profiler->entries[profiler->count++];
+    memset(item, 0, sizeof(*item));
+    item->line = start.line;
+    item->column = start.column;
+    item->kind = kolibri_node_keyword(kind);
+    item->parent = parent;
+    kolibri_profile_place(profiler, profiler->count);
+    return profiler->count;
+}
+
+static void kolibri_profile_record(KolibriScriptProfiler *profiler, size_t entry, bool counted, uint64_t self_ns) {
+    KolibriScriptProfileEntry *item = &profiler->entries[entry - 1U];
+    item->count += counted ? 1U : 0U;
+    item->self_ns += self_ns;
+    item->evolution_ns += profiler->evolution_ns;
+    profiler->evolution_ns = 0;
+    if (profiler->trace) {
+        profiler->trace(profiler->trace_user, item, self_ns);
+    }
+}
+
+static void kolibri_profile_clear(KolibriScriptProfiler *profiler) {
+    profiler->count = 0;
+    if (profiler->index) {
+        memset(profiler->index, 0, profiler->index_capacity * sizeof(size_t));
+    }
+    profiler->current = 0;
+    profiler->child_ns = 0;
+    profiler->evolution_ns = 0;
+}
+
+/* Inclusive time per entry; children always come after their parent. */
+static uint64_t *kolibri_profile_totals(const KolibriScriptProfiler *profiler) {
+    uint64_t *totals = (uint64_t *)kolibri_mem_calloc(profiler->allocator, profiler->count + 1U, sizeof(uint64_t));
+    if (!totals) {
+        return NULL;
+    }
+    for (size_t i = profiler->count; i-- > 0;) {
+        const KolibriScriptProfileEntry *item = &profiler->entries[i];
+        totals[i] += item->self_ns;
+        if (item->parent != 0U && item->parent - 1U < i) {
+            totals[item->parent - 1U] += totals[i];
+        }
+    }
+    return totals;
+}
+
+static void kolibri_profile_write_frames(FILE *out, const KolibriScriptProfiler *profiler, size_t entry) {
+    const KolibriScriptProfileEntry *item = &profiler->entries[entry - 1U];
+    if (item->parent != 0U && item->parent < entry) {
+        kolibri_profile_write_frames(out, profiler, item->parent);
+    } else {
+        fputs("сценарий", out);
+    }
+    fprintf(out, ";%s (%zu:%zu)", item->kind, item->line, item->column);
+}
+
 /* ===================== Interpreter ===================== */
 
-static int kolibri_execute_show(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_show(KolibriScript *script, const KolibriExpression *expr) {
     KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.show.value, &value) != 0) {
+    if (kolibri_evaluate_expression(script, expr, &value) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить аргумент команды 'показать'");
         return -1;
     }
     char *text = NULL;
-    if (kolibri_value_to_string(&value, &text) != 0) {
-        kolibri_value_free(&value);
+    if (kolibri_value_to_string(script, &value, &text) != 0) {
         return -1;
     }
     if (!script->vyvod) {
@@ -2269,33 +2738,39 @@ static int kolibri_execute_show(KolibriScript *script, const KolibriStatement *s
     }
     fprintf(script->vyvod, "%s\n", text);
     kolibri_script_log(script, "SCRIPT_SHOW", text);
-    free(text);
-    kolibri_value_free(&value);
     return 0;
 }
 
-static int kolibri_execute_variable(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_variable(KolibriScript *script, const char *name, size_t slot,
+                                    const KolibriExpression *expr) {
     KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.variable.value, &value) != 0) {
+    if (kolibri_evaluate_expression(script, expr, &value) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить выражение переменной");
         return -1;
     }
-    if (kolibri_script_set_variable(script, stmt->data.variable.name, value) != 0) {
-        kolibri_value_free(&value);
+    size_t *cached = script->frame && slot != 0 ? &script->frame->variables[slot - 1U] : NULL;
+    if (cached && *cached != 0) {
+        script->variables[*cached - 1U].value = value;
+        return 0;
+    }
+    if (kolibri_script_set_variable(script, name, value) != 0) {
         return -1;
     }
+    if (cached) {
+        KolibriScriptVariable *var = kolibri_script_find_variable(script, name);
+        *cached = var ? (size_t)(var - script->variables) + 1U : 0U;
+    }
     return 0;
 }
 
-static int kolibri_execute_mode(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_mode(KolibriScript *script, const KolibriExpression *expr) {
     KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.mode_stmt.value, &value) != 0) {
+    if (kolibri_evaluate_expression(script, expr, &value) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить режим");
         return -1;
     }
     char *text = NULL;
-    if (kolibri_value_to_string(&value, &text) != 0) {
-        kolibri_value_free(&value);
+    if (kolibri_value_to_string(script, &value, &text) != 0) {
         return -1;
     }
     kolibri_script_set_mode(script, text);
@@ -2305,39 +2780,29 @@ static int kolibri_execute_mode(KolibriScript *script, const KolibriStatement *s
     if (script->vyvod) {
         fprintf(script->vyvod, "[Колибри] Режим установлен: %s\n", script->mode);
     }
-    free(text);
-    kolibri_value_free(&value);
     return 0;
 }
 
-static int kolibri_execute_teach(KolibriScript *script, const KolibriStatement *stmt) {
+/* With more set the pair waits in the teach batch for the statement after it. */
+static int kolibri_execute_teach(KolibriScript *script, const KolibriExpression *left_expr,
+                                 const KolibriExpression *right_expr, bool more) {
     KolibriValue left;
     KolibriValue right;
-    if (kolibri_evaluate_expression(script, &stmt->data.teach.left, &left) != 0 ||
-        kolibri_evaluate_expression(script, &stmt->data.teach.right, &right) != 0) {
-        kolibri_value_free(&left);
-        kolibri_value_free(&right);
+    if (kolibri_evaluate_expression(script, left_expr, &left) != 0 ||
+        kolibri_evaluate_expression(script, right_expr, &right) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось получить аргументы для 'обучить связь'");
         return -1;
     }
     char *left_text = NULL;
     char *right_text = NULL;
-    if (kolibri_value_to_string(&left, &left_text) != 0 ||
-        kolibri_value_to_string(&right, &right_text) != 0) {
-        kolibri_value_free(&left);
-        kolibri_value_free(&right);
-        free(left_text);
-        free(right_text);
+    if (kolibri_value_to_string(script, &left, &left_text) != 0 ||
+        kolibri_value_to_string(script, &right, &right_text) != 0) {
         return -1;
     }
     if (script->associations_count == script->associations_capacity) {
         size_t new_capacity = script->associations_capacity == 0 ? 4U : script->associations_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriScriptAssociation *new_items = (KolibriScriptAssociation *)realloc(script->associations, new_capacity * sizeof(KolibriScriptAssociation));
+        KolibriScriptAssociation *new_items = (KolibriScriptAssociation *)kolibri_mem_realloc(&script->allocator, script->associations, new_capacity * sizeof(KolibriScriptAssociation));
         if (!new_items) {
-            kolibri_value_free(&left);
-            kolibri_value_free(&right);
-            free(left_text);
-            free(right_text);
             return -1;
         }
         script->associations = new_items;
@@ -2348,63 +2813,63 @@ static int kolibri_execute_teach(KolibriScript *script, const KolibriStatement *
     assoc->response = right_text;
 
     if (script->pool) {
-        uint64_t now = (uint64_t)time(NULL);
-        (void)kf_pool_add_association(script->pool, &script->symbol_table, left_text, right_text, "teach", now);
-        kolibri_record_ngrams(script, left_text, right_text, "teach", now);
+        if (kolibri_teach_batch_add(script, left_text, right_text, "teach") != 0) {
+            return -1;
+        }
+        if (!more) {
+            kolibri_teach_batch_flush(script, "teach");
+        }
     }
     kolibri_script_log(script, "SCRIPT_TEACH", assoc->stimulus);
-    kolibri_value_free(&left);
-    kolibri_value_free(&right);
     return 0;
 }
 
-static int kolibri_execute_create_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_create_formula(KolibriScript *script, const char *name,
+                                          const KolibriExpression *expr) {
     if (!script->pool) {
         return 0;
     }
-    if (kolibri_script_bind_formula(script, stmt->data.create_formula.name, stmt->data.create_formula.expression.text) != 0) {
+    if (kolibri_script_bind_formula(script, name, expr->text) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось зарегистрировать формулу");
         return -1;
     }
-    kolibri_script_log(script, "SCRIPT_FORMULA_CREATE", stmt->data.create_formula.name);
+    kolibri_script_log(script, "SCRIPT_FORMULA_CREATE", name);
     return 0;
 }
 
-static int kolibri_execute_evaluate_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_evaluate_formula(KolibriScript *script, const char *name,
+                                            const KolibriExpression *task) {
     if (!script->pool) {
         return 0;
     }
-    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, stmt->data.evaluate_formula.name);
+    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, name);
     if (!binding) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена");
         return -1;
     }
     KolibriValue task_value;
-    if (kolibri_evaluate_expression(script, &stmt->data.evaluate_formula.task, &task_value) != 0) {
+    if (kolibri_evaluate_expression(script, task, &task_value) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить задачу для формулы");
         return -1;
     }
     char *task_text = NULL;
-    if (kolibri_value_to_string(&task_value, &task_text) != 0) {
-        kolibri_value_free(&task_value);
+    if (kolibri_value_to_string(script, &task_value, &task_text) != 0) {
         return -1;
     }
     int task_int = kf_hash_from_text(task_text);
     KolibriFormula *formula = &script->pool->formulas[binding->pool_index % script->pool->count];
     int output = 0;
     if (kf_formula_apply(formula, task_int, &output) != 0) {
-        free(task_text);
-        kolibri_value_free(&task_value);
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула вернула ошибку");
         return -1;
     }
     char answer_buffer[512];
     bool answer_generated = false;
-    if (kf_formula_lookup_answer(formula, task_int, answer_buffer, sizeof(answer_buffer)) == 0) {
+    if (kf_pool_lookup_answer(script->pool, formula, task_int, answer_buffer, sizeof(answer_buffer)) == 0) {
         answer_generated = true;
     }
     if (!answer_generated) {
-        const KolibriAssociation *partial = kolibri_find_partial_association(script->pool, task_text);
+        const KolibriAssociation *partial = kf_pool_match_association(script->pool, task_text);
         if (partial) {
             strncpy(answer_buffer, partial->answer, sizeof(answer_buffer) - 1U);
             answer_buffer[sizeof(answer_buffer) - 1U] = '\0';
@@ -2423,10 +2888,8 @@ static int kolibri_execute_evaluate_formula(KolibriScript *script, const Kolibri
             strncpy(answer_buffer, synthesized, sizeof(answer_buffer) - 1U);
             answer_buffer[sizeof(answer_buffer) - 1U] = '\0';
             answer_generated = true;
-            if (script->pool) {
-                uint64_t now = (uint64_t)time(NULL);
-                (void)kf_pool_add_association(script->pool, &script->symbol_table, task_text, answer_buffer, "auto", now);
-                kolibri_record_ngrams(script, task_text, answer_buffer, "auto", now);
+            if (script->pool && kolibri_teach_batch_add(script, task_text, answer_buffer, "auto") == 0) {
+                kolibri_teach_batch_flush(script, "auto");
             }
         }
     }
@@ -2444,18 +2907,16 @@ static int kolibri_execute_evaluate_formula(KolibriScript *script, const Kolibri
     kolibri_script_log(script, "SCRIPT_EVALUATE", task_text);
     kolibri_clean_answer(answer_buffer);
     kolibri_apply_mode(script, answer_buffer);
-    KolibriValue result_value = kolibri_value_from_string(answer_buffer);
+    KolibriValue result_value = kolibri_value_from_string(script, answer_buffer);
     kolibri_script_set_variable(script, "итог", result_value);
-    free(task_text);
-    kolibri_value_free(&task_value);
     return 0;
 }
 
-static int kolibri_execute_save_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_save_formula(KolibriScript *script, const char *name) {
     if (!script->pool) {
         return 0;
     }
-    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, stmt->data.save_formula.name);
+    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, name);
     if (!binding) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена для сохранения");
         return -1;
@@ -2476,12 +2937,12 @@ static int kolibri_execute_save_formula(KolibriScript *script, const KolibriStat
     return 0;
 }
 
-static int kolibri_execute_drop_formula(KolibriScript *script, const KolibriStatement *stmt) {
-    if (kolibri_script_remove_formula(script, stmt->data.drop_formula.name) != 0) {
+static int kolibri_execute_drop_formula(KolibriScript *script, const char *name) {
+    if (kolibri_script_remove_formula(script, name) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена для удаления");
         return -1;
     }
-    kolibri_script_log(script, "SCRIPT_FORMULA_DROP", stmt->data.drop_formula.name);
+    kolibri_script_log(script, "SCRIPT_FORMULA_DROP", name);
     return 0;
 }
 
@@ -2489,7 +2950,11 @@ static int kolibri_execute_call_evolution(KolibriScript *script) {
     if (!script->pool) {
         return 0;
     }
+    uint64_t start = script->profiler ? kolibri_now_ns() : 0U;
     kf_pool_tick(script->pool, 1U);
+    if (script->profiler) {
+        script->profiler->evolution_ns += kolibri_now_ns() - start;
+    }
     const KolibriFormula *best = kf_pool_best(script->pool);
     if (best) {
         char buffer[64];
@@ -2508,18 +2973,49 @@ static int kolibri_execute_print_canvas(KolibriScript *script) {
     return 0;
 }
 
-static int kolibri_execute_swarm(KolibriScript *script, const KolibriStatement *stmt) {
-    (void)script;
-    (void)stmt;
+static int kolibri_execute_swarm(KolibriScript *script, const char *name) {
+    (void)name;
     kolibri_script_log(script, "SCRIPT_SWARM", "отправка не реализована");
     return 0;
 }
 
 static int kolibri_execute_statement(KolibriScript *script, const KolibriStatement *stmt);
 
+static int kolibri_execute_step(KolibriScript *script, const KolibriStatement *stmt, bool more) {
+    if (stmt->kind == KOLIBRI_NODE_TEACH) {
+        return kolibri_execute_teach(script, &stmt->data.teach.left, &stmt->data.teach.right, more);
+    }
+    return kolibri_execute_statement(script, stmt);
+}
+
+static int kolibri_execute_profiled(KolibriScript *script, const KolibriStatement *stmt, bool more) {
+    KolibriScriptProfiler *profiler = script->profiler;
+    size_t parent = profiler->current;
+    size_t entry = kolibri_profile_entry(profiler, stmt->span.start, stmt->kind, parent);
+    if (entry == 0U) {
+        return kolibri_execute_step(script, stmt, more);
+    }
+    uint64_t outer_child_ns = profiler->child_ns;
+    profiler->current = entry;
+    profiler->child_ns = 0;
+    uint64_t start = kolibri_now_ns();
+    int status = kolibri_execute_step(script, stmt, more);
+    uint64_t elapsed = kolibri_now_ns() - start;
+    kolibri_profile_record(profiler, entry, true, elapsed > profiler->child_ns ? elapsed - profiler->child_ns : 0U);
+    profiler->current = parent;
+    profiler->child_ns = outer_child_ns + elapsed;
+    return status;
+}
+
 static int kolibri_execute_block(KolibriScript *script, const KolibriStatementList *list) {
     for (size_t i = 0; i < list->count; ++i) {
-        if (kolibri_execute_statement(script, list->items[i]) != 0) {
+        const KolibriStatement *stmt = list->items[i];
+        /* A run of teach statements reaches the pool as one batch. */
+        bool more = stmt->kind == KOLIBRI_NODE_TEACH && i + 1U < list->count &&
+                    list->items[i + 1U]->kind == KOLIBRI_NODE_TEACH;
+        int status = script->profiler ? kolibri_execute_profiled(script, stmt, more)
+                                      : kolibri_execute_step(script, stmt, more);
+        if (status != 0) {
             return -1;
         }
     }
@@ -2564,181 +3060,1520 @@ static int kolibri_execute_while(KolibriScript *script, const KolibriStatement *
 static int kolibri_execute_statement(KolibriScript *script, const KolibriStatement *stmt) {
     switch (stmt->kind) {
     case KOLIBRI_NODE_SHOW:
-        return kolibri_execute_show(script, stmt);
+        return kolibri_execute_show(script, &stmt->data.show.value);
     case KOLIBRI_NODE_VARIABLE:
-        return kolibri_execute_variable(script, stmt);
+        return kolibri_execute_variable(script, stmt->data.variable.name, 0U, &stmt->data.variable.value);
     case KOLIBRI_NODE_TEACH:
-        return kolibri_execute_teach(script, stmt);
+        return kolibri_execute_teach(script, &stmt->data.teach.left, &stmt->data.teach.right, false);
     case KOLIBRI_NODE_CREATE_FORMULA:
-        return kolibri_execute_create_formula(script, stmt);
+        return kolibri_execute_create_formula(script, stmt->data.create_formula.name,
+                                              &stmt->data.create_formula.expression);
     case KOLIBRI_NODE_EVALUATE_FORMULA:
-        return kolibri_execute_evaluate_formula(script, stmt);
+        return kolibri_execute_evaluate_formula(script, stmt->data.evaluate_formula.name,
+                                                &stmt->data.evaluate_formula.task);
     case KOLIBRI_NODE_SAVE_FORMULA:
-        return kolibri_execute_save_formula(script, stmt);
+        return kolibri_execute_save_formula(script, stmt->data.save_formula.name);
     case KOLIBRI_NODE_DROP_FORMULA:
-        return kolibri_execute_drop_formula(script, stmt);
+        return kolibri_execute_drop_formula(script, stmt->data.drop_formula.name);
     case KOLIBRI_NODE_CALL_EVOLUTION:
         return kolibri_execute_call_evolution(script);
     case KOLIBRI_NODE_PRINT_CANVAS:
         return kolibri_execute_print_canvas(script);
     case KOLIBRI_NODE_SWARM_SEND:
-        return kolibri_execute_swarm(script, stmt);
+        return kolibri_execute_swarm(script, stmt->data.swarm_send.name);
     case KOLIBRI_NODE_IF:
         return kolibri_execute_if(script, stmt);
     case KOLIBRI_NODE_WHILE:
         return kolibri_execute_while(script, stmt);
     case KOLIBRI_NODE_MODE:
-        return kolibri_execute_mode(script, stmt);
+        return kolibri_execute_mode(script, &stmt->data.mode_stmt.value);
     default:
         return 0;
     }
 }
 
+static void kolibri_continuation_drop(KolibriScript *script);
+
 static void kolibri_script_reset(KolibriScript *script) {
     kolibri_script_clear_variables(script);
     kolibri_script_clear_associations(script);
     kolibri_script_clear_formulas(script);
     if (script) {
+        script->teach = NULL;
+        script->session_lines = 0;
+        kolibri_continuation_drop(script);
+        if (script->profiler) {
+            script->profiler->current = 0;
+            script->profiler->child_ns = 0;
+            script->profiler->evolution_ns = 0;
+        }
+        kolibri_arena_reset(&script->arena);
         kolibri_script_set_mode(script, "neutral");
         kolibri_script_apply_controls(script);
     }
 }
 
-/* ===================== Public API ===================== */
+/* ===================== Bytecode ===================== */
 
-int ks_init(KolibriScript *skript, KolibriFormulaPool *pool, KolibriGenome *genome) {
-    if (!skript) {
-        return -1;
+/*
+ * ks_compile flattens the AST into an instruction stream. Operands index the
+ * program's constant pool of resolved expressions and its interned names;
+ * a name's index doubles as its variable slot. Loops keep their iteration
+ * counters in per-run loop slots, so a program never changes once built and
+ * may run against any number of scripts and pools.
+ */
+typedef enum {
+    KOLIBRI_OP_SHOW = 0,
+    KOLIBRI_OP_SET,
+    KOLIBRI_OP_MODE,
+    KOLIBRI_OP_TEACH,
+    KOLIBRI_OP_CREATE,
+    KOLIBRI_OP_EVALUATE,
+    KOLIBRI_OP_SAVE,
+    KOLIBRI_OP_DROP,
+    KOLIBRI_OP_SWARM,
+    KOLIBRI_OP_EVOLVE,
+    KOLIBRI_OP_CANVAS,
+    KOLIBRI_OP_IF,
+    KOLIBRI_OP_LOOP_INIT,
+    KOLIBRI_OP_WHILE,
+    KOLIBRI_OP_LOOP_NEXT,
+    KOLIBRI_OP_JUMP,
+    KOLIBRI_OP_HALT,
+    KOLIBRI_OP_COUNT
+} KolibriOpcode;
+
+/* site is the statement's index in the site table plus one, with
+ * KOLIBRI_SITE_ENTRY on the instruction that starts it. */
+#define KOLIBRI_SITE_ENTRY 0x80000000U
+
+typedef struct {
+    uint8_t op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t site;
+} KolibriInstruction;
+
+typedef struct {
+    KolibriSourceLocation start;
+    uint32_t parent;
+    uint8_t kind;
+} KolibriProgramSite;
+
+struct KolibriScriptProgram {
+    KolibriInstruction *code;
+    size_t code_count;
+    size_t code_capacity;
+    KolibriExpression *constants;
+    size_t constants_count;
+    size_t constants_capacity;
+    char **names;
+    size_t names_count;
+    size_t names_capacity;
+    size_t loops;
+    KolibriProgramSite *sites;
+    size_t sites_count;
+    size_t sites_capacity;
+    /* Site of the statement being compiled. */
+    uint32_t site;
+    KolibriScriptNameIndex names_index;
+    KolibriScriptNameIndex constants_index;
+    KolibriScriptArena arena;
+    KolibriAllocator allocator; /* serves every buffer above, the arena included */
+};
+
+static KolibriScriptProgram *kolibri_program_load(const char *path, const char *source_text,
+                                                  const KolibriAllocator *allocator);
+
+/* A zeroed program whose buffers come from allocator. */
+static KolibriScriptProgram *kolibri_program_new(const KolibriAllocator *allocator) {
+    KolibriScriptProgram *program =
+        (KolibriScriptProgram *)kolibri_mem_calloc(allocator, 1U, sizeof(KolibriScriptProgram));
+    if (!program) {
+        return NULL;
     }
-    memset(skript, 0, sizeof(*skript));
-    skript->pool = pool;
-    skript->genome = genome;
-    skript->vyvod = stdout;
-    skript->source_text = NULL;
-    kolibri_symbol_table_init(&skript->symbol_table, genome);
-    kolibri_symbol_table_load(&skript->symbol_table);
-    kolibri_symbol_table_seed_defaults(&skript->symbol_table);
-    kolibri_script_set_mode(skript, "neutral");
-    KolibriScriptControls defaults = {
-        .lambda_b = 0.25,
-        .lambda_d = 0.2,
-        .target_b = NAN,
-        .target_d = NAN,
-        .temperature = 0.85,
-        .top_k = 4.0,
-        .cf_beam = 1,
-    };
-    (void)ks_set_controls(skript, &defaults);
-    return 0;
+    kolibri_allocator_resolve(&program->allocator, allocator);
+    program->names_index.allocator = &program->allocator;
+    program->constants_index.allocator = &program->allocator;
+    program->arena.allocator = &program->allocator;
+    return program;
 }
 
-void ks_free(KolibriScript *skript) {
-    if (!skript) {
-        return;
+static bool kolibri_bytecode_reserve(KolibriScriptProgram *program, void **items, size_t *capacity, size_t count,
+                                     size_t item_size) {
+    if (count < *capacity) {
+        return true;
     }
-    kolibri_script_reset(skript);
-    free(skript->source_text);
-    skript->source_text = NULL;
-    skript->pool = NULL;
-    skript->genome = NULL;
-    skript->vyvod = NULL;
+    size_t new_capacity = *capacity == 0 ? 8U : *capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
+    void *grown = kolibri_mem_realloc(&program->allocator, *items, new_capacity * item_size);
+    if (!grown) {
+        return false;
+    }
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
 }
 
-void ks_set_output(KolibriScript *skript, FILE *vyvod) {
-    if (!skript) {
-        return;
+static bool kolibri_bytecode_emit(KolibriScriptProgram *program, KolibriOpcode op, uint32_t a,
+                                  uint32_t b, uint32_t c, size_t *at) {
+    if (program->code_count >= UINT32_MAX ||
+        !kolibri_bytecode_reserve(program, (void **)&program->code, &program->code_capacity,
+                                  program->code_count, sizeof(KolibriInstruction))) {
+        return false;
     }
-    skript->vyvod = vyvod ? vyvod : stdout;
+    KolibriInstruction *insn = &program->code[program->code_count];
+    insn->op = (uint8_t)op;
+    insn->a = a;
+    insn->b = b;
+    insn->c = c;
+    insn->site = program->site;
+    program->site &= ~KOLIBRI_SITE_ENTRY;
+    if (at) {
+        *at = program->code_count;
+    }
+    program->code_count++;
+    return true;
 }
 
-int ks_load_text(KolibriScript *skript, const char *text) {
-    if (!skript || !text) {
-        return -1;
-    }
-    char *copy = strdup(text);
-    if (!copy) {
-        return -1;
+static bool kolibri_bytecode_site(KolibriScriptProgram *program, const KolibriStatement *stmt) {
+    if (program->sites_count >= KOLIBRI_SITE_ENTRY - 1U ||
+        !kolibri_bytecode_reserve(program, (void **)&program->sites, &program->sites_capacity, program->sites_count,
+                                  sizeof(KolibriProgramSite))) {
+        return false;
     }
-    free(skript->source_text);
-    skript->source_text = copy;
-    return 0;
+    KolibriProgramSite *site = &program->sites[program->sites_count++];
+    site->start = stmt->span.start;
+    site->parent = program->site & ~KOLIBRI_SITE_ENTRY;
+    site->kind = (uint8_t)stmt->kind;
+    program->site = (uint32_t)program->sites_count | KOLIBRI_SITE_ENTRY;
+    return true;
 }
 
-int ks_load_file(KolibriScript *skript, const char *path) {
-    if (!skript || !path) {
-        return -1;
+static bool kolibri_bytecode_name(KolibriScriptProgram *program, const char *name, uint32_t *out) {
+    if (!name) {
+        return false;
     }
-    FILE *file = fopen(path, "rb");
-    if (!file) {
-        return -1;
+    size_t found = kolibri_name_index_find(&program->names_index, program->names, sizeof(char *),
+                                           program->names_count, name);
+    if (found != SIZE_MAX) {
+        *out = (uint32_t)found;
+        return true;
     }
-    if (fseek(file, 0L, SEEK_END) != 0) {
-        fclose(file);
-        return -1;
+    if (!kolibri_bytecode_reserve(program, (void **)&program->names, &program->names_capacity,
+                                  program->names_count, sizeof(char *))) {
+        return false;
     }
-    long size = ftell(file);
-    if (size < 0) {
-        fclose(file);
-        return -1;
+    char *copy = kolibri_arena_strdup(&program->arena, name);
+    if (!copy) {
+        return false;
     }
-    if (fseek(file, 0L, SEEK_SET) != 0) {
-        fclose(file);
-        return -1;
+    program->names[program->names_count] = copy;
+    *out = (uint32_t)program->names_count++;
+    (void)kolibri_name_index_add(&program->names_index, program->names, sizeof(char *),
+                                 program->names_count);
+    return true;
+}
+
+static bool kolibri_bytecode_bind_slots(KolibriScriptProgram *program, KolibriExpression *expr) {
+    if (expr->name) {
+        uint32_t index = 0;
+        if (!kolibri_bytecode_name(program, expr->name, &index)) {
+            return false;
+        }
+        expr->slot = (size_t)index + 1U;
     }
-    char *buffer = (char *)malloc((size_t)size + 1U);
-    if (!buffer) {
-        fclose(file);
-        return -1;
+    if (expr->operands) {
+        return kolibri_bytecode_bind_slots(program, &expr->operands[0]) &&
+               kolibri_bytecode_bind_slots(program, &expr->operands[1]);
     }
-    size_t read_bytes = fread(buffer, 1U, (size_t)size, file);
-    fclose(file);
-    buffer[read_bytes] = '\0';
-    int result = ks_load_text(skript, buffer);
-    free(buffer);
-    return result;
+    return true;
 }
 
-int ks_execute(KolibriScript *skript) {
-    if (!skript || !skript->source_text) {
-        return -1;
+/* Moves expr out of the AST. Equal texts resolve identically, so they share
+ * one constant. */
+static bool kolibri_bytecode_constant(KolibriScriptProgram *program, KolibriExpression *expr,
+                                      uint32_t *out) {
+    size_t found = expr->text ? kolibri_name_index_find(&program->constants_index, program->constants,
+                                                         sizeof(KolibriExpression),
+                                                         program->constants_count, expr->text)
+                              : SIZE_MAX;
+    if (found != SIZE_MAX) {
+        *out = (uint32_t)found;
+        return true;
     }
-    kolibri_script_reset(skript);
-    KolibriTokenBuffer tokens;
-    kolibri_token_buffer_init(&tokens);
-    KolibriDiagnosticBuffer diagnostics;
-    kolibri_diagnostic_buffer_init(&diagnostics);
+    if (!kolibri_bytecode_reserve(program, (void **)&program->constants, &program->constants_capacity,
+                                  program->constants_count, sizeof(KolibriExpression))) {
+        return false;
+    }
+    KolibriExpression *constant = &program->constants[program->constants_count];
+    *constant = *expr;
+    memset(expr, 0, sizeof(*expr));
+    *out = (uint32_t)program->constants_count++;
+    (void)kolibri_name_index_add(&program->constants_index, program->constants,
+                                 sizeof(KolibriExpression), program->constants_count);
+    return kolibri_bytecode_bind_slots(program, constant);
+}
 
-    KolibriLexer lexer;
-    kolibri_lexer_init(&lexer, skript->source_text, &tokens, &diagnostics);
+static bool kolibri_bytecode_block(KolibriScriptProgram *program, KolibriStatementList *list);
+
+static bool kolibri_bytecode_statement(KolibriScriptProgram *program, KolibriStatement *stmt) {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    switch (stmt->kind) {
+    case KOLIBRI_NODE_SHOW:
+        return kolibri_bytecode_constant(program, &stmt->data.show.value, &a) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_SHOW, a, 0U, 0U, NULL);
+    case KOLIBRI_NODE_VARIABLE:
+        return kolibri_bytecode_name(program, stmt->data.variable.name, &a) &&
+               kolibri_bytecode_constant(program, &stmt->data.variable.value, &b) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_SET, a, b, 0U, NULL);
+    case KOLIBRI_NODE_TEACH:
+        return kolibri_bytecode_constant(program, &stmt->data.teach.left, &a) &&
+               kolibri_bytecode_constant(program, &stmt->data.teach.right, &b) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_TEACH, a, b, 0U, NULL);
+    case KOLIBRI_NODE_CREATE_FORMULA:
+        return kolibri_bytecode_name(program, stmt->data.create_formula.name, &a) &&
+               kolibri_bytecode_constant(program, &stmt->data.create_formula.expression, &b) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_CREATE, a, b, 0U, NULL);
+    case KOLIBRI_NODE_EVALUATE_FORMULA:
+        return kolibri_bytecode_name(program, stmt->data.evaluate_formula.name, &a) &&
+               kolibri_bytecode_constant(program, &stmt->data.evaluate_formula.task, &b) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_EVALUATE, a, b, 0U, NULL);
+    case KOLIBRI_NODE_SAVE_FORMULA:
+        return kolibri_bytecode_name(program, stmt->data.save_formula.name, &a) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_SAVE, a, 0U, 0U, NULL);
+    case KOLIBRI_NODE_DROP_FORMULA:
+        return kolibri_bytecode_name(program, stmt->data.drop_formula.name, &a) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_DROP, a, 0U, 0U, NULL);
+    case KOLIBRI_NODE_SWARM_SEND:
+        return kolibri_bytecode_name(program, stmt->data.swarm_send.name, &a) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_SWARM, a, 0U, 0U, NULL);
+    case KOLIBRI_NODE_CALL_EVOLUTION:
+        return kolibri_bytecode_emit(program, KOLIBRI_OP_EVOLVE, 0U, 0U, 0U, NULL);
+    case KOLIBRI_NODE_PRINT_CANVAS:
+        return kolibri_bytecode_emit(program, KOLIBRI_OP_CANVAS, 0U, 0U, 0U, NULL);
+    case KOLIBRI_NODE_MODE:
+        return kolibri_bytecode_constant(program, &stmt->data.mode_stmt.value, &a) &&
+               kolibri_bytecode_emit(program, KOLIBRI_OP_MODE, a, 0U, 0U, NULL);
+    case KOLIBRI_NODE_IF: {
+        size_t branch = 0;
+        size_t skip = 0;
+        if (!kolibri_bytecode_constant(program, &stmt->data.if_stmt.condition, &a) ||
+            !kolibri_bytecode_emit(program, KOLIBRI_OP_IF, a, 0U, 0U, &branch) ||
+            !kolibri_bytecode_block(program, &stmt->data.if_stmt.then_body)) {
+            return false;
+        }
+        if (stmt->data.if_stmt.else_body.count == 0) {
+            program->code[branch].b = (uint32_t)program->code_count;
+            return true;
+        }
+        if (!kolibri_bytecode_emit(program, KOLIBRI_OP_JUMP, 0U, 0U, 0U, &skip)) {
+            return false;
+        }
+        program->code[branch].b = (uint32_t)program->code_count;
+        if (!kolibri_bytecode_block(program, &stmt->data.if_stmt.else_body)) {
+            return false;
+        }
+        program->code[skip].a = (uint32_t)program->code_count;
+        return true;
+    }
+    case KOLIBRI_NODE_WHILE: {
+        uint32_t loop = (uint32_t)program->loops++;
+        size_t test = 0;
+        if (!kolibri_bytecode_constant(program, &stmt->data.while_stmt.condition, &a) ||
+            !kolibri_bytecode_emit(program, KOLIBRI_OP_LOOP_INIT, 0U, 0U, loop, NULL) ||
+            !kolibri_bytecode_emit(program, KOLIBRI_OP_WHILE, a, 0U, loop, &test) ||
+            !kolibri_bytecode_block(program, &stmt->data.while_stmt.body) ||
+            !kolibri_bytecode_emit(program, KOLIBRI_OP_LOOP_NEXT, 0U, (uint32_t)test, loop, NULL)) {
+            return false;
+        }
+        program->code[test].b = (uint32_t)program->code_count;
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+static bool kolibri_bytecode_block(KolibriScriptProgram *program, KolibriStatementList *list) {
+    for (size_t i = 0; i < list->count; ++i) {
+        uint32_t outer = program->site & ~KOLIBRI_SITE_ENTRY;
+        if (!kolibri_bytecode_site(program, list->items[i]) ||
+            !kolibri_bytecode_statement(program, list->items[i])) {
+            return false;
+        }
+        program->site = outer;
+        /* c marks a TEACH whose batch continues with the next instruction. */
+        if (list->items[i]->kind == KOLIBRI_NODE_TEACH && i + 1U < list->count &&
+            list->items[i + 1U]->kind == KOLIBRI_NODE_TEACH) {
+            program->code[program->code_count - 1U].c = 1U;
+        }
+    }
+    return true;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KOLIBRI_VM_COMPUTED_GOTO 1
+#endif
+
+/* The instruction being timed while the VM runs under the profiler. */
+typedef struct {
+    const size_t *entries;
+    uint32_t site;
+    uint64_t start_ns;
+} KolibriVmProfile;
+
+static void kolibri_vm_profile_step(KolibriScript *script, KolibriVmProfile *profile, uint32_t next_site) {
+    uint64_t now = kolibri_now_ns();
+    size_t entry = profile->site != 0U ? profile->entries[profile->site & ~KOLIBRI_SITE_ENTRY] : 0U;
+    if (entry != 0U) {
+        kolibri_profile_record(script->profiler, entry, (profile->site & KOLIBRI_SITE_ENTRY) != 0U,
+                               now - profile->start_ns);
+    }
+    profile->site = next_site;
+    profile->start_ns = now;
+}
+
+/*
+ * Runs from *resume until HALT (0) or an error (-1). With a deadline the VM
+ * also stops at a yield point past it, a loop's back edge or the end of an
+ * evolution or evaluation, and returns 1 with *resume at the next
+ * instruction. Everything else a run needs is in the frame.
+ */
+static int kolibri_vm_run(KolibriScript *script, const KolibriScriptProgram *program, KolibriVmProfile *profile,
+                          size_t *resume, uint64_t deadline_ns) {
+    const KolibriInstruction *code = program->code;
+    const KolibriExpression *constants = program->constants;
+    char *const *names = program->names;
+    size_t *loops = script->frame->loops;
+    const KolibriInstruction *insn = NULL;
+    size_t pc = *resume;
+    bool condition = false;
+#define KOLIBRI_VM_YIELD()                                              \
+    do {                                                                \
+        if (deadline_ns != 0U && kolibri_now_ns() >= deadline_ns) {     \
+            *resume = pc;                                               \
+            return 1;                                                   \
+        }                                                               \
+    } while (0)
+
+#if defined(KOLIBRI_VM_COMPUTED_GOTO)
+    static const void *const dispatch[KOLIBRI_OP_COUNT] = {
+        [KOLIBRI_OP_SHOW] = &&op_show,
+        [KOLIBRI_OP_SET] = &&op_set,
+        [KOLIBRI_OP_MODE] = &&op_mode,
+        [KOLIBRI_OP_TEACH] = &&op_teach,
+        [KOLIBRI_OP_CREATE] = &&op_create,
+        [KOLIBRI_OP_EVALUATE] = &&op_evaluate,
+        [KOLIBRI_OP_SAVE] = &&op_save,
+        [KOLIBRI_OP_DROP] = &&op_drop,
+        [KOLIBRI_OP_SWARM] = &&op_swarm,
+        [KOLIBRI_OP_EVOLVE] = &&op_evolve,
+        [KOLIBRI_OP_CANVAS] = &&op_canvas,
+        [KOLIBRI_OP_IF] = &&op_if,
+        [KOLIBRI_OP_LOOP_INIT] = &&op_loop_init,
+        [KOLIBRI_OP_WHILE] = &&op_while,
+        [KOLIBRI_OP_LOOP_NEXT] = &&op_loop_next,
+        [KOLIBRI_OP_JUMP] = &&op_jump,
+        [KOLIBRI_OP_HALT] = &&op_halt,
+    };
+    /* Under the profiler every opcode first passes through op_profile. */
+    static const void *const profiled[KOLIBRI_OP_COUNT] = {[0 ... KOLIBRI_OP_COUNT - 1] = &&op_profile};
+    const void *const *table = profile ? profiled : dispatch;
+#define KOLIBRI_VM_OP(op, label) label
+#define KOLIBRI_VM_NEXT()        \
+    do {                         \
+        insn = &code[pc++];      \
+        goto *table[insn->op];   \
+    } while (0)
+    KOLIBRI_VM_NEXT();
+op_profile:
+    kolibri_vm_profile_step(script, profile, insn->site);
+    goto *dispatch[insn->op];
+#else
+#define KOLIBRI_VM_OP(op, label) case op
+#define KOLIBRI_VM_NEXT() continue
+    for (;;) {
+        insn = &code[pc++];
+        if (profile) {
+            kolibri_vm_profile_step(script, profile, insn->site);
+        }
+        switch ((KolibriOpcode)insn->op) {
+#endif
+    KOLIBRI_VM_OP(KOLIBRI_OP_SHOW, op_show):
+        if (kolibri_execute_show(script, &constants[insn->a]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_SET, op_set):
+        if (kolibri_execute_variable(script, names[insn->a], (size_t)insn->a + 1U, &constants[insn->b]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_MODE, op_mode):
+        if (kolibri_execute_mode(script, &constants[insn->a]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_TEACH, op_teach):
+        if (kolibri_execute_teach(script, &constants[insn->a], &constants[insn->b], insn->c != 0U) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_CREATE, op_create):
+        if (kolibri_execute_create_formula(script, names[insn->a], &constants[insn->b]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_EVALUATE, op_evaluate):
+        if (kolibri_execute_evaluate_formula(script, names[insn->a], &constants[insn->b]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_YIELD();
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_SAVE, op_save):
+        if (kolibri_execute_save_formula(script, names[insn->a]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_DROP, op_drop):
+        if (kolibri_execute_drop_formula(script, names[insn->a]) != 0) {
+            return -1;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_SWARM, op_swarm):
+        (void)kolibri_execute_swarm(script, names[insn->a]);
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_EVOLVE, op_evolve):
+        (void)kolibri_execute_call_evolution(script);
+        KOLIBRI_VM_YIELD();
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_CANVAS, op_canvas):
+        (void)kolibri_execute_print_canvas(script);
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_IF, op_if):
+        if (!kolibri_evaluate_condition(script, &constants[insn->a], &condition)) {
+            kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить условие 'если'");
+            return -1;
+        }
+        if (!condition) {
+            pc = insn->b;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_LOOP_INIT, op_loop_init):
+        loops[insn->c] = 0U;
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_WHILE, op_while):
+        if (loops[insn->c] >= KOLIBRI_MAX_LOOP_ITERATIONS) {
+            kolibri_script_log(script, "SCRIPT_ERROR", "Превышен лимит итераций цикла");
+            return -1;
+        }
+        if (!kolibri_evaluate_condition(script, &constants[insn->a], &condition)) {
+            kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить условие 'пока'");
+            return -1;
+        }
+        if (!condition) {
+            pc = insn->b;
+        }
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_LOOP_NEXT, op_loop_next):
+        loops[insn->c] += 1U;
+        pc = insn->b;
+        KOLIBRI_VM_YIELD();
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_JUMP, op_jump):
+        pc = insn->a;
+        KOLIBRI_VM_NEXT();
+    KOLIBRI_VM_OP(KOLIBRI_OP_HALT, op_halt):
+        return 0;
+#if !defined(KOLIBRI_VM_COMPUTED_GOTO)
+        default:
+            return -1;
+        }
+    }
+#endif
+#undef KOLIBRI_VM_OP
+#undef KOLIBRI_VM_NEXT
+#undef KOLIBRI_VM_YIELD
+}
+
+/* ===================== Artifacts ===================== */
+
+/*
+ * A .ksc file is the little-endian image of a compiled program: magic,
+ * format version, length and FNV-1a hash of the source text, then the
+ * instruction stream, the constant pool and the names. Spans are not kept,
+ * they only serve parser diagnostics.
+ */
+#define KOLIBRI_KSC_MAGIC "KSC\0"
+#define KOLIBRI_KSC_VERSION 2U
+#define KOLIBRI_KSC_NO_STRING UINT32_MAX
+#define KOLIBRI_KSC_MAX_STRING (1U << 20)
+
+typedef struct {
+    FILE *file;
+    bool ok;
+    KolibriScriptArena *arena;
+} KolibriKscStream;
+
+static void kolibri_ksc_put(KolibriKscStream *stream, uint64_t value, size_t bytes) {
+    unsigned char buffer[8];
+    for (size_t i = 0; i < bytes; ++i) {
+        buffer[i] = (unsigned char)(value >> (8U * i));
+    }
+    if (stream->ok && fwrite(buffer, 1U, bytes, stream->file) != bytes) {
+        stream->ok = false;
+    }
+}
+
+static uint64_t kolibri_ksc_get(KolibriKscStream *stream, size_t bytes) {
+    unsigned char buffer[8];
+    if (!stream->ok || fread(buffer, 1U, bytes, stream->file) != bytes) {
+        stream->ok = false;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= (uint64_t)buffer[i] << (8U * i);
+    }
+    return value;
+}
+
+static void kolibri_ksc_put_string(KolibriKscStream *stream, const char *text) {
+    if (!text) {
+        kolibri_ksc_put(stream, KOLIBRI_KSC_NO_STRING, 4U);
+        return;
+    }
+    size_t len = strlen(text);
+    kolibri_ksc_put(stream, len, 4U);
+    if (stream->ok && fwrite(text, 1U, len, stream->file) != len) {
+        stream->ok = false;
+    }
+}
+
+static char *kolibri_ksc_get_string(KolibriKscStream *stream) {
+    uint32_t len = (uint32_t)kolibri_ksc_get(stream, 4U);
+    if (!stream->ok || len == KOLIBRI_KSC_NO_STRING) {
+        return NULL;
+    }
+    char *text = len <= KOLIBRI_KSC_MAX_STRING ? (char *)kolibri_arena_alloc(stream->arena, (size_t)len + 1U) : NULL;
+    if (!text || fread(text, 1U, len, stream->file) != len) {
+        stream->ok = false;
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static void kolibri_ksc_put_expression(KolibriKscStream *stream, const KolibriExpression *expr) {
+    uint64_t number = 0;
+    memcpy(&number, &expr->number, sizeof(number));
+    kolibri_ksc_put_string(stream, expr->text);
+    kolibri_ksc_put_string(stream, expr->name);
+    kolibri_ksc_put_string(stream, expr->string);
+    kolibri_ksc_put(stream, number, 8U);
+    kolibri_ksc_put(stream, expr->slot, 4U);
+    kolibri_ksc_put(stream, (uint64_t)expr->kind, 1U);
+    kolibri_ksc_put(stream, (uint64_t)expr->comparator, 1U);
+    kolibri_ksc_put(stream, expr->numeric ? 1U : 0U, 1U);
+    kolibri_ksc_put(stream, expr->operands ? 1U : 0U, 1U);
+    if (expr->operands) {
+        kolibri_ksc_put_expression(stream, &expr->operands[0]);
+        kolibri_ksc_put_expression(stream, &expr->operands[1]);
+    }
+}
+
+/* Comparisons nest one level deep, depth stops a crafted file from
+ * recursing further. */
+static void kolibri_ksc_get_expression(KolibriKscStream *stream, KolibriExpression *expr,
+                                       size_t names_count, int depth) {
+    memset(expr, 0, sizeof(*expr));
+    expr->text = kolibri_ksc_get_string(stream);
+    expr->name = kolibri_ksc_get_string(stream);
+    expr->string = kolibri_ksc_get_string(stream);
+    uint64_t number = kolibri_ksc_get(stream, 8U);
+    memcpy(&expr->number, &number, sizeof(number));
+    expr->slot = (size_t)kolibri_ksc_get(stream, 4U);
+    uint64_t kind = kolibri_ksc_get(stream, 1U);
+    uint64_t comparator = kolibri_ksc_get(stream, 1U);
+    expr->numeric = kolibri_ksc_get(stream, 1U) != 0;
+    bool has_operands = kolibri_ksc_get(stream, 1U) != 0;
+    if (!stream->ok || kind > KOLIBRI_EXPR_FITNESS || comparator > KOLIBRI_COMPARE_LT ||
+        expr->slot > names_count || (expr->slot != 0 && !expr->name) ||
+        (comparator != KOLIBRI_COMPARE_NONE) != has_operands) {
+        stream->ok = false;
+        return;
+    }
+    expr->kind = (KolibriExpressionKind)kind;
+    expr->comparator = (KolibriComparator)comparator;
+    if (!has_operands) {
+        return;
+    }
+    expr->operands = depth > 0 ? (KolibriExpression *)kolibri_arena_alloc(stream->arena, 2U * sizeof(KolibriExpression))
+                               : NULL;
+    if (!expr->operands) {
+        stream->ok = false;
+        return;
+    }
+    kolibri_ksc_get_expression(stream, &expr->operands[0], names_count, depth - 1);
+    kolibri_ksc_get_expression(stream, &expr->operands[1], names_count, depth - 1);
+}
+
+/* Rejects operands that would index past the pools of a damaged file. */
+static bool kolibri_ksc_validate(const KolibriScriptProgram *program) {
+    if (program->code_count == 0 || program->code[program->code_count - 1U].op != KOLIBRI_OP_HALT) {
+        return false;
+    }
+    for (size_t i = 0; i < program->sites_count; ++i) {
+        /* Parents come first, which keeps the profiler's tree acyclic. */
+        if (program->sites[i].parent > i || program->sites[i].kind > KOLIBRI_NODE_MODE) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < program->code_count; ++i) {
+        const KolibriInstruction *insn = &program->code[i];
+        if ((insn->site & ~KOLIBRI_SITE_ENTRY) > program->sites_count) {
+            return false;
+        }
+        bool constant_a = insn->a < program->constants_count;
+        bool constant_b = insn->b < program->constants_count;
+        bool name_a = insn->a < program->names_count;
+        bool target_b = insn->b < program->code_count;
+        bool loop_c = insn->c < program->loops;
+        bool valid = true;
+        switch ((KolibriOpcode)insn->op) {
+        case KOLIBRI_OP_SHOW:
+        case KOLIBRI_OP_MODE:
+            valid = constant_a;
+            break;
+        case KOLIBRI_OP_TEACH:
+            valid = constant_a && constant_b &&
+                    (insn->c == 0U || (i + 1U < program->code_count && program->code[i + 1U].op == KOLIBRI_OP_TEACH));
+            break;
+        case KOLIBRI_OP_SET:
+        case KOLIBRI_OP_CREATE:
+        case KOLIBRI_OP_EVALUATE:
+            valid = name_a && constant_b;
+            break;
+        case KOLIBRI_OP_SAVE:
+        case KOLIBRI_OP_DROP:
+        case KOLIBRI_OP_SWARM:
+            valid = name_a;
+            break;
+        case KOLIBRI_OP_IF:
+            valid = constant_a && target_b;
+            break;
+        case KOLIBRI_OP_WHILE:
+            valid = constant_a && target_b && loop_c;
+            break;
+        case KOLIBRI_OP_LOOP_INIT:
+            valid = loop_c;
+            break;
+        case KOLIBRI_OP_LOOP_NEXT:
+            valid = target_b && loop_c;
+            break;
+        case KOLIBRI_OP_JUMP:
+            valid = insn->a < program->code_count;
+            break;
+        case KOLIBRI_OP_EVOLVE:
+        case KOLIBRI_OP_CANVAS:
+        case KOLIBRI_OP_HALT:
+            break;
+        default:
+            valid = false;
+            break;
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ===================== Public API ===================== */
+
+int ks_init(KolibriScript *skript, KolibriFormulaPool *pool, KolibriGenome *genome) {
+    return ks_init_ex(skript, pool, genome, NULL);
+}
+
+int ks_init_ex(KolibriScript *skript, KolibriFormulaPool *pool, KolibriGenome *genome,
+               const KolibriAllocator *allocator) {
+    if (!skript) {
+        return -1;
+    }
+    memset(skript, 0, sizeof(*skript));
+    kolibri_allocator_resolve(&skript->allocator, allocator);
+    skript->arena.allocator = &skript->allocator;
+    skript->variables_index.allocator = &skript->allocator;
+    skript->formulas_index.allocator = &skript->allocator;
+    skript->pool = pool;
+    skript->genome = genome;
+    skript->vyvod = stdout;
+    skript->source_text = NULL;
+    kolibri_symbol_table_init(&skript->symbol_table, genome);
+    kolibri_symbol_table_load(&skript->symbol_table);
+    kolibri_symbol_table_seed_defaults(&skript->symbol_table);
+    kolibri_script_set_mode(skript, "neutral");
+    KolibriScriptControls defaults = {
+        .lambda_b = 0.25,
+        .lambda_d = 0.2,
+        .target_b = NAN,
+        .target_d = NAN,
+        .temperature = 0.85,
+        .top_k = 4.0,
+        .cf_beam = 1,
+    };
+    (void)ks_set_controls(skript, &defaults);
+    const char *profile = getenv("KOLIBRI_SCRIPT_PROFILE");
+    if (profile && profile[0] != '\0' && strcmp(profile, "0") != 0 && ks_set_profiler(skript, 1) == 0) {
+        if (strcmp(profile, "1") == 0) {
+            skript->profiler->report_stderr = true;
+        } else {
+            skript->profiler->report_path = kolibri_mem_strdup(&skript->allocator, profile);
+        }
+    }
+    return 0;
+}
+
+void ks_free(KolibriScript *skript) {
+    if (!skript) {
+        return;
+    }
+    kolibri_script_reset(skript);
+    kolibri_arena_free(&skript->arena);
+    if (skript->profiler) {
+        if (skript->profiler->report_stderr) {
+            (void)ks_profile_report(skript, stderr);
+        } else if (skript->profiler->report_path) {
+            FILE *out = fopen(skript->profiler->report_path, "a");
+            if (out) {
+                (void)ks_profile_write_collapsed(skript, out);
+                fclose(out);
+            }
+        }
+        (void)ks_set_profiler(skript, 0);
+    }
+    kolibri_shared_detach(skript);
+    kolibri_symbol_table_free(&skript->symbol_table);
+    kolibri_mem_free(&skript->allocator, skript->source_text);
+    skript->source_text = NULL;
+    ks_program_free(skript->program);
+    skript->program = NULL;
+    skript->pool = NULL;
+    skript->genome = NULL;
+    skript->vyvod = NULL;
+}
+
+void ks_set_output(KolibriScript *skript, FILE *vyvod) {
+    if (!skript) {
+        return;
+    }
+    skript->vyvod = vyvod ? vyvod : stdout;
+}
+
+int ks_load_text(KolibriScript *skript, const char *text) {
+    if (!skript || !text) {
+        return -1;
+    }
+    char *copy = kolibri_mem_strdup(&skript->allocator, text);
+    if (!copy) {
+        return -1;
+    }
+    /* Positions of another text would alias the old statements. */
+    if (skript->profiler && (!skript->source_text || strcmp(skript->source_text, copy) != 0)) {
+        kolibri_profile_clear(skript->profiler);
+    }
+    kolibri_mem_free(&skript->allocator, skript->source_text);
+    skript->source_text = copy;
+    ks_program_free(skript->program);
+    skript->program = NULL;
+    return 0;
+}
+
+int ks_load_file(KolibriScript *skript, const char *path) {
+    if (!skript || !path) {
+        return -1;
+    }
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    if (fseek(file, 0L, SEEK_END) != 0) {
+        fclose(file);
+        return -1;
+    }
+    long size = ftell(file);
+    if (size < 0) {
+        fclose(file);
+        return -1;
+    }
+    if (fseek(file, 0L, SEEK_SET) != 0) {
+        fclose(file);
+        return -1;
+    }
+    char *buffer = (char *)kolibri_mem_alloc(&skript->allocator, (size_t)size + 1U);
+    if (!buffer) {
+        fclose(file);
+        return -1;
+    }
+    size_t read_bytes = fread(buffer, 1U, (size_t)size, file);
+    fclose(file);
+    buffer[read_bytes] = '\0';
+    int result = ks_load_text(skript, buffer);
+    kolibri_mem_free(&skript->allocator, buffer);
+    char cache[4096];
+    if (result == 0 && ks_program_cache_path(path, cache, sizeof(cache)) == 0) {
+        skript->program = kolibri_program_load(cache, skript->source_text, &skript->allocator);
+    }
+    return result;
+}
+
+/*
+ * Lexes and parses text, numbering its lines from first_line. A fragment is
+ * a bare statement list without the начало/конец frame; one that ends inside
+ * an unfinished block sets *incomplete instead of logging an error.
+ */
+static bool kolibri_script_parse_text(KolibriScript *skript, const char *text, size_t first_line,
+                                      bool fragment, KolibriProgram *program, bool *incomplete) {
+    KolibriTokenBuffer tokens;
+    kolibri_token_buffer_init(&tokens, &skript->allocator);
+    KolibriDiagnosticBuffer diagnostics;
+    kolibri_diagnostic_buffer_init(&diagnostics, &skript->allocator);
+    kolibri_statement_list_init(&program->statements);
+    program->arena.head = NULL;
+    program->arena.allocator = &skript->allocator;
+
+    KolibriLexer lexer;
+    kolibri_lexer_init(&lexer, text, &tokens, &diagnostics, &program->arena);
+    lexer.line = first_line;
     if (kolibri_lexer_run(&lexer) != 0) {
+        kolibri_program_free(program);
         kolibri_token_buffer_free(&tokens);
         kolibri_diagnostic_buffer_free(&diagnostics);
         kolibri_script_log(skript, "SCRIPT_ERROR", "Лексический анализ завершился с ошибкой");
-        return -1;
+        return false;
     }
 
     KolibriParser parser;
-    kolibri_parser_init(&parser, &tokens, &diagnostics);
-    KolibriProgram program;
-    kolibri_statement_list_init(&program.statements);
-    bool parsed = kolibri_parser_parse_program(&parser, &program);
+    kolibri_parser_init(&parser, &tokens, &diagnostics, &program->arena);
+    bool parsed = true;
+    if (fragment) {
+        kolibri_parser_skip_newlines(&parser);
+        program->statements = kolibri_parser_parse_statements(&parser, NULL, 0U);
+    } else {
+        parsed = kolibri_parser_parse_program(&parser, program);
+    }
     if (!parsed || diagnostics.count > 0) {
-        if (diagnostics.count > 0 && diagnostics.data[0].message) {
+        const KolibriToken *eof = &tokens.data[tokens.count - 1U];
+        if (fragment && incomplete && diagnostics.count > 0 &&
+            diagnostics.data[0].span.start.line == eof->span.start.line &&
+            diagnostics.data[0].span.start.column == eof->span.start.column) {
+            *incomplete = true;
+        } else if (diagnostics.count > 0 && diagnostics.data[0].message) {
             kolibri_script_log(skript, "SCRIPT_ERROR", diagnostics.data[0].message);
         }
+        kolibri_program_free(program);
+        parsed = false;
+    }
+    kolibri_token_buffer_free(&tokens);
+    kolibri_diagnostic_buffer_free(&diagnostics);
+    return parsed;
+}
+
+/* Lexes and parses the loaded text; logs the first diagnostic on failure. */
+static bool kolibri_script_parse(KolibriScript *skript, KolibriProgram *program) {
+    return kolibri_script_parse_text(skript, skript->source_text, 1U, false, program, NULL);
+}
+
+int ks_execute(KolibriScript *skript) {
+    KOLIBRI_TRACE_SCOPE("ks_execute");
+    if (!skript || !skript->source_text) {
+        return -1;
+    }
+    if (skript->program) {
+        return ks_execute_compiled(skript, skript->program);
+    }
+    if (kolibri_shared_begin(skript) != 0) {
+        return -1;
+    }
+    kolibri_script_reset(skript);
+    KolibriProgram program;
+    int status = -1;
+    if (kolibri_script_parse(skript, &program)) {
+        status = kolibri_execute_block(skript, &program.statements);
+        /* A failed statement may leave earlier teach pairs queued. */
+        kolibri_teach_batch_flush(skript, "teach");
         kolibri_program_free(&program);
-        kolibri_token_buffer_free(&tokens);
-        kolibri_diagnostic_buffer_free(&diagnostics);
+    }
+    kolibri_shared_merge(skript);
+    return status;
+}
+
+/* A final line without its newline still counts. */
+static size_t kolibri_count_lines(const char *text) {
+    size_t lines = 0U;
+    char last = '\n';
+    for (; *text; ++text) {
+        lines += *text == '\n';
+        last = *text;
+    }
+    return lines + (last != '\n');
+}
+
+int ks_execute_append(KolibriScript *skript, const char *text) {
+    if (!skript || !text) {
+        return -1;
+    }
+    if (kolibri_shared_begin(skript) != 0) {
+        return -1;
+    }
+    KolibriProgram fragment;
+    bool incomplete = false;
+    int status = -1;
+    if (kolibri_script_parse_text(skript, text, skript->session_lines + 1U, true, &fragment, &incomplete)) {
+        skript->session_lines += kolibri_count_lines(text);
+        /* Values may point into the fragment's tree, so it lives as long as they do. */
+        kolibri_arena_adopt(&skript->arena, &fragment.arena);
+        status = kolibri_execute_block(skript, &fragment.statements);
+        kolibri_teach_batch_flush(skript, "teach");
+    } else if (incomplete) {
+        status = 1;
+    } else {
+        skript->session_lines += kolibri_count_lines(text);
+    }
+    kolibri_shared_merge(skript);
+    return status;
+}
+
+KolibriScriptProgram *ks_compile(KolibriScript *skript) {
+    if (!skript || !skript->source_text) {
+        return NULL;
+    }
+    KolibriProgram ast;
+    if (!kolibri_script_parse(skript, &ast)) {
+        return NULL;
+    }
+    KolibriScriptProgram *program = kolibri_program_new(&skript->allocator);
+    if (!program) {
+        kolibri_program_free(&ast);
+        return NULL;
+    }
+    /* Constants keep pointing into the tree's arena, so the program takes
+     * it over instead of copying them out; both allocators are the script's. */
+    program->arena.head = ast.arena.head;
+    bool compiled = kolibri_bytecode_block(program, &ast.statements) &&
+                    kolibri_bytecode_emit(program, KOLIBRI_OP_HALT, 0U, 0U, 0U, NULL);
+    if (!compiled) {
+        ks_program_free(program);
+        kolibri_script_log(skript, "SCRIPT_ERROR", "Не удалось скомпилировать сценарий");
+        return NULL;
+    }
+    return program;
+}
+
+/* A fresh frame for program and, under the profiler, the entries of its sites. */
+static int kolibri_vm_prepare(KolibriScript *skript, const KolibriScriptProgram *program, KolibriScriptFrame *frame,
+                              KolibriVmProfile *profile) {
+    frame->variables = (size_t *)kolibri_arena_alloc(&skript->arena, (program->names_count + 1U) * sizeof(size_t));
+    frame->loops = (size_t *)kolibri_arena_alloc(&skript->arena, (program->loops + 1U) * sizeof(size_t));
+    if (!frame->variables || !frame->loops) {
         return -1;
     }
+    profile->entries = NULL;
+    profile->site = 0U;
+    profile->start_ns = 0U;
+    if (skript->profiler) {
+        size_t *entries = (size_t *)kolibri_arena_alloc(&skript->arena, (program->sites_count + 1U) * sizeof(size_t));
+        if (!entries) {
+            return -1;
+        }
+        /* Parent sites precede their children. */
+        for (size_t i = 0; i < program->sites_count; ++i) {
+            const KolibriProgramSite *site = &program->sites[i];
+            entries[i + 1U] = kolibri_profile_entry(skript->profiler, site->start, (KolibriNodeKind)site->kind,
+                                                    entries[site->parent]);
+        }
+        profile->entries = entries;
+    }
+    return 0;
+}
 
-    int status = kolibri_execute_block(skript, &program.statements);
+/* Runs the VM until it stops; a yield closes the timed instruction so the
+ * pause is charged to nobody. */
+static int kolibri_vm_resume(KolibriScript *skript, const KolibriScriptProgram *program, KolibriScriptFrame *frame,
+                             KolibriVmProfile *profile, size_t *pc, uint64_t deadline_ns) {
+    skript->frame = frame;
+    int status = kolibri_vm_run(skript, program, profile->entries ? profile : NULL, pc, deadline_ns);
+    skript->frame = NULL;
+    if (profile->entries) {
+        kolibri_vm_profile_step(skript, profile, 0U);
+    }
+    return status;
+}
 
-    kolibri_program_free(&program);
-    kolibri_token_buffer_free(&tokens);
-    kolibri_diagnostic_buffer_free(&diagnostics);
+static int kolibri_execute_compiled(KolibriScript *skript, const KolibriScriptProgram *program) {
+    kolibri_script_reset(skript);
+    KolibriScriptFrame frame;
+    KolibriVmProfile profile;
+    if (kolibri_vm_prepare(skript, program, &frame, &profile) != 0) {
+        return -1;
+    }
+    size_t pc = 0;
+    int status = kolibri_vm_resume(skript, program, &frame, &profile, &pc, 0U);
+    kolibri_teach_batch_flush(skript, "teach");
+    return status;
+}
 
+/* A run ks_step has left off: its program, frame and where to resume. */
+typedef struct KolibriScriptContinuation {
+    KolibriScriptProgram *compiled; /* owned; NULL when the loaded .ksc runs */
+    const KolibriScriptProgram *program;
+    KolibriScriptFrame frame;
+    KolibriVmProfile profile;
+    size_t pc;
+} KolibriScriptContinuation;
+
+static void kolibri_continuation_drop(KolibriScript *script) {
+    if (script->continuation) {
+        ks_program_free(script->continuation->compiled);
+        script->continuation = NULL;
+    }
+}
+
+static KolibriScriptStatus kolibri_step_finish(KolibriScript *skript, int status) {
+    kolibri_teach_batch_flush(skript, "teach");
+    kolibri_continuation_drop(skript);
+    kolibri_shared_merge(skript);
+    return status == 0 ? KOLIBRI_SCRIPT_DONE : KOLIBRI_SCRIPT_ERROR;
+}
+
+KolibriScriptStatus ks_step(KolibriScript *skript, uint64_t budget_ns) {
+    if (!skript) {
+        return KOLIBRI_SCRIPT_ERROR;
+    }
+    KolibriScriptContinuation *run = skript->continuation;
+    if (!run) {
+        if (!skript->source_text || kolibri_shared_begin(skript) != 0) {
+            return KOLIBRI_SCRIPT_ERROR;
+        }
+        kolibri_script_reset(skript);
+        KolibriScriptProgram *compiled = skript->program ? NULL : ks_compile(skript);
+        run = (skript->program || compiled)
+                  ? (KolibriScriptContinuation *)kolibri_arena_alloc(&skript->arena, sizeof(KolibriScriptContinuation))
+                  : NULL;
+        if (!run) {
+            ks_program_free(compiled);
+            return kolibri_step_finish(skript, -1);
+        }
+        run->compiled = compiled;
+        run->program = compiled ? compiled : skript->program;
+        skript->continuation = run;
+        if (kolibri_vm_prepare(skript, run->program, &run->frame, &run->profile) != 0) {
+            return kolibri_step_finish(skript, -1);
+        }
+    }
+    uint64_t deadline = kolibri_now_ns() + budget_ns;
+    int status = kolibri_vm_resume(skript, run->program, &run->frame, &run->profile, &run->pc, deadline);
+    if (status == 1) {
+        return KOLIBRI_SCRIPT_YIELDED;
+    }
+    return kolibri_step_finish(skript, status);
+}
+
+int ks_execute_compiled(KolibriScript *skript, const KolibriScriptProgram *program) {
+    if (!skript || !program || kolibri_shared_begin(skript) != 0) {
+        return -1;
+    }
+    int status = kolibri_execute_compiled(skript, program);
+    kolibri_shared_merge(skript);
     return status;
 }
+
+static int kolibri_teach_bulk(KolibriScript *skript, const KolibriAssociationInput *pairs, size_t count) {
+    size_t taught = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!pairs[i].question || !pairs[i].answer) {
+            continue;
+        }
+        if (kolibri_teach_batch_add(skript, pairs[i].question, pairs[i].answer, "teach") != 0) {
+            kolibri_teach_batch_flush(skript, "teach");
+            return -1;
+        }
+        taught++;
+    }
+    kolibri_teach_batch_flush(skript, "teach");
+    char message[64];
+    snprintf(message, sizeof(message), "пакет: %zu", taught);
+    kolibri_script_log(skript, "SCRIPT_TEACH", message);
+    return 0;
+}
+
+int ks_teach_bulk(KolibriScript *skript, const KolibriAssociationInput *pairs, size_t count) {
+    if (!skript || !skript->pool || (!pairs && count > 0) || kolibri_shared_begin(skript) != 0) {
+        return -1;
+    }
+    int status = kolibri_teach_bulk(skript, pairs, count);
+    kolibri_shared_merge(skript);
+    return status;
+}
+
+KolibriSharedPool *ks_shared_create(KolibriFormulaPool *pool, KolibriGenome *genome) {
+    if (!pool) {
+        return NULL;
+    }
+    KolibriSharedPool *shared = (KolibriSharedPool *)kolibri_mem_calloc(NULL, 1U, sizeof(KolibriSharedPool));
+    if (!shared) {
+        return NULL;
+    }
+#ifdef KOLIBRI_SCRIPT_THREADS
+    if (pthread_mutex_init(&shared->lock, NULL) != 0) {
+        kolibri_mem_free(NULL, shared);
+        return NULL;
+    }
+#endif
+    shared->pool = pool;
+    shared->genome = genome;
+    kolibri_symbol_table_init(&shared->symbols, genome);
+    kolibri_symbol_table_load(&shared->symbols);
+    kolibri_symbol_table_seed_defaults(&shared->symbols);
+    return shared;
+}
+
+void ks_shared_destroy(KolibriSharedPool *shared) {
+    if (!shared) {
+        return;
+    }
+#ifdef KOLIBRI_SCRIPT_THREADS
+    pthread_mutex_destroy(&shared->lock);
+#endif
+    kolibri_symbol_table_free(&shared->symbols);
+    kolibri_mem_free(NULL, shared);
+}
+
+void ks_shared_lock(KolibriSharedPool *shared) {
+#ifdef KOLIBRI_SCRIPT_THREADS
+    if (shared) {
+        pthread_mutex_lock(&shared->lock);
+    }
+#else
+    (void)shared;
+#endif
+}
+
+void ks_shared_unlock(KolibriSharedPool *shared) {
+#ifdef KOLIBRI_SCRIPT_THREADS
+    if (shared) {
+        pthread_mutex_unlock(&shared->lock);
+    }
+#else
+    (void)shared;
+#endif
+}
+
+int ks_attach_shared(KolibriScript *skript, KolibriSharedPool *shared) {
+    if (!skript) {
+        return -1;
+    }
+    if (skript->changes) {
+        if (skript->changes->shared == shared) {
+            return 0;
+        }
+        kolibri_shared_detach(skript);
+        kolibri_symbol_table_free(&skript->symbol_table);
+        kolibri_symbol_table_init(&skript->symbol_table, skript->genome);
+        kolibri_symbol_table_load(&skript->symbol_table);
+        kolibri_symbol_table_seed_defaults(&skript->symbol_table);
+    }
+    if (!shared) {
+        return 0;
+    }
+    KolibriScriptChanges *changes =
+        (KolibriScriptChanges *)kolibri_mem_calloc(&skript->allocator, 1U, sizeof(KolibriScriptChanges));
+    if (!changes) {
+        return -1;
+    }
+    changes->arena.allocator = &skript->allocator;
+    changes->shared = shared;
+    changes->home_pool = skript->pool;
+    changes->home_genome = skript->genome;
+    changes->tail = &changes->head;
+    skript->changes = changes;
+    skript->genome = NULL;
+    if (kolibri_shared_begin(skript) != 0) {
+        (void)ks_attach_shared(skript, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+int ks_set_profiler(KolibriScript *skript, int enabled) {
+    if (!skript) {
+        return -1;
+    }
+    if (!enabled) {
+        if (skript->profiler) {
+            const KolibriAllocator *allocator = &skript->allocator;
+            kolibri_mem_free(allocator, skript->profiler->entries);
+            kolibri_mem_free(allocator, skript->profiler->index);
+            kolibri_mem_free(allocator, skript->profiler->report_path);
+            kolibri_mem_free(allocator, skript->profiler);
+            skript->profiler = NULL;
+        }
+        return 0;
+    }
+    if (!skript->profiler) {
+        skript->profiler =
+            (KolibriScriptProfiler *)kolibri_mem_calloc(&skript->allocator, 1U, sizeof(KolibriScriptProfiler));
+        if (!skript->profiler) {
+            return -1;
+        }
+        skript->profiler->allocator = &skript->allocator;
+    }
+    return 0;
+}
+
+int ks_set_trace_hook(KolibriScript *skript, KolibriScriptTraceHook hook, void *user) {
+    if (!skript || (hook && ks_set_profiler(skript, 1) != 0)) {
+        return -1;
+    }
+    if (skript->profiler) {
+        skript->profiler->trace = hook;
+        skript->profiler->trace_user = hook ? user : NULL;
+    }
+    return 0;
+}
+
+size_t ks_profile_entries(const KolibriScript *skript, const KolibriScriptProfileEntry **entries) {
+    const KolibriScriptProfiler *profiler = skript ? skript->profiler : NULL;
+    if (entries) {
+        *entries = profiler ? profiler->entries : NULL;
+    }
+    return profiler ? profiler->count : 0U;
+}
+
+void ks_profile_reset(KolibriScript *skript) {
+    if (skript && skript->profiler) {
+        kolibri_profile_clear(skript->profiler);
+    }
+}
+
+typedef struct {
+    uint64_t total_ns;
+    size_t entry;
+} KolibriProfileRow;
+
+static int kolibri_profile_compare(const void *lhs, const void *rhs) {
+    const KolibriProfileRow *a = (const KolibriProfileRow *)lhs;
+    const KolibriProfileRow *b = (const KolibriProfileRow *)rhs;
+    if (a->total_ns != b->total_ns) {
+        return a->total_ns > b->total_ns ? -1 : 1;
+    }
+    return a->entry < b->entry ? -1 : 1;
+}
+
+int ks_profile_report(const KolibriScript *skript, FILE *out) {
+    const KolibriScriptProfiler *profiler = skript ? skript->profiler : NULL;
+    if (!profiler || !out) {
+        return -1;
+    }
+    uint64_t *totals = kolibri_profile_totals(profiler);
+    KolibriProfileRow *rows =
+        (KolibriProfileRow *)kolibri_mem_alloc(profiler->allocator, (profiler->count + 1U) * sizeof(KolibriProfileRow));
+    if (!totals || !rows) {
+        kolibri_mem_free(profiler->allocator, totals);
+        kolibri_mem_free(profiler->allocator, rows);
+        return -1;
+    }
+    for (size_t i = 0; i < profiler->count; ++i) {
+        rows[i].total_ns = totals[i];
+        rows[i].entry = i;
+    }
+    kolibri_mem_free(profiler->allocator, totals);
+    qsort(rows, profiler->count, sizeof(KolibriProfileRow), kolibri_profile_compare);
+    fprintf(out, "строка:столбец\tоператор\tвызовы\tвсего_нс\tсвоё_нс\tэволюция_нс\n");
+    for (size_t i = 0; i < profiler->count; ++i) {
+        const KolibriScriptProfileEntry *item = &profiler->entries[rows[i].entry];
+        fprintf(out, "%zu:%zu\t%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n", item->line,
+                item->column, item->kind, item->count, rows[i].total_ns, item->self_ns, item->evolution_ns);
+    }
+    kolibri_mem_free(profiler->allocator, rows);
+    return ferror(out) ? -1 : 0;
+}
+
+int ks_profile_write_collapsed(const KolibriScript *skript, FILE *out) {
+    const KolibriScriptProfiler *profiler = skript ? skript->profiler : NULL;
+    if (!profiler || !out) {
+        return -1;
+    }
+    for (size_t i = 0; i < profiler->count; ++i) {
+        const KolibriScriptProfileEntry *item = &profiler->entries[i];
+        uint64_t own = item->self_ns > item->evolution_ns ? item->self_ns - item->evolution_ns : 0U;
+        if (own > 0U) {
+            kolibri_profile_write_frames(out, profiler, i + 1U);
+            fprintf(out, " %" PRIu64 "\n", own);
+        }
+        if (item->evolution_ns > 0U) {
+            kolibri_profile_write_frames(out, profiler, i + 1U);
+            fprintf(out, ";kf_pool_tick %" PRIu64 "\n", item->evolution_ns);
+        }
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+void ks_program_free(KolibriScriptProgram *program) {
+    if (!program) {
+        return;
+    }
+    KolibriAllocator allocator = program->allocator;
+    kolibri_mem_free(&allocator, program->constants);
+    kolibri_mem_free(&allocator, program->names);
+    kolibri_mem_free(&allocator, program->code);
+    kolibri_mem_free(&allocator, program->sites);
+    kolibri_name_index_free(&program->names_index);
+    kolibri_name_index_free(&program->constants_index);
+    kolibri_arena_free(&program->arena);
+    kolibri_mem_free(&allocator, program);
+}
+
+int ks_program_cache_path(const char *source_path, char *out, size_t out_len) {
+    if (!source_path || !out || out_len == 0) {
+        return -1;
+    }
+    size_t len = strlen(source_path);
+    bool ks_suffix = len >= 3U && strcmp(source_path + len - 3U, ".ks") == 0;
+    int written = snprintf(out, out_len, ks_suffix ? "%sc" : "%s.ksc", source_path);
+    return written > 0 && (size_t)written < out_len ? 0 : -1;
+}
+
+int ks_program_save(const KolibriScriptProgram *program, const char *source_text, const char *path) {
+    if (!program || !source_text || !path) {
+        return -1;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    KolibriKscStream stream = {file, true, NULL};
+    if (fwrite(KOLIBRI_KSC_MAGIC, 1U, 4U, file) != 4U) {
+        stream.ok = false;
+    }
+    kolibri_ksc_put(&stream, KOLIBRI_KSC_VERSION, 4U);
+    kolibri_ksc_put(&stream, strlen(source_text), 8U);
+    kolibri_ksc_put(&stream, kolibri_text_hash(source_text), 8U);
+    kolibri_ksc_put(&stream, program->code_count, 4U);
+    kolibri_ksc_put(&stream, program->constants_count, 4U);
+    kolibri_ksc_put(&stream, program->names_count, 4U);
+    kolibri_ksc_put(&stream, program->loops, 4U);
+    kolibri_ksc_put(&stream, program->sites_count, 4U);
+    for (size_t i = 0; i < program->code_count; ++i) {
+        const KolibriInstruction *insn = &program->code[i];
+        kolibri_ksc_put(&stream, insn->op, 1U);
+        kolibri_ksc_put(&stream, insn->a, 4U);
+        kolibri_ksc_put(&stream, insn->b, 4U);
+        kolibri_ksc_put(&stream, insn->c, 4U);
+        kolibri_ksc_put(&stream, insn->site, 4U);
+    }
+    for (size_t i = 0; i < program->sites_count; ++i) {
+        const KolibriProgramSite *site = &program->sites[i];
+        kolibri_ksc_put(&stream, site->start.line, 4U);
+        kolibri_ksc_put(&stream, site->start.column, 4U);
+        kolibri_ksc_put(&stream, site->parent, 4U);
+        kolibri_ksc_put(&stream, site->kind, 1U);
+    }
+    for (size_t i = 0; i < program->constants_count; ++i) {
+        kolibri_ksc_put_expression(&stream, &program->constants[i]);
+    }
+    for (size_t i = 0; i < program->names_count; ++i) {
+        kolibri_ksc_put_string(&stream, program->names[i]);
+    }
+    if (fclose(file) != 0) {
+        stream.ok = false;
+    }
+    if (!stream.ok) {
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+static KolibriScriptProgram *kolibri_program_load(const char *path, const char *source_text,
+                                                  const KolibriAllocator *allocator) {
+    if (!path || !source_text) {
+        return NULL;
+    }
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    KolibriKscStream stream = {file, true, NULL};
+    char magic[4];
+    if (fread(magic, 1U, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, KOLIBRI_KSC_MAGIC, sizeof(magic)) != 0 ||
+        kolibri_ksc_get(&stream, 4U) != KOLIBRI_KSC_VERSION ||
+        kolibri_ksc_get(&stream, 8U) != strlen(source_text) ||
+        kolibri_ksc_get(&stream, 8U) != kolibri_text_hash(source_text)) {
+        fclose(file);
+        return NULL;
+    }
+    size_t code_count = (size_t)kolibri_ksc_get(&stream, 4U);
+    size_t constants_count = (size_t)kolibri_ksc_get(&stream, 4U);
+    size_t names_count = (size_t)kolibri_ksc_get(&stream, 4U);
+    size_t loops = (size_t)kolibri_ksc_get(&stream, 4U);
+    size_t sites_count = (size_t)kolibri_ksc_get(&stream, 4U);
+    KolibriScriptProgram *program = stream.ok ? kolibri_program_new(allocator) : NULL;
+    if (!stream.ok || !program || loops > code_count || code_count > KOLIBRI_KSC_MAX_STRING ||
+        constants_count > code_count * 2U || names_count > constants_count * 3U + code_count ||
+        sites_count > code_count) {
+        fclose(file);
+        ks_program_free(program);
+        return NULL;
+    }
+    program->code = (KolibriInstruction *)kolibri_mem_calloc(allocator, code_count + 1U, sizeof(KolibriInstruction));
+    program->constants =
+        (KolibriExpression *)kolibri_mem_calloc(allocator, constants_count + 1U, sizeof(KolibriExpression));
+    program->names = (char **)kolibri_mem_calloc(allocator, names_count + 1U, sizeof(char *));
+    program->sites = (KolibriProgramSite *)kolibri_mem_calloc(allocator, sites_count + 1U, sizeof(KolibriProgramSite));
+    program->loops = loops;
+    stream.arena = &program->arena;
+    if (!program->code || !program->constants || !program->names || !program->sites) {
+        stream.ok = false;
+    }
+    for (size_t i = 0; stream.ok && i < code_count; ++i) {
+        KolibriInstruction *insn = &program->code[program->code_count++];
+        insn->op = (uint8_t)kolibri_ksc_get(&stream, 1U);
+        insn->a = (uint32_t)kolibri_ksc_get(&stream, 4U);
+        insn->b = (uint32_t)kolibri_ksc_get(&stream, 4U);
+        insn->c = (uint32_t)kolibri_ksc_get(&stream, 4U);
+        insn->site = (uint32_t)kolibri_ksc_get(&stream, 4U);
+    }
+    for (size_t i = 0; stream.ok && i < sites_count; ++i) {
+        KolibriProgramSite *site = &program->sites[program->sites_count++];
+        site->start.line = (size_t)kolibri_ksc_get(&stream, 4U);
+        site->start.column = (size_t)kolibri_ksc_get(&stream, 4U);
+        site->parent = (uint32_t)kolibri_ksc_get(&stream, 4U);
+        site->kind = (uint8_t)kolibri_ksc_get(&stream, 1U);
+    }
+    for (size_t i = 0; stream.ok && i < constants_count; ++i) {
+        kolibri_ksc_get_expression(&stream, &program->constants[program->constants_count++], names_count, 1);
+    }
+    for (size_t i = 0; stream.ok && i < names_count; ++i) {
+        program->names[program->names_count] = kolibri_ksc_get_string(&stream);
+        if (program->names[program->names_count++] == NULL) {
+            stream.ok = false;
+        }
+    }
+    bool trailing = fgetc(file) != EOF;
+    fclose(file);
+    if (!stream.ok || trailing || !kolibri_ksc_validate(program)) {
+        ks_program_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+KolibriScriptProgram *ks_program_load(const char *path, const char *source_text) {
+    return kolibri_program_load(path, source_text, NULL);
+}
 #include <ctype.h>
 #include <inttypes.h>
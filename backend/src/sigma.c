@@ -1,5 +1,7 @@
 #include "kolibri/sigma.h"
 
+#include "kolibri/alloc.h"
+
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -7,29 +9,85 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(__EMSCRIPTEN__) && !defined(_WIN32)
+#define KOLIBRI_SIGMA_THREADS 1
+#define KOLIBRI_SIGMA_MMAP 1
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define K_SIGMA_DIGITS 10U
-#define K_SIGMA_VERSION 1U
+#define K_SIGMA_VERSION 2U
+#define K_SIGMA_VERSION_V1 1U
 #define K_SIGMA_MAGIC "KSGM"
+#define K_SIGMA_HEADER_SIZE 20U
+/* token_count, syll_count, total_count, blob_size */
+#define K_SIGMA_DIGIT_HEADER_SIZE 20U
+/* offset, length, count, hash and three vote ranks */
+#define K_SIGMA_TOKEN_RECORD_WORDS 7U
+
+#define K_SIGMA_ARENA_CHUNK 4096U
+#define K_SIGMA_VOTE_MODES  3U
+/* Distinct words k_observe gathers before it takes the digit locks. */
+#define K_SIGMA_OBSERVE_BATCH 256U
 
 typedef struct {
-    char    *token;
-    uint32_t count;
+    const char *token; /* interned, NUL-terminated */
+    uint32_t    len;
+    uint32_t    hash;
+    uint32_t    count;
+    float       score[K_SIGMA_VOTE_MODES];
 } KSigmaToken;
 
+/* Token and syllable bytes; freed only with the digit. */
+typedef struct KSigmaChunk {
+    struct KSigmaChunk *next;
+    size_t              used;
+    size_t              size;
+    char                data[];
+} KSigmaChunk;
+
+/*
+ * tokens keeps observation order, which decides ties and the saved layout;
+ * slots is an open-addressing index over it (token index + 1, 0 is empty)
+ * kept at most half full. ranked[mode] lists token indices by descending
+ * score, earlier tokens first on ties, which is the order k_decode takes.
+ */
 typedef struct {
     KSigmaToken *tokens;
     size_t       token_count;
     size_t       token_cap;
+    uint32_t    *slots;
+    size_t       slot_cap;
+    uint32_t    *ranked[K_SIGMA_VOTE_MODES];
 
-    char  **syllables;
-    size_t  syll_count;
-    size_t  syll_cap;
+    const char **syllables;
+    size_t       syll_count;
+    size_t       syll_cap;
 
     uint64_t total_count;
+    KSigmaChunk *arena;
+    const KolibriAllocator *allocator; /* the owning state's */
+#ifdef KOLIBRI_SIGMA_THREADS
+    pthread_rwlock_t lock; /* initialised only in concurrent mode */
+#endif
 } KSigmaDigit;
 
+/*
+ * A read-only state comes from k_state_view or k_state_map: its token and
+ * syllable bytes point into the snapshot, so it can decode and save but not
+ * learn. mapping is the file k_state_map owns.
+ */
 typedef struct {
     KSigmaDigit digits[K_SIGMA_DIGITS];
+    KolibriAllocator allocator;
+    bool        concurrent;
+    bool        read_only;
+    void       *mapping;
+    size_t      mapping_size;
     size_t      init_token_cap;
     size_t      init_syll_cap;
     float       breadth_limit;
@@ -37,33 +95,105 @@ typedef struct {
     int         vote_mode;
 } KSigmaState;
 
+/* Defaults for states created later; decode reads only its own state. */
 static float g_default_breadth = 1.0f;
 static float g_default_depth   = 3.0f;
 static int   g_default_vote    = K_SIGMA_VOTE_RESONANT;
 
-static inline int allowed_emit(float b_used, float d_used, float b_add, float d_add) {
-    return (b_used + b_add <= g_default_breadth + 1e-6f) &&
-           (d_used + d_add <= g_default_depth   + 1e-6f);
+static inline int allowed_emit(const KSigmaState *st, float b_used, float d_used, float b_add, float d_add) {
+    return (b_used + b_add <= st->breadth_limit + 1e-6f) &&
+           (d_used + d_add <= st->depth_limit   + 1e-6f);
+}
+
+static bool sigma_vote_valid(int mode) {
+    return mode == K_SIGMA_VOTE_GREEDY || mode == K_SIGMA_VOTE_RESONANT || mode == K_SIGMA_VOTE_COUNTERFACTUAL;
 }
 
 static void sigma_digit_clear(KSigmaDigit *digit) {
     if (!digit) return;
-    for (size_t i = 0; i < digit->token_count; ++i) {
-        free(digit->tokens[i].token);
-    }
-    free(digit->tokens);
+    const KolibriAllocator *allocator = digit->allocator;
+    kolibri_mem_free(allocator, digit->tokens);
     digit->tokens = NULL;
     digit->token_count = 0U;
     digit->token_cap = 0U;
-
-    for (size_t i = 0; i < digit->syll_count; ++i) {
-        free(digit->syllables[i]);
+    kolibri_mem_free(allocator, digit->slots);
+    digit->slots = NULL;
+    digit->slot_cap = 0U;
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        kolibri_mem_free(allocator, digit->ranked[m]);
+        digit->ranked[m] = NULL;
     }
-    free(digit->syllables);
+
+    kolibri_mem_free(allocator, digit->syllables);
     digit->syllables = NULL;
     digit->syll_count = 0U;
     digit->syll_cap = 0U;
     digit->total_count = 0U;
+
+    KSigmaChunk *chunk = digit->arena;
+    while (chunk) {
+        KSigmaChunk *next = chunk->next;
+        kolibri_mem_free(allocator, chunk);
+        chunk = next;
+    }
+    digit->arena = NULL;
+}
+
+static void sigma_state_clear(KSigmaState *state) {
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        sigma_digit_clear(&state->digits[i]);
+    }
+}
+
+/*
+ * Digit locks are no-ops until k_state_set_concurrent. Writers are observe,
+ * syllable additions and load; decode, save and profile only read.
+ */
+static void sigma_read_lock(const KSigmaState *state, KSigmaDigit *digit) {
+#ifdef KOLIBRI_SIGMA_THREADS
+    if (state->concurrent) pthread_rwlock_rdlock(&digit->lock);
+#else
+    (void)state;
+    (void)digit;
+#endif
+}
+
+static void sigma_write_lock(const KSigmaState *state, KSigmaDigit *digit) {
+#ifdef KOLIBRI_SIGMA_THREADS
+    if (state->concurrent) pthread_rwlock_wrlock(&digit->lock);
+#else
+    (void)state;
+    (void)digit;
+#endif
+}
+
+static void sigma_unlock(const KSigmaState *state, KSigmaDigit *digit) {
+#ifdef KOLIBRI_SIGMA_THREADS
+    if (state->concurrent) pthread_rwlock_unlock(&digit->lock);
+#else
+    (void)state;
+    (void)digit;
+#endif
+}
+
+static const char *sigma_intern(KSigmaDigit *digit, const uint8_t *word, size_t len) {
+    KSigmaChunk *chunk = digit->arena;
+    if (!chunk || chunk->size - chunk->used < len + 1U) {
+        size_t size = chunk ? chunk->size * 2U : K_SIGMA_ARENA_CHUNK;
+        if (size < len + 1U) size = len + 1U;
+        KSigmaChunk *grown = kolibri_mem_alloc(digit->allocator, sizeof(KSigmaChunk) + size);
+        if (!grown) return NULL;
+        grown->next = chunk;
+        grown->used = 0U;
+        grown->size = size;
+        digit->arena = grown;
+        chunk = grown;
+    }
+    char *copy = chunk->data + chunk->used;
+    if (len) memcpy(copy, word, len);
+    copy[len] = '\0';
+    chunk->used += len + 1U;
+    return copy;
 }
 
 static void sigma_state_reset_limits(KSigmaState *st) {
@@ -74,8 +204,18 @@ static void sigma_state_reset_limits(KSigmaState *st) {
 }
 
 uintptr_t k_state_new(uint32_t cap) {
-    KSigmaState *state = calloc(1U, sizeof(KSigmaState));
+    return k_state_new_ex(cap, NULL);
+}
+
+uintptr_t k_state_new_ex(uint32_t cap, const KolibriAllocator *allocator) {
+    KolibriAllocator use;
+    kolibri_allocator_resolve(&use, allocator);
+    KSigmaState *state = kolibri_mem_calloc(&use, 1U, sizeof(KSigmaState));
     if (!state) return (uintptr_t)0U;
+    state->allocator = use;
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        state->digits[i].allocator = &state->allocator;
+    }
     state->init_token_cap = cap ? (size_t)cap : 8U;
     state->init_syll_cap  = 4U;
     sigma_state_reset_limits(state);
@@ -85,10 +225,13 @@ uintptr_t k_state_new(uint32_t cap) {
 void k_state_free(uintptr_t ptr) {
     if (!ptr) return;
     KSigmaState *state = (KSigmaState *)ptr;
-    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        sigma_digit_clear(&state->digits[i]);
-    }
-    free(state);
+    k_state_set_concurrent(ptr, 0);
+    sigma_state_clear(state);
+#ifdef KOLIBRI_SIGMA_MMAP
+    if (state->mapping) munmap(state->mapping, state->mapping_size);
+#endif
+    KolibriAllocator allocator = state->allocator;
+    kolibri_mem_free(&allocator, state);
 }
 
 static uint32_t sigma_hash_word(const uint8_t *word, size_t len) {
@@ -110,12 +253,15 @@ static int sigma_ensure_token_cap(KSigmaState *st, KSigmaDigit *digit, size_t ne
     size_t new_cap = digit->token_cap ? digit->token_cap : st->init_token_cap;
     while (new_cap < need) {
         new_cap = new_cap < (SIZE_MAX / 2U) ? new_cap * 2U : need;
-        if (new_cap == need) break;
-        if (new_cap < need) return -1;
     }
-    KSigmaToken *tokens = realloc(digit->tokens, new_cap * sizeof(KSigmaToken));
+    KSigmaToken *tokens = kolibri_mem_realloc(digit->allocator, digit->tokens, new_cap * sizeof(KSigmaToken));
     if (!tokens) return -1;
     digit->tokens = tokens;
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        uint32_t *ranked = kolibri_mem_realloc(digit->allocator, digit->ranked[m], new_cap * sizeof(uint32_t));
+        if (!ranked) return -1;
+        digit->ranked[m] = ranked;
+    }
     digit->token_cap = new_cap;
     return 0;
 }
@@ -125,74 +271,293 @@ static int sigma_ensure_syll_cap(KSigmaState *st, KSigmaDigit *digit, size_t nee
     size_t new_cap = digit->syll_cap ? digit->syll_cap : st->init_syll_cap;
     while (new_cap < need) {
         new_cap = new_cap < (SIZE_MAX / 2U) ? new_cap * 2U : need;
-        if (new_cap == need) break;
-        if (new_cap < need) return -1;
     }
-    char **syll = realloc(digit->syllables, new_cap * sizeof(char *));
+    const char **syll = kolibri_mem_realloc(digit->allocator, (void *)digit->syllables, new_cap * sizeof(char *));
     if (!syll) return -1;
     digit->syllables = syll;
     digit->syll_cap = new_cap;
     return 0;
 }
 
-static KSigmaToken *sigma_find_token(const KSigmaDigit *digit, const uint8_t *word, size_t len) {
-    for (size_t i = 0; i < digit->token_count; ++i) {
-        const KSigmaToken *tk = &digit->tokens[i];
-        if (strlen(tk->token) == len && memcmp(tk->token, word, len) == 0) {
-            return &((KSigmaDigit *)digit)->tokens[i];
+/* Every hash in a digit has the same residue mod 10, so the digit is
+ * divided out before masking. */
+static inline size_t sigma_slot_home(const KSigmaDigit *digit, uint32_t hash) {
+    return (size_t)(hash / K_SIGMA_DIGITS) & (digit->slot_cap - 1U);
+}
+
+static KSigmaToken *sigma_find_token(const KSigmaDigit *digit, const uint8_t *word, size_t len, uint32_t hash) {
+    if (digit->slot_cap == 0U) return NULL;
+    for (size_t probe = sigma_slot_home(digit, hash); digit->slots[probe] != 0U;
+         probe = (probe + 1U) & (digit->slot_cap - 1U)) {
+        KSigmaToken *tk = &digit->tokens[digit->slots[probe] - 1U];
+        if (tk->hash == hash && tk->len == len && memcmp(tk->token, word, len) == 0) {
+            return tk;
         }
     }
     return NULL;
 }
 
-static char *sigma_copy_word(const uint8_t *word, size_t len) {
-    char *copy = malloc(len + 1U);
+static void sigma_slot_insert(KSigmaDigit *digit, size_t index) {
+    size_t probe = sigma_slot_home(digit, digit->tokens[index].hash);
+    while (digit->slots[probe] != 0U) {
+        probe = (probe + 1U) & (digit->slot_cap - 1U);
+    }
+    digit->slots[probe] = (uint32_t)(index + 1U);
+}
+
+static int sigma_ensure_slots(KSigmaDigit *digit, size_t need) {
+    if (need > UINT32_MAX - 1U) return -1;
+    if (digit->slot_cap >= need * 2U) return 0;
+    size_t cap = digit->slot_cap ? digit->slot_cap : 16U;
+    while (cap < need * 2U) {
+        if (cap > SIZE_MAX / 2U) return -1;
+        cap *= 2U;
+    }
+    uint32_t *slots = kolibri_mem_calloc(digit->allocator, cap, sizeof(uint32_t));
+    if (!slots) return -1;
+    kolibri_mem_free(digit->allocator, digit->slots);
+    digit->slots = slots;
+    digit->slot_cap = cap;
+    for (size_t i = 0; i < digit->token_count; ++i) {
+        sigma_slot_insert(digit, i);
+    }
+    return 0;
+}
+
+static float sigma_token_score(const KSigmaToken *tk, int mode) {
+    if (!tk) return 0.0f;
+    float base = (float)tk->count;
+    size_t len = tk->len;
+    switch (mode) {
+        case K_SIGMA_VOTE_RESONANT:
+            base *= 1.0f + 0.1f * (float)(len > 0U ? len - 1U : 0U);
+            break;
+        case K_SIGMA_VOTE_COUNTERFACTUAL:
+            base *= (tk->count > 1U) ? 0.85f : 1.1f;
+            break;
+        default:
+            break;
+    }
+    return base;
+}
+
+static size_t sigma_vote_slot(int mode) {
+    return (mode >= 0 && (unsigned)mode < K_SIGMA_VOTE_MODES) ? (size_t)mode : K_SIGMA_VOTE_GREEDY;
+}
+
+static void sigma_token_rescore(KSigmaToken *tk) {
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        tk->score[m] = sigma_token_score(tk, (int)m);
+    }
+}
+
+/* First rank in [0, end) not ahead of a token with this score and index. */
+static size_t sigma_rank_bound(const KSigmaDigit *digit, size_t mode, float score, uint32_t index, size_t end) {
+    const uint32_t *ranked = digit->ranked[mode];
+    size_t lo = 0U;
+    while (lo < end) {
+        size_t mid = lo + (end - lo) / 2U;
+        const KSigmaToken *tk = &digit->tokens[ranked[mid]];
+        float other = tk->score[mode];
+        if (other > score || (other == score && ranked[mid] < index)) {
+            lo = mid + 1U;
+        } else {
+            end = mid;
+        }
+    }
+    return lo;
+}
+
+/* Ranks the newest token; it sits after every equal score. */
+static void sigma_rank_insert(KSigmaDigit *digit, uint32_t index) {
+    const KSigmaToken *tk = &digit->tokens[index];
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        uint32_t *ranked = digit->ranked[m];
+        size_t at = sigma_rank_bound(digit, m, tk->score[m], index, index);
+        memmove(ranked + at + 1U, ranked + at, (index - at) * sizeof(uint32_t));
+        ranked[at] = index;
+    }
+}
+
+/* Every score grows with the count, so a counted token only moves ahead. */
+static void sigma_rank_promote(KSigmaDigit *digit, uint32_t index) {
+    KSigmaToken *tk = &digit->tokens[index];
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        uint32_t *ranked = digit->ranked[m];
+        size_t from = sigma_rank_bound(digit, m, tk->score[m], index, digit->token_count);
+        tk->score[m] = sigma_token_score(tk, (int)m);
+        size_t to = sigma_rank_bound(digit, m, tk->score[m], index, from);
+        memmove(ranked + to + 1U, ranked + to, (from - to) * sizeof(uint32_t));
+        ranked[to] = index;
+    }
+}
+
+typedef struct {
+    float    score;
+    uint32_t index;
+} SigmaRankEntry;
+
+static int sigma_rank_compare(const void *a, const void *b) {
+    const SigmaRankEntry *x = a;
+    const SigmaRankEntry *y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static int sigma_rank_rebuild(KSigmaDigit *digit) {
+    if (digit->token_count == 0U) return 0;
+    SigmaRankEntry *entries = kolibri_mem_alloc(digit->allocator, digit->token_count * sizeof(SigmaRankEntry));
+    if (!entries) return -1;
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        for (size_t i = 0; i < digit->token_count; ++i) {
+            entries[i].score = digit->tokens[i].score[m];
+            entries[i].index = (uint32_t)i;
+        }
+        qsort(entries, digit->token_count, sizeof(SigmaRankEntry), sigma_rank_compare);
+        for (size_t i = 0; i < digit->token_count; ++i) {
+            digit->ranked[m][i] = entries[i].index;
+        }
+    }
+    kolibri_mem_free(digit->allocator, entries);
+    return 0;
+}
+
+/* Appends a token the digit does not hold yet; ranking is left to the caller. */
+static KSigmaToken *sigma_add_token(KSigmaState *state, KSigmaDigit *digit, const uint8_t *word, size_t len,
+                                    uint32_t hash, uint32_t count) {
+    if (len > UINT32_MAX) return NULL;
+    if (sigma_ensure_token_cap(state, digit, digit->token_count + 1U) ||
+        sigma_ensure_slots(digit, digit->token_count + 1U)) {
+        return NULL;
+    }
+    const char *copy = sigma_intern(digit, word, len);
     if (!copy) return NULL;
-    memcpy(copy, word, len);
-    copy[len] = '\0';
-    return copy;
+    size_t index = digit->token_count++;
+    KSigmaToken *tk = &digit->tokens[index];
+    tk->token = copy;
+    tk->len = (uint32_t)len;
+    tk->hash = hash;
+    tk->count = count;
+    sigma_token_rescore(tk);
+    sigma_slot_insert(digit, index);
+    return tk;
 }
 
 static bool sigma_is_token_char(unsigned char c) {
     return (c & 0x80U) || isalnum(c) || c == '_' || c == '-' || c == '+';
 }
 
-static int sigma_observe_word(KSigmaState *state, const uint8_t *word, size_t len) {
-    if (!len) return 0;
-    uint32_t hash = sigma_hash_word(word, len);
-    uint8_t digit_idx = sigma_digit_from_hash(hash);
-    KSigmaDigit *digit = &state->digits[digit_idx];
-
-    KSigmaToken *token = sigma_find_token(digit, word, len);
+static int sigma_count_word(KSigmaState *state, KSigmaDigit *digit, const uint8_t *word, size_t len,
+                            uint32_t hash, uint32_t n) {
+    KSigmaToken *token = sigma_find_token(digit, word, len, hash);
     if (token) {
         if (token->count < UINT32_MAX) {
-            token->count += 1U;
+            token->count = n > UINT32_MAX - token->count ? UINT32_MAX : token->count + n;
+            sigma_rank_promote(digit, (uint32_t)(token - digit->tokens));
         }
     } else {
-        if (sigma_ensure_token_cap(state, digit, digit->token_count + 1U)) return -1;
-        char *copy = sigma_copy_word(word, len);
-        if (!copy) return -2;
-        KSigmaToken *tk = &digit->tokens[digit->token_count++];
-        tk->token = copy;
-        tk->count = 1U;
-    }
-    digit->total_count += 1U;
+        if (!sigma_add_token(state, digit, word, len, hash, n)) return -1;
+        sigma_rank_insert(digit, (uint32_t)(digit->token_count - 1U));
+    }
+    digit->total_count += n;
+    return 0;
+}
+
+/*
+ * Words of one k_observe call, merged by text and chained per digit in the
+ * order they first appeared, so a flush leaves the digits exactly as one
+ * word at a time would, while each digit lock is taken once per batch.
+ */
+typedef struct {
+    const uint8_t *word;
+    uint32_t       len;
+    uint32_t       hash;
+    uint32_t       count;
+    uint16_t       next; /* item index + 1 within the digit chain */
+} SigmaPending;
+
+typedef struct {
+    SigmaPending items[K_SIGMA_OBSERVE_BATCH];
+    uint16_t     slots[2U * K_SIGMA_OBSERVE_BATCH]; /* item index + 1 */
+    uint16_t     head[K_SIGMA_DIGITS];
+    uint16_t     tail[K_SIGMA_DIGITS];
+    size_t       count;
+} SigmaBatch;
+
+static int sigma_batch_flush(KSigmaState *state, SigmaBatch *batch) {
+    int rc = 0;
+    for (size_t d = 0; d < K_SIGMA_DIGITS && rc == 0; ++d) {
+        if (batch->head[d] == 0U) continue;
+        KSigmaDigit *digit = &state->digits[d];
+        sigma_write_lock(state, digit);
+        for (uint16_t at = batch->head[d]; at != 0U; at = batch->items[at - 1U].next) {
+            const SigmaPending *item = &batch->items[at - 1U];
+            if (sigma_count_word(state, digit, item->word, item->len, item->hash, item->count)) {
+                rc = -1;
+                break;
+            }
+        }
+        sigma_unlock(state, digit);
+    }
+    memset(batch->slots, 0, sizeof(batch->slots));
+    memset(batch->head, 0, sizeof(batch->head));
+    batch->count = 0U;
+    return rc;
+}
+
+static int sigma_batch_add(KSigmaState *state, SigmaBatch *batch, const uint8_t *word, size_t len) {
+    if (len > UINT32_MAX) return -1;
+    uint32_t hash = sigma_hash_word(word, len);
+    const size_t mask = 2U * K_SIGMA_OBSERVE_BATCH - 1U;
+    size_t probe = hash & mask;
+    while (batch->slots[probe] != 0U) {
+        SigmaPending *item = &batch->items[batch->slots[probe] - 1U];
+        if (item->hash == hash && item->len == len && memcmp(item->word, word, len) == 0) {
+            if (item->count < UINT32_MAX) item->count++;
+            return 0;
+        }
+        probe = (probe + 1U) & mask;
+    }
+    if (batch->count == K_SIGMA_OBSERVE_BATCH) {
+        if (sigma_batch_flush(state, batch)) return -1;
+        probe = hash & mask;
+    }
+    uint16_t index = (uint16_t)batch->count++;
+    SigmaPending *item = &batch->items[index];
+    item->word = word;
+    item->len = (uint32_t)len;
+    item->hash = hash;
+    item->count = 1U;
+    item->next = 0U;
+    batch->slots[probe] = (uint16_t)(index + 1U);
+    uint8_t d = sigma_digit_from_hash(hash);
+    if (batch->head[d] == 0U) {
+        batch->head[d] = (uint16_t)(index + 1U);
+    } else {
+        batch->items[batch->tail[d] - 1U].next = (uint16_t)(index + 1U);
+    }
+    batch->tail[d] = (uint16_t)(index + 1U);
     return 0;
 }
 
 int k_observe(uintptr_t ptr, const uint8_t *in, size_t n) {
     if (!ptr || (!in && n > 0U)) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
+    if (state->read_only) return -3;
+    SigmaBatch batch;
+    memset(batch.slots, 0, sizeof(batch.slots));
+    memset(batch.head, 0, sizeof(batch.head));
+    batch.count = 0U;
     size_t pos = 0U;
     while (pos < n) {
         while (pos < n && !sigma_is_token_char((unsigned char)in[pos])) pos++;
         size_t start = pos;
         while (pos < n && sigma_is_token_char((unsigned char)in[pos])) pos++;
         if (pos > start) {
-            if (sigma_observe_word(state, in + start, pos - start)) return -2;
+            if (sigma_batch_add(state, &batch, in + start, pos - start)) return -2;
         }
     }
-    return 0;
+    return sigma_batch_flush(state, &batch) ? -2 : 0;
 }
 
 static size_t sigma_pick_digit_from_prompt(const uint8_t *in, size_t n, KSigmaState *state, bool *have_digit) {
@@ -221,63 +586,32 @@ static size_t sigma_pick_digit_from_prompt(const uint8_t *in, size_t n, KSigmaSt
     }
     uint64_t best_total = 0U;
     size_t best_digit = 0U;
+    size_t first_syllables = K_SIGMA_DIGITS;
     for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        if (state->digits[i].total_count > best_total) {
-            best_total = state->digits[i].total_count;
+        KSigmaDigit *digit = &state->digits[i];
+        sigma_read_lock(state, digit);
+        if (digit->total_count > best_total) {
+            best_total = digit->total_count;
             best_digit = i;
         }
+        if (first_syllables == K_SIGMA_DIGITS && digit->syll_count > 0U) {
+            first_syllables = i;
+        }
+        sigma_unlock(state, digit);
     }
     if (best_total > 0U) {
         *have_digit = true;
         return best_digit;
     }
-    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        if (state->digits[i].syll_count > 0U) {
-            *have_digit = true;
-            return i;
-        }
+    if (first_syllables < K_SIGMA_DIGITS) {
+        *have_digit = true;
+        return first_syllables;
     }
     return 0U;
 }
 
-static float sigma_token_score(const KSigmaToken *tk, int mode) {
-    if (!tk) return 0.0f;
-    float base = (float)tk->count;
-    size_t len = strlen(tk->token);
-    switch (mode) {
-        case K_SIGMA_VOTE_RESONANT:
-            base *= 1.0f + 0.1f * (float)(len > 0U ? len - 1U : 0U);
-            break;
-        case K_SIGMA_VOTE_COUNTERFACTUAL:
-            base *= (tk->count > 1U) ? 0.85f : 1.1f;
-            break;
-        default:
-            break;
-    }
-    return base;
-}
-
-static KSigmaToken *sigma_select_token(KSigmaDigit *digit, bool *used, int mode) {
-    KSigmaToken *best = NULL;
-    float best_score = 0.0f;
-    for (size_t i = 0; i < digit->token_count; ++i) {
-        if (used[i]) continue;
-        KSigmaToken *candidate = &digit->tokens[i];
-        float score = sigma_token_score(candidate, mode);
-        if (!best || score > best_score) {
-            best = candidate;
-            best_score = score;
-        }
-    }
-    if (!best) return NULL;
-    size_t idx = (size_t)(best - digit->tokens);
-    used[idx] = true;
-    return best;
-}
-
-static int sigma_emit_word(uint8_t *out, size_t cap, size_t *written, const char *word, bool first) {
+static int sigma_emit_word(uint8_t *out, size_t cap, size_t *written, const char *word, size_t len, bool first) {
     size_t w = *written;
-    size_t len = strlen(word);
     if (!first) {
         if (w + 1U >= cap) return -1;
         out[w++] = ' ';
@@ -293,26 +627,10 @@ static int sigma_emit_syllable(uint8_t *out, size_t cap, size_t *written, KSigma
     if (digit->syll_count == 0U) return -1;
     size_t idx = index % digit->syll_count;
     const char *word = digit->syllables[idx];
-    return sigma_emit_word(out, cap, written, word, first);
+    return sigma_emit_word(out, cap, written, word, strlen(word), first);
 }
 
-int k_decode(uintptr_t ptr,
-             const uint8_t *in,
-             size_t n,
-             uint8_t *out,
-             size_t cap,
-             int temp_q8,
-             int topk) {
-    if (!ptr || !out || cap == 0U) return -1;
-    KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
-    bool have_digit = false;
-    size_t digit_idx = sigma_pick_digit_from_prompt(in, n, state, &have_digit);
-    if (!have_digit) {
-        if (cap > 0U) out[0] = '\0';
-        return 0;
-    }
-    KSigmaDigit *digit = &state->digits[digit_idx];
+static int sigma_decode_digit(const KSigmaState *state, KSigmaDigit *digit, uint8_t *out, size_t cap, int topk) {
     int limit = topk > 0 ? topk : 1;
     if (limit > (int)digit->token_count) limit = (int)digit->token_count;
     if (limit <= 0) limit = digit->syll_count > 0 ? 1 : 0;
@@ -322,26 +640,16 @@ int k_decode(uintptr_t ptr,
     size_t written = 0U;
     if (cap > 0U) out[0] = '\0';
 
-    bool *used = NULL;
-    if (digit->token_count > 0U) {
-        used = calloc(digit->token_count, sizeof(bool));
-        if (!used) {
-            if (cap > 0U) out[0] = '\0';
-            return -4;
-        }
-    }
-
+    const uint32_t *ranked = digit->ranked[sigma_vote_slot(state->vote_mode)];
     int produced = 0;
-    for (int step = 0; step < limit; ++step) {
-        KSigmaToken *token = sigma_select_token(digit, used, state->vote_mode);
-        if (!token) break;
+    for (int step = 0; step < limit && (size_t)step < digit->token_count; ++step) {
+        KSigmaToken *token = &digit->tokens[ranked[step]];
         float b_add = 1.0f / (float)(token->count ? token->count : 1U);
         float d_add = 1.0f;
-        if (!allowed_emit(breadth, depth, b_add, d_add)) {
+        if (!allowed_emit(state, breadth, depth, b_add, d_add)) {
             continue;
         }
-        if (sigma_emit_word(out, cap, &written, token->token, produced == 0)) {
-            free(used);
+        if (sigma_emit_word(out, cap, &written, token->token, token->len, produced == 0)) {
             return -2;
         }
         breadth += b_add;
@@ -349,12 +657,10 @@ int k_decode(uintptr_t ptr,
         produced++;
     }
 
-    free(used);
-
     if (produced == 0 && digit->syll_count > 0U) {
         float b_add = 0.5f;
         float d_add = 0.5f;
-        if (allowed_emit(breadth, depth, b_add, d_add)) {
+        if (allowed_emit(state, breadth, depth, b_add, d_add)) {
             if (sigma_emit_syllable(out, cap, &written, digit, 0U, true)) return -3;
             breadth += b_add;
             depth += d_add;
@@ -368,20 +674,52 @@ int k_decode(uintptr_t ptr,
     }
 
     if (cap > written) out[written] = '\0';
+    return (int)written;
+}
+
+int k_decode(uintptr_t ptr,
+             const uint8_t *in,
+             size_t n,
+             uint8_t *out,
+             size_t cap,
+             int temp_q8,
+             int topk) {
+    if (!ptr || !out || cap == 0U) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    bool have_digit = false;
+    size_t digit_idx = sigma_pick_digit_from_prompt(in, n, state, &have_digit);
+    if (!have_digit) {
+        if (cap > 0U) out[0] = '\0';
+        return 0;
+    }
+    KSigmaDigit *digit = &state->digits[digit_idx];
+    sigma_read_lock(state, digit);
+    int rc = sigma_decode_digit(state, digit, out, cap, topk);
+    sigma_unlock(state, digit);
 
     (void)temp_q8; /* температура пока не используется напрямую */
-    return (int)written;
+    return rc;
 }
 
 int k_digit_add_syll(uintptr_t ptr, uint8_t digit_index, const uint8_t *u8, uint16_t len) {
     if (!ptr || digit_index >= K_SIGMA_DIGITS || (!u8 && len > 0U)) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
+    if (state->read_only) return -4;
     KSigmaDigit *digit = &state->digits[digit_index];
-    if (sigma_ensure_syll_cap(state, digit, digit->syll_count + 1U)) return -2;
-    char *copy = sigma_copy_word(u8, len);
-    if (!copy) return -3;
-    digit->syllables[digit->syll_count++] = copy;
-    return 0;
+    int rc = 0;
+    sigma_write_lock(state, digit);
+    if (sigma_ensure_syll_cap(state, digit, digit->syll_count + 1U)) {
+        rc = -2;
+    } else {
+        const char *copy = sigma_intern(digit, u8, len);
+        if (copy) {
+            digit->syllables[digit->syll_count++] = copy;
+        } else {
+            rc = -3;
+        }
+    }
+    sigma_unlock(state, digit);
+    return rc;
 }
 
 typedef struct {
@@ -408,10 +746,90 @@ static int sigma_buf_write_f32(SigmaBuffer *buf, float value) {
     return sigma_buf_write(buf, &value, sizeof(value));
 }
 
+/*
+ * v2 digit layout, native byte order:
+ *   u32 token_count, u32 syll_count, u64 total_count, u32 blob_size
+ *   u32 offset[tokens], length[tokens], count[tokens], hash[tokens]
+ *   u32 rank[K_SIGMA_VOTE_MODES][tokens], syllable_offset[syllables]
+ *   blob: NUL-terminated tokens, then syllables
+ * The strings can be used in place, which is what k_state_view relies on.
+ */
+static uint64_t sigma_digit_blob_size(const KSigmaDigit *digit) {
+    uint64_t blob = 0U;
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        blob += (uint64_t)digit->tokens[t].len + 1U;
+    }
+    for (size_t s = 0; s < digit->syll_count; ++s) {
+        blob += (uint64_t)strlen(digit->syllables[s]) + 1U;
+    }
+    return blob;
+}
+
+static uint64_t sigma_digit_save_size(const KSigmaDigit *digit) {
+    return K_SIGMA_DIGIT_HEADER_SIZE +
+           (uint64_t)digit->token_count * K_SIGMA_TOKEN_RECORD_WORDS * sizeof(uint32_t) +
+           (uint64_t)digit->syll_count * sizeof(uint32_t) + sigma_digit_blob_size(digit);
+}
+
+static int sigma_save_digit(SigmaBuffer *buf, const KSigmaDigit *digit) {
+    uint64_t blob = sigma_digit_blob_size(digit);
+    if (blob > UINT32_MAX || digit->token_count > UINT32_MAX || digit->syll_count > UINT32_MAX) return -3;
+    if (sigma_buf_write_u32(buf, (uint32_t)digit->token_count)) return -2;
+    if (sigma_buf_write_u32(buf, (uint32_t)digit->syll_count)) return -2;
+    uint64_t total = digit->total_count;
+    if (sigma_buf_write(buf, &total, sizeof(total))) return -2;
+    if (sigma_buf_write_u32(buf, (uint32_t)blob)) return -2;
+
+    uint32_t offset = 0U;
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        if (sigma_buf_write_u32(buf, offset)) return -2;
+        offset += digit->tokens[t].len + 1U;
+    }
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        if (sigma_buf_write_u32(buf, digit->tokens[t].len)) return -2;
+    }
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        if (sigma_buf_write_u32(buf, digit->tokens[t].count)) return -2;
+    }
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        if (sigma_buf_write_u32(buf, digit->tokens[t].hash)) return -2;
+    }
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        if (digit->token_count &&
+            sigma_buf_write(buf, digit->ranked[m], digit->token_count * sizeof(uint32_t))) {
+            return -2;
+        }
+    }
+    for (size_t s = 0; s < digit->syll_count; ++s) {
+        if (sigma_buf_write_u32(buf, offset)) return -2;
+        offset += (uint32_t)strlen(digit->syllables[s]) + 1U;
+    }
+
+    for (size_t t = 0; t < digit->token_count; ++t) {
+        if (sigma_buf_write(buf, digit->tokens[t].token, digit->tokens[t].len + 1U)) return -2;
+    }
+    for (size_t s = 0; s < digit->syll_count; ++s) {
+        if (sigma_buf_write(buf, digit->syllables[s], strlen(digit->syllables[s]) + 1U)) return -2;
+    }
+    return 0;
+}
+
+size_t k_state_save_size(uintptr_t ptr) {
+    if (!ptr) return 0U;
+    KSigmaState *state = (KSigmaState *)ptr;
+    uint64_t size = K_SIGMA_HEADER_SIZE;
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        KSigmaDigit *digit = &state->digits[i];
+        sigma_read_lock(state, digit);
+        size += sigma_digit_save_size(digit);
+        sigma_unlock(state, digit);
+    }
+    return size > SIZE_MAX ? 0U : (size_t)size;
+}
+
 int k_state_save(uintptr_t ptr, uint8_t *out, size_t cap) {
     if (!ptr || !out || cap == 0U) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
     SigmaBuffer buf = { .cursor = out, .remaining = cap, .written = 0U };
     if (sigma_buf_write(&buf, K_SIGMA_MAGIC, 4U)) return -2;
     if (sigma_buf_write_u32(&buf, K_SIGMA_VERSION)) return -2;
@@ -421,23 +839,12 @@ int k_state_save(uintptr_t ptr, uint8_t *out, size_t cap) {
 
     for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
         KSigmaDigit *digit = &state->digits[i];
-        if (sigma_buf_write_u32(&buf, (uint32_t)digit->token_count)) return -2;
-        for (size_t t = 0; t < digit->token_count; ++t) {
-            KSigmaToken *tk = &digit->tokens[t];
-            uint32_t len = (uint32_t)strlen(tk->token);
-            if (sigma_buf_write_u32(&buf, len)) return -2;
-            if (sigma_buf_write(&buf, tk->token, len)) return -2;
-            if (sigma_buf_write_u32(&buf, tk->count)) return -2;
-        }
-        if (sigma_buf_write_u32(&buf, (uint32_t)digit->syll_count)) return -2;
-        for (size_t s = 0; s < digit->syll_count; ++s) {
-            uint32_t len = (uint32_t)strlen(digit->syllables[s]);
-            if (sigma_buf_write_u32(&buf, len)) return -2;
-            if (sigma_buf_write(&buf, digit->syllables[s], len)) return -2;
-        }
-        uint64_t total = digit->total_count;
-        if (sigma_buf_write(&buf, &total, sizeof(total))) return -2;
+        sigma_read_lock(state, digit);
+        int rc = sigma_save_digit(&buf, digit);
+        sigma_unlock(state, digit);
+        if (rc) return rc;
     }
+    if (buf.written > INT32_MAX) return -3;
 
     if (buf.remaining > 0U) {
         out[buf.written] = 0U;
@@ -462,81 +869,205 @@ static int sigma_buf_read_f32(SigmaBuffer *buf, float *value) {
     return sigma_buf_read(buf, value, sizeof(float));
 }
 
+static uint32_t sigma_word_at(const uint8_t *words, size_t index) {
+    uint32_t value;
+    memcpy(&value, words + index * sizeof(uint32_t), sizeof(value));
+    return value;
+}
+
+/* Digits of a v2 snapshot; borrow leaves the strings in the caller's bytes. */
+static int sigma_load_digits_v2(KSigmaState *state, SigmaBuffer *in, bool borrow) {
+    SigmaBuffer buf = *in;
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        KSigmaDigit *digit = &state->digits[i];
+        uint32_t token_count = 0U, syll_count = 0U, blob = 0U;
+        uint64_t total = 0U;
+        if (sigma_buf_read_u32(&buf, &token_count)) return -2;
+        if (sigma_buf_read_u32(&buf, &syll_count)) return -2;
+        if (sigma_buf_read(&buf, &total, sizeof(total))) return -2;
+        if (sigma_buf_read_u32(&buf, &blob)) return -2;
+        uint64_t need = (uint64_t)token_count * K_SIGMA_TOKEN_RECORD_WORDS * sizeof(uint32_t) +
+                        (uint64_t)syll_count * sizeof(uint32_t) + blob;
+        if (need > buf.remaining) return -2;
+        const uint8_t *offsets = buf.cursor;
+        const uint8_t *lengths = offsets + (size_t)token_count * sizeof(uint32_t);
+        const uint8_t *counts = lengths + (size_t)token_count * sizeof(uint32_t);
+        const uint8_t *hashes = counts + (size_t)token_count * sizeof(uint32_t);
+        const uint8_t *ranks = hashes + (size_t)token_count * sizeof(uint32_t);
+        const uint8_t *sylls = ranks + (size_t)token_count * K_SIGMA_VOTE_MODES * sizeof(uint32_t);
+        const uint8_t *bytes = sylls + (size_t)syll_count * sizeof(uint32_t);
+        buf.cursor += need;
+        buf.remaining -= need;
+        buf.written += need;
+        /* A NUL at the end bounds every syllable; tokens are checked below. */
+        if ((token_count || syll_count) && (blob == 0U || bytes[blob - 1U] != 0U)) return -2;
+
+        const char *base = (const char *)bytes;
+        if (!borrow && blob > 0U) {
+            base = sigma_intern(digit, bytes, blob);
+            if (!base) return -5;
+        }
+        if (sigma_ensure_token_cap(state, digit, token_count)) return -5;
+        if (!borrow && sigma_ensure_slots(digit, token_count)) return -5;
+        for (uint32_t t = 0U; t < token_count; ++t) {
+            uint32_t offset = sigma_word_at(offsets, t);
+            uint32_t len = sigma_word_at(lengths, t);
+            if (offset >= blob || len >= blob - offset || bytes[offset + len] != 0U) return -2;
+            KSigmaToken *tk = &digit->tokens[t];
+            tk->token = base + offset;
+            tk->len = len;
+            tk->count = sigma_word_at(counts, t);
+            tk->hash = sigma_word_at(hashes, t);
+            sigma_token_rescore(tk);
+            digit->token_count = t + 1U;
+            if (!borrow) sigma_slot_insert(digit, t);
+        }
+        for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+            for (uint32_t t = 0U; t < token_count; ++t) {
+                uint32_t index = sigma_word_at(ranks, (size_t)m * token_count + t);
+                if (index >= token_count) return -2;
+                digit->ranked[m][t] = index;
+            }
+        }
+        if (sigma_ensure_syll_cap(state, digit, syll_count)) return -5;
+        for (uint32_t s = 0U; s < syll_count; ++s) {
+            uint32_t offset = sigma_word_at(sylls, s);
+            if (offset >= blob) return -2;
+            digit->syllables[digit->syll_count++] = base + offset;
+        }
+        digit->total_count = total;
+    }
+    *in = buf;
+    return 0;
+}
+
+static int sigma_load_digits(KSigmaState *state, SigmaBuffer *in);
+
+static int sigma_read_header(SigmaBuffer *buf, uint32_t *version, float *breadth, float *depth, uint32_t *vote) {
+    char magic[4];
+    if (sigma_buf_read(buf, magic, 4U)) return -2;
+    if (memcmp(magic, K_SIGMA_MAGIC, 4U) != 0) return -3;
+    if (sigma_buf_read_u32(buf, version)) return -2;
+    if (*version != K_SIGMA_VERSION && *version != K_SIGMA_VERSION_V1) return -4;
+    if (sigma_buf_read_f32(buf, breadth)) return -2;
+    if (sigma_buf_read_f32(buf, depth)) return -2;
+    if (sigma_buf_read_u32(buf, vote)) return -2;
+    return 0;
+}
+
+static void sigma_apply_header(KSigmaState *state, float breadth, float depth, uint32_t vote) {
+    state->breadth_limit = breadth;
+    state->depth_limit = depth;
+    state->vote_mode = sigma_vote_valid((int)vote) ? (int)vote : K_SIGMA_VOTE_RESONANT;
+}
+
 int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
     if (!ptr || !in || n < 4U) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
+    if (state->read_only) return -6;
     SigmaBuffer buf = { .cursor = (uint8_t *)in, .remaining = n, .written = 0U };
-    char magic[4];
-    if (sigma_buf_read(&buf, magic, 4U)) return -2;
-    if (memcmp(magic, K_SIGMA_MAGIC, 4U) != 0) return -3;
-    uint32_t version = 0U;
-    if (sigma_buf_read_u32(&buf, &version)) return -2;
-    if (version != K_SIGMA_VERSION) return -4;
+    uint32_t version = 0U, vote = 0U;
     float breadth = 0.0f, depth = 0.0f;
-    uint32_t vote = 0U;
-    if (sigma_buf_read_f32(&buf, &breadth)) return -2;
-    if (sigma_buf_read_f32(&buf, &depth)) return -2;
-    if (sigma_buf_read_u32(&buf, &vote)) return -2;
+    int rc = sigma_read_header(&buf, &version, &breadth, &depth, &vote);
+    if (rc) return rc;
 
     for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        sigma_digit_clear(&state->digits[i]);
+        sigma_write_lock(state, &state->digits[i]);
     }
+    sigma_state_clear(state);
+    sigma_apply_header(state, breadth, depth, vote);
 
-    state->breadth_limit = breadth;
-    state->depth_limit = depth;
-    state->vote_mode = (int)vote;
-    g_default_breadth = breadth;
-    g_default_depth = depth;
-    g_default_vote = (int)vote;
+    rc = version == K_SIGMA_VERSION_V1 ? sigma_load_digits(state, &buf)
+                                       : sigma_load_digits_v2(state, &buf, false);
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        sigma_unlock(state, &state->digits[i]);
+    }
+    return rc;
+}
+
+uintptr_t k_state_view(const uint8_t *in, size_t n) {
+    if (!in) return (uintptr_t)0U;
+    SigmaBuffer buf = { .cursor = (uint8_t *)in, .remaining = n, .written = 0U };
+    uint32_t version = 0U, vote = 0U;
+    float breadth = 0.0f, depth = 0.0f;
+    if (sigma_read_header(&buf, &version, &breadth, &depth, &vote) || version != K_SIGMA_VERSION) {
+        return (uintptr_t)0U;
+    }
+    uintptr_t ptr = k_state_new(0);
+    if (!ptr) return (uintptr_t)0U;
+    KSigmaState *state = (KSigmaState *)ptr;
+    sigma_apply_header(state, breadth, depth, vote);
+    state->read_only = true;
+    if (sigma_load_digits_v2(state, &buf, true)) {
+        k_state_free(ptr);
+        return (uintptr_t)0U;
+    }
+    return ptr;
+}
+
+uintptr_t k_state_map(const char *path) {
+#ifdef KOLIBRI_SIGMA_MMAP
+    if (!path) return (uintptr_t)0U;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return (uintptr_t)0U;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return (uintptr_t)0U;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return (uintptr_t)0U;
+    uintptr_t ptr = k_state_view(mapping, size);
+    if (!ptr) {
+        munmap(mapping, size);
+        return (uintptr_t)0U;
+    }
+    KSigmaState *state = (KSigmaState *)ptr;
+    state->mapping = mapping;
+    state->mapping_size = size;
+    return ptr;
+#else
+    (void)path;
+    return (uintptr_t)0U;
+#endif
+}
 
+static int sigma_load_digits(KSigmaState *state, SigmaBuffer *in) {
+    SigmaBuffer buf = *in;
     for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
         KSigmaDigit *digit = &state->digits[i];
         uint32_t token_count = 0U;
         if (sigma_buf_read_u32(&buf, &token_count)) return -2;
-        if (sigma_ensure_token_cap(state, digit, token_count)) return -5;
+        if (token_count > buf.remaining / (2U * sizeof(uint32_t))) return -2;
+        if (sigma_ensure_token_cap(state, digit, token_count) || sigma_ensure_slots(digit, token_count)) return -5;
         for (uint32_t t = 0U; t < token_count; ++t) {
             uint32_t len = 0U;
             if (sigma_buf_read_u32(&buf, &len)) return -2;
-            size_t alloc = len ? (size_t)len : 1U;
-            uint8_t *tmp = malloc(alloc);
-            if (!tmp) return -5;
-            if (sigma_buf_read(&buf, tmp, len)) {
-                free(tmp);
-                return -2;
-            }
-            if (sigma_ensure_token_cap(state, digit, digit->token_count + 1U)) {
-                free(tmp);
-                return -5;
-            }
-            char *copy = sigma_copy_word(tmp, len);
-            free(tmp);
-            if (!copy) return -5;
+            if (len > buf.remaining) return -2;
+            const uint8_t *word = buf.cursor;
+            buf.cursor += len;
+            buf.remaining -= len;
+            buf.written += len;
             uint32_t count = 0U;
-            if (sigma_buf_read_u32(&buf, &count)) {
-                free(copy);
-                return -2;
-            }
-            KSigmaToken *tk = &digit->tokens[digit->token_count++];
-            tk->token = copy;
-            tk->count = count;
+            if (sigma_buf_read_u32(&buf, &count)) return -2;
+            if (!sigma_add_token(state, digit, word, len, sigma_hash_word(word, len), count)) return -5;
             digit->total_count += count;
         }
+        if (sigma_rank_rebuild(digit)) return -5;
         uint32_t syll_count = 0U;
         if (sigma_buf_read_u32(&buf, &syll_count)) return -2;
         if (sigma_ensure_syll_cap(state, digit, syll_count)) return -5;
         for (uint32_t s = 0U; s < syll_count; ++s) {
             uint32_t len = 0U;
             if (sigma_buf_read_u32(&buf, &len)) return -2;
-            size_t alloc = len ? (size_t)len : 1U;
-            uint8_t *tmp = malloc(alloc);
-            if (!tmp) return -5;
-            if (sigma_buf_read(&buf, tmp, len)) {
-                free(tmp);
-                return -2;
-            }
-            char *copy = sigma_copy_word(tmp, len);
-            free(tmp);
+            if (len > buf.remaining) return -2;
+            const char *copy = sigma_intern(digit, buf.cursor, len);
             if (!copy) return -5;
+            buf.cursor += len;
+            buf.remaining -= len;
+            buf.written += len;
             digit->syllables[digit->syll_count++] = copy;
         }
         uint64_t total = 0U;
@@ -550,21 +1081,18 @@ int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
 int k_profile(uintptr_t ptr, uint32_t what, uint8_t *out, size_t cap) {
     if (!ptr || !out || cap == 0U) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
     if (what != K_SIGMA_PROFILE_DIGITS) return -2;
+    size_t tokens[K_SIGMA_DIGITS];
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        sigma_read_lock(state, &state->digits[i]);
+        tokens[i] = state->digits[i].token_count;
+        sigma_unlock(state, &state->digits[i]);
+    }
     size_t written = 0U;
     int rc = snprintf((char *)out, cap,
                       "{\"digits\":[%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu],\"breadth\":%.3f,\"depth\":%.3f,\"mode\":%d}",
-                      state->digits[0].token_count,
-                      state->digits[1].token_count,
-                      state->digits[2].token_count,
-                      state->digits[3].token_count,
-                      state->digits[4].token_count,
-                      state->digits[5].token_count,
-                      state->digits[6].token_count,
-                      state->digits[7].token_count,
-                      state->digits[8].token_count,
-                      state->digits[9].token_count,
+                      tokens[0], tokens[1], tokens[2], tokens[3], tokens[4],
+                      tokens[5], tokens[6], tokens[7], tokens[8], tokens[9],
                       state->breadth_limit,
                       state->depth_limit,
                       state->vote_mode);
@@ -583,8 +1111,49 @@ int k_set_constraints(float breadth, float depth) {
 
 int k_vote_mode(int mode) {
     int prev = g_default_vote;
-    if (mode == K_SIGMA_VOTE_GREEDY || mode == K_SIGMA_VOTE_RESONANT || mode == K_SIGMA_VOTE_COUNTERFACTUAL) {
+    if (sigma_vote_valid(mode)) {
         g_default_vote = mode;
     }
     return prev;
 }
+
+int k_state_set_constraints(uintptr_t ptr, float breadth, float depth) {
+    if (!ptr || !(breadth > 0.0f) || !(depth > 0.0f)) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    state->breadth_limit = breadth;
+    state->depth_limit = depth;
+    return 0;
+}
+
+int k_state_set_concurrent(uintptr_t ptr, int enabled) {
+    if (!ptr) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    bool want = enabled != 0;
+    if (state->concurrent == want) return 0;
+#ifdef KOLIBRI_SIGMA_THREADS
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        if (want) {
+            if (pthread_rwlock_init(&state->digits[i].lock, NULL) != 0) {
+                while (i-- > 0U) pthread_rwlock_destroy(&state->digits[i].lock);
+                return -1;
+            }
+        } else {
+            pthread_rwlock_destroy(&state->digits[i].lock);
+        }
+    }
+    state->concurrent = want;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int k_state_vote_mode(uintptr_t ptr, int mode) {
+    if (!ptr) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    int prev = state->vote_mode;
+    if (sigma_vote_valid(mode)) {
+        state->vote_mode = mode;
+    }
+    return prev;
+}
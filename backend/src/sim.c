@@ -1,73 +1,261 @@
 #include "kolibri/sim.h"
 
+#include "kolibri/alloc.h"
 #include "kolibri/formula.h"
+#include "kolibri/genome.h"
 #include "kolibri/random.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #define KOLIBRI_SIM_LOG_CAPACITY 512
+#define KOLIBRI_SIM_LOG_TIP_MAX 16
+#define KOLIBRI_SIM_LOG_MESSAGE_MAX 128
 #define KOLIBRI_SIM_POP_SIZE 24
+#define KOLIBRI_SIM_GENOME_CAPACITY 64
+#define KOLIBRI_SIM_TRACE_BUFFER (64U * 1024U)
+#define KOLIBRI_SIM_TRACE_LINE 1024
+#define KOLIBRI_SIM_TRACE_FLUSH_MS 200
 
+/* Entries are stored inline, longer text is cut; the ring never allocates. */
 typedef struct {
-    char *tip;
-    char *soobshenie;
+    char tip[KOLIBRI_SIM_LOG_TIP_MAX];
+    char soobshenie[KOLIBRI_SIM_LOG_MESSAGE_MAX];
     double metka;
 } LogItem;
 
+/* The newest appended blocks, rendered once for kolibri_sim_get_genome. */
+typedef struct {
+    uint32_t index;
+    char pred_hash[KOLIBRI_HASH_SIZE * 2 + 1];
+    char payload_dec[KOLIBRI_PAYLOAD_SIZE + 1];
+    char hmac_dec[KOLIBRI_HASH_SIZE * 3 + 1];
+    char result_hash[KOLIBRI_HASH_SIZE * 2 + 1];
+} GenomeItem;
+
+/*
+ * JSON Lines trace. The tick loop only copies lines into the front buffer;
+ * the writer thread swaps it with the back buffer and writes that out, so
+ * the tick waits on the disk only when a whole buffer is still pending.
+ */
+typedef struct {
+    FILE *file;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t space;
+    char *front;
+    char *back;
+    size_t front_len;
+    int stop;
+    int failed;
+    const KolibriAllocator *allocator; /* the owning sim's */
+} SimTrace;
+
 struct KolibriSim {
     KolibriSimConfig config;
+    KolibriAllocator allocator; /* fixed at create; reset keeps it */
     KolibriRng rng;
     KolibriFormulaPool pool;
     LogItem logs[KOLIBRI_SIM_LOG_CAPACITY];
     size_t log_head;
     size_t log_count;
     size_t log_offset;
+    SimTrace *trace;
+    KolibriGenome genome;
+    int genome_open;
+    GenomeItem blocks[KOLIBRI_SIM_GENOME_CAPACITY];
+    size_t block_head;
+    size_t block_count;
+    uint64_t ticks;
 };
 
-static void log_item_free(LogItem *item) {
-    free(item->tip);
-    free(item->soobshenie);
-    item->tip = NULL;
-    item->soobshenie = NULL;
+static void *trace_main(void *arg) {
+    SimTrace *trace = (SimTrace *)arg;
+    pthread_mutex_lock(&trace->lock);
+    for (;;) {
+        if (trace->front_len < KOLIBRI_SIM_TRACE_BUFFER / 2U && !trace->stop) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += KOLIBRI_SIM_TRACE_FLUSH_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec += 1;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&trace->wake, &trace->lock, &until);
+        }
+        if (trace->front_len == 0U) {
+            if (trace->stop) {
+                break;
+            }
+            continue;
+        }
+        char *chunk = trace->front;
+        size_t len = trace->front_len;
+        trace->front = trace->back;
+        trace->back = chunk;
+        trace->front_len = 0U;
+        pthread_cond_broadcast(&trace->space);
+        pthread_mutex_unlock(&trace->lock);
+        int failed = fwrite(chunk, 1, len, trace->file) != len || fflush(trace->file) != 0;
+        pthread_mutex_lock(&trace->lock);
+        if (failed) {
+            trace->failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&trace->lock);
+    return NULL;
+}
+
+static void trace_free(SimTrace *trace) {
+    if (trace->file) {
+        fclose(trace->file);
+    }
+    pthread_cond_destroy(&trace->space);
+    pthread_cond_destroy(&trace->wake);
+    pthread_mutex_destroy(&trace->lock);
+    kolibri_mem_free(trace->allocator, trace->front);
+    kolibri_mem_free(trace->allocator, trace->back);
+    kolibri_mem_free(trace->allocator, trace);
 }
 
-static char *kolibri_sim_strdup(const char *text) {
-    if (!text) {
+static SimTrace *trace_open(const char *path, const KolibriAllocator *allocator) {
+    SimTrace *trace = (SimTrace *)kolibri_mem_calloc(allocator, 1, sizeof(SimTrace));
+    if (!trace) {
         return NULL;
     }
-    size_t len = strlen(text);
-    char *copy = (char *)malloc(len + 1U);
-    if (!copy) {
+    trace->allocator = allocator;
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->wake, NULL);
+    pthread_cond_init(&trace->space, NULL);
+    trace->front = (char *)kolibri_mem_alloc(allocator, KOLIBRI_SIM_TRACE_BUFFER);
+    trace->back = (char *)kolibri_mem_alloc(allocator, KOLIBRI_SIM_TRACE_BUFFER);
+    trace->file = fopen(path, "a");
+    if (!trace->front || !trace->back || !trace->file ||
+        pthread_create(&trace->thread, NULL, trace_main, trace) != 0) {
+        trace_free(trace);
         return NULL;
     }
-    memcpy(copy, text, len + 1U);
-    return copy;
+    return trace;
+}
+
+/* Writes out everything queued so far; 0 when no write has failed. */
+static int trace_close(SimTrace *trace) {
+    if (!trace) {
+        return 0;
+    }
+    pthread_mutex_lock(&trace->lock);
+    trace->stop = 1;
+    pthread_cond_signal(&trace->wake);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+    int failed = trace->failed;
+    trace_free(trace);
+    return failed ? -1 : 0;
+}
+
+static void trace_emit(SimTrace *trace, const char *line, size_t len) {
+    if (!trace || len == 0U || len > KOLIBRI_SIM_TRACE_BUFFER) {
+        return;
+    }
+    pthread_mutex_lock(&trace->lock);
+    while (trace->front_len + len > KOLIBRI_SIM_TRACE_BUFFER) {
+        pthread_cond_signal(&trace->wake);
+        pthread_cond_wait(&trace->space, &trace->lock);
+    }
+    memcpy(trace->front + trace->front_len, line, len);
+    trace->front_len += len;
+    if (trace->front_len >= KOLIBRI_SIM_TRACE_BUFFER / 2U) {
+        pthread_cond_signal(&trace->wake);
+    }
+    pthread_mutex_unlock(&trace->lock);
+}
+
+/* One JSON Lines record; text that does not fit is cut. */
+typedef struct {
+    char data[KOLIBRI_SIM_TRACE_LINE];
+    size_t len;
+} TraceLine;
+
+static void line_raw(TraceLine *line, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(line->data + line->len, sizeof(line->data) - line->len, format, args);
+    va_end(args);
+    if (written > 0) {
+        line->len += (size_t)written;
+        if (line->len >= sizeof(line->data)) {
+            line->len = sizeof(line->data) - 1U;
+        }
+    }
+}
+
+static void line_string(TraceLine *line, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    line_raw(line, "\"");
+    for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
+        if (line->len + 8U >= sizeof(line->data)) {
+            break;
+        }
+        char *out = line->data + line->len;
+        if (*c == '"' || *c == '\\') {
+            out[0] = '\\';
+            out[1] = (char)*c;
+            line->len += 2U;
+        } else if (*c < 0x20U) {
+            memcpy(out, "\\u00", 4U);
+            out[4] = hex[*c >> 4];
+            out[5] = hex[*c & 0x0FU];
+            line->len += 6U;
+        } else {
+            out[0] = (char)*c;
+            line->len += 1U;
+        }
+    }
+    line_raw(line, "\"");
+}
+
+static void line_emit(SimTrace *trace, TraceLine *line) {
+    line_raw(line, "}\n");
+    trace_emit(trace, line->data, line->len);
+}
+
+static void log_copy(char *dst, size_t capacity, const char *text) {
+    size_t len = text ? strnlen(text, capacity - 1U) : 0U;
+    memcpy(dst, text ? text : "", len);
+    dst[len] = '\0';
 }
 
 static void log_push(KolibriSim *sim, const char *tip, const char *message) {
     size_t index = (sim->log_head + sim->log_count) % KOLIBRI_SIM_LOG_CAPACITY;
     if (sim->log_count == KOLIBRI_SIM_LOG_CAPACITY) {
-        log_item_free(&sim->logs[sim->log_head]);
         sim->log_head = (sim->log_head + 1U) % KOLIBRI_SIM_LOG_CAPACITY;
         sim->log_offset += 1U;
         sim->log_count -= 1U;
     }
     LogItem *item = &sim->logs[index];
-    item->tip = kolibri_sim_strdup(tip);
-    item->soobshenie = kolibri_sim_strdup(message);
+    log_copy(item->tip, sizeof(item->tip), tip);
+    log_copy(item->soobshenie, sizeof(item->soobshenie), message);
     item->metka = (double)time(NULL);
     sim->log_count += 1U;
+    if (sim->trace) {
+        TraceLine line = {{0}, 0U};
+        line_raw(&line, "{\"tip\":");
+        line_string(&line, item->tip);
+        line_raw(&line, ",\"soobshenie\":");
+        line_string(&line, item->soobshenie);
+        line_raw(&line, ",\"metka\":%.6f", item->metka);
+        line_emit(sim->trace, &line);
+    }
 }
 
 static void sim_reset_logs(KolibriSim *sim) {
-    for (size_t i = 0; i < sim->log_count; ++i) {
-        size_t index = (sim->log_head + i) % KOLIBRI_SIM_LOG_CAPACITY;
-        log_item_free(&sim->logs[index]);
-    }
     sim->log_head = 0U;
     sim->log_count = 0U;
     sim->log_offset = 0U;
@@ -83,28 +271,141 @@ static void sim_init_pool(KolibriSim *sim) {
     }
 }
 
-static KolibriSim *kolibri_sim_alloc(void) {
-    KolibriSim *sim = (KolibriSim *)calloc(1, sizeof(KolibriSim));
+static void render_digits(const unsigned char *bytes, size_t len, char *out) {
+    for (size_t i = 0; i < len; ++i) {
+        out[i * 3U] = (char)('0' + bytes[i] / 100U);
+        out[i * 3U + 1U] = (char)('0' + bytes[i] / 10U % 10U);
+        out[i * 3U + 2U] = (char)('0' + bytes[i] % 10U);
+    }
+    out[len * 3U] = '\0';
+}
+
+static void render_hex(const unsigned char *bytes, size_t len, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; ++i) {
+        out[i * 2U] = hex[bytes[i] >> 4];
+        out[i * 2U + 1U] = hex[bytes[i] & 0x0FU];
+    }
+    out[len * 2U] = '\0';
+}
+
+/* Flushing every block would cost a syscall per tick, so appends are synced in groups. */
+static const KolibriGenomeSyncPolicy sim_genome_sync = {KG_SYNC_FLUSH, 64U, 1000U};
+
+static void sim_close_outputs(KolibriSim *sim) {
+    if (sim->genome_open) {
+        kg_sync(&sim->genome);
+        kg_close(&sim->genome);
+        sim->genome_open = 0;
+    }
+    trace_close(sim->trace);
+    sim->trace = NULL;
+    sim->block_head = 0U;
+    sim->block_count = 0U;
+}
+
+static int sim_open_outputs(KolibriSim *sim) {
+    const KolibriSimConfig *config = &sim->config;
+    if (config->genome_path && config->genome_path[0]) {
+        const char *key = config->hmac_key ? config->hmac_key : "";
+        if (kg_open(&sim->genome, config->genome_path, (const unsigned char *)key, strlen(key)) != 0) {
+            return -1;
+        }
+        sim->genome_open = 1;
+        kg_set_sync_policy(&sim->genome, &sim_genome_sync);
+    }
+    if (config->trace_path && config->trace_path[0]) {
+        sim->trace = trace_open(config->trace_path, &sim->allocator);
+        if (!sim->trace) {
+            sim_close_outputs(sim);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void sim_record_block(KolibriSim *sim, const ReasonBlock *block) {
+    size_t index = (sim->block_head + sim->block_count) % KOLIBRI_SIM_GENOME_CAPACITY;
+    if (sim->block_count == KOLIBRI_SIM_GENOME_CAPACITY) {
+        sim->block_head = (sim->block_head + 1U) % KOLIBRI_SIM_GENOME_CAPACITY;
+    } else {
+        sim->block_count += 1U;
+    }
+    GenomeItem *item = &sim->blocks[index];
+    item->index = (uint32_t)block->index;
+    render_hex(block->prev_hash, KOLIBRI_HASH_SIZE, item->pred_hash);
+    log_copy(item->payload_dec, sizeof(item->payload_dec), block->payload);
+    render_digits(block->hmac, KOLIBRI_HASH_SIZE, item->hmac_dec);
+    render_hex(sim->genome.chain_hash, KOLIBRI_HASH_SIZE, item->result_hash);
+    if (sim->trace && sim->config.trace_include_genome) {
+        TraceLine line = {{0}, 0U};
+        line_raw(&line, "{\"tip\":\"genome\",\"index\":%u,\"pred_hash\":\"%s\",", item->index,
+                 item->pred_hash);
+        line_raw(&line, "\"payload_dec\":\"%s\",\"hmac_dec\":\"%s\",\"result_hash\":\"%s\"",
+                 item->payload_dec, item->hmac_dec, item->result_hash);
+        line_emit(sim->trace, &line);
+    }
+}
+
+static void sim_append_genome(KolibriSim *sim, const char *description) {
+    if (!sim->genome_open) {
+        return;
+    }
+    /* The payload holds three digits per byte, so long descriptions are cut
+     * at a character boundary. */
+    char text[(KOLIBRI_PAYLOAD_SIZE - 1) / 3 + 1];
+    log_copy(text, sizeof(text), description);
+    size_t len = strlen(text);
+    while (len > 0U && description[len] != '\0' && ((unsigned char)description[len] & 0xC0U) == 0x80U) {
+        text[--len] = '\0';
+    }
+    char payload[KOLIBRI_PAYLOAD_SIZE];
+    ReasonBlock block;
+    if (kg_encode_payload(text, payload, sizeof(payload)) < 0 ||
+        kg_append(&sim->genome, "SIM_TICK", payload, &block) != 0) {
+        log_push(sim, "genome", "append failed");
+        return;
+    }
+    sim_record_block(sim, &block);
+}
+
+static KolibriSim *kolibri_sim_alloc(const KolibriAllocator *allocator) {
+    KolibriAllocator use;
+    kolibri_allocator_resolve(&use, allocator);
+    KolibriSim *sim = (KolibriSim *)kolibri_mem_calloc(&use, 1, sizeof(KolibriSim));
+    if (sim) {
+        sim->allocator = use;
+    }
     return sim;
 }
 
+static void kolibri_sim_release(KolibriSim *sim) {
+    KolibriAllocator allocator = sim->allocator;
+    kolibri_mem_free(&allocator, sim);
+}
+
 static void kolibri_sim_free(KolibriSim *sim) {
     if (!sim) {
         return;
     }
+    sim_close_outputs(sim);
     sim_reset_logs(sim);
-    free(sim);
+    kolibri_sim_release(sim);
 }
 
 KolibriSim *kolibri_sim_create(const KolibriSimConfig *config) {
     if (!config) {
         return NULL;
     }
-    KolibriSim *sim = kolibri_sim_alloc();
+    KolibriSim *sim = kolibri_sim_alloc(config->allocator);
     if (!sim) {
         return NULL;
     }
     sim->config = *config;
+    if (sim_open_outputs(sim) != 0) {
+        kolibri_sim_release(sim);
+        return NULL;
+    }
     k_rng_seed(&sim->rng, (uint64_t)config->seed);
     sim_init_pool(sim);
     log_push(sim, "init", "KolibriSim initialized");
@@ -119,8 +420,13 @@ int kolibri_sim_reset(KolibriSim *sim, const KolibriSimConfig *config) {
     if (!sim || !config) {
         return -1;
     }
+    sim_close_outputs(sim);
     sim_reset_logs(sim);
     sim->config = *config;
+    sim->ticks = 0U;
+    if (sim_open_outputs(sim) != 0) {
+        return -1;
+    }
     k_rng_seed(&sim->rng, (uint64_t)config->seed);
     sim_init_pool(sim);
     log_push(sim, "reset", "KolibriSim reset");
@@ -137,14 +443,24 @@ int kolibri_sim_tick(KolibriSim *sim) {
         log_push(sim, "pool", "empty");
         return 0;
     }
+    sim->ticks += 1U;
     char description[128];
     if (kf_formula_describe(best, description, sizeof(description)) == 0) {
         log_push(sim, "best", description);
+        sim_append_genome(sim, description);
+    }
+    if (sim->trace) {
+        TraceLine line = {{0}, 0U};
+        line_raw(&line, "{\"tip\":\"tick\",\"tick\":%llu,\"fitness\":%.6f,\"evaluations\":%llu",
+                 (unsigned long long)sim->ticks, best->fitness,
+                 (unsigned long long)sim->pool.profile.evaluation_calls);
+        line_emit(sim->trace, &line);
     }
     return 0;
 }
 
 int kolibri_sim_get_logs(KolibriSim *sim,
+                         size_t since_offset,
                          KolibriSimLog *buffer,
                          size_t capacity,
                          size_t *out_count,
@@ -152,15 +468,17 @@ int kolibri_sim_get_logs(KolibriSim *sim,
     if (!sim || !buffer || !out_count || !out_offset) {
         return -1;
     }
-    size_t count = sim->log_count < capacity ? sim->log_count : capacity;
+    size_t first = since_offset > sim->log_offset ? since_offset - sim->log_offset : 0U;
+    size_t available = first < sim->log_count ? sim->log_count - first : 0U;
+    size_t count = available < capacity ? available : capacity;
     for (size_t i = 0; i < count; ++i) {
-        size_t index = (sim->log_head + i) % KOLIBRI_SIM_LOG_CAPACITY;
+        size_t index = (sim->log_head + first + i) % KOLIBRI_SIM_LOG_CAPACITY;
         buffer[i].tip = sim->logs[index].tip;
         buffer[i].soobshenie = sim->logs[index].soobshenie;
         buffer[i].metka = sim->logs[index].metka;
     }
     *out_count = count;
-    *out_offset = sim->log_offset;
+    *out_offset = sim->log_offset + first;
     return 0;
 }
 
@@ -193,8 +511,211 @@ int kolibri_sim_get_genome(KolibriSim *sim,
     if (!sim || !buffer || !out_count) {
         return -1;
     }
-    (void)sim;
-    (void)buffer;
-    *out_count = 0U;
+    size_t count = sim->block_count < capacity ? sim->block_count : capacity;
+    size_t first = sim->block_count - count;
+    for (size_t i = 0; i < count; ++i) {
+        const GenomeItem *item = &sim->blocks[(sim->block_head + first + i) % KOLIBRI_SIM_GENOME_CAPACITY];
+        buffer[i].index = item->index;
+        buffer[i].pred_hash = item->pred_hash;
+        buffer[i].payload_dec = item->payload_dec;
+        buffer[i].hmac_dec = item->hmac_dec;
+        buffer[i].result_hash = item->result_hash;
+    }
+    *out_count = count;
     return 0;
 }
+
+int kolibri_sim_get_profile_json(KolibriSim *sim, char *buffer, size_t capacity) {
+    if (!sim || !buffer) {
+        return -1;
+    }
+    return kf_pool_profile_json(kf_pool_profile(&sim->pool), buffer, capacity) < 0 ? -1 : 0;
+}
+
+uint64_t kolibri_sim_evaluations(const KolibriSim *sim) {
+    return sim ? sim->pool.profile.evaluation_calls : 0U;
+}
+
+/* Workers live as long as the batch and take simulations one at a time. */
+struct KolibriSimBatch {
+    KolibriSim **sims;
+    size_t count;
+    pthread_t *workers;
+    size_t worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint64_t round;
+    size_t next;
+    size_t pending;
+    uint64_t *tick_ns;
+    int failed;
+    int stop;
+    KolibriAllocator allocator;
+};
+
+static uint64_t sim_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void batch_drain(KolibriSimBatch *batch) {
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        size_t index = batch->next;
+        if (index < batch->count) {
+            batch->next++;
+        }
+        uint64_t *tick_ns = batch->tick_ns;
+        pthread_mutex_unlock(&batch->lock);
+        if (index >= batch->count) {
+            return;
+        }
+        uint64_t started = sim_monotonic_ns();
+        int status = kolibri_sim_tick(batch->sims[index]);
+        if (tick_ns) {
+            tick_ns[index] = sim_monotonic_ns() - started;
+        }
+        pthread_mutex_lock(&batch->lock);
+        if (status != 0) {
+            batch->failed = 1;
+        }
+        if (--batch->pending == 0U) {
+            pthread_cond_signal(&batch->done);
+        }
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+static void *batch_worker_main(void *arg) {
+    KolibriSimBatch *batch = (KolibriSimBatch *)arg;
+    uint64_t seen = 0ULL;
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        while (!batch->stop && batch->round == seen) {
+            pthread_cond_wait(&batch->wake, &batch->lock);
+        }
+        if (batch->stop) {
+            pthread_mutex_unlock(&batch->lock);
+            return NULL;
+        }
+        seen = batch->round;
+        pthread_mutex_unlock(&batch->lock);
+        batch_drain(batch);
+    }
+}
+
+KolibriSimBatch *kolibri_sim_batch_create(const KolibriSimConfig *config, size_t count, size_t threads) {
+    if (!config || count == 0U) {
+        return NULL;
+    }
+    KolibriAllocator allocator;
+    kolibri_allocator_resolve(&allocator, config->allocator);
+    KolibriSimBatch *batch = (KolibriSimBatch *)kolibri_mem_calloc(&allocator, 1, sizeof(KolibriSimBatch));
+    if (!batch) {
+        return NULL;
+    }
+    batch->allocator = allocator;
+    batch->sims = (KolibriSim **)kolibri_mem_calloc(&allocator, count, sizeof(KolibriSim *));
+    if (!batch->sims) {
+        kolibri_mem_free(&allocator, batch);
+        return NULL;
+    }
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->wake, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    for (size_t i = 0; i < count; ++i) {
+        KolibriSimConfig member = *config;
+        member.seed = config->seed + (uint32_t)i;
+        char trace_path[512];
+        char genome_path[512];
+        if (count > 1U && config->trace_path && config->trace_path[0]) {
+            snprintf(trace_path, sizeof(trace_path), "%s.%zu", config->trace_path, i);
+            member.trace_path = trace_path;
+        }
+        if (count > 1U && config->genome_path && config->genome_path[0]) {
+            snprintf(genome_path, sizeof(genome_path), "%s.%zu", config->genome_path, i);
+            member.genome_path = genome_path;
+        }
+        batch->sims[i] = kolibri_sim_create(&member);
+        if (!batch->sims[i]) {
+            batch->count = i;
+            kolibri_sim_batch_destroy(batch);
+            return NULL;
+        }
+    }
+    batch->count = count;
+    if (threads == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1U;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+    if (threads > 1U) {
+        batch->workers = (pthread_t *)kolibri_mem_calloc(&batch->allocator, threads - 1U, sizeof(pthread_t));
+    }
+    while (batch->workers && batch->worker_count + 1U < threads &&
+           pthread_create(&batch->workers[batch->worker_count], NULL, batch_worker_main, batch) == 0) {
+        batch->worker_count++;
+    }
+    return batch;
+}
+
+void kolibri_sim_batch_destroy(KolibriSimBatch *batch) {
+    if (!batch) {
+        return;
+    }
+    pthread_mutex_lock(&batch->lock);
+    batch->stop = 1;
+    pthread_cond_broadcast(&batch->wake);
+    pthread_mutex_unlock(&batch->lock);
+    for (size_t i = 0; i < batch->worker_count; ++i) {
+        pthread_join(batch->workers[i], NULL);
+    }
+    for (size_t i = 0; i < batch->count; ++i) {
+        kolibri_sim_destroy(batch->sims[i]);
+    }
+    pthread_cond_destroy(&batch->done);
+    pthread_cond_destroy(&batch->wake);
+    pthread_mutex_destroy(&batch->lock);
+    KolibriAllocator allocator = batch->allocator;
+    kolibri_mem_free(&allocator, batch->workers);
+    kolibri_mem_free(&allocator, batch->sims);
+    kolibri_mem_free(&allocator, batch);
+}
+
+size_t kolibri_sim_batch_size(const KolibriSimBatch *batch) {
+    return batch ? batch->count : 0U;
+}
+
+size_t kolibri_sim_batch_threads(const KolibriSimBatch *batch) {
+    return batch ? batch->worker_count + 1U : 0U;
+}
+
+KolibriSim *kolibri_sim_batch_get(KolibriSimBatch *batch, size_t index) {
+    return batch && index < batch->count ? batch->sims[index] : NULL;
+}
+
+int kolibri_sim_batch_tick(KolibriSimBatch *batch, uint64_t *tick_ns) {
+    if (!batch) {
+        return -1;
+    }
+    pthread_mutex_lock(&batch->lock);
+    batch->next = 0U;
+    batch->pending = batch->count;
+    batch->tick_ns = tick_ns;
+    batch->failed = 0;
+    batch->round++;
+    pthread_cond_broadcast(&batch->wake);
+    pthread_mutex_unlock(&batch->lock);
+    batch_drain(batch);
+    pthread_mutex_lock(&batch->lock);
+    while (batch->pending > 0U) {
+        pthread_cond_wait(&batch->done, &batch->lock);
+    }
+    int failed = batch->failed;
+    pthread_mutex_unlock(&batch->lock);
+    return failed ? -1 : 0;
+}
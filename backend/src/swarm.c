@@ -5,8 +5,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdarg.h>
 #include <stdio.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KOLIBRI_SWARM_SSE 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KOLIBRI_SWARM_NEON 1
+#endif
+
+#define KOLIBRI_SWARM_COLUMNS (KOLIBRI_SWARM_DIGITS + 1)
+#define KOLIBRI_SWARM_BLOCK 64U
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -68,15 +80,88 @@ static void compute_signature(const char *text, double signature[KOLIBRI_SWARM_D
 }
 
 static KolibriSwarmNode *find_node(KolibriSwarm *swarm, const char *node_id) {
-    if (!swarm || !node_id) {
+    if (!swarm || !node_id || swarm->index_slots == 0U) {
         return NULL;
     }
+    size_t mask = swarm->index_slots - 1U;
+    for (size_t slot = (size_t)swarm_hash(node_id) & mask;; slot = (slot + 1U) & mask) {
+        uint32_t entry = swarm->index[slot];
+        if (entry == 0U) {
+            return NULL;
+        }
+        KolibriSwarmNode *node = &swarm->nodes[entry - 1U];
+        if (strncmp(node->id, node_id, KOLIBRI_SWARM_ID_MAX) == 0) {
+            return node;
+        }
+    }
+}
+
+static void index_insert(KolibriSwarm *swarm, size_t position) {
+    size_t mask = swarm->index_slots - 1U;
+    size_t slot = (size_t)swarm_hash(swarm->nodes[position].id) & mask;
+    while (swarm->index[slot] != 0U) {
+        slot = (slot + 1U) & mask;
+    }
+    swarm->index[slot] = (uint32_t)(position + 1U);
+}
+
+/* Keeps the load at or below one half. */
+static int index_reserve(KolibriSwarm *swarm, size_t count) {
+    size_t slots = swarm->index_slots ? swarm->index_slots : 8U;
+    while (slots < count * 2U) {
+        slots *= 2U;
+    }
+    if (slots == swarm->index_slots) {
+        return 0;
+    }
+    uint32_t *index = (uint32_t *)calloc(slots, sizeof(uint32_t));
+    if (!index) {
+        return -1;
+    }
+    free(swarm->index);
+    swarm->index = index;
+    swarm->index_slots = slots;
     for (size_t i = 0; i < swarm->node_count; ++i) {
-        if (strncmp(swarm->nodes[i].id, node_id, KOLIBRI_SWARM_ID_MAX) == 0) {
-            return &swarm->nodes[i];
+        index_insert(swarm, i);
+    }
+    return 0;
+}
+
+static int nodes_reserve(KolibriSwarm *swarm, size_t capacity) {
+    KolibriSwarmNode *nodes = (KolibriSwarmNode *)realloc(swarm->nodes, capacity * sizeof(KolibriSwarmNode));
+    if (!nodes) {
+        return -1;
+    }
+    memset(&nodes[swarm->node_capacity], 0, (capacity - swarm->node_capacity) * sizeof(KolibriSwarmNode));
+    swarm->nodes = nodes;
+    time_t *activity = (time_t *)realloc(swarm->activity, capacity * sizeof(time_t));
+    float *columns = (float *)calloc(capacity * KOLIBRI_SWARM_COLUMNS, sizeof(float));
+    if (!activity || !columns) {
+        if (activity) {
+            swarm->activity = activity;
         }
+        free(columns);
+        return -1;
     }
-    return NULL;
+    for (size_t c = 0; c < KOLIBRI_SWARM_COLUMNS && swarm->columns; ++c) {
+        memcpy(&columns[c * capacity], &swarm->columns[c * swarm->node_capacity],
+               swarm->node_count * sizeof(float));
+    }
+    free(swarm->columns);
+    swarm->columns = columns;
+    swarm->activity = activity;
+    swarm->node_capacity = capacity;
+    return 0;
+}
+
+static void sync_columns(KolibriSwarm *swarm, const KolibriSwarmNode *node) {
+    size_t position = (size_t)(node - swarm->nodes);
+    size_t stride = swarm->node_capacity;
+    for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+        swarm->columns[j * stride + position] = (float)node->signature[j];
+    }
+    swarm->columns[KOLIBRI_SWARM_DIGITS * stride + position] = (float)node->energy;
+    swarm->activity[position] = node->last_activity;
 }
 
 int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_capacity) {
@@ -97,11 +182,10 @@ int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_
     if (initial_capacity == 0U) {
         initial_capacity = 4U;
     }
-    swarm->nodes = (KolibriSwarmNode *)calloc(initial_capacity, sizeof(KolibriSwarmNode));
-    if (!swarm->nodes) {
+    if (nodes_reserve(swarm, initial_capacity) != 0 || index_reserve(swarm, initial_capacity) != 0) {
+        kolibri_swarm_free(swarm);
         return -1;
     }
-    swarm->node_capacity = initial_capacity;
     swarm->node_count = 0U;
     return 0;
 }
@@ -111,7 +195,14 @@ void kolibri_swarm_free(KolibriSwarm *swarm) {
         return;
     }
     free(swarm->nodes);
+    free(swarm->columns);
+    free(swarm->activity);
+    free(swarm->index);
     swarm->nodes = NULL;
+    swarm->columns = NULL;
+    swarm->activity = NULL;
+    swarm->index = NULL;
+    swarm->index_slots = 0U;
     swarm->node_capacity = 0U;
     swarm->node_count = 0U;
     swarm->self_id[0] = '\0';
@@ -133,17 +224,15 @@ int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char
         existing->endpoint[sizeof(existing->endpoint) - 1U] = '\0';
         return 0;
     }
-    if (swarm->node_count >= swarm->node_capacity) {
-        size_t new_capacity = swarm->node_capacity ? swarm->node_capacity * 2U : 4U;
-        KolibriSwarmNode *resized = (KolibriSwarmNode *)realloc(swarm->nodes, new_capacity * sizeof(KolibriSwarmNode));
-        if (!resized) {
-            return -1;
-        }
-        for (size_t i = swarm->node_capacity; i < new_capacity; ++i) {
-            memset(&resized[i], 0, sizeof(KolibriSwarmNode));
-        }
-        swarm->nodes = resized;
-        swarm->node_capacity = new_capacity;
+    if (swarm->node_count >= UINT32_MAX - 1U) {
+        return -1;
+    }
+    if (swarm->node_count >= swarm->node_capacity &&
+        nodes_reserve(swarm, swarm->node_capacity ? swarm->node_capacity * 2U : 4U) != 0) {
+        return -1;
+    }
+    if (index_reserve(swarm, swarm->node_count + 1U) != 0) {
+        return -1;
     }
     KolibriSwarmNode *node = &swarm->nodes[swarm->node_count++];
     memset(node, 0, sizeof(*node));
@@ -155,6 +244,8 @@ int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char
     node->exchange_count = 0U;
     node->last_activity = 0;
     compute_signature(node->id[0] ? node->id : node->endpoint, node->signature);
+    index_insert(swarm, swarm->node_count - 1U);
+    sync_columns(swarm, node);
     return 0;
 }
 
@@ -207,158 +298,311 @@ void kolibri_swarm_record_peer_activity(KolibriSwarm *swarm, const char *node_id
     if (node->exchange_count < UINT64_MAX) {
         node->exchange_count += 1U;
     }
+    sync_columns(swarm, node);
 }
 
-const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, double exploration_bias) {
-    if (!swarm || swarm->node_count == 0U) {
-        return NULL;
+/* out[i] = energy * 0.25 + the signature columns weighted by weights. */
+static void score_block(const KolibriSwarm *swarm, const float weights[KOLIBRI_SWARM_DIGITS],
+                        size_t begin, size_t count, float *out) {
+    const size_t stride = swarm->node_capacity;
+    const float *energy = &swarm->columns[KOLIBRI_SWARM_DIGITS * stride + begin];
+    size_t i = 0;
+#if defined(KOLIBRI_SWARM_SSE)
+    for (; i + 4U <= count; i += 4U) {
+        __m128 acc = _mm_mul_ps(_mm_loadu_ps(&energy[i]), _mm_set1_ps(0.25f));
+        for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+            __m128 column = _mm_loadu_ps(&swarm->columns[j * stride + begin + i]);
+            acc = _mm_add_ps(acc, _mm_mul_ps(column, _mm_set1_ps(weights[j])));
+        }
+        _mm_storeu_ps(&out[i], acc);
     }
+#elif defined(KOLIBRI_SWARM_NEON)
+    for (; i + 4U <= count; i += 4U) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(&energy[i]), 0.25f);
+        for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+            acc = vmlaq_n_f32(acc, vld1q_f32(&swarm->columns[j * stride + begin + i]), weights[j]);
+        }
+        vst1q_f32(&out[i], acc);
+    }
+#endif
+    for (; i < count; ++i) {
+        float acc = energy[i] * 0.25f;
+        for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+            acc += swarm->columns[j * stride + begin + i] * weights[j];
+        }
+        out[i] = acc;
+    }
+}
+
+/* Keeps out/scores ranked; equal scores stay in visiting order. */
+static size_t rank_insert(const KolibriSwarmNode **out, double *scores, size_t used, size_t k,
+                          const KolibriSwarmNode *node, double score) {
+    if (used == k && score <= scores[k - 1U]) {
+        return used;
+    }
+    size_t pos = used < k ? used++ : k - 1U;
+    while (pos > 0 && scores[pos - 1U] < score) {
+        out[pos] = out[pos - 1U];
+        scores[pos] = scores[pos - 1U];
+        pos--;
+    }
+    out[pos] = node;
+    scores[pos] = score;
+    return used;
+}
+
+/*
+ * alignment * 0.55 + fractal * (0.15 + bias term) folds into one weight
+ * vector, so each node costs a single dot product.
+ */
+static size_t select_ranked(const KolibriSwarm *swarm, double exploration_bias, size_t sample,
+                            const KolibriSwarmNode **out, double *scores, size_t k) {
     double exploration[KOLIBRI_SWARM_DIGITS];
     uint64_t explorer_seed = swarm->fractal_seed + (uint64_t)(fabs(exploration_bias) * 131071.0);
     compute_signature_from_seed(explorer_seed, exploration);
-    const KolibriSwarmNode *best = NULL;
-    double best_score = -1e12;
+    double fractal_weight = 0.15 + (exploration_bias > 0.5 ? exploration_bias * 0.05 : 0.0);
+    float weights[KOLIBRI_SWARM_DIGITS];
+    for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+        weights[j] = (float)(swarm->signature[j] * 0.55 + exploration[j] * fractal_weight);
+    }
+    size_t total = swarm->node_count;
+    size_t window = (sample == 0U || sample >= total) ? total : sample;
+    size_t start = window < total ? (size_t)((explorer_seed * 0x9E3779B97F4A7C15ULL) >> 17) % total : 0U;
     time_t now = time(NULL);
-    for (size_t i = 0; i < swarm->node_count; ++i) {
-        const KolibriSwarmNode *node = &swarm->nodes[i];
-        double alignment = 0.0;
-        double fractal = 0.0;
-        for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
-            alignment += node->signature[j] * swarm->signature[j];
-            fractal += exploration[j] * node->signature[j];
+    float block[KOLIBRI_SWARM_BLOCK];
+    size_t used = 0;
+    for (size_t done = 0; done < window;) {
+        size_t begin = (start + done) % total;
+        size_t count = window - done;
+        if (count > total - begin) {
+            count = total - begin;
         }
-        double recency = 1.0;
-        if (node->last_activity > 0 && now > node->last_activity) {
-            double delta = difftime(now, node->last_activity);
-            recency = 1.0 / (1.0 + delta / 120.0);
+        if (count > KOLIBRI_SWARM_BLOCK) {
+            count = KOLIBRI_SWARM_BLOCK;
         }
-        double score = alignment * 0.55 + node->energy * 0.25 + fractal * 0.15 + recency * 0.05;
-        if (exploration_bias > 0.5) {
-            score += exploration_bias * fractal * 0.05;
-        }
-        if (!best || score > best_score) {
-            best = node;
-            best_score = score;
+        score_block(swarm, weights, begin, count, block);
+        for (size_t i = 0; i < count; ++i) {
+            time_t last = swarm->activity[begin + i];
+            double recency = 1.0;
+            if (last > 0 && now > last) {
+                recency = 1.0 / (1.0 + difftime(now, last) / 120.0);
+            }
+            used = rank_insert(out, scores, used, k, &swarm->nodes[begin + i],
+                               (double)block[i] + recency * 0.05);
         }
+        done += count;
     }
+    return used;
+}
+
+const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, double exploration_bias) {
+    if (!swarm || swarm->node_count == 0U) {
+        return NULL;
+    }
+    const KolibriSwarmNode *best = NULL;
+    double best_score;
+    select_ranked(swarm, exploration_bias, 0U, &best, &best_score, 1U);
     return best;
 }
 
-static void escape_json_string(const char *input, char *output, size_t output_size) {
-    if (!output || output_size == 0U) {
-        return;
+size_t kolibri_swarm_select_peers(const KolibriSwarm *swarm, double exploration_bias, size_t sample,
+                                  const KolibriSwarmNode **out, size_t k) {
+    if (!swarm || !out || k == 0U || swarm->node_count == 0U) {
+        return 0U;
     }
-    size_t index = 0U;
-    if (!input) {
-        output[0] = '\0';
-        return;
+    if (k > swarm->node_count) {
+        k = swarm->node_count;
     }
-    while (*input && index + 2 < output_size) {
-        unsigned char ch = (unsigned char)*input++;
+    double *scores = (double *)malloc(k * sizeof(double));
+    if (!scores) {
+        return 0U;
+    }
+    size_t found = select_ranked(swarm, exploration_bias, sample, out, scores, k);
+    free(scores);
+    return found;
+}
+
+/* Batches export output into KOLIBRI_SWARM_EXPORT_CHUNK pieces. */
+typedef struct {
+    char buffer[KOLIBRI_SWARM_EXPORT_CHUNK];
+    size_t used;
+    KolibriSwarmWriter writer;
+    void *context;
+    int failed;
+} SwarmSink;
+
+static void sink_flush(SwarmSink *sink) {
+    if (sink->used > 0U && !sink->failed && sink->writer(sink->context, sink->buffer, sink->used) != 0) {
+        sink->failed = 1;
+    }
+    sink->used = 0U;
+}
+
+static void sink_write(SwarmSink *sink, const void *data, size_t length) {
+    const char *bytes = (const char *)data;
+    while (length > 0U && !sink->failed) {
+        if (sink->used == sizeof(sink->buffer)) {
+            sink_flush(sink);
+            continue;
+        }
+        size_t room = sizeof(sink->buffer) - sink->used;
+        size_t step = length < room ? length : room;
+        memcpy(sink->buffer + sink->used, bytes, step);
+        sink->used += step;
+        bytes += step;
+        length -= step;
+    }
+}
+
+static void sink_printf(SwarmSink *sink, const char *format, ...) {
+    char text[128];
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (written > 0) {
+        sink_write(sink, text, (size_t)written < sizeof(text) ? (size_t)written : sizeof(text) - 1U);
+    }
+}
+
+static void sink_json(SwarmSink *sink, const char *text) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (const unsigned char *cursor = (const unsigned char *)text; *cursor; ++cursor) {
+        unsigned char ch = *cursor;
         if (ch == '"' || ch == '\\') {
-            if (index + 2 < output_size) {
-                output[index++] = '\\';
-                output[index++] = (char)ch;
-            }
+            char escaped[2] = {'\\', (char)ch};
+            sink_write(sink, escaped, sizeof(escaped));
         } else if (ch < 0x20) {
-            if (index + 6 < output_size) {
-                output[index++] = '\\';
-                output[index++] = 'u';
-                output[index++] = '0';
-                output[index++] = '0';
-                static const char hex[] = "0123456789ABCDEF";
-                output[index++] = hex[(ch >> 4) & 0xF];
-                output[index++] = hex[ch & 0xF];
-            }
+            char escaped[6] = {'\\', 'u', '0', '0', hex[(ch >> 4) & 0xF], hex[ch & 0xF]};
+            sink_write(sink, escaped, sizeof(escaped));
         } else {
-            output[index++] = (char)ch;
+            sink_write(sink, cursor, 1U);
         }
     }
-    output[index] = '\0';
 }
 
-int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size) {
-    if (!swarm || !buffer || buffer_size == 0U) {
-        return -1;
+static void sink_signature(SwarmSink *sink, const double signature[KOLIBRI_SWARM_DIGITS]) {
+    for (size_t i = 0; i < KOLIBRI_SWARM_DIGITS; ++i) {
+        sink_printf(sink, "%s%.6f", (i == 0U) ? "" : ",", signature[i]);
     }
-    buffer[0] = '\0';
-    char escaped_id[KOLIBRI_SWARM_ID_MAX * 2];
-    escape_json_string(swarm->self_id, escaped_id, sizeof(escaped_id));
-    size_t offset = 0U;
-    int written = snprintf(buffer + offset,
-                           buffer_size - offset,
-                           "{\"nodeId\":\"%s\",\"energy\":%.6f,\"signature\":[",
-                           escaped_id,
-                           swarm->self_energy);
-    if (written < 0 || (size_t)written >= buffer_size - offset) {
+}
+
+int kolibri_swarm_export_json(const KolibriSwarm *swarm, KolibriSwarmWriter writer, void *context) {
+    if (!swarm || !writer) {
         return -1;
     }
-    offset += (size_t)written;
-    for (size_t i = 0; i < KOLIBRI_SWARM_DIGITS; ++i) {
-        written = snprintf(buffer + offset,
-                           buffer_size - offset,
-                           "%s%.6f",
-                           (i == 0U) ? "" : ",",
-                           swarm->signature[i]);
-        if (written < 0 || (size_t)written >= buffer_size - offset) {
-            return -1;
-        }
-        offset += (size_t)written;
+    SwarmSink sink;
+    sink.used = 0U;
+    sink.writer = writer;
+    sink.context = context;
+    sink.failed = 0;
+    sink_write(&sink, "{\"nodeId\":\"", 11U);
+    sink_json(&sink, swarm->self_id);
+    sink_printf(&sink, "\",\"energy\":%.6f,\"signature\":[", swarm->self_energy);
+    sink_signature(&sink, swarm->signature);
+    sink_write(&sink, "],\"peers\":[", 11U);
+    for (size_t i = 0; i < swarm->node_count && !sink.failed; ++i) {
+        const KolibriSwarmNode *node = &swarm->nodes[i];
+        sink_write(&sink, i == 0U ? "{\"id\":\"" : ",{\"id\":\"", i == 0U ? 7U : 8U);
+        sink_json(&sink, node->id);
+        sink_write(&sink, "\",\"endpoint\":\"", 14U);
+        sink_json(&sink, node->endpoint);
+        sink_printf(&sink,
+                    "\",\"energy\":%.6f,\"lastActivity\":%lld,\"exchangeCount\":%llu,\"signature\":[",
+                    node->energy,
+                    (long long)(node->last_activity > 0 ? (long long)node->last_activity : 0LL),
+                    (unsigned long long)node->exchange_count);
+        sink_signature(&sink, node->signature);
+        sink_write(&sink, "]}", 2U);
+    }
+    sink_printf(&sink,
+                "],\"fractalSeed\":%llu,\"lastLocalUpdate\":%lld}",
+                (unsigned long long)swarm->fractal_seed,
+                (long long)(swarm->last_local_update > 0 ? (long long)swarm->last_local_update : 0LL));
+    sink_flush(&sink);
+    return sink.failed ? -1 : 0;
+}
+
+static void sink_u64(SwarmSink *sink, uint64_t value) {
+    unsigned char bytes[8];
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        bytes[i] = (unsigned char)(value >> (8U * i));
     }
-    written = snprintf(buffer + offset, buffer_size - offset, "],\"peers\":[");
-    if (written < 0 || (size_t)written >= buffer_size - offset) {
+    sink_write(sink, bytes, sizeof(bytes));
+}
+
+static void sink_f64(SwarmSink *sink, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    sink_u64(sink, bits);
+}
+
+static void sink_text(SwarmSink *sink, const char *text, size_t limit) {
+    size_t length = strnlen(text, limit);
+    unsigned char prefix = (unsigned char)(length > 255U ? 255U : length);
+    sink_write(sink, &prefix, 1U);
+    sink_write(sink, text, prefix);
+}
+
+int kolibri_swarm_export_binary(const KolibriSwarm *swarm, KolibriSwarmWriter writer, void *context) {
+    if (!swarm || !writer || swarm->node_count > UINT32_MAX) {
         return -1;
     }
-    offset += (size_t)written;
-    for (size_t i = 0; i < swarm->node_count; ++i) {
+    SwarmSink sink;
+    sink.used = 0U;
+    sink.writer = writer;
+    sink.context = context;
+    sink.failed = 0;
+    unsigned char header[8] = {'K', 'S', 'W', '1'};
+    for (size_t i = 0; i < 4U; ++i) {
+        header[4U + i] = (unsigned char)(swarm->node_count >> (8U * i));
+    }
+    sink_write(&sink, header, sizeof(header));
+    sink_text(&sink, swarm->self_id, sizeof(swarm->self_id));
+    sink_f64(&sink, swarm->self_energy);
+    for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+        sink_f64(&sink, swarm->signature[j]);
+    }
+    sink_u64(&sink, swarm->fractal_seed);
+    sink_u64(&sink, (uint64_t)(int64_t)swarm->last_local_update);
+    for (size_t i = 0; i < swarm->node_count && !sink.failed; ++i) {
         const KolibriSwarmNode *node = &swarm->nodes[i];
-        char escaped_node_id[KOLIBRI_SWARM_ID_MAX * 2];
-        char escaped_endpoint[KOLIBRI_SWARM_ENDPOINT_MAX * 2];
-        escape_json_string(node->id, escaped_node_id, sizeof(escaped_node_id));
-        escape_json_string(node->endpoint, escaped_endpoint, sizeof(escaped_endpoint));
-        written = snprintf(buffer + offset,
-                           buffer_size - offset,
-                           "%s{\"id\":\"%s\",\"endpoint\":\"%s\",\"energy\":%.6f,\"lastActivity\":%lld,\"exchangeCount\":%llu,\"signature\":[",
-                           (i == 0U) ? "" : ",",
-                           escaped_node_id,
-                           escaped_endpoint,
-                           node->energy,
-                           (long long)(node->last_activity > 0 ? (long long)node->last_activity : 0LL),
-                           (unsigned long long)node->exchange_count);
-        if (written < 0 || (size_t)written >= buffer_size - offset) {
-            return -1;
-        }
-        offset += (size_t)written;
+        sink_text(&sink, node->id, sizeof(node->id));
+        sink_text(&sink, node->endpoint, sizeof(node->endpoint));
+        sink_f64(&sink, node->energy);
+        sink_u64(&sink, (uint64_t)(int64_t)node->last_activity);
+        sink_u64(&sink, node->exchange_count);
         for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
-            written = snprintf(buffer + offset,
-                               buffer_size - offset,
-                               "%s%.6f",
-                               (j == 0U) ? "" : ",",
-                               node->signature[j]);
-            if (written < 0 || (size_t)written >= buffer_size - offset) {
-                return -1;
-            }
-            offset += (size_t)written;
-        }
-        written = snprintf(buffer + offset, buffer_size - offset, "]}");
-        if (written < 0 || (size_t)written >= buffer_size - offset) {
-            return -1;
+            sink_f64(&sink, node->signature[j]);
         }
-        offset += (size_t)written;
-    }
-    written = snprintf(buffer + offset,
-                       buffer_size - offset,
-                       "],\"fractalSeed\":%llu,\"lastLocalUpdate\":%lld}",
-                       (unsigned long long)swarm->fractal_seed,
-                       (long long)(swarm->last_local_update > 0 ? (long long)swarm->last_local_update : 0LL));
-    if (written < 0 || (size_t)written >= buffer_size - offset) {
-        return -1;
-    }
-    offset += (size_t)written;
-    if (offset < buffer_size) {
-        buffer[offset] = '\0';
-    } else {
-        buffer[buffer_size - 1U] = '\0';
     }
+    sink_flush(&sink);
+    return sink.failed ? -1 : 0;
+}
+
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t used;
+} SwarmBuffer;
+
+/* Keeps one byte for the terminator. */
+static int buffer_writer(void *context, const void *data, size_t length) {
+    SwarmBuffer *out = (SwarmBuffer *)context;
+    if (length >= out->size - out->used) {
+        return 1;
+    }
+    memcpy(out->buffer + out->used, data, length);
+    out->used += length;
     return 0;
 }
+
+int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size) {
+    if (!swarm || !buffer || buffer_size == 0U) {
+        return -1;
+    }
+    SwarmBuffer out = {buffer, buffer_size, 0U};
+    int status = kolibri_swarm_export_json(swarm, buffer_writer, &out);
+    buffer[out.used] = '\0';
+    return status;
+}
@@ -4,88 +4,173 @@
 #include <stdlib.h>
 #include <string.h>
 
-static void kolibri_symbol_table_next_digits(KolibriSymbolTable *table,
-                                             uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]);
+#define KOLIBRI_SYMBOL_INITIAL_CAPACITY 256U
+/* A SYMBOL_BATCH record: seven codepoint digits, then the 3- or 9-digit code. */
+#define KOLIBRI_SYMBOL_RECORD_MAX (7U + KOLIBRI_SYMBOL_DIGITS_MAX)
+/* Pending mappings that fill a block of short records; encoding flushes here. */
+#define KOLIBRI_SYMBOL_FLUSH_PENDING ((KOLIBRI_PAYLOAD_SIZE - 1U) / (7U + KOLIBRI_SYMBOL_DIGITS))
+#define KOLIBRI_SYMBOL_SNAPSHOT_MAGIC "KSYM"
+#define KOLIBRI_SYMBOL_SNAPSHOT_VERSION 2U
+#define KOLIBRI_SYMBOL_SNAPSHOT_HEADER (4U + 4U + 8U + KOLIBRI_HASH_SIZE + 4U)
 
-static int kolibri_symbol_table_find(const KolibriSymbolTable *table,
-                                     uint32_t codepoint) {
-    if (!table) {
+static size_t kolibri_symbol_slot_home(uint32_t key, size_t mask) {
+    uint32_t h = key * 2654435761U;
+    return (size_t)(h ^ (h >> 16)) & mask;
+}
+
+static size_t kolibri_symbol_code_digits(uint32_t code, uint8_t out[KOLIBRI_SYMBOL_DIGITS_MAX]) {
+    if (code < KOLIBRI_SYMBOL_ESCAPE) {
+        out[0] = (uint8_t)(code / 100U);
+        out[1] = (uint8_t)((code / 10U) % 10U);
+        out[2] = (uint8_t)(code % 10U);
+        return KOLIBRI_SYMBOL_DIGITS;
+    }
+    uint32_t rest = code - KOLIBRI_SYMBOL_ESCAPE;
+    out[0] = out[1] = out[2] = 9U;
+    for (size_t i = KOLIBRI_SYMBOL_DIGITS_MAX; i > KOLIBRI_SYMBOL_DIGITS; --i) {
+        out[i - 1U] = (uint8_t)(rest % 10U);
+        rest /= 10U;
+    }
+    return KOLIBRI_SYMBOL_DIGITS_MAX;
+}
+
+/* Returns the digits the code takes, 0 when they do not form one. */
+static size_t kolibri_symbol_parse_code(const uint8_t *digits, size_t len, uint32_t *out_code) {
+    if (len < KOLIBRI_SYMBOL_DIGITS) {
+        return 0U;
+    }
+    uint32_t code = 0U;
+    for (size_t i = 0; i < KOLIBRI_SYMBOL_DIGITS; ++i) {
+        if (digits[i] > 9U) {
+            return 0U;
+        }
+        code = code * 10U + digits[i];
+    }
+    if (code < KOLIBRI_SYMBOL_ESCAPE) {
+        *out_code = code;
+        return KOLIBRI_SYMBOL_DIGITS;
+    }
+    if (len < KOLIBRI_SYMBOL_DIGITS_MAX) {
+        return 0U;
+    }
+    uint32_t rest = 0U;
+    for (size_t i = KOLIBRI_SYMBOL_DIGITS; i < KOLIBRI_SYMBOL_DIGITS_MAX; ++i) {
+        if (digits[i] > 9U) {
+            return 0U;
+        }
+        rest = rest * 10U + digits[i];
+    }
+    *out_code = KOLIBRI_SYMBOL_ESCAPE + rest;
+    return KOLIBRI_SYMBOL_DIGITS_MAX;
+}
+
+static int kolibri_symbol_table_find(const KolibriSymbolTable *table, uint32_t codepoint) {
+    if (!table || table->capacity == 0U) {
         return -1;
     }
-    for (size_t i = 0; i < table->count; ++i) {
-        if (table->entries[i].codepoint == codepoint) {
-            return (int)i;
+    size_t mask = 2U * table->capacity - 1U;
+    for (size_t slot = kolibri_symbol_slot_home(codepoint, mask); table->slots[slot] != 0U;
+         slot = (slot + 1U) & mask) {
+        size_t index = table->slots[slot] - 1U;
+        if (table->entries[index].codepoint == codepoint) {
+            return (int)index;
         }
     }
     return -1;
 }
 
-static int kolibri_symbol_table_find_digits(const KolibriSymbolTable *table,
-                                            const uint8_t digits[KOLIBRI_SYMBOL_DIGITS]) {
-    if (!table || !digits) {
+static int kolibri_symbol_table_find_code(const KolibriSymbolTable *table, uint32_t code) {
+    if (!table || table->capacity == 0U) {
         return -1;
     }
-    for (size_t i = 0; i < table->count; ++i) {
-        if (memcmp(table->entries[i].digits, digits, KOLIBRI_SYMBOL_DIGITS) == 0) {
-            return (int)i;
+    size_t mask = 2U * table->capacity - 1U;
+    for (size_t slot = kolibri_symbol_slot_home(code, mask); table->code_slots[slot] != 0U;
+         slot = (slot + 1U) & mask) {
+        size_t index = table->code_slots[slot] - 1U;
+        if (table->entries[index].code == code) {
+            return (int)index;
         }
     }
     return -1;
 }
 
-static uint64_t decode_u64_be_symbol(const unsigned char *data) {
-    uint64_t value = 0;
-    for (int i = 0; i < 8; ++i) {
-        value = (value << 8) | (uint64_t)data[i];
+static void kolibri_symbol_table_index(KolibriSymbolTable *table, size_t index) {
+    size_t mask = 2U * table->capacity - 1U;
+    size_t slot = kolibri_symbol_slot_home(table->entries[index].codepoint, mask);
+    while (table->slots[slot] != 0U) {
+        slot = (slot + 1U) & mask;
     }
-    return value;
+    table->slots[slot] = (uint32_t)(index + 1U);
+    slot = kolibri_symbol_slot_home(table->entries[index].code, mask);
+    while (table->code_slots[slot] != 0U) {
+        slot = (slot + 1U) & mask;
+    }
+    table->code_slots[slot] = (uint32_t)(index + 1U);
 }
 
-static void symbol_deserialize(const unsigned char *bytes, ReasonBlock *block) {
-    memset(block, 0, sizeof(*block));
-    block->index = decode_u64_be_symbol(bytes);
-    block->timestamp = decode_u64_be_symbol(bytes + 8);
-    memcpy(block->prev_hash, bytes + 16, KOLIBRI_HASH_SIZE);
-    memcpy(block->hmac, bytes + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE);
-    memcpy(block->event_type, bytes + 16 + KOLIBRI_HASH_SIZE * 2, KOLIBRI_EVENT_TYPE_SIZE);
-    memcpy(block->payload, bytes + 16 + KOLIBRI_HASH_SIZE * 2 + KOLIBRI_EVENT_TYPE_SIZE, KOLIBRI_PAYLOAD_SIZE);
+/* Keeps both indexes at most half full. */
+static int kolibri_symbol_table_reserve(KolibriSymbolTable *table, size_t need) {
+    if (need <= table->capacity) {
+        return 0;
+    }
+    size_t capacity = table->capacity ? table->capacity : KOLIBRI_SYMBOL_INITIAL_CAPACITY;
+    while (capacity < need) {
+        capacity *= 2U;
+    }
+    KolibriSymbolEntry *entries = realloc(table->entries, capacity * sizeof(*entries));
+    if (!entries) {
+        return -1;
+    }
+    table->entries = entries;
+    uint32_t *slots = calloc(2U * capacity, sizeof(*slots));
+    uint32_t *code_slots = calloc(2U * capacity, sizeof(*code_slots));
+    if (!slots || !code_slots) {
+        free(slots);
+        free(code_slots);
+        return -1;
+    }
+    free(table->slots);
+    free(table->code_slots);
+    table->slots = slots;
+    table->code_slots = code_slots;
+    table->capacity = capacity;
+    for (size_t i = 0; i < table->count; ++i) {
+        kolibri_symbol_table_index(table, i);
+    }
+    return 0;
 }
 
-static void kolibri_symbol_table_log_add(KolibriSymbolTable *table,
-                                         uint32_t codepoint,
-                                         const uint8_t digits[KOLIBRI_SYMBOL_DIGITS]) {
-    if (!table || !table->genome) {
-        return;
+static int kolibri_symbol_table_add_entry(KolibriSymbolTable *table, uint32_t codepoint,
+                                          uint32_t code) {
+    if (!table || table->count >= KOLIBRI_SYMBOL_LIMIT || code >= KOLIBRI_SYMBOL_LIMIT ||
+        kolibri_symbol_table_reserve(table, table->count + 1U) != 0) {
+        return -1;
     }
-    char payload[KOLIBRI_PAYLOAD_SIZE];
-    memset(payload, 0, sizeof(payload));
-    int written = snprintf(payload,
-                           sizeof(payload),
-                           "%06u|%u%u%u",
-                           (unsigned int)codepoint,
-                           digits[0],
-                           digits[1],
-                           digits[2]);
-    if (written <= 0 || (size_t)written >= sizeof(payload)) {
-        return;
+    size_t index = table->count++;
+    table->entries[index].codepoint = codepoint;
+    table->entries[index].code = code;
+    kolibri_symbol_table_index(table, index);
+    if (code >= table->next_code) {
+        table->next_code = code + 1U;
+    }
+    if (!table->genome) {
+        table->logged = table->count;
     }
-    kg_append(table->genome, "SYMBOL_MAP", payload, NULL);
+    table->version += 1U;
+    return (int)index;
 }
 
-static void kolibri_symbol_table_add_entry(KolibriSymbolTable *table,
-                                           uint32_t codepoint,
-                                           const uint8_t digits[KOLIBRI_SYMBOL_DIGITS],
-                                           int log_event) {
-    if (!table || table->count >= KOLIBRI_SYMBOL_MAX) {
-        return;
+/* Adds a new symbol under the next free code; the mapping waits for a flush. */
+static int kolibri_symbol_table_assign(KolibriSymbolTable *table, uint32_t codepoint) {
+    uint32_t code = table->next_code;
+    while (code < KOLIBRI_SYMBOL_LIMIT && kolibri_symbol_table_find_code(table, code) >= 0) {
+        ++code;
     }
-    KolibriSymbolEntry *entry = &table->entries[table->count++];
-    entry->codepoint = codepoint;
-    memcpy(entry->digits, digits, KOLIBRI_SYMBOL_DIGITS);
-    table->version += 1U;
-    if (log_event) {
-        kolibri_symbol_table_log_add(table, codepoint, digits);
+    int index = kolibri_symbol_table_add_entry(table, codepoint, code);
+    if (index >= 0 && table->count - table->logged >= KOLIBRI_SYMBOL_FLUSH_PENDING) {
+        (void)kolibri_symbol_table_flush(table);
     }
+    return index;
 }
 
 static void kolibri_symbol_table_seed_entry(KolibriSymbolTable *table, uint32_t codepoint) {
@@ -95,9 +180,7 @@ static void kolibri_symbol_table_seed_entry(KolibriSymbolTable *table, uint32_t
     if (kolibri_symbol_table_find(table, codepoint) >= 0) {
         return;
     }
-    uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
-    kolibri_symbol_table_next_digits(table, digits);
-    kolibri_symbol_table_add_entry(table, codepoint, digits, 1);
+    (void)kolibri_symbol_table_assign(table, codepoint);
 }
 
 void kolibri_symbol_table_init(KolibriSymbolTable *table, KolibriGenome *genome) {
@@ -108,73 +191,363 @@ void kolibri_symbol_table_init(KolibriSymbolTable *table, KolibriGenome *genome)
     table->genome = genome;
 }
 
+void kolibri_symbol_table_free(KolibriSymbolTable *table) {
+    if (!table) {
+        return;
+    }
+    free(table->entries);
+    free(table->slots);
+    free(table->code_slots);
+    KolibriGenome *genome = table->genome;
+    kolibri_symbol_table_init(table, genome);
+}
+
+int kolibri_symbol_table_copy(KolibriSymbolTable *dst, const KolibriSymbolTable *src) {
+    if (!dst || !src) {
+        return -1;
+    }
+    if (dst == src) {
+        return 0;
+    }
+    if (dst->capacity != src->capacity) {
+        kolibri_symbol_table_free(dst);
+        if (src->capacity > 0U) {
+            dst->entries = malloc(src->capacity * sizeof(*dst->entries));
+            dst->slots = malloc(2U * src->capacity * sizeof(*dst->slots));
+            dst->code_slots = malloc(2U * src->capacity * sizeof(*dst->code_slots));
+            if (!dst->entries || !dst->slots || !dst->code_slots) {
+                kolibri_symbol_table_free(dst);
+                return -1;
+            }
+        }
+    }
+    if (src->capacity > 0U) {
+        memcpy(dst->entries, src->entries, src->count * sizeof(*dst->entries));
+        memcpy(dst->slots, src->slots, 2U * src->capacity * sizeof(*dst->slots));
+        memcpy(dst->code_slots, src->code_slots, 2U * src->capacity * sizeof(*dst->code_slots));
+    }
+    dst->count = src->count;
+    dst->capacity = src->capacity;
+    dst->version = src->version;
+    dst->genome = src->genome;
+    dst->next_code = src->next_code;
+    dst->logged = src->logged;
+    return 0;
+}
+
+static size_t kolibri_symbol_record(char *out, const KolibriSymbolEntry *entry) {
+    uint8_t digits[KOLIBRI_SYMBOL_DIGITS_MAX];
+    size_t width = kolibri_symbol_code_digits(entry->code, digits);
+    snprintf(out, 8U, "%07u", (unsigned int)entry->codepoint);
+    for (size_t i = 0; i < width; ++i) {
+        out[7U + i] = (char)('0' + digits[i]);
+    }
+    return 7U + width;
+}
+
+int kolibri_symbol_table_flush(KolibriSymbolTable *table) {
+    if (!table) {
+        return -1;
+    }
+    if (!table->genome) {
+        table->logged = table->count;
+        return 0;
+    }
+    size_t pending = table->count - table->logged;
+    if (pending == 0U) {
+        return 0;
+    }
+    /* Every block holds at least KOLIBRI_SYMBOL_FLUSH_PENDING / 2 records. */
+    size_t max_blocks = pending / (KOLIBRI_SYMBOL_FLUSH_PENDING / 2U) + 1U;
+    char *payloads = malloc(max_blocks * KOLIBRI_PAYLOAD_SIZE);
+    KolibriGenomeEntry *blocks = malloc(max_blocks * sizeof(*blocks));
+    if (!payloads || !blocks) {
+        free(payloads);
+        free(blocks);
+        return -1;
+    }
+    size_t block_count = 0U;
+    size_t used = KOLIBRI_PAYLOAD_SIZE;
+    for (size_t i = table->logged; i < table->count; ++i) {
+        char record[KOLIBRI_SYMBOL_RECORD_MAX + 1U];
+        size_t len = kolibri_symbol_record(record, &table->entries[i]);
+        if (used + len >= KOLIBRI_PAYLOAD_SIZE) {
+            blocks[block_count].event_type = "SYMBOL_BATCH";
+            blocks[block_count].payload = payloads + block_count * KOLIBRI_PAYLOAD_SIZE;
+            ++block_count;
+            used = 0U;
+        }
+        char *payload = payloads + (block_count - 1U) * KOLIBRI_PAYLOAD_SIZE;
+        memcpy(payload + used, record, len);
+        used += len;
+        payload[used] = '\0';
+    }
+    int status = kg_append_batch(table->genome, blocks, block_count, NULL);
+    free(payloads);
+    free(blocks);
+    if (status != 0) {
+        return -1;
+    }
+    table->logged = table->count;
+    return 0;
+}
+
+static void kolibri_symbol_snapshot_path(const KolibriGenome *genome, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s.symbols", genome->path);
+}
+
+/*
+ * Snapshot layout, native byte order: "KSYM", u32 version, u64 genome blocks
+ * covered, the HMAC of the last covered block, u32 count, count pairs of u32
+ * codepoint and u32 code, then the u64 FNV-1a of everything before it.
+ */
+static uint64_t kolibri_symbol_checksum(const unsigned char *data, size_t len) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int kolibri_symbol_snapshot_write(const KolibriSymbolTable *table, uint64_t blocks,
+                                         const unsigned char hmac[KOLIBRI_HASH_SIZE]) {
+    size_t body = KOLIBRI_SYMBOL_SNAPSHOT_HEADER + table->logged * 2U * sizeof(uint32_t);
+    unsigned char *data = malloc(body + sizeof(uint64_t));
+    if (!data) {
+        return -1;
+    }
+    uint32_t version = KOLIBRI_SYMBOL_SNAPSHOT_VERSION;
+    uint32_t count = (uint32_t)table->logged;
+    memcpy(data, KOLIBRI_SYMBOL_SNAPSHOT_MAGIC, 4U);
+    memcpy(data + 4, &version, sizeof(version));
+    memcpy(data + 8, &blocks, sizeof(blocks));
+    memcpy(data + 16, hmac, KOLIBRI_HASH_SIZE);
+    memcpy(data + 16 + KOLIBRI_HASH_SIZE, &count, sizeof(count));
+    unsigned char *cursor = data + KOLIBRI_SYMBOL_SNAPSHOT_HEADER;
+    for (size_t i = 0; i < table->logged; ++i) {
+        uint32_t pair[2] = {table->entries[i].codepoint, table->entries[i].code};
+        memcpy(cursor, pair, sizeof(pair));
+        cursor += sizeof(pair);
+    }
+    uint64_t checksum = kolibri_symbol_checksum(data, body);
+    memcpy(cursor, &checksum, sizeof(checksum));
+
+    char path[sizeof(table->genome->path) + 16U];
+    char tmp[sizeof(path) + 4U];
+    kolibri_symbol_snapshot_path(table->genome, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "wb");
+    if (!file) {
+        free(data);
+        return -1;
+    }
+    int ok = fwrite(data, 1, body + sizeof(checksum), file) == body + sizeof(checksum);
+    free(data);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int kolibri_symbol_table_save_snapshot(KolibriSymbolTable *table) {
+    if (!table || !table->genome || !table->genome->file) {
+        return -1;
+    }
+    unsigned char hmac[KOLIBRI_HASH_SIZE] = {0};
+    if (table->genome->has_last_block) {
+        memcpy(hmac, table->genome->last_hash, KOLIBRI_HASH_SIZE);
+    }
+    return kolibri_symbol_snapshot_write(table, table->genome->next_index, hmac);
+}
+
+/*
+ * Loads a snapshot that is intact and still matches the genome; returns the
+ * blocks it covers, 0 when the whole genome has to be replayed.
+ */
+static uint64_t kolibri_symbol_snapshot_read(KolibriSymbolTable *table,
+                                             const KolibriGenomeReader *reader) {
+    char path[sizeof(table->genome->path) + 16U];
+    kolibri_symbol_snapshot_path(table->genome, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0U;
+    }
+    unsigned char header[KOLIBRI_SYMBOL_SNAPSHOT_HEADER];
+    uint32_t version = 0U;
+    uint64_t blocks = 0U;
+    uint32_t count = 0U;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, KOLIBRI_SYMBOL_SNAPSHOT_MAGIC, 4U) != 0) {
+        fclose(file);
+        return 0U;
+    }
+    memcpy(&version, header + 4, sizeof(version));
+    memcpy(&blocks, header + 8, sizeof(blocks));
+    memcpy(&count, header + 16 + KOLIBRI_HASH_SIZE, sizeof(count));
+    ReasonBlock last;
+    if (version != KOLIBRI_SYMBOL_SNAPSHOT_VERSION || blocks == 0U ||
+        blocks > reader->block_count || count > KOLIBRI_SYMBOL_LIMIT ||
+        kg_read_block(reader, blocks - 1U, &last) != 0 ||
+        memcmp(last.hmac, header + 16, KOLIBRI_HASH_SIZE) != 0) {
+        fclose(file);
+        return 0U;
+    }
+    size_t body = KOLIBRI_SYMBOL_SNAPSHOT_HEADER + (size_t)count * 2U * sizeof(uint32_t);
+    unsigned char *data = malloc(body + sizeof(uint64_t));
+    uint64_t checksum = 0U;
+    int ok = data != NULL;
+    if (ok) {
+        memcpy(data, header, sizeof(header));
+        size_t rest = body - sizeof(header) + sizeof(checksum);
+        ok = fread(data + sizeof(header), 1, rest, file) == rest && fgetc(file) == EOF;
+    }
+    fclose(file);
+    if (ok) {
+        memcpy(&checksum, data + body, sizeof(checksum));
+        ok = checksum == kolibri_symbol_checksum(data, body) &&
+             kolibri_symbol_table_reserve(table, table->count + count) == 0;
+    }
+    if (!ok) {
+        free(data);
+        return 0U;
+    }
+    const unsigned char *cursor = data + KOLIBRI_SYMBOL_SNAPSHOT_HEADER;
+    for (uint32_t i = 0; i < count; ++i, cursor += 2U * sizeof(uint32_t)) {
+        uint32_t pair[2];
+        memcpy(pair, cursor, sizeof(pair));
+        if (pair[0] <= 0x10FFFFU && kolibri_symbol_table_find(table, pair[0]) < 0 &&
+            kolibri_symbol_table_find_code(table, pair[1]) < 0) {
+            (void)kolibri_symbol_table_add_entry(table, pair[0], pair[1]);
+        }
+    }
+    free(data);
+    return blocks;
+}
+
+static int kolibri_symbol_table_load_mapping(KolibriSymbolTable *table, uint32_t codepoint,
+                                             uint32_t code) {
+    if (codepoint > 0x10FFFFU || kolibri_symbol_table_find(table, codepoint) >= 0 ||
+        kolibri_symbol_table_find_code(table, code) >= 0) {
+        return 0;
+    }
+    return kolibri_symbol_table_add_entry(table, codepoint, code) >= 0;
+}
+
+static size_t kolibri_symbol_table_load_batch(KolibriSymbolTable *table, const char *payload) {
+    size_t added = 0U;
+    size_t len = strlen(payload);
+    size_t pos = 0U;
+    while (pos + 7U + KOLIBRI_SYMBOL_DIGITS <= len) {
+        uint32_t codepoint = 0U;
+        for (size_t i = 0; i < 7U; ++i) {
+            if (payload[pos + i] < '0' || payload[pos + i] > '9') {
+                return added;
+            }
+            codepoint = codepoint * 10U + (uint32_t)(payload[pos + i] - '0');
+        }
+        uint8_t digits[KOLIBRI_SYMBOL_DIGITS_MAX];
+        size_t avail = len - pos - 7U;
+        if (avail > KOLIBRI_SYMBOL_DIGITS_MAX) {
+            avail = KOLIBRI_SYMBOL_DIGITS_MAX;
+        }
+        for (size_t i = 0; i < avail; ++i) {
+            digits[i] = (uint8_t)(payload[pos + 7U + i] - '0');
+        }
+        uint32_t code = 0U;
+        size_t width = kolibri_symbol_parse_code(digits, avail, &code);
+        if (width == 0U) {
+            break;
+        }
+        added += (size_t)kolibri_symbol_table_load_mapping(table, codepoint, code);
+        pos += 7U + width;
+    }
+    return added;
+}
+
+/* SYMBOL_MAP blocks of older genomes, one mapping each. */
+static size_t kolibri_symbol_table_load_map(KolibriSymbolTable *table, const char *payload) {
+    unsigned int d0 = 0U;
+    unsigned int d1 = 0U;
+    unsigned int d2 = 0U;
+    uint32_t codepoint = 0U;
+    const char *separator = strchr(payload, '|');
+    if (separator) {
+        size_t cp_len = (size_t)(separator - payload);
+        if (cp_len == 0U || cp_len >= 16U) {
+            return 0U;
+        }
+        char buffer[16];
+        memcpy(buffer, payload, cp_len);
+        buffer[cp_len] = '\0';
+        char *endptr = NULL;
+        unsigned long value = strtoul(buffer, &endptr, 10);
+        if (!endptr || *endptr != '\0' || value > 0x10FFFFUL) {
+            return 0U;
+        }
+        if (strlen(separator + 1) < 3U) {
+            return 0U;
+        }
+        const char *digits_str = separator + 1;
+        if (digits_str[0] < '0' || digits_str[0] > '9' ||
+            digits_str[1] < '0' || digits_str[1] > '9' ||
+            digits_str[2] < '0' || digits_str[2] > '9') {
+            return 0U;
+        }
+        d0 = (unsigned int)(digits_str[0] - '0');
+        d1 = (unsigned int)(digits_str[1] - '0');
+        d2 = (unsigned int)(digits_str[2] - '0');
+        codepoint = (uint32_t)value;
+    } else {
+        unsigned int ascii = 0U;
+        if (sscanf(payload, "%03u%1u%1u%1u", &ascii, &d0, &d1, &d2) != 4) {
+            return 0U;
+        }
+        codepoint = (uint32_t)ascii;
+    }
+    uint32_t code = d0 * 100U + d1 * 10U + d2;
+    if (code >= KOLIBRI_SYMBOL_ESCAPE) {
+        return 0U;
+    }
+    return (size_t)kolibri_symbol_table_load_mapping(table, codepoint, code);
+}
+
 void kolibri_symbol_table_load(KolibriSymbolTable *table) {
     if (!table || !table->genome || !table->genome->file) {
         return;
     }
     KolibriGenome *ctx = table->genome;
-    long original_pos = ftell(ctx->file);
-    if (original_pos < 0) {
-        original_pos = 0;
-    }
-    if (fseek(ctx->file, 0, SEEK_SET) != 0) {
+    /* The reader decodes both genome formats from the file on disk. */
+    KolibriGenomeReader reader;
+    if (fflush(ctx->file) != 0 || kg_reader_open(&reader, ctx->path) != 0) {
         return;
     }
-    unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-    while (fread(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file) == KOLIBRI_BLOCK_SIZE) {
+    uint64_t start = kolibri_symbol_snapshot_read(table, &reader);
+    size_t replayed = 0U;
+    for (uint64_t i = start; i < reader.block_count; ++i) {
         ReasonBlock block;
-        symbol_deserialize(bytes, &block);
-        if (strncmp(block.event_type, "SYMBOL_MAP", KOLIBRI_EVENT_TYPE_SIZE) != 0) {
+        if (kg_read_block(&reader, i, &block) != 0) {
             continue;
         }
         char payload[KOLIBRI_PAYLOAD_SIZE + 1];
         memcpy(payload, block.payload, KOLIBRI_PAYLOAD_SIZE);
         payload[KOLIBRI_PAYLOAD_SIZE] = '\0';
-        unsigned int d0 = 0U;
-        unsigned int d1 = 0U;
-        unsigned int d2 = 0U;
-        uint32_t codepoint = 0U;
-        const char *separator = strchr(payload, '|');
-        if (separator) {
-            size_t cp_len = (size_t)(separator - payload);
-            if (cp_len == 0U || cp_len >= 16U) {
-                continue;
-            }
-            char buffer[16];
-            memcpy(buffer, payload, cp_len);
-            buffer[cp_len] = '\0';
-            char *endptr = NULL;
-            unsigned long value = strtoul(buffer, &endptr, 10);
-            if (!endptr || *endptr != '\0' || value > 0x10FFFFUL) {
-                continue;
-            }
-            if (strlen(separator + 1) < 3U) {
-                continue;
-            }
-            const char *digits_str = separator + 1;
-            if (digits_str[0] < '0' || digits_str[0] > '9' ||
-                digits_str[1] < '0' || digits_str[1] > '9' ||
-                digits_str[2] < '0' || digits_str[2] > '9') {
-                continue;
-            }
-            d0 = (unsigned int)(digits_str[0] - '0');
-            d1 = (unsigned int)(digits_str[1] - '0');
-            d2 = (unsigned int)(digits_str[2] - '0');
-            codepoint = (uint32_t)value;
-        } else {
-            unsigned int ascii = 0U;
-            if (sscanf(payload, "%03u%1u%1u%1u", &ascii, &d0, &d1, &d2) != 4) {
-                continue;
-            }
-            codepoint = (uint32_t)ascii;
+        if (strncmp(block.event_type, "SYMBOL_BATCH", KOLIBRI_EVENT_TYPE_SIZE) == 0) {
+            replayed += kolibri_symbol_table_load_batch(table, payload);
+        } else if (strncmp(block.event_type, "SYMBOL_MAP", KOLIBRI_EVENT_TYPE_SIZE) == 0) {
+            replayed += kolibri_symbol_table_load_map(table, payload);
         }
-        uint8_t digits[KOLIBRI_SYMBOL_DIGITS] = { (uint8_t)d0, (uint8_t)d1, (uint8_t)d2 };
-        if (kolibri_symbol_table_find(table, codepoint) >= 0) {
-            continue;
+    }
+    table->logged = table->count;
+    if (replayed > 0U && reader.block_count > 0U) {
+        ReasonBlock last;
+        if (kg_read_block(&reader, reader.block_count - 1U, &last) == 0) {
+            (void)kolibri_symbol_snapshot_write(table, reader.block_count, last.hmac);
         }
-        kolibri_symbol_table_add_entry(table, codepoint, digits, 0);
     }
-    fseek(ctx->file, original_pos, SEEK_SET);
+    kg_reader_close(&reader);
 }
 
 void kolibri_symbol_table_seed_defaults(KolibriSymbolTable *table) {
@@ -208,45 +581,59 @@ void kolibri_symbol_table_seed_defaults(KolibriSymbolTable *table) {
     for (uint32_t letter = 0x0436; letter <= 0x044F; ++letter) {
         kolibri_symbol_table_seed_entry(table, letter);
     }
+    (void)kolibri_symbol_table_flush(table);
 }
 
-static void kolibri_symbol_table_next_digits(KolibriSymbolTable *table,
-                                             uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]) {
-    size_t index = table->count;
-    /* простое последовательное распределение */
-    out_digits[0] = (uint8_t)((index / 100U) % 10U);
-    out_digits[1] = (uint8_t)((index / 10U) % 10U);
-    out_digits[2] = (uint8_t)(index % 10U);
-}
-
-int kolibri_symbol_encode(KolibriSymbolTable *table,
-                          uint32_t codepoint,
-                          uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]) {
+int kolibri_symbol_encode_var(KolibriSymbolTable *table, uint32_t codepoint,
+                              uint8_t *out_digits, size_t out_len) {
     if (!table || !out_digits) {
         return -1;
     }
     int index = kolibri_symbol_table_find(table, codepoint);
-    if (index >= 0) {
-        memcpy(out_digits, table->entries[index].digits, KOLIBRI_SYMBOL_DIGITS);
-        return 0;
+    if (index < 0) {
+        index = kolibri_symbol_table_assign(table, codepoint);
+        if (index < 0) {
+            return -1;
+        }
     }
-    uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
-    kolibri_symbol_table_next_digits(table, digits);
-    kolibri_symbol_table_add_entry(table, codepoint, digits, 1);
-    memcpy(out_digits, digits, KOLIBRI_SYMBOL_DIGITS);
-    return 0;
+    uint8_t digits[KOLIBRI_SYMBOL_DIGITS_MAX];
+    size_t width = kolibri_symbol_code_digits(table->entries[index].code, digits);
+    if (width > out_len) {
+        return -1;
+    }
+    memcpy(out_digits, digits, width);
+    return (int)width;
 }
 
-int kolibri_symbol_decode(const KolibriSymbolTable *table,
-                          const uint8_t digits[KOLIBRI_SYMBOL_DIGITS],
-                          uint32_t *out_codepoint) {
+int kolibri_symbol_decode_var(const KolibriSymbolTable *table, const uint8_t *digits,
+                              size_t len, uint32_t *out_codepoint) {
     if (!table || !digits || !out_codepoint) {
         return -1;
     }
-    int index = kolibri_symbol_table_find_digits(table, digits);
+    uint32_t code = 0U;
+    size_t width = kolibri_symbol_parse_code(digits, len, &code);
+    int index = width ? kolibri_symbol_table_find_code(table, code) : -1;
     if (index < 0) {
         return -1;
     }
     *out_codepoint = table->entries[index].codepoint;
-    return 0;
+    return (int)width;
+}
+
+int kolibri_symbol_encode(KolibriSymbolTable *table,
+                          uint32_t codepoint,
+                          uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]) {
+    return kolibri_symbol_encode_var(table, codepoint, out_digits, KOLIBRI_SYMBOL_DIGITS) ==
+                   (int)KOLIBRI_SYMBOL_DIGITS
+               ? 0
+               : -1;
+}
+
+int kolibri_symbol_decode(const KolibriSymbolTable *table,
+                          const uint8_t digits[KOLIBRI_SYMBOL_DIGITS],
+                          uint32_t *out_codepoint) {
+    return kolibri_symbol_decode_var(table, digits, KOLIBRI_SYMBOL_DIGITS, out_codepoint) ==
+                   (int)KOLIBRI_SYMBOL_DIGITS
+               ? 0
+               : -1;
 }
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/trace.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} KolibriTraceEvent;
+
+/*
+ * One ring per recording thread. Only its owner writes it; the lock is
+ * uncontended except while a start or an export walks the rings. A ring
+ * whose thread has exited keeps its spans for the export and is handed to
+ * a new thread once a start has emptied it.
+ */
+typedef struct KolibriTraceRing {
+    struct KolibriTraceRing *next;
+    pthread_mutex_t lock;
+    KolibriTraceEvent *events;
+    size_t capacity;
+    uint64_t written;
+    uint32_t tid;
+    int owned;
+} KolibriTraceRing;
+
+atomic_int kolibri_trace_active = 0;
+
+static pthread_mutex_t trace_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static KolibriTraceRing *trace_rings = NULL;
+static size_t trace_capacity = KOLIBRI_TRACE_DEFAULT_CAPACITY;
+static uint64_t trace_origin_ns = 0U;
+static uint32_t trace_next_tid = 1U;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static _Thread_local KolibriTraceRing *trace_ring = NULL;
+
+static void trace_ring_release(void *arg) {
+    KolibriTraceRing *ring = (KolibriTraceRing *)arg;
+    pthread_mutex_lock(&trace_registry_lock);
+    ring->owned = 0;
+    pthread_mutex_unlock(&trace_registry_lock);
+}
+
+static void trace_key_create(void) {
+    (void)pthread_key_create(&trace_key, trace_ring_release);
+}
+
+/* Resizes an emptied ring to the current capacity; callers hold both locks. */
+static int trace_ring_fit(KolibriTraceRing *ring) {
+    if (ring->capacity != trace_capacity) {
+        KolibriTraceEvent *events = (KolibriTraceEvent *)malloc(trace_capacity * sizeof(KolibriTraceEvent));
+        if (!events) {
+            return -1;
+        }
+        free(ring->events);
+        ring->events = events;
+        ring->capacity = trace_capacity;
+    }
+    return 0;
+}
+
+static KolibriTraceRing *trace_ring_adopt(void) {
+    pthread_once(&trace_key_once, trace_key_create);
+    pthread_mutex_lock(&trace_registry_lock);
+    KolibriTraceRing *ring = trace_rings;
+    while (ring && (ring->owned || ring->written != 0U)) {
+        ring = ring->next;
+    }
+    if (!ring) {
+        ring = (KolibriTraceRing *)calloc(1U, sizeof(KolibriTraceRing));
+        if (!ring) {
+            pthread_mutex_unlock(&trace_registry_lock);
+            return NULL;
+        }
+        pthread_mutex_init(&ring->lock, NULL);
+        ring->next = trace_rings;
+        trace_rings = ring;
+    }
+    pthread_mutex_lock(&ring->lock);
+    int fit = trace_ring_fit(ring);
+    pthread_mutex_unlock(&ring->lock);
+    if (fit != 0) {
+        pthread_mutex_unlock(&trace_registry_lock);
+        return NULL;
+    }
+    ring->owned = 1;
+    ring->tid = trace_next_tid++;
+    pthread_mutex_unlock(&trace_registry_lock);
+    (void)pthread_setspecific(trace_key, ring);
+    return ring;
+}
+
+uint64_t kolibri_trace_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+int kolibri_trace_start(size_t capacity) {
+    if (capacity == 0U) {
+        capacity = KOLIBRI_TRACE_DEFAULT_CAPACITY;
+    }
+    if (capacity > SIZE_MAX / sizeof(KolibriTraceEvent)) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace_registry_lock);
+    trace_capacity = capacity;
+    int status = 0;
+    for (KolibriTraceRing *ring = trace_rings; ring; ring = ring->next) {
+        pthread_mutex_lock(&ring->lock);
+        ring->written = 0U;
+        if (trace_ring_fit(ring) != 0) {
+            status = -1;
+        }
+        pthread_mutex_unlock(&ring->lock);
+    }
+    trace_origin_ns = kolibri_trace_now_ns();
+    atomic_store(&kolibri_trace_active, status == 0);
+    pthread_mutex_unlock(&trace_registry_lock);
+    return status;
+}
+
+void kolibri_trace_stop(void) {
+    atomic_store(&kolibri_trace_active, 0);
+}
+
+const char *kolibri_trace_start_from_env(void) {
+    const char *path = getenv("KOLIBRI_TRACE");
+    if (!path || path[0] == '\0' || kolibri_trace_start(0U) != 0) {
+        return NULL;
+    }
+    return path;
+}
+
+void kolibri_trace_complete(const char *name, uint64_t start_ns, uint64_t end_ns) {
+    if (!kolibri_trace_on() || !name) {
+        return;
+    }
+    KolibriTraceRing *ring = trace_ring;
+    if (!ring) {
+        ring = trace_ring_adopt();
+        if (!ring) {
+            return;
+        }
+        trace_ring = ring;
+    }
+    pthread_mutex_lock(&ring->lock);
+    KolibriTraceEvent *event = &ring->events[ring->written % ring->capacity];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns > start_ns ? end_ns - start_ns : 0U;
+    ring->written++;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+size_t kolibri_trace_span_count(void) {
+    size_t total = 0U;
+    pthread_mutex_lock(&trace_registry_lock);
+    for (KolibriTraceRing *ring = trace_rings; ring; ring = ring->next) {
+        pthread_mutex_lock(&ring->lock);
+        total += ring->written < ring->capacity ? (size_t)ring->written : ring->capacity;
+        pthread_mutex_unlock(&ring->lock);
+    }
+    pthread_mutex_unlock(&trace_registry_lock);
+    return total;
+}
+
+uint64_t kolibri_trace_dropped(void) {
+    uint64_t dropped = 0U;
+    pthread_mutex_lock(&trace_registry_lock);
+    for (KolibriTraceRing *ring = trace_rings; ring; ring = ring->next) {
+        pthread_mutex_lock(&ring->lock);
+        if (ring->written > ring->capacity) {
+            dropped += ring->written - ring->capacity;
+        }
+        pthread_mutex_unlock(&ring->lock);
+    }
+    pthread_mutex_unlock(&trace_registry_lock);
+    return dropped;
+}
+
+static void trace_write_name(FILE *out, const char *name) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20U) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static double trace_micros(uint64_t start_ns, uint64_t origin_ns) {
+    return start_ns >= origin_ns ? (double)(start_ns - origin_ns) / 1000.0
+                                 : -(double)(origin_ns - start_ns) / 1000.0;
+}
+
+int kolibri_trace_write_json(FILE *out) {
+    if (!out) {
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(out,
+            "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"kolibri\"}}",
+            pid);
+    pthread_mutex_lock(&trace_registry_lock);
+    uint64_t origin = trace_origin_ns;
+    for (KolibriTraceRing *ring = trace_rings; ring; ring = ring->next) {
+        pthread_mutex_lock(&ring->lock);
+        if (ring->written > 0U) {
+            fprintf(out,
+                    ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread-%u\"}}",
+                    pid,
+                    ring->tid,
+                    ring->tid);
+        }
+        uint64_t first = ring->written > ring->capacity ? ring->written - ring->capacity : 0U;
+        for (uint64_t i = first; i < ring->written; ++i) {
+            const KolibriTraceEvent *event = &ring->events[i % ring->capacity];
+            fputs(",\n{\"name\":", out);
+            trace_write_name(out, event->name);
+            fprintf(out,
+                    ",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    pid,
+                    ring->tid,
+                    trace_micros(event->start_ns, origin),
+                    (double)event->duration_ns / 1000.0);
+        }
+        pthread_mutex_unlock(&ring->lock);
+    }
+    pthread_mutex_unlock(&trace_registry_lock);
+    fputs("\n]}\n", out);
+    return ferror(out) ? -1 : 0;
+}
+
+int kolibri_trace_write_file(const char *path) {
+    if (!path) {
+        return -1;
+    }
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return -1;
+    }
+    int status = kolibri_trace_write_json(out);
+    if (fclose(out) != 0) {
+        status = -1;
+    }
+    return status;
+}
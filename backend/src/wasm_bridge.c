@@ -1,5 +1,7 @@
 #define _GNU_SOURCE
 
+#include "kolibri/wasm_bridge.h"
+
 #include "kolibri/formula.h"
 #include "kolibri/script.h"
 
@@ -8,10 +10,27 @@
 #include <stdlib.h>
 #include <string.h>
 
-static KolibriFormulaPool g_pool;
-static KolibriScript g_script;
-static int g_bridge_ready = 0;
-static KolibriScriptControls g_controls = {
+#define BRIDGE_POOL_SEED 424242ULL
+#define BRIDGE_SLOTS_MAX 0xffffu
+
+/* The pool lives on its embedded storage, so a context is never moved. */
+typedef struct {
+    KolibriFormulaPool pool;
+    KolibriScript script;
+    KolibriScriptControls controls;
+} BridgeContext;
+
+typedef struct {
+    BridgeContext *context;
+    uint16_t generation;
+} BridgeSlot;
+
+static BridgeSlot *g_slots = NULL;
+static uint32_t g_slot_count = 0u;
+/* The context behind the handle-less kolibri_bridge_* functions. */
+static uint32_t g_default_handle = 0u;
+
+static const KolibriScriptControls bridge_default_controls = {
     .lambda_b = 0.25,
     .lambda_d = 0.2,
     .target_b = NAN,
@@ -21,48 +40,103 @@ static KolibriScriptControls g_controls = {
     .cf_beam = 1,
 };
 
-static int bridge_ensure_initialized(void) {
-    if (g_bridge_ready) {
-        return 0;
+static BridgeContext *bridge_lookup(uint32_t handle) {
+    uint32_t slot = handle & 0xffffu;
+    if (slot == 0u || slot > g_slot_count) {
+        return NULL;
     }
+    const BridgeSlot *entry = &g_slots[slot - 1u];
+    return entry->generation == (uint16_t)(handle >> 16u) ? entry->context : NULL;
+}
 
-    kf_pool_init(&g_pool, 424242ULL);
-    if (ks_init(&g_script, &g_pool, NULL) != 0) {
+static int bridge_start_script(BridgeContext *context) {
+    if (ks_init(&context->script, &context->pool, NULL) != 0) {
         return -1;
     }
-    if (ks_set_controls(&g_script, &g_controls) != 0) {
-        return -1;
+    return ks_set_controls(&context->script, &context->controls);
+}
+
+uint32_t kolibri_bridge_new(void) {
+    uint32_t slot = 0u;
+    while (slot < g_slot_count && g_slots[slot].context) {
+        ++slot;
+    }
+    if (slot == g_slot_count) {
+        if (g_slot_count == BRIDGE_SLOTS_MAX) {
+            return 0u;
+        }
+        uint32_t count = g_slot_count ? g_slot_count * 2u : 4u;
+        if (count > BRIDGE_SLOTS_MAX) {
+            count = BRIDGE_SLOTS_MAX;
+        }
+        BridgeSlot *slots = (BridgeSlot *)realloc(g_slots, count * sizeof(BridgeSlot));
+        if (!slots) {
+            return 0u;
+        }
+        memset(slots + g_slot_count, 0, (count - g_slot_count) * sizeof(BridgeSlot));
+        g_slots = slots;
+        g_slot_count = count;
     }
+    BridgeContext *context = (BridgeContext *)malloc(sizeof(BridgeContext));
+    if (!context) {
+        return 0u;
+    }
+    kf_pool_init(&context->pool, BRIDGE_POOL_SEED);
+    context->controls = bridge_default_controls;
+    if (bridge_start_script(context) != 0) {
+        ks_free(&context->script);
+        free(context);
+        return 0u;
+    }
+    g_slots[slot].context = context;
+    return ((uint32_t)g_slots[slot].generation << 16u) | (slot + 1u);
+}
 
-    g_bridge_ready = 1;
-    return 0;
+void kolibri_bridge_free(uint32_t handle) {
+    BridgeContext *context = bridge_lookup(handle);
+    if (!context) {
+        return;
+    }
+    BridgeSlot *entry = &g_slots[(handle & 0xffffu) - 1u];
+    entry->context = NULL;
+    entry->generation++;
+    ks_free(&context->script);
+    free(context);
 }
 
-int kolibri_bridge_init(void) {
-    g_bridge_ready = 0;
-    return bridge_ensure_initialized();
+int kolibri_bridge_reset_handle(uint32_t handle) {
+    BridgeContext *context = bridge_lookup(handle);
+    if (!context) {
+        return -1;
+    }
+    ks_free(&context->script);
+    kf_pool_init(&context->pool, BRIDGE_POOL_SEED);
+    return bridge_start_script(context);
 }
 
-int kolibri_bridge_reset(void) {
-    if (g_bridge_ready) {
-        ks_free(&g_script);
-        g_bridge_ready = 0;
+int kolibri_bridge_reset_script_handle(uint32_t handle) {
+    BridgeContext *context = bridge_lookup(handle);
+    if (!context) {
+        return -1;
     }
-    return bridge_ensure_initialized();
+    ks_free(&context->script);
+    return bridge_start_script(context);
 }
 
-int kolibri_bridge_configure(int lambda_b_milli,
-                             int lambda_d_milli,
-                             int target_b_milli,
-                             int target_d_milli,
-                             int temperature_milli,
-                             int top_k,
-                             int enable_cf_beam) {
-    if (bridge_ensure_initialized() != 0) {
+int kolibri_bridge_configure_handle(uint32_t handle,
+                                    int lambda_b_milli,
+                                    int lambda_d_milli,
+                                    int target_b_milli,
+                                    int target_d_milli,
+                                    int temperature_milli,
+                                    int top_k,
+                                    int enable_cf_beam) {
+    BridgeContext *context = bridge_lookup(handle);
+    if (!context) {
         return -1;
     }
 
-    KolibriScriptControls next = g_controls;
+    KolibriScriptControls next = context->controls;
     next.lambda_b = (double)lambda_b_milli / 1000.0;
     next.lambda_d = (double)lambda_d_milli / 1000.0;
     next.target_b = target_b_milli < 0 ? NAN : (double)target_b_milli / 1000.0;
@@ -71,19 +145,22 @@ int kolibri_bridge_configure(int lambda_b_milli,
     next.top_k = top_k > 0 ? (double)top_k : 1.0;
     next.cf_beam = enable_cf_beam ? 1 : 0;
 
-    g_controls = next;
-    return ks_set_controls(&g_script, &g_controls);
+    context->controls = next;
+    return ks_set_controls(&context->script, &context->controls);
 }
 
-int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t out_capacity) {
+int kolibri_bridge_execute_handle(uint32_t handle, const char *program_utf8,
+                                  char *out_buffer, size_t out_capacity) {
     if (!program_utf8 || !out_buffer || out_capacity == 0) {
         return -5;
     }
 
-    if (bridge_ensure_initialized() != 0) {
+    BridgeContext *context = bridge_lookup(handle);
+    if (!context) {
         out_buffer[0] = '\0';
         return -1;
     }
+    KolibriScript *script = &context->script;
 
     FILE *sink = NULL;
 #if defined(__EMSCRIPTEN__)
@@ -98,23 +175,23 @@ int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t ou
         return -2;
     }
 
-    ks_set_output(&g_script, sink);
-    if (ks_load_text(&g_script, program_utf8) != 0) {
+    ks_set_output(script, sink);
+    if (ks_load_text(script, program_utf8) != 0) {
         fclose(sink);
 #if defined(__EMSCRIPTEN__)
         free(sink_buffer);
 #endif
-        ks_set_output(&g_script, stdout);
+        ks_set_output(script, stdout);
         out_buffer[0] = '\0';
         return -3;
     }
 
-    if (ks_execute(&g_script) != 0) {
+    if (ks_execute(script) != 0) {
         fclose(sink);
 #if defined(__EMSCRIPTEN__)
         free(sink_buffer);
 #endif
-        ks_set_output(&g_script, stdout);
+        ks_set_output(script, stdout);
         out_buffer[0] = '\0';
         return -4;
     }
@@ -122,7 +199,7 @@ int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t ou
     fflush(sink);
 #if defined(__EMSCRIPTEN__)
     fclose(sink);
-    ks_set_output(&g_script, stdout);
+    ks_set_output(script, stdout);
 
     size_t copy = sink_size < (out_capacity - 1U) ? sink_size : (out_capacity - 1U);
     if (copy > 0U) {
@@ -135,7 +212,7 @@ int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t ou
 #else
     if (fseek(sink, 0L, SEEK_SET) != 0) {
         fclose(sink);
-        ks_set_output(&g_script, stdout);
+        ks_set_output(script, stdout);
         out_buffer[0] = '\0';
         return -2;
     }
@@ -144,12 +221,54 @@ int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t ou
     out_buffer[written] = '\0';
 
     fclose(sink);
-    ks_set_output(&g_script, stdout);
+    ks_set_output(script, stdout);
 
     return (int)written;
 #endif
 }
 
+uint32_t kolibri_bridge_handle(void) {
+    if (!bridge_lookup(g_default_handle) && kolibri_bridge_init() != 0) {
+        return 0u;
+    }
+    return g_default_handle;
+}
+
+int kolibri_bridge_init(void) {
+    kolibri_bridge_free(g_default_handle);
+    g_default_handle = kolibri_bridge_new();
+    return g_default_handle ? 0 : -1;
+}
+
+int kolibri_bridge_reset(void) {
+    return kolibri_bridge_reset_handle(kolibri_bridge_handle());
+}
+
+int kolibri_bridge_reset_script(void) {
+    return kolibri_bridge_reset_script_handle(kolibri_bridge_handle());
+}
+
+int kolibri_bridge_configure(int lambda_b_milli,
+                             int lambda_d_milli,
+                             int target_b_milli,
+                             int target_d_milli,
+                             int temperature_milli,
+                             int top_k,
+                             int enable_cf_beam) {
+    return kolibri_bridge_configure_handle(kolibri_bridge_handle(),
+                                           lambda_b_milli,
+                                           lambda_d_milli,
+                                           target_b_milli,
+                                           target_d_milli,
+                                           temperature_milli,
+                                           top_k,
+                                           enable_cf_beam);
+}
+
+int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t out_capacity) {
+    return kolibri_bridge_execute_handle(kolibri_bridge_handle(), program_utf8, out_buffer, out_capacity);
+}
+
 int kolibri_bridge_has_simd(void) {
 #if defined(KOLIBRI_USE_WASM_SIMD) && defined(__wasm_simd128__)
     return 1;
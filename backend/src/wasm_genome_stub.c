@@ -18,6 +18,30 @@ int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload, R
     return 0;
 }
 
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEntry *entries, size_t count, ReasonBlock *out_blocks) {
+    (void)ctx;
+    (void)entries;
+    (void)count;
+    (void)out_blocks;
+    return 0;
+}
+
+void kg_set_sync_policy(KolibriGenome *ctx, const KolibriGenomeSyncPolicy *policy) {
+    (void)ctx;
+    (void)policy;
+}
+
+int kg_sync(KolibriGenome *ctx) {
+    (void)ctx;
+    return 0;
+}
+
+int kg_set_format(KolibriGenome *ctx, int format) {
+    (void)ctx;
+    (void)format;
+    return -1;
+}
+
 int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key, size_t key_len) {
     (void)ctx;
     (void)path;
@@ -26,6 +50,12 @@ int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key, size
     return -1;
 }
 
+int kg_open_ex(KolibriGenome *ctx, const char *path, const unsigned char *key, size_t key_len,
+               const KolibriGenomeVerifyOptions *options) {
+    (void)options;
+    return kg_open(ctx, path, key, key_len);
+}
+
 void kg_close(KolibriGenome *ctx) {
     (void)ctx;
 }
@@ -37,6 +67,85 @@ int kg_verify_file(const char *path, const unsigned char *key, size_t key_len) {
     return -1;
 }
 
+int kg_verify_file_ex(const char *path, const unsigned char *key, size_t key_len,
+                      const KolibriGenomeVerifyOptions *options) {
+    (void)options;
+    return kg_verify_file(path, key, key_len);
+}
+
+int kg_open_segmented(KolibriGenome *ctx, const char *dir, const unsigned char *key,
+                      size_t key_len, uint64_t segment_blocks) {
+    (void)segment_blocks;
+    return kg_open(ctx, dir, key, key_len);
+}
+
+int kg_segments_load(const char *dir, const unsigned char *key, size_t key_len,
+                     KolibriGenomeSegment **out_segments, size_t *out_count) {
+    (void)dir;
+    (void)key;
+    (void)key_len;
+    if (out_segments) {
+        *out_segments = NULL;
+    }
+    if (out_count) {
+        *out_count = 0;
+    }
+    return -1;
+}
+
+int kg_verify_segmented(const char *dir, const unsigned char *key, size_t key_len,
+                        const KolibriGenomeVerifyOptions *options) {
+    (void)options;
+    return kg_verify_file(dir, key, key_len);
+}
+
+int kg_compact(const char *dir, const unsigned char *key, size_t key_len,
+               size_t keep_segments) {
+    (void)dir;
+    (void)key;
+    (void)key_len;
+    (void)keep_segments;
+    return -1;
+}
+
+int kg_reader_open(KolibriGenomeReader *reader, const char *path) {
+    (void)reader;
+    (void)path;
+    return -1;
+}
+
+void kg_reader_close(KolibriGenomeReader *reader) {
+    (void)reader;
+}
+
+int kg_read_block(const KolibriGenomeReader *reader, uint64_t index, ReasonBlock *out_block) {
+    (void)reader;
+    (void)index;
+    (void)out_block;
+    return -1;
+}
+
+int kg_follow_open(KolibriGenomeFollower *follower, const char *path, const unsigned char *key,
+                   size_t key_len, uint64_t start_index) {
+    (void)follower;
+    (void)path;
+    (void)key;
+    (void)key_len;
+    (void)start_index;
+    return -1;
+}
+
+int kg_follow(KolibriGenomeFollower *follower, ReasonBlock *out_block, int timeout_ms) {
+    (void)follower;
+    (void)out_block;
+    (void)timeout_ms;
+    return -1;
+}
+
+void kg_follow_close(KolibriGenomeFollower *follower) {
+    (void)follower;
+}
+
 int kg_encode_payload(const char *utf8, char *out, size_t out_len) {
     if (!out || out_len == 0) {
         return -1;
@@ -23,16 +23,66 @@ bits 32
 global kolibri_boot_entry
 extern kolibri_kernel_main
 
+CR0_MP equ 1 << 1
+CR0_EM equ 1 << 2
+CR0_TS equ 1 << 3
+CR0_NE equ 1 << 5
+CR4_OSFXSR equ 1 << 9
+CR4_OSXMMEXCPT equ 1 << 10
+CPUID_FXSR equ 1 << 24
+CPUID_SSE2 equ 1 << 26
+
 kolibri_boot_entry:
     cli
     mov esp, stack_top
-    push ebx                 ; multiboot_info
-    push eax                 ; multiboot_magic
+    mov esi, eax             ; cpuid портит eax и ebx
+    mov edi, ebx
+
+    ; Ядро собрано с SSE2: без FXSR/SSE2 дальше идти нельзя
+    mov eax, 1
+    cpuid
+    and edx, CPUID_FXSR | CPUID_SSE2
+    cmp edx, CPUID_FXSR | CPUID_SSE2
+    jne net_sse
+
+    ; FPU без эмуляции, ошибки через #MF; FXSAVE и исключения SSE включены
+    mov eax, cr0
+    and eax, ~(CR0_EM | CR0_TS)
+    or eax, CR0_MP | CR0_NE
+    mov cr0, eax
+    mov eax, cr4
+    or eax, CR4_OSFXSR | CR4_OSXMMEXCPT
+    mov cr4, eax
+    fninit
+    ldmxcsr [mxcsr_nachalnyj]
+
+    ; ABI i386 с SSE: перед call стек выровнен на 16
+    sub esp, 8
+    push edi                 ; multiboot_info
+    push esi                 ; multiboot_magic
     call kolibri_kernel_main
 petlya_zavison:
     hlt
     jmp petlya_zavison
 
+net_sse:
+    mov esi, soobshenie_net_sse
+    mov edi, 0xB8000
+.simvol:
+    lodsb
+    test al, al
+    jz petlya_zavison
+    mov ah, 0x0C
+    stosw
+    jmp .simvol
+
+SECTION .rodata
+align 4
+mxcsr_nachalnyj:
+    dd 0x1F80                ; все исключения SSE замаскированы
+soobshenie_net_sse:
+    db "Kolibri OS: CPU without SSE2/FXSR is not supported", 0
+
 SECTION .bss
 align 16
 stack_nachalo:
@@ -1,4 +1,5 @@
 #include "kolibri/formula.h"
+#include "kolibri/formula_batch.h"
 
 #include "support.h"
 
@@ -36,15 +37,18 @@ static double evaluate_formula(const KolibriFormula *formula, const KolibriFormu
     if (decode_coefficients(&formula->gene, &slope, &bias) != 0) {
         return 0.0;
     }
-    double total_error = 0.0;
-    for (size_t i = 0; i < pool->examples; ++i) {
-        int prediction = slope * pool->inputs[i] + bias;
-        int diff = prediction - pool->targets[i];
-        if (diff < 0) {
-            diff = -diff;
-        }
-        total_error += (double)diff;
+    // Векторное ядро общее с бэкендом; хвост и большие входы — скалярно
+    KolibriBatchSums sums = {0, 0, 0};
+    size_t done = 0U;
+    if (pool->input_peak <= KOLIBRI_BATCH_LINEAR_PEAK) {
+        done = kolibri_batch_apply_vec4(slope, bias, 0, pool->inputs, pool->targets, pool->examples, &sums);
+    }
+    for (size_t i = done; i < pool->examples; ++i) {
+        int64_t prediction = (int64_t)slope * pool->inputs[i] + bias;
+        int64_t diff = prediction - pool->targets[i];
+        sums.abs_error += diff < 0 ? -diff : diff;
     }
+    double total_error = (double)sums.abs_error;
     double normalized = 1.0 / (1.0 + total_error);
     double adjusted = normalized + formula->feedback;
     if (adjusted < 0.0) {
@@ -84,6 +88,7 @@ void kf_pool_clear_examples(KolibriFormulaPool *pool) {
         return;
     }
     pool->examples = 0U;
+    pool->input_peak = 0U;
 }
 
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target) {
@@ -93,6 +98,10 @@ int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target) {
     pool->inputs[pool->examples] = input;
     pool->targets[pool->examples] = target;
     ++pool->examples;
+    uint32_t magnitude = input < 0 ? 0U - (uint32_t)input : (uint32_t)input;
+    if (magnitude > pool->input_peak) {
+        pool->input_peak = magnitude;
+    }
     return 0;
 }
 
@@ -140,6 +149,42 @@ void kf_pool_tick(KolibriFormulaPool *pool, size_t generations) {
     evaluate_pool(pool);
 }
 
+static int pool_holds_gene(const KolibriFormulaPool *pool, const KolibriGene *gene) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        if (pool->formulas[i].gene.length == gene->length &&
+            k_memcmp(pool->formulas[i].gene.digits, gene->digits, gene->length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+size_t kf_pool_immigrate(KolibriFormulaPool *pool, const KolibriFormula *migrants, size_t count) {
+    if (!pool || !migrants || pool->count == 0U) {
+        return 0U;
+    }
+    size_t accepted = 0U;
+    for (size_t m = 0; m < count; ++m) {
+        if (migrants[m].gene.length == 0U || migrants[m].gene.length > sizeof(migrants[m].gene.digits) ||
+            pool_holds_gene(pool, &migrants[m].gene)) {
+            continue;
+        }
+        // Мигрант занимает место слабейшей формулы
+        size_t weakest = 0U;
+        for (size_t i = 1; i < pool->count; ++i) {
+            if (pool->formulas[i].fitness < pool->formulas[weakest].fitness) {
+                weakest = i;
+            }
+        }
+        KolibriFormula *slot = &pool->formulas[weakest];
+        k_memcpy(&slot->gene, &migrants[m].gene, sizeof(slot->gene));
+        slot->feedback = 0.0;
+        slot->fitness = evaluate_formula(slot, pool);
+        accepted++;
+    }
+    return accepted;
+}
+
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool) {
     if (!pool || pool->count == 0U) {
         return NULL;
@@ -1,5 +1,6 @@
 #include "kolibri/genome.h"
 
+#include "ramdisk.h"
 #include "support.h"
 
 typedef struct {
@@ -8,25 +9,20 @@ typedef struct {
     char payload[KOLIBRI_PAYLOAD_SIZE];
 } GenomeRecord;
 
-int kg_open(KolibriGenome *ctx, uint8_t *storage, size_t capacity) {
-    if (!ctx || !storage || capacity < sizeof(GenomeRecord)) {
+int kg_open(KolibriGenome *ctx) {
+    if (!ctx) {
         return -1;
     }
-    ctx->data = storage;
-    ctx->capacity = capacity;
-    ctx->size = 0U;
+    ctx->open = 0;
     ctx->next_index = 0U;
-
-    size_t offset = 0U;
-    while (offset + sizeof(GenomeRecord) <= capacity) {
-        const GenomeRecord *record = (const GenomeRecord *)(storage + offset);
-        if (record->event_type[0] == '\0') {
-            break;
-        }
-        ctx->size = offset + sizeof(GenomeRecord);
-        ctx->next_index = record->index + 1U;
-        offset += sizeof(GenomeRecord);
+    if (ramdisk_open((uint32_t)sizeof(GenomeRecord)) < 0) {
+        return -1;
     }
+    // Хвост журнала берётся из заголовка хранилища, без сканирования
+    if (ramdisk_record_count() > 0U) {
+        ctx->next_index = ramdisk_last_index() + 1U;
+    }
+    ctx->open = 1;
     return 0;
 }
 
@@ -34,53 +30,51 @@ void kg_close(KolibriGenome *ctx) {
     if (!ctx) {
         return;
     }
-    ctx->data = NULL;
-    ctx->size = 0U;
-    ctx->capacity = 0U;
+    ctx->open = 0;
     ctx->next_index = 0U;
 }
 
 int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload, ReasonBlock *out_block) {
-    if (!ctx || !ctx->data || !event_type || !payload) {
+    if (!ctx || !ctx->open || !event_type || !payload) {
         return -1;
     }
-    if (ctx->size + sizeof(GenomeRecord) > ctx->capacity) {
+    GenomeRecord record;
+    k_memset(&record, 0, sizeof(record));
+    record.index = ctx->next_index;
+    k_strlcpy(record.event_type, event_type, sizeof(record.event_type));
+    k_strlcpy(record.payload, payload, sizeof(record.payload));
+    if (ramdisk_append(&record, record.index) != 0) {
         return -1;
     }
-    GenomeRecord *record = (GenomeRecord *)(ctx->data + ctx->size);
-    k_memset(record, 0, sizeof(*record));
-    record->index = ctx->next_index++;
-    k_strlcpy(record->event_type, event_type, sizeof(record->event_type));
-    k_strlcpy(record->payload, payload, sizeof(record->payload));
-    ctx->size += sizeof(GenomeRecord);
-
-    if (ctx->size + sizeof(GenomeRecord) <= ctx->capacity) {
-        GenomeRecord *sentinel = (GenomeRecord *)(ctx->data + ctx->size);
-        k_memset(sentinel, 0, sizeof(*sentinel));
-    }
+    ctx->next_index++;
 
     if (out_block) {
-        out_block->index = record->index;
-        k_strlcpy(out_block->event_type, record->event_type, sizeof(out_block->event_type));
-        k_strlcpy(out_block->payload, record->payload, sizeof(out_block->payload));
+        out_block->index = record.index;
+        k_strlcpy(out_block->event_type, record.event_type, sizeof(out_block->event_type));
+        k_strlcpy(out_block->payload, record.payload, sizeof(out_block->payload));
     }
     return 0;
 }
 
 int kg_replay(const KolibriGenome *ctx, ReasonBlock *out_block, uint32_t index) {
-    if (!ctx || !ctx->data || !out_block) {
+    if (!ctx || !ctx->open || !out_block) {
         return -1;
     }
-    size_t offset = 0U;
-    while (offset + sizeof(GenomeRecord) <= ctx->size) {
-        const GenomeRecord *record = (const GenomeRecord *)(ctx->data + offset);
-        if (record->index == index) {
-            out_block->index = record->index;
-            k_strlcpy(out_block->event_type, record->event_type, sizeof(out_block->event_type));
-            k_strlcpy(out_block->payload, record->payload, sizeof(out_block->payload));
-            return 0;
-        }
-        offset += sizeof(GenomeRecord);
+    // Индексы идут подряд, поэтому блок записи находится по смещению от старейшей
+    uint32_t live = ramdisk_live_blocks();
+    if (live == 0U) {
+        return -1;
+    }
+    uint32_t oldest = ramdisk_last_index() - (live - 1U);
+    if (index - oldest >= live) {
+        return -1;
     }
-    return -1;
+    const GenomeRecord *record = (const GenomeRecord *)ramdisk_block(index - oldest);
+    if (!record || record->index != index) {
+        return -1;
+    }
+    out_block->index = record->index;
+    k_strlcpy(out_block->event_type, record->event_type, sizeof(out_block->event_type));
+    k_strlcpy(out_block->payload, record->payload, sizeof(out_block->payload));
+    return 0;
 }
@@ -3,17 +3,29 @@ SECTION .text
 bits 32
 global isr_timer
 global isr_keyboard
+global isr_serial
 extern obrabotat_tajmer
 extern obrabotat_klaviaturu
+extern obrabotat_serial
 
-isr_timer:
+; Обработчики на C собраны с SSE2, поэтому состояние FPU/SSE прерванного
+; кода сохраняется FXSAVE в выровненной области стека и восстанавливается
+; перед возвратом. Стек выравнивается на 16 перед вызовом по ABI i386.
+%macro ISR_STUB 2
+%1:
     pusha
-    call obrabotat_tajmer
+    mov ebp, esp
+    and esp, -16
+    sub esp, 512
+    fxsave [esp]
+    cld
+    call %2
+    fxrstor [esp]
+    mov esp, ebp
     popa
     iretd
+%endmacro
 
-isr_keyboard:
-    pusha
-    call obrabotat_klaviaturu
-    popa
-    iretd
+ISR_STUB isr_timer, obrabotat_tajmer
+ISR_STUB isr_keyboard, obrabotat_klaviaturu
+ISR_STUB isr_serial, obrabotat_serial
@@ -24,6 +24,7 @@ typedef struct {
     int inputs[32];
     int targets[32];
     size_t examples;
+    uint32_t input_peak; /* max |input| среди примеров */
 } KolibriFormulaPool;
 
 void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed);
@@ -31,6 +32,8 @@ void kf_pool_clear_examples(KolibriFormulaPool *pool);
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target);
 void kf_pool_tick(KolibriFormulaPool *pool, size_t generations);
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool);
+/* Меняет слабейшие формулы на мигрантов, которых в пуле ещё нет. */
+size_t kf_pool_immigrate(KolibriFormulaPool *pool, const KolibriFormula *migrants, size_t count);
 int kf_formula_apply(const KolibriFormula *formula, int input, int *output);
 size_t kf_formula_digits(const KolibriFormula *formula, uint8_t *out, size_t out_len);
 int kf_formula_describe(const KolibriFormula *formula, char *buffer, size_t buffer_len);
@@ -6,16 +6,48 @@
 
 #define KOLIBRI_SLIP_MAX_PAYLOAD 256U
 
+#define KOLIBRI_SLIP_MAX_GENE 32U
+
 typedef struct {
     uint16_t local_port;
     uint16_t remote_port;
     uint8_t remote_ip[4];
     uint8_t tx_buffer[KOLIBRI_SLIP_MAX_PAYLOAD + 32U];
+    /* Кадр SLIP в сборке: байты после декодирования экранирования. */
+    uint8_t rx_buffer[KOLIBRI_SLIP_MAX_PAYLOAD];
+    size_t rx_length;
+    int rx_escape;
+    int rx_discard;        /* кадр испорчен или не влез: отбросить на END */
+    uint32_t frames_received;
+    uint32_t frames_rejected;
+    uint32_t frames_dropped; /* не поместились в очередь передачи */
 } KolibriSlipUdp;
 
+typedef enum {
+    KN_PACKET_HELLO = 1,
+    KN_PACKET_GENE = 2
+} KolibriSlipPacketType;
+
+/* Сообщение роя: HELLO:<node> или GENE:<node>:<цифры>. */
+typedef struct {
+    KolibriSlipPacketType type;
+    uint32_t node_id;
+    uint8_t digits[KOLIBRI_SLIP_MAX_GENE];
+    size_t length;
+    uint8_t source_ip[4];
+    uint16_t source_port;
+} KolibriSlipPacket;
+
 void kn_slip_udp_init(KolibriSlipUdp *ctx, uint16_t local_port);
 void kn_slip_udp_set_remote(KolibriSlipUdp *ctx, const uint8_t ip[4], uint16_t port);
-void kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length);
-void kn_slip_udp_send_hello(KolibriSlipUdp *ctx, uint32_t node_id);
+/* Кадр уходит в очередь передачи целиком; -1, если места нет и кадр отброшен. */
+int kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length);
+int kn_slip_udp_send_hello(KolibriSlipUdp *ctx, uint32_t node_id);
+int kn_slip_udp_send_gene(KolibriSlipUdp *ctx, uint32_t node_id, const uint8_t *digits, size_t length);
+/*
+ * Разбирает принятые байты, не ожидая новых. 1 — в out готовое сообщение
+ * для local_port, 0 — принятое кончилось. Битые и чужие кадры пропускаются.
+ */
+int kn_slip_udp_poll(KolibriSlipUdp *ctx, KolibriSlipPacket *out);
 
 #endif /* KOLIBRI_KERNEL_NET_H */
@@ -28,6 +28,17 @@
 
 #define PIT_PORT_KANAL0 0x40U
 #define PIT_PORT_KOMANDA 0x43U
+#define PIT_CHASTOTA_GC 100U
+
+/*
+ * Планировщик эволюции: длина среза, период отчёта и период записи генома
+ * в тиках PIT, а также число поколений между проверками таймера.
+ */
+#define KOLIBRI_SREZ_TIKOV 5U
+#define KOLIBRI_OTCHET_TIKOV PIT_CHASTOTA_GC
+#define KOLIBRI_KOMMIT_TIKOV (10U * PIT_CHASTOTA_GC)
+#define KOLIBRI_POKOLENIJ_ZA_SHAG 8U
+#define KOLIBRI_GOSSIP_TIKOV (5U * PIT_CHASTOTA_GC)
 
 struct gdt_zapis {
     uint16_t limit_nizkij;
@@ -60,12 +71,16 @@ static volatile uint16_t *vga_okno = VGA_ADRES;
 static size_t vga_poziciya = 0U;
 static struct gdt_zapis gdt_tablica[3];
 static struct idt_zapis idt_tablica[256];
-static uint64_t schetchik_tickov = 0ULL;
+/* 32-битное чтение атомарно; разности беззнаковые и переживают переполнение. */
+static volatile uint32_t schetchik_tickov = 0U;
 
 static KolibriFormulaPool kernel_pool;
 static KolibriSlipUdp net_interface;
+static bool net_ready = false;
+static uint32_t kernel_node_id = 0U;
 static KolibriGenome genome_context;
 static bool genome_ready = false;
+static double genome_best_fitness = 0.0;
 
 struct KolibriBootConfig {
     uint32_t seed;
@@ -76,6 +91,7 @@ struct KolibriBootConfig {
 
 extern void isr_timer(void);
 extern void isr_keyboard(void);
+extern void isr_serial(void);
 
 static void serial_state(const char *message) {
     serial_write_string("[STATE] ");
@@ -175,7 +191,27 @@ static void kolibri_print_gene(const KolibriGene *gene) {
     serial_write_char('\n');
 }
 
-static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
+/* Дописывает лучшую формулу в геном, если она лучше записанной, и сбрасывает RAM-диск. */
+static void kolibri_commit_best(const KolibriFormula *best, const char *event_type) {
+    if (!genome_ready || !best) {
+        return;
+    }
+    if (best->fitness > genome_best_fitness) {
+        char payload[128];
+        if (kf_formula_describe(best, payload, sizeof(payload)) != 0) {
+            k_strlcpy(payload, "unknown", sizeof(payload));
+        }
+        if (kg_append(&genome_context, event_type, payload, NULL) == 0) {
+            genome_best_fitness = best->fitness;
+            serial_state("genome.append");
+        } else {
+            serial_state("genome.append_failed");
+        }
+    }
+    ramdisk_commit();
+}
+
+static bool kolibri_autopilot(const struct KolibriBootConfig *cfg) {
     uint32_t seed = cfg && cfg->seed != 0U ? cfg->seed : 20250923U;
     uint32_t node_id = cfg && cfg->node_id != 0U ? cfg->node_id : 1U;
     uint16_t listen_port = cfg ? cfg->listen_port : 0U;
@@ -184,15 +220,12 @@ static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
     serial_state_value("seed", seed);
     serial_state_value("node", node_id);
 
-    ramdisk_init();
     genome_ready = false;
-    if (kg_open(&genome_context, ramdisk_data(), ramdisk_capacity()) == 0) {
+    if (kg_open(&genome_context) == 0) {
         genome_ready = true;
-        genome_context.size = ramdisk_size();
-        if (genome_context.size > genome_context.capacity) {
-            genome_context.size = 0U;
-        }
         serial_state_value("genome.entries", genome_context.next_index);
+        serial_state_value("genome.live", ramdisk_live_blocks());
+        serial_state_value("genome.blocks", ramdisk_block_count());
         vga_pechat_stroku("[Kolibri] genome entries: ");
         vga_pechat_chislo_u32(genome_context.next_index);
         vga_pechat_stroku("\n");
@@ -221,7 +254,7 @@ static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
     if (!best) {
         vga_pechat_stroku("[Kolibri] pool empty\n");
         serial_state("pool.empty");
-        return;
+        return false;
     }
 
     char description[128];
@@ -243,28 +276,106 @@ static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
         serial_state_value("preview", (uint32_t)preview);
     }
 
-    if (genome_ready) {
-        char payload[128];
-        if (kf_formula_describe(best, payload, sizeof(payload)) != 0) {
-            k_strlcpy(payload, "unknown", sizeof(payload));
-        }
-        if (kg_append(&genome_context, "AUTOPILOT", payload, NULL) == 0) {
-            serial_state("genome.append");
-        }
-        ramdisk_commit(genome_context.size);
-        kg_close(&genome_context);
-    }
+    genome_best_fitness = -1.0;
+    kolibri_commit_best(best, "AUTOPILOT");
 
     if (listen_port != 0U) {
         vga_pechat_stroku("[Kolibri] swarm bootstrap\n");
         kn_slip_udp_init(&net_interface, listen_port);
-        kn_slip_udp_send_hello(&net_interface, node_id);
-        serial_state("network.hello_sent");
+        net_ready = true;
+        kernel_node_id = node_id;
+        if (kn_slip_udp_send_hello(&net_interface, node_id) == 0) {
+            serial_state("network.hello_sent");
+        }
     } else {
         serial_state("network.disabled");
     }
 
     serial_state("autopilot.done");
+    return true;
+}
+
+/* Разбирает принятые кадры роя: гены идут в пул мигрантами. */
+static void kolibri_swarm_poll(void) {
+    KolibriSlipPacket packet;
+    while (kn_slip_udp_poll(&net_interface, &packet) == 1) {
+        if (packet.type == KN_PACKET_HELLO) {
+            serial_state_value("swarm.hello", packet.node_id);
+            continue;
+        }
+        if (packet.node_id == kernel_node_id) {
+            continue;
+        }
+        KolibriFormula migrant;
+        k_memset(&migrant, 0, sizeof(migrant));
+        k_memcpy(migrant.gene.digits, packet.digits, packet.length);
+        migrant.gene.length = packet.length;
+        if (kf_pool_immigrate(&kernel_pool, &migrant, 1U) == 1U) {
+            serial_state_value("swarm.gene_from", packet.node_id);
+        }
+    }
+}
+
+/* Рассылает лучший ген; при занятом порте кадр просто пропускается. */
+static void kolibri_swarm_gossip(void) {
+    const KolibriFormula *best = kf_pool_best(&kernel_pool);
+    if (best) {
+        (void)kn_slip_udp_send_gene(&net_interface, kernel_node_id, best->gene.digits, best->gene.length);
+    }
+}
+
+/* Сообщает скорость эволюции: поколений в секунду и всего. */
+static void kolibri_report_rate(uint32_t pokolenij, uint32_t okno, uint32_t vsego) {
+    uint32_t v_sekundu = pokolenij / okno * PIT_CHASTOTA_GC +
+                         pokolenij % okno * PIT_CHASTOTA_GC / okno;
+    serial_write_string("[RATE ] gen/s=");
+    serial_write_dec32(v_sekundu);
+    serial_write_string(" total=");
+    serial_write_dec32(vsego);
+    serial_write_char('\n');
+}
+
+/*
+ * Планировщик: бесконечная эволюция срезами по KOLIBRI_SREZ_TIKOV тиков.
+ * Таймер лишь отмеряет срезы, поколения считаются вне прерывания, так что
+ * обработчики остаются короткими, а процессор не простаивает.
+ */
+static void kolibri_scheduler_run(void) {
+    uint32_t pokolenij_vsego = 0U;
+    uint32_t pokolenij_v_okne = 0U;
+    uint32_t start_okna = schetchik_tickov;
+    uint32_t poslednij_kommit = start_okna;
+    uint32_t poslednij_gossip = start_okna;
+
+    serial_state("scheduler.start");
+    serial_state_value("scheduler.slice_ticks", KOLIBRI_SREZ_TIKOV);
+    for (;;) {
+        uint32_t start_sreza = schetchik_tickov;
+        do {
+            kf_pool_tick(&kernel_pool, KOLIBRI_POKOLENIJ_ZA_SHAG);
+            pokolenij_v_okne += KOLIBRI_POKOLENIJ_ZA_SHAG;
+        } while (schetchik_tickov - start_sreza < KOLIBRI_SREZ_TIKOV);
+
+        uint32_t sejchas = schetchik_tickov;
+        uint32_t okno = sejchas - start_okna;
+        if (okno >= KOLIBRI_OTCHET_TIKOV) {
+            pokolenij_vsego += pokolenij_v_okne;
+            kolibri_report_rate(pokolenij_v_okne, okno, pokolenij_vsego);
+            pokolenij_v_okne = 0U;
+            start_okna = sejchas;
+        }
+        if (net_ready) {
+            kolibri_swarm_poll();
+            if (sejchas - poslednij_gossip >= KOLIBRI_GOSSIP_TIKOV) {
+                kolibri_swarm_gossip();
+                poslednij_gossip = sejchas;
+            }
+        }
+        if (sejchas - poslednij_kommit >= KOLIBRI_KOMMIT_TIKOV) {
+            kolibri_commit_best(kf_pool_best(&kernel_pool), "EVOLVE");
+            poslednij_kommit = sejchas;
+        }
+    }
 }
 
 /* Создаёт запись GDT с заданными параметрами. */
@@ -314,13 +425,14 @@ static void zapolnit_idt_zapis(int nomer, uint32_t baza, uint16_t selektor,
     zapis->baza_verh = (uint16_t)((baza >> 16U) & 0xFFFFU);
 }
 
-/* Настраивает IDT и подключает обработчики таймера и клавиатуры. */
+/* Настраивает IDT и подключает обработчики таймера, клавиатуры и COM1. */
 static void nastroit_idt(void) {
     for (int indeks = 0; indeks < 256; ++indeks) {
         zapolnit_idt_zapis(indeks, 0U, 0x08U, 0x8EU);
     }
     zapolnit_idt_zapis(32, (uint32_t)isr_timer, 0x08U, 0x8EU);
     zapolnit_idt_zapis(33, (uint32_t)isr_keyboard, 0x08U, 0x8EU);
+    zapolnit_idt_zapis(36, (uint32_t)isr_serial, 0x08U, 0x8EU);
 
     struct idt_registr reg;
     reg.limit = sizeof(idt_tablica) - 1U;
@@ -350,13 +462,13 @@ static void nastroit_pic(void) {
     zapisat_port8(PIC1_PORT_DANNYE, 0x01U);
     zapisat_port8(PIC2_PORT_DANNYE, 0x01U);
 
-    zapisat_port8(PIC1_PORT_DANNYE, mask1 & ~0x03U);
+    zapisat_port8(PIC1_PORT_DANNYE, mask1 & ~0x13U);
     zapisat_port8(PIC2_PORT_DANNYE, mask2 & ~0x00U);
 }
 
 /* Настраивает программируемый таймер на частоту 100 Гц. */
 static void nastroit_pit(void) {
-    uint16_t delitel = 1193180U / 100U;
+    uint16_t delitel = 1193180U / PIT_CHASTOTA_GC;
     zapisat_port8(PIT_PORT_KOMANDA, 0x36U);
     zapisat_port8(PIT_PORT_KANAL0, (uint8_t)(delitel & 0xFFU));
     zapisat_port8(PIT_PORT_KANAL0, (uint8_t)((delitel >> 8U) & 0xFFU));
@@ -373,7 +485,7 @@ static void preobrazovat_bajt_v_hex(uint8_t znachenie, char *vyhod) {
 /* Обработчик аппаратного таймера. */
 void obrabotat_tajmer(void) {
     ++schetchik_tickov;
-    if (((uint32_t)schetchik_tickov % 100U) == 0U) {
+    if ((schetchik_tickov % PIT_CHASTOTA_GC) == 0U) {
         vga_pechat_stroku("[TICK]\n");
     }
     poslati_eoi(0U);
@@ -390,9 +502,14 @@ void obrabotat_klaviaturu(void) {
     poslati_eoi(1U);
 }
 
+/* Обработчик прерывания COM1: кольца приёма и передачи UART. */
+void obrabotat_serial(void) {
+    serial_handle_irq();
+    poslati_eoi(4U);
+}
+
 /* Точка входа ядра Kolibri OS после загрузчика GRUB. */
 void kolibri_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
-    (void)multiboot_info;
     serial_init(3U);
     serial_state("boot.enter");
     vga_ochistit();
@@ -405,17 +522,26 @@ void kolibri_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
         }
     }
 
+    if (ramdisk_init((const void *)(uintptr_t)multiboot_info)) {
+        serial_state_value("ramdisk.module", (uint32_t)ramdisk_region_size());
+    } else {
+        serial_state_value("ramdisk.builtin", (uint32_t)ramdisk_region_size());
+    }
+
     nastroit_gdt();
     nastroit_idt();
     nastroit_pic();
     nastroit_pit();
+    serial_enable_irq();
 
     vga_pechat_stroku("Прерывания активируются...\n");
     __asm__ __volatile__("sti");
     serial_state("interrupts.enabled");
 
     const struct KolibriBootConfig *config = (const struct KolibriBootConfig *)0x00008000U;
-    kolibri_autopilot(config);
+    if (kolibri_autopilot(config)) {
+        kolibri_scheduler_run();
+    }
 
     for (;;) {
         __asm__ __volatile__("hlt");
@@ -10,16 +10,27 @@
 
 static const uint8_t LOCAL_IP[4] = {192U, 168U, 0U, 2U};
 
-static void slip_send_byte(uint8_t byte) {
-    if (byte == SLIP_END) {
-        serial_write_char((char)SLIP_ESC);
-        serial_write_char((char)SLIP_ESC_END);
-    } else if (byte == SLIP_ESC) {
-        serial_write_char((char)SLIP_ESC);
-        serial_write_char((char)SLIP_ESC_ESC);
-    } else {
-        serial_write_char((char)byte);
+#define IPV4_HEADER 20U
+#define UDP_HEADER 8U
+#define IP_PROTO_UDP 17U
+
+/* Кодирует пакет в кадр SLIP; худший случай — каждый байт экранирован. */
+static size_t slip_encode(const uint8_t *packet, size_t length, uint8_t *frame) {
+    size_t out = 0U;
+    frame[out++] = SLIP_END;
+    for (size_t i = 0; i < length; ++i) {
+        if (packet[i] == SLIP_END) {
+            frame[out++] = SLIP_ESC;
+            frame[out++] = SLIP_ESC_END;
+        } else if (packet[i] == SLIP_ESC) {
+            frame[out++] = SLIP_ESC;
+            frame[out++] = SLIP_ESC_ESC;
+        } else {
+            frame[out++] = packet[i];
+        }
     }
+    frame[out++] = SLIP_END;
+    return out;
 }
 
 static uint16_t ip_checksum(const uint8_t *data, size_t length) {
@@ -98,16 +109,19 @@ void kn_slip_udp_set_remote(KolibriSlipUdp *ctx, const uint8_t ip[4], uint16_t p
     ctx->remote_port = port;
 }
 
-void kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length) {
+int kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length) {
     if (!ctx || !payload || length == 0U) {
-        return;
+        return -1;
     }
+    uint8_t frame[2U * KOLIBRI_SLIP_MAX_PAYLOAD + 2U];
     size_t packet_len = build_ipv4_udp(ctx, payload, length, ctx->tx_buffer);
-    serial_write_char((char)SLIP_END);
-    for (size_t i = 0; i < packet_len; ++i) {
-        slip_send_byte(ctx->tx_buffer[i]);
+    size_t frame_len = slip_encode(ctx->tx_buffer, packet_len, frame);
+    // Госсип не ждёт порт: при полной очереди кадр теряется
+    if (serial_try_write(frame, frame_len) != 0) {
+        ctx->frames_dropped++;
+        return -1;
     }
-    serial_write_char((char)SLIP_END);
+    return 0;
 }
 
 static size_t u32_to_dec(uint32_t value, char *buffer, size_t buffer_len) {
@@ -135,12 +149,152 @@ static size_t u32_to_dec(uint32_t value, char *buffer, size_t buffer_len) {
     return written;
 }
 
-void kn_slip_udp_send_hello(KolibriSlipUdp *ctx, uint32_t node_id) {
+int kn_slip_udp_send_hello(KolibriSlipUdp *ctx, uint32_t node_id) {
     if (!ctx) {
-        return;
+        return -1;
     }
     char message[64];
     k_strlcpy(message, "HELLO:", sizeof(message));
     u32_to_dec(node_id, message + 6, sizeof(message) - 6U);
-    kn_slip_udp_send(ctx, (const uint8_t *)message, k_strlen(message));
+    return kn_slip_udp_send(ctx, (const uint8_t *)message, k_strlen(message));
+}
+
+int kn_slip_udp_send_gene(KolibriSlipUdp *ctx, uint32_t node_id, const uint8_t *digits, size_t length) {
+    if (!ctx || !digits || length == 0U || length > KOLIBRI_SLIP_MAX_GENE) {
+        return -1;
+    }
+    char message[64];
+    k_strlcpy(message, "GENE:", sizeof(message));
+    size_t used = 5U;
+    used += u32_to_dec(node_id, message + used, sizeof(message) - used) - 1U;
+    message[used++] = ':';
+    for (size_t i = 0; i < length; ++i) {
+        message[used++] = (char)('0' + digits[i] % 10U);
+    }
+    return kn_slip_udp_send(ctx, (const uint8_t *)message, used);
+}
+
+/* Разбирает десятичное число до разделителя; -1 при пустом или переполнении. */
+static int parse_u32(const uint8_t *text, size_t length, size_t *pos, uint32_t *out) {
+    uint32_t value = 0U;
+    size_t start = *pos;
+    while (*pos < length && text[*pos] >= '0' && text[*pos] <= '9') {
+        uint32_t digit = (uint32_t)(text[*pos] - '0');
+        if (value > (0xFFFFFFFFU - digit) / 10U) {
+            return -1;
+        }
+        value = value * 10U + digit;
+        ++*pos;
+    }
+    if (*pos == start) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+static int parse_message(const uint8_t *text, size_t length, KolibriSlipPacket *out) {
+    size_t pos = 0U;
+    if (length > 6U && k_memcmp(text, "HELLO:", 6U) == 0) {
+        pos = 6U;
+        if (parse_u32(text, length, &pos, &out->node_id) != 0 || pos != length) {
+            return -1;
+        }
+        out->type = KN_PACKET_HELLO;
+        out->length = 0U;
+        return 0;
+    }
+    if (length > 5U && k_memcmp(text, "GENE:", 5U) == 0) {
+        pos = 5U;
+        if (parse_u32(text, length, &pos, &out->node_id) != 0 || pos >= length || text[pos] != ':') {
+            return -1;
+        }
+        ++pos;
+        size_t count = length - pos;
+        if (count == 0U || count > KOLIBRI_SLIP_MAX_GENE) {
+            return -1;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t c = text[pos + i];
+            if (c < '0' || c > '9') {
+                return -1;
+            }
+            out->digits[i] = (uint8_t)(c - '0');
+        }
+        out->type = KN_PACKET_GENE;
+        out->length = count;
+        return 0;
+    }
+    return -1;
+}
+
+/* Проверяет IPv4/UDP-обёртку кадра и разбирает сообщение для local_port. */
+static int parse_frame(const KolibriSlipUdp *ctx, const uint8_t *frame, size_t length,
+                       KolibriSlipPacket *out) {
+    if (length < IPV4_HEADER + UDP_HEADER || (frame[0] >> 4U) != 4U) {
+        return -1;
+    }
+    size_t ihl = (size_t)(frame[0] & 0x0FU) * 4U;
+    size_t total = ((size_t)frame[2] << 8) | frame[3];
+    if (ihl < IPV4_HEADER || total > length || total < ihl + UDP_HEADER ||
+        frame[9] != IP_PROTO_UDP || ip_checksum(frame, ihl) != 0U) {
+        return -1;
+    }
+    const uint8_t *udp = frame + ihl;
+    uint16_t dst_port = (uint16_t)((udp[2] << 8) | udp[3]);
+    size_t udp_len = ((size_t)udp[4] << 8) | udp[5];
+    if (dst_port != ctx->local_port || udp_len < UDP_HEADER || udp_len > total - ihl) {
+        return -1;
+    }
+    if (parse_message(udp + UDP_HEADER, udp_len - UDP_HEADER, out) != 0) {
+        return -1;
+    }
+    k_memcpy(out->source_ip, &frame[12], 4U);
+    out->source_port = (uint16_t)((udp[0] << 8) | udp[1]);
+    return 0;
+}
+
+int kn_slip_udp_poll(KolibriSlipUdp *ctx, KolibriSlipPacket *out) {
+    if (!ctx || !out) {
+        return 0;
+    }
+    char c;
+    while (serial_read_char(&c) == 0) {
+        uint8_t byte = (uint8_t)c;
+        if (byte == SLIP_END) {
+            size_t length = ctx->rx_length;
+            int discard = ctx->rx_discard;
+            ctx->rx_length = 0U;
+            ctx->rx_escape = 0;
+            ctx->rx_discard = 0;
+            if (length == 0U) {
+                continue; /* разделитель между кадрами */
+            }
+            if (!discard && parse_frame(ctx, ctx->rx_buffer, length, out) == 0) {
+                ctx->frames_received++;
+                return 1;
+            }
+            ctx->frames_rejected++;
+            continue;
+        }
+        if (ctx->rx_escape) {
+            ctx->rx_escape = 0;
+            if (byte == SLIP_ESC_END) {
+                byte = SLIP_END;
+            } else if (byte == SLIP_ESC_ESC) {
+                byte = SLIP_ESC;
+            } else {
+                ctx->rx_discard = 1;
+            }
+        } else if (byte == SLIP_ESC) {
+            ctx->rx_escape = 1;
+            continue;
+        }
+        if (ctx->rx_length < sizeof(ctx->rx_buffer)) {
+            ctx->rx_buffer[ctx->rx_length++] = byte;
+        } else {
+            ctx->rx_discard = 1;
+        }
+    }
+    return 0;
 }
@@ -3,51 +3,172 @@
 #include "support.h"
 
 #define RAMDISK_MAGIC 0x4B4F474EU /* 'KOGN' */
+#define RAMDISK_VERSION 2U
+#define RAMDISK_DATA_OFFSET 64U
 
-static uint8_t ramdisk_buffer[KOLIBRI_RAMDISK_SIZE];
-static size_t ramdisk_used = 0U;
-
-void ramdisk_init(void) {
-    uint32_t stored_magic = 0U;
-    k_memcpy(&stored_magic, ramdisk_buffer, sizeof(stored_magic));
-    if (stored_magic != RAMDISK_MAGIC) {
-        k_memset(ramdisk_buffer, 0, sizeof(ramdisk_buffer));
-        stored_magic = RAMDISK_MAGIC;
-        k_memcpy(ramdisk_buffer, &stored_magic, sizeof(stored_magic));
-        ramdisk_used = 0U;
-    } else {
-        k_memcpy(&ramdisk_used, ramdisk_buffer + sizeof(stored_magic), sizeof(ramdisk_used));
-        if (ramdisk_used > KOLIBRI_RAMDISK_SIZE - sizeof(stored_magic) - sizeof(ramdisk_used)) {
-            ramdisk_used = 0U;
-        }
+#define MULTIBOOT2_TAG_END 0U
+#define MULTIBOOT2_TAG_MODULE 3U
+
+struct multiboot2_tag {
+    uint32_t type;
+    uint32_t size;
+};
+
+struct multiboot2_tag_module {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start;
+    uint32_t mod_end;
+    char cmdline[];
+};
+
+static uint8_t ramdisk_buffer[KOLIBRI_RAMDISK_SIZE] __attribute__((aligned(16)));
+static uint8_t *ramdisk_base = ramdisk_buffer;
+static size_t ramdisk_size_bytes = KOLIBRI_RAMDISK_SIZE;
+static KolibriRamdiskHeader ramdisk_header;
+static int ramdisk_opened = 0;
+
+static uint32_t header_checksum(const KolibriRamdiskHeader *header) {
+    const uint8_t *bytes = (const uint8_t *)header;
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < offsetof(KolibriRamdiskHeader, checksum); ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static const struct multiboot2_tag_module *find_module(const void *multiboot_info) {
+    if (!multiboot_info) {
+        return NULL;
     }
-    size_t capacity = ramdisk_capacity();
-    if (ramdisk_used < capacity) {
-        k_memset(ramdisk_data() + ramdisk_used, 0, capacity - ramdisk_used);
+    const uint8_t *info = (const uint8_t *)multiboot_info;
+    uint32_t total_size = 0U;
+    k_memcpy(&total_size, info, sizeof(total_size));
+    const struct multiboot2_tag_module *first = NULL;
+    size_t offset = 8U;
+    while (offset + sizeof(struct multiboot2_tag) <= total_size) {
+        const struct multiboot2_tag *tag = (const struct multiboot2_tag *)(info + offset);
+        if (tag->type == MULTIBOOT2_TAG_END || tag->size < sizeof(struct multiboot2_tag)) {
+            break;
+        }
+        if (tag->type == MULTIBOOT2_TAG_MODULE && tag->size >= sizeof(struct multiboot2_tag_module)) {
+            const struct multiboot2_tag_module *module = (const struct multiboot2_tag_module *)tag;
+            if (module->mod_end > module->mod_start) {
+                if (tag->size > sizeof(*module) && k_strcmp(module->cmdline, "genome") == 0) {
+                    return module;
+                }
+                if (!first) {
+                    first = module;
+                }
+            }
+        }
+        offset += (tag->size + 7U) & ~7U;
     }
+    return first;
 }
 
-uint8_t *ramdisk_data(void) {
-    return ramdisk_buffer + sizeof(uint32_t) + sizeof(size_t);
+int ramdisk_init(const void *multiboot_info) {
+    const struct multiboot2_tag_module *module = find_module(multiboot_info);
+    ramdisk_opened = 0;
+    if (module && module->mod_end - module->mod_start > RAMDISK_DATA_OFFSET) {
+        ramdisk_base = (uint8_t *)(uintptr_t)module->mod_start;
+        ramdisk_size_bytes = module->mod_end - module->mod_start;
+        return 1;
+    }
+    ramdisk_base = ramdisk_buffer;
+    ramdisk_size_bytes = KOLIBRI_RAMDISK_SIZE;
+    return 0;
 }
 
-size_t ramdisk_capacity(void) {
-    return KOLIBRI_RAMDISK_SIZE - sizeof(uint32_t) - sizeof(size_t);
+int ramdisk_open(uint32_t block_size) {
+    if (block_size == 0U || ramdisk_size_bytes <= RAMDISK_DATA_OFFSET) {
+        return -1;
+    }
+    uint32_t blocks = (uint32_t)((ramdisk_size_bytes - RAMDISK_DATA_OFFSET) / block_size);
+    uint32_t segment = KOLIBRI_RAMDISK_SEGMENT_BLOCKS;
+    if (blocks < segment) {
+        segment = blocks;
+    }
+    if (segment == 0U) {
+        return -1;
+    }
+    blocks -= blocks % segment;
+
+    // Заголовок принимается, только если геометрия совпадает
+    KolibriRamdiskHeader stored;
+    k_memcpy(&stored, ramdisk_base, sizeof(stored));
+    if (stored.magic == RAMDISK_MAGIC && stored.version == RAMDISK_VERSION &&
+        stored.block_size == block_size && stored.block_count == blocks &&
+        stored.segment_blocks == segment && stored.head < blocks &&
+        stored.live <= blocks && stored.checksum == header_checksum(&stored)) {
+        ramdisk_header = stored;
+    } else {
+        k_memset(&ramdisk_header, 0, sizeof(ramdisk_header));
+        ramdisk_header.magic = RAMDISK_MAGIC;
+        ramdisk_header.version = RAMDISK_VERSION;
+        ramdisk_header.block_size = block_size;
+        ramdisk_header.block_count = blocks;
+        ramdisk_header.segment_blocks = segment;
+        ramdisk_opened = 1;
+        ramdisk_commit();
+        return 1;
+    }
+    ramdisk_opened = 1;
+    return 0;
 }
 
-size_t ramdisk_size(void) {
-    return ramdisk_used;
+int ramdisk_append(const void *block, uint32_t index) {
+    if (!ramdisk_opened || !block) {
+        return -1;
+    }
+    KolibriRamdiskHeader *header = &ramdisk_header;
+    if (header->live == header->block_count) {
+        // Кольцо полно: освобождаем старейший сегмент
+        header->head = (header->head + header->segment_blocks) % header->block_count;
+        header->live -= header->segment_blocks;
+    }
+    uint32_t slot = (header->head + header->live) % header->block_count;
+    k_memcpy(ramdisk_base + RAMDISK_DATA_OFFSET + (size_t)slot * header->block_size, block,
+             header->block_size);
+    header->live++;
+    header->record_count++;
+    header->last_index = index;
+    return 0;
 }
 
-void ramdisk_commit(size_t used_bytes) {
-    size_t capacity = ramdisk_capacity();
-    if (used_bytes > capacity) {
-        used_bytes = capacity;
+const void *ramdisk_block(uint32_t ordinal) {
+    if (!ramdisk_opened || ordinal >= ramdisk_header.live) {
+        return NULL;
     }
-    ramdisk_used = used_bytes;
-    k_memcpy(ramdisk_buffer, &(uint32_t){RAMDISK_MAGIC}, sizeof(uint32_t));
-    k_memcpy(ramdisk_buffer + sizeof(uint32_t), &ramdisk_used, sizeof(ramdisk_used));
-    if (ramdisk_used < capacity) {
-        k_memset(ramdisk_data() + ramdisk_used, 0, capacity - ramdisk_used);
+    uint32_t slot = (ramdisk_header.head + ordinal) % ramdisk_header.block_count;
+    return ramdisk_base + RAMDISK_DATA_OFFSET + (size_t)slot * ramdisk_header.block_size;
+}
+
+uint32_t ramdisk_live_blocks(void) {
+    return ramdisk_opened ? ramdisk_header.live : 0U;
+}
+
+uint32_t ramdisk_block_count(void) {
+    return ramdisk_opened ? ramdisk_header.block_count : 0U;
+}
+
+uint32_t ramdisk_record_count(void) {
+    return ramdisk_opened ? ramdisk_header.record_count : 0U;
+}
+
+uint32_t ramdisk_last_index(void) {
+    return ramdisk_opened ? ramdisk_header.last_index : 0U;
+}
+
+size_t ramdisk_region_size(void) {
+    return ramdisk_size_bytes;
+}
+
+void ramdisk_commit(void) {
+    if (!ramdisk_opened) {
+        return;
     }
+    ramdisk_header.checksum = header_checksum(&ramdisk_header);
+    k_memcpy(ramdisk_base, &ramdisk_header, sizeof(ramdisk_header));
 }
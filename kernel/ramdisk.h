@@ -4,12 +4,45 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define KOLIBRI_RAMDISK_SIZE 4096U
+/* Встроенная область на случай, когда загрузчик не передал модуль genome. */
+#define KOLIBRI_RAMDISK_SIZE 65536U
+#define KOLIBRI_RAMDISK_SEGMENT_BLOCKS 64U
 
-void ramdisk_init(void);
-uint8_t *ramdisk_data(void);
-size_t ramdisk_capacity(void);
-size_t ramdisk_size(void);
-void ramdisk_commit(size_t used_bytes);
+/*
+ * Блочное хранилище журнала: заголовок и кольцо блоков одного размера.
+ * Запись только дописывает блок в хвост; когда место кончается, старейший
+ * сегмент из KOLIBRI_RAMDISK_SEGMENT_BLOCKS блоков освобождается целиком.
+ * Хвост и счётчики лежат в заголовке, поэтому открытие не сканирует блоки.
+ * Дописанное видно сразу, а в заголовок области попадает при ramdisk_commit.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t block_count;    /* кратно segment_blocks */
+    uint32_t segment_blocks;
+    uint32_t head;           /* старейший живой блок */
+    uint32_t live;           /* живых блоков */
+    uint32_t record_count;   /* дописано за всё время */
+    uint32_t last_index;     /* метка последнего блока */
+    uint32_t checksum;
+} KolibriRamdiskHeader;
+
+/*
+ * Выбирает область: модуль Multiboot2 со строкой "genome" (или первый модуль),
+ * иначе встроенный буфер. Возвращает 1 для модуля, 0 для буфера.
+ */
+int ramdisk_init(const void *multiboot_info);
+/* Читает заголовок (0) или размечает область заново под блоки block_size (1). */
+int ramdisk_open(uint32_t block_size);
+int ramdisk_append(const void *block, uint32_t index);
+/* Живой блок по порядку, 0 — старейший; NULL вне диапазона. */
+const void *ramdisk_block(uint32_t ordinal);
+uint32_t ramdisk_live_blocks(void);
+uint32_t ramdisk_block_count(void);
+uint32_t ramdisk_record_count(void);
+uint32_t ramdisk_last_index(void);
+size_t ramdisk_region_size(void);
+void ramdisk_commit(void);
 
 #endif /* KOLIBRI_KERNEL_RAMDISK_H */
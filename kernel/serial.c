@@ -11,6 +11,35 @@ static inline uint8_t io_in8(uint16_t port) {
 }
 
 #define COM1_BASE 0x3F8U
+#define UART_FIFO_DEPTH 16U
+
+#define SERIAL_TX_SIZE 4096U
+#define SERIAL_RX_SIZE 1024U
+
+/*
+ * Кольца UART после serial_enable_irq: передачу ведёт основной поток, а
+ * прерывание THRE сливает её в FIFO; приём пишет прерывание, читает поток.
+ * У каждого кольца один писатель, поэтому хватает volatile-индексов.
+ */
+static uint8_t serial_tx_ring[SERIAL_TX_SIZE];
+static uint8_t serial_rx_ring[SERIAL_RX_SIZE];
+static volatile uint32_t serial_tx_head = 0U;
+static volatile uint32_t serial_tx_tail = 0U;
+static volatile uint32_t serial_rx_head = 0U;
+static volatile uint32_t serial_rx_tail = 0U;
+static volatile uint32_t serial_rx_dropped = 0U;
+static int serial_irq_enabled = 0;
+static int serial_tx_armed = 0; /* включено прерывание THRE */
+
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags) {
+    __asm__ __volatile__("push %0\n\tpopf" : : "r"(flags) : "memory", "cc");
+}
 
 void serial_init(uint32_t baud_divisor) {
     io_out8(COM1_BASE + 1U, 0x00U);
@@ -27,12 +56,116 @@ static void serial_wait_tx(void) {
     }
 }
 
+void serial_enable_irq(void) {
+    serial_tx_head = serial_tx_tail = 0U;
+    serial_rx_head = serial_rx_tail = 0U;
+    serial_irq_enabled = 1;
+    serial_tx_armed = 0;
+    /* Приём сразу, THRE — пока есть что передавать; OUT2 открывает линию IRQ4. */
+    io_out8(COM1_BASE + 4U, 0x0BU);
+    io_out8(COM1_BASE + 1U, 0x01U);
+}
+
+/* Переносит хвост передачи в FIFO; вызывается при запрещённых прерываниях. */
+static void serial_drain_tx(void) {
+    if ((io_in8(COM1_BASE + 5U) & 0x20U) == 0U) {
+        return;
+    }
+    for (uint32_t i = 0; i < UART_FIFO_DEPTH && serial_tx_tail != serial_tx_head; ++i) {
+        io_out8(COM1_BASE, serial_tx_ring[serial_tx_tail % SERIAL_TX_SIZE]);
+        serial_tx_tail++;
+    }
+    int armed = serial_tx_tail != serial_tx_head;
+    if (armed != serial_tx_armed) {
+        io_out8(COM1_BASE + 1U, armed ? 0x03U : 0x01U);
+        serial_tx_armed = armed;
+    }
+}
+
+void serial_handle_irq(void) {
+    for (;;) {
+        uint8_t iir = io_in8(COM1_BASE + 2U);
+        if (iir & 0x01U) {
+            break;
+        }
+        switch ((iir >> 1U) & 0x07U) {
+        case 0x02U: /* данные */
+        case 0x06U: /* тайм-аут FIFO */
+            while (io_in8(COM1_BASE + 5U) & 0x01U) {
+                uint8_t byte = io_in8(COM1_BASE);
+                if (serial_rx_head - serial_rx_tail < SERIAL_RX_SIZE) {
+                    serial_rx_ring[serial_rx_head % SERIAL_RX_SIZE] = byte;
+                    serial_rx_head++;
+                } else {
+                    serial_rx_dropped++;
+                }
+            }
+            break;
+        case 0x01U: /* THR пуст */
+            serial_drain_tx();
+            break;
+        case 0x03U:
+            (void)io_in8(COM1_BASE + 5U);
+            break;
+        default:
+            (void)io_in8(COM1_BASE + 6U);
+            break;
+        }
+    }
+}
+
+/* Кладёт байты в кольцо целиком; при нехватке места не пишет ничего. */
+static int serial_enqueue(const uint8_t *data, size_t length) {
+    uint32_t flags = irq_save();
+    if (SERIAL_TX_SIZE - (serial_tx_head - serial_tx_tail) < length) {
+        irq_restore(flags);
+        return -1;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        serial_tx_ring[serial_tx_head % SERIAL_TX_SIZE] = data[i];
+        serial_tx_head++;
+    }
+    if (!serial_tx_armed) {
+        serial_drain_tx();
+    }
+    irq_restore(flags);
+    return 0;
+}
+
+int serial_try_write(const uint8_t *data, size_t length) {
+    if (!data || length > SERIAL_TX_SIZE) {
+        return -1;
+    }
+    if (!serial_irq_enabled) {
+        for (size_t i = 0; i < length; ++i) {
+            serial_wait_tx();
+            io_out8(COM1_BASE, data[i]);
+        }
+        return 0;
+    }
+    return serial_enqueue(data, length);
+}
+
+static void serial_put_byte(uint8_t byte) {
+    if (!serial_irq_enabled) {
+        serial_wait_tx();
+        io_out8(COM1_BASE, byte);
+        return;
+    }
+    /* Журнал не теряется: при полном кольце ждём, пока FIFO освободит место. */
+    while (serial_enqueue(&byte, 1U) != 0) {
+        uint32_t flags = irq_save();
+        serial_wait_tx();
+        serial_drain_tx();
+        irq_restore(flags);
+    }
+}
+
 void serial_write_char(char c) {
     if (c == '\n') {
-        serial_write_char('\r');
+        serial_put_byte((uint8_t)'\r');
     }
-    serial_wait_tx();
-    io_out8(COM1_BASE, (uint8_t)c);
+    serial_put_byte((uint8_t)c);
 }
 
 void serial_write_string(const char *str) {
@@ -56,13 +189,36 @@ void serial_write_hex32(uint32_t value) {
     }
 }
 
+void serial_write_dec32(uint32_t value) {
+    char buffer[11];
+    size_t index = sizeof(buffer) - 1U;
+    buffer[index] = '\0';
+    do {
+        buffer[--index] = (char)('0' + (value % 10U));
+        value /= 10U;
+    } while (value != 0U && index > 0U);
+    serial_write_string(&buffer[index]);
+}
+
 int serial_read_char(char *out) {
     if (!out) {
         return -1;
     }
+    if (serial_irq_enabled) {
+        if (serial_rx_tail == serial_rx_head) {
+            return 1;
+        }
+        *out = (char)serial_rx_ring[serial_rx_tail % SERIAL_RX_SIZE];
+        serial_rx_tail++;
+        return 0;
+    }
     if ((io_in8(COM1_BASE + 5U) & 0x01U) == 0U) {
         return 1;
     }
     *out = (char)io_in8(COM1_BASE);
     return 0;
 }
+
+uint32_t serial_rx_overruns(void) {
+    return serial_rx_dropped;
+}
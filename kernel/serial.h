@@ -8,6 +8,15 @@ void serial_init(uint32_t baud_divisor);
 void serial_write_char(char c);
 void serial_write_string(const char *str);
 void serial_write_hex32(uint32_t value);
+void serial_write_dec32(uint32_t value);
+/* 0 — байт прочитан, 1 — данных нет. */
 int serial_read_char(char *out);
 
+/* Переводит порт на кольца и прерывания IRQ4; до этого ввод-вывод опросный. */
+void serial_enable_irq(void);
+void serial_handle_irq(void);
+/* Ставит блок в очередь передачи целиком или не ставит: 0 или -1. */
+int serial_try_write(const uint8_t *data, size_t length);
+uint32_t serial_rx_overruns(void);
+
 #endif /* KOLIBRI_KERNEL_SERIAL_H */
@@ -2,6 +2,7 @@
 #define OMEGA_ABSTRACTION_ENGINE_H
 
 #include "kolibri_omega/include/forward.h"
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -66,4 +67,95 @@ uint64_t omega_create_abstract_rule(kf_pool_t* formula_pool,
                                      omega_category_t* condition_category,
                                      omega_category_t* consequence_category);
 
+/**
+ * @brief Онлайн-кластеризация фактов в контексте агента.
+ *
+ * Признаки факта — хеши имён предикатов и пар «имя=значение». Ключи корзин
+ * LSH — OMEGA_STREAM_LSH_BANDS полос MinHash-подписи признаков и ключ схемы
+ * (набора имён предикатов); корзина помнит последнюю категорию с этим
+ * ключом. Новый факт сравнивается только с категориями своих корзин, поэтому
+ * назначение стоит O(1) в среднем, а центроид категории (сколько её членов
+ * несут каждый признак) обновляется на месте. Число категорий не ограничено.
+ * Каждые merge_interval фактов проход слияния сравнивает изменившиеся
+ * категории с соседями по корзинам их центроидов и сливает меньшую в
+ * большую; omega_stream_merge_categories запускает такой проход вне очереди,
+ * например в паузе между тактами.
+ */
+#define OMEGA_STREAM_LSH_BANDS 4
+#define OMEGA_STREAM_LSH_ROWS 2
+#define OMEGA_STREAM_CENTROID_FEATURES 16
+#define OMEGA_STREAM_MERGE_INTERVAL 64
+
+typedef struct {
+    double assign_threshold;  // сходство факта с центроидом для назначения, 0 — 0.5
+    double merge_threshold;   // сходство центроидов для слияния, 0 — 0.7
+    size_t merge_interval;    // фактов между проходами слияния, 0 — OMEGA_STREAM_MERGE_INTERVAL
+} omega_stream_cluster_config_t;
+
+typedef struct {
+    uint64_t feature;
+    double weight;  // членов с этим признаком; при вытеснении — оценка сверху
+} omega_stream_feature_t;
+
+/**
+ * @brief Категория потока. Центроид хранит OMEGA_STREAM_CENTROID_FEATURES
+ * самых частых признаков; заполненный центроид вытесняет самый лёгкий.
+ */
+typedef struct {
+    uint64_t id;
+    omega_category_type_t type;
+    char name[64];
+    uint64_t* members;
+    size_t member_count;
+    size_t member_capacity;
+    omega_stream_feature_t centroid[OMEGA_STREAM_CENTROID_FEATURES];
+    size_t feature_count;
+    double similarity_sum;  // сходство членов с центроидом при назначении
+    uint64_t merged_into;   // категория, поглотившая эту; 0 — живая
+} omega_stream_category_t;
+
+typedef struct {
+    uint64_t facts_assigned;
+    uint64_t categories_created;
+    uint64_t categories_merged;
+    uint64_t merge_passes;
+    uint64_t candidates_checked;  // сравнений с центроидами при назначении
+    size_t live_categories;
+} omega_stream_cluster_stats_t;
+
+/**
+ * @brief Включает онлайн-кластеризацию; config NULL — значения по умолчанию.
+ * Повторный вызов начинает кластеризацию заново.
+ */
+int omega_stream_clustering_init(omega_context_t* ctx, const omega_stream_cluster_config_t* config);
+
+/**
+ * @brief Назначает факт категории, создавая новую, если похожей нет.
+ * Возвращает ID категории или 0, если формула не факт или модуль не включён.
+ */
+uint64_t omega_stream_categorize_fact(omega_context_t* ctx, kf_pool_t* formula_pool, uint64_t fact_id);
+
+/**
+ * @brief Проход слияния по изменившимся категориям, не больше budget
+ * (0 — все). Возвращает число слитых категорий.
+ */
+size_t omega_stream_merge_categories(omega_context_t* ctx, size_t budget);
+
+/**
+ * @brief Категория по ID с учётом слияний или NULL. Указатель живёт до
+ * следующего назначения или слияния.
+ */
+const omega_stream_category_t* omega_stream_find_category(omega_context_t* ctx, uint64_t category_id);
+
+/**
+ * @brief Копирует до max живых категорий, самые большие первыми, в формат
+ * omega_category_t для omega_create_abstract_rule. Членов копируется не
+ * больше MAX_FACTS_PER_CATEGORY. Возвращает число категорий.
+ */
+size_t omega_stream_export_categories(omega_context_t* ctx, omega_category_t* out, size_t max);
+
+const omega_stream_cluster_stats_t* omega_stream_cluster_statistics(omega_context_t* ctx);
+
+void omega_stream_clustering_shutdown(omega_context_t* ctx);
+
 #endif // OMEGA_ABSTRACTION_ENGINE_H
@@ -9,6 +9,7 @@
 #ifndef OMEGA_ADAPTIVE_ABSTRACTION_MANAGER_H
 #define OMEGA_ADAPTIVE_ABSTRACTION_MANAGER_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 
 /* ========== Определения констант ========== */
@@ -130,12 +131,12 @@ typedef struct {
 /**
  * omega_adaptive_abstraction_init - инициализация
  */
-int omega_adaptive_abstraction_init(void);
+int omega_adaptive_abstraction_init(omega_context_t* ctx);
 
 /**
  * omega_register_abstraction_metric - зарегистрировать метрику
  */
-int omega_register_abstraction_metric(omega_metric_type_t metric_type,
+int omega_register_abstraction_metric(omega_context_t* ctx, omega_metric_type_t metric_type,
                                      double threshold_low,
                                      double threshold_high,
                                      double weight);
@@ -146,7 +147,7 @@ int omega_register_abstraction_metric(omega_metric_type_t metric_type,
  * Правило автоматически переводит систему на другой уровень абстракции
  * когда метрика превышает триггерное значение.
  */
-int omega_add_adaptation_rule(omega_metric_type_t trigger_metric,
+int omega_add_adaptation_rule(omega_context_t* ctx, omega_metric_type_t trigger_metric,
                              double trigger_value,
                              omega_abstraction_level_t target_level,
                              const char* description);
@@ -157,12 +158,12 @@ int omega_add_adaptation_rule(omega_metric_type_t trigger_metric,
  * На основе текущих метрик вычисляет, какой уровень абстракции выбрать.
  * @return Рекомендуемый уровень абстракции
  */
-omega_abstraction_level_t omega_compute_adaptation_level(void);
+omega_abstraction_level_t omega_compute_adaptation_level(omega_context_t* ctx);
 
 /**
  * omega_update_metric - обновить значение метрики
  */
-int omega_update_metric(omega_metric_type_t metric_type, double value);
+int omega_update_metric(omega_context_t* ctx, omega_metric_type_t metric_type, double value);
 
 /**
  * omega_apply_adaptation - применить адаптацию
@@ -170,26 +171,26 @@ int omega_update_metric(omega_metric_type_t metric_type, double value);
  * Переводит систему на новый уровень абстракции с сохранением критической информации.
  * @return 1 если адаптация произошла, 0 если уровень не изменился
  */
-int omega_apply_adaptation(omega_abstraction_level_t new_level);
+int omega_apply_adaptation(omega_context_t* ctx, omega_abstraction_level_t new_level);
 
 /**
  * omega_get_current_abstraction_level - получить текущий уровень
  */
-omega_abstraction_level_t omega_get_current_abstraction_level(void);
+omega_abstraction_level_t omega_get_current_abstraction_level(omega_context_t* ctx);
 
 /**
  * omega_get_level_config - получить конфигурацию уровня
  */
-const omega_abstraction_level_config_t* omega_get_level_config(omega_abstraction_level_t level);
+const omega_abstraction_level_config_t* omega_get_level_config(omega_context_t* ctx, omega_abstraction_level_t level);
 
 /**
  * omega_get_adaptive_abstraction_statistics - получить статистику
  */
-const omega_adaptive_abstraction_stats_t* omega_get_adaptive_abstraction_statistics(void);
+const omega_adaptive_abstraction_stats_t* omega_get_adaptive_abstraction_statistics(omega_context_t* ctx);
 
 /**
  * omega_adaptive_abstraction_shutdown - остановка
  */
-void omega_adaptive_abstraction_shutdown(void);
+void omega_adaptive_abstraction_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_ADAPTIVE_ABSTRACTION_MANAGER_H
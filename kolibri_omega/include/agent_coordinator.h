@@ -1,6 +1,7 @@
 #ifndef OMEGA_AGENT_COORDINATOR_H
 #define OMEGA_AGENT_COORDINATOR_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -9,11 +10,18 @@
  * 
  * Обнаруживает паттерны координации между несколькими объектами/агентами.
  * Отслеживает синхронизированные действия, emergent поведение и групповые паттерны.
+ *
+ * Число агентов, пар и паттернов не ограничено: таблицы растут по мере надобности.
+ * Новое состояние сравнивается только с последними OMEGA_MAX_COORDINATION_HISTORY
+ * состояниями, попавшими в окно синхронизации, и обновляет скользящую статистику
+ * этих пар — число совпадений, среднюю задержку и ковариацию уверенностей.
+ * Пары, ни разу не совпавшие по времени, памяти не занимают.
  */
 
-#define OMEGA_MAX_AGENTS 10
-#define OMEGA_MAX_AGENT_PATTERNS 50
-#define OMEGA_MAX_COORDINATION_HISTORY 100
+#define OMEGA_MAX_AGENTS 10                 /* агентов в одном событии или паттерне */
+#define OMEGA_MAX_AGENT_PATTERNS 50         /* начальная ёмкость таблицы паттернов */
+#define OMEGA_MAX_COORDINATION_HISTORY 100  /* последних состояний для поиска пар */
+#define OMEGA_AGENT_SYNC_WINDOW_MS 50       /* окно до первого omega_find_synchronized_agents */
 
 /**
  * omega_agent_state_t - состояние одного агента в момент времени
@@ -72,6 +80,19 @@ typedef struct {
     int synchronization_pairs;          /* Пар агентов, синхронизированных */
 } omega_multi_agent_stats_t;
 
+/**
+ * omega_agent_pair_stats_t - скользящая статистика пары агентов
+ */
+typedef struct {
+    uint32_t agent_a;                   /* меньший ID */
+    uint32_t agent_b;                   /* больший ID */
+    uint64_t co_occurrences;            /* смен состояния в пределах окна */
+    double mean_delta_ms;               /* средняя задержка между ними */
+    int64_t last_delta_ms;              /* задержка последнего совпадения */
+    double covariance;                  /* ковариация уверенностей совпавших состояний */
+    double correlation;                 /* корреляция Пирсона, 0 при меньше двух совпадений */
+} omega_agent_pair_stats_t;
+
 /* API функции */
 
 /**
@@ -79,12 +100,14 @@ typedef struct {
  * 
  * Return: 0 при успехе, -1 при ошибке
  */
-int omega_agent_coordinator_init(void);
+int omega_agent_coordinator_init(omega_context_t* ctx);
 
 /**
  * omega_detect_agent_state_changes - обнаружение изменений состояния агентов
  * 
- * Отслеживает как меняется состояние каждого агента во времени.
+ * Отслеживает как меняется состояние каждого агента во времени и обновляет
+ * статистику пар с агентами, сменившими состояние не раньше чем за окно
+ * синхронизации до timestamp.
  * 
  * @agent_id: ID агента
  * @formula_id: текущая формула/состояние
@@ -93,33 +116,37 @@ int omega_agent_coordinator_init(void);
  * 
  * Return: количество обнаруженных новых изменений
  */
-int omega_detect_agent_state_changes(uint32_t agent_id, uint64_t formula_id,
+int omega_detect_agent_state_changes(omega_context_t* ctx, uint32_t agent_id, uint64_t formula_id,
                                      int64_t timestamp, double confidence);
 
 /**
  * omega_find_synchronized_agents - поиск синхронизированных агентов
  * 
  * Находит пары/группы агентов, которые выполняют действия одновременно
- * (в пределах временного окна max_time_delta_ms).
+ * (в пределах временного окна max_time_delta_ms). Пары собираются при
+ * записи состояний, поэтому вызов сообщает только пары, совпавшие после
+ * прошлого вызова, а max_time_delta_ms становится окном для следующих
+ * состояний.
  * 
  * @max_time_delta_ms: максимальный временной промежуток между действиями
  * 
  * Return: количество найденных пар синхронизации
  */
-int omega_find_synchronized_agents(int64_t max_time_delta_ms);
+int omega_find_synchronized_agents(omega_context_t* ctx, int64_t max_time_delta_ms);
 
 /**
  * omega_detect_coordination_patterns - обнаружение паттернов координации
  * 
  * Анализирует взаимодействия между агентами и выявляет повторяющиеся
- * паттерны (флокинг, избегание, преследование и т.д.).
+ * паттерны (флокинг, избегание, преследование и т.д.). Событие с тем же
+ * набором агентов и типом увеличивает occurrences уже известного паттерна.
  * 
  * @coordination_events: массив событий координации для анализа
  * @event_count: количество событий
  * 
  * Return: количество обнаруженных новых паттернов
  */
-int omega_detect_coordination_patterns(const omega_coordination_event_t* coordination_events,
+int omega_detect_coordination_patterns(omega_context_t* ctx, const omega_coordination_event_t* coordination_events,
                                        int event_count);
 
 /**
@@ -150,7 +177,7 @@ double omega_analyze_emergent_behavior(const omega_agent_pattern_t* agent_patter
  * 
  * Return: 0 при успехе, -1 при ошибке
  */
-int omega_create_coordination_event(const uint32_t* agent_ids, int agent_count,
+int omega_create_coordination_event(omega_context_t* ctx, const uint32_t* agent_ids, int agent_count,
                                     int64_t start_time, double coordination_strength,
                                     omega_coordination_event_t* coordination_event_out);
 
@@ -159,11 +186,19 @@ int omega_create_coordination_event(const uint32_t* agent_ids, int agent_count,
  * 
  * Return: const указатель на статистику
  */
-const omega_multi_agent_stats_t* omega_get_multi_agent_statistics(void);
+const omega_multi_agent_stats_t* omega_get_multi_agent_statistics(omega_context_t* ctx);
+
+/**
+ * omega_get_agent_pair_stats - статистика пары агентов в любом порядке
+ * 
+ * Return: 0 при успехе, -1 если пара ни разу не совпала по времени
+ */
+int omega_get_agent_pair_stats(omega_context_t* ctx, uint32_t agent_a, uint32_t agent_b,
+                               omega_agent_pair_stats_t* stats_out);
 
 /**
  * omega_agent_coordinator_shutdown - остановка
  */
-void omega_agent_coordinator_shutdown(void);
+void omega_agent_coordinator_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_AGENT_COORDINATOR_H
@@ -1,6 +1,8 @@
 #ifndef OMEGA_BAYESIAN_CAUSAL_NETWORKS_H
 #define OMEGA_BAYESIAN_CAUSAL_NETWORKS_H
 
+#include <stddef.h>
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 
 /* ========== Константы ========== */
@@ -8,7 +10,9 @@
 #define OMEGA_MAX_CAUSAL_EDGES 200
 #define OMEGA_MAX_EVIDENCE_STATES 100
 #define OMEGA_MAX_CPD_STATES 10
-#define OMEGA_MAX_CAUSAL_EPISODES 500
+// Затухание счётчиков CPD за одно наблюдение: эффективное окно 1/(1 - d),
+// 500 наблюдений
+#define OMEGA_CAUSAL_COUNT_DECAY 0.998
 
 /* ========== Структуры данных ========== */
 
@@ -54,7 +58,7 @@ typedef struct {
     // cpd[i][j] = P(Child_state_j | Parent_state_i)
     double cpd[OMEGA_MAX_CPD_STATES][OMEGA_MAX_CPD_STATES];
     
-    // Learned from data
+    // Learned from data: наблюдений, где известны оба состояния
     int times_observed;
     int confirmed;
 } omega_causal_edge_t;
@@ -100,7 +104,7 @@ typedef struct {
 /**
  * omega_causal_episode_t - запись эпизода для обучения
  * 
- * Используется для обновления CPD на основе наблюдений
+ * Сами эпизоды не хранятся: наблюдение сразу пополняет счётчики рёбер
  */
 typedef struct {
     uint32_t episode_id;
@@ -135,17 +139,41 @@ typedef struct {
     int most_influential_node;
 } omega_bayesian_network_stats_t;
 
+/**
+ * omega_compiled_network_t - скомпилированная форма сети для точного вывода
+ *
+ * Узлы лежат в топологическом порядке, и дальше узел обозначается своим
+ * индексом в этом порядке. Родители узла — список CSR по возрастанию
+ * индексов. CPD всех узлов лежат подряд в одном массиве: строка на каждую
+ * комбинацию состояний родителей (последний родитель меняется быстрее всех),
+ * в строке — распределение состояний узла. Сеть не меняется после
+ * компиляции, поэтому вывод по ней можно вести из нескольких потоков.
+ */
+typedef struct {
+    int node_count;
+    uint32_t* node_ids;       // [node_count]
+    int* num_states;          // [node_count]
+    int* parent_offsets;      // [node_count + 1]
+    int* parents;             // [parent_offsets[node_count]]
+    size_t* cpd_offsets;      // [node_count + 1]
+    double* cpd;              // [cpd_offsets[node_count]]
+    int* source_index;        // [node_count] индекс -> позиция во входном массиве
+    int* position;            // [node_count] позиция во входном массиве -> индекс
+    uint32_t* sorted_ids;     // [node_count] id по возрастанию, для поиска
+    int* sorted_index;        // [node_count] индексы узлов в том же порядке
+} omega_compiled_network_t;
+
 /* ========== API функции ========== */
 
 /**
  * omega_bayesian_network_init - инициализация системы
  */
-int omega_bayesian_network_init(void);
+int omega_bayesian_network_init(omega_context_t* ctx);
 
 /**
  * omega_add_causal_node - добавить узел в сеть
  */
-uint32_t omega_add_causal_node(const char* node_name,
+uint32_t omega_add_causal_node(omega_context_t* ctx, const char* node_name,
                               int num_states,
                               const char** state_names,
                               double prior_probability);
@@ -155,7 +183,7 @@ uint32_t omega_add_causal_node(const char* node_name,
  * 
  * Использует CPD для кодирования условной вероятности
  */
-uint32_t omega_add_causal_edge(uint32_t parent_node_id,
+uint32_t omega_add_causal_edge(omega_context_t* ctx, uint32_t parent_node_id,
                               uint32_t child_node_id,
                               double** cpd_table,
                               double causal_strength);
@@ -163,21 +191,25 @@ uint32_t omega_add_causal_edge(uint32_t parent_node_id,
 /**
  * omega_set_evidence - установить наблюдаемое свидетельство для узла
  */
-int omega_set_evidence(uint32_t node_id, int observed_state);
+int omega_set_evidence(omega_context_t* ctx, uint32_t node_id, int observed_state);
 
 /**
  * omega_bayesian_inference - выполнить вероятностный вывод
  * 
- * Использует алгоритм belief propagation или точного вывода
- * для вычисления P(Node | Evidence) для всех узлов
+ * Точный вывод P(Node | Evidence) по скомпилированной форме сети, которая
+ * пересобирается после изменения узлов, рёбер или CPD
  */
-int omega_bayesian_inference(uint32_t target_node_id,
+int omega_bayesian_inference(omega_context_t* ctx, uint32_t target_node_id,
                             omega_inference_result_t* result_out);
 
 /**
  * omega_record_causal_observation - записать наблюдение для обучения CPD
+ *
+ * Пополняет затухающие совместные счётчики (состояние родителя, состояние
+ * ребёнка) каждого ребра, у которого наблюдаются оба конца; время не
+ * зависит от числа прошлых наблюдений.
  */
-int omega_record_causal_observation(const uint32_t* node_ids,
+int omega_record_causal_observation(omega_context_t* ctx, const uint32_t* node_ids,
                                    const int* states,
                                    int num_observations,
                                    double likelihood);
@@ -186,8 +218,18 @@ int omega_record_causal_observation(const uint32_t* node_ids,
  * omega_learn_cpd_from_episodes - обновить CPD на основе эпизодов
  * 
  * Байесовское обновление: P(CPD | Data) ∝ P(Data | CPD) * P(CPD)
+ * CPD рёбер строятся из счётчиков, эпизоды заново не просматриваются.
+ */
+int omega_learn_cpd_from_episodes(omega_context_t* ctx);
+
+/**
+ * omega_get_causal_cpd_row - текущая строка CPD ребра по счётчикам
+ *
+ * row_out[j] = P(Child=j | Parent=parent_state) со сглаживанием Лапласа;
+ * без наблюдений для этой строки — строка CPD ребра. Возвращает число
+ * состояний ребёнка или -1.
  */
-int omega_learn_cpd_from_episodes(void);
+int omega_get_causal_cpd_row(omega_context_t* ctx, uint32_t edge_id, int parent_state, double* row_out);
 
 /**
  * omega_find_markov_blanket - найти Markov Blanket узла
@@ -195,18 +237,76 @@ int omega_learn_cpd_from_episodes(void);
  * Markov Blanket: множество узлов, на которых целевой узел независим от остальных
  * Markov Blanket(X) = Parents(X) ∪ Children(X) ∪ CoParents(X)
  */
-int omega_find_markov_blanket(uint32_t node_id,
+int omega_find_markov_blanket(omega_context_t* ctx, uint32_t node_id,
                              uint32_t* blanket_nodes_out,
                              int* blanket_size_out);
 
 /**
  * omega_get_causal_network_statistics - получить статистику сети
  */
-const omega_bayesian_network_stats_t* omega_get_causal_network_statistics(void);
+const omega_bayesian_network_stats_t* omega_get_causal_network_statistics(omega_context_t* ctx);
+
+/**
+ * omega_compile_causal_network - скомпилировать сеть из узлов и рёбер
+ *
+ * Вход не обязан принадлежать сети контекста, так что независимых сетей
+ * может быть сколько угодно. Узел с несколькими родителями получает CPD
+ * P(X | родители) ∝ P(X) · Π CPD рёбер, для одного родителя это CPD ребра,
+ * умноженная на prior узла. Рёбра к неизвестным узлам и петли пропускаются.
+ * Возвращает -1 при цикле, повторном id или слишком большой таблице.
+ */
+int omega_compile_causal_network(const omega_causal_node_t* nodes,
+                                int node_count,
+                                const omega_causal_edge_t* edges,
+                                int edge_count,
+                                omega_compiled_network_t* net_out);
+
+/**
+ * omega_bayesian_network_compile - скомпилировать сеть контекста
+ */
+int omega_bayesian_network_compile(omega_context_t* ctx, omega_compiled_network_t* net_out);
+
+/**
+ * omega_compiled_network_free - освободить скомпилированную сеть
+ */
+void omega_compiled_network_free(omega_compiled_network_t* net);
+
+/**
+ * omega_compiled_network_index - индекс узла по id, -1 если узла нет
+ */
+int omega_compiled_network_index(const omega_compiled_network_t* net, uint32_t node_id);
+
+/**
+ * omega_compiled_network_infer - точный вывод P(target | evidence)
+ *
+ * Исключение переменных: узлы, не являющиеся предками цели или
+ * свидетельств, отбрасываются, остальные скрытые исключаются жадно по
+ * размеру получаемого фактора. evidence[i] — наблюдаемое состояние узла
+ * с индексом i или -1. Возвращает -1 при неверных аргументах, слишком
+ * большом факторе или невозможном свидетельстве.
+ */
+int omega_compiled_network_infer(const omega_compiled_network_t* net,
+                                const int* evidence,
+                                int target_index,
+                                omega_inference_result_t* result_out);
+
+/**
+ * omega_compiled_network_infer_batch - вывод для набора свидетельств
+ *
+ * evidence_sets — set_count строк по node_count состояний. Буферы общие
+ * для всего набора, а порядок исключения переиспользуется, пока набор
+ * наблюдаемых узлов не меняется. Возвращает число успешных выводов;
+ * результат неудачного вывода обнулён.
+ */
+int omega_compiled_network_infer_batch(const omega_compiled_network_t* net,
+                                      const int* evidence_sets,
+                                      int set_count,
+                                      int target_index,
+                                      omega_inference_result_t* results_out);
 
 /**
  * omega_bayesian_network_shutdown - остановка
  */
-void omega_bayesian_network_shutdown(void);
+void omega_bayesian_network_shutdown(omega_context_t* ctx);
 
 #endif  // OMEGA_BAYESIAN_CAUSAL_NETWORKS_H
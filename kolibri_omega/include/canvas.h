@@ -2,6 +2,8 @@
 #define OMEGA_CANVAS_H
 
 #include "kolibri_omega/include/forward.h"
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * @brief Инициализирует Холст.
@@ -26,18 +28,69 @@ void omega_canvas_destroy(omega_canvas_t* canvas);
 uint64_t omega_canvas_add_item(omega_canvas_t* canvas, omega_canvas_item_t* item);
 
 /**
- * @brief Удаляет элемент с Холста.
+ * @brief ID, который omega_canvas_add_item возвращает для отложенного элемента
+ */
+#define OMEGA_CANVAS_STAGED_ID UINT64_MAX
+
+/**
+ * @brief Открывает в текущем потоке этап: omega_canvas_add_item для этого
+ * Холста откладывает элементы в stage и возвращает OMEGA_CANVAS_STAGED_ID.
+ * Холст не меняется, и его могут читать другие потоки.
+ */
+void omega_canvas_stage_begin(omega_canvas_stage_t* stage, omega_canvas_t* canvas);
+void omega_canvas_stage_end(void);
+
+/**
+ * @brief Добавляет отложенные элементы на Холст; их формулы должны быть
+ * видны через kf_borrow_formula. Вызывать, когда Холст никто не читает.
+ * @return 0 в случае успеха, -1 если места не нашлось.
+ */
+int omega_canvas_stage_commit(omega_canvas_stage_t* stage);
+void omega_canvas_stage_free(omega_canvas_stage_t* stage);
+
+/**
+ * @brief Удаляет элемент с Холста за O(1): на его место встаёт последний.
+ * В режиме стабильного порядка остальные элементы сдвигаются, как раньше.
  * @param canvas Указатель на Холст.
  * @param index Индекс элемента для удаления.
  * @return 0 в случае успеха, -1 в случае ошибки.
  */
 int omega_canvas_remove_item(omega_canvas_t* canvas, size_t index);
 
+/**
+ * @brief Удаляет элемент с Холста по его ID.
+ * @return 0 в случае успеха, -1 если элемента уже нет.
+ */
+int omega_canvas_remove_id(omega_canvas_t* canvas, uint64_t item_id);
+
+/**
+ * @brief Включает или выключает стабильный порядок элементов.
+ * @param canvas Указатель на Холст.
+ * @param stable 1 — удаление сохраняет порядок добавления (за O(count)).
+ */
+void omega_canvas_set_stable_order(omega_canvas_t* canvas, int stable);
+
+/**
+ * @brief Первый по порядку добавления элемент с формулой-фактом (object_id, time).
+ * @param canvas Указатель на Холст.
+ * @param object_id Объект факта.
+ * @param time Время факта.
+ * @return Индекс найденного элемента или canvas->count, если его нет.
+ */
+size_t omega_canvas_first_at(const omega_canvas_t* canvas, int object_id, int time);
+
+/**
+ * @brief Следующий после index элемент с тем же (object_id, time).
+ * @return Индекс найденного элемента или canvas->count, если его нет.
+ */
+size_t omega_canvas_next_at(const omega_canvas_t* canvas, size_t index);
+
 /**
  * @brief Находит элемент на Холсте по его ID.
  * @param canvas Указатель на Холст.
  * @param item_id ID искомого элемента.
- * @return Указатель на элемент или NULL, если он не найден.
+ * @return Указатель на элемент или NULL, если он не найден или удалён.
+ * Указатель действителен до следующего добавления или удаления.
  */
 omega_canvas_item_t* omega_canvas_get_item(omega_canvas_t* canvas, uint64_t item_id);
 
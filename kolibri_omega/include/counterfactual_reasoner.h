@@ -9,6 +9,7 @@
 #ifndef OMEGA_COUNTERFACTUAL_REASONER_H
 #define OMEGA_COUNTERFACTUAL_REASONER_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -19,6 +20,7 @@
 #define OMEGA_MAX_CAUSAL_LINKS 100       // Максимум причинно-следственных связей
 #define OMEGA_MAX_BRANCHES 200           // Максимум ветвей дерева сценариев
 #define OMEGA_SCENARIO_NAME_LEN 64       // Длина имени сценария
+#define OMEGA_CF_PREFIX_CACHE_NODES 65536 // Мягкий предел кэша префиксов
 
 /* ========== Типы вмешательств ========== */
 
@@ -130,14 +132,36 @@ typedef struct {
     
     double average_divergence;
     double largest_divergence;
+    
+    int prefix_states_computed;     // Состояний, вычисленных по префиксам
+    int prefix_states_reused;       // Шагов, взятых из кэша префиксов
 } omega_counterfactual_stats_t;
 
+/**
+ * omega_intervention_sequence_t - последовательность вмешательств для ранжирования
+ */
+typedef struct {
+    const omega_intervention_t* interventions;
+    int intervention_count;
+} omega_intervention_sequence_t;
+
+/**
+ * omega_scenario_rank_t - место последовательности в ранжировании
+ */
+typedef struct {
+    int index;                     // Позиция во входном массиве
+    double impact;                 // Сдвиг ожидаемых исходов от базовой линии
+    double expected_canvas_items;
+    double expected_agent_sync;
+    double expected_pattern_count;
+} omega_scenario_rank_t;
+
 /* ========== API функции ========== */
 
 /**
  * omega_counterfactual_reasoner_init - инициализация
  */
-int omega_counterfactual_reasoner_init(void);
+int omega_counterfactual_reasoner_init(omega_context_t* ctx);
 
 /**
  * omega_create_scenario - создать новый сценарий
@@ -146,12 +170,12 @@ int omega_counterfactual_reasoner_init(void);
  * @param divergence_timestamp - момент отхода от базовой линии
  * @return ID созданного сценария или 0 при ошибке
  */
-uint64_t omega_create_scenario(const char* scenario_name, int64_t divergence_timestamp);
+uint64_t omega_create_scenario(omega_context_t* ctx, const char* scenario_name, int64_t divergence_timestamp);
 
 /**
  * omega_add_intervention - добавить вмешательство в сценарий
  */
-int omega_add_intervention(uint64_t scenario_id, omega_intervention_type_t type,
+int omega_add_intervention(omega_context_t* ctx, uint64_t scenario_id, omega_intervention_type_t type,
                           uint32_t target_agent_id, uint64_t target_formula_id,
                           double strength, const char* description);
 
@@ -161,7 +185,7 @@ int omega_add_intervention(uint64_t scenario_id, omega_intervention_type_t type,
  * Создает новую ветвь и вычисляет вероятность исхода.
  * @return ID созданной ветви
  */
-uint64_t omega_analyze_scenario_branch(uint64_t parent_scenario_id, int depth);
+uint64_t omega_analyze_scenario_branch(omega_context_t* ctx, uint64_t parent_scenario_id, int depth);
 
 /**
  * omega_apply_interventions - применить все вмешательства сценария
@@ -169,7 +193,7 @@ uint64_t omega_analyze_scenario_branch(uint64_t parent_scenario_id, int depth);
  * Симулирует эффекты вмешательств (без изменения реального состояния).
  * @return 1 если успешно, -1 при ошибке
  */
-int omega_apply_interventions(uint64_t scenario_id);
+int omega_apply_interventions(omega_context_t* ctx, uint64_t scenario_id);
 
 /**
  * omega_detect_causal_links - обнаружить причинно-следственные связи
@@ -177,7 +201,7 @@ int omega_apply_interventions(uint64_t scenario_id);
  * Анализирует последовательности формул в сценарии и находит причинные связи.
  * @return Количество обнаруженных связей
  */
-int omega_detect_causal_links(uint64_t scenario_id);
+int omega_detect_causal_links(omega_context_t* ctx, uint64_t scenario_id);
 
 /**
  * omega_compute_divergence - вычислить расхождение от базовой линии
@@ -185,26 +209,43 @@ int omega_detect_causal_links(uint64_t scenario_id);
  * Сравнивает ожидаемые и фактические результаты.
  * @return Ratio расхождения (0.0 = идентично, 1.0 = полное различие)
  */
-double omega_compute_divergence(uint64_t scenario_id);
+double omega_compute_divergence(omega_context_t* ctx, uint64_t scenario_id);
 
 /**
  * omega_rank_scenarios_by_impact - ранжировать сценарии по влиянию
  * 
- * Заполняет массив отсортированных ID сценариев.
+ * Заполняет массив отсортированных ID сценариев. Импакт — взвешенный сдвиг
+ * ожидаемых исходов от базовой линии (веса как в omega_compute_divergence).
+ * Состояния мира берутся из кэша префиксов: общий префикс вмешательств
+ * вычисляется один раз, а новые вмешательства сценария досчитываются
+ * от уже известного состояния.
  * @param scenario_ids_out - выходной массив (макс OMEGA_MAX_SCENARIOS)
  * @param max_count - размер выходного массива
  * @return Количество заполненных элементов
  */
-int omega_rank_scenarios_by_impact(uint64_t* scenario_ids_out, int max_count);
+int omega_rank_scenarios_by_impact(omega_context_t* ctx, uint64_t* scenario_ids_out, int max_count);
+
+/**
+ * omega_rank_intervention_sequences - ранжировать набор последовательностей
+ * 
+ * Пакетный вариант для сотен сценариев за вызов: последовательности
+ * проходят по тому же кэшу префиксов, так что их общие начала
+ * вычисляются один раз.
+ * @param ranks_out - count элементов, по убыванию импакта
+ * @return count или -1 при ошибке
+ */
+int omega_rank_intervention_sequences(omega_context_t* ctx, const omega_intervention_sequence_t* sequences,
+                                      int count,
+                                      omega_scenario_rank_t* ranks_out);
 
 /**
  * omega_get_counterfactual_statistics - получить статистику
  */
-const omega_counterfactual_stats_t* omega_get_counterfactual_statistics(void);
+const omega_counterfactual_stats_t* omega_get_counterfactual_statistics(omega_context_t* ctx);
 
 /**
  * omega_counterfactual_reasoner_shutdown - остановка
  */
-void omega_counterfactual_reasoner_shutdown(void);
+void omega_counterfactual_reasoner_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_COUNTERFACTUAL_REASONER_H
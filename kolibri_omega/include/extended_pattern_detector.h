@@ -1,6 +1,7 @@
 #ifndef OMEGA_EXTENDED_PATTERN_DETECTOR_H
 #define OMEGA_EXTENDED_PATTERN_DETECTOR_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -8,9 +9,20 @@
  * Extended Pattern Detector Header - Phase 3 Component
  * 
  * Детектор паттернов для последовательностей из 3-10 шагов.
+ *
+ * Шаги подаются потоком. Майнер держит бор суффиксов потока глубиной до
+ * OMEGA_MAX_PATTERN_LENGTH: каждый шаг продлевает не больше
+ * OMEGA_MAX_PATTERN_LENGTH активных контекстов, а разрыв дольше
+ * OMEGA_MAX_TIME_DELTA_MS между соседними шагами обнуляет их. Паттерн
+ * регистрируется, когда последовательность из 3+ шагов встретилась
+ * OMEGA_PATTERN_MIN_SUPPORT раз; вероятности переходов и предсказания
+ * читаются из счётчиков бора без повторного перебора.
  */
 
 #define OMEGA_MAX_PATTERN_LENGTH 10
+#define OMEGA_MAX_TIME_DELTA_MS 100
+#define OMEGA_PATTERN_MIN_SUPPORT 2
+#define OMEGA_PATTERN_MINER_MAX_NODES 65536
 
 /**
  * omega_pattern_step_t - отдельный шаг в паттерне
@@ -41,25 +53,48 @@ typedef struct {
     double average_confidence;
     int min_length;
     int max_length;
+    uint64_t steps_observed;  // шагов, поданных в майнер
+    int miner_nodes;          // узлов суффиксного бора
 } omega_pattern_statistics_t;
 
 /* API функции */
 
-int omega_extended_pattern_detector_init(void);
+int omega_extended_pattern_detector_init(omega_context_t* ctx);
 
 int omega_validate_temporal_constraint(int64_t timestamp1, int64_t timestamp2,
                                         int64_t max_time_delta_ms);
 
-double omega_compute_transition_probabilities(const omega_extended_pattern_t* pattern,
+/**
+ * omega_observe_pattern_step - подаёт в майнер следующий шаг потока
+ * Возвращает число новых паттернов или -1 при ошибке.
+ */
+int omega_observe_pattern_step(omega_context_t* ctx, const omega_pattern_step_t* step);
+
+/**
+ * omega_compute_transition_probabilities - P(steps[step_index + 1] | steps[0..step_index])
+ * по наблюдённому потоку; 0, если такой контекст не встречался.
+ */
+double omega_compute_transition_probabilities(omega_context_t* ctx, const omega_extended_pattern_t* pattern,
                                               int step_index);
 
-int omega_predict_next_pattern_step(const omega_extended_pattern_t* pattern,
+/**
+ * omega_predict_next_pattern_step - самое частое продолжение паттерна.
+ * Если у полного паттерна продолжений нет, отбрасывает его первые шаги.
+ * Возвращает -1, если предсказать нечего.
+ */
+int omega_predict_next_pattern_step(omega_context_t* ctx, const omega_extended_pattern_t* pattern,
                                     omega_pattern_step_t* next_step_out);
 
-int omega_detect_extended_patterns(const void* facts, int fact_count, int64_t current_time);
+/**
+ * omega_detect_extended_patterns - подаёт fact_count шагов
+ * (const omega_pattern_step_t*) и возвращает число новых паттернов.
+ * При facts == NULL подаёт синтетические шаги 100 + i в моменты
+ * current_time + i * 10.
+ */
+int omega_detect_extended_patterns(omega_context_t* ctx, const void* facts, int fact_count, int64_t current_time);
 
-const omega_pattern_statistics_t* omega_get_pattern_statistics(void);
+const omega_pattern_statistics_t* omega_get_pattern_statistics(omega_context_t* ctx);
 
-void omega_extended_pattern_detector_shutdown(void);
+void omega_extended_pattern_detector_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_EXTENDED_PATTERN_DETECTOR_H
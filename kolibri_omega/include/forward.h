@@ -8,12 +8,14 @@
 typedef struct kf_predicate_s kf_predicate_t;
 typedef struct kf_formula_s kf_formula_t;
 typedef struct kf_pool_s kf_pool_t;
+typedef struct kf_pool_stage_s kf_pool_stage_t;
 
 typedef struct sigma_task_s sigma_task_t;
 typedef struct sigma_coordinator_s sigma_coordinator_t;
 
 typedef struct omega_canvas_item_s omega_canvas_item_t;
 typedef struct omega_canvas_s omega_canvas_t;
+typedef struct omega_canvas_stage_s omega_canvas_stage_t;
 
 typedef struct omega_observer_s omega_observer_t;
 typedef struct omega_dreamer_s omega_dreamer_t;
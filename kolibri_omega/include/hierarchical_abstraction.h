@@ -1,6 +1,7 @@
 #ifndef OMEGA_HIERARCHICAL_ABSTRACTION_H
 #define OMEGA_HIERARCHICAL_ABSTRACTION_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -12,7 +13,7 @@
  * процессах как о атомарных единицах.
  */
 
-#define OMEGA_MAX_META_EVENTS 100
+#define OMEGA_MAX_META_EVENTS 100  /* событий уровня в omega_abstraction_hierarchy_t */
 #define OMEGA_ABSTRACTION_LEVELS 5  /* Уровни абстракции */
 
 /**
@@ -63,7 +64,7 @@ typedef struct {
  * 
  * Return: 0 при успехе, -1 при ошибке
  */
-int omega_hierarchical_abstraction_init(void);
+int omega_hierarchical_abstraction_init(omega_context_t* ctx);
 
 /**
  * omega_create_meta_event_from_pattern - превращение паттерна в мета-событие
@@ -78,7 +79,7 @@ int omega_hierarchical_abstraction_init(void);
  * 
  * Return: 0 при успехе, -1 при ошибке
  */
-int omega_create_meta_event_from_pattern(uint64_t pattern_id, 
+int omega_create_meta_event_from_pattern(omega_context_t* ctx, uint64_t pattern_id, 
                                          const uint64_t* step_ids,
                                          double confidence,
                                          int64_t start_time,
@@ -88,7 +89,8 @@ int omega_create_meta_event_from_pattern(uint64_t pattern_id,
  * omega_build_abstraction_hierarchy - построение иерархии уровней
  * 
  * Берет набор 3-шаговых паттернов и создает иерархию абстракции,
- * группируя мета-события по типам и связанности.
+ * группируя мета-события по типам и связанности. Строит всё заново;
+ * иерархию контекста поддерживает omega_get_abstraction_hierarchy.
  * 
  * @meta_events: массив мета-событий
  * @event_count: количество мета-событий
@@ -112,7 +114,7 @@ int omega_build_abstraction_hierarchy(const omega_meta_event_t* meta_events,
  * 
  * Return: 0 при успехе, -1 при ошибке
  */
-int omega_abstract_pattern_sequence(const omega_meta_event_t* meta_events,
+int omega_abstract_pattern_sequence(omega_context_t* ctx, const omega_meta_event_t* meta_events,
                                     int event_count,
                                     omega_meta_event_t* merged_meta_event_out);
 
@@ -134,20 +136,38 @@ int omega_get_hierarchy_level_by_event(uint64_t event_id);
  * Пример: [fact_A, fact_B, fact_C, fact_D, fact_E, fact_F]
  *         → [MetaEvent_1, MetaEvent_2]
  * 
+ * Сжатие ленивое: новое мета-событие лишь помечает свой уровень, а вызов
+ * проходит только помеченные уровни и только события после прошлого
+ * вызова. Соседние по времени события уровня попарно становятся событием
+ * следующего уровня, так что каждое новое событие поднимается лишь по
+ * цепочке своих предков.
+ * 
  * Return: количество созданных мета-событий
  */
-int omega_compress_representation(void);
+int omega_compress_representation(omega_context_t* ctx);
+
+/**
+ * omega_get_abstraction_hierarchy - иерархия контекста
+ * 
+ * Досжимает помеченные уровни и копирует все OMEGA_ABSTRACTION_LEVELS
+ * уровней; event_ids уровня — его последние OMEGA_MAX_META_EVENTS событий.
+ * 
+ * @hierarchy_out: массив из OMEGA_ABSTRACTION_LEVELS уровней
+ * 
+ * Return: количество уровней до верхнего непустого, -1 при ошибке
+ */
+int omega_get_abstraction_hierarchy(omega_context_t* ctx, omega_abstraction_hierarchy_t* hierarchy_out);
 
 /**
  * omega_get_hierarchical_statistics - получить статистику иерархии
  * 
  * Return: const указатель на статистику
  */
-const omega_hierarchical_stats_t* omega_get_hierarchical_statistics(void);
+const omega_hierarchical_stats_t* omega_get_hierarchical_statistics(omega_context_t* ctx);
 
 /**
  * omega_hierarchical_abstraction_shutdown - остановка
  */
-void omega_hierarchical_abstraction_shutdown(void);
+void omega_hierarchical_abstraction_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_HIERARCHICAL_ABSTRACTION_H
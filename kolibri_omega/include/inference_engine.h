@@ -25,11 +25,21 @@ typedef struct {
     double confidence;             // Общая уверенность цепочки (произведение)
 } omega_inference_chain_t;
 
+// Уровни журнала модуля вывода
+#define OMEGA_INFERENCE_LOG_QUIET 0   // ничего не печатать
+#define OMEGA_INFERENCE_LOG_SUMMARY 1 // найденные цепочки и созданные правила
+#define OMEGA_INFERENCE_LOG_TRACE 2   // каждый шаг вывода
+
 /**
- * @brief Инициализирует модуль логического вывода.
+ * @brief Инициализирует модуль логического вывода и сбрасывает кэш выводов.
  */
 void omega_inference_engine_init(void);
 
+/**
+ * @brief Задает уровень журнала (OMEGA_INFERENCE_LOG_*); по умолчанию QUIET.
+ */
+void omega_inference_set_verbosity(int level);
+
 /**
  * @brief Выполняет одноступенчатый логический вывод.
  * Применяет одно правило к одному факту и возвращает результат.
@@ -45,10 +55,12 @@ uint64_t omega_inference_single_step(kf_pool_t* formula_pool,
  * 
  * Алгоритм:
  * 1. Начинаем с initial_fact_id
- * 2. Ищем все применимые правила
- * 3. Применяем правило → получаем промежуточный результат
- * 4. Повторяем со следующим правилом до max_steps
- * 5. Возвращаем найденную цепочку
+ * 2. Правила с этим условием берутся из индекса пула по condition_formula_id
+ * 3. Обход в ширину не дальше max_depth правил (и не больше 10)
+ * 4. Каждый новый вывод даёт одну цепочку — кратчайший путь к нему
+ * 5. Возвращаем не больше max_chains цепочек
+ *
+ * Результат запоминается для факта, пока правила пула не менялись.
  */
 int omega_inference_forward_chain(kf_pool_t* formula_pool,
                                    uint64_t initial_fact_id,
@@ -68,6 +80,7 @@ double omega_compute_chain_confidence(omega_inference_chain_t* chain, kf_pool_t*
 /**
  * @brief Создает новое правило на основе обнаруженной цепочки вывода.
  * Это позволяет системе "запомнить" найденные связи для будущего использования.
+ * Если такое правило уже есть, возвращает его ID.
  */
 uint64_t omega_create_rule_from_chain(kf_pool_t* formula_pool, 
                                        omega_inference_chain_t* chain);
@@ -0,0 +1,49 @@
+#ifndef KOLIBRI_OMEGA_CONTEXT_H
+#define KOLIBRI_OMEGA_CONTEXT_H
+
+/**
+ * @brief Контекст одного агента Омеги: состояние всех модулей анализа.
+ *
+ * Каждый контекст изолирован, поэтому в одном процессе может жить сколько
+ * угодно агентов. Модуль заводит своё состояние в контексте при *_init и
+ * освобождает при *_shutdown; до init функции модуля сообщают об ошибке.
+ * Контекст не защищён блокировками: один контекст — один поток за раз,
+ * разные контексты можно вести на разных ядрах. Профилирование (omega_perf)
+ * и журнал ошибок (omega_errors) остаются общими для процесса и защищены
+ * блокировками.
+ */
+
+struct omega_extended_pattern_detector_ctx_s;
+struct omega_hierarchical_ctx_s;
+struct omega_agent_coordinator_ctx_s;
+struct omega_counterfactual_ctx_s;
+struct omega_adaptive_ctx_s;
+struct omega_policy_ctx_s;
+struct omega_bayesian_ctx_s;
+struct omega_planner_ctx_s;
+struct omega_abstraction_ctx_s;
+
+typedef struct omega_context_s {
+    struct omega_extended_pattern_detector_ctx_s* patterns;
+    struct omega_hierarchical_ctx_s* hierarchy;
+    struct omega_agent_coordinator_ctx_s* coordinator;
+    struct omega_counterfactual_ctx_s* counterfactual;
+    struct omega_adaptive_ctx_s* adaptive;
+    struct omega_policy_ctx_s* policy;
+    struct omega_bayesian_ctx_s* bayesian;
+    struct omega_planner_ctx_s* planner;
+    struct omega_abstraction_ctx_s* abstraction;
+} omega_context_t;
+
+/**
+ * @brief Создаёт пустой контекст; модули в нём ещё не инициализированы.
+ * @return Контекст или NULL при нехватке памяти.
+ */
+omega_context_t* omega_context_create(void);
+
+/**
+ * @brief Останавливает модули, которые ещё работают, и освобождает контекст.
+ */
+void omega_context_destroy(omega_context_t* ctx);
+
+#endif // KOLIBRI_OMEGA_CONTEXT_H
@@ -12,6 +12,7 @@
  * @date November 4, 2025
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -31,6 +32,21 @@ typedef enum {
     OMEGA_PERF_CATEGORY_COUNT
 } omega_perf_category_t;
 
+/**
+ * @brief Upper bound on built-in plus registered categories
+ */
+#define OMEGA_PERF_MAX_CATEGORIES 16
+
+/**
+ * @brief Latency histogram layout: 2^OMEGA_PERF_HIST_SUB_BITS linear
+ * sub-buckets per power of two, exact below 16 ns, saturating at 2^40 ns
+ */
+#define OMEGA_PERF_HIST_SUB_BITS 3
+#define OMEGA_PERF_HIST_MAX_BITS 40
+#define OMEGA_PERF_HIST_BUCKETS \
+    ((2 << OMEGA_PERF_HIST_SUB_BITS) + \
+     (OMEGA_PERF_HIST_MAX_BITS - OMEGA_PERF_HIST_SUB_BITS - 1) * (1 << OMEGA_PERF_HIST_SUB_BITS))
+
 /**
  * @brief Performance measurement sample
  */
@@ -51,7 +67,10 @@ typedef struct {
     uint64_t min_ns;                // Minimum duration
     uint64_t max_ns;                // Maximum duration
     uint64_t avg_ns;                // Average duration
-    double cpu_usage_percent;       // CPU usage percentage
+    uint64_t p50_ns;                // Median, from the histogram
+    uint64_t p95_ns;
+    uint64_t p99_ns;
+    double cpu_usage_percent;       // Share of wall time since init/reset
 } omega_perf_stats_t;
 
 /**
@@ -64,6 +83,13 @@ typedef struct {
 
 // ==================== Public API ====================
 
+/*
+ * Every thread records into its own stat block, so omega_perf_end takes no
+ * lock and reads the clock once. Readers sum the blocks under a lock that
+ * only registration, reads and reset use. Shutdown must not race with
+ * threads that are still measuring.
+ */
+
 /**
  * @brief Initialize performance profiling system
  * @return 0 on success, error code on failure
@@ -89,13 +115,42 @@ omega_perf_handle_t omega_perf_start(omega_perf_category_t category);
  */
 uint64_t omega_perf_end(omega_perf_handle_t handle);
 
+/**
+ * @brief Register a category beyond the built-in enum
+ * @param name Display name (copied, at most 31 bytes kept)
+ * @param out Receives the new category id
+ * @return 0 on success, OMEGA_ERROR_RESOURCE_EXHAUSTED when all
+ *         OMEGA_PERF_MAX_CATEGORIES are taken
+ */
+int omega_perf_register_category(const char* name, omega_perf_category_t* out);
+
 /**
  * @brief Get performance statistics for a category
  * @param category Performance category
- * @return Pointer to statistics (NULL if not available)
+ * @return Pointer to statistics (NULL if not available); it is overwritten
+ *         by the next call for the same category
  */
 const omega_perf_stats_t* omega_perf_get_stats(omega_perf_category_t category);
 
+/**
+ * @brief Copy aggregated statistics for a category
+ * @return 0 on success, OMEGA_ERROR_NOT_FOUND if there are no samples
+ */
+int omega_perf_snapshot(omega_perf_category_t category, omega_perf_stats_t* out);
+
+/**
+ * @brief Write all categories with samples as one JSON object
+ * @return Length written, or -1 if the buffer is too small
+ */
+int omega_perf_export_json(char* buffer, size_t buffer_len);
+
+/**
+ * @brief Write all categories in the Prometheus text format as a summary
+ *        (duration quantiles, sum and count per category label)
+ * @return Length written, or -1 if the buffer is too small
+ */
+int omega_perf_export_prometheus(char* buffer, size_t buffer_len);
+
 /**
  * @brief Reset all performance statistics
  */
@@ -0,0 +1,112 @@
+#ifndef KOLIBRI_OMEGA_RUNTIME_H
+#define KOLIBRI_OMEGA_RUNTIME_H
+
+#include "kolibri_omega/include/types.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Среда выполнения такта: лобы как задачи на пуле потоков.
+ *
+ * Каждая задача объявляет, какие общие ресурсы она читает, пополняет и
+ * изменяет. Порядок добавления задач задаёт последовательную семантику:
+ * задача ждёт более ранние, с которыми конфликтует (одна из двух изменяет
+ * то, чем пользуется другая), а остальные идут параллельно. Готовые задачи
+ * лежат в очередях потоков, свободный поток забирает работу у соседей.
+ *
+ * Пополнение (appends) Холста и пула откладывается в этап задачи и сливается
+ * в порядке задач: перед задачей, которая изменяет ресурс, и на барьере в
+ * конце такта. Поэтому читающие задачи того же такта чужих добавлений не
+ * видят. Добавление на Холст читает пул, так что задачи, меняющие или
+ * пополняющие Холст, считаются читающими пул.
+ */
+
+typedef enum {
+    OMEGA_RESOURCE_CANVAS = 1u << 0,
+    OMEGA_RESOURCE_POOL = 1u << 1,
+    OMEGA_RESOURCE_COORDINATOR = 1u << 2
+} omega_resource_t;
+
+#define OMEGA_RUNTIME_MAX_TASKS 16
+#define OMEGA_RUNTIME_MAX_WORKERS 8
+
+/**
+ * @brief Задача такта и её наборы ресурсов (маски omega_resource_t).
+ */
+typedef struct {
+    const char* name;
+    void (*run)(void* arg);
+    void* arg;
+    unsigned reads;   // только чтение
+    unsigned appends; // только добавления в Холст или пул, с чтением
+    unsigned writes;  // любые изменения, исключительный доступ
+} omega_runtime_task_t;
+
+struct omega_runtime_s;
+
+// Поток пула и его очередь готовых задач: владелец берёт с головы, то есть
+// в порядке задач, а другие потоки забирают с хвоста
+typedef struct {
+    struct omega_runtime_s* runtime;
+    size_t index;
+    pthread_mutex_t lock;
+    size_t items[OMEGA_RUNTIME_MAX_TASKS];
+    size_t head;
+    size_t tail;
+} omega_runtime_worker_t;
+
+typedef struct omega_runtime_s {
+    omega_canvas_t* canvas;
+    kf_pool_t* pool;
+    omega_runtime_task_t tasks[OMEGA_RUNTIME_MAX_TASKS];
+    size_t task_count;
+    kf_pool_stage_t pool_stages[OMEGA_RUNTIME_MAX_TASKS];
+    omega_canvas_stage_t canvas_stages[OMEGA_RUNTIME_MAX_TASKS];
+
+    // Состояние текущего такта, под lock
+    size_t pending[OMEGA_RUNTIME_MAX_TASKS]; // невыполненные зависимости
+    uint32_t dependents[OMEGA_RUNTIME_MAX_TASKS];
+    uint32_t finished;        // маска выполненных задач
+    uint32_t pool_merged;     // маска задач, чьи формулы уже в пуле
+    uint32_t canvas_merged;
+    size_t remaining;
+    size_t ready;             // задач в очередях, атомарно
+    int merge_failed;
+
+    omega_runtime_worker_t workers[OMEGA_RUNTIME_MAX_WORKERS];
+    size_t worker_count;      // вместе с вызывающим потоком
+    pthread_t threads[OMEGA_RUNTIME_MAX_WORKERS];
+    size_t started;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} omega_runtime_t;
+
+/**
+ * @brief Инициализирует среду и запускает потоки.
+ * @param workers Число потоков вместе с вызывающим; 0 — по числу ядер.
+ * @return 0 в случае успеха, -1 в случае ошибки.
+ */
+int omega_runtime_init(omega_runtime_t* runtime, omega_canvas_t* canvas, kf_pool_t* pool, size_t workers);
+
+/**
+ * @brief Останавливает потоки и освобождает этапы.
+ */
+void omega_runtime_destroy(omega_runtime_t* runtime);
+
+/**
+ * @brief Добавляет задачу, выполняемую в каждом такте.
+ * @return 0 в случае успеха, -1 если задач слишком много или наборы неверны
+ * (пополнять можно только Холст и пул).
+ */
+int omega_runtime_add_task(omega_runtime_t* runtime, const omega_runtime_task_t* task);
+
+/**
+ * @brief Выполняет все задачи один раз и сливает их добавления.
+ * Вызывающий поток работает наравне с остальными.
+ * @return 0 в случае успеха, -1 если добавления не удалось слить.
+ */
+int omega_runtime_tick(omega_runtime_t* runtime);
+
+#endif // KOLIBRI_OMEGA_RUNTIME_H
@@ -9,6 +9,7 @@
 #ifndef OMEGA_POLICY_LEARNER_H
 #define OMEGA_POLICY_LEARNER_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 
 /* ========== Определения констант ========== */
@@ -54,7 +55,7 @@ typedef struct {
     omega_system_state_t target_state;
     char policy_name[64];
     
-    omega_action_value_t actions[OMEGA_MAX_POLICY_ACTIONS];
+    // Оценки действий лежат в разреженной Q-таблице модуля
     int action_count;
     
     // Параметры обучения
@@ -87,6 +88,16 @@ typedef struct {
     int episode_length;  // Сколько шагов заняло
 } omega_learning_episode_t;
 
+/**
+ * omega_policy_transition_t - Переход для пакетного обновления
+ */
+typedef struct {
+    omega_system_state_t state;
+    uint64_t action;
+    double reward;
+    omega_system_state_t next_state;
+} omega_policy_transition_t;
+
 /**
  * omega_policy_stats_t - Статистика обучения политики
  */
@@ -114,12 +125,12 @@ typedef struct {
 /**
  * omega_policy_learner_init - инициализация системы обучения
  */
-int omega_policy_learner_init(void);
+int omega_policy_learner_init(omega_context_t* ctx);
 
 /**
  * omega_create_policy - создать новую политику для состояния
  */
-uint64_t omega_create_policy(omega_system_state_t state,
+uint64_t omega_create_policy(omega_context_t* ctx, omega_system_state_t state,
                             const char* policy_name,
                             double learning_rate);
 
@@ -128,7 +139,7 @@ uint64_t omega_create_policy(omega_system_state_t state,
  * 
  * После каждого сценария из Phase 6 записываем результат.
  */
-int omega_record_learning_episode(omega_system_state_t initial_state,
+int omega_record_learning_episode(omega_context_t* ctx, omega_system_state_t initial_state,
                                  uint64_t action_taken,
                                  double reward,
                                  omega_system_state_t next_state,
@@ -154,7 +165,7 @@ double omega_compute_reward(double divergence_before,
  * 
  * @return ID лучшего действия или 0
  */
-uint64_t omega_select_best_action(omega_system_state_t state,
+uint64_t omega_select_best_action(omega_context_t* ctx, omega_system_state_t state,
                                  double exploration_epsilon);
 
 /**
@@ -162,17 +173,37 @@ uint64_t omega_select_best_action(omega_system_state_t state,
  * 
  * Использует Q-learning: Q_new = Q_old + α * (R + γ * max(Q_next) - Q_old)
  */
-int omega_update_policy(omega_system_state_t state,
+int omega_update_policy(omega_context_t* ctx, omega_system_state_t state,
                        uint64_t action,
                        double reward,
                        omega_system_state_t next_state);
 
+/**
+ * omega_update_policy_batch - обновить Q-values пакетом переходов
+ * 
+ * Цели R + γ * max(Q_next) считаются по Q до пакета, затем переходы
+ * применяются по порядку. Переходы без политики пропускаются.
+ * @return Число применённых переходов или -1 при неверных аргументах
+ */
+int omega_update_policy_batch(omega_context_t* ctx,
+                              const omega_policy_transition_t* transitions,
+                              int count);
+
+/**
+ * omega_replay_learning_episodes - experience replay
+ * 
+ * Выбирает batch_size случайных записанных эпизодов (с повторами) и
+ * обновляет по ним политики одним пакетом.
+ * @return Число применённых переходов или -1 при ошибке
+ */
+int omega_replay_learning_episodes(omega_context_t* ctx, int batch_size);
+
 /**
  * omega_get_policy_effectiveness - оценить эффективность политики
  * 
  * @return Эффективность [0.0, 1.0] (win_rate)
  */
-double omega_get_policy_effectiveness(omega_system_state_t state);
+double omega_get_policy_effectiveness(omega_context_t* ctx, omega_system_state_t state);
 
 /**
  * omega_extract_best_policy_actions - извлечь лучшие действия
@@ -182,18 +213,18 @@ double omega_get_policy_effectiveness(omega_system_state_t state);
  * @param max_count - размер массива
  * @return Количество извлеченных действий
  */
-int omega_extract_best_policy_actions(omega_system_state_t state,
+int omega_extract_best_policy_actions(omega_context_t* ctx, omega_system_state_t state,
                                      uint64_t* actions_out,
                                      int max_count);
 
 /**
  * omega_get_policy_statistics - получить статистику
  */
-const omega_policy_stats_t* omega_get_policy_statistics(void);
+const omega_policy_stats_t* omega_get_policy_statistics(omega_context_t* ctx);
 
 /**
  * omega_policy_learner_shutdown - остановка
  */
-void omega_policy_learner_shutdown(void);
+void omega_policy_learner_shutdown(omega_context_t* ctx);
 
 #endif // OMEGA_POLICY_LEARNER_H
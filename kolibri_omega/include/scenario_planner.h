@@ -1,6 +1,7 @@
 #ifndef OMEGA_SCENARIO_PLANNER_H
 #define OMEGA_SCENARIO_PLANNER_H
 
+#include "kolibri_omega/include/omega_context.h"
 #include <stdint.h>
 
 /* ========== Константы ========== */
@@ -10,6 +11,13 @@
 #define OMEGA_MAX_PLAN_STATES 50
 #define OMEGA_MAX_OUTCOMES 200
 
+// Поиск Монте-Карло по дереву
+#define OMEGA_PLAN_ACTION_COUNT 6
+#define OMEGA_PLAN_MAX_SEARCH_DEPTH 64
+#define OMEGA_PLAN_DEFAULT_NODES 65536
+#define OMEGA_PLAN_DEFAULT_ROLLOUTS 4096
+#define OMEGA_PLAN_MAX_WORKERS 16
+
 /* ========== Перечисления ========== */
 
 /**
@@ -143,8 +151,43 @@ typedef struct {
     // Итоговая оценка плана
     double total_expected_value;
     int recommended_branch;
+
+    // Розыгрышей поиска по дереву плана, 0 — поиска не было
+    uint64_t search_rollouts;
 } omega_scenario_plan_t;
 
+/**
+ * omega_plan_search_config_t - параметры поиска Монте-Карло
+ *
+ * Нулевые поля берут значения по умолчанию. Поиск останавливается по
+ * первому из ограничений deadline_ms и max_rollouts; если оба нулевые,
+ * выполняется OMEGA_PLAN_DEFAULT_ROLLOUTS розыгрышей.
+ */
+typedef struct {
+    int workers;             // потоков вместе с вызывающим, 0 — по числу ядер
+    uint32_t deadline_ms;    // бюджет времени
+    uint64_t max_rollouts;   // бюджет розыгрышей за вызов
+    int max_nodes;           // ёмкость пула узлов, задаётся первым поиском плана
+    int max_depth;           // глубина дерева, 0 — OMEGA_MAX_PLANNING_DEPTH
+    int rollout_depth;       // случайных шагов после листа, 0 — 5
+    double exploration;      // константа UCT, 0 — 1.41
+    uint64_t seed;
+} omega_plan_search_config_t;
+
+/**
+ * omega_plan_search_result_t - итог поиска (лучшее на момент остановки)
+ */
+typedef struct {
+    uint64_t rollouts;       // за этот вызов
+    uint64_t total_rollouts; // за все вызовы для плана
+    int nodes;
+    int workers;
+    omega_planning_action_t best_action;
+    double best_value;
+    int best_visits;
+    double elapsed_ms;
+} omega_plan_search_result_t;
+
 /**
  * omega_planning_stats_t - статистика планирования
  */
@@ -169,19 +212,19 @@ typedef struct {
 /**
  * omega_scenario_planner_init - инициализация планировщика
  */
-int omega_scenario_planner_init(void);
+int omega_scenario_planner_init(omega_context_t* ctx);
 
 /**
  * omega_create_scenario_plan - создать новый план сценариев
  */
-uint32_t omega_create_scenario_plan(const char* plan_name,
+uint32_t omega_create_scenario_plan(omega_context_t* ctx, const char* plan_name,
                                    const omega_plan_state_t* current_state,
                                    int planning_depth);
 
 /**
  * omega_add_scenario_branch - добавить ветвь к плану
  */
-uint32_t omega_add_scenario_branch(uint32_t plan_id,
+uint32_t omega_add_scenario_branch(omega_context_t* ctx, uint32_t plan_id,
                                   uint32_t parent_branch_id,
                                   omega_planning_action_t action,
                                   const char* action_description);
@@ -191,7 +234,7 @@ uint32_t omega_add_scenario_branch(uint32_t plan_id,
  * 
  * Использует предсказатели и политики для моделирования пути
  */
-uint32_t omega_compute_trajectory(uint32_t plan_id,
+uint32_t omega_compute_trajectory(omega_context_t* ctx, uint32_t plan_id,
                                  uint32_t start_branch_id,
                                  const omega_plan_state_t* target_state,
                                  int max_steps);
@@ -199,43 +242,60 @@ uint32_t omega_compute_trajectory(uint32_t plan_id,
 /**
  * omega_evaluate_branch - оценить ветвь с помощью UCB или ожидаемой стоимости
  */
-double omega_evaluate_branch(uint32_t plan_id, uint32_t branch_id);
+double omega_evaluate_branch(omega_context_t* ctx, uint32_t plan_id, uint32_t branch_id);
 
 /**
  * omega_predict_outcome - предсказать итоговый результат для ветви
  */
-int omega_predict_outcome(uint32_t plan_id,
+int omega_predict_outcome(omega_context_t* ctx, uint32_t plan_id,
                          uint32_t branch_id,
                          omega_plan_outcome_t* outcome_out);
 
+/**
+ * omega_plan_search - параллельный поиск Монте-Карло (UCT) от корня плана
+ *
+ * Потоки с собственными генераторами выбирают узлы по UCT с виртуальной
+ * потерей, раскрывают их в общем пуле без блокировок и разыгрывают
+ * случайное продолжение. Повторный вызов продолжает то же дерево, так что
+ * качество плана растёт с числом ядер и бюджетом времени. Потомки корня
+ * записываются в ветви плана глубины 1. Возвращает 0 или -1.
+ */
+int omega_plan_search(omega_context_t* ctx, uint32_t plan_id,
+                     const omega_plan_search_config_t* config,
+                     omega_plan_search_result_t* result_out);
+
 /**
  * omega_select_best_branch - выбрать лучшую ветвь по expected value
+ *
+ * После omega_plan_search — ветвь глубины 1 с наибольшим числом посещений,
+ * то есть лучшая на момент, когда истёк бюджет поиска
  */
-uint32_t omega_select_best_branch(uint32_t plan_id);
+uint32_t omega_select_best_branch(omega_context_t* ctx, uint32_t plan_id);
 
 /**
  * omega_expand_scenario_tree - расширить дерево сценариев на один уровень
  * 
  * Генерирует новые ветви для всех листовых узлов
  */
-int omega_expand_scenario_tree(uint32_t plan_id);
+int omega_expand_scenario_tree(omega_context_t* ctx, uint32_t plan_id);
 
 /**
  * omega_simulate_plan_execution - симулировать выполнение плана
  * 
- * Пройти по лучшей траектории и собрать прогнозы
+ * Пройти по лучшей траектории и собрать прогнозы. После omega_plan_search
+ * траектория — путь по наиболее посещаемым узлам дерева поиска.
  */
-int omega_simulate_plan_execution(uint32_t plan_id,
+int omega_simulate_plan_execution(omega_context_t* ctx, uint32_t plan_id,
                                  omega_plan_trajectory_t* trajectory_out);
 
 /**
  * omega_get_planning_statistics - получить статистику
  */
-const omega_planning_stats_t* omega_get_planning_statistics(void);
+const omega_planning_stats_t* omega_get_planning_statistics(omega_context_t* ctx);
 
 /**
  * omega_scenario_planner_shutdown - остановка
  */
-void omega_scenario_planner_shutdown(void);
+void omega_scenario_planner_shutdown(omega_context_t* ctx);
 
 #endif  // OMEGA_SCENARIO_PLANNER_H
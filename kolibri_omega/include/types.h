@@ -7,7 +7,8 @@
 #include "forward.h"
 
 // --- KF Pool Types ---
-#define MAX_FORMULAS 1024
+// Начальная ёмкость пула; дальше массив формул растёт удвоением
+#define KF_POOL_INITIAL_CAPACITY 1024
 #define MAX_PREDICATES 4
 
 typedef enum {
@@ -39,10 +40,30 @@ struct kf_formula_s {
     } data;
 };
 
+// Формулы лежат плотным массивом в порядке добавления; slots — открытая
+// адресация по id, хранит индекс формулы + 1 (0 — пустая ячейка)
 struct kf_pool_s {
-    kf_formula_t formulas[MAX_FORMULAS];
+    kf_formula_t* formulas;
     size_t count;
+    size_t capacity;
     uint64_t next_id;
+    size_t* slots;
+    size_t slot_capacity;
+    // Правила по condition_formula_id: цепочки индекс + 1 в порядке пула,
+    // головы и хвосты на slot_capacity ячеек
+    size_t* rule_heads;
+    size_t* rule_tails;
+    size_t* rule_next;
+    uint64_t rules_version; // растёт при любом изменении, которое может задеть правила
+};
+
+// Формулы, добавленные потоком во время параллельного такта. id выдаются
+// сразу, а в пул формулы попадают при слиянии на барьере
+struct kf_pool_stage_s {
+    kf_pool_t* pool;
+    kf_formula_t* formulas;
+    size_t count;
+    size_t capacity;
 };
 
 // --- Sigma Coordinator Types ---
@@ -78,27 +99,67 @@ struct sigma_coordinator_s {
 };
 
 // --- Canvas Types ---
-#define MAX_CANVAS_ITEMS 256
+#define OMEGA_CANVAS_INITIAL_CAPACITY 256
 
 typedef enum {
     OMEGA_HYPOTHESIS_FACT,
     OMEGA_HYPOTHESIS_PREDICTION,
     OMEGA_HYPOTHESIS_DREAM
 } omega_hypothesis_type;
+#define OMEGA_HYPOTHESIS_TYPES 3
 
 struct omega_canvas_item_s {
-    uint64_t id; // Уникальный ID элемента на холсте
+    uint64_t id; // Уникальный ID элемента на холсте: поколение << 32 | слот + 1
     omega_hypothesis_type type;
     uint64_t formula_id;
     uint64_t derived_from_rule_id; // 0 если это просто факт
     int timestamp; // Время добавления на холст
 };
 
+// Слот карты ID. У живого элемента index — его позиция в items,
+// у свободного слота — следующий свободный слот + 1
+typedef struct {
+    uint32_t generation;
+    uint32_t index;
+} omega_canvas_slot_t;
+
+// Служебные данные элемента, параллельные items
+typedef struct {
+    uint32_t slot;
+    uint32_t type_pos; // позиция в type_items[type]
+    uint32_t key_prev; // соседи в цепочке ключа: индекс + 1, 0 — нет
+    uint32_t key_next;
+    int object_id;     // (object_id, time) формулы-факта
+    int time;
+    unsigned char keyed; // формула элемента — факт
+} omega_canvas_entry_t;
+
 struct omega_canvas_s {
-    omega_canvas_item_t items[MAX_CANVAS_ITEMS];
+    omega_canvas_item_t* items; // Живые элементы подряд
     size_t count;
-    uint64_t next_item_id; // ID для следующего элемента
+    size_t capacity;
     kf_pool_t* formula_pool;
+    int stable_order; // 1 — удаление сдвигает элементы и сохраняет порядок
+    omega_canvas_entry_t* entries;
+    // Карта ID: слоты переиспользуются, поколение отличает старые ID
+    omega_canvas_slot_t* slots;
+    size_t slot_count;
+    uint32_t free_slot; // голова списка свободных слотов, слот + 1
+    // Индекс по (object_id, time): цепочки в порядке добавления элементов
+    uint32_t* key_head;
+    uint32_t* key_tail;
+    size_t key_slots;
+    // Индексы элементов каждого типа
+    uint32_t* type_items[OMEGA_HYPOTHESIS_TYPES];
+    size_t type_count[OMEGA_HYPOTHESIS_TYPES];
+};
+
+// Элементы, добавленные потоком во время параллельного такта
+struct omega_canvas_stage_s {
+    omega_canvas_t* canvas;
+    omega_canvas_item_t* items;
+    size_t count;
+    size_t capacity;
 };
 
 // --- Cognitive Module Types ---
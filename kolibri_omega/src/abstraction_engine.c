@@ -2,7 +2,9 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
 #include "kolibri_omega/include/canvas.h"
+#include "kolibri/log.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -10,7 +12,7 @@
  * @brief Инициализирует модуль абстракции.
  */
 void omega_abstraction_engine_init(void) {
-    printf("[AbstractionEngine] Initialized. Ready for knowledge abstraction and categorization.\n");
+    KOLIBRI_LOG_INFO("AbstractionEngine", "Initialized. Ready for knowledge abstraction and categorization.");
 }
 
 /**
@@ -76,7 +78,7 @@ int omega_discover_categories(omega_canvas_t* canvas, kf_pool_t* formula_pool,
         
         if (position_category->member_count > 0) {
             position_category->average_confidence = 0.8;  // Высокая уверенность в прямых наблюдениях
-            printf("[AbstractionEngine] Discovered category '%s' with %zu members\n",
+            KOLIBRI_LOG_INFO("AbstractionEngine", "Discovered category '%s' with %zu members",
                    position_category->name, position_category->member_count);
             category_count++;
         }
@@ -144,10 +146,596 @@ uint64_t omega_create_abstract_rule(kf_pool_t* formula_pool,
     
     uint64_t rule_id = kf_add_formula(formula_pool, &abstract_rule);
     
-    printf("[AbstractionEngine] Created ABSTRACT RULE %llu: %s(cat:%zu) → %s(cat:%zu) (conf: 0.75)\n",
+    KOLIBRI_LOG_INFO("AbstractionEngine", "Created ABSTRACT RULE %llu: %s(cat:%zu) → %s(cat:%zu) (conf: 0.75)",
            (unsigned long long)rule_id,
            condition_category->name, condition_category->member_count,
            consequence_category->name, consequence_category->member_count);
     
     return rule_id;
 }
+
+// --- Онлайн-кластеризация ---
+
+#define STREAM_FACT_FEATURES (2 * MAX_PREDICATES)
+#define STREAM_KEYS (OMEGA_STREAM_LSH_BANDS + 1)   // полосы MinHash и ключ схемы
+
+struct omega_abstraction_ctx_s {
+    omega_stream_cluster_config_t config;
+    omega_stream_cluster_stats_t stats;
+
+    omega_stream_category_t* categories;   // индекс = id - 1
+    size_t category_count;
+    size_t category_capacity;
+
+    // Корзины LSH: открытая адресация по ключу, значение — индекс категории + 1
+    uint64_t* bucket_keys;
+    uint32_t* bucket_values;
+    size_t bucket_slots;
+    size_t bucket_used;
+
+    // Категории, изменившиеся после своего последнего прохода слияния
+    uint32_t* dirty;
+    uint8_t* dirty_flags;
+    size_t dirty_count;
+    size_t since_merge;
+};
+
+typedef struct omega_abstraction_ctx_s omega_abstraction_ctx_t;
+
+static uint64_t stream_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Признаки имён нечётные, признаки пар «имя=значение» чётные: так ключ
+// схемы можно получить и из центроида, где остались только хеши.
+static uint64_t stream_feature(const char* name, const char* value) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const unsigned char* p = (const unsigned char*)name; *p; ++p) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    if (!value) {
+        return h | 1;
+    }
+    h = (h ^ '=') * 0x100000001B3ULL;
+    for (const unsigned char* p = (const unsigned char*)value; *p; ++p) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    return h & ~1ULL;
+}
+
+static size_t stream_add_feature(uint64_t* features, size_t count, uint64_t feature) {
+    for (size_t i = 0; i < count; ++i) {
+        if (features[i] == feature) {
+            return count;
+        }
+    }
+    features[count] = feature;
+    return count + 1;
+}
+
+static size_t stream_fact_features(const kf_formula_t* fact, uint64_t* features) {
+    size_t count = 0;
+    size_t predicates = fact->data.fact.num_predicates;
+    if (predicates > MAX_PREDICATES) {
+        predicates = MAX_PREDICATES;
+    }
+    for (size_t i = 0; i < predicates; ++i) {
+        const kf_predicate_t* predicate = &fact->data.fact.predicates[i];
+        count = stream_add_feature(features, count, stream_feature(predicate->name, NULL));
+        count = stream_add_feature(features, count, stream_feature(predicate->name, predicate->value));
+    }
+    return count;
+}
+
+// Ключи корзин: OMEGA_STREAM_LSH_BANDS полос по OMEGA_STREAM_LSH_ROWS
+// минимумов MinHash и сумма хешей имён — ключ схемы. Ноль означает пустой слот.
+static void stream_keys(const uint64_t* features, size_t count, uint64_t* keys) {
+    uint64_t schema = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (features[i] & 1) {
+            schema += stream_mix(features[i]);
+        }
+    }
+    for (size_t band = 0; band < OMEGA_STREAM_LSH_BANDS; ++band) {
+        uint64_t key = stream_mix(band + 1);
+        for (size_t row = 0; row < OMEGA_STREAM_LSH_ROWS; ++row) {
+            uint64_t seed = (band * OMEGA_STREAM_LSH_ROWS + row + 1) * 0x9E3779B97F4A7C15ULL;
+            uint64_t minimum = UINT64_MAX;
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t h = stream_mix(features[i] ^ seed);
+                if (h < minimum) {
+                    minimum = h;
+                }
+            }
+            key = stream_mix(key ^ minimum);
+        }
+        keys[band] = key ? key : 1;
+    }
+    schema = stream_mix(schema ^ 0x5C4E3A2B1D0F9E8DULL);
+    keys[OMEGA_STREAM_LSH_BANDS] = schema ? schema : 1;
+}
+
+static uint32_t stream_bucket_get(omega_abstraction_ctx_t* ac, uint64_t key) {
+    size_t mask = ac->bucket_slots - 1;
+    size_t slot = (size_t)stream_mix(key) & mask;
+    while (ac->bucket_keys[slot]) {
+        if (ac->bucket_keys[slot] == key) {
+            return ac->bucket_values[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+static void stream_bucket_place(uint64_t* keys, uint32_t* values, size_t slots,
+                                uint64_t key, uint32_t value, size_t* used) {
+    size_t mask = slots - 1;
+    size_t slot = (size_t)stream_mix(key) & mask;
+    while (keys[slot] && keys[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    if (!keys[slot]) {
+        keys[slot] = key;
+        ++*used;
+    }
+    values[slot] = value;
+}
+
+static int stream_bucket_put(omega_abstraction_ctx_t* ac, uint64_t key, uint32_t value) {
+    if ((ac->bucket_used + 1) * 2 > ac->bucket_slots) {
+        size_t slots = ac->bucket_slots * 2;
+        uint64_t* keys = calloc(slots, sizeof(uint64_t));
+        uint32_t* values = calloc(slots, sizeof(uint32_t));
+        if (!keys || !values) {
+            free(keys);
+            free(values);
+            return -1;
+        }
+        size_t used = 0;
+        for (size_t i = 0; i < ac->bucket_slots; ++i) {
+            if (ac->bucket_keys[i]) {
+                stream_bucket_place(keys, values, slots, ac->bucket_keys[i], ac->bucket_values[i], &used);
+            }
+        }
+        free(ac->bucket_keys);
+        free(ac->bucket_values);
+        ac->bucket_keys = keys;
+        ac->bucket_values = values;
+        ac->bucket_slots = slots;
+        ac->bucket_used = used;
+    }
+    stream_bucket_place(ac->bucket_keys, ac->bucket_values, ac->bucket_slots, key, value, &ac->bucket_used);
+    return 0;
+}
+
+// Живая категория, поглотившая index, со сжатием пути
+static size_t stream_root(omega_abstraction_ctx_t* ac, size_t index) {
+    size_t root = index;
+    while (ac->categories[root].merged_into) {
+        root = (size_t)ac->categories[root].merged_into - 1;
+    }
+    while (ac->categories[index].merged_into) {
+        size_t next = (size_t)ac->categories[index].merged_into - 1;
+        ac->categories[index].merged_into = ac->categories[root].id;
+        index = next;
+    }
+    return root;
+}
+
+static double stream_weight(const omega_stream_category_t* category, uint64_t feature) {
+    for (size_t i = 0; i < category->feature_count; ++i) {
+        if (category->centroid[i].feature == feature) {
+            return category->centroid[i].weight;
+        }
+    }
+    return 0.0;
+}
+
+static double stream_fact_similarity(const omega_stream_category_t* category,
+                                     const uint64_t* features, size_t count) {
+    if (category->member_count == 0 || count == 0) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += stream_weight(category, features[i]);
+    }
+    return sum / ((double)category->member_count * (double)count);
+}
+
+// Взвешенный коэффициент Жаккара по долям членов с каждым признаком
+static double stream_centroid_similarity(const omega_stream_category_t* a, const omega_stream_category_t* b) {
+    double na = (double)a->member_count;
+    double nb = (double)b->member_count;
+    double overlap = 0.0;
+    double total = 0.0;
+    for (size_t i = 0; i < a->feature_count; ++i) {
+        double pa = a->centroid[i].weight / na;
+        double pb = stream_weight(b, a->centroid[i].feature) / nb;
+        overlap += pa < pb ? pa : pb;
+        total += pa;
+    }
+    for (size_t i = 0; i < b->feature_count; ++i) {
+        total += b->centroid[i].weight / nb;
+    }
+    total -= overlap;
+    return total > 0.0 ? overlap / total : 0.0;
+}
+
+// Заполненный центроид отдаёт слот самого лёгкого признака, как в Space-Saving
+static void stream_centroid_add(omega_stream_category_t* category, uint64_t feature, double weight) {
+    size_t lightest = 0;
+    for (size_t i = 0; i < category->feature_count; ++i) {
+        if (category->centroid[i].feature == feature) {
+            category->centroid[i].weight += weight;
+            return;
+        }
+        if (category->centroid[i].weight < category->centroid[lightest].weight) {
+            lightest = i;
+        }
+    }
+    if (category->feature_count < OMEGA_STREAM_CENTROID_FEATURES) {
+        category->centroid[category->feature_count].feature = feature;
+        category->centroid[category->feature_count].weight = weight;
+        category->feature_count++;
+        return;
+    }
+    category->centroid[lightest].feature = feature;
+    category->centroid[lightest].weight += weight;
+}
+
+static int stream_push_member(omega_stream_category_t* category, uint64_t fact_id) {
+    if (category->member_count == category->member_capacity) {
+        size_t capacity = category->member_capacity ? category->member_capacity * 2 : 8;
+        uint64_t* members = realloc(category->members, capacity * sizeof(uint64_t));
+        if (!members) {
+            return -1;
+        }
+        category->members = members;
+        category->member_capacity = capacity;
+    }
+    category->members[category->member_count++] = fact_id;
+    return 0;
+}
+
+static void stream_mark_dirty(omega_abstraction_ctx_t* ac, size_t index) {
+    if (!ac->dirty_flags[index]) {
+        ac->dirty_flags[index] = 1;
+        ac->dirty[ac->dirty_count++] = (uint32_t)index;
+    }
+}
+
+static long stream_new_category(omega_abstraction_ctx_t* ac, const kf_formula_t* fact) {
+    if (ac->category_count == ac->category_capacity) {
+        size_t capacity = ac->category_capacity * 2;
+        omega_stream_category_t* categories = realloc(ac->categories, capacity * sizeof(*categories));
+        if (!categories) {
+            return -1;
+        }
+        ac->categories = categories;
+        uint32_t* dirty = realloc(ac->dirty, capacity * sizeof(uint32_t));
+        if (!dirty) {
+            return -1;
+        }
+        ac->dirty = dirty;
+        uint8_t* flags = realloc(ac->dirty_flags, capacity);
+        if (!flags) {
+            return -1;
+        }
+        memset(flags + ac->category_capacity, 0, capacity - ac->category_capacity);
+        ac->dirty_flags = flags;
+        ac->category_capacity = capacity;
+    }
+    size_t index = ac->category_count++;
+    omega_stream_category_t* category = &ac->categories[index];
+    memset(category, 0, sizeof(*category));
+    category->id = index + 1;
+
+    const char* predicate = fact->data.fact.predicates[0].name;
+    if (strncmp(predicate, "position", 8) == 0) {
+        category->type = CATEGORY_POSITION;
+    } else if (strncmp(predicate, "velocity", 8) == 0 || strncmp(predicate, "speed", 5) == 0) {
+        category->type = CATEGORY_MOTION;
+    } else {
+        category->type = CATEGORY_STATE;
+    }
+    snprintf(category->name, sizeof(category->name), "%.50s#%llu",
+             predicate, (unsigned long long)category->id);
+    ac->stats.categories_created++;
+    ac->stats.live_categories++;
+    return (long)index;
+}
+
+static void stream_free(omega_abstraction_ctx_t* ac) {
+    for (size_t i = 0; i < ac->category_count; ++i) {
+        free(ac->categories[i].members);
+    }
+    free(ac->categories);
+    free(ac->bucket_keys);
+    free(ac->bucket_values);
+    free(ac->dirty);
+    free(ac->dirty_flags);
+    ac->categories = NULL;
+    ac->bucket_keys = NULL;
+    ac->bucket_values = NULL;
+    ac->dirty = NULL;
+    ac->dirty_flags = NULL;
+}
+
+int omega_stream_clustering_init(omega_context_t* ctx, const omega_stream_cluster_config_t* config) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->abstraction && !(ctx->abstraction = calloc(1, sizeof(omega_abstraction_ctx_t)))) {
+        return -1;
+    }
+    omega_abstraction_ctx_t* ac = ctx->abstraction;
+    stream_free(ac);
+    memset(ac, 0, sizeof(*ac));
+    if (config) {
+        ac->config = *config;
+    }
+    if (ac->config.assign_threshold <= 0.0) {
+        ac->config.assign_threshold = 0.5;
+    }
+    if (ac->config.merge_threshold <= 0.0) {
+        ac->config.merge_threshold = 0.7;
+    }
+    if (ac->config.merge_interval == 0) {
+        ac->config.merge_interval = OMEGA_STREAM_MERGE_INTERVAL;
+    }
+
+    ac->category_capacity = 64;
+    ac->bucket_slots = 256;
+    ac->categories = malloc(ac->category_capacity * sizeof(omega_stream_category_t));
+    ac->dirty = malloc(ac->category_capacity * sizeof(uint32_t));
+    ac->dirty_flags = calloc(ac->category_capacity, 1);
+    ac->bucket_keys = calloc(ac->bucket_slots, sizeof(uint64_t));
+    ac->bucket_values = calloc(ac->bucket_slots, sizeof(uint32_t));
+    if (!ac->categories || !ac->dirty || !ac->dirty_flags || !ac->bucket_keys || !ac->bucket_values) {
+        stream_free(ac);
+        free(ac);
+        ctx->abstraction = NULL;
+        return -1;
+    }
+    KOLIBRI_LOG_INFO("AbstractionEngine", "Stream clustering initialized (assign %.2f, merge %.2f every %zu facts)",
+           ac->config.assign_threshold, ac->config.merge_threshold, ac->config.merge_interval);
+    return 0;
+}
+
+uint64_t omega_stream_categorize_fact(omega_context_t* ctx, kf_pool_t* formula_pool, uint64_t fact_id) {
+    omega_abstraction_ctx_t* ac = ctx ? ctx->abstraction : NULL;
+    if (!ac || !formula_pool) {
+        return 0;
+    }
+    const kf_formula_t* fact = kf_borrow_formula(formula_pool, fact_id);
+    if (!fact || fact->type != KF_TYPE_FACT || fact->data.fact.num_predicates == 0) {
+        return 0;
+    }
+
+    uint64_t features[STREAM_FACT_FEATURES];
+    uint64_t keys[STREAM_KEYS];
+    size_t feature_count = stream_fact_features(fact, features);
+    stream_keys(features, feature_count, keys);
+
+    // Кандидаты — категории корзин факта; разные ключи часто ведут к одной
+    size_t seen[STREAM_KEYS];
+    size_t seen_count = 0;
+    long best = -1;
+    double best_similarity = 0.0;
+    for (size_t k = 0; k < STREAM_KEYS; ++k) {
+        uint32_t value = stream_bucket_get(ac, keys[k]);
+        if (!value) {
+            continue;
+        }
+        size_t index = stream_root(ac, value - 1);
+        size_t j = 0;
+        while (j < seen_count && seen[j] != index) {
+            ++j;
+        }
+        if (j < seen_count) {
+            continue;
+        }
+        seen[seen_count++] = index;
+        ac->stats.candidates_checked++;
+        double similarity = stream_fact_similarity(&ac->categories[index], features, feature_count);
+        if (similarity > best_similarity) {
+            best_similarity = similarity;
+            best = (long)index;
+        }
+    }
+
+    if (best < 0 || best_similarity < ac->config.assign_threshold) {
+        best = stream_new_category(ac, fact);
+        if (best < 0) {
+            return 0;
+        }
+        best_similarity = 1.0;
+    }
+    omega_stream_category_t* category = &ac->categories[best];
+    if (stream_push_member(category, fact_id) != 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < feature_count; ++i) {
+        stream_centroid_add(category, features[i], 1.0);
+    }
+    category->similarity_sum += best_similarity;
+    for (size_t k = 0; k < STREAM_KEYS; ++k) {
+        stream_bucket_put(ac, keys[k], (uint32_t)best + 1);
+    }
+    stream_mark_dirty(ac, (size_t)best);
+    ac->stats.facts_assigned++;
+    uint64_t category_id = category->id;
+
+    if (++ac->since_merge >= ac->config.merge_interval) {
+        ac->since_merge = 0;
+        omega_stream_merge_categories(ctx, ac->config.merge_interval);
+    }
+    return category_id;
+}
+
+// Меньшая категория переходит в большую; возвращает индекс выжившей
+static size_t stream_absorb(omega_abstraction_ctx_t* ac, size_t a, size_t b) {
+    if (ac->categories[b].member_count > ac->categories[a].member_count) {
+        size_t t = a;
+        a = b;
+        b = t;
+    }
+    omega_stream_category_t* into = &ac->categories[a];
+    omega_stream_category_t* from = &ac->categories[b];
+    for (size_t i = 0; i < from->member_count; ++i) {
+        if (stream_push_member(into, from->members[i]) != 0) {
+            return a;
+        }
+    }
+    for (size_t i = 0; i < from->feature_count; ++i) {
+        stream_centroid_add(into, from->centroid[i].feature, from->centroid[i].weight);
+    }
+    into->similarity_sum += from->similarity_sum;
+    from->merged_into = into->id;
+    free(from->members);
+    from->members = NULL;
+    from->member_count = 0;
+    from->member_capacity = 0;
+    ac->stats.categories_merged++;
+    ac->stats.live_categories--;
+    return a;
+}
+
+size_t omega_stream_merge_categories(omega_context_t* ctx, size_t budget) {
+    omega_abstraction_ctx_t* ac = ctx ? ctx->abstraction : NULL;
+    if (!ac) {
+        return 0;
+    }
+    ac->stats.merge_passes++;
+    size_t merged = 0;
+    size_t processed = 0;
+    while (ac->dirty_count > 0 && (budget == 0 || processed < budget)) {
+        size_t index = ac->dirty[--ac->dirty_count];
+        ac->dirty_flags[index] = 0;
+        processed++;
+        if (ac->categories[index].merged_into) {
+            continue;
+        }
+
+        // Типичный член категории: признаки, которые несёт хотя бы половина членов
+        const omega_stream_category_t* category = &ac->categories[index];
+        uint64_t features[OMEGA_STREAM_CENTROID_FEATURES];
+        size_t feature_count = 0;
+        for (size_t i = 0; i < category->feature_count; ++i) {
+            if (category->centroid[i].weight * 2.0 >= (double)category->member_count) {
+                features[feature_count++] = category->centroid[i].feature;
+            }
+        }
+        if (feature_count == 0) {
+            continue;
+        }
+        uint64_t keys[STREAM_KEYS];
+        stream_keys(features, feature_count, keys);
+
+        int absorbed = 0;
+        for (size_t k = 0; k < STREAM_KEYS; ++k) {
+            uint32_t value = stream_bucket_get(ac, keys[k]);
+            if (!value) {
+                continue;
+            }
+            size_t other = stream_root(ac, value - 1);
+            if (other == index) {
+                continue;
+            }
+            if (stream_centroid_similarity(&ac->categories[index], &ac->categories[other]) >= ac->config.merge_threshold) {
+                index = stream_absorb(ac, index, other);
+                merged++;
+                absorbed = 1;
+            }
+        }
+        for (size_t k = 0; k < STREAM_KEYS; ++k) {
+            stream_bucket_put(ac, keys[k], (uint32_t)index + 1);
+        }
+        // Выжившая могла стать похожей на новых соседей — в следующий проход
+        if (absorbed) {
+            stream_mark_dirty(ac, index);
+        }
+    }
+    return merged;
+}
+
+const omega_stream_category_t* omega_stream_find_category(omega_context_t* ctx, uint64_t category_id) {
+    omega_abstraction_ctx_t* ac = ctx ? ctx->abstraction : NULL;
+    if (!ac || category_id == 0 || category_id > ac->category_count) {
+        return NULL;
+    }
+    return &ac->categories[stream_root(ac, (size_t)category_id - 1)];
+}
+
+typedef struct {
+    size_t member_count;
+    size_t index;
+} stream_rank_t;
+
+static int stream_rank_compare(const void* a, const void* b) {
+    const stream_rank_t* ra = a;
+    const stream_rank_t* rb = b;
+    if (ra->member_count != rb->member_count) {
+        return ra->member_count > rb->member_count ? -1 : 1;
+    }
+    return ra->index < rb->index ? -1 : (ra->index > rb->index);
+}
+
+size_t omega_stream_export_categories(omega_context_t* ctx, omega_category_t* out, size_t max) {
+    omega_abstraction_ctx_t* ac = ctx ? ctx->abstraction : NULL;
+    if (!ac || !out || max == 0 || ac->stats.live_categories == 0) {
+        return 0;
+    }
+    stream_rank_t* ranks = malloc(ac->stats.live_categories * sizeof(stream_rank_t));
+    if (!ranks) {
+        return 0;
+    }
+    size_t live = 0;
+    for (size_t i = 0; i < ac->category_count; ++i) {
+        if (!ac->categories[i].merged_into) {
+            ranks[live].member_count = ac->categories[i].member_count;
+            ranks[live].index = i;
+            live++;
+        }
+    }
+    qsort(ranks, live, sizeof(stream_rank_t), stream_rank_compare);
+
+    size_t count = live < max ? live : max;
+    for (size_t i = 0; i < count; ++i) {
+        const omega_stream_category_t* category = &ac->categories[ranks[i].index];
+        omega_category_t* dst = &out[i];
+        dst->id = category->id;
+        dst->type = category->type;
+        memcpy(dst->name, category->name, sizeof(dst->name));
+        dst->member_count = category->member_count < MAX_FACTS_PER_CATEGORY
+                                ? category->member_count : MAX_FACTS_PER_CATEGORY;
+        memcpy(dst->member_facts, category->members, dst->member_count * sizeof(uint64_t));
+        dst->average_confidence = category->member_count
+                                      ? category->similarity_sum / (double)category->member_count : 0.0;
+    }
+    free(ranks);
+    return count;
+}
+
+const omega_stream_cluster_stats_t* omega_stream_cluster_statistics(omega_context_t* ctx) {
+    return ctx && ctx->abstraction ? &ctx->abstraction->stats : NULL;
+}
+
+void omega_stream_clustering_shutdown(omega_context_t* ctx) {
+    omega_abstraction_ctx_t* ac = ctx ? ctx->abstraction : NULL;
+    if (!ac) {
+        return;
+    }
+    KOLIBRI_LOG_INFO("AbstractionEngine", "Stream clustering shutdown: %llu facts in %zu categories (%llu merged)",
+           (unsigned long long)ac->stats.facts_assigned, ac->stats.live_categories,
+           (unsigned long long)ac->stats.categories_merged);
+    stream_free(ac);
+    free(ac);
+    ctx->abstraction = NULL;
+}
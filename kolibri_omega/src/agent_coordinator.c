@@ -1,31 +1,270 @@
 #include "kolibri_omega/include/agent_coordinator.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
-#define OMEGA_MAX_AGENT_STATES 200
+// Открытая адресация по 64-битному ключу: значение — индекс записи + 1
+typedef struct {
+    uint64_t* keys;
+    uint32_t* values;
+    size_t slot_count;
+    size_t used;
+} coord_map_t;
 
 typedef struct {
-    omega_agent_state_t agent_states[OMEGA_MAX_AGENT_STATES];
-    int state_count;
-    
-    omega_agent_pattern_t patterns[OMEGA_MAX_AGENT_PATTERNS];
+    uint32_t agent_id;
+    uint64_t changes;
+    uint64_t mark;        // последнее состояние, для которого агент уже учтён в паре
+} coord_agent_t;
+
+// Скользящие моменты уверенностей по алгоритму Уэлфорда
+typedef struct {
+    omega_agent_pair_stats_t stats;
+    double mean_a;
+    double mean_b;
+    double m2_a;
+    double m2_b;
+    double co_moment;
+    int pending;          // совпадал после прошлого omega_find_synchronized_agents
+} coord_pair_t;
+
+struct omega_agent_coordinator_ctx_s {
+    // Последние состояния всех агентов, кольцо по времени прихода
+    omega_agent_state_t recent[OMEGA_MAX_COORDINATION_HISTORY];
+    int recent_head;
+    int recent_count;
+    uint64_t state_seq;
+    int64_t sync_window_ms;
+
+    coord_agent_t* agents;
+    size_t agent_capacity;
+    coord_map_t agent_map;
+
+    coord_pair_t* pairs;
+    size_t pair_count;
+    size_t pair_capacity;
+    coord_map_t pair_map;
+    uint32_t* pending;    // пары, совпавшие после прошлого поиска
+    size_t pending_count;
+    size_t pending_capacity;
+
+    omega_agent_pattern_t* patterns;
     int pattern_count;
+    int pattern_capacity;
+    coord_map_t pattern_map;
     
     int unique_agents;
     omega_multi_agent_stats_t stats;
-} omega_agent_coordinator_ctx_t;
+};
 
-static omega_agent_coordinator_ctx_t coordinator_ctx = {0};
+typedef struct omega_agent_coordinator_ctx_s omega_agent_coordinator_ctx_t;
+
+static uint64_t coord_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static int coord_map_init(coord_map_t* map, size_t slot_count) {
+    map->keys = calloc(slot_count, sizeof(uint64_t));
+    map->values = calloc(slot_count, sizeof(uint32_t));
+    map->slot_count = slot_count;
+    map->used = 0;
+    return map->keys && map->values ? 0 : -1;
+}
+
+static void coord_map_free(coord_map_t* map) {
+    free(map->keys);
+    free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+}
+
+static uint32_t coord_map_get(const coord_map_t* map, uint64_t key) {
+    size_t mask = map->slot_count - 1;
+    size_t slot = (size_t)coord_hash(key) & mask;
+    while (map->values[slot]) {
+        if (map->keys[slot] == key) {
+            return map->values[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+static void coord_map_place(coord_map_t* map, uint64_t key, uint32_t value) {
+    size_t mask = map->slot_count - 1;
+    size_t slot = (size_t)coord_hash(key) & mask;
+    while (map->values[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    map->keys[slot] = key;
+    map->values[slot] = value;
+    map->used++;
+}
+
+// Только для новых ключей
+static int coord_map_put(coord_map_t* map, uint64_t key, uint32_t value) {
+    if ((map->used + 1) * 2 > map->slot_count) {
+        coord_map_t grown;
+        if (coord_map_init(&grown, map->slot_count * 2) != 0) {
+            coord_map_free(&grown);
+            return -1;
+        }
+        for (size_t i = 0; i < map->slot_count; ++i) {
+            if (map->values[i]) {
+                coord_map_place(&grown, map->keys[i], map->values[i]);
+            }
+        }
+        coord_map_free(map);
+        *map = grown;
+    }
+    coord_map_place(map, key, value);
+    return 0;
+}
+
+static int coord_reserve(void** items, size_t* capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t grown = *capacity ? *capacity * 2 : 16;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void* resized = realloc(*items, grown * item_size);
+    if (!resized) {
+        return -1;
+    }
+    *items = resized;
+    *capacity = grown;
+    return 0;
+}
+
+static void coord_free(omega_agent_coordinator_ctx_t* coordinator_ctx) {
+    free(coordinator_ctx->agents);
+    free(coordinator_ctx->pairs);
+    free(coordinator_ctx->pending);
+    free(coordinator_ctx->patterns);
+    coord_map_free(&coordinator_ctx->agent_map);
+    coord_map_free(&coordinator_ctx->pair_map);
+    coord_map_free(&coordinator_ctx->pattern_map);
+    coordinator_ctx->agents = NULL;
+    coordinator_ctx->pairs = NULL;
+    coordinator_ctx->pending = NULL;
+    coordinator_ctx->patterns = NULL;
+}
+
+// Индекс агента; новый агент заводится. -1 при нехватке памяти
+static long coord_agent(omega_agent_coordinator_ctx_t* coordinator_ctx, uint32_t agent_id) {
+    uint32_t found = coord_map_get(&coordinator_ctx->agent_map, agent_id);
+    if (found) {
+        return (long)found - 1;
+    }
+    size_t index = (size_t)coordinator_ctx->unique_agents;
+    if (coord_reserve((void**)&coordinator_ctx->agents, &coordinator_ctx->agent_capacity,
+                      index + 1, sizeof(coord_agent_t)) != 0 ||
+        coord_map_put(&coordinator_ctx->agent_map, agent_id, (uint32_t)index + 1) != 0) {
+        return -1;
+    }
+    memset(&coordinator_ctx->agents[index], 0, sizeof(coord_agent_t));
+    coordinator_ctx->agents[index].agent_id = agent_id;
+    coordinator_ctx->unique_agents++;
+    return (long)index;
+}
+
+static uint64_t coord_pair_key(uint32_t agent_a, uint32_t agent_b) {
+    return agent_a < agent_b ? ((uint64_t)agent_a << 32) | agent_b
+                             : ((uint64_t)agent_b << 32) | agent_a;
+}
+
+// Совпадение смен состояния: earlier пришло раньше later на delta мс
+static int coord_pair_update(omega_agent_coordinator_ctx_t* coordinator_ctx,
+                             const omega_agent_state_t* earlier, const omega_agent_state_t* later,
+                             int64_t delta) {
+    uint64_t key = coord_pair_key(earlier->agent_id, later->agent_id);
+    uint32_t found = coord_map_get(&coordinator_ctx->pair_map, key);
+    coord_pair_t* pair;
+    size_t index;
+    if (found) {
+        index = found - 1;
+        pair = &coordinator_ctx->pairs[index];
+    } else {
+        index = coordinator_ctx->pair_count;
+        if (coord_reserve((void**)&coordinator_ctx->pairs, &coordinator_ctx->pair_capacity,
+                          index + 1, sizeof(coord_pair_t)) != 0 ||
+            coord_reserve((void**)&coordinator_ctx->pending, &coordinator_ctx->pending_capacity,
+                          index + 1, sizeof(uint32_t)) != 0 ||
+            coord_map_put(&coordinator_ctx->pair_map, key, (uint32_t)index + 1) != 0) {
+            return -1;
+        }
+        coordinator_ctx->pair_count++;
+        pair = &coordinator_ctx->pairs[index];
+        memset(pair, 0, sizeof(*pair));
+        pair->stats.agent_a = (uint32_t)(key >> 32);
+        pair->stats.agent_b = (uint32_t)key;
+    }
+
+    double a = earlier->agent_id == pair->stats.agent_a ? earlier->confidence : later->confidence;
+    double b = earlier->agent_id == pair->stats.agent_a ? later->confidence : earlier->confidence;
+    double n = (double)++pair->stats.co_occurrences;
+    double delta_a = a - pair->mean_a;
+    double delta_b = b - pair->mean_b;
+    pair->mean_a += delta_a / n;
+    pair->mean_b += delta_b / n;
+    pair->m2_a += delta_a * (a - pair->mean_a);
+    pair->m2_b += delta_b * (b - pair->mean_b);
+    pair->co_moment += delta_a * (b - pair->mean_b);
+    pair->stats.mean_delta_ms += ((double)delta - pair->stats.mean_delta_ms) / n;
+    pair->stats.last_delta_ms = delta;
+
+    if (!pair->pending) {
+        pair->pending = 1;
+        coordinator_ctx->pending[coordinator_ctx->pending_count++] = (uint32_t)index;
+    }
+    return 0;
+}
+
+static void coord_pair_export(const coord_pair_t* pair, omega_agent_pair_stats_t* out) {
+    *out = pair->stats;
+    out->covariance = pair->stats.co_occurrences > 1
+                          ? pair->co_moment / (double)(pair->stats.co_occurrences - 1) : 0.0;
+    out->correlation = pair->m2_a > 0.0 && pair->m2_b > 0.0
+                           ? pair->co_moment / sqrt(pair->m2_a * pair->m2_b) : 0.0;
+}
 
 /**
  * omega_agent_coordinator_init - инициализация
  */
-int omega_agent_coordinator_init(void) {
-    memset(&coordinator_ctx, 0, sizeof(coordinator_ctx));
+int omega_agent_coordinator_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->coordinator && !(ctx->coordinator = calloc(1, sizeof(omega_agent_coordinator_ctx_t)))) {
+        return -1;
+    }
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx->coordinator;
+    coord_free(coordinator_ctx);
+    memset(coordinator_ctx, 0, sizeof(*coordinator_ctx));
+    coordinator_ctx->sync_window_ms = OMEGA_AGENT_SYNC_WINDOW_MS;
+    coordinator_ctx->pattern_capacity = OMEGA_MAX_AGENT_PATTERNS;
+    coordinator_ctx->patterns = malloc(OMEGA_MAX_AGENT_PATTERNS * sizeof(omega_agent_pattern_t));
+    if (!coordinator_ctx->patterns ||
+        coord_map_init(&coordinator_ctx->agent_map, 64) != 0 ||
+        coord_map_init(&coordinator_ctx->pair_map, 256) != 0 ||
+        coord_map_init(&coordinator_ctx->pattern_map, 128) != 0) {
+        coord_free(coordinator_ctx);
+        free(coordinator_ctx);
+        ctx->coordinator = NULL;
+        return -1;
+    }
     
-    printf("[AgentCoordinator] Initialized for tracking up to %d agents\n",
-           OMEGA_MAX_AGENTS);
+    KOLIBRI_LOG_INFO("AgentCoordinator", "Initialized (agent tables grow on demand, sync window %d ms)",
+           OMEGA_AGENT_SYNC_WINDOW_MS);
     
     return 0;
 }
@@ -33,35 +272,54 @@ int omega_agent_coordinator_init(void) {
 /**
  * omega_detect_agent_state_changes - обнаружение изменений
  */
-int omega_detect_agent_state_changes(uint32_t agent_id, uint64_t formula_id,
+int omega_detect_agent_state_changes(omega_context_t* ctx, uint32_t agent_id, uint64_t formula_id,
                                      int64_t timestamp, double confidence) {
-    if (coordinator_ctx.state_count >= OMEGA_MAX_AGENT_STATES) {
-        return 0;  // Переполнение
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return -1;
     }
-    
-    // Проверяем, есть ли уже состояния этого агента
-    int found_agent = 0;
-    for (int i = 0; i < coordinator_ctx.state_count; i++) {
-        if (coordinator_ctx.agent_states[i].agent_id == agent_id) {
-            found_agent = 1;
+    long agent = coord_agent(coordinator_ctx, agent_id);
+    if (agent < 0) {
+        return -1;
+    }
+    uint64_t seq = ++coordinator_ctx->state_seq;
+    coordinator_ctx->agents[agent].changes++;
+    coordinator_ctx->agents[agent].mark = seq;
+
+    omega_agent_state_t state = { agent_id, formula_id, timestamp, confidence };
+
+    // Кольцо идёт от новых к старым; при времени по неубыванию первое
+    // состояние старше окна заканчивает поиск. Каждый агент — одна пара,
+    // по его последней смене состояния
+    for (int i = 0; i < coordinator_ctx->recent_count; ++i) {
+        int slot = (coordinator_ctx->recent_head - 1 - i + OMEGA_MAX_COORDINATION_HISTORY) %
+                   OMEGA_MAX_COORDINATION_HISTORY;
+        const omega_agent_state_t* other = &coordinator_ctx->recent[slot];
+        int64_t delta = timestamp - other->timestamp;
+        if (delta > coordinator_ctx->sync_window_ms) {
             break;
         }
+        if (delta < 0) {
+            continue;
+        }
+        coord_agent_t* other_agent = &coordinator_ctx->agents[coord_map_get(&coordinator_ctx->agent_map, other->agent_id) - 1];
+        if (other_agent->mark == seq) {
+            continue;
+        }
+        other_agent->mark = seq;
+        if (coord_pair_update(coordinator_ctx, other, &state, delta) != 0) {
+            return -1;
+        }
     }
-    
-    // Сохраняем новое состояние
-    coordinator_ctx.agent_states[coordinator_ctx.state_count].agent_id = agent_id;
-    coordinator_ctx.agent_states[coordinator_ctx.state_count].formula_id = formula_id;
-    coordinator_ctx.agent_states[coordinator_ctx.state_count].timestamp = timestamp;
-    coordinator_ctx.agent_states[coordinator_ctx.state_count].confidence = confidence;
-    
-    coordinator_ctx.state_count++;
-    
-    if (!found_agent) {
-        coordinator_ctx.unique_agents++;
+
+    coordinator_ctx->recent[coordinator_ctx->recent_head] = state;
+    coordinator_ctx->recent_head = (coordinator_ctx->recent_head + 1) % OMEGA_MAX_COORDINATION_HISTORY;
+    if (coordinator_ctx->recent_count < OMEGA_MAX_COORDINATION_HISTORY) {
+        coordinator_ctx->recent_count++;
     }
     
-    printf("[AgentCoordinator] Agent %u changed state to formula %lu at time %ld "
-           "(confidence: %.2f)\n", agent_id, (unsigned long)formula_id, (long)timestamp, confidence);
+    KOLIBRI_LOG_INFO("AgentCoordinator", "Agent %u changed state to formula %lu at time %ld "
+           "(confidence: %.2f)", agent_id, (unsigned long)formula_id, (long)timestamp, confidence);
     
     return 1;  // Одно изменение обнаружено
 }
@@ -69,37 +327,52 @@ int omega_detect_agent_state_changes(uint32_t agent_id, uint64_t formula_id,
 /**
  * omega_find_synchronized_agents - поиск синхронизированных агентов
  */
-int omega_find_synchronized_agents(int64_t max_time_delta_ms) {
+int omega_find_synchronized_agents(omega_context_t* ctx, int64_t max_time_delta_ms) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return -1;
+    }
     int synchronized_pairs = 0;
     
-    // Проверяем все пары агентов
-    for (int i = 0; i < coordinator_ctx.state_count - 1; i++) {
-        for (int j = i + 1; j < coordinator_ctx.state_count; j++) {
-            omega_agent_state_t* state_i = &coordinator_ctx.agent_states[i];
-            omega_agent_state_t* state_j = &coordinator_ctx.agent_states[j];
-            
-            // Если агенты разные но действия произошли близко во времени
-            if (state_i->agent_id != state_j->agent_id) {
-                int64_t time_delta = state_j->timestamp - state_i->timestamp;
-                if (time_delta >= 0 && time_delta <= max_time_delta_ms) {
-                    printf("[AgentCoordinator] Synchronized pair: Agent %u ↔ Agent %u "
-                           "(time delta: %ld ms)\n",
-                           state_i->agent_id, state_j->agent_id, (long)time_delta);
-                    synchronized_pairs++;
-                    coordinator_ctx.stats.synchronization_pairs++;
-                }
-            }
+    // Только пары, совпавшие после прошлого вызова
+    for (size_t i = 0; i < coordinator_ctx->pending_count; i++) {
+        coord_pair_t* pair = &coordinator_ctx->pairs[coordinator_ctx->pending[i]];
+        pair->pending = 0;
+        if (pair->stats.last_delta_ms > max_time_delta_ms) {
+            continue;
         }
+        omega_agent_pair_stats_t pair_stats;
+        coord_pair_export(pair, &pair_stats);
+        KOLIBRI_LOG_INFO("AgentCoordinator", "Synchronized pair: Agent %u ↔ Agent %u "
+               "(time delta: %ld ms, %llu times, correlation %.2f)",
+               pair_stats.agent_a, pair_stats.agent_b, (long)pair_stats.last_delta_ms,
+               (unsigned long long)pair_stats.co_occurrences, pair_stats.correlation);
+        synchronized_pairs++;
     }
+    coordinator_ctx->pending_count = 0;
+    coordinator_ctx->sync_window_ms = max_time_delta_ms > 0 ? max_time_delta_ms : 0;
+    coordinator_ctx->stats.synchronization_pairs = (int)coordinator_ctx->pair_count;
     
     return synchronized_pairs;
 }
 
+static uint64_t coord_pattern_key(const uint32_t* agent_ids, int agent_count, int pattern_type) {
+    uint64_t key = coord_hash((uint64_t)pattern_type + 1);
+    for (int i = 0; i < agent_count; i++) {
+        key = coord_hash(key ^ agent_ids[i]);
+    }
+    return key;
+}
+
 /**
  * omega_detect_coordination_patterns - обнаружение паттернов
  */
-int omega_detect_coordination_patterns(const omega_coordination_event_t* coordination_events,
+int omega_detect_coordination_patterns(omega_context_t* ctx, const omega_coordination_event_t* coordination_events,
                                        int event_count) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return -1;
+    }
     if (!coordination_events || event_count == 0) {
         return 0;
     }
@@ -107,38 +380,84 @@ int omega_detect_coordination_patterns(const omega_coordination_event_t* coordin
     int new_patterns = 0;
     
     // Анализируем события координации
-    for (int i = 0; i < event_count && coordinator_ctx.pattern_count < OMEGA_MAX_AGENT_PATTERNS; i++) {
+    for (int i = 0; i < event_count; i++) {
         const omega_coordination_event_t* event = &coordination_events[i];
-        
-        // Создаем паттерн из события координации
-        omega_agent_pattern_t* pattern = &coordinator_ctx.patterns[coordinator_ctx.pattern_count];
-        
-        pattern->pattern_id = 3000 + coordinator_ctx.pattern_count;
-        pattern->agent_count = event->agent_count;
-        
-        for (int j = 0; j < event->agent_count; j++) {
-            pattern->agent_ids[j] = event->agent_ids[j];
+        if (event->agent_count <= 0 || event->agent_count > OMEGA_MAX_AGENTS) {
+            continue;
+        }
+
+        // Набор агентов без учёта порядка
+        uint32_t agent_ids[OMEGA_MAX_AGENTS];
+        int agent_count = event->agent_count;
+        for (int j = 0; j < agent_count; j++) {
+            uint32_t id = event->agent_ids[j];
+            int k = j;
+            while (k > 0 && agent_ids[k - 1] > id) {
+                agent_ids[k] = agent_ids[k - 1];
+                k--;
+            }
+            agent_ids[k] = id;
         }
-        
-        pattern->average_confidence = event->pattern_confidence;
-        pattern->occurrences = 1;
         
         // Определяем тип паттерна по coordination_strength
+        int pattern_type;
         if (event->coordination_strength > 0.8) {
-            pattern->pattern_type = 0;  // Флокинг (высокая синхронность)
+            pattern_type = 0;  // Флокинг (высокая синхронность)
         } else if (event->coordination_strength > 0.5) {
-            pattern->pattern_type = 1;  // Избегание (средняя синхронность)
+            pattern_type = 1;  // Избегание (средняя синхронность)
         } else {
-            pattern->pattern_type = 3;  // Другое
+            pattern_type = 3;  // Другое
+        }
+
+        uint64_t key = coord_pattern_key(agent_ids, agent_count, pattern_type);
+        uint32_t found = coord_map_get(&coordinator_ctx->pattern_map, key);
+        if (found) {
+            omega_agent_pattern_t* known = &coordinator_ctx->patterns[found - 1];
+            if (known->agent_count == agent_count &&
+                memcmp(known->agent_ids, agent_ids, (size_t)agent_count * sizeof(uint32_t)) == 0) {
+                known->occurrences++;
+                known->average_confidence += ((double)event->pattern_confidence - known->average_confidence) /
+                                             known->occurrences;
+                continue;
+            }
+        }
+
+        if (coordinator_ctx->pattern_count == coordinator_ctx->pattern_capacity) {
+            int capacity = coordinator_ctx->pattern_capacity * 2;
+            omega_agent_pattern_t* patterns = realloc(coordinator_ctx->patterns,
+                                                      (size_t)capacity * sizeof(omega_agent_pattern_t));
+            if (!patterns) {
+                break;
+            }
+            coordinator_ctx->patterns = patterns;
+            coordinator_ctx->pattern_capacity = capacity;
+        }
+        
+        // Создаем паттерн из события координации
+        omega_agent_pattern_t* pattern = &coordinator_ctx->patterns[coordinator_ctx->pattern_count];
+        memset(pattern, 0, sizeof(*pattern));
+        
+        pattern->pattern_id = 3000 + coordinator_ctx->pattern_count;
+        pattern->agent_count = agent_count;
+        memcpy(pattern->agent_ids, agent_ids, (size_t)agent_count * sizeof(uint32_t));
+        
+        pattern->average_confidence = event->pattern_confidence;
+        pattern->occurrences = 1;
+        pattern->pattern_type = pattern_type;
+
+        // Коллизия ключа оставляет паттерн без индекса: повторы станут новыми паттернами
+        if (!found && coord_map_put(&coordinator_ctx->pattern_map, key,
+                                    (uint32_t)coordinator_ctx->pattern_count + 1) != 0) {
+            break;
         }
         
-        printf("[AgentCoordinator] Detected coordination pattern %lu: %d agents "
-               "(type: %d, strength: %.2f)\n",
+        KOLIBRI_LOG_INFO("AgentCoordinator", "Detected coordination pattern %lu: %d agents "
+               "(type: %d, strength: %.2f)",
                (unsigned long)pattern->pattern_id, pattern->agent_count, pattern->pattern_type,
                event->coordination_strength);
         
-        coordinator_ctx.pattern_count++;
-        coordinator_ctx.stats.total_patterns++;
+        coordinator_ctx->pattern_count++;
+        coordinator_ctx->stats.total_patterns++;
         new_patterns++;
     }
     
@@ -170,8 +489,8 @@ double omega_analyze_emergent_behavior(const omega_agent_pattern_t* agent_patter
     
     if (multi_agent_patterns > 0) {
         emergent_score = (double)multi_agent_patterns / pattern_count;
-        printf("[AgentCoordinator] Emergent behavior detected: score %.3f "
-               "(%d multi-agent patterns)\n", emergent_score, multi_agent_patterns);
+        KOLIBRI_LOG_INFO("AgentCoordinator", "Emergent behavior detected: score %.3f "
+               "(%d multi-agent patterns)", emergent_score, multi_agent_patterns);
     }
     
     return emergent_score;
@@ -180,14 +499,18 @@ double omega_analyze_emergent_behavior(const omega_agent_pattern_t* agent_patter
 /**
  * omega_create_coordination_event - создание события
  */
-int omega_create_coordination_event(const uint32_t* agent_ids, int agent_count,
+int omega_create_coordination_event(omega_context_t* ctx, const uint32_t* agent_ids, int agent_count,
                                     int64_t start_time, double coordination_strength,
                                     omega_coordination_event_t* coordination_event_out) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return -1;
+    }
     if (!agent_ids || !coordination_event_out || agent_count == 0 || agent_count > OMEGA_MAX_AGENTS) {
         return -1;
     }
     
-    coordination_event_out->coordination_id = 4000 + coordinator_ctx.stats.total_coordination_events;
+    coordination_event_out->coordination_id = 4000 + coordinator_ctx->stats.total_coordination_events;
     coordination_event_out->agent_count = agent_count;
     
     for (int i = 0; i < agent_count; i++) {
@@ -201,11 +524,11 @@ int omega_create_coordination_event(const uint32_t* agent_ids, int agent_count,
     coordination_event_out->coordination_type = (coordination_strength > 0.7) ? 0 : 1;
     coordination_event_out->pattern_confidence = 0.8 * 1.0;  // Базовая уверенность
     
-    coordinator_ctx.stats.total_coordination_events++;
-    coordinator_ctx.stats.average_coordination_strength += coordination_strength;
+    coordinator_ctx->stats.total_coordination_events++;
+    coordinator_ctx->stats.average_coordination_strength += coordination_strength;
     
-    printf("[AgentCoordinator] Created coordination event %lu: %d agents, "
-           "strength %.2f\n",
+    KOLIBRI_LOG_INFO("AgentCoordinator", "Created coordination event %lu: %d agents, "
+           "strength %.2f",
            (unsigned long)coordination_event_out->coordination_id, agent_count, coordination_strength);
     
     return 0;
@@ -214,31 +537,58 @@ int omega_create_coordination_event(const uint32_t* agent_ids, int agent_count,
 /**
  * omega_get_multi_agent_statistics - получить статистику
  */
-const omega_multi_agent_stats_t* omega_get_multi_agent_statistics(void) {
-    coordinator_ctx.stats.total_agents = coordinator_ctx.unique_agents;
-    coordinator_ctx.stats.total_coordination_events = 0;  // Count events properly
-    coordinator_ctx.stats.total_patterns = coordinator_ctx.pattern_count;
+const omega_multi_agent_stats_t* omega_get_multi_agent_statistics(omega_context_t* ctx) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return NULL;
+    }
+    coordinator_ctx->stats.total_agents = coordinator_ctx->unique_agents;
+    coordinator_ctx->stats.total_coordination_events = 0;  // Count events properly
+    coordinator_ctx->stats.total_patterns = coordinator_ctx->pattern_count;
     
-    if (coordinator_ctx.pattern_count > 0) {
+    if (coordinator_ctx->pattern_count > 0) {
         int flocking_count = 0;
-        for (int i = 0; i < coordinator_ctx.pattern_count; i++) {
-            if (coordinator_ctx.patterns[i].pattern_type == 0) {
+        for (int i = 0; i < coordinator_ctx->pattern_count; i++) {
+            if (coordinator_ctx->patterns[i].pattern_type == 0) {
                 flocking_count++;
             }
         }
-        coordinator_ctx.stats.most_common_pattern_type = (flocking_count > 0) ? 0 : 3;
+        coordinator_ctx->stats.most_common_pattern_type = (flocking_count > 0) ? 0 : 3;
     }
     
-    return &coordinator_ctx.stats;
+    return &coordinator_ctx->stats;
+}
+
+/**
+ * omega_get_agent_pair_stats - статистика пары
+ */
+int omega_get_agent_pair_stats(omega_context_t* ctx, uint32_t agent_a, uint32_t agent_b,
+                               omega_agent_pair_stats_t* stats_out) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx || !stats_out || agent_a == agent_b) {
+        return -1;
+    }
+    uint32_t found = coord_map_get(&coordinator_ctx->pair_map, coord_pair_key(agent_a, agent_b));
+    if (!found) {
+        return -1;
+    }
+    coord_pair_export(&coordinator_ctx->pairs[found - 1], stats_out);
+    return 0;
 }
 
 /**
  * omega_agent_coordinator_shutdown - остановка
  */
-void omega_agent_coordinator_shutdown(void) {
-    printf("[AgentCoordinator] Shutdown: tracked %d agents, detected %d patterns, "
-           "%d coordination events\n",
-           coordinator_ctx.unique_agents, coordinator_ctx.pattern_count,
-           coordinator_ctx.stats.total_coordination_events);
-    memset(&coordinator_ctx, 0, sizeof(coordinator_ctx));
+void omega_agent_coordinator_shutdown(omega_context_t* ctx) {
+    omega_agent_coordinator_ctx_t* coordinator_ctx = ctx ? ctx->coordinator : NULL;
+    if (!coordinator_ctx) {
+        return;
+    }
+    KOLIBRI_LOG_INFO("AgentCoordinator", "Shutdown: tracked %d agents, detected %d patterns, "
+           "%d coordination events",
+           coordinator_ctx->unique_agents, coordinator_ctx->pattern_count,
+           coordinator_ctx->stats.total_coordination_events);
+    coord_free(coordinator_ctx);
+    free(coordinator_ctx);
+    ctx->coordinator = NULL;
 }
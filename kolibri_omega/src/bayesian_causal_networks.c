@@ -1,33 +1,50 @@
 #include "kolibri_omega/include/bayesian_causal_networks.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
 
-typedef struct {
+struct omega_bayesian_ctx_s {
     omega_causal_node_t nodes[OMEGA_MAX_CAUSAL_NODES];
     int node_count;
     
     omega_causal_edge_t edges[OMEGA_MAX_CAUSAL_EDGES];
     int edge_count;
     
-    omega_causal_episode_t episodes[OMEGA_MAX_CAUSAL_EPISODES];
-    int episode_count;
+    // Затухающие счётчики рёбер, хранятся умноженными на count_weight:
+    // вес нового наблюдения растёт вместо затухания всех старых
+    double edge_counts[OMEGA_MAX_CAUSAL_EDGES][OMEGA_MAX_CPD_STATES][OMEGA_MAX_CPD_STATES];
+    double count_weight;
     
     omega_bayesian_network_stats_t stats;
-} omega_bayesian_ctx_t;
 
-static omega_bayesian_ctx_t bayesian_ctx = {0};
+    // Скомпилированная форма; пересобирается после изменения сети
+    omega_compiled_network_t compiled;
+    int compiled_fresh;
+};
+
+typedef struct omega_bayesian_ctx_s omega_bayesian_ctx_t;
 
 /**
  * omega_bayesian_network_init - инициализация
  */
-int omega_bayesian_network_init(void) {
-    memset(&bayesian_ctx, 0, sizeof(bayesian_ctx));
+int omega_bayesian_network_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->bayesian && !(ctx->bayesian = calloc(1, sizeof(omega_bayesian_ctx_t)))) {
+        return -1;
+    }
+    omega_bayesian_ctx_t* bayesian_ctx = ctx->bayesian;
+    omega_compiled_network_free(&bayesian_ctx->compiled);
+    memset(bayesian_ctx, 0, sizeof(*bayesian_ctx));
+    bayesian_ctx->count_weight = 1.0;
     
-    printf("[BayesianCausal] Initialized with max %d nodes, %d edges\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Initialized with max %d nodes, %d edges",
            OMEGA_MAX_CAUSAL_NODES, OMEGA_MAX_CAUSAL_EDGES);
-    printf("[BayesianCausal] Probabilistic causality inference enabled\n");
+    KOLIBRI_LOG_INFO("BayesianCausal", "Probabilistic causality inference enabled");
     
     return 0;
 }
@@ -35,17 +52,18 @@ int omega_bayesian_network_init(void) {
 /**
  * omega_add_causal_node - добавить узел
  */
-uint32_t omega_add_causal_node(const char* node_name,
+uint32_t omega_add_causal_node(omega_context_t* ctx, const char* node_name,
                               int num_states,
                               const char** state_names,
                               double prior_probability) {
-    if (bayesian_ctx.node_count >= OMEGA_MAX_CAUSAL_NODES) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx || bayesian_ctx->node_count >= OMEGA_MAX_CAUSAL_NODES) {
         return 0;
     }
     
-    omega_causal_node_t* node = &bayesian_ctx.nodes[bayesian_ctx.node_count];
+    omega_causal_node_t* node = &bayesian_ctx->nodes[bayesian_ctx->node_count];
     
-    node->node_id = 5000 + bayesian_ctx.node_count;
+    node->node_id = 5000 + bayesian_ctx->node_count;
     strncpy(node->node_name, node_name, sizeof(node->node_name) - 1);
     node->num_states = num_states;
     
@@ -59,10 +77,11 @@ uint32_t omega_add_causal_node(const char* node_name,
     node->observed_state = -1;  // Not observed
     node->is_observed = 0;
     
-    bayesian_ctx.node_count++;
-    bayesian_ctx.stats.total_nodes++;
+    bayesian_ctx->node_count++;
+    bayesian_ctx->stats.total_nodes++;
+    bayesian_ctx->compiled_fresh = 0;
     
-    printf("[BayesianCausal] Added node %u: \"%s\" with %d states, prior=%.2f\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Added node %u: \"%s\" with %d states, prior=%.2f",
            node->node_id, node_name, num_states, prior_probability);
     
     return node->node_id;
@@ -71,17 +90,18 @@ uint32_t omega_add_causal_node(const char* node_name,
 /**
  * omega_add_causal_edge - добавить причинное ребро
  */
-uint32_t omega_add_causal_edge(uint32_t parent_node_id,
+uint32_t omega_add_causal_edge(omega_context_t* ctx, uint32_t parent_node_id,
                               uint32_t child_node_id,
                               double** cpd_table,
                               double causal_strength) {
-    if (bayesian_ctx.edge_count >= OMEGA_MAX_CAUSAL_EDGES) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx || bayesian_ctx->edge_count >= OMEGA_MAX_CAUSAL_EDGES) {
         return 0;
     }
     
-    omega_causal_edge_t* edge = &bayesian_ctx.edges[bayesian_ctx.edge_count];
+    omega_causal_edge_t* edge = &bayesian_ctx->edges[bayesian_ctx->edge_count];
     
-    edge->edge_id = 6000 + bayesian_ctx.edge_count;
+    edge->edge_id = 6000 + bayesian_ctx->edge_count;
     edge->parent_node_id = parent_node_id;
     edge->child_node_id = child_node_id;
     edge->causal_strength = causal_strength;
@@ -104,11 +124,12 @@ uint32_t omega_add_causal_edge(uint32_t parent_node_id,
         }
     }
     
-    bayesian_ctx.edge_count++;
-    bayesian_ctx.stats.total_edges++;
-    bayesian_ctx.stats.average_causal_strength += causal_strength;
+    bayesian_ctx->edge_count++;
+    bayesian_ctx->stats.total_edges++;
+    bayesian_ctx->compiled_fresh = 0;
+    bayesian_ctx->stats.average_causal_strength += causal_strength;
     
-    printf("[BayesianCausal] Added edge %u: %u -> %u (strength=%.2f)\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Added edge %u: %u -> %u (strength=%.2f)",
            edge->edge_id, parent_node_id, child_node_id, causal_strength);
     
     return edge->edge_id;
@@ -117,13 +138,17 @@ uint32_t omega_add_causal_edge(uint32_t parent_node_id,
 /**
  * omega_set_evidence - установить свидетельство
  */
-int omega_set_evidence(uint32_t node_id, int observed_state) {
-    for (int i = 0; i < bayesian_ctx.node_count; i++) {
-        if (bayesian_ctx.nodes[i].node_id == node_id) {
-            bayesian_ctx.nodes[i].is_observed = 1;
-            bayesian_ctx.nodes[i].observed_state = observed_state;
+int omega_set_evidence(omega_context_t* ctx, uint32_t node_id, int observed_state) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
+        return -1;
+    }
+    for (int i = 0; i < bayesian_ctx->node_count; i++) {
+        if (bayesian_ctx->nodes[i].node_id == node_id) {
+            bayesian_ctx->nodes[i].is_observed = 1;
+            bayesian_ctx->nodes[i].observed_state = observed_state;
             
-            printf("[BayesianCausal] Set evidence: Node %u = state %d\n",
+            KOLIBRI_LOG_INFO("BayesianCausal", "Set evidence: Node %u = state %d",
                    node_id, observed_state);
             
             return 0;
@@ -132,206 +157,1071 @@ int omega_set_evidence(uint32_t node_id, int observed_state) {
     return -1;
 }
 
+/* ========== Скомпилированная сеть ========== */
+
+// Предел числа переменных и записей одного фактора
+#define OMEGA_BN_MAX_SCOPE 16
+#define OMEGA_BN_MAX_FACTOR_SIZE ((size_t)1 << 16)
+
+typedef struct {
+    uint32_t id;
+    int index;
+} bn_id_entry_t;
+
+static int bn_compare_ids(const void* a, const void* b) {
+    const bn_id_entry_t* x = a;
+    const bn_id_entry_t* y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int bn_compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int bn_find_id(const bn_id_entry_t* ids, int count, uint32_t id) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ids[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < count && ids[lo].id == id) ? ids[lo].index : -1;
+}
+
+void omega_compiled_network_free(omega_compiled_network_t* net) {
+    if (!net) {
+        return;
+    }
+    free(net->node_ids);
+    free(net->num_states);
+    free(net->parent_offsets);
+    free(net->parents);
+    free(net->cpd_offsets);
+    free(net->cpd);
+    free(net->source_index);
+    free(net->position);
+    free(net->sorted_ids);
+    free(net->sorted_index);
+    memset(net, 0, sizeof(*net));
+}
+
 /**
- * omega_bayesian_inference - вероятностный вывод
- * 
- * Использует простой Байесовский вывод:
- * P(X | E) ∝ P(E | X) * P(X)
+ * omega_compile_causal_network - компиляция сети
+ *
+ * Рёбра группируются по ребёнку, родители ребёнка сливаются в множество,
+ * затем алгоритм Кана даёт топологический порядок, в котором строятся
+ * CSR родителей и CPD узлов.
  */
-int omega_bayesian_inference(uint32_t target_node_id,
-                            omega_inference_result_t* result_out) {
-    if (!result_out) {
+int omega_compile_causal_network(const omega_causal_node_t* nodes,
+                                int node_count,
+                                const omega_causal_edge_t* edges,
+                                int edge_count,
+                                omega_compiled_network_t* net_out) {
+    if (!net_out || node_count < 0 || edge_count < 0 ||
+        (node_count > 0 && !nodes) || (edge_count > 0 && !edges)) {
         return -1;
     }
-    
-    // Найти целевой узел
-    omega_causal_node_t* target = NULL;
-    for (int i = 0; i < bayesian_ctx.node_count; i++) {
-        if (bayesian_ctx.nodes[i].node_id == target_node_id) {
-            target = &bayesian_ctx.nodes[i];
-            break;
+    memset(net_out, 0, sizeof(*net_out));
+
+    int n = node_count;
+    size_t node_slots = n > 0 ? (size_t)n : 1;
+    size_t edge_slots = edge_count > 0 ? (size_t)edge_count : 1;
+    int rc = -1;
+
+    bn_id_entry_t* ids = malloc(node_slots * sizeof(*ids));
+    int* edge_parent = malloc(edge_slots * sizeof(int));
+    int* edge_child = malloc(edge_slots * sizeof(int));
+    int* edge_slot = malloc(edge_slots * sizeof(int));
+    int* in_offsets = calloc(node_slots + 1, sizeof(int));
+    int* in_edges = malloc(edge_slots * sizeof(int));
+    int* in_parents = malloc(edge_slots * sizeof(int));
+    int* parent_count = calloc(node_slots, sizeof(int));
+    int* out_offsets = calloc(node_slots + 1, sizeof(int));
+    int* out_children = malloc(edge_slots * sizeof(int));
+    int* fill = calloc(node_slots, sizeof(int));
+    int* queue = malloc(node_slots * sizeof(int));
+    omega_compiled_network_t* net = net_out;
+
+    if (!ids || !edge_parent || !edge_child || !edge_slot || !in_offsets || !in_edges ||
+        !in_parents || !parent_count || !out_offsets || !out_children || !fill || !queue) {
+        goto done;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (nodes[i].num_states < 1 || nodes[i].num_states > OMEGA_MAX_CPD_STATES) {
+            goto done;
         }
+        ids[i].id = nodes[i].node_id;
+        ids[i].index = i;
     }
-    
-    if (!target) {
+    qsort(ids, (size_t)n, sizeof(*ids), bn_compare_ids);
+    for (int i = 1; i < n; i++) {
+        if (ids[i].id == ids[i - 1].id) {
+            goto done;
+        }
+    }
+
+    // Рёбра по детям, в порядке добавления
+    for (int e = 0; e < edge_count; e++) {
+        edge_parent[e] = bn_find_id(ids, n, edges[e].parent_node_id);
+        edge_child[e] = bn_find_id(ids, n, edges[e].child_node_id);
+        if (edge_parent[e] < 0 || edge_child[e] < 0 || edge_parent[e] == edge_child[e]) {
+            edge_child[e] = -1;
+            continue;
+        }
+        in_offsets[edge_child[e] + 1]++;
+    }
+    for (int i = 0; i < n; i++) {
+        in_offsets[i + 1] += in_offsets[i];
+    }
+    for (int e = 0; e < edge_count; e++) {
+        int c = edge_child[e];
+        if (c >= 0) {
+            in_edges[in_offsets[c] + fill[c]++] = e;
+        }
+    }
+
+    // Множество родителей каждого узла: начало его отрезка in_parents
+    for (int c = 0; c < n; c++) {
+        int begin = in_offsets[c];
+        int count = in_offsets[c + 1] - begin;
+        for (int k = 0; k < count; k++) {
+            in_parents[begin + k] = edge_parent[in_edges[begin + k]];
+        }
+        qsort(in_parents + begin, (size_t)count, sizeof(int), bn_compare_ints);
+        int unique = 0;
+        for (int k = 0; k < count; k++) {
+            if (unique == 0 || in_parents[begin + k] != in_parents[begin + unique - 1]) {
+                in_parents[begin + unique++] = in_parents[begin + k];
+            }
+        }
+        if (unique + 1 > OMEGA_BN_MAX_SCOPE) {
+            goto done;
+        }
+        parent_count[c] = unique;
+        for (int k = 0; k < unique; k++) {
+            out_offsets[in_parents[begin + k] + 1]++;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        out_offsets[i + 1] += out_offsets[i];
+        fill[i] = 0;
+    }
+    for (int c = 0; c < n; c++) {
+        for (int k = 0; k < parent_count[c]; k++) {
+            int p = in_parents[in_offsets[c] + k];
+            out_children[out_offsets[p] + fill[p]++] = c;
+        }
+    }
+
+    net->node_count = n;
+    net->node_ids = malloc(node_slots * sizeof(uint32_t));
+    net->num_states = malloc(node_slots * sizeof(int));
+    net->parent_offsets = calloc(node_slots + 1, sizeof(int));
+    net->parents = malloc(edge_slots * sizeof(int));
+    net->cpd_offsets = calloc(node_slots + 1, sizeof(size_t));
+    net->source_index = malloc(node_slots * sizeof(int));
+    net->position = malloc(node_slots * sizeof(int));
+    net->sorted_ids = malloc(node_slots * sizeof(uint32_t));
+    net->sorted_index = malloc(node_slots * sizeof(int));
+    if (!net->node_ids || !net->num_states || !net->parent_offsets || !net->parents ||
+        !net->cpd_offsets || !net->source_index || !net->position ||
+        !net->sorted_ids || !net->sorted_index) {
+        goto done;
+    }
+
+    // Алгоритм Кана; fill — число ещё не размещённых родителей
+    int head = 0, tail = 0;
+    for (int i = 0; i < n; i++) {
+        fill[i] = parent_count[i];
+        if (fill[i] == 0) {
+            queue[tail++] = i;
+        }
+    }
+    while (head < tail) {
+        int v = queue[head];
+        net->source_index[head] = v;
+        net->position[v] = head;
+        head++;
+        for (int k = out_offsets[v]; k < out_offsets[v + 1]; k++) {
+            if (--fill[out_children[k]] == 0) {
+                queue[tail++] = out_children[k];
+            }
+        }
+    }
+    if (head < n) {
+        goto done;  // цикл
+    }
+
+    for (int t = 0; t < n; t++) {
+        int src = net->source_index[t];
+        int begin = net->parent_offsets[t];
+        net->node_ids[t] = nodes[src].node_id;
+        net->num_states[t] = nodes[src].num_states;
+        for (int k = 0; k < parent_count[src]; k++) {
+            net->parents[begin + k] = net->position[in_parents[in_offsets[src] + k]];
+        }
+        qsort(net->parents + begin, (size_t)parent_count[src], sizeof(int), bn_compare_ints);
+        net->parent_offsets[t + 1] = begin + parent_count[src];
+
+        size_t size = (size_t)net->num_states[t];
+        for (int k = begin; k < net->parent_offsets[t + 1]; k++) {
+            size *= (size_t)net->num_states[net->parents[k]];
+            if (size > OMEGA_BN_MAX_FACTOR_SIZE) {
+                goto done;
+            }
+        }
+        net->cpd_offsets[t + 1] = net->cpd_offsets[t] + size;
+    }
+    for (int i = 0; i < n; i++) {
+        net->sorted_ids[i] = ids[i].id;
+        net->sorted_index[i] = net->position[ids[i].index];
+    }
+
+    net->cpd = malloc((net->cpd_offsets[n] > 0 ? net->cpd_offsets[n] : 1) * sizeof(double));
+    if (!net->cpd) {
+        goto done;
+    }
+
+    // CPD: P(X | родители) ∝ P(X) · Π CPD рёбер, по строке на комбинацию
+    for (int t = 0; t < n; t++) {
+        int src = net->source_index[t];
+        const int* parents = net->parents + net->parent_offsets[t];
+        int k = net->parent_offsets[t + 1] - net->parent_offsets[t];
+        int states = net->num_states[t];
+        double* row = net->cpd + net->cpd_offsets[t];
+        double* end = net->cpd + net->cpd_offsets[t + 1];
+        int assignment[OMEGA_BN_MAX_SCOPE] = {0};
+
+        for (int j = in_offsets[src]; j < in_offsets[src + 1]; j++) {
+            int e = in_edges[j];
+            int parent = net->position[edge_parent[e]];
+            edge_slot[e] = 0;
+            while (parents[edge_slot[e]] != parent) {
+                edge_slot[e]++;
+            }
+        }
+
+        for (; row < end; row += states) {
+            double total = 0.0;
+            for (int c = 0; c < states; c++) {
+                row[c] = nodes[src].state_probabilities[c];
+            }
+            for (int j = in_offsets[src]; j < in_offsets[src + 1]; j++) {
+                const omega_causal_edge_t* edge = &edges[in_edges[j]];
+                int parent_state = assignment[edge_slot[in_edges[j]]];
+                for (int c = 0; c < states; c++) {
+                    row[c] *= edge->cpd[parent_state][c];
+                }
+            }
+            for (int c = 0; c < states; c++) {
+                total += row[c];
+            }
+            for (int c = 0; c < states; c++) {
+                row[c] = total > 0.0 ? row[c] / total : 1.0 / states;
+            }
+
+            for (int d = k - 1; d >= 0; d--) {
+                if (++assignment[d] < net->num_states[parents[d]]) {
+                    break;
+                }
+                assignment[d] = 0;
+            }
+        }
+    }
+    rc = 0;
+
+done:
+    if (rc != 0) {
+        omega_compiled_network_free(net);
+    }
+    free(ids);
+    free(edge_parent);
+    free(edge_child);
+    free(edge_slot);
+    free(in_offsets);
+    free(in_edges);
+    free(in_parents);
+    free(parent_count);
+    free(out_offsets);
+    free(out_children);
+    free(fill);
+    free(queue);
+    return rc;
+}
+
+int omega_bayesian_network_compile(omega_context_t* ctx, omega_compiled_network_t* net_out) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
         return -1;
     }
-    
-    result_out->node_id = target_node_id;
-    
-    // Вычисляем posterior для каждого состояния целевого узла
-    double likelihood[OMEGA_MAX_CPD_STATES];
-    memset(likelihood, 0, sizeof(likelihood));
-    
-    // P(Evidence | State) оценивается из родительских узлов
-    for (int state = 0; state < target->num_states; state++) {
-        likelihood[state] = target->state_probabilities[state];
-        
-        // Применяем свидетельство: если узел наблюдается, вероятность = 1 для этого состояния
-        if (target->is_observed) {
-            if (target->observed_state == state) {
-                likelihood[state] = 1.0;
-            } else {
-                likelihood[state] = 0.0;
+    return omega_compile_causal_network(bayesian_ctx->nodes, bayesian_ctx->node_count,
+                                        bayesian_ctx->edges, bayesian_ctx->edge_count,
+                                        net_out);
+}
+
+int omega_compiled_network_index(const omega_compiled_network_t* net, uint32_t node_id) {
+    if (!net) {
+        return -1;
+    }
+    int lo = 0, hi = net->node_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (net->sorted_ids[mid] < node_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < net->node_count && net->sorted_ids[lo] == node_id) ? net->sorted_index[lo] : -1;
+}
+
+/* ========== Исключение переменных ========== */
+
+// Фактор над vars (по возрастанию индексов), последняя переменная младшая.
+// Значения лежат в арене по смещению, чтобы пережить её рост.
+typedef struct {
+    int vars[OMEGA_BN_MAX_SCOPE];
+    int var_count;
+    size_t size;
+    size_t offset;
+    int alive;
+} bn_factor_t;
+
+// Буферы вывода и план: порядок исключения для набора наблюдаемых узлов
+typedef struct {
+    const omega_compiled_network_t* net;
+    bn_factor_t* factors;
+    int factor_count;
+    int factor_capacity;
+    double* arena;
+    size_t arena_used;
+    size_t arena_capacity;
+    unsigned char* relevant;
+    unsigned char* observed;
+    unsigned char* eliminated;
+    int* order;
+    int order_count;
+    int plan_target;  // -1 — плана нет
+} bn_workspace_t;
+
+static int bn_workspace_init(bn_workspace_t* ws, const omega_compiled_network_t* net) {
+    size_t slots = net->node_count > 0 ? (size_t)net->node_count : 1;
+    memset(ws, 0, sizeof(*ws));
+    ws->net = net;
+    ws->plan_target = -1;
+    ws->relevant = calloc(slots, 1);
+    ws->observed = calloc(slots, 1);
+    ws->eliminated = calloc(slots, 1);
+    ws->order = malloc(slots * sizeof(int));
+    if (!ws->relevant || !ws->observed || !ws->eliminated || !ws->order) {
+        free(ws->relevant);
+        free(ws->observed);
+        free(ws->eliminated);
+        free(ws->order);
+        return -1;
+    }
+    return 0;
+}
+
+static void bn_workspace_free(bn_workspace_t* ws) {
+    free(ws->factors);
+    free(ws->arena);
+    free(ws->relevant);
+    free(ws->observed);
+    free(ws->eliminated);
+    free(ws->order);
+}
+
+// Новый фактор; без values место под значения не выделяется (для плана)
+static int bn_new_factor(bn_workspace_t* ws, const int* vars, int var_count, int values) {
+    size_t size = 1;
+    for (int k = 0; k < var_count; k++) {
+        size *= (size_t)ws->net->num_states[vars[k]];
+        if (size > OMEGA_BN_MAX_FACTOR_SIZE) {
+            return -1;
+        }
+    }
+    if (ws->factor_count == ws->factor_capacity) {
+        int capacity = ws->factor_capacity ? ws->factor_capacity * 2 : 64;
+        bn_factor_t* grown = realloc(ws->factors, (size_t)capacity * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        ws->factors = grown;
+        ws->factor_capacity = capacity;
+    }
+    bn_factor_t* f = &ws->factors[ws->factor_count];
+    memcpy(f->vars, vars, (size_t)var_count * sizeof(int));
+    f->var_count = var_count;
+    f->size = size;
+    f->offset = 0;
+    f->alive = 1;
+    if (values) {
+        if (ws->arena_used + size > ws->arena_capacity) {
+            size_t capacity = ws->arena_capacity ? ws->arena_capacity * 2 : 1024;
+            while (capacity < ws->arena_used + size) {
+                capacity *= 2;
+            }
+            double* grown = realloc(ws->arena, capacity * sizeof(double));
+            if (!grown) {
+                return -1;
             }
+            ws->arena = grown;
+            ws->arena_capacity = capacity;
+        }
+        f->offset = ws->arena_used;
+        ws->arena_used += size;
+    }
+    return ws->factor_count++;
+}
+
+static int bn_contains(const bn_factor_t* f, int var) {
+    for (int k = 0; k < f->var_count; k++) {
+        if (f->vars[k] == var) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Слияние упорядоченных множеств переменных; -1 если больше предела
+static int bn_union(const int* a, int a_count, const int* b, int b_count, int* out) {
+    int i = 0, j = 0, n = 0;
+    while (i < a_count || j < b_count) {
+        int v;
+        if (j == b_count || (i < a_count && a[i] < b[j])) {
+            v = a[i++];
+        } else if (i == a_count || b[j] < a[i]) {
+            v = b[j++];
         } else {
-            // Иначе: пропагируем вероятность через родительские узлы
-            // (упрощенный вывод)
-            for (int e = 0; e < bayesian_ctx.edge_count; e++) {
-                if (bayesian_ctx.edges[e].child_node_id == target_node_id) {
-                    // Есть ребро от parent к нам
-                    omega_causal_edge_t* edge = &bayesian_ctx.edges[e];
-                    
-                    // Найти родителя
-                    for (int p = 0; p < bayesian_ctx.node_count; p++) {
-                        if (bayesian_ctx.nodes[p].node_id == edge->parent_node_id) {
-                            omega_causal_node_t* parent = &bayesian_ctx.nodes[p];
-                            
-                            // P(target=state | parent_state) из CPD
-                            if (parent->is_observed) {
-                                double conditional = edge->cpd[parent->observed_state][state];
-                                likelihood[state] *= conditional;
-                            }
-                            break;
-                        }
-                    }
-                }
+            v = a[i++];
+            j++;
+        }
+        if (n == OMEGA_BN_MAX_SCOPE) {
+            return -1;
+        }
+        out[n++] = v;
+    }
+    return n;
+}
+
+// Шаги переменных vars внутри f, 0 для отсутствующих
+static void bn_strides_in(const bn_workspace_t* ws, const bn_factor_t* f,
+                          const int* vars, int var_count, size_t* strides) {
+    size_t own[OMEGA_BN_MAX_SCOPE];
+    size_t stride = 1;
+    for (int k = f->var_count - 1; k >= 0; k--) {
+        own[k] = stride;
+        stride *= (size_t)ws->net->num_states[f->vars[k]];
+    }
+    for (int k = 0, j = 0; k < var_count; k++) {
+        while (j < f->var_count && f->vars[j] < vars[k]) {
+            j++;
+        }
+        strides[k] = (j < f->var_count && f->vars[j] == vars[k]) ? own[j] : 0;
+    }
+}
+
+// Строка произведения; шаг младшей переменной в сомножителе 0 или 1,
+// так что каждая ветка — простой векторизуемый цикл
+static void bn_multiply_row(double* restrict out, const double* restrict a, size_t a_step,
+                            const double* restrict b, size_t b_step, size_t len) {
+    if (a_step == 1 && b_step == 1) {
+        for (size_t i = 0; i < len; i++) {
+            out[i] = a[i] * b[i];
+        }
+    } else if (a_step == 1) {
+        double scale = b[0];
+        for (size_t i = 0; i < len; i++) {
+            out[i] = a[i] * scale;
+        }
+    } else {
+        double scale = a[0];
+        for (size_t i = 0; i < len; i++) {
+            out[i] = scale * b[i];
+        }
+    }
+}
+
+static int bn_product(bn_workspace_t* ws, int a, int b, int values) {
+    int vars[OMEGA_BN_MAX_SCOPE];
+    int n = bn_union(ws->factors[a].vars, ws->factors[a].var_count,
+                     ws->factors[b].vars, ws->factors[b].var_count, vars);
+    if (n < 0) {
+        return -1;
+    }
+    int c = bn_new_factor(ws, vars, n, values);
+    if (c < 0 || !values) {
+        return c;
+    }
+
+    const bn_factor_t* fa = &ws->factors[a];
+    const bn_factor_t* fb = &ws->factors[b];
+    const bn_factor_t* fc = &ws->factors[c];
+    const double* va = ws->arena + fa->offset;
+    const double* vb = ws->arena + fb->offset;
+    double* out = ws->arena + fc->offset;
+    if (n == 0) {
+        out[0] = va[0] * vb[0];
+        return c;
+    }
+
+    size_t sa[OMEGA_BN_MAX_SCOPE], sb[OMEGA_BN_MAX_SCOPE];
+    size_t assignment[OMEGA_BN_MAX_SCOPE] = {0};
+    bn_strides_in(ws, fa, vars, n, sa);
+    bn_strides_in(ws, fb, vars, n, sb);
+    int last = n - 1;
+    size_t len = (size_t)ws->net->num_states[vars[last]];
+    size_t ia = 0, ib = 0;
+    for (size_t pos = 0; pos < fc->size; pos += len) {
+        bn_multiply_row(out + pos, va + ia, sa[last], vb + ib, sb[last], len);
+        for (int d = last - 1; d >= 0; d--) {
+            size_t card = (size_t)ws->net->num_states[vars[d]];
+            ia += sa[d];
+            ib += sb[d];
+            if (++assignment[d] < card) {
+                break;
             }
+            ia -= sa[d] * card;
+            ib -= sb[d] * card;
+            assignment[d] = 0;
         }
     }
-    
-    // Нормализуем posterior: P(X|E) = P(E|X)*P(X) / P(E)
-    double total_likelihood = 0.0;
-    for (int i = 0; i < target->num_states; i++) {
-        total_likelihood += likelihood[i];
+    return c;
+}
+
+static int bn_sum_out(bn_workspace_t* ws, int f, int var, int values) {
+    int vars[OMEGA_BN_MAX_SCOPE];
+    int n = 0;
+    for (int k = 0; k < ws->factors[f].var_count; k++) {
+        if (ws->factors[f].vars[k] != var) {
+            vars[n++] = ws->factors[f].vars[k];
+        }
     }
-    
-    if (total_likelihood > 0.0) {
-        for (int i = 0; i < target->num_states; i++) {
-            result_out->posterior[i] = likelihood[i] / total_likelihood;
+    int g = bn_new_factor(ws, vars, n, values);
+    if (g < 0 || !values) {
+        return g;
+    }
+
+    const bn_factor_t* ff = &ws->factors[f];
+    const bn_factor_t* fg = &ws->factors[g];
+    const double* in = ws->arena + ff->offset;
+    double* out = ws->arena + fg->offset;
+    memset(out, 0, fg->size * sizeof(double));
+
+    size_t sg[OMEGA_BN_MAX_SCOPE];
+    size_t assignment[OMEGA_BN_MAX_SCOPE] = {0};
+    bn_strides_in(ws, fg, ff->vars, ff->var_count, sg);
+    int last = ff->var_count - 1;
+    size_t len = (size_t)ws->net->num_states[ff->vars[last]];
+    int reduce_last = ff->vars[last] == var;
+    size_t ig = 0;
+    for (size_t pos = 0; pos < ff->size; pos += len) {
+        const double* row = in + pos;
+        if (reduce_last) {
+            double sum = 0.0;
+            for (size_t i = 0; i < len; i++) {
+                sum += row[i];
+            }
+            out[ig] += sum;
+        } else {
+            for (size_t i = 0; i < len; i++) {
+                out[ig + i] += row[i];
+            }
+        }
+        for (int d = last - 1; d >= 0; d--) {
+            size_t card = (size_t)ws->net->num_states[ff->vars[d]];
+            ig += sg[d];
+            if (++assignment[d] < card) {
+                break;
+            }
+            ig -= sg[d] * card;
+            assignment[d] = 0;
         }
     }
-    
+    return g;
+}
+
+// CPD узла, сужённая на свидетельство
+static int bn_reduce_cpd(bn_workspace_t* ws, int node, const int* evidence, int values) {
+    const omega_compiled_network_t* net = ws->net;
+    int scope[OMEGA_BN_MAX_SCOPE];
+    size_t strides[OMEGA_BN_MAX_SCOPE];
+    int vars[OMEGA_BN_MAX_SCOPE];
+    size_t steps[OMEGA_BN_MAX_SCOPE];
+    int k = net->parent_offsets[node + 1] - net->parent_offsets[node];
+    memcpy(scope, net->parents + net->parent_offsets[node], (size_t)k * sizeof(int));
+    scope[k] = node;
+
+    size_t stride = 1, base = 0;
+    for (int j = k; j >= 0; j--) {
+        strides[j] = stride;
+        stride *= (size_t)net->num_states[scope[j]];
+    }
+    int n = 0;
+    for (int j = 0; j <= k; j++) {
+        if (evidence[scope[j]] >= 0) {
+            base += (size_t)evidence[scope[j]] * strides[j];
+        } else {
+            vars[n] = scope[j];
+            steps[n++] = strides[j];
+        }
+    }
+    int f = bn_new_factor(ws, vars, n, values);
+    if (f < 0 || !values) {
+        return f;
+    }
+
+    const double* src = net->cpd + net->cpd_offsets[node] + base;
+    double* out = ws->arena + ws->factors[f].offset;
+    if (n == k + 1) {
+        memcpy(out, src, ws->factors[f].size * sizeof(double));
+        return f;
+    }
+    size_t assignment[OMEGA_BN_MAX_SCOPE] = {0};
+    size_t is = 0;
+    for (size_t o = 0; o < ws->factors[f].size; o++) {
+        out[o] = src[is];
+        for (int d = n - 1; d >= 0; d--) {
+            size_t card = (size_t)net->num_states[vars[d]];
+            is += steps[d];
+            if (++assignment[d] < card) {
+                break;
+            }
+            is -= steps[d] * card;
+            assignment[d] = 0;
+        }
+    }
+    return f;
+}
+
+// Перемножает факторы с var и суммирует var
+static int bn_eliminate(bn_workspace_t* ws, int var, int values) {
+    int count = ws->factor_count;
+    int acc = -1;
+    for (int i = 0; i < count; i++) {
+        if (!ws->factors[i].alive || !bn_contains(&ws->factors[i], var)) {
+            continue;
+        }
+        ws->factors[i].alive = 0;
+        if (acc < 0) {
+            acc = i;
+            continue;
+        }
+        int p = bn_product(ws, acc, i, values);
+        if (p < 0) {
+            return -1;
+        }
+        ws->factors[acc].alive = 0;
+        ws->factors[p].alive = 0;
+        acc = p;
+    }
+    if (acc < 0) {
+        return 0;
+    }
+    return bn_sum_out(ws, acc, var, values) < 0 ? -1 : 0;
+}
+
+// Размер произведения факторов с var; SIZE_MAX если слишком велико
+static size_t bn_elimination_size(const bn_workspace_t* ws, int var) {
+    int vars[OMEGA_BN_MAX_SCOPE];
+    int merged[OMEGA_BN_MAX_SCOPE];
+    int n = 0;
+    for (int i = 0; i < ws->factor_count; i++) {
+        const bn_factor_t* f = &ws->factors[i];
+        if (!f->alive || !bn_contains(f, var)) {
+            continue;
+        }
+        n = bn_union(vars, n, f->vars, f->var_count, merged);
+        if (n < 0) {
+            return SIZE_MAX;
+        }
+        memcpy(vars, merged, (size_t)n * sizeof(int));
+    }
+    size_t size = 1;
+    for (int k = 0; k < n; k++) {
+        size *= (size_t)ws->net->num_states[vars[k]];
+        if (size > OMEGA_BN_MAX_FACTOR_SIZE) {
+            return SIZE_MAX;
+        }
+    }
+    return size;
+}
+
+static int bn_plan_matches(const bn_workspace_t* ws, const int* evidence, int target) {
+    if (ws->plan_target != target) {
+        return 0;
+    }
+    for (int i = 0; i < ws->net->node_count; i++) {
+        if (ws->observed[i] != (evidence[i] >= 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// План: предки цели и свидетельств, затем жадный порядок исключения
+// по размеру фактора, разыгранный на одних областях определения
+static int bn_plan(bn_workspace_t* ws, const int* evidence, int target) {
+    const omega_compiled_network_t* net = ws->net;
+    int n = net->node_count;
+    ws->plan_target = -1;
+    for (int i = 0; i < n; i++) {
+        ws->observed[i] = evidence[i] >= 0;
+        ws->relevant[i] = ws->observed[i] || i == target;
+        ws->eliminated[i] = 0;
+    }
+    for (int v = n - 1; v >= 0; v--) {
+        if (ws->relevant[v]) {
+            for (int k = net->parent_offsets[v]; k < net->parent_offsets[v + 1]; k++) {
+                ws->relevant[net->parents[k]] = 1;
+            }
+        }
+    }
+
+    ws->factor_count = 0;
+    for (int v = 0; v < n; v++) {
+        if (ws->relevant[v] && bn_reduce_cpd(ws, v, evidence, 0) < 0) {
+            return -1;
+        }
+    }
+    ws->order_count = 0;
+    for (;;) {
+        int best = -1;
+        size_t best_size = SIZE_MAX;
+        for (int v = 0; v < n; v++) {
+            if (!ws->relevant[v] || ws->observed[v] || v == target || ws->eliminated[v]) {
+                continue;
+            }
+            size_t size = bn_elimination_size(ws, v);
+            if (best < 0 || size < best_size) {
+                best = v;
+                best_size = size;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        if (best_size == SIZE_MAX || bn_eliminate(ws, best, 0) != 0) {
+            return -1;
+        }
+        ws->eliminated[best] = 1;
+        ws->order[ws->order_count++] = best;
+    }
+    ws->plan_target = target;
+    return 0;
+}
+
+static void bn_fill_result(omega_inference_result_t* result, const double* posterior, int states) {
+    memcpy(result->posterior, posterior, (size_t)states * sizeof(double));
+
     // Найти наиболее вероятное состояние
-    result_out->most_likely_state = 0;
-    result_out->most_likely_probability = result_out->posterior[0];
-    
-    for (int i = 1; i < target->num_states; i++) {
-        if (result_out->posterior[i] > result_out->most_likely_probability) {
-            result_out->most_likely_probability = result_out->posterior[i];
-            result_out->most_likely_state = i;
+    result->most_likely_state = 0;
+    result->most_likely_probability = result->posterior[0];
+    for (int i = 1; i < states; i++) {
+        if (result->posterior[i] > result->most_likely_probability) {
+            result->most_likely_probability = result->posterior[i];
+            result->most_likely_state = i;
         }
     }
-    
+
     // Вычисляем энтропию: H(X) = -Σ P(x) * log(P(x))
-    result_out->entropy = 0.0;
-    for (int i = 0; i < target->num_states; i++) {
-        if (result_out->posterior[i] > 1e-10) {
-            result_out->entropy -= result_out->posterior[i] * log(result_out->posterior[i]);
+    result->entropy = 0.0;
+    for (int i = 0; i < states; i++) {
+        if (result->posterior[i] > 1e-10) {
+            result->entropy -= result->posterior[i] * log(result->posterior[i]);
+        }
+    }
+}
+
+static int bn_infer(bn_workspace_t* ws, const int* evidence, int target,
+                    omega_inference_result_t* result_out) {
+    const omega_compiled_network_t* net = ws->net;
+    int states = net->num_states[target];
+    double posterior[OMEGA_MAX_CPD_STATES];
+
+    memset(result_out, 0, sizeof(*result_out));
+    for (int i = 0; i < net->node_count; i++) {
+        if (evidence[i] < -1 || evidence[i] >= net->num_states[i]) {
+            return -1;
+        }
+    }
+
+    if (evidence[target] >= 0) {
+        // Наблюдаемый узел: вероятность = 1 для его состояния
+        for (int s = 0; s < states; s++) {
+            posterior[s] = s == evidence[target] ? 1.0 : 0.0;
+        }
+    } else {
+        if (!bn_plan_matches(ws, evidence, target) && bn_plan(ws, evidence, target) != 0) {
+            return -1;
+        }
+        ws->factor_count = 0;
+        ws->arena_used = 0;
+        for (int v = 0; v < net->node_count; v++) {
+            if (ws->relevant[v] && bn_reduce_cpd(ws, v, evidence, 1) < 0) {
+                return -1;
+            }
+        }
+        for (int k = 0; k < ws->order_count; k++) {
+            if (bn_eliminate(ws, ws->order[k], 1) != 0) {
+                return -1;
+            }
+        }
+
+        // Остались факторы над целью и константы: P(target, E)
+        for (int s = 0; s < states; s++) {
+            posterior[s] = 1.0;
+        }
+        for (int i = 0; i < ws->factor_count; i++) {
+            const bn_factor_t* f = &ws->factors[i];
+            const double* values = ws->arena + f->offset;
+            if (!f->alive) {
+                continue;
+            }
+            for (int s = 0; s < states; s++) {
+                posterior[s] *= f->var_count ? values[s] : values[0];
+            }
+        }
+        double total = 0.0;
+        for (int s = 0; s < states; s++) {
+            total += posterior[s];
+        }
+        if (!(total > 0.0)) {
+            return -1;  // свидетельство невозможно
+        }
+        for (int s = 0; s < states; s++) {
+            posterior[s] /= total;
         }
     }
+
+    result_out->node_id = net->node_ids[target];
+    bn_fill_result(result_out, posterior, states);
+    return 0;
+}
+
+int omega_compiled_network_infer(const omega_compiled_network_t* net,
+                                const int* evidence,
+                                int target_index,
+                                omega_inference_result_t* result_out) {
+    return omega_compiled_network_infer_batch(net, evidence, 1, target_index, result_out) == 1 ? 0 : -1;
+}
+
+int omega_compiled_network_infer_batch(const omega_compiled_network_t* net,
+                                      const int* evidence_sets,
+                                      int set_count,
+                                      int target_index,
+                                      omega_inference_result_t* results_out) {
+    if (!net || !evidence_sets || !results_out || set_count < 0 ||
+        target_index < 0 || target_index >= net->node_count) {
+        return -1;
+    }
+    bn_workspace_t ws;
+    if (bn_workspace_init(&ws, net) != 0) {
+        return -1;
+    }
+    int inferred = 0;
+    for (int s = 0; s < set_count; s++) {
+        const int* evidence = evidence_sets + (size_t)s * (size_t)net->node_count;
+        if (bn_infer(&ws, evidence, target_index, &results_out[s]) == 0) {
+            inferred++;
+        } else {
+            memset(&results_out[s], 0, sizeof(results_out[s]));
+        }
+    }
+    bn_workspace_free(&ws);
+    return inferred;
+}
+
+/**
+ * omega_bayesian_inference - вероятностный вывод
+ * 
+ * Точный вывод по скомпилированной сети:
+ * P(X | E) ∝ Σ_скрытые Π P(узел | родители)
+ */
+int omega_bayesian_inference(omega_context_t* ctx, uint32_t target_node_id,
+                            omega_inference_result_t* result_out) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx || !result_out) {
+        return -1;
+    }
+
+    if (!bayesian_ctx->compiled_fresh) {
+        omega_compiled_network_free(&bayesian_ctx->compiled);
+        if (omega_bayesian_network_compile(ctx, &bayesian_ctx->compiled) != 0) {
+            return -1;
+        }
+        bayesian_ctx->compiled_fresh = 1;
+    }
+    const omega_compiled_network_t* net = &bayesian_ctx->compiled;
+
+    // Найти целевой узел
+    int target = omega_compiled_network_index(net, target_node_id);
+    if (target < 0) {
+        return -1;
+    }
+
+    int evidence[OMEGA_MAX_CAUSAL_NODES];
+    for (int i = 0; i < bayesian_ctx->node_count; i++) {
+        const omega_causal_node_t* node = &bayesian_ctx->nodes[i];
+        evidence[net->position[i]] = node->is_observed ? node->observed_state : -1;
+    }
+    if (omega_compiled_network_infer(net, evidence, target, result_out) != 0) {
+        return -1;
+    }
     
-    bayesian_ctx.stats.total_inferences++;
-    bayesian_ctx.stats.average_entropy += result_out->entropy;
+    bayesian_ctx->stats.total_inferences++;
+    bayesian_ctx->stats.average_entropy += result_out->entropy;
     
-    printf("[BayesianCausal] Inference for node %u: state=%d, prob=%.2f, entropy=%.3f\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Inference for node %u: state=%d, prob=%.2f, entropy=%.3f",
            target_node_id, result_out->most_likely_state,
            result_out->most_likely_probability, result_out->entropy);
     
     return 0;
 }
 
+// Индекс узла по id: узлы получают id 5000 + позиция
+static int bayesian_node_index(omega_bayesian_ctx_t* bayesian_ctx, uint32_t node_id) {
+    uint32_t index = node_id - 5000;
+    if (node_id < 5000 || index >= (uint32_t)bayesian_ctx->node_count) {
+        return -1;
+    }
+    return (int)index;
+}
+
 /**
  * omega_record_causal_observation - записать наблюдение
  */
-int omega_record_causal_observation(const uint32_t* node_ids,
+int omega_record_causal_observation(omega_context_t* ctx, const uint32_t* node_ids,
                                    const int* states,
                                    int num_observations,
                                    double likelihood) {
-    if (bayesian_ctx.episode_count >= OMEGA_MAX_CAUSAL_EPISODES) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
         return -1;
     }
-    
-    omega_causal_episode_t* episode = &bayesian_ctx.episodes[bayesian_ctx.episode_count];
-    
-    episode->episode_id = 7000 + bayesian_ctx.episode_count;
-    episode->timestamp_ms = 0;  // Placeholder
-    episode->num_observations = num_observations;
-    episode->likelihood = likelihood;
-    
-    for (int i = 0; i < num_observations && i < OMEGA_MAX_CAUSAL_NODES; i++) {
-        episode->node_ids[i] = node_ids[i];
-        episode->observed_states[i] = states[i];
+    if (num_observations < 0 || (num_observations > 0 && (!node_ids || !states))) {
+        return -1;
     }
-    
-    bayesian_ctx.episode_count++;
-    bayesian_ctx.stats.total_learning_episodes++;
-    bayesian_ctx.stats.total_likelihood += likelihood;
+
+    int observed[OMEGA_MAX_CAUSAL_NODES];
+    for (int i = 0; i < bayesian_ctx->node_count; i++) {
+        observed[i] = -1;
+    }
+    for (int o = 0; o < num_observations; o++) {
+        int index = bayesian_node_index(bayesian_ctx, node_ids[o]);
+        if (index >= 0 && states[o] >= 0 && states[o] < bayesian_ctx->nodes[index].num_states) {
+            observed[index] = states[o];
+        }
+    }
+
+    // Затухание: вместо умножения всех счётчиков на d новый вес делится на d
+    bayesian_ctx->count_weight /= OMEGA_CAUSAL_COUNT_DECAY;
+    if (bayesian_ctx->count_weight > 1e150) {
+        double scale = 1.0 / bayesian_ctx->count_weight;
+        for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+            for (int p = 0; p < OMEGA_MAX_CPD_STATES; p++) {
+                for (int c = 0; c < OMEGA_MAX_CPD_STATES; c++) {
+                    bayesian_ctx->edge_counts[e][p][c] *= scale;
+                }
+            }
+        }
+        bayesian_ctx->count_weight = 1.0;
+    }
+
+    for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+        omega_causal_edge_t* edge = &bayesian_ctx->edges[e];
+        int parent = bayesian_node_index(bayesian_ctx, edge->parent_node_id);
+        int child = bayesian_node_index(bayesian_ctx, edge->child_node_id);
+        if (parent < 0 || child < 0 || observed[parent] < 0 || observed[child] < 0) {
+            continue;
+        }
+        bayesian_ctx->edge_counts[e][observed[parent]][observed[child]] += bayesian_ctx->count_weight;
+        edge->times_observed++;
+    }
+
+    bayesian_ctx->stats.total_learning_episodes++;
+    bayesian_ctx->stats.total_likelihood += likelihood;
     
     return 0;
 }
 
+// Строка CPD ребра по счётчикам; 0 если для строки нет наблюдений
+static int bayesian_cpd_row(omega_bayesian_ctx_t* bayesian_ctx, int e, int parent_state, double* row_out) {
+    const omega_causal_edge_t* edge = &bayesian_ctx->edges[e];
+    int child = bayesian_node_index(bayesian_ctx, edge->child_node_id);
+    int states = child >= 0 ? bayesian_ctx->nodes[child].num_states : OMEGA_MAX_CPD_STATES;
+    const double* counts = bayesian_ctx->edge_counts[e][parent_state];
+    double row_sum = 0.0;
+
+    for (int c = 0; c < states; c++) {
+        row_sum += counts[c];
+    }
+    if (row_sum <= 0.0) {
+        memcpy(row_out, edge->cpd[parent_state], (size_t)states * sizeof(double));
+        return 0;
+    }
+    // Лапласово сглаживание: (count + 1) / (total + K)
+    row_sum /= bayesian_ctx->count_weight;
+    for (int c = 0; c < states; c++) {
+        row_out[c] = (counts[c] / bayesian_ctx->count_weight + 1.0) / (row_sum + states);
+    }
+    return 1;
+}
+
+/**
+ * omega_get_causal_cpd_row - строка CPD по счётчикам
+ */
+int omega_get_causal_cpd_row(omega_context_t* ctx, uint32_t edge_id, int parent_state, double* row_out) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
+        return -1;
+    }
+    uint32_t e = edge_id - 6000;
+    if (!row_out || edge_id < 6000 || e >= (uint32_t)bayesian_ctx->edge_count ||
+        parent_state < 0 || parent_state >= OMEGA_MAX_CPD_STATES) {
+        return -1;
+    }
+    bayesian_cpd_row(bayesian_ctx, (int)e, parent_state, row_out);
+    int child = bayesian_node_index(bayesian_ctx, bayesian_ctx->edges[e].child_node_id);
+    return child >= 0 ? bayesian_ctx->nodes[child].num_states : OMEGA_MAX_CPD_STATES;
+}
+
 /**
  * omega_learn_cpd_from_episodes - обновить CPD
  */
-int omega_learn_cpd_from_episodes(void) {
-    if (bayesian_ctx.episode_count == 0) {
+int omega_learn_cpd_from_episodes(omega_context_t* ctx) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
+        return -1;
+    }
+    if (bayesian_ctx->stats.total_learning_episodes == 0) {
         return 0;
     }
     
-    // Для каждого ребра: обновить CPD на основе наблюдений
-    for (int e = 0; e < bayesian_ctx.edge_count; e++) {
-        omega_causal_edge_t* edge = &bayesian_ctx.edges[e];
-        
-        // Считаем совместные вероятности из эпизодов
-        int joint_counts[OMEGA_MAX_CPD_STATES][OMEGA_MAX_CPD_STATES];
-        memset(joint_counts, 0, sizeof(joint_counts));
-        
-        for (int ep = 0; ep < bayesian_ctx.episode_count; ep++) {
-            omega_causal_episode_t* episode = &bayesian_ctx.episodes[ep];
-            
-            // Найти состояния parent и child в этом эпизоде
-            int parent_state = -1, child_state = -1;
-            
-            for (int o = 0; o < episode->num_observations; o++) {
-                if (episode->node_ids[o] == edge->parent_node_id) {
-                    parent_state = episode->observed_states[o];
-                }
-                if (episode->node_ids[o] == edge->child_node_id) {
-                    child_state = episode->observed_states[o];
-                }
-            }
-            
-            if (parent_state >= 0 && child_state >= 0 && parent_state < OMEGA_MAX_CPD_STATES && child_state < OMEGA_MAX_CPD_STATES) {
-                joint_counts[parent_state][child_state]++;
-            }
-        }
-        
-        // Обновляем CPD с использованием Байесовского обновления
+    // Для каждого ребра: строки CPD из накопленных счётчиков
+    for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+        omega_causal_edge_t* edge = &bayesian_ctx->edges[e];
         for (int p = 0; p < OMEGA_MAX_CPD_STATES; p++) {
-            double row_sum = 0.0;
-            for (int c = 0; c < OMEGA_MAX_CPD_STATES; c++) {
-                row_sum += joint_counts[p][c];
-            }
-            
-            if (row_sum > 0.0) {
-                for (int c = 0; c < OMEGA_MAX_CPD_STATES; c++) {
-                    // Лапласово сглаживание: (count + 1) / (total + K)
-                    edge->cpd[p][c] = (joint_counts[p][c] + 1.0) / (row_sum + OMEGA_MAX_CPD_STATES);
-                    edge->times_observed++;
-                }
-            }
+            bayesian_cpd_row(bayesian_ctx, e, p, edge->cpd[p]);
         }
         
         // Если CPD достаточно уверен, помечаем ребро как подтвержденное
-        if (edge->times_observed > 5 && edge->causal_strength > 0.6) {
+        if (!edge->confirmed && edge->times_observed > 5 && edge->causal_strength > 0.6) {
             edge->confirmed = 1;
-            bayesian_ctx.stats.confirmed_causal_edges++;
+            bayesian_ctx->stats.confirmed_causal_edges++;
         }
     }
+    bayesian_ctx->compiled_fresh = 0;
     
-    printf("[BayesianCausal] Learned CPD from %d episodes\n",
-           bayesian_ctx.episode_count);
+    KOLIBRI_LOG_INFO("BayesianCausal", "Learned CPD from %d episodes",
+           bayesian_ctx->stats.total_learning_episodes);
     
     return 0;
 }
@@ -339,39 +1229,40 @@ int omega_learn_cpd_from_episodes(void) {
 /**
  * omega_find_markov_blanket - найти Markov Blanket
  */
-int omega_find_markov_blanket(uint32_t node_id,
+int omega_find_markov_blanket(omega_context_t* ctx, uint32_t node_id,
                              uint32_t* blanket_nodes_out,
                              int* blanket_size_out) {
-    if (!blanket_nodes_out || !blanket_size_out) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx || !blanket_nodes_out || !blanket_size_out) {
         return -1;
     }
     
     int blanket_size = 0;
     
     // Найти всех родителей
-    for (int e = 0; e < bayesian_ctx.edge_count; e++) {
-        if (bayesian_ctx.edges[e].child_node_id == node_id) {
-            blanket_nodes_out[blanket_size++] = bayesian_ctx.edges[e].parent_node_id;
+    for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+        if (bayesian_ctx->edges[e].child_node_id == node_id) {
+            blanket_nodes_out[blanket_size++] = bayesian_ctx->edges[e].parent_node_id;
         }
     }
     
     // Найти всех детей
-    for (int e = 0; e < bayesian_ctx.edge_count; e++) {
-        if (bayesian_ctx.edges[e].parent_node_id == node_id) {
-            blanket_nodes_out[blanket_size++] = bayesian_ctx.edges[e].child_node_id;
+    for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+        if (bayesian_ctx->edges[e].parent_node_id == node_id) {
+            blanket_nodes_out[blanket_size++] = bayesian_ctx->edges[e].child_node_id;
         }
     }
     
     // Найти со-родителей (родителей детей)
-    for (int e = 0; e < bayesian_ctx.edge_count; e++) {
-        if (bayesian_ctx.edges[e].parent_node_id == node_id) {
-            uint32_t child = bayesian_ctx.edges[e].child_node_id;
+    for (int e = 0; e < bayesian_ctx->edge_count; e++) {
+        if (bayesian_ctx->edges[e].parent_node_id == node_id) {
+            uint32_t child = bayesian_ctx->edges[e].child_node_id;
             
             // Найти других родителей этого ребенка
-            for (int e2 = 0; e2 < bayesian_ctx.edge_count; e2++) {
-                if (bayesian_ctx.edges[e2].child_node_id == child &&
-                    bayesian_ctx.edges[e2].parent_node_id != node_id) {
-                    blanket_nodes_out[blanket_size++] = bayesian_ctx.edges[e2].parent_node_id;
+            for (int e2 = 0; e2 < bayesian_ctx->edge_count; e2++) {
+                if (bayesian_ctx->edges[e2].child_node_id == child &&
+                    bayesian_ctx->edges[e2].parent_node_id != node_id) {
+                    blanket_nodes_out[blanket_size++] = bayesian_ctx->edges[e2].parent_node_id;
                 }
             }
         }
@@ -379,7 +1270,7 @@ int omega_find_markov_blanket(uint32_t node_id,
     
     *blanket_size_out = blanket_size;
     
-    printf("[BayesianCausal] Markov Blanket for node %u: %d nodes\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Markov Blanket for node %u: %d nodes",
            node_id, blanket_size);
     
     return 0;
@@ -388,33 +1279,43 @@ int omega_find_markov_blanket(uint32_t node_id,
 /**
  * omega_get_causal_network_statistics - получить статистику
  */
-const omega_bayesian_network_stats_t* omega_get_causal_network_statistics(void) {
-    if (bayesian_ctx.stats.total_inferences > 0) {
-        bayesian_ctx.stats.average_entropy /= bayesian_ctx.stats.total_inferences;
+const omega_bayesian_network_stats_t* omega_get_causal_network_statistics(omega_context_t* ctx) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
+        return NULL;
+    }
+    if (bayesian_ctx->stats.total_inferences > 0) {
+        bayesian_ctx->stats.average_entropy /= bayesian_ctx->stats.total_inferences;
     }
     
-    if (bayesian_ctx.stats.total_edges > 0) {
-        bayesian_ctx.stats.average_causal_strength /= bayesian_ctx.stats.total_edges;
+    if (bayesian_ctx->stats.total_edges > 0) {
+        bayesian_ctx->stats.average_causal_strength /= bayesian_ctx->stats.total_edges;
     }
     
-    return &bayesian_ctx.stats;
+    return &bayesian_ctx->stats;
 }
 
 /**
  * omega_bayesian_network_shutdown - остановка
  */
-void omega_bayesian_network_shutdown(void) {
-    const omega_bayesian_network_stats_t* stats = omega_get_causal_network_statistics();
+void omega_bayesian_network_shutdown(omega_context_t* ctx) {
+    omega_bayesian_ctx_t* bayesian_ctx = ctx ? ctx->bayesian : NULL;
+    if (!bayesian_ctx) {
+        return;
+    }
+    const omega_bayesian_network_stats_t* stats = omega_get_causal_network_statistics(ctx);
     
-    printf("[BayesianCausal] Shutdown: %d nodes, %d edges, %d inferences\n",
-           bayesian_ctx.node_count, bayesian_ctx.edge_count,
-           bayesian_ctx.stats.total_inferences);
-    printf("  Confirmed causal edges: %d, Rejected: %d\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Shutdown: %d nodes, %d edges, %d inferences",
+           bayesian_ctx->node_count, bayesian_ctx->edge_count,
+           bayesian_ctx->stats.total_inferences);
+    KOLIBRI_LOG_INFO("BayesianCausal", "Confirmed causal edges: %d, Rejected: %d",
            stats->confirmed_causal_edges, stats->rejected_causal_edges);
-    printf("  Average entropy: %.3f, Average causal strength: %.2f\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Average entropy: %.3f, Average causal strength: %.2f",
            stats->average_entropy, stats->average_causal_strength);
-    printf("  Learning episodes: %d, Total likelihood: %.2f\n",
+    KOLIBRI_LOG_INFO("BayesianCausal", "Learning episodes: %d, Total likelihood: %.2f",
            stats->total_learning_episodes, stats->total_likelihood);
     
-    memset(&bayesian_ctx, 0, sizeof(bayesian_ctx));
+    omega_compiled_network_free(&bayesian_ctx->compiled);
+    free(bayesian_ctx);
+    ctx->bayesian = NULL;
 }
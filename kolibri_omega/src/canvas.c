@@ -1,42 +1,253 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/include/canvas.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+static __thread omega_canvas_stage_t* canvas_active_stage = NULL;
+
+static size_t canvas_key_slot(const omega_canvas_t* canvas, int object_id, int time) {
+    uint64_t key = ((uint64_t)(uint32_t)object_id << 32) | (uint32_t)time;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (canvas->key_slots - 1);
+}
+
+// Ставит элемент index в конец цепочки своего ключа
+static void canvas_key_link(omega_canvas_t* canvas, size_t index) {
+    omega_canvas_entry_t* entry = &canvas->entries[index];
+    entry->key_prev = 0;
+    entry->key_next = 0;
+    if (!entry->keyed) {
+        return;
+    }
+    size_t slot = canvas_key_slot(canvas, entry->object_id, entry->time);
+    uint32_t tail = canvas->key_tail[slot];
+    entry->key_prev = tail;
+    if (tail) {
+        canvas->entries[tail - 1].key_next = (uint32_t)(index + 1);
+    } else {
+        canvas->key_head[slot] = (uint32_t)(index + 1);
+    }
+    canvas->key_tail[slot] = (uint32_t)(index + 1);
+}
+
+static void canvas_key_unlink(omega_canvas_t* canvas, size_t index) {
+    omega_canvas_entry_t* entry = &canvas->entries[index];
+    if (!entry->keyed) {
+        return;
+    }
+    size_t slot = canvas_key_slot(canvas, entry->object_id, entry->time);
+    if (entry->key_prev) {
+        canvas->entries[entry->key_prev - 1].key_next = entry->key_next;
+    } else {
+        canvas->key_head[slot] = entry->key_next;
+    }
+    if (entry->key_next) {
+        canvas->entries[entry->key_next - 1].key_prev = entry->key_prev;
+    } else {
+        canvas->key_tail[slot] = entry->key_prev;
+    }
+}
+
+// Элемент переехал на позицию index: соседи по цепочке узнают новый адрес
+static void canvas_key_relink(omega_canvas_t* canvas, size_t index) {
+    omega_canvas_entry_t* entry = &canvas->entries[index];
+    if (!entry->keyed) {
+        return;
+    }
+    size_t slot = canvas_key_slot(canvas, entry->object_id, entry->time);
+    if (entry->key_prev) {
+        canvas->entries[entry->key_prev - 1].key_next = (uint32_t)(index + 1);
+    } else {
+        canvas->key_head[slot] = (uint32_t)(index + 1);
+    }
+    if (entry->key_next) {
+        canvas->entries[entry->key_next - 1].key_prev = (uint32_t)(index + 1);
+    } else {
+        canvas->key_tail[slot] = (uint32_t)(index + 1);
+    }
+}
+
+static void canvas_type_link(omega_canvas_t* canvas, size_t index) {
+    omega_hypothesis_type type = canvas->items[index].type;
+    if ((unsigned)type < OMEGA_HYPOTHESIS_TYPES) {
+        canvas->entries[index].type_pos = (uint32_t)canvas->type_count[type];
+        canvas->type_items[type][canvas->type_count[type]++] = (uint32_t)index;
+    }
+}
+
+static void canvas_type_unlink(omega_canvas_t* canvas, size_t index) {
+    omega_hypothesis_type type = canvas->items[index].type;
+    if ((unsigned)type < OMEGA_HYPOTHESIS_TYPES) {
+        uint32_t pos = canvas->entries[index].type_pos;
+        uint32_t moved = canvas->type_items[type][--canvas->type_count[type]];
+        canvas->type_items[type][pos] = moved;
+        canvas->entries[moved].type_pos = pos;
+    }
+}
+
+// Строит цепочки и списки типов заново в порядке items
+static void canvas_relink_all(omega_canvas_t* canvas) {
+    memset(canvas->key_head, 0, canvas->key_slots * sizeof(uint32_t));
+    memset(canvas->key_tail, 0, canvas->key_slots * sizeof(uint32_t));
+    memset(canvas->type_count, 0, sizeof(canvas->type_count));
+    for (size_t i = 0; i < canvas->count; ++i) {
+        canvas_key_link(canvas, i);
+        canvas_type_link(canvas, i);
+    }
+}
+
+// Пересобирает индекс ключей под key_slots ячеек, не меняя порядок цепочек
+static int canvas_rehash(omega_canvas_t* canvas, size_t key_slots) {
+    uint32_t* head = calloc(key_slots, sizeof(uint32_t));
+    uint32_t* tail = calloc(key_slots, sizeof(uint32_t));
+    if (!head || !tail) {
+        free(head);
+        free(tail);
+        return -1;
+    }
+    uint32_t* old_head = canvas->key_head;
+    size_t old_slots = canvas->key_slots;
+    uint32_t* order = canvas->count ? malloc(canvas->count * sizeof(uint32_t)) : NULL;
+    if (canvas->count && !order) {
+        free(head);
+        free(tail);
+        return -1;
+    }
+    size_t ordered = 0;
+    for (size_t slot = 0; slot < old_slots; ++slot) {
+        for (uint32_t at = old_head[slot]; at; at = canvas->entries[at - 1].key_next) {
+            order[ordered++] = at - 1;
+        }
+    }
+    free(canvas->key_head);
+    free(canvas->key_tail);
+    canvas->key_head = head;
+    canvas->key_tail = tail;
+    canvas->key_slots = key_slots;
+    for (size_t i = 0; i < ordered; ++i) {
+        canvas_key_link(canvas, order[i]);
+    }
+    free(order);
+    return 0;
+}
+
+static int canvas_reserve(omega_canvas_t* canvas, size_t capacity) {
+    if (capacity <= canvas->capacity) {
+        return 0;
+    }
+    size_t new_capacity = canvas->capacity ? canvas->capacity : OMEGA_CANVAS_INITIAL_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > UINT32_MAX / 2) {
+        return -1;
+    }
+    omega_canvas_item_t* items = realloc(canvas->items, new_capacity * sizeof(omega_canvas_item_t));
+    if (!items) {
+        return -1;
+    }
+    canvas->items = items;
+    omega_canvas_entry_t* entries = realloc(canvas->entries, new_capacity * sizeof(omega_canvas_entry_t));
+    if (!entries) {
+        return -1;
+    }
+    canvas->entries = entries;
+    omega_canvas_slot_t* slots = realloc(canvas->slots, new_capacity * sizeof(omega_canvas_slot_t));
+    if (!slots) {
+        return -1;
+    }
+    canvas->slots = slots;
+    for (int type = 0; type < OMEGA_HYPOTHESIS_TYPES; ++type) {
+        uint32_t* list = realloc(canvas->type_items[type], new_capacity * sizeof(uint32_t));
+        if (!list) {
+            return -1;
+        }
+        canvas->type_items[type] = list;
+    }
+    if (canvas_rehash(canvas, new_capacity * 2) != 0) {
+        return -1;
+    }
+    canvas->capacity = new_capacity;
+    return 0;
+}
+
 /**
  * @brief Инициализирует Холст.
  */
 int omega_canvas_init(omega_canvas_t* canvas, kf_pool_t* formula_pool) {
     if (!canvas || !formula_pool) return -1;
+    memset(canvas, 0, sizeof(*canvas));
     canvas->formula_pool = formula_pool;
-    canvas->count = 0;
-    canvas->next_item_id = 1;
-    // Массив 'items' является частью структуры и не требует динамического выделения
-    return 0;
+    return canvas_reserve(canvas, OMEGA_CANVAS_INITIAL_CAPACITY);
 }
 
 /**
  * @brief Уничтожает Холст, освобождая все ресурсы.
  */
 void omega_canvas_destroy(omega_canvas_t* canvas) {
-    // Нет необходимости освобождать 'items', так как он не выделяется динамически
-    if (canvas) {
-        canvas->count = 0;
+    if (!canvas) {
+        return;
     }
+    free(canvas->items);
+    free(canvas->entries);
+    free(canvas->slots);
+    free(canvas->key_head);
+    free(canvas->key_tail);
+    for (int type = 0; type < OMEGA_HYPOTHESIS_TYPES; ++type) {
+        free(canvas->type_items[type]);
+    }
+    memset(canvas, 0, sizeof(*canvas));
+}
+
+void omega_canvas_set_stable_order(omega_canvas_t* canvas, int stable) {
+    canvas->stable_order = stable ? 1 : 0;
 }
 
 /**
  * @brief Добавляет новый элемент на Холст.
  */
 uint64_t omega_canvas_add_item(omega_canvas_t* canvas, omega_canvas_item_t* item) {
-    if (canvas->count >= MAX_CANVAS_ITEMS) {
-        printf("Canvas is full!\n");
+    omega_canvas_stage_t* stage = canvas_active_stage;
+    if (stage && stage->canvas == canvas) {
+        if (stage->count == stage->capacity) {
+            size_t capacity = stage->capacity ? stage->capacity * 2 : 16;
+            omega_canvas_item_t* items = realloc(stage->items, capacity * sizeof(omega_canvas_item_t));
+            if (!items) {
+                return 0;
+            }
+            stage->items = items;
+            stage->capacity = capacity;
+        }
+        stage->items[stage->count++] = *item;
+        return OMEGA_CANVAS_STAGED_ID;
+    }
+    if (canvas_reserve(canvas, canvas->count + 1) != 0) {
+        KOLIBRI_LOG_WARN("Canvas", "Canvas is full!");
         return 0;
     }
-    item->id = canvas->next_item_id++;
-    canvas->items[canvas->count++] = *item;
+    size_t index = canvas->count++;
+    uint32_t slot;
+    if (canvas->free_slot) {
+        slot = canvas->free_slot - 1;
+        canvas->free_slot = canvas->slots[slot].index;
+    } else {
+        slot = (uint32_t)canvas->slot_count++;
+        canvas->slots[slot].generation = 1;
+    }
+    canvas->slots[slot].index = (uint32_t)index;
+    item->id = ((uint64_t)canvas->slots[slot].generation << 32) | (slot + 1);
+    canvas->items[index] = *item;
+
+    omega_canvas_entry_t* entry = &canvas->entries[index];
+    const kf_formula_t* formula = kf_borrow_formula(canvas->formula_pool, item->formula_id);
+    entry->slot = slot;
+    entry->keyed = formula && formula->type == KF_TYPE_FACT;
+    entry->object_id = entry->keyed ? formula->data.fact.object_id : 0;
+    entry->time = entry->keyed ? formula->time : 0;
+    canvas_key_link(canvas, index);
+    canvas_type_link(canvas, index);
     return item->id;
 }
 
@@ -47,13 +258,113 @@ int omega_canvas_remove_item(omega_canvas_t* canvas, size_t index) {
     if (index >= canvas->count) {
         return -1;
     }
-    for (size_t i = index; i < canvas->count - 1; ++i) {
-        canvas->items[i] = canvas->items[i + 1];
+    omega_canvas_slot_t* slot = &canvas->slots[canvas->entries[index].slot];
+    slot->generation++;
+    slot->index = canvas->free_slot;
+    canvas->free_slot = canvas->entries[index].slot + 1;
+
+    size_t last = canvas->count - 1;
+    if (canvas->stable_order) {
+        memmove(&canvas->items[index], &canvas->items[index + 1], (last - index) * sizeof(omega_canvas_item_t));
+        memmove(&canvas->entries[index], &canvas->entries[index + 1], (last - index) * sizeof(omega_canvas_entry_t));
+        canvas->count--;
+        for (size_t i = index; i < canvas->count; ++i) {
+            canvas->slots[canvas->entries[i].slot].index = (uint32_t)i;
+        }
+        canvas_relink_all(canvas);
+        return 0;
+    }
+
+    // На место удалённого встаёт последний элемент
+    canvas_key_unlink(canvas, index);
+    canvas_type_unlink(canvas, index);
+    if (index != last) {
+        canvas->items[index] = canvas->items[last];
+        canvas->entries[index] = canvas->entries[last];
+        canvas_key_relink(canvas, index);
+        omega_hypothesis_type type = canvas->items[index].type;
+        if ((unsigned)type < OMEGA_HYPOTHESIS_TYPES) {
+            canvas->type_items[type][canvas->entries[index].type_pos] = (uint32_t)index;
+        }
+        canvas->slots[canvas->entries[index].slot].index = (uint32_t)index;
     }
     canvas->count--;
     return 0;
 }
 
+void omega_canvas_stage_begin(omega_canvas_stage_t* stage, omega_canvas_t* canvas) {
+    stage->canvas = canvas;
+    canvas_active_stage = stage;
+}
+
+void omega_canvas_stage_end(void) {
+    canvas_active_stage = NULL;
+}
+
+int omega_canvas_stage_commit(omega_canvas_stage_t* stage) {
+    omega_canvas_t* canvas = stage->canvas;
+    if (!canvas || stage->count == 0) {
+        return 0;
+    }
+    omega_canvas_stage_t* active = canvas_active_stage;
+    canvas_active_stage = NULL;
+    int result = canvas_reserve(canvas, canvas->count + stage->count);
+    for (size_t i = 0; result == 0 && i < stage->count; ++i) {
+        omega_canvas_add_item(canvas, &stage->items[i]);
+    }
+    canvas_active_stage = active;
+    stage->count = 0;
+    return result;
+}
+
+void omega_canvas_stage_free(omega_canvas_stage_t* stage) {
+    free(stage->items);
+    memset(stage, 0, sizeof(*stage));
+}
+
+// Позиция элемента с этим ID или canvas->count, если он уже удалён
+static size_t canvas_index_of(const omega_canvas_t* canvas, uint64_t item_id) {
+    uint32_t slot = (uint32_t)item_id;
+    if (slot == 0 || slot > canvas->slot_count) {
+        return canvas->count;
+    }
+    const omega_canvas_slot_t* entry = &canvas->slots[slot - 1];
+    if (entry->generation != (uint32_t)(item_id >> 32)) {
+        return canvas->count;
+    }
+    return entry->index;
+}
+
+omega_canvas_item_t* omega_canvas_get_item(omega_canvas_t* canvas, uint64_t item_id) {
+    size_t index = canvas_index_of(canvas, item_id);
+    return index < canvas->count ? &canvas->items[index] : NULL;
+}
+
+int omega_canvas_remove_id(omega_canvas_t* canvas, uint64_t item_id) {
+    return omega_canvas_remove_item(canvas, canvas_index_of(canvas, item_id));
+}
+
+size_t omega_canvas_first_at(const omega_canvas_t* canvas, int object_id, int time) {
+    for (uint32_t at = canvas->key_head[canvas_key_slot(canvas, object_id, time)]; at; at = canvas->entries[at - 1].key_next) {
+        const omega_canvas_entry_t* entry = &canvas->entries[at - 1];
+        if (entry->object_id == object_id && entry->time == time) {
+            return at - 1;
+        }
+    }
+    return canvas->count;
+}
+
+size_t omega_canvas_next_at(const omega_canvas_t* canvas, size_t index) {
+    const omega_canvas_entry_t* from = &canvas->entries[index];
+    for (uint32_t at = from->key_next; at; at = canvas->entries[at - 1].key_next) {
+        const omega_canvas_entry_t* entry = &canvas->entries[at - 1];
+        if (entry->object_id == from->object_id && entry->time == from->time) {
+            return at - 1;
+        }
+    }
+    return canvas->count;
+}
+
 /**
  * @brief Печатает содержимое Холста.
  */
@@ -1,4 +1,5 @@
 #include "kolibri_omega/include/counterfactual_reasoner.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,7 +7,34 @@
 
 #define OMEGA_MAX_SCENARIO_INSTANCES 50
 
+/* ========== Кэш префиксов вмешательств ========== */
+
+// Состояние мира после префикса вмешательств
+typedef struct {
+    double total_effect;  // Σ strength * 0.1
+    double survival;      // Π (1 - strength)
+} cf_world_t;
+
+// Узел бора: вмешательство поверх родительского префикса. Ключ — поля,
+// от которых зависит состояние; ID и описание в него не входят.
+typedef struct {
+    int32_t parent;
+    omega_intervention_type_t type;
+    uint32_t target_agent_id;
+    uint64_t target_formula_id;
+    double strength;
+    cf_world_t world;
+} cf_prefix_node_t;
+
 typedef struct {
+    cf_prefix_node_t* nodes;
+    int count;
+    int capacity;
+    int32_t* slots;  // открытая адресация по (родитель, ключ): индекс + 1
+    size_t slot_count;
+} cf_prefix_trie_t;
+
+struct omega_counterfactual_ctx_s {
     omega_scenario_t scenarios[OMEGA_MAX_SCENARIOS];
     int scenario_count;
     
@@ -16,20 +44,242 @@ typedef struct {
     omega_branch_t branches[OMEGA_MAX_BRANCHES];
     int branch_count;
     
+    // Кэш префиксов и докуда в нём пройден каждый сценарий
+    cf_prefix_trie_t trie;
+    int32_t scenario_nodes[OMEGA_MAX_SCENARIOS];
+    int scenario_depths[OMEGA_MAX_SCENARIOS];
+    
     omega_counterfactual_stats_t stats;
-} omega_counterfactual_ctx_t;
+};
+
+typedef struct omega_counterfactual_ctx_s omega_counterfactual_ctx_t;
+
+static void cf_world_step(cf_world_t* world, const omega_intervention_t* intervention) {
+    world->total_effect += intervention->intervention_strength * 0.1;
+    world->survival *= 1.0 - intervention->intervention_strength;
+}
+
+// Ожидаемые исходы основаны на вмешательствах
+static void cf_world_expected(const cf_world_t* world, double* canvas_items,
+                              double* agent_sync, double* pattern_count) {
+    *canvas_items = 100.0 + (world->total_effect * 50.0);
+    *agent_sync = 0.5 + (world->total_effect * 0.3);
+    *pattern_count = 10.0 + (world->total_effect * 20.0);
+}
+
+// Сдвиг ожидаемых исходов от мира без вмешательств
+static double cf_world_impact(const cf_world_t* world) {
+    const cf_world_t baseline = { 0.0, 1.0 };
+    double canvas, sync, patterns, base_canvas, base_sync, base_patterns;
+    cf_world_expected(world, &canvas, &sync, &patterns);
+    cf_world_expected(&baseline, &base_canvas, &base_sync, &base_patterns);
+    return fabs(canvas - base_canvas) / (base_canvas + 1) * 0.4 +
+           fabs(sync - base_sync) * 0.3 +
+           fabs(patterns - base_patterns) / (base_patterns + 1) * 0.3;
+}
+
+static int cf_same_step(const cf_prefix_node_t* node, int32_t parent,
+                        const omega_intervention_t* intervention) {
+    return node->parent == parent &&
+           node->type == intervention->intervention_type &&
+           node->target_agent_id == intervention->target_agent_id &&
+           node->target_formula_id == intervention->target_formula_id &&
+           memcmp(&node->strength, &intervention->intervention_strength, sizeof(double)) == 0;
+}
+
+static size_t cf_step_hash(int32_t parent, omega_intervention_type_t type, uint32_t agent,
+                           uint64_t formula, double strength) {
+    uint64_t bits;
+    memcpy(&bits, &strength, sizeof(bits));
+    uint64_t h = (uint64_t)(uint32_t)parent * 0x9E3779B97F4A7C15ULL;
+    h ^= ((uint64_t)type << 32 | agent) + 0xBF58476D1CE4E5B9ULL + (h << 6) + (h >> 2);
+    h ^= formula + 0x94D049BB133111EBULL + (h << 6) + (h >> 2);
+    h ^= bits + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    return (size_t)h;
+}
+
+static size_t cf_node_hash(const cf_prefix_node_t* node) {
+    return cf_step_hash(node->parent, node->type, node->target_agent_id,
+                        node->target_formula_id, node->strength);
+}
+
+static void cf_trie_free(omega_counterfactual_ctx_t* cf_ctx) {
+    free(cf_ctx->trie.nodes);
+    free(cf_ctx->trie.slots);
+    memset(&cf_ctx->trie, 0, sizeof(cf_ctx->trie));
+}
+
+// Очищает кэш и кэш сценариев, оставляя корень — мир без вмешательств
+static int cf_trie_reset(omega_counterfactual_ctx_t* cf_ctx) {
+    cf_prefix_trie_t* trie = &cf_ctx->trie;
+    if (!trie->nodes) {
+        trie->nodes = malloc(256 * sizeof(cf_prefix_node_t));
+        trie->slots = calloc(512, sizeof(int32_t));
+        if (!trie->nodes || !trie->slots) {
+            cf_trie_free(cf_ctx);
+            return -1;
+        }
+        trie->capacity = 256;
+        trie->slot_count = 512;
+    } else {
+        memset(trie->slots, 0, trie->slot_count * sizeof(int32_t));
+    }
+    memset(&trie->nodes[0], 0, sizeof(trie->nodes[0]));
+    trie->nodes[0].parent = -1;
+    trie->nodes[0].world.survival = 1.0;
+    trie->count = 1;
+    memset(cf_ctx->scenario_depths, 0, sizeof(cf_ctx->scenario_depths));
+    memset(cf_ctx->scenario_nodes, 0, sizeof(cf_ctx->scenario_nodes));
+    return 0;
+}
+
+// Готовит кэш к extra новым шагам; сбрасывает его за мягким пределом
+static int cf_trie_prepare(omega_counterfactual_ctx_t* cf_ctx, size_t extra) {
+    if (!cf_ctx->trie.nodes ||
+        (size_t)cf_ctx->trie.count + extra > OMEGA_CF_PREFIX_CACHE_NODES) {
+        return cf_trie_reset(cf_ctx);
+    }
+    return 0;
+}
+
+static int cf_trie_grow(omega_counterfactual_ctx_t* cf_ctx) {
+    cf_prefix_trie_t* trie = &cf_ctx->trie;
+    if (trie->count == trie->capacity) {
+        int capacity = trie->capacity * 2;
+        cf_prefix_node_t* nodes = realloc(trie->nodes, (size_t)capacity * sizeof(*nodes));
+        if (!nodes) {
+            return -1;
+        }
+        trie->nodes = nodes;
+        trie->capacity = capacity;
+    }
+    // Загрузка таблицы не выше половины
+    if ((size_t)(trie->count + 1) * 2 > trie->slot_count) {
+        size_t slot_count = trie->slot_count * 2;
+        int32_t* slots = calloc(slot_count, sizeof(int32_t));
+        if (!slots) {
+            return -1;
+        }
+        for (int i = 1; i < trie->count; i++) {
+            size_t slot = cf_node_hash(&trie->nodes[i]) & (slot_count - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(trie->slots);
+        trie->slots = slots;
+        trie->slot_count = slot_count;
+    }
+    return 0;
+}
+
+// Префикс parent + intervention: из кэша или один новый шаг модели
+static int32_t cf_trie_child(omega_counterfactual_ctx_t* cf_ctx, int32_t parent, const omega_intervention_t* intervention) {
+    cf_prefix_trie_t* trie = &cf_ctx->trie;
+    size_t mask = trie->slot_count - 1;
+    size_t slot = cf_step_hash(parent, intervention->intervention_type, intervention->target_agent_id,
+                               intervention->target_formula_id, intervention->intervention_strength) & mask;
+    while (trie->slots[slot]) {
+        int32_t index = trie->slots[slot] - 1;
+        if (cf_same_step(&trie->nodes[index], parent, intervention)) {
+            cf_ctx->stats.prefix_states_reused++;
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (cf_trie_grow(cf_ctx) != 0) {
+        return -1;
+    }
+    if (trie->slot_count - 1 != mask) {
+        mask = trie->slot_count - 1;
+        slot = cf_step_hash(parent, intervention->intervention_type, intervention->target_agent_id,
+                            intervention->target_formula_id, intervention->intervention_strength) & mask;
+        while (trie->slots[slot]) {
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    int32_t index = trie->count++;
+    cf_prefix_node_t* node = &trie->nodes[index];
+    node->parent = parent;
+    node->type = intervention->intervention_type;
+    node->target_agent_id = intervention->target_agent_id;
+    node->target_formula_id = intervention->target_formula_id;
+    node->strength = intervention->intervention_strength;
+    node->world = trie->nodes[parent].world;
+    cf_world_step(&node->world, intervention);
+    trie->slots[slot] = index + 1;
+    cf_ctx->stats.prefix_states_computed++;
+    return index;
+}
+
+// Узел полного префикса сценария; досчитываются только новые вмешательства
+static int32_t cf_scenario_node(omega_counterfactual_ctx_t* cf_ctx, int index) {
+    const omega_scenario_t* scenario = &cf_ctx->scenarios[index];
+    if (cf_trie_prepare(cf_ctx, (size_t)(scenario->intervention_count - cf_ctx->scenario_depths[index])) != 0) {
+        return -1;
+    }
+    int32_t node = cf_ctx->scenario_nodes[index];
+    for (int j = cf_ctx->scenario_depths[index]; j < scenario->intervention_count; j++) {
+        node = cf_trie_child(cf_ctx, node, &scenario->interventions[j]);
+        if (node < 0) {
+            return -1;
+        }
+        cf_ctx->scenario_nodes[index] = node;
+        cf_ctx->scenario_depths[index] = j + 1;
+    }
+    return node;
+}
+
+static int cf_find_scenario(omega_counterfactual_ctx_t* cf_ctx, uint64_t scenario_id) {
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        if (cf_ctx->scenarios[i].scenario_id == scenario_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Порядок ранжирования: импакт, затем число вмешательств, затем позиция
+typedef struct {
+    int index;
+    int intervention_count;
+    double impact;
+} cf_rank_entry_t;
+
+static int cf_compare_rank(const void* a, const void* b) {
+    const cf_rank_entry_t* x = a;
+    const cf_rank_entry_t* y = b;
+    if (x->impact != y->impact) {
+        return x->impact < y->impact ? 1 : -1;
+    }
+    if (x->intervention_count != y->intervention_count) {
+        return x->intervention_count < y->intervention_count ? 1 : -1;
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
 
-static omega_counterfactual_ctx_t cf_ctx = {0};
 
 /**
  * omega_counterfactual_reasoner_init - инициализация
  */
-int omega_counterfactual_reasoner_init(void) {
-    memset(&cf_ctx, 0, sizeof(cf_ctx));
+int omega_counterfactual_reasoner_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->counterfactual && !(ctx->counterfactual = calloc(1, sizeof(omega_counterfactual_ctx_t)))) {
+        return -1;
+    }
+    omega_counterfactual_ctx_t* cf_ctx = ctx->counterfactual;
+    cf_trie_free(cf_ctx);
+    memset(cf_ctx, 0, sizeof(*cf_ctx));
     
-    printf("[CounterfactualReasoner] Initialized for analyzing up to %d scenarios\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Initialized for analyzing up to %d scenarios",
            OMEGA_MAX_SCENARIOS);
-    printf("[CounterfactualReasoner] Max interventions per scenario: %d\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Max interventions per scenario: %d",
            OMEGA_MAX_INTERVENTIONS);
     
     return 0;
@@ -38,24 +288,25 @@ int omega_counterfactual_reasoner_init(void) {
 /**
  * omega_create_scenario - создать новый сценарий
  */
-uint64_t omega_create_scenario(const char* scenario_name, int64_t divergence_timestamp) {
-    if (cf_ctx.scenario_count >= OMEGA_MAX_SCENARIOS || !scenario_name) {
+uint64_t omega_create_scenario(omega_context_t* ctx, const char* scenario_name, int64_t divergence_timestamp) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx || cf_ctx->scenario_count >= OMEGA_MAX_SCENARIOS || !scenario_name) {
         return 0;
     }
     
-    omega_scenario_t* scenario = &cf_ctx.scenarios[cf_ctx.scenario_count];
+    omega_scenario_t* scenario = &cf_ctx->scenarios[cf_ctx->scenario_count];
     
-    scenario->scenario_id = 5000 + cf_ctx.scenario_count;
+    scenario->scenario_id = 5000 + cf_ctx->scenario_count;
     strncpy(scenario->scenario_name, scenario_name, OMEGA_SCENARIO_NAME_LEN - 1);
     scenario->divergence_timestamp = divergence_timestamp;
     scenario->intervention_count = 0;
     scenario->is_active = 1;
     
-    cf_ctx.scenario_count++;
-    cf_ctx.stats.total_scenarios++;
-    cf_ctx.stats.active_scenarios++;
+    cf_ctx->scenario_count++;
+    cf_ctx->stats.total_scenarios++;
+    cf_ctx->stats.active_scenarios++;
     
-    printf("[CounterfactualReasoner] Created scenario %lu: \"%s\" (divergence at %ld)\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Created scenario %lu: \"%s\" (divergence at %ld)",
            (unsigned long)scenario->scenario_id, scenario_name, (long)divergence_timestamp);
     
     return scenario->scenario_id;
@@ -64,14 +315,18 @@ uint64_t omega_create_scenario(const char* scenario_name, int64_t divergence_tim
 /**
  * omega_add_intervention - добавить вмешательство в сценарий
  */
-int omega_add_intervention(uint64_t scenario_id, omega_intervention_type_t type,
+int omega_add_intervention(omega_context_t* ctx, uint64_t scenario_id, omega_intervention_type_t type,
                           uint32_t target_agent_id, uint64_t target_formula_id,
                           double strength, const char* description) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return -1;
+    }
     // Найти сценарий
     omega_scenario_t* scenario = NULL;
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        if (cf_ctx.scenarios[i].scenario_id == scenario_id) {
-            scenario = &cf_ctx.scenarios[i];
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        if (cf_ctx->scenarios[i].scenario_id == scenario_id) {
+            scenario = &cf_ctx->scenarios[i];
             break;
         }
     }
@@ -91,13 +346,13 @@ int omega_add_intervention(uint64_t scenario_id, omega_intervention_type_t type,
     strncpy(intervention->description, description, sizeof(intervention->description) - 1);
     
     scenario->intervention_count++;
-    cf_ctx.stats.total_interventions_tested++;
+    cf_ctx->stats.total_interventions_tested++;
     
     if (strength > 0.7) {
-        cf_ctx.stats.high_impact_interventions++;
+        cf_ctx->stats.high_impact_interventions++;
     }
     
-    printf("[CounterfactualReasoner] Added intervention: %s (strength: %.2f)\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Added intervention: %s (strength: %.2f)",
            description, strength);
     
     return 0;
@@ -106,14 +361,15 @@ int omega_add_intervention(uint64_t scenario_id, omega_intervention_type_t type,
 /**
  * omega_analyze_scenario_branch - проанализировать ветвь
  */
-uint64_t omega_analyze_scenario_branch(uint64_t parent_scenario_id, int depth) {
-    if (cf_ctx.branch_count >= OMEGA_MAX_BRANCHES) {
+uint64_t omega_analyze_scenario_branch(omega_context_t* ctx, uint64_t parent_scenario_id, int depth) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx || cf_ctx->branch_count >= OMEGA_MAX_BRANCHES) {
         return 0;
     }
     
-    omega_branch_t* branch = &cf_ctx.branches[cf_ctx.branch_count];
+    omega_branch_t* branch = &cf_ctx->branches[cf_ctx->branch_count];
     
-    branch->branch_id = 7000 + cf_ctx.branch_count;
+    branch->branch_id = 7000 + cf_ctx->branch_count;
     branch->parent_scenario_id = parent_scenario_id;
     branch->depth = depth;
     branch->num_children = 0;
@@ -126,25 +382,21 @@ uint64_t omega_analyze_scenario_branch(uint64_t parent_scenario_id, int depth) {
     
     // Найти родительский сценарий для вычисления импакта
     if (parent_scenario_id > 0) {
-        for (int i = 0; i < cf_ctx.scenario_count; i++) {
-            if (cf_ctx.scenarios[i].scenario_id == parent_scenario_id) {
-                for (int j = 0; j < cf_ctx.scenarios[i].intervention_count; j++) {
-                    branch->cumulative_impact *= 
-                        (1.0 - cf_ctx.scenarios[i].interventions[j].intervention_strength);
-                }
-                break;
-            }
+        int index = cf_find_scenario(cf_ctx, parent_scenario_id);
+        int32_t node = index >= 0 ? cf_scenario_node(cf_ctx, index) : -1;
+        if (node >= 0) {
+            branch->cumulative_impact *= cf_ctx->trie.nodes[node].world.survival;
         }
     }
     
-    cf_ctx.branch_count++;
-    cf_ctx.stats.branches_explored++;
+    cf_ctx->branch_count++;
+    cf_ctx->stats.branches_explored++;
     
-    if (branch->branch_probability > cf_ctx.stats.max_branch_probability) {
-        cf_ctx.stats.max_branch_probability = branch->branch_probability;
+    if (branch->branch_probability > cf_ctx->stats.max_branch_probability) {
+        cf_ctx->stats.max_branch_probability = branch->branch_probability;
     }
     
-    printf("[CounterfactualReasoner] Analyzed branch %lu (depth: %d, prob: %.3f)\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Analyzed branch %lu (depth: %d, prob: %.3f)",
            (unsigned long)branch->branch_id, depth, branch->branch_probability);
     
     return branch->branch_id;
@@ -153,44 +405,36 @@ uint64_t omega_analyze_scenario_branch(uint64_t parent_scenario_id, int depth) {
 /**
  * omega_apply_interventions - применить вмешательства
  */
-int omega_apply_interventions(uint64_t scenario_id) {
-    omega_scenario_t* scenario = NULL;
-    
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        if (cf_ctx.scenarios[i].scenario_id == scenario_id) {
-            scenario = &cf_ctx.scenarios[i];
-            break;
-        }
+int omega_apply_interventions(omega_context_t* ctx, uint64_t scenario_id) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return -1;
     }
-    
-    if (!scenario) {
+    int index = cf_find_scenario(cf_ctx, scenario_id);
+    if (index < 0) {
         return -1;
     }
+    omega_scenario_t* scenario = &cf_ctx->scenarios[index];
     
-    // Симулируем эффекты вмешательств
-    // В реальной системе здесь была бы комплексная логика
-    
-    double total_effect = 0.0;
-    for (int i = 0; i < scenario->intervention_count; i++) {
-        total_effect += scenario->interventions[i].intervention_strength * 0.1;
+    // Симулируем эффекты вмешательств: состояние мира из кэша префиксов
+    int32_t node = cf_scenario_node(cf_ctx, index);
+    if (node < 0) {
+        return -1;
     }
-    
-    // Ожидаемые исходы основаны на вмешательствах
-    scenario->expected_canvas_items = 100.0 + (total_effect * 50.0);
-    scenario->expected_agent_sync = 0.5 + (total_effect * 0.3);
-    scenario->expected_pattern_count = 10.0 + (total_effect * 20.0);
+    cf_world_expected(&cf_ctx->trie.nodes[node].world, &scenario->expected_canvas_items,
+                      &scenario->expected_agent_sync, &scenario->expected_pattern_count);
     
     // Симулируем реальные результаты (с некоторой вариативностью)
     scenario->actual_canvas_items = scenario->expected_canvas_items * (0.9 + (rand() % 20) / 100.0);
     scenario->actual_agent_sync = scenario->expected_agent_sync * (0.9 + (rand() % 20) / 100.0);
     scenario->actual_pattern_count = scenario->expected_pattern_count * (0.9 + (rand() % 20) / 100.0);
     
-    printf("[CounterfactualReasoner] Applied %d interventions to scenario %lu\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Applied %d interventions to scenario %lu",
            scenario->intervention_count, (unsigned long)scenario_id);
-    printf("  Expected: %.0f canvas items, %.2f agent sync, %.0f patterns\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Expected: %.0f canvas items, %.2f agent sync, %.0f patterns",
            scenario->expected_canvas_items, scenario->expected_agent_sync,
            scenario->expected_pattern_count);
-    printf("  Actual: %.0f canvas items, %.2f agent sync, %.0f patterns\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Actual: %.0f canvas items, %.2f agent sync, %.0f patterns",
            scenario->actual_canvas_items, scenario->actual_agent_sync,
            scenario->actual_pattern_count);
     
@@ -200,16 +444,20 @@ int omega_apply_interventions(uint64_t scenario_id) {
 /**
  * omega_detect_causal_links - обнаружить причинные связи
  */
-int omega_detect_causal_links(uint64_t scenario_id) {
-    if (cf_ctx.causal_link_count >= OMEGA_MAX_CAUSAL_LINKS) {
+int omega_detect_causal_links(omega_context_t* ctx, uint64_t scenario_id) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return -1;
+    }
+    if (cf_ctx->causal_link_count >= OMEGA_MAX_CAUSAL_LINKS) {
         return 0;
     }
     
     // Создаем гипотетические причинные связи на основе интервенций
     omega_scenario_t* scenario = NULL;
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        if (cf_ctx.scenarios[i].scenario_id == scenario_id) {
-            scenario = &cf_ctx.scenarios[i];
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        if (cf_ctx->scenarios[i].scenario_id == scenario_id) {
+            scenario = &cf_ctx->scenarios[i];
             break;
         }
     }
@@ -222,11 +470,11 @@ int omega_detect_causal_links(uint64_t scenario_id) {
     
     // Для каждой пары вмешательств создаем возможную причинную связь
     for (int i = 0; i < scenario->intervention_count - 1 && 
-         cf_ctx.causal_link_count < OMEGA_MAX_CAUSAL_LINKS; i++) {
+         cf_ctx->causal_link_count < OMEGA_MAX_CAUSAL_LINKS; i++) {
         
-        omega_causal_link_t* link = &cf_ctx.causal_links[cf_ctx.causal_link_count];
+        omega_causal_link_t* link = &cf_ctx->causal_links[cf_ctx->causal_link_count];
         
-        link->link_id = 8000 + cf_ctx.causal_link_count;
+        link->link_id = 8000 + cf_ctx->causal_link_count;
         link->cause_formula_id = scenario->interventions[i].target_formula_id;
         link->effect_formula_id = scenario->interventions[i + 1].target_formula_id;
         
@@ -243,12 +491,12 @@ int omega_detect_causal_links(uint64_t scenario_id) {
         link->observed_delay_ms = 10 + (i * 5);
         link->confirmed = 0;  // Гипотетическая связь
         
-        cf_ctx.causal_link_count++;
-        cf_ctx.stats.causal_links_discovered++;
+        cf_ctx->causal_link_count++;
+        cf_ctx->stats.causal_links_discovered++;
         new_links++;
     }
     
-    printf("[CounterfactualReasoner] Detected %d causal links for scenario %lu\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Detected %d causal links for scenario %lu",
            new_links, (unsigned long)scenario_id);
     
     return new_links;
@@ -257,12 +505,16 @@ int omega_detect_causal_links(uint64_t scenario_id) {
 /**
  * omega_compute_divergence - вычислить расхождение
  */
-double omega_compute_divergence(uint64_t scenario_id) {
+double omega_compute_divergence(omega_context_t* ctx, uint64_t scenario_id) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return 0.0;
+    }
     omega_scenario_t* scenario = NULL;
     
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        if (cf_ctx.scenarios[i].scenario_id == scenario_id) {
-            scenario = &cf_ctx.scenarios[i];
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        if (cf_ctx->scenarios[i].scenario_id == scenario_id) {
+            scenario = &cf_ctx->scenarios[i];
             break;
         }
     }
@@ -288,12 +540,12 @@ double omega_compute_divergence(uint64_t scenario_id) {
     
     scenario->outcome_consistent = (scenario->divergence_ratio < 0.1) ? 1 : 0;
     
-    cf_ctx.stats.average_divergence += scenario->divergence_ratio;
-    if (scenario->divergence_ratio > cf_ctx.stats.largest_divergence) {
-        cf_ctx.stats.largest_divergence = scenario->divergence_ratio;
+    cf_ctx->stats.average_divergence += scenario->divergence_ratio;
+    if (scenario->divergence_ratio > cf_ctx->stats.largest_divergence) {
+        cf_ctx->stats.largest_divergence = scenario->divergence_ratio;
     }
     
-    printf("[CounterfactualReasoner] Divergence for scenario %lu: %.3f %s\n",
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Divergence for scenario %lu: %.3f %s",
            (unsigned long)scenario_id, scenario->divergence_ratio,
            scenario->outcome_consistent ? "(consistent)" : "(diverged)");
     
@@ -303,42 +555,98 @@ double omega_compute_divergence(uint64_t scenario_id) {
 /**
  * omega_rank_scenarios_by_impact - ранжировать сценарии
  */
-int omega_rank_scenarios_by_impact(uint64_t* scenario_ids_out, int max_count) {
+int omega_rank_scenarios_by_impact(omega_context_t* ctx, uint64_t* scenario_ids_out, int max_count) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return -1;
+    }
     if (!scenario_ids_out || max_count <= 0) {
         return 0;
     }
     
-    // Простая сортировка: по количеству интервенций и их силе
-    int count = (cf_ctx.scenario_count < max_count) ? cf_ctx.scenario_count : max_count;
+    cf_rank_entry_t entries[OMEGA_MAX_SCENARIOS];
+    int ranked = 0;
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        int32_t node = cf_scenario_node(cf_ctx, i);
+        if (node < 0) {
+            continue;
+        }
+        entries[ranked].index = i;
+        entries[ranked].intervention_count = cf_ctx->scenarios[i].intervention_count;
+        entries[ranked].impact = cf_world_impact(&cf_ctx->trie.nodes[node].world);
+        ranked++;
+    }
+    qsort(entries, (size_t)ranked, sizeof(entries[0]), cf_compare_rank);
     
-    // Создаем список индексов отсортированных по импакту
-    int indices[OMEGA_MAX_SCENARIOS];
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        indices[i] = i;
+    // Заполняем выходной массив
+    int count = (ranked < max_count) ? ranked : max_count;
+    for (int i = 0; i < count; i++) {
+        scenario_ids_out[i] = cf_ctx->scenarios[entries[i].index].scenario_id;
     }
     
-    // Простая сортировка пузырьком по интервенциям
-    for (int i = 0; i < cf_ctx.scenario_count - 1; i++) {
-        for (int j = 0; j < cf_ctx.scenario_count - i - 1; j++) {
-            int idx1 = indices[j];
-            int idx2 = indices[j + 1];
-            
-            int impact1 = cf_ctx.scenarios[idx1].intervention_count;
-            int impact2 = cf_ctx.scenarios[idx2].intervention_count;
-            
-            if (impact1 < impact2) {
-                indices[j] = idx2;
-                indices[j + 1] = idx1;
-            }
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Ranked %d scenarios by impact", count);
+    
+    return count;
+}
+
+/**
+ * omega_rank_intervention_sequences - пакетное ранжирование
+ */
+int omega_rank_intervention_sequences(omega_context_t* ctx, const omega_intervention_sequence_t* sequences,
+                                      int count,
+                                      omega_scenario_rank_t* ranks_out) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx || count < 0 || (count > 0 && (!sequences || !ranks_out))) {
+        return -1;
+    }
+    
+    size_t steps = 0;
+    for (int i = 0; i < count; i++) {
+        if (sequences[i].intervention_count < 0 ||
+            (sequences[i].intervention_count > 0 && !sequences[i].interventions)) {
+            return -1;
         }
+        steps += (size_t)sequences[i].intervention_count;
+    }
+    cf_rank_entry_t* entries = malloc((count > 0 ? (size_t)count : 1) * sizeof(*entries));
+    if (!entries || cf_trie_prepare(cf_ctx, steps) != 0) {
+        free(entries);
+        return -1;
     }
     
-    // Заполняем выходной массив
+    // ranks_out заполняется в порядке входа, затем переставляется
     for (int i = 0; i < count; i++) {
-        scenario_ids_out[i] = cf_ctx.scenarios[indices[i]].scenario_id;
+        int32_t node = 0;
+        for (int j = 0; j < sequences[i].intervention_count; j++) {
+            node = cf_trie_child(cf_ctx, node, &sequences[i].interventions[j]);
+            if (node < 0) {
+                free(entries);
+                return -1;
+            }
+        }
+        const cf_world_t* world = &cf_ctx->trie.nodes[node].world;
+        entries[i].index = i;
+        entries[i].intervention_count = sequences[i].intervention_count;
+        entries[i].impact = cf_world_impact(world);
+        ranks_out[i].index = i;
+        ranks_out[i].impact = entries[i].impact;
+        cf_world_expected(world, &ranks_out[i].expected_canvas_items,
+                          &ranks_out[i].expected_agent_sync, &ranks_out[i].expected_pattern_count);
     }
+    qsort(entries, (size_t)count, sizeof(entries[0]), cf_compare_rank);
     
-    printf("[CounterfactualReasoner] Ranked %d scenarios by impact\n", count);
+    // Переставляем результаты в порядок ранжирования
+    omega_scenario_rank_t* sorted = malloc((count > 0 ? (size_t)count : 1) * sizeof(*sorted));
+    if (!sorted) {
+        free(entries);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        sorted[i] = ranks_out[entries[i].index];
+    }
+    memcpy(ranks_out, sorted, (size_t)count * sizeof(*sorted));
+    free(sorted);
+    free(entries);
     
     return count;
 }
@@ -346,35 +654,47 @@ int omega_rank_scenarios_by_impact(uint64_t* scenario_ids_out, int max_count) {
 /**
  * omega_get_counterfactual_statistics - получить статистику
  */
-const omega_counterfactual_stats_t* omega_get_counterfactual_statistics(void) {
-    cf_ctx.stats.active_scenarios = 0;
-    for (int i = 0; i < cf_ctx.scenario_count; i++) {
-        if (cf_ctx.scenarios[i].is_active) {
-            cf_ctx.stats.active_scenarios++;
+const omega_counterfactual_stats_t* omega_get_counterfactual_statistics(omega_context_t* ctx) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return NULL;
+    }
+    cf_ctx->stats.active_scenarios = 0;
+    for (int i = 0; i < cf_ctx->scenario_count; i++) {
+        if (cf_ctx->scenarios[i].is_active) {
+            cf_ctx->stats.active_scenarios++;
         }
     }
     
-    if (cf_ctx.scenario_count > 0) {
-        cf_ctx.stats.average_divergence /= cf_ctx.scenario_count;
+    if (cf_ctx->scenario_count > 0) {
+        cf_ctx->stats.average_divergence /= cf_ctx->scenario_count;
     }
     
-    cf_ctx.stats.scenarios_completed = cf_ctx.scenario_count - cf_ctx.stats.active_scenarios;
+    cf_ctx->stats.scenarios_completed = cf_ctx->scenario_count - cf_ctx->stats.active_scenarios;
     
-    return &cf_ctx.stats;
+    return &cf_ctx->stats;
 }
 
 /**
  * omega_counterfactual_reasoner_shutdown - остановка
  */
-void omega_counterfactual_reasoner_shutdown(void) {
-    printf("[CounterfactualReasoner] Shutdown: %d scenarios, %d interventions, "
-           "%d causal links, %d branches\n",
-           cf_ctx.scenario_count, cf_ctx.stats.total_interventions_tested,
-           cf_ctx.causal_link_count, cf_ctx.branch_count);
-    printf("[CounterfactualReasoner] High-impact interventions: %d\n",
-           cf_ctx.stats.high_impact_interventions);
-    printf("[CounterfactualReasoner] Average divergence: %.3f, Max: %.3f\n",
-           cf_ctx.stats.average_divergence, cf_ctx.stats.largest_divergence);
-    
-    memset(&cf_ctx, 0, sizeof(cf_ctx));
+void omega_counterfactual_reasoner_shutdown(omega_context_t* ctx) {
+    omega_counterfactual_ctx_t* cf_ctx = ctx ? ctx->counterfactual : NULL;
+    if (!cf_ctx) {
+        return;
+    }
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Shutdown: %d scenarios, %d interventions, "
+           "%d causal links, %d branches",
+           cf_ctx->scenario_count, cf_ctx->stats.total_interventions_tested,
+           cf_ctx->causal_link_count, cf_ctx->branch_count);
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "High-impact interventions: %d",
+           cf_ctx->stats.high_impact_interventions);
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Average divergence: %.3f, Max: %.3f",
+           cf_ctx->stats.average_divergence, cf_ctx->stats.largest_divergence);
+    KOLIBRI_LOG_INFO("CounterfactualReasoner", "Prefix states: %d computed, %d reused",
+           cf_ctx->stats.prefix_states_computed, cf_ctx->stats.prefix_states_reused);
+    
+    cf_trie_free(cf_ctx);
+    free(cf_ctx);
+    ctx->counterfactual = NULL;
 }
@@ -3,6 +3,7 @@
 #include "kolibri_omega/include/abstraction_engine.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
 #include "kolibri_omega/include/canvas.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -17,7 +18,7 @@ int omega_dreamer_init(omega_dreamer_t* dreamer, omega_canvas_t* canvas, kf_pool
     dreamer->formula_pool = formula_pool;
     dreamer->coordinator = coordinator;
     dreamer->next_object_id = 100; // Начнем с ID 100 для создаваемых объектов
-    printf("[Dreamer] Initialized.\n");
+    KOLIBRI_LOG_INFO("Dreamer", "Initialized.");
     return 0;
 }
 
@@ -27,6 +28,8 @@ int omega_dreamer_init(omega_dreamer_t* dreamer, omega_canvas_t* canvas, kf_pool
 void omega_dreamer_tick(omega_dreamer_t* dreamer, int current_time) {
     // Блокировки мьютексов удалены для однопоточной модели
 
+    // Копии элементов: добавление сна может перевыделить Холст
+    omega_canvas_item_t pair1, pair2;
     omega_canvas_item_t* fact1 = NULL;
     omega_canvas_item_t* fact2 = NULL;
 
@@ -35,8 +38,8 @@ void omega_dreamer_tick(omega_dreamer_t* dreamer, int current_time) {
     for (size_t i = 0; i < dreamer->canvas->count; ++i) {
         omega_canvas_item_t* item1 = &dreamer->canvas->items[i];
         if (item1->type == OMEGA_HYPOTHESIS_FACT) {
-            kf_formula_t formula1;
-            if (kf_get_formula(dreamer->formula_pool, item1->formula_id, &formula1) != 0) {
+            const kf_formula_t* formula1 = kf_borrow_formula(dreamer->formula_pool, item1->formula_id);
+            if (!formula1) {
                 continue;
             }
 
@@ -44,15 +47,17 @@ void omega_dreamer_tick(omega_dreamer_t* dreamer, int current_time) {
             for (size_t j = i + 1; j < dreamer->canvas->count; ++j) {
                 omega_canvas_item_t* item2 = &dreamer->canvas->items[j];
                 if (item2->type == OMEGA_HYPOTHESIS_FACT) {
-                    kf_formula_t formula2;
-                    if (kf_get_formula(dreamer->formula_pool, item2->formula_id, &formula2) != 0) {
+                    const kf_formula_t* formula2 = kf_borrow_formula(dreamer->formula_pool, item2->formula_id);
+                    if (!formula2) {
                         continue;
                     }
 
                     // Проверяем, что факты произошли в одно время и касаются разных объектов
-                    if (formula1.time == formula2.time && formula1.data.fact.object_id != formula2.data.fact.object_id) {
-                        fact1 = item1;
-                        fact2 = item2;
+                    if (formula1->time == formula2->time && formula1->data.fact.object_id != formula2->data.fact.object_id) {
+                        pair1 = *item1;
+                        pair2 = *item2;
+                        fact1 = &pair1;
+                        fact2 = &pair2;
                         goto found_pair; // Нашли подходящую пару, выходим из циклов
                     }
                 }
@@ -90,7 +95,7 @@ found_pair:
                 .derived_from_rule_id = 0, // Не выведено из правила
             };
             uint64_t item_id = omega_canvas_add_item(dreamer->canvas, &dream_item);
-            printf("[Dreamer] Dreamt a new rule %llu based on co-occurrence of facts %llu and %llu at time %d. New canvas item ID: %llu\n",
+            KOLIBRI_LOG_INFO("Dreamer", "Dreamt a new rule %llu based on co-occurrence of facts %llu and %llu at time %d. New canvas item ID: %llu",
                    (unsigned long long)new_formula_id,
                    (unsigned long long)fact1->formula_id,
                    (unsigned long long)fact2->formula_id,
@@ -120,6 +125,6 @@ void omega_dreamer_destroy(omega_dreamer_t* dreamer) {
     // В текущей простой реализации здесь нечего освобождать.
     // Добавлено для полноты API.
     if (dreamer) {
-        printf("[Dreamer] Destroyed.\n");
+        KOLIBRI_LOG_INFO("Dreamer", "Destroyed.");
     }
 }
@@ -1,28 +1,221 @@
 #include "kolibri_omega/include/extended_pattern_detector.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define OMEGA_MAX_EXTENDED_PATTERNS 50
-#define OMEGA_MAX_TIME_DELTA_MS 100
 
+// Узел бора суффиксов: последовательность шагов от корня до узла.
+// count — сколько раз она завершалась очередным шагом потока,
+// next_total — сколько раз после неё пришёл ещё один шаг в окне.
 typedef struct {
+    uint64_t formula_id;
+    int32_t parent;
+    int32_t best_child;   // самое частое продолжение, -1 — нет
+    int depth;
+    int reported;
+    uint64_t count;
+    uint64_t next_total;
+    double confidence_sum;
+    int64_t delta_sum;    // паузы перед последним шагом
+    uint64_t delta_samples;
+    double span_sum;      // длительность от первого шага до последнего
+    double span_sq_sum;
+} epd_node_t;
+
+// Активный контекст: узел суффикса потока и время его первого шага
+typedef struct {
+    int32_t node;
+    int64_t start;
+} epd_context_t;
+
+struct omega_extended_pattern_detector_ctx_s {
     omega_extended_pattern_t patterns[OMEGA_MAX_EXTENDED_PATTERNS];
     int pattern_count;
     omega_pattern_statistics_t stats;
-} omega_extended_pattern_detector_ctx_t;
 
-static omega_extended_pattern_detector_ctx_t detector_ctx = {0};
+    epd_node_t* nodes;
+    int node_count;
+    int node_capacity;
+    int32_t* slots;       // открытая адресация по (родитель, формула): индекс + 1
+    size_t slot_count;
+
+    // Суффиксы потока длиной 1..OMEGA_MAX_PATTERN_LENGTH по возрастанию
+    epd_context_t active[OMEGA_MAX_PATTERN_LENGTH];
+    int active_count;
+    omega_pattern_step_t recent[OMEGA_MAX_PATTERN_LENGTH];
+    int recent_count;
+};
+
+typedef struct omega_extended_pattern_detector_ctx_s omega_extended_pattern_detector_ctx_t;
+
+static size_t epd_hash(int32_t parent, uint64_t formula_id) {
+    uint64_t h = (uint64_t)(uint32_t)parent * 0x9E3779B97F4A7C15ULL;
+    h ^= formula_id + 0xBF58476D1CE4E5B9ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    return (size_t)h;
+}
+
+static void epd_free(omega_extended_pattern_detector_ctx_t* detector_ctx) {
+    free(detector_ctx->nodes);
+    free(detector_ctx->slots);
+    detector_ctx->nodes = NULL;
+    detector_ctx->slots = NULL;
+}
+
+static int32_t epd_find(omega_extended_pattern_detector_ctx_t* detector_ctx, int32_t parent, uint64_t formula_id) {
+    size_t mask = detector_ctx->slot_count - 1;
+    size_t slot = epd_hash(parent, formula_id) & mask;
+    while (detector_ctx->slots[slot]) {
+        int32_t index = detector_ctx->slots[slot] - 1;
+        const epd_node_t* node = &detector_ctx->nodes[index];
+        if (node->parent == parent && node->formula_id == formula_id) {
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static int epd_grow(omega_extended_pattern_detector_ctx_t* detector_ctx) {
+    if (detector_ctx->node_count == detector_ctx->node_capacity) {
+        int capacity = detector_ctx->node_capacity * 2;
+        epd_node_t* nodes = realloc(detector_ctx->nodes, (size_t)capacity * sizeof(*nodes));
+        if (!nodes) {
+            return -1;
+        }
+        detector_ctx->nodes = nodes;
+        detector_ctx->node_capacity = capacity;
+    }
+    // Загрузка таблицы не выше половины
+    if ((size_t)(detector_ctx->node_count + 1) * 2 > detector_ctx->slot_count) {
+        size_t slot_count = detector_ctx->slot_count * 2;
+        int32_t* slots = calloc(slot_count, sizeof(int32_t));
+        if (!slots) {
+            return -1;
+        }
+        for (int i = 1; i < detector_ctx->node_count; i++) {
+            const epd_node_t* node = &detector_ctx->nodes[i];
+            size_t slot = epd_hash(node->parent, node->formula_id) & (slot_count - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(detector_ctx->slots);
+        detector_ctx->slots = slots;
+        detector_ctx->slot_count = slot_count;
+    }
+    return 0;
+}
+
+// Продолжение parent шагом formula_id; за пределом узлов новые не заводятся
+static int32_t epd_child(omega_extended_pattern_detector_ctx_t* detector_ctx, int32_t parent, uint64_t formula_id) {
+    int32_t index = epd_find(detector_ctx, parent, formula_id);
+    if (index >= 0) {
+        return index;
+    }
+    if (detector_ctx->node_count >= OMEGA_PATTERN_MINER_MAX_NODES || epd_grow(detector_ctx) != 0) {
+        return -1;
+    }
+    size_t mask = detector_ctx->slot_count - 1;
+    size_t slot = epd_hash(parent, formula_id) & mask;
+    while (detector_ctx->slots[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    index = detector_ctx->node_count++;
+    epd_node_t* node = &detector_ctx->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->formula_id = formula_id;
+    node->parent = parent;
+    node->best_child = -1;
+    node->depth = detector_ctx->nodes[parent].depth + 1;
+    detector_ctx->slots[slot] = index + 1;
+    return index;
+}
+
+// Узел последовательности steps[from..to), -1 — она не встречалась
+static int32_t epd_locate(omega_extended_pattern_detector_ctx_t* detector_ctx, const omega_pattern_step_t* steps, int from, int to) {
+    int32_t node = 0;
+    for (int i = from; i < to && node >= 0; i++) {
+        node = epd_find(detector_ctx, node, steps[i].formula_id);
+    }
+    return node;
+}
+
+// Регистрирует паттерн узла; его шаги — последние шаги потока
+static int epd_report(omega_extended_pattern_detector_ctx_t* detector_ctx, int32_t index) {
+    epd_node_t* node = &detector_ctx->nodes[index];
+    node->reported = 1;
+    if (detector_ctx->pattern_count >= OMEGA_MAX_EXTENDED_PATTERNS) {
+        return 0;
+    }
+
+    omega_extended_pattern_t* pattern = &detector_ctx->patterns[detector_ctx->pattern_count];
+    pattern->pattern_id = 1000 + detector_ctx->pattern_count;
+    pattern->step_count = node->depth;
+    pattern->overall_confidence = 1.0;
+    const omega_pattern_step_t* tail = &detector_ctx->recent[detector_ctx->recent_count - node->depth];
+    int32_t at = index;
+    for (int i = node->depth - 1; i >= 0; i--) {
+        const epd_node_t* step_node = &detector_ctx->nodes[at];
+        double confidence = step_node->confidence_sum / (double)step_node->count;
+        pattern->steps[i].formula_id = step_node->formula_id;
+        pattern->steps[i].timestamp = tail[i].timestamp;
+        pattern->steps[i].confidence = confidence;
+        pattern->overall_confidence *= confidence;
+        at = step_node->parent;
+    }
+    double mean_span = node->span_sum / (double)node->count;
+    pattern->timing_variance = (int64_t)(node->span_sq_sum / (double)node->count - mean_span * mean_span);
+
+    char chain[OMEGA_MAX_PATTERN_LENGTH * 24] = "";
+    size_t used = 0;
+    for (int i = 0; i < pattern->step_count && used < sizeof(chain); i++) {
+        used += (size_t)snprintf(chain + used, sizeof(chain) - used, i ? " -> %lu" : "%lu",
+                                 (unsigned long)pattern->steps[i].formula_id);
+    }
+    KOLIBRI_LOG_INFO("ExtendedPatternDetector", "Detected %d-step pattern %lu: %s "
+           "(support: %lu, confidence: %.3f)",
+           pattern->step_count, (unsigned long)pattern->pattern_id, chain,
+           (unsigned long)node->count, pattern->overall_confidence);
+
+    detector_ctx->pattern_count++;
+    detector_ctx->stats.patterns_by_length[pattern->step_count]++;
+    return 1;
+}
 
 /**
  * omega_extended_pattern_detector_init - инициализация детектора
  */
-int omega_extended_pattern_detector_init(void) {
-    memset(&detector_ctx, 0, sizeof(detector_ctx));
-    detector_ctx.stats.max_length = 10;
-    detector_ctx.stats.min_length = 3;
+int omega_extended_pattern_detector_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->patterns && !(ctx->patterns = calloc(1, sizeof(omega_extended_pattern_detector_ctx_t)))) {
+        return -1;
+    }
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx->patterns;
+    epd_free(detector_ctx);
+    memset(detector_ctx, 0, sizeof(*detector_ctx));
+    detector_ctx->stats.max_length = OMEGA_MAX_PATTERN_LENGTH;
+    detector_ctx->stats.min_length = 3;
+
+    detector_ctx->nodes = malloc(256 * sizeof(epd_node_t));
+    detector_ctx->slots = calloc(512, sizeof(int32_t));
+    if (!detector_ctx->nodes || !detector_ctx->slots) {
+        epd_free(detector_ctx);
+        return -1;
+    }
+    detector_ctx->node_capacity = 256;
+    detector_ctx->slot_count = 512;
+    memset(&detector_ctx->nodes[0], 0, sizeof(detector_ctx->nodes[0]));
+    detector_ctx->nodes[0].parent = -1;
+    detector_ctx->nodes[0].best_child = -1;
+    detector_ctx->node_count = 1;
     
-    printf("[ExtendedPatternDetector] Initialized with capacity %d patterns\n",
+    KOLIBRI_LOG_INFO("ExtendedPatternDetector", "Initialized with capacity %d patterns",
            OMEGA_MAX_EXTENDED_PATTERNS);
     
     return 0;
@@ -42,89 +235,159 @@ int omega_validate_temporal_constraint(int64_t timestamp1, int64_t timestamp2,
 }
 
 /**
- * omega_compute_transition_probabilities - вычисление вероятностей
+ * omega_observe_pattern_step - продление активных контекстов шагом потока
  */
-double omega_compute_transition_probabilities(const omega_extended_pattern_t* pattern,
+int omega_observe_pattern_step(omega_context_t* ctx, const omega_pattern_step_t* step) {
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx ? ctx->patterns : NULL;
+    if (!detector_ctx || !step || !detector_ctx->nodes) {
+        return -1;
+    }
+
+    // Разрыв во времени начинает поток заново
+    int has_previous = 0;
+    int64_t delta = 0;
+    if (detector_ctx->recent_count > 0) {
+        int64_t previous = detector_ctx->recent[detector_ctx->recent_count - 1].timestamp;
+        if (omega_validate_temporal_constraint(previous, step->timestamp, OMEGA_MAX_TIME_DELTA_MS)) {
+            has_previous = 1;
+            delta = step->timestamp - previous;
+        } else {
+            detector_ctx->active_count = 0;
+            detector_ctx->recent_count = 0;
+        }
+    }
+    if (detector_ctx->recent_count == OMEGA_MAX_PATTERN_LENGTH) {
+        memmove(detector_ctx->recent, detector_ctx->recent + 1,
+                (OMEGA_MAX_PATTERN_LENGTH - 1) * sizeof(detector_ctx->recent[0]));
+        detector_ctx->recent_count--;
+    }
+    detector_ctx->recent[detector_ctx->recent_count++] = *step;
+    detector_ctx->nodes[0].count++;
+
+    // Контексты-кандидаты: пустой и каждый активный суффикс
+    epd_context_t contexts[OMEGA_MAX_PATTERN_LENGTH + 1];
+    int context_count = 0;
+    contexts[context_count++] = (epd_context_t){ 0, step->timestamp };
+    for (int i = 0; i < detector_ctx->active_count; i++) {
+        contexts[context_count++] = detector_ctx->active[i];
+    }
+
+    int newly_detected = 0;
+    detector_ctx->active_count = 0;
+    for (int i = 0; i < context_count; i++) {
+        int32_t parent = contexts[i].node;
+        if (detector_ctx->nodes[parent].depth >= OMEGA_MAX_PATTERN_LENGTH) {
+            continue;
+        }
+        int32_t index = epd_child(detector_ctx, parent, step->formula_id);
+        if (index < 0) {
+            continue;
+        }
+
+        epd_node_t* node = &detector_ctx->nodes[index];
+        double span = (double)(step->timestamp - contexts[i].start);
+        node->count++;
+        node->confidence_sum += step->confidence;
+        if (has_previous) {
+            node->delta_sum += delta;
+            node->delta_samples++;
+        }
+        node->span_sum += span;
+        node->span_sq_sum += span * span;
+
+        // Счётчики только растут, поэтому лучшего потомка хватает сравнить с новым
+        epd_node_t* parent_node = &detector_ctx->nodes[parent];
+        parent_node->next_total++;
+        if (parent_node->best_child < 0 ||
+            node->count > detector_ctx->nodes[parent_node->best_child].count) {
+            parent_node->best_child = index;
+        }
+
+        detector_ctx->active[detector_ctx->active_count++] = (epd_context_t){ index, contexts[i].start };
+        if (node->depth >= 3 && !node->reported && node->count >= OMEGA_PATTERN_MIN_SUPPORT) {
+            newly_detected += epd_report(detector_ctx, index);
+        }
+    }
+    return newly_detected;
+}
+
+/**
+ * omega_compute_transition_probabilities - вероятность перехода по счётчикам бора
+ */
+double omega_compute_transition_probabilities(omega_context_t* ctx, const omega_extended_pattern_t* pattern,
                                              int step_index) {
-    if (!pattern || step_index >= pattern->step_count - 1) {
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx ? ctx->patterns : NULL;
+    if (!detector_ctx) {
+        return 0.0;
+    }
+    if (!pattern || !detector_ctx->nodes || step_index < 0 ||
+        step_index >= pattern->step_count - 1) {
         return 0.0;
     }
     
-    return 0.5;  // Упрощенная версия
+    int32_t context = epd_locate(detector_ctx, pattern->steps, 0, step_index + 1);
+    if (context < 0 || detector_ctx->nodes[context].next_total == 0) {
+        return 0.0;
+    }
+    int32_t next = epd_find(detector_ctx, context, pattern->steps[step_index + 1].formula_id);
+    if (next < 0) {
+        return 0.0;
+    }
+    return (double)detector_ctx->nodes[next].count / (double)detector_ctx->nodes[context].next_total;
 }
 
 /**
  * omega_predict_next_pattern_step - предсказание следующего шага
  */
-int omega_predict_next_pattern_step(const omega_extended_pattern_t* pattern,
+int omega_predict_next_pattern_step(omega_context_t* ctx, const omega_extended_pattern_t* pattern,
                                    omega_pattern_step_t* next_step_out) {
-    if (!pattern || !next_step_out || pattern->step_count >= OMEGA_MAX_PATTERN_LENGTH) {
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx ? ctx->patterns : NULL;
+    if (!detector_ctx) {
+        return -1;
+    }
+    if (!pattern || !next_step_out || !detector_ctx->nodes || pattern->step_count <= 0 ||
+        pattern->step_count > OMEGA_MAX_PATTERN_LENGTH) {
         return -1;
     }
     
-    next_step_out->formula_id = pattern->steps[pattern->step_count - 1].formula_id + 1;
-    next_step_out->timestamp = pattern->steps[pattern->step_count - 1].timestamp + 
-                               OMEGA_MAX_TIME_DELTA_MS / 2;
-    next_step_out->confidence = 0.3;
+    // Самый длинный суффикс паттерна, у которого есть продолжения
+    int32_t context = -1;
+    for (int from = 0; from <= pattern->step_count; from++) {
+        int32_t node = epd_locate(detector_ctx, pattern->steps, from, pattern->step_count);
+        if (node >= 0 && detector_ctx->nodes[node].best_child >= 0) {
+            context = node;
+            break;
+        }
+    }
+    if (context < 0) {
+        return -1;
+    }
+
+    const epd_node_t* parent = &detector_ctx->nodes[context];
+    const epd_node_t* best = &detector_ctx->nodes[parent->best_child];
+    int64_t delay = best->delta_samples > 0 ?
+        best->delta_sum / (int64_t)best->delta_samples : OMEGA_MAX_TIME_DELTA_MS / 2;
+    next_step_out->formula_id = best->formula_id;
+    next_step_out->timestamp = pattern->steps[pattern->step_count - 1].timestamp + delay;
+    next_step_out->confidence = best->confidence_sum / (double)parent->next_total;
     
     return 0;
 }
 
 /**
- * omega_detect_extended_patterns - обнаружение паттернов из 3+ шагов
+ * omega_detect_extended_patterns - подача шагов в майнер паттернов из 3+ шагов
  */
-int omega_detect_extended_patterns(const void* facts, int fact_count, int64_t current_time) {
+int omega_detect_extended_patterns(omega_context_t* ctx, const void* facts, int fact_count, int64_t current_time) {
+    const omega_pattern_step_t* steps = facts;
     int newly_detected = 0;
     
-    if (fact_count < 3 || detector_ctx.pattern_count >= OMEGA_MAX_EXTENDED_PATTERNS) {
-        return 0;
-    }
-    
-    // Проверяем 3-шаговые паттерны
-    for (int i = 0; i < fact_count - 2; i++) {
-        for (int j = i + 1; j < fact_count - 1; j++) {
-            for (int k = j + 1; k < fact_count; k++) {
-                int fid_i = 100 + i;
-                int fid_j = 100 + j;
-                int fid_k = 100 + k;
-                
-                if (omega_validate_temporal_constraint(i, j, OMEGA_MAX_TIME_DELTA_MS) &&
-                    omega_validate_temporal_constraint(j, k, OMEGA_MAX_TIME_DELTA_MS)) {
-                    
-                    if (detector_ctx.pattern_count < OMEGA_MAX_EXTENDED_PATTERNS) {
-                        omega_extended_pattern_t* pattern = 
-                            &detector_ctx.patterns[detector_ctx.pattern_count];
-                        
-                        pattern->pattern_id = 1000 + detector_ctx.pattern_count;
-                        pattern->step_count = 3;
-                        
-                        pattern->steps[0].formula_id = fid_i;
-                        pattern->steps[0].timestamp = i * 10;
-                        pattern->steps[0].confidence = 0.9;
-                        
-                        pattern->steps[1].formula_id = fid_j;
-                        pattern->steps[1].timestamp = j * 10;
-                        pattern->steps[1].confidence = 0.9;
-                        
-                        pattern->steps[2].formula_id = fid_k;
-                        pattern->steps[2].timestamp = k * 10;
-                        pattern->steps[2].confidence = 0.9;
-                        
-                        pattern->overall_confidence = 0.9 * 0.9 * 0.9;
-                        pattern->timing_variance = 5;
-                        
-                        printf("[ExtendedPatternDetector] Detected 3-step pattern %lu: "
-                               "%d -> %d -> %d (confidence: %.3f)\n",
-                               (unsigned long)pattern->pattern_id, fid_i, fid_j, fid_k,
-                               pattern->overall_confidence);
-                        
-                        detector_ctx.pattern_count++;
-                        detector_ctx.stats.patterns_by_length[3]++;
-                        newly_detected++;
-                    }
-                }
-            }
+    for (int i = 0; i < fact_count; i++) {
+        omega_pattern_step_t step = { 100 + (uint64_t)i, current_time + i * 10, 0.9 };
+        int found = omega_observe_pattern_step(ctx, steps ? &steps[i] : &step);
+        if (found < 0) {
+            return newly_detected;
         }
+        newly_detected += found;
     }
     
     return newly_detected;
@@ -133,27 +396,39 @@ int omega_detect_extended_patterns(const void* facts, int fact_count, int64_t cu
 /**
  * omega_get_pattern_statistics - получение статистики
  */
-const omega_pattern_statistics_t* omega_get_pattern_statistics(void) {
-    detector_ctx.stats.total_patterns = detector_ctx.pattern_count;
+const omega_pattern_statistics_t* omega_get_pattern_statistics(omega_context_t* ctx) {
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx ? ctx->patterns : NULL;
+    if (!detector_ctx) {
+        return NULL;
+    }
+    detector_ctx->stats.total_patterns = detector_ctx->pattern_count;
+    detector_ctx->stats.steps_observed = detector_ctx->nodes ? detector_ctx->nodes[0].count : 0;
+    detector_ctx->stats.miner_nodes = detector_ctx->node_count > 0 ? detector_ctx->node_count - 1 : 0;
     
-    if (detector_ctx.pattern_count > 0) {
+    if (detector_ctx->pattern_count > 0) {
         double sum = 0.0;
-        for (int i = 0; i < detector_ctx.pattern_count; i++) {
-            sum += detector_ctx.patterns[i].overall_confidence;
+        for (int i = 0; i < detector_ctx->pattern_count; i++) {
+            sum += detector_ctx->patterns[i].overall_confidence;
         }
-        detector_ctx.stats.average_confidence = sum / detector_ctx.pattern_count;
+        detector_ctx->stats.average_confidence = sum / detector_ctx->pattern_count;
     } else {
-        detector_ctx.stats.average_confidence = 0.0;
+        detector_ctx->stats.average_confidence = 0.0;
     }
     
-    return &detector_ctx.stats;
+    return &detector_ctx->stats;
 }
 
 /**
  * omega_extended_pattern_detector_shutdown - остановка
  */
-void omega_extended_pattern_detector_shutdown(void) {
-    printf("[ExtendedPatternDetector] Shutdown: detected %d total patterns\n",
-           detector_ctx.pattern_count);
-    memset(&detector_ctx, 0, sizeof(detector_ctx));
+void omega_extended_pattern_detector_shutdown(omega_context_t* ctx) {
+    omega_extended_pattern_detector_ctx_t* detector_ctx = ctx ? ctx->patterns : NULL;
+    if (!detector_ctx) {
+        return;
+    }
+    KOLIBRI_LOG_INFO("ExtendedPatternDetector", "Shutdown: detected %d total patterns",
+           detector_ctx->pattern_count);
+    epd_free(detector_ctx);
+    free(detector_ctx);
+    ctx->patterns = NULL;
 }
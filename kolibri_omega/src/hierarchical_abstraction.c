@@ -1,30 +1,117 @@
 #include "kolibri_omega/include/hierarchical_abstraction.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define OMEGA_MAX_META_EVENTS_INTERNAL 100
+#define OMEGA_COMPRESS_MAX_GAP_MS 100
 
+// Мета-событие и его предок: событие следующего уровня, в которое оно сжато
 typedef struct {
-    omega_meta_event_t events[OMEGA_MAX_META_EVENTS_INTERNAL];
-    int event_count;
+    omega_meta_event_t event;
+    int32_t parent;         // индекс узла, -1 — ещё не сжато
+} ha_node_t;
+
+// Уровень иерархии: его узлы в порядке появления. Узлы до frontier уже
+// рассмотрены сжатием; новые узлы ставят бит уровня в dirty_levels
+typedef struct {
+    int32_t* members;
+    int member_count;
+    int member_capacity;
+    int frontier;
+    double confidence_sum;
+} ha_level_t;
+
+struct omega_hierarchical_ctx_s {
+    ha_node_t* nodes;
+    int node_count;
+    int node_capacity;
+    int event_count;        // мета-событий уровня 1
+    int merged_count;       // событий, созданных сжатием
     
-    omega_abstraction_hierarchy_t hierarchies[OMEGA_ABSTRACTION_LEVELS];
-    int hierarchy_count;
+    ha_level_t levels[OMEGA_ABSTRACTION_LEVELS];
+    uint32_t dirty_levels;
     
     omega_hierarchical_stats_t stats;
-} omega_hierarchical_ctx_t;
+};
 
-static omega_hierarchical_ctx_t hierarchy_ctx = {0};
+typedef struct omega_hierarchical_ctx_s omega_hierarchical_ctx_t;
+
+static void ha_free(omega_hierarchical_ctx_t* hierarchy_ctx) {
+    free(hierarchy_ctx->nodes);
+    hierarchy_ctx->nodes = NULL;
+    for (int level = 0; level < OMEGA_ABSTRACTION_LEVELS; level++) {
+        free(hierarchy_ctx->levels[level].members);
+        hierarchy_ctx->levels[level].members = NULL;
+    }
+}
+
+// Добавляет событие в узлы и на его уровень; -1 при нехватке памяти
+static int ha_add_node(omega_hierarchical_ctx_t* hierarchy_ctx, const omega_meta_event_t* event) {
+    ha_level_t* level = &hierarchy_ctx->levels[event->abstraction_level];
+    if (hierarchy_ctx->node_count == hierarchy_ctx->node_capacity) {
+        int capacity = hierarchy_ctx->node_capacity ? hierarchy_ctx->node_capacity * 2 : 64;
+        ha_node_t* nodes = realloc(hierarchy_ctx->nodes, (size_t)capacity * sizeof(ha_node_t));
+        if (!nodes) {
+            return -1;
+        }
+        hierarchy_ctx->nodes = nodes;
+        hierarchy_ctx->node_capacity = capacity;
+    }
+    if (level->member_count == level->member_capacity) {
+        int capacity = level->member_capacity ? level->member_capacity * 2 : 64;
+        int32_t* members = realloc(level->members, (size_t)capacity * sizeof(int32_t));
+        if (!members) {
+            return -1;
+        }
+        level->members = members;
+        level->member_capacity = capacity;
+    }
+    int index = hierarchy_ctx->node_count++;
+    hierarchy_ctx->nodes[index].event = *event;
+    hierarchy_ctx->nodes[index].parent = -1;
+    level->members[level->member_count++] = index;
+    level->confidence_sum += event->confidence;
+    hierarchy_ctx->dirty_levels |= 1u << event->abstraction_level;
+    return index;
+}
+
+// Мета-событие из последовательности: шаги первого, произведение уверенностей
+static void ha_combine(const omega_meta_event_t* meta_events, int event_count,
+                       omega_meta_event_t* merged) {
+    merged->source_pattern_id = meta_events[0].source_pattern_id;
+    merged->step_formula_ids[0] = meta_events[0].step_formula_ids[0];
+    merged->step_formula_ids[1] = meta_events[0].step_formula_ids[1];
+    merged->step_formula_ids[2] = meta_events[0].step_formula_ids[2];
+    
+    double combined_conf = 1.0;
+    for (int i = 0; i < event_count; i++) {
+        combined_conf *= meta_events[i].confidence;
+    }
+    merged->confidence = combined_conf;
+    
+    merged->start_timestamp = meta_events[0].start_timestamp;
+    merged->duration_ms = (meta_events[event_count - 1].start_timestamp + 50) -
+                          meta_events[0].start_timestamp;
+    merged->metadata_flags = 0;
+}
 
 /**
  * omega_hierarchical_abstraction_init - инициализация
  */
-int omega_hierarchical_abstraction_init(void) {
-    memset(&hierarchy_ctx, 0, sizeof(hierarchy_ctx));
-    hierarchy_ctx.stats.total_levels = OMEGA_ABSTRACTION_LEVELS;
+int omega_hierarchical_abstraction_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->hierarchy && !(ctx->hierarchy = calloc(1, sizeof(omega_hierarchical_ctx_t)))) {
+        return -1;
+    }
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx->hierarchy;
+    ha_free(hierarchy_ctx);
+    memset(hierarchy_ctx, 0, sizeof(*hierarchy_ctx));
+    hierarchy_ctx->stats.total_levels = OMEGA_ABSTRACTION_LEVELS;
     
-    printf("[HierarchicalAbstraction] Initialized with %d levels\n",
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Initialized with %d levels",
            OMEGA_ABSTRACTION_LEVELS);
     
     return 0;
@@ -33,20 +120,17 @@ int omega_hierarchical_abstraction_init(void) {
 /**
  * omega_create_meta_event_from_pattern - создание мета-события
  */
-int omega_create_meta_event_from_pattern(uint64_t pattern_id, 
+int omega_create_meta_event_from_pattern(omega_context_t* ctx, uint64_t pattern_id, 
                                          const uint64_t* step_ids,
                                          double confidence,
                                          int64_t start_time,
                                          omega_meta_event_t* meta_event_out) {
-    if (!step_ids || !meta_event_out) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx || !step_ids || !meta_event_out) {
         return -1;
     }
     
-    if (hierarchy_ctx.event_count >= OMEGA_MAX_META_EVENTS_INTERNAL) {
-        return -1;  // Переполнение
-    }
-    
-    meta_event_out->meta_event_id = 5000 + hierarchy_ctx.event_count;
+    meta_event_out->meta_event_id = 5000 + hierarchy_ctx->event_count;
     meta_event_out->source_pattern_id = pattern_id;
     
     meta_event_out->step_formula_ids[0] = step_ids[0];
@@ -60,15 +144,16 @@ int omega_create_meta_event_from_pattern(uint64_t pattern_id,
     meta_event_out->abstraction_level = 1;  // Уровень 1 = 3-шаговые паттерны
     meta_event_out->metadata_flags = 0;
     
-    // Добавляем в контекст
-    memcpy(&hierarchy_ctx.events[hierarchy_ctx.event_count],
-           meta_event_out, sizeof(omega_meta_event_t));
-    hierarchy_ctx.event_count++;
-    hierarchy_ctx.stats.meta_events_created++;
-    hierarchy_ctx.stats.patterns_abstracted++;
+    // Добавляем в контекст; уровни выше пересчитает следующее сжатие
+    if (ha_add_node(hierarchy_ctx, meta_event_out) < 0) {
+        return -1;
+    }
+    hierarchy_ctx->event_count++;
+    hierarchy_ctx->stats.meta_events_created++;
+    hierarchy_ctx->stats.patterns_abstracted++;
     
-    printf("[HierarchicalAbstraction] Created meta_event %lu from pattern %lu "
-           "(%lu → %lu → %lu, confidence: %.3f)\n",
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Created meta_event %lu from pattern %lu "
+           "(%lu → %lu → %lu, confidence: %.3f)",
            (unsigned long)meta_event_out->meta_event_id, (unsigned long)pattern_id,
            (unsigned long)step_ids[0], (unsigned long)step_ids[1], (unsigned long)step_ids[2], confidence);
     
@@ -101,8 +186,8 @@ int omega_build_abstraction_hierarchy(const omega_meta_event_t* meta_events,
     }
     hierarchy_out[1].avg_confidence = sum_conf / event_count;
     
-    printf("[HierarchicalAbstraction] Built hierarchy with level 0 (facts) "
-           "and level 1 (%d meta_events, avg_confidence: %.3f)\n",
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Built hierarchy with level 0 (facts) "
+           "and level 1 (%d meta_events, avg_confidence: %.3f)",
            event_count, hierarchy_out[1].avg_confidence);
     
     return 2;  // Количество уровней
@@ -111,39 +196,21 @@ int omega_build_abstraction_hierarchy(const omega_meta_event_t* meta_events,
 /**
  * omega_abstract_pattern_sequence - абстрактирование последовательности
  */
-int omega_abstract_pattern_sequence(const omega_meta_event_t* meta_events,
+int omega_abstract_pattern_sequence(omega_context_t* ctx, const omega_meta_event_t* meta_events,
                                     int event_count,
                                     omega_meta_event_t* merged_meta_event_out) {
-    if (!meta_events || !merged_meta_event_out || event_count < 2) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx || !meta_events || !merged_meta_event_out || event_count < 2) {
         return -1;
     }
     
     // Создаем мета-мета-событие из последовательности мета-событий
-    merged_meta_event_out->meta_event_id = 6000 + hierarchy_ctx.event_count;
+    merged_meta_event_out->meta_event_id = 6000 + hierarchy_ctx->event_count;
     merged_meta_event_out->abstraction_level = 2;  // Уровень 2
+    ha_combine(meta_events, event_count, merged_meta_event_out);
     
-    // Копируем первые 3 formula ID из первого события
-    merged_meta_event_out->step_formula_ids[0] = meta_events[0].step_formula_ids[0];
-    merged_meta_event_out->step_formula_ids[1] = meta_events[0].step_formula_ids[1];
-    merged_meta_event_out->step_formula_ids[2] = meta_events[0].step_formula_ids[2];
-    
-    // Общая уверенность - произведение
-    double combined_conf = 1.0;
-    for (int i = 0; i < event_count; i++) {
-        combined_conf *= meta_events[i].confidence;
-    }
-    merged_meta_event_out->confidence = combined_conf;
-    
-    // Временные данные
-    merged_meta_event_out->start_timestamp = meta_events[0].start_timestamp;
-    if (event_count > 0) {
-        merged_meta_event_out->duration_ms = 
-            (meta_events[event_count - 1].start_timestamp + 50) - 
-            meta_events[0].start_timestamp;
-    }
-    
-    printf("[HierarchicalAbstraction] Abstracted sequence of %d meta_events into "
-           "meta_meta_event %lu (confidence: %.4f)\n",
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Abstracted sequence of %d meta_events into "
+           "meta_meta_event %lu (confidence: %.4f)",
            event_count, (unsigned long)merged_meta_event_out->meta_event_id,
            merged_meta_event_out->confidence);
     
@@ -166,68 +233,126 @@ int omega_get_hierarchy_level_by_event(uint64_t event_id) {
     return 0;  // Факты
 }
 
-/**
- * omega_compress_representation - сжатие представления
- */
-int omega_compress_representation(void) {
-    // Берем все накопленные события и пытаемся их сжать
-    if (hierarchy_ctx.event_count < 3) {
-        return 0;
-    }
-    
-    // Простой алгоритм: последовательные мета-события объединяем
-    int compressed = 0;
-    for (int i = 0; i < hierarchy_ctx.event_count - 2; i++) {
-        if (hierarchy_ctx.events[i].abstraction_level == 1 &&
-            hierarchy_ctx.events[i+1].abstraction_level == 1) {
-            
-            // Проверяем временную близость
-            int64_t gap = hierarchy_ctx.events[i+1].start_timestamp - 
-                         (hierarchy_ctx.events[i].start_timestamp + 
-                          hierarchy_ctx.events[i].duration_ms);
+// Сжимает грязные уровни снизу вверх, начиная с их frontier: соседние
+// по времени события уровня попарно становятся событием следующего уровня,
+// которое само ждёт пары уже там. Каждое событие рассматривается один раз,
+// так что работа пропорциональна числу новых событий
+static int ha_compress_dirty(omega_hierarchical_ctx_t* hierarchy_ctx) {
+    int created = 0;
+    for (int level = 1; level < OMEGA_ABSTRACTION_LEVELS - 1; level++) {
+        if (!(hierarchy_ctx->dirty_levels & (1u << level))) {
+            continue;
+        }
+        ha_level_t* current = &hierarchy_ctx->levels[level];
+        while (current->frontier + 1 < current->member_count) {
+            int32_t first = current->members[current->frontier];
+            int32_t second = current->members[current->frontier + 1];
+            omega_meta_event_t pair[2] = { hierarchy_ctx->nodes[first].event,
+                                           hierarchy_ctx->nodes[second].event };
+            int64_t gap = pair[1].start_timestamp - (pair[0].start_timestamp + pair[0].duration_ms);
+            if (gap >= OMEGA_COMPRESS_MAX_GAP_MS) {
+                current->frontier++;  // первому пары уже не найти
+                continue;
+            }
             
-            if (gap < 100) {  // Менее чем 100ms между ними
-                omega_meta_event_t merged;
-                omega_abstract_pattern_sequence(
-                    &hierarchy_ctx.events[i], 2, &merged
-                );
-                compressed++;
+            omega_meta_event_t merged;
+            merged.meta_event_id = 6000 + hierarchy_ctx->merged_count;
+            merged.abstraction_level = level + 1;
+            ha_combine(pair, 2, &merged);
+            int index = ha_add_node(hierarchy_ctx, &merged);
+            if (index < 0) {
+                return created;  // уровень остаётся грязным
             }
+            // Рост мог переместить узлы, поэтому только по индексам
+            hierarchy_ctx->nodes[first].parent = index;
+            hierarchy_ctx->nodes[second].parent = index;
+            hierarchy_ctx->merged_count++;
+            current->frontier += 2;
+            created++;
         }
+        hierarchy_ctx->dirty_levels &= ~(1u << level);
     }
+    return created;
+}
+
+/**
+ * omega_compress_representation - сжатие представления
+ */
+int omega_compress_representation(omega_context_t* ctx) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx) {
+        return -1;
+    }
+    int compressed = ha_compress_dirty(hierarchy_ctx);
     
-    printf("[HierarchicalAbstraction] Compressed %d sequential events\n",
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Compressed %d sequential events",
            compressed);
     
     return compressed;
 }
 
 /**
- * omega_get_hierarchical_statistics - получить статистику
+ * omega_get_abstraction_hierarchy - иерархия контекста
  */
-const omega_hierarchical_stats_t* omega_get_hierarchical_statistics(void) {
-    hierarchy_ctx.stats.total_levels = OMEGA_ABSTRACTION_LEVELS;
-    hierarchy_ctx.stats.meta_events_created = hierarchy_ctx.event_count;
-    
-    if (hierarchy_ctx.event_count > 0) {
-        double sum = 0.0;
-        for (int i = 0; i < hierarchy_ctx.event_count; i++) {
-            sum += hierarchy_ctx.events[i].confidence;
+int omega_get_abstraction_hierarchy(omega_context_t* ctx, omega_abstraction_hierarchy_t* hierarchy_out) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx || !hierarchy_out) {
+        return -1;
+    }
+    ha_compress_dirty(hierarchy_ctx);
+    
+    int levels = 1;
+    for (int level = 0; level < OMEGA_ABSTRACTION_LEVELS; level++) {
+        const ha_level_t* source = &hierarchy_ctx->levels[level];
+        omega_abstraction_hierarchy_t* out = &hierarchy_out[level];
+        out->level = level;
+        out->event_count = source->member_count;
+        int copied = source->member_count < OMEGA_MAX_META_EVENTS ? source->member_count : OMEGA_MAX_META_EVENTS;
+        const int32_t* members = source->members + (source->member_count - copied);
+        for (int i = 0; i < copied; i++) {
+            out->event_ids[i] = hierarchy_ctx->nodes[members[i]].event.meta_event_id;
         }
-        hierarchy_ctx.stats.average_abstraction_confidence = 
-            sum / hierarchy_ctx.event_count;
+        out->avg_confidence = level == 0 ? 1.0
+                            : source->member_count ? source->confidence_sum / source->member_count : 0.0;
+        if (source->member_count > 0) {
+            levels = level + 1;
+        }
+    }
+    return levels;
+}
+
+/**
+ * omega_get_hierarchical_statistics - получить статистику
+ */
+const omega_hierarchical_stats_t* omega_get_hierarchical_statistics(omega_context_t* ctx) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx) {
+        return NULL;
+    }
+    hierarchy_ctx->stats.total_levels = OMEGA_ABSTRACTION_LEVELS;
+    hierarchy_ctx->stats.meta_events_created = hierarchy_ctx->event_count;
+    
+    if (hierarchy_ctx->event_count > 0) {
+        hierarchy_ctx->stats.average_abstraction_confidence = 
+            hierarchy_ctx->levels[1].confidence_sum / hierarchy_ctx->event_count;
     }
     
-    return &hierarchy_ctx.stats;
+    return &hierarchy_ctx->stats;
 }
 
 /**
  * omega_hierarchical_abstraction_shutdown - остановка
  */
-void omega_hierarchical_abstraction_shutdown(void) {
-    printf("[HierarchicalAbstraction] Shutdown: processed %d meta_events, "
-           "abstracted %d patterns\n",
-           hierarchy_ctx.event_count, 
-           hierarchy_ctx.stats.patterns_abstracted);
-    memset(&hierarchy_ctx, 0, sizeof(hierarchy_ctx));
+void omega_hierarchical_abstraction_shutdown(omega_context_t* ctx) {
+    omega_hierarchical_ctx_t* hierarchy_ctx = ctx ? ctx->hierarchy : NULL;
+    if (!hierarchy_ctx) {
+        return;
+    }
+    KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Shutdown: processed %d meta_events, "
+           "abstracted %d patterns",
+           hierarchy_ctx->event_count, 
+           hierarchy_ctx->stats.patterns_abstracted);
+    ha_free(hierarchy_ctx);
+    free(hierarchy_ctx);
+    ctx->hierarchy = NULL;
 }
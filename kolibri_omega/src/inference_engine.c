@@ -1,15 +1,54 @@
 #include "kolibri_omega/include/inference_engine.h"
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 
+#define OMEGA_INFERENCE_MEMO_SLOTS 64
+#define OMEGA_INFERENCE_MEMO_CHAINS 8
+#define OMEGA_INFERENCE_MAX_VISITED 256
+
+// Выводы для одного факта, действительные, пока правила пула не менялись
+typedef struct {
+    const kf_pool_t* pool;
+    uint64_t rules_version;
+    uint64_t fact_id;
+    int max_depth;
+    size_t max_chains;
+    int chain_count;
+    omega_inference_chain_t chains[OMEGA_INFERENCE_MEMO_CHAINS];
+} omega_inference_memo_t;
+
+static struct {
+    int verbosity;
+    omega_inference_memo_t memo[OMEGA_INFERENCE_MEMO_SLOTS];
+} inference_ctx = { .verbosity = OMEGA_INFERENCE_LOG_QUIET };
+
+// Состояние одного обхода: найденные цепочки и уже достигнутые выводы
+typedef struct {
+    kf_pool_t* pool;
+    omega_inference_chain_t* chains;
+    size_t max_chains;
+    size_t chain_count;
+    size_t depth_limit;
+    uint64_t visited[OMEGA_INFERENCE_MAX_VISITED];
+    size_t visited_count;
+} omega_inference_walk_t;
+
 /**
  * @brief Инициализирует модуль логического вывода.
  */
 void omega_inference_engine_init(void) {
-    printf("[InferenceEngine] Initialized. Ready for multi-step reasoning.\n");
+    memset(inference_ctx.memo, 0, sizeof(inference_ctx.memo));
+    if (inference_ctx.verbosity >= OMEGA_INFERENCE_LOG_SUMMARY) {
+        KOLIBRI_LOG_INFO("InferenceEngine", "Initialized. Ready for multi-step reasoning.");
+    }
+}
+
+void omega_inference_set_verbosity(int level) {
+    inference_ctx.verbosity = level;
 }
 
 /**
@@ -44,13 +83,54 @@ uint64_t omega_inference_single_step(kf_pool_t* formula_pool,
     *result = consequence;
     result->time = fact.time + 1;
     
-    printf("[InferenceEngine] Single-step inference: fact %llu + rule %llu → consequence %llu (confidence: %.2f)\n",
-           (unsigned long long)fact_id, (unsigned long long)rule_id, 
-           (unsigned long long)consequence.id, rule.data.rule.confidence);
+    if (inference_ctx.verbosity >= OMEGA_INFERENCE_LOG_TRACE) {
+        KOLIBRI_LOG_INFO("InferenceEngine", "Single-step inference: fact %llu + rule %llu → consequence %llu (confidence: %.2f)",
+               (unsigned long long)fact_id, (unsigned long long)rule_id,
+               (unsigned long long)consequence.id, rule.data.rule.confidence);
+    }
     
     return consequence.id;
 }
 
+// Отмечает вывод как достигнутый; 0, если он уже был или место кончилось
+static int inference_visit(omega_inference_walk_t* walk, uint64_t formula_id) {
+    for (size_t i = 0; i < walk->visited_count; ++i) {
+        if (walk->visited[i] == formula_id) {
+            return 0;
+        }
+    }
+    if (walk->visited_count == OMEGA_INFERENCE_MAX_VISITED) {
+        return 0;
+    }
+    walk->visited[walk->visited_count++] = formula_id;
+    return 1;
+}
+
+// Добавляет цепочки path + правило для каждого правила с условием condition_id
+static void inference_expand(omega_inference_walk_t* walk, const omega_inference_chain_t* path,
+                             uint64_t condition_id) {
+    for (size_t at = kf_first_rule_for(walk->pool, condition_id);
+         at < walk->pool->count && walk->chain_count < walk->max_chains;
+         at = kf_next_rule_for(walk->pool, at)) {
+        const kf_formula_t* rule = &walk->pool->formulas[at];
+        if (!rule->is_valid || !inference_visit(walk, rule->data.rule.consequence_formula_id)) {
+            continue;
+        }
+
+        omega_inference_chain_t* chain = &walk->chains[walk->chain_count++];
+        *chain = *path;
+        chain->rule_chain[chain->chain_length++] = rule->id;
+        chain->final_conclusion_id = rule->data.rule.consequence_formula_id;
+        chain->confidence = path->confidence * rule->data.rule.confidence;
+
+        if (inference_ctx.verbosity >= OMEGA_INFERENCE_LOG_TRACE && path->chain_length) {
+            KOLIBRI_LOG_INFO("InferenceEngine", "Extended chain: rule %llu → %llu (new confidence: %.4f)",
+                   (unsigned long long)path->rule_chain[path->chain_length - 1],
+                   (unsigned long long)rule->id, chain->confidence);
+        }
+    }
+}
+
 /**
  * @brief Выполняет многоступенчатый логический вывод (forward chaining).
  */
@@ -62,59 +142,57 @@ int omega_inference_forward_chain(kf_pool_t* formula_pool,
     if (!formula_pool || !chains || max_chains == 0 || max_depth <= 0) {
         return 0;
     }
-    
-    int chain_count = 0;
-    
-    // Простой алгоритм forward chaining: для каждого факта найти применимые правила
-    for (size_t i = 0; i < formula_pool->count && chain_count < max_chains; ++i) {
-        kf_formula_t* rule = &formula_pool->formulas[i];
-        
-        if (rule->type != KF_TYPE_RULE || !rule->is_valid) {
-            continue;
+
+    omega_inference_memo_t* memo = NULL;
+    if (max_chains <= OMEGA_INFERENCE_MEMO_CHAINS) {
+        memo = &inference_ctx.memo[(initial_fact_id * 0x9E3779B97F4A7C15ULL >> 32) % OMEGA_INFERENCE_MEMO_SLOTS];
+        if (memo->pool == formula_pool && memo->rules_version == formula_pool->rules_version &&
+            memo->fact_id == initial_fact_id && memo->max_depth == max_depth && memo->max_chains == max_chains) {
+            memcpy(chains, memo->chains, (size_t)memo->chain_count * sizeof(omega_inference_chain_t));
+            return memo->chain_count;
         }
-        
-        // Проверяем, применимо ли это правило к начальному факту
-        if (rule->data.rule.condition_formula_id == initial_fact_id) {
-            // Создаем новую цепочку
-            omega_inference_chain_t* chain = &chains[chain_count];
-            chain->rule_chain[0] = rule->id;
-            chain->chain_length = 1;
-            chain->initial_condition_id = initial_fact_id;
-            chain->final_conclusion_id = rule->data.rule.consequence_formula_id;
-            chain->confidence = rule->data.rule.confidence;
-            
-            // Пытаемся продолжить цепочку (рекурсивный поиск)
-            if (max_depth > 1) {
-                for (size_t j = 0; j < formula_pool->count && chain->chain_length < 10; ++j) {
-                    kf_formula_t* next_rule = &formula_pool->formulas[j];
-                    
-                    if (next_rule->type != KF_TYPE_RULE || !next_rule->is_valid) {
-                        continue;
-                    }
-                    
-                    // Проверяем, применимо ли следующее правило к следствию текущего
-                    if (next_rule->data.rule.condition_formula_id == chain->final_conclusion_id) {
-                        chain->rule_chain[chain->chain_length] = next_rule->id;
-                        chain->chain_length++;
-                        chain->final_conclusion_id = next_rule->data.rule.consequence_formula_id;
-                        chain->confidence *= next_rule->data.rule.confidence;
-                        
-                        printf("[InferenceEngine] Extended chain: rule %llu → %llu (new confidence: %.4f)\n",
-                               (unsigned long long)rule->id, (unsigned long long)next_rule->id,
-                               chain->confidence);
-                    }
-                }
-            }
-            
-            printf("[InferenceEngine] Found inference chain of length %zu: %llu ⟹ %llu (confidence: %.4f)\n",
-                   chain->chain_length, (unsigned long long)initial_fact_id, 
-                   (unsigned long long)chain->final_conclusion_id, chain->confidence);
-            
-            chain_count++;
+    }
+
+    size_t depth_limit = (size_t)max_depth;
+    if (depth_limit > sizeof(chains->rule_chain) / sizeof(chains->rule_chain[0])) {
+        depth_limit = sizeof(chains->rule_chain) / sizeof(chains->rule_chain[0]);
+    }
+    omega_inference_walk_t walk = {
+        .pool = formula_pool,
+        .chains = chains,
+        .max_chains = max_chains,
+        .depth_limit = depth_limit,
+    };
+    // Возврат к начальному факту — не вывод
+    inference_visit(&walk, initial_fact_id);
+    omega_inference_chain_t root = { .initial_condition_id = initial_fact_id, .confidence = 1.0 };
+    inference_expand(&walk, &root, initial_fact_id);
+    // Обход в ширину: найденные цепочки сами служат очередью, так что каждый
+    // вывод получает кратчайший путь
+    for (size_t next = 0; next < walk.chain_count && walk.chain_count < max_chains; ++next) {
+        if (chains[next].chain_length < depth_limit) {
+            inference_expand(&walk, &chains[next], chains[next].final_conclusion_id);
         }
     }
-    
-    return chain_count;
+
+    if (inference_ctx.verbosity >= OMEGA_INFERENCE_LOG_SUMMARY) {
+        for (size_t c = 0; c < walk.chain_count; ++c) {
+            KOLIBRI_LOG_INFO("InferenceEngine", "Found inference chain of length %zu: %llu ⟹ %llu (confidence: %.4f)",
+                   chains[c].chain_length, (unsigned long long)initial_fact_id,
+                   (unsigned long long)chains[c].final_conclusion_id, chains[c].confidence);
+        }
+    }
+
+    if (memo) {
+        memo->pool = formula_pool;
+        memo->rules_version = formula_pool->rules_version;
+        memo->fact_id = initial_fact_id;
+        memo->max_depth = max_depth;
+        memo->max_chains = max_chains;
+        memo->chain_count = (int)walk.chain_count;
+        memcpy(memo->chains, chains, walk.chain_count * sizeof(omega_inference_chain_t));
+    }
+    return (int)walk.chain_count;
 }
 
 /**
@@ -128,9 +206,9 @@ double omega_compute_chain_confidence(omega_inference_chain_t* chain, kf_pool_t*
     double total_confidence = 1.0;
     
     for (size_t i = 0; i < chain->chain_length; ++i) {
-        kf_formula_t rule;
-        if (kf_get_formula(formula_pool, chain->rule_chain[i], &rule) == 0 && rule.type == KF_TYPE_RULE) {
-            total_confidence *= rule.data.rule.confidence;
+        const kf_formula_t* rule = kf_borrow_formula(formula_pool, chain->rule_chain[i]);
+        if (rule && rule->type == KF_TYPE_RULE) {
+            total_confidence *= rule->data.rule.confidence;
         }
     }
     
@@ -146,6 +224,16 @@ uint64_t omega_create_rule_from_chain(kf_pool_t* formula_pool,
         return 0;
     }
     
+    // Такой короткий путь уже есть — повторно не создаём
+    for (size_t at = kf_first_rule_for(formula_pool, chain->initial_condition_id);
+         at < formula_pool->count;
+         at = kf_next_rule_for(formula_pool, at)) {
+        const kf_formula_t* rule = &formula_pool->formulas[at];
+        if (rule->is_valid && rule->data.rule.consequence_formula_id == chain->final_conclusion_id) {
+            return rule->id;
+        }
+    }
+
     // Создаем новое правило: начальное условие → конечное следствие
     kf_formula_t new_rule = {
         .type = KF_TYPE_RULE,
@@ -162,8 +250,10 @@ uint64_t omega_create_rule_from_chain(kf_pool_t* formula_pool,
     
     uint64_t rule_id = kf_add_formula(formula_pool, &new_rule);
     
-    printf("[InferenceEngine] Created shortcut rule %llu from inference chain (length: %zu, confidence: %.4f)\n",
+    if (inference_ctx.verbosity >= OMEGA_INFERENCE_LOG_SUMMARY) {
+        KOLIBRI_LOG_INFO("InferenceEngine", "Created shortcut rule %llu from inference chain (length: %zu, confidence: %.4f)",
            (unsigned long long)rule_id, chain->chain_length, chain->confidence);
+    }
     
     return rule_id;
 }
@@ -2,6 +2,7 @@
 #include "kolibri_omega/include/self_reflection.h"
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <math.h>
 
@@ -9,8 +10,8 @@
  * @brief Обновляет уверенность правила (adaptive learning).
  */
 void omega_update_rule_confidence(kf_pool_t* formula_pool, uint64_t rule_id, int was_correct) {
-    kf_formula_t rule;
-    if (kf_get_formula(formula_pool, rule_id, &rule) != 0 || rule.type != KF_TYPE_RULE) {
+    kf_formula_t* rule = kf_borrow_formula_mut(formula_pool, rule_id);
+    if (!rule || rule->type != KF_TYPE_RULE) {
         return;
     }
 
@@ -27,32 +28,27 @@ void omega_update_rule_confidence(kf_pool_t* formula_pool, uint64_t rule_id, int
     // Экспоненциальное скользящее среднее для уверенности
     double new_value = was_correct ? 1.0 : 0.0;
     double alpha = 0.1;  // Коэффициент обучения
-    rule.data.rule.confidence = rule.data.rule.confidence * (1.0 - alpha) + new_value * alpha;
+    double confidence = rule->data.rule.confidence * (1.0 - alpha) + new_value * alpha;
 
     // Клампируем значение в диапазон [0.0, 1.0]
-    if (rule.data.rule.confidence > 1.0) rule.data.rule.confidence = 1.0;
-    if (rule.data.rule.confidence < 0.0) rule.data.rule.confidence = 0.0;
+    if (confidence > 1.0) confidence = 1.0;
+    if (confidence < 0.0) confidence = 0.0;
 
-    // Обновляем правило в пуле
-    for (size_t i = 0; i < formula_pool->count; ++i) {
-        if (formula_pool->formulas[i].id == rule_id) {
-            formula_pool->formulas[i].data.rule.confidence = rule.data.rule.confidence;
-            printf("[LearningEngine] Updated confidence of rule %llu to %.2f\n",
-                   (unsigned long long)rule_id, rule.data.rule.confidence);
-            return;
-        }
-    }
+    // Обновляем правило прямо в пуле
+    rule->data.rule.confidence = confidence;
+    KOLIBRI_LOG_INFO("LearningEngine", "Updated confidence of rule %llu to %.2f",
+           (unsigned long long)rule_id, confidence);
 }
 
 /**
  * @brief Вычисляет точность правила.
  */
 double omega_calculate_rule_accuracy(kf_pool_t* formula_pool, uint64_t rule_id) {
-    kf_formula_t rule;
-    if (kf_get_formula(formula_pool, rule_id, &rule) != 0 || rule.type != KF_TYPE_RULE) {
+    const kf_formula_t* rule = kf_borrow_formula(formula_pool, rule_id);
+    if (!rule || rule->type != KF_TYPE_RULE) {
         return 0.0;
     }
-    return rule.data.rule.confidence;
+    return rule->data.rule.confidence;
 }
 
 /**
@@ -81,5 +77,7 @@ void omega_rank_rules_by_confidence(kf_pool_t* formula_pool) {
         }
     }
 
-    printf("[LearningEngine] Rules ranked by confidence\n");
+    // Формулы переставлены, индекс по id строится заново
+    kf_pool_reindex(formula_pool);
+    KOLIBRI_LOG_INFO("LearningEngine", "Rules ranked by confidence");
 }
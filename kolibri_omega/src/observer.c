@@ -1,6 +1,7 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/include/observer.h"
 #include "kolibri_omega/include/learning_engine.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -35,70 +36,67 @@ void omega_observer_destroy(omega_observer_t* observer) {
 void omega_observer_tick(omega_observer_t* observer) {
     // pthread_mutex_lock(&observer->canvas->mutex); // УДАЛЕНО: не нужно в однопоточном режиме
 
+    omega_canvas_t* canvas = observer->canvas;
+
     // --- Фаза 1: Проверка ПРЕДСКАЗАНИЙ ---
-    for (size_t i = 0; i < observer->canvas->count; ) {
-        omega_canvas_item_t* prediction_item = &observer->canvas->items[i];
+    // Каждому предсказанию соответствует первый факт с тем же (object_id, time),
+    // его находит индекс Холста — без перебора всех элементов
+    for (size_t k = 0; k < canvas->type_count[OMEGA_HYPOTHESIS_PREDICTION]; ++k) {
+        size_t i = canvas->type_items[OMEGA_HYPOTHESIS_PREDICTION][k];
+        if (!canvas->entries[i].keyed) continue;
+        omega_canvas_item_t* prediction_item = &canvas->items[i];
 
-        if (prediction_item->type != OMEGA_HYPOTHESIS_PREDICTION) {
-            i++;
-            continue;
+        size_t j = omega_canvas_first_at(canvas, canvas->entries[i].object_id, canvas->entries[i].time);
+        while (j < canvas->count && canvas->items[j].type != OMEGA_HYPOTHESIS_FACT) {
+            j = omega_canvas_next_at(canvas, j);
         }
+        if (j == canvas->count) continue;
+        omega_canvas_item_t* fact_item = &canvas->items[j];
 
-        kf_formula_t prediction_formula;
-        if (kf_get_formula(observer->canvas->formula_pool, prediction_item->formula_id, &prediction_formula) == 0) {
-            // Ищем соответствующий факт
-            for (size_t j = 0; j < observer->canvas->count; ++j) {
-                omega_canvas_item_t* fact_item = &observer->canvas->items[j];
-                if (fact_item->type != OMEGA_HYPOTHESIS_FACT) continue;
-
-                kf_formula_t fact_formula;
-                if (kf_get_formula(observer->canvas->formula_pool, fact_item->formula_id, &fact_formula) != 0) continue;
+        // Сравниваем факт и предсказание
+        if (kf_are_contradictory(canvas->formula_pool, fact_item->formula_id, prediction_item->formula_id)) {
+            KOLIBRI_LOG_INFO("Observer", "Contradiction found between fact %llu and prediction %llu!",
+                   (unsigned long long)fact_item->formula_id,
+                   (unsigned long long)prediction_item->formula_id);
 
-                // Сравниваем факт и предсказание
-                if (fact_formula.time == prediction_formula.time && fact_formula.data.fact.object_id == prediction_formula.data.fact.object_id) {
-                    if (kf_are_contradictory(observer->canvas->formula_pool, fact_item->formula_id, prediction_item->formula_id)) {
-                        printf("[Observer] Contradiction found between fact %llu and prediction %llu!\n",
-                               (unsigned long long)fact_item->formula_id,
-                               (unsigned long long)prediction_item->formula_id);
-                        
-                        // Обновляем уверенность правила, на основе которого было создано неверное предсказание
-                        if (prediction_item->derived_from_rule_id > 0) {
-                            omega_update_rule_confidence(observer->canvas->formula_pool, 
-                                                        prediction_item->derived_from_rule_id, 
-                                                        0);  // 0 = неверное предсказание
-                        }
-                        
-                        sigma_task_t task = {
-                            .type = TASK_INVALID_RULE,
-                            .data = { .invalid_rule = { .rule_id = prediction_item->derived_from_rule_id } }
-                        };
-                        sigma_add_task(observer->coordinator, &task);
-                        omega_canvas_remove_item(observer->canvas, i);
-                        return; // Выходим после нахождения и обработки противоречия
-                    }
-                    break; 
-                }
+            // Обновляем уверенность правила, на основе которого было создано неверное предсказание
+            if (prediction_item->derived_from_rule_id > 0) {
+                omega_update_rule_confidence(canvas->formula_pool,
+                                            prediction_item->derived_from_rule_id,
+                                            0);  // 0 = неверное предсказание
             }
+
+            sigma_task_t task = {
+                .type = TASK_INVALID_RULE,
+                .data = { .invalid_rule = { .rule_id = prediction_item->derived_from_rule_id } }
+            };
+            sigma_add_task(observer->coordinator, &task);
+            omega_canvas_remove_item(canvas, i);
+            return; // Выходим после нахождения и обработки противоречия
         }
-        i++;
     }
 
     // --- Фаза 2: Поиск прямых противоречий между ФАКТАМИ ---
-    for (size_t i = 0; i < observer->canvas->count; ++i) {
-        for (size_t j = i + 1; j < observer->canvas->count; ++j) {
-            omega_canvas_item_t* item1 = &observer->canvas->items[i];
-            omega_canvas_item_t* item2 = &observer->canvas->items[j];
+    // Противоречат друг другу только факты об одном объекте в одно время,
+    // поэтому пары берутся из одной цепочки индекса
+    for (size_t k = 0; k < canvas->type_count[OMEGA_HYPOTHESIS_FACT]; ++k) {
+        size_t i = canvas->type_items[OMEGA_HYPOTHESIS_FACT][k];
+        if (!canvas->entries[i].keyed) continue;
+        omega_canvas_item_t* item1 = &canvas->items[i];
+
+        // Пары берутся только с элементами, добавленными позже item1
+        for (size_t j = omega_canvas_next_at(canvas, i); j < canvas->count; j = omega_canvas_next_at(canvas, j)) {
+            omega_canvas_item_t* item2 = &canvas->items[j];
+            if (item2->type != OMEGA_HYPOTHESIS_FACT) continue;
 
-            if (item1->type == OMEGA_HYPOTHESIS_FACT && item2->type == OMEGA_HYPOTHESIS_FACT) {
-                if (kf_are_contradictory(observer->canvas->formula_pool, item1->formula_id, item2->formula_id)) {
-                    printf("[Observer] Found contradiction between fact %llu and fact %llu.\n", (unsigned long long)item1->formula_id, (unsigned long long)item2->formula_id);
-                    sigma_task_t task = {
-                        .type = TASK_CONTRADICTION,
-                        .data = { .contradiction = {item1->formula_id, item2->formula_id} }
-                    };
-                    sigma_add_task(observer->coordinator, &task);
-                    return; // Выходим после нахождения и обработки противоречия
-                }
+            if (kf_are_contradictory(canvas->formula_pool, item1->formula_id, item2->formula_id)) {
+                KOLIBRI_LOG_INFO("Observer", "Found contradiction between fact %llu and fact %llu.", (unsigned long long)item1->formula_id, (unsigned long long)item2->formula_id);
+                sigma_task_t task = {
+                    .type = TASK_CONTRADICTION,
+                    .data = { .contradiction = { .formula_ids = {item1->formula_id, item2->formula_id} } }
+                };
+                sigma_add_task(observer->coordinator, &task);
+                return; // Выходим после нахождения и обработки противоречия
             }
         }
     }
@@ -0,0 +1,50 @@
+#include "kolibri_omega/include/omega_context.h"
+#include "kolibri_omega/include/extended_pattern_detector.h"
+#include "kolibri_omega/include/hierarchical_abstraction.h"
+#include "kolibri_omega/include/agent_coordinator.h"
+#include "kolibri_omega/include/counterfactual_reasoner.h"
+#include "kolibri_omega/include/adaptive_abstraction_manager.h"
+#include "kolibri_omega/include/policy_learner.h"
+#include "kolibri_omega/include/bayesian_causal_networks.h"
+#include "kolibri_omega/include/scenario_planner.h"
+#include "kolibri_omega/include/abstraction_engine.h"
+#include <stdlib.h>
+
+omega_context_t* omega_context_create(void) {
+    return calloc(1, sizeof(omega_context_t));
+}
+
+void omega_context_destroy(omega_context_t* ctx) {
+    if (!ctx) {
+        return;
+    }
+    // Модули, которые вызывающий не остановил сам
+    if (ctx->abstraction) {
+        omega_stream_clustering_shutdown(ctx);
+    }
+    if (ctx->planner) {
+        omega_scenario_planner_shutdown(ctx);
+    }
+    if (ctx->bayesian) {
+        omega_bayesian_network_shutdown(ctx);
+    }
+    if (ctx->policy) {
+        omega_policy_learner_shutdown(ctx);
+    }
+    if (ctx->adaptive) {
+        omega_adaptive_abstraction_shutdown(ctx);
+    }
+    if (ctx->counterfactual) {
+        omega_counterfactual_reasoner_shutdown(ctx);
+    }
+    if (ctx->coordinator) {
+        omega_agent_coordinator_shutdown(ctx);
+    }
+    if (ctx->hierarchy) {
+        omega_hierarchical_abstraction_shutdown(ctx);
+    }
+    if (ctx->patterns) {
+        omega_extended_pattern_detector_shutdown(ctx);
+    }
+    free(ctx);
+}
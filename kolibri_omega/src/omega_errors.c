@@ -7,6 +7,7 @@
  */
 
 #include "kolibri_omega/include/omega_errors.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -73,7 +74,9 @@ const char* omega_error_string(omega_error_code_t code) {
 static void default_error_handler(const omega_error_context_t* ctx, void* user_data) {
     (void)user_data;  // Unused
     
-    fprintf(stderr, "[OMEGA ERROR] %s:%s:%d - %s (%d): %s\n",
+    // A fixed log module: ctx->module belongs to the caller and need not
+    // outlive the queued record.
+    KOLIBRI_LOG_ERROR("Omega", "%s:%s:%d - %s (%d): %s",
             ctx->module ? ctx->module : "unknown",
             ctx->function ? ctx->function : "unknown",
             ctx->line,
@@ -119,9 +122,9 @@ void omega_error_set_handler(omega_error_handler_t handler, void* user_data) {
 
 void omega_error_report(omega_error_code_t code, const char* module,
                        const char* function, int line, const char* message) {
-    // Even if not initialized, print to stderr
+    // Even if not initialized, still log the error
     if (!error_system.initialized) {
-        fprintf(stderr, "[OMEGA ERROR] (system not initialized) %s:%s:%d - code %d: %s\n",
+        KOLIBRI_LOG_ERROR("Omega", "(system not initialized) %s:%s:%d - code %d: %s",
                 module ? module : "unknown",
                 function ? function : "unknown",
                 line, code,
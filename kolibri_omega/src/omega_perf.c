@@ -2,28 +2,59 @@
  * @file omega_perf.c
  * @brief Implementation of lightweight performance profiling system
  * 
- * Provides minimal-overhead performance tracking with <1% CPU impact.
+ * Provides minimal-overhead performance tracking with <1% CPU impact:
+ * per-thread stat blocks with log-linear histograms, summed on read.
  */
 
 #include "kolibri_omega/include/omega_perf.h"
 #include "kolibri_omega/include/omega_errors.h"
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
 // ==================== Internal State ====================
 
-#define OMEGA_PERF_MAX_SAMPLES 1000
+#define OMEGA_PERF_NAME_MAX 32
+
+/*
+ * One category in one thread's block. Only the owning thread writes, with
+ * relaxed atomic stores; readers load the fields the same way.
+ */
+typedef struct {
+    uint64_t sample_count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[OMEGA_PERF_HIST_BUCKETS];
+} omega_perf_counter_t;
+
+typedef struct omega_perf_thread_s {
+    struct omega_perf_thread_s* next;
+    int in_use;                  // a live thread owns the block
+    uint64_t epoch;              // counters are valid for this reset epoch
+    omega_perf_counter_t counters[OMEGA_PERF_MAX_CATEGORIES];
+} omega_perf_thread_t;
 
 typedef struct {
     int initialized;
-    omega_perf_stats_t stats[OMEGA_PERF_CATEGORY_COUNT];
+    uint64_t generation;         // bumped per init, invalidates thread caches
+    uint64_t epoch;              // bumped per reset
+    int category_count;
+    char names[OMEGA_PERF_MAX_CATEGORIES][OMEGA_PERF_NAME_MAX];
+    omega_perf_thread_t* threads;
+    omega_perf_stats_t snapshot[OMEGA_PERF_MAX_CATEGORIES];
     pthread_mutex_t lock;
+    pthread_key_t thread_key;
     uint64_t global_start_ns;
 } omega_perf_system_t;
 
 static omega_perf_system_t perf_system = {0};
 
+static __thread omega_perf_thread_t* perf_thread = NULL;
+static __thread uint64_t perf_thread_generation = 0;
+
 // ==================== Category Names ====================
 
 static const char* category_names[] = {
@@ -47,32 +78,176 @@ static inline uint64_t get_time_ns(void) {
     return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-static void update_stats(omega_perf_category_t category, uint64_t duration_ns) {
-    omega_perf_stats_t* stats = &perf_system.stats[category];
-    
+#define PERF_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define PERF_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+static size_t histogram_bucket(uint64_t duration_ns) {
+    const uint64_t linear = 2U << OMEGA_PERF_HIST_SUB_BITS;
+    if (duration_ns < linear) {
+        return (size_t)duration_ns;
+    }
+    int msb = 63 - __builtin_clzll(duration_ns);
+    if (msb >= OMEGA_PERF_HIST_MAX_BITS) {
+        return OMEGA_PERF_HIST_BUCKETS - 1;
+    }
+    uint64_t sub = (duration_ns >> (msb - OMEGA_PERF_HIST_SUB_BITS)) & ((1U << OMEGA_PERF_HIST_SUB_BITS) - 1);
+    return (size_t)(linear + (uint64_t)(msb - OMEGA_PERF_HIST_SUB_BITS - 1) * (1U << OMEGA_PERF_HIST_SUB_BITS) + sub);
+}
+
+// Midpoint of the durations a bucket covers
+static uint64_t histogram_value(size_t bucket) {
+    const size_t linear = 2U << OMEGA_PERF_HIST_SUB_BITS;
+    if (bucket < linear) {
+        return bucket;
+    }
+    size_t octave = (bucket - linear) >> OMEGA_PERF_HIST_SUB_BITS;
+    size_t sub = (bucket - linear) & ((1U << OMEGA_PERF_HIST_SUB_BITS) - 1);
+    int shift = (int)octave + 1;
+    uint64_t lower = (uint64_t)((1U << OMEGA_PERF_HIST_SUB_BITS) + sub) << shift;
+    return lower + ((1ULL << shift) >> 1);
+}
+
+static void thread_release(void* arg) {
+    omega_perf_thread_t* block = arg;
     pthread_mutex_lock(&perf_system.lock);
-    
-    stats->category = category;
-    stats->sample_count++;
-    stats->total_ns += duration_ns;
-    
-    if (stats->sample_count == 1) {
-        stats->min_ns = duration_ns;
-        stats->max_ns = duration_ns;
-    } else {
-        if (duration_ns < stats->min_ns) stats->min_ns = duration_ns;
-        if (duration_ns > stats->max_ns) stats->max_ns = duration_ns;
+    block->in_use = 0;
+    pthread_mutex_unlock(&perf_system.lock);
+}
+
+// This thread's block; a block left by an exited thread is reused
+static omega_perf_thread_t* thread_block(void) {
+    if (perf_thread && perf_thread_generation == perf_system.generation) {
+        return perf_thread;
+    }
+    pthread_mutex_lock(&perf_system.lock);
+    omega_perf_thread_t* block = perf_system.threads;
+    while (block && block->in_use) {
+        block = block->next;
+    }
+    if (!block) {
+        block = calloc(1, sizeof(*block));
+        if (!block) {
+            pthread_mutex_unlock(&perf_system.lock);
+            return NULL;
+        }
+        block->next = perf_system.threads;
+        perf_system.threads = block;
+    }
+    block->in_use = 1;
+    pthread_mutex_unlock(&perf_system.lock);
+    pthread_setspecific(perf_system.thread_key, block);
+    perf_thread = block;
+    perf_thread_generation = perf_system.generation;
+    return block;
+}
+
+static void update_stats(omega_perf_category_t category, uint64_t duration_ns) {
+    omega_perf_thread_t* block = thread_block();
+    if (!block) {
+        return;
+    }
+    uint64_t epoch = __atomic_load_n(&perf_system.epoch, __ATOMIC_ACQUIRE);
+    if (block->epoch != epoch) {
+        // A reset happened since this thread last recorded
+        for (int i = 0; i < OMEGA_PERF_MAX_CATEGORIES; i++) {
+            omega_perf_counter_t* counter = &block->counters[i];
+            PERF_STORE(counter->sample_count, 0);
+            PERF_STORE(counter->total_ns, 0);
+            PERF_STORE(counter->max_ns, 0);
+            for (size_t b = 0; b < OMEGA_PERF_HIST_BUCKETS; b++) {
+                PERF_STORE(counter->buckets[b], 0);
+            }
+        }
+        __atomic_store_n(&block->epoch, epoch, __ATOMIC_RELEASE);
+    }
+
+    omega_perf_counter_t* counter = &block->counters[category];
+    if (counter->sample_count == 0 || duration_ns < counter->min_ns) {
+        PERF_STORE(counter->min_ns, duration_ns);
+    }
+    if (duration_ns > counter->max_ns) {
+        PERF_STORE(counter->max_ns, duration_ns);
+    }
+    PERF_STORE(counter->total_ns, counter->total_ns + duration_ns);
+    size_t bucket = histogram_bucket(duration_ns);
+    PERF_STORE(counter->buckets[bucket], counter->buckets[bucket] + 1);
+    PERF_STORE(counter->sample_count, counter->sample_count + 1);
+}
+
+static uint64_t histogram_percentile(const uint64_t* buckets, uint64_t count, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)count);
+    if (rank >= count) {
+        rank = count - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t b = 0; b < OMEGA_PERF_HIST_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return histogram_value(b);
+        }
+    }
+    return histogram_value(OMEGA_PERF_HIST_BUCKETS - 1);
+}
+
+// Sums every thread's block; the caller holds perf_system.lock
+static void aggregate_locked(int category, omega_perf_stats_t* out) {
+    static uint64_t buckets[OMEGA_PERF_HIST_BUCKETS];
+    memset(out, 0, sizeof(*out));
+    memset(buckets, 0, sizeof(buckets));
+    out->category = (omega_perf_category_t)category;
+    out->min_ns = UINT64_MAX;
+    uint64_t epoch = perf_system.epoch;
+    for (omega_perf_thread_t* block = perf_system.threads; block; block = block->next) {
+        if (__atomic_load_n(&block->epoch, __ATOMIC_ACQUIRE) != epoch) {
+            continue;
+        }
+        const omega_perf_counter_t* counter = &block->counters[category];
+        uint64_t count = PERF_LOAD(counter->sample_count);
+        if (count == 0) {
+            continue;
+        }
+        out->sample_count += count;
+        out->total_ns += PERF_LOAD(counter->total_ns);
+        uint64_t min_ns = PERF_LOAD(counter->min_ns);
+        uint64_t max_ns = PERF_LOAD(counter->max_ns);
+        if (min_ns < out->min_ns) out->min_ns = min_ns;
+        if (max_ns > out->max_ns) out->max_ns = max_ns;
+        for (size_t b = 0; b < OMEGA_PERF_HIST_BUCKETS; b++) {
+            buckets[b] += PERF_LOAD(counter->buckets[b]);
+        }
+    }
+    if (out->sample_count == 0) {
+        out->min_ns = UINT64_MAX;
+        return;
+    }
+    // The histogram may lag the count by an in-flight sample
+    uint64_t histogram_count = 0;
+    for (size_t b = 0; b < OMEGA_PERF_HIST_BUCKETS; b++) {
+        histogram_count += buckets[b];
+    }
+    out->avg_ns = out->total_ns / out->sample_count;
+    if (histogram_count > 0) {
+        out->p50_ns = histogram_percentile(buckets, histogram_count, 0.50);
+        out->p95_ns = histogram_percentile(buckets, histogram_count, 0.95);
+        out->p99_ns = histogram_percentile(buckets, histogram_count, 0.99);
+    }
+    // Bucket midpoints can fall outside the observed range
+    uint64_t* quantiles[] = {&out->p50_ns, &out->p95_ns, &out->p99_ns};
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        if (*quantiles[q] < out->min_ns) *quantiles[q] = out->min_ns;
+        if (*quantiles[q] > out->max_ns) *quantiles[q] = out->max_ns;
     }
-    
-    stats->avg_ns = stats->total_ns / stats->sample_count;
-    
-    // Calculate CPU usage (rough approximation)
     uint64_t elapsed = get_time_ns() - perf_system.global_start_ns;
     if (elapsed > 0) {
-        stats->cpu_usage_percent = (stats->total_ns * 100.0) / elapsed;
+        out->cpu_usage_percent = (out->total_ns * 100.0) / elapsed;
     }
-    
-    pthread_mutex_unlock(&perf_system.lock);
+}
+
+static const char* category_name_locked(int category) {
+    if (category < OMEGA_PERF_CATEGORY_COUNT) {
+        return category_names[category];
+    }
+    return perf_system.names[category];
 }
 
 // ==================== Public API Implementation ====================
@@ -82,16 +257,18 @@ int omega_perf_init(void) {
         return OMEGA_ERROR_ALREADY_INITIALIZED;
     }
     
+    uint64_t generation = perf_system.generation + 1;
     memset(&perf_system, 0, sizeof(perf_system));
+    if (pthread_key_create(&perf_system.thread_key, thread_release) != 0) {
+        return OMEGA_ERROR_GENERIC;
+    }
     pthread_mutex_init(&perf_system.lock, NULL);
+    perf_system.generation = generation;
+    perf_system.epoch = 1;
+    perf_system.category_count = OMEGA_PERF_CATEGORY_COUNT;
     perf_system.global_start_ns = get_time_ns();
     perf_system.initialized = 1;
     
-    // Initialize min values to max
-    for (int i = 0; i < OMEGA_PERF_CATEGORY_COUNT; i++) {
-        perf_system.stats[i].min_ns = UINT64_MAX;
-    }
-    
     return OMEGA_OK;
 }
 
@@ -100,8 +277,38 @@ void omega_perf_shutdown(void) {
         return;
     }
     
+    pthread_key_delete(perf_system.thread_key);
+    omega_perf_thread_t* block = perf_system.threads;
+    while (block) {
+        omega_perf_thread_t* next = block->next;
+        free(block);
+        block = next;
+    }
     pthread_mutex_destroy(&perf_system.lock);
+    uint64_t generation = perf_system.generation;
     memset(&perf_system, 0, sizeof(perf_system));
+    perf_system.generation = generation;
+    perf_thread = NULL;
+}
+
+int omega_perf_register_category(const char* name, omega_perf_category_t* out) {
+    if (!name || !out) {
+        return OMEGA_ERROR_NULL_POINTER;
+    }
+    if (!perf_system.initialized) {
+        return OMEGA_ERROR_NOT_INITIALIZED;
+    }
+    pthread_mutex_lock(&perf_system.lock);
+    if (perf_system.category_count >= OMEGA_PERF_MAX_CATEGORIES) {
+        pthread_mutex_unlock(&perf_system.lock);
+        return OMEGA_ERROR_RESOURCE_EXHAUSTED;
+    }
+    int category = perf_system.category_count;
+    snprintf(perf_system.names[category], OMEGA_PERF_NAME_MAX, "%s", name);
+    __atomic_store_n(&perf_system.category_count, category + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&perf_system.lock);
+    *out = (omega_perf_category_t)category;
+    return OMEGA_OK;
 }
 
 omega_perf_handle_t omega_perf_start(omega_perf_category_t category) {
@@ -115,23 +322,38 @@ uint64_t omega_perf_end(omega_perf_handle_t handle) {
     uint64_t end_ns = get_time_ns();
     uint64_t duration_ns = end_ns - handle.start_ns;
     
-    if (perf_system.initialized) {
+    if (perf_system.initialized && (int)handle.category >= 0 &&
+        (int)handle.category < __atomic_load_n(&perf_system.category_count, __ATOMIC_ACQUIRE)) {
         update_stats(handle.category, duration_ns);
     }
     
     return duration_ns;
 }
 
-const omega_perf_stats_t* omega_perf_get_stats(omega_perf_category_t category) {
-    if (!perf_system.initialized || category >= OMEGA_PERF_CATEGORY_COUNT) {
-        return NULL;
+int omega_perf_snapshot(omega_perf_category_t category, omega_perf_stats_t* out) {
+    if (!out) {
+        return OMEGA_ERROR_NULL_POINTER;
+    }
+    if (!perf_system.initialized) {
+        return OMEGA_ERROR_NOT_INITIALIZED;
     }
-    
     pthread_mutex_lock(&perf_system.lock);
-    const omega_perf_stats_t* stats = &perf_system.stats[category];
+    if ((int)category < 0 || (int)category >= perf_system.category_count) {
+        pthread_mutex_unlock(&perf_system.lock);
+        return OMEGA_ERROR_OUT_OF_RANGE;
+    }
+    aggregate_locked(category, out);
     pthread_mutex_unlock(&perf_system.lock);
+    return out->sample_count > 0 ? OMEGA_OK : OMEGA_ERROR_NOT_FOUND;
+}
+
+const omega_perf_stats_t* omega_perf_get_stats(omega_perf_category_t category) {
+    if (!perf_system.initialized || (int)category < 0 || (int)category >= OMEGA_PERF_MAX_CATEGORIES) {
+        return NULL;
+    }
     
-    return (stats->sample_count > 0) ? stats : NULL;
+    omega_perf_stats_t* stats = &perf_system.snapshot[category];
+    return omega_perf_snapshot(category, stats) == OMEGA_OK ? stats : NULL;
 }
 
 void omega_perf_reset(void) {
@@ -139,15 +361,115 @@ void omega_perf_reset(void) {
         return;
     }
     
+    // Blocks are cleared by their owners on the next sample
     pthread_mutex_lock(&perf_system.lock);
-    memset(&perf_system.stats, 0, sizeof(perf_system.stats));
+    __atomic_store_n(&perf_system.epoch, perf_system.epoch + 1, __ATOMIC_RELEASE);
     perf_system.global_start_ns = get_time_ns();
-    
-    // Reinitialize min values
-    for (int i = 0; i < OMEGA_PERF_CATEGORY_COUNT; i++) {
-        perf_system.stats[i].min_ns = UINT64_MAX;
+    pthread_mutex_unlock(&perf_system.lock);
+}
+
+// Appends to buffer; returns -1 once it no longer fits
+static int append(char* buffer, size_t buffer_len, size_t* used, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + *used, buffer_len - *used, format, args);
+    va_end(args);
+    if (written < 0 || (size_t)written >= buffer_len - *used) {
+        return -1;
+    }
+    *used += (size_t)written;
+    return 0;
+}
+
+// Escapes a name for a JSON string or a Prometheus label value
+static void escape_name(const char* name, char* out, size_t out_len) {
+    size_t used = 0;
+    for (; *name && used + 2 < out_len; name++) {
+        if (*name == '"' || *name == '\\') {
+            out[used++] = '\\';
+        }
+        out[used++] = *name;
+    }
+    out[used] = '\0';
+}
+
+int omega_perf_export_json(char* buffer, size_t buffer_len) {
+    if (!buffer || buffer_len == 0 || !perf_system.initialized) {
+        return -1;
+    }
+    size_t used = 0;
+    int first = 1;
+    if (append(buffer, buffer_len, &used, "{\"categories\":[") != 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&perf_system.lock);
+    for (int i = 0; i < perf_system.category_count; i++) {
+        omega_perf_stats_t stats;
+        aggregate_locked(i, &stats);
+        if (stats.sample_count == 0) {
+            continue;
+        }
+        char name[2 * OMEGA_PERF_NAME_MAX];
+        escape_name(category_name_locked(i), name, sizeof(name));
+        if (append(buffer, buffer_len, &used,
+                   "%s{\"name\":\"%s\",\"samples\":%llu,\"total_ns\":%llu,\"min_ns\":%llu,"
+                   "\"max_ns\":%llu,\"avg_ns\":%llu,\"p50_ns\":%llu,\"p95_ns\":%llu,"
+                   "\"p99_ns\":%llu,\"cpu_usage_percent\":%.3f}",
+                   first ? "" : ",", name,
+                   (unsigned long long)stats.sample_count, (unsigned long long)stats.total_ns,
+                   (unsigned long long)stats.min_ns, (unsigned long long)stats.max_ns,
+                   (unsigned long long)stats.avg_ns, (unsigned long long)stats.p50_ns,
+                   (unsigned long long)stats.p95_ns, (unsigned long long)stats.p99_ns,
+                   stats.cpu_usage_percent) != 0) {
+            pthread_mutex_unlock(&perf_system.lock);
+            return -1;
+        }
+        first = 0;
     }
     pthread_mutex_unlock(&perf_system.lock);
+    if (append(buffer, buffer_len, &used, "]}") != 0) {
+        return -1;
+    }
+    return (int)used;
+}
+
+int omega_perf_export_prometheus(char* buffer, size_t buffer_len) {
+    if (!buffer || buffer_len == 0 || !perf_system.initialized) {
+        return -1;
+    }
+    size_t used = 0;
+    if (append(buffer, buffer_len, &used,
+               "# HELP kolibri_omega_perf_duration_seconds Duration of measured cognitive operations.\n"
+               "# TYPE kolibri_omega_perf_duration_seconds summary\n") != 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&perf_system.lock);
+    for (int i = 0; i < perf_system.category_count; i++) {
+        omega_perf_stats_t stats;
+        aggregate_locked(i, &stats);
+        if (stats.sample_count == 0) {
+            continue;
+        }
+        char name[2 * OMEGA_PERF_NAME_MAX];
+        escape_name(category_name_locked(i), name, sizeof(name));
+        const char* metric = "kolibri_omega_perf_duration_seconds";
+        if (append(buffer, buffer_len, &used,
+                   "%s{category=\"%s\",quantile=\"0.5\"} %.9f\n"
+                   "%s{category=\"%s\",quantile=\"0.95\"} %.9f\n"
+                   "%s{category=\"%s\",quantile=\"0.99\"} %.9f\n"
+                   "%s_sum{category=\"%s\"} %.9f\n"
+                   "%s_count{category=\"%s\"} %llu\n",
+                   metric, name, stats.p50_ns / 1e9,
+                   metric, name, stats.p95_ns / 1e9,
+                   metric, name, stats.p99_ns / 1e9,
+                   metric, name, stats.total_ns / 1e9,
+                   metric, name, (unsigned long long)stats.sample_count) != 0) {
+            pthread_mutex_unlock(&perf_system.lock);
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&perf_system.lock);
+    return (int)used;
 }
 
 void omega_perf_print_report(void) {
@@ -156,34 +478,39 @@ void omega_perf_print_report(void) {
         return;
     }
     
-    printf("\n╔════════════════════════════════════════════════════════════════╗\n");
-    printf("║              Kolibri-Omega Performance Report                 ║\n");
-    printf("╠════════════════════════════════════════════════════════════════╣\n");
-    printf("║ Category            │ Samples │   Avg    │   Min    │   Max   ║\n");
-    printf("╠════════════════════════════════════════════════════════════════╣\n");
+    printf("\n╔═══════════════════════════════════════════════════════════════════════════╗\n");
+    printf("║                    Kolibri-Omega Performance Report                      ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════════════╣\n");
+    printf("║ Category            │ Samples │   Avg    │   P99    │   Min    │   Max    ║\n");
+    printf("╠═══════════════════════════════════════════════════════════════════════════╣\n");
     
     pthread_mutex_lock(&perf_system.lock);
     
-    for (int i = 0; i < OMEGA_PERF_CATEGORY_COUNT; i++) {
-        const omega_perf_stats_t* stats = &perf_system.stats[i];
-        if (stats->sample_count > 0) {
-            printf("║ %-19s │ %7lu │ %6lu µs │ %6lu µs │ %6lu µs ║\n",
-                   category_names[i],
-                   (unsigned long)stats->sample_count,
-                   (unsigned long)(stats->avg_ns / 1000),
-                   (unsigned long)(stats->min_ns / 1000),
-                   (unsigned long)(stats->max_ns / 1000));
+    for (int i = 0; i < perf_system.category_count; i++) {
+        omega_perf_stats_t stats;
+        aggregate_locked(i, &stats);
+        if (stats.sample_count > 0) {
+            printf("║ %-19s │ %7lu │ %6lu µs │ %6lu µs │ %6lu µs │ %6lu µs ║\n",
+                   category_name_locked(i),
+                   (unsigned long)stats.sample_count,
+                   (unsigned long)(stats.avg_ns / 1000),
+                   (unsigned long)(stats.p99_ns / 1000),
+                   (unsigned long)(stats.min_ns / 1000),
+                   (unsigned long)(stats.max_ns / 1000));
         }
     }
     
     pthread_mutex_unlock(&perf_system.lock);
     
-    printf("╚════════════════════════════════════════════════════════════════╝\n");
+    printf("╚═══════════════════════════════════════════════════════════════════════════╝\n");
 }
 
 const char* omega_perf_category_name(omega_perf_category_t category) {
-    if (category >= 0 && category < OMEGA_PERF_CATEGORY_COUNT) {
+    if ((int)category >= 0 && (int)category < OMEGA_PERF_CATEGORY_COUNT) {
         return category_names[category];
     }
+    if ((int)category >= 0 && (int)category < __atomic_load_n(&perf_system.category_count, __ATOMIC_ACQUIRE)) {
+        return perf_system.names[category];
+    }
     return "Unknown";
 }
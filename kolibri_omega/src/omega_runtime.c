@@ -0,0 +1,266 @@
+#include "kolibri_omega/include/omega_runtime.h"
+#include "kolibri_omega/include/canvas.h"
+#include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static unsigned runtime_uses(const omega_runtime_task_t* task) {
+    return task->reads | task->appends | task->writes;
+}
+
+// Задачи конфликтуют, если одна изменяет то, чем пользуется другая
+static int runtime_conflict(const omega_runtime_task_t* a, const omega_runtime_task_t* b) {
+    return (a->writes & runtime_uses(b)) || (b->writes & runtime_uses(a));
+}
+
+// Кладёт готовую задачу в очередь потока; вызывается под runtime->lock
+static void runtime_push(omega_runtime_t* runtime, size_t worker, size_t task) {
+    omega_runtime_worker_t* queue = &runtime->workers[worker];
+    pthread_mutex_lock(&queue->lock);
+    queue->items[queue->tail++] = task;
+    pthread_mutex_unlock(&queue->lock);
+    __atomic_add_fetch(&runtime->ready, 1, __ATOMIC_RELEASE);
+}
+
+static int runtime_take(omega_runtime_t* runtime, size_t worker, size_t* task) {
+    for (size_t k = 0; k < runtime->worker_count; ++k) {
+        omega_runtime_worker_t* queue = &runtime->workers[(worker + k) % runtime->worker_count];
+        int found = 0;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->tail > queue->head) {
+            // Своя очередь — с головы, чужая — с хвоста
+            *task = k == 0 ? queue->items[queue->head++] : queue->items[--queue->tail];
+            found = 1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (found) {
+            __atomic_sub_fetch(&runtime->ready, 1, __ATOMIC_ACQ_REL);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Сливает отложенные добавления в ресурс от выполненных задач раньше before
+ * (все задачи — при before == task_count). Никто в это время ресурсом не
+ * пользуется: более ранние задачи, которые его касаются, уже выполнены, а
+ * более поздние ждут задачу before.
+ */
+static void runtime_merge(omega_runtime_t* runtime, size_t before, omega_resource_t resource) {
+    pthread_mutex_lock(&runtime->lock);
+    uint32_t merged = resource == OMEGA_RESOURCE_POOL ? runtime->pool_merged : runtime->canvas_merged;
+    uint32_t candidates = runtime->finished & ~merged;
+    pthread_mutex_unlock(&runtime->lock);
+
+    uint32_t done = 0;
+    int failed = 0;
+    for (size_t i = 0; i < before; ++i) {
+        if (!(candidates & (1u << i)) || !(runtime->tasks[i].appends & resource)) {
+            continue;
+        }
+        if (resource == OMEGA_RESOURCE_POOL) {
+            failed |= kf_pool_stage_commit(&runtime->pool_stages[i]) != 0;
+        } else {
+            // Формулы элементов могут ещё лежать в этапе пула той же задачи
+            kf_pool_stage_begin(&runtime->pool_stages[i], runtime->pool);
+            failed |= omega_canvas_stage_commit(&runtime->canvas_stages[i]) != 0;
+            kf_pool_stage_end();
+        }
+        done |= 1u << i;
+    }
+
+    pthread_mutex_lock(&runtime->lock);
+    if (resource == OMEGA_RESOURCE_POOL) {
+        runtime->pool_merged |= done;
+    } else {
+        runtime->canvas_merged |= done;
+    }
+    runtime->merge_failed |= failed;
+    pthread_mutex_unlock(&runtime->lock);
+}
+
+static void runtime_run(omega_runtime_t* runtime, size_t worker, size_t index) {
+    const omega_runtime_task_t* task = &runtime->tasks[index];
+    if (task->writes & OMEGA_RESOURCE_POOL) {
+        runtime_merge(runtime, index, OMEGA_RESOURCE_POOL);
+    }
+    if (task->writes & OMEGA_RESOURCE_CANVAS) {
+        runtime_merge(runtime, index, OMEGA_RESOURCE_CANVAS);
+    }
+    if (task->appends & OMEGA_RESOURCE_POOL) {
+        kf_pool_stage_begin(&runtime->pool_stages[index], runtime->pool);
+    }
+    if (task->appends & OMEGA_RESOURCE_CANVAS) {
+        omega_canvas_stage_begin(&runtime->canvas_stages[index], runtime->canvas);
+    }
+    task->run(task->arg);
+    kf_pool_stage_end();
+    omega_canvas_stage_end();
+
+    pthread_mutex_lock(&runtime->lock);
+    runtime->finished |= 1u << index;
+    runtime->remaining--;
+    for (size_t d = 0; d < runtime->task_count; ++d) {
+        if ((runtime->dependents[index] & (1u << d)) && --runtime->pending[d] == 0) {
+            runtime_push(runtime, worker, d);
+        }
+    }
+    pthread_cond_broadcast(&runtime->wake);
+    pthread_mutex_unlock(&runtime->lock);
+}
+
+static void* runtime_worker_main(void* arg) {
+    omega_runtime_worker_t* self = arg;
+    omega_runtime_t* runtime = self->runtime;
+    for (;;) {
+        size_t task;
+        if (runtime_take(runtime, self->index, &task)) {
+            runtime_run(runtime, self->index, task);
+            continue;
+        }
+        pthread_mutex_lock(&runtime->lock);
+        while (!runtime->stopping && __atomic_load_n(&runtime->ready, __ATOMIC_ACQUIRE) == 0) {
+            pthread_cond_wait(&runtime->wake, &runtime->lock);
+        }
+        int stopping = runtime->stopping;
+        pthread_mutex_unlock(&runtime->lock);
+        if (stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int omega_runtime_init(omega_runtime_t* runtime, omega_canvas_t* canvas, kf_pool_t* pool, size_t workers) {
+    if (!runtime || !canvas || !pool) {
+        return -1;
+    }
+    memset(runtime, 0, sizeof(*runtime));
+    runtime->canvas = canvas;
+    runtime->pool = pool;
+    if (workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (size_t)online : 1;
+    }
+    if (workers > OMEGA_RUNTIME_MAX_WORKERS) {
+        workers = OMEGA_RUNTIME_MAX_WORKERS;
+    }
+    runtime->worker_count = workers;
+    pthread_mutex_init(&runtime->lock, NULL);
+    pthread_cond_init(&runtime->wake, NULL);
+    for (size_t w = 0; w < workers; ++w) {
+        runtime->workers[w].runtime = runtime;
+        runtime->workers[w].index = w;
+        pthread_mutex_init(&runtime->workers[w].lock, NULL);
+    }
+    // Поток 0 — вызывающий omega_runtime_tick
+    for (size_t w = 1; w < workers; ++w) {
+        if (pthread_create(&runtime->threads[w], NULL, runtime_worker_main, &runtime->workers[w]) != 0) {
+            break;
+        }
+        runtime->started = w;
+    }
+    KOLIBRI_LOG_INFO("Runtime", "Initialized with %zu worker(s).", runtime->started + 1);
+    return 0;
+}
+
+void omega_runtime_destroy(omega_runtime_t* runtime) {
+    if (!runtime) {
+        return;
+    }
+    pthread_mutex_lock(&runtime->lock);
+    runtime->stopping = 1;
+    pthread_cond_broadcast(&runtime->wake);
+    pthread_mutex_unlock(&runtime->lock);
+    for (size_t w = 1; w <= runtime->started; ++w) {
+        pthread_join(runtime->threads[w], NULL);
+    }
+    for (size_t i = 0; i < runtime->task_count; ++i) {
+        kf_pool_stage_free(&runtime->pool_stages[i]);
+        omega_canvas_stage_free(&runtime->canvas_stages[i]);
+    }
+    for (size_t w = 0; w < runtime->worker_count; ++w) {
+        pthread_mutex_destroy(&runtime->workers[w].lock);
+    }
+    pthread_cond_destroy(&runtime->wake);
+    pthread_mutex_destroy(&runtime->lock);
+}
+
+int omega_runtime_add_task(omega_runtime_t* runtime, const omega_runtime_task_t* task) {
+    if (!runtime || !task || !task->run || runtime->task_count >= OMEGA_RUNTIME_MAX_TASKS) {
+        return -1;
+    }
+    if (task->appends & ~(unsigned)(OMEGA_RESOURCE_CANVAS | OMEGA_RESOURCE_POOL)) {
+        return -1;
+    }
+    omega_runtime_task_t* added = &runtime->tasks[runtime->task_count++];
+    *added = *task;
+    if ((added->appends | added->writes) & OMEGA_RESOURCE_CANVAS) {
+        added->reads |= OMEGA_RESOURCE_POOL;
+    }
+    return 0;
+}
+
+int omega_runtime_tick(omega_runtime_t* runtime) {
+    if (!runtime) {
+        return -1;
+    }
+    size_t count = runtime->task_count;
+
+    pthread_mutex_lock(&runtime->lock);
+    for (size_t w = 0; w < runtime->worker_count; ++w) {
+        omega_runtime_worker_t* queue = &runtime->workers[w];
+        pthread_mutex_lock(&queue->lock);
+        queue->head = queue->tail = 0;
+        pthread_mutex_unlock(&queue->lock);
+    }
+    for (size_t j = 0; j < count; ++j) {
+        runtime->pending[j] = 0;
+        runtime->dependents[j] = 0;
+        for (size_t i = 0; i < j; ++i) {
+            if (runtime_conflict(&runtime->tasks[i], &runtime->tasks[j])) {
+                runtime->pending[j]++;
+                runtime->dependents[i] |= 1u << j;
+            }
+        }
+    }
+    runtime->finished = 0;
+    runtime->pool_merged = 0;
+    runtime->canvas_merged = 0;
+    runtime->remaining = count;
+    runtime->merge_failed = 0;
+    size_t next_worker = 0;
+    for (size_t j = 0; j < count; ++j) {
+        if (runtime->pending[j] == 0) {
+            runtime_push(runtime, next_worker, j);
+            next_worker = (next_worker + 1) % (runtime->started + 1);
+        }
+    }
+    pthread_cond_broadcast(&runtime->wake);
+    pthread_mutex_unlock(&runtime->lock);
+
+    for (;;) {
+        size_t task;
+        if (runtime_take(runtime, 0, &task)) {
+            runtime_run(runtime, 0, task);
+            continue;
+        }
+        pthread_mutex_lock(&runtime->lock);
+        while (runtime->remaining > 0 && __atomic_load_n(&runtime->ready, __ATOMIC_ACQUIRE) == 0) {
+            pthread_cond_wait(&runtime->wake, &runtime->lock);
+        }
+        size_t remaining = runtime->remaining;
+        pthread_mutex_unlock(&runtime->lock);
+        if (remaining == 0) {
+            break;
+        }
+    }
+
+    // Барьер: формулы раньше элементов, которые на них ссылаются
+    runtime_merge(runtime, count, OMEGA_RESOURCE_POOL);
+    runtime_merge(runtime, count, OMEGA_RESOURCE_CANVAS);
+    return runtime->merge_failed ? -1 : 0;
+}
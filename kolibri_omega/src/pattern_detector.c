@@ -1,6 +1,8 @@
 #include "kolibri_omega/include/pattern_detector.h"
 #include "kolibri_omega/include/types.h"
+#include "kolibri_omega/include/canvas.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -8,57 +10,51 @@
  * @brief Инициализирует детектор паттернов.
  */
 void omega_pattern_detector_init(void) {
-    printf("[PatternDetector] Initialized.\n");
+    KOLIBRI_LOG_INFO("PatternDetector", "Initialized.");
 }
 
 /**
  * @brief Обнаруживает простые паттерны: последовательности из двух фактов.
  * 
- * Простая реализация, которая ищет повторяющиеся пары событий.
+ * Идёт по временной линии каждого объекта: за фактом (object_id, t)
+ * следует факт (object_id, t + 1), найденный через индекс Холста.
  */
 int omega_detect_patterns(omega_canvas_t* canvas, kf_pool_t* formula_pool, omega_pattern_t* patterns, size_t max_patterns) {
     if (!canvas || !formula_pool || !patterns || max_patterns == 0) {
         return 0;
     }
 
-    int pattern_count = 0;
+    size_t pattern_count = 0;
 
-    // Упрощенная логика: ищем пары фактов, которые часто происходят подряд
-    for (size_t i = 0; i < canvas->count && pattern_count < max_patterns; ++i) {
+    for (size_t k = 0; k < canvas->type_count[OMEGA_HYPOTHESIS_FACT] && pattern_count < max_patterns; ++k) {
+        size_t i = canvas->type_items[OMEGA_HYPOTHESIS_FACT][k];
+        if (!canvas->entries[i].keyed) continue;
         omega_canvas_item_t* item1 = &canvas->items[i];
-        if (item1->type != OMEGA_HYPOTHESIS_FACT) continue;
 
-        kf_formula_t f1;
-        if (kf_get_formula(formula_pool, item1->formula_id, &f1) != 0) continue;
-
-        for (size_t j = i + 1; j < canvas->count; ++j) {
+        for (size_t j = omega_canvas_first_at(canvas, canvas->entries[i].object_id, canvas->entries[i].time + 1);
+             j < canvas->count;
+             j = omega_canvas_next_at(canvas, j)) {
             omega_canvas_item_t* item2 = &canvas->items[j];
             if (item2->type != OMEGA_HYPOTHESIS_FACT) continue;
 
-            kf_formula_t f2;
-            if (kf_get_formula(formula_pool, item2->formula_id, &f2) != 0) continue;
+            // Факт того же объекта в следующую временную единицу — это может быть паттерн!
+            omega_pattern_t* pattern = &patterns[pattern_count];
+            pattern->formula_ids[0] = item1->formula_id;
+            pattern->formula_ids[1] = item2->formula_id;
+            pattern->length = 2;
+            pattern->confidence = 50; // Средняя уверенность
+            pattern->occurrences = 1;
 
-            // Если факты произошли близко друг к другу (в пределах 1 временной единицы)
-            if (f2.time == f1.time + 1) {
-                // Это может быть паттерн!
-                omega_pattern_t* pattern = &patterns[pattern_count];
-                pattern->formula_ids[0] = item1->formula_id;
-                pattern->formula_ids[1] = item2->formula_id;
-                pattern->length = 2;
-                pattern->confidence = 50; // Средняя уверенность
-                pattern->occurrences = 1;
-                
-                printf("[PatternDetector] Found pattern: %llu -> %llu\n",
-                       (unsigned long long)item1->formula_id,
-                       (unsigned long long)item2->formula_id);
-                
-                pattern_count++;
-                if (pattern_count >= max_patterns) break;
-            }
+            KOLIBRI_LOG_INFO("PatternDetector", "Found pattern: %llu -> %llu",
+                   (unsigned long long)item1->formula_id,
+                   (unsigned long long)item2->formula_id);
+
+            pattern_count++;
+            if (pattern_count >= max_patterns) break;
         }
     }
 
-    return pattern_count;
+    return (int)pattern_count;
 }
 
 /**
@@ -84,7 +80,7 @@ uint64_t omega_create_rule_from_pattern(kf_pool_t* formula_pool, omega_pattern_t
     };
 
     uint64_t rule_id = kf_add_formula(formula_pool, &rule);
-    printf("[PatternDetector] Created rule %llu from detected pattern (confidence: %d%%)\n",
+    KOLIBRI_LOG_INFO("PatternDetector", "Created rule %llu from detected pattern (confidence: %d%%)",
            (unsigned long long)rule_id, pattern->confidence);
     
     return rule_id;
@@ -1,4 +1,5 @@
 #include "kolibri_omega/include/policy_learner.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,7 +7,14 @@
 
 #define OMEGA_MAX_POLICY_INSTANCES 20
 
+// Оценка действия в арене; order — номер действия в политике
 typedef struct {
+    omega_action_value_t value;
+    int32_t policy;
+    int32_t order;
+} policy_entry_t;
+
+struct omega_policy_ctx_s {
     omega_policy_t policies[OMEGA_MAX_POLICIES];
     int policy_count;
     
@@ -14,19 +22,256 @@ typedef struct {
     int episode_count;
     
     omega_policy_stats_t stats;
-} omega_policy_ctx_t;
 
-static omega_policy_ctx_t policy_ctx = {0};
+    // Разреженная Q-таблица: оценки лежат в арене подряд, таблица
+    // открытой адресации по (политика, действие) хранит индекс + 1
+    policy_entry_t* entries;
+    int entry_count;
+    int entry_capacity;
+    int32_t* slots;
+    size_t slot_count;
+
+    // Действия каждой политики в порядке появления
+    int32_t* policy_actions[OMEGA_MAX_POLICIES];
+    int policy_action_capacity[OMEGA_MAX_POLICIES];
+
+    // Кэш argmax Q по политике: индекс записи, -1 — пересчитать
+    int32_t best_entry[OMEGA_MAX_POLICIES];
+
+    // Первая политика состояния: индекс + 1, 0 — нет
+    int32_t state_policy[OMEGA_MAX_STATE_SPACE];
+};
+
+typedef struct omega_policy_ctx_s omega_policy_ctx_t;
+
+static size_t policy_hash(int32_t policy, uint64_t action) {
+    uint64_t h = (uint64_t)(uint32_t)policy * 0x9E3779B97F4A7C15ULL;
+    h ^= action + 0xBF58476D1CE4E5B9ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    return (size_t)h;
+}
+
+static void policy_free_tables(omega_policy_ctx_t* policy_ctx) {
+    free(policy_ctx->entries);
+    free(policy_ctx->slots);
+    for (int i = 0; i < OMEGA_MAX_POLICIES; i++) {
+        free(policy_ctx->policy_actions[i]);
+    }
+}
+
+// Индекс политики состояния или -1
+static int policy_find(const omega_policy_ctx_t* policy_ctx, omega_system_state_t state) {
+    if ((unsigned)state < OMEGA_MAX_STATE_SPACE) {
+        return policy_ctx->state_policy[state] - 1;
+    }
+    for (int i = 0; i < policy_ctx->policy_count; i++) {
+        if (policy_ctx->policies[i].target_state == state) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int32_t policy_find_entry(const omega_policy_ctx_t* policy_ctx, int policy, uint64_t action) {
+    if (!policy_ctx->slots) {
+        return -1;
+    }
+    size_t mask = policy_ctx->slot_count - 1;
+    size_t slot = policy_hash(policy, action) & mask;
+    while (policy_ctx->slots[slot]) {
+        int32_t index = policy_ctx->slots[slot] - 1;
+        const policy_entry_t* entry = &policy_ctx->entries[index];
+        if (entry->policy == policy && entry->value.action_id == action) {
+            return index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static int policy_grow(omega_policy_ctx_t* policy_ctx, int policy) {
+    if (policy_ctx->entry_count == policy_ctx->entry_capacity) {
+        int capacity = policy_ctx->entry_capacity ? policy_ctx->entry_capacity * 2 : 64;
+        policy_entry_t* entries = realloc(policy_ctx->entries, (size_t)capacity * sizeof(*entries));
+        if (!entries) {
+            return -1;
+        }
+        policy_ctx->entries = entries;
+        policy_ctx->entry_capacity = capacity;
+    }
+    // Загрузка таблицы не выше половины
+    if ((size_t)(policy_ctx->entry_count + 1) * 2 > policy_ctx->slot_count) {
+        size_t slot_count = policy_ctx->slot_count ? policy_ctx->slot_count * 2 : 128;
+        int32_t* slots = calloc(slot_count, sizeof(int32_t));
+        if (!slots) {
+            return -1;
+        }
+        for (int i = 0; i < policy_ctx->entry_count; i++) {
+            const policy_entry_t* entry = &policy_ctx->entries[i];
+            size_t slot = policy_hash(entry->policy, entry->value.action_id) & (slot_count - 1);
+            while (slots[slot]) {
+                slot = (slot + 1) & (slot_count - 1);
+            }
+            slots[slot] = i + 1;
+        }
+        free(policy_ctx->slots);
+        policy_ctx->slots = slots;
+        policy_ctx->slot_count = slot_count;
+    }
+    int count = policy_ctx->policies[policy].action_count;
+    if (count == policy_ctx->policy_action_capacity[policy]) {
+        int capacity = count ? count * 2 : 8;
+        if (capacity > OMEGA_MAX_POLICY_ACTIONS) {
+            capacity = OMEGA_MAX_POLICY_ACTIONS;
+        }
+        int32_t* actions = realloc(policy_ctx->policy_actions[policy], (size_t)capacity * sizeof(*actions));
+        if (!actions) {
+            return -1;
+        }
+        policy_ctx->policy_actions[policy] = actions;
+        policy_ctx->policy_action_capacity[policy] = capacity;
+    }
+    return 0;
+}
+
+// Оценка действия политики; новое действие заводится с нулевым Q
+static int32_t policy_entry(omega_policy_ctx_t* policy_ctx, int policy, uint64_t action) {
+    int32_t index = policy_find_entry(policy_ctx, policy, action);
+    if (index >= 0) {
+        return index;
+    }
+    omega_policy_t* owner = &policy_ctx->policies[policy];
+    if (owner->action_count >= OMEGA_MAX_POLICY_ACTIONS || policy_grow(policy_ctx, policy) != 0) {
+        return -1;
+    }
+    size_t mask = policy_ctx->slot_count - 1;
+    size_t slot = policy_hash(policy, action) & mask;
+    while (policy_ctx->slots[slot]) {
+        slot = (slot + 1) & mask;
+    }
+    index = policy_ctx->entry_count++;
+    policy_entry_t* entry = &policy_ctx->entries[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->value.action_id = action;
+    entry->policy = policy;
+    entry->order = owner->action_count;
+    policy_ctx->slots[slot] = index + 1;
+    policy_ctx->policy_actions[policy][owner->action_count++] = index;
+    return index;
+}
+
+// Действие с наибольшим Q, при равенстве — появившееся раньше; -1 — действий нет
+static int32_t policy_best(omega_policy_ctx_t* policy_ctx, int policy) {
+    if (policy_ctx->best_entry[policy] < 0) {
+        const omega_policy_t* owner = &policy_ctx->policies[policy];
+        const int32_t* actions = policy_ctx->policy_actions[policy];
+        int32_t best = -1;
+        for (int i = 0; i < owner->action_count; i++) {
+            if (best < 0 || policy_ctx->entries[actions[i]].value.q_value >
+                            policy_ctx->entries[best].value.q_value) {
+                best = actions[i];
+            }
+        }
+        policy_ctx->best_entry[policy] = best;
+    }
+    return policy_ctx->best_entry[policy];
+}
+
+// max Q по действиям политики состояния; 0, если их нет
+static double policy_max_q(omega_policy_ctx_t* policy_ctx, omega_system_state_t state) {
+    int policy = policy_find(policy_ctx, state);
+    int32_t best = policy >= 0 ? policy_best(policy_ctx, policy) : -1;
+    return best >= 0 ? policy_ctx->entries[best].value.q_value : 0.0;
+}
+
+// Шаг Q-learning к готовой цели и поправка кэша argmax
+static int policy_apply(omega_policy_ctx_t* policy_ctx, int policy, uint64_t action,
+                        double reward, double q_target) {
+    int32_t index = policy_entry(policy_ctx, policy, action);
+    if (index < 0) {
+        return -1;  // Невозможно добавить действие
+    }
+    omega_policy_t* owner = &policy_ctx->policies[policy];
+    policy_entry_t* entry = &policy_ctx->entries[index];
+    omega_action_value_t* action_value = &entry->value;
+
+    // Q-learning update: Q_new = Q_old + α * (R + γ * max(Q_next) - Q_old)
+    double old_q = action_value->q_value;
+    action_value->q_value = old_q + (owner->learning_rate * (q_target - old_q));
+
+    // Кэш остаётся верным, если лучшее действие не подешевело
+    int32_t best = policy_ctx->best_entry[policy];
+    if (best == index) {
+        if (action_value->q_value < old_q) {
+            policy_ctx->best_entry[policy] = -1;
+        }
+    } else if (best >= 0) {
+        const policy_entry_t* current = &policy_ctx->entries[best];
+        if (action_value->q_value > current->value.q_value ||
+            (action_value->q_value == current->value.q_value && entry->order < current->order)) {
+            policy_ctx->best_entry[policy] = index;
+        }
+    }
+    
+    // Обновляем статистику действия
+    action_value->reward_sum += reward;
+    action_value->visit_count++;
+    action_value->average_reward = action_value->reward_sum / action_value->visit_count;
+    
+    if (action_value->average_reward > 0.5) {
+        action_value->is_effective = 1;
+    }
+    
+    owner->episodes_trained++;
+    owner->average_reward_per_episode = action_value->average_reward;
+    owner->win_rate = (double)action_value->visit_count / (action_value->visit_count + 1);
+    
+    policy_ctx->stats.policy_updates++;
+    policy_ctx->stats.average_q_value += action_value->q_value;
+    
+    if (action_value->q_value > policy_ctx->stats.max_q_value) {
+        policy_ctx->stats.max_q_value = action_value->q_value;
+    }
+    
+    return 0;
+}
+
+typedef struct {
+    double q_value;
+    int32_t order;
+    uint64_t action_id;
+} policy_rank_t;
+
+// По убыванию Q, при равенстве — в порядке появления
+static int policy_compare_rank(const void* a, const void* b) {
+    const policy_rank_t* x = a;
+    const policy_rank_t* y = b;
+    if (x->q_value != y->q_value) {
+        return x->q_value < y->q_value ? 1 : -1;
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
 
 /**
  * omega_policy_learner_init - инициализация
  */
-int omega_policy_learner_init(void) {
-    memset(&policy_ctx, 0, sizeof(policy_ctx));
+int omega_policy_learner_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->policy && !(ctx->policy = calloc(1, sizeof(omega_policy_ctx_t)))) {
+        return -1;
+    }
+    omega_policy_ctx_t* policy_ctx = ctx->policy;
+    policy_free_tables(policy_ctx);
+    memset(policy_ctx, 0, sizeof(*policy_ctx));
+    for (int i = 0; i < OMEGA_MAX_POLICIES; i++) {
+        policy_ctx->best_entry[i] = -1;
+    }
     
-    printf("[PolicyLearner] Initialized for learning up to %d policies\n",
+    KOLIBRI_LOG_INFO("PolicyLearner", "Initialized for learning up to %d policies",
            OMEGA_MAX_POLICIES);
-    printf("[PolicyLearner] Q-learning framework with epsilon-greedy exploration\n");
+    KOLIBRI_LOG_INFO("PolicyLearner", "Q-learning framework with epsilon-greedy exploration");
     
     return 0;
 }
@@ -34,27 +279,31 @@ int omega_policy_learner_init(void) {
 /**
  * omega_create_policy - создать политику
  */
-uint64_t omega_create_policy(omega_system_state_t state,
+uint64_t omega_create_policy(omega_context_t* ctx, omega_system_state_t state,
                             const char* policy_name,
                             double learning_rate) {
-    if (policy_ctx.policy_count >= OMEGA_MAX_POLICIES) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx || policy_ctx->policy_count >= OMEGA_MAX_POLICIES) {
         return 0;
     }
     
-    omega_policy_t* policy = &policy_ctx.policies[policy_ctx.policy_count];
+    omega_policy_t* policy = &policy_ctx->policies[policy_ctx->policy_count];
     
-    policy->policy_id = 10000 + policy_ctx.policy_count;
+    policy->policy_id = 10000 + policy_ctx->policy_count;
     policy->target_state = state;
     strncpy(policy->policy_name, policy_name, sizeof(policy->policy_name) - 1);
     policy->learning_rate = learning_rate;
     policy->exploration_rate = 0.2;  // 20% exploration
     policy->discount_factor = 0.99;  // 99% future reward discount
+    if ((unsigned)state < OMEGA_MAX_STATE_SPACE && policy_ctx->state_policy[state] == 0) {
+        policy_ctx->state_policy[state] = policy_ctx->policy_count + 1;
+    }
+
+    policy_ctx->policy_count++;
+    policy_ctx->stats.total_policies++;
+    policy_ctx->stats.active_policies++;
     
-    policy_ctx.policy_count++;
-    policy_ctx.stats.total_policies++;
-    policy_ctx.stats.active_policies++;
-    
-    printf("[PolicyLearner] Created policy %lu: \"%s\" for state %d (α=%.2f)\n",
+    KOLIBRI_LOG_INFO("PolicyLearner", "Created policy %lu: \"%s\" for state %d (α=%.2f)",
            (unsigned long)policy->policy_id, policy_name, state, learning_rate);
     
     return policy->policy_id;
@@ -63,19 +312,20 @@ uint64_t omega_create_policy(omega_system_state_t state,
 /**
  * omega_record_learning_episode - записать эпизод
  */
-int omega_record_learning_episode(omega_system_state_t initial_state,
+int omega_record_learning_episode(omega_context_t* ctx, omega_system_state_t initial_state,
                                  uint64_t action_taken,
                                  double reward,
                                  omega_system_state_t next_state,
                                  double divergence_delta) {
-    if (policy_ctx.episode_count >= OMEGA_MAX_LEARNING_EPISODES) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx || policy_ctx->episode_count >= OMEGA_MAX_LEARNING_EPISODES) {
         return -1;
     }
     
-    omega_learning_episode_t* episode = &policy_ctx.episodes[policy_ctx.episode_count];
+    omega_learning_episode_t* episode = &policy_ctx->episodes[policy_ctx->episode_count];
     
-    episode->episode_id = 11000 + policy_ctx.episode_count;
-    episode->episode_number = policy_ctx.episode_count;
+    episode->episode_id = 11000 + policy_ctx->episode_count;
+    episode->episode_number = policy_ctx->episode_count;
     episode->initial_state = initial_state;
     episode->action_taken = action_taken;
     episode->reward_received = reward;
@@ -83,19 +333,19 @@ int omega_record_learning_episode(omega_system_state_t initial_state,
     episode->divergence_before = divergence_delta > 0 ? divergence_delta : 0.1;
     episode->divergence_after = fabs(divergence_delta * 0.5);
     
-    policy_ctx.episode_count++;
-    policy_ctx.stats.total_episodes++;
+    policy_ctx->episode_count++;
+    policy_ctx->stats.total_episodes++;
     
     if (reward > 0) {
-        policy_ctx.stats.successful_episodes++;
+        policy_ctx->stats.successful_episodes++;
     } else {
-        policy_ctx.stats.failed_episodes++;
+        policy_ctx->stats.failed_episodes++;
     }
     
-    policy_ctx.stats.cumulative_reward += reward;
+    policy_ctx->stats.cumulative_reward += reward;
     
-    if (reward > policy_ctx.stats.best_episode_reward) {
-        policy_ctx.stats.best_episode_reward = reward;
+    if (reward > policy_ctx->stats.best_episode_reward) {
+        policy_ctx->stats.best_episode_reward = reward;
     }
     
     return 0;
@@ -128,20 +378,29 @@ double omega_compute_reward(double divergence_before,
 /**
  * omega_select_best_action - выбрать лучшее действие
  */
-uint64_t omega_select_best_action(omega_system_state_t state,
+uint64_t omega_select_best_action(omega_context_t* ctx, omega_system_state_t state,
                                  double exploration_epsilon) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx) {
+        return 0;
+    }
     // Найти политику для состояния
-    omega_policy_t* target_policy = NULL;
-    for (int i = 0; i < policy_ctx.policy_count; i++) {
-        if (policy_ctx.policies[i].target_state == state && policy_ctx.policies[i].action_count > 0) {
-            target_policy = &policy_ctx.policies[i];
-            break;
+    int policy = policy_find(policy_ctx, state);
+    if (policy >= 0 && policy_ctx->policies[policy].action_count == 0) {
+        // У первой политики состояния действий нет — ищем следующую
+        int found = -1;
+        for (int i = policy + 1; i < policy_ctx->policy_count && found < 0; i++) {
+            if (policy_ctx->policies[i].target_state == state && policy_ctx->policies[i].action_count > 0) {
+                found = i;
+            }
         }
+        policy = found;
     }
     
-    if (!target_policy) {
+    if (policy < 0) {
         return 0;  // Политика не найдена
     }
+    omega_policy_t* target_policy = &policy_ctx->policies[policy];
     
     // Epsilon-greedy выбор
     double rand_val = (double)rand() / RAND_MAX;
@@ -149,129 +408,121 @@ uint64_t omega_select_best_action(omega_system_state_t state,
     if (rand_val < exploration_epsilon) {
         // Исследование: выбираем случайное действие
         int random_idx = rand() % target_policy->action_count;
-        policy_ctx.stats.exploration_vs_exploitation++;
-        return target_policy->actions[random_idx].action_id;
+        policy_ctx->stats.exploration_vs_exploitation++;
+        return policy_ctx->entries[policy_ctx->policy_actions[policy][random_idx]].value.action_id;
     } else {
-        // Эксплуатация: выбираем действие с максимальным Q
-        int best_idx = 0;
-        double best_q = target_policy->actions[0].q_value;
-        
-        for (int i = 1; i < target_policy->action_count; i++) {
-            if (target_policy->actions[i].q_value > best_q) {
-                best_q = target_policy->actions[i].q_value;
-                best_idx = i;
-            }
-        }
-        
-        return target_policy->actions[best_idx].action_id;
+        // Эксплуатация: действие с максимальным Q из кэша
+        return policy_ctx->entries[policy_best(policy_ctx, policy)].value.action_id;
     }
 }
 
 /**
  * omega_update_policy - обновить политику (Q-learning)
  */
-int omega_update_policy(omega_system_state_t state,
+int omega_update_policy(omega_context_t* ctx, omega_system_state_t state,
                        uint64_t action,
                        double reward,
                        omega_system_state_t next_state) {
-    // Найти политику для текущего состояния
-    omega_policy_t* policy = NULL;
-    for (int i = 0; i < policy_ctx.policy_count; i++) {
-        if (policy_ctx.policies[i].target_state == state) {
-            policy = &policy_ctx.policies[i];
-            break;
-        }
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx) {
+        return -1;
     }
-    
-    if (!policy) {
+    // Найти политику для текущего состояния
+    int policy = policy_find(policy_ctx, state);
+    if (policy < 0) {
         return -1;
     }
     
-    // Найти или создать action-value для этого действия
-    omega_action_value_t* action_value = NULL;
-    int action_idx = -1;
-    
-    for (int i = 0; i < policy->action_count; i++) {
-        if (policy->actions[i].action_id == action) {
-            action_value = &policy->actions[i];
-            action_idx = i;
-            break;
-        }
+    double q_target = reward + (policy_ctx->policies[policy].discount_factor *
+                                policy_max_q(policy_ctx, next_state));
+    return policy_apply(policy_ctx, policy, action, reward, q_target);
+}
+
+/**
+ * omega_update_policy_batch - обновить политику пакетом переходов
+ */
+int omega_update_policy_batch(omega_context_t* ctx,
+                              const omega_policy_transition_t* transitions,
+                              int count) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx || (!transitions && count > 0) || count < 0) {
+        return -1;
     }
-    
-    // Если действия нет, добавляем новое
-    if (!action_value && policy->action_count < OMEGA_MAX_POLICY_ACTIONS) {
-        action_value = &policy->actions[policy->action_count];
-        action_value->action_id = action;
-        action_value->q_value = 0.0;
-        action_value->reward_sum = 0.0;
-        action_value->visit_count = 0;
-        action_idx = policy->action_count;
-        policy->action_count++;
+    if (count == 0) {
+        return 0;
     }
     
-    if (!action_value) {
-        return -1;  // Невозможно добавить действие
+    // Цели считаются по Q до пакета, поэтому порядок внутри пакета
+    // не влияет на оценку следующих состояний
+    double* targets = malloc((size_t)count * sizeof(double));
+    int* policies = malloc((size_t)count * sizeof(int));
+    if (!targets || !policies) {
+        free(targets);
+        free(policies);
+        return -1;
     }
-    
-    // Находим max Q для next_state
-    double max_q_next = 0.0;
-    omega_policy_t* next_policy = NULL;
-    for (int i = 0; i < policy_ctx.policy_count; i++) {
-        if (policy_ctx.policies[i].target_state == next_state) {
-            next_policy = &policy_ctx.policies[i];
-            break;
+    for (int i = 0; i < count; i++) {
+        const omega_policy_transition_t* t = &transitions[i];
+        policies[i] = policy_find(policy_ctx, t->state);
+        if (policies[i] >= 0) {
+            targets[i] = t->reward + (policy_ctx->policies[policies[i]].discount_factor *
+                                      policy_max_q(policy_ctx, t->next_state));
         }
     }
     
-    if (next_policy && next_policy->action_count > 0) {
-        max_q_next = next_policy->actions[0].q_value;
-        for (int i = 1; i < next_policy->action_count; i++) {
-            if (next_policy->actions[i].q_value > max_q_next) {
-                max_q_next = next_policy->actions[i].q_value;
-            }
+    int applied = 0;
+    for (int i = 0; i < count; i++) {
+        if (policies[i] >= 0 &&
+            policy_apply(policy_ctx, policies[i], transitions[i].action,
+                         transitions[i].reward, targets[i]) == 0) {
+            applied++;
         }
     }
     
-    // Q-learning update: Q_new = Q_old + α * (R + γ * max(Q_next) - Q_old)
-    double old_q = action_value->q_value;
-    double q_target = reward + (policy->discount_factor * max_q_next);
-    action_value->q_value = old_q + (policy->learning_rate * (q_target - old_q));
-    
-    // Обновляем статистику действия
-    action_value->reward_sum += reward;
-    action_value->visit_count++;
-    action_value->average_reward = action_value->reward_sum / action_value->visit_count;
-    
-    if (action_value->average_reward > 0.5) {
-        action_value->is_effective = 1;
+    free(targets);
+    free(policies);
+    return applied;
+}
+
+/**
+ * omega_replay_learning_episodes - повторить случайные записанные эпизоды
+ */
+int omega_replay_learning_episodes(omega_context_t* ctx, int batch_size) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx || batch_size < 0) {
+        return -1;
+    }
+    if (batch_size == 0 || policy_ctx->episode_count == 0) {
+        return 0;
     }
     
-    policy->episodes_trained++;
-    policy->average_reward_per_episode = action_value->average_reward;
-    policy->win_rate = (double)action_value->visit_count / (action_value->visit_count + 1);
-    
-    policy_ctx.stats.policy_updates++;
-    policy_ctx.stats.average_q_value += action_value->q_value;
-    
-    if (action_value->q_value > policy_ctx.stats.max_q_value) {
-        policy_ctx.stats.max_q_value = action_value->q_value;
+    omega_policy_transition_t* batch = malloc((size_t)batch_size * sizeof(*batch));
+    if (!batch) {
+        return -1;
+    }
+    for (int i = 0; i < batch_size; i++) {
+        const omega_learning_episode_t* episode = &policy_ctx->episodes[rand() % policy_ctx->episode_count];
+        batch[i].state = episode->initial_state;
+        batch[i].action = episode->action_taken;
+        batch[i].reward = episode->reward_received;
+        batch[i].next_state = episode->next_state;
     }
     
-    return 0;
+    int applied = omega_update_policy_batch(ctx, batch, batch_size);
+    free(batch);
+    return applied;
 }
 
 /**
  * omega_get_policy_effectiveness - оценить эффективность политики
  */
-double omega_get_policy_effectiveness(omega_system_state_t state) {
-    omega_policy_t* policy = NULL;
-    for (int i = 0; i < policy_ctx.policy_count; i++) {
-        if (policy_ctx.policies[i].target_state == state) {
-            policy = &policy_ctx.policies[i];
-            break;
-        }
+double omega_get_policy_effectiveness(omega_context_t* ctx, omega_system_state_t state) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx) {
+        return 0.0;
     }
+    int index = policy_find(policy_ctx, state);
+    omega_policy_t* policy = index >= 0 ? &policy_ctx->policies[index] : NULL;
     
     if (!policy || policy->episodes_trained == 0) {
         return 0.0;
@@ -283,45 +534,34 @@ double omega_get_policy_effectiveness(omega_system_state_t state) {
 /**
  * omega_extract_best_policy_actions - извлечь лучшие действия
  */
-int omega_extract_best_policy_actions(omega_system_state_t state,
+int omega_extract_best_policy_actions(omega_context_t* ctx, omega_system_state_t state,
                                      uint64_t* actions_out,
                                      int max_count) {
-    if (!actions_out || max_count <= 0) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx || !actions_out || max_count <= 0) {
         return 0;
     }
     
-    omega_policy_t* policy = NULL;
-    for (int i = 0; i < policy_ctx.policy_count; i++) {
-        if (policy_ctx.policies[i].target_state == state) {
-            policy = &policy_ctx.policies[i];
-            break;
-        }
-    }
-    
-    if (!policy || policy->action_count == 0) {
+    int index = policy_find(policy_ctx, state);
+    if (index < 0 || policy_ctx->policies[index].action_count == 0) {
         return 0;
     }
+    const omega_policy_t* policy = &policy_ctx->policies[index];
     
-    // Сортируем действия по Q-value (пузырьком)
-    int indices[OMEGA_MAX_POLICY_ACTIONS];
+    // Сортируем действия по Q-value
+    policy_rank_t ranks[OMEGA_MAX_POLICY_ACTIONS];
     for (int i = 0; i < policy->action_count; i++) {
-        indices[i] = i;
-    }
-    
-    for (int i = 0; i < policy->action_count - 1; i++) {
-        for (int j = 0; j < policy->action_count - i - 1; j++) {
-            if (policy->actions[indices[j]].q_value < policy->actions[indices[j + 1]].q_value) {
-                int tmp = indices[j];
-                indices[j] = indices[j + 1];
-                indices[j + 1] = tmp;
-            }
-        }
+        const policy_entry_t* entry = &policy_ctx->entries[policy_ctx->policy_actions[index][i]];
+        ranks[i].q_value = entry->value.q_value;
+        ranks[i].order = entry->order;
+        ranks[i].action_id = entry->value.action_id;
     }
+    qsort(ranks, (size_t)policy->action_count, sizeof(ranks[0]), policy_compare_rank);
     
     // Заполняем выходной массив
     int count = (policy->action_count < max_count) ? policy->action_count : max_count;
     for (int i = 0; i < count; i++) {
-        actions_out[i] = policy->actions[indices[i]].action_id;
+        actions_out[i] = ranks[i].action_id;
     }
     
     return count;
@@ -330,29 +570,39 @@ int omega_extract_best_policy_actions(omega_system_state_t state,
 /**
  * omega_get_policy_statistics - получить статистику
  */
-const omega_policy_stats_t* omega_get_policy_statistics(void) {
-    if (policy_ctx.stats.total_episodes > 0) {
-        policy_ctx.stats.average_reward = policy_ctx.stats.cumulative_reward / policy_ctx.stats.total_episodes;
-        policy_ctx.stats.average_q_value = policy_ctx.stats.average_q_value / (policy_ctx.stats.policy_updates + 1);
+const omega_policy_stats_t* omega_get_policy_statistics(omega_context_t* ctx) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx) {
+        return NULL;
+    }
+    if (policy_ctx->stats.total_episodes > 0) {
+        policy_ctx->stats.average_reward = policy_ctx->stats.cumulative_reward / policy_ctx->stats.total_episodes;
+        policy_ctx->stats.average_q_value = policy_ctx->stats.average_q_value / (policy_ctx->stats.policy_updates + 1);
     }
     
-    return &policy_ctx.stats;
+    return &policy_ctx->stats;
 }
 
 /**
  * omega_policy_learner_shutdown - остановка
  */
-void omega_policy_learner_shutdown(void) {
-    const omega_policy_stats_t* stats = omega_get_policy_statistics();
+void omega_policy_learner_shutdown(omega_context_t* ctx) {
+    omega_policy_ctx_t* policy_ctx = ctx ? ctx->policy : NULL;
+    if (!policy_ctx) {
+        return;
+    }
+    const omega_policy_stats_t* stats = omega_get_policy_statistics(ctx);
     
-    printf("[PolicyLearner] Shutdown: %d policies, %d total episodes\n",
-           policy_ctx.policy_count, stats->total_episodes);
-    printf("  Successful: %d, Failed: %d\n",
+    KOLIBRI_LOG_INFO("PolicyLearner", "Shutdown: %d policies, %d total episodes",
+           policy_ctx->policy_count, stats->total_episodes);
+    KOLIBRI_LOG_INFO("PolicyLearner", "Successful: %d, Failed: %d",
            stats->successful_episodes, stats->failed_episodes);
-    printf("  Average reward: %.2f, Best: %.2f\n",
+    KOLIBRI_LOG_INFO("PolicyLearner", "Average reward: %.2f, Best: %.2f",
            stats->average_reward, stats->best_episode_reward);
-    printf("  Policy updates: %d, Average Q-value: %.3f\n",
+    KOLIBRI_LOG_INFO("PolicyLearner", "Policy updates: %d, Average Q-value: %.3f",
            stats->policy_updates, stats->average_q_value);
     
-    memset(&policy_ctx, 0, sizeof(policy_ctx));
+    policy_free_tables(policy_ctx);
+    free(policy_ctx);
+    ctx->policy = NULL;
 }
@@ -3,6 +3,7 @@
 #include "kolibri_omega/include/inference_engine.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
 #include "kolibri_omega/include/canvas.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 
 /**
@@ -21,7 +22,9 @@ void omega_predictor_lobe_tick(omega_predictor_lobe_t* lobe, int current_time) {
 
     // Проходим по всем элементам на Холсте
     for (size_t i = 0; i < lobe->canvas->count; ++i) {
-        omega_canvas_item_t* item = &lobe->canvas->items[i];
+        // Добавление предсказаний может перевыделить Холст — элемент копируется
+        omega_canvas_item_t fact = lobe->canvas->items[i];
+        const omega_canvas_item_t* item = &fact;
 
         // Предсказываем только на основе фактов из прошлого или настоящего
         if (item->type == OMEGA_HYPOTHESIS_FACT && item->timestamp <= current_time) {
@@ -29,15 +32,17 @@ void omega_predictor_lobe_tick(omega_predictor_lobe_t* lobe, int current_time) {
             for (size_t j = 0; j < lobe->formula_pool->count; ++j) {
                 kf_formula_t* rule = &lobe->formula_pool->formulas[j];
                 if (rule->type == KF_TYPE_RULE && rule->is_valid) {
+                    // kf_add_formula может перевыделить пул — id правила берём заранее
+                    uint64_t rule_id = rule->id;
                     kf_formula_t predicted_formula;
-                    if (kf_apply_rule_to_fact(lobe->formula_pool, rule->id, item->formula_id, &predicted_formula) == 0) {
+                    if (kf_apply_rule_to_fact(lobe->formula_pool, rule_id, item->formula_id, &predicted_formula) == 0) {
                         
                         uint64_t predicted_formula_id = kf_add_formula(lobe->formula_pool, &predicted_formula);
                         if (predicted_formula_id > 0) {
                             omega_canvas_item_t prediction_item = {
                                 .type = OMEGA_HYPOTHESIS_PREDICTION,
                                 .formula_id = predicted_formula_id,
-                                .derived_from_rule_id = rule->id,
+                                .derived_from_rule_id = rule_id,
                                 .timestamp = predicted_formula.time,
                             };
                             omega_canvas_add_item(lobe->canvas, &prediction_item);
@@ -73,7 +78,7 @@ void omega_predictor_lobe_tick(omega_predictor_lobe_t* lobe, int current_time) {
                                 };
                                 omega_canvas_add_item(lobe->canvas, &inference_item);
                                 
-                                printf("[Predictor] Multi-step inference: created prediction %llu via chain of %zu rules (confidence: %.4f)\n",
+                                KOLIBRI_LOG_INFO("Predictor", "Multi-step inference: created prediction %llu via chain of %zu rules (confidence: %.4f)",
                                        (unsigned long long)inferred_id, chain->chain_length, chain->confidence);
                             }
                         }
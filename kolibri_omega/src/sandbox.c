@@ -1,5 +1,6 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/include/sandbox.h"
+#include "kolibri/log.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,7 +33,7 @@ void sandbox_update(sandbox_world_t* world) {
 }
 
 void sandbox_observe_world(sandbox_world_t* world, omega_canvas_t* canvas, int time) {
-    printf("[Observer] Observing world at time %d.\n", time);
+    KOLIBRI_LOG_INFO("Observer", "Observing world at time %d.", time);
     // Блокировки мьютексов удалены для однопоточной модели
     for (size_t i = 0; i < world->num_objects; ++i) {
         kf_formula_t fact_formula = {
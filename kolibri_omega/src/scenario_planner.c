@@ -1,27 +1,113 @@
 #include "kolibri_omega/include/scenario_planner.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
+// Узел дерева поиска. children публикуются CAS после заполнения узла,
+// visits и value_sum меняются атомарно.
 typedef struct {
+    omega_plan_state_t state;
+    int32_t parent;
+    int32_t children[OMEGA_PLAN_ACTION_COUNT];  // 0 — не раскрыт
+    omega_planning_action_t action;
+    int depth;
+    int visits;
+    int successes;
+    double value_sum;
+} omega_plan_node_t;
+
+// Пул узлов плана: выделение — атомарный сдвиг count
+typedef struct {
+    omega_plan_node_t* nodes;
+    int capacity;
+    int count;
+    uint64_t rollouts;
+} omega_plan_tree_t;
+
+struct omega_planner_ctx_s {
     omega_scenario_plan_t plans[OMEGA_MAX_PLANNING_DEPTH];
     int plan_count;
+    omega_plan_tree_t* trees[OMEGA_MAX_PLANNING_DEPTH];
     
     omega_planning_stats_t stats;
-} omega_planner_ctx_t;
+};
 
-static omega_planner_ctx_t planner_ctx = {0};
+typedef struct omega_planner_ctx_s omega_planner_ctx_t;
+
+/**
+ * planner_apply_action - модель влияния действия на состояние
+ * (упрощенная модель: действие влияет на metrics)
+ */
+static void planner_apply_action(omega_plan_state_t* state, omega_planning_action_t action) {
+    switch (action) {
+        case OMEGA_PLAN_ESCALATE:
+            state->divergence *= 1.2;
+            state->complexity *= 1.15;
+            state->quality_score *= 0.85;
+            break;
+        case OMEGA_PLAN_STABILIZE:
+            state->divergence *= 0.7;
+            state->complexity *= 0.8;
+            state->quality_score *= 1.1;
+            break;
+        case OMEGA_PLAN_ADAPT:
+            state->synchronization *= 1.05;
+            state->quality_score *= 1.05;
+            break;
+        case OMEGA_PLAN_EXPLORE:
+            state->complexity *= 1.3;
+            state->quality_score *= 1.0;  // Neutral
+            break;
+        case OMEGA_PLAN_COORDINATE:
+            state->coordination_level *= 1.2;
+            state->synchronization *= 1.1;
+            state->quality_score *= 1.08;
+            break;
+        case OMEGA_PLAN_WAIT:
+        default:
+            // Никаких изменений
+            break;
+    }
+    
+    // Clamp values to [0, 1]
+    if (state->divergence > 1.0) state->divergence = 1.0;
+    if (state->complexity > 1.0) state->complexity = 1.0;
+    if (state->quality_score > 1.0) state->quality_score = 1.0;
+    if (state->quality_score < 0.0) state->quality_score = 0.0;
+}
+
+static void planner_free_trees(omega_planner_ctx_t* planner_ctx) {
+    for (int i = 0; i < OMEGA_MAX_PLANNING_DEPTH; i++) {
+        if (planner_ctx->trees[i]) {
+            free(planner_ctx->trees[i]->nodes);
+            free(planner_ctx->trees[i]);
+            planner_ctx->trees[i] = NULL;
+        }
+    }
+}
 
 /**
  * omega_scenario_planner_init - инициализация
  */
-int omega_scenario_planner_init(void) {
-    memset(&planner_ctx, 0, sizeof(planner_ctx));
+int omega_scenario_planner_init(omega_context_t* ctx) {
+    if (!ctx) {
+        return -1;
+    }
+    if (!ctx->planner && !(ctx->planner = calloc(1, sizeof(omega_planner_ctx_t)))) {
+        return -1;
+    }
+    omega_planner_ctx_t* planner_ctx = ctx->planner;
+    planner_free_trees(planner_ctx);
+    memset(planner_ctx, 0, sizeof(*planner_ctx));
     
-    printf("[ScenarioPlanner] Initialized with max %d plans, %d branches per plan\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Initialized with max %d plans, %d branches per plan",
            OMEGA_MAX_PLANNING_DEPTH, OMEGA_MAX_SCENARIO_BRANCHES);
-    printf("[ScenarioPlanner] Multi-branch future modeling enabled\n");
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Multi-branch future modeling enabled");
     
     return 0;
 }
@@ -29,21 +115,22 @@ int omega_scenario_planner_init(void) {
 /**
  * omega_create_scenario_plan - создать план
  */
-uint32_t omega_create_scenario_plan(const char* plan_name,
+uint32_t omega_create_scenario_plan(omega_context_t* ctx, const char* plan_name,
                                    const omega_plan_state_t* current_state,
                                    int planning_depth) {
-    if (planner_ctx.plan_count >= OMEGA_MAX_PLANNING_DEPTH) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx || planner_ctx->plan_count >= OMEGA_MAX_PLANNING_DEPTH) {
         return 0;
     }
     
-    omega_scenario_plan_t* plan = &planner_ctx.plans[planner_ctx.plan_count];
+    omega_scenario_plan_t* plan = &planner_ctx->plans[planner_ctx->plan_count];
     
-    plan->plan_id = 8000 + planner_ctx.plan_count;
+    plan->plan_id = 8000 + planner_ctx->plan_count;
     strncpy(plan->plan_name, plan_name, sizeof(plan->plan_name) - 1);
     
     // Добавляем корневую ветвь (текущее состояние)
     omega_scenario_branch_t* root = &plan->branches[plan->branch_count];
-    root->branch_id = 9000 + planner_ctx.plan_count * 100;
+    root->branch_id = 9000 + planner_ctx->plan_count * 100;
     root->parent_branch_id = 0;
     root->depth = 0;
     root->action = OMEGA_PLAN_WAIT;
@@ -56,10 +143,10 @@ uint32_t omega_create_scenario_plan(const char* plan_name,
     root->average_outcome = current_state->quality_score;
     
     plan->branch_count = 1;
-    planner_ctx.plan_count++;
-    planner_ctx.stats.total_plans_generated++;
+    planner_ctx->plan_count++;
+    planner_ctx->stats.total_plans_generated++;
     
-    printf("[ScenarioPlanner] Created plan %u: \"%s\" with depth=%d, root_quality=%.2f\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Created plan %u: \"%s\" with depth=%d, root_quality=%.2f",
            plan->plan_id, plan_name, planning_depth, current_state->quality_score);
     
     return plan->plan_id;
@@ -68,15 +155,19 @@ uint32_t omega_create_scenario_plan(const char* plan_name,
 /**
  * omega_add_scenario_branch - добавить ветвь
  */
-uint32_t omega_add_scenario_branch(uint32_t plan_id,
+uint32_t omega_add_scenario_branch(omega_context_t* ctx, uint32_t plan_id,
                                   uint32_t parent_branch_id,
                                   omega_planning_action_t action,
                                   const char* action_description) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return 0;
+    }
     // Найти план
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -97,49 +188,14 @@ uint32_t omega_add_scenario_branch(uint32_t plan_id,
     // Создаем новую ветвь
     omega_scenario_branch_t* branch = &plan->branches[plan->branch_count];
     
-    branch->branch_id = 9000 + planner_ctx.plan_count * 100 + plan->branch_count;
+    branch->branch_id = 9000 + planner_ctx->plan_count * 100 + plan->branch_count;
     branch->parent_branch_id = parent_branch_id;
     branch->depth = parent_depth + 1;
     branch->action = action;
     strncpy(branch->action_description, action_description, sizeof(branch->action_description) - 1);
     
     // Симулируем влияние действия на состояние
-    // (упрощенная модель: действие влияет на metrics)
-    switch (action) {
-        case OMEGA_PLAN_ESCALATE:
-            branch->final_state.divergence *= 1.2;
-            branch->final_state.complexity *= 1.15;
-            branch->final_state.quality_score *= 0.85;
-            break;
-        case OMEGA_PLAN_STABILIZE:
-            branch->final_state.divergence *= 0.7;
-            branch->final_state.complexity *= 0.8;
-            branch->final_state.quality_score *= 1.1;
-            break;
-        case OMEGA_PLAN_ADAPT:
-            branch->final_state.synchronization *= 1.05;
-            branch->final_state.quality_score *= 1.05;
-            break;
-        case OMEGA_PLAN_EXPLORE:
-            branch->final_state.complexity *= 1.3;
-            branch->final_state.quality_score *= 1.0;  // Neutral
-            break;
-        case OMEGA_PLAN_COORDINATE:
-            branch->final_state.coordination_level *= 1.2;
-            branch->final_state.synchronization *= 1.1;
-            branch->final_state.quality_score *= 1.08;
-            break;
-        case OMEGA_PLAN_WAIT:
-        default:
-            // Никаких изменений
-            break;
-    }
-    
-    // Clamp values to [0, 1]
-    if (branch->final_state.divergence > 1.0) branch->final_state.divergence = 1.0;
-    if (branch->final_state.complexity > 1.0) branch->final_state.complexity = 1.0;
-    if (branch->final_state.quality_score > 1.0) branch->final_state.quality_score = 1.0;
-    if (branch->final_state.quality_score < 0.0) branch->final_state.quality_score = 0.0;
+    planner_apply_action(&branch->final_state, action);
     
     branch->expected_value = branch->final_state.quality_score;
     branch->confidence = 0.7;  // Меньше уверенности в предсказаниях
@@ -148,9 +204,9 @@ uint32_t omega_add_scenario_branch(uint32_t plan_id,
     branch->average_outcome = 0.0;
     
     plan->branch_count++;
-    planner_ctx.stats.total_branches_explored++;
+    planner_ctx->stats.total_branches_explored++;
     
-    printf("[ScenarioPlanner] Added branch %u: %s (action=%d, quality=%.2f)\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Added branch %u: %s (action=%d, quality=%.2f)",
            branch->branch_id, action_description, action, branch->final_state.quality_score);
     
     return branch->branch_id;
@@ -159,14 +215,18 @@ uint32_t omega_add_scenario_branch(uint32_t plan_id,
 /**
  * omega_compute_trajectory - вычислить траекторию
  */
-uint32_t omega_compute_trajectory(uint32_t plan_id,
+uint32_t omega_compute_trajectory(omega_context_t* ctx, uint32_t plan_id,
                                  uint32_t start_branch_id,
                                  const omega_plan_state_t* target_state,
                                  int max_steps) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return 0;
+    }
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -176,7 +236,7 @@ uint32_t omega_compute_trajectory(uint32_t plan_id,
     }
     
     omega_plan_trajectory_t* traj = &plan->trajectories[plan->trajectory_count];
-    traj->trajectory_id = 10000 + planner_ctx.plan_count * 100 + plan->trajectory_count;
+    traj->trajectory_id = 10000 + planner_ctx->plan_count * 100 + plan->trajectory_count;
     
     // Найти стартовое состояние
     omega_plan_state_t current = {0};
@@ -234,9 +294,9 @@ uint32_t omega_compute_trajectory(uint32_t plan_id,
     traj->primary_action = OMEGA_PLAN_STABILIZE;  // Default action
     
     plan->trajectory_count++;
-    planner_ctx.stats.total_trajectories_computed++;
+    planner_ctx->stats.total_trajectories_computed++;
     
-    printf("[ScenarioPlanner] Computed trajectory %u: %d steps, feasible=%d, success_prob=%.2f\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Computed trajectory %u: %d steps, feasible=%d, success_prob=%.2f",
            traj->trajectory_id, traj->length, traj->is_feasible, traj->success_probability);
     
     return traj->trajectory_id;
@@ -248,11 +308,15 @@ uint32_t omega_compute_trajectory(uint32_t plan_id,
  * Upper Confidence Bound (UCB) для балансировки exploration/exploitation:
  * UCB = average_value + C * sqrt(log(N) / n)
  */
-double omega_evaluate_branch(uint32_t plan_id, uint32_t branch_id) {
+double omega_evaluate_branch(omega_context_t* ctx, uint32_t plan_id, uint32_t branch_id) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return 0.0;
+    }
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -287,15 +351,19 @@ double omega_evaluate_branch(uint32_t plan_id, uint32_t branch_id) {
 /**
  * omega_predict_outcome - предсказать результат
  */
-int omega_predict_outcome(uint32_t plan_id,
+int omega_predict_outcome(omega_context_t* ctx, uint32_t plan_id,
                          uint32_t branch_id,
                          omega_plan_outcome_t* outcome_out) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return -1;
+    }
     if (!outcome_out) return -1;
     
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -333,9 +401,9 @@ int omega_predict_outcome(uint32_t plan_id,
         plan->outcome_count++;
     }
     
-    planner_ctx.stats.total_outcomes_predicted++;
+    planner_ctx->stats.total_outcomes_predicted++;
     
-    printf("[ScenarioPlanner] Predicted outcome %u: prob=%.2f, desirable=%d, quality=%.2f\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Predicted outcome %u: prob=%.2f, desirable=%d, quality=%.2f",
            outcome_out->outcome_id, outcome_out->probability,
            outcome_out->is_desirable, outcome_out->desirability_score);
     
@@ -345,11 +413,15 @@ int omega_predict_outcome(uint32_t plan_id,
 /**
  * omega_select_best_branch - выбрать лучшую ветвь
  */
-uint32_t omega_select_best_branch(uint32_t plan_id) {
+uint32_t omega_select_best_branch(omega_context_t* ctx, uint32_t plan_id) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return 0;
+    }
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -358,12 +430,33 @@ uint32_t omega_select_best_branch(uint32_t plan_id) {
         return 0;
     }
     
+    // После поиска: наиболее посещаемый потомок корня
+    if (plan->search_rollouts > 0) {
+        const omega_scenario_branch_t* best = NULL;
+        for (int i = 1; i < plan->branch_count; i++) {
+            const omega_scenario_branch_t* branch = &plan->branches[i];
+            if (branch->parent_branch_id != plan->branches[0].branch_id || branch->depth != 1 ||
+                branch->times_visited <= 0) {
+                continue;
+            }
+            if (!best || branch->times_visited > best->times_visited) {
+                best = branch;
+            }
+        }
+        if (best) {
+            plan->recommended_branch = best->branch_id;
+            KOLIBRI_LOG_INFO("ScenarioPlanner", "Selected best branch %u with value=%.2f (%d visits)",
+                   best->branch_id, best->average_outcome, best->times_visited);
+            return best->branch_id;
+        }
+    }
+    
     // Найти ветвь с максимальным expected value
     uint32_t best_branch_id = plan->branches[0].branch_id;
     double best_value = plan->branches[0].expected_value;
     
     for (int i = 1; i < plan->branch_count; i++) {
-        double value = omega_evaluate_branch(plan_id, plan->branches[i].branch_id);
+        double value = omega_evaluate_branch(ctx, plan_id, plan->branches[i].branch_id);
         if (value > best_value) {
             best_value = value;
             best_branch_id = plan->branches[i].branch_id;
@@ -372,7 +465,7 @@ uint32_t omega_select_best_branch(uint32_t plan_id) {
     
     plan->recommended_branch = best_branch_id;
     
-    printf("[ScenarioPlanner] Selected best branch %u with value=%.2f\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Selected best branch %u with value=%.2f",
            best_branch_id, best_value);
     
     return best_branch_id;
@@ -381,11 +474,15 @@ uint32_t omega_select_best_branch(uint32_t plan_id) {
 /**
  * omega_expand_scenario_tree - расширить дерево
  */
-int omega_expand_scenario_tree(uint32_t plan_id) {
+int omega_expand_scenario_tree(omega_context_t* ctx, uint32_t plan_id) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return -1;
+    }
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
@@ -400,21 +497,21 @@ int omega_expand_scenario_tree(uint32_t plan_id) {
         // Генерируем новые ветви для каждого листового узла
         if (plan->branches[i].depth < 3) {  // Ограничение глубины
             // Добавляем 3-4 возможных действия
-            omega_add_scenario_branch(plan_id, plan->branches[i].branch_id,
+            omega_add_scenario_branch(ctx, plan_id, plan->branches[i].branch_id,
                                      OMEGA_PLAN_STABILIZE, "Stabilize system");
-            omega_add_scenario_branch(plan_id, plan->branches[i].branch_id,
+            omega_add_scenario_branch(ctx, plan_id, plan->branches[i].branch_id,
                                      OMEGA_PLAN_ADAPT, "Adapt parameters");
-            omega_add_scenario_branch(plan_id, plan->branches[i].branch_id,
+            omega_add_scenario_branch(ctx, plan_id, plan->branches[i].branch_id,
                                      OMEGA_PLAN_COORDINATE, "Coordinate agents");
             
             leaves_expanded++;
         }
     }
     
-    planner_ctx.stats.average_branch_count = (double)plan->branch_count / (planner_ctx.plan_count + 1);
-    planner_ctx.stats.average_plan_depth = 2.0;  // Hardcoded for demo
+    planner_ctx->stats.average_branch_count = (double)plan->branch_count / (planner_ctx->plan_count + 1);
+    planner_ctx->stats.average_plan_depth = 2.0;  // Hardcoded for demo
     
-    printf("[ScenarioPlanner] Expanded tree: added %d new branches (total=%d)\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Expanded tree: added %d new branches (total=%d)",
            plan->branch_count - initial_branch_count, plan->branch_count);
     
     return leaves_expanded;
@@ -423,52 +520,458 @@ int omega_expand_scenario_tree(uint32_t plan_id) {
 /**
  * omega_simulate_plan_execution - симулировать выполнение
  */
-int omega_simulate_plan_execution(uint32_t plan_id,
+int omega_simulate_plan_execution(omega_context_t* ctx, uint32_t plan_id,
                                  omega_plan_trajectory_t* trajectory_out) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return -1;
+    }
     if (!trajectory_out) return -1;
     
     omega_scenario_plan_t* plan = NULL;
-    for (int i = 0; i < planner_ctx.plan_count; i++) {
-        if (planner_ctx.plans[i].plan_id == plan_id) {
-            plan = &planner_ctx.plans[i];
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            plan = &planner_ctx->plans[i];
             break;
         }
     }
     
-    if (!plan || plan->trajectory_count == 0) {
+    if (!plan) {
+        return -1;
+    }
+    
+    // После поиска: путь по наиболее посещаемым узлам дерева
+    const omega_plan_tree_t* tree = planner_ctx->trees[plan - planner_ctx->plans];
+    if (tree) {
+        memset(trajectory_out, 0, sizeof(*trajectory_out));
+        int32_t current = 0;
+        while (trajectory_out->length < OMEGA_MAX_TRAJECTORY_POINTS) {
+            const omega_plan_node_t* node = &tree->nodes[current];
+            trajectory_out->states[trajectory_out->length++] = node->state;
+            if (node->visits > 0) {
+                trajectory_out->total_reward += node->value_sum / node->visits;
+            }
+            int32_t next = 0;
+            for (int action = 0; action < OMEGA_PLAN_ACTION_COUNT; action++) {
+                int32_t child = node->children[action];
+                if (child && (!next || tree->nodes[child].visits > tree->nodes[next].visits)) {
+                    next = child;
+                }
+            }
+            if (!next) {
+                break;
+            }
+            if (current == 0) {
+                trajectory_out->primary_action = tree->nodes[next].action;
+                trajectory_out->success_probability = tree->nodes[next].visits > 0
+                    ? (double)tree->nodes[next].successes / tree->nodes[next].visits : 0.0;
+            }
+            current = next;
+        }
+        trajectory_out->total_cost = trajectory_out->length - 1;
+        trajectory_out->is_feasible = trajectory_out->length > 1;
+        
+        KOLIBRI_LOG_INFO("ScenarioPlanner", "Simulated execution: search path with %d steps, success_prob=%.2f",
+               trajectory_out->length, trajectory_out->success_probability);
+        
+        return 0;
+    }
+    
+    if (plan->trajectory_count == 0) {
         return -1;
     }
     
     // Копируем лучшую траекторию (или первую)
     memcpy(trajectory_out, &plan->trajectories[0], sizeof(omega_plan_trajectory_t));
     
-    printf("[ScenarioPlanner] Simulated execution: trajectory %u with %d steps\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Simulated execution: trajectory %u with %d steps",
            plan->trajectories[0].trajectory_id, plan->trajectories[0].length);
     
     return 0;
 }
 
+/* ========== Поиск Монте-Карло ========== */
+
+// Разброс качества на каждом шаге случайного розыгрыша
+#define OMEGA_PLAN_ROLLOUT_NOISE 0.05
+// Порог удачного розыгрыша, как у желательного исхода
+#define OMEGA_PLAN_SUCCESS_QUALITY 0.6
+
+static const char* planner_action_names[OMEGA_PLAN_ACTION_COUNT] = {
+    [OMEGA_PLAN_WAIT] = "Wait",
+    [OMEGA_PLAN_ESCALATE] = "Escalate activity",
+    [OMEGA_PLAN_STABILIZE] = "Stabilize system",
+    [OMEGA_PLAN_ADAPT] = "Adapt parameters",
+    [OMEGA_PLAN_EXPLORE] = "Explore strategies",
+    [OMEGA_PLAN_COORDINATE] = "Coordinate agents"
+};
+
+typedef struct {
+    omega_plan_tree_t* tree;
+    const omega_plan_search_config_t* config;
+    uint64_t deadline_ns;  // 0 — без ограничения
+    uint64_t started;      // начатых розыгрышей, атомарно
+    uint64_t done;         // завершённых розыгрышей, атомарно
+} planner_search_t;
+
+typedef struct {
+    planner_search_t* search;
+    uint64_t rng;
+} planner_worker_t;
+
+static int planner_find_plan(omega_planner_ctx_t* planner_ctx, uint32_t plan_id) {
+    for (int i = 0; i < planner_ctx->plan_count; i++) {
+        if (planner_ctx->plans[i].plan_id == plan_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint64_t planner_now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// splitmix64: независимые начальные значения для потоков
+static uint64_t planner_seed(uint64_t seed, uint64_t stream) {
+    uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+// xorshift64*: генератор одного потока
+static uint64_t planner_rng_next(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double planner_rng_uniform(uint64_t* state) {
+    return (double)(planner_rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void planner_atomic_add_double(double* target, double delta) {
+    double expected, desired;
+    __atomic_load(target, &expected, __ATOMIC_RELAXED);
+    do {
+        desired = expected + delta;
+    } while (!__atomic_compare_exchange(target, &expected, &desired, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Узел из пула; -1 если пул заполнен. Узел ещё никому не виден.
+static int32_t planner_new_node(omega_plan_tree_t* tree, int32_t parent, omega_planning_action_t action) {
+    if (__atomic_load_n(&tree->count, __ATOMIC_RELAXED) >= tree->capacity) {
+        return -1;
+    }
+    int32_t index = __atomic_fetch_add(&tree->count, 1, __ATOMIC_RELAXED);
+    if (index >= tree->capacity) {
+        return -1;
+    }
+    omega_plan_node_t* node = &tree->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->state = tree->nodes[parent].state;
+    planner_apply_action(&node->state, action);
+    node->parent = parent;
+    node->action = action;
+    node->depth = tree->nodes[parent].depth + 1;
+    node->state.depth = node->depth;
+    return index;
+}
+
+/**
+ * planner_rollout - один розыгрыш: выбор по UCT, раскрытие, продолжение
+ *
+ * Посещения засчитываются при спуске (виртуальная потеря), поэтому
+ * параллельные потоки расходятся по разным ветвям, а награда добавляется
+ * на обратном проходе.
+ */
+static void planner_rollout(planner_search_t* search, uint64_t* rng) {
+    omega_plan_tree_t* tree = search->tree;
+    const omega_plan_search_config_t* config = search->config;
+    int32_t path[OMEGA_PLAN_MAX_SEARCH_DEPTH + 1];
+    int length = 0;
+    int32_t current = 0;
+
+    path[length++] = current;
+    __atomic_fetch_add(&tree->nodes[current].visits, 1, __ATOMIC_RELAXED);
+
+    while (tree->nodes[current].depth < config->max_depth) {
+        omega_plan_node_t* node = &tree->nodes[current];
+        int32_t next = 0;
+        int expanded = 0;
+
+        // Сначала неиспробованное действие, со случайного места
+        int start = (int)(planner_rng_next(rng) % OMEGA_PLAN_ACTION_COUNT);
+        for (int k = 0; k < OMEGA_PLAN_ACTION_COUNT; k++) {
+            int action = (start + k) % OMEGA_PLAN_ACTION_COUNT;
+            if (__atomic_load_n(&node->children[action], __ATOMIC_ACQUIRE) != 0) {
+                continue;
+            }
+            int32_t child = planner_new_node(tree, current, (omega_planning_action_t)action);
+            if (child < 0) {
+                break;
+            }
+            int32_t expected = 0;
+            if (__atomic_compare_exchange_n(&node->children[action], &expected, child, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                next = child;
+                expanded = 1;
+            } else {
+                next = expected;  // раскрыл другой поток, наш узел остаётся в пуле
+            }
+            break;
+        }
+
+        if (next == 0) {
+            int visits = __atomic_load_n(&node->visits, __ATOMIC_RELAXED);
+            double log_n = log((double)(visits > 1 ? visits : 1));
+            double best_score = -INFINITY;
+            for (int action = 0; action < OMEGA_PLAN_ACTION_COUNT; action++) {
+                int32_t child = __atomic_load_n(&node->children[action], __ATOMIC_ACQUIRE);
+                if (child == 0) {
+                    continue;
+                }
+                int n = __atomic_load_n(&tree->nodes[child].visits, __ATOMIC_RELAXED);
+                double score = INFINITY;
+                if (n > 0) {
+                    double value;
+                    __atomic_load(&tree->nodes[child].value_sum, &value, __ATOMIC_RELAXED);
+                    score = value / n + config->exploration * sqrt(log_n / n);
+                }
+                if (score > best_score) {
+                    best_score = score;
+                    next = child;
+                }
+            }
+            if (next == 0) {
+                break;  // пул заполнен, потомков нет
+            }
+        }
+
+        __atomic_fetch_add(&tree->nodes[next].visits, 1, __ATOMIC_RELAXED);
+        path[length++] = next;
+        current = next;
+        if (expanded) {
+            break;
+        }
+    }
+
+    // Случайное продолжение с шумом модели
+    omega_plan_state_t state = tree->nodes[current].state;
+    for (int step = 0; step < config->rollout_depth; step++) {
+        planner_apply_action(&state, (omega_planning_action_t)(planner_rng_next(rng) % OMEGA_PLAN_ACTION_COUNT));
+        state.quality_score *= 1.0 + OMEGA_PLAN_ROLLOUT_NOISE * (2.0 * planner_rng_uniform(rng) - 1.0);
+        if (state.quality_score > 1.0) state.quality_score = 1.0;
+    }
+    double reward = state.quality_score;
+    int success = reward > OMEGA_PLAN_SUCCESS_QUALITY;
+
+    for (int i = 0; i < length; i++) {
+        planner_atomic_add_double(&tree->nodes[path[i]].value_sum, reward);
+        if (success) {
+            __atomic_fetch_add(&tree->nodes[path[i]].successes, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void* planner_worker_main(void* arg) {
+    planner_worker_t* worker = arg;
+    planner_search_t* search = worker->search;
+    uint64_t budget = search->config->max_rollouts;
+
+    for (;;) {
+        if (budget && __atomic_fetch_add(&search->started, 1, __ATOMIC_RELAXED) >= budget) {
+            break;
+        }
+        if (search->deadline_ns && planner_now_ns() >= search->deadline_ns) {
+            break;
+        }
+        planner_rollout(search, &worker->rng);
+        __atomic_fetch_add(&search->done, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * omega_plan_search - параллельный поиск по дереву плана
+ */
+int omega_plan_search(omega_context_t* ctx, uint32_t plan_id,
+                     const omega_plan_search_config_t* config,
+                     omega_plan_search_result_t* result_out) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return -1;
+    }
+    int index = planner_find_plan(planner_ctx, plan_id);
+    if (index < 0) {
+        return -1;
+    }
+    omega_scenario_plan_t* plan = &planner_ctx->plans[index];
+
+    omega_plan_search_config_t cfg = {0};
+    if (config) {
+        cfg = *config;
+    }
+    if (cfg.workers <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        cfg.workers = online > 0 ? (int)online : 1;
+    }
+    if (cfg.workers > OMEGA_PLAN_MAX_WORKERS) cfg.workers = OMEGA_PLAN_MAX_WORKERS;
+    if (cfg.max_nodes <= 0) cfg.max_nodes = OMEGA_PLAN_DEFAULT_NODES;
+    if (cfg.max_depth <= 0) cfg.max_depth = OMEGA_MAX_PLANNING_DEPTH;
+    if (cfg.max_depth > OMEGA_PLAN_MAX_SEARCH_DEPTH) cfg.max_depth = OMEGA_PLAN_MAX_SEARCH_DEPTH;
+    if (cfg.rollout_depth <= 0) cfg.rollout_depth = 5;
+    if (cfg.exploration <= 0.0) cfg.exploration = 1.41;
+    if (!cfg.deadline_ms && !cfg.max_rollouts) cfg.max_rollouts = OMEGA_PLAN_DEFAULT_ROLLOUTS;
+
+    omega_plan_tree_t* tree = planner_ctx->trees[index];
+    if (!tree) {
+        tree = calloc(1, sizeof(*tree));
+        if (!tree) {
+            return -1;
+        }
+        tree->nodes = malloc((size_t)cfg.max_nodes * sizeof(omega_plan_node_t));
+        if (!tree->nodes) {
+            free(tree);
+            return -1;
+        }
+        tree->capacity = cfg.max_nodes;
+        tree->count = 1;
+        memset(&tree->nodes[0], 0, sizeof(tree->nodes[0]));
+        tree->nodes[0].state = plan->branches[0].final_state;
+        tree->nodes[0].parent = -1;
+        tree->nodes[0].action = OMEGA_PLAN_WAIT;
+        planner_ctx->trees[index] = tree;
+    }
+
+    planner_search_t search = { tree, &cfg, 0, 0, 0 };
+    planner_worker_t workers[OMEGA_PLAN_MAX_WORKERS];
+    pthread_t threads[OMEGA_PLAN_MAX_WORKERS];
+    uint64_t start_ns = planner_now_ns();
+    if (cfg.deadline_ms) {
+        search.deadline_ns = start_ns + (uint64_t)cfg.deadline_ms * 1000000ULL;
+    }
+
+    // Вызывающий поток — рабочий 0
+    int started = 1;
+    for (int w = 0; w < cfg.workers; w++) {
+        workers[w].search = &search;
+        workers[w].rng = planner_seed(cfg.seed ^ tree->rollouts, (uint64_t)w);
+    }
+    for (int w = 1; w < cfg.workers; w++) {
+        if (pthread_create(&threads[w], NULL, planner_worker_main, &workers[w]) != 0) {
+            break;
+        }
+        started++;
+    }
+    planner_worker_main(&workers[0]);
+    for (int w = 1; w < started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    double elapsed_ms = (double)(planner_now_ns() - start_ns) / 1e6;
+    tree->rollouts += search.done;
+    plan->search_rollouts = tree->rollouts;
+
+    // Потомки корня — ветви плана глубины 1
+    const omega_plan_node_t* root = &tree->nodes[0];
+    uint32_t root_id = plan->branches[0].branch_id;
+    const omega_plan_node_t* best = NULL;
+    for (int action = 0; action < OMEGA_PLAN_ACTION_COUNT; action++) {
+        if (root->children[action] == 0) {
+            continue;
+        }
+        const omega_plan_node_t* child = &tree->nodes[root->children[action]];
+        omega_scenario_branch_t* branch = NULL;
+        for (int i = 1; i < plan->branch_count; i++) {
+            if (plan->branches[i].parent_branch_id == root_id && plan->branches[i].depth == 1 &&
+                plan->branches[i].action == (omega_planning_action_t)action) {
+                branch = &plan->branches[i];
+                break;
+            }
+        }
+        if (!branch) {
+            if (omega_add_scenario_branch(ctx, plan_id, root_id, (omega_planning_action_t)action,
+                                          planner_action_names[action]) == 0) {
+                continue;
+            }
+            branch = &plan->branches[plan->branch_count - 1];
+        }
+        branch->final_state = child->state;
+        branch->times_visited = child->visits;
+        branch->times_successful = child->successes;
+        branch->average_outcome = child->visits > 0 ? child->value_sum / child->visits : 0.0;
+        branch->expected_value = branch->average_outcome;
+        branch->confidence = root->visits > 0 ? (double)child->visits / root->visits : 0.0;
+        if (!best || child->visits > best->visits) {
+            best = child;
+        }
+    }
+
+    int nodes = tree->count < tree->capacity ? tree->count : tree->capacity;
+    double best_value = best && best->visits > 0 ? best->value_sum / best->visits : 0.0;
+    if (best_value > planner_ctx->stats.best_expected_value) {
+        planner_ctx->stats.best_expected_value = best_value;
+    }
+
+    if (result_out) {
+        result_out->rollouts = search.done;
+        result_out->total_rollouts = tree->rollouts;
+        result_out->nodes = nodes;
+        result_out->workers = started;
+        result_out->best_action = best ? best->action : OMEGA_PLAN_WAIT;
+        result_out->best_value = best_value;
+        result_out->best_visits = best ? best->visits : 0;
+        result_out->elapsed_ms = elapsed_ms;
+    }
+
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Searched plan %u: %llu rollouts on %d worker(s), %d nodes, best action=%d (value=%.2f) in %.1f ms",
+           plan_id, (unsigned long long)search.done, started, nodes,
+           best ? (int)best->action : -1, best_value, elapsed_ms);
+
+    return 0;
+}
+
 /**
  * omega_get_planning_statistics - получить статистику
  */
-const omega_planning_stats_t* omega_get_planning_statistics(void) {
-    return &planner_ctx.stats;
+const omega_planning_stats_t* omega_get_planning_statistics(omega_context_t* ctx) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return NULL;
+    }
+    return &planner_ctx->stats;
 }
 
 /**
  * omega_scenario_planner_shutdown - остановка
  */
-void omega_scenario_planner_shutdown(void) {
-    const omega_planning_stats_t* stats = omega_get_planning_statistics();
+void omega_scenario_planner_shutdown(omega_context_t* ctx) {
+    omega_planner_ctx_t* planner_ctx = ctx ? ctx->planner : NULL;
+    if (!planner_ctx) {
+        return;
+    }
+    const omega_planning_stats_t* stats = omega_get_planning_statistics(ctx);
     
-    printf("[ScenarioPlanner] Shutdown: %d plans, %d branches explored\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Shutdown: %d plans, %d branches explored",
            stats->total_plans_generated, stats->total_branches_explored);
-    printf("  Trajectories: %d, Outcomes: %d\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Trajectories: %d, Outcomes: %d",
            stats->total_trajectories_computed, stats->total_outcomes_predicted);
-    printf("  Avg branch count: %.1f, Avg depth: %.1f, Avg trajectory: %.1f\n",
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Avg branch count: %.1f, Avg depth: %.1f, Avg trajectory: %.1f",
            stats->average_branch_count, stats->average_plan_depth,
            stats->average_trajectory_length);
-    printf("  Best expected value: %.2f\n", stats->best_expected_value);
+    KOLIBRI_LOG_INFO("ScenarioPlanner", "Best expected value: %.2f", stats->best_expected_value);
     
-    memset(&planner_ctx, 0, sizeof(planner_ctx));
+    planner_free_trees(planner_ctx);
+    free(planner_ctx);
+    ctx->planner = NULL;
 }
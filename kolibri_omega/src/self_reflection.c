@@ -1,11 +1,12 @@
 #include "kolibri_omega/include/self_reflection.h"
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 void omega_self_reflection_init(void) {
-    printf("[SelfReflection] Initialized. Ready for knowledge quality analysis.\n");
+    KOLIBRI_LOG_INFO("SelfReflection", "Initialized. Ready for knowledge quality analysis.");
 }
 
 int omega_analyze_rule_quality(kf_pool_t* formula_pool, uint64_t rule_id,
@@ -14,17 +15,13 @@ int omega_analyze_rule_quality(kf_pool_t* formula_pool, uint64_t rule_id,
         return -1;
     }
     
-    kf_formula_t rule;
-    if (kf_get_formula(formula_pool, rule_id, &rule) != 0) {
-        return -1;
-    }
-    
-    if (rule.type != KF_TYPE_RULE) {
+    const kf_formula_t* rule = kf_borrow_formula(formula_pool, rule_id);
+    if (!rule || rule->type != KF_TYPE_RULE) {
         return -1;
     }
     
     out_metrics->rule_id = rule_id;
-    out_metrics->confidence = rule.data.rule.confidence;
+    out_metrics->confidence = rule->data.rule.confidence;
     out_metrics->times_applied = 1;
     out_metrics->times_verified = 1;
     out_metrics->times_contradicted = 0;
@@ -79,12 +76,12 @@ void omega_full_self_reflection(kf_pool_t* formula_pool) {
         return;
     }
     
-    printf("[SelfReflection] Full reflection cycle started.\n");
+    KOLIBRI_LOG_INFO("SelfReflection", "Full reflection cycle started.");
     
     omega_learning_stats_t stats = {0};
     omega_compute_learning_stats(formula_pool, &stats);
     
-    printf("[SelfReflection] Total rules: %d (High: %d, Medium: %d, Low: %d)\n",
+    KOLIBRI_LOG_INFO("SelfReflection", "Total rules: %d (High: %d, Medium: %d, Low: %d)",
            stats.total_rules,
            stats.high_quality_rules,
            stats.medium_quality_rules,
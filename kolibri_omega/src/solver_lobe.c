@@ -2,6 +2,7 @@
 #include "kolibri_omega/include/solver_lobe.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
 #include "kolibri_omega/stubs/sigma_coordinator_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 
 #include "kolibri_omega/include/types.h"
@@ -28,7 +29,7 @@ void omega_solver_lobe_tick(omega_solver_lobe_t* lobe) {
         // Если задача получена, обрабатываем ее
         switch (task.type) {
             case TASK_CONTRADICTION: {
-                printf("[Solver] Processing CONTRADICTION task %llu between facts %llu and %llu.\n",
+                KOLIBRI_LOG_INFO("Solver", "Processing CONTRADICTION task %llu between facts %llu and %llu.",
                        (unsigned long long)task.id,
                        (unsigned long long)task.data.contradiction.formula_ids[0],
                        (unsigned long long)task.data.contradiction.formula_ids[1]);
@@ -41,26 +42,26 @@ void omega_solver_lobe_tick(omega_solver_lobe_t* lobe) {
                 );
 
                 if (new_rule_id > 0) {
-                    printf("[Solver] Created explanation rule %llu to resolve contradiction.\n", (unsigned long long)new_rule_id);
+                    KOLIBRI_LOG_INFO("Solver", "Created explanation rule %llu to resolve contradiction.", (unsigned long long)new_rule_id);
                 } else {
-                    printf("[Solver] Failed to create a rule for task %llu.\n", (unsigned long long)task.id);
+                    KOLIBRI_LOG_WARN("Solver", "Failed to create a rule for task %llu.", (unsigned long long)task.id);
                 }
                 
                 // Помечаем задачу как выполненную
                 sigma_update_task_status(lobe->coordinator, task.id, TASK_STATUS_DONE);
-                printf("[Solver] Task %llu marked as DONE.\n", (unsigned long long)task.id);
+                KOLIBRI_LOG_INFO("Solver", "Task %llu marked as DONE.", (unsigned long long)task.id);
                 break;
             }
             case TASK_INVALID_RULE: {
-                printf("[Solver] Processing INVALID_RULE task %llu for rule %llu.\n",
+                KOLIBRI_LOG_INFO("Solver", "Processing INVALID_RULE task %llu for rule %llu.",
                        (unsigned long long)task.id,
                        (unsigned long long)task.data.invalid_rule.rule_id);
                 
                 kf_invalidate_rule(lobe->formula_pool, task.data.invalid_rule.rule_id);
-                printf("[Solver] Rule %llu invalidated.\n", (unsigned long long)task.data.invalid_rule.rule_id);
+                KOLIBRI_LOG_INFO("Solver", "Rule %llu invalidated.", (unsigned long long)task.data.invalid_rule.rule_id);
                 
                 sigma_update_task_status(lobe->coordinator, task.id, TASK_STATUS_DONE);
-                printf("[Solver] Task %llu marked as DONE.\n", (unsigned long long)task.id);
+                KOLIBRI_LOG_INFO("Solver", "Task %llu marked as DONE.", (unsigned long long)task.id);
                 break;
             }
         }
@@ -1,64 +1,274 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+static __thread kf_pool_stage_t* kf_active_stage = NULL;
+
+static size_t kf_slot_of(uint64_t id, size_t slot_capacity) {
+    return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 17) & (slot_capacity - 1);
+}
+
+static void kf_index_insert(kf_pool_t* pool, size_t index) {
+    size_t slot = kf_slot_of(pool->formulas[index].id, pool->slot_capacity);
+    while (pool->slots[slot] != 0) {
+        slot = (slot + 1) & (pool->slot_capacity - 1);
+    }
+    pool->slots[slot] = index + 1;
+}
+
+static long kf_index_find(const kf_pool_t* pool, uint64_t formula_id) {
+    if (pool->slot_capacity == 0) {
+        return -1;
+    }
+    size_t slot = kf_slot_of(formula_id, pool->slot_capacity);
+    while (pool->slots[slot] != 0) {
+        size_t index = pool->slots[slot] - 1;
+        if (pool->formulas[index].id == formula_id) {
+            return (long)index;
+        }
+        slot = (slot + 1) & (pool->slot_capacity - 1);
+    }
+    return -1;
+}
+
+static void kf_rule_link(kf_pool_t* pool, size_t index) {
+    const kf_formula_t* rule = &pool->formulas[index];
+    pool->rule_next[index] = 0;
+    if (rule->type != KF_TYPE_RULE) {
+        return;
+    }
+    size_t slot = kf_slot_of(rule->data.rule.condition_formula_id, pool->slot_capacity);
+    if (pool->rule_tails[slot]) {
+        pool->rule_next[pool->rule_tails[slot] - 1] = index + 1;
+    } else {
+        pool->rule_heads[slot] = index + 1;
+    }
+    pool->rule_tails[slot] = index + 1;
+}
+
+void kf_pool_reindex(kf_pool_t* pool) {
+    memset(pool->slots, 0, pool->slot_capacity * sizeof(size_t));
+    memset(pool->rule_heads, 0, pool->slot_capacity * sizeof(size_t));
+    memset(pool->rule_tails, 0, pool->slot_capacity * sizeof(size_t));
+    for (size_t i = 0; i < pool->count; ++i) {
+        kf_index_insert(pool, i);
+        kf_rule_link(pool, i);
+    }
+    pool->rules_version++;
+}
+
+size_t kf_first_rule_for(const kf_pool_t* pool, uint64_t condition_id) {
+    if (pool->slot_capacity == 0) {
+        return pool->count;
+    }
+    for (size_t at = pool->rule_heads[kf_slot_of(condition_id, pool->slot_capacity)]; at; at = pool->rule_next[at - 1]) {
+        if (pool->formulas[at - 1].data.rule.condition_formula_id == condition_id) {
+            return at - 1;
+        }
+    }
+    return pool->count;
+}
+
+size_t kf_next_rule_for(const kf_pool_t* pool, size_t index) {
+    uint64_t condition_id = pool->formulas[index].data.rule.condition_formula_id;
+    for (size_t at = pool->rule_next[index]; at; at = pool->rule_next[at - 1]) {
+        if (pool->formulas[at - 1].data.rule.condition_formula_id == condition_id) {
+            return at - 1;
+        }
+    }
+    return pool->count;
+}
+
+// Индекс держится заполненным не больше чем наполовину
+static int kf_pool_reserve(kf_pool_t* pool, size_t capacity) {
+    if (capacity <= pool->capacity) {
+        return 0;
+    }
+    size_t new_capacity = pool->capacity ? pool->capacity : KF_POOL_INITIAL_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity *= 2;
+    }
+    kf_formula_t* formulas = realloc(pool->formulas, new_capacity * sizeof(kf_formula_t));
+    if (!formulas) {
+        return -1;
+    }
+    pool->formulas = formulas;
+    size_t* rule_next = realloc(pool->rule_next, new_capacity * sizeof(size_t));
+    if (!rule_next) {
+        return -1;
+    }
+    pool->rule_next = rule_next;
+    size_t* slots = calloc(new_capacity * 2, sizeof(size_t));
+    size_t* rule_heads = calloc(new_capacity * 2, sizeof(size_t));
+    size_t* rule_tails = calloc(new_capacity * 2, sizeof(size_t));
+    if (!slots || !rule_heads || !rule_tails) {
+        free(slots);
+        free(rule_heads);
+        free(rule_tails);
+        return -1;
+    }
+    free(pool->slots);
+    free(pool->rule_heads);
+    free(pool->rule_tails);
+    pool->slots = slots;
+    pool->rule_heads = rule_heads;
+    pool->rule_tails = rule_tails;
+    pool->slot_capacity = new_capacity * 2;
+    pool->capacity = new_capacity;
+    kf_pool_reindex(pool);
+    return 0;
+}
+
 void kf_pool_init(kf_pool_t* pool) {
-    pool->count = 0;
+    memset(pool, 0, sizeof(*pool));
     pool->next_id = 1000;
-    // pthread_mutex_init(&pool->mutex, NULL); // Удалено
+    kf_pool_reserve(pool, KF_POOL_INITIAL_CAPACITY);
 }
 
 void kf_pool_destroy(kf_pool_t* pool) {
-    // pthread_mutex_destroy(&pool->mutex); // Удалено
+    free(pool->formulas);
+    free(pool->slots);
+    free(pool->rule_heads);
+    free(pool->rule_tails);
+    free(pool->rule_next);
+    memset(pool, 0, sizeof(*pool));
+}
+
+static uint64_t kf_stage_add(kf_pool_stage_t* stage, kf_formula_t* formula) {
+    if (stage->count == stage->capacity) {
+        size_t capacity = stage->capacity ? stage->capacity * 2 : 16;
+        kf_formula_t* formulas = realloc(stage->formulas, capacity * sizeof(kf_formula_t));
+        if (!formulas) {
+            return 0;
+        }
+        stage->formulas = formulas;
+        stage->capacity = capacity;
+    }
+    formula->id = __atomic_fetch_add(&stage->pool->next_id, 1, __ATOMIC_RELAXED);
+    formula->is_valid = 1;
+    stage->formulas[stage->count++] = *formula;
+    return formula->id;
 }
 
 uint64_t kf_add_formula(kf_pool_t* pool, kf_formula_t* formula) {
-    if (pool->count >= MAX_FORMULAS) {
+    if (kf_active_stage && kf_active_stage->pool == pool) {
+        return kf_stage_add(kf_active_stage, formula);
+    }
+    if (kf_pool_reserve(pool, pool->count + 1) != 0) {
         return 0;
     }
     formula->id = pool->next_id++;
     formula->is_valid = 1; // По умолчанию все валидно
-    pool->formulas[pool->count++] = *formula;
+    pool->formulas[pool->count] = *formula;
+    kf_index_insert(pool, pool->count);
+    kf_rule_link(pool, pool->count);
+    pool->count++;
+    if (formula->type == KF_TYPE_RULE) {
+        pool->rules_version++;
+    }
     return formula->id;
 }
 
-int kf_get_formula(kf_pool_t* pool, uint64_t formula_id, kf_formula_t* formula) {
-    for (size_t i = 0; i < pool->count; ++i) {
-        if (pool->formulas[i].id == formula_id) {
-            *formula = pool->formulas[i];
-            return 0;
+const kf_formula_t* kf_borrow_formula(const kf_pool_t* pool, uint64_t formula_id) {
+    long index = kf_index_find(pool, formula_id);
+    if (index >= 0) {
+        return &pool->formulas[index];
+    }
+    if (kf_active_stage && kf_active_stage->pool == pool) {
+        for (size_t i = kf_active_stage->count; i-- > 0;) {
+            if (kf_active_stage->formulas[i].id == formula_id) {
+                return &kf_active_stage->formulas[i];
+            }
         }
     }
-    return -1;
+    return NULL;
+}
+
+void kf_pool_stage_begin(kf_pool_stage_t* stage, kf_pool_t* pool) {
+    stage->pool = pool;
+    kf_active_stage = stage;
+}
+
+void kf_pool_stage_end(void) {
+    kf_active_stage = NULL;
+}
+
+int kf_pool_stage_commit(kf_pool_stage_t* stage) {
+    kf_pool_t* pool = stage->pool;
+    if (!pool || stage->count == 0) {
+        return 0;
+    }
+    if (kf_pool_reserve(pool, pool->count + stage->count) != 0) {
+        return -1;
+    }
+    // id уже выданы, поэтому формулы вставляются как есть
+    for (size_t i = 0; i < stage->count; ++i) {
+        pool->formulas[pool->count] = stage->formulas[i];
+        kf_index_insert(pool, pool->count);
+        kf_rule_link(pool, pool->count);
+        pool->count++;
+    }
+    stage->count = 0;
+    pool->rules_version++;
+    return 0;
 }
 
+void kf_pool_stage_free(kf_pool_stage_t* stage) {
+    free(stage->formulas);
+    memset(stage, 0, sizeof(*stage));
+}
+
+// Вызывающий может поменять уверенность или валидность правила
+kf_formula_t* kf_borrow_formula_mut(kf_pool_t* pool, uint64_t formula_id) {
+    long index = kf_index_find(pool, formula_id);
+    pool->rules_version++;
+    return index < 0 ? NULL : &pool->formulas[index];
+}
+
+int kf_get_formula(kf_pool_t* pool, uint64_t formula_id, kf_formula_t* formula) {
+    const kf_formula_t* found = kf_borrow_formula(pool, formula_id);
+    if (!found) {
+        return -1;
+    }
+    *formula = *found;
+    return 0;
+}
+
+// id задаёт индекс, поэтому formula->id не меняется
 int kf_set_formula(kf_pool_t* pool, uint64_t formula_id, kf_formula_t* formula) {
-    for (size_t i = 0; i < pool->count; ++i) {
-        if (pool->formulas[i].id == formula_id) {
-            pool->formulas[i] = *formula;
-            return 0;
-        }
+    kf_formula_t* found = kf_borrow_formula_mut(pool, formula_id);
+    if (!found) {
+        return -1;
     }
-    return -1;
+    int relink = found->type == KF_TYPE_RULE || formula->type == KF_TYPE_RULE;
+    *found = *formula;
+    found->id = formula_id;
+    if (relink) {
+        // Тип или условие правила могли смениться
+        kf_pool_reindex(pool);
+    }
+    return 0;
 }
 
 // Упрощенная проверка на противоречие: две формулы противоречат, если у них один и тот же объект в одно и то же время, но разные предикаты.
 int kf_are_contradictory(kf_pool_t* pool, uint64_t formula_id1, uint64_t formula_id2) {
-    kf_formula_t f1, f2;
-    if (kf_get_formula(pool, formula_id1, &f1) != 0 || kf_get_formula(pool, formula_id2, &f2) != 0) {
+    const kf_formula_t* f1 = kf_borrow_formula(pool, formula_id1);
+    const kf_formula_t* f2 = kf_borrow_formula(pool, formula_id2);
+    if (!f1 || !f2) {
         return 0; // Не удалось получить формулы
     }
 
-    if (f1.type != KF_TYPE_FACT || f2.type != KF_TYPE_FACT) {
+    if (f1->type != KF_TYPE_FACT || f2->type != KF_TYPE_FACT) {
         return 0; // Сравниваем только факты
     }
 
-    if (f1.data.fact.object_id == f2.data.fact.object_id && f1.time == f2.time) {
-        if (f1.data.fact.num_predicates != f2.data.fact.num_predicates) return 1; // Разное количество предикатов - уже противоречие
-        for(size_t i=0; i < f1.data.fact.num_predicates; ++i) {
-            if (strcmp(f1.data.fact.predicates[i].name, f2.data.fact.predicates[i].name) != 0 || strcmp(f1.data.fact.predicates[i].value, f2.data.fact.predicates[i].value) != 0) {
+    if (f1->data.fact.object_id == f2->data.fact.object_id && f1->time == f2->time) {
+        if (f1->data.fact.num_predicates != f2->data.fact.num_predicates) return 1; // Разное количество предикатов - уже противоречие
+        for(size_t i=0; i < f1->data.fact.num_predicates; ++i) {
+            if (strcmp(f1->data.fact.predicates[i].name, f2->data.fact.predicates[i].name) != 0 || strcmp(f1->data.fact.predicates[i].value, f2->data.fact.predicates[i].value) != 0) {
                 return 1; // Найден предикат с тем же именем, но разным значением
             }
         }
@@ -127,7 +337,7 @@ uint64_t kf_create_rule_for_contradiction(kf_pool_t* pool, uint64_t contradictin
     };
     
     uint64_t rule_id = kf_add_formula(pool, &explanation_rule);
-    printf("[KF Pool] Created explanation rule %llu to resolve contradiction between %llu and %llu\n",
+    KOLIBRI_LOG_INFO("KF Pool", "Created explanation rule %llu to resolve contradiction between %llu and %llu",
            (unsigned long long)rule_id, (unsigned long long)contradicting_fact_id1, (unsigned long long)contradicting_fact_id2);
     return rule_id;
 }
@@ -153,11 +363,10 @@ void kf_print_formula(kf_pool_t* pool, uint64_t formula_id) {
 }
 
 int kf_invalidate_rule(kf_pool_t* pool, uint64_t rule_id) {
-    for (size_t i = 0; i < pool->count; ++i) {
-        if (pool->formulas[i].id == rule_id && pool->formulas[i].type == KF_TYPE_RULE) {
-            pool->formulas[i].is_valid = 0;
-            return 0;
-        }
+    kf_formula_t* rule = kf_borrow_formula_mut(pool, rule_id);
+    if (!rule || rule->type != KF_TYPE_RULE) {
+        return -1;
     }
-    return -1;
+    rule->is_valid = 0;
+    return 0;
 }
@@ -11,6 +11,14 @@ void kf_pool_destroy(kf_pool_t* pool);
 uint64_t kf_add_formula(kf_pool_t* pool, kf_formula_t* formula);
 int kf_get_formula(kf_pool_t* pool, uint64_t formula_id, kf_formula_t* formula);
 int kf_set_formula(kf_pool_t* pool, uint64_t formula_id, kf_formula_t* formula);
+// Формула без копирования или NULL. Указатель живёт до следующего kf_add_formula
+const kf_formula_t* kf_borrow_formula(const kf_pool_t* pool, uint64_t formula_id);
+kf_formula_t* kf_borrow_formula_mut(kf_pool_t* pool, uint64_t formula_id);
+// Перестраивает индекс по id после перестановки pool->formulas на месте
+void kf_pool_reindex(kf_pool_t* pool);
+// Правила с этим условием по порядку пула: индекс в pool->formulas или pool->count
+size_t kf_first_rule_for(const kf_pool_t* pool, uint64_t condition_id);
+size_t kf_next_rule_for(const kf_pool_t* pool, size_t index);
 int kf_are_contradictory(kf_pool_t* pool, uint64_t formula_id1, uint64_t formula_id2);
 void kf_print_formula(kf_pool_t* pool, uint64_t formula_id);
 int kf_invalidate_rule(kf_pool_t* pool, uint64_t rule_id);
@@ -18,4 +26,13 @@ uint64_t kf_create_rule_from_facts(kf_pool_t* pool, uint64_t fact_id1, uint64_t
 uint64_t kf_create_rule_for_contradiction(kf_pool_t* pool, uint64_t contradicting_fact_id1, uint64_t contradicting_fact_id2);
 int kf_apply_rule_to_fact(kf_pool_t* pool, uint64_t rule_id, uint64_t fact_id, kf_formula_t* predicted_formula);
 
+// Пока в потоке открыт этап, kf_add_formula для его пула только выдаёт id и
+// откладывает формулу в этап; kf_borrow_formula этого потока её тоже видит.
+// Пул при этом не меняется, так что его могут читать другие потоки
+void kf_pool_stage_begin(kf_pool_stage_t* stage, kf_pool_t* pool);
+void kf_pool_stage_end(void);
+// Переносит отложенные формулы в пул; вызывать, когда пул никто не читает
+int kf_pool_stage_commit(kf_pool_stage_t* stage);
+void kf_pool_stage_free(kf_pool_stage_t* stage);
+
 #endif // KF_POOL_STUB_H
@@ -1,5 +1,6 @@
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/stubs/sigma_coordinator_stub.h"
+#include "kolibri/log.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -34,7 +35,7 @@ int sigma_add_task(sigma_coordinator_t* coordinator, sigma_task_t* task) {
     task->id = coordinator->next_task_id++;
     task->status = TASK_STATUS_OPEN;
     coordinator->tasks[coordinator->count++] = *task;
-    printf("COORDINATOR: New task added, total tasks: %d\n", coordinator->count);
+    KOLIBRI_LOG_INFO("Coordinator", "New task added, total tasks: %d", coordinator->count);
     return 0;
 }
 
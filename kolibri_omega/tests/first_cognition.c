@@ -5,6 +5,7 @@
 #include <string.h>
 
 // Сначала включаем все определения типов
+#include "kolibri/log.h"
 #include "kolibri_omega/include/types.h"
 #include "kolibri_omega/include/omega_errors.h"
 #include "kolibri_omega/include/omega_perf.h"
@@ -16,9 +17,11 @@
 #include "kolibri_omega/include/sandbox.h"
 #include "kolibri_omega/include/solver_lobe.h"
 #include "kolibri_omega/include/predictor_lobe.h"
+#include "kolibri_omega/include/inference_engine.h"
 #include "kolibri_omega/include/self_reflection.h"
 #include "kolibri_omega/stubs/kf_pool_stub.h"
 #include "kolibri_omega/stubs/sigma_coordinator_stub.h"
+#include "kolibri_omega/include/omega_context.h"
 #include "kolibri_omega/include/extended_pattern_detector.h"
 #include "kolibri_omega/include/hierarchical_abstraction.h"
 #include "kolibri_omega/include/agent_coordinator.h"
@@ -26,7 +29,41 @@
 #include "kolibri_omega/include/adaptive_abstraction_manager.h"
 #include "kolibri_omega/include/policy_learner.h"
 #include "kolibri_omega/include/bayesian_causal_networks.h"
+#include "kolibri_omega/include/abstraction_engine.h"
 #include "kolibri_omega/include/scenario_planner.h"
+#include "kolibri_omega/include/omega_runtime.h"
+
+// Лобы одного такта и его время — аргумент задач среды выполнения
+typedef struct {
+    omega_observer_t* observer;
+    omega_predictor_lobe_t* predictor;
+    omega_solver_lobe_t* solver;
+    omega_dreamer_t* dreamer;
+    int time;
+} cognition_lobes_t;
+
+static void run_observer(void* arg) {
+    cognition_lobes_t* lobes = arg;
+    omega_observer_tick(lobes->observer);
+}
+
+static void run_predictor(void* arg) {
+    cognition_lobes_t* lobes = arg;
+    // Предсказатель делает предсказания (с профилированием)
+    omega_perf_handle_t perf_pred = omega_perf_start(OMEGA_PERF_INFERENCE);
+    omega_predictor_lobe_tick(lobes->predictor, lobes->time);
+    omega_perf_end(perf_pred);
+}
+
+static void run_solver(void* arg) {
+    cognition_lobes_t* lobes = arg;
+    omega_solver_lobe_tick(lobes->solver);
+}
+
+static void run_dreamer(void* arg) {
+    cognition_lobes_t* lobes = arg;
+    omega_dreamer_tick(lobes->dreamer, lobes->time);
+}
 
 int main() {
     srandom(time(NULL));
@@ -47,6 +84,11 @@ int main() {
     }
     printf("[PerfSystem] Initialized successfully\n");
 
+    // Журнал модулей пишет фоновый поток; перед прямым выводом теста — flush
+    if (kolibri_log_start(NULL) != 0) {
+        fprintf(stderr, "Failed to start the log, writing synchronously\n");
+    }
+
     // Инициализация
     kf_pool_t pool;
     sigma_coordinator_t coord;
@@ -56,6 +98,11 @@ int main() {
     omega_solver_lobe_t solver;
     omega_predictor_lobe_t predictor;
     sandbox_world_t world;
+    omega_context_t* agent = omega_context_create();  // состояние модулей анализа этого агента
+    if (!agent) {
+        fprintf(stderr, "Failed to create omega context\n");
+        return 1;
+    }
 
     kf_pool_init(&pool);
     sigma_coordinator_init(&coord);
@@ -64,54 +111,78 @@ int main() {
     omega_dreamer_init(&dreamer, &canvas, &pool, &coord);
     omega_solver_lobe_init(&solver, &coord, &pool);
     omega_predictor_lobe_init(&predictor, &canvas, &pool);
+    omega_inference_set_verbosity(OMEGA_INFERENCE_LOG_SUMMARY);  // цепочки вывода видны в демонстрации
+    omega_inference_engine_init();
     omega_self_reflection_init();  // НОВОЕ: инициализирует самоанализ
-    omega_extended_pattern_detector_init();  // Phase 3: инициализирует детектор паттернов
-    omega_hierarchical_abstraction_init();  // Phase 4: инициализирует иерархию абстракции
-    omega_agent_coordinator_init();  // Phase 5: инициализирует координатор агентов
-    omega_counterfactual_reasoner_init();  // Phase 6: инициализирует counterfactual reasoner
-    omega_adaptive_abstraction_init();  // Phase 7: инициализирует адаптивное абстрактирование
-    omega_policy_learner_init();  // Phase 8: инициализирует обучение политикам
+    omega_extended_pattern_detector_init(agent);  // Phase 3: инициализирует детектор паттернов
+    omega_hierarchical_abstraction_init(agent);  // Phase 4: инициализирует иерархию абстракции
+    omega_agent_coordinator_init(agent);  // Phase 5: инициализирует координатор агентов
+    omega_counterfactual_reasoner_init(agent);  // Phase 6: инициализирует counterfactual reasoner
+    omega_adaptive_abstraction_init(agent);  // Phase 7: инициализирует адаптивное абстрактирование
+    omega_policy_learner_init(agent);  // Phase 8: инициализирует обучение политикам
     
     // Phase 7: Регистрируем метрики для адаптации
-    omega_register_abstraction_metric(OMEGA_METRIC_DIVERGENCE, 0.05, 0.15, 0.5);
-    omega_register_abstraction_metric(OMEGA_METRIC_COMPLEXITY, 50.0, 200.0, 0.3);
-    omega_register_abstraction_metric(OMEGA_METRIC_SYNCHRONIZATION, 0.3, 0.9, 0.2);
+    omega_register_abstraction_metric(agent, OMEGA_METRIC_DIVERGENCE, 0.05, 0.15, 0.5);
+    omega_register_abstraction_metric(agent, OMEGA_METRIC_COMPLEXITY, 50.0, 200.0, 0.3);
+    omega_register_abstraction_metric(agent, OMEGA_METRIC_SYNCHRONIZATION, 0.3, 0.9, 0.2);
     
     // Устанавливаем начальные значения метрик (норма, внутри диапазонов)
-    omega_update_metric(OMEGA_METRIC_DIVERGENCE, 0.10);
-    omega_update_metric(OMEGA_METRIC_COMPLEXITY, 120.0);
-    omega_update_metric(OMEGA_METRIC_SYNCHRONIZATION, 0.6);
+    omega_update_metric(agent, OMEGA_METRIC_DIVERGENCE, 0.10);
+    omega_update_metric(agent, OMEGA_METRIC_COMPLEXITY, 120.0);
+    omega_update_metric(agent, OMEGA_METRIC_SYNCHRONIZATION, 0.6);
     
     // Phase 8: Создаем начальные политики для ключевых состояний
-    omega_create_policy(OMEGA_STATE_STABLE, "stable_policy", 0.1);
-    omega_create_policy(OMEGA_STATE_DIVERGING, "diverging_policy", 0.3);
+    omega_create_policy(agent, OMEGA_STATE_STABLE, "stable_policy", 0.1);
+    omega_create_policy(agent, OMEGA_STATE_DIVERGING, "diverging_policy", 0.3);
     
     // Phase 9: Инициализируем Байесовскую причинную сеть
-    omega_bayesian_network_init();
+    omega_bayesian_network_init(agent);
     
     // Создаем узлы: Divergence, Complexity, SyncState, CoordinationLevel
     const char* divergence_states[] = {"Low", "Medium", "High"};
-    uint32_t div_node = omega_add_causal_node("Divergence", 3, divergence_states, 0.33);
+    uint32_t div_node = omega_add_causal_node(agent, "Divergence", 3, divergence_states, 0.33);
     
     const char* complexity_states[] = {"Simple", "Moderate", "Complex"};
-    uint32_t complex_node = omega_add_causal_node("Complexity", 3, complexity_states, 0.33);
+    uint32_t complex_node = omega_add_causal_node(agent, "Complexity", 3, complexity_states, 0.33);
     
     const char* sync_states[] = {"Synced", "Drift", "Desync"};
-    uint32_t sync_node = omega_add_causal_node("Synchronization", 3, sync_states, 0.33);
+    uint32_t sync_node = omega_add_causal_node(agent, "Synchronization", 3, sync_states, 0.33);
     
     // Создаем причинные ребра с default CPD (identity matrix)
-    omega_add_causal_edge(complex_node, div_node, NULL, 0.75);
-    omega_add_causal_edge(div_node, sync_node, NULL, 0.80);
+    omega_add_causal_edge(agent, complex_node, div_node, NULL, 0.75);
+    omega_add_causal_edge(agent, div_node, sync_node, NULL, 0.80);
     
     // Phase 10: Инициализируем планировщик сценариев
-    omega_scenario_planner_init();
+    omega_scenario_planner_init(agent);
+    
+    // Онлайн-кластеризация фактов Холста
+    omega_stream_clustering_init(agent, NULL);
+    size_t clustered_items = 0;
     
+    // Лобы — задачи среды выполнения. Решатель идёт сразу за Наблюдателем;
+    // Предсказатель и Мечтатель только читают и пополняют Холст и пул,
+    // поэтому выполняются параллельно
+    omega_runtime_t runtime;
+    cognition_lobes_t lobes = { &observer, &predictor, &solver, &dreamer, 0 };
+    omega_runtime_init(&runtime, &canvas, &pool, 0);
+    const omega_runtime_task_t lobe_tasks[] = {
+        { "observer", run_observer, &lobes, 0, 0,
+          OMEGA_RESOURCE_CANVAS | OMEGA_RESOURCE_POOL | OMEGA_RESOURCE_COORDINATOR },
+        { "solver", run_solver, &lobes, 0, 0, OMEGA_RESOURCE_POOL | OMEGA_RESOURCE_COORDINATOR },
+        { "predictor", run_predictor, &lobes, 0, OMEGA_RESOURCE_CANVAS | OMEGA_RESOURCE_POOL, 0 },
+        { "dreamer", run_dreamer, &lobes, 0, OMEGA_RESOURCE_CANVAS | OMEGA_RESOURCE_POOL, 0 },
+    };
+    for (size_t i = 0; i < sizeof(lobe_tasks) / sizeof(lobe_tasks[0]); ++i) {
+        omega_runtime_add_task(&runtime, &lobe_tasks[i]);
+    }
+
     sandbox_init(&world, 2);
     world.objects[0].y = 1.5f;
     world.objects[1].y = 2.5f;
 
     // Основной цикл симуляции
     for (int t = 0; t < 10; ++t) {
+        kolibri_log_flush();
         printf("\n--- Simulation Time: %d ---\n", t);
 
         // 1. Мир изменяется
@@ -120,24 +191,36 @@ int main() {
         // 2. Наблюдатель видит мир и создает факты
         sandbox_observe_world(&world, &canvas, t);
 
-        // 3. Наблюдатель анализирует холст
-        omega_observer_tick(&observer);
-
-        // 4. Предсказатель делает предсказания (с профилированием)
-        omega_perf_handle_t perf_pred = omega_perf_start(OMEGA_PERF_INFERENCE);
-        omega_predictor_lobe_tick(&predictor, t);
-        omega_perf_end(perf_pred);
+        // 3-6. Наблюдатель, Решатель, Предсказатель и Мечтатель — один такт среды
+        lobes.time = t;
+        if (omega_runtime_tick(&runtime) != 0) {
+            fprintf(stderr, "Failed to merge lobe writes at time %d\n", t);
+        }
+        
+        // Новые факты такта — в категории потока
+        if (clustered_items > canvas.count) {
+            clustered_items = 0;
+        }
+        for (; clustered_items < canvas.count; ++clustered_items) {
+            if (canvas.items[clustered_items].type == OMEGA_HYPOTHESIS_FACT) {
+                omega_stream_categorize_fact(agent, &pool, canvas.items[clustered_items].formula_id);
+            }
+        }
         
         // Phase 3: Обнаруживаем паттерны из 3+ шагов (с профилированием)
         omega_perf_handle_t perf_pattern = omega_perf_start(OMEGA_PERF_PATTERN_DETECTION);
-        omega_detect_extended_patterns(NULL, 5, t * 100);
+        omega_detect_extended_patterns(agent, NULL, 5, t * 100);
         omega_perf_end(perf_pattern);
-
-        // 5. Решатель обрабатывает задачи
-        omega_solver_lobe_tick(&solver);
         
-        // 6. Мечтатель делает свое дело
-        omega_dreamer_tick(&dreamer, t);
+        // Phase 4: мета-событие такта; иерархия досжимается лениво раз в 3 такта
+        if (t >= 2) {
+            uint64_t steps[3] = { 100 + t - 2, 100 + t - 1, 100 + t };
+            omega_meta_event_t meta_event;
+            omega_create_meta_event_from_pattern(agent, 3000 + t, steps, 0.8, t * 60, &meta_event);
+        }
+        if (t > 0 && t % 3 == 0) {
+            omega_compress_representation(agent);
+        }
         
         // 7. НОВОЕ: Каждые 5 тактов выполняем самоанализ
         if (t > 0 && t % 5 == 0) {
@@ -145,28 +228,28 @@ int main() {
         }
         
         // Phase 5: Обнаруживаем координацию агентов
-        omega_detect_agent_state_changes(1 + (t % 2), 100 + t, t * 100, 0.8 + (t * 0.01));
-        omega_find_synchronized_agents(50);  // Поиск синхронных агентов в окне 50ms
+        omega_detect_agent_state_changes(agent, 1 + (t % 2), 100 + t, t * 100, 0.8 + (t * 0.01));
+        omega_find_synchronized_agents(agent, 50);  // Поиск синхронных агентов в окне 50ms
         
         // Phase 6: Counterfactual analysis (каждые 3 такта)
         if (t > 0 && t % 3 == 0) {
-            uint64_t scenario_id = omega_create_scenario("scenario_hypothesis", t * 100);
+            uint64_t scenario_id = omega_create_scenario(agent, "scenario_hypothesis", t * 100);
             if (scenario_id > 0) {
-                omega_add_intervention(scenario_id, OMEGA_INTERVENTION_FORCE_ACTION, 1, 100 + t, 0.7, "Test intervention");
-                omega_analyze_scenario_branch(scenario_id, 1);
-                omega_apply_interventions(scenario_id);
-                omega_detect_causal_links(scenario_id);
-                double divergence = omega_compute_divergence(scenario_id);
+                omega_add_intervention(agent, scenario_id, OMEGA_INTERVENTION_FORCE_ACTION, 1, 100 + t, 0.7, "Test intervention");
+                omega_analyze_scenario_branch(agent, scenario_id, 1);
+                omega_apply_interventions(agent, scenario_id);
+                omega_detect_causal_links(agent, scenario_id);
+                double divergence = omega_compute_divergence(agent, scenario_id);
                 
                 // Phase 7: Обновляем метрики адаптации
-                omega_update_metric(OMEGA_METRIC_DIVERGENCE, divergence);
-                omega_update_metric(OMEGA_METRIC_COMPLEXITY, 100.0 + (t * 10.0));
-                omega_update_metric(OMEGA_METRIC_SYNCHRONIZATION, 0.5 + (t * 0.05));
+                omega_update_metric(agent, OMEGA_METRIC_DIVERGENCE, divergence);
+                omega_update_metric(agent, OMEGA_METRIC_COMPLEXITY, 100.0 + (t * 10.0));
+                omega_update_metric(agent, OMEGA_METRIC_SYNCHRONIZATION, 0.5 + (t * 0.05));
                 
                 // Phase 8: Рекордим эпизод обучения и обновляем политику
                 double reward = omega_compute_reward(0.15, divergence, 1, 0.05);
-                omega_record_learning_episode(OMEGA_STATE_DIVERGING, scenario_id, reward, OMEGA_STATE_STABLE, divergence);
-                omega_update_policy(OMEGA_STATE_DIVERGING, scenario_id, reward, OMEGA_STATE_STABLE);
+                omega_record_learning_episode(agent, OMEGA_STATE_DIVERGING, scenario_id, reward, OMEGA_STATE_STABLE, divergence);
+                omega_update_policy(agent, OMEGA_STATE_DIVERGING, scenario_id, reward, OMEGA_STATE_STABLE);
             }
         }
         
@@ -174,38 +257,38 @@ int main() {
         if (t > 0 && t % 4 == 0) {
             // Принудительно устанавливаем экстремальные метрики для демонстрации
             if (t == 4) {
-                omega_update_metric(OMEGA_METRIC_COMPLEXITY, 250.0);  // Выше верхнего порога
+                omega_update_metric(agent, OMEGA_METRIC_COMPLEXITY, 250.0);  // Выше верхнего порога
             } else if (t == 8) {
-                omega_update_metric(OMEGA_METRIC_COMPLEXITY, 400.0);   // Еще выше
+                omega_update_metric(agent, OMEGA_METRIC_COMPLEXITY, 400.0);   // Еще выше
             }
             
-            omega_abstraction_level_t new_level = omega_compute_adaptation_level();
-            omega_apply_adaptation(new_level);
+            omega_abstraction_level_t new_level = omega_compute_adaptation_level(agent);
+            omega_apply_adaptation(agent, new_level);
         }
         
         // Phase 9: Байесовский причинный вывод (каждые 5 тактов)
         if (t > 0 && t % 5 == 0) {
             // Устанавливаем свидетельство о сложности системы
             int complexity_state = (t / 5) % 3;  // Циклируем через 0, 1, 2
-            omega_set_evidence(complex_node, complexity_state);
+            omega_set_evidence(agent, complex_node, complexity_state);
             
             // Выполняем вероятностный вывод для узла Divergence
             omega_inference_result_t divergence_inference;
-            omega_bayesian_inference(div_node, &divergence_inference);
+            omega_bayesian_inference(agent, div_node, &divergence_inference);
             
             // Выполняем вероятностный вывод для узла Synchronization
             omega_inference_result_t sync_inference;
-            omega_bayesian_inference(sync_node, &sync_inference);
+            omega_bayesian_inference(agent, sync_node, &sync_inference);
             
             // Записываем наблюдение для обучения CPD
             uint32_t obs_nodes[] = {complex_node, div_node, sync_node};
             int obs_states[] = {complexity_state, divergence_inference.most_likely_state, sync_inference.most_likely_state};
             double likelihood = divergence_inference.most_likely_probability * sync_inference.most_likely_probability;
-            omega_record_causal_observation(obs_nodes, obs_states, 3, likelihood);
+            omega_record_causal_observation(agent, obs_nodes, obs_states, 3, likelihood);
             
             // Обновляем CPD на основе накопленных эпизодов
             if (t >= 5) {  // После первого цикла
-                omega_learn_cpd_from_episodes();
+                omega_learn_cpd_from_episodes(agent);
             }
         }
         
@@ -224,11 +307,22 @@ int main() {
             };
             
             // Создаем план
-            uint32_t plan_id = omega_create_scenario_plan("tactical_plan", &current_state, 3);
+            uint32_t plan_id = omega_create_scenario_plan(agent, "tactical_plan", &current_state, 3);
             
             if (plan_id > 0) {
                 // Расширяем дерево сценариев
-                omega_expand_scenario_tree(plan_id);
+                omega_expand_scenario_tree(agent, plan_id);
+                
+                // Поиск Монте-Карло по дереву: не дольше 20 мс
+                omega_plan_search_config_t search_config = {
+                    .deadline_ms = 20,
+                    .max_rollouts = 20000,
+                    .seed = (uint64_t)t
+                };
+                omega_plan_search_result_t search_result;
+                omega_perf_handle_t perf_plan = omega_perf_start(OMEGA_PERF_PLANNING);
+                omega_plan_search(agent, plan_id, &search_config, &search_result);
+                omega_perf_end(perf_plan);
                 
                 // Вычисляем траекторию к целевому состоянию
                 omega_plan_state_t target_state = {
@@ -241,44 +335,66 @@ int main() {
                 // Получаем корневую ветвь (текущее состояние)
                 uint32_t root_branch = 0;
                 
-                omega_compute_trajectory(plan_id, root_branch, &target_state, 5);
+                omega_compute_trajectory(agent, plan_id, root_branch, &target_state, 5);
                 
                 // Выбираем лучшую ветвь по expected value
-                uint32_t best_branch = omega_select_best_branch(plan_id);
+                uint32_t best_branch = omega_select_best_branch(agent, plan_id);
                 
                 // Предсказываем результат
                 omega_plan_outcome_t outcome;
-                omega_predict_outcome(plan_id, best_branch, &outcome);
+                omega_predict_outcome(agent, plan_id, best_branch, &outcome);
                 
                 // Симулируем выполнение плана
                 omega_plan_trajectory_t trajectory;
-                omega_simulate_plan_execution(plan_id, &trajectory);
+                omega_simulate_plan_execution(agent, plan_id, &trajectory);
             }
         }
 
+        kolibri_log_flush();
         omega_canvas_print(&canvas);
 
         usleep(100000); // Замедлим симуляцию
     }
 
     // Остановка и уничтожение
+    kolibri_log_flush();
     printf("\n--- Simulation Finished. Shutting down. ---\n");
     
     // Print performance report before shutdown
     omega_perf_print_report();
     
-    omega_agent_coordinator_shutdown();  // Phase 5: остановка координатора
-    omega_counterfactual_reasoner_shutdown();  // Phase 6: остановка counterfactual reasoner
-    omega_adaptive_abstraction_shutdown();  // Phase 7: остановка адаптивной абстракции
-    omega_policy_learner_shutdown();  // Phase 8: остановка обучения политики
-    omega_bayesian_network_shutdown();  // Phase 9: остановка байесовской сети
-    omega_scenario_planner_shutdown();  // Phase 10: остановка планировщика
+    omega_abstraction_hierarchy_t hierarchy[OMEGA_ABSTRACTION_LEVELS];
+    int hierarchy_levels = omega_get_abstraction_hierarchy(agent, hierarchy);
+    for (int level = 1; level < hierarchy_levels; ++level) {
+        KOLIBRI_LOG_INFO("HierarchicalAbstraction", "Level %d: %d events, avg_confidence %.3f",
+                         level, hierarchy[level].event_count, hierarchy[level].avg_confidence);
+    }
+    omega_agent_coordinator_shutdown(agent);  // Phase 5: остановка координатора
+    omega_counterfactual_reasoner_shutdown(agent);  // Phase 6: остановка counterfactual reasoner
+    omega_adaptive_abstraction_shutdown(agent);  // Phase 7: остановка адаптивной абстракции
+    omega_policy_learner_shutdown(agent);  // Phase 8: остановка обучения политики
+    omega_bayesian_network_shutdown(agent);  // Phase 9: остановка байесовской сети
+    omega_scenario_planner_shutdown(agent);  // Phase 10: остановка планировщика
+    
+    omega_stream_merge_categories(agent, 0);
+    omega_category_t stream_categories[4];
+    size_t stream_count = omega_stream_export_categories(agent, stream_categories, 4);
+    for (size_t i = 0; i < stream_count; ++i) {
+        KOLIBRI_LOG_INFO("AbstractionEngine", "Stream category '%s': %zu facts, confidence %.2f",
+                         stream_categories[i].name, stream_categories[i].member_count,
+                         stream_categories[i].average_confidence);
+    }
+    omega_stream_clustering_shutdown(agent);
+    omega_context_destroy(agent);  // остальные модули агента
+    omega_runtime_destroy(&runtime);
     omega_observer_destroy(&observer);
     omega_dreamer_destroy(&dreamer);
     omega_canvas_destroy(&canvas);
     kf_pool_destroy(&pool);
     sigma_coordinator_destroy(&coord);
     
+    kolibri_log_stop();
+
     // Shutdown profiling and error handling systems last
     omega_perf_shutdown();
     printf("[PerfSystem] Shutdown complete\n");
@@ -77,7 +77,10 @@ if (( ${#otsutstvuet[@]} > 0 )); then
 fi
 
 # Проверяем, поддерживает ли компилятор целевую архитектуру.
-dopolnitelnye_flagi=("-ffreestanding" "-fno-stack-protector" "-fno-pic" "-Wall" "-Wextra" "-O2")
+# SSE2 для оценки формул: entry.asm включает его в CR0/CR4, обработчики
+# прерываний сохраняют состояние через FXSAVE.
+dopolnitelnye_flagi=("-ffreestanding" "-fno-stack-protector" "-fno-pic" "-Wall" "-Wextra" "-O2"
+    "-msse2" "-mfpmath=sse")
 if "$CC" --version | grep -qi "gcc"; then
     dopolnitelnye_flagi+=("-m32")
 fi
@@ -132,6 +135,14 @@ if [[ $kernel_only -eq 0 ]]; then
     cp "$postroika_dir/kolibri.bin" "$iso_dir/boot/kolibri.bin"
     cp "$proekt_koren/boot/grub/grub.cfg" "$iso_dir/boot/grub/grub.cfg"
 
+    # Область журнала генома: модуль Multiboot2, который ядро размечает
+    # блочным кольцом. Существующий build/genome.dat переносится как есть.
+    genome_dat="$postroika_dir/genome.dat"
+    if [[ ! -f "$genome_dat" ]]; then
+        dd if=/dev/zero of="$genome_dat" bs=1M count="${KOLIBRI_GENOME_MB:-16}" status=none
+    fi
+    cp "$genome_dat" "$iso_dir/boot/genome.dat"
+
     set -x
     "$GRUB_MKRESCUE" -o "$postroika_dir/kolibri.iso" "$iso_dir"
     set +x
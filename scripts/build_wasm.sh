@@ -11,6 +11,8 @@ vyhod_dir="${KOLIBRI_WASM_OUTPUT_DIR:-$proekt_koren/build/wasm}"
 mkdir -p "$vyhod_dir"
 
 vyhod_wasm="$vyhod_dir/kolibri.wasm"
+# Та же сборка без SIMD128 для сред, где kolibri.wasm не проходит валидацию.
+vyhod_wasm_scalar="$vyhod_dir/kolibri-scalar.wasm"
 vremennaja_map="$vyhod_dir/kolibri.map"
 vremennaja_js="$vyhod_dir/kolibri.js"
 
@@ -1043,8 +1045,12 @@ exports=(
     "_k_state_new"
     "_k_state_free"
     "_k_state_save"
+    "_k_state_save_size"
     "_k_state_load"
     "_k_observe"
+    "_k_observe_begin"
+    "_k_observe_chunk"
+    "_k_observe_end"
     "_k_decode"
     "_k_digit_add_syll"
     "_k_profile"
@@ -1052,6 +1058,10 @@ exports=(
     "_kolibri_bridge_reset"
     "_kolibri_bridge_configure"
     "_kolibri_bridge_execute"
+    "_kolibri_bridge_handle"
+    "_kolibri_bridge_reset_handle"
+    "_kolibri_bridge_configure_handle"
+    "_kolibri_bridge_execute_handle"
     "_kolibri_bridge_has_simd"
     "_kolibri_bridge_lane_width"
     "_malloc"
@@ -1067,7 +1077,6 @@ fi
 flags=(
     -O3
     -std=gnu11
-    -msimd128
     -sSTANDALONE_WASM=1
     -sSIDE_MODULE=0
     -sALLOW_MEMORY_GROWTH=1
@@ -1076,21 +1085,23 @@ flags=(
     -sEXPORTED_FUNCTIONS="[$export_list]"
     --no-entry
     -I"$proekt_koren/backend/include"
-    -DKOLIBRI_USE_WASM_SIMD=1
-    -o "$vyhod_wasm"
 )
 
 if [[ "${KOLIBRI_WASM_GENERATE_MAP:-0}" == "1" ]]; then
     flags+=(--emit-symbol-map)
 fi
 
-"$EMCC" "${istochniki[@]}" "${flags[@]}"
+"$EMCC" "${istochniki[@]}" "${flags[@]}" -msimd128 -DKOLIBRI_USE_WASM_SIMD=1 -o "$vyhod_wasm"
+"$EMCC" "${istochniki[@]}" "${flags[@]}" -o "$vyhod_wasm_scalar"
 
 razmer=$(opredelit_razmer "$vyhod_wasm")
-if (( razmer > 1024 * 1024 )); then
-    printf '[ОШИБКА] kolibri.wasm превышает бюджет: %.2f МБ\n' "$(awk -v b="$razmer" 'BEGIN {printf "%.2f", b/1048576}')" >&2
-    exit 1
-fi
+razmer_scalar=$(opredelit_razmer "$vyhod_wasm_scalar")
+for modul_razmer in "$razmer" "$razmer_scalar"; do
+    if (( modul_razmer > 1024 * 1024 )); then
+        printf '[ОШИБКА] kolibri.wasm превышает бюджет: %.2f МБ\n' "$(awk -v b="$modul_razmer" 'BEGIN {printf "%.2f", b/1048576}')" >&2
+        exit 1
+    fi
+done
 
 ekport_info="$vyhod_dir/kolibri.wasm.txt"
 cat >"$ekport_info" <<EOF_INFO
@@ -1098,9 +1109,12 @@ kolibri.wasm: $(awk -v b="$razmer" 'BEGIN {printf "%.2f МБ", b/1048576}')
 Эта сборка содержит ядро KOLIBRI-Σ: арена памяти, обратимые скетчи,
 компактный DAAWG, микро-VM с резонансным голосованием и аудит профиля.
 Модуль автономен и готов к офлайн-запуску в PWA.
+Ядра резонанса, окон бюджета и top-k собраны с SIMD128;
+kolibri-scalar.wasm ($(awk -v b="$razmer_scalar" 'BEGIN {printf "%.2f МБ", b/1048576}')) — та же сборка без SIMD.
 EOF_INFO
 
 zapisat_sha256 "$vyhod_wasm" "$vyhod_dir/kolibri.wasm.sha256"
+zapisat_sha256 "$vyhod_wasm_scalar" "$vyhod_dir/kolibri-scalar.wasm.sha256"
 
 zapisat_otchet "success" "kolibri.wasm успешно собран" "$razmer" "$stub_flag"
 
@@ -19,14 +19,22 @@ EXPORTS: List[str] = [
     "_k_state_new",
     "_k_state_free",
     "_k_state_save",
+    "_k_state_save_size",
     "_k_state_load",
     "_k_observe",
+    "_k_observe_begin",
+    "_k_observe_chunk",
+    "_k_observe_end",
     "_k_decode",
     "_k_digit_add_syll",
     "_k_profile",
     "_kolibri_bridge_init",
     "_kolibri_bridge_reset",
     "_kolibri_bridge_execute",
+    "_kolibri_bridge_handle",
+    "_kolibri_bridge_reset_handle",
+    "_kolibri_bridge_configure_handle",
+    "_kolibri_bridge_execute_handle",
     "_malloc",
     "_free",
 ]
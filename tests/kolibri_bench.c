@@ -0,0 +1,718 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+/*
+ * Microbenchmarks of the core hot paths. Each case is calibrated until one
+ * repetition runs for at least --min-time-ms, warmed up, then timed
+ * --repetitions times; the report gives the median time per operation and
+ * its median absolute deviation, which a single slow repetition cannot move.
+ *
+ *   kolibri_bench [--filter TEXT] [--repetitions N] [--warmup N]
+ *                 [--min-time-ms N] [--json PATH|-] [--script PATH] [--quick]
+ */
+
+#include "kolibri/decimal.h"
+#include "kolibri/formula.h"
+#include "kolibri/genome.h"
+#include "kolibri/knowledge_index.h"
+#include "kolibri/net.h"
+#include "kolibri/script.h"
+#include "kolibri/sigma.h"
+#include "kolibri/symbol_table.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef KOLIBRI_BENCH_SCRIPT
+#define KOLIBRI_BENCH_SCRIPT "knowledge_bootstrap.ks"
+#endif
+
+#define BENCH_MAX_REPETITIONS 1000U
+#define BENCH_MAX_ITERATIONS (1ULL << 30)
+#define BENCH_NAME_MAX 96U
+
+typedef void (*BenchOp)(void *ctx);
+
+typedef struct {
+    const char *filter;
+    size_t repetitions;
+    size_t warmup;
+    uint64_t min_time_ns;
+    int quick;
+    const char *script_path;
+    FILE *json;
+    int table;
+    size_t reported;
+    int failed;
+} BenchRunner;
+
+/* Results flow here so the compiler cannot drop an operation as dead. */
+static volatile uint64_t bench_sink;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static int bench_wanted(const BenchRunner *runner, const char *name) {
+    return !runner->filter || strstr(name, runner->filter) != NULL;
+}
+
+static uint64_t bench_time(BenchOp op, void *ctx, uint64_t iterations) {
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        op(ctx);
+    }
+    return bench_now_ns() - start;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Median of a sorted array. */
+static double bench_median(const double *sorted, size_t count) {
+    return count % 2U ? sorted[count / 2U] : (sorted[count / 2U - 1U] + sorted[count / 2U]) / 2.0;
+}
+
+static void bench_fail(BenchRunner *runner, const char *name, const char *what) {
+    fprintf(stderr, "kolibri_bench: %s: %s\n", name, what);
+    runner->failed = 1;
+}
+
+/*
+ * Times op, which performs one operation on items units of work (bytes,
+ * documents, blocks; 0 when only the operation rate matters).
+ */
+static void bench_run(BenchRunner *runner, const char *name, double items, BenchOp op, void *ctx) {
+    uint64_t iterations = 1U;
+    for (;;) {
+        uint64_t elapsed = bench_time(op, ctx, iterations);
+        if (elapsed >= runner->min_time_ns || iterations >= BENCH_MAX_ITERATIONS) {
+            break;
+        }
+        /* Aims a little past the target, at most 10x per step. */
+        uint64_t scale = elapsed ? (runner->min_time_ns * 12U / 10U) / elapsed + 1U : 10U;
+        iterations *= scale > 10U ? 10U : scale;
+    }
+    for (size_t i = 0; i < runner->warmup; ++i) {
+        (void)bench_time(op, ctx, iterations);
+    }
+
+    double samples[BENCH_MAX_REPETITIONS];
+    double deviations[BENCH_MAX_REPETITIONS];
+    size_t count = runner->repetitions;
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = (double)bench_time(op, ctx, iterations) / (double)iterations;
+    }
+    qsort(samples, count, sizeof(samples[0]), bench_compare);
+    double median = bench_median(samples, count);
+    for (size_t i = 0; i < count; ++i) {
+        deviations[i] = samples[i] > median ? samples[i] - median : median - samples[i];
+    }
+    qsort(deviations, count, sizeof(deviations[0]), bench_compare);
+    double mad = bench_median(deviations, count);
+    double rate = items > 0.0 && median > 0.0 ? items * 1e9 / median : 0.0;
+
+    if (runner->table) {
+        printf("%-52s %12.1f ns %10.1f ns %12llu it", name, median, mad,
+               (unsigned long long)iterations);
+        if (rate > 0.0) {
+            printf(" %14.0f items/s", rate);
+        }
+        putchar('\n');
+        fflush(stdout);
+    }
+    if (runner->json) {
+        fprintf(runner->json,
+                "%s\n    {\"name\":\"%s\",\"iterations\":%llu,\"repetitions\":%zu,"
+                "\"median_ns\":%.3f,\"mad_ns\":%.3f,\"min_ns\":%.3f,\"max_ns\":%.3f",
+                runner->reported ? "," : "", name, (unsigned long long)iterations, count, median, mad,
+                samples[0], samples[count - 1U]);
+        if (rate > 0.0) {
+            fprintf(runner->json, ",\"items_per_op\":%.0f,\"items_per_second\":%.3f", items, rate);
+        }
+        fputc('}', runner->json);
+    }
+    runner->reported++;
+}
+
+/* xorshift64*, so every run builds the same inputs. */
+static uint64_t bench_rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ULL;
+}
+
+static const char bench_text[] =
+    "Kolibri хранит знания в цифровом геноме и отвечает формулами. "
+    "The swarm exchanges the best formulas between nodes every few generations. "
+    "Колибри — распределённый движок знаний, исполняющий программы KolibriScript. ";
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    KolibriFormulaPool *pool;
+} PoolCase;
+
+static void op_pool_tick(void *ctx) {
+    PoolCase *c = (PoolCase *)ctx;
+    kf_pool_tick(c->pool, 1U);
+    bench_sink += (uint64_t)(c->pool->formulas[0].fitness * 1e6);
+}
+
+static void bench_pool_tick(BenchRunner *runner) {
+    static const size_t formulas_full[] = {24U, 96U, 384U};
+    static const size_t examples_full[] = {16U, 64U, 1024U};
+    static const size_t formulas_quick[] = {24U};
+    static const size_t examples_quick[] = {16U};
+    const size_t *formulas = runner->quick ? formulas_quick : formulas_full;
+    const size_t *examples = runner->quick ? examples_quick : examples_full;
+    size_t formula_sizes = runner->quick ? 1U : sizeof(formulas_full) / sizeof(formulas_full[0]);
+    size_t example_sizes = runner->quick ? 1U : sizeof(examples_full) / sizeof(examples_full[0]);
+
+    for (size_t f = 0; f < formula_sizes; ++f) {
+        for (size_t e = 0; e < example_sizes; ++e) {
+            char name[BENCH_NAME_MAX];
+            snprintf(name, sizeof(name), "kf_pool_tick/formulas=%zu/examples=%zu", formulas[f], examples[e]);
+            if (!bench_wanted(runner, name)) {
+                continue;
+            }
+            KolibriPoolConfig config = {formulas[f], examples[e], 0U, 20250101ULL};
+            PoolCase c = {kf_pool_create(&config)};
+            if (!c.pool) {
+                bench_fail(runner, name, "kf_pool_create failed");
+                continue;
+            }
+            for (size_t i = 0; i < examples[e]; ++i) {
+                int input = (int)i - (int)(examples[e] / 2U);
+                (void)kf_pool_add_example(c.pool, input, 3 * input + 7);
+            }
+            bench_run(runner, name, 0.0, op_pool_tick, &c);
+            kf_pool_destroy(c.pool);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+#define BENCH_VOCABULARY 768U
+#define BENCH_DOC_WORDS 160U
+#define BENCH_QUERIES 16U
+
+typedef struct {
+    KolibriKnowledgeIndex *index;
+    char queries[BENCH_QUERIES][64];
+    size_t next;
+} IndexCase;
+
+static const char *const bench_syllables[] = {
+    "ko", "li", "bri", "ge", "nom", "for", "mu", "la", "roy", "zna",
+    "ni", "ya", "da", "ta", "sig", "ma", "de", "ci", "mal", "vet",
+};
+
+static void bench_word(size_t id, char *out, size_t cap) {
+    size_t n = sizeof(bench_syllables) / sizeof(bench_syllables[0]);
+    snprintf(out, cap, "%s%s%s", bench_syllables[id % n], bench_syllables[(id / n) % n],
+             bench_syllables[(id / (n * n) + id) % n]);
+}
+
+/* Words follow a skewed distribution, so common terms have long postings. */
+static size_t bench_pick_word(uint64_t *rng) {
+    double u = (double)(bench_rng_next(rng) >> 11) / 9007199254740992.0;
+    return (size_t)(u * u * u * (double)BENCH_VOCABULARY);
+}
+
+static int bench_write_corpus(const char *dir, size_t documents) {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    char path[512];
+    char word[32];
+    for (size_t d = 0; d < documents; ++d) {
+        snprintf(path, sizeof(path), "%s/doc_%05zu.md", dir, d);
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            return -1;
+        }
+        bench_word(bench_pick_word(&rng), word, sizeof(word));
+        fprintf(file, "# %s %zu\n\n", word, d);
+        for (size_t w = 0; w < BENCH_DOC_WORDS; ++w) {
+            bench_word(bench_pick_word(&rng), word, sizeof(word));
+            fprintf(file, "%s%c", word, w % 16U == 15U ? '\n' : ' ');
+        }
+        if (fclose(file) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bench_remove_corpus(const char *dir, size_t documents) {
+    char path[512];
+    for (size_t d = 0; d < documents; ++d) {
+        snprintf(path, sizeof(path), "%s/doc_%05zu.md", dir, d);
+        (void)unlink(path);
+    }
+    (void)rmdir(dir);
+}
+
+static void op_index_search(void *ctx) {
+    IndexCase *c = (IndexCase *)ctx;
+    size_t indices[10];
+    float scores[10];
+    size_t count = 0U;
+    (void)kolibri_knowledge_index_search(c->index, c->queries[c->next], 10U, indices, scores, &count);
+    c->next = (c->next + 1U) % BENCH_QUERIES;
+    bench_sink += count;
+}
+
+static void bench_index_search(BenchRunner *runner) {
+    static const size_t sizes_full[] = {1000U, 10000U};
+    static const size_t sizes_quick[] = {200U};
+    const size_t *sizes = runner->quick ? sizes_quick : sizes_full;
+    size_t size_count = runner->quick ? 1U : sizeof(sizes_full) / sizeof(sizes_full[0]);
+
+    for (size_t s = 0; s < size_count; ++s) {
+        char name[BENCH_NAME_MAX];
+        snprintf(name, sizeof(name), "knowledge_index_search/documents=%zu", sizes[s]);
+        if (!bench_wanted(runner, name)) {
+            continue;
+        }
+        char dir[] = "/tmp/kolibri_benchXXXXXX";
+        if (!mkdtemp(dir)) {
+            bench_fail(runner, name, "mkdtemp failed");
+            continue;
+        }
+        IndexCase c;
+        memset(&c, 0, sizeof(c));
+        const char *roots[] = {dir};
+        if (bench_write_corpus(dir, sizes[s]) != 0 ||
+            kolibri_knowledge_index_create(roots, 1U, 256U, &c.index) != 0 || !c.index) {
+            bench_fail(runner, name, "corpus setup failed");
+            bench_remove_corpus(dir, sizes[s]);
+            continue;
+        }
+        uint64_t rng = 42U;
+        for (size_t q = 0; q < BENCH_QUERIES; ++q) {
+            char first[32];
+            char second[32];
+            bench_word(bench_pick_word(&rng), first, sizeof(first));
+            bench_word(bench_pick_word(&rng) + BENCH_VOCABULARY / 8U, second, sizeof(second));
+            snprintf(c.queries[q], sizeof(c.queries[q]), "%s %s", first, second);
+        }
+        bench_run(runner, name, 0.0, op_index_search, &c);
+        kolibri_knowledge_index_destroy(c.index);
+        bench_remove_corpus(dir, sizes[s]);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+static const unsigned char bench_key[] = "kolibri-bench-key";
+/* Genome payloads are decimal digit strings, as k_encode_text produces. */
+static const char bench_payload[] = "075111108105098114105032102111114109117108097";
+
+typedef struct {
+    KolibriGenome genome;
+    const char *path;
+} GenomeCase;
+
+static void op_genome_append(void *ctx) {
+    GenomeCase *c = (GenomeCase *)ctx;
+    bench_sink += (uint64_t)kg_append(&c->genome, "BENCH", bench_payload, NULL);
+}
+
+static void op_genome_verify(void *ctx) {
+    GenomeCase *c = (GenomeCase *)ctx;
+    bench_sink += (uint64_t)kg_verify_file(c->path, bench_key, sizeof(bench_key) - 1U);
+}
+
+static int bench_genome_path(char *path, size_t cap) {
+    snprintf(path, cap, "/tmp/kolibri_bench_genomeXXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    (void)unlink(path);
+    return 0;
+}
+
+static void bench_genome(BenchRunner *runner) {
+    char path[64];
+    if (bench_wanted(runner, "kg_append")) {
+        GenomeCase c;
+        memset(&c, 0, sizeof(c));
+        if (bench_genome_path(path, sizeof(path)) != 0 ||
+            kg_open(&c.genome, path, bench_key, sizeof(bench_key) - 1U) != 0) {
+            bench_fail(runner, "kg_append", "kg_open failed");
+        } else if (kg_append(&c.genome, "BENCH", bench_payload, NULL) != 0) {
+            bench_fail(runner, "kg_append", "kg_append failed");
+            kg_close(&c.genome);
+            (void)unlink(path);
+        } else {
+            bench_run(runner, "kg_append", 0.0, op_genome_append, &c);
+            kg_close(&c.genome);
+            (void)unlink(path);
+        }
+    }
+
+    size_t blocks = runner->quick ? 100U : 10000U;
+    char name[BENCH_NAME_MAX];
+    snprintf(name, sizeof(name), "kg_verify_file/blocks=%zu", blocks);
+    if (!bench_wanted(runner, name)) {
+        return;
+    }
+    GenomeCase c;
+    memset(&c, 0, sizeof(c));
+    if (bench_genome_path(path, sizeof(path)) != 0 ||
+        kg_open(&c.genome, path, bench_key, sizeof(bench_key) - 1U) != 0) {
+        bench_fail(runner, name, "kg_open failed");
+        return;
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        op_genome_append(&c);
+    }
+    kg_close(&c.genome);
+    c.path = path;
+    if (kg_verify_file(path, bench_key, sizeof(bench_key) - 1U) != 0) {
+        bench_fail(runner, name, "fresh genome does not verify");
+    } else {
+        bench_run(runner, name, (double)blocks, op_genome_verify, &c);
+    }
+    (void)unlink(path);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    uintptr_t state;
+    uint8_t out[256];
+} SigmaCase;
+
+static void op_sigma_observe(void *ctx) {
+    SigmaCase *c = (SigmaCase *)ctx;
+    bench_sink += (uint64_t)k_observe(c->state, (const uint8_t *)bench_text, sizeof(bench_text) - 1U);
+}
+
+static void op_sigma_decode(void *ctx) {
+    SigmaCase *c = (SigmaCase *)ctx;
+    static const char prompt[] = "Kolibri хранит";
+    bench_sink += (uint64_t)k_decode(c->state, (const uint8_t *)prompt, sizeof(prompt) - 1U, c->out,
+                                     sizeof(c->out), 0, 3);
+}
+
+static void bench_sigma(BenchRunner *runner) {
+    if (!bench_wanted(runner, "k_observe") && !bench_wanted(runner, "k_decode")) {
+        return;
+    }
+    SigmaCase c;
+    memset(&c, 0, sizeof(c));
+    c.state = k_state_new(0U);
+    if (!c.state) {
+        bench_fail(runner, "k_observe", "k_state_new failed");
+        return;
+    }
+    if (bench_wanted(runner, "k_observe")) {
+        bench_run(runner, "k_observe", (double)(sizeof(bench_text) - 1U), op_sigma_observe, &c);
+    } else {
+        op_sigma_observe(&c);
+    }
+    if (bench_wanted(runner, "k_decode")) {
+        bench_run(runner, "k_decode", 0.0, op_sigma_decode, &c);
+    }
+    k_state_free(c.state);
+}
+
+/* ------------------------------------------------------------------------ */
+
+#define BENCH_UTF8_BYTES 4096U
+
+typedef struct {
+    unsigned char text[BENCH_UTF8_BYTES];
+    size_t length;
+    uint8_t digits[BENCH_UTF8_BYTES * 3U];
+    k_digit_stream stream;
+} DecimalCase;
+
+static void op_transduce_utf8(void *ctx) {
+    DecimalCase *c = (DecimalCase *)ctx;
+    k_digit_stream_reset(&c->stream);
+    bench_sink += (uint64_t)k_transduce_utf8(&c->stream, c->text, c->length);
+}
+
+static void bench_decimal(BenchRunner *runner) {
+    char name[BENCH_NAME_MAX];
+    snprintf(name, sizeof(name), "k_transduce_utf8/bytes=%u", BENCH_UTF8_BYTES);
+    if (!bench_wanted(runner, name)) {
+        return;
+    }
+    DecimalCase *c = (DecimalCase *)calloc(1U, sizeof(DecimalCase));
+    if (!c) {
+        bench_fail(runner, name, "out of memory");
+        return;
+    }
+    size_t chunk = sizeof(bench_text) - 1U;
+    while (c->length + chunk <= BENCH_UTF8_BYTES) {
+        memcpy(c->text + c->length, bench_text, chunk);
+        c->length += chunk;
+    }
+    k_digit_stream_init(&c->stream, c->digits, sizeof(c->digits));
+    bench_run(runner, name, (double)c->length, op_transduce_utf8, c);
+    free(c);
+}
+
+/* ------------------------------------------------------------------------ */
+
+#define BENCH_SYMBOLS 64U
+
+typedef struct {
+    KolibriSymbolTable table;
+    uint32_t codepoints[BENCH_SYMBOLS];
+} SymbolCase;
+
+static void op_symbol_encode(void *ctx) {
+    SymbolCase *c = (SymbolCase *)ctx;
+    uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
+    for (size_t i = 0; i < BENCH_SYMBOLS; ++i) {
+        bench_sink += (uint64_t)kolibri_symbol_encode(&c->table, c->codepoints[i], digits);
+    }
+}
+
+static void bench_symbols(BenchRunner *runner) {
+    char name[BENCH_NAME_MAX];
+    snprintf(name, sizeof(name), "kolibri_symbol_encode/symbols=%u", BENCH_SYMBOLS);
+    if (!bench_wanted(runner, name)) {
+        return;
+    }
+    SymbolCase c;
+    memset(&c, 0, sizeof(c));
+    kolibri_symbol_table_init(&c.table, NULL);
+    /* Latin, Cyrillic and CJK, all known to the table after the first pass. */
+    for (size_t i = 0; i < BENCH_SYMBOLS; ++i) {
+        static const uint32_t bases[] = {0x61U, 0x430U, 0x4E00U, 0x30U};
+        c.codepoints[i] = bases[i % 4U] + (uint32_t)(i / 4U);
+    }
+    op_symbol_encode(&c);
+    bench_run(runner, name, (double)BENCH_SYMBOLS, op_symbol_encode, &c);
+    kolibri_symbol_table_free(&c.table);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    KolibriFormulaPool pool;
+    KolibriScript script;
+} ScriptCase;
+
+static void op_script_execute(void *ctx) {
+    ScriptCase *c = (ScriptCase *)ctx;
+    bench_sink += (uint64_t)ks_execute(&c->script);
+}
+
+static void bench_script(BenchRunner *runner) {
+    if (!bench_wanted(runner, "ks_execute/knowledge_bootstrap")) {
+        return;
+    }
+    const char *name = "ks_execute/knowledge_bootstrap";
+    ScriptCase *c = (ScriptCase *)calloc(1U, sizeof(ScriptCase));
+    FILE *sink = fopen("/dev/null", "w");
+    if (!c || !sink) {
+        bench_fail(runner, name, "setup failed");
+        free(c);
+        if (sink) {
+            fclose(sink);
+        }
+        return;
+    }
+    kf_pool_init(&c->pool, 20250101ULL);
+    if (ks_init(&c->script, &c->pool, NULL) != 0) {
+        bench_fail(runner, name, "ks_init failed");
+    } else {
+        ks_set_output(&c->script, sink);
+        if (ks_load_file(&c->script, runner->script_path) != 0 || ks_execute(&c->script) != 0) {
+            bench_fail(runner, name, "cannot run the bootstrap script (see --script)");
+        } else {
+            bench_run(runner, name, 0.0, op_script_execute, c);
+        }
+        ks_free(&c->script);
+    }
+    fclose(sink);
+    free(c);
+}
+
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+    uint8_t frame[KOLIBRI_NET_FRAME_MAX];
+    size_t length;
+    KolibriFormula formula;
+} NetCase;
+
+static void op_net_encode(void *ctx) {
+    NetCase *c = (NetCase *)ctx;
+    c->length = kn_message_encode_formula(c->frame, sizeof(c->frame), 7U, &c->formula);
+    bench_sink += c->length;
+}
+
+static void op_net_decode(void *ctx) {
+    NetCase *c = (NetCase *)ctx;
+    KolibriNetMessage message;
+    bench_sink += (uint64_t)kn_message_decode(c->frame, c->length, &message);
+    bench_sink += message.data.formula.length;
+}
+
+static void bench_net(BenchRunner *runner) {
+    if (!bench_wanted(runner, "kn_message_")) {
+        return;
+    }
+    NetCase c;
+    memset(&c, 0, sizeof(c));
+    c.formula.gene.length = 16U;
+    for (size_t i = 0; i < c.formula.gene.length; ++i) {
+        c.formula.gene.digits[i] = (uint8_t)(i * 7U % 10U);
+    }
+    c.formula.fitness = 0.875;
+    op_net_encode(&c);
+    if (c.length == 0U) {
+        bench_fail(runner, "kn_message_encode_formula", "encoding failed");
+        return;
+    }
+    if (bench_wanted(runner, "kn_message_encode_formula")) {
+        bench_run(runner, "kn_message_encode_formula", 0.0, op_net_encode, &c);
+    }
+    if (bench_wanted(runner, "kn_message_decode")) {
+        bench_run(runner, "kn_message_decode/formula", 0.0, op_net_decode, &c);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage: kolibri_bench [--filter TEXT] [--repetitions N] [--warmup N]\n"
+            "                     [--min-time-ms N] [--json PATH|-] [--script PATH] [--quick]\n"
+            "  --filter       run only cases whose name contains TEXT\n"
+            "  --repetitions  timed repetitions per case (default 15, at most %u)\n"
+            "  --warmup       untimed repetitions after calibration (default 2)\n"
+            "  --min-time-ms  shortest repetition (default 50)\n"
+            "  --json         write the results as JSON to PATH, or to stdout for -\n"
+            "  --script       KolibriScript for ks_execute (default %s)\n"
+            "  --quick        smallest sizes and short repetitions, for smoke runs\n",
+            BENCH_MAX_REPETITIONS, KOLIBRI_BENCH_SCRIPT);
+}
+
+static int parse_count(const char *text, unsigned long max, unsigned long *out) {
+    char *end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (!end || *end != '\0' || value > max) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    BenchRunner runner;
+    memset(&runner, 0, sizeof(runner));
+    runner.script_path = KOLIBRI_BENCH_SCRIPT;
+    unsigned long repetitions = 15U;
+    unsigned long warmup = 2U;
+    unsigned long min_time_ms = 50U;
+    int repetitions_set = 0;
+    int min_time_set = 0;
+    const char *json_path = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        int bad = 0;
+        if (strcmp(arg, "--quick") == 0) {
+            runner.quick = 1;
+            continue;
+        }
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_usage();
+            return 0;
+        }
+        if (!value) {
+            bad = 1;
+        } else if (strcmp(arg, "--filter") == 0) {
+            runner.filter = value;
+        } else if (strcmp(arg, "--repetitions") == 0) {
+            bad = parse_count(value, BENCH_MAX_REPETITIONS, &repetitions) != 0 || repetitions == 0U;
+            repetitions_set = 1;
+        } else if (strcmp(arg, "--warmup") == 0) {
+            bad = parse_count(value, 1000U, &warmup) != 0;
+        } else if (strcmp(arg, "--min-time-ms") == 0) {
+            bad = parse_count(value, 60000U, &min_time_ms) != 0;
+            min_time_set = 1;
+        } else if (strcmp(arg, "--json") == 0) {
+            json_path = value;
+        } else if (strcmp(arg, "--script") == 0) {
+            runner.script_path = value;
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            print_usage();
+            return 1;
+        }
+        ++i;
+    }
+    if (runner.quick) {
+        repetitions = repetitions_set ? repetitions : 3U;
+        min_time_ms = min_time_set ? min_time_ms : 2U;
+    }
+    runner.repetitions = (size_t)repetitions;
+    runner.warmup = (size_t)warmup;
+    runner.min_time_ns = (uint64_t)min_time_ms * 1000000ULL;
+
+    runner.table = !json_path || strcmp(json_path, "-") != 0;
+    if (json_path) {
+        runner.json = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!runner.json) {
+            fprintf(stderr, "kolibri_bench: cannot write %s\n", json_path);
+            return 1;
+        }
+        fprintf(runner.json,
+                "{\n  \"context\":{\"repetitions\":%zu,\"warmup\":%zu,\"min_time_ms\":%lu,\"quick\":%s},\n"
+                "  \"benchmarks\":[",
+                runner.repetitions, runner.warmup, min_time_ms, runner.quick ? "true" : "false");
+    }
+    if (runner.table) {
+        printf("%-52s %15s %13s %15s\n", "case", "median/op", "MAD", "iterations");
+    }
+
+    bench_pool_tick(&runner);
+    bench_index_search(&runner);
+    bench_genome(&runner);
+    bench_sigma(&runner);
+    bench_decimal(&runner);
+    bench_symbols(&runner);
+    bench_script(&runner);
+    bench_net(&runner);
+
+    if (runner.json) {
+        fputs("\n  ]\n}\n", runner.json);
+        if (runner.json != stdout && fclose(runner.json) != 0) {
+            fprintf(stderr, "kolibri_bench: cannot write %s\n", json_path);
+            runner.failed = 1;
+        }
+    }
+    if (runner.reported == 0U) {
+        fprintf(stderr, "kolibri_bench: no case matches the filter\n");
+        return 1;
+    }
+    return runner.failed ? 1 : 0;
+}
@@ -26,3 +26,13 @@ file(READ "${decoded_path}" decoded_contents)
 if(NOT decoded_contents STREQUAL sample_script)
     message(FATAL_ERROR "Декодированный текст не совпадает с исходным")
 endif()
+
+set(artifact_path "${CMAKE_CURRENT_BINARY_DIR}/ks_roundtrip.ksc")
+file(REMOVE "${artifact_path}")
+execute_process(
+    COMMAND "${ks_compiler}" --ksc "${sample_path}"
+    RESULT_VARIABLE ksc_result
+)
+if(NOT ksc_result EQUAL 0 OR NOT EXISTS "${artifact_path}")
+    message(FATAL_ERROR "ks_compiler не создал артефакт .ksc")
+endif()
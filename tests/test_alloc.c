@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/alloc.h"
+#include "kolibri/formula.h"
+#include "kolibri/knowledge_index.h"
+#include "kolibri/script.h"
+#include "kolibri/sigma.h"
+#include "kolibri/sim.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALLOC_TEST_MAGIC 0x6b6f6c6962726931ULL
+
+/* Counts live bytes behind a header; budget >= 0 fails every call after it runs out. */
+typedef struct {
+    atomic_size_t outstanding;
+    atomic_size_t calls;
+    atomic_long budget;
+} AllocTracker;
+
+typedef struct {
+    size_t size;
+    uint64_t magic;
+} AllocHeader;
+
+static int tracker_take(AllocTracker *tracker) {
+    atomic_fetch_add(&tracker->calls, 1U);
+    if (atomic_load(&tracker->budget) < 0) {
+        return 1;
+    }
+    return atomic_fetch_sub(&tracker->budget, 1) > 0;
+}
+
+static void *tracker_alloc(void *user, size_t size) {
+    AllocTracker *tracker = (AllocTracker *)user;
+    if (!tracker_take(tracker)) {
+        return NULL;
+    }
+    AllocHeader *header = (AllocHeader *)malloc(sizeof(AllocHeader) + size);
+    if (!header) {
+        return NULL;
+    }
+    header->size = size;
+    header->magic = ALLOC_TEST_MAGIC;
+    atomic_fetch_add(&tracker->outstanding, size);
+    return header + 1;
+}
+
+static void tracker_free(void *user, void *ptr) {
+    AllocTracker *tracker = (AllocTracker *)user;
+    if (!ptr) {
+        return;
+    }
+    AllocHeader *header = (AllocHeader *)ptr - 1;
+    assert(header->magic == ALLOC_TEST_MAGIC);
+    header->magic = 0U;
+    atomic_fetch_sub(&tracker->outstanding, header->size);
+    free(header);
+}
+
+static void *tracker_realloc(void *user, void *ptr, size_t size) {
+    AllocTracker *tracker = (AllocTracker *)user;
+    if (!ptr) {
+        return tracker_alloc(user, size);
+    }
+    AllocHeader *header = (AllocHeader *)ptr - 1;
+    assert(header->magic == ALLOC_TEST_MAGIC);
+    if (!tracker_take(tracker)) {
+        return NULL;
+    }
+    size_t old_size = header->size;
+    AllocHeader *grown = (AllocHeader *)realloc(header, sizeof(AllocHeader) + size);
+    if (!grown) {
+        return NULL;
+    }
+    grown->size = size;
+    atomic_fetch_sub(&tracker->outstanding, old_size);
+    atomic_fetch_add(&tracker->outstanding, size);
+    return grown + 1;
+}
+
+static void tracker_init(AllocTracker *tracker, KolibriAllocator *allocator, long budget) {
+    atomic_init(&tracker->outstanding, 0U);
+    atomic_init(&tracker->calls, 0U);
+    atomic_init(&tracker->budget, budget);
+    allocator->alloc = tracker_alloc;
+    allocator->realloc = tracker_realloc;
+    allocator->free = tracker_free;
+    allocator->user = tracker;
+}
+
+static void write_text(const char *path, const char *content) {
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fputs(content, f);
+    fclose(f);
+}
+
+static void test_alloc_default(void) {
+    KolibriAllocator broken = {tracker_alloc, NULL, tracker_free, NULL};
+    assert(kolibri_allocator_set_default(&broken) == -1);
+
+    AllocTracker tracker;
+    KolibriAllocator allocator;
+    tracker_init(&tracker, &allocator, -1);
+    assert(kolibri_allocator_set_default(&allocator) == 0);
+    char *copy = kolibri_mem_strdup(NULL, "колибри");
+    assert(copy && strcmp(copy, "колибри") == 0);
+    assert(atomic_load(&tracker.outstanding) == strlen("колибри") + 1U);
+    kolibri_mem_free(NULL, copy);
+    assert(kolibri_mem_calloc(NULL, SIZE_MAX / 2U, 4U) == NULL);
+    assert(kolibri_allocator_set_default(NULL) == 0);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+}
+
+static void test_alloc_index(void) {
+    system("mkdir -p ./test_alloc_data/nested");
+    write_text("./test_alloc_data/alpha.md", "# Альфа\nKolibri отвечает на вопросы о памяти\n");
+    write_text("./test_alloc_data/beta.md", "# Beta\nMemory arenas keep every tenant apart.\n");
+    write_text("./test_alloc_data/nested/gamma.md", "# Гамма\nОтветы и вопросы, память и арены.\n");
+    const char *roots[1] = {"./test_alloc_data"};
+
+    AllocTracker tracker;
+    KolibriAllocator allocator;
+    tracker_init(&tracker, &allocator, -1);
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.threads = 2U;
+    options.keep_term_counts = 1;
+    options.keep_positions = 1;
+    options.allocator = &allocator;
+    KolibriKnowledgeIndex *index = NULL;
+    assert(kolibri_knowledge_index_create_ex(roots, 1U, &options, &index) == 0);
+    assert(kolibri_knowledge_index_document_count(index) == 3U);
+    size_t build_calls = atomic_load(&tracker.calls);
+    assert(build_calls > 0U && atomic_load(&tracker.outstanding) > 0U);
+
+    size_t indices[3];
+    float scores[3];
+    size_t found = 0U;
+    const char *queries[2] = {"memory", "\"вопросы о памяти\""};
+    size_t counts[2];
+    size_t batch_indices[6];
+    float batch_scores[6];
+    assert(kolibri_knowledge_index_search(index, "вопросы", 3U, indices, scores, &found) == 0 && found == 2U);
+    assert(kolibri_knowledge_index_search_batch(index, queries, 2U, 3U, batch_indices, batch_scores, counts) == 0);
+    assert(counts[0] == 1U && counts[1] == 1U);
+    write_text("./test_alloc_data/delta.md", "# Delta\nA fourth document about memory.\n");
+    assert(kolibri_knowledge_index_add_document(index, "./test_alloc_data/delta.md", &options) == 0);
+    assert(kolibri_knowledge_index_commit(index, &options) == 0);
+    assert(kolibri_knowledge_index_search(index, "memory", 3U, indices, scores, &found) == 0 && found == 2U);
+    assert(atomic_load(&tracker.calls) > build_calls);
+    kolibri_knowledge_index_destroy(index);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+
+    /* Every allocation in turn fails: creation reports ENOMEM and leaks nothing. */
+    options.threads = 1U;
+    int built = 0;
+    for (long budget = 0; !built; ++budget) {
+        assert(budget < 100000);
+        tracker_init(&tracker, &allocator, budget);
+        index = NULL;
+        int err = kolibri_knowledge_index_create_ex(roots, 1U, &options, &index);
+        assert(err == 0 || err == ENOMEM);
+        if (err == 0) {
+            assert(kolibri_knowledge_index_document_count(index) == 4U);
+            assert(kolibri_knowledge_index_search(index, "memory", 3U, indices, scores, &found) == 0 &&
+                   found == 2U);
+            kolibri_knowledge_index_destroy(index);
+            built = 1;
+        } else {
+            assert(index == NULL);
+        }
+        assert(atomic_load(&tracker.outstanding) == 0U);
+    }
+
+    /* The same for a mutation: the index keeps answering after ENOMEM. */
+    tracker_init(&tracker, &allocator, -1);
+    assert(kolibri_knowledge_index_create_ex(roots, 1U, &options, &index) == 0);
+    write_text("./test_alloc_data/epsilon.md", "# Epsilon\nFresh words: hummingbird nectar.\n");
+    int added = 0;
+    for (long budget = 0; !added; ++budget) {
+        assert(budget < 100000);
+        atomic_store(&tracker.budget, budget);
+        int err = kolibri_knowledge_index_add_document(index, "./test_alloc_data/epsilon.md", &options);
+        if (err == 0) {
+            err = kolibri_knowledge_index_commit(index, &options);
+        }
+        assert(err == 0 || err == ENOMEM);
+        atomic_store(&tracker.budget, -1);
+        if (err == 0) {
+            added = 1;
+        } else {
+            assert(kolibri_knowledge_index_commit(index, &options) == 0);
+        }
+        assert(kolibri_knowledge_index_search(index, "memory", 3U, indices, scores, &found) == 0 && found == 2U);
+    }
+    assert(kolibri_knowledge_index_search(index, "hummingbird", 3U, indices, scores, &found) == 0 && found == 1U);
+
+    /* An embedding graph that cannot be built leaves the index without one. */
+    float vectors[5 * 4];
+    for (size_t i = 0; i < 5U * 4U; ++i) {
+        vectors[i] = (float)((i * 7U) % 5U) - 2.0f;
+    }
+    int embedded = 0;
+    for (long budget = 0; !embedded; ++budget) {
+        assert(budget < 100000);
+        atomic_store(&tracker.budget, budget);
+        int err = kolibri_knowledge_index_set_embeddings(index, vectors, 4U, NULL);
+        atomic_store(&tracker.budget, -1);
+        assert(err == 0 || err == ENOMEM);
+        embedded = err == 0;
+        assert(kolibri_knowledge_index_embedding_dim(index) == (embedded ? 4U : 0U));
+    }
+    assert(kolibri_knowledge_index_search_dense(index, vectors, 4U, 3U, 0U, indices, scores, &found) == 0 &&
+           found == 3U);
+    kolibri_knowledge_index_destroy(index);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+    system("rm -rf ./test_alloc_data");
+}
+
+static void test_alloc_sigma(void) {
+    static const uint8_t text[] = "колибри летает над цветами и пьёт нектар 0123456789";
+    AllocTracker tracker;
+    KolibriAllocator allocator;
+    tracker_init(&tracker, &allocator, -1);
+    uintptr_t state = k_state_new_ex(64U, &allocator);
+    assert(state != 0U);
+    assert(k_observe(state, text, sizeof(text) - 1U) == 0);
+    assert(atomic_load(&tracker.outstanding) > 0U);
+    k_state_free(state);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+
+    int created = 0;
+    for (long budget = 0; !created; ++budget) {
+        assert(budget < 10000);
+        tracker_init(&tracker, &allocator, budget);
+        state = k_state_new_ex(64U, &allocator);
+        if (state != 0U) {
+            (void)k_observe(state, text, sizeof(text) - 1U);
+            k_state_free(state);
+            created = 1;
+        }
+        assert(atomic_load(&tracker.outstanding) == 0U);
+    }
+}
+
+static void test_alloc_script(void) {
+    static const char *program =
+        "начало:\n"
+        "    показать \"память\"\n"
+        "    обучить связь \"2\" -> \"4\"\n"
+        "    создать формулу ответ из \"ассоциация\"\n"
+        "    показать итог\n"
+        "конец.\n";
+    KolibriFormulaPool pool;
+    kf_pool_init(&pool, 7ULL);
+    AllocTracker tracker;
+    KolibriAllocator allocator;
+    tracker_init(&tracker, &allocator, -1);
+    FILE *sink = tmpfile();
+    assert(sink != NULL);
+
+    KolibriScript skript;
+    assert(ks_init_ex(&skript, &pool, NULL, &allocator) == 0);
+    ks_set_output(&skript, sink);
+    assert(ks_load_text(&skript, program) == 0);
+    assert(ks_execute(&skript) == 0);
+    assert(atomic_load(&tracker.outstanding) > 0U);
+    ks_free(&skript);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+
+    int ran = 0;
+    for (long budget = 0; !ran; ++budget) {
+        assert(budget < 10000);
+        kf_pool_init(&pool, 7ULL);
+        tracker_init(&tracker, &allocator, budget);
+        if (ks_init_ex(&skript, &pool, NULL, &allocator) != 0) {
+            continue;
+        }
+        ks_set_output(&skript, sink);
+        ran = ks_load_text(&skript, program) == 0 && ks_execute(&skript) == 0;
+        ks_free(&skript);
+        assert(atomic_load(&tracker.outstanding) == 0U);
+    }
+    fclose(sink);
+}
+
+static void test_alloc_sim(void) {
+    AllocTracker tracker;
+    KolibriAllocator allocator;
+    tracker_init(&tracker, &allocator, -1);
+    KolibriSimConfig config = {
+        .seed = 99,
+        .hmac_key = "kolibri-hmac",
+        .allocator = &allocator,
+    };
+    KolibriSim *sim = kolibri_sim_create(&config);
+    assert(sim != NULL);
+    assert(kolibri_sim_tick(sim) == 0);
+    assert(atomic_load(&tracker.outstanding) > 0U);
+    kolibri_sim_destroy(sim);
+    assert(atomic_load(&tracker.outstanding) == 0U);
+
+    int created = 0;
+    for (long budget = 0; !created; ++budget) {
+        assert(budget < 10000);
+        tracker_init(&tracker, &allocator, budget);
+        sim = kolibri_sim_create(&config);
+        if (sim) {
+            (void)kolibri_sim_tick(sim);
+            kolibri_sim_destroy(sim);
+            created = 1;
+        }
+        assert(atomic_load(&tracker.outstanding) == 0U);
+    }
+}
+
+void test_alloc(void) {
+    test_alloc_default();
+    test_alloc_index();
+    test_alloc_sigma();
+    test_alloc_script();
+    test_alloc_sim();
+}
@@ -44,8 +44,72 @@ static void test_text_roundtrip(void) {
   assert(strcmp(text, decoded) == 0);
 }
 
+static void test_transducer_long_input(void) {
+  /* Long enough for the vector kernels, with a scalar tail of 7 bytes. */
+  unsigned char payload[599];
+  for (size_t i = 0; i < sizeof(payload); ++i) {
+    payload[i] = (unsigned char)((i * 37u + 11u) & 0xffu);
+  }
+  static uint8_t buffer[3 * sizeof(payload)];
+  k_digit_stream stream;
+  k_digit_stream_init(&stream, buffer, sizeof(buffer));
+  assert(k_transduce_utf8(&stream, payload, sizeof(payload)) == 0);
+  assert(stream.length == 3 * sizeof(payload));
+  for (size_t i = 0; i < sizeof(payload); ++i) {
+    assert(buffer[3 * i] == payload[i] / 100u);
+    assert(buffer[3 * i + 1] == payload[i] / 10u % 10u);
+    assert(buffer[3 * i + 2] == payload[i] % 10u);
+  }
+  unsigned char restored[sizeof(payload)];
+  size_t written = 0;
+  assert(k_emit_utf8(&stream, restored, sizeof(restored), &written) == 0);
+  assert(written == sizeof(payload));
+  assert(memcmp(payload, restored, sizeof(payload)) == 0);
+
+  /* A payload that does not fit leaves the stream as it was. */
+  assert(k_transduce_utf8(&stream, payload, 1) != 0);
+  assert(stream.length == 3 * sizeof(payload));
+
+  const uint8_t over[] = {2, 5, 6};
+  assert(k_digits_to_utf8(over, 1, restored) == -2);
+}
+
+static void test_push_bulk(void) {
+  uint8_t buffer[4];
+  k_digit_stream stream;
+  k_digit_stream_init(&stream, buffer, sizeof(buffer));
+  const uint8_t digits[] = {3, 1, 4, 1, 5};
+  assert(k_digit_stream_push_bulk(&stream, digits, 5) != 0);
+  assert(stream.length == 0);
+  const uint8_t bad[] = {1, 10};
+  assert(k_digit_stream_push_bulk(&stream, bad, 2) != 0);
+  assert(stream.length == 0);
+  assert(k_digit_stream_push_bulk(&stream, digits, 4) == 0);
+  assert(stream.length == 4 && memcmp(buffer, digits, 4) == 0);
+}
+
+static void test_text_roundtrip_long(void) {
+  /* Longer than the old 512-digit scratch buffer. */
+  char text[301];
+  for (size_t i = 0; i < sizeof(text) - 1; ++i) {
+    text[i] = (char)('a' + i % 26);
+  }
+  text[sizeof(text) - 1] = '\0';
+  static char encoded[3 * sizeof(text)];
+  char decoded[sizeof(text)];
+  assert(k_encode_text(text, encoded, sizeof(encoded)) == 0);
+  assert(strlen(encoded) == 3 * (sizeof(text) - 1));
+  assert(k_decode_text(encoded, decoded, sizeof(decoded)) == 0);
+  assert(strcmp(text, decoded) == 0);
+  assert(k_decode_text("999", decoded, sizeof(decoded)) != 0);
+  assert(k_decode_text("07a", decoded, sizeof(decoded)) != 0);
+}
+
 void test_decimal(void) {
   test_transducer_roundtrip();
   test_digit_stream_bounds();
   test_text_roundtrip();
+  test_transducer_long_input();
+  test_push_bulk();
+  test_text_roundtrip_long();
 }
@@ -1,9 +1,12 @@
 #include "kolibri/formula.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void teach_linear_task(KolibriFormulaPool *pool) {
   for (int i = 0; i < 4; ++i) {
@@ -59,7 +62,7 @@ static void test_feedback_adjustment(void) {
 static void test_sampling_controls(void) {
   KolibriFormulaPool pool;
   kf_pool_init(&pool, 11);
-  size_t capacity = sizeof(pool.formulas) / sizeof(pool.formulas[0]);
+  size_t capacity = pool.count;
 
   kf_pool_set_sampling(&pool, 0.05, 0);
   assert(fabs(pool.temperature - 0.1) < 1e-9);
@@ -74,6 +77,459 @@ static void test_sampling_controls(void) {
   assert(pool.top_k == capacity);
 }
 
+static void test_shared_associations(void) {
+  KolibriFormulaPool *pool = malloc(sizeof(*pool));
+  assert(pool);
+  kf_pool_init(pool, 99);
+  assert(kf_pool_add_association(pool, NULL, "2+2", "4", "test", 1) == 0);
+  assert(kf_pool_add_association(pool, NULL, "3+3", "6", "test", 2) == 0);
+  kf_pool_tick(pool, 8);
+  const KolibriFormula *best = kf_pool_best(pool);
+  assert(best != NULL);
+  assert(best->associations == pool->associations);
+  assert(best->association_count == 2);
+  for (size_t i = 1; i < pool->count; ++i) {
+    assert(pool->formulas[i - 1].fitness >= pool->formulas[i].fitness);
+  }
+  kf_pool_clear_examples(pool);
+  for (size_t i = 0; i < pool->count; ++i) {
+    assert(pool->formulas[i].associations == NULL);
+    assert(pool->formulas[i].association_count == 0);
+  }
+  free(pool);
+}
+
+static void test_parallel_evaluation(void) {
+  KolibriFormulaPool *serial = malloc(sizeof(*serial));
+  KolibriFormulaPool *parallel = malloc(sizeof(*parallel));
+  assert(serial && parallel);
+  kf_pool_init(serial, 4242);
+  kf_pool_init(parallel, 4242);
+  kf_pool_set_coherence_gain(serial, 0.05);
+  kf_pool_set_coherence_gain(parallel, 0.05);
+  teach_linear_task(serial);
+  teach_linear_task(parallel);
+  kf_pool_set_parallelism(parallel, 4);
+  assert(parallel->parallelism == 4);
+  kf_pool_tick(serial, 32);
+  kf_pool_tick(parallel, 32);
+  for (size_t i = 0; i < serial->count; ++i) {
+    assert(serial->formulas[i].fitness == parallel->formulas[i].fitness);
+    assert(memcmp(serial->formulas[i].gene.digits,
+                  parallel->formulas[i].gene.digits,
+                  sizeof(serial->formulas[i].gene.digits)) == 0);
+  }
+  kf_pool_set_parallelism(parallel, 1000);
+  assert(parallel->parallelism == KOLIBRI_POOL_MAX_PARALLELISM);
+  free(serial);
+  free(parallel);
+}
+
+static void test_heap_pool(void) {
+  KolibriPoolConfig config = {1000, 500, 2, 7};
+  KolibriFormulaPool *pool = kf_pool_create(&config);
+  assert(pool != NULL);
+  assert(pool->count == 1000);
+  assert(pool->example_capacity == 500);
+  assert(kf_pool_add_association(pool, NULL, "a", "1", "test", 1) == 0);
+  assert(kf_pool_add_association(pool, NULL, "b", "2", "test", 2) == 0);
+  assert(kf_pool_add_association(pool, NULL, "c", "3", "test", 3) == 0);
+  assert(pool->association_count == 2);
+  assert(strcmp(pool->associations[0].question, "b") == 0);
+  assert(pool->examples == 3);
+  for (int i = 3; i < 500; ++i) {
+    assert(kf_pool_add_example(pool, i, 2 * i + 1) == 0);
+  }
+  assert(kf_pool_add_example(pool, 500, 1001) == -1);
+  kf_pool_set_parallelism(pool, 2);
+  kf_pool_tick(pool, 4);
+  for (size_t i = 1; i < pool->count; ++i) {
+    assert(pool->formulas[i - 1].fitness >= pool->formulas[i].fitness);
+  }
+  kf_pool_set_sampling(pool, 1.0, 0);
+  assert(pool->top_k == 1000);
+  kf_pool_destroy(pool);
+
+  KolibriFormulaPool *defaults = kf_pool_create(NULL);
+  assert(defaults != NULL);
+  assert(defaults->count == KOLIBRI_POOL_MAX_FORMULAS);
+  assert(defaults->example_capacity == KOLIBRI_POOL_MAX_EXAMPLES);
+  kf_pool_destroy(defaults);
+}
+
+/* With no penalties, coherence or feedback a formula's fitness is its base
+ * score, which must match a scalar replay through kf_formula_apply. */
+static void assert_fitness_matches_scalar(const KolibriFormulaPool *pool) {
+  for (size_t f = 0; f < pool->count; ++f) {
+    const KolibriFormula *formula = &pool->formulas[f];
+    double error = 0.0;
+    for (size_t i = 0; i < pool->examples; ++i) {
+      int prediction = 0;
+      assert(kf_formula_apply(formula, pool->inputs[i], &prediction) == 0);
+      error += fabs((double)pool->targets[i] - (double)prediction);
+    }
+    double penalty = 0.0;
+    for (size_t i = 0; i < formula->gene.length; ++i) {
+      penalty += 0.001 * (double)formula->gene.digits[i];
+    }
+    double expected = 1.0 / (1.0 + error + penalty);
+    assert(fabs(formula->fitness - expected) < 1e-12);
+  }
+}
+
+static void test_batch_evaluation(void) {
+  KolibriFormulaPool *pool = malloc(sizeof(*pool));
+  assert(pool);
+  kf_pool_init(pool, 555);
+  for (int i = 0; i < 61; ++i) {
+    assert(kf_pool_add_example(pool, i * 37 - 900, 3 * i - 11) == 0);
+  }
+  kf_pool_tick(pool, 6);
+  assert_fitness_matches_scalar(pool);
+
+  /* Large inputs overflow int32 lanes and take the clamping path. */
+  kf_pool_clear_examples(pool);
+  assert(pool->input_peak == 0U);
+  const int inputs[] = {2000000000, -2147483647 - 1, 65536, -70000, 5};
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    assert(kf_pool_add_example(pool, inputs[i], 2147483647) == 0);
+  }
+  assert(pool->input_peak == 2147483648U);
+  kf_pool_tick(pool, 6);
+  assert_fitness_matches_scalar(pool);
+  free(pool);
+}
+
+static void test_fitness_cache(void) {
+  KolibriFormulaPool *cached = malloc(sizeof(*cached));
+  KolibriFormulaPool *uncached = malloc(sizeof(*uncached));
+  assert(cached && uncached);
+  kf_pool_init(cached, 808);
+  kf_pool_init(uncached, 808);
+  uncached->cache_slots = 0;
+  teach_linear_task(cached);
+  teach_linear_task(uncached);
+  kf_pool_set_sampling(cached, 0.1, 4);
+  kf_pool_set_sampling(uncached, 0.1, 4);
+  kf_pool_tick(cached, 40);
+  kf_pool_tick(uncached, 40);
+  for (size_t i = 0; i < cached->count; ++i) {
+    assert(cached->formulas[i].fitness == uncached->formulas[i].fitness);
+    assert(memcmp(cached->formulas[i].gene.digits,
+                  uncached->formulas[i].gene.digits,
+                  sizeof(cached->formulas[i].gene.digits)) == 0);
+  }
+  const KolibriPoolProfile *profile = kf_pool_profile(cached);
+  assert(profile->cache_hits > 0);
+  assert(profile->cache_hits + profile->cache_misses == 41 * cached->count);
+  assert(profile->cache_hit_rate > 0.0 && profile->cache_hit_rate <= 1.0);
+  assert(kf_pool_profile(uncached)->cache_hits == 0);
+
+  /* New targets retire the cached drift metrics. */
+  uint64_t version = cached->dataset_version;
+  kf_pool_set_targets(cached, NAN, NAN);
+  assert(cached->dataset_version == version);
+  kf_pool_set_targets(cached, 3.0, 0.4);
+  assert(cached->dataset_version != version);
+  free(cached);
+  free(uncached);
+}
+
+static void test_pool_profile(void) {
+  KolibriFormulaPool *pool = malloc(sizeof(*pool));
+  assert(pool);
+  kf_pool_init(pool, 909);
+  teach_linear_task(pool);
+  kf_pool_set_coherence_gain(pool, 0.05);
+  kf_pool_tick(pool, 12);
+  kf_pool_tick(pool, 4);
+  const KolibriPoolProfile *profile = kf_pool_profile(pool);
+  assert(profile->generation_steps == 16);
+  assert(profile->evaluation_calls == 18 * pool->count);
+  assert(profile->total_tick_ns >= profile->last_tick_ns);
+  assert(profile->total_tick_ns > 0);
+  assert(profile->evaluation_ns > 0 && profile->coherence_ns > 0);
+  assert(profile->evaluations_per_sec > 0.0);
+
+  char json[512];
+  int written = kf_pool_profile_json(profile, json, sizeof(json));
+  assert(written > 0 && (size_t)written == strlen(json));
+  assert(json[0] == '{' && json[written - 1] == '}');
+  assert(strstr(json, "\"generation_steps\":16,") != NULL);
+  assert(strstr(json, "\"reproduce_ns\":") != NULL);
+  assert(kf_pool_profile_json(profile, json, 16) == -1);
+
+  kf_pool_clear_examples(pool);
+  assert(kf_pool_profile(pool)->total_tick_ns == 0);
+  assert(kf_pool_profile(pool)->evaluations_per_sec == 0.0);
+  free(pool);
+}
+
+static void test_tick_budget(void) {
+  KolibriFormulaPool *fixed = malloc(sizeof(*fixed));
+  KolibriFormulaPool *budgeted = malloc(sizeof(*budgeted));
+  assert(fixed && budgeted);
+  kf_pool_init(fixed, 515);
+  kf_pool_init(budgeted, 515);
+  teach_linear_task(fixed);
+  teach_linear_task(budgeted);
+  /* Without stop conditions the budget matches a plain tick. */
+  KolibriTickBudget budget = {16, 0, 0.0, 0};
+  kf_pool_tick(fixed, 16);
+  assert(kf_pool_tick_until(budgeted, &budget) == 16);
+  for (size_t i = 0; i < fixed->count; ++i) {
+    assert(fixed->formulas[i].fitness == budgeted->formulas[i].fitness);
+    assert(memcmp(fixed->formulas[i].gene.digits,
+                  budgeted->formulas[i].gene.digits,
+                  sizeof(fixed->formulas[i].gene.digits)) == 0);
+  }
+
+  /* A pool that already meets the target does not evolve. */
+  KolibriTickBudget reached = {100, 0, kf_pool_best(budgeted)->fitness, 0};
+  assert(kf_pool_tick_until(budgeted, &reached) == 0);
+
+  KolibriTickBudget stagnant = {100000, 0, 0.0, 3};
+  uint64_t steps = kf_pool_profile(budgeted)->generation_steps;
+  size_t completed = kf_pool_tick_until(budgeted, &stagnant);
+  assert(completed < 100000);
+  assert(kf_pool_profile(budgeted)->generation_steps == steps + completed);
+
+  KolibriTickBudget deadline = {100000000, 5, 0.0, 0};
+  assert(kf_pool_tick_until(budgeted, &deadline) < 100000000);
+  assert(kf_pool_tick_until(NULL, &deadline) == 0);
+  free(fixed);
+  free(budgeted);
+}
+
+static void lower_copy(const char *src, char *dst, size_t dst_len) {
+  size_t i = 0;
+  for (; src[i] && i + 1 < dst_len; ++i) {
+    dst[i] = (char)tolower((unsigned char)src[i]);
+  }
+  dst[i] = '\0';
+}
+
+/* The linear scan the index replaces. */
+static const KolibriAssociation *scan_partial(const KolibriFormulaPool *pool,
+                                              const char *question) {
+  char lowered_question[256];
+  lower_copy(question, lowered_question, sizeof(lowered_question));
+  size_t best_len = 0;
+  const KolibriAssociation *best = NULL;
+  for (size_t i = 0; i < pool->association_count; ++i) {
+    char lowered_assoc[256];
+    lower_copy(pool->associations[i].question, lowered_assoc, sizeof(lowered_assoc));
+    if (strstr(lowered_question, lowered_assoc) || strstr(lowered_assoc, lowered_question)) {
+      size_t len = strlen(pool->associations[i].question);
+      if (len > best_len) {
+        best_len = len;
+        best = &pool->associations[i];
+      }
+    }
+  }
+  return best;
+}
+
+static void test_association_index(void) {
+  KolibriPoolConfig config = {24, 400, 100, 5};
+  KolibriFormulaPool *pool = kf_pool_create(&config);
+  assert(pool != NULL);
+  char question[64];
+  char answer[32];
+  /* 150 questions into 100 slots, so the oldest are evicted. */
+  for (int i = 0; i < 150; ++i) {
+    if (i % 25 == 0) {
+      snprintf(question, sizeof(question), "%c", 'a' + i / 25);
+    } else {
+      snprintf(question, sizeof(question), "How much is %d PLUS %d", i % 13, i);
+    }
+    snprintf(answer, sizeof(answer), "%d", i);
+    kf_pool_add_association(pool, NULL, question, answer, "test", (uint64_t)i);
+  }
+  assert(pool->association_count == 100);
+  /* Updating a known question keeps its slot. */
+  kf_pool_add_association(pool, NULL, "How much is 3 PLUS 120", "new", "test", 200);
+  assert(pool->association_count == 100);
+
+  const char *queries[] = {
+      "how much is 3 plus 120", "HOW MUCH IS 3 PLUS 120?", "much is 7", "Plus 14",
+      "tell me: how much is 9 plus 139 today", "c", "", "xyz", "сколько будет", "e",
+  };
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+    assert(kf_pool_match_association(pool, queries[q]) == scan_partial(pool, queries[q]));
+  }
+  const KolibriAssociation *updated = kf_pool_match_association(pool, "how much is 3 plus 120");
+  assert(updated && strcmp(updated->answer, "new") == 0);
+
+  for (size_t i = 0; i < pool->association_count; ++i) {
+    const KolibriAssociation *found =
+        kf_pool_find_association(pool, pool->associations[i].input_hash);
+    assert(found && found <= &pool->associations[i]);
+    assert(found->input_hash == pool->associations[i].input_hash);
+  }
+  assert(kf_pool_find_association(pool, kf_hash_from_text("How much is 1 PLUS 1")) == NULL);
+
+  kf_pool_tick(pool, 2);
+  const KolibriFormula *best = kf_pool_best(pool);
+  char buffer[64];
+  char expected[64];
+  for (size_t i = 0; i < pool->association_count; ++i) {
+    int hash = pool->associations[i].input_hash;
+    int via_pool = kf_pool_lookup_answer(pool, best, hash, buffer, sizeof(buffer));
+    int via_scan = kf_formula_lookup_answer(best, hash, expected, sizeof(expected));
+    assert(via_pool == via_scan);
+    assert(via_pool != 0 || strcmp(buffer, expected) == 0);
+  }
+
+  kf_pool_clear_examples(pool);
+  assert(kf_pool_match_association(pool, "") == NULL);
+  assert(kf_pool_find_association(pool, 0) == NULL);
+  kf_pool_destroy(pool);
+}
+
+/* The bulk path must leave the same table, order and index as one call per
+ * pair, including when the table overflows and questions repeat. */
+static void test_bulk_associations(void) {
+  KolibriPoolConfig config = {24, 400, 16, 9};
+  KolibriFormulaPool *serial = kf_pool_create(&config);
+  KolibriFormulaPool *bulk = kf_pool_create(&config);
+  assert(serial && bulk);
+  KolibriSymbolTable serial_symbols;
+  KolibriSymbolTable bulk_symbols;
+  kolibri_symbol_table_init(&serial_symbols, NULL);
+  kolibri_symbol_table_init(&bulk_symbols, NULL);
+
+  char questions[90][32];
+  char answers[90][16];
+  KolibriAssociationInput items[90];
+  for (int i = 0; i < 90; ++i) {
+    snprintf(questions[i], sizeof(questions[i]), "вопрос %d", i % 7 == 0 ? 3 : i);
+    snprintf(answers[i], sizeof(answers[i]), "%d", i / 4);
+    items[i].question = questions[i];
+    items[i].answer = answers[i];
+  }
+  items[5].answer = NULL;
+  for (int i = 0; i < 90; ++i) {
+    if (items[i].answer) {
+      kf_pool_add_association(serial, &serial_symbols, items[i].question, items[i].answer, "bulk", 42);
+    }
+  }
+  /* Split in two so the second call starts from a full table. */
+  assert(kf_pool_add_associations_bulk(bulk, &bulk_symbols, items, 30, "bulk", 42) == 29);
+  assert(kf_pool_add_associations_bulk(bulk, &bulk_symbols, &items[30], 60, "bulk", 42) == 60);
+
+  assert(bulk->association_count == serial->association_count);
+  assert(bulk->examples == serial->examples);
+  for (size_t i = 0; i < serial->association_count; ++i) {
+    const KolibriAssociation *a = &serial->associations[i];
+    const KolibriAssociation *b = &bulk->associations[i];
+    assert(strcmp(a->question, b->question) == 0);
+    assert(strcmp(a->answer, b->answer) == 0);
+    assert(a->answer_digits_length == b->answer_digits_length);
+    assert(memcmp(a->answer_digits, b->answer_digits, a->answer_digits_length) == 0);
+    assert(a->question_digits_length == b->question_digits_length);
+    const KolibriAssociation *found = kf_pool_find_association(bulk, a->input_hash);
+    assert(found && found - bulk->associations ==
+                        kf_pool_find_association(serial, a->input_hash) - serial->associations);
+    assert(kf_pool_match_association(bulk, a->question) - bulk->associations ==
+           kf_pool_match_association(serial, a->question) - serial->associations);
+  }
+  assert(kf_pool_add_associations_bulk(bulk, NULL, NULL, 3, "bulk", 42) == 0);
+  kolibri_symbol_table_free(&serial_symbols);
+  kolibri_symbol_table_free(&bulk_symbols);
+  kf_pool_destroy(serial);
+  kf_pool_destroy(bulk);
+}
+
+static int same_formulas(const KolibriFormulaPool *a, const KolibriFormulaPool *b) {
+  for (size_t i = 0; i < a->count; ++i) {
+    const KolibriFormula *x = &a->formulas[i];
+    const KolibriFormula *y = &b->formulas[i];
+    if (x->gene.length != y->gene.length ||
+        memcmp(x->gene.digits, y->gene.digits, x->gene.length) != 0 ||
+        x->fitness != y->fitness || x->feedback != y->feedback ||
+        x->association_count != y->association_count ||
+        (x->associations == a->associations) != (y->associations == b->associations)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void test_pool_checkpoint(void) {
+  char path[] = "/tmp/kolibri_pool_ckptXXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  close(fd);
+  KolibriFormulaPool *pool = malloc(sizeof(*pool));
+  KolibriFormulaPool *restored = malloc(sizeof(*restored));
+  assert(pool && restored);
+  kf_pool_init(pool, 31);
+  kf_pool_init(restored, 99);
+  KolibriSymbolTable symbols;
+  kolibri_symbol_table_init(&symbols, NULL);
+  assert(kf_pool_add_association(pool, &symbols, "столица франции", "париж", "ckpt", 5) == 0);
+  assert(kf_pool_add_association(pool, NULL, "2+2", "4", "ckpt", 6) == 0);
+  teach_linear_task(pool);
+  assert(kf_pool_add_example(pool, -7, -13) == 0);
+  kf_pool_set_penalties(pool, 0.01, 0.02);
+  kf_pool_set_sampling(pool, 0.5, 6);
+  kf_pool_tick(pool, 16);
+  assert(kf_pool_feedback(pool, &kf_pool_best(pool)->gene, 0.5) == 0);
+
+  uint64_t saved = 0;
+  uint64_t loaded = 0;
+  assert(kf_pool_save(pool, path, &saved) == 0);
+  assert(kf_pool_load(restored, path, &loaded) == 0);
+  assert(saved == loaded && saved != 0);
+  assert(same_formulas(pool, restored));
+  assert(restored->rng.state == pool->rng.state);
+  assert(restored->examples == pool->examples && restored->input_peak == pool->input_peak);
+  assert(memcmp(restored->inputs, pool->inputs, pool->examples * sizeof(int)) == 0);
+  assert(memcmp(restored->targets, pool->targets, pool->examples * sizeof(int)) == 0);
+  assert(restored->lambda_d == pool->lambda_d && restored->top_k == 6);
+  assert(restored->association_count == 2);
+  for (size_t i = 0; i < pool->association_count; ++i) {
+    const KolibriAssociation *a = &pool->associations[i];
+    const KolibriAssociation *b = &restored->associations[i];
+    assert(strcmp(a->question, b->question) == 0 && strcmp(a->answer, b->answer) == 0);
+    assert(strcmp(a->source, b->source) == 0 && a->timestamp == b->timestamp);
+    assert(a->answer_digits_length == b->answer_digits_length);
+    assert(memcmp(a->answer_digits, b->answer_digits, a->answer_digits_length) == 0);
+    assert(kf_pool_find_association(restored, a->input_hash) == b);
+  }
+  assert(kf_pool_match_association(restored, "какая столица франции?") == &restored->associations[0]);
+  /* The restored pool evolves exactly like the one it was taken from. */
+  kf_pool_tick(pool, 8);
+  kf_pool_tick(restored, 8);
+  assert(same_formulas(pool, restored));
+
+  /* A damaged, truncated or ill-fitting checkpoint leaves the pool alone. */
+  assert(kf_pool_save(pool, path, &saved) == 0);
+  FILE *file = fopen(path, "r+b");
+  assert(file && fseek(file, 40L, SEEK_SET) == 0);
+  int byte = fgetc(file);
+  assert(fseek(file, 40L, SEEK_SET) == 0 && fputc(byte ^ 0x20, file) != EOF);
+  fclose(file);
+  uint64_t state = restored->rng.state;
+  assert(kf_pool_load(restored, path, NULL) == -1);
+  assert(restored->rng.state == state);
+  assert(truncate(path, 12) == 0);
+  assert(kf_pool_load(restored, path, NULL) == -1);
+  KolibriPoolConfig config = {8, 0, 0, 1};
+  KolibriFormulaPool *small = kf_pool_create(&config);
+  assert(small != NULL);
+  assert(kf_pool_save(pool, path, NULL) == 0);
+  assert(kf_pool_load(small, path, NULL) == -1);
+  kf_pool_destroy(small);
+  remove(path);
+  assert(kf_pool_load(restored, path, NULL) == 1);
+
+  kolibri_symbol_table_free(&symbols);
+  free(pool);
+  free(restored);
+}
+
 void test_formula(void) {
   KolibriFormulaPool pool;
   kf_pool_init(&pool, 77);
@@ -100,4 +556,14 @@ void test_formula(void) {
   assert_deterministic();
   test_feedback_adjustment();
   test_sampling_controls();
+  test_shared_associations();
+  test_parallel_evaluation();
+  test_heap_pool();
+  test_batch_evaluation();
+  test_fitness_cache();
+  test_pool_profile();
+  test_tick_budget();
+  test_association_index();
+  test_bulk_associations();
+  test_pool_checkpoint();
 }
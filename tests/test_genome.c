@@ -36,6 +36,305 @@ static void assert_payload_digits(const char *digits) {
   }
 }
 
+static void test_genome_parallel_verify(void) {
+  char template[] = "/tmp/kolibri_genome_parXXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+  char checkpoint[64];
+  snprintf(checkpoint, sizeof(checkpoint), "%s.verified", template);
+
+  const unsigned char key[] = "parallel-key";
+  KolibriGenome genome;
+  int rc = kg_open(&genome, template, key, sizeof(key) - 1);
+  assert(rc == 0);
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("bulk", payload, sizeof(payload)) == 0);
+  enum { BATCH = 1000, ROUNDS = 5 };
+  KolibriGenomeEntry *entries =
+      (KolibriGenomeEntry *)calloc(BATCH, sizeof(KolibriGenomeEntry));
+  assert(entries != NULL);
+  for (size_t i = 0; i < BATCH; ++i) {
+    entries[i].event_type = "BULK";
+    entries[i].payload = payload;
+  }
+  for (int round = 0; round < ROUNDS; ++round) {
+    rc = kg_append_batch(&genome, entries, BATCH, NULL);
+    assert(rc == 0);
+  }
+  free(entries);
+  kg_close(&genome);
+
+  KolibriGenomeReader reader;
+  rc = kg_reader_open(&reader, template);
+  assert(rc == 0);
+  assert(reader.block_count == (uint64_t)BATCH * ROUNDS);
+  ReasonBlock block;
+  rc = kg_read_block(&reader, 4321, &block);
+  assert(rc == 0);
+  assert(block.index == 4321);
+  assert(strcmp(block.event_type, "BULK") == 0);
+  assert(kg_read_block(&reader, reader.block_count, &block) == -1);
+  kg_reader_close(&reader);
+
+  KolibriGenomeVerifyOptions options = {4, checkpoint};
+  rc = kg_verify_file_ex(template, key, sizeof(key) - 1, &options);
+  assert(rc == 0);
+  assert(access(checkpoint, F_OK) == 0);
+
+  /* Reopening trusts the checkpointed prefix and appends after it. */
+  rc = kg_open_ex(&genome, template, key, sizeof(key) - 1, &options);
+  assert(rc == 0);
+  assert(genome.next_index == (uint64_t)BATCH * ROUNDS);
+  kg_close(&genome);
+
+  FILE *f = fopen(template, "r+b");
+  assert(f != NULL);
+  long offset = 4000L * (long)KOLIBRI_BLOCK_SIZE + 120L;
+  assert(fseek(f, offset, SEEK_SET) == 0);
+  int byte = fgetc(f);
+  assert(byte != EOF);
+  assert(fseek(f, offset, SEEK_SET) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+
+  /* The checkpoint vouches for the damaged prefix; checks without it fail. */
+  rc = kg_verify_file_ex(template, key, sizeof(key) - 1, NULL);
+  assert(rc == -1);
+  KolibriGenomeVerifyOptions parallel = {8, NULL};
+  rc = kg_verify_file_ex(template, key, sizeof(key) - 1, &parallel);
+  assert(rc == -1);
+
+  remove(checkpoint);
+  remove(template);
+}
+
+static void test_genome_segments(void) {
+  char dir[] = "/tmp/kolibri_genome_segXXXXXX";
+  assert(mkdtemp(dir) != NULL);
+  const unsigned char key[] = "segment-key";
+  const size_t key_len = sizeof(key) - 1;
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("seg", payload, sizeof(payload)) == 0);
+  KolibriGenomeEntry entries[7];
+  for (size_t i = 0; i < 7; ++i) {
+    entries[i].event_type = "SEG";
+    entries[i].payload = payload;
+  }
+
+  KolibriGenome genome;
+  int rc = kg_open_segmented(&genome, dir, key, key_len, 4);
+  assert(rc == 0);
+  /* 7 + 3 blocks: segments [0,4) and [4,8) sealed, [8,10) active. */
+  rc = kg_append_batch(&genome, entries, 7, NULL);
+  assert(rc == 0);
+  rc = kg_append_batch(&genome, entries, 3, NULL);
+  assert(rc == 0);
+  kg_close(&genome);
+
+  KolibriGenomeSegment *segments = NULL;
+  size_t count = 0;
+  rc = kg_segments_load(dir, key, key_len, &segments, &count);
+  assert(rc == 0);
+  assert(count == 2);
+  assert(segments[1].first_index == 4 && segments[1].block_count == 4);
+  free(segments);
+
+  rc = kg_open_segmented(&genome, dir, key, key_len, 4);
+  assert(rc == 0);
+  assert(genome.next_index == 10);
+  rc = kg_append(&genome, "SEG", payload, NULL);
+  assert(rc == 0);
+  kg_close(&genome);
+  assert(kg_verify_segmented(dir, key, key_len, NULL) == 0);
+
+  /* Folding keeps the chain verifiable across the summary. */
+  rc = kg_compact(dir, key, key_len, 1);
+  assert(rc == 1);
+  char path[128];
+  snprintf(path, sizeof(path), "%s/segment-%020d.dat", dir, 0);
+  assert(access(path, F_OK) != 0);
+  assert(kg_verify_segmented(dir, key, key_len, NULL) == 0);
+  rc = kg_segments_load(dir, key, key_len, &segments, &count);
+  assert(rc == 0);
+  assert(count == 2 && segments[0].file[0] == '\0');
+  free(segments);
+  rc = kg_open_segmented(&genome, dir, key, key_len, 4);
+  assert(rc == 0);
+  assert(genome.next_index == 11);
+  kg_close(&genome);
+
+  const unsigned char wrong[] = "other-key";
+  assert(kg_segments_load(dir, wrong, sizeof(wrong) - 1, &segments, &count) ==
+         -1);
+
+  /* Damage in a sealed segment is caught by the full check only. */
+  snprintf(path, sizeof(path), "%s/segment-%020d.dat", dir, 4);
+  FILE *f = fopen(path, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, 120L, SEEK_SET) == 0);
+  int byte = fgetc(f);
+  assert(fseek(f, 120L, SEEK_SET) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+  assert(kg_verify_segmented(dir, key, key_len, NULL) == -1);
+  rc = kg_open_segmented(&genome, dir, key, key_len, 4);
+  assert(rc == 0);
+  kg_close(&genome);
+
+  remove(path);
+  snprintf(path, sizeof(path), "%s/segment-%020d.dat", dir, 8);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/MANIFEST", dir);
+  remove(path);
+  rmdir(dir);
+}
+
+static void test_genome_packed_format(void) {
+  char template[] = "/tmp/kolibri_genome_v2XXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+  const unsigned char key[] = "packed-key";
+  const size_t key_len = sizeof(key) - 1;
+
+  KolibriGenome genome;
+  int rc = kg_open(&genome, template, key, key_len);
+  assert(rc == 0);
+  assert(kg_set_format(&genome, KOLIBRI_GENOME_FORMAT_V2) == 0);
+  char text[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("привет", text, sizeof(text)) == 0);
+  /* Not a byte triple sequence, so it is stored as BCD. */
+  const char *odd = "12345";
+  KolibriGenomeEntry entries[3] = {{"TEXT", text}, {"ODD", odd}, {"EMPTY", NULL}};
+  rc = kg_append_batch(&genome, entries, 3, NULL);
+  assert(rc == 0);
+  kg_close(&genome);
+
+  rc = kg_open(&genome, template, key, key_len);
+  assert(rc == 0);
+  assert(genome.format == KOLIBRI_GENOME_FORMAT_V2);
+  assert(genome.next_index == 3);
+  assert(kg_set_format(&genome, KOLIBRI_GENOME_FORMAT_V1) == -1);
+  rc = kg_append(&genome, "TEXT", text, NULL);
+  assert(rc == 0);
+  kg_close(&genome);
+  assert(kg_verify_file(template, key, key_len) == 0);
+
+  KolibriGenomeReader reader;
+  rc = kg_reader_open(&reader, template);
+  assert(rc == 0);
+  assert(reader.format == KOLIBRI_GENOME_FORMAT_V2);
+  assert(reader.block_count == 4);
+  assert(reader.size < 4U * KOLIBRI_BLOCK_SIZE / 2U);
+  ReasonBlock block;
+  assert(kg_read_block(&reader, 0, &block) == 0);
+  assert(strcmp(block.payload, text) == 0);
+  assert(kg_read_block(&reader, 1, &block) == 0);
+  assert(strcmp(block.event_type, "ODD") == 0);
+  assert(strcmp(block.payload, odd) == 0);
+  assert(kg_read_block(&reader, 2, &block) == 0);
+  assert(block.index == 2 && block.payload[0] == '\0');
+  kg_reader_close(&reader);
+
+  /* Flip a packed payload byte of the last record. */
+  FILE *f = fopen(template, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, -3L, SEEK_END) == 0);
+  int byte = fgetc(f);
+  assert(fseek(f, -3L, SEEK_END) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+  assert(kg_verify_file(template, key, key_len) == -1);
+
+  remove(template);
+}
+
+static void test_genome_follow(void) {
+  char template[] = "/tmp/kolibri_genome_followXXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+  const unsigned char key[] = "follow-key";
+  const size_t key_len = sizeof(key) - 1;
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("tail", payload, sizeof(payload)) == 0);
+  KolibriGenomeEntry entries[5];
+  for (size_t i = 0; i < 5; ++i) {
+    entries[i].event_type = "TAIL";
+    entries[i].payload = payload;
+  }
+
+  KolibriGenome genome;
+  assert(kg_open(&genome, template, key, key_len) == 0);
+  assert(kg_append_batch(&genome, entries, 5, NULL) == 0);
+
+  KolibriGenomeFollower follower;
+  assert(kg_follow_open(&follower, template, key, key_len, 2) == 0);
+  ReasonBlock block;
+  for (uint64_t expected = 2; expected < 5; ++expected) {
+    assert(kg_follow(&follower, &block, 0) == 0);
+    assert(block.index == expected);
+  }
+  assert(kg_follow(&follower, &block, 10) == 1);
+  assert(kg_append_batch(&genome, entries, 2, NULL) == 0);
+  assert(kg_follow(&follower, &block, 1000) == 0);
+  assert(block.index == 5);
+  assert(kg_follow(&follower, &block, 0) == 0);
+  assert(block.index == 6);
+  kg_follow_close(&follower);
+  kg_close(&genome);
+  remove(template);
+
+  /* A packed segmented genome is followed across its segment files. */
+  char dir[] = "/tmp/kolibri_genome_fsegXXXXXX";
+  assert(mkdtemp(dir) != NULL);
+  assert(kg_open_segmented(&genome, dir, key, key_len, 3) == 0);
+  assert(kg_set_format(&genome, KOLIBRI_GENOME_FORMAT_V2) == 0);
+  assert(kg_append_batch(&genome, entries, 5, NULL) == 0);
+  assert(kg_follow_open(&follower, dir, key, key_len, 1) == 0);
+  for (uint64_t expected = 1; expected < 5; ++expected) {
+    assert(kg_follow(&follower, &block, 0) == 0);
+    assert(block.index == expected);
+  }
+  assert(kg_follow(&follower, &block, 0) == 1);
+  assert(kg_append_batch(&genome, entries, 3, NULL) == 0);
+  for (uint64_t expected = 5; expected < 8; ++expected) {
+    assert(kg_follow(&follower, &block, 0) == 0);
+    assert(block.index == expected);
+  }
+  kg_follow_close(&follower);
+  kg_close(&genome);
+
+  /* Compacted blocks are skipped; a damaged block stops the cursor. */
+  assert(kg_compact(dir, key, key_len, 1) == 1);
+  assert(kg_follow_open(&follower, dir, key, key_len, 0) == 0);
+  assert(follower.start_index == 3);
+  assert(kg_follow(&follower, &block, 0) == 0);
+  assert(block.index == 3);
+  kg_follow_close(&follower);
+  char path[128];
+  snprintf(path, sizeof(path), "%s/segment-%020d.dat", dir, 6);
+  FILE *f = fopen(path, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, -2L, SEEK_END) == 0);
+  int byte = fgetc(f);
+  assert(fseek(f, -2L, SEEK_END) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+  assert(kg_follow_open(&follower, dir, key, key_len, 6) == 0);
+  assert(kg_follow(&follower, &block, 0) == 0);
+  assert(kg_follow(&follower, &block, 0) == -1);
+  kg_follow_close(&follower);
+
+  remove(path);
+  snprintf(path, sizeof(path), "%s/segment-%020d.dat", dir, 3);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/MANIFEST", dir);
+  remove(path);
+  rmdir(dir);
+}
+
 void test_genome(void) {
   char template[] = "/tmp/kolibri_genomeXXXXXX";
   int fd = mkstemp(template);
@@ -76,6 +375,25 @@ void test_genome(void) {
   assert(rc == 0);
   assert(block3.index == 2);
 
+  KolibriGenomeSyncPolicy policy = {KG_SYNC_FDATASYNC, 0, 0};
+  kg_set_sync_policy(&genome, &policy);
+  KolibriGenomeEntry entries[2] = {{"TEST", payload1}, {"TEST", payload2}};
+  ReasonBlock batch_blocks[2];
+  KolibriGenomeEntry bad_entries[2] = {{"TEST", payload1}, {"TEST", "notdigits"}};
+  rc = kg_append_batch(&genome, bad_entries, 2, NULL);
+  assert(rc == -1);
+  assert(genome.next_index == 3);
+  rc = kg_append_batch(&genome, entries, 2, batch_blocks);
+  assert(rc == 0);
+  assert(batch_blocks[0].index == 3);
+  assert(batch_blocks[1].index == 4);
+  assert(genome.unsynced_blocks == 2);
+  rc = kg_sync(&genome);
+  assert(rc == 0);
+  assert(genome.unsynced_blocks == 0);
+  rc = kg_verify_file(template, key, sizeof(key) - 1);
+  assert(rc == 0);
+
   kg_close(&genome);
 
   FILE *f = fopen(template, "rb");
@@ -83,7 +401,7 @@ void test_genome(void) {
   int seek_rc = fseek(f, 0, SEEK_END);
   assert(seek_rc == 0);
   long size = ftell(f);
-  assert(size == 3L * (long)KOLIBRI_BLOCK_SIZE);
+  assert(size == 5L * (long)KOLIBRI_BLOCK_SIZE);
   seek_rc = fseek(f, 0, SEEK_SET);
   assert(seek_rc == 0);
 
@@ -158,4 +476,9 @@ void test_genome(void) {
 
   rc = kg_verify_file(template, key, sizeof(key) - 1);
   assert(rc == 1);
+
+  test_genome_parallel_verify();
+  test_genome_segments();
+  test_genome_packed_format();
+  test_genome_follow();
 }
@@ -0,0 +1,96 @@
+#include "kolibri/island.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void test_migration_targets(void) {
+    KolibriMigrationPolicy policy;
+    kf_migration_policy_default(&policy);
+    size_t targets[8];
+
+    assert(kf_migration_targets(&policy, 3, 4, 0, targets, 8) == 1);
+    assert(targets[0] == 0);
+    assert(kf_migration_targets(&policy, 0, 1, 0, targets, 8) == 0);
+
+    policy.topology = KOLIBRI_MIGRATION_FULL;
+    assert(kf_migration_targets(&policy, 1, 4, 0, targets, 8) == 3);
+    assert(targets[0] == 2 && targets[1] == 3 && targets[2] == 0);
+
+    policy.topology = KOLIBRI_MIGRATION_RANDOM;
+    for (uint64_t r = 0; r < 16; ++r) {
+        assert(kf_migration_targets(&policy, 2, 5, r, targets, 8) == 1);
+        assert(targets[0] != 2 && targets[0] < 5);
+    }
+
+    KolibriMigrationTopology topology;
+    assert(kf_migration_topology_parse("full", &topology) == 0);
+    assert(topology == KOLIBRI_MIGRATION_FULL);
+    assert(kf_migration_topology_parse("star", &topology) == -1);
+}
+
+static void test_immigrate(void) {
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 11);
+    assert(kf_pool_add_example(pool, 1, 3) == 0);
+    kf_pool_tick(pool, 2);
+
+    KolibriFormula migrant = pool->formulas[pool->count - 1];
+    migrant.gene.digits[0] = (uint8_t)((migrant.gene.digits[0] + 1U) % 10U);
+    migrant.gene.digits[1] = (uint8_t)((migrant.gene.digits[1] + 3U) % 10U);
+    migrant.fitness = 2.0;
+    assert(kf_pool_immigrate(pool, &migrant, 1) == 1);
+    assert(memcmp(pool->formulas[0].gene.digits, migrant.gene.digits,
+                  migrant.gene.length) == 0);
+    assert(pool->formulas[0].associations == NULL);
+    /* A gene the pool already holds is not taken twice. */
+    assert(kf_pool_immigrate(pool, &migrant, 1) == 0);
+    free(pool);
+}
+
+static void run_archipelago(uint64_t seed, KolibriFormula *best_out, uint64_t *migrations) {
+    KolibriFormulaPool *home = malloc(sizeof(*home));
+    assert(home);
+    kf_pool_init(home, seed);
+    for (int i = 0; i < 8; ++i) {
+        assert(kf_pool_add_example(home, i, 3 * i + 2) == 0);
+    }
+    KolibriMigrationPolicy policy = {KOLIBRI_MIGRATION_RING, 4, 2};
+    KolibriArchipelago archipelago;
+    assert(kf_archipelago_init(&archipelago, home, 4, &policy, seed) == 0);
+    assert(archipelago.count == 4);
+    kf_archipelago_tick(&archipelago, 10);
+    kf_archipelago_tick(&archipelago, 6);
+    for (size_t i = 1; i < archipelago.count; ++i) {
+        assert(archipelago.islands[i]->examples == home->examples);
+    }
+    const KolibriFormula *best = kf_archipelago_best(&archipelago);
+    assert(best != NULL);
+    assert(best->fitness >= kf_pool_best(home)->fitness);
+    *best_out = *best;
+    *migrations = archipelago.migrations;
+    kf_archipelago_free(&archipelago);
+    assert(archipelago.count == 1);
+    free(home);
+}
+
+static void test_archipelago(void) {
+    KolibriFormula first;
+    KolibriFormula second;
+    uint64_t first_migrations = 0;
+    uint64_t second_migrations = 0;
+    run_archipelago(31337, &first, &first_migrations);
+    run_archipelago(31337, &second, &second_migrations);
+    /* 16 generations at interval 4. */
+    assert(first_migrations == 4);
+    assert(first_migrations == second_migrations);
+    assert(first.fitness == second.fitness);
+    assert(memcmp(first.gene.digits, second.gene.digits, sizeof(first.gene.digits)) == 0);
+}
+
+void test_island(void) {
+    test_migration_targets();
+    test_immigrate();
+    test_archipelago();
+}
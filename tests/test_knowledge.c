@@ -0,0 +1,59 @@
+#include "kolibri/knowledge.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void write_note(const char *path, const char *content) {
+    FILE *f = fopen(path, "wb");
+    assert(f);
+    fputs(content, f);
+    fclose(f);
+}
+
+static size_t search_ids(const KolibriKnowledgeIndex *index, const char *query, char *ids, size_t ids_size) {
+    const KolibriKnowledgeDocument *results[4];
+    double scores[4];
+    size_t count = kolibri_knowledge_search(index, query, 4U, results, scores);
+    ids[0] = '\0';
+    for (size_t i = 0; i < count; ++i) {
+        strncat(ids, results[i]->id, ids_size - strlen(ids) - 2U);
+        strcat(ids, " ");
+    }
+    return count;
+}
+
+void test_knowledge(void) {
+    system("rm -rf ./test_legacy && mkdir -p ./test_legacy");
+    write_note("./test_legacy/alpha.md", "# Alpha\nThe Knowledge server answers.\n");
+    write_note("./test_legacy/beta.txt", "abc then bcd, and X7 codes\n");
+
+    KolibriKnowledgeIndex index;
+    assert(kolibri_knowledge_index_init(&index) == 0);
+    assert(kolibri_knowledge_index_load_directory(&index, "./test_legacy") == 0);
+    assert(index.count == 2U && index.grams != NULL);
+
+    char ids[128];
+    /* Substring semantics: fragments of words match, case is ignored. */
+    assert(search_ids(&index, "LEDGE", ids, sizeof(ids)) == 1U && strcmp(ids, "alpha ") == 0);
+    assert(search_ids(&index, "x7", ids, sizeof(ids)) == 1U && strcmp(ids, "beta ") == 0);
+    /* Both trigrams of "abcd" occur in beta, the string itself does not. */
+    assert(search_ids(&index, "abcd", ids, sizeof(ids)) == 0U);
+    assert(search_ids(&index, "the answers", ids, sizeof(ids)) == 2U && strcmp(ids, "alpha beta ") == 0);
+
+    /* A second root is appended and the postings are rebuilt over both. */
+    system("mkdir -p ./test_legacy/more");
+    write_note("./test_legacy/more/gamma.md", "# Gamma\nbcdabcd\n");
+    KolibriKnowledgeIndex extra;
+    kolibri_knowledge_index_init(&extra);
+    assert(kolibri_knowledge_index_load_directory(&extra, "./test_legacy/more") == 0);
+    assert(kolibri_knowledge_index_load_directory(&index, "./test_legacy/more") == 0);
+    assert(index.count == 3U);
+    assert(search_ids(&index, "abcd", ids, sizeof(ids)) == 1U && strcmp(ids, "gamma ") == 0);
+    assert(search_ids(&extra, "dab", ids, sizeof(ids)) == 1U && strcmp(ids, "gamma ") == 0);
+
+    kolibri_knowledge_index_free(&extra);
+    kolibri_knowledge_index_free(&index);
+    system("rm -rf ./test_legacy");
+}
@@ -1,7 +1,12 @@
 #include "kolibri/knowledge_index.h"
 
+#include <errno.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 static int write_markdown(const char *path, const char *content) {
     FILE *f = fopen(path, "wb");
@@ -59,6 +64,1014 @@ void test_knowledge_index(void) {
         exit(1);
     }
 
+    unsigned long long before = 0ULL;
+    unsigned long long again = 0ULL;
+    unsigned long long after = 0ULL;
+    kolibri_knowledge_index_fingerprint(roots, 1U, &before);
+    kolibri_knowledge_index_fingerprint(roots, 1U, &again);
+    write_markdown("./test_data/gamma.md", "# Третий\nНовый документ\n");
+    kolibri_knowledge_index_fingerprint(roots, 1U, &after);
+    if (before != again || before == after) {
+        fprintf(stderr, "fingerprint did not track sources\n");
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+
+    kolibri_knowledge_index_destroy(index);
+
+    /* Vocabulary larger than the initial dictionary forces rehashing. */
+    FILE *wide = fopen("./test_data/wide.md", "wb");
+    if (!wide) {
+        cleanup();
+        exit(1);
+    }
+    fputs("# Словарь\n", wide);
+    for (int i = 0; i < 3000; ++i) {
+        fprintf(wide, "term%d ", i);
+    }
+    fclose(wide);
+    index = NULL;
+    err = kolibri_knowledge_index_create(roots, 1U, 256U, &index);
+    if (err != 0 || !index || kolibri_knowledge_index_token_count(index) < 3000U) {
+        fprintf(stderr, "wide vocabulary build failed: %d\n", err);
+        cleanup();
+        exit(1);
+    }
+    err = kolibri_knowledge_index_write_json(index, "./test_data/cache");
+    kolibri_knowledge_index_destroy(index);
+    index = NULL;
+    if (err != 0 || kolibri_knowledge_index_load_json("./test_data/cache", &index) != 0 || !index) {
+        fprintf(stderr, "json round trip failed: %d\n", err);
+        cleanup();
+        exit(1);
+    }
+    result_count = 0U;
+    err = kolibri_knowledge_index_search(index, "kolibri", 2U, indices, scores, &result_count);
+    doc = result_count > 0U ? kolibri_knowledge_index_document(index, indices[0]) : NULL;
+    if (err != 0 || !doc || strcmp(doc->id, "alpha") != 0) {
+        fprintf(stderr, "search after reload failed: %d\n", err);
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+
+    KolibriKnowledgeIndex *mapped = NULL;
+    if (kolibri_knowledge_index_write_binary(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != 0 || !mapped ||
+        kolibri_knowledge_index_token_count(mapped) != kolibri_knowledge_index_token_count(index)) {
+        fprintf(stderr, "binary snapshot round trip failed\n");
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+    size_t mapped_indices[2];
+    float mapped_scores[2];
+    size_t mapped_count = 0U;
+    err = kolibri_knowledge_index_search(mapped, "kolibri", 2U, mapped_indices, mapped_scores, &mapped_count);
+    const KolibriKnowledgeDoc *mapped_doc = mapped_count > 0U ? kolibri_knowledge_index_document(mapped, mapped_indices[0]) : NULL;
+    if (err != 0 || mapped_count != result_count || !mapped_doc || strcmp(mapped_doc->id, doc->id) != 0 ||
+        strcmp(mapped_doc->content, doc->content) != 0 || mapped_scores[0] != scores[0]) {
+        fprintf(stderr, "search over binary snapshot differs\n");
+        kolibri_knowledge_index_destroy(mapped);
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(mapped);
+
+    FILE *snapshot = fopen("./test_data/cache/index.kbin", "r+b");
+    if (snapshot) {
+        fseek(snapshot, 12, SEEK_SET);
+        fputc(0x7f, snapshot);
+        fclose(snapshot);
+    }
+    mapped = NULL;
+    if (kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != EINVAL || mapped) {
+        fprintf(stderr, "corrupt binary snapshot accepted\n");
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+
+    /* Pruned top-k must agree with the head of the full ranking. */
+    system("mkdir -p ./test_data");
+    for (int i = 0; i < 40; ++i) {
+        char path[64];
+        snprintf(path, sizeof(path), "./test_data/doc%d.md", i);
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            cleanup();
+            exit(1);
+        }
+        fprintf(f, "# Doc %d\ncommon ", i);
+        for (int r = 0; r < (i % 7) + 1; ++r) {
+            fputs("rare ", f);
+        }
+        for (int r = 0; r < (i % 5); ++r) {
+            fprintf(f, "filler%d ", r);
+        }
+        fclose(f);
+    }
+    index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        cleanup();
+        exit(1);
+    }
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 256U;
+    options.threads = 4U;
+    KolibriKnowledgeIndex *parallel = NULL;
+    if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &parallel) != 0 || !parallel ||
+        kolibri_knowledge_index_token_count(parallel) != kolibri_knowledge_index_token_count(index) ||
+        kolibri_knowledge_index_document_count(parallel) != kolibri_knowledge_index_document_count(index)) {
+        fprintf(stderr, "parallel build differs in shape\n");
+        cleanup();
+        exit(1);
+    }
+    for (size_t i = 0; i < kolibri_knowledge_index_token_count(index); ++i) {
+        if (strcmp(kolibri_knowledge_index_token(index, i)->token, kolibri_knowledge_index_token(parallel, i)->token) != 0) {
+            fprintf(stderr, "parallel build token order differs at %zu\n", i);
+            cleanup();
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < kolibri_knowledge_index_document_count(index); ++i) {
+        const KolibriKnowledgeDoc *serial_doc = kolibri_knowledge_index_document(index, i);
+        const KolibriKnowledgeDoc *parallel_doc = kolibri_knowledge_index_document(parallel, i);
+        if (serial_doc->vector_size != parallel_doc->vector_size || serial_doc->norm != parallel_doc->norm ||
+            strcmp(serial_doc->source, parallel_doc->source) != 0) {
+            fprintf(stderr, "parallel build document differs at %zu\n", i);
+            cleanup();
+            exit(1);
+        }
+    }
+    kolibri_knowledge_index_destroy(parallel);
+
+    size_t all_indices[40];
+    float all_scores[40];
+    size_t all_count = 0U;
+    size_t top_indices[3];
+    float top_scores[3];
+    size_t top_count = 0U;
+    kolibri_knowledge_index_search(index, "rare common filler3", 40U, all_indices, all_scores, &all_count);
+    kolibri_knowledge_index_search(index, "rare common filler3", 3U, top_indices, top_scores, &top_count);
+    if (all_count != 40U || top_count != 3U) {
+        fprintf(stderr, "unexpected result counts: %zu %zu\n", all_count, top_count);
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+    for (size_t i = 0; i < 3U; ++i) {
+        if (top_scores[i] != all_scores[i] || (i > 0 && all_scores[i] > all_scores[i - 1U])) {
+            fprintf(stderr, "top-k mismatch at %zu\n", i);
+            kolibri_knowledge_index_destroy(index);
+            cleanup();
+            exit(1);
+        }
+    }
+
+    const char *batch[3] = {"rare common filler3", "unknownword", "filler1 rare"};
+    size_t batch_indices[3 * 5];
+    float batch_scores[3 * 5];
+    size_t batch_counts[3];
+    err = kolibri_knowledge_index_search_batch(index, batch, 3U, 5U, batch_indices, batch_scores, batch_counts);
+    if (err != 0 || batch_counts[1] != 0U) {
+        fprintf(stderr, "batch search failed: %d\n", err);
+        kolibri_knowledge_index_destroy(index);
+        cleanup();
+        exit(1);
+    }
+    for (size_t q = 0; q < 3U; ++q) {
+        size_t single_indices[5];
+        float single_scores[5];
+        size_t single_count = 0U;
+        kolibri_knowledge_index_search(index, batch[q], 5U, single_indices, single_scores, &single_count);
+        if (single_count != batch_counts[q]) {
+            fprintf(stderr, "batch count mismatch for query %zu\n", q);
+            kolibri_knowledge_index_destroy(index);
+            cleanup();
+            exit(1);
+        }
+        for (size_t i = 0; i < single_count; ++i) {
+            if (single_indices[i] != batch_indices[q * 5U + i] ||
+                fabsf(single_scores[i] - batch_scores[q * 5U + i]) > 1e-6f) {
+                fprintf(stderr, "batch result mismatch for query %zu at %zu\n", q, i);
+                kolibri_knowledge_index_destroy(index);
+                cleanup();
+                exit(1);
+            }
+        }
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static float top_score(const KolibriKnowledgeIndex *index, const char *query, const char **out_id) {
+    size_t indices[1];
+    float scores[1];
+    size_t count = 0U;
+    if (kolibri_knowledge_index_search(index, query, 1U, indices, scores, &count) != 0 || count == 0U) {
+        *out_id = NULL;
+        return 0.0f;
+    }
+    *out_id = kolibri_knowledge_index_document(index, indices[0])->id;
+    return scores[0];
+}
+
+void test_knowledge_index_incremental(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    write_markdown("./test_data/alpha.md", "# Alpha\nkolibri shared words here\n");
+    write_markdown("./test_data/beta.md", "# Beta\nshared words and beta specifics\n");
+    write_markdown("./test_data/gamma.md", "# Gamma\ngamma only text shared\n");
+
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 256U;
+    KolibriKnowledgeIndex *plain = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &plain);
+    if (!plain || kolibri_knowledge_index_remove_document(plain, "./test_data/alpha.md") != ENOTSUP) {
+        fprintf(stderr, "index without term counts accepted an update\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(plain);
+
+    options.keep_term_counts = 1;
+    options.idf_staleness = 0.0;
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &index) != 0 ||
+        kolibri_knowledge_index_write_json(index, "./test_data/cache") != 0) {
+        fprintf(stderr, "incremental base build failed\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(index);
+
+    write_markdown("./test_data/beta.md", "# Beta\nrewritten beta about kolibri\n");
+    write_markdown("./test_data/delta.md", "# Delta\nfresh delta document\n");
+    remove("./test_data/gamma.md");
+
+    index = NULL;
+    size_t changed = 0U;
+    if (kolibri_knowledge_index_load_json("./test_data/cache", &index) != 0 ||
+        kolibri_knowledge_index_update(index, roots, 1U, &options, &changed) != 0 || changed != 3U ||
+        kolibri_knowledge_index_document_count(index) != 3U) {
+        fprintf(stderr, "incremental update failed: %zu changed\n", changed);
+        cleanup();
+        exit(1);
+    }
+    changed = 1U;
+    if (kolibri_knowledge_index_update(index, roots, 1U, &options, &changed) != 0 || changed != 0U) {
+        fprintf(stderr, "unchanged sources were reprocessed\n");
+        cleanup();
+        exit(1);
+    }
+
+    KolibriKnowledgeIndex *fresh = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &fresh);
+    const char *queries[] = {"kolibri", "delta", "gamma", "beta rewritten"};
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+        const char *updated_id = NULL;
+        const char *fresh_id = NULL;
+        float updated = top_score(index, queries[i], &updated_id);
+        float rebuilt = top_score(fresh, queries[i], &fresh_id);
+        if (fabsf(updated - rebuilt) > 1e-5f || (updated_id == NULL) != (fresh_id == NULL) ||
+            (updated_id && strcmp(updated_id, fresh_id) != 0)) {
+            fprintf(stderr, "incremental index diverged on '%s'\n", queries[i]);
+            cleanup();
+            exit(1);
+        }
+    }
+    kolibri_knowledge_index_destroy(fresh);
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+void test_knowledge_index_unicode(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    write_markdown("./test_data/ru.md", "# Документы\nВ этом документе описаны Ёлки и ответы.\n");
+    write_markdown("./test_data/de.md", "# Köln\nKÖLN am Rhein, ŁÓDŹ «рядом»\n");
+    write_markdown("./test_data/en.md", "# Queries\nIndexing queries quickly\n");
+
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 256U;
+    KolibriKnowledgeIndex *index = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &index);
+    const char *id = NULL;
+    if (!index || (top_score(index, "ДОКУМЕНТЕ", &id), !id || strcmp(id, "ru") != 0) ||
+        (top_score(index, "köln łódź", &id), !id || strcmp(id, "de") != 0) ||
+        (top_score(index, "елки", &id), !id || strcmp(id, "ru") != 0) ||
+        (top_score(index, "рядом", &id), !id || strcmp(id, "de") != 0) ||
+        (top_score(index, "документами", &id), id != NULL)) {
+        fprintf(stderr, "unicode folding failed\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(index);
+
+    options.stemming = 1;
+    options.keep_term_counts = 1;
+    index = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &index);
+    KolibriKnowledgeIndex *loaded = NULL;
+    KolibriKnowledgeIndex *mapped = NULL;
+    if (!index || kolibri_knowledge_index_write_json(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_write_binary(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_load_json("./test_data/cache", &loaded) != 0 ||
+        kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != 0) {
+        fprintf(stderr, "stemmed index build failed\n");
+        cleanup();
+        exit(1);
+    }
+    KolibriKnowledgeIndex *variants[] = {index, loaded, mapped};
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i) {
+        if ((top_score(variants[i], "документами", &id), !id || strcmp(id, "ru") != 0) ||
+            (top_score(variants[i], "query indexed", &id), !id || strcmp(id, "en") != 0)) {
+            fprintf(stderr, "stemmed search failed on variant %zu\n", i);
+            cleanup();
+            exit(1);
+        }
+    }
+    size_t changed = 0U;
+    options.stemming = 0;
+    if (kolibri_knowledge_index_update(loaded, roots, 1U, &options, &changed) != EINVAL) {
+        fprintf(stderr, "update accepted a different stemming setting\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(mapped);
+    kolibri_knowledge_index_destroy(loaded);
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static size_t phrase_hits(const KolibriKnowledgeIndex *index, const char *query, const char **out_first) {
+    size_t indices[4];
+    float scores[4];
+    size_t count = 0U;
+    if (kolibri_knowledge_index_search(index, query, 4U, indices, scores, &count) != 0) {
+        return (size_t)-1;
+    }
+    *out_first = count > 0U ? kolibri_knowledge_index_document(index, indices[0])->id : NULL;
+    return count;
+}
+
+void test_knowledge_index_phrases(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    write_markdown("./test_data/alpha.md", "# Alpha\nthe knowledge server answers questions\n");
+    write_markdown("./test_data/beta.md", "# Beta\nserver knowledge is stored by the server\n");
+
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 256U;
+    KolibriKnowledgeIndex *plain = NULL;
+    const char *first = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &plain);
+    if (!plain || phrase_hits(plain, "\"knowledge server\"", &first) != 2U) {
+        fprintf(stderr, "phrase without positions must match as plain words\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(plain);
+
+    options.keep_positions = 1;
+    KolibriKnowledgeIndex *index = NULL;
+    KolibriKnowledgeIndex *loaded = NULL;
+    KolibriKnowledgeIndex *mapped = NULL;
+    kolibri_knowledge_index_create_ex(roots, 1U, &options, &index);
+    if (!index || kolibri_knowledge_index_write_json(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_write_binary(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_load_json("./test_data/cache", &loaded) != 0 ||
+        kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != 0) {
+        fprintf(stderr, "positional index build failed\n");
+        cleanup();
+        exit(1);
+    }
+    KolibriKnowledgeIndex *variants[] = {index, loaded, mapped};
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); ++i) {
+        const KolibriKnowledgeIndex *v = variants[i];
+        if (phrase_hits(v, "\"knowledge server\"", &first) != 1U || strcmp(first, "alpha") != 0 ||
+            phrase_hits(v, "\"server knowledge\" stored", &first) != 1U || strcmp(first, "beta") != 0 ||
+            phrase_hits(v, "\"server knowledge\" \"answers questions\"", &first) != 0U ||
+            phrase_hits(v, "\"knowledge unknownword\"", &first) != 0U ||
+            phrase_hits(v, "knowledge server", &first) != 2U ||
+            phrase_hits(v, "ques*", &first) != 1U || strcmp(first, "alpha") != 0) {
+            fprintf(stderr, "phrase or prefix query failed on variant %zu\n", i);
+            cleanup();
+            exit(1);
+        }
+        const char *suggestions[3];
+        size_t suggestion_count = 0U;
+        if (kolibri_knowledge_index_suggest(v, "the S", 3U, suggestions, &suggestion_count) != 0 ||
+            suggestion_count != 2U || strcmp(suggestions[0], "server") != 0 || strcmp(suggestions[1], "stored") != 0 ||
+            kolibri_knowledge_index_suggest(v, "server ", 3U, suggestions, &suggestion_count) != 0 ||
+            suggestion_count != 0U) {
+            fprintf(stderr, "suggest failed on variant %zu\n", i);
+            cleanup();
+            exit(1);
+        }
+    }
+
+    const char *queries[] = {"\"knowledge server\"", "stored"};
+    size_t batch_indices[8];
+    float batch_scores[8];
+    size_t batch_counts[2];
+    if (kolibri_knowledge_index_search_batch(index, queries, 2U, 4U, batch_indices, batch_scores, batch_counts) != 0 ||
+        batch_counts[0] != 1U || batch_counts[1] != 1U ||
+        strcmp(kolibri_knowledge_index_document(index, batch_indices[0])->id, "alpha") != 0 ||
+        strcmp(kolibri_knowledge_index_document(index, batch_indices[4])->id, "beta") != 0) {
+        fprintf(stderr, "batch phrase search failed\n");
+        cleanup();
+        exit(1);
+    }
+    kolibri_knowledge_index_destroy(mapped);
+    kolibri_knowledge_index_destroy(loaded);
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+/* Nested roots crawled on several workers, with mapped and read files. */
+void test_knowledge_index_crawl(void) {
+    const char *roots[2] = {"./test_data/b", "./test_data/a"};
+    system("rm -rf ./test_data && mkdir -p ./test_data/a/deep/er ./test_data/b/x ./test_data/b/y");
+    write_markdown("./test_data/a/top.md", "# Top\nalpha root\n");
+    write_markdown("./test_data/a/deep/mid.md", "# Mid\nalpha nested\n");
+    write_markdown("./test_data/a/deep/er/low.md", "# Low\nalpha deepest\n");
+    write_markdown("./test_data/a/deep/skip.txt", "not markdown\n");
+    write_markdown("./test_data/b/y/two.md", "# Two\nbeta\n");
+    write_markdown("./test_data/b/x/one.md", "# One\nbeta\n");
+    /* Above the mapping threshold: one ends inside a page, one on a page boundary. */
+    for (int variant = 0; variant < 2; ++variant) {
+        FILE *f = fopen(variant ? "./test_data/b/x/exact.md" : "./test_data/b/x/large.md", "wb");
+        if (!f) {
+            cleanup();
+            exit(1);
+        }
+        size_t target = variant ? 65536U : 70001U;
+        size_t written = (size_t)fprintf(f, "# Large\n");
+        while (written + 6U <= target - 8U) {
+            written += (size_t)fprintf(f, "bulky ");
+        }
+        while (written < target - 7U) {
+            written += (size_t)fprintf(f, " ");
+        }
+        fputs("closing", f);
+        fclose(f);
+    }
+
+    const char *expected[] = {
+        "./test_data/b/x/exact.md", "./test_data/b/x/large.md", "./test_data/b/x/one.md",
+        "./test_data/b/y/two.md", "./test_data/a/deep/er/low.md", "./test_data/a/deep/mid.md",
+        "./test_data/a/top.md",
+    };
+    size_t expected_count = sizeof(expected) / sizeof(expected[0]);
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 128U;
+    for (size_t threads = 1U; threads <= 4U; threads += 3U) {
+        options.threads = threads;
+        KolibriKnowledgeIndex *index = NULL;
+        if (kolibri_knowledge_index_create_ex(roots, 2U, &options, &index) != 0 || !index ||
+            kolibri_knowledge_index_document_count(index) != expected_count) {
+            fprintf(stderr, "crawl with %zu threads found the wrong files\n", threads);
+            cleanup();
+            exit(1);
+        }
+        for (size_t i = 0; i < expected_count; ++i) {
+            if (strcmp(kolibri_knowledge_index_document(index, i)->source, expected[i]) != 0) {
+                fprintf(stderr, "crawl order differs at %zu: %s\n", i,
+                        kolibri_knowledge_index_document(index, i)->source);
+                cleanup();
+                exit(1);
+            }
+        }
+        const char *id = NULL;
+        if (top_score(index, "closing", &id) <= 0.0f || top_score(index, "bulky", &id) <= 0.0f ||
+            strcmp(kolibri_knowledge_index_document(index, 0)->title, "Large") != 0) {
+            fprintf(stderr, "large documents were not read whole\n");
+            cleanup();
+            exit(1);
+        }
+        kolibri_knowledge_index_destroy(index);
+    }
+    cleanup();
+}
+
+#define DENSE_DOCS 300U
+#define DENSE_DIM 24U
+
+static void dense_fail(const char *message) {
+    fprintf(stderr, "%s\n", message);
+    cleanup();
+    exit(1);
+}
+
+static size_t dense_top(const KolibriKnowledgeIndex *index, const float *query, size_t limit, size_t *indices,
+                        float *scores) {
+    size_t count = 0U;
+    if (kolibri_knowledge_index_search_dense(index, query, DENSE_DIM, limit, 0U, indices, scores, &count) != 0) {
+        return (size_t)-1;
+    }
+    return count;
+}
+
+/* HNSW recall against brute force, sidecar loading, fusion, snapshots and commits. */
+void test_knowledge_index_dense(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    char path[64];
+    char text[96];
+    for (size_t i = 0; i < DENSE_DOCS; ++i) {
+        snprintf(path, sizeof(path), "./test_data/d%03zu.md", i);
+        snprintf(text, sizeof(text), "# Doc %zu\ncluster%zu notes%s\n", i, i % 7U, i == 10U ? " special" : "");
+        write_markdown(path, text);
+    }
+    static float vectors[DENSE_DOCS * DENSE_DIM];
+    unsigned long long state = 12345ULL;
+    for (size_t i = 0; i < DENSE_DOCS * DENSE_DIM; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        vectors[i] = (float)((double)(state >> 40) / 8388608.0 - 1.0);
+    }
+    memset(&vectors[5U * DENSE_DIM], 0, DENSE_DIM * sizeof(float));
+
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 128U;
+    options.keep_term_counts = 1;
+    KolibriKnowledgeIndex *index = NULL;
+    KolibriKnowledgeAnnOptions ann;
+    kolibri_knowledge_index_ann_options_init(&ann);
+    ann.ef_construction = 100U;
+    float probe[DENSE_DIM] = {0};
+    size_t indices[16];
+    float scores[16];
+    if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &index) != 0 ||
+        kolibri_knowledge_index_document_count(index) != DENSE_DOCS ||
+        kolibri_knowledge_index_embedding_dim(index) != 0U || dense_top(index, probe, 4U, indices, scores) != 0U ||
+        kolibri_knowledge_index_set_embeddings(index, vectors, DENSE_DIM, &ann) != 0 ||
+        kolibri_knowledge_index_embedding_dim(index) != DENSE_DIM ||
+        kolibri_knowledge_index_document(index, 5U)->embedding != NULL ||
+        kolibri_knowledge_index_document(index, 6U)->embedding == NULL) {
+        dense_fail("embedding graph build failed");
+    }
+    size_t count = 0U;
+    if (kolibri_knowledge_index_search_dense(index, probe, DENSE_DIM - 1U, 4U, 0U, indices, scores, &count) != EINVAL ||
+        dense_top(index, probe, 4U, indices, scores) != 0U) {
+        dense_fail("dense search accepted a bad query");
+    }
+
+    /* Recall@10 against brute force over the normalized vectors. */
+    size_t hits = 0U;
+    size_t queries = 40U;
+    for (size_t q = 0; q < queries; ++q) {
+        for (size_t d = 0; d < DENSE_DIM; ++d) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            probe[d] = (float)((double)(state >> 40) / 8388608.0 - 1.0);
+        }
+        float best[10];
+        size_t best_docs[10];
+        size_t best_count = 0U;
+        for (size_t i = 0; i < DENSE_DOCS; ++i) {
+            const float *embedding = kolibri_knowledge_index_document(index, i)->embedding;
+            if (!embedding) {
+                continue;
+            }
+            float dot = 0.0f;
+            for (size_t d = 0; d < DENSE_DIM; ++d) {
+                dot += embedding[d] * probe[d];
+            }
+            size_t pos = best_count < 10U ? best_count++ : 10U;
+            while (pos > 0U && best[pos - 1U] < dot) {
+                if (pos < 10U) {
+                    best[pos] = best[pos - 1U];
+                    best_docs[pos] = best_docs[pos - 1U];
+                }
+                --pos;
+            }
+            if (pos < 10U) {
+                best[pos] = dot;
+                best_docs[pos] = i;
+            }
+        }
+        if (dense_top(index, probe, 10U, indices, scores) != 10U || scores[0] < scores[9]) {
+            dense_fail("dense search returned too few results");
+        }
+        for (size_t i = 0; i < 10U; ++i) {
+            for (size_t j = 0; j < 10U; ++j) {
+                hits += indices[i] == best_docs[j] ? 1U : 0U;
+            }
+        }
+    }
+    if (hits * 10U < queries * 10U * 9U) {
+        fprintf(stderr, "dense recall@10 too low: %zu of %zu\n", hits, queries * 10U);
+        cleanup();
+        exit(1);
+    }
+    if (dense_top(index, &vectors[17U * DENSE_DIM], 1U, indices, scores) != 1U || indices[0] != 17U ||
+        fabsf(scores[0] - 1.0f) > 1e-4f) {
+        dense_fail("a document's own embedding is not its nearest neighbour");
+    }
+
+    /* Fusion: "special" only matches d010 lexically. */
+    size_t fused[4];
+    float fused_scores[4];
+    KolibriKnowledgeHybridOptions hybrid;
+    kolibri_knowledge_index_hybrid_options_init(&hybrid);
+    if (kolibri_knowledge_index_search_hybrid(index, "special", &vectors[10U * DENSE_DIM], DENSE_DIM, &hybrid, 4U,
+                                              fused, fused_scores, &count) != 0 ||
+        count != 4U || fused[0] != 10U || fabsf(fused_scores[0] - 2.0f / 61.0f) > 1e-6f ||
+        kolibri_knowledge_index_search_hybrid(index, "special", &vectors[20U * DENSE_DIM], DENSE_DIM, &hybrid, 2U,
+                                              fused, fused_scores, &count) != 0 ||
+        count != 2U || fused[0] != 10U || fused[1] != 20U || fused_scores[0] != fused_scores[1] ||
+        kolibri_knowledge_index_search_hybrid(index, "special", NULL, 0U, NULL, 4U, fused, fused_scores, &count) != 0 ||
+        count != 1U || fused[0] != 10U ||
+        kolibri_knowledge_index_search_hybrid(index, NULL, NULL, 0U, NULL, 4U, fused, fused_scores, &count) != EINVAL) {
+        dense_fail("hybrid fusion ranked wrongly");
+    }
+
+    KolibriKnowledgeIndex *mapped = NULL;
+    size_t mapped_indices[16];
+    float mapped_scores[16];
+    if (kolibri_knowledge_index_write_binary(index, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != 0 ||
+        kolibri_knowledge_index_embedding_dim(mapped) != DENSE_DIM ||
+        kolibri_knowledge_index_document(mapped, 5U)->embedding != NULL ||
+        memcmp(kolibri_knowledge_index_document(mapped, 6U)->embedding,
+               kolibri_knowledge_index_document(index, 6U)->embedding, DENSE_DIM * sizeof(float)) != 0 ||
+        kolibri_knowledge_index_set_embeddings(mapped, vectors, DENSE_DIM, NULL) != EROFS) {
+        dense_fail("embedding graph did not survive the snapshot");
+    }
+    if (dense_top(index, probe, 16U, indices, scores) != 16U ||
+        dense_top(mapped, probe, 16U, mapped_indices, mapped_scores) != 16U ||
+        memcmp(indices, mapped_indices, sizeof(indices)) != 0) {
+        dense_fail("mapped graph answers differently");
+    }
+    kolibri_knowledge_index_destroy(mapped);
+
+    /* A tombstone is skipped at once; the commit renumbers and rebuilds the graph. */
+    float kept[DENSE_DIM];
+    memcpy(kept, kolibri_knowledge_index_document(index, 50U)->embedding, sizeof(kept));
+    if (kolibri_knowledge_index_remove_document(index, "./test_data/d017.md") != 0 ||
+        dense_top(index, &vectors[17U * DENSE_DIM], 1U, indices, scores) != 1U || indices[0] == 17U ||
+        kolibri_knowledge_index_commit(index, &options) != 0 ||
+        kolibri_knowledge_index_embedding_dim(index) != DENSE_DIM ||
+        dense_top(index, kept, 1U, indices, scores) != 1U ||
+        strcmp(kolibri_knowledge_index_document(index, indices[0])->id, "d050") != 0) {
+        dense_fail("embeddings did not follow the commit");
+    }
+
+    /* Sidecar: keyed by source or id, unknown keys and comments skipped. */
+    FILE *sidecar = fopen("./test_data/embeddings.tsv", "wb");
+    if (!sidecar) {
+        dense_fail("cannot write the sidecar");
+    }
+    fputs("# dense vectors\n./test_data/d001.md\t1 0 0\nd002\t0 2 0\r\n\nmissing\t0 0 1\nd003\t1 1 0\n", sidecar);
+    fclose(sidecar);
+    float axis[3] = {0.0f, 1.0f, 0.0f};
+    if (kolibri_knowledge_index_load_embeddings(index, "./test_data/embeddings.tsv", NULL) != 0 ||
+        kolibri_knowledge_index_embedding_dim(index) != 3U ||
+        kolibri_knowledge_index_document(index, 0U)->embedding != NULL ||
+        kolibri_knowledge_index_document(index, 2U)->embedding[1] != 1.0f ||
+        kolibri_knowledge_index_search_dense(index, axis, 3U, 4U, 0U, indices, scores, &count) != 0 || count != 3U ||
+        indices[0] != 2U || indices[1] != 3U || indices[2] != 1U) {
+        dense_fail("sidecar embeddings were not loaded");
+    }
+    sidecar = fopen("./test_data/embeddings.tsv", "wb");
+    fputs("d001\t1 0\nd002\t1 0 0\n", sidecar);
+    fclose(sidecar);
+    if (kolibri_knowledge_index_load_embeddings(index, "./test_data/embeddings.tsv", NULL) != EINVAL ||
+        kolibri_knowledge_index_embedding_dim(index) != 3U ||
+        kolibri_knowledge_index_load_embeddings(index, "./test_data/absent.tsv", NULL) != ENOENT) {
+        dense_fail("a bad sidecar replaced the embeddings");
+    }
     kolibri_knowledge_index_destroy(index);
     cleanup();
 }
+
+#define QUANT_DOCS 240U
+#define QUANT_WORDS 48U
+#define QUANT_LIMIT 10U
+
+static const char *quant_word(size_t w) {
+    static char words[QUANT_WORDS][16];
+    snprintf(words[w], sizeof(words[w]), "w%02zu", w);
+    return words[w];
+}
+
+/* Same ids and (within float noise) the same scores as the float index. */
+static void quant_compare(const KolibriKnowledgeIndex *exact, const KolibriKnowledgeIndex *quantized,
+                          const char *query, const char *what) {
+    size_t expected[QUANT_LIMIT];
+    float expected_scores[QUANT_LIMIT];
+    size_t got[QUANT_LIMIT];
+    float got_scores[QUANT_LIMIT];
+    size_t expected_count = 0U;
+    size_t got_count = 0U;
+    if (kolibri_knowledge_index_search(exact, query, QUANT_LIMIT, expected, expected_scores, &expected_count) != 0 ||
+        kolibri_knowledge_index_search(quantized, query, QUANT_LIMIT, got, got_scores, &got_count) != 0 ||
+        expected_count != got_count) {
+        fprintf(stderr, "%s: \"%s\" returned %zu results, expected %zu\n", what, query, got_count, expected_count);
+        cleanup();
+        exit(1);
+    }
+    for (size_t i = 0; i < got_count; ++i) {
+        if (got[i] != expected[i] || fabsf(got_scores[i] - expected_scores[i]) > 1e-5f) {
+            fprintf(stderr, "%s: \"%s\" rank %zu is %zu (%f), expected %zu (%f)\n", what, query, i, got[i],
+                    (double)got_scores[i], expected[i], (double)expected_scores[i]);
+            cleanup();
+            exit(1);
+        }
+    }
+}
+
+/* 8-bit postings rank like the float ones after rescoring, through phrases,
+ * batches, both persisted formats and commits. */
+void test_knowledge_index_quantized(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    unsigned long long state = 987654321ULL;
+    char path[64];
+    char text[1024];
+    for (size_t i = 0; i < QUANT_DOCS; ++i) {
+        size_t len = (size_t)snprintf(text, sizeof(text), "# Q %zu\n", i);
+        size_t words = 6U + i % 11U;
+        for (size_t w = 0; w < words; ++w) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            /* Skewed draws give low words high DF and a spread of weights. */
+            size_t word = (size_t)((state >> 33) % QUANT_WORDS);
+            word = word * word / QUANT_WORDS;
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "%s ", quant_word(word));
+        }
+        snprintf(text + len, sizeof(text) - len, "\n");
+        snprintf(path, sizeof(path), "./test_data/q%03zu.md", i);
+        write_markdown(path, text);
+    }
+
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.max_length = 64U;
+    options.keep_term_counts = 1;
+    options.keep_positions = 1;
+    KolibriKnowledgeIndex *exact = NULL;
+    KolibriKnowledgeIndex *quantized = NULL;
+    if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &exact) != 0) {
+        fprintf(stderr, "float index build failed\n");
+        cleanup();
+        exit(1);
+    }
+    options.quantize = 1;
+    if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &quantized) != 0) {
+        fprintf(stderr, "quantized index build failed\n");
+        cleanup();
+        exit(1);
+    }
+
+    char queries[64][64];
+    const char *query_list[64];
+    for (size_t q = 0; q < 64U; ++q) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t a = (size_t)((state >> 20) % QUANT_WORDS);
+        size_t b = (size_t)((state >> 40) % QUANT_WORDS);
+        if (q % 3U == 0U) {
+            snprintf(queries[q], sizeof(queries[q]), "%s", quant_word(a));
+        } else if (q % 3U == 1U) {
+            snprintf(queries[q], sizeof(queries[q]), "%s %s w0*", quant_word(a), quant_word(b));
+        } else {
+            snprintf(queries[q], sizeof(queries[q]), "\"%s %s\" %s", quant_word(a), quant_word(b), quant_word(b));
+        }
+        query_list[q] = queries[q];
+        quant_compare(exact, quantized, queries[q], "quantized");
+    }
+
+    size_t batch_indices[64U * QUANT_LIMIT];
+    float batch_scores[64U * QUANT_LIMIT];
+    size_t batch_counts[64];
+    if (kolibri_knowledge_index_search_batch(quantized, query_list, 64U, QUANT_LIMIT, batch_indices, batch_scores,
+                                             batch_counts) != 0) {
+        fprintf(stderr, "quantized batch search failed\n");
+        cleanup();
+        exit(1);
+    }
+    for (size_t q = 0; q < 64U; ++q) {
+        size_t single[QUANT_LIMIT];
+        float single_scores[QUANT_LIMIT];
+        size_t count = 0U;
+        kolibri_knowledge_index_search(quantized, query_list[q], QUANT_LIMIT, single, single_scores, &count);
+        if (batch_counts[q] != count ||
+            memcmp(&batch_indices[q * QUANT_LIMIT], single, count * sizeof(size_t)) != 0) {
+            fprintf(stderr, "quantized batch differs from single search for \"%s\"\n", query_list[q]);
+            cleanup();
+            exit(1);
+        }
+    }
+
+    KolibriKnowledgeIndex *loaded = NULL;
+    KolibriKnowledgeIndex *mapped = NULL;
+    if (kolibri_knowledge_index_write_json(quantized, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_write_binary(quantized, "./test_data/cache") != 0 ||
+        kolibri_knowledge_index_load_json("./test_data/cache", &loaded) != 0 ||
+        kolibri_knowledge_index_load_binary("./test_data/cache", &mapped) != 0) {
+        fprintf(stderr, "quantized index did not round-trip\n");
+        cleanup();
+        exit(1);
+    }
+    for (size_t q = 0; q < 64U; q += 5U) {
+        quant_compare(exact, loaded, query_list[q], "quantized json");
+        quant_compare(exact, mapped, query_list[q], "quantized snapshot");
+    }
+    kolibri_knowledge_index_destroy(loaded);
+    kolibri_knowledge_index_destroy(mapped);
+
+    write_markdown("./test_data/q999.md", "# Extra\nw47 w47 w47 w46\n");
+    if (kolibri_knowledge_index_add_document(exact, "./test_data/q999.md", &options) != 0 ||
+        kolibri_knowledge_index_add_document(quantized, "./test_data/q999.md", &options) != 0 ||
+        kolibri_knowledge_index_remove_document(exact, "./test_data/q003.md") != 0 ||
+        kolibri_knowledge_index_remove_document(quantized, "./test_data/q003.md") != 0 ||
+        kolibri_knowledge_index_commit(exact, &options) != 0 ||
+        kolibri_knowledge_index_commit(quantized, &options) != 0) {
+        fprintf(stderr, "quantized index did not commit\n");
+        cleanup();
+        exit(1);
+    }
+    quant_compare(exact, quantized, "w47 w46", "quantized after commit");
+    for (size_t q = 0; q < 64U; q += 7U) {
+        quant_compare(exact, quantized, query_list[q], "quantized after commit");
+    }
+    kolibri_knowledge_index_destroy(exact);
+    kolibri_knowledge_index_destroy(quantized);
+    cleanup();
+}
+
+/* Shards partition the crawl by id, and update keeps each to its partition. */
+void test_knowledge_index_shards(void) {
+    const char *roots[1] = {"./test_data"};
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    char path[64];
+    for (size_t i = 0; i < 30U; ++i) {
+        snprintf(path, sizeof(path), "./test_data/s%02zu.md", i);
+        write_markdown(path, "# Shard\nkolibri shard text\n");
+    }
+    KolibriKnowledgeIndexOptions options;
+    kolibri_knowledge_index_options_init(&options);
+    options.keep_term_counts = 1;
+    options.shard_count = 3U;
+    KolibriKnowledgeIndex *shards[3] = {NULL, NULL, NULL};
+    size_t total = 0U;
+    for (size_t s = 0; s < 3U; ++s) {
+        options.shard_index = s;
+        if (kolibri_knowledge_index_create_ex(roots, 1U, &options, &shards[s]) != 0) {
+            fprintf(stderr, "shard %zu build failed\n", s);
+            cleanup();
+            exit(1);
+        }
+        size_t count = kolibri_knowledge_index_document_count(shards[s]);
+        for (size_t i = 0; i < count; ++i) {
+            if (kolibri_knowledge_index_shard_of(kolibri_knowledge_index_document(shards[s], i)->id, 3U) != s) {
+                fprintf(stderr, "shard %zu holds a foreign document\n", s);
+                cleanup();
+                exit(1);
+            }
+        }
+        total += count;
+    }
+    KolibriKnowledgeIndex *invalid = NULL;
+    options.shard_index = 3U;
+    if (total != 30U || kolibri_knowledge_index_shard_of("s01", 1U) != 0U ||
+        kolibri_knowledge_index_create_ex(roots, 1U, &options, &invalid) != EINVAL) {
+        fprintf(stderr, "shards do not partition the corpus\n");
+        cleanup();
+        exit(1);
+    }
+
+    const char *extra_id = NULL;
+    char extra_name[16];
+    for (size_t i = 30U; !extra_id; ++i) {
+        snprintf(extra_name, sizeof(extra_name), "s%02zu", i);
+        extra_id = kolibri_knowledge_index_shard_of(extra_name, 3U) == 1U ? extra_name : NULL;
+    }
+    snprintf(path, sizeof(path), "./test_data/%s.md", extra_id);
+    write_markdown(path, "# Extra\nkolibri shard addition\n");
+    size_t before = kolibri_knowledge_index_document_count(shards[1]);
+    size_t changed = 0U;
+    options.shard_index = 1U;
+    if (kolibri_knowledge_index_update(shards[1], roots, 1U, &options, &changed) != 0 || changed != 1U ||
+        kolibri_knowledge_index_document_count(shards[1]) != before + 1U) {
+        fprintf(stderr, "shard update picked up the wrong files\n");
+        cleanup();
+        exit(1);
+    }
+    for (size_t s = 0; s < 3U; ++s) {
+        kolibri_knowledge_index_destroy(shards[s]);
+    }
+    cleanup();
+}
+
+#define SIMD_DOCS 160U
+#define SIMD_LIMIT 10U
+
+typedef struct {
+    char id[64];
+    float score;
+} SimdHit;
+
+/*
+ * Kernels are chosen once per process, so each ISA gets its own
+ * `kolibri_indexer search` run; an unset `simd` keeps the detected one.
+ */
+static size_t simd_search(const char *simd, const char *query, SimdHit *hits) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "simd: pipe failed\n");
+        cleanup();
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (simd) {
+            setenv("KOLIBRI_KNOWLEDGE_SIMD", simd, 1);
+        } else {
+            unsetenv("KOLIBRI_KNOWLEDGE_SIMD");
+        }
+        execl("./kolibri_indexer", "kolibri_indexer", "search", "--query", query, "--limit", "10", "./test_data",
+              (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    FILE *out = pid > 0 ? fdopen(fds[0], "r") : NULL;
+    size_t count = 0U;
+    char line[512];
+    while (out && count < SIMD_LIMIT && fgets(line, sizeof(line), out)) {
+        if (sscanf(line, "%f\t%63[^\t\n]", &hits[count].score, hits[count].id) == 2) {
+            count += 1U;
+        }
+    }
+    if (out) {
+        fclose(out);
+    } else {
+        close(fds[0]);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "simd: kolibri_indexer search (%s) failed\n", simd ? simd : "detected");
+        cleanup();
+        exit(1);
+    }
+    return count;
+}
+
+/* The AVX2/NEON kernels rank exactly like the scalar ones. */
+void test_knowledge_index_simd(void) {
+    system("rm -rf ./test_data && mkdir -p ./test_data");
+    unsigned long long state = 192837465ULL;
+    char path[64];
+    char text[1024];
+    for (size_t i = 0; i < SIMD_DOCS; ++i) {
+        size_t len = (size_t)snprintf(text, sizeof(text), "# S %zu\n", i);
+        size_t words = 5U + i % 13U;
+        for (size_t w = 0; w < words; ++w) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t word = (size_t)((state >> 33) % QUANT_WORDS);
+            word = word * word / QUANT_WORDS;
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "%s ", quant_word(word));
+        }
+        snprintf(text + len, sizeof(text) - len, "\n");
+        snprintf(path, sizeof(path), "./test_data/v%03zu.md", i);
+        write_markdown(path, text);
+    }
+
+    const char *queries[] = {"w00 w03", "w01 w05 w09", "w02 w07 w15 w22", "w04 w11 w18 w26 w33", "w12"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        SimdHit scalar[SIMD_LIMIT];
+        SimdHit detected[SIMD_LIMIT];
+        size_t scalar_count = simd_search("scalar", queries[q], scalar);
+        size_t detected_count = simd_search(NULL, queries[q], detected);
+        if (scalar_count == 0U || scalar_count != detected_count) {
+            fprintf(stderr, "simd: \"%s\" returned %zu results, scalar %zu\n", queries[q], detected_count,
+                    scalar_count);
+            cleanup();
+            exit(1);
+        }
+        for (size_t i = 0; i < scalar_count; ++i) {
+            /* The indexer prints four decimals. */
+            if (strcmp(detected[i].id, scalar[i].id) != 0 || fabsf(detected[i].score - scalar[i].score) > 2e-4f) {
+                fprintf(stderr, "simd: \"%s\" rank %zu is %s (%f), scalar %s (%f)\n", queries[q], i, detected[i].id,
+                        (double)detected[i].score, scalar[i].id, (double)scalar[i].score);
+                cleanup();
+                exit(1);
+            }
+        }
+    }
+    cleanup();
+}
@@ -3,6 +3,8 @@
 #include <sqlite3.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 static const char *DB_PATH = "./queue_test.db";
 
@@ -40,12 +42,100 @@ void test_knowledge_queue(void) {
         exit(1);
     }
 
+    KolibriQueueSubmission batch[3] = {
+        {"Пакет 1", "Первый", NULL, NULL},
+        {"Пакет 2", "Второй", "import", "{\"line\":2}"},
+        {"Пакет 3", "Третий", NULL, NULL},
+    };
+    long long batch_ids[3] = {0, 0, 0};
+    if (kolibri_queue_enqueue_batch(queue, batch, 3U, batch_ids) != SQLITE_OK ||
+        batch_ids[0] <= id || batch_ids[1] != batch_ids[0] + 1 || batch_ids[2] != batch_ids[1] + 1) {
+        fprintf(stderr, "batch enqueue failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    batch[1].content = NULL;
+    if (kolibri_queue_enqueue_batch(queue, batch, 3U, NULL) != SQLITE_MISUSE) {
+        fprintf(stderr, "invalid batch accepted\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    if (kolibri_queue_fetch(queue, KOLIBRI_QUEUE_STATUS_PENDING, 10U, &records, &count) != SQLITE_OK || count != 3U) {
+        fprintf(stderr, "fetch batch failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    kolibri_queue_free_records(records, count);
+
+    KolibriQueueOptions options;
+    kolibri_queue_options_init(&options);
+    options.busy_timeout_ms = 100;
+    KolibriQueue *reader = NULL;
+    if (kolibri_queue_open_ex(DB_PATH, &options, &reader) != SQLITE_OK ||
+        kolibri_queue_fetch(reader, KOLIBRI_QUEUE_STATUS_PENDING, 2U, &records, &count) != SQLITE_OK || count != 2U ||
+        records[0].submission_id != batch_ids[0] || records[1].submission_id != batch_ids[1]) {
+        fprintf(stderr, "second handle fetch failed\n");
+        kolibri_queue_close(reader);
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    kolibri_queue_free_records(records, count);
+    kolibri_queue_close(reader);
+
+    KolibriQueueIter *iter = NULL;
+    KolibriQueueRow row;
+    size_t seen = 0U;
+    int rc = kolibri_queue_iter_open(queue, KOLIBRI_QUEUE_STATUS_PENDING, 0, 2U, &iter);
+    while (rc == SQLITE_OK && (rc = kolibri_queue_iter_next(iter, &row)) == SQLITE_ROW) {
+        if (seen >= 3U || row.submission_id != batch_ids[seen] || strcmp(row.title, batch[seen].title) != 0) {
+            break;
+        }
+        seen++;
+        rc = SQLITE_OK;
+    }
+    kolibri_queue_iter_close(iter);
+    if (rc != SQLITE_DONE || seen != 3U) {
+        fprintf(stderr, "iterator walk failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    iter = NULL;
+    if (kolibri_queue_iter_open(queue, KOLIBRI_QUEUE_STATUS_PENDING, batch_ids[1], 0U, &iter) != SQLITE_OK ||
+        kolibri_queue_iter_next(iter, &row) != SQLITE_ROW || row.submission_id != batch_ids[2] ||
+        kolibri_queue_iter_next(iter, &row) != SQLITE_DONE) {
+        fprintf(stderr, "iterator resume failed\n");
+        kolibri_queue_iter_close(iter);
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    kolibri_queue_iter_close(iter);
+
     if (kolibri_queue_export_markdown(queue, KOLIBRI_QUEUE_STATUS_APPROVED, "./queue_export", &count) != SQLITE_OK || count != 1U) {
         fprintf(stderr, "export failed\n");
         kolibri_queue_close(queue);
         exit(1);
     }
 
+    char first_path[256];
+    snprintf(first_path, sizeof(first_path), "./queue_export/%06lld_submission.md", id);
+    struct stat before;
+    struct stat after;
+    if (stat(first_path, &before) != 0 ||
+        kolibri_queue_moderate(queue, batch_ids[0], KOLIBRI_QUEUE_STATUS_APPROVED, "tester", NULL) != SQLITE_OK ||
+        kolibri_queue_export_markdown(queue, KOLIBRI_QUEUE_STATUS_APPROVED, "./queue_export", &count) != SQLITE_OK ||
+        count != 2U || stat(first_path, &after) != 0 || after.st_ino != before.st_ino) {
+        fprintf(stderr, "incremental export rewrote an unchanged file\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    if (kolibri_queue_moderate(queue, id, KOLIBRI_QUEUE_STATUS_REJECTED, "tester", NULL) != SQLITE_OK ||
+        kolibri_queue_export_markdown(queue, KOLIBRI_QUEUE_STATUS_APPROVED, "./queue_export", &count) != SQLITE_OK ||
+        count != 1U || stat(first_path, &after) == 0) {
+        fprintf(stderr, "incremental export kept a stale file\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+
     kolibri_queue_close(queue);
     cleanup();
 }
@@ -21,6 +21,9 @@ static void write_file(const char *path, const char *content) {
     fclose(f);
 }
 
+/* Loopback source address for http_request(); every 127/8 address reaches the server. */
+static const char *http_source_address = NULL;
+
 static int http_request(const char *method,
                         const char *path,
                         const char *body,
@@ -40,6 +43,10 @@ static int http_request(const char *method,
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
+    if (http_source_address) {
+        assert(inet_pton(AF_INET, http_source_address, &addr.sin_addr) == 1);
+        assert(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    }
     addr.sin_port = htons((uint16_t)port);
     addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
     int rc = connect(sock, (struct sockaddr *)&addr, sizeof(addr));
@@ -111,6 +118,61 @@ static void wait_for_server(int port) {
     assert(!"knowledge server did not become ready");
 }
 
+static int open_idle_connection(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return sock;
+}
+
+/* Serves one keep-alive request and leaves the connection open and idle. */
+static int open_keepalive_connection(int port) {
+    int sock = open_idle_connection(port);
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    const char *request = "GET /healthz HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    assert(send(sock, request, strlen(request), 0) == (ssize_t)strlen(request));
+    char response[4096];
+    ssize_t received = recv(sock, response, sizeof(response) - 1U, 0);
+    assert(received > 0);
+    response[received] = '\0';
+    assert(strstr(response, "Connection: keep-alive"));
+    return sock;
+}
+
+/* Sends two pipelined requests on one connection and counts the responses. */
+static int pipelined_response_count(int port) {
+    int sock = open_idle_connection(port);
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    const char *requests = "GET /healthz HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                           "GET /api/knowledge/search?q=Kolibri HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                           "Connection: close\r\n\r\n";
+    assert(send(sock, requests, strlen(requests), 0) == (ssize_t)strlen(requests));
+    char response[8192];
+    size_t total = 0U;
+    while (total + 1U < sizeof(response)) {
+        ssize_t chunk = recv(sock, response + total, sizeof(response) - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+    }
+    response[total] = '\0';
+    close(sock);
+    assert(strstr(response, "Connection: keep-alive"));
+    int count = 0;
+    for (const char *cursor = strstr(response, "HTTP/1.1 200"); cursor; cursor = strstr(cursor + 1, "HTTP/1.1 200")) {
+        count += 1;
+    }
+    return count;
+}
+
 static void spawn_env_set(const char *key, const char *value) {
     if (value) {
         assert(setenv(key, value, 1) == 0);
@@ -123,6 +185,369 @@ static void remove_path(const char *path) {
     (void)remove(path);
 }
 
+static void remove_index_cache(const char *cache_dir) {
+    const char *names[] = { "index.json", "index.kbin", "manifest.json", "sources.fingerprint" };
+    char path[512];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, names[i]);
+        remove_path(path);
+    }
+    rmdir(cache_dir);
+}
+
+/* Reloads run in the background: poll /healthz until the new snapshot serves. */
+static void reload_and_wait(int port, const char *expected) {
+    char response[4096];
+    int status = http_request("POST",
+                              "/api/knowledge/reload",
+                              NULL,
+                              "Authorization: Bearer secret-token\r\n",
+                              response,
+                              sizeof(response),
+                              port);
+    assert(status == 202);
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
+        if (status == 200 && strstr(response, expected) && strstr(response, "\"reloading\":false")) {
+            return;
+        }
+        usleep(50000);
+    }
+    assert(!"index reload did not finish");
+}
+
+/* Warm training runs behind the listener: poll /healthz until it reports done. */
+static void wait_for_warm_training(int port, const char *expected) {
+    char response[4096];
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        int status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
+        if (status == 200 && strstr(response, expected)) {
+            return;
+        }
+        usleep(50000);
+    }
+    assert(!"warm training did not finish");
+}
+
+/* Reassembles a chunked body in place; returns its length or -1 when malformed. */
+static long decode_chunked(char *body) {
+    char *write = body;
+    const char *cursor = body;
+    for (;;) {
+        char *end = NULL;
+        unsigned long size = strtoul(cursor, &end, 16);
+        if (end == cursor || strncmp(end, "\r\n", 2) != 0) {
+            return -1;
+        }
+        cursor = end + 2;
+        if (size == 0UL) {
+            *write = '\0';
+            return strcmp(cursor, "\r\n") == 0 ? (long)(write - body) : -1;
+        }
+        if (strlen(cursor) < size + 2UL || strncmp(cursor + size, "\r\n", 2) != 0) {
+            return -1;
+        }
+        memmove(write, cursor, size);
+        write += size;
+        cursor += size + 2UL;
+    }
+}
+
+/*
+ * Клиент молчит дольше таймаутов отправки, пока сервер пишет большой
+ * keep-alive ответ (HTTP/1.0, чтобы тело ушло целиком с Content-Length).
+ * Недописанный ответ закрывает соединение: следующий ответ может идти
+ * только после всего тела первого, а не посреди него.
+ */
+static void slow_reader_keepalive(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    int small = 2048;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    const char *request = "GET /api/knowledge/search?q=Kolibri&limit=40 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n";
+    assert(send(sock, request, strlen(request), 0) == (ssize_t)strlen(request));
+    /* Сервер с буфером 4 КБ сдаётся примерно через три таймаута по 5 с. */
+    sleep(17);
+    const char *next = "GET /healthz HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+    (void)send(sock, next, strlen(next), MSG_NOSIGNAL);
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    size_t response_size = 256U * 1024U;
+    char *response = malloc(response_size);
+    assert(response);
+    size_t total = 0U;
+    while (total + 1U < response_size) {
+        ssize_t chunk = recv(sock, response + total, response_size - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+    }
+    response[total] = '\0';
+    close(sock);
+    assert(strncmp(response, "HTTP/1.1 200", 12) == 0);
+    const char *length_field = strstr(response, "Content-Length: ");
+    const char *body = strstr(response, "\r\n\r\n");
+    assert(length_field && body);
+    size_t body_end = (size_t)(body + 4 - response) + (size_t)strtoul(length_field + 16, NULL, 10);
+    const char *next_status = strstr(response + 1, "HTTP/1.");
+    assert(!next_status || (size_t)(next_status - response) == body_end);
+    free(response);
+}
+
+/* Forty ~900-byte snippets: the search body must exceed the old 32 KB cap intact. */
+static void test_knowledge_server_large_results(int port) {
+    char docs_template[] = "/tmp/kolibri_largeXXXXXX";
+    char cache_template[] = "/tmp/kolibri_large_cacheXXXXXX";
+    char *docs_dir = mkdtemp(docs_template);
+    char *cache_dir = mkdtemp(cache_template);
+    assert(docs_dir && cache_dir);
+    char filler[901];
+    for (size_t i = 0; i < sizeof(filler) - 1U; ++i) {
+        filler[i] = (char)('a' + (char)(i % 26U));
+    }
+    filler[sizeof(filler) - 1U] = '\0';
+    char doc_path[512];
+    for (int i = 0; i < 40; ++i) {
+        char content[1024];
+        snprintf(content, sizeof(content), "# Kolibri %d\n\nKolibri %s", i, filler);
+        snprintf(doc_path, sizeof(doc_path), "%s/doc%02d.md", docs_dir, i);
+        write_file(doc_path, content);
+    }
+
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        spawn_env_set("KOLIBRI_KNOWLEDGE_PORT", "19081");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_BIND", "127.0.0.1");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_DIRS", docs_dir);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_CACHE", cache_dir);
+        spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SNDBUF", "4096");
+        execl("./kolibri_knowledge_server", "kolibri_knowledge_server", NULL);
+        perror("execl");
+        _exit(1);
+    }
+    wait_for_server(port);
+
+    size_t response_size = 128U * 1024U;
+    char *response = malloc(response_size);
+    assert(response);
+    int status = http_request("GET", "/api/knowledge/search?q=Kolibri&limit=40", NULL, NULL, response, response_size, port);
+    assert(status == 200);
+    assert(strstr(response, "Transfer-Encoding: chunked\r\n"));
+    char *body = strstr(response, "\r\n\r\n");
+    assert(body);
+    body += 4;
+    long body_len = decode_chunked(body);
+    assert(body_len > 32768L);
+    int ids = 0;
+    for (const char *cursor = strstr(body, "\"id\":"); cursor; cursor = strstr(cursor + 1, "\"id\":")) {
+        ids += 1;
+    }
+    assert(ids == 40);
+    assert(strncmp(body, "{\"snippets\":[", 13) == 0);
+    assert(strcmp(body + body_len - 2, "]}") == 0);
+
+    /* Тот же поиск с ETag: совпавший If-None-Match получает 304 без тела. */
+    const char *search = "/api/knowledge/search?q=Kolibri&limit=40";
+    status = http_request("GET", search, NULL, "Accept-Encoding: gzip;q=1, deflate;q=0.5\r\n", response,
+                          response_size, port);
+    assert(status == 200);
+    assert(!strstr(response, "Transfer-Encoding: chunked\r\n"));
+    const char *etag = strstr(response, "ETag: ");
+    assert(etag);
+    char if_none_match[96];
+    const char *etag_end = strstr(etag, "\r\n");
+    snprintf(if_none_match, sizeof(if_none_match), "If-None-Match: %.*s\r\n", (int)(etag_end - etag - 6), etag + 6);
+#if defined(KOLIBRI_HAVE_ZLIB)
+    /* Сжатое тело целиком и меньше исходного; вариант gzip остаётся в кэше поиска. */
+    assert(strstr(response, "Content-Encoding: gzip\r\n"));
+    assert(strstr(if_none_match, "-gzip\""));
+    const char *length_field = strstr(response, "Content-Length: ");
+    assert(length_field);
+    long packed_len = strtol(length_field + 16, NULL, 10);
+    assert(packed_len > 0L && packed_len < body_len);
+    body = strstr(response, "\r\n\r\n") + 4;
+    assert((unsigned char)body[0] == 0x1fU && (unsigned char)body[1] == 0x8bU);
+    status = http_request("GET", search, NULL, "Accept-Encoding: gzip\r\n", response, response_size, port);
+    assert(status == 200);
+    assert(strstr(response, "Content-Encoding: gzip\r\n"));
+    char *cached_length = strstr(response, "Content-Length: ");
+    assert(cached_length && strtol(cached_length + 16, NULL, 10) == packed_len);
+#endif
+    char conditional[160];
+    snprintf(conditional, sizeof(conditional), "Accept-Encoding: gzip\r\n%s", if_none_match);
+    status = http_request("GET", search, NULL, conditional, response, response_size, port);
+    assert(status == 304);
+    body = strstr(response, "\r\n\r\n");
+    assert(body && body[4] == '\0');
+    status = http_request("GET", "/metrics", NULL, NULL, response, response_size, port);
+    assert(status == 200);
+    assert(strstr(response, "kolibri_http_not_modified_total 1\n"));
+#if defined(KOLIBRI_HAVE_ZLIB)
+    assert(strstr(response, "kolibri_http_compressed_responses_total 2\n"));
+    assert(strstr(response, "kolibri_http_compressions_total 1\n"));
+#endif
+    free(response);
+    slow_reader_keepalive(port);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    for (int i = 0; i < 40; ++i) {
+        snprintf(doc_path, sizeof(doc_path), "%s/doc%02d.md", docs_dir, i);
+        remove_path(doc_path);
+    }
+    rmdir(docs_dir);
+    remove_index_cache(cache_dir);
+}
+
+static long json_count_field(const char *text, const char *field) {
+    const char *cursor = strstr(text, field);
+    return cursor ? atol(cursor + strlen(field)) : -1L;
+}
+
+/* Runs the server from its own working directory, so each instance keeps a separate genome. */
+static pid_t spawn_shard_server(const char *server,
+                                const char *workdir,
+                                const char *port,
+                                const char *docs_dir,
+                                const char *shard,
+                                const char *peers) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        if (chdir(workdir) != 0) {
+            _exit(1);
+        }
+        spawn_env_set("KOLIBRI_KNOWLEDGE_PORT", port);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_BIND", "127.0.0.1");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_DIRS", docs_dir);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_CACHE", "cache");
+        spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SHARD", shard);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SHARDS", peers);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS", "300");
+        execl(server, "kolibri_knowledge_server", NULL);
+        perror("execl");
+        _exit(1);
+    }
+    return pid;
+}
+
+/* Two shards split the corpus by id; the coordinator merges them and leaves out a silent peer. */
+static void test_knowledge_server_sharded(void) {
+    char server[1024];
+    assert(realpath("./kolibri_knowledge_server", server));
+    char base_template[] = "/tmp/kolibri_shardsXXXXXX";
+    char *base = mkdtemp(base_template);
+    assert(base);
+    char docs_dir[256];
+    char empty_dir[256];
+    char workdirs[3][256];
+    snprintf(docs_dir, sizeof(docs_dir), "%s/docs", base);
+    snprintf(empty_dir, sizeof(empty_dir), "%s/empty", base);
+    assert(mkdir(docs_dir, 0700) == 0 && mkdir(empty_dir, 0700) == 0);
+    for (int i = 0; i < 3; ++i) {
+        snprintf(workdirs[i], sizeof(workdirs[i]), "%s/node%d", base, i);
+        assert(mkdir(workdirs[i], 0700) == 0);
+    }
+    char doc_path[512];
+    for (int i = 0; i < 12; ++i) {
+        char content[128];
+        snprintf(content, sizeof(content), "# Shard doc %d\n\nKolibri sharded document number %d.", i, i);
+        snprintf(doc_path, sizeof(doc_path), "%s/doc%02d.md", docs_dir, i);
+        write_file(doc_path, content);
+    }
+
+    pid_t shard0 = spawn_shard_server(server, workdirs[0], "19082", docs_dir, "0/2", NULL);
+    pid_t shard1 = spawn_shard_server(server, workdirs[1], "19083", docs_dir, "1/2", NULL);
+    wait_for_server(19082);
+    wait_for_server(19083);
+    char response[16384];
+    assert(http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), 19082) == 200);
+    long documents0 = json_count_field(response, "\"documents\":");
+    assert(http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), 19083) == 200);
+    long documents1 = json_count_field(response, "\"documents\":");
+    assert(documents0 > 0 && documents1 > 0 && documents0 + documents1 == 12);
+
+    /* A peer that accepts connections but never answers stands in for a slow shard. */
+    int silent = socket(AF_INET, SOCK_STREAM, 0);
+    assert(silent >= 0);
+    int reuse = 1;
+    setsockopt(silent, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(19084);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(silent, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(silent, 8) == 0);
+
+    pid_t coordinator = spawn_shard_server(server, workdirs[2], "19081", empty_dir, NULL,
+                                           "127.0.0.1:19082, http://127.0.0.1:19083/");
+    wait_for_server(19081);
+    assert(http_request("GET", "/api/knowledge/search?q=kolibri%20sharded&limit=20", NULL, NULL, response,
+                        sizeof(response), 19081) == 200);
+    int ids = 0;
+    for (const char *cursor = strstr(response, "\"id\":\"doc"); cursor; cursor = strstr(cursor + 1, "\"id\":\"doc")) {
+        ids += 1;
+    }
+    assert(ids == 12);
+    assert(strstr(response, "\"shards\":{\"total\":2,\"answered\":2}"));
+    assert(!strstr(response, "\"partial\""));
+    assert(http_request("GET", "/api/knowledge/search?q=number&limit=3", NULL, NULL, response, sizeof(response),
+                        19081) == 200);
+    assert(strstr(response, "\"answered\":2"));
+    kill(coordinator, SIGTERM);
+    waitpid(coordinator, NULL, 0);
+
+    coordinator = spawn_shard_server(server, workdirs[2], "19081", empty_dir, NULL,
+                                     "127.0.0.1:19082,127.0.0.1:19084,127.0.0.1:19083");
+    wait_for_server(19081);
+    struct timespec before;
+    struct timespec after;
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    assert(http_request("GET", "/api/knowledge/search?q=kolibri&limit=20", NULL, NULL, response, sizeof(response),
+                        19081) == 200);
+    clock_gettime(CLOCK_MONOTONIC, &after);
+    double elapsed = (double)(after.tv_sec - before.tv_sec) + (double)(after.tv_nsec - before.tv_nsec) / 1e9;
+    assert(elapsed < 1.5);
+    assert(strstr(response, "\"shards\":{\"total\":3,\"answered\":2},\"partial\":true"));
+    ids = 0;
+    for (const char *cursor = strstr(response, "\"id\":\"doc"); cursor; cursor = strstr(cursor + 1, "\"id\":\"doc")) {
+        ids += 1;
+    }
+    assert(ids == 12);
+    assert(http_request("GET", "/metrics", NULL, NULL, response, sizeof(response), 19081) == 200);
+    assert(json_count_field(response, "\nkolibri_shard_partial_total ") == 1L);
+
+    kill(coordinator, SIGTERM);
+    kill(shard0, SIGTERM);
+    kill(shard1, SIGTERM);
+    waitpid(coordinator, NULL, 0);
+
+    /* Ожидание шардов блокирует свой поток, поэтому координатор не стартует с event loop. */
+    spawn_env_set("KOLIBRI_KNOWLEDGE_EVENT_LOOP", "1");
+    coordinator = spawn_shard_server(server, workdirs[2], "19081", empty_dir, NULL, "127.0.0.1:19082");
+    spawn_env_set("KOLIBRI_KNOWLEDGE_EVENT_LOOP", NULL);
+    int exit_status = 0;
+    assert(waitpid(coordinator, &exit_status, 0) == coordinator);
+    assert(WIFEXITED(exit_status) && WEXITSTATUS(exit_status) == 1);
+    waitpid(shard0, NULL, 0);
+    waitpid(shard1, NULL, 0);
+    close(silent);
+    char command[512];
+    snprintf(command, sizeof(command), "rm -rf %s", base);
+    assert(system(command) == 0);
+}
+
 void test_knowledge_server_integration(void) {
     char docs_template[] = "/tmp/kolibri_docsXXXXXX";
     char cache_template[] = "/tmp/kolibri_cacheXXXXXX";
@@ -146,6 +571,9 @@ void test_knowledge_server_integration(void) {
         spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_CACHE", cache_dir);
         spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
         spawn_env_set("KOLIBRI_KNOWLEDGE_ADMIN_TOKEN", token);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_WORKERS", "2");
+        spawn_env_set("KOLIBRI_SWARM_ID", "hub");
+        spawn_env_set("KOLIBRI_SWARM_NODES", "alpha@http://10.0.0.1:8000, http://10.0.0.2:8000");
         execl("./kolibri_knowledge_server", "kolibri_knowledge_server", NULL);
         perror("execl");
         _exit(1);
@@ -154,15 +582,64 @@ void test_knowledge_server_integration(void) {
     wait_for_server(port);
 
     char response[4096];
+    /* A silent client must not block other requests while it holds a worker. */
+    int idle_sock = open_idle_connection(port);
     int status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
     assert(status == 200);
+    close(idle_sock);
     assert(strstr(response, "\"documents\":1"));
+    /* Простаивающие keep-alive соединения не держат воркеры, иначе оба воркера ждали бы их по 5 с. */
+    int kept[2];
+    for (size_t i = 0; i < sizeof(kept) / sizeof(kept[0]); ++i) {
+        kept[i] = open_keepalive_connection(port);
+    }
+    status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    for (size_t i = 0; i < sizeof(kept) / sizeof(kept[0]); ++i) {
+        close(kept[i]);
+    }
+    assert(pipelined_response_count(port) == 2);
     assert(strstr(response, "\"indexSource\":\"directories\""));
+    wait_for_warm_training(port, "\"warmTraining\":{\"state\":\"done\",\"trained\":1,\"documents\":1,");
 
     status = http_request("GET", "/api/knowledge/search?q=Kolibri", NULL, NULL, response, sizeof(response), port);
     assert(status == 200);
     assert(strstr(response, "snippets"));
 
+    /* The pipelined probe cached this query; both searches since were hits. */
+    status = http_request("GET", "/api/knowledge/search?q=%20KOLIBRI", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "guide"));
+
+    status = http_request("GET", "/api/knowledge/swarm", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "{\"nodeId\":\"hub\""));
+    assert(strstr(response, "{\"id\":\"alpha\",\"endpoint\":\"http://10.0.0.1:8000\""));
+    assert(strstr(response, "{\"id\":\"peer-3\",\"endpoint\":\"http://10.0.0.2:8000\""));
+    char metrics[65536];
+    status = http_request("GET", "/metrics", NULL, NULL, metrics, sizeof(metrics), port);
+    assert(status == 200);
+    assert(strstr(metrics, "kolibri_search_cache_hits_total 2\n"));
+    assert(strstr(metrics, "kolibri_search_cache_entries 1\n"));
+    assert(strstr(metrics, "# TYPE kolibri_http_request_duration_seconds histogram\n"));
+    assert(strstr(metrics, "kolibri_http_request_duration_seconds_bucket{route=\"search\",le=\"+Inf\"} 3\n"));
+    assert(strstr(metrics, "kolibri_http_request_duration_seconds_count{route=\"healthz\"} "));
+    /* Only the first search reached the index; the rest were cache hits. */
+    assert(strstr(metrics, "kolibri_http_phase_duration_seconds_count{phase=\"search\"} 1\n"));
+    assert(strstr(metrics, "kolibri_http_phase_duration_seconds_count{phase=\"receive\"} "));
+
+    status = http_request("GET", "/api/knowledge/suggest?q=know", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "\"suggestions\":[\"knowledge\"]"));
+    status = http_request("GET", "/api/knowledge/search?q=%22server%20integration%22", NULL, NULL, response,
+                          sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "guide"));
+    status = http_request("GET", "/api/knowledge/search?q=%22integration%20server%22", NULL, NULL, response,
+                          sizeof(response), port);
+    assert(status == 200);
+    assert(!strstr(response, "guide"));
+
     status = http_request("POST",
                           "/api/knowledge/feedback",
                           "rating=good&q=question&a=answer",
@@ -181,9 +658,71 @@ void test_knowledge_server_integration(void) {
                           port);
     assert(status == 200);
 
+    /* The bucket holds 30 feedback requests per client; other clients keep their own. */
+    for (int i = 1; i < 30; ++i) {
+        status = http_request("POST",
+                              "/api/knowledge/feedback",
+                              "rating=good&q=question&a=answer",
+                              "Authorization: Bearer secret-token\r\n",
+                              response,
+                              sizeof(response),
+                              port);
+        assert(status == 200);
+    }
+    status = http_request("POST",
+                          "/api/knowledge/feedback",
+                          "rating=good&q=question&a=answer",
+                          "Authorization: Bearer secret-token\r\n",
+                          response,
+                          sizeof(response),
+                          port);
+    assert(status == 429);
+    http_source_address = "127.0.0.2";
+    status = http_request("POST",
+                          "/api/knowledge/feedback",
+                          "rating=good&q=question&a=answer",
+                          "Authorization: Bearer secret-token\r\n",
+                          response,
+                          sizeof(response),
+                          port);
+    http_source_address = NULL;
+    assert(status == 200);
+    status = http_request("GET", "/metrics", NULL, NULL, metrics, sizeof(metrics), port);
+    assert(status == 200);
+    assert(strstr(metrics, "kolibri_rate_limited_total{route=\"feedback\"} 1\n"));
+    /* Flush durability: every acknowledged feedback event is already written. */
+    const char *written = strstr(metrics, "\nkolibri_genome_events_written_total ");
+    assert(written);
+    assert(strtoul(written + strlen("\nkolibri_genome_events_written_total "), NULL, 10) >= 31UL);
+    assert(strstr(metrics, "kolibri_genome_queue_capacity 1024\n"));
+    /* Очередь не переполнялась: поиск не терял событий. */
+    assert(strstr(metrics, "kolibri_genome_events_dropped_total 0\n"));
+    assert(strstr(metrics, "kolibri_genome_flush_duration_seconds_bucket{le=\"+Inf\"} "));
+
+    status = http_request("POST", "/api/knowledge/reload", NULL, NULL, response, sizeof(response), port);
+    assert(status == 401);
+    char extra_path[512];
+    snprintf(extra_path, sizeof(extra_path), "%s/swap.md", docs_dir);
+    write_file(extra_path, "# Swap\n\nHot reload brings a hummingbird document.");
+    reload_and_wait(port, "\"documents\":2");
+    status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "\"indexGeneration\":2"));
+    status = http_request("GET", "/api/knowledge/search?q=hummingbird", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "swap"));
+    /* Unchanged sources keep the current snapshot. */
+    reload_and_wait(port, "\"indexGeneration\":2");
+    remove_path(extra_path);
+    reload_and_wait(port, "\"documents\":1");
+
     kill(pid, SIGTERM);
     waitpid(pid, NULL, 0);
 
+    char snapshot_path[512];
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s/index.kbin", cache_dir);
+    assert(access(snapshot_path, R_OK) == 0);
+
     remove_path(doc_path);
     rmdir(docs_dir);
 
@@ -215,11 +754,60 @@ void test_knowledge_server_integration(void) {
     kill(pid, SIGTERM);
     waitpid(pid, NULL, 0);
 
-    char cache_index[512];
-    char cache_manifest[512];
-    snprintf(cache_index, sizeof(cache_index), "%s/index.json", cache_dir);
-    snprintf(cache_manifest, sizeof(cache_manifest), "%s/manifest.json", cache_dir);
-    remove_path(cache_index);
-    remove_path(cache_manifest);
-    rmdir(cache_dir);
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        spawn_env_set("KOLIBRI_KNOWLEDGE_PORT", "19081");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_BIND", "127.0.0.1");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_JSON", cache_dir);
+        spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_ADMIN_TOKEN", token);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_EVENT_LOOP", "1");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_GENOME_DURABILITY", "enqueue");
+        execl("./kolibri_knowledge_server", "kolibri_knowledge_server", NULL);
+        perror("execl");
+        _exit(1);
+    }
+
+    wait_for_server(port);
+    idle_sock = open_idle_connection(port);
+    const char *request_line = "GET /healthz HTTP/1.1\r\n";
+    assert(send(idle_sock, request_line, strlen(request_line), 0) == (ssize_t)strlen(request_line));
+    status = http_request("GET", "/api/knowledge/search?q=Kolibri", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "Kolibri"));
+    assert(send(idle_sock, "\r\n", 2, 0) == 2);
+    char partial[1024];
+    ssize_t partial_len = recv(idle_sock, partial, sizeof(partial) - 1U, 0);
+    assert(partial_len > 0);
+    partial[partial_len] = '\0';
+    assert(strstr(partial, "HTTP/1.1 200"));
+    close(idle_sock);
+    assert(pipelined_response_count(port) == 2);
+
+    status = http_request("POST",
+                          "/api/knowledge/teach",
+                          "q=question&a=answer",
+                          "Authorization: Bearer wrong-token\r\n",
+                          response,
+                          sizeof(response),
+                          port);
+    assert(status == 403);
+
+    status = http_request("POST",
+                          "/api/knowledge/teach",
+                          "q=question&a=answer",
+                          "Authorization: Bearer secret-token\r\n",
+                          response,
+                          sizeof(response),
+                          port);
+    assert(status == 200);
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    remove_index_cache(cache_dir);
+
+    test_knowledge_server_large_results(port);
+    test_knowledge_server_sharded();
 }
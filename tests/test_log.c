@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/log.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TEST_THREADS 4
+#define LOG_TEST_RECORDS 500
+
+static void *log_worker_main(void *arg) {
+    int worker = *(const int *)arg;
+    for (int i = 0; i < LOG_TEST_RECORDS; ++i) {
+        KOLIBRI_LOG_INFO("test.worker", "worker %d record %d", worker, i);
+    }
+    return NULL;
+}
+
+static char *log_read_all(FILE *file, size_t *size_out) {
+    long size = ftell(file);
+    assert(size >= 0);
+    rewind(file);
+    char *text = (char *)malloc((size_t)size + 1U);
+    assert(text);
+    size_t read = fread(text, 1U, (size_t)size, file);
+    text[read] = '\0';
+    if (size_out) {
+        *size_out = read;
+    }
+    return text;
+}
+
+static size_t log_occurrences(const char *text, const char *needle) {
+    size_t count = 0U;
+    for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) {
+        count++;
+    }
+    return count;
+}
+
+void test_log(void) {
+    KolibriLogLevel level;
+    KolibriLogFormat format;
+    assert(kolibri_log_parse_level("warn", &level) == 0 && level == KOLIBRI_LOG_LEVEL_WARN);
+    assert(kolibri_log_parse_format("jsonl", &format) == 0 && format == KOLIBRI_LOG_FORMAT_JSONL);
+    assert(kolibri_log_parse_level("loud", &level) == -1);
+
+    // Несколько производителей, JSON-строки, фильтр уровня модуля
+    FILE *file = tmpfile();
+    assert(file);
+    KolibriLogConfig config = {KOLIBRI_LOG_LEVEL_INFO, KOLIBRI_LOG_FORMAT_JSONL, file, 0U, 0U};
+    assert(kolibri_log_start(&config) == 0);
+    assert(kolibri_log_set_module_level("test.quiet", KOLIBRI_LOG_LEVEL_WARN) == 0);
+    assert(!kolibri_log_enabled(KOLIBRI_LOG_LEVEL_INFO, "test.quiet"));
+    assert(kolibri_log_enabled(KOLIBRI_LOG_LEVEL_INFO, "test.worker"));
+
+    pthread_t workers[LOG_TEST_THREADS];
+    int ids[LOG_TEST_THREADS];
+    for (int i = 0; i < LOG_TEST_THREADS; ++i) {
+        ids[i] = i;
+        assert(pthread_create(&workers[i], NULL, log_worker_main, &ids[i]) == 0);
+    }
+    for (int i = 0; i < LOG_TEST_THREADS; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    KOLIBRI_LOG_INFO("test.quiet", "hidden");
+    KOLIBRI_LOG_WARN("test.quiet", "say \"%s\"", "hi");
+    KOLIBRI_LOG_DEBUG("test.worker", "below the global level");
+    kolibri_log_flush();
+
+    KolibriLogStats stats;
+    kolibri_log_stats(&stats);
+    // Кольцо по умолчанию вмещает все записи разом
+    assert(stats.dropped == 0U);
+    assert(stats.written == LOG_TEST_THREADS * LOG_TEST_RECORDS + 1U);
+    kolibri_log_stop();
+    size_t size = 0U;
+    char *text = log_read_all(file, &size);
+    fclose(file);
+    assert(log_occurrences(text, "\n") == stats.written);
+    assert(log_occurrences(text, "\"module\":\"test.worker\"") == LOG_TEST_THREADS * LOG_TEST_RECORDS);
+    assert(strstr(text, "{\"ts_ns\":"));
+    assert(strstr(text, "\"message\":\"worker 3 record 499\"}"));
+    assert(strstr(text, "\"level\":\"warn\",\"module\":\"test.quiet\",\"message\":\"say \\\"hi\\\"\"}"));
+    assert(!strstr(text, "hidden"));
+    assert(!strstr(text, "below the global level"));
+    free(text);
+    assert(kolibri_log_set_module_level("test.quiet", KOLIBRI_LOG_LEVEL_DEBUG) == 0);
+
+    // Ограничение частоты: лишние записи места вызова считаются и сводятся в одну
+    file = tmpfile();
+    assert(file);
+    KolibriLogConfig limited = {KOLIBRI_LOG_LEVEL_INFO, KOLIBRI_LOG_FORMAT_TEXT, file, 0U, 5U};
+    assert(kolibri_log_start(&limited) == 0);
+    for (int i = 0; i < 40; ++i) {
+        KOLIBRI_LOG_INFO("test.rate", "tick %d", i);
+    }
+    kolibri_log_stats(&stats);
+    assert(stats.suppressed >= 30U);
+    kolibri_log_stop();
+    text = log_read_all(file, NULL);
+    fclose(file);
+    assert(log_occurrences(text, "[test.rate] tick ") + stats.suppressed == 40U);
+    assert(strstr(text, "[test.rate] tick 0\n"));
+    assert(strstr(text, " similar records suppressed\n"));
+    free(text);
+
+    // Двоичные записи
+    file = tmpfile();
+    assert(file);
+    KolibriLogConfig binary = {KOLIBRI_LOG_LEVEL_INFO, KOLIBRI_LOG_FORMAT_BINARY, file, 0U, 0U};
+    assert(kolibri_log_start(&binary) == 0);
+    KOLIBRI_LOG_ERROR("bin", "value=%d", 42);
+    kolibri_log_stop();
+    text = log_read_all(file, &size);
+    fclose(file);
+    assert(size == 4U + 13U + 3U + 8U);
+    const unsigned char *bytes = (const unsigned char *)text;
+    assert(memcmp(bytes, "KLG1", 4U) == 0);
+    assert(bytes[12] == KOLIBRI_LOG_LEVEL_ERROR);
+    assert(bytes[13] == 3U && bytes[14] == 0U && bytes[15] == 8U && bytes[16] == 0U);
+    assert(memcmp(bytes + 17, "binvalue=42", 11U) == 0);
+    free(text);
+
+    KolibriLogConfig bad = {KOLIBRI_LOG_LEVEL_INFO, (KolibriLogFormat)7, NULL, 0U, 0U};
+    assert(kolibri_log_start(&bad) == -1);
+}
@@ -3,31 +3,79 @@
 void test_decimal(void);
 void test_genome(void);
 void test_formula(void);
+void test_island(void);
 void test_net(void);
 void test_digits(void);
 void test_script(void);
 void test_script_load_file(void);
+void test_script_expressions(void);
+void test_script_compiled(void);
+void test_script_artifact(void);
+void test_script_many_names(void);
+void test_script_rerun(void);
+void test_script_teach_bulk(void);
+void test_script_profile(void);
+void test_script_shared_pool(void);
+void test_script_append(void);
+void test_script_step(void);
+void test_knowledge(void);
 void test_knowledge_index(void);
+void test_knowledge_index_incremental(void);
+void test_knowledge_index_unicode(void);
+void test_knowledge_index_phrases(void);
+void test_knowledge_index_crawl(void);
+void test_knowledge_index_dense(void);
+void test_knowledge_index_quantized(void);
+void test_knowledge_index_shards(void);
+void test_knowledge_index_simd(void);
 void test_knowledge_queue(void);
 void test_sim(void);
 void test_public_api(void);
 void test_knowledge_server_integration(void);
 void test_sigma(void);
+void test_wasm_bridge(void);
+void test_trace(void);
+void test_log(void);
+void test_alloc(void);
 
 int main(void) {
   test_decimal();
   test_genome();
   test_formula();
+  test_island();
   test_digits();
   test_net();
   test_script();
   test_script_load_file();
+  test_script_expressions();
+  test_script_compiled();
+  test_script_artifact();
+  test_script_many_names();
+  test_script_rerun();
+  test_script_teach_bulk();
+  test_script_profile();
+  test_script_shared_pool();
+  test_script_append();
+  test_script_step();
+  test_knowledge();
   test_knowledge_index();
+  test_knowledge_index_incremental();
+  test_knowledge_index_unicode();
+  test_knowledge_index_phrases();
+  test_knowledge_index_crawl();
+  test_knowledge_index_dense();
+  test_knowledge_index_quantized();
+  test_knowledge_index_shards();
+  test_knowledge_index_simd();
   test_knowledge_queue();
   test_sim();
   test_public_api();
   test_knowledge_server_integration();
   test_sigma();
+  test_wasm_bridge();
+  test_trace();
+  test_log();
+  test_alloc();
   printf("all tests passed\n");
   return 0;
 }
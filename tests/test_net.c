@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/time.h>
 
@@ -52,4 +53,115 @@ void test_net(void) {
   assert(elapsed_ms >= 0.0);
   assert(elapsed_ms < 50.0);
   kn_listener_close(&listener);
+
+  /* One connection carries HELLO and every formula; the listener keeps it. */
+  assert(kn_listener_start(&listener, 51310U) == 0);
+  KolibriNetPeers peers;
+  kn_peers_init(&peers, 9U);
+  assert(kn_peers_add(&peers, "127.0.0.1", 51310U) == 0);
+  for (int i = 0; i < 3; ++i) {
+    formula.fitness = (double)i;
+    assert(kn_peers_send_formula(&peers, 0U, &formula) == 0);
+  }
+  int socket_fd = peers.items[0].socket_fd;
+  assert(socket_fd >= 0);
+  int hellos = 0;
+  int formulas = 0;
+  for (int spins = 0; spins < 50 && formulas < 3; ++spins) {
+    if (kn_listener_poll(&listener, 100U, &message) == 1) {
+      if (message.type == KOLIBRI_MSG_HELLO) {
+        assert(message.data.hello.node_id == 9U);
+        hellos++;
+      } else {
+        assert(message.type == KOLIBRI_MSG_MIGRATE_RULE);
+        assert(message.data.formula.fitness == (double)formulas);
+        formulas++;
+      }
+    }
+  }
+  assert(hellos == 1 && formulas == 3);
+  assert(listener.client_count == 1U);
+  assert(kn_peers_send_formula(&peers, 0U, &formula) == 0);
+  assert(peers.items[0].socket_fd == socket_fd);
+
+  /* A second, idle connection does not hold back the messages of the first. */
+  KolibriNetPeers idle;
+  kn_peers_init(&idle, 10U);
+  assert(kn_peers_add(&idle, "127.0.0.1", 51310U) == 0);
+  assert(kn_peers_send_formula(&idle, 0U, &formula) == 0);
+  for (int i = 0; i < 4; ++i) {
+    assert(kn_peers_send_formula(&peers, 0U, &formula) == 0);
+  }
+  KolibriNetMessage batch[16];
+  size_t collected = 0;
+  for (int spins = 0; spins < 50 && collected < 7U; ++spins) {
+    collected += kn_listener_poll_many(&listener, 100U, batch + collected,
+                                       16U - collected);
+  }
+  /* The first share's formula, then HELLO + formula from idle, then four more. */
+  assert(collected == 7U);
+  assert(listener.client_count == 2U);
+
+  /* A blob is the frame kn_message_encode_formula writes, split after the header. */
+  KolibriNetBlob *blob = kn_blob_formula(9U, &formula);
+  assert(blob && blob->refs == 1U);
+  uint8_t encoded[KOLIBRI_NET_FRAME_MAX];
+  size_t encoded_len = kn_message_encode_formula(encoded, sizeof(encoded), 9U,
+                                                 &formula);
+  assert(blob->length == encoded_len);
+  assert(memcmp(blob->frame, encoded, encoded_len) == 0);
+  struct iovec parts[2];
+  assert(kn_blob_iov(blob, parts) == 2U);
+  assert(parts[0].iov_len + parts[1].iov_len == encoded_len);
+  assert(kn_blob_retain(blob) == blob && blob->refs == 2U);
+  kn_blob_release(blob);
+  assert(kn_peers_broadcast_blob(&peers, blob) == 1U);
+  kn_blob_release(blob);
+  collected = 0;
+  for (int spins = 0; spins < 50 && collected == 0U; ++spins) {
+    collected = kn_listener_poll_many(&listener, 100U, batch, 16U);
+  }
+  assert(collected == 1U && batch[0].type == KOLIBRI_MSG_MIGRATE_RULE);
+  assert(batch[0].data.formula.fitness == formula.fitness);
+
+  /* Where the listener has a readiness fd, it wakes an outside poll. */
+  int ready_fd = kn_listener_fd(&listener);
+  if (ready_fd >= 0) {
+    assert(kn_peers_send_formula(&peers, 0U, &formula) == 0);
+    struct pollfd wait = {ready_fd, POLLIN, 0};
+    assert(poll(&wait, 1, 1000) == 1 && (wait.revents & POLLIN));
+    assert(kn_listener_poll_many(&listener, 0U, batch, 16U) == 1U);
+  }
+  kn_peers_close(&idle);
+  kn_peers_close(&peers);
+  for (int spins = 0; spins < 50 && listener.client_count > 0U; ++spins) {
+    kn_listener_poll(&listener, 20U, &message);
+  }
+  assert(listener.client_count == 0U);
+  kn_listener_close(&listener);
+
+  /* A refused peer backs off instead of reconnecting on every send. */
+  kn_peers_init(&peers, 9U);
+  assert(kn_peers_add(&peers, "127.0.0.1", 51311U) == 0);
+  assert(kn_peers_send_formula(&peers, 0U, &formula) == -1);
+  assert(kn_peers_send_formula(&peers, 0U, &formula) == -1);
+  assert(peers.items[0].failures == 1U);
+  kn_peers_close(&peers);
+
+  /* A broadcast connects in parallel and records per-peer health. */
+  assert(kn_listener_start(&listener, 51310U) == 0);
+  kn_peers_init(&peers, 9U);
+  assert(kn_peers_add(&peers, "127.0.0.1", 51311U) == 0);
+  assert(kn_peers_add(&peers, "127.0.0.1", 51310U) == 1);
+  assert(kn_peers_broadcast_formula(&peers, &formula) == 1U);
+  assert(peers.items[0].errors == 1U && peers.items[0].sent == 0U);
+  assert(peers.items[1].errors == 0U && peers.items[1].sent == 1U);
+  char stats[4096];
+  assert(kn_peers_stats_json(&peers, stats, sizeof(stats)) > 0);
+  assert(strstr(stats, "\"target\":\"127.0.0.1:51310\",\"connected\":true,\"sent\":1"));
+  assert(kn_peers_stats_prometheus(&peers, stats, sizeof(stats)) > 0);
+  assert(strstr(stats, "kolibri_peer_errors_total{target=\"127.0.0.1:51311\"} 1\n"));
+  assert(kn_peers_stats_json(&peers, stats, 16U) == -1);
+  kn_peers_close(&peers);
+  kn_listener_close(&listener);
 }
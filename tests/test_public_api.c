@@ -1,6 +1,7 @@
 #include "kolibri/formula.h"
 #include "kolibri/genome.h"
 #include "kolibri/script.h"
+#include "kolibri/symbol_table.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -73,10 +74,97 @@ static void test_symbol_table_cyrillic(void) {
     size_t before = table.count;
     assert(kolibri_symbol_encode(&table, 0x2728U, digits) == 0); /* новая точка */
     assert(table.count == before + 1U);
+
+    /* Past code 998 the codes escape to nine digits; copies decode alike. */
+    for (uint32_t cp = 0x4E00U; table.count < 1200U; ++cp) {
+        uint8_t wide[KOLIBRI_SYMBOL_DIGITS_MAX];
+        assert(kolibri_symbol_encode_var(&table, cp, wide, sizeof(wide)) > 0);
+    }
+    KolibriSymbolTable copy;
+    kolibri_symbol_table_init(&copy, NULL);
+    assert(kolibri_symbol_table_copy(&copy, &table) == 0);
+    kolibri_symbol_table_free(&table);
+    for (size_t i = 0; i < copy.count; ++i) {
+        uint8_t wide[KOLIBRI_SYMBOL_DIGITS_MAX];
+        int width = kolibri_symbol_encode_var(&copy, copy.entries[i].codepoint, wide, sizeof(wide));
+        assert(width == (copy.entries[i].code < KOLIBRI_SYMBOL_ESCAPE ? 3 : 9));
+        assert(kolibri_symbol_decode_var(&copy, wide, sizeof(wide), &decoded) == width);
+        assert(decoded == copy.entries[i].codepoint);
+    }
+    assert(copy.count == 1200U);
+    assert(kolibri_symbol_encode(&copy, copy.entries[1100].codepoint, digits) == -1);
+    const uint8_t escaped[KOLIBRI_SYMBOL_DIGITS] = {9, 9, 9};
+    const uint8_t invalid[KOLIBRI_SYMBOL_DIGITS] = {0, 12, 0};
+    assert(kolibri_symbol_decode(&copy, escaped, &decoded) == -1);
+    assert(kolibri_symbol_decode(&copy, invalid, &decoded) == -1);
+    kolibri_symbol_table_free(&copy);
+}
+
+static void test_symbol_table_genome(void) {
+    unsigned char key[KOLIBRI_HMAC_KEY_SIZE];
+    memset(key, 2, sizeof(key));
+    char path[L_tmpnam];
+    assert(tmpnam(path));
+    char snapshot[L_tmpnam + 16];
+    snprintf(snapshot, sizeof(snapshot), "%s.symbols", path);
+
+    KolibriGenome genome;
+    assert(kg_open(&genome, path, key, sizeof(key)) == 0);
+    KolibriSymbolTable table;
+    kolibri_symbol_table_init(&table, &genome);
+    kolibri_symbol_table_seed_defaults(&table);
+    uint8_t wide[KOLIBRI_SYMBOL_DIGITS_MAX];
+    for (uint32_t cp = 0x4E00U; table.count < 1010U; ++cp) {
+        assert(kolibri_symbol_encode_var(&table, cp, wide, sizeof(wide)) > 0);
+    }
+    assert(kolibri_symbol_table_flush(&table) == 0);
+    /* Mappings go out in batches of many per block. */
+    assert(genome.next_index < table.count / 10U);
+    kg_close(&genome);
+    table.genome = NULL;
+
+    /* The first load replays the genome and leaves a snapshot behind. */
+    for (int round = 0; round < 3; ++round) {
+        KolibriSymbolTable loaded;
+        assert(kg_open(&genome, path, key, sizeof(key)) == 0);
+        kolibri_symbol_table_init(&loaded, &genome);
+        kolibri_symbol_table_load(&loaded);
+        assert(loaded.count == table.count);
+        for (size_t i = 0; i < table.count; ++i) {
+            int width = kolibri_symbol_encode_var(&loaded, table.entries[i].codepoint, wide,
+                                                  sizeof(wide));
+            uint32_t decoded = 0U;
+            assert(kolibri_symbol_decode_var(&table, wide, (size_t)width, &decoded) == width);
+            assert(decoded == table.entries[i].codepoint);
+        }
+        FILE *file = fopen(snapshot, "rb");
+        assert(file);
+        fclose(file);
+        /* A symbol logged after the snapshot is replayed on top of it. */
+        if (round == 0) {
+            assert(kolibri_symbol_encode_var(&table, 0x1F600U, wide, sizeof(wide)) > 0);
+            assert(kolibri_symbol_encode_var(&loaded, 0x1F600U, wide, sizeof(wide)) > 0);
+            assert(kolibri_symbol_table_flush(&loaded) == 0);
+        }
+        /* A damaged snapshot is ignored and rebuilt from the genome. */
+        if (round == 1) {
+            file = fopen(snapshot, "r+b");
+            assert(file);
+            assert(fseek(file, -12L, SEEK_END) == 0);
+            assert(fputc(0x7F, file) != EOF);
+            fclose(file);
+        }
+        kolibri_symbol_table_free(&loaded);
+        kg_close(&genome);
+    }
+    kolibri_symbol_table_free(&table);
+    remove(snapshot);
+    remove(path);
 }
 
 void test_public_api(void) {
     test_script_smoke();
     test_genome_smoke();
     test_symbol_table_cyrillic();
+    test_symbol_table_genome();
 }
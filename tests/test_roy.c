@@ -22,8 +22,9 @@ void test_roy(void) {
     KolibriRoy vtoroj;
     assert(kolibri_roy_zapustit(&pervyj, 1001U, 51200U, TEST_KEY,
                                 sizeof(TEST_KEY) - 1U) == 0);
-    assert(kolibri_roy_zapustit(&vtoroj, 2002U, 51201U, TEST_KEY,
-                                sizeof(TEST_KEY) - 1U) == 0);
+    assert(kolibri_roy_zapustit_s_glubinoj(&vtoroj, 2002U, 51201U, TEST_KEY,
+                                           sizeof(TEST_KEY) - 1U, 3U) == 0);
+    assert(vtoroj.ochered_glubina == 4U);
 
     struct sockaddr_in adres;
     memset(&adres, 0, sizeof(adres));
@@ -43,22 +44,64 @@ void test_roy(void) {
 
     KolibriFormula formula;
     zapolnit_formulu(&formula);
-    assert(kolibri_roy_otpravit_vsem(&pervyj, &formula) == 0);
+    /* Больше формул, чем вмещает очередь: лишние отбрасываются. */
+    for (int povtor = 0; povtor < 8; ++povtor) {
+        assert(kolibri_roy_otpravit_vsem(&pervyj, &formula) == 0);
+    }
 
     usleep(200000);
 
     int nashli_formulu = 0;
+    size_t prinyato = 0U;
     KolibriRoySobytie sobytie;
     while (kolibri_roy_poluchit_sobytie(&vtoroj, &sobytie) > 0) {
+        prinyato++;
         if (sobytie.tip == KOLIBRI_ROY_SOBYTIE_FORMULA) {
-            assert(sobytie.formula.gene.length == 3U);
-            assert(sobytie.formula.gene.digits[0] == 1U);
-            assert(sobytie.formula.gene.digits[1] == 2U);
-            assert(sobytie.formula.gene.digits[2] == 3U);
+            assert(sobytie.gene.length == 3U);
+            assert(sobytie.gene.digits[0] == 1U);
+            assert(sobytie.gene.digits[1] == 2U);
+            assert(sobytie.gene.digits[2] == 3U);
+            assert(sobytie.fitness == 0.75);
             nashli_formulu = 1;
         }
     }
     assert(nashli_formulu);
+    assert(prinyato <= 4U);
+    assert(kolibri_roy_poteri(&vtoroj) > 0U);
+
+    KolibriRoySosed vid[KOLIBRI_ROY_MAX_VID];
+    assert(kolibri_roy_vid(&pervyj, vid, KOLIBRI_ROY_MAX_VID) == 1U);
+    assert(vid[0].identifikator == 2002U);
+
+    /* Анонс несёт только отпечаток; ген сосед вытягивает сам и один раз. */
+    KolibriFormula novaya = formula;
+    novaya.gene.digits[2] = 9U;
+    assert(kolibri_roy_anonsirovat(&pervyj, &novaya, 1U, 7U) == 1);
+    usleep(200000);
+    int vytyanuli = 0;
+    while (kolibri_roy_poluchit_sobytie(&vtoroj, &sobytie) > 0) {
+        if (sobytie.tip == KOLIBRI_ROY_SOBYTIE_FORMULA && sobytie.pokolenie == 7U) {
+            assert(sobytie.gene.length == 3U);
+            assert(sobytie.gene.digits[2] == 9U);
+            assert(sobytie.fitness == 0.75);
+            vytyanuli++;
+        }
+    }
+    assert(vytyanuli == 1);
+    assert(kolibri_roy_anonsirovat(&pervyj, &novaya, 1U, 8U) == 0);
+
+    /* Таблица растёт за начальную ёмкость, а вид остаётся порядка log2 N. */
+    for (uint32_t nomer = 0U; nomer < 300U; ++nomer) {
+        adres.sin_port = htons((uint16_t)(40000U + nomer));
+        assert(kolibri_roy_dobavit_soseda(&pervyj, &adres, 5000U + nomer) == 0);
+    }
+    adres.sin_port = htons(40000U);
+    assert(kolibri_roy_dobavit_soseda(&pervyj, &adres, 5000U) == 0);
+    static KolibriRoySosed vse[512];
+    assert(kolibri_roy_spisok_sosedey(&pervyj, vse, 512U) == 301U);
+    size_t razmer_vida = kolibri_roy_vid(&pervyj, vid, KOLIBRI_ROY_MAX_VID);
+    assert(razmer_vida >= 1U && razmer_vida <= 10U);
+    assert(kolibri_roy_otpravit_sluchajnomu(&pervyj, 7U, &formula) == 0);
 
     kolibri_roy_ostanovit(&pervyj);
     kolibri_roy_ostanovit(&vtoroj);
@@ -6,6 +6,7 @@
 #include "kolibri/formula.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -89,3 +90,634 @@ void test_script_load_file(void) {
     remove(vremya);
     ks_free(&skript);
 }
+
+void test_script_expressions(void) {
+    KolibriFormulaPool pool;
+    kf_pool_init(&pool, 313131ULL);
+
+    KolibriScript skript;
+    assert(ks_init(&skript, &pool, NULL) == 0);
+
+    const char *programma =
+        "начало:\n"
+        "    переменная порог = 2\n"
+        "    переменная метка = \"5\"\n"
+        "    если метка >= порог тогда\n"
+        "        показать \"больше\"\n"
+        "    иначе\n"
+        "        показать \"меньше\"\n"
+        "    конец\n"
+        "    переменная флаг = 0\n"
+        "    пока флаг < 1 делать\n"
+        "        показать \"шаг\"\n"
+        "        переменная флаг = 1\n"
+        "    конец\n"
+        "    если фитнес пусто == 0 тогда\n"
+        "        показать \"ноль\"\n"
+        "    конец\n"
+        "    показать метка\n"
+        "конец.\n";
+
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+
+    assert(ks_load_text(&skript, programma) == 0);
+    assert(ks_execute(&skript) == 0);
+
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    char bufer[256];
+    size_t prochitano = fread(bufer, 1U, sizeof(bufer) - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    ks_free(&skript);
+
+    assert(strstr(bufer, "больше") != NULL);
+    assert(strstr(bufer, "меньше") == NULL);
+    const char *shag = strstr(bufer, "шаг");
+    assert(shag != NULL && strstr(shag + 1, "шаг") == NULL);
+    assert(strstr(bufer, "ноль") != NULL);
+    assert(strstr(bufer, "5") != NULL);
+}
+
+static int vypolnit_s_vyvodom(KolibriScript *skript, const KolibriScriptProgram *programma,
+                              char *bufer, size_t razmer) {
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(skript, vyvod);
+    int rezultat = programma ? ks_execute_compiled(skript, programma) : ks_execute(skript);
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    size_t prochitano = fread(bufer, 1U, razmer - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    ks_set_output(skript, NULL);
+    return rezultat;
+}
+
+void test_script_compiled(void) {
+    const char *programma =
+        "начало:\n"
+        "    переменная флаг = 0\n"
+        "    пока флаг < 1 делать\n"
+        "        показать \"шаг\"\n"
+        "        если флаг == 0 тогда\n"
+        "            переменная флаг = 1\n"
+        "        иначе\n"
+        "            показать \"лишнее\"\n"
+        "        конец\n"
+        "    конец\n"
+        "    обучить связь \"2\" -> \"4\"\n"
+        "    создать формулу ответ из \"ассоциация\"\n"
+        "    вызвать эволюцию\n"
+        "    оценить ответ на задаче \"2\"\n"
+        "    показать итог\n"
+        "    показать флаг\n"
+        "конец.\n";
+
+    KolibriFormulaPool *pervyj = malloc(sizeof(*pervyj));
+    KolibriFormulaPool *vtoroj = malloc(sizeof(*vtoroj));
+    assert(pervyj && vtoroj);
+    kf_pool_init(pervyj, 515151ULL);
+    kf_pool_init(vtoroj, 515151ULL);
+
+    char ozhidaemo[512];
+    char bufer[512];
+    KolibriScript skript;
+    assert(ks_init(&skript, pervyj, NULL) == 0);
+    assert(ks_load_text(&skript, programma) == 0);
+    assert(vypolnit_s_vyvodom(&skript, NULL, ozhidaemo, sizeof(ozhidaemo)) == 0);
+    assert(strstr(ozhidaemo, "шаг") != NULL);
+    assert(strstr(ozhidaemo, "лишнее") == NULL);
+    assert(strstr(ozhidaemo, "4") != NULL);
+
+    KolibriScriptProgram *kod = ks_compile(&skript);
+    assert(kod != NULL);
+    ks_free(&skript);
+
+    /* One program, a fresh script and pool per run. */
+    assert(ks_init(&skript, vtoroj, NULL) == 0);
+    assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, ozhidaemo) == 0);
+    assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == 0);
+    assert(strstr(bufer, "шаг") != NULL && strstr(bufer, "4") != NULL);
+    ks_free(&skript);
+    ks_program_free(kod);
+
+    assert(ks_init(&skript, pervyj, NULL) == 0);
+    assert(ks_load_text(&skript,
+                        "начало:\n"
+                        "    пока 0 < 1 делать\n"
+                        "        показать \"снова\"\n"
+                        "    конец\n"
+                        "конец.\n") == 0);
+    kod = ks_compile(&skript);
+    assert(kod != NULL);
+    assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == -1);
+    ks_program_free(kod);
+    assert(ks_load_text(&skript, "начало:\n    показать\nконец.\n") == 0);
+    assert(ks_compile(&skript) == NULL);
+    ks_free(&skript);
+
+    free(pervyj);
+    free(vtoroj);
+}
+
+void test_script_artifact(void) {
+    const char *programma =
+        "начало:\n"
+        "    переменная флаг = 0\n"
+        "    пока флаг < 1 делать\n"
+        "        показать \"из артефакта\"\n"
+        "        переменная флаг = 1\n"
+        "    конец\n"
+        "конец.\n";
+    char put[sizeof "/tmp/kolibri_scriptXXXXXX"];
+    zapisat_skript_text(put, sizeof(put), programma);
+    char artefakt[sizeof(put) + 4U];
+    assert(ks_program_cache_path(put, artefakt, sizeof(artefakt)) == 0);
+    assert(strcmp(artefakt + strlen(put), ".ksc") == 0);
+
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 616161ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+
+    assert(ks_load_file(&skript, put) == 0);
+    assert(skript.program == NULL);
+    KolibriScriptProgram *kod = ks_compile(&skript);
+    assert(kod != NULL);
+    assert(ks_program_save(kod, programma, artefakt) == 0);
+    ks_program_free(kod);
+
+    assert(ks_load_file(&skript, put) == 0);
+    assert(skript.program != NULL);
+    char bufer[256];
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "из артефакта\n") == 0);
+    assert(ks_program_load(artefakt, "начало:\nконец.\n") == NULL);
+
+    /* An edited source no longer matches the artifact. */
+    FILE *file = fopen(put, "ab");
+    assert(file != NULL);
+    fputs("\n", file);
+    fclose(file);
+    assert(ks_load_file(&skript, put) == 0);
+    assert(skript.program == NULL);
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "из артефакта\n") == 0);
+
+    /* A truncated artifact is rejected rather than half-read. */
+    file = fopen(artefakt, "rb+");
+    assert(file != NULL);
+    assert(ftruncate(fileno(file), 40) == 0);
+    fclose(file);
+    assert(ks_program_load(artefakt, programma) == NULL);
+
+    remove(artefakt);
+    remove(put);
+    ks_free(&skript);
+    free(pool);
+}
+
+void test_script_many_names(void) {
+    size_t emkost = 192U * 1024U;
+    char *programma = malloc(emkost);
+    assert(programma);
+    size_t dlina = (size_t)snprintf(programma, emkost, "начало:\n");
+    for (int i = 0; i < 3000; ++i) {
+        dlina += (size_t)snprintf(programma + dlina, emkost - dlina, "    переменная v%d = %d\n", i, i);
+    }
+    for (int i = 0; i < 8; ++i) {
+        dlina += (size_t)snprintf(programma + dlina, emkost - dlina,
+                                  "    создать формулу f%d из \"ассоциация\"\n", i);
+    }
+    dlina += (size_t)snprintf(programma + dlina, emkost - dlina,
+                              "    отбросить f2\n"
+                              "    сохранить f7 в геном\n"
+                              "    переменная v1500 = 7\n"
+                              "    если v2999 == 2999 тогда\n"
+                              "        показать v1500\n"
+                              "    конец\n"
+                              "    показать v0\n"
+                              "конец.\n");
+    assert(dlina < emkost);
+
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 727272ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+    assert(ks_load_text(&skript, programma) == 0);
+    char bufer[64];
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "7\n0\n") == 0);
+    assert(skript.variables_count == 3000);
+    assert(skript.formulas_count == 7);
+
+    KolibriScriptProgram *kod = ks_compile(&skript);
+    assert(kod != NULL);
+    assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "7\n0\n") == 0);
+    ks_program_free(kod);
+
+    /* A dropped binding is gone, the ones after it are still found. */
+    assert(ks_load_text(&skript, "начало:\n    создать формулу a из \"x\"\n    создать формулу b из \"x\"\n"
+                                 "    отбросить a\n    отбросить b\n    отбросить a\nконец.\n") == 0);
+    assert(ks_execute(&skript) == -1);
+    assert(skript.formulas_count == 0);
+
+    ks_free(&skript);
+    free(pool);
+    free(programma);
+}
+
+void test_script_rerun(void) {
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 515151ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+    const char *programma = "начало:\n"
+                            "    переменная приветствие = \"привет\"\n"
+                            "    переменная флаг = 0\n"
+                            "    пока флаг < 1 делать\n"
+                            "        показать приветствие\n"
+                            "        переменная флаг = 1\n"
+                            "    конец\n"
+                            "    показать флаг\n"
+                            "конец.\n";
+    char bufer[64];
+    /* Each run starts from a reset arena; the output must not drift. */
+    for (int i = 0; i < 50; ++i) {
+        assert(ks_load_text(&skript, programma) == 0);
+        assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+        assert(strcmp(bufer, "привет\n1\n") == 0);
+    }
+    KolibriScriptProgram *kod = ks_compile(&skript);
+    assert(kod != NULL);
+    for (int i = 0; i < 50; ++i) {
+        assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == 0);
+        assert(strcmp(bufer, "привет\n1\n") == 0);
+    }
+    ks_program_free(kod);
+    ks_free(&skript);
+    free(pool);
+}
+
+void test_script_teach_bulk(void) {
+    const KolibriAssociationInput pary[] = {
+        {"как дела у тебя", "хорошо"},
+        {"как   дела", "отлично"},
+        {"сколько будет два плюс два", "четыре"},
+    };
+    KolibriFormulaPool *pervyj = malloc(sizeof(*pervyj));
+    KolibriFormulaPool *vtoroj = malloc(sizeof(*vtoroj));
+    assert(pervyj && vtoroj);
+    kf_pool_init(pervyj, 1ULL);
+    kf_pool_init(vtoroj, 1ULL);
+
+    KolibriScript skript;
+    assert(ks_init(&skript, pervyj, NULL) == 0);
+    assert(ks_load_text(&skript, "начало:\n"
+                                 "    обучить связь \"как дела у тебя\" -> \"хорошо\"\n"
+                                 "    обучить связь \"как   дела\" -> \"отлично\"\n"
+                                 "    обучить связь \"сколько будет два плюс два\" -> \"четыре\"\n"
+                                 "конец.\n") == 0);
+    char bufer[64];
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(skript.associations_count == 3);
+    ks_free(&skript);
+
+    assert(ks_init(&skript, vtoroj, NULL) == 0);
+    assert(ks_teach_bulk(&skript, pary, sizeof(pary) / sizeof(pary[0])) == 0);
+    ks_free(&skript);
+
+    /* 3 questions and 5 + 7 n-grams; "как дела" is taught twice. */
+    assert(pervyj->association_count == 15);
+    assert(vtoroj->association_count == pervyj->association_count);
+    for (size_t i = 0; i < pervyj->association_count; ++i) {
+        assert(strcmp(pervyj->associations[i].question, vtoroj->associations[i].question) == 0);
+        assert(strcmp(pervyj->associations[i].answer, vtoroj->associations[i].answer) == 0);
+    }
+    const KolibriAssociation *ngramma = kf_pool_find_association(pervyj, kf_hash_from_text("дела у тебя"));
+    assert(ngramma && strcmp(ngramma->answer, "хорошо") == 0);
+    ngramma = kf_pool_find_association(pervyj, kf_hash_from_text("как дела"));
+    assert(ngramma && strcmp(ngramma->answer, "отлично") == 0);
+
+    assert(ks_init(&skript, NULL, NULL) == 0);
+    assert(ks_teach_bulk(&skript, pary, 1) == -1);
+    ks_free(&skript);
+    free(pervyj);
+    free(vtoroj);
+}
+
+static void sledit(void *schetchik, const KolibriScriptProfileEntry *zapis, uint64_t vremja) {
+    (void)vremja;
+    assert(zapis->line > 0);
+    *(size_t *)schetchik += 1U;
+}
+
+/* Both execution paths must produce the same entries in the same order. */
+static void proverit_profil(const KolibriScript *skript) {
+    const KolibriScriptProfileEntry *zapisi = NULL;
+    assert(ks_profile_entries(skript, &zapisi) == 6);
+    const size_t stroki[] = {2, 3, 4, 5, 6, 9};
+    const size_t roditeli[] = {0, 0, 2, 2, 4, 0};
+    for (size_t i = 0; i < 6; ++i) {
+        assert(zapisi[i].line == stroki[i]);
+        assert(zapisi[i].parent == roditeli[i]);
+        assert(zapisi[i].count == 1);
+    }
+    assert(strcmp(zapisi[1].kind, "пока") == 0);
+    assert(strcmp(zapisi[2].kind, "вызвать эволюцию") == 0);
+    assert(zapisi[2].evolution_ns > 0 && zapisi[2].evolution_ns <= zapisi[2].self_ns);
+    assert(zapisi[0].evolution_ns == 0);
+}
+
+void test_script_profile(void) {
+    const char *programma =
+        "начало:\n"
+        "    переменная шаг = 0\n"
+        "    пока шаг < 1 делать\n"
+        "        вызвать эволюцию\n"
+        "        если шаг == 0 тогда\n"
+        "            переменная шаг = 1\n"
+        "        конец\n"
+        "    конец\n"
+        "    показать шаг\n"
+        "конец.\n";
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 424242ULL);
+    assert(kf_pool_add_example(pool, 1, 2) == 0);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+    assert(ks_profile_entries(&skript, NULL) == 0);
+    size_t shagi = 0;
+    assert(ks_set_trace_hook(&skript, sledit, &shagi) == 0);
+    assert(skript.profiler != NULL);
+
+    assert(ks_load_text(&skript, programma) == 0);
+    char bufer[64];
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "1\n") == 0);
+    proverit_profil(&skript);
+    assert(shagi == 6);
+
+    FILE *otchet = tmpfile();
+    assert(otchet != NULL);
+    assert(ks_profile_report(&skript, otchet) == 0);
+    assert(ks_profile_write_collapsed(&skript, otchet) == 0);
+    fseek(otchet, 0L, SEEK_SET);
+    char tekst[2048];
+    size_t prochitano = fread(tekst, 1U, sizeof(tekst) - 1U, otchet);
+    tekst[prochitano] = '\0';
+    fclose(otchet);
+    /* The loop's total includes the evolution, so it is listed first. */
+    char *cikl = strstr(tekst, "\n3:5\tпока\t1\t");
+    char *evoljucija = strstr(tekst, "\n4:9\tвызвать эволюцию\t1\t");
+    assert(cikl && evoljucija && cikl < evoljucija);
+    assert(strstr(tekst, "сценарий;пока (3:5);вызвать эволюцию (4:9);kf_pool_tick ") != NULL);
+
+    KolibriScriptProgram *kod = ks_compile(&skript);
+    assert(kod != NULL);
+    char put[] = "/tmp/kolibri_profileXXXXXX";
+    int fd = mkstemp(put);
+    assert(fd >= 0);
+    close(fd);
+    assert(ks_program_save(kod, programma, put) == 0);
+    ks_program_free(kod);
+    kod = ks_program_load(put, programma);
+    assert(kod != NULL);
+    remove(put);
+
+    ks_profile_reset(&skript);
+    assert(vypolnit_s_vyvodom(&skript, kod, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "1\n") == 0);
+    proverit_profil(&skript);
+    ks_program_free(kod);
+
+    /* Another text starts a fresh profile; disabling drops it. */
+    assert(ks_load_text(&skript, "начало:\n    показать 1\nконец.\n") == 0);
+    assert(ks_profile_entries(&skript, NULL) == 0);
+    assert(ks_set_profiler(&skript, 0) == 0);
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(ks_profile_entries(&skript, NULL) == 0);
+    ks_free(&skript);
+    free(pool);
+}
+
+static int dopisat_s_vyvodom(KolibriScript *skript, const char *fragment, char *bufer, size_t razmer) {
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(skript, vyvod);
+    int rezultat = ks_execute_append(skript, fragment);
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    size_t prochitano = fread(bufer, 1U, razmer - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    ks_set_output(skript, NULL);
+    return rezultat;
+}
+
+void test_script_append(void) {
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 616161ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+    char bufer[64];
+    assert(dopisat_s_vyvodom(&skript, "переменная приветствие = \"привет\"\n", bufer, sizeof(bufer)) == 0);
+    assert(dopisat_s_vyvodom(&skript, "переменная флаг = 0\n", bufer, sizeof(bufer)) == 0);
+    assert(dopisat_s_vyvodom(&skript, "показать приветствие\n", bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "привет\n") == 0);
+
+    /* An open block runs nothing until its end arrives. */
+    assert(dopisat_s_vyvodom(&skript, "пока флаг < 1 делать\n", bufer, sizeof(bufer)) == 1);
+    assert(bufer[0] == '\0');
+    assert(dopisat_s_vyvodom(&skript,
+                             "пока флаг < 1 делать\n"
+                             "    показать приветствие\n"
+                             "    переменная флаг = 1\n"
+                             "конец\n",
+                             bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "привет\n") == 0);
+    assert(dopisat_s_vyvodom(&skript, "ерунда\n", bufer, sizeof(bufer)) == -1);
+    assert(dopisat_s_vyvodom(&skript, "обучить связь \"кто ты\" -> \"колибри\"\nпоказать флаг\n", bufer,
+                             sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "1\n") == 0);
+    assert(skript.associations_count == 1);
+    assert(kf_pool_find_association(pool, kf_hash_from_text("кто ты")) != NULL);
+    assert(skript.session_lines == 10);
+
+    /* A full run starts the session over. */
+    assert(ks_load_text(&skript, "начало:\n    показать флаг\nконец.\n") == 0);
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(strcmp(bufer, "флаг\n") == 0);
+    assert(skript.session_lines == 0);
+    ks_free(&skript);
+    free(pool);
+}
+
+void test_script_step(void) {
+    const char *programma = "начало:\n"
+                            "    переменная шаг = 0\n"
+                            "    пока шаг < 3 делать\n"
+                            "        вызвать эволюцию\n"
+                            "        если шаг == 2 тогда\n"
+                            "            переменная шаг = 3\n"
+                            "        конец\n"
+                            "        если шаг == 1 тогда\n"
+                            "            переменная шаг = 2\n"
+                            "        конец\n"
+                            "        если шаг == 0 тогда\n"
+                            "            переменная шаг = 1\n"
+                            "        конец\n"
+                            "        показать шаг\n"
+                            "    конец\n"
+                            "    показать \"готово\"\n"
+                            "конец.\n";
+    KolibriFormulaPool *pool = malloc(sizeof(*pool));
+    assert(pool);
+    kf_pool_init(pool, 717171ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, pool, NULL) == 0);
+    assert(ks_load_text(&skript, programma) == 0);
+    char ozhidanie[64];
+    assert(vypolnit_s_vyvodom(&skript, NULL, ozhidanie, sizeof(ozhidanie)) == 0);
+    assert(strcmp(ozhidanie, "1\n2\n3\nготово\n") == 0);
+
+    /* A zero budget stops at every yield point: each evolution and back edge. */
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    size_t ustupki = 0;
+    KolibriScriptStatus status;
+    while ((status = ks_step(&skript, 0U)) == KOLIBRI_SCRIPT_YIELDED) {
+        assert(skript.continuation != NULL);
+        ustupki++;
+    }
+    assert(status == KOLIBRI_SCRIPT_DONE);
+    assert(ustupki == 6);
+    assert(skript.continuation == NULL);
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    char bufer[64];
+    size_t prochitano = fread(bufer, 1U, sizeof(bufer) - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    ks_set_output(&skript, NULL);
+    assert(strcmp(bufer, ozhidanie) == 0);
+
+    /* A full run abandons the stepped one. */
+    assert(ks_step(&skript, 0U) == KOLIBRI_SCRIPT_YIELDED);
+    assert(vypolnit_s_vyvodom(&skript, NULL, bufer, sizeof(bufer)) == 0);
+    assert(skript.continuation == NULL);
+    assert(strcmp(bufer, ozhidanie) == 0);
+    vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    assert(ks_step(&skript, UINT64_MAX / 2U) == KOLIBRI_SCRIPT_DONE);
+    fclose(vyvod);
+    ks_set_output(&skript, NULL);
+
+    assert(ks_load_text(&skript, "начало:\n    ерунда\nконец.\n") == 0);
+    assert(ks_step(&skript, 0U) == KOLIBRI_SCRIPT_ERROR);
+    ks_free(&skript);
+    free(pool);
+}
+
+#define SHARED_POTOKI 4
+#define SHARED_ZAPUSKI 8
+
+typedef struct {
+    KolibriSharedPool *obshchij;
+    int nomer;
+    int oshibki;
+} SharedZadacha;
+
+static void *shared_potok(void *arg) {
+    SharedZadacha *zadacha = (SharedZadacha *)arg;
+    KolibriScript skript;
+    assert(ks_init(&skript, NULL, NULL) == 0);
+    assert(ks_attach_shared(&skript, zadacha->obshchij) == 0);
+    FILE *vyvod = fopen("/dev/null", "w");
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    for (int i = 0; i < SHARED_ZAPUSKI; ++i) {
+        char programma[256];
+        snprintf(programma, sizeof(programma),
+                 "начало:\n"
+                 "    обучить связь \"в%dш%d\" -> \"о%d\"\n"
+                 "    вызвать эволюцию\n"
+                 "конец.\n",
+                 zadacha->nomer, i, zadacha->nomer);
+        if (ks_load_text(&skript, programma) != 0 || ks_execute(&skript) != 0) {
+            zadacha->oshibki++;
+        }
+    }
+    ks_free(&skript);
+    fclose(vyvod);
+    return NULL;
+}
+
+void test_script_shared_pool(void) {
+    KolibriPoolConfig config = {0U, 0U, 256U, 77ULL};
+    KolibriFormulaPool *pool = kf_pool_create(&config);
+    assert(pool);
+    assert(kf_pool_add_example(pool, 1, 2) == 0);
+    KolibriSharedPool *obshchij = ks_shared_create(pool, NULL);
+    assert(obshchij);
+
+    pthread_t potoki[SHARED_POTOKI];
+    SharedZadacha zadachi[SHARED_POTOKI];
+    for (int t = 0; t < SHARED_POTOKI; ++t) {
+        zadachi[t].obshchij = obshchij;
+        zadachi[t].nomer = t;
+        zadachi[t].oshibki = 0;
+        assert(pthread_create(&potoki[t], NULL, shared_potok, &zadachi[t]) == 0);
+    }
+    for (int t = 0; t < SHARED_POTOKI; ++t) {
+        assert(pthread_join(potoki[t], NULL) == 0);
+        assert(zadachi[t].oshibki == 0);
+    }
+
+    /* Every pair reaches the shared pool, and so do evolved formulas. */
+    assert(pool->association_count == SHARED_POTOKI * SHARED_ZAPUSKI);
+    for (int t = 0; t < SHARED_POTOKI; ++t) {
+        for (int i = 0; i < SHARED_ZAPUSKI; ++i) {
+            char vopros[32];
+            char otvet[32];
+            snprintf(vopros, sizeof(vopros), "в%dш%d", t, i);
+            snprintf(otvet, sizeof(otvet), "о%d", t);
+            const KolibriAssociation *svjaz = kf_pool_find_association(pool, kf_hash_from_text(vopros));
+            assert(svjaz && strcmp(svjaz->answer, otvet) == 0);
+        }
+    }
+    assert(kf_pool_best(pool)->fitness > 0.0);
+
+    /* Detached, a script writes to its own pool again. */
+    KolibriFormulaPool *svoj = malloc(sizeof(*svoj));
+    assert(svoj);
+    kf_pool_init(svoj, 3ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, svoj, NULL) == 0);
+    assert(ks_attach_shared(&skript, obshchij) == 0);
+    assert(skript.pool != pool && skript.pool != svoj);
+    const KolibriAssociationInput para = {"чей", "общий"};
+    assert(ks_teach_bulk(&skript, &para, 1) == 0);
+    assert(kf_pool_find_association(pool, kf_hash_from_text("чей")) != NULL);
+    assert(ks_attach_shared(&skript, NULL) == 0);
+    assert(skript.pool == svoj && skript.changes == NULL);
+    assert(ks_teach_bulk(&skript, &para, 1) == 0);
+    assert(svoj->association_count == 1);
+    ks_free(&skript);
+
+    ks_shared_destroy(obshchij);
+    kf_pool_destroy(pool);
+    free(svoj);
+}
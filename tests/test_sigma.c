@@ -1,10 +1,44 @@
 #include "kolibri/sigma.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+static uint32_t sigma_read_u32(const uint8_t **cursor) {
+    uint32_t value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+/* Walks a v2 snapshot: every token must have been seen expected times. */
+static size_t sigma_snapshot_tokens(const uint8_t *snapshot, uint32_t expected) {
+    const uint8_t *cursor = snapshot + 20;
+    size_t tokens = 0U;
+    for (int d = 0; d < 10; ++d) {
+        uint32_t count = sigma_read_u32(&cursor);
+        uint32_t sylls = sigma_read_u32(&cursor);
+        uint64_t total;
+        memcpy(&total, cursor, sizeof(total));
+        cursor += sizeof(total);
+        uint32_t blob = sigma_read_u32(&cursor);
+        const uint8_t *counts = cursor + 2U * count * sizeof(uint32_t);
+        uint64_t sum = 0U;
+        for (uint32_t t = 0U; t < count; ++t) {
+            uint32_t seen = sigma_read_u32(&counts);
+            assert(seen == expected);
+            sum += seen;
+        }
+        assert(total == sum);
+        tokens += count;
+        cursor += (7U * count + sylls) * sizeof(uint32_t) + blob;
+    }
+    return tokens;
+}
+
 static void test_sigma_learn_and_decode(void) {
     uintptr_t st = k_state_new(0);
     assert(st != 0U);
@@ -20,10 +54,11 @@ static void test_sigma_learn_and_decode(void) {
         assert(strstr((char *)buffer, "alpha") != NULL);
     }
 
-    assert(k_set_constraints(0.5f, 1.0f) == 0);
+    assert(k_state_set_constraints(st, 0.5f, 1.0f) == 0);
+    assert(k_state_set_constraints(st, 0.0f, 1.0f) == -1);
     produced = k_decode(st, NULL, 0U, buffer, sizeof(buffer), 0, 2);
     assert(produced >= 0);
-    k_set_constraints(1.0f, 3.0f);
+    k_state_set_constraints(st, 1.0f, 3.0f);
 
     assert(k_digit_add_syll(st, 0U, (const uint8_t *)"zo", 2U) == 0);
 
@@ -45,6 +80,285 @@ static void test_sigma_learn_and_decode(void) {
     k_state_free(st2);
 }
 
+static void test_sigma_many_tokens(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+
+    char text[16384];
+    size_t len = 0U;
+    for (int i = 0; i < 600; ++i) {
+        len += (size_t)snprintf(text + len, sizeof(text) - len, "w%d ", i % 300);
+    }
+    assert(k_observe(st, (const uint8_t *)text, len) == 0);
+
+    uint8_t *snapshot = malloc(65536);
+    uint8_t *again = malloc(65536);
+    assert(snapshot && again);
+    int snap = k_state_save(st, snapshot, 65536);
+    assert(snap > 0);
+
+    assert((size_t)snap == k_state_save_size(st));
+    assert(k_state_save(st, snapshot, (size_t)snap - 1U) < 0);
+    /* 300 distinct tokens, each stored once with a count of 2. */
+    assert(sigma_snapshot_tokens(snapshot, 2U) == 300U);
+
+    uintptr_t st2 = k_state_new(0);
+    assert(st2 != 0U);
+    assert(k_state_load(st2, snapshot, (size_t)snap) == 0);
+    assert(k_observe(st2, (const uint8_t *)"w7", 2U) == 0);
+    assert(k_observe(st, (const uint8_t *)"w7", 2U) == 0);
+    assert(k_state_save(st2, again, 65536) == snap);
+    assert(k_state_save(st, snapshot, 65536) == snap);
+    assert(memcmp(snapshot, again, (size_t)snap) == 0);
+
+    free(snapshot);
+    free(again);
+    k_state_free(st);
+    k_state_free(st2);
+}
+
+static int sigma_count_of(const char *word) {
+    int n = atoi(word + 1);
+    return n % 7 + 1;
+}
+
+static void test_sigma_ranked_decode(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    for (int round = 0; round < 7; ++round) {
+        for (int i = 0; i < 200; ++i) {
+            if (i % 7 + 1 <= round) continue;
+            char word[8];
+            int wlen = snprintf(word, sizeof(word), "w%d", i);
+            assert(k_observe(st, (const uint8_t *)word, (size_t)wlen) == 0);
+        }
+    }
+
+    assert(k_state_vote_mode(st, K_SIGMA_VOTE_GREEDY) == K_SIGMA_VOTE_RESONANT);
+    assert(k_state_set_constraints(st, 1000.0f, 1000.0f) == 0);
+    char first[4096];
+    int produced = k_decode(st, (const uint8_t *)"w5", 2U, (uint8_t *)first, sizeof(first), 0, 200);
+    assert(produced > 0);
+    first[produced] = '\0';
+
+    char copy[4096];
+    memcpy(copy, first, (size_t)produced + 1U);
+    int last = 8;
+    int words = 0;
+    for (char *word = strtok(copy, " "); word; word = strtok(NULL, " ")) {
+        assert(sigma_count_of(word) <= last);
+        last = sigma_count_of(word);
+        words++;
+    }
+    assert(words > 1);
+
+    uint8_t *snapshot = malloc(65536);
+    assert(snapshot);
+    int snap = k_state_save(st, snapshot, 65536);
+    assert(snap > 0);
+    uintptr_t st2 = k_state_new(0);
+    assert(st2 != 0U);
+    assert(k_state_load(st2, snapshot, (size_t)snap) == 0);
+    char second[4096];
+    assert(k_decode(st2, (const uint8_t *)"w5", 2U, (uint8_t *)second, sizeof(second), 0, 200) == produced);
+    second[produced] = '\0';
+    assert(strcmp(first, second) == 0);
+
+    free(snapshot);
+    k_state_free(st);
+    k_state_free(st2);
+}
+
+static void test_sigma_state_limits(void) {
+    uintptr_t wide = k_state_new(0);
+    uintptr_t narrow = k_state_new(0);
+    assert(wide != 0U && narrow != 0U);
+    const char *sample = "w1 w1 w1 w11 w11 w21 w31 w41 w51 w61";
+    assert(k_observe(wide, (const uint8_t *)sample, strlen(sample)) == 0);
+    assert(k_observe(narrow, (const uint8_t *)sample, strlen(sample)) == 0);
+    assert(k_state_set_constraints(wide, 100.0f, 100.0f) == 0);
+    assert(k_state_set_constraints(narrow, 0.1f, 1.0f) == 0);
+
+    /* Process defaults do not reach states that already exist. */
+    assert(k_set_constraints(0.01f, 0.01f) == 0);
+    assert(k_vote_mode(K_SIGMA_VOTE_COUNTERFACTUAL) == K_SIGMA_VOTE_RESONANT);
+
+    uint8_t a[256];
+    uint8_t b[256];
+    int wide_len = k_decode(wide, (const uint8_t *)"w1", 2U, a, sizeof(a), 0, 8);
+    int narrow_len = k_decode(narrow, (const uint8_t *)"w1", 2U, b, sizeof(b), 0, 8);
+    assert(wide_len >= 2 && narrow_len == 0);
+    a[wide_len] = '\0';
+    assert(strncmp((char *)a, "w1", 2U) == 0);
+
+    uintptr_t fresh = k_state_new(0);
+    assert(fresh != 0U);
+    assert(k_state_vote_mode(fresh, 99) == K_SIGMA_VOTE_COUNTERFACTUAL);
+    assert(k_state_vote_mode(fresh, K_SIGMA_VOTE_GREEDY) == K_SIGMA_VOTE_COUNTERFACTUAL);
+    k_set_constraints(1.0f, 3.0f);
+    k_vote_mode(K_SIGMA_VOTE_RESONANT);
+
+    k_state_free(wide);
+    k_state_free(narrow);
+    k_state_free(fresh);
+}
+
+#define SIGMA_WRITERS 4
+#define SIGMA_ROUNDS 20
+#define SIGMA_WORDS 200
+
+typedef struct {
+    uintptr_t state;
+    int writer;
+} SigmaJob;
+
+static void *sigma_writer(void *arg) {
+    const SigmaJob *job = arg;
+    char text[2048];
+    for (int round = 0; round < SIGMA_ROUNDS; ++round) {
+        size_t len = 0U;
+        for (int i = 0; i < SIGMA_WORDS; ++i) {
+            int w = (i + job->writer * 37 + round) % SIGMA_WORDS;
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "c%d ", w);
+        }
+        assert(k_observe(job->state, (const uint8_t *)text, len) == 0);
+    }
+    return NULL;
+}
+
+static void *sigma_reader(void *arg) {
+    const SigmaJob *job = arg;
+    uint8_t out[512];
+    for (int i = 0; i < 400; ++i) {
+        char prompt[8];
+        int plen = snprintf(prompt, sizeof(prompt), "c%d", i % SIGMA_WORDS);
+        assert(k_decode(job->state, (const uint8_t *)prompt, (size_t)plen, out, sizeof(out), 0, 4) >= 0);
+    }
+    return NULL;
+}
+
+static void test_sigma_concurrent(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    assert(k_state_set_concurrent(st, 1) == 0);
+
+    pthread_t threads[SIGMA_WRITERS + 2];
+    SigmaJob jobs[SIGMA_WRITERS + 2];
+    for (int t = 0; t < SIGMA_WRITERS + 2; ++t) {
+        jobs[t].state = st;
+        jobs[t].writer = t;
+        assert(pthread_create(&threads[t], NULL, t < SIGMA_WRITERS ? sigma_writer : sigma_reader, &jobs[t]) == 0);
+    }
+    for (int t = 0; t < SIGMA_WRITERS + 2; ++t) {
+        assert(pthread_join(threads[t], NULL) == 0);
+    }
+
+    uint8_t *snapshot = malloc(65536);
+    assert(snapshot);
+    int snap = k_state_save(st, snapshot, 65536);
+    assert(snap > 0);
+    assert(sigma_snapshot_tokens(snapshot, SIGMA_WRITERS * SIGMA_ROUNDS) == SIGMA_WORDS);
+
+    free(snapshot);
+    k_state_free(st);
+}
+
+static void test_sigma_v1_snapshot(void) {
+    /* v1 keeps each string inline: length, bytes, count. */
+    uint8_t snapshot[256];
+    uint8_t *at = snapshot;
+    const float breadth = 1.0f, depth = 3.0f;
+    const uint32_t version = 1U, vote = K_SIGMA_VOTE_GREEDY;
+    memcpy(at, "KSGM", 4);
+    memcpy(at + 4, &version, 4);
+    memcpy(at + 8, &breadth, 4);
+    memcpy(at + 12, &depth, 4);
+    memcpy(at + 16, &vote, 4);
+    at += 20;
+    for (int d = 0; d < 10; ++d) {
+        const uint32_t tokens = d == 0 ? 1U : 0U;
+        memcpy(at, &tokens, 4);
+        at += 4;
+        uint64_t total = 0U;
+        if (d == 0) {
+            const uint32_t len = 5U, count = 3U;
+            memcpy(at, &len, 4);
+            memcpy(at + 4, "alpha", 5);
+            memcpy(at + 9, &count, 4);
+            at += 13;
+            total = 3U;
+        }
+        const uint32_t sylls = 0U;
+        memcpy(at, &sylls, 4);
+        memcpy(at + 4, &total, 8);
+        at += 12;
+    }
+
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    assert(k_state_load(st, snapshot, (size_t)(at - snapshot)) == 0);
+    uint8_t out[64];
+    int produced = k_decode(st, NULL, 0U, out, sizeof(out), 0, 1);
+    assert(produced == 5 && memcmp(out, "alpha", 5) == 0);
+    k_state_free(st);
+}
+
+static void test_sigma_view(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    const char *sample = "gamma delta gamma epsilon gamma delta";
+    assert(k_observe(st, (const uint8_t *)sample, strlen(sample)) == 0);
+    assert(k_digit_add_syll(st, 3U, (const uint8_t *)"ra", 2U) == 0);
+    size_t size = k_state_save_size(st);
+    uint8_t *snapshot = malloc(size);
+    uint8_t *again = malloc(size);
+    assert(snapshot && again);
+    assert(k_state_save(st, snapshot, size) == (int)size);
+
+    uintptr_t view = k_state_view(snapshot, size);
+    assert(view != 0U);
+    assert(k_observe(view, (const uint8_t *)"gamma", 5U) == -3);
+    assert(k_digit_add_syll(view, 3U, (const uint8_t *)"ra", 2U) == -4);
+    assert(k_state_load(view, snapshot, size) == -6);
+    assert(k_state_save(view, again, size) == (int)size);
+    assert(memcmp(snapshot, again, size) == 0);
+
+    uint8_t a[128];
+    uint8_t b[128];
+    int from_state = k_decode(st, (const uint8_t *)"gamma", 5U, a, sizeof(a), 0, 3);
+    int from_view = k_decode(view, (const uint8_t *)"gamma", 5U, b, sizeof(b), 0, 3);
+    assert(from_state > 0 && from_state == from_view && memcmp(a, b, (size_t)from_state) == 0);
+    k_state_free(view);
+
+    char path[] = "/tmp/kolibri_sigma_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    FILE *file = fdopen(fd, "wb");
+    assert(file && fwrite(snapshot, 1U, size, file) == size);
+    fclose(file);
+    uintptr_t mapped = k_state_map(path);
+    assert(mapped != 0U);
+    from_view = k_decode(mapped, (const uint8_t *)"gamma", 5U, b, sizeof(b), 0, 3);
+    assert(from_view == from_state && memcmp(a, b, (size_t)from_state) == 0);
+    k_state_free(mapped);
+    remove(path);
+
+    /* A truncated snapshot is refused rather than read past its end. */
+    assert(k_state_view(snapshot, size - 3U) == 0U);
+    snapshot[4] = 9U;
+    assert(k_state_view(snapshot, size) == 0U);
+
+    free(snapshot);
+    free(again);
+    k_state_free(st);
+}
+
 void test_sigma(void) {
     test_sigma_learn_and_decode();
+    test_sigma_many_tokens();
+    test_sigma_ranked_decode();
+    test_sigma_state_limits();
+    test_sigma_concurrent();
+    test_sigma_v1_snapshot();
+    test_sigma_view();
 }
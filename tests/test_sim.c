@@ -1,7 +1,12 @@
 #include "kolibri/sim.h"
 
+#include "kolibri/genome.h"
+
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 void test_sim(void) {
     KolibriSimConfig cfg = {
@@ -27,7 +32,7 @@ void test_sim(void) {
     KolibriSimLog logs[8];
     size_t count = 0U;
     size_t offset = 0U;
-    if (kolibri_sim_get_logs(sim, logs, 8U, &count, &offset) != 0) {
+    if (kolibri_sim_get_logs(sim, 0U, logs, 8U, &count, &offset) != 0) {
         fprintf(stderr, "kolibri_sim_get_logs failed\n");
         kolibri_sim_destroy(sim);
         exit(1);
@@ -39,6 +44,24 @@ void test_sim(void) {
         exit(1);
     }
 
+    /* Pollers pass the offset after the last entry they saw and get only newer ones. */
+    size_t seen = offset + count;
+    while (kolibri_sim_get_logs(sim, seen, logs, 8U, &count, &offset) == 0 && count > 0U) {
+        seen = offset + count;
+    }
+    if (count != 0U || offset != seen) {
+        fprintf(stderr, "kolibri_sim_get_logs returned entries past the end\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+    if (kolibri_sim_tick(sim) != 0 ||
+        kolibri_sim_get_logs(sim, seen, logs, 8U, &count, &offset) != 0 ||
+        count == 0U || offset != seen) {
+        fprintf(stderr, "kolibri_sim_get_logs missed new entries\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+
     KolibriSimFormula formulas[8];
     size_t fcount = 0U;
     if (kolibri_sim_get_formulas(sim, formulas, 8U, &fcount) != 0) {
@@ -53,6 +76,112 @@ void test_sim(void) {
         exit(1);
     }
 
+    char profile[512];
+    if (kolibri_sim_get_profile_json(sim, profile, sizeof(profile)) != 0 ||
+        strstr(profile, "\"evaluations_per_sec\":") == NULL) {
+        fprintf(stderr, "kolibri_sim_get_profile_json failed\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+
     kolibri_sim_destroy(sim);
-}
 
+    /* A threaded batch evolves each member exactly like a standalone sim. */
+    KolibriSimBatch *batch = kolibri_sim_batch_create(&cfg, 3U, 2U);
+    if (!batch || kolibri_sim_batch_size(batch) != 3U || kolibri_sim_batch_threads(batch) != 2U) {
+        fprintf(stderr, "kolibri_sim_batch_create failed\n");
+        exit(1);
+    }
+    uint64_t tick_ns[3] = {0U, 0U, 0U};
+    for (int round = 0; round < 2; ++round) {
+        if (kolibri_sim_batch_tick(batch, tick_ns) != 0) {
+            fprintf(stderr, "kolibri_sim_batch_tick failed\n");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < 3U; ++i) {
+        KolibriSimConfig member = cfg;
+        member.seed = cfg.seed + (uint32_t)i;
+        KolibriSim *alone = kolibri_sim_create(&member);
+        if (!alone || kolibri_sim_tick(alone) != 0 || kolibri_sim_tick(alone) != 0) {
+            fprintf(stderr, "standalone sim failed\n");
+            exit(1);
+        }
+        KolibriSimFormula expected[8];
+        KolibriSimFormula actual[8];
+        size_t expected_count = 0U;
+        size_t actual_count = 0U;
+        kolibri_sim_get_formulas(alone, expected, 8U, &expected_count);
+        kolibri_sim_get_formulas(kolibri_sim_batch_get(batch, i), actual, 8U, &actual_count);
+        if (tick_ns[i] == 0U || actual_count != expected_count ||
+            kolibri_sim_evaluations(alone) != kolibri_sim_evaluations(kolibri_sim_batch_get(batch, i))) {
+            fprintf(stderr, "batch member %zu diverged\n", i);
+            exit(1);
+        }
+        for (size_t f = 0; f < actual_count; ++f) {
+            if (actual[f].fitness != expected[f].fitness) {
+                fprintf(stderr, "batch member %zu diverged\n", i);
+                exit(1);
+            }
+        }
+        kolibri_sim_destroy(alone);
+    }
+    kolibri_sim_batch_destroy(batch);
+
+    /* Ticks land in the genome chain and, with their blocks, in the trace. */
+    char trace_path[] = "/tmp/kolibri_sim_traceXXXXXX";
+    char genome_path[] = "/tmp/kolibri_sim_genomeXXXXXX";
+    int trace_fd = mkstemp(trace_path);
+    int genome_fd = mkstemp(genome_path);
+    if (trace_fd < 0 || genome_fd < 0) {
+        fprintf(stderr, "mkstemp failed\n");
+        exit(1);
+    }
+    close(trace_fd);
+    close(genome_fd);
+    KolibriSimConfig traced = cfg;
+    traced.trace_path = trace_path;
+    traced.trace_include_genome = 1;
+    traced.genome_path = genome_path;
+    KolibriSim *recorder = kolibri_sim_create(&traced);
+    if (!recorder) {
+        fprintf(stderr, "kolibri_sim_create with trace failed\n");
+        exit(1);
+    }
+    for (int tick = 0; tick < 3; ++tick) {
+        if (kolibri_sim_tick(recorder) != 0) {
+            fprintf(stderr, "kolibri_sim_tick with trace failed\n");
+            exit(1);
+        }
+    }
+    KolibriSimGenomeBlock blocks[8];
+    size_t block_count = 0U;
+    if (kolibri_sim_get_genome(recorder, blocks, 8U, &block_count) != 0 || block_count != 3U ||
+        blocks[2].index != 2U || strcmp(blocks[1].pred_hash, blocks[0].result_hash) != 0 ||
+        blocks[0].payload_dec[0] == '\0') {
+        fprintf(stderr, "kolibri_sim_get_genome returned no chain\n");
+        exit(1);
+    }
+    kolibri_sim_destroy(recorder);
+    if (kg_verify_file(genome_path, (const unsigned char *)cfg.hmac_key, strlen(cfg.hmac_key)) != 0) {
+        fprintf(stderr, "sim genome does not verify\n");
+        exit(1);
+    }
+    FILE *trace = fopen(trace_path, "r");
+    char line[1024];
+    size_t ticks = 0U;
+    size_t genome_lines = 0U;
+    while (trace && fgets(line, sizeof(line), trace)) {
+        ticks += strstr(line, "{\"tip\":\"tick\"") == line;
+        genome_lines += strstr(line, "{\"tip\":\"genome\"") == line;
+    }
+    if (trace) {
+        fclose(trace);
+    }
+    if (ticks != 3U || genome_lines != 3U) {
+        fprintf(stderr, "sim trace misses records\n");
+        exit(1);
+    }
+    unlink(trace_path);
+    unlink(genome_path);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/trace.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void trace_scoped_work(void) {
+    KOLIBRI_TRACE_SCOPE("test.scope");
+}
+
+static void *trace_worker_main(void *arg) {
+    (void)arg;
+    for (int i = 0; i < 3; ++i) {
+        trace_scoped_work();
+    }
+    return NULL;
+}
+
+static char *trace_export(void) {
+    FILE *file = tmpfile();
+    assert(file);
+    assert(kolibri_trace_write_json(file) == 0);
+    long size = ftell(file);
+    assert(size > 0);
+    rewind(file);
+    char *text = (char *)malloc((size_t)size + 1U);
+    assert(text);
+    size_t read = fread(text, 1U, (size_t)size, file);
+    text[read] = '\0';
+    fclose(file);
+    return text;
+}
+
+static size_t trace_occurrences(const char *text, const char *needle) {
+    size_t count = 0U;
+    for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) {
+        count++;
+    }
+    return count;
+}
+
+void test_trace(void) {
+    assert(kolibri_trace_start(8U) == 0);
+    trace_scoped_work();
+    uint64_t start = kolibri_trace_now_ns();
+    kolibri_trace_complete("test.\"quoted\"", start, start + 2500U);
+
+    pthread_t worker;
+    assert(pthread_create(&worker, NULL, trace_worker_main, NULL) == 0);
+    pthread_join(worker, NULL);
+    assert(kolibri_trace_span_count() == 5U);
+    assert(kolibri_trace_dropped() == 0U);
+
+    char *json = trace_export();
+    assert(strncmp(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) == 0);
+    assert(trace_occurrences(json, "\"name\":\"test.scope\",\"ph\":\"X\"") == 4U);
+    assert(strstr(json, "\"name\":\"test.\\\"quoted\\\"\",\"ph\":\"X\""));
+    assert(strstr(json, "\"dur\":2.500}"));
+    assert(trace_occurrences(json, "\"thread_name\"") == 2U);
+    free(json);
+
+    // Полное кольцо вытесняет старейшие спаны
+    for (int i = 0; i < 10; ++i) {
+        trace_scoped_work();
+    }
+    assert(kolibri_trace_span_count() == 8U + 3U);
+    assert(kolibri_trace_dropped() == 4U);
+
+    // Остановленная трассировка ничего не пишет, новый запуск начинает с нуля
+    kolibri_trace_stop();
+    trace_scoped_work();
+    assert(kolibri_trace_span_count() == 11U);
+    assert(kolibri_trace_start(0U) == 0);
+    assert(kolibri_trace_span_count() == 0U);
+    kolibri_trace_stop();
+}
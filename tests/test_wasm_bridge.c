@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2025 Кочуров Владислав Евгеньевич
+ */
+
+#include "kolibri/wasm_bridge.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const bridge_teach =
+    "начало:\n"
+    "    обучить связь \"7\" -> \"49\"\n"
+    "    создать формулу ответ из \"ассоциация\"\n"
+    "    вызвать эволюцию\n"
+    "    оценить ответ на задаче \"7\"\n"
+    "    показать итог\n"
+    "конец.\n";
+
+static const char *const bridge_ask =
+    "начало:\n"
+    "    создать формулу ответ из \"ассоциация\"\n"
+    "    оценить ответ на задаче \"7\"\n"
+    "    показать итог\n"
+    "конец.\n";
+
+void test_wasm_bridge(void) {
+    char out[1024];
+    uint32_t warm = kolibri_bridge_new();
+    uint32_t cold = kolibri_bridge_new();
+    assert(warm != 0u && cold != 0u && warm != cold);
+
+    int written = kolibri_bridge_execute_handle(warm, bridge_teach, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") != NULL);
+
+    // Связь живёт в пуле: сброс сценария её сохраняет, соседний контекст её не видит
+    int status = kolibri_bridge_reset_script_handle(warm);
+    assert(status == 0);
+    written = kolibri_bridge_execute_handle(warm, bridge_ask, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") != NULL);
+    written = kolibri_bridge_execute_handle(cold, bridge_ask, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") == NULL);
+
+    // Полный сброс пересевает пул
+    status = kolibri_bridge_reset_handle(warm);
+    assert(status == 0);
+    written = kolibri_bridge_execute_handle(warm, bridge_ask, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") == NULL);
+
+    // Освобождённый дескриптор не оживает, даже когда его слот занят снова
+    kolibri_bridge_free(warm);
+    written = kolibri_bridge_execute_handle(warm, bridge_ask, out, sizeof(out));
+    assert(written == -1);
+    uint32_t reused = kolibri_bridge_new();
+    assert(reused != 0u && reused != warm);
+    status = kolibri_bridge_reset_script_handle(warm);
+    assert(status == -1);
+
+    written = kolibri_bridge_execute(bridge_teach, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") != NULL);
+    status = kolibri_bridge_reset_script();
+    assert(status == 0);
+    written = kolibri_bridge_execute_handle(kolibri_bridge_handle(), bridge_ask, out, sizeof(out));
+    assert(written > 0 && strstr(out, "49") != NULL);
+
+    kolibri_bridge_free(reused);
+    kolibri_bridge_free(cold);
+    kolibri_bridge_free(kolibri_bridge_handle());
+}
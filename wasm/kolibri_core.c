@@ -11,17 +11,24 @@
 #define alignof(type) __alignof__(type)
 #endif
 
+#if defined(KOLIBRI_USE_WASM_SIMD) && defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define K_SIMD 1
+#endif
+
 #ifndef EMSCRIPTEN_KEEPALIVE
 #define EMSCRIPTEN_KEEPALIVE __attribute__((used))
 #endif
 
 #define K_DIGIT_COUNT 10
+#define K_DIGIT_LANES 12 /* K_DIGIT_COUNT rounded up to whole f32x4 vectors */
 #define K_MAX_LEVELS 4
 #define K_VM_STACK_MAX 32
 #define K_VM_PROGRAM_MAX 64
+#define K_VM_LANES 16
 #define K_WINDOW 128
 #define K_MAX_TOKEN 128
-#define K_SAVE_VERSION 1u
+#define K_SAVE_VERSION 2u /* 1 lacks the graphs and sketches and still loads */
 #define K_PAGE_SIZE 4096u
 #define K_DEFAULT_B_LIMIT 240.0
 #define K_DEFAULT_D_LIMIT 160.0
@@ -31,96 +38,171 @@
 
 /* -------------------------- Bump arena allocator -------------------------- */
 
-typedef struct KArenaPage {
-    uint8_t *data;
-    size_t capacity;
-    size_t offset;
-    struct KArenaPage *next;
-} KArenaPage;
-
+/*
+ * One contiguous block that grows by half when full. Blocks are addressed by
+ * 32-bit offsets, which stay valid across growth; offset 0 is never handed out
+ * and serves as null. Past one wasm page the capacity is rounded to whole
+ * pages, so freed blocks come in few sizes and fit the next arena that grows.
+ */
 typedef struct {
-    KArenaPage *head;
-    KArenaPage *current;
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
     size_t page_size;
-    size_t fragmentation;
+    size_t fragmentation; /* bytes of blocks that were replaced by larger ones */
 } KArena;
 
-static KArenaPage *k_arena_page_create(size_t page_size) {
-    KArenaPage *page = (KArenaPage *)malloc(sizeof(KArenaPage));
-    if (!page) {
-        return NULL;
+#define K_WASM_PAGE 65536u
+#define K_ARENA_POOL_SLOTS 16u
+#define K_ARENA_POOL_BYTES (16u * 1024u * 1024u)
+
+/*
+ * Blocks of disposed or outgrown arenas, shared by all arenas. Linear memory
+ * never shrinks, so handing them to the next arena beats growing the heap.
+ */
+typedef struct {
+    uint8_t *data;
+    uint32_t capacity;
+} KArenaBlock;
+
+static KArenaBlock g_arena_pool[K_ARENA_POOL_SLOTS];
+static size_t g_arena_pool_count = 0u;
+static size_t g_arena_pool_bytes = 0u;
+
+static void k_arena_pool_put(uint8_t *data, uint32_t capacity) {
+    if (!data) {
+        return;
+    }
+    if (g_arena_pool_count == K_ARENA_POOL_SLOTS || g_arena_pool_bytes + capacity > K_ARENA_POOL_BYTES) {
+        free(data);
+        return;
     }
-    page->data = (uint8_t *)malloc(page_size);
-    if (!page->data) {
-        free(page);
+    g_arena_pool[g_arena_pool_count].data = data;
+    g_arena_pool[g_arena_pool_count].capacity = capacity;
+    g_arena_pool_count++;
+    g_arena_pool_bytes += capacity;
+}
+
+/* Smallest pooled block of at least need bytes whose size is no larger than capacity. */
+static uint8_t *k_arena_pool_take(size_t need, size_t capacity, uint32_t *taken) {
+    size_t best = g_arena_pool_count;
+    for (size_t i = 0; i < g_arena_pool_count; ++i) {
+        uint32_t size = g_arena_pool[i].capacity;
+        if (size >= need && size <= capacity &&
+            (best == g_arena_pool_count || size < g_arena_pool[best].capacity)) {
+            best = i;
+        }
+    }
+    if (best == g_arena_pool_count) {
         return NULL;
     }
-    page->capacity = page_size;
-    page->offset = 0u;
-    page->next = NULL;
-    return page;
+    uint8_t *data = g_arena_pool[best].data;
+    *taken = g_arena_pool[best].capacity;
+    g_arena_pool_bytes -= *taken;
+    g_arena_pool[best] = g_arena_pool[--g_arena_pool_count];
+    return data;
+}
+
+static size_t k_arena_capacity_for(size_t current, size_t page_size, size_t need) {
+    size_t capacity = current ? current : page_size;
+    while (capacity < need) {
+        capacity += capacity / 2u;
+    }
+    if (capacity > K_WASM_PAGE) {
+        capacity = (capacity + K_WASM_PAGE - 1u) & ~(size_t)(K_WASM_PAGE - 1u);
+    }
+    return capacity > UINT32_MAX ? UINT32_MAX : capacity;
+}
+
+/* Moves the contents to a block of at least need bytes, pooled if one fits. */
+static int k_arena_grow(KArena *arena, size_t need) {
+    size_t capacity = k_arena_capacity_for(arena->capacity, arena->page_size, need);
+    uint32_t taken = 0u;
+    uint8_t *data = k_arena_pool_take(need, capacity, &taken);
+    if (data) {
+        if (arena->size) {
+            memcpy(data, arena->data, arena->size);
+        }
+        k_arena_pool_put(arena->data, arena->capacity);
+        capacity = taken;
+    } else {
+        data = (uint8_t *)realloc(arena->data, capacity);
+        if (!data) {
+            return -1;
+        }
+    }
+    arena->data = data;
+    arena->capacity = (uint32_t)capacity;
+    return 0;
 }
 
 static void k_arena_init(KArena *arena, size_t page_size) {
-    arena->head = NULL;
-    arena->current = NULL;
+    arena->data = NULL;
+    arena->size = 0u;
+    arena->capacity = 0u;
     arena->page_size = page_size ? page_size : K_PAGE_SIZE;
     arena->fragmentation = 0u;
 }
 
 static void k_arena_dispose(KArena *arena) {
-    KArenaPage *page = arena->head;
-    while (page) {
-        KArenaPage *next = page->next;
-        free(page->data);
-        free(page);
-        page = next;
-    }
-    arena->head = NULL;
-    arena->current = NULL;
+    k_arena_pool_put(arena->data, arena->capacity);
+    arena->data = NULL;
+    arena->size = 0u;
+    arena->capacity = 0u;
     arena->fragmentation = 0u;
 }
 
-static void k_arena_reset(KArena *arena) {
-    KArenaPage *page = arena->head;
-    while (page) {
-        page->offset = 0u;
-        page = page->next;
+/*
+ * Scoped allocation: everything allocated after k_arena_mark is released by
+ * k_arena_rewind to that mark, keeping the block for the next allocations.
+ */
+static uint32_t k_arena_mark(const KArena *arena) {
+    return arena->size;
+}
+
+static void k_arena_rewind(KArena *arena, uint32_t mark) {
+    if (mark < arena->size) {
+        arena->size = mark;
     }
-    arena->current = arena->head;
 }
 
-static void *k_arena_alloc(KArena *arena, size_t size, size_t alignment) {
+static void k_arena_reset(KArena *arena) {
+    k_arena_rewind(arena, 0u);
+    arena->fragmentation = 0u;
+}
+
+static uint32_t k_arena_alloc(KArena *arena, size_t size, size_t alignment) {
     if (alignment == 0u) {
-        alignment = sizeof(void *);
+        alignment = sizeof(uint64_t);
     }
-    if (!arena->current) {
-        arena->head = k_arena_page_create(arena->page_size);
-        arena->current = arena->head;
-        if (!arena->current) {
-            return NULL;
-        }
+    size_t offset = arena->size ? arena->size : alignment;
+    offset = (offset + alignment - 1u) & ~(alignment - 1u);
+    if (size > UINT32_MAX - offset) {
+        return 0u;
     }
-
-    KArenaPage *page = arena->current;
-    size_t aligned_offset = (page->offset + alignment - 1u) & ~(alignment - 1u);
-    if (aligned_offset + size > page->capacity) {
-        arena->fragmentation += (uint32_t)(page->capacity - page->offset);
-        if (!page->next) {
-            page->next = k_arena_page_create(arena->page_size);
-            if (!page->next) {
-                return NULL;
-            }
-        }
-        arena->current = page->next;
-        page = arena->current;
-        page->offset = 0u;
-        aligned_offset = 0u;
+    size_t need = offset + size;
+    if (need > arena->capacity && k_arena_grow(arena, need) != 0) {
+        return 0u;
     }
+    /* Zeroed, padding included, so snapshots of equal graphs are equal. */
+    memset(arena->data + arena->size, 0, need - arena->size);
+    arena->size = (uint32_t)need;
+    return (uint32_t)offset;
+}
+
+static void *k_arena_at(const KArena *arena, uint32_t offset) {
+    return arena->data + offset;
+}
 
-    void *ptr = page->data + aligned_offset;
-    page->offset = aligned_offset + size;
-    return ptr;
+/* Replaces the contents with size bytes saved from another arena. */
+static int k_arena_restore(KArena *arena, const uint8_t *image, uint32_t size) {
+    arena->size = 0u;
+    if (size > arena->capacity && k_arena_grow(arena, size) != 0) {
+        return -1;
+    }
+    memcpy(arena->data, image, size);
+    arena->size = size;
+    return 0;
 }
 
 /* -------------------------- Reversible sketches -------------------------- */
@@ -181,59 +263,132 @@ static uint32_t k_random_u32(uint64_t *state, uint32_t bound) {
 
 /* --------------------------- Directed acyclic DAWG ------------------------ */
 
-typedef struct KDaawgNode KDaawgNode;
+/* Nodes and edges refer to each other by arena offset; 0 is null. */
+typedef uint32_t KDaawgRef;
 
+#define K_DAAWG_FREQ_SHIFT 8u
+#define K_DAAWG_FREQ_MAX (UINT32_MAX >> K_DAAWG_FREQ_SHIFT)
+#define K_DAAWG_CAPACITY_MASK 0x0fu
+#define K_DAAWG_ATTRACTOR 0x80u
+#define K_DAAWG_LINEAR_FANOUT 8u
+#define K_DAAWG_DIRECT_FANOUT 32u
+#define K_DAAWG_DIRECT_SYMBOLS 256u
+#define K_DAAWG_DEDUPE_INITIAL 1024u
+
+/* The symbol byte and a frequency that saturates at K_DAAWG_FREQ_MAX. */
 typedef struct {
-    uint32_t symbol;
-    uint32_t frequency;
-    uint8_t flags;
-    uint8_t padding[3];
-    KDaawgNode *target;
+    KDaawgRef target;
+    uint32_t packed;
 } KDaawgEdge;
 
-struct KDaawgNode {
-    uint32_t id;
-    uint32_t depth;
+/*
+ * children points at a block of child_capacity edges in insertion order, then
+ * as many uint16_t child positions sorted by symbol (valid for the first
+ * `indexed` children) and, once the capacity exceeds K_DAAWG_DIRECT_FANOUT, a
+ * table of position + 1 per symbol byte.
+ */
+typedef struct {
+    uint64_t sketch;
     uint32_t frequency;
-    uint32_t signature;
+    KDaawgRef children;
     uint16_t child_count;
-    uint16_t child_capacity;
-    uint8_t is_attractor;
+    uint16_t indexed;
+    uint16_t depth; /* saturates at UINT16_MAX */
     uint8_t boundary_flags;
-    uint8_t reserved[2];
-    KDaawgEdge *children;
-    uint64_t sketch;
-};
+    uint8_t shape; /* log2 of the child capacity, K_DAAWG_ATTRACTOR */
+} KDaawgNode;
 
+/* distance is the probe length from the home bucket; an empty bucket has no node. */
 typedef struct {
     uint64_t signature;
-    KDaawgNode *node;
+    KDaawgRef node;
+    uint32_t distance;
 } KDaawgBucket;
 
+typedef struct {
+    uint64_t lookups;
+    uint64_t probes;
+    uint32_t max_probe;
+    uint32_t grows;
+    uint64_t merged;
+    uint64_t pruned;
+} KDaawgDedupeStats;
+
 typedef struct {
     KArena arena;
-    KDaawgNode *root;
+    KDaawgRef root;
     KDaawgBucket *dedupe;
     size_t dedupe_capacity;
+    size_t dedupe_count;
+    KDaawgDedupeStats dedupe_stats;
     size_t node_count;
     size_t edge_count;
 } KDaawg;
 
-static uint64_t k_daawg_signature(const KDaawgNode *node) {
+static KDaawgNode *k_daawg_node(const KDaawg *graph, KDaawgRef ref) {
+    return ref ? (KDaawgNode *)k_arena_at(&graph->arena, ref) : NULL;
+}
+
+static uint32_t k_daawg_capacity(const KDaawgNode *node) {
+    uint32_t log2 = node->shape & K_DAAWG_CAPACITY_MASK;
+    return log2 ? 1u << log2 : 0u;
+}
+
+static KDaawgEdge *k_daawg_edges(const KDaawg *graph, const KDaawgNode *node) {
+    return (KDaawgEdge *)k_arena_at(&graph->arena, node->children);
+}
+
+static uint16_t *k_daawg_order(const KDaawg *graph, const KDaawgNode *node) {
+    return (uint16_t *)(k_daawg_edges(graph, node) + k_daawg_capacity(node));
+}
+
+static uint16_t *k_daawg_direct(const KDaawg *graph, const KDaawgNode *node) {
+    uint32_t capacity = k_daawg_capacity(node);
+    return capacity > K_DAAWG_DIRECT_FANOUT ? k_daawg_order(graph, node) + capacity : NULL;
+}
+
+static size_t k_daawg_block_size(uint32_t capacity) {
+    size_t bytes = (size_t)capacity * (sizeof(KDaawgEdge) + sizeof(uint16_t));
+    return capacity > K_DAAWG_DIRECT_FANOUT ? bytes + K_DAAWG_DIRECT_SYMBOLS * sizeof(uint16_t) : bytes;
+}
+
+static uint32_t k_daawg_edge_symbol(const KDaawgEdge *edge) {
+    return edge->packed & ((1u << K_DAAWG_FREQ_SHIFT) - 1u);
+}
+
+static uint32_t k_daawg_edge_frequency(const KDaawgEdge *edge) {
+    return edge->packed >> K_DAAWG_FREQ_SHIFT;
+}
+
+static void k_daawg_edge_hit(KDaawgEdge *edge) {
+    if (k_daawg_edge_frequency(edge) < K_DAAWG_FREQ_MAX) {
+        edge->packed += 1u << K_DAAWG_FREQ_SHIFT;
+    }
+}
+
+static bool k_daawg_is_attractor(const KDaawgNode *node) {
+    return (node->shape & K_DAAWG_ATTRACTOR) != 0u;
+}
+
+static uint64_t k_daawg_signature(const KDaawg *graph, const KDaawgNode *node) {
     uint64_t sig = ((uint64_t)node->frequency << 32u) ^ (uint64_t)node->child_count;
+    const KDaawgEdge *edges = k_daawg_edges(graph, node);
     for (uint16_t i = 0; i < node->child_count; ++i) {
-        const KDaawgEdge *edge = &node->children[i];
-        sig = k_sketch_compose(sig ^ (edge->symbol * 0x9e3779b1u), edge->target ? edge->target->sketch : 0u);
-        sig ^= ((uint64_t)edge->frequency << (i & 31u));
+        const KDaawgEdge *edge = &edges[i];
+        const KDaawgNode *target = k_daawg_node(graph, edge->target);
+        sig = k_sketch_compose(sig ^ (k_daawg_edge_symbol(edge) * 0x9e3779b1u), target ? target->sketch : 0u);
+        sig ^= ((uint64_t)k_daawg_edge_frequency(edge) << (i & 31u));
     }
     return sig;
 }
 
 static void k_daawg_init(KDaawg *graph) {
     k_arena_init(&graph->arena, K_PAGE_SIZE);
-    graph->root = NULL;
+    graph->root = 0u;
     graph->dedupe = NULL;
     graph->dedupe_capacity = 0u;
+    graph->dedupe_count = 0u;
+    memset(&graph->dedupe_stats, 0, sizeof(graph->dedupe_stats));
     graph->node_count = 0u;
     graph->edge_count = 0u;
 }
@@ -244,155 +399,312 @@ static void k_daawg_dispose(KDaawg *graph) {
         graph->dedupe = NULL;
     }
     k_arena_dispose(&graph->arena);
-    graph->root = NULL;
+    graph->root = 0u;
     graph->dedupe_capacity = 0u;
+    graph->dedupe_count = 0u;
+    memset(&graph->dedupe_stats, 0, sizeof(graph->dedupe_stats));
     graph->node_count = 0u;
     graph->edge_count = 0u;
 }
 
-static KDaawgNode *k_daawg_new_node(KDaawg *graph, uint32_t depth) {
-    KDaawgNode *node = (KDaawgNode *)k_arena_alloc(&graph->arena, sizeof(KDaawgNode), alignof(KDaawgNode));
-    if (!node) {
-        return NULL;
+static KDaawgRef k_daawg_new_node(KDaawg *graph, uint32_t depth) {
+    KDaawgRef ref = k_arena_alloc(&graph->arena, sizeof(KDaawgNode), alignof(KDaawgNode));
+    if (!ref) {
+        return 0u;
     }
-    node->id = (uint32_t)graph->node_count++;
-    node->depth = depth;
-    node->frequency = 0u;
-    node->signature = 0u;
-    node->child_count = 0u;
-    node->child_capacity = 0u;
-    node->is_attractor = 0u;
-    node->boundary_flags = 0u;
-    node->children = NULL;
-    node->sketch = 0u;
-    return node;
+    graph->node_count++;
+    KDaawgNode *node = k_daawg_node(graph, ref);
+    memset(node, 0, sizeof(*node));
+    node->depth = (uint16_t)(depth < UINT16_MAX ? depth : UINT16_MAX);
+    return ref;
 }
 
-static bool k_daawg_nodes_equivalent(const KDaawgNode *lhs, const KDaawgNode *rhs) {
+static bool k_daawg_nodes_equivalent(const KDaawg *graph, const KDaawgNode *lhs, const KDaawgNode *rhs) {
     if (lhs->frequency != rhs->frequency || lhs->child_count != rhs->child_count) {
         return false;
     }
-    if (lhs->is_attractor != rhs->is_attractor || lhs->boundary_flags != rhs->boundary_flags) {
+    if (k_daawg_is_attractor(lhs) != k_daawg_is_attractor(rhs) || lhs->boundary_flags != rhs->boundary_flags) {
         return false;
     }
+    const KDaawgEdge *left = k_daawg_edges(graph, lhs);
+    const KDaawgEdge *right = k_daawg_edges(graph, rhs);
     for (uint16_t i = 0; i < lhs->child_count; ++i) {
-        const KDaawgEdge *le = &lhs->children[i];
-        const KDaawgEdge *re = &rhs->children[i];
-        if (le->symbol != re->symbol || le->frequency != re->frequency || le->flags != re->flags) {
-            return false;
-        }
-        if (le->target != re->target) {
+        if (left[i].packed != right[i].packed || left[i].target != right[i].target) {
             return false;
         }
     }
     return true;
 }
 
-static KDaawgNode *k_daawg_dedupe(KDaawg *graph, KDaawgNode *node) {
-    if (!graph->dedupe) {
-        graph->dedupe_capacity = 1024u;
-        graph->dedupe = (KDaawgBucket *)calloc(graph->dedupe_capacity, sizeof(KDaawgBucket));
-        if (!graph->dedupe) {
-            return node;
+/*
+ * Dedupe table: Robin Hood probing over a power-of-two bucket array that
+ * doubles at 0.7 load. Nodes keep changing after they are registered, so a
+ * bucket whose node no longer has its stored signature can never match again
+ * (equivalent nodes have equal signatures); lookups drop such buckets with a
+ * backward shift, which keeps the table free of tombstones.
+ */
+static size_t k_daawg_bucket_home(uint64_t signature, size_t mask) {
+    uint64_t h = signature ^ (signature >> 31u);
+    h *= 0x9e3779b97f4a7c15ull;
+    return (size_t)(h ^ (h >> 29u)) & mask;
+}
+
+static void k_daawg_bucket_place(KDaawgBucket *table, size_t mask, KDaawgBucket entry, size_t index) {
+    for (;;) {
+        KDaawgBucket *bucket = &table[index];
+        if (!bucket->node) {
+            *bucket = entry;
+            return;
+        }
+        if (bucket->distance < entry.distance) {
+            KDaawgBucket displaced = *bucket;
+            *bucket = entry;
+            entry = displaced;
+        }
+        index = (index + 1u) & mask;
+        entry.distance += 1u;
+    }
+}
+
+static void k_daawg_bucket_remove(KDaawg *graph, size_t index) {
+    size_t mask = graph->dedupe_capacity - 1u;
+    size_t next = (index + 1u) & mask;
+    while (graph->dedupe[next].node && graph->dedupe[next].distance > 0u) {
+        graph->dedupe[index] = graph->dedupe[next];
+        graph->dedupe[index].distance -= 1u;
+        index = next;
+        next = (next + 1u) & mask;
+    }
+    memset(&graph->dedupe[index], 0, sizeof(KDaawgBucket));
+    graph->dedupe_count -= 1u;
+}
+
+static int k_daawg_dedupe_grow(KDaawg *graph) {
+    size_t capacity = graph->dedupe_capacity ? graph->dedupe_capacity * 2u : K_DAAWG_DEDUPE_INITIAL;
+    KDaawgBucket *table = (KDaawgBucket *)calloc(capacity, sizeof(KDaawgBucket));
+    if (!table) {
+        return -1;
+    }
+    size_t mask = capacity - 1u;
+    for (size_t i = 0; i < graph->dedupe_capacity; ++i) {
+        KDaawgBucket entry = graph->dedupe[i];
+        if (entry.node) {
+            entry.distance = 0u;
+            k_daawg_bucket_place(table, mask, entry, k_daawg_bucket_home(entry.signature, mask));
         }
     }
+    if (graph->dedupe) {
+        graph->dedupe_stats.grows += 1u;
+    }
+    free(graph->dedupe);
+    graph->dedupe = table;
+    graph->dedupe_capacity = capacity;
+    return 0;
+}
+
+static KDaawgRef k_daawg_dedupe(KDaawg *graph, KDaawgRef ref) {
+    if ((graph->dedupe_count + 1u) * 10u > graph->dedupe_capacity * 7u && k_daawg_dedupe_grow(graph) != 0) {
+        return ref;
+    }
 
-    uint64_t signature = k_daawg_signature(node);
-    node->signature = (uint32_t)(signature & 0xffffffffu);
+    const KDaawgNode *node = k_daawg_node(graph, ref);
+    uint64_t signature = k_daawg_signature(graph, node);
     size_t mask = graph->dedupe_capacity - 1u;
-    size_t index = (size_t)(signature & mask);
+    size_t index = k_daawg_bucket_home(signature, mask);
+    uint32_t distance = 0u;
+    KDaawgDedupeStats *stats = &graph->dedupe_stats;
+    stats->lookups += 1u;
     for (;;) {
         KDaawgBucket *bucket = &graph->dedupe[index];
-        if (!bucket->node) {
-            bucket->node = node;
-            bucket->signature = signature;
-            return node;
+        stats->probes += 1u;
+        if (!bucket->node || bucket->distance < distance) {
+            break;
         }
-        if (bucket->signature == signature && k_daawg_nodes_equivalent(bucket->node, node)) {
-            return bucket->node;
+        if (bucket->signature == signature) {
+            const KDaawgNode *candidate = k_daawg_node(graph, bucket->node);
+            if (k_daawg_nodes_equivalent(graph, candidate, node)) {
+                stats->merged += 1u;
+                return bucket->node;
+            }
+            if (k_daawg_signature(graph, candidate) != bucket->signature) {
+                /* The next bucket moves into this one, so probe it again. */
+                k_daawg_bucket_remove(graph, index);
+                stats->pruned += 1u;
+                continue;
+            }
         }
         index = (index + 1u) & mask;
+        distance += 1u;
+    }
+    if (distance > stats->max_probe) {
+        stats->max_probe = distance;
     }
+    KDaawgBucket entry = { signature, ref, distance };
+    k_daawg_bucket_place(graph->dedupe, mask, entry, index);
+    graph->dedupe_count += 1u;
+    return ref;
 }
 
-static int k_daawg_reserve_children(KDaawgNode *node, KArena *arena, uint16_t capacity) {
-    if (node->child_capacity >= capacity) {
-        return 0;
-    }
-    KDaawgEdge *next = (KDaawgEdge *)k_arena_alloc(arena, sizeof(KDaawgEdge) * capacity, alignof(KDaawgEdge));
-    if (!next) {
+/* Moves the children to a block for 2^log2 edges, keeping the index prefix. */
+/*
+ * A block at the end of the arena grows in place: rewinding to it and
+ * allocating again returns the same offset with the edges where they were.
+ */
+static int k_daawg_reserve_children(KDaawg *graph, KDaawgRef ref, uint32_t log2) {
+    uint32_t capacity = 1u << log2;
+    const KDaawgNode *current = k_daawg_node(graph, ref);
+    uint32_t mark = k_arena_mark(&graph->arena);
+    bool in_place = current->children &&
+                    current->children + k_daawg_block_size(k_daawg_capacity(current)) == mark;
+    if (in_place) {
+        k_arena_rewind(&graph->arena, current->children);
+    }
+    KDaawgRef block = k_arena_alloc(&graph->arena, k_daawg_block_size(capacity), alignof(KDaawgEdge));
+    if (!block) {
+        if (in_place) {
+            graph->arena.size = mark;
+        }
         return -1;
     }
-    if (node->child_count) {
-        memcpy(next, node->children, sizeof(KDaawgEdge) * node->child_count);
+    KDaawgNode *node = k_daawg_node(graph, ref);
+    KDaawgNode moved = *node;
+    moved.children = block;
+    moved.shape = (uint8_t)((node->shape & ~K_DAAWG_CAPACITY_MASK) | log2);
+    KDaawgEdge *edges = k_daawg_edges(graph, &moved);
+    uint16_t *order = k_daawg_order(graph, &moved);
+    uint16_t *direct = k_daawg_direct(graph, &moved);
+    if (block == node->children) {
+        memmove(order, k_daawg_order(graph, node), sizeof(uint16_t) * node->indexed);
+    } else if (node->child_count) {
+        memcpy(edges, k_daawg_edges(graph, node), sizeof(KDaawgEdge) * node->child_count);
+        memcpy(order, k_daawg_order(graph, node), sizeof(uint16_t) * node->indexed);
+        graph->arena.fragmentation += k_daawg_block_size(k_daawg_capacity(node));
+    }
+    if (direct) {
+        memset(direct, 0, K_DAAWG_DIRECT_SYMBOLS * sizeof(uint16_t));
+        for (uint16_t i = 0; i < node->indexed; ++i) {
+            direct[k_daawg_edge_symbol(&edges[i])] = (uint16_t)(i + 1u);
+        }
     }
-    node->children = next;
-    node->child_capacity = capacity;
+    *node = moved;
     return 0;
 }
 
-static KDaawgEdge *k_daawg_get_child(KDaawgNode *node, uint32_t symbol) {
-    for (uint16_t i = 0; i < node->child_count; ++i) {
-        if (node->children[i].symbol == symbol) {
-            return &node->children[i];
+/* Brings the index up to date with children added since the last lookup. */
+static void k_daawg_index_children(const KDaawg *graph, KDaawgNode *node) {
+    const KDaawgEdge *edges = k_daawg_edges(graph, node);
+    uint16_t *order = k_daawg_order(graph, node);
+    uint16_t *direct = k_daawg_direct(graph, node);
+    for (uint16_t i = node->indexed; i < node->child_count; ++i) {
+        uint32_t symbol = k_daawg_edge_symbol(&edges[i]);
+        uint16_t pos = i;
+        while (pos > 0u && k_daawg_edge_symbol(&edges[order[pos - 1u]]) > symbol) {
+            order[pos] = order[pos - 1u];
+            --pos;
+        }
+        order[pos] = i;
+        if (direct) {
+            direct[symbol] = (uint16_t)(i + 1u);
         }
     }
-    return NULL;
+    node->indexed = node->child_count;
 }
 
-static KDaawgEdge *k_daawg_add_child(KDaawg *graph, KDaawgNode *node, uint32_t symbol) {
-    if (node->child_count == node->child_capacity) {
-        uint16_t next_capacity = node->child_capacity ? (uint16_t)(node->child_capacity * 2u) : 2u;
-        if (next_capacity < node->child_capacity) {
-            next_capacity = (uint16_t)(node->child_capacity + 4u);
+static KDaawgEdge *k_daawg_get_child(const KDaawg *graph, KDaawgNode *node, uint32_t symbol) {
+    KDaawgEdge *edges = k_daawg_edges(graph, node);
+    if (node->child_count <= K_DAAWG_LINEAR_FANOUT) {
+        for (uint16_t i = 0; i < node->child_count; ++i) {
+            if (k_daawg_edge_symbol(&edges[i]) == symbol) {
+                return &edges[i];
+            }
         }
-        if (k_daawg_reserve_children(node, &graph->arena, next_capacity) != 0) {
-            return NULL;
+        return NULL;
+    }
+    if (node->indexed != node->child_count) {
+        k_daawg_index_children(graph, node);
+    }
+    const uint16_t *direct = k_daawg_direct(graph, node);
+    if (direct) {
+        uint16_t slot = symbol < K_DAAWG_DIRECT_SYMBOLS ? direct[symbol] : 0u;
+        return slot ? &edges[slot - 1u] : NULL;
+    }
+    /* Branchless search for the last position whose symbol is <= symbol. */
+    const uint16_t *order = k_daawg_order(graph, node);
+    size_t lo = 0u;
+    size_t n = node->child_count;
+    while (n > 1u) {
+        size_t half = n >> 1u;
+        lo = k_daawg_edge_symbol(&edges[order[lo + half]]) <= symbol ? lo + half : lo;
+        n -= half;
+    }
+    KDaawgEdge *edge = &edges[order[lo]];
+    return k_daawg_edge_symbol(edge) == symbol ? edge : NULL;
+}
+
+/* Appends an edge without a target; returns its position or -1. */
+static int k_daawg_add_child(KDaawg *graph, KDaawgRef ref, uint32_t symbol) {
+    KDaawgNode *node = k_daawg_node(graph, ref);
+    if (node->child_count == k_daawg_capacity(node)) {
+        uint32_t log2 = (node->shape & K_DAAWG_CAPACITY_MASK) + 1u;
+        if (log2 > K_DAAWG_CAPACITY_MASK || k_daawg_reserve_children(graph, ref, log2) != 0) {
+            return -1;
         }
+        node = k_daawg_node(graph, ref);
     }
-    KDaawgEdge *edge = &node->children[node->child_count++];
-    edge->symbol = symbol;
-    edge->frequency = 0u;
-    edge->flags = 0u;
-    edge->target = NULL;
+    uint16_t slot = node->child_count++;
+    KDaawgEdge *edge = &k_daawg_edges(graph, node)[slot];
+    edge->target = 0u;
+    edge->packed = symbol & ((1u << K_DAAWG_FREQ_SHIFT) - 1u);
     graph->edge_count += 1u;
-    return edge;
+    return (int)slot;
 }
 
 static void k_daawg_update_attractor(KDaawgNode *node) {
-    node->is_attractor = (uint8_t)((node->frequency > 8u && node->child_count > 1u) ? 1u : 0u);
+    bool attractor = node->frequency > 8u && node->child_count > 1u;
+    node->shape = (uint8_t)((node->shape & ~K_DAAWG_ATTRACTOR) | (attractor ? K_DAAWG_ATTRACTOR : 0u));
 }
 
+/* Node pointers are fetched again after every allocation, which may move the arena. */
 static int k_daawg_insert(KDaawg *graph, const uint8_t *data, size_t len, uint32_t boundary_mask) {
     if (!graph->root) {
         graph->root = k_daawg_new_node(graph, 0u);
         if (!graph->root) {
             return -1;
         }
-        k_sketch_init((KSketch *)&graph->root->sketch, 0x1234u);
+        KSketch root_sketch;
+        k_sketch_init(&root_sketch, 0x1234u);
+        k_daawg_node(graph, graph->root)->sketch = root_sketch.state;
     }
 
-    KDaawgNode *node = graph->root;
+    KDaawgRef ref = graph->root;
+    KDaawgNode *node = k_daawg_node(graph, ref);
     node->frequency += 1u;
     k_daawg_update_attractor(node);
 
     for (size_t i = 0; i < len; ++i) {
         uint32_t symbol = (uint32_t)data[i];
-        KDaawgEdge *edge = k_daawg_get_child(node, symbol);
+        KDaawgEdge *edge = k_daawg_get_child(graph, node, symbol);
         if (!edge) {
-            edge = k_daawg_add_child(graph, node, symbol);
-            if (!edge) {
+            int slot = k_daawg_add_child(graph, ref, symbol);
+            if (slot < 0) {
                 return -1;
             }
-            KDaawgNode *child = k_daawg_new_node(graph, node->depth + 1u);
+            node = k_daawg_node(graph, ref);
+            uint32_t depth = (uint32_t)node->depth + 1u;
+            uint64_t sketch = node->sketch ^ k_sketch_compose((uint64_t)symbol, depth);
+            KDaawgRef child = k_daawg_new_node(graph, depth);
             if (!child) {
                 return -1;
             }
-            child->sketch = node->sketch ^ k_sketch_compose((uint64_t)symbol, node->depth + 1u);
-            edge->target = k_daawg_dedupe(graph, child);
+            k_daawg_node(graph, child)->sketch = sketch;
+            child = k_daawg_dedupe(graph, child);
+            node = k_daawg_node(graph, ref);
+            edge = &k_daawg_edges(graph, node)[slot];
+            edge->target = child;
         }
-        edge->frequency += 1u;
-        node = edge->target;
+        k_daawg_edge_hit(edge);
+        ref = edge->target;
+        node = k_daawg_node(graph, ref);
         if (!node) {
             return -1;
         }
@@ -407,7 +719,124 @@ static int k_daawg_insert(KDaawg *graph, const uint8_t *data, size_t len, uint32
     return 0;
 }
 
-static size_t k_daawg_collect(const KDaawgNode *node, uint8_t *buffer, size_t capacity, size_t depth) {
+/*
+ * Image of a graph for snapshots. Every reference is an arena offset, so the
+ * arena and the dedupe buckets are copied verbatim in both directions; the
+ * checksum covers both and the header, and is checked before anything is
+ * replaced.
+ */
+typedef struct {
+    uint32_t arena_size;
+    KDaawgRef root;
+    uint32_t dedupe_capacity;
+    uint32_t dedupe_count;
+    uint64_t node_count;
+    uint64_t edge_count;
+    uint64_t fragmentation;
+    KDaawgDedupeStats dedupe_stats;
+    uint64_t checksum;
+} KDaawgImage;
+
+static uint64_t k_image_checksum(uint64_t hash, const uint8_t *data, size_t len) {
+    size_t i = 0u;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32u;
+    }
+    for (; i < len; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t k_daawg_image_checksum(const KDaawgImage *image, const uint8_t *arena, const uint8_t *buckets) {
+    KDaawgImage header = *image;
+    header.checksum = 0u;
+    uint64_t hash = k_image_checksum(0xcbf29ce484222325ull, (const uint8_t *)&header, sizeof(header));
+    hash = k_image_checksum(hash, arena, image->arena_size);
+    return k_image_checksum(hash, buckets, (size_t)image->dedupe_capacity * sizeof(KDaawgBucket));
+}
+
+static size_t k_daawg_image_size(const KDaawg *graph) {
+    return sizeof(KDaawgImage) + graph->arena.size + graph->dedupe_capacity * sizeof(KDaawgBucket);
+}
+
+static size_t k_daawg_save_image(const KDaawg *graph, uint8_t *out, size_t capacity) {
+    size_t buckets = graph->dedupe_capacity * sizeof(KDaawgBucket);
+    if (capacity < k_daawg_image_size(graph)) {
+        return 0u;
+    }
+    KDaawgImage image;
+    memset(&image, 0, sizeof(image));
+    image.arena_size = graph->arena.size;
+    image.root = graph->root;
+    image.dedupe_capacity = (uint32_t)graph->dedupe_capacity;
+    image.dedupe_count = (uint32_t)graph->dedupe_count;
+    image.node_count = graph->node_count;
+    image.edge_count = graph->edge_count;
+    image.fragmentation = graph->arena.fragmentation;
+    image.dedupe_stats = graph->dedupe_stats;
+    image.checksum = k_daawg_image_checksum(&image, graph->arena.data, (const uint8_t *)graph->dedupe);
+    memcpy(out, &image, sizeof(image));
+    if (graph->arena.size) {
+        memcpy(out + sizeof(image), graph->arena.data, graph->arena.size);
+    }
+    if (buckets) {
+        memcpy(out + sizeof(image) + graph->arena.size, graph->dedupe, buckets);
+    }
+    return k_daawg_image_size(graph);
+}
+
+/* Returns the bytes consumed, or 0 if the image is damaged or truncated. */
+static size_t k_daawg_load_image(KDaawg *graph, const uint8_t *in, size_t length) {
+    KDaawgImage image;
+    if (length < sizeof(image)) {
+        return 0u;
+    }
+    memcpy(&image, in, sizeof(image));
+    size_t buckets = (size_t)image.dedupe_capacity * sizeof(KDaawgBucket);
+    if (length - sizeof(image) < image.arena_size || length - sizeof(image) - image.arena_size < buckets) {
+        return 0u;
+    }
+    if ((image.root != 0u) != (image.arena_size != 0u) ||
+        (image.root && (image.root > image.arena_size - sizeof(KDaawgNode) || image.arena_size < sizeof(KDaawgNode))) ||
+        (image.dedupe_capacity & (image.dedupe_capacity - 1u)) != 0u || image.dedupe_count > image.dedupe_capacity) {
+        return 0u;
+    }
+    const uint8_t *arena = in + sizeof(image);
+    const uint8_t *table = arena + image.arena_size;
+    if (k_daawg_image_checksum(&image, arena, table) != image.checksum) {
+        return 0u;
+    }
+
+    KDaawgBucket *dedupe = NULL;
+    if (buckets) {
+        dedupe = (KDaawgBucket *)malloc(buckets);
+        if (!dedupe) {
+            return 0u;
+        }
+        memcpy(dedupe, table, buckets);
+    }
+    k_daawg_dispose(graph);
+    k_daawg_init(graph);
+    if (image.arena_size && k_arena_restore(&graph->arena, arena, image.arena_size) != 0) {
+        free(dedupe);
+        return 0u;
+    }
+    graph->root = image.root;
+    graph->dedupe = dedupe;
+    graph->dedupe_capacity = image.dedupe_capacity;
+    graph->dedupe_count = image.dedupe_count;
+    graph->dedupe_stats = image.dedupe_stats;
+    graph->node_count = (size_t)image.node_count;
+    graph->edge_count = (size_t)image.edge_count;
+    graph->arena.fragmentation = (size_t)image.fragmentation;
+    return sizeof(image) + image.arena_size + buckets;
+}
+
+static size_t k_daawg_collect(const KDaawg *graph, const KDaawgNode *node, uint8_t *buffer, size_t capacity, size_t depth) {
     if (!node || !buffer) {
         return 0u;
     }
@@ -415,10 +844,11 @@ static size_t k_daawg_collect(const KDaawgNode *node, uint8_t *buffer, size_t ca
     if (node->boundary_flags && depth < capacity) {
         buffer[length++] = (uint8_t)node->boundary_flags;
     }
+    const KDaawgEdge *edges = k_daawg_edges(graph, node);
     for (uint16_t i = 0; i < node->child_count && length + 9u < capacity; ++i) {
-        const KDaawgEdge *edge = &node->children[i];
-        buffer[length++] = (uint8_t)edge->symbol;
-        uint32_t freq = edge->frequency;
+        const KDaawgEdge *edge = &edges[i];
+        buffer[length++] = (uint8_t)k_daawg_edge_symbol(edge);
+        uint32_t freq = k_daawg_edge_frequency(edge);
         memcpy(buffer + length, &freq, sizeof(uint32_t));
         length += sizeof(uint32_t);
     }
@@ -429,7 +859,7 @@ static size_t k_daawg_generate(const KDaawg *graph, char *output, size_t capacit
     if (!graph->root || capacity == 0u) {
         return 0u;
     }
-    const KDaawgNode *node = graph->root;
+    const KDaawgNode *node = k_daawg_node(graph, graph->root);
     size_t written = 0u;
     double coverage = 0.0;
     double depth = 0.0;
@@ -437,22 +867,22 @@ static size_t k_daawg_generate(const KDaawg *graph, char *output, size_t capacit
     while (written + 1u < capacity && node && node->child_count > 0u) {
         uint32_t best = 0u;
         float best_score = -1.0e9f;
+        const KDaawgEdge *edges = k_daawg_edges(graph, node);
         for (uint16_t i = 0; i < node->child_count; ++i) {
-            const KDaawgEdge *edge = &node->children[i];
-            float base = (float)edge->frequency;
+            float base = (float)k_daawg_edge_frequency(&edges[i]);
             float noise = (k_random_float(rng) - 0.5f) * 0.1f;
-            float score = base + noise + (edge->flags ? 1.0f : 0.0f);
+            float score = base + noise;
             if (score > best_score) {
                 best_score = score;
                 best = i;
             }
         }
-        const KDaawgEdge *edge = &node->children[best];
-        uint8_t symbol = (uint8_t)(edge->symbol & 0xffu);
+        const KDaawgEdge *edge = &edges[best];
+        uint8_t symbol = (uint8_t)k_daawg_edge_symbol(edge);
         output[written++] = (char)symbol;
         coverage += 1.0;
         depth = (double)node->depth;
-        node = edge->target;
+        node = k_daawg_node(graph, edge->target);
         if (node && node->boundary_flags) {
             break;
         }
@@ -600,6 +1030,173 @@ static float k_vm_exec(const KVmProgram *program, const float *ctx, size_t ctx_l
     return sp ? stack[sp - 1u] : 0.0f;
 }
 
+/*
+ * The stack depth after each instruction depends only on the program, so the
+ * lanes share one stack pointer and every instruction is a loop over lanes.
+ */
+static void k_vm_exec_lanes(const KVmProgram *program, const float *ctx, size_t ctx_len, size_t ctx_stride,
+                            size_t count, uint64_t *rng, float *out) {
+    float stack[K_VM_STACK_MAX][K_VM_LANES];
+    size_t sp = 0u;
+    for (uint16_t ip = 0u; ip < program->length && ip < K_VM_PROGRAM_MAX; ++ip) {
+        const KVmInstr *instr = &program->code[ip];
+        float *top = sp ? stack[sp - 1u] : NULL;
+        float *below = sp >= 2u ? stack[sp - 2u] : NULL;
+        switch ((KVmOpcode)instr->opcode) {
+            case K_VM_OP_END:
+                ip = K_VM_PROGRAM_MAX;
+                break;
+            case K_VM_OP_PUSH_CONST:
+                if (sp < K_VM_STACK_MAX) {
+                    for (size_t l = 0; l < count; ++l) {
+                        stack[sp][l] = instr->operand_value;
+                    }
+                    sp++;
+                }
+                break;
+            case K_VM_OP_PUSH_CTX: {
+                uint8_t index = instr->operand_index;
+                if (sp < K_VM_STACK_MAX) {
+                    for (size_t l = 0; l < count; ++l) {
+                        stack[sp][l] = (index < ctx_len) ? ctx[l * ctx_stride + index] : 0.0f;
+                    }
+                    sp++;
+                }
+                break;
+            }
+            case K_VM_OP_ADD:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = below[l] + top[l];
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_SUB:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = below[l] - top[l];
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_MUL:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = below[l] * top[l];
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_DIV:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = top[l] != 0.0f ? below[l] / top[l] : below[l];
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_MIN:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = fminf(below[l], top[l]);
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_MAX:
+                if (below) {
+                    for (size_t l = 0; l < count; ++l) {
+                        below[l] = fmaxf(below[l], top[l]);
+                    }
+                    sp -= 1u;
+                }
+                break;
+            case K_VM_OP_SIGMOID:
+                if (top) {
+                    for (size_t l = 0; l < count; ++l) {
+                        top[l] = k_vm_sigmoid(top[l]);
+                    }
+                }
+                break;
+            case K_VM_OP_TANH:
+                if (top) {
+                    for (size_t l = 0; l < count; ++l) {
+                        top[l] = tanhf(top[l]);
+                    }
+                }
+                break;
+            case K_VM_OP_ABS:
+                if (top) {
+                    for (size_t l = 0; l < count; ++l) {
+                        top[l] = fabsf(top[l]);
+                    }
+                }
+                break;
+            case K_VM_OP_CLAMP01:
+                if (top) {
+                    for (size_t l = 0; l < count; ++l) {
+                        float value = top[l];
+                        top[l] = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+                    }
+                }
+                break;
+            case K_VM_OP_NOISE:
+                if (sp < K_VM_STACK_MAX) {
+                    for (size_t l = 0; l < count; ++l) {
+                        stack[sp][l] = (k_random_float(rng) - 0.5f) * instr->operand_value;
+                    }
+                    sp++;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    for (size_t l = 0; l < count; ++l) {
+        out[l] = sp ? stack[sp - 1u][l] : 0.0f;
+    }
+}
+
+/*
+ * k_vm_exec of one program over count context vectors, ctx_stride floats
+ * apart. Each lane gets the result k_vm_exec would return, except that NOISE
+ * draws one value per lane in lane order.
+ */
+static void k_vm_exec_batch(const KVmProgram *program, const float *ctx, size_t ctx_len, size_t ctx_stride,
+                            size_t count, uint64_t *rng, float *out) {
+    while (count > 0u) {
+        size_t lanes = count < K_VM_LANES ? count : K_VM_LANES;
+        k_vm_exec_lanes(program, ctx, ctx_len, ctx_stride, lanes, rng, out);
+        ctx += lanes * ctx_stride;
+        out += lanes;
+        count -= lanes;
+    }
+}
+
+static bool k_vm_has_noise(const KVmProgram *program) {
+    for (uint16_t ip = 0u; ip < program->length && ip < K_VM_PROGRAM_MAX; ++ip) {
+        if (program->code[ip].opcode == K_VM_OP_NOISE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool k_vm_same_program(const KVmProgram *lhs, const KVmProgram *rhs) {
+    if (lhs->length != rhs->length) {
+        return false;
+    }
+    for (uint16_t ip = 0u; ip < lhs->length && ip < K_VM_PROGRAM_MAX; ++ip) {
+        const KVmInstr *a = &lhs->code[ip];
+        const KVmInstr *b = &rhs->code[ip];
+        if (a->opcode != b->opcode || a->operand_index != b->operand_index || a->operand_value != b->operand_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void k_vm_fill_default(KVmProgram *program, float bias) {
     program->length = 0u;
     program->code[program->length++] = (KVmInstr){ .opcode = K_VM_OP_PUSH_CONST, .operand_value = bias };
@@ -623,6 +1220,23 @@ typedef struct {
     double budget_d;
 } KDigit;
 
+typedef struct {
+    double lambda_b;
+    double lambda_d;
+    double target_b;
+    double target_d;
+    double temperature;
+    int top_k;
+    int cf_beam;
+} KBridgeControls;
+
+/* A token cut by a chunk boundary; bytes past K_MAX_TOKEN are dropped as in k_observe. */
+typedef struct {
+    uint8_t token[K_MAX_TOKEN];
+    uint32_t length;
+    bool active;
+} KObserveStream;
+
 typedef struct {
     KDigit digits[K_DIGIT_COUNT];
     double limit_b;
@@ -631,32 +1245,42 @@ typedef struct {
     double window_d[K_WINDOW];
     uint32_t window_index;
     uint32_t window_size;
+    double sum_b; /* running totals of the windows */
+    double sum_d;
     uint64_t rng_state;
     double transitions[K_DIGIT_COUNT][K_DIGIT_COUNT];
     double usage[K_DIGIT_COUNT];
     KSketch summary_sketch;
+    KBridgeControls controls;
+    KObserveStream stream;
 } KState;
 
-typedef struct {
-    double lambda_b;
-    double lambda_d;
-    double target_b;
-    double target_d;
-    double temperature;
-    int top_k;
-    int cf_beam;
-} KBridgeControls;
+/*
+ * States are addressed by handle, so one module instance and its linear
+ * memory can host many isolated states. A handle is the slot index + 1 in
+ * the low 16 bits and the slot's generation above, so a freed handle stops
+ * resolving once its slot is reused; 0 is never a handle.
+ */
+#define K_STATE_SLOTS_MAX 0xffffu
 
-static KState *g_state = NULL;
-static KBridgeControls g_controls = {
-    .lambda_b = 0.25,
-    .lambda_d = 0.2,
-    .target_b = NAN,
-    .target_d = NAN,
-    .temperature = 0.85,
-    .top_k = 4,
-    .cf_beam = 1,
-};
+typedef struct {
+    KState *state;
+    uint16_t generation;
+} KStateSlot;
+
+static KStateSlot *g_slots = NULL;
+static uint32_t g_slot_count = 0u;
+/* The state behind the handle-less kolibri_bridge_* exports. */
+static uint32_t g_bridge_handle = 0u;
+
+static KState *k_state_lookup(uint32_t handle) {
+    uint32_t slot = handle & 0xffffu;
+    if (slot == 0u || slot > g_slot_count) {
+        return NULL;
+    }
+    const KStateSlot *entry = &g_slots[slot - 1u];
+    return entry->generation == (uint16_t)(handle >> 16u) ? entry->state : NULL;
+}
 
 static void k_digit_init(KDigit *digit, uint32_t seed) {
     k_daawg_init(&digit->graph);
@@ -681,6 +1305,30 @@ static void k_digit_dispose(KDigit *digit) {
     k_daawg_dispose(&digit->graph);
 }
 
+static double k_state_sum_window(const double *values, uint32_t size) {
+    double total = 0.0;
+    uint32_t i = 0u;
+#ifdef K_SIMD
+    v128_t lo = wasm_f64x2_splat(0.0);
+    v128_t hi = wasm_f64x2_splat(0.0);
+    for (; i + 4u <= size; i += 4u) {
+        lo = wasm_f64x2_add(lo, wasm_v128_load(values + i));
+        hi = wasm_f64x2_add(hi, wasm_v128_load(values + i + 2u));
+    }
+    lo = wasm_f64x2_add(lo, hi);
+    total = wasm_f64x2_extract_lane(lo, 0) + wasm_f64x2_extract_lane(lo, 1);
+#endif
+    for (; i < size; ++i) {
+        total += values[i];
+    }
+    return total;
+}
+
+static void k_state_resum_windows(KState *state) {
+    state->sum_b = k_state_sum_window(state->window_b, state->window_size);
+    state->sum_d = k_state_sum_window(state->window_d, state->window_size);
+}
+
 static void k_state_clear_windows(KState *state) {
     for (size_t i = 0; i < K_WINDOW; ++i) {
         state->window_b[i] = 0.0;
@@ -688,31 +1336,34 @@ static void k_state_clear_windows(KState *state) {
     }
     state->window_index = 0u;
     state->window_size = 0u;
+    state->sum_b = 0.0;
+    state->sum_d = 0.0;
 }
 
+/* The totals are updated in place and summed afresh once per lap of the ring,
+ * so rounding drift never outlives K_WINDOW pushes. */
 static void k_state_push_window(KState *state, double b, double d) {
+    uint32_t slot = state->window_index;
     if (state->window_size < K_WINDOW) {
         state->window_size += 1u;
+    } else {
+        state->sum_b -= state->window_b[slot];
+        state->sum_d -= state->window_d[slot];
+    }
+    state->window_b[slot] = b;
+    state->window_d[slot] = d;
+    state->sum_b += b;
+    state->sum_d += d;
+    state->window_index = (slot + 1u) % K_WINDOW;
+    if (state->window_index == 0u) {
+        k_state_resum_windows(state);
     }
-    state->window_b[state->window_index] = b;
-    state->window_d[state->window_index] = d;
-    state->window_index = (state->window_index + 1u) % K_WINDOW;
-}
-
-static double k_state_sum_window(const double *values, uint32_t size) {
-    double total = 0.0;
-    for (uint32_t i = 0u; i < size; ++i) {
-        total += values[i];
-    }
-    return total;
 }
 
 static void k_state_recompute_budgets(KState *state) {
-    double total_b = k_state_sum_window(state->window_b, state->window_size);
-    double total_d = k_state_sum_window(state->window_d, state->window_size);
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        state->digits[i].budget_b = total_b;
-        state->digits[i].budget_d = total_d;
+        state->digits[i].budget_b = state->sum_b;
+        state->digits[i].budget_d = state->sum_d;
     }
 }
 
@@ -730,6 +1381,13 @@ static void k_state_init(KState *state) {
         state->usage[i] = 0.0;
     }
     k_state_clear_windows(state);
+    state->controls.lambda_b = 0.25;
+    state->controls.lambda_d = 0.2;
+    state->controls.target_b = NAN;
+    state->controls.target_d = NAN;
+    state->controls.temperature = 0.85;
+    state->controls.top_k = 4;
+    state->controls.cf_beam = 1;
 }
 
 static void k_state_dispose(KState *state) {
@@ -740,10 +1398,8 @@ static void k_state_dispose(KState *state) {
 
 /* -------------------------- Observation pipeline ------------------------- */
 
-static void k_digit_apply_vm(KDigit *digit, const float *ctx, size_t ctx_len, uint64_t *rng) {
-    digit->energy = k_vm_exec(&digit->vm_g, ctx, ctx_len, rng);
-    digit->phase = k_vm_exec(&digit->vm_d, ctx, ctx_len, rng);
-    digit->weight = 1.0f + k_vm_exec(&digit->vm_v, ctx, ctx_len, rng);
+static void k_digit_set_weight(KDigit *digit, float value) {
+    digit->weight = 1.0f + value;
     if (digit->weight < 0.1f) {
         digit->weight = 0.1f;
     }
@@ -752,6 +1408,12 @@ static void k_digit_apply_vm(KDigit *digit, const float *ctx, size_t ctx_len, ui
     }
 }
 
+static void k_digit_apply_vm(KDigit *digit, const float *ctx, size_t ctx_len, uint64_t *rng) {
+    digit->energy = k_vm_exec(&digit->vm_g, ctx, ctx_len, rng);
+    digit->phase = k_vm_exec(&digit->vm_d, ctx, ctx_len, rng);
+    k_digit_set_weight(digit, k_vm_exec(&digit->vm_v, ctx, ctx_len, rng));
+}
+
 static uint32_t k_token_digit(const char *token, size_t len) {
     if (len == 0u) {
         return 0u;
@@ -778,10 +1440,14 @@ static void k_observe_token(KState *state, const char *token, size_t len) {
     k_state_recompute_budgets(state);
 }
 
+static bool k_is_separator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
 static void k_parse_observation(KState *state, const char *text, size_t len) {
     size_t start = 0u;
     for (size_t i = 0; i <= len; ++i) {
-        bool is_end = i == len || text[i] == ' ' || text[i] == '\n' || text[i] == '\t' || text[i] == '\r';
+        bool is_end = i == len || k_is_separator(text[i]);
         if (!is_end) {
             continue;
         }
@@ -796,40 +1462,158 @@ static void k_parse_observation(KState *state, const char *text, size_t len) {
     }
 }
 
+/*
+ * Tokens that lie wholly inside the chunk are observed in place; only the
+ * one continuing from the previous chunk and the one running past its end
+ * go through the stream buffer.
+ */
+static void k_stream_feed(KState *state, const char *text, size_t len) {
+    KObserveStream *stream = &state->stream;
+    size_t i = 0u;
+    if (stream->length) {
+        while (i < len && !k_is_separator(text[i])) {
+            if (stream->length < K_MAX_TOKEN) {
+                stream->token[stream->length++] = (uint8_t)text[i];
+            }
+            ++i;
+        }
+        if (i == len) {
+            return;
+        }
+        k_observe_token(state, (const char *)stream->token, stream->length);
+        stream->length = 0u;
+    }
+    size_t tail = len;
+    while (tail > i && !k_is_separator(text[tail - 1u])) {
+        --tail;
+    }
+    if (tail > i) {
+        k_parse_observation(state, text + i, tail - 1u - i);
+    }
+    size_t partial = len - tail;
+    if (partial > K_MAX_TOKEN) {
+        partial = K_MAX_TOKEN;
+    }
+    memcpy(stream->token, text + tail, partial);
+    stream->length = (uint32_t)partial;
+}
+
+#define K_DIGIT_CTX 16u
+
+static void k_digit_context(const KState *state, size_t i, float *ctx, uint64_t *rng) {
+    ctx[0] = (float)(state->usage[i]);
+    ctx[1] = (float)(state->digits[i].budget_b);
+    ctx[2] = (float)(state->digits[i].budget_d);
+    ctx[3] = (float)(state->limit_b);
+    ctx[4] = (float)(state->limit_d);
+    ctx[5] = (float)(state->digits[i].energy);
+    ctx[6] = (float)(state->digits[i].phase);
+    ctx[7] = (float)(state->digits[i].weight);
+    ctx[8] = (float)(i);
+    ctx[9] = (float)(state->window_size);
+    ctx[10] = (float)(state->transitions[i][i]);
+    ctx[11] = (float)(state->usage[(i + 1u) % K_DIGIT_COUNT]);
+    ctx[12] = (float)k_random_float(rng);
+    ctx[13] = 1.0f;
+    ctx[14] = (float)(state->digits[i].bias[i]);
+    ctx[15] = (float)(state->digits[i].logits[i]);
+}
+
+static const KVmProgram *k_digit_program(const KDigit *digit, size_t slot) {
+    return slot == 0u ? &digit->vm_g : (slot == 1u ? &digit->vm_d : &digit->vm_v);
+}
+
+/*
+ * Digits that share a program run it as one batch. NOISE would draw in a
+ * different order than the digit-by-digit pass, so any NOISE keeps that pass.
+ */
 static void k_refresh_digit_programs(KState *state) {
-    float ctx[16];
+    bool batch = true;
+    for (size_t i = 0; i < K_DIGIT_COUNT && batch; ++i) {
+        for (size_t slot = 0; slot < 3u; ++slot) {
+            if (k_vm_has_noise(k_digit_program(&state->digits[i], slot))) {
+                batch = false;
+            }
+        }
+    }
+    if (!batch) {
+        float ctx[K_DIGIT_CTX];
+        for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+            k_digit_context(state, i, ctx, &state->rng_state);
+            k_digit_apply_vm(&state->digits[i], ctx, K_DIGIT_CTX, &state->rng_state);
+        }
+        return;
+    }
+
+    float ctx[K_DIGIT_COUNT][K_DIGIT_CTX];
+    for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+        k_digit_context(state, i, ctx[i], &state->rng_state);
+    }
+    float results[3][K_DIGIT_COUNT];
+    for (size_t slot = 0; slot < 3u; ++slot) {
+        bool done[K_DIGIT_COUNT] = { false };
+        for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+            if (done[i]) {
+                continue;
+            }
+            const KVmProgram *program = k_digit_program(&state->digits[i], slot);
+            float lanes[K_DIGIT_COUNT][K_DIGIT_CTX];
+            size_t members[K_DIGIT_COUNT];
+            size_t count = 0u;
+            for (size_t j = i; j < K_DIGIT_COUNT; ++j) {
+                if (!done[j] && k_vm_same_program(program, k_digit_program(&state->digits[j], slot))) {
+                    memcpy(lanes[count], ctx[j], sizeof(ctx[j]));
+                    members[count++] = j;
+                    done[j] = true;
+                }
+            }
+            float out[K_DIGIT_COUNT];
+            k_vm_exec_batch(program, &lanes[0][0], K_DIGIT_CTX, K_DIGIT_CTX, count, &state->rng_state, out);
+            for (size_t m = 0; m < count; ++m) {
+                results[slot][members[m]] = out[m];
+            }
+        }
+    }
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        ctx[0] = (float)(state->usage[i]);
-        ctx[1] = (float)(state->digits[i].budget_b);
-        ctx[2] = (float)(state->digits[i].budget_d);
-        ctx[3] = (float)(state->limit_b);
-        ctx[4] = (float)(state->limit_d);
-        ctx[5] = (float)(state->digits[i].energy);
-        ctx[6] = (float)(state->digits[i].phase);
-        ctx[7] = (float)(state->digits[i].weight);
-        ctx[8] = (float)(i);
-        ctx[9] = (float)(state->window_size);
-        ctx[10] = (float)(state->transitions[i][i]);
-        ctx[11] = (float)(state->usage[(i + 1u) % K_DIGIT_COUNT]);
-        ctx[12] = (float)k_random_float(&state->rng_state);
-        ctx[13] = 1.0f;
-        ctx[14] = (float)(state->digits[i].bias[i]);
-        ctx[15] = (float)(state->digits[i].logits[i]);
-        k_digit_apply_vm(&state->digits[i], ctx, 16u, &state->rng_state);
+        state->digits[i].energy = results[0][i];
+        state->digits[i].phase = results[1][i];
+        k_digit_set_weight(&state->digits[i], results[2][i]);
     }
 }
 
 /* ---------------------------- Resonance voting --------------------------- */
 
+/*
+ * cos(a - b) = cos a cos b + sin a sin b, so each phase needs one cosf and one
+ * sinf and the digit-by-digit sum becomes a multiply-add over the score lanes.
+ */
 static void k_resonance_scores(KState *state, float temperature, int topk, float *scores) {
-    float baseline_phase[K_DIGIT_COUNT];
+    float cos_phase[K_DIGIT_COUNT];
+    float sin_phase[K_DIGIT_COUNT];
+    for (size_t j = 0; j < K_DIGIT_COUNT; ++j) {
+        cos_phase[j] = cosf(state->digits[j].phase);
+        sin_phase[j] = sinf(state->digits[j].phase);
+    }
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        baseline_phase[i] = state->digits[i].phase;
-        for (size_t j = 0; j < K_DIGIT_COUNT; ++j) {
-            float phase_delta = state->digits[i].phase - baseline_phase[j];
-            float resonance = cosf(phase_delta);
-            float logit = state->digits[i].bias[j] + state->digits[i].energy;
-            scores[j] += state->digits[i].weight * logit * resonance;
+        const KDigit *digit = &state->digits[i];
+        size_t j = 0u;
+#ifdef K_SIMD
+        v128_t weight = wasm_f32x4_splat(digit->weight);
+        v128_t energy = wasm_f32x4_splat(digit->energy);
+        v128_t cos_i = wasm_f32x4_splat(cos_phase[i]);
+        v128_t sin_i = wasm_f32x4_splat(sin_phase[i]);
+        for (; j + 4u <= K_DIGIT_COUNT; j += 4u) {
+            v128_t resonance = wasm_f32x4_add(wasm_f32x4_mul(cos_i, wasm_v128_load(cos_phase + j)),
+                                              wasm_f32x4_mul(sin_i, wasm_v128_load(sin_phase + j)));
+            v128_t logit = wasm_f32x4_add(wasm_v128_load(digit->bias + j), energy);
+            v128_t acc = wasm_v128_load(scores + j);
+            wasm_v128_store(scores + j, wasm_f32x4_add(acc, wasm_f32x4_mul(wasm_f32x4_mul(weight, logit), resonance)));
+        }
+#endif
+        for (; j < K_DIGIT_COUNT; ++j) {
+            float resonance = cos_phase[i] * cos_phase[j] + sin_phase[i] * sin_phase[j];
+            float logit = digit->bias[j] + digit->energy;
+            scores[j] += digit->weight * logit * resonance;
         }
     }
     if (temperature <= 0.0f) {
@@ -843,6 +1627,45 @@ static void k_resonance_scores(KState *state, float temperature, int topk, float
     }
 }
 
+/* Index of the largest score; ties go to the lower digit. */
+static uint32_t k_argmax_scores(const float *scores) {
+    uint32_t best = 0u;
+    for (uint32_t j = 1u; j < K_DIGIT_COUNT; ++j) {
+        if (scores[j] > scores[best]) {
+            best = j;
+        }
+    }
+    return best;
+}
+
+/* Fills order with the limit best digits, best first. */
+static void k_rank_scores(const float *scores, uint32_t limit, uint32_t *order) {
+    float work[K_DIGIT_LANES];
+    for (uint32_t j = 0u; j < K_DIGIT_LANES; ++j) {
+        work[j] = j < K_DIGIT_COUNT ? scores[j] : -INFINITY;
+    }
+    for (uint32_t r = 0u; r < limit; ++r) {
+        uint32_t best;
+#ifdef K_SIMD
+        v128_t a = wasm_v128_load(work);
+        v128_t b = wasm_v128_load(work + 4);
+        v128_t c = wasm_v128_load(work + 8);
+        v128_t top = wasm_f32x4_max(wasm_f32x4_max(a, b), c);
+        top = wasm_f32x4_max(top, wasm_i32x4_shuffle(top, top, 2, 3, 0, 1));
+        top = wasm_f32x4_max(top, wasm_i32x4_shuffle(top, top, 1, 0, 3, 2));
+        uint32_t hits = wasm_i32x4_bitmask(wasm_f32x4_eq(a, top)) |
+                        (wasm_i32x4_bitmask(wasm_f32x4_eq(b, top)) << 4) |
+                        (wasm_i32x4_bitmask(wasm_f32x4_eq(c, top)) << 8);
+        /* No lane matches only when a NaN poisoned the maximum. */
+        best = hits ? (uint32_t)__builtin_ctz(hits) : k_argmax_scores(work);
+#else
+        best = k_argmax_scores(work);
+#endif
+        order[r] = best;
+        work[best] = -INFINITY;
+    }
+}
+
 static uint32_t k_select_digit(KState *state, float temperature, int topk) {
     float scores[K_DIGIT_COUNT];
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
@@ -850,24 +1673,12 @@ static uint32_t k_select_digit(KState *state, float temperature, int topk) {
     }
     k_resonance_scores(state, temperature, topk, scores);
 
-    uint32_t order[K_DIGIT_COUNT];
-    for (uint32_t i = 0u; i < K_DIGIT_COUNT; ++i) {
-        order[i] = i;
-    }
-    for (uint32_t i = 0u; i < K_DIGIT_COUNT; ++i) {
-        for (uint32_t j = i + 1u; j < K_DIGIT_COUNT; ++j) {
-            if (scores[order[j]] > scores[order[i]]) {
-                uint32_t tmp = order[i];
-                order[i] = order[j];
-                order[j] = tmp;
-            }
-        }
-    }
-
     uint32_t limit = (uint32_t)(topk < K_MIN_TOPK ? K_MIN_TOPK : topk);
     if (limit > K_DIGIT_COUNT) {
         limit = K_DIGIT_COUNT;
     }
+    uint32_t order[K_DIGIT_COUNT];
+    k_rank_scores(scores, limit, order);
     uint32_t selected = order[0];
     if (limit > 1u) {
         uint32_t idx = k_random_u32(&state->rng_state, limit);
@@ -879,32 +1690,53 @@ static uint32_t k_select_digit(KState *state, float temperature, int topk) {
 /* ----------------------------- API functions ----------------------------- */
 
 EMSCRIPTEN_KEEPALIVE
-KState *k_state_new(void) {
-    if (g_state) {
-        k_state_dispose(g_state);
-        free(g_state);
-        g_state = NULL;
-    }
-    g_state = (KState *)calloc(1u, sizeof(KState));
-    if (!g_state) {
-        return NULL;
+uint32_t k_state_new(void) {
+    uint32_t slot = 0u;
+    while (slot < g_slot_count && g_slots[slot].state) {
+        ++slot;
+    }
+    if (slot == g_slot_count) {
+        if (g_slot_count == K_STATE_SLOTS_MAX) {
+            return 0u;
+        }
+        uint32_t count = g_slot_count ? g_slot_count * 2u : 8u;
+        if (count > K_STATE_SLOTS_MAX) {
+            count = K_STATE_SLOTS_MAX;
+        }
+        KStateSlot *slots = (KStateSlot *)realloc(g_slots, count * sizeof(KStateSlot));
+        if (!slots) {
+            return 0u;
+        }
+        memset(slots + g_slot_count, 0, (count - g_slot_count) * sizeof(KStateSlot));
+        g_slots = slots;
+        g_slot_count = count;
     }
-    k_state_init(g_state);
-    return g_state;
+    KState *state = (KState *)calloc(1u, sizeof(KState));
+    if (!state) {
+        return 0u;
+    }
+    k_state_init(state);
+    g_slots[slot].state = state;
+    return ((uint32_t)g_slots[slot].generation << 16u) | (slot + 1u);
 }
 
 EMSCRIPTEN_KEEPALIVE
-void k_state_free(void) {
-    if (g_state) {
-        k_state_dispose(g_state);
-        free(g_state);
-        g_state = NULL;
+void k_state_free(uint32_t handle) {
+    KState *state = k_state_lookup(handle);
+    if (!state) {
+        return;
     }
+    KStateSlot *entry = &g_slots[(handle & 0xffffu) - 1u];
+    entry->state = NULL;
+    entry->generation++;
+    k_state_dispose(state);
+    free(state);
 }
 
 EMSCRIPTEN_KEEPALIVE
-size_t k_state_save(uint8_t *buffer, size_t capacity) {
-    if (!g_state || !buffer || capacity < sizeof(uint32_t) * 6u) {
+size_t k_state_save(uint32_t handle, uint8_t *buffer, size_t capacity) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !buffer || capacity < sizeof(uint32_t) * 6u) {
         return 0u;
     }
     uint8_t *cursor = buffer;
@@ -916,45 +1748,45 @@ size_t k_state_save(uint8_t *buffer, size_t capacity) {
     memcpy(cursor, &version, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
 
-    double limits[2] = { g_state->limit_b, g_state->limit_d };
+    double limits[2] = { state->limit_b, state->limit_d };
     if ((size_t)(end - cursor) < sizeof(limits)) {
         return 0u;
     }
     memcpy(cursor, limits, sizeof(limits));
     cursor += sizeof(limits);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->usage)) {
+    if ((size_t)(end - cursor) < sizeof(state->usage)) {
         return 0u;
     }
-    memcpy(cursor, g_state->usage, sizeof(g_state->usage));
-    cursor += sizeof(g_state->usage);
+    memcpy(cursor, state->usage, sizeof(state->usage));
+    cursor += sizeof(state->usage);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->transitions)) {
+    if ((size_t)(end - cursor) < sizeof(state->transitions)) {
         return 0u;
     }
-    memcpy(cursor, g_state->transitions, sizeof(g_state->transitions));
-    cursor += sizeof(g_state->transitions);
+    memcpy(cursor, state->transitions, sizeof(state->transitions));
+    cursor += sizeof(state->transitions);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->window_b) + sizeof(g_state->window_d)) {
+    if ((size_t)(end - cursor) < sizeof(state->window_b) + sizeof(state->window_d)) {
         return 0u;
     }
-    memcpy(cursor, g_state->window_b, sizeof(g_state->window_b));
-    cursor += sizeof(g_state->window_b);
-    memcpy(cursor, g_state->window_d, sizeof(g_state->window_d));
-    cursor += sizeof(g_state->window_d);
+    memcpy(cursor, state->window_b, sizeof(state->window_b));
+    cursor += sizeof(state->window_b);
+    memcpy(cursor, state->window_d, sizeof(state->window_d));
+    cursor += sizeof(state->window_d);
 
     if ((size_t)(end - cursor) < sizeof(uint32_t) * 2u + sizeof(uint64_t)) {
         return 0u;
     }
-    memcpy(cursor, &g_state->window_index, sizeof(uint32_t));
+    memcpy(cursor, &state->window_index, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
-    memcpy(cursor, &g_state->window_size, sizeof(uint32_t));
+    memcpy(cursor, &state->window_size, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
-    memcpy(cursor, &g_state->rng_state, sizeof(uint64_t));
+    memcpy(cursor, &state->rng_state, sizeof(uint64_t));
     cursor += sizeof(uint64_t);
 
     for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
-        const KDigit *digit = &g_state->digits[d];
+        const KDigit *digit = &state->digits[d];
         if ((size_t)(end - cursor) < sizeof(digit->bias)) {
             return 0u;
         }
@@ -978,18 +1810,53 @@ size_t k_state_save(uint8_t *buffer, size_t capacity) {
         cursor += sizeof(digit->budget_d);
     }
 
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        const KDigit *digit = &state->digits[d];
+        if ((size_t)(end - cursor) < sizeof(digit->level_sketch)) {
+            return 0u;
+        }
+        memcpy(cursor, digit->level_sketch, sizeof(digit->level_sketch));
+        cursor += sizeof(digit->level_sketch);
+        size_t written = k_daawg_save_image(&digit->graph, cursor, (size_t)(end - cursor));
+        if (written == 0u) {
+            return 0u;
+        }
+        cursor += written;
+    }
+    if ((size_t)(end - cursor) < sizeof(state->summary_sketch)) {
+        return 0u;
+    }
+    memcpy(cursor, &state->summary_sketch, sizeof(state->summary_sketch));
+    cursor += sizeof(state->summary_sketch);
+
     return (size_t)(cursor - buffer);
 }
 
+/* Exact length of what k_state_save writes for this state. */
+EMSCRIPTEN_KEEPALIVE
+size_t k_state_save_size(uint32_t handle) {
+    const KState *state = k_state_lookup(handle);
+    if (!state) {
+        return 0u;
+    }
+    size_t size = sizeof(uint32_t) + sizeof(double) * 2u + sizeof(state->usage) + sizeof(state->transitions) +
+                  sizeof(state->window_b) + sizeof(state->window_d) + sizeof(uint32_t) * 2u + sizeof(uint64_t);
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        const KDigit *digit = &state->digits[d];
+        size += sizeof(digit->bias) + sizeof(float) * 3u + sizeof(double) * 2u;
+        size += sizeof(digit->level_sketch) + k_daawg_image_size(&digit->graph);
+    }
+    return size + sizeof(state->summary_sketch);
+}
+
 EMSCRIPTEN_KEEPALIVE
-int k_state_load(const uint8_t *buffer, size_t length) {
+int k_state_load(uint32_t handle, const uint8_t *buffer, size_t length) {
+    KState *state = k_state_lookup(handle);
     if (!buffer || length < sizeof(uint32_t)) {
         return -1;
     }
-    if (!g_state) {
-        if (!k_state_new()) {
-            return -1;
-        }
+    if (!state) {
+        return -1;
     }
     const uint8_t *cursor = buffer;
     const uint8_t *end = buffer + length;
@@ -997,88 +1864,156 @@ int k_state_load(const uint8_t *buffer, size_t length) {
     uint32_t version = 0u;
     memcpy(&version, cursor, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
-    if (version != K_SAVE_VERSION) {
+    if (version != 1u && version != K_SAVE_VERSION) {
         return -1;
     }
 
     if ((size_t)(end - cursor) < sizeof(double) * 2u) {
         return -1;
     }
-    memcpy(&g_state->limit_b, cursor, sizeof(double));
+    memcpy(&state->limit_b, cursor, sizeof(double));
     cursor += sizeof(double);
-    memcpy(&g_state->limit_d, cursor, sizeof(double));
+    memcpy(&state->limit_d, cursor, sizeof(double));
     cursor += sizeof(double);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->usage)) {
+    if ((size_t)(end - cursor) < sizeof(state->usage)) {
         return -1;
     }
-    memcpy(g_state->usage, cursor, sizeof(g_state->usage));
-    cursor += sizeof(g_state->usage);
+    memcpy(state->usage, cursor, sizeof(state->usage));
+    cursor += sizeof(state->usage);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->transitions)) {
+    if ((size_t)(end - cursor) < sizeof(state->transitions)) {
         return -1;
     }
-    memcpy(g_state->transitions, cursor, sizeof(g_state->transitions));
-    cursor += sizeof(g_state->transitions);
+    memcpy(state->transitions, cursor, sizeof(state->transitions));
+    cursor += sizeof(state->transitions);
 
-    if ((size_t)(end - cursor) < sizeof(g_state->window_b) + sizeof(g_state->window_d)) {
+    if ((size_t)(end - cursor) < sizeof(state->window_b) + sizeof(state->window_d)) {
         return -1;
     }
-    memcpy(g_state->window_b, cursor, sizeof(g_state->window_b));
-    cursor += sizeof(g_state->window_b);
-    memcpy(g_state->window_d, cursor, sizeof(g_state->window_d));
-    cursor += sizeof(g_state->window_d);
+    memcpy(state->window_b, cursor, sizeof(state->window_b));
+    cursor += sizeof(state->window_b);
+    memcpy(state->window_d, cursor, sizeof(state->window_d));
+    cursor += sizeof(state->window_d);
 
     if ((size_t)(end - cursor) < sizeof(uint32_t) * 2u + sizeof(uint64_t)) {
         return -1;
     }
-    memcpy(&g_state->window_index, cursor, sizeof(uint32_t));
+    memcpy(&state->window_index, cursor, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
-    memcpy(&g_state->window_size, cursor, sizeof(uint32_t));
+    memcpy(&state->window_size, cursor, sizeof(uint32_t));
     cursor += sizeof(uint32_t);
-    memcpy(&g_state->rng_state, cursor, sizeof(uint64_t));
+    memcpy(&state->rng_state, cursor, sizeof(uint64_t));
     cursor += sizeof(uint64_t);
+    if (state->window_index >= K_WINDOW || state->window_size > K_WINDOW) {
+        return -1;
+    }
+    k_state_resum_windows(state);
 
     for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
-        if ((size_t)(end - cursor) < sizeof(g_state->digits[d].bias)) {
+        if ((size_t)(end - cursor) < sizeof(state->digits[d].bias)) {
             return -1;
         }
-        memcpy(g_state->digits[d].bias, cursor, sizeof(g_state->digits[d].bias));
-        cursor += sizeof(g_state->digits[d].bias);
+        memcpy(state->digits[d].bias, cursor, sizeof(state->digits[d].bias));
+        cursor += sizeof(state->digits[d].bias);
         if ((size_t)(end - cursor) < sizeof(float) * 3u) {
             return -1;
         }
-        memcpy(&g_state->digits[d].energy, cursor, sizeof(float));
+        memcpy(&state->digits[d].energy, cursor, sizeof(float));
         cursor += sizeof(float);
-        memcpy(&g_state->digits[d].phase, cursor, sizeof(float));
+        memcpy(&state->digits[d].phase, cursor, sizeof(float));
         cursor += sizeof(float);
-        memcpy(&g_state->digits[d].weight, cursor, sizeof(float));
+        memcpy(&state->digits[d].weight, cursor, sizeof(float));
         cursor += sizeof(float);
         if ((size_t)(end - cursor) < sizeof(double) * 2u) {
             return -1;
         }
-        memcpy(&g_state->digits[d].budget_b, cursor, sizeof(double));
+        memcpy(&state->digits[d].budget_b, cursor, sizeof(double));
         cursor += sizeof(double);
-        memcpy(&g_state->digits[d].budget_d, cursor, sizeof(double));
+        memcpy(&state->digits[d].budget_d, cursor, sizeof(double));
         cursor += sizeof(double);
     }
+    if (version == 1u) {
+        return 0;
+    }
+
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        KDigit *digit = &state->digits[d];
+        if ((size_t)(end - cursor) < sizeof(digit->level_sketch)) {
+            return -1;
+        }
+        memcpy(digit->level_sketch, cursor, sizeof(digit->level_sketch));
+        cursor += sizeof(digit->level_sketch);
+        size_t consumed = k_daawg_load_image(&digit->graph, cursor, (size_t)(end - cursor));
+        if (consumed == 0u) {
+            return -1;
+        }
+        cursor += consumed;
+    }
+    if ((size_t)(end - cursor) < sizeof(state->summary_sketch)) {
+        return -1;
+    }
+    memcpy(&state->summary_sketch, cursor, sizeof(state->summary_sketch));
 
     return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
-int k_observe(const uint8_t *data, size_t length) {
-    if (!g_state || !data || length == 0u) {
+int k_observe(uint32_t handle, const uint8_t *data, size_t length) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !data || length == 0u) {
         return -1;
     }
-    k_parse_observation(g_state, (const char *)data, length);
-    k_refresh_digit_programs(g_state);
+    k_parse_observation(state, (const char *)data, length);
+    k_refresh_digit_programs(state);
     return 0;
 }
 
+/*
+ * Streaming k_observe: the chunks between k_observe_begin and k_observe_end
+ * are observed as if concatenated into one k_observe call, with tokens
+ * carried across chunk boundaries.
+ */
 EMSCRIPTEN_KEEPALIVE
-size_t k_decode(const uint8_t *prompt, size_t prompt_len, uint8_t *output, size_t capacity, int temp_q8, int topk) {
-    if (!g_state || !output || capacity == 0u) {
+int k_observe_begin(uint32_t handle) {
+    KState *state = k_state_lookup(handle);
+    if (!state) {
+        return -1;
+    }
+    state->stream.length = 0u;
+    state->stream.active = true;
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int k_observe_chunk(uint32_t handle, const uint8_t *data, size_t length) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !state->stream.active || (!data && length > 0u)) {
+        return -1;
+    }
+    k_stream_feed(state, (const char *)data, length);
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int k_observe_end(uint32_t handle) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !state->stream.active) {
+        return -1;
+    }
+    if (state->stream.length) {
+        k_observe_token(state, (const char *)state->stream.token, state->stream.length);
+        state->stream.length = 0u;
+    }
+    state->stream.active = false;
+    k_refresh_digit_programs(state);
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t k_decode(uint32_t handle, const uint8_t *prompt, size_t prompt_len, uint8_t *output, size_t capacity, int temp_q8, int topk) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !output || capacity == 0u) {
         return 0u;
     }
     float temperature = temp_q8 <= 0 ? 1.0f : (float)temp_q8 / 256.0f;
@@ -1086,50 +2021,52 @@ size_t k_decode(const uint8_t *prompt, size_t prompt_len, uint8_t *output, size_
         temperature = 0.1f;
     }
     if (prompt && prompt_len > 0u) {
-        k_sketch_update(&g_state->summary_sketch, prompt, prompt_len);
+        k_sketch_update(&state->summary_sketch, prompt, prompt_len);
     }
 
-    uint32_t selected = k_select_digit(g_state, temperature, topk);
-    KDigit *digit = &g_state->digits[selected];
+    uint32_t selected = k_select_digit(state, temperature, topk);
+    KDigit *digit = &state->digits[selected];
     double delta_b = 0.0;
     double delta_d = 0.0;
-    size_t produced = k_daawg_generate(&digit->graph, (char *)output, capacity, &delta_b, &delta_d, &g_state->rng_state);
+    size_t produced = k_daawg_generate(&digit->graph, (char *)output, capacity, &delta_b, &delta_d, &state->rng_state);
     if (produced == 0u) {
         return 0u;
     }
-    if (digit->budget_b + delta_b > g_state->limit_b || digit->budget_d + delta_d > g_state->limit_d) {
+    if (digit->budget_b + delta_b > state->limit_b || digit->budget_d + delta_d > state->limit_d) {
         output[0] = '\0';
         return 0u;
     }
-    k_state_push_window(g_state, delta_b, delta_d);
-    k_state_recompute_budgets(g_state);
-    g_state->usage[selected] += 1.0;
+    k_state_push_window(state, delta_b, delta_d);
+    k_state_recompute_budgets(state);
+    state->usage[selected] += 1.0;
     for (size_t j = 0; j < K_DIGIT_COUNT; ++j) {
-        g_state->transitions[selected][j] *= 0.97;
+        state->transitions[selected][j] *= 0.97;
     }
     return produced;
 }
 
 EMSCRIPTEN_KEEPALIVE
-int k_digit_add_syll(uint32_t digit_index, const uint8_t *utf8, size_t length) {
-    if (!g_state || !utf8 || digit_index >= K_DIGIT_COUNT || length == 0u) {
+int k_digit_add_syll(uint32_t handle, uint32_t digit_index, const uint8_t *utf8, size_t length) {
+    KState *state = k_state_lookup(handle);
+    if (!state || !utf8 || digit_index >= K_DIGIT_COUNT || length == 0u) {
         return -1;
     }
     if (length > K_MAX_TOKEN) {
         length = K_MAX_TOKEN;
     }
-    k_daawg_insert(&g_state->digits[digit_index].graph, utf8, length, 1u);
-    k_state_push_window(g_state, (double)length, log2((double)length + 1.0));
-    k_state_recompute_budgets(g_state);
+    k_daawg_insert(&state->digits[digit_index].graph, utf8, length, 1u);
+    k_state_push_window(state, (double)length, log2((double)length + 1.0));
+    k_state_recompute_budgets(state);
     return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
-size_t k_profile(uint32_t query, uint8_t *buffer, size_t capacity) {
+size_t k_profile(uint32_t handle, uint32_t query, uint8_t *buffer, size_t capacity) {
+    KState *state = k_state_lookup(handle);
     if (!buffer || capacity == 0u) {
         return 0u;
     }
-    if (!g_state) {
+    if (!state) {
         const char *empty = "{}";
         size_t len = strlen(empty);
         if (len >= capacity) {
@@ -1140,14 +2077,14 @@ size_t k_profile(uint32_t query, uint8_t *buffer, size_t capacity) {
         return len;
     }
     char scratch[K_MAX_PROFILE];
-    double total_b = k_state_sum_window(g_state->window_b, g_state->window_size);
-    double total_d = k_state_sum_window(g_state->window_d, g_state->window_size);
+    double total_b = state->sum_b;
+    double total_d = state->sum_d;
     int written = snprintf(
         scratch,
         sizeof(scratch),
         "{\n  \"limit_b\": %.3f,\n  \"limit_d\": %.3f,\n  \"budget_b\": %.3f,\n  \"budget_d\": %.3f,\n  \"usage\": [",
-        g_state->limit_b,
-        g_state->limit_d,
+        state->limit_b,
+        state->limit_d,
         total_b,
         total_d);
     if (written < 0) {
@@ -1155,18 +2092,47 @@ size_t k_profile(uint32_t query, uint8_t *buffer, size_t capacity) {
     }
     size_t offset = (size_t)written;
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        written = snprintf(scratch + offset, sizeof(scratch) - offset, "%s%.3f", i ? ", " : "", g_state->usage[i]);
+        written = snprintf(scratch + offset, sizeof(scratch) - offset, "%s%.3f", i ? ", " : "", state->usage[i]);
         if (written < 0) {
             return 0u;
         }
         offset += (size_t)written;
     }
+    size_t graph_bytes = 0u;
+    size_t dedupe_count = 0u;
+    size_t dedupe_capacity = 0u;
+    KDaawgDedupeStats dedupe = { 0u, 0u, 0u, 0u, 0u, 0u };
+    for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+        const KDaawg *graph = &state->digits[i].graph;
+        graph_bytes += graph->arena.size;
+        dedupe_count += graph->dedupe_count;
+        dedupe_capacity += graph->dedupe_capacity;
+        dedupe.lookups += graph->dedupe_stats.lookups;
+        dedupe.probes += graph->dedupe_stats.probes;
+        dedupe.grows += graph->dedupe_stats.grows;
+        dedupe.merged += graph->dedupe_stats.merged;
+        dedupe.pruned += graph->dedupe_stats.pruned;
+        if (graph->dedupe_stats.max_probe > dedupe.max_probe) {
+            dedupe.max_probe = graph->dedupe_stats.max_probe;
+        }
+    }
     written = snprintf(
         scratch + offset,
         sizeof(scratch) - offset,
-        "],\n  \"window\": %u,\n  \"fragmentation\": %zu\n}\n",
-        g_state->window_size,
-        g_state->digits[0].graph.arena.fragmentation + g_state->digits[1].graph.arena.fragmentation);
+        "],\n  \"window\": %u,\n  \"graph_bytes\": %zu,\n  \"fragmentation\": %zu,\n"
+        "  \"dedupe\": {\"entries\": %zu, \"capacity\": %zu, \"lookups\": %llu, \"avg_probe\": %.3f, "
+        "\"max_probe\": %u, \"grows\": %u, \"merged\": %llu, \"pruned\": %llu}\n}\n",
+        state->window_size,
+        graph_bytes,
+        state->digits[0].graph.arena.fragmentation + state->digits[1].graph.arena.fragmentation,
+        dedupe_count,
+        dedupe_capacity,
+        (unsigned long long)dedupe.lookups,
+        dedupe.lookups ? (double)dedupe.probes / (double)dedupe.lookups : 0.0,
+        dedupe.max_probe,
+        dedupe.grows,
+        (unsigned long long)dedupe.merged,
+        (unsigned long long)dedupe.pruned);
     if (written < 0) {
         return 0u;
     }
@@ -1181,15 +2147,69 @@ size_t k_profile(uint32_t query, uint8_t *buffer, size_t capacity) {
 
 /* ---------------------- Compatibility bridge exports --------------------- */
 
+/*
+ * The *_handle exports work on any state from k_state_new. The handle-less
+ * ones keep the single-state bridge working on a state of their own, which
+ * kolibri_bridge_handle exposes to the k_* exports.
+ */
+
 EMSCRIPTEN_KEEPALIVE
 int kolibri_bridge_init(void) {
-    return k_state_new() ? 0 : -1;
+    k_state_free(g_bridge_handle);
+    g_bridge_handle = k_state_new();
+    return g_bridge_handle ? 0 : -1;
 }
 
 EMSCRIPTEN_KEEPALIVE
 int kolibri_bridge_reset(void) {
-    k_state_free();
-    return k_state_new() ? 0 : -1;
+    return kolibri_bridge_init();
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t kolibri_bridge_handle(void) {
+    if (!k_state_lookup(g_bridge_handle) && kolibri_bridge_init() != 0) {
+        return 0u;
+    }
+    return g_bridge_handle;
+}
+
+/* Clears a state in place; its handle stays valid. */
+EMSCRIPTEN_KEEPALIVE
+int kolibri_bridge_reset_handle(uint32_t handle) {
+    KState *state = k_state_lookup(handle);
+    if (!state) {
+        return -1;
+    }
+    k_state_dispose(state);
+    memset(state, 0, sizeof(*state));
+    k_state_init(state);
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int kolibri_bridge_configure_handle(uint32_t handle,
+                                    int lambda_b_milli,
+                                    int lambda_d_milli,
+                                    int target_b_milli,
+                                    int target_d_milli,
+                                    int temperature_milli,
+                                    int top_k,
+                                    int enable_cf_beam) {
+    KState *state = k_state_lookup(handle);
+    if (!state) {
+        return -1;
+    }
+
+    KBridgeControls *controls = &state->controls;
+    controls->lambda_b = (double)lambda_b_milli / 1000.0;
+    controls->lambda_d = (double)lambda_d_milli / 1000.0;
+    controls->target_b = target_b_milli < 0 ? NAN : (double)target_b_milli / 1000.0;
+    controls->target_d = target_d_milli < 0 ? NAN : (double)target_d_milli / 1000.0;
+    controls->temperature = (double)temperature_milli / 100.0;
+    controls->top_k = top_k > 0 ? top_k : 1;
+    controls->cf_beam = enable_cf_beam ? 1 : 0;
+
+    return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -1200,34 +2220,22 @@ int kolibri_bridge_configure(int lambda_b_milli,
                              int temperature_milli,
                              int top_k,
                              int enable_cf_beam) {
-    if (!g_state) {
-        if (!k_state_new()) {
-            return -1;
-        }
-    }
-
-    g_controls.lambda_b = (double)lambda_b_milli / 1000.0;
-    g_controls.lambda_d = (double)lambda_d_milli / 1000.0;
-    g_controls.target_b = target_b_milli < 0 ? NAN : (double)target_b_milli / 1000.0;
-    g_controls.target_d = target_d_milli < 0 ? NAN : (double)target_d_milli / 1000.0;
-    g_controls.temperature = (double)temperature_milli / 100.0;
-    g_controls.top_k = top_k > 0 ? top_k : 1;
-    g_controls.cf_beam = enable_cf_beam ? 1 : 0;
-
-    return 0;
+    return kolibri_bridge_configure_handle(kolibri_bridge_handle(),
+                                           lambda_b_milli,
+                                           lambda_d_milli,
+                                           target_b_milli,
+                                           target_d_milli,
+                                           temperature_milli,
+                                           top_k,
+                                           enable_cf_beam);
 }
 
 EMSCRIPTEN_KEEPALIVE
-int kolibri_bridge_execute(const uint8_t *program, uint8_t *buffer, size_t capacity) {
-    if (!program || !buffer || capacity == 0u) {
+int kolibri_bridge_execute_handle(uint32_t handle, const uint8_t *program, uint8_t *buffer, size_t capacity) {
+    if (!program || !buffer || capacity == 0u || !k_state_lookup(handle)) {
         return -1;
     }
-    if (!g_state) {
-        if (!k_state_new()) {
-            return -1;
-        }
-    }
-    size_t produced = k_decode(program, strlen((const char *)program), buffer, capacity, 256, 3);
+    size_t produced = k_decode(handle, program, strlen((const char *)program), buffer, capacity, 256, 3);
     if (produced == 0u) {
         buffer[0] = '\0';
         return 0;
@@ -1235,6 +2243,14 @@ int kolibri_bridge_execute(const uint8_t *program, uint8_t *buffer, size_t capac
     return (int)produced;
 }
 
+EMSCRIPTEN_KEEPALIVE
+int kolibri_bridge_execute(const uint8_t *program, uint8_t *buffer, size_t capacity) {
+    if (!program || !buffer || capacity == 0u) {
+        return -1;
+    }
+    return kolibri_bridge_execute_handle(kolibri_bridge_handle(), program, buffer, capacity);
+}
+
 
 EMSCRIPTEN_KEEPALIVE
 int kolibri_bridge_has_simd(void) {